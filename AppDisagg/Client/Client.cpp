@@ -4,6 +4,7 @@
  */
 
 #include <cstdlib>
+#include <climits>
 #include <winsock2.h>
 #include <iostream>
 #include <thread>
@@ -12,9 +13,15 @@
 #include <windows.h>
 #include <tchar.h>
 #include <random>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 
 #include "../Common/Include/Config.h"
-#include "../Common/Include/LatencyHelpers.h"
+#include "../Common/Include/HdrHistogram.h"
+#include "../Common/Include/Workload.h"
+#include "../../Common/Include/DDSTrace.h"
 #include "Client.h"
 
 #pragma comment(lib,"ws2_32.lib")
@@ -33,481 +40,626 @@ int* FILEID;
 int FILENUM;
 uint64_t FILE_SIZE;
 
-int RunClientForLatency(
-    int MessageSize,
-    int BatchSize,
-    int QueueDepth,
-    uint64_t ReadNum,
-    int Port
-) {
-    //
-    // Initialize Winsock
-    //
-    //
-    WSADATA wsaData;
-    int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (iResult != 0) {
-        cout << "WSAStartup failed with error: " << iResult << endl;
-        return 1;
-    }
+//
+// Latencies are recorded in nanoseconds, up to a minute, to 3 significant digits
+//
+//
+#define LATENCY_HIGHEST_TRACKABLE_NS (60ULL * 1000 * 1000 * 1000)
+#define LATENCY_SIGNIFICANT_DIGITS 3
+#define LATENCY_HGRM_PATH "client_latency.hgrm"
+
+//
+// 1 in CLIENT_TRACE_SAMPLE_EVERY requests is traced end to end, 0 traces none
+//
+//
+#define CLIENT_TRACE_SAMPLE_EVERY DDS_TRACE_SAMPLE_EVERY_DEFAULT
+#define CLIENT_TRACE_PATH "client_trace.csv"
+
+//
+// The trace state of a connection: requests are sent and received on different threads in the open loop,
+// so each has its own ring; a trace id is the run, the connection, and the sequence of the request
+//
+//
+struct ConnectionTrace {
+    DDSTraceRingT* SendRing;
+    DDSTraceRingT* RecvRing;
+    uint64_t IdBase;
+    uint64_t Seq;
+};
 
-    //
-    // Create a socket for the client
-    //
-    //
-    SOCKET clientSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (clientSocket == INVALID_SOCKET) {
-        cout << "Error creating socket: " << WSAGetLastError() << endl;
-        WSACleanup();
-        return 1;
-    }
+//
+// Hedging: a batch of reads that has been outstanding for longer than the HedgePercentile-th percentile
+// of the latencies of its connection is sent to the replica as well. The percentile is taken every
+// HEDGE_DELAY_UPDATE_BATCHES batches, once HEDGE_MIN_SAMPLES requests have completed
+//
+//
+#define HEDGE_MIN_SAMPLES 1000
+#define HEDGE_DELAY_UPDATE_BATCHES 64
+
+//
+// The connection to the replica of a connection that hedges its reads, and what hedging did
+//
+//
+struct ReplicaConnection {
+    SOCKET Socket;
+    char* RecvBuffer;
+    double HedgePercentile;
+    uint64_t HedgedBatches;
+    uint64_t Wins;
+};
 
-    //
-    // set socket to no delay, sends out packet without coalescing
-    //
-    //
-    int noDelay = 1;
-    iResult = setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char*) &noDelay, sizeof(noDelay));
-    if (iResult) {
-        printf("set TCP_NODELAY failed: %d\n", WSAGetLastError());
-    }
+//
+// The requests of a connection that hedges: a response is taken only if it is the first of its request
+//
+//
+struct HedgeState {
+    atomic_uint8_t* Completed;
+    uint64_t NumRequests;
+};
 
-    //
-    // Set up the address of the client
-    //
-    //
-    sockaddr_in clientAddr;
-    clientAddr.sin_family = AF_INET;
-    clientAddr.sin_port = htons(Port);
-    clientAddr.sin_addr.s_addr = inet_addr(CLIENT_IP);
+//
+// A batch outstanding on the primary: Tag is its index in the run plus 1, or 0 if its batch id is free,
+// and Due is when it was due
+//
+//
+struct InFlightBatch {
+    atomic_uint64_t Tag;
+    atomic_llong Due;
+};
 
-    // Set up the address of the server
-    sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(SERVER_PORT);
-    serverAddr.sin_addr.s_addr = inet_addr(SERVER_IP);
+//
+// Print the latencies of a histogram in microseconds
+//
+//
+void PrintLatencies(
+    const HdrHistogram* Latencies
+) {
+    printf(
+        "Min: %.2lf, Max: %.2lf, Mean: %.2lf, 50th: %.2lf, 90th: %.2lf, 99th: %.2lf, 99.9th: %.2lf, 99.99th: %.2lf, StdDev: %.2lf\n",
+        Latencies->Min() / 1000.0,
+        Latencies->Max() / 1000.0,
+        Latencies->Mean() / 1000.0,
+        Latencies->ValueAtPercentile(50.0) / 1000.0,
+        Latencies->ValueAtPercentile(90.0) / 1000.0,
+        Latencies->ValueAtPercentile(99.0) / 1000.0,
+        Latencies->ValueAtPercentile(99.9) / 1000.0,
+        Latencies->ValueAtPercentile(99.99) / 1000.0,
+        Latencies->StandardDeviation() / 1000.0);
+}
 
-    cout << "Connecting to the server..." << endl;
+//
+// Send all bytes of a buffer, in packets of at most SEND_PACKET_SIZE
+//
+//
+bool SendAll(
+    SOCKET Socket,
+    const char* Buffer,
+    int Length
+) {
+    int oneSend = 0;
+    while (oneSend < Length) {
+        int actualBytesToSend = Length - oneSend > SEND_PACKET_SIZE ? SEND_PACKET_SIZE : Length - oneSend;
+        int iResult = send(Socket, Buffer + oneSend, actualBytesToSend, 0);
+        if (iResult == SOCKET_ERROR) {
+            cout << "Error sending message: " << WSAGetLastError() << endl;
+            return false;
+        }
+        oneSend += iResult;
+    }
+    return true;
+}
 
-    //
-    // Connect to the server
-    //
-    //
-    iResult = connect(clientSocket, (SOCKADDR*)&serverAddr, sizeof(serverAddr));
-    if (iResult == SOCKET_ERROR) {
-        cout << "Unable to connect to server: " << WSAGetLastError() << endl;
-        closesocket(clientSocket);
-        WSACleanup();
-        return 1;
+//
+// Receive exactly Length bytes
+//
+//
+bool RecvAll(
+    SOCKET Socket,
+    char* Buffer,
+    int Length
+) {
+    int oneReceive = 0;
+    while (oneReceive < Length) {
+        int iResult = recv(Socket, Buffer + oneReceive, Length - oneReceive, 0);
+        if (iResult == SOCKET_ERROR || iResult == 0) {
+            cout << "Error receiving message: " << WSAGetLastError() << endl;
+            return false;
+        }
+        oneReceive += iResult;
     }
+    return true;
+}
 
-    cout << "Preparing message buffers..." << endl;
+//
+// Build a batch of requests into the send buffer and return its size:
+// every request is a header, followed by the data of a write;
+// the requests have the ids from FirstRequestId, and are not traced without Trace
+//
+//
+int BuildBatch(
+    char* SendBuffer,
+    const WorkloadRequest* Requests,
+    int BatchSize,
+    uint16_t BatchId,
+    uint64_t FirstRequestId,
+    long long TimeSend,
+    const char* Content,
+    ConnectionTrace* Trace
+) {
+    int size = 0;
+    for (int i = 0; i != BatchSize; i++) {
+        MessageHeader* hdr = (MessageHeader*)(SendBuffer + size);
+        hdr->TimeSend = TimeSend;
+        hdr->TraceId = 0;
+        if (Trace != NULL) {
+            uint64_t seq = Trace->Seq++;
+            hdr->TraceId = DDSTraceSampled(seq, CLIENT_TRACE_SAMPLE_EVERY) ? Trace->IdBase | (seq & 0xffffffffULL) : 0;
+            DDSTraceRecord(Trace->SendRing, hdr->TraceId, DDS_TRACE_HOP_CLIENT_SEND, BatchId);
+        }
+        hdr->RequestId = FirstRequestId + i;
+        hdr->BatchId = BatchId;
+        hdr->FileId = Requests[i].FileId;
+        hdr->Op = Requests[i].Op;
+        hdr->Offset = Requests[i].Offset;
+        hdr->Length = Requests[i].Length;
+        size += sizeof(MessageHeader);
+        if (Requests[i].Op == MESSAGE_OP_WRITE) {
+            memcpy(SendBuffer + size, Content, Requests[i].Length);
+            size += Requests[i].Length;
+        }
+    }
+    return size;
+}
 
-    // Send message to the server and receive response
+//
+// Receive the responses of a batch, each a header, followed by the data of a read, and record their latencies
+// in nanoseconds;
+// the batch id of the responses is returned in BatchId. With Hedge, the responses of requests
+// that another server has answered first are dropped; without Trace, no hop is traced
+//
+//
+bool ReceiveBatch(
+    SOCKET Socket,
+    char* RecvBuffer,
+    int BatchSize,
+    int QueueDepth,
+    HdrHistogram* Latencies,
+    uint16_t* BatchId,
+    uint64_t* BytesCompleted,
+    ConnectionTrace* Trace,
+    HedgeState* Hedge
+) {
     const int HeaderSize = sizeof(MessageHeader);
+    MessageHeader hdr;
 
-    char* sendBuffer = new char[HeaderSize*BatchSize];
-    memset(sendBuffer, 0, HeaderSize);
-    MessageHeader* hdr;
     for (int i = 0; i != BatchSize; i++) {
-        hdr = (MessageHeader*)(sendBuffer+i*HeaderSize);
-        hdr->Length = MessageSize;
-    }
-    int TOTAL_MESSAGE_SIZE = (HeaderSize + MessageSize)*BatchSize;
-    char* recvBuffer = new char[TOTAL_MESSAGE_SIZE];
-    memset(recvBuffer, 0, TOTAL_MESSAGE_SIZE);
+        if (!RecvAll(Socket, (char*)&hdr, HeaderSize)) {
+            return false;
+        }
+        int dataSize = hdr.Op == MESSAGE_OP_READ ? hdr.Length : 0;
+        if (dataSize != 0 && !RecvAll(Socket, RecvBuffer, dataSize)) {
+            return false;
+        }
+        if (hdr.BatchId >= QueueDepth) {
+            cerr << "ERROR: got wrong batchId from server: " << hdr.BatchId << endl;
+        }
+        *BatchId = hdr.BatchId;
+        if (Hedge != NULL) {
+            if (hdr.RequestId >= Hedge->NumRequests) {
+                cerr << "ERROR: got wrong requestId from server: " << hdr.RequestId << endl;
+                return false;
+            }
+            if (Hedge->Completed[hdr.RequestId].exchange(1)) {
+                continue;
+            }
+        }
+        if (Trace != NULL) {
+            DDSTraceRecord(Trace->RecvRing, hdr.TraceId, DDS_TRACE_HOP_CLIENT_RECV, hdr.BatchId);
+        }
 
-    double* latencies = new double[ReadNum];
-    for (int l = 0; l != ReadNum; l++) {
-        latencies[l] = 0;
+        //
+        // diff is the time in nanosecond since the request was due
+        //
+        //
+        long long diff = high_resolution_clock::now().time_since_epoch().count() - hdr.TimeSend;
+        Latencies->Record(diff > 0 ? (uint64_t)diff : 0);
+        *BytesCompleted += HeaderSize + dataSize;
     }
+    return true;
+}
 
-    //
-    //Prepare FileId and offset for each request
-    // 
-    // 
-    uint16_t* FileIds = new uint16_t[ReadNum];
-    uint64_t* Offsets = new uint64_t[ReadNum];
-    std::random_device rd;
-    std::mt19937_64 eng(rd());
-    std::uniform_int_distribution<uint64_t> distr;
+//
+// Run the workload of a connection in a closed loop: QueueDepth batches are outstanding,
+// and a batch is sent as soon as one completes
+//
+//
+bool RunClosedLoop(
+    int BatchSize,
+    const uint64_t ReadNum,
+    const int QueueDepth,
+    SOCKET* ClientSocket,
+    char* SendBuffer,
+    char* RecvBuffer,
+    const WorkloadRequest* Requests,
+    HdrHistogram* Latencies,
+    uint64_t* BytesCompleted,
+    const char* Content,
+    ConnectionTrace* Trace
+) {
+    const uint64_t batchNum = ReadNum / BatchSize;
+    uint64_t msgIndex = 0;
+    uint16_t batchId;
 
-    for (int l = 0; l != ReadNum; l++) {
-        FileIds[l] = FILEID[rand() % FILENUM];
-        uint64_t randomValue = distr(eng);
-        randomValue %= (FILE_SIZE - MessageSize - 1);
-        // ensure offset is sector size aligned
-        randomValue = (randomValue / SECTOR_SIZE) * SECTOR_SIZE;
-        Offsets[l] = randomValue;
+    for (uint64_t q = 0; q != QueueDepth && msgIndex < batchNum; q++) {
+        int size = BuildBatch(SendBuffer, Requests + msgIndex * BatchSize, BatchSize, (uint16_t)q, msgIndex * BatchSize,
+            high_resolution_clock::now().time_since_epoch().count(), Content, Trace);
+        msgIndex++;
+        if (!SendAll(*ClientSocket, SendBuffer, size)) {
+            return false;
+        }
     }
 
-    cout << "Starting measurement..." << endl;
+    for (uint64_t respIndex = 0; respIndex != batchNum; respIndex++) {
+        if (!ReceiveBatch(*ClientSocket, RecvBuffer, BatchSize, QueueDepth, Latencies,
+            &batchId, BytesCompleted, Trace, NULL)) {
+            return false;
+        }
 
-    int firstMsg = HeaderSize * BatchSize;
-    iResult = send(clientSocket, (const char*)&firstMsg, sizeof(int), 0);
-    if (iResult == SOCKET_ERROR || iResult != sizeof(int)) {
-        cout << "Error sending the first message: " << WSAGetLastError() << endl;
-        closesocket(clientSocket);
-        WSACleanup();
-        return 1;
+        if (msgIndex < batchNum) {
+            int size = BuildBatch(SendBuffer, Requests + msgIndex * BatchSize, BatchSize, batchId, msgIndex * BatchSize,
+                high_resolution_clock::now().time_since_epoch().count(), Content, Trace);
+            msgIndex++;
+            if (!SendAll(*ClientSocket, SendBuffer, size)) {
+                return false;
+            }
+        }
     }
+    return true;
+}
 
-    uint64_t bytesCompleted = 0;
-    uint64_t bytesSent = 0;
-
-    auto startTime = high_resolution_clock::now().time_since_epoch().count(); // measure start time
-
-    int oneSend = 0;
-    int remainingBytesToSend = HeaderSize;
-    int actualBytesToSend;
-
-    uint64_t msgIndex = 0;
-
-    for (uint64_t q = 0; q != QueueDepth; q++) {
-        //batch size
-        for (int i = 0; i != BatchSize; i++) {
-            hdr = (MessageHeader*)(sendBuffer + i * HeaderSize);
-            hdr->TimeSend = high_resolution_clock::now().time_since_epoch().count();
-            hdr->BatchId = (uint16_t)q;
-            hdr->FileId = FileIds[msgIndex * BatchSize + i];
-            hdr->Offset = Offsets[msgIndex * BatchSize + i];
+//
+// Run the workload of a connection in an open loop: batches are sent on a schedule of RateRps requests per second,
+// with Poisson or constant gaps, whether or not earlier ones completed; the receiver runs on this thread and the sender
+// on its own, so a slow response never delays the schedule. At most QueueDepth batches are outstanding, as the server
+// has a slot for no more, so a batch due when all are taken waits for one; its latency is from when it was due,
+// not sent, which keeps the wait in the measurement instead of omitting it.
+// With Replica, a hedger thread sends the batches of reads that are late to the replica, which has QueueDepth slots
+// of its own, and a thread receives its responses; the primary still answers every batch, which frees its slot,
+// and each request takes the first of its responses
+//
+//
+bool RunOpenLoop(
+    int BatchSize,
+    const uint64_t ReadNum,
+    const int QueueDepth,
+    double RateRps,
+    bool PoissonArrivals,
+    uint64_t Seed,
+    SOCKET* ClientSocket,
+    char* SendBuffer,
+    char* RecvBuffer,
+    const WorkloadRequest* Requests,
+    HdrHistogram* Latencies,
+    uint64_t* BytesCompleted,
+    const char* Content,
+    uint64_t* LateBatches,
+    ConnectionTrace* Trace,
+    ReplicaConnection* Replica
+) {
+    const uint64_t batchNum = ReadNum / BatchSize;
+    vector<uint16_t> freeBatchIds;
+    mutex freeMutex;
+    condition_variable freeCond;
+    atomic_bool failed = false;
+
+    HedgeState hedge = { NULL, batchNum * BatchSize };
+    HedgeState* hedgeState = NULL;
+    InFlightBatch* inFlight = NULL;
+    atomic_uint64_t hedgeDelayNs = 0;
+    vector<uint16_t> replicaFreeBatchIds;
+    mutex replicaMutex;
+    condition_variable replicaCond;
+    uint64_t replicaInFlight = 0;
+    bool hedgerDone = false;
+    atomic_bool stopHedging = false;
+    atomic_bool replicaFailed = false;
+    HdrHistogram replicaLatencies(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+    uint64_t replicaBytesCompleted = 0;
+    thread hedger;
+    thread replicaReceiver;
+
+    for (int q = QueueDepth - 1; q >= 0; q--) {
+        freeBatchIds.push_back((uint16_t)q);
+    }
 
+    if (Replica != NULL) {
+        hedge.Completed = new atomic_uint8_t[hedge.NumRequests];
+        for (uint64_t r = 0; r != hedge.NumRequests; r++) {
+            hedge.Completed[r] = 0;
         }
-        msgIndex++;
-        while (oneSend < HeaderSize * BatchSize) {
-            actualBytesToSend = remainingBytesToSend > SEND_PACKET_SIZE ? SEND_PACKET_SIZE : remainingBytesToSend;
-            iResult = send(clientSocket, sendBuffer + oneSend, actualBytesToSend, 0);
-            if (iResult == SOCKET_ERROR) {
-                cout << "Error sending message: " << WSAGetLastError() << endl;
-                closesocket(clientSocket);
-                WSACleanup();
-                return 1;
+        hedgeState = &hedge;
+        inFlight = new InFlightBatch[QueueDepth];
+        for (int q = QueueDepth - 1; q >= 0; q--) {
+            inFlight[q].Tag = 0;
+            inFlight[q].Due = 0;
+            replicaFreeBatchIds.push_back((uint16_t)q);
+        }
+
+        hedger = thread([&] {
+            char* hedgeBuffer = new char[sizeof(MessageHeader) * BatchSize];
+            vector<uint64_t> hedgedTags(QueueDepth, 0);
+
+            while (!stopHedging && !replicaFailed) {
+                uint64_t delay = hedgeDelayNs.load(memory_order_relaxed);
+                long long now = high_resolution_clock::now().time_since_epoch().count();
+
+                for (int q = 0; delay != 0 && q != QueueDepth; q++) {
+                    uint64_t tag = inFlight[q].Tag.load(memory_order_acquire);
+                    long long due = inFlight[q].Due.load(memory_order_relaxed);
+                    if (tag == 0 || hedgedTags[q] == tag || now - due < (long long)delay) {
+                        continue;
+                    }
+
+                    //
+                    // Writes are never sent twice, and a batch already answered needs no hedge
+                    //
+                    //
+                    const WorkloadRequest* requests = Requests + (tag - 1) * BatchSize;
+                    bool reads = hedge.Completed[(tag - 1) * BatchSize].load(memory_order_relaxed) == 0;
+                    for (int i = 0; reads && i != BatchSize; i++) {
+                        reads = requests[i].Op == MESSAGE_OP_READ;
+                    }
+                    if (!reads) {
+                        hedgedTags[q] = tag;
+                        continue;
+                    }
+
+                    uint16_t replicaBatchId;
+                    {
+                        lock_guard<mutex> lock(replicaMutex);
+                        if (replicaFreeBatchIds.empty()) {
+                            break;
+                        }
+                        replicaBatchId = replicaFreeBatchIds.back();
+                        replicaFreeBatchIds.pop_back();
+                        replicaInFlight++;
+                    }
+                    hedgedTags[q] = tag;
+
+                    int size = BuildBatch(hedgeBuffer, requests, BatchSize, replicaBatchId, (tag - 1) * BatchSize,
+                        due, NULL, NULL);
+                    if (!SendAll(Replica->Socket, hedgeBuffer, size)) {
+                        replicaFailed = true;
+                        shutdown(Replica->Socket, SD_BOTH);
+                        break;
+                    }
+                    Replica->HedgedBatches++;
+                    replicaCond.notify_one();
+                }
+                std::this_thread::yield();
             }
 
-            oneSend += iResult;
-            remainingBytesToSend = HeaderSize * BatchSize - oneSend;
-        }
+            delete[] hedgeBuffer;
+            lock_guard<mutex> lock(replicaMutex);
+            hedgerDone = true;
+            replicaCond.notify_one();
+        });
+
+        replicaReceiver = thread([&] {
+            for (;;) {
+                {
+                    unique_lock<mutex> lock(replicaMutex);
+                    replicaCond.wait(lock, [&] { return replicaInFlight != 0 || hedgerDone; });
+                    if (replicaInFlight == 0) {
+                        return;
+                    }
+                }
 
-        bytesSent += oneSend;
+                uint16_t batchId;
+                if (!ReceiveBatch(Replica->Socket, Replica->RecvBuffer, BatchSize, QueueDepth, &replicaLatencies,
+                    &batchId, &replicaBytesCompleted, NULL, &hedge)) {
+                    replicaFailed = true;
+                    shutdown(Replica->Socket, SD_BOTH);
+                    return;
+                }
 
-        oneSend = 0;
-        remainingBytesToSend = HeaderSize * BatchSize;
+                lock_guard<mutex> lock(replicaMutex);
+                replicaInFlight--;
+                replicaFreeBatchIds.push_back(batchId);
+            }
+        });
     }
 
-    int oneReceive = 0;
-    int remainingBytesToReceive = TOTAL_MESSAGE_SIZE;
-    uint64_t RespIndex = 0;
-
-    while (true) {
-        //
-        // receive one message
-        //
-        //
-        while (oneReceive < TOTAL_MESSAGE_SIZE) {
-            iResult = recv(clientSocket, recvBuffer + oneReceive, remainingBytesToReceive, 0);
+    thread sender([&] {
+        mt19937_64 eng(Seed);
+        exponential_distribution<double> interArrival(RateRps / BatchSize);
+        const double constantGap = BatchSize / RateRps;
+        auto start = high_resolution_clock::now();
+        auto due = start;
+        double dueSeconds = 0;
+
+        for (uint64_t msgIndex = 0; msgIndex != batchNum && !failed; msgIndex++) {
+            //
+            // The schedule is kept in seconds from the start, so rounding doesn't drift it
+            //
+            //
+            dueSeconds += PoissonArrivals ? interArrival(eng) : constantGap;
+            due = start + duration_cast<high_resolution_clock::duration>(duration<double>(dueSeconds));
+            while (high_resolution_clock::now() < due) {
+                std::this_thread::yield();
+            }
 
-            if (iResult == SOCKET_ERROR) {
-                cout << "Error receiving message: " << WSAGetLastError() << endl;
-                closesocket(clientSocket);
-                WSACleanup();
-                return 1;
+            uint16_t batchId;
+            {
+                unique_lock<mutex> lock(freeMutex);
+                if (freeBatchIds.empty()) {
+                    (*LateBatches)++;
+                    freeCond.wait(lock, [&] { return !freeBatchIds.empty() || failed; });
+                    if (failed) {
+                        return;
+                    }
+                }
+                batchId = freeBatchIds.back();
+                freeBatchIds.pop_back();
             }
 
-            oneReceive += iResult;
-            remainingBytesToReceive = TOTAL_MESSAGE_SIZE - oneReceive;
+            int size = BuildBatch(SendBuffer, Requests + msgIndex * BatchSize, BatchSize, batchId, msgIndex * BatchSize,
+                due.time_since_epoch().count(), Content, Trace);
+            if (inFlight != NULL) {
+                inFlight[batchId].Due.store(due.time_since_epoch().count(), memory_order_relaxed);
+                inFlight[batchId].Tag.store(msgIndex + 1, memory_order_release);
+            }
+            if (!SendAll(*ClientSocket, SendBuffer, size)) {
+                failed = true;
+                return;
+            }
         }
-
-        //
-        // measure latency
-        //
-        //
-        long long diff;
-        uint16_t BatchID;
-        for (int i = 0; i != BatchSize; i++) {
-            //diff returns the time in nanosecond, here we divide it by 1000 to get time in microsecond
-            hdr = (MessageHeader*)(recvBuffer + i * (HeaderSize+ MessageSize));
-            diff = high_resolution_clock::now().time_since_epoch().count() - hdr->TimeSend;
-            BatchID = hdr->BatchId;
-            latencies[RespIndex * BatchSize + i] = ((double) diff) / 1000;
-        }
-        bytesCompleted += oneReceive;
-        RespIndex++;
-
-        if (RespIndex == ReadNum/BatchSize) { 
+    });
+
+    for (uint64_t respIndex = 0; respIndex != batchNum; respIndex++) {
+        uint16_t batchId;
+        if (!ReceiveBatch(*ClientSocket, RecvBuffer, BatchSize, QueueDepth, Latencies,
+            &batchId, BytesCompleted, Trace, hedgeState)) {
+            //
+            // Unblock the sender, which may be in a send
+            //
+            //
+            failed = true;
+            shutdown(*ClientSocket, SD_BOTH);
             break;
         }
 
-        oneReceive = 0;
-        remainingBytesToReceive = TOTAL_MESSAGE_SIZE;
-
-        //
-        // send another message
-        //
-        //
-        if (msgIndex < ReadNum/BatchSize) {
-            for (int i = 0; i != BatchSize; i++) {
-                hdr = (MessageHeader*)(sendBuffer + i * HeaderSize);
-                hdr->TimeSend = high_resolution_clock::now().time_since_epoch().count();
-                hdr->BatchId = BatchID;
-                hdr->FileId = FileIds[msgIndex * BatchSize + i];
-                hdr->Offset = Offsets[msgIndex * BatchSize + i];
-
+        if (inFlight != NULL) {
+            inFlight[batchId].Tag.store(0, memory_order_release);
+            if (respIndex % HEDGE_DELAY_UPDATE_BATCHES == 0 && Latencies->TotalCount() >= HEDGE_MIN_SAMPLES) {
+                hedgeDelayNs.store(Latencies->ValueAtPercentile(Replica->HedgePercentile), memory_order_relaxed);
             }
-            msgIndex++;
-            while (oneSend < HeaderSize * BatchSize) {
-                actualBytesToSend = remainingBytesToSend > SEND_PACKET_SIZE ? SEND_PACKET_SIZE : remainingBytesToSend;
-                iResult = send(clientSocket, sendBuffer + oneSend, actualBytesToSend, 0);
-                if (iResult == SOCKET_ERROR) {
-                    std::cout << "Error sending message: " << WSAGetLastError() << endl;
-                    closesocket(clientSocket);
-                    WSACleanup();
-                    return 1;
-                }
-
-                oneSend += iResult;
-                remainingBytesToSend = HeaderSize * BatchSize - oneSend;
-            }
-
-            bytesSent += oneSend;
-
-            oneSend = 0;
-            remainingBytesToSend = HeaderSize * BatchSize;
         }
-    }
-    auto endTime = high_resolution_clock::now().time_since_epoch().count(); // measure end time
 
-    cout << "Processing results..." << endl;
-
-    //
-    // Calculate throughput
-    //
-    //
-    auto duration = (endTime - startTime)/1000; // duration in microseconds
-    double throughput = (double)bytesCompleted / (double)duration * 1000000.0f / (1024.0 * 1024.0 * 1024.0); // in giga bytes per second
-
-    //
-    // Calculate latency
-    //
-    //
-    Statistics LatencyStats;
-    Percentiles PercentileStats;
-    GetStatistics(latencies, ReadNum, &LatencyStats, &PercentileStats);
-    printf(
-        "Result for %zu requests of %d bytes (%.2lf seconds): %.2lf RPS, Min: %.2lf, Max: %.2lf, 50th: %.2lf, 90th: %.2lf, 99th: %.2lf, 99.9th: %.2lf, 99.99th: %.2lf, StdErr: %.2lf\n",
-        ReadNum,
-        MessageSize,
-        (duration / 1000000.0),
-        (ReadNum / (duration / 1000000.0)),
-        LatencyStats.Min,
-        LatencyStats.Max,
-        PercentileStats.P50,
-        PercentileStats.P90,
-        PercentileStats.P99,
-        PercentileStats.P99p9,
-        PercentileStats.P99p99,
-        LatencyStats.StandardError);
-
-    cout << "Throughput: " << throughput << " GB/s" << endl;
+        lock_guard<mutex> lock(freeMutex);
+        freeBatchIds.push_back(batchId);
+        freeCond.notify_one();
+    }
 
-    //
-    // Release buffers
-    //
-    //
-    delete[] latencies;
-    // delete[] oneMessage;
-    delete[] sendBuffer;
-    delete[] recvBuffer;
-    delete[] FileIds;
-    delete[] Offsets;
+    {
+        lock_guard<mutex> lock(freeMutex);
+        freeCond.notify_one();
+    }
+    sender.join();
 
     //
-    // Close the socket and clean up
+    // The replica answers the hedges it has before its thread exits, unless the run failed
     //
     //
-    int ret = closesocket(clientSocket);
-    if (ret != 0) {
-        cout << "closing socket err: " << WSAGetLastError() << endl;;
+    if (Replica != NULL) {
+        stopHedging = true;
+        if (failed) {
+            shutdown(Replica->Socket, SD_BOTH);
+        }
+        hedger.join();
+        replicaReceiver.join();
+
+        Replica->Wins = replicaLatencies.TotalCount();
+        Latencies->Add(&replicaLatencies);
+        *BytesCompleted += replicaBytesCompleted;
+        if (replicaFailed) {
+            cout << "The connection to the replica failed, reads are no longer hedged" << endl;
+        }
+        delete[] hedge.Completed;
+        delete[] inFlight;
     }
-    WSACleanup();
-    cout << "closing socket completed" << endl;
 
-    return 0;
+    return !failed;
 }
 
 void ThreadFunc(
     int ThreadNum,
-    int MessageSize,
+    int MaxLength,
     int BatchSize,
     const uint64_t ReadNum,
     const int QueueDepth,
+    double RateRps,
+    bool PoissonArrivals,
     SOCKET* ClientSocket,
-    char* SendBuffer,
-    char* RecvBuffer,
-    uint16_t* FileIds,
-    uint64_t* Offsets,
-    double* latencies,
+    const WorkloadRequest* Requests,
+    HdrHistogram* latencies,
     std::chrono::steady_clock::time_point* StartTime,
     std::chrono::steady_clock::time_point* EndTime,
     uint64_t* BytesCompleted,
-    char** content
+    uint64_t* LateBatches,
+    const char* Content,
+    ConnectionTrace* Trace,
+    ReplicaConnection* Replica
 ) {
     int iResult;
     const int HeaderSize = sizeof(MessageHeader);
-    //the following are used for read
-    /*const int firstMsg = HeaderSize*BatchSize;
-    const int TOTAL_MESSAGE_SIZE = BatchSize * (HeaderSize + MessageSize);*/
-    //the following are used for write
-    const int TOTAL_MESSAGE_SIZE = HeaderSize * BatchSize;
-    const int firstMsg = BatchSize * (HeaderSize + MessageSize);
-
-    iResult = send(*ClientSocket, (const char*)&firstMsg, sizeof(int), 0);
-    if (iResult == SOCKET_ERROR || iResult != sizeof(int)) {
+    bool done;
+
+    //
+    // A batch is built whole before it is sent, so its largest size must fit the int of a send
+    //
+    //
+    if (MaxLength < 0 || ((size_t)HeaderSize + MaxLength) * BatchSize > INT_MAX) {
+        cout << "A batch of " << BatchSize << " requests of up to " << MaxLength << " bytes is too large to send" << endl;
+        closesocket(*ClientSocket);
+        return;
+    }
+    const int batchBytes = (HeaderSize + MaxLength) * BatchSize;
+    char* sendBuffer = new char[batchBytes];
+    char* recvBuffer = new char[MaxLength];
+
+    SessionHeader session;
+    session.BatchSize = BatchSize;
+    session.MaxLength = MaxLength;
+    iResult = send(*ClientSocket, (const char*)&session, sizeof(session), 0);
+    if (iResult == SOCKET_ERROR || iResult != sizeof(session)) {
         cout << "Error sending the first message: " << WSAGetLastError() << endl;
         closesocket(*ClientSocket);
-        WSACleanup();
+        delete[] sendBuffer;
+        delete[] recvBuffer;
         return;
     }
 
-    uint64_t bytesCompleted = 0;
-    uint64_t bytesSent = 0;
-
-    int oneSend = 0;
-    int remainingBytesToSend = firstMsg;
-    int actualBytesToSend;
-    uint64_t msgIndex = 0;
-
-    MessageHeader* hdr;
-
-    *StartTime = high_resolution_clock::now();
-
-    for (uint64_t q = 0; q != QueueDepth; q++) {
-        for (int i = 0; i != BatchSize; i++) {
-            //read
-            //hdr = (MessageHeader*)(SendBuffer + i * HeaderSize);
-            //write
-            hdr = (MessageHeader*)(SendBuffer + i * (HeaderSize+ MessageSize));
-            hdr->TimeSend = high_resolution_clock::now().time_since_epoch().count();
-            hdr->BatchId = (uint16_t)q;
-            hdr->FileId = FileIds[msgIndex * BatchSize + i];
-            hdr->Offset = Offsets[msgIndex * BatchSize + i];
-            //only for write
-            memcpy(SendBuffer + i * (HeaderSize + MessageSize) + HeaderSize, content[msgIndex * BatchSize + i], MessageSize);
-
+    //
+    // Without its replica, the connection just doesn't hedge
+    //
+    //
+    if (Replica != NULL) {
+        iResult = send(Replica->Socket, (const char*)&session, sizeof(session), 0);
+        if (iResult == SOCKET_ERROR || iResult != sizeof(session)) {
+            cout << "Error sending the first message to the replica: " << WSAGetLastError() << endl;
+            Replica = NULL;
         }
-        msgIndex++;
-        while (oneSend < firstMsg) {
-            actualBytesToSend = remainingBytesToSend > SEND_PACKET_SIZE ? SEND_PACKET_SIZE : remainingBytesToSend;
-            iResult = send(*ClientSocket, SendBuffer + oneSend, actualBytesToSend, 0);
-            if (iResult == SOCKET_ERROR) {
-                cout << "Error sending message: " << WSAGetLastError() << endl;
-                closesocket(*ClientSocket);
-                WSACleanup();
-                return;
-            }
-
-            oneSend += iResult;
-            remainingBytesToSend = firstMsg - oneSend;
+        else {
+            Replica->RecvBuffer = new char[MaxLength];
         }
-
-        bytesSent += oneSend;
-
-        oneSend = 0;
-        remainingBytesToSend = firstMsg;
     }
 
-    int oneReceive = 0;
-    int remainingBytesToReceive = TOTAL_MESSAGE_SIZE;
-    uint64_t RespIndex = 0;
-
-    while (true) {
-        //
-        // receive one message
-        //
-        //
-        while (oneReceive < TOTAL_MESSAGE_SIZE) {
-            iResult = recv(*ClientSocket, RecvBuffer + oneReceive, remainingBytesToReceive, 0);
-            if (iResult == SOCKET_ERROR) {
-                cout << "Error receiving message: " << WSAGetLastError() << endl;
-                closesocket(*ClientSocket);
-                WSACleanup();
-                return;
-            }
-
-            oneReceive += iResult;
-            remainingBytesToReceive = TOTAL_MESSAGE_SIZE - oneReceive;
-        }
-        //
-        // measure latency
-        //
-        //
-        long long diff;
-        uint16_t BatchID;
-        for (int i = 0; i != BatchSize; i++) {
-            //diff returns the time in nanosecond, here we divide it by 1000 to get time in microsecond
-            //used for read
-            //hdr = (MessageHeader*)(RecvBuffer + i * (HeaderSize + MessageSize));
-            //used for write
-            hdr = (MessageHeader*)(RecvBuffer + i * HeaderSize);
-            diff = high_resolution_clock::now().time_since_epoch().count() - hdr->TimeSend;
-            BatchID = hdr->BatchId;
-            if (BatchID > QueueDepth) {
-                cerr << "ERROR: got wrong batchId from server: " << BatchID << endl;
-            }
-            latencies[RespIndex * BatchSize + i] = (double) diff / 1000;
-        }
-        bytesCompleted += oneReceive;
-        RespIndex++;
-
-        if (RespIndex == ReadNum/BatchSize) {
-            break;
-        }
-
-        oneReceive = 0;
-        remainingBytesToReceive = TOTAL_MESSAGE_SIZE;
-
-        //
-        // send another message
-        //
-        //
-        if (msgIndex < ReadNum / BatchSize) {
-            for (int i = 0; i != BatchSize; i++) {
-                //read
-                //hdr = (MessageHeader*)(SendBuffer + i * HeaderSize);
-                //write
-                hdr = (MessageHeader*)(SendBuffer + i * (HeaderSize + MessageSize));
-                hdr->TimeSend = high_resolution_clock::now().time_since_epoch().count();
-                hdr->BatchId = (uint16_t)BatchID;
-                hdr->FileId = FileIds[msgIndex * BatchSize + i];
-                hdr->Offset = Offsets[msgIndex * BatchSize + i];
-                //only for write
-                memcpy(SendBuffer + i * (HeaderSize + MessageSize) + HeaderSize, content[msgIndex * BatchSize + i], MessageSize);
-
-            }
-            msgIndex++;
-            while (oneSend < firstMsg) {
-                actualBytesToSend = remainingBytesToSend > SEND_PACKET_SIZE ? SEND_PACKET_SIZE : remainingBytesToSend;
-                iResult = send(*ClientSocket, SendBuffer + oneSend, actualBytesToSend, 0);
-                if (iResult == SOCKET_ERROR) {
-                    cout << "Error sending message: " << WSAGetLastError() << endl;
-                    closesocket(*ClientSocket);
-                    WSACleanup();
-                    return;
-                }
-
-                oneSend += iResult;
-                remainingBytesToSend = firstMsg - oneSend;
-            }
-
-            bytesSent += oneSend;
+    *BytesCompleted = 0;
+    *LateBatches = 0;
+    *StartTime = high_resolution_clock::now();
 
-            oneSend = 0;
-            remainingBytesToSend = firstMsg;
-        }
+    if (RateRps > 0) {
+        done = RunOpenLoop(BatchSize, ReadNum, QueueDepth, RateRps, PoissonArrivals, RAND_SEED + ThreadNum,
+            ClientSocket, sendBuffer, recvBuffer, Requests, latencies, BytesCompleted, Content, LateBatches, Trace, Replica);
+    }
+    else {
+        done = RunClosedLoop(BatchSize, ReadNum, QueueDepth, ClientSocket, sendBuffer, recvBuffer, Requests, latencies,
+            BytesCompleted, Content, Trace);
+    }
+    if (!done) {
+        closesocket(*ClientSocket);
     }
 
     *EndTime = high_resolution_clock::now();
-    *BytesCompleted = bytesCompleted;
+
+    delete[] sendBuffer;
+    delete[] recvBuffer;
+    if (Replica != NULL) {
+        delete[] Replica->RecvBuffer;
+    }
 }
+
 void GenerateRandomData(char* buffer, size_t size) {
     std::random_device rd;
     std::mt19937 generator(rd());
@@ -525,7 +677,7 @@ void GenerateRandomData(char* buffer, size_t size) {
 }
 
 int RunClientForThroughput(
-    int MessageSize,
+    const WorkloadSpec* Spec,
     int BatchSize,
     int QueueDepth,
     uint64_t ReadNum,
@@ -595,91 +747,87 @@ int RunClientForThroughput(
         cout << "Connection #" << i << " has been connected" << endl;
     }
 
-    cout << "Preparing message buffers..." << endl;
-
-    const int HeaderSize = sizeof(MessageHeader);
-
-
-    char** sendBuffers = new char* [NumConnections];
-    char** recvBuffers = new char* [NumConnections];
-    //the following are used for read
-    /*int TOTAL_MESSAGE_SIZE = (HeaderSize + MessageSize) * BatchSize;
-    for (int i = 0; i != NumConnections; i++) {
-        sendBuffers[i] = new char[HeaderSize*BatchSize];
-        memset(sendBuffers[i], 0, HeaderSize * BatchSize);
-        MessageHeader* hdr;
-        for (int j = 0; j != BatchSize; j++) {
-            hdr = (MessageHeader*)(sendBuffers[i] + j * HeaderSize);
-            hdr->Length = MessageSize;
-        }
-        recvBuffers[i] = new char[TOTAL_MESSAGE_SIZE];
-        memset(recvBuffers[i], 0, TOTAL_MESSAGE_SIZE);
-    }*/
-    //the following are used for write
-    int TOTAL_MESSAGE_SIZE = (HeaderSize + MessageSize) * BatchSize;
-    for (int i = 0; i != NumConnections; i++) {
-        sendBuffers[i] = new char[TOTAL_MESSAGE_SIZE];
-        memset(sendBuffers[i], 0, TOTAL_MESSAGE_SIZE);
-        MessageHeader* hdr;
-        for (int j = 0; j != BatchSize; j++) {
-            hdr = (MessageHeader*)(sendBuffers[i] + j * (HeaderSize + MessageSize));
-            hdr->Length = MessageSize;
+    //
+    // Connect every connection to the replica as well if reads are hedged, which needs the open loop
+    //
+    //
+    ReplicaConnection* replicas = NULL;
+    if (Spec->HedgePercentile > 0 && Spec->RateRps <= 0) {
+        cout << "Reads are hedged only in the open loop (rate=), so they are not" << endl;
+    }
+    else if (Spec->HedgePercentile > 0) {
+        sockaddr_in replicaAddr = serverAddr;
+        replicaAddr.sin_addr.s_addr = inet_addr(HEDGE_REPLICA_IP);
+        replicas = new ReplicaConnection[NumConnections];
+        for (int i = 0; i != NumConnections; i++) {
+            replicas[i].RecvBuffer = NULL;
+            replicas[i].HedgePercentile = Spec->HedgePercentile;
+            replicas[i].HedgedBatches = 0;
+            replicas[i].Wins = 0;
+            replicas[i].Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            if (replicas[i].Socket == INVALID_SOCKET ||
+                connect(replicas[i].Socket, (SOCKADDR*)&replicaAddr, sizeof(replicaAddr)) == SOCKET_ERROR) {
+                cout << "Unable to connect to the replica: " << WSAGetLastError() << endl;
+                WSACleanup();
+                return 1;
+            }
+            int noDelay = 1;
+            setsockopt(replicas[i].Socket, IPPROTO_TCP, TCP_NODELAY, (char*)&noDelay, sizeof(noDelay));
         }
-        recvBuffers[i] = new char[HeaderSize * BatchSize];
-        memset(recvBuffers[i], 0, HeaderSize * BatchSize);
+        cout << "Connected to the replica at " << HEDGE_REPLICA_IP << endl;
     }
 
+    cout << "Preparing requests..." << endl;
+    PrintWorkloadSpec(Spec);
+
     //
-    // Prepare FileId and offset for each request
+    // Prepare the requests of every connection, and the data writes send
     //
     //
-    std::random_device rd;
-    std::mt19937_64 eng(rd());
-    std::uniform_int_distribution<uint64_t> distr;
+    WorkloadRequest** requests = new WorkloadRequest* [NumConnections];
+    HdrHistogram** latencies = new HdrHistogram* [NumConnections];
+    ConnectionTrace* traces = new ConnectionTrace[NumConnections];
 
-    uint16_t** FileIds = new uint16_t* [NumConnections];
-    uint64_t** Offsets = new uint64_t* [NumConnections];
-    double** latencies = new double* [NumConnections];
-    char*** content = new char** [NumConnections];
+    //
+    // Trace ids never have the top bit, which marks the keys of back end hops, and are never 0;
+    // the run id tells the traces of runs and clients apart
+    //
+    //
+    uint64_t traceRunId = (uint64_t)(std::random_device()() & 0x7fff) << 1 | 1;
     for (int i = 0; i != NumConnections; i++) {
-        FileIds[i] = new uint16_t[ReadNum];
-        Offsets[i] = new uint64_t[ReadNum];
-        latencies[i] = new double[ReadNum];
-        content[i] = new char* [ReadNum];
-        for (int l = 0; l != ReadNum; l++) {
-            FileIds[i][l] = FILEID[rand() % FILENUM];
-            // Offsets[i][l] = rand() % (FILE_SIZE - MessageSize - 1);
-            uint64_t randomValue = distr(eng);
-            randomValue %= (FILE_SIZE - MessageSize - 1);
-            // ensure offset is sector size aligned
-            randomValue = (randomValue / SECTOR_SIZE) * SECTOR_SIZE;
-            Offsets[i][l] = randomValue;
-            if (Offsets[i][l] + 8192 > 1073741824) {
-                cout << "wrong offset: " << Offsets[i][l] << endl;
-            }
-            latencies[i][l] = 0;
-            content[i][l] = new char[MessageSize];
-            GenerateRandomData(content[i][l], MessageSize);
-
-        }
-    }  
+        requests[i] = new WorkloadRequest[ReadNum];
+        GenerateWorkload(Spec, FILEID, FILENUM, FILE_SIZE, ReadNum, RAND_SEED + i, requests[i]);
+        latencies[i] = new HdrHistogram(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+        traces[i].SendRing = DDSTraceRingCreate(i);
+        traces[i].RecvRing = DDSTraceRingCreate(i);
+        traces[i].IdBase = traceRunId << 47 | (uint64_t)(i & 0x7fff) << 32;
+        traces[i].Seq = 0;
+    }
+    char* content = new char[Spec->MaxSize];
+    GenerateRandomData(content, Spec->MaxSize);
 
     cout << "Starting measurement..." << endl;
     std::chrono::steady_clock::time_point* startTimes = new std::chrono::steady_clock::time_point[NumConnections];
     std::chrono::steady_clock::time_point* endTimes = new std::chrono::steady_clock::time_point[NumConnections];
     uint64_t* bytesCompleted = new uint64_t[NumConnections];
+    uint64_t* lateBatches = new uint64_t[NumConnections];
+    double connRateRps = Spec->RateRps / NumConnections;
+    bool poissonArrivals = Spec->PoissonArrivals;
+    int maxLength = Spec->MaxSize;
 
     thread** ioThreads = new thread * [NumConnections];
     for (int i = 0; i != NumConnections; i++) {
-        thread* worker = new thread([i, MessageSize, BatchSize, ReadNum, QueueDepth, clientSockets, sendBuffers, recvBuffers, FileIds, Offsets, latencies, startTimes, endTimes, bytesCompleted, content]
+        thread* worker = new thread([i, maxLength, BatchSize, ReadNum, QueueDepth, connRateRps, poissonArrivals, clientSockets, requests, latencies, startTimes, endTimes, bytesCompleted, lateBatches, content, traces, replicas]
             {
-                ThreadFunc(i, MessageSize, BatchSize, ReadNum, QueueDepth, &clientSockets[i], sendBuffers[i], recvBuffers[i], FileIds[i], Offsets[i], latencies[i], &startTimes[i], &endTimes[i], &bytesCompleted[i], content[i]);
+                ThreadFunc(i, maxLength, BatchSize, ReadNum, QueueDepth, connRateRps, poissonArrivals, &clientSockets[i], requests[i], latencies[i], &startTimes[i], &endTimes[i], &bytesCompleted[i], &lateBatches[i], content, &traces[i],
+                    replicas != NULL ? &replicas[i] : NULL);
             });
         ioThreads[i] = worker;
     }
 
     for (int i = 0; i != NumConnections; i++) {
         ioThreads[i]->join();
+        delete ioThreads[i];
     }
 
     cout << "Processing results..." << endl;
@@ -690,11 +838,8 @@ int RunClientForThroughput(
     //
     std::chrono::steady_clock::time_point aggStartTime = startTimes[0], aggEndTime = endTimes[0];
     uint64_t aggBytesCompleted = 0;
-    double P50Sum = 0;
-    double P90Sum = 0;
-    double P99Sum = 0;
-    Statistics LatencyStats;
-    Percentiles PercentileStats;
+    uint64_t aggLateBatches = 0;
+    HdrHistogram aggLatencies(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
     for (int i = 0; i != NumConnections; i++) {
         if (aggStartTime > startTimes[i]) {
             aggStartTime = startTimes[i];
@@ -704,60 +849,89 @@ int RunClientForThroughput(
         }
 
         aggBytesCompleted += bytesCompleted[i];
+        aggLateBatches += lateBatches[i];
     }
     auto duration = duration_cast<microseconds>(aggEndTime - aggStartTime).count(); // duration in microseconds
     double throughput = (double)aggBytesCompleted / (double)duration * 1000000.0f / (1024.0 * 1024.0 * 1024.0); // in giga bytes per second
     for (int i = 0; i != NumConnections; i++) {
-        GetStatistics(latencies[i], ReadNum, &LatencyStats, &PercentileStats);
-        printf(
-            "Thread %d: Result for %zu requests of %d bytes (%.2lf seconds): %.2lf RPS, Min: %.2lf, Max: %.2lf, 50th: %.2lf, 90th: %.2lf, 99th: %.2lf, 99.9th: %.2lf, 99.99th: %.2lf, StdErr: %.2lf\n",
+        printf("Thread %d: Result for %zu requests of %d-%d bytes (%.2lf seconds): %.2lf RPS, ",
             i,
             ReadNum,
-            MessageSize,
+            Spec->MinSize,
+            Spec->MaxSize,
             (duration / 1000000.0),
-            (ReadNum / (duration / 1000000.0)),
-            LatencyStats.Min,
-            LatencyStats.Max,
-            PercentileStats.P50,
-            PercentileStats.P90,
-            PercentileStats.P99,
-            PercentileStats.P99p9,
-            PercentileStats.P99p99,
-            LatencyStats.StandardError);
-        P50Sum += PercentileStats.P50;
-        P90Sum += PercentileStats.P90;
-        P99Sum += PercentileStats.P99;
+            (ReadNum / (duration / 1000000.0)));
+        PrintLatencies(latencies[i]);
+        aggLatencies.Add(latencies[i]);
     }
 
-
     cout << "Throughput: " << throughput << " GB/s" << endl;
     cout << "IOPS: " << ReadNum* NumConnections/((double)duration/ 1000000) << "RPS" << endl;
-    cout << "Avg P50: " << P50Sum / NumConnections << endl;
-    cout << "Avg P90: " << P90Sum / NumConnections << endl;
-    cout << "Avg P99: " << P99Sum / NumConnections << endl;
+    printf("All threads: ");
+    PrintLatencies(&aggLatencies);
+    if (Spec->RateRps > 0) {
+        cout << "Batches that waited for a free batch slot: " << aggLateBatches << endl;
+    }
+    if (replicas != NULL) {
+        uint64_t hedgedBatches = 0, hedgeWins = 0;
+        for (int i = 0; i != NumConnections; i++) {
+            hedgedBatches += replicas[i].HedgedBatches;
+            hedgeWins += replicas[i].Wins;
+        }
+        cout << "Hedged batches: " << hedgedBatches << " (" << hedgedBatches * BatchSize * 100.0 / ((double)ReadNum * NumConnections)
+            << "% of the requests), requests answered first by the replica: " << hedgeWins << endl;
+    }
+
+    //
+    // The distribution of all requests, for HdrHistogram's plotter
+    //
+    //
+    FILE* hgrm = fopen(LATENCY_HGRM_PATH, "w");
+    if (hgrm != NULL) {
+        aggLatencies.WritePercentiles(hgrm, 1000.0, 5);
+        fclose(hgrm);
+        cout << "Latency distribution (us) written to " << LATENCY_HGRM_PATH << endl;
+    }
+
+    //
+    // The hops of traced requests, for Scripts/DDSTraceToChrome.py
+    //
+    //
+    FILE* traceFile = fopen(CLIENT_TRACE_PATH, "w");
+    if (traceFile != NULL) {
+        uint64_t traceEvents = 0;
+        for (int i = 0; i != NumConnections; i++) {
+            if (traces[i].SendRing != NULL) {
+                traceEvents += DDSTraceDump(traces[i].SendRing, "client", traceFile);
+            }
+            if (traces[i].RecvRing != NULL) {
+                traceEvents += DDSTraceDump(traces[i].RecvRing, "client", traceFile);
+            }
+        }
+        fclose(traceFile);
+        cout << traceEvents << " trace events written to " << CLIENT_TRACE_PATH << endl;
+    }
 
     //
     // Release buffers
     //
     //
     for (int i = 0; i != NumConnections; i++) {
-        delete[] sendBuffers[i];
-        delete[] recvBuffers[i];
-        delete[] FileIds[i];
-        delete[] Offsets[i];
-        delete[] latencies[i];
-        for (int j = 0; j != ReadNum; j++) {
-            delete[] content[i][j];
-        }
-        delete content[i];
-    }
-    delete[] sendBuffers;
-    delete[] recvBuffers;
-    delete[] FileIds;
-    delete[] Offsets;
+        delete[] requests[i];
+        delete latencies[i];
+        free(traces[i].SendRing);
+        free(traces[i].RecvRing);
+    }
+    delete[] requests;
     delete[] latencies;
-    delete[] FILEID;
+    delete[] traces;
     delete[] content;
+    delete[] startTimes;
+    delete[] endTimes;
+    delete[] bytesCompleted;
+    delete[] lateBatches;
+    delete[] ioThreads;
+    delete[] FILEID;
 
     //
     // Close the socket and clean up
@@ -765,12 +939,31 @@ int RunClientForThroughput(
     //
     for (int i = 0; i != NumConnections; i++) {
         closesocket(clientSockets[i]);
+        if (replicas != NULL) {
+            closesocket(replicas[i].Socket);
+        }
     }
     delete[] clientSockets;
+    delete[] replicas;
     WSACleanup();
 
     return 0;
 }
+
+//
+// Measure latency on a single connection
+//
+//
+int RunClientForLatency(
+    const WorkloadSpec* Spec,
+    int BatchSize,
+    int QueueDepth,
+    uint64_t ReadNum,
+    int Port
+) {
+    return RunClientForThroughput(Spec, BatchSize, QueueDepth, ReadNum, Port, 1);
+}
+
 struct FileReadData {
     HANDLE hFile;
     char* buffer;
@@ -803,7 +996,13 @@ int main(
     const char** args
 )
 {
-    if (argc == 7) {
+    //
+    // The workload spec is the optional last argument, see Workload.h
+    //
+    //
+    WorkloadSpec spec;
+
+    if (argc == 7 || argc == 8) {
         int msgSize = stoi(args[1]);
         int batchSize = stoi(args[2]);
         int queueDepth = stoi(args[3]);
@@ -811,9 +1010,16 @@ int main(
         int port = stoi(args[5]);
         uint64_t fileSize = stoull(args[6]);
         FILE_SIZE = fileSize * 1024 * 1024 * 1024;
-        return RunClientForLatency(msgSize, batchSize, queueDepth, readNum, port);
+        FILEID = new int[1];
+        FILEID[0] = 0;
+        FILENUM = 1;
+        if (!ParseWorkloadSpec(argc == 8 ? args[7] : NULL, msgSize, &spec)) {
+            cout << "Invalid workload spec: " << args[7] << endl;
+            return 1;
+        }
+        return RunClientForLatency(&spec, batchSize, queueDepth, readNum, port);
     }
-    else if (argc == 9) {
+    else if (argc == 9 || argc == 10) {
         int msgSize = stoi(args[1]);
         int batchSize = stoi(args[2]);
         int queueDepth = stoi(args[3]);
@@ -828,11 +1034,17 @@ int main(
             FILEID[i] = i;
         }
         FILENUM = fileNum;
-        return RunClientForThroughput(msgSize, batchSize, queueDepth, readNum, port, numConns);
+        if (!ParseWorkloadSpec(argc == 10 ? args[9] : NULL, msgSize, &spec)) {
+            cout << "Invalid workload spec: " << args[9] << endl;
+            return 1;
+        }
+        return RunClientForThroughput(&spec, batchSize, queueDepth, readNum, port, numConns);
     }
     else {
-        cout << "Client (latency) usage: " << args[0] << " [Read Size] [Batch Size] [Queue Depth] [ReadNum] [Port] [File Size (in gigabyte)]" << endl;
-        cout << "Client (bandwidth) usage: " << args[0] << " [Read Size] [Batch Size] [Queue Depth] [ReadNum] [Port Base] [Num Connections] [File Size (in gigabyte)] [File Num]" << endl;
+        cout << "Client (latency) usage: " << args[0] << " [Request Size] [Batch Size] [Queue Depth] [ReadNum] [Port] [File Size (in gigabyte)] [Workload]" << endl;
+        cout << "Client (bandwidth) usage: " << args[0] << " [Request Size] [Batch Size] [Queue Depth] [ReadNum] [Port Base] [Num Connections] [File Size (in gigabyte)] [File Num] [Workload]" << endl;
+        cout << "Workload (optional): comma-separated read=PERCENT, offset=seq|uniform|zipf:THETA, size=N|uniform:MIN:MAX|mix:S@W/S@W..., rate=RPS, arrival=poisson|constant" << endl;
+        cout << "  e.g. read=70,offset=zipf:0.99,size=mix:4096@80/65536@20,rate=200000; the default is uniform reads of [Request Size]" << endl;
     }
 
     return 0;
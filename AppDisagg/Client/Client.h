@@ -5,19 +5,21 @@
 
 #pragma once
 
+#include "../Common/Include/Workload.h"
+
 int RunClientForLatency(
-    int MessageSize,
+    const WorkloadSpec* Spec,
+    int BatchSize,
     int QueueDepth,
-    size_t TotalBytes,
-    int Port,
-    int OffloadPercent
+    uint64_t ReadNum,
+    int Port
 );
 
 int RunClientForThroughput(
-    int MessageSize,
+    const WorkloadSpec* Spec,
+    int BatchSize,
     int QueueDepth,
-    size_t TotalBytes,
+    uint64_t ReadNum,
     int PortBase,
-    int OffloadPercent,
     int NumConnections
 );
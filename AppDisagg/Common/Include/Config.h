@@ -11,19 +11,53 @@
 #define SERVER_IP "10.1.0.4"//"10.1.0.6"
 #define SERVER_PORT 3232
 
+//
+// The DDS node with a replica of the files, which hedged reads go to (see hedge= in Workload.h)
+//
+//
+#define HEDGE_REPLICA_IP "10.1.0.5"
+
 #define FILE_DIR "E:\YimingZheng\dpdpu\DPDPU\AppDisagg\x64\Release"
 
 #define SECTOR_SIZE 4096
 
-#define SEND_PACKET_SIZE 1024
+//
+// The most bytes the client hands to one send; the requests and responses of a batch go out in as many sends
+// as they take, and both sides receive every message by the length in its header, however it is split on the wire
+//
+//
+#define SEND_PACKET_SIZE 1048576
 
 using namespace std;
 using namespace std::chrono;
 
+#define MESSAGE_OP_READ 0
+#define MESSAGE_OP_WRITE 1
+
+//
+// A request is a header, followed by Length bytes for a write;
+// its response is the header, followed by Length bytes for a read;
+// TraceId is non-zero for a request that is traced end to end (see DDSTrace.h);
+// RequestId is unique in the run of a connection, and the server returns it as it is,
+// so the client tells the responses of a request sent to several servers apart
+//
+//
 struct MessageHeader {
 	long long TimeSend;
+	uint64_t TraceId;
+	uint64_t RequestId;
 	uint16_t BatchId;
 	uint16_t FileId;
+	uint16_t Op;
 	uint64_t Offset;
 	int Length;
 };
+
+//
+// The first message of a connection
+//
+//
+struct SessionHeader {
+	int BatchSize;
+	int MaxLength;
+};
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+//
+// A high dynamic range histogram, after HdrHistogram (Gil Tene): values up to HighestTrackable are kept
+// with SignificantDigits of precision in log-linear buckets, so percentiles up to the max are exact
+// to that precision in fixed memory, and histograms of threads merge by adding their counts
+//
+//
+class HdrHistogram {
+public:
+    HdrHistogram(
+        uint64_t HighestTrackable,
+        int SignificantDigits
+    ) {
+        uint64_t largestSingleUnit = 2;
+        for (int d = 0; d != SignificantDigits; d++) {
+            largestSingleUnit *= 10;
+        }
+
+        subBucketCountMagnitude = Log2Ceil(largestSingleUnit);
+        subBucketHalfCountMagnitude = subBucketCountMagnitude - 1;
+        subBucketCount = 1ULL << subBucketCountMagnitude;
+        subBucketHalfCount = subBucketCount / 2;
+        subBucketMask = subBucketCount - 1;
+
+        bucketCount = 1;
+        for (uint64_t smallestUntrackable = subBucketCount; smallestUntrackable <= HighestTrackable; smallestUntrackable <<= 1) {
+            bucketCount++;
+        }
+        countsLength = (bucketCount + 1) * (int)subBucketHalfCount;
+        highestTrackable = HighestTrackable;
+
+        counts = new uint64_t[countsLength];
+        Reset();
+    }
+
+    ~HdrHistogram() {
+        delete[] counts;
+    }
+
+    void
+    Reset() {
+        memset(counts, 0, sizeof(uint64_t) * countsLength);
+        totalCount = 0;
+        minValue = UINT64_MAX;
+        maxValue = 0;
+        sum = 0;
+        sumOfSquares = 0;
+    }
+
+    //
+    // Record a value; values above the highest trackable are recorded as it
+    //
+    //
+    void
+    Record(
+        uint64_t Value
+    ) {
+        if (Value > highestTrackable) {
+            Value = highestTrackable;
+        }
+        counts[CountsIndex(Value)]++;
+        totalCount++;
+        if (Value < minValue) {
+            minValue = Value;
+        }
+        if (Value > maxValue) {
+            maxValue = Value;
+        }
+        sum += (double)Value;
+        sumOfSquares += (double)Value * (double)Value;
+    }
+
+    //
+    // Add the counts of another histogram of the same range and precision
+    //
+    //
+    void
+    Add(
+        const HdrHistogram* Other
+    ) {
+        for (int i = 0; i != countsLength && i != Other->countsLength; i++) {
+            counts[i] += Other->counts[i];
+        }
+        totalCount += Other->totalCount;
+        if (Other->minValue < minValue) {
+            minValue = Other->minValue;
+        }
+        if (Other->maxValue > maxValue) {
+            maxValue = Other->maxValue;
+        }
+        sum += Other->sum;
+        sumOfSquares += Other->sumOfSquares;
+    }
+
+    uint64_t
+    TotalCount() const {
+        return totalCount;
+    }
+
+    uint64_t
+    Min() const {
+        return totalCount == 0 ? 0 : minValue;
+    }
+
+    uint64_t
+    Max() const {
+        return maxValue;
+    }
+
+    double
+    Mean() const {
+        return totalCount == 0 ? 0 : sum / (double)totalCount;
+    }
+
+    double
+    StandardDeviation() const {
+        if (totalCount == 0) {
+            return 0;
+        }
+        double mean = Mean();
+        double variance = sumOfSquares / (double)totalCount - mean * mean;
+        return variance > 0 ? sqrt(variance) : 0;
+    }
+
+    //
+    // The value at a percentile, in [0, 100]: the highest value equivalent to that of the recording at the percentile
+    //
+    //
+    uint64_t
+    ValueAtPercentile(
+        double Percentile
+    ) const {
+        if (totalCount == 0) {
+            return 0;
+        }
+        if (Percentile > 100.0) {
+            Percentile = 100.0;
+        }
+
+        uint64_t countAtPercentile = (uint64_t)ceil(Percentile / 100.0 * (double)totalCount);
+        if (countAtPercentile == 0) {
+            countAtPercentile = 1;
+        }
+
+        uint64_t cumulative = 0;
+        for (int i = 0; i != countsLength; i++) {
+            cumulative += counts[i];
+            if (cumulative >= countAtPercentile) {
+                uint64_t value = HighestEquivalentValue(ValueFromIndex(i));
+                return value < maxValue ? value : maxValue;
+            }
+        }
+        return maxValue;
+    }
+
+    //
+    // Write the percentile distribution in the text format of HdrHistogram's plotter (.hgrm),
+    // with values divided by Scale, e.g. 1000 for nanoseconds written as microseconds
+    //
+    //
+    void
+    WritePercentiles(
+        FILE* Out,
+        double Scale,
+        int TicksPerHalfDistance
+    ) const {
+        fprintf(Out, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+        for (int tick = 0; ; tick++) {
+            double percentile = 100.0 - 100.0 / pow(2.0, (double)tick / TicksPerHalfDistance);
+            uint64_t value = ValueAtPercentile(percentile);
+            uint64_t countAtValue = CountAtOrBelow(value);
+            double fraction = (double)countAtValue / (double)(totalCount == 0 ? 1 : totalCount);
+
+            if (fraction >= 1.0 || totalCount == 0) {
+                fprintf(Out, "%12.3lf %14.12lf %10llu\n", (double)maxValue / Scale, 1.0, (unsigned long long)totalCount);
+                break;
+            }
+            fprintf(Out, "%12.3lf %14.12lf %10llu %14.2lf\n", (double)value / Scale, percentile / 100.0,
+                (unsigned long long)countAtValue, 1.0 / (1.0 - percentile / 100.0));
+        }
+
+        fprintf(Out, "#[Mean    = %12.3lf, StdDeviation   = %12.3lf]\n", Mean() / Scale, StandardDeviation() / Scale);
+        fprintf(Out, "#[Max     = %12.3lf, Total count    = %12llu]\n", (double)maxValue / Scale, (unsigned long long)totalCount);
+        fprintf(Out, "#[Buckets = %12d, SubBuckets     = %12llu]\n", bucketCount, (unsigned long long)subBucketCount);
+    }
+
+private:
+    static int
+    Log2Ceil(
+        uint64_t Value
+    ) {
+        int log = 0;
+        while ((1ULL << log) < Value) {
+            log++;
+        }
+        return log;
+    }
+
+    static int
+    Log2Floor(
+        uint64_t Value
+    ) {
+        int log = 0;
+        while (Value >>= 1) {
+            log++;
+        }
+        return log;
+    }
+
+    int
+    CountsIndex(
+        uint64_t Value
+    ) const {
+        int bucketIndex = Log2Floor(Value | subBucketMask) - subBucketHalfCountMagnitude;
+        int subBucketIndex = (int)(Value >> bucketIndex);
+        return ((bucketIndex + 1) << subBucketHalfCountMagnitude) + (subBucketIndex - (int)subBucketHalfCount);
+    }
+
+    uint64_t
+    ValueFromIndex(
+        int Index
+    ) const {
+        int bucketIndex = (Index >> subBucketHalfCountMagnitude) - 1;
+        int subBucketIndex = (Index & ((int)subBucketHalfCount - 1)) + (int)subBucketHalfCount;
+        if (bucketIndex < 0) {
+            subBucketIndex -= (int)subBucketHalfCount;
+            bucketIndex = 0;
+        }
+        return (uint64_t)subBucketIndex << bucketIndex;
+    }
+
+    uint64_t
+    HighestEquivalentValue(
+        uint64_t Value
+    ) const {
+        int bucketIndex = Log2Floor(Value | subBucketMask) - subBucketHalfCountMagnitude;
+        return Value + (1ULL << bucketIndex) - 1;
+    }
+
+    uint64_t
+    CountAtOrBelow(
+        uint64_t Value
+    ) const {
+        uint64_t count = 0;
+        int last = CountsIndex(Value < highestTrackable ? Value : highestTrackable);
+        for (int i = 0; i <= last && i != countsLength; i++) {
+            count += counts[i];
+        }
+        return count;
+    }
+
+    uint64_t* counts;
+    int countsLength;
+    int bucketCount;
+    int subBucketCountMagnitude;
+    int subBucketHalfCountMagnitude;
+    uint64_t subBucketCount;
+    uint64_t subBucketHalfCount;
+    uint64_t subBucketMask;
+    uint64_t highestTrackable;
+    uint64_t totalCount;
+    uint64_t minValue;
+    uint64_t maxValue;
+    double sum;
+    double sumOfSquares;
+};
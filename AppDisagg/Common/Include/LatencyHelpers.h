@@ -8,6 +8,8 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include "HdrHistogram.h"
+
 typedef struct Statistics {
 	double Mean;
 	double Variance;
@@ -27,134 +29,36 @@ typedef struct Percentiles {
 	double P99p9999;
 } Percentiles;
 
-double square_root(double x) {
-	double guess = x / 2.0;
-	double prev_guess = 0.0;
-	const double tolerance = 0.00001;
-
-	while (fabs(guess - prev_guess) > tolerance) {
-		prev_guess = guess;
-		guess = (guess + x / guess) / 2.0;
-	}
-
-	return guess;
-}
-
-void quick_sort(double arr[], int left, int right) {
-	if (left < right) {
-		int pivot_index = left + (right - left) / 2;
-		double pivot_value = arr[pivot_index];
-		int i = left;
-		int j = right;
-		while (i <= j) {
-			while (arr[i] < pivot_value) {
-				i++;
-			}
-			while (arr[j] > pivot_value) {
-				j--;
-			}
-			if (i <= j) {
-				// swap arr[i] and arr[j]
-				double temp = arr[i];
-				arr[i] = arr[j];
-				arr[j] = temp;
-				i++;
-				j--;
-			}
-		}
-		quick_sort(arr, left, j);
-		quick_sort(arr, i, right);
-	}
-}
-
-double
-ComputeVariance(
-		double* Measurements,
-		size_t Length,
-		double Mean
-	       ) {
-	if (Length <= 1) {
-		return 0;
-	}
-	double Variance = 0;
-	for (size_t i = 0; i < Length; i++) {
-		double Value = Measurements[i];
-		Variance += (Value - Mean) * (Value - Mean) / (Length - 1);
-	}
-	return Variance;
-}
-
-int cmpfunc (const void * a, const void * b) {
-	return (int)(*(double*)a - *(double*)b);
-}
-
+//
+// Get the statistics of the latencies recorded in a histogram, with values divided by Scale,
+// e.g. 1000 for nanoseconds reported as microseconds; the histograms of threads are merged with Add first
+//
+//
 static void
 GetStatistics(
-		double* Data,
-		size_t DataLength,
+		const HdrHistogram* Histogram,
+		double Scale,
 		Statistics* AllStatistics,
 		Percentiles* PercentileStats
 	     ) {
-	if (DataLength == 0) {
+	uint64_t Count = Histogram->TotalCount();
+	if (Count == 0) {
 		return;
 	}
 
-	double Sum = 0;
-	double Min = 0xFFFFFFFF;
-	double Max = 0;
-	for (size_t i = 0; i < DataLength; i++) {
-		double Value = Data[i];
-		Sum += Value;
-		if (Value > Max) {
-			Max = Value;
-		}
-		if (Value < Min) {
-			Min = Value;
-		}
-	}
-	double Mean = Sum / (double)DataLength;
-	double Variance =
-		ComputeVariance(
-				Data,
-				DataLength,
-				Mean);
-	double StandardDeviation = square_root(Variance);
-	double StandardError = StandardDeviation / square_root((double)DataLength);
-	AllStatistics->Mean = Mean;
-	AllStatistics->Variance = Variance;
+	double StandardDeviation = Histogram->StandardDeviation() / Scale;
+	AllStatistics->Mean = Histogram->Mean() / Scale;
+	AllStatistics->Variance = StandardDeviation * StandardDeviation;
 	AllStatistics->StandardDeviation = StandardDeviation;
-	AllStatistics->StandardError = StandardError;
-	AllStatistics->Min = Min;
-	AllStatistics->Max = Max;
-
-	/*
-	qsort(
-			Data,
-			DataLength,
-			sizeof(double),
-			cmpfunc
-	     );
-	*/
-	quick_sort(Data, 0, (int)DataLength - 1);
-
-	size_t PercentileIndex = (size_t)(DataLength * 0.5);
-	PercentileStats->P50 = Data[PercentileIndex];
-
-	PercentileIndex = (size_t)(DataLength * 0.9);
-	PercentileStats->P90 = Data[PercentileIndex];
-
-	PercentileIndex = (size_t)(DataLength * 0.99);
-	PercentileStats->P99 = Data[PercentileIndex];
-
-	PercentileIndex = (size_t)(DataLength * 0.999);
-	PercentileStats->P99p9 = Data[PercentileIndex];
-
-	PercentileIndex = (size_t)(DataLength * 0.9999);
-	PercentileStats->P99p99 = Data[PercentileIndex];
-
-	PercentileIndex = (size_t)(DataLength * 0.99999);
-	PercentileStats->P99p999 = Data[PercentileIndex];
-
-	PercentileIndex = (size_t)(DataLength * 0.999999);
-	PercentileStats->P99p9999 = Data[PercentileIndex];
+	AllStatistics->StandardError = StandardDeviation / sqrt((double)Count);
+	AllStatistics->Min = (double)Histogram->Min() / Scale;
+	AllStatistics->Max = (double)Histogram->Max() / Scale;
+
+	PercentileStats->P50 = (double)Histogram->ValueAtPercentile(50.0) / Scale;
+	PercentileStats->P90 = (double)Histogram->ValueAtPercentile(90.0) / Scale;
+	PercentileStats->P99 = (double)Histogram->ValueAtPercentile(99.0) / Scale;
+	PercentileStats->P99p9 = (double)Histogram->ValueAtPercentile(99.9) / Scale;
+	PercentileStats->P99p99 = (double)Histogram->ValueAtPercentile(99.99) / Scale;
+	PercentileStats->P99p999 = (double)Histogram->ValueAtPercentile(99.999) / Scale;
+	PercentileStats->P99p9999 = (double)Histogram->ValueAtPercentile(99.9999) / Scale;
 }
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Config.h"
+
+//
+// A workload spec, given as comma-separated key=value pairs, e.g.
+//   read=70,offset=zipf:0.99,size=mix:4096@80/65536@20,rate=200000
+//
+//   read=P                 percentage of reads, the rest are writes (default 100)
+//   offset=seq             sequential offsets, per connection, wrapping at the end of the file
+//   offset=uniform         uniformly random sector-aligned offsets (default)
+//   offset=zipf:THETA      Zipfian over the sectors of the file, hot sectors scattered over the file
+//   size=N                 all requests of N bytes (default: the message size on the command line)
+//   size=uniform:MIN:MAX   sizes uniform in [MIN, MAX], in sectors when both are sector multiples
+//   size=mix:S@W/S@W/...   sizes S with weights W
+//   rate=R                 open-loop arrivals of R requests per second over all connections;
+//                          0 keeps the closed loop of queue depth batches (default)
+//   arrival=poisson        exponential gaps between open-loop arrivals (default)
+//   arrival=constant       equal gaps between open-loop arrivals
+//   hedge=P                in the open loop, send a batch of reads that has not completed by the P-th percentile
+//                          of the latencies so far to the replica at HEDGE_REPLICA_IP as well, and take
+//                          the first response of each request; 0 never hedges (default)
+//
+//
+enum WorkloadOffsetKind {
+    WORKLOAD_OFFSET_SEQUENTIAL,
+    WORKLOAD_OFFSET_UNIFORM,
+    WORKLOAD_OFFSET_ZIPFIAN
+};
+
+enum WorkloadSizeKind {
+    WORKLOAD_SIZE_FIXED,
+    WORKLOAD_SIZE_UNIFORM,
+    WORKLOAD_SIZE_MIX
+};
+
+struct WorkloadSpec {
+    int ReadPercent;
+    WorkloadOffsetKind OffsetKind;
+    double ZipfTheta;
+    WorkloadSizeKind SizeKind;
+    int MinSize;
+    int MaxSize;
+    vector<int> MixSizes;
+    vector<double> MixWeights;
+    double RateRps;
+    bool PoissonArrivals;
+    double HedgePercentile;
+};
+
+struct WorkloadRequest {
+    uint16_t Op;
+    uint16_t FileId;
+    uint64_t Offset;
+    int Length;
+};
+
+//
+// Parse a workload spec; DefaultSize is the size when the spec has none
+//
+//
+static bool
+ParseWorkloadSpec(
+    const char* Str,
+    int DefaultSize,
+    WorkloadSpec* Spec
+) {
+    Spec->ReadPercent = 100;
+    Spec->OffsetKind = WORKLOAD_OFFSET_UNIFORM;
+    Spec->ZipfTheta = 0.99;
+    Spec->SizeKind = WORKLOAD_SIZE_FIXED;
+    Spec->MinSize = DefaultSize;
+    Spec->MaxSize = DefaultSize;
+    Spec->MixSizes.clear();
+    Spec->MixWeights.clear();
+    Spec->RateRps = 0;
+    Spec->PoissonArrivals = true;
+    Spec->HedgePercentile = 0;
+
+    if (Str == NULL || Str[0] == '\0') {
+        return true;
+    }
+
+    string spec(Str);
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == string::npos) {
+            end = spec.size();
+        }
+        string item = spec.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+
+        size_t eq = item.find('=');
+        if (eq == string::npos) {
+            return false;
+        }
+        string key = item.substr(0, eq);
+        string value = item.substr(eq + 1);
+
+        if (key == "read") {
+            Spec->ReadPercent = atoi(value.c_str());
+            if (Spec->ReadPercent < 0 || Spec->ReadPercent > 100) {
+                return false;
+            }
+        }
+        else if (key == "offset") {
+            if (value == "seq") {
+                Spec->OffsetKind = WORKLOAD_OFFSET_SEQUENTIAL;
+            }
+            else if (value == "uniform") {
+                Spec->OffsetKind = WORKLOAD_OFFSET_UNIFORM;
+            }
+            else if (value.compare(0, 4, "zipf") == 0) {
+                Spec->OffsetKind = WORKLOAD_OFFSET_ZIPFIAN;
+                if (value.size() > 5 && value[4] == ':') {
+                    Spec->ZipfTheta = atof(value.c_str() + 5);
+                }
+                if (Spec->ZipfTheta <= 0 || Spec->ZipfTheta == 1.0) {
+                    return false;
+                }
+            }
+            else {
+                return false;
+            }
+        }
+        else if (key == "size") {
+            if (value.compare(0, 8, "uniform:") == 0) {
+                Spec->SizeKind = WORKLOAD_SIZE_UNIFORM;
+                if (sscanf(value.c_str() + 8, "%d:%d", &Spec->MinSize, &Spec->MaxSize) != 2 ||
+                    Spec->MinSize <= 0 || Spec->MinSize > Spec->MaxSize) {
+                    return false;
+                }
+            }
+            else if (value.compare(0, 4, "mix:") == 0) {
+                Spec->SizeKind = WORKLOAD_SIZE_MIX;
+                const char* p = value.c_str() + 4;
+                while (*p != '\0') {
+                    int size, consumed;
+                    double weight;
+                    if (sscanf(p, "%d@%lf%n", &size, &weight, &consumed) != 2 || size <= 0 || weight < 0) {
+                        return false;
+                    }
+                    Spec->MixSizes.push_back(size);
+                    Spec->MixWeights.push_back(weight);
+                    p += consumed;
+                    if (*p == '/') {
+                        p++;
+                    }
+                }
+                if (Spec->MixSizes.empty()) {
+                    return false;
+                }
+                Spec->MinSize = Spec->MaxSize = Spec->MixSizes[0];
+                for (size_t i = 1; i != Spec->MixSizes.size(); i++) {
+                    if (Spec->MixSizes[i] < Spec->MinSize) {
+                        Spec->MinSize = Spec->MixSizes[i];
+                    }
+                    if (Spec->MixSizes[i] > Spec->MaxSize) {
+                        Spec->MaxSize = Spec->MixSizes[i];
+                    }
+                }
+            }
+            else {
+                Spec->SizeKind = WORKLOAD_SIZE_FIXED;
+                Spec->MinSize = Spec->MaxSize = atoi(value.c_str());
+                if (Spec->MinSize <= 0) {
+                    return false;
+                }
+            }
+        }
+        else if (key == "rate") {
+            Spec->RateRps = atof(value.c_str());
+            if (Spec->RateRps < 0) {
+                return false;
+            }
+        }
+        else if (key == "arrival") {
+            if (value == "poisson") {
+                Spec->PoissonArrivals = true;
+            }
+            else if (value == "constant") {
+                Spec->PoissonArrivals = false;
+            }
+            else {
+                return false;
+            }
+        }
+        else if (key == "hedge") {
+            Spec->HedgePercentile = atof(value.c_str());
+            if (Spec->HedgePercentile < 0 || Spec->HedgePercentile >= 100) {
+                return false;
+            }
+        }
+        else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Zipfian ranks over [0, Items), after Gray et al., "Quickly generating billion-record synthetic databases",
+// as YCSB does; zeta(Items) is computed once, in O(Items)
+//
+//
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(
+        uint64_t Items,
+        double Theta
+    ) : items(Items), theta(Theta), uniform(0.0, 1.0) {
+        zetaN = Zeta(Items, Theta);
+        double zeta2 = Zeta(2, Theta);
+        alpha = 1.0 / (1.0 - Theta);
+        eta = (1.0 - pow(2.0 / (double)Items, 1.0 - Theta)) / (1.0 - zeta2 / zetaN);
+    }
+
+    template <class Engine>
+    uint64_t
+    Next(
+        Engine& Eng
+    ) {
+        double u = uniform(Eng);
+        double uz = u * zetaN;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, theta)) {
+            return 1;
+        }
+        uint64_t rank = (uint64_t)((double)items * pow(eta * u - eta + 1.0, alpha));
+        return rank < items ? rank : items - 1;
+    }
+
+private:
+    static double
+    Zeta(
+        uint64_t N,
+        double Theta
+    ) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= N; i++) {
+            sum += 1.0 / pow((double)i, Theta);
+        }
+        return sum;
+    }
+
+    uint64_t items;
+    double theta;
+    double zetaN;
+    double alpha;
+    double eta;
+    uniform_real_distribution<double> uniform;
+};
+
+//
+// Scatter a rank over [0, Items), so that the hot sectors aren't all at the beginning of the file
+//
+//
+static inline uint64_t
+ScrambleRank(
+    uint64_t Rank,
+    uint64_t Items
+) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i != 8; i++) {
+        hash ^= (Rank >> (i * 8)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash % Items;
+}
+
+//
+// Generate the requests of a connection; FileSize bounds the offsets, so that every request stays in the file
+//
+//
+static void
+GenerateWorkload(
+    const WorkloadSpec* Spec,
+    const int* FileIdList,
+    int NumFiles,
+    uint64_t FileSize,
+    uint64_t NumRequests,
+    uint64_t Seed,
+    WorkloadRequest* Requests
+) {
+    mt19937_64 eng(Seed);
+    uniform_int_distribution<int> percent(0, 99);
+    uniform_int_distribution<int> fileDistr(0, NumFiles - 1);
+    uint64_t sectors = (FileSize - Spec->MaxSize) / SECTOR_SIZE;
+    uniform_int_distribution<uint64_t> sectorDistr(0, sectors - 1);
+    ZipfianGenerator* zipf = NULL;
+    discrete_distribution<int> mixDistr(Spec->MixWeights.begin(), Spec->MixWeights.end());
+    bool inSectors = Spec->MinSize % SECTOR_SIZE == 0 && Spec->MaxSize % SECTOR_SIZE == 0;
+    uniform_int_distribution<int> sizeDistr(inSectors ? Spec->MinSize / SECTOR_SIZE : Spec->MinSize,
+        inSectors ? Spec->MaxSize / SECTOR_SIZE : Spec->MaxSize);
+    uint64_t nextOffset = 0;
+
+    if (Spec->OffsetKind == WORKLOAD_OFFSET_ZIPFIAN) {
+        zipf = new ZipfianGenerator(sectors, Spec->ZipfTheta);
+    }
+
+    for (uint64_t r = 0; r != NumRequests; r++) {
+        WorkloadRequest* req = &Requests[r];
+
+        req->Op = percent(eng) < Spec->ReadPercent ? MESSAGE_OP_READ : MESSAGE_OP_WRITE;
+        req->FileId = (uint16_t)FileIdList[fileDistr(eng)];
+
+        switch (Spec->SizeKind) {
+        case WORKLOAD_SIZE_UNIFORM:
+            req->Length = inSectors ? sizeDistr(eng) * SECTOR_SIZE : sizeDistr(eng);
+            break;
+        case WORKLOAD_SIZE_MIX:
+            req->Length = Spec->MixSizes[mixDistr(eng)];
+            break;
+        default:
+            req->Length = Spec->MaxSize;
+            break;
+        }
+
+        switch (Spec->OffsetKind) {
+        case WORKLOAD_OFFSET_SEQUENTIAL:
+            if (nextOffset + req->Length > FileSize) {
+                nextOffset = 0;
+            }
+            req->Offset = nextOffset;
+            nextOffset = (nextOffset + req->Length + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+            break;
+        case WORKLOAD_OFFSET_ZIPFIAN:
+            req->Offset = ScrambleRank(zipf->Next(eng), sectors) * SECTOR_SIZE;
+            break;
+        default:
+            req->Offset = sectorDistr(eng) * SECTOR_SIZE;
+            break;
+        }
+    }
+
+    delete zipf;
+}
+
+//
+// Print a workload spec
+//
+//
+static void
+PrintWorkloadSpec(
+    const WorkloadSpec* Spec
+) {
+    static const char* offsetKinds[] = { "sequential", "uniform", "zipfian" };
+
+    printf("Workload: %d%% reads, %s offsets", Spec->ReadPercent, offsetKinds[Spec->OffsetKind]);
+    if (Spec->OffsetKind == WORKLOAD_OFFSET_ZIPFIAN) {
+        printf(" (theta = %.2lf)", Spec->ZipfTheta);
+    }
+    printf(", sizes in [%d, %d] bytes, ", Spec->MinSize, Spec->MaxSize);
+    if (Spec->RateRps > 0) {
+        printf("open loop at %.0lf RPS, %s arrivals", Spec->RateRps, Spec->PoissonArrivals ? "Poisson" : "constant");
+        if (Spec->HedgePercentile > 0) {
+            printf(", reads hedged at p%.4g to %s", Spec->HedgePercentile, HEDGE_REPLICA_IP);
+        }
+        printf("\n");
+    }
+    else {
+        printf("closed loop\n");
+    }
+}
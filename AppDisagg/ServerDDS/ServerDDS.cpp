@@ -14,150 +14,317 @@ using std::endl;
 using std::thread;
 using std::this_thread::yield;
 
-// msgSize is HeaderSize * BatchSize
-void HandleFirstMsg(SOCKET clientSocket, int* msgSize) {
+// receive exactly Length bytes, false if the connection failed or was closed
+bool RecvExact(SOCKET clientSocket, char* buffer, int length, bool* closed) {
+    int received = 0;
+    *closed = false;
+    while (received < length) {
+        int iResult = recv(clientSocket, buffer + received, length - received, 0);
+        if (iResult == SOCKET_ERROR) {
+            return false;
+        }
+        else if (iResult == 0) {
+            *closed = true;
+            return false;
+        }
+        received += iResult;
+    }
+    return true;
+}
+
+// the first message carries the batch size and the largest request of the client
+void HandleFirstMsg(SOCKET clientSocket, SessionHeader* session) {
     int iResult = 0;
-    iResult = recv(clientSocket, (char*)msgSize, sizeof(int), 0);
-    if (iResult == SOCKET_ERROR || iResult != sizeof(int)) {
+    iResult = recv(clientSocket, (char*)session, sizeof(SessionHeader), MSG_WAITALL);
+    if (iResult == SOCKET_ERROR || iResult != sizeof(SessionHeader)) {
         cout << "Error receiving the first message: " << WSAGetLastError() << endl;
-        closesocket(clientSocket);
-        WSACleanup();
-        return;
+        session->BatchSize = 0;
+        session->MaxLength = 0;
     }
+}
 
+// issue the read or write of a request, retrying while the front end is full
+ErrorCodeT IssueRequest(DDS_FrontEnd::DDSFrontEnd* Store, MessageHeader* requestMsg, char* payload, char* respBuffer, ServerContext* respCtx) {
+    ErrorCodeT ret;
+    do {
+        // the front end takes the trace id with the I/O slot of the request, so set it for every attempt
+        Store->SetNextIOTraceId(requestMsg->TraceId);
+        if (requestMsg->Op == MESSAGE_OP_WRITE) {
+            ret = Store->WriteFile(requestMsg->FileId, payload, requestMsg->Offset, requestMsg->Length,
+                &respCtx->BytesWritten, NULL, respCtx);
+        }
+        else {
+            ret = Store->ReadFile(requestMsg->FileId, respBuffer + sizeof(MessageHeader), requestMsg->Offset, requestMsg->Length,
+                &respCtx->BytesRead, NULL, respCtx);
+        }
+    } while (ret == DDS_ERROR_CODE_TOO_MANY_REQUESTS || ret == DDS_ERROR_CODE_REQUEST_RING_FAILURE);
+    return ret;
 }
 
+#ifdef SERVER_USE_RIO
+// send responses with RIO from where they are in bufferMem, deferring all but the last, and poll for their completions
+bool SendResponses(ConnectionSender* sender, WSABUF* respBufs, int numBufs, DWORD batchRespSize, WSAOVERLAPPED* overlapped) {
+    RIORESULT results[RIO_DEQUEUE_BATCH_SIZE];
+    for (int b = 0; b < numBufs; b++) {
+        RIO_BUF rioBuf;
+        rioBuf.BufferId = sender->respBufferId;
+        rioBuf.Offset = (ULONG)(respBufs[b].buf - sender->bufferMem);
+        rioBuf.Length = respBufs[b].len;
+        if (!rio.RIOSend(sender->requestQueue, &rioBuf, 1, b == numBufs - 1 ? 0 : RIO_MSG_DEFER, NULL)) {
+            return false;
+        }
+    }
 
-void ThreadFunc(SOCKET clientSocket, DDS_FrontEnd::DDSFrontEnd *Store, int payloadSize, int batchSize, int queueDepth, int clientIndex) {
-    // Initialize context and preallocate memory
-    // total no. of outstanding requests is batch size * queue depth
-    
-    ////for read
-    // int responseSize = sizeof(MessageHeader) + payloadSize;
-    ////for write
-    int responseSize = sizeof(MessageHeader);
+    int completed = 0;
+    DWORD bytesSent = 0;
+    bool succeeded = true;
+    while (completed != numBufs) {
+        ULONG numResults = rio.RIODequeueCompletion(sender->sendCq, results, RIO_DEQUEUE_BATCH_SIZE);
+        if (numResults == RIO_CORRUPT_CQ) {
+            return false;
+        }
+        for (ULONG r = 0; r < numResults; r++) {
+            if (results[r].Status != NO_ERROR) {
+                succeeded = false;
+            }
+            bytesSent += results[r].BytesTransferred;
+        }
+        completed += (int)numResults;
+        if (numResults == 0) {
+            yield();
+        }
+    }
+    return succeeded && bytesSent == batchRespSize;
+}
+#else
+// send responses with one overlapped WSASend and wait for it
+bool SendResponses(ConnectionSender* sender, WSABUF* respBufs, int numBufs, DWORD batchRespSize, WSAOVERLAPPED* overlapped) {
+    DWORD bytesSent = 0;
+    DWORD flags = 0;
+    WSAResetEvent(overlapped->hEvent);
+    int iResult = WSASend(sender->hSocket, respBufs, numBufs, &bytesSent, 0, overlapped, NULL);
+    if (iResult == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING) {
+        iResult = WSAGetOverlappedResult(sender->hSocket, overlapped, &bytesSent, TRUE, &flags) ? 0 : SOCKET_ERROR;
+    }
+    return iResult != SOCKET_ERROR && bytesSent == batchRespSize;
+}
+#endif
+
+// the sender of a connection sends the batches that completion threads push, gathering all the ready batches
+// into one send; a batch's slots are not reused before its response is sent, as the client
+// sends the next requests of a batch only after receiving its response
+void SenderRoutine(ConnectionSender* sender, int queueDepth) {
+    WSABUF* respBufs = new WSABUF[(size_t)sender->batchSize * queueDepth];
+    uint16_t* batchIds = new uint16_t[queueDepth];
+    WSAOVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = WSACreateEvent();
+
+    while (true) {
+        uint32_t pending = sender->pending.load();
+        if (pending == 0) {
+            if (sender->stop.load()) {
+                break;
+            }
+            WaitForSingleObject(sender->readyEvent, INFINITE);
+            continue;
+        }
+
+        // every pushed batch is published before it is counted in pending
+        uint32_t numBatches = 0;
+        DWORD batchRespSize = 0;
+        int numBufs = 0;
+        while (numBatches != pending && sender->readyBatches->Pop(&batchIds[numBatches])) {
+            // every response is its header, followed by the data of a read
+            for (int i = 0; i < sender->batchSize; i++) {
+                char* respBuffer = sender->bufferMem + (size_t)(batchIds[numBatches] * sender->batchSize + i) * sender->slotSize;
+                MessageHeader* respMsg = (MessageHeader*)respBuffer;
+                respBufs[numBufs].buf = respBuffer;
+                respBufs[numBufs].len = (ULONG)(sizeof(MessageHeader) + (respMsg->Op == MESSAGE_OP_READ ? respMsg->Length : 0));
+                batchRespSize += respBufs[numBufs].len;
+                numBufs++;
+            }
+            numBatches++;
+        }
 
-    int batchRespSize = responseSize * batchSize;
+        if (!sender->failed.load()) {
+            if (!SendResponses(sender, respBufs, numBufs, batchRespSize, &overlapped)) {
+                // stop the receiving thread of the connection, which closes the socket
+                cerr << "Error sending response: " << WSAGetLastError() << endl;
+                sender->failed.store(true);
+                shutdown(sender->hSocket, SD_BOTH);
+            }
+            else {
+                int64_t sendEnd = high_resolution_clock::now().time_since_epoch().count();
+                for (int b = 0; b != numBufs; b++) {
+                    MessageHeader* respMsg = (MessageHeader*)respBufs[b].buf;
+                    DDSTraceRecord(sendTraceRings[sender->clientIndex], respMsg->TraceId, DDS_TRACE_HOP_SERVER_SEND, respMsg->BatchId);
+                }
+                for (uint32_t b = 0; b != numBatches; b++) {
+                    connSendBackLatencies[sender->clientIndex]->Record((uint64_t)(sendEnd - sender->batchReadyTimes[batchIds[b]]));
+                }
+                sendCount.fetch_add(numBatches);
+            }
+        }
 
-    char* bufferMem = (char*)_aligned_malloc(batchSize * queueDepth * responseSize, 4096);
-    memset(bufferMem, 0, batchSize * queueDepth * responseSize);
-    ServerContext* serverContexts = (ServerContext*)malloc(batchSize * queueDepth * sizeof(ServerContext));
-    memset(serverContexts, 0, batchSize * queueDepth * sizeof(ServerContext));
-    atomic_uint16_t* batchCompletionCounts = new atomic_uint16_t[queueDepth];
+        sender->pending.fetch_sub(numBatches);
+    }
 
-    // send on the same socket mustn't be concurrent, per windows doc, so needs a lock
-    mutex* socketMutex = new mutex();
+    WSACloseEvent(overlapped.hEvent);
+    delete[] batchIds;
+    delete[] respBufs;
+}
+
+void ThreadFunc(SOCKET clientSocket, DDS_FrontEnd::DDSFrontEnd *Store, int payloadSize, int batchSize, int queueDepth, int clientIndex) {
+    // Initialize context and preallocate memory
+    // total no. of outstanding requests is batch size * queue depth
+    // every request has a slot of the largest request for its payload and for its response,
+    // as writes are issued from the payload and reads land in the response
 
-    int iResult = -1;
     ErrorCodeT ret = -1;
 
     // cout << "Thread for client " << clientIndex << " Waiting for the first message..." << endl;
 
     // Receive the first message
-    int msgSize = 0;
-    HandleFirstMsg(clientSocket, &msgSize);
-    ////for read
-    // int mbatchSize = msgSize / sizeof(MessageHeader);
-    ////for write
-    int mbatchSize = msgSize / (sizeof(MessageHeader) + payloadSize);
-
-    if (mbatchSize != batchSize) {
+    SessionHeader session;
+    HandleFirstMsg(clientSocket, &session);
+
+    if (session.BatchSize != batchSize) {
         cerr << "ERROR: batch size MISMATCH on server and client" << endl;
     }
-    else {
-        // cout << "got batch size from client: " << mbatchSize << endl;
+    if (session.MaxLength < 0 || session.MaxLength > payloadSize) {
+        cerr << "ERROR: client requests up to " << session.MaxLength << " bytes, server serves up to " << payloadSize << endl;
+        closesocket(clientSocket);
+        return;
     }
 
-    char* recvBuffer = new char[msgSize];
-    memset(recvBuffer, 0, msgSize);
-
-    int oneReceive = 0;
-    int remainingBytesToReceive = msgSize;
+    // the slots of a connection take the largest request of its client, not of the server,
+    // so that a server started for bulk transfers of MBs doesn't reserve as much for every small request
+    payloadSize = session.MaxLength;
+    int slotSize = sizeof(MessageHeader) + payloadSize;
+    char* bufferMem = (char*)_aligned_malloc((size_t)batchSize * queueDepth * slotSize, 4096);
+    memset(bufferMem, 0, (size_t)batchSize * queueDepth * slotSize);
+    char* payloadMem = (char*)_aligned_malloc((size_t)batchSize * queueDepth * payloadSize, 4096);
+    ServerContext* serverContexts = (ServerContext*)malloc(batchSize * queueDepth * sizeof(ServerContext));
+    memset(serverContexts, 0, batchSize * queueDepth * sizeof(ServerContext));
+    atomic_uint16_t* batchCompletionCounts = new atomic_uint16_t[queueDepth];
+    for (int q = 0; q < queueDepth; q++) {
+        batchCompletionCounts[q] = 0;
+    }
 
-    int oneSend = 0;
-    int remainingBytesToSend = batchRespSize;
+    // send on the same socket mustn't be concurrent, per windows doc, so the sender of the connection
+    // is the only thread that sends on it, and completion threads hand it the batches that are ready
+    ConnectionSender* sender = new ConnectionSender();
+    sender->hSocket = clientSocket;
+    sender->bufferMem = bufferMem;
+    sender->slotSize = slotSize;
+    sender->batchSize = batchSize;
+    sender->clientIndex = clientIndex;
+    sender->readyBatches = new BatchQueue(queueDepth);
+    sender->batchReadyTimes = new int64_t[queueDepth];
+    sender->pending = 0;
+    sender->readyEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    sender->stop = false;
+    sender->failed = false;
+#ifdef SERVER_USE_RIO
+    // register the response slots, so that responses go to the wire from where DDS put them
+    sender->respBufferId = rio.RIORegisterBuffer(bufferMem, (DWORD)((size_t)batchSize * queueDepth * slotSize));
+    sender->sendCq = rio.RIOCreateCompletionQueue((DWORD)(batchSize * queueDepth), NULL);
+    sender->requestQueue = sender->sendCq == RIO_INVALID_CQ ? RIO_INVALID_RQ :
+        rio.RIOCreateRequestQueue(clientSocket, 1, 1, (ULONG)(batchSize * queueDepth), 1, sender->sendCq, sender->sendCq, sender);
+    if (sender->respBufferId == RIO_INVALID_BUFFERID || sender->requestQueue == RIO_INVALID_RQ) {
+        cerr << "Error setting up RIO for client " << clientIndex << ": " << WSAGetLastError() << endl;
+        closesocket(clientSocket);
+        return;
+    }
+#endif
+    sender->senderThread = new thread([sender, queueDepth]
+        {
+            SenderRoutine(sender, queueDepth);
+        });
 
     bool finished = false;
-    uint64_t recvCount = 0;
+    bool closed = false;
+    MessageHeader requestMsg;
     while (!finished) {
-        // Receive message from client and send response
-
-        while (oneReceive < msgSize) {
-            iResult = recv(clientSocket, recvBuffer + oneReceive, remainingBytesToReceive, 0);
-            recvCount++;
-
-            if (iResult == SOCKET_ERROR) {
-                if ((int64_t)msgProcessedCount[clientIndex] != readNum) {
-                    doWork.store(false);
-                    cout << "Error receiving message: " << WSAGetLastError() << endl;
-                    cout << "msgProcessedCount: " << (int64_t)msgProcessedCount[clientIndex] << endl;
-                }
-                else {
-                    cout << "recv from client but client is finished and closed (conn rest)" << endl;
-                }
+        // Receive a batch of requests, each a header and the payload of a write, and issue them
+        for (int i = 0; i < batchSize; i++) {
+            if (!RecvExact(clientSocket, (char*)&requestMsg, sizeof(MessageHeader), &closed)) {
                 finished = true;
                 break;
             }
-            else if (iResult == 0) {
+
+            if (requestMsg.BatchId >= queueDepth || requestMsg.Length < 0 || requestMsg.Length > payloadSize) {
+                cout << "got a wrong request from client: batch id " << requestMsg.BatchId << ", length " << requestMsg.Length << endl;
                 finished = true;
-                cout << "client closed socket" << endl;
                 break;
             }
+            DDSTraceRecord(recvTraceRings[clientIndex], requestMsg.TraceId, DDS_TRACE_HOP_SERVER_RECV, requestMsg.BatchId);
 
-            oneReceive += iResult;
-            remainingBytesToReceive = msgSize - oneReceive;
-        }
-
-
-
-        if (finished) {
-            break;
-        }
-
-        oneReceive = 0;
-        remainingBytesToReceive = msgSize;
+            int index = (int)(requestMsg.BatchId * batchSize + i);
+            char* payload = payloadMem + (size_t)index * payloadSize;
+            if (requestMsg.Op == MESSAGE_OP_WRITE && !RecvExact(clientSocket, payload, requestMsg.Length, &closed)) {
+                finished = true;
+                break;
+            }
 
+            char* respBuffer = bufferMem + (size_t)index * slotSize;
+            memcpy(respBuffer, &requestMsg, sizeof(MessageHeader));
 
-        // issue file read
-        MessageHeader* requestMsg;
-        for (size_t i = 0; i < batchSize; i++) {
-            requestMsg = (MessageHeader*)(recvBuffer + i * (sizeof(MessageHeader) + payloadSize));
-            
-            if (requestMsg->BatchId > batchSize) {
-                cout << "got wrong batch id from clinet: " << requestMsg->BatchId << endl;
-            }
-            int index = (int)(requestMsg->BatchId * batchSize + i);
-            char* respBuffer = bufferMem + index * responseSize;
-            memcpy(respBuffer, requestMsg, sizeof(MessageHeader));
-            
             ServerContext* respCtx = serverContexts + index;
             respCtx->clientIndex = clientIndex;
             respCtx->ReadStartTime = high_resolution_clock::now().time_since_epoch().count();
             respCtx->hSocket = clientSocket;
-            respCtx->socketMutex = socketMutex;
-            respCtx->BatchId = requestMsg->BatchId;
+            respCtx->sender = sender;
+            respCtx->BatchId = requestMsg.BatchId;
+            respCtx->TraceId = requestMsg.TraceId;
             respCtx->bufferMem = bufferMem;
             respCtx->serverContexts = serverContexts;
             respCtx->batchCompletionCounts = batchCompletionCounts;
-            
-            ////for read
-            // ret = Store->ReadFile(requestMsg->FileId, respBuffer, requestMsg->Offset, payloadSize, &respCtx->BytesRead, NULL, respCtx);
-            ////for write
-            ret = Store->WriteFile(requestMsg->FileId, recvBuffer + i * (sizeof(MessageHeader) + payloadSize) + sizeof(MessageHeader),
-                requestMsg->Offset, payloadSize, &respCtx->BytesWritten, NULL, respCtx);
-
-
-            while (ret == DDS_ERROR_CODE_TOO_MANY_REQUESTS || ret == DDS_ERROR_CODE_REQUEST_RING_FAILURE) {
-                // just retry issuing the write
-                ret = Store->WriteFile(requestMsg->FileId, recvBuffer + i * (sizeof(MessageHeader) + payloadSize) + sizeof(MessageHeader),
-                    requestMsg->Offset, payloadSize, &respCtx->BytesWritten, NULL, respCtx);
+            respCtx->slotSize = slotSize;
+
+            ret = IssueRequest(Store, &requestMsg, payload, respBuffer, respCtx);
+            if (ret != DDS_ERROR_CODE_SUCCESS && ret != DDS_ERROR_CODE_IO_PENDING) {
+                cout << "failed to issue a request: " << ret << endl;
             }
         }
     }
 
+    if (closed) {
+        cout << "client closed socket" << endl;
+    }
+    else if ((int64_t)msgProcessedCount[clientIndex] != readNum) {
+        doWork.store(false);
+        cout << "Error receiving message: " << WSAGetLastError() << endl;
+        cout << "msgProcessedCount: " << (int64_t)msgProcessedCount[clientIndex] << endl;
+    }
+    else {
+        cout << "recv from client but client is finished and closed (conn rest)" << endl;
+    }
+
+    // stop the sender once it sent what is pending
+    sender->stop.store(true);
+    SetEvent(sender->readyEvent);
+    sender->senderThread->join();
+    delete sender->senderThread;
+    CloseHandle(sender->readyEvent);
+    delete sender->readyBatches;
+    delete[] sender->batchReadyTimes;
+#ifndef SERVER_USE_RIO
+    delete sender;
+#endif
+
+    //
+    // Merge the latencies that the completion threads recorded for this connection
+    //
+    //
+    for (int t = 0; t < numCompletionThreads; t++) {
+        connReadLatencies[clientIndex]->Add(readLatencies[t * numConnections + clientIndex]);
+    }
+
     Statistics stats;
     Percentiles PercentileStats;
-    GetStatistics(readLatencies[clientIndex], readNum, &stats, &PercentileStats);
+    GetStatistics(connReadLatencies[clientIndex], 1000.0, &stats, &PercentileStats);
     printf(
         "readLatencies, Thread %d:  Min: %.2lf, Max: %.2lf, 50th: %.2lf, 90th: %.2lf, 99th: %.2lf, 99.9th: %.2lf, 99.99th: %.2lf, StdErr: %.2lf\n",
         clientIndex,
@@ -172,7 +339,7 @@ void ThreadFunc(SOCKET clientSocket, DDS_FrontEnd::DDSFrontEnd *Store, int paylo
     allClientsReadLatencyStats[clientIndex] = stats;
     allClientsReadLatencyPercentiles[clientIndex] = PercentileStats;
 
-    GetStatistics(sendBackLatencies[clientIndex], readNum / batchSize, &stats, &PercentileStats);
+    GetStatistics(connSendBackLatencies[clientIndex], 1000.0, &stats, &PercentileStats);
     printf(
         "send back times, Thread %d:  Min: %.2lf, Max: %.2lf, 50th: %.2lf, 90th: %.2lf, 99th: %.2lf, 99.9th: %.2lf, 99.99th: %.2lf, StdErr: %.2lf\n",
         clientIndex,
@@ -188,13 +355,20 @@ void ThreadFunc(SOCKET clientSocket, DDS_FrontEnd::DDSFrontEnd *Store, int paylo
     allClientsSendBackPercentiles[clientIndex] = PercentileStats;
 
     // Clear buffer
-    delete[] recvBuffer;
+    _aligned_free(payloadMem);
 
     // Close the socket for this client
     ret = closesocket(clientSocket);
     if (ret) {
         cout << "closing socket err: " << WSAGetLastError() << endl;;
     }
+
+#ifdef SERVER_USE_RIO
+    // the request queue is closed with the socket, before its completion queue
+    rio.RIOCloseCompletionQueue(sender->sendCq);
+    rio.RIODeregisterBuffer(sender->respBufferId);
+    delete sender;
+#endif
 }
 
 // 1 thread will run this routine to PollWait the DDS front end IOs
@@ -202,41 +376,31 @@ void ThreadFunc(SOCKET clientSocket, DDS_FrontEnd::DDSFrontEnd *Store, int paylo
 void PollWaitRoutine(DDS_FrontEnd::DDSFrontEnd* Store) {
     PollIdT pollId;
     ErrorCodeT ret = Store->GetDefaultPoll(&pollId);
-    FileIOSizeT bytesServiced;
-    ContextT ctx = nullptr;
-    ContextT pollContext = nullptr;  // should not be used
-    bool pollResult;
+    DDS_FrontEnd::PollCompletionT completions[POLL_WAIT_BATCH_SIZE];
+    size_t numCompletions;
 
     cout << "Pollwait routine running..." << endl;
     while (doWork) {
-        ret = Store->PollWait(pollId, &bytesServiced, &pollContext, &ctx, INFINITE, &pollResult);
-       
-        ret = PostQueuedCompletionStatus(ioCompletionPort, bytesServiced, (ULONG_PTR)ctx, NULL);
-        if (!ret) {
-            DWORD err = GetLastError();
-            if (err == 6) {
-                cout << "completion port closed" << err << endl;
-                break;
-            }
-            else {
-                cout << "Error posting to completion port: " << err << endl;
+        ret = Store->PollWaitBatch(pollId, completions, POLL_WAIT_BATCH_SIZE, INFINITE, &numCompletions);
+
+        for (size_t i = 0; i != numCompletions; i++) {
+            ret = PostQueuedCompletionStatus(ioCompletionPort, completions[i].BytesServiced, (ULONG_PTR)completions[i].IOContext, NULL);
+            if (!ret) {
+                DWORD err = GetLastError();
+                if (err == 6) {
+                    cout << "completion port closed" << err << endl;
+                    return;
+                }
+                else {
+                    cout << "Error posting to completion port: " << err << endl;
+                }
             }
         }
     }
 }
 
 // pollers will run this, the context to get is in the completion key, not overlapped
-void HandleCompletions(int payloadSize, int batchSize, int readNum) {
-    
-    volatile ErrorCodeT iResult2 = 0;
-    int oneSend = 0;
-
-    ////for read
-    // int batchRespSize = (sizeof(MessageHeader) + payloadSize) * batchSize;
-    ////for write
-    int batchRespSize = (sizeof(MessageHeader)) * batchSize;
-    int remainingBytesToSend = batchRespSize;
-
+void HandleCompletions(int threadIndex, int payloadSize, int batchSize, int readNum) {
     DWORD bytesTransferred = 0;
     LPOVERLAPPED overlapped = NULL;  // unused
     uint64_t completionKey = NULL;  // ptr to dds ctx
@@ -257,38 +421,22 @@ void HandleCompletions(int payloadSize, int batchSize, int readNum) {
         // only send ALL responses if whole batch finished
         // ctx->batchCompletionCounts[ctx->BatchId] += 1; // racy!!
         uint16_t completionCount = ctx->batchCompletionCounts[ctx->BatchId].fetch_add(1);
-        atomic_uint64_t processedCount = msgProcessedCount[ctx->clientIndex].fetch_add(1);
-        readLatencies[ctx->clientIndex][processedCount] =
-            (double)(high_resolution_clock::now().time_since_epoch().count() - ctx->ReadStartTime) / 1000;
+        msgProcessedCount[ctx->clientIndex].fetch_add(1);
+        readLatencies[threadIndex * numConnections + ctx->clientIndex]->Record(
+            (uint64_t)(high_resolution_clock::now().time_since_epoch().count() - ctx->ReadStartTime));
+        DDSTraceRecord(completionTraceRings[threadIndex], ctx->TraceId, DDS_TRACE_HOP_SERVER_COMPLETE, ctx->BatchId);
 
         if (completionCount == batchSize - 1) {
-            int bytesSent = 0;
             ctx->batchCompletionCounts[ctx->BatchId].store(0);  // reset
-            char* buf = ctx->bufferMem + (ctx->BatchId * batchRespSize);
 
-            auto sendStart = high_resolution_clock::now().time_since_epoch().count();
-            ctx->socketMutex->lock();  // can't have concurrent sends, other completion threads may also send on same socket
-            
-            while (oneSend < batchRespSize) {
-                bytesSent = send(ctx->hSocket, buf + oneSend, remainingBytesToSend, 0);
-        
-                if (bytesSent == SOCKET_ERROR) {
-                    ctx->socketMutex->unlock();
-                    cerr << "Error sending response: " << WSAGetLastError() << endl;
-                    closesocket(ctx->hSocket);
-                    WSACleanup();
-                    return;
-                }
-                oneSend += bytesSent;
-                remainingBytesToSend = batchRespSize - oneSend;
+            // hand the batch to the sender of the connection; the queue is never full,
+            // as a connection has at most queue depth batches outstanding
+            ConnectionSender* sender = ctx->sender;
+            sender->batchReadyTimes[ctx->BatchId] = high_resolution_clock::now().time_since_epoch().count();
+            sender->readyBatches->Push(ctx->BatchId);
+            if (sender->pending.fetch_add(1) == 0) {
+                SetEvent(sender->readyEvent);
             }
-            ctx->socketMutex->unlock();
-            uint64_t sendC = sendCount.fetch_add(1);
-            sendBackLatencies[ctx->clientIndex][processedCount / batchSize] =
-                (double)(high_resolution_clock::now().time_since_epoch().count() - sendStart) / 1000;
-
-            oneSend = 0;
-            remainingBytesToSend = batchRespSize;
         }
     }
 }
@@ -303,16 +451,28 @@ int RunServer(int payloadSize, int batchSize, int queueDepth, int readNum, int f
     allClientsSendBackStats = new Statistics[nConnections];
     allClientsSendBackPercentiles = new Percentiles[nConnections];
 
+    // every completion thread records into its own histograms, so recording takes no lock
     msgProcessedCount = new atomic_uint64_t[nConnections];
-    readLatencies = new double* [nConnections];
-    sendBackLatencies = new double* [nConnections];
-    int batchNum = readNum / batchSize;
+    numCompletionThreads = nCompletionThreads;
+    numConnections = nConnections;
+    readLatencies = new HdrHistogram* [nCompletionThreads * nConnections];
+    for (int i = 0; i < nCompletionThreads * nConnections; i++) {
+        readLatencies[i] = new HdrHistogram(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+    }
+    completionTraceRings = new DDSTraceRingT* [nCompletionThreads];
+    for (int i = 0; i < nCompletionThreads; i++) {
+        completionTraceRings[i] = DDSTraceRingCreate(i);
+    }
+    recvTraceRings = new DDSTraceRingT* [nConnections];
+    sendTraceRings = new DDSTraceRingT* [nConnections];
+    connReadLatencies = new HdrHistogram* [nConnections];
+    connSendBackLatencies = new HdrHistogram* [nConnections];
     for (int i = 0; i < nConnections; i++) {
         msgProcessedCount[i] = 0;
-        readLatencies[i] = new double[readNum];
-        memset(readLatencies[i], 0, sizeof(double) * readNum);
-        sendBackLatencies[i] = new double[batchNum];
-        memset(sendBackLatencies[i], 0, sizeof(double) * batchNum);
+        connReadLatencies[i] = new HdrHistogram(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+        connSendBackLatencies[i] = new HdrHistogram(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+        recvTraceRings[i] = DDSTraceRingCreate(nCompletionThreads + 2 * i);
+        sendTraceRings[i] = DDSTraceRingCreate(nCompletionThreads + 2 * i + 1);
     }
 
 
@@ -383,10 +543,10 @@ int RunServer(int payloadSize, int batchSize, int queueDepth, int readNum, int f
         });
 
     // setup threads for polling completions (on completion port)
-    for (size_t i = 0; i < nCompletionThreads; i++) {
-        thread* poller = new thread([payloadSize, batchSize, readNum]
+    for (int i = 0; i < nCompletionThreads; i++) {
+        thread* poller = new thread([i, payloadSize, batchSize, readNum]
             {
-                HandleCompletions(payloadSize, batchSize, readNum);
+                HandleCompletions(i, payloadSize, batchSize, readNum);
             });
     }
 
@@ -399,13 +559,30 @@ int RunServer(int payloadSize, int batchSize, int queueDepth, int readNum, int f
     }
 
     // Create a socket for the server
+#ifdef SERVER_USE_RIO
+    // accepted sockets inherit RIO from the listen socket
+    SOCKET listenSocket = WSASocket(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_REGISTERED_IO);
+#else
     SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#endif
     if (listenSocket == INVALID_SOCKET) {
         cout << "Error creating socket: " << WSAGetLastError() << endl;
         WSACleanup();
         return 1;
     }
 
+#ifdef SERVER_USE_RIO
+    GUID rioFunctionTableId = WSAID_MULTIPLE_RIO;
+    DWORD rioBytes = 0;
+    if (WSAIoctl(listenSocket, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &rioFunctionTableId, sizeof(GUID),
+        (void**)&rio, sizeof(rio), &rioBytes, NULL, NULL) != 0) {
+        cout << "Error loading RIO: " << WSAGetLastError() << endl;
+        closesocket(listenSocket);
+        WSACleanup();
+        return 1;
+    }
+#endif
+
     // Set up the address of the server
     sockaddr_in serverAddr;
     serverAddr.sin_family = AF_INET;
@@ -487,6 +664,44 @@ int RunServer(int payloadSize, int batchSize, int queueDepth, int readNum, int f
 
     cout << "SendBack time (avg): mean: " << statsMean << ", p50: " << p50Mean << ", p99.9: " << p99p9Mean << endl;
 
+    //
+    // The percentiles of all the requests, from the merged histograms rather than averaged over connections
+    //
+    //
+    HdrHistogram allReadLatencies(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+    HdrHistogram allSendBackLatencies(LATENCY_HIGHEST_TRACKABLE_NS, LATENCY_SIGNIFICANT_DIGITS);
+    for (i = 0; i < nConnections; i++) {
+        allReadLatencies.Add(connReadLatencies[i]);
+        allSendBackLatencies.Add(connSendBackLatencies[i]);
+    }
+    Statistics allStats;
+    Percentiles allPercentiles;
+    GetStatistics(&allReadLatencies, 1000.0, &allStats, &allPercentiles);
+    cout << "ReadLatency (all): mean: " << allStats.Mean << ", p50: " << allPercentiles.P50 << ", p99.9: " << allPercentiles.P99p9 << endl;
+    GetStatistics(&allSendBackLatencies, 1000.0, &allStats, &allPercentiles);
+    cout << "SendBack time (all): mean: " << allStats.Mean << ", p50: " << allPercentiles.P50 << ", p99.9: " << allPercentiles.P99p9 << endl;
+
+    // the hops of traced requests, for Scripts/DDSTraceToChrome.py; the front end writes its own when it's deleted
+    FILE* traceFile = fopen(SERVER_TRACE_PATH, "w");
+    if (traceFile != NULL) {
+        uint64_t traceEvents = 0;
+        for (i = 0; i < nCompletionThreads; i++) {
+            if (completionTraceRings[i] != NULL) {
+                traceEvents += DDSTraceDump(completionTraceRings[i], "server", traceFile);
+            }
+        }
+        for (i = 0; i < nConnections; i++) {
+            if (recvTraceRings[i] != NULL) {
+                traceEvents += DDSTraceDump(recvTraceRings[i], "server", traceFile);
+            }
+            if (sendTraceRings[i] != NULL) {
+                traceEvents += DDSTraceDump(sendTraceRings[i], "server", traceFile);
+            }
+        }
+        fclose(traceFile);
+        cout << traceEvents << " trace events written to " << SERVER_TRACE_PATH << endl;
+    }
+
     // Disconnect from DPU
     delete store;
 
@@ -519,7 +734,7 @@ int main(
 )
 {
     if (argc == 9) {
-        int readSize = stoi(args[1]);
+        int maxRequestSize = stoi(args[1]);
         int batchSize = stoi(args[2]);
         int queueDepth = stoi(args[3]);
         readNum = stoi(args[4]);
@@ -527,10 +742,11 @@ int main(
         int nFile = stoi(args[6]);
         int nConnections = stoi(args[7]);
         int nCompletionThreads = stoi(args[8]);
-        return RunServer(readSize, batchSize, queueDepth, readNum, fileSize, nFile, nConnections, nCompletionThreads);
+        return RunServer(maxRequestSize, batchSize, queueDepth, readNum, fileSize, nFile, nConnections, nCompletionThreads);
     }
     else {
-        cout << "Server usage: readSize batchSize queueDepth readNum fileSize(GB) nFile nConnections nCompletionThreads" << endl;
+        cout << "Server usage: maxRequestSize batchSize queueDepth readNum fileSize(GB) nFile nConnections nCompletionThreads" << endl;
+        cout << "  every request is a read or a write of up to maxRequestSize bytes, as the client's workload spec says" << endl;
     }
 
     return 0;
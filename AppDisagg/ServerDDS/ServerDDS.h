@@ -8,6 +8,7 @@
 #include <random>
 #include <mutex>
 #include <winsock2.h>
+#include <mswsock.h>
 #include <iostream>
 #include <thread>
 #include <vector>
@@ -30,6 +31,15 @@
 
 // #define N_CONCURRENT_COMPLETION_THREADS 32
 #define FILE_BASE_NAME "random.txt"
+#define POLL_WAIT_BATCH_SIZE 32
+#define LATENCY_HIGHEST_TRACKABLE_NS 10000000000ULL  // 10 s
+#define LATENCY_SIGNIFICANT_DIGITS 3
+
+// send responses with Registered I/O: the response slots, where DDS reads land, are registered with RIO
+// and sent from in place, and the sender polls the completion queue of its connection
+#define SERVER_USE_RIO
+#define RIO_DEQUEUE_BATCH_SIZE 64
+#define SERVER_TRACE_PATH "server_trace.csv"
 
 // assuming only 1 file for now
 // HANDLE* fileHandles;
@@ -39,6 +49,102 @@ FileIdT *fileIds;
 thread** allClientThreads;
 thread* pollWaitThread;
 
+//
+// A bounded lock-free queue of the batches of a connection that are ready to send, after Vyukov's bounded queue:
+// completion threads push, the sender of the connection pops; Capacity is a power of two of at least the queue depth
+//
+//
+struct BatchQueue
+{
+    struct Cell {
+        atomic_uint64_t Sequence;
+        uint16_t BatchId;
+    };
+
+    Cell* Cells;
+    uint64_t Mask;
+    alignas(64) atomic_uint64_t Tail;
+    alignas(64) uint64_t Head;
+
+    BatchQueue(int MinCapacity) {
+        uint64_t capacity = 1;
+        while (capacity < (uint64_t)MinCapacity) {
+            capacity <<= 1;
+        }
+        Cells = new Cell[capacity];
+        for (uint64_t i = 0; i != capacity; i++) {
+            Cells[i].Sequence.store(i, memory_order_relaxed);
+        }
+        Mask = capacity - 1;
+        Tail.store(0, memory_order_relaxed);
+        Head = 0;
+    }
+
+    ~BatchQueue() {
+        delete[] Cells;
+    }
+
+    // any thread; false if the queue is full
+    bool Push(uint16_t BatchId) {
+        uint64_t pos = Tail.load(memory_order_relaxed);
+        for (;;) {
+            Cell* cell = &Cells[pos & Mask];
+            int64_t diff = (int64_t)cell->Sequence.load(memory_order_acquire) - (int64_t)pos;
+            if (diff == 0) {
+                if (Tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell->BatchId = BatchId;
+                    cell->Sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = Tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // the sender only; false if the queue is empty
+    bool Pop(uint16_t* BatchId) {
+        Cell* cell = &Cells[Head & Mask];
+        if (cell->Sequence.load(memory_order_acquire) != Head + 1) {
+            return false;
+        }
+        *BatchId = cell->BatchId;
+        cell->Sequence.store(Head + Mask + 1, memory_order_release);
+        Head++;
+        return true;
+    }
+};
+
+//
+// The send side of a connection: a thread that owns the socket for sending, and gathers all the batches
+// that completed since its last send into one overlapped WSASend, so completion threads never wait on a socket
+//
+//
+struct ConnectionSender
+{
+    SOCKET hSocket;
+    char* bufferMem;
+    int slotSize;
+    int batchSize;
+    int clientIndex;
+    BatchQueue* readyBatches;
+    int64_t* batchReadyTimes;  // of size [queue depth], when a batch completed
+    atomic_uint32_t pending;  // batches pushed but not yet sent; the sender waits on readyEvent at 0
+    HANDLE readyEvent;
+    atomic_bool stop;
+    atomic_bool failed;
+    thread* senderThread;
+#ifdef SERVER_USE_RIO
+    RIO_BUFFERID respBufferId;  // bufferMem
+    RIO_CQ sendCq;
+    RIO_RQ requestQueue;
+#endif
+};
+
 struct ServerContext
 {
     union {
@@ -52,18 +158,32 @@ struct ServerContext
     int64_t ReadStartTime;
     int64_t ReadEndTime;
     int64_t SendBackTime;
+    uint64_t TraceId;  // of the request, 0 if it isn't traced
     // uint16_t Index; // unused
     // the following are per socket data
     SOCKET hSocket;
-    mutex* socketMutex;
+    ConnectionSender* sender;
     char* bufferMem;
     ServerContext* serverContexts;
     int clientIndex;
+    int slotSize;  // the bytes of a response slot in bufferMem, a header and the largest read
 };
 
+#ifdef SERVER_USE_RIO
+RIO_EXTENSION_FUNCTION_TABLE rio;
+#endif
+
 atomic_uint64_t* msgProcessedCount;  // of size [no. connections]
-double** readLatencies;  // of size [no. connections][readNum]
-double** sendBackLatencies;  // of size [no. connections][readNum]
+HdrHistogram** readLatencies;  // of size [no. completion threads * no. connections], in ns
+HdrHistogram** connReadLatencies;  // of size [no. connections], merged when a connection finishes
+HdrHistogram** connSendBackLatencies;  // of size [no. connections], recorded by the sender of the connection
+int numCompletionThreads;
+int numConnections;
+
+// the hops of traced requests, a ring for every thread that records them
+DDSTraceRingT** recvTraceRings;  // of size [no. connections], the receiving thread of a connection
+DDSTraceRingT** sendTraceRings;  // of size [no. connections], the sender of a connection
+DDSTraceRingT** completionTraceRings;  // of size [no. completion threads]
 
 Statistics* allClientsReadLatencyStats;
 Percentiles* allClientsReadLatencyPercentiles;
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+//
+// Request capture: while a capture is on, the front end records every read, write and flush that the application
+// submits and the front end accepts, with its file, offset, size and the time since the capture started,
+// into a binary trace that FrontEndReplay drives open loop against any back end.
+// A trace is a DDSCaptureHeaderT followed by DDSCaptureRecordT records; each thread appends to a buffer
+// of its own, which goes to the trace once full, so the records are in time order per thread only
+//
+//
+#define DDS_CAPTURE_MAGIC "DDSCAPT"
+#define DDS_CAPTURE_VERSION 1
+#define DDS_CAPTURE_BUFFER_RECORDS 4096
+
+#define DDS_CAPTURE_OP_READ 0
+#define DDS_CAPTURE_OP_WRITE 1
+#define DDS_CAPTURE_OP_FLUSH 2
+#define DDS_CAPTURE_OPS 3
+
+static const char* const DDSCaptureOpNames[DDS_CAPTURE_OPS] = {
+    "read",
+    "write",
+    "flush",
+};
+
+typedef struct {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t RecordBytes;
+} DDSCaptureHeaderT;
+
+//
+// A request, at TimeNs since the start of the capture on a monotonic clock;
+// scattered, gathered, zero-copy and batched requests are recorded as plain reads and writes of their bytes
+//
+//
+typedef struct {
+    uint64_t TimeNs;
+    uint64_t Offset;
+    uint32_t Bytes;
+    uint16_t FileId;
+    uint16_t Thread;
+    uint8_t Op;
+    uint8_t Reserved[7];
+} DDSCaptureRecordT;
+
+static inline void
+DDSCaptureHeaderInit(
+    DDSCaptureHeaderT* Header
+) {
+    memset(Header, 0, sizeof(DDSCaptureHeaderT));
+    memcpy(Header->Magic, DDS_CAPTURE_MAGIC, sizeof(DDS_CAPTURE_MAGIC));
+    Header->Version = DDS_CAPTURE_VERSION;
+    Header->RecordBytes = (uint32_t)sizeof(DDSCaptureRecordT);
+}
+
+//
+// Whether a trace starts with a header this build reads
+//
+//
+static inline int
+DDSCaptureHeaderValid(
+    const DDSCaptureHeaderT* Header
+) {
+    return memcmp(Header->Magic, DDS_CAPTURE_MAGIC, sizeof(DDS_CAPTURE_MAGIC)) == 0 &&
+        Header->Version == DDS_CAPTURE_VERSION && Header->RecordBytes == sizeof(DDSCaptureRecordT);
+}
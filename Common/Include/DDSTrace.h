@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//
+// End-to-end request tracing: a client gives 1 in N requests a non-zero trace id, which travels with
+// the request, and every hop the request passes records the time it did into a trace ring of the core
+// (or thread) it ran on; rings have a single producer, take no locks, and keep the latest events.
+// Rings are dumped as text, one event per line, and Scripts/DDSTraceToChrome.py merges the dumps
+// of the processes into a Chrome trace; untraced requests cost a test of the trace id per hop
+//
+//
+#define DDS_TRACE_RING_EVENTS 65536
+#define DDS_TRACE_SAMPLE_EVERY_DEFAULT 1024
+
+//
+// Requests on the host rings carry no trace id, but a traced request has BUFF_MSG_REQUEST_FLAG_TRACED
+// and a tag in its request id; the back end records its hops under this key of the tagged request id,
+// and the collector joins them with the front end hops that recorded the same tagged request id
+//
+//
+#define DDS_TRACE_REQUEST_KEY(TaggedRequestId) (0x8000000000000000ULL | (uint64_t)(TaggedRequestId))
+
+#define DDS_TRACE_HOP_CLIENT_SEND 0
+#define DDS_TRACE_HOP_SERVER_RECV 1
+#define DDS_TRACE_HOP_FE_SUBMIT 2
+#define DDS_TRACE_HOP_BE_REQUEST 3
+#define DDS_TRACE_HOP_BE_COMPLETE 4
+#define DDS_TRACE_HOP_FE_RESPONSE 5
+#define DDS_TRACE_HOP_SERVER_COMPLETE 6
+#define DDS_TRACE_HOP_SERVER_SEND 7
+#define DDS_TRACE_HOP_CLIENT_RECV 8
+#define DDS_TRACE_HOPS 9
+
+static const char* const DDSTraceHopNames[DDS_TRACE_HOPS] = {
+    "client_send",
+    "server_recv",
+    "fe_submit",
+    "be_request",
+    "be_complete",
+    "fe_response",
+    "server_complete",
+    "server_send",
+    "client_recv",
+};
+
+typedef struct {
+    uint64_t TraceId;
+    uint64_t TimeNs;
+    uint32_t Hop;
+    uint32_t Arg;
+} DDSTraceEventT;
+
+typedef struct {
+    volatile uint64_t Head;
+    uint32_t Core;
+    uint32_t Reserved;
+    DDSTraceEventT Events[DDS_TRACE_RING_EVENTS];
+} DDSTraceRingT;
+
+//
+// The wall clock in ns, so that the events of different machines line up as well as their clocks do
+//
+//
+static inline uint64_t
+DDSTraceNow(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline DDSTraceRingT*
+DDSTraceRingCreate(
+    uint32_t Core
+) {
+    DDSTraceRingT* ring = (DDSTraceRingT*)calloc(1, sizeof(DDSTraceRingT));
+    if (ring) {
+        ring->Core = Core;
+    }
+    return ring;
+}
+
+//
+// Whether the Seq-th request is traced, with 1 in SampleEvery traced and none at 0
+//
+//
+static inline int
+DDSTraceSampled(
+    uint64_t Seq,
+    uint32_t SampleEvery
+) {
+    return SampleEvery != 0 && Seq % SampleEvery == 0;
+}
+
+//
+// Record a hop of a traced request; the producer of the ring is the only writer
+//
+//
+static inline void
+DDSTraceRecord(
+    DDSTraceRingT* Ring,
+    uint64_t TraceId,
+    uint32_t Hop,
+    uint32_t Arg
+) {
+    if (TraceId == 0 || Ring == NULL) {
+        return;
+    }
+
+    uint64_t head = Ring->Head;
+    DDSTraceEventT* event = &Ring->Events[head % DDS_TRACE_RING_EVENTS];
+    event->TraceId = TraceId;
+    event->TimeNs = DDSTraceNow();
+    event->Hop = Hop;
+    event->Arg = Arg;
+#ifdef __GNUC__
+    __atomic_store_n(&Ring->Head, head + 1, __ATOMIC_RELEASE);
+#else
+    _ReadWriteBarrier();
+    Ring->Head = head + 1;
+#endif
+}
+
+//
+// Write the events of a ring as "process,core,trace id,hop,time ns,arg" lines; returns the events written
+//
+//
+static inline uint64_t
+DDSTraceDump(
+    const DDSTraceRingT* Ring,
+    const char* Process,
+    FILE* Out
+) {
+    uint64_t head = Ring->Head;
+    uint64_t first = head > DDS_TRACE_RING_EVENTS ? head - DDS_TRACE_RING_EVENTS : 0;
+
+    for (uint64_t e = first; e != head; e++) {
+        const DDSTraceEventT* event = &Ring->Events[e % DDS_TRACE_RING_EVENTS];
+        fprintf(Out, "%s,%u,%llu,%s,%llu,%u\n", Process, Ring->Core, (unsigned long long)event->TraceId,
+            event->Hop < DDS_TRACE_HOPS ? DDSTraceHopNames[event->Hop] : "unknown",
+            (unsigned long long)event->TimeNs, event->Arg);
+    }
+
+    return head - first;
+}
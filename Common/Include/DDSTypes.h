@@ -37,6 +37,7 @@ typedef uint32_t FileCreationDispositionT;
 typedef uint32_t FileIOSizeT;
 typedef uint64_t FileSizeT;
 typedef uint16_t PollIdT;
+typedef uint32_t RingProtocolT;
 typedef uint32_t RingSizeT;
 typedef uint32_t RingSlotSizeT;
 typedef uint16_t RequestIdT;
@@ -52,6 +53,73 @@ enum FilePointerPosition {
     END
 };
 
+//
+// How writes without an offset use the file pointer
+// WRITE_AT_POINTER: write at the pointer and advance it after the write is issued
+// WRITE_APPEND: reserve the range with an atomic fetch-and-add on the pointer before issuing,
+//               so concurrent writers get disjoint ranges without locking
+//
+//
+enum FileWriteMode {
+    WRITE_AT_POINTER,
+    WRITE_APPEND
+};
+
+//
+// When the writes to a file reach the media of the back end
+// DURABILITY_VOLATILE: writes are acknowledged once the device took them, possibly into its volatile cache,
+//                      and FlushFileBuffers only drains the cache of the host
+// DURABILITY_FUA: every write is acknowledged only after the device flushed it to the media
+// DURABILITY_GROUP_COMMIT: writes are acknowledged as in DURABILITY_VOLATILE, and FlushFileBuffers
+//                          flushes the device, sharing one flush with every flush that arrives meanwhile
+//
+//
+enum FileDurability {
+    DURABILITY_VOLATILE,
+    DURABILITY_FUA,
+    DURABILITY_GROUP_COMMIT
+};
+
+//
+// How an application plans to read a file, for the back end to read ahead or not
+// ACCESS_HINT_NORMAL: no plan; the back end doesn't read ahead
+// ACCESS_HINT_SEQUENTIAL: the file is read front to back, so the back end reads ahead of the reads into its memory
+// ACCESS_HINT_RANDOM: the file is read at random, and the back end stops reading ahead
+// ACCESS_HINT_WILLNEED: a range of the file is read soon, so the back end reads it into its memory now;
+//                       the plan of the file is kept
+//
+//
+enum FileAccessHint {
+    ACCESS_HINT_NORMAL,
+    ACCESS_HINT_SEQUENTIAL,
+    ACCESS_HINT_RANDOM,
+    ACCESS_HINT_WILLNEED
+};
+
+//
+// The lease a front end holds of a file shared with other front ends of the same back end
+// LEASE_NONE: no lease; the front end caches nothing of a shared file for long
+// LEASE_READ: no other front end writes the file, and any number of them read it
+// LEASE_WRITE: no other front end reads or writes the file
+//
+//
+enum FileLeaseMode {
+    LEASE_NONE,
+    LEASE_READ,
+    LEASE_WRITE
+};
+
+//
+// Priority class of a poll
+// POLL_PRIORITY_NORMAL: bulk I/O, served with the remaining share of the back end
+// POLL_PRIORITY_HIGH: latency-critical I/O, whose rings the back end drains first
+//
+//
+enum PollPriority {
+    POLL_PRIORITY_NORMAL,
+    POLL_PRIORITY_HIGH
+};
+
 //
 // Properties of a file
 //
@@ -83,6 +151,66 @@ typedef struct {
     BufferT SecondAddr;
 } SplittableBufferT;
 
+//
+// Types of updates to the cache table on the DPU
+// CACHE_UPDATE_ADD: add the key with where its data is, or update it
+// CACHE_UPDATE_DELETE: invalidate the key; only Key is used
+//
+//
+enum CacheUpdateType {
+    CACHE_UPDATE_ADD,
+    CACHE_UPDATE_DELETE
+};
+
+//
+// Keys of the cache table on the DPU are DDS_CACHE_KEY_BYTES wide, 8 or 16 for composite ids;
+// a 16-byte key is KeyHigh:Key
+//
+//
+#define DDS_CACHE_KEY_BYTES 8
+
+//
+// An update to the cache table on the DPU, which maps a key to the Size bytes at Offset in file FileId
+//
+//
+typedef struct {
+    uint64_t Key;
+#if DDS_CACHE_KEY_BYTES == 16
+    uint64_t KeyHigh;
+#endif
+    FileSizeT Offset;
+    FileIOSizeT Size;
+    FileIdT FileId;
+    uint16_t Type;
+} CacheUpdateT;
+
+//
+// A key of the cache table on the DPU, as a read by key names it
+//
+//
+typedef struct {
+    uint64_t Key;
+#if DDS_CACHE_KEY_BYTES == 16
+    uint64_t KeyHigh;
+#endif
+} CacheKeyT;
+
+//
+// A request the DPU served partially for the host, delivered through an offload response ring:
+// the result of the read the DPU issued for it, the client it came from (IPv4, in network order),
+// and where the request and the BytesServiced bytes of data are; in a ring, the request is right after
+// the size of the record and this header, and DataOffset is from the start of the record
+//
+//
+typedef struct {
+    ErrorCodeT Result;
+    uint16_t ClientPort;
+    uint32_t ClientAddr;
+    FileIOSizeT ReqSize;
+    FileIOSizeT DataOffset;
+    FileIOSizeT BytesServiced;
+} OffloadResponseT;
+
 
 //
 // Check a few parameters at the compile time
@@ -102,6 +230,7 @@ typedef struct {
 AssertStaticDDSTypes((1 << sizeof(FileIdT) * 8) - 1 == DDS_FILE_INVALID, 0);
 AssertStaticDDSTypes((1 << sizeof(DirIdT) * 8) - 1 == DDS_DIR_INVALID, 1);
 AssertStaticDDSTypes((1 << sizeof(RequestIdT) * 8) - 1 == DDS_REQUEST_INVALID, 2);
+AssertStaticDDSTypes(DDS_CACHE_KEY_BYTES == 8 || DDS_CACHE_KEY_BYTES == 16, 3);
 
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
@@ -6,4 +6,10 @@
 #pragma once
 
 extern volatile int ForceQuitStorageEngine;
-extern volatile int ForceQuitNetworkEngine;
\ No newline at end of file
+extern volatile int ForceQuitNetworkEngine;
+
+//
+// Set when the storage engine hands over to a new build (DDS_RING_HANDOVER_OFFSET)
+//
+//
+extern volatile int HandOverStorageEngine;
\ No newline at end of file
@@ -5,18 +5,81 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #include "DDSTypes.h"
 #include "MsgTypes.h"
 
 //
-// Context for a pending data plane request from the host
+// A fence of reads behind writes on a range of a file, or of every file if FileId is DDS_FILE_INVALID;
+// Bytes of 0 is no fence
 //
 //
 typedef struct {
-    int IsRead;
-    BuffMsgF2BReqHeader* Request;
+    FileIdT FileId;
+    FileSizeT Offset;
+    FileSizeT Bytes;
+} ReadFenceT;
+
+//
+// Widen a fence to cover another one as well
+//
+//
+static inline void
+MergeReadFence(
+    ReadFenceT* Into,
+    const ReadFenceT* Fence
+) {
+    if (!Into->Bytes) {
+        *Into = *Fence;
+        return;
+    }
+
+    FileSizeT end = Into->Offset + Into->Bytes;
+    if (Fence->Offset + Fence->Bytes > end) {
+        end = Fence->Offset + Fence->Bytes;
+    }
+    if (Fence->Offset < Into->Offset) {
+        Into->Offset = Fence->Offset;
+    }
+    if (Fence->FileId != Into->FileId) {
+        Into->FileId = DDS_FILE_INVALID;
+    }
+    Into->Bytes = end - Into->Offset;
+}
+
+//
+// The parts of a pending data plane request that most requests leave alone, kept out of the line of the context
+//
+//
+typedef struct {
+    ReadFenceT Fence;  // the fence that came right before the request, if Fenced
+    BuffMsgF2BScanHeader Scan;  // the scan a read asks for, if Scanned
+    char* ResponseValue;  // where the response of an append or an atomic operation takes its value
+    BuffMsgF2BAtomicHeader Atomic;  // the atomic operation a write asks for, if AtomicOp
+#ifdef OPT_FILE_SERVICE_REPLICATION
+    uint64_t ReplicaSeq;  // the sequence number of the write at the peer
+    int ReplicaState;  // where the write and its copy at the peer are, see DPUBackEndReplica.h
+    FileIOSizeT ReplicaBytes;  // the bytes of the local write, for whichever side completes it
+#endif
+} DataPlaneRequestColdContext;
+
+//
+// Context for a pending data plane request from the host: what every request touches fits in one cache line,
+// and Cold points to the rest, which the owner of the context sets up once
+//
+//
+typedef struct {
+    _Alignas(DDS_CACHE_LINE_SIZE) BuffMsgF2BReqHeader* Request;
     BuffMsgB2FAckHeader* Response;
     SplittableBufferT DataBuffer;
+    int IsRead;
+    int Durable;  // a write acknowledged once it is flushed to the media
+    bool Fenced;
+    bool Scanned;
+    bool Appended;
+    bool AtomicOp;
+    DataPlaneRequestColdContext* Cold;
 } DataPlaneRequestContext;
 
 //
@@ -45,11 +108,17 @@ typedef struct {
 #pragma warning (disable: 4804)
 #endif
 //
-// Ring space is allocated at the |size of a response| + |header size|
-// The alignment is enforced once a response is inserted into the ring
+// A record of an offload response ring is its size, the response, the request, and the data,
+// and the request starts aligned like the record
+//
+//
+AssertStaticBackEndTypes((sizeof(FileIOSizeT) + sizeof(OffloadResponseT)) % OFFLOAD_RESPONSE_RECORD_ALIGNMENT == 0, 0);
+
+//
+// A data plane request context is one cache line
 //
 //
-AssertStaticBackEndTypes(OFFLOAD_RESPONSE_RING_BYTES % (sizeof(OffloadWorkResponse) + sizeof(FileIOSizeT)) == 0, 0);
+AssertStaticBackEndTypes(sizeof(DataPlaneRequestContext) == DDS_CACHE_LINE_SIZE, 1);
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #else
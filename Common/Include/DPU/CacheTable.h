@@ -5,10 +5,14 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include "BackEndTypes.h"
 
 //
-// Total items allowed in the cache table 
+// Total items allowed in the cache table at its largest
 // Note: 128GB contains 16777216 8KB pages
 //
 //
@@ -17,6 +21,99 @@
 #define CACHE_TABLE_BUCKET_COUNT 8388608
 #define CACHE_TABLE_BUCKET_COUNT_POWER 23
 
+//
+// The table starts with 2^CACHE_TABLE_INITIAL_BUCKET_COUNT_POWER buckets and grows by linear hashing:
+// once its items fill CACHE_TABLE_SPLIT_LOAD_PERCENT of its slots, each addition splits the next
+// CACHE_TABLE_SPLIT_BUCKETS_PER_ADD buckets in two, and an addition that finds no slot
+// splits CACHE_TABLE_SPLIT_BUCKETS_ON_FAILURE more until it does
+//
+//
+#define CACHE_TABLE_INITIAL_BUCKET_COUNT_POWER 16
+#define CACHE_TABLE_SPLIT_LOAD_PERCENT 85
+#define CACHE_TABLE_SPLIT_BUCKETS_PER_ADD 4
+#define CACHE_TABLE_SPLIT_BUCKETS_ON_FAILURE 64
+
+//
+// The buckets are one array, committed on huge pages of this size as the table grows
+//
+//
+#define CACHE_TABLE_HUGE_PAGE_SIZE 2097152
+
+//
+// Eviction keeps the table within a budget of MaxItems items, CACHE_TABLE_DEFAULT_MAX_ITEMS unless
+// SetCacheTableMaxItems sets another, so that it holds the hot part of a working set larger than the budget:
+// an addition at the budget first evicts an item the policy picks, and an addition that finds no slot
+// in a table at its largest evicts from the two buckets of its own key, so additions don't fail under churn
+//
+// CACHE_TABLE_EVICTION chooses the policy: lookups mark the slot of the item they find, with its reference bit
+// for CLOCK, whose hand sweeps the slots and evicts the first item not referenced since the last sweep,
+// or with the current epoch for sampled LRU, which evicts the oldest of CACHE_TABLE_EVICTION_SAMPLES items
+// in buckets picked at random; the epoch advances every MaxItems / CACHE_TABLE_LRU_EPOCHS additions
+// and is 8 bits in the slots, so ages past 255 epochs wrap around
+// With CACHE_TABLE_EVICTION_NONE nothing is marked, and additions fail once the table is full
+//
+//
+#define CACHE_TABLE_EVICTION_NONE 0
+#define CACHE_TABLE_EVICTION_CLOCK 1
+#define CACHE_TABLE_EVICTION_SAMPLED_LRU 2
+
+#ifndef CACHE_TABLE_EVICTION
+#define CACHE_TABLE_EVICTION CACHE_TABLE_EVICTION_CLOCK
+#endif
+
+#define CACHE_TABLE_DEFAULT_MAX_ITEMS CACHE_TABLE_CAPACITY
+#define CACHE_TABLE_EVICTION_SAMPLES 8
+#define CACHE_TABLE_LRU_EPOCHS 64
+
+//
+// Batched lookups prefetch the buckets of this many keys at a time
+//
+//
+#define CACHE_TABLE_LOOKUP_GROUP 16
+
+//
+// Count the lookups of each thread in a slot of its own, and the work of the writer, for GetCacheTableStats;
+// threads past CACHE_TABLE_STATS_SLOTS share slots and may lose counts;
+// insertions are counted by how many items they displaced, in buckets of 0, 1, 2-3, 4-7, ... items
+// Without CACHE_TABLE_STATS_ENABLED the counting compiles away
+//
+//
+#define CACHE_TABLE_STATS_ENABLED
+#define CACHE_TABLE_STATS_SLOTS 64
+#define CACHE_TABLE_STATS_DEPTH_BUCKETS 12
+
+//
+// A snapshot of the table is a file with a header of CACHE_TABLE_SNAPSHOT_HEADER_BYTES
+// followed by the buckets as they are in memory, so that loading it is one sequential read
+// into the buckets, without rehashing; the buckets start page aligned, so the file can also be mapped;
+// CACHE_TABLE_SNAPSHOT_FORMAT changes whenever the layout of the buckets does
+//
+//
+#define CACHE_TABLE_SNAPSHOT_MAGIC 0x54414e5344444344ULL
+#define CACHE_TABLE_SNAPSHOT_FORMAT 2
+#define CACHE_TABLE_SNAPSHOT_HEADER_BYTES 4096
+
+//
+// The hash functions the table can use, chosen by CACHE_TABLE_HASH:
+// Murmur, CRC32C (in hardware on Arm and x86) followed by a finalizer, or XXH3
+//
+//
+#define CACHE_TABLE_HASH_MURMUR 0
+#define CACHE_TABLE_HASH_CRC32C 1
+#define CACHE_TABLE_HASH_XXH3 2
+
+#ifndef CACHE_TABLE_HASH
+#define CACHE_TABLE_HASH CACHE_TABLE_HASH_MURMUR
+#endif
+
+#if CACHE_TABLE_HASH == CACHE_TABLE_HASH_CRC32C
+#define HASH_FUNCTION1(keyptr,keylen,hashv) HASH_CRC32C(keyptr, keylen, hashv, 0x9747b28c)
+#define HASH_FUNCTION2(keyptr,keylen,hashv) HASH_CRC32C(keyptr, keylen, hashv, 0xfeedbeef)
+#elif CACHE_TABLE_HASH == CACHE_TABLE_HASH_XXH3
+#define HASH_FUNCTION1(keyptr,keylen,hashv) HASH_XXH3(keyptr, keylen, hashv, 0x9747b28c)
+#define HASH_FUNCTION2(keyptr,keylen,hashv) HASH_XXH3(keyptr, keylen, hashv, 0xfeedbeef)
+#endif
+
 //
 // Define hash value type
 //
@@ -24,10 +121,17 @@
 typedef uint32_t HashValueT;
 
 //
-// Define key type
+// Define key type, as wide as the keys the host sends (DDS_CACHE_KEY_BYTES);
+// a 16-byte key is one 128-bit integer, so it is compared and copied like an 8-byte one
 //
 //
+#define CACHE_TABLE_KEY_BYTES DDS_CACHE_KEY_BYTES
+
+#if CACHE_TABLE_KEY_BYTES == 16
+typedef unsigned __int128 KeyT;
+#else
 typedef size_t KeyT;
+#endif
 
 //
 // Define cache item type
@@ -50,32 +154,278 @@ typedef struct {
     CacheItemT Item;
     HashValueT Hash1;
     HashValueT Hash2;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-    _Atomic int8_t Occ;
-#endif
 } CacheElementT;
 
 //
-// The header of each bucket, which contains the
-// hash values of all the items in this bucket
+// Store the items compactly, for more of them in the same DRAM: a bucket keeps a 16-bit tag per slot
+// instead of a hash value, and next to the keys, side arrays of 24-bit sizes and of 48-bit offsets
+// packed with 16-bit file ids; the hash values of an item are computed again from its key when it moves,
+// Version is not kept, and an item whose offset or size doesn't fit is not added
+//
+//
+// #define CACHE_TABLE_COMPACT
+#ifdef CACHE_TABLE_COMPACT
+#define CACHE_TABLE_COMPACT_OFFSET_BITS 48
+#define CACHE_TABLE_COMPACT_SIZE_BITS 24
+#endif
+
+#ifdef CACHE_TABLE_COMPACT
+//
+// Define the tag type; a tag is the same in both buckets of an item, and 0 marks an empty slot
+//
+//
+typedef uint16_t CacheTagT;
+
+//
+// Define the bucket type
+// Version is odd while the bucket is being changed, and a reader retries
+// if it was odd or has changed by the time the reader has copied what it needs (seqlock);
+// Recency is the mark of the eviction policy on each slot, which lookups set without changing Version;
+// buckets start on a cache line and span whole ones, so that none straddles a line in the contiguous table
 //
 //
 typedef struct {
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    _Atomic int8_t Occ;
+    _Alignas(DDS_CACHE_LINE_SIZE) _Atomic uint32_t Version;
+    CacheTagT Tags[CACHE_TABLE_BUCKET_SIZE];
+    uint8_t Sizes[CACHE_TABLE_BUCKET_SIZE][CACHE_TABLE_COMPACT_SIZE_BITS / 8];
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    _Atomic uint8_t Recency[CACHE_TABLE_BUCKET_SIZE];
 #endif
+    KeyT Keys[CACHE_TABLE_BUCKET_SIZE];
+    uint64_t Locations[CACHE_TABLE_BUCKET_SIZE];
+} CacheBucketT;
+#else
+//
+// Define the tag type; the tag of an item is its hash value for the bucket it is in, and 0 marks an empty slot
+//
+//
+typedef HashValueT CacheTagT;
+
+//
+// The header of each bucket, which contains the
+// hash values of all the items in this bucket;
+// Version is odd while the bucket is being changed, and a reader retries
+// if it was odd or has changed by the time the reader has copied what it needs (seqlock);
+// Recency is the mark of the eviction policy on each slot, which lookups set without changing Version;
+// buckets start on a cache line and span whole ones, so that none straddles a line in the contiguous table
+//
+//
+typedef struct {
+    _Alignas(DDS_CACHE_LINE_SIZE) _Atomic uint32_t Version;
     HashValueT HashValues[CACHE_TABLE_BUCKET_SIZE];
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    _Atomic uint8_t Recency[CACHE_TABLE_BUCKET_SIZE];
+#endif
     CacheElementT Elements[CACHE_TABLE_BUCKET_SIZE];
 } CacheBucketT;
+#endif
+
+//
+// The tag of an item in the bucket of Hash, Other being its other hash value
+//
+//
+static inline CacheTagT
+CacheTableTag(
+    HashValueT Hash,
+    HashValueT Other
+) {
+#ifdef CACHE_TABLE_COMPACT
+    CacheTagT tag = (CacheTagT)((Hash ^ Other) >> 16);
+    return tag ? tag : 1;
+#else
+    (void)Other;
+    return Hash;
+#endif
+}
+
+//
+// The tags of the slots of a bucket
+//
+//
+static inline CacheTagT*
+CacheBucketTags(
+    CacheBucketT* Bucket
+) {
+#ifdef CACHE_TABLE_COMPACT
+    return Bucket->Tags;
+#else
+    return Bucket->HashValues;
+#endif
+}
+
+//
+// The key in a slot of a bucket
+//
+//
+static inline KeyT
+CacheBucketKey(
+    CacheBucketT* Bucket,
+    int Slot
+) {
+#ifdef CACHE_TABLE_COMPACT
+    return Bucket->Keys[Slot];
+#else
+    return Bucket->Elements[Slot].Item.Key;
+#endif
+}
+
+//
+// Copy the item in a slot of a bucket out
+//
+//
+static inline void
+CopyCacheBucketItem(
+    CacheBucketT* Bucket,
+    int Slot,
+    CacheItemT* Item
+) {
+#ifdef CACHE_TABLE_COMPACT
+    uint32_t size = 0;
+    for (int b = 0; b != CACHE_TABLE_COMPACT_SIZE_BITS / 8; b++) {
+        size |= (uint32_t)Bucket->Sizes[Slot][b] << (b * 8);
+    }
+    Item->Key = Bucket->Keys[Slot];
+    Item->Version = 0;
+    Item->FileId = (FileIdT)Bucket->Locations[Slot];
+    Item->Offset = Bucket->Locations[Slot] >> (64 - CACHE_TABLE_COMPACT_OFFSET_BITS);
+    Item->Size = size;
+#else
+    memcpy(Item, &Bucket->Elements[Slot].Item, sizeof(CacheItemT));
+#endif
+}
+
+//
+// Whether an item can be stored in the table
+//
+//
+static inline bool
+CacheTableItemFits(
+    CacheItemT* Item
+) {
+#ifdef CACHE_TABLE_COMPACT
+    return (Item->Offset >> CACHE_TABLE_COMPACT_OFFSET_BITS) == 0 &&
+        (Item->Size >> CACHE_TABLE_COMPACT_SIZE_BITS) == 0;
+#else
+    (void)Item;
+    return true;
+#endif
+}
+
+//
+// The lookup counters of one thread, on a cache line of their own;
+// Retries counts the probes repeated because a bucket or the displacements changed meanwhile
+//
+//
+typedef struct {
+    _Atomic uint64_t Lookups;
+    _Atomic uint64_t Hits;
+    _Atomic uint64_t Retries;
+    uint64_t Padding[DDS_CACHE_LINE_SIZE_BY_LONGLONG - 3];
+} CacheTableLookupStatsT;
+
+//
+// The counters of the writer; Failures are the additions that returned an error
+//
+//
+typedef struct {
+    _Atomic uint64_t Additions;
+    _Atomic uint64_t Updates;
+    _Atomic uint64_t Deletions;
+    _Atomic uint64_t Failures;
+    _Atomic uint64_t Evictions;
+    _Atomic uint64_t Splits;
+    _Atomic uint64_t Depths[CACHE_TABLE_STATS_DEPTH_BUCKETS];
+} CacheTableWriterStatsT;
+
+//
+// The counters summed over all the threads, with the load factor at the time
+// and the budget of items the hits are had with
+//
+//
+typedef struct {
+    uint64_t Lookups;
+    uint64_t Hits;
+    uint64_t Misses;
+    uint64_t Retries;
+    uint64_t Additions;
+    uint64_t Updates;
+    uint64_t Deletions;
+    uint64_t Failures;
+    uint64_t Evictions;
+    uint64_t Splits;
+    uint64_t Depths[CACHE_TABLE_STATS_DEPTH_BUCKETS];
+    size_t NumItems;
+    size_t MaxItems;
+    size_t NumSlots;
+    double LoadFactor;
+} CacheTableStatsT;
 
 //
 // Define cache table type
+// Table is room for CACHE_TABLE_BUCKET_COUNT contiguous buckets, of which the first TableBytes are mapped,
+// on huge pages of hugetlbfs if any are reserved, or else on transparent huge pages;
+// Layout is the power and split pointer of the linear hashing, see CacheTableBucket;
+// Displacements is odd while an insertion or a split moves items between buckets, when an item can be in neither,
+// so a lookup that misses retries if it was odd or has changed;
+// Changes counts the additions and deletions, so that a snapshot can be skipped if there are none since the last;
+// Epoch is what lookups mark slots with under sampled LRU, next to Layout, which they read anyway;
+// ClockHand, EpochAdditions and EvictionRandom are the state of the eviction policy, kept by the writer
 //
 //
 typedef struct {
-    CacheBucketT** Table;
+    CacheBucketT* Table;
+    void* Reservation;
+    size_t ReservationBytes;
+    size_t TableBytes;
+    bool HugePages;
+    _Atomic uint64_t Layout;
+    _Atomic uint32_t Epoch;
+    size_t NumItems;
+    size_t MaxItems;
+    size_t Changes;
+    _Atomic uint32_t Displacements;
+    size_t ClockHand;
+    size_t EpochAdditions;
+    uint64_t EvictionRandom;
+#ifdef CACHE_TABLE_STATS_ENABLED
+    CacheTableLookupStatsT* LookupStats;
+    _Atomic uint32_t NextLookupStats;
+    CacheTableWriterStatsT WriterStats;
+#endif
 } CacheTableT;
 
+//
+// The header of a snapshot; HashCheck is the hash values of a fixed key,
+// so that a snapshot taken with other hash functions is not loaded
+//
+//
+typedef struct {
+    uint64_t Magic;
+    uint32_t Format;
+    uint32_t BucketBytes;
+    uint32_t BucketSize;
+    HashValueT HashCheck;
+    uint64_t Layout;
+} CacheTableSnapshotHeaderT;
+
+//
+// The bucket of a hash value for a Layout of (Power << 32) | Split:
+// the table has 2^Power buckets and Split more, buckets [0, Split) having been split with [2^Power, 2^Power + Split)
+//
+//
+static inline uint32_t
+CacheTableBucket(
+    uint64_t Layout,
+    HashValueT Hash
+) {
+    uint32_t power = (uint32_t)(Layout >> 32);
+    uint32_t bucket = Hash & ((1U << power) - 1);
+    if (bucket < (uint32_t)Layout) {
+        bucket = Hash & ((2U << power) - 1);
+    }
+    return bucket;
+}
+
 //
 // Global cache table
 //
@@ -92,7 +442,10 @@ InitCacheTable(
 );
 
 //
-// Add an item to the cache table
+// Add an item to the cache table, or update it if its key is there, evicting an item if the table is at its budget;
+// fails only if the item doesn't fit (CacheTableItemFits), or without eviction, if the table is at its largest
+// and no slot can be found
+// Additions and deletions are made by one thread at a time, concurrently with any number of lookups
 //
 //
 int
@@ -101,6 +454,17 @@ AddToCacheTable(
     CacheItemT* Item
 );
 
+//
+// Set the budget of items of the cache table, evicting items down to it;
+// made by the thread that adds and deletes items
+//
+//
+void
+SetCacheTableMaxItems(
+    CacheTableT* CacheTable,
+    size_t MaxItems
+);
+
 //
 // Delete an item from the cache table
 //
@@ -112,13 +476,62 @@ DeleteFromCacheTable(
 );
 
 //
-// Look up the cache table given a key
+// Look up the cache table given a key, and copy the item out if it's there;
+// returns false if it's not
 //
 //
-CacheItemT*
+bool
 LookUpCacheTable(
     CacheTableT* CacheTable,
-    KeyT* Key
+    KeyT* Key,
+    CacheItemT* Item
+);
+
+//
+// Look up NumKeys keys at once, copying the item of Keys[i] to Items[i] if Found[i] is set;
+// returns the number of keys found
+//
+//
+int
+LookUpCacheTableBatch(
+    CacheTableT* CacheTable,
+    KeyT* Keys,
+    int NumKeys,
+    CacheItemT* Items,
+    bool* Found
+);
+
+//
+// Write a snapshot of the cache table to a file, replacing it only once the snapshot is complete;
+// made by the thread that adds and deletes items, so that none are changed meanwhile
+//
+//
+int
+SaveCacheTable(
+    CacheTableT* CacheTable,
+    const char* Path
+);
+
+//
+// Load a snapshot into a cache table that is still empty, before any lookup;
+// the table is left empty if the snapshot is missing or doesn't match this table
+//
+//
+int
+LoadCacheTable(
+    CacheTableT* CacheTable,
+    const char* Path
+);
+
+//
+// Sum up the counters of the cache table; returns -1, with only the number of items
+// and the load factor, if they are compiled out
+//
+//
+int
+GetCacheTableStats(
+    CacheTableT* CacheTable,
+    CacheTableStatsT* Stats
 );
 
 //
@@ -148,6 +561,15 @@ DestroyCacheTable(
 AssertStaticCacheTable(CACHE_TABLE_CAPACITY == CACHE_TABLE_BUCKET_SIZE * CACHE_TABLE_BUCKET_COUNT, 0);
 AssertStaticCacheTable((CACHE_TABLE_BUCKET_SIZE & (CACHE_TABLE_BUCKET_SIZE - 1)) == 0, 1);
 AssertStaticCacheTable(1 << CACHE_TABLE_BUCKET_COUNT_POWER == CACHE_TABLE_BUCKET_COUNT, 2);
+AssertStaticCacheTable(CACHE_TABLE_INITIAL_BUCKET_COUNT_POWER <= CACHE_TABLE_BUCKET_COUNT_POWER, 3);
+AssertStaticCacheTable(sizeof(CacheTableSnapshotHeaderT) <= CACHE_TABLE_SNAPSHOT_HEADER_BYTES, 4);
+AssertStaticCacheTable(sizeof(KeyT) == CACHE_TABLE_KEY_BYTES, 5);
+AssertStaticCacheTable(CACHE_TABLE_DEFAULT_MAX_ITEMS > 0 && CACHE_TABLE_DEFAULT_MAX_ITEMS <= CACHE_TABLE_CAPACITY, 8);
+AssertStaticCacheTable(sizeof(CacheBucketT) % DDS_CACHE_LINE_SIZE == 0, 9);
+#ifdef CACHE_TABLE_COMPACT
+AssertStaticCacheTable(CACHE_TABLE_COMPACT_OFFSET_BITS + sizeof(FileIdT) * 8 == 64, 6);
+AssertStaticCacheTable(CACHE_TABLE_COMPACT_SIZE_BITS % 8 == 0 && CACHE_TABLE_COMPACT_SIZE_BITS <= 32, 7);
+#endif
 
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../Protocol.h"
+
+//
+// The plan of the cores of the DPU (see CORE_ALLOCATION_* in Protocol.h) is checked as the engines start:
+// every thread that polls without sleeping claims its core before it runs there, and a claim fails
+// if another busy-polling thread already has the core, so that a config mistake stops the start
+// instead of leaving two pollers to share a core. Threads that sleep most of the time claim their core
+// as shared, which never fails
+//
+//
+#define CORE_PLAN_MAX_CORES 64
+#define CORE_PLAN_OWNER_CHARS 32
+
+//
+// Claim Core for Owner, a busy-polling thread if BusyPoll; claiming a core again for the same owner is fine.
+// Return 0, -EINVAL if Core is out of range, or -EBUSY if another busy-polling thread has the core
+//
+//
+int
+CorePlanClaim(
+    uint32_t Core,
+    const char* Owner,
+    bool BusyPoll
+);
+
+//
+// Claim Core for Owner as above, then pin the current thread to it
+//
+//
+int
+CorePlanPin(
+    uint32_t Core,
+    const char* Owner,
+    bool BusyPoll
+);
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+//
+// Leveled and rate-limited logging for the data path of the DPU.
+// A site above DPU_LOG_LEVEL compiles to nothing but the type check of its arguments, so traces can stay
+// in the hot path; an enabled site prints at most DPU_LOG_BURST lines every DPU_LOG_INTERVAL_MS
+// and counts the ones it drops, which its next line reports. Sites keep their own counters,
+// so a storm of one message does not silence the others
+//
+//
+#define DPU_LOG_LEVEL_NONE 0
+#define DPU_LOG_LEVEL_ERROR 1
+#define DPU_LOG_LEVEL_WARNING 2
+#define DPU_LOG_LEVEL_NOTICE 3
+#define DPU_LOG_LEVEL_DEBUG 4
+#define DPU_LOG_LEVEL_TRACE 5
+
+#ifndef DPU_LOG_LEVEL
+#define DPU_LOG_LEVEL DPU_LOG_LEVEL_NOTICE
+#endif
+#define DPU_LOG_BURST 16
+#define DPU_LOG_INTERVAL_MS 1000
+
+typedef struct {
+    _Atomic uint64_t WindowStartMs;
+    _Atomic uint32_t Printed;
+    _Atomic uint32_t Suppressed;
+} DPULogSiteT;
+
+static inline uint64_t
+DPULogNowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+//
+// Whether a site may print now; if so, Suppressed is the number of lines it dropped since it last printed
+//
+//
+static inline bool
+DPULogAdmit(
+    DPULogSiteT* Site,
+    uint32_t* Suppressed
+) {
+    uint64_t now = DPULogNowMs();
+    uint64_t windowStart = atomic_load_explicit(&Site->WindowStartMs, memory_order_relaxed);
+
+    if (now - windowStart >= DPU_LOG_INTERVAL_MS &&
+        atomic_compare_exchange_strong_explicit(&Site->WindowStartMs, &windowStart, now,
+            memory_order_relaxed, memory_order_relaxed)) {
+        atomic_store_explicit(&Site->Printed, 0, memory_order_relaxed);
+    }
+
+    if (atomic_fetch_add_explicit(&Site->Printed, 1, memory_order_relaxed) >= DPU_LOG_BURST) {
+        atomic_fetch_add_explicit(&Site->Suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+
+    *Suppressed = atomic_exchange_explicit(&Site->Suppressed, 0, memory_order_relaxed);
+    return true;
+}
+
+#define DPU_LOG_AT(Level, Tag, Fmt, ...) \
+    do { \
+        if ((Level) <= DPU_LOG_LEVEL) { \
+            static DPULogSiteT dpuLogSite; \
+            uint32_t dpuLogSuppressed; \
+            if (DPULogAdmit(&dpuLogSite, &dpuLogSuppressed)) { \
+                if (dpuLogSuppressed) { \
+                    fprintf(stderr, "[%s] %s:%d %s: %u lines suppressed\n", Tag, __FILE__, __LINE__, __func__, \
+                        dpuLogSuppressed); \
+                } \
+                fprintf(stderr, "[%s] %s:%d %s: " Fmt, Tag, __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+            } \
+        } \
+    } while (0)
+
+#define DPULogError(Fmt, ...) DPU_LOG_AT(DPU_LOG_LEVEL_ERROR, "error", Fmt, ##__VA_ARGS__)
+#define DPULogWarning(Fmt, ...) DPU_LOG_AT(DPU_LOG_LEVEL_WARNING, "warning", Fmt, ##__VA_ARGS__)
+#define DPULogNotice(Fmt, ...) DPU_LOG_AT(DPU_LOG_LEVEL_NOTICE, "notice", Fmt, ##__VA_ARGS__)
+#define DPULogDebug(Fmt, ...) DPU_LOG_AT(DPU_LOG_LEVEL_DEBUG, "debug", Fmt, ##__VA_ARGS__)
+#define DPULogTrace(Fmt, ...) DPU_LOG_AT(DPU_LOG_LEVEL_TRACE, "trace", Fmt, ##__VA_ARGS__)
@@ -10,7 +10,65 @@
 #include "Zmalloc.h"
 #include "DataPlaneHandlers.h"
 
-#define WORKER_THREAD_COUNT 1
+//
+// Worker threads of the file service; each block of I/O slots (one per host buffer or DPU slot group)
+// is served by a single worker so that its batches complete in order, and control plane requests go to the first one
+//
+//
+#define WORKER_THREAD_COUNT 2
+#define MAX_WORKER_THREAD_COUNT 16
+#define CONTROL_PLANE_WORKER_ID 0
+
+//
+// Reads offloaded by the network threads go to each worker through a multi-producer ring,
+// which the worker polls in bursts, instead of a message per request
+//
+//
+#define OFFLOAD_RING_ENTRIES 1024
+#define OFFLOAD_RING_BURST OFFLOAD_ENGINE_BATCH_SIZE
+
+#ifdef OPT_FILE_SERVICE_ENCRYPTION
+//
+// With OPT_FILE_SERVICE_ENCRYPTION (the Encryption option of meson), the store is encrypted at rest by a crypto vbdev
+// of SPDK under it, and the file service opens nothing else. The vbdev encrypts the blocks with AES-XTS,
+// tweaked by their addresses, on the accel engines (mlx5 on the DPU); everything above it, the block cache included,
+// sees plaintext. Its key is provisioned with accel_crypto_key_create, in the config or over the RPC socket
+//
+//
+#define DDS_ENCRYPTION_BDEV_MODULE "crypto"
+#endif
+
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+#include "tle_dring.h"
+
+//
+// With OPT_FILE_SERVICE_OFFLOAD_DRING, each range of DDS_DPU_IO_SLOTS_PER_THREAD DPU slots, i.e., each offloading
+// network lcore, has a channel to the worker of its slots. The lcore is the only producer and the worker
+// the only consumer of its dring; the blocks of the dring are allocated with the channel, and the worker returns
+// those it has drained to the lcore through a single-producer single-consumer ring, so neither side
+// touches a mempool or an atomic shared with other lcores
+//
+//
+#define OFFLOAD_CHANNELS DDS_DPU_IO_PARALLELISM
+#define OFFLOAD_CHANNEL_DRB_OBJS OFFLOAD_RING_BURST
+#define OFFLOAD_CHANNEL_DRBS 16
+#define OFFLOAD_CHANNEL_FREE_DRB_ENTRIES (2 * OFFLOAD_CHANNEL_DRBS)
+
+typedef struct {
+    struct tle_dring Ring;
+    struct spdk_ring *FreeDrbs;
+    int WorkerId;
+
+    //
+    // Blocks the lcore took from FreeDrbs but hasn't used yet; only the lcore touches them
+    //
+    //
+    struct tle_drb *CachedDrbs[OFFLOAD_CHANNEL_DRBS];
+    uint32_t NumCachedDrbs;
+
+    void *Drbs;
+} OffloadChannelT;
+#endif
 
 //
 // File service running on the DPU
@@ -28,6 +86,18 @@ typedef struct {
 
     struct spdk_thread *AppThread;
     SPDKContextT *MasterSPDKContext;
+
+    //
+    // Offload rings and their pollers, one per worker; OffloadReady is set once the rings accept requests.
+    // The pollers also drain the offload channels of their workers
+    //
+    //
+    struct spdk_ring **OffloadRings;
+    struct spdk_poller **OffloadPollers;
+    atomic_bool OffloadReady;
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+    OffloadChannelT *OffloadChannels[OFFLOAD_CHANNELS];
+#endif
 } FileService;
 
 extern FileService* FS;
@@ -96,7 +166,7 @@ SubmitControlPlaneRequest(
 );
 
 //
-// Send a data plane request to the file service
+// Send a data plane request to the file service; a batch wraps around the IoSlotSpan slots from IoSlotBase
 //
 //
 #ifdef OPT_FILE_SERVICE_BATCHING
@@ -106,7 +176,8 @@ SubmitDataPlaneRequest(
     DataPlaneRequestContext* Context,
     RequestIdT Index,
     RequestIdT BatchSize,
-    RequestIdT IoSlotBase
+    RequestIdT IoSlotBase,
+    RequestIdT IoSlotSpan
 );
 #else
 void
@@ -116,4 +187,18 @@ SubmitDataPlaneRequest(
     bool IsRead,
     RequestIdT Index
 );
-#endif
\ No newline at end of file
+#endif
+
+//
+// Submit reads offloaded by a network thread directly to the worker of their I/O slots, which must share a block
+// of DDS_MAX_OUTSTANDING_IO slots; the host rings are not involved, and each read completes in its response,
+// which the network thread polls. Returns false if the file service doesn't take offloaded reads yet
+//
+//
+bool
+SubmitOffloadRequests(
+    FileService* FS,
+    DataPlaneRequestContext** Contexts,
+    RequestIdT* Indices,
+    int Count
+);
@@ -201,3 +201,105 @@ do {
   hashv += hashv >> 6;                                                           \
 } while (0)
 
+
+//
+// Hash macros for the short keys of the cache table
+//
+//
+
+//
+// CRC32C of the key, in hardware on Arm with the CRC extension and on x86 with SSE 4.2,
+// then the Murmur3 finalizer, since CRC is linear and the two hash values of a key would
+// otherwise differ by a constant, pairing the same two buckets for every key
+//
+//
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HASH_CRC32C_U64(crc,v) ((crc) = __crc32cd((crc), (v)))
+#define HASH_CRC32C_U8(crc,v) ((crc) = __crc32cb((crc), (v)))
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#define HASH_CRC32C_U64(crc,v) ((crc) = (uint32_t)_mm_crc32_u64((crc), (v)))
+#define HASH_CRC32C_U8(crc,v) ((crc) = _mm_crc32_u8((crc), (v)))
+#else
+#define HASH_CRC32C_U8(crc,v)                                                    \
+do {                                                                             \
+  unsigned _cb_i;                                                                \
+  (crc) ^= (uint8_t)(v);                                                         \
+  for (_cb_i=0; _cb_i < 8U; _cb_i++) {                                           \
+    (crc) = ((crc) >> 1) ^ (0x82f63b78u & (0u - ((crc) & 1u)));                  \
+  }                                                                              \
+} while (0)
+#define HASH_CRC32C_U64(crc,v)                                                   \
+do {                                                                             \
+  unsigned _cw_i;                                                                \
+  uint64_t _cw_v = (v);                                                          \
+  for (_cw_i=0; _cw_i < 8U; _cw_i++) {                                           \
+    HASH_CRC32C_U8(crc, _cw_v >> (_cw_i * 8U));                                  \
+  }                                                                              \
+} while (0)
+#endif
+
+#define HASH_CRC32C(key,keylen,hashv,seed)                                       \
+do {                                                                             \
+  const unsigned char *_hc_key = (const unsigned char*)(key);                    \
+  unsigned _hc_len = (unsigned)(keylen);                                         \
+  uint32_t _hc_crc = 0xffffffffu;                                                \
+  uint64_t _hc_word;                                                             \
+  while (_hc_len >= 8U) {                                                        \
+    memcpy(&_hc_word, _hc_key, sizeof(_hc_word));                                \
+    HASH_CRC32C_U64(_hc_crc, _hc_word);                                          \
+    _hc_key += 8;                                                                \
+    _hc_len -= 8U;                                                               \
+  }                                                                              \
+  while (_hc_len--) {                                                            \
+    HASH_CRC32C_U8(_hc_crc, *_hc_key++);                                         \
+  }                                                                              \
+  hashv = ~_hc_crc ^ (seed);                                                     \
+  hashv ^= hashv >> 16;                                                          \
+  hashv *= 0x85ebca6bu;                                                          \
+  hashv ^= hashv >> 13;                                                          \
+  hashv *= 0xc2b2ae35u;                                                          \
+  hashv ^= hashv >> 16;                                                          \
+} while (0)
+
+//
+// XXH3 (64 bits, with a seed) of a key of 4 to 16 bytes, folded to 32 bits;
+// the constants are the bit flips XXH3 derives from its default secret for these lengths
+//
+//
+#define HASH_XXH3(key,keylen,hashv,seed)                                         \
+do {                                                                             \
+  const unsigned char *_hx_key = (const unsigned char*)(key);                    \
+  uint64_t _hx_len = (uint64_t)(keylen);                                         \
+  uint64_t _hx_seed = (uint64_t)(seed);                                          \
+  uint64_t _hx_h;                                                                \
+  if (_hx_len <= 8U) {                                                           \
+    uint32_t _hx_in1, _hx_in2;                                                   \
+    memcpy(&_hx_in1, _hx_key, sizeof(_hx_in1));                                  \
+    memcpy(&_hx_in2, _hx_key + _hx_len - 4, sizeof(_hx_in2));                    \
+    _hx_seed ^= (uint64_t)__builtin_bswap32((uint32_t)_hx_seed) << 32;           \
+    _hx_h = (_hx_in2 + ((uint64_t)_hx_in1 << 32)) ^                              \
+      (0xc73ab174c5ecd5a2ULL - _hx_seed);                                        \
+    _hx_h ^= ((_hx_h << 49) | (_hx_h >> 15)) ^ ((_hx_h << 24) | (_hx_h >> 40));  \
+    _hx_h *= 0x9fb21c651e98df25ULL;                                              \
+    _hx_h ^= (_hx_h >> 35) + _hx_len;                                            \
+    _hx_h *= 0x9fb21c651e98df25ULL;                                              \
+    _hx_h ^= _hx_h >> 28;                                                        \
+  }                                                                              \
+  else {                                                                         \
+    uint64_t _hx_lo, _hx_hi;                                                     \
+    unsigned __int128 _hx_product;                                               \
+    memcpy(&_hx_lo, _hx_key, sizeof(_hx_lo));                                    \
+    memcpy(&_hx_hi, _hx_key + _hx_len - 8, sizeof(_hx_hi));                      \
+    _hx_lo ^= 0x6782737bea4239b9ULL + _hx_seed;                                  \
+    _hx_hi ^= 0xaf56bc3b0996523aULL - _hx_seed;                                  \
+    _hx_product = (unsigned __int128)_hx_lo * _hx_hi;                            \
+    _hx_h = _hx_len + __builtin_bswap64(_hx_lo) + _hx_hi +                       \
+      ((uint64_t)_hx_product ^ (uint64_t)(_hx_product >> 64));                   \
+    _hx_h ^= _hx_h >> 37;                                                        \
+    _hx_h *= 0x165667919e3779f9ULL;                                              \
+    _hx_h ^= _hx_h >> 32;                                                        \
+  }                                                                              \
+  hashv = (uint32_t)(_hx_h ^ (_hx_h >> 32));                                     \
+} while (0)
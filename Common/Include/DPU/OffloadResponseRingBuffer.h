@@ -5,35 +5,92 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #include "BackEndTypes.h"
-#include "Protocol.h" 
+#include "Protocol.h"
 
 //
-// A ring buffer for storing read responses, owned by a network thread that performs offloading
+// A ring buffer for storing offload responses, owned by a network thread that performs offloading,
+// which reserves records at TailA and releases them, in order, at TailB once their reads complete;
+// the back end writes [TailC, TailB) to the host, with the tail, and reads back the head of the host,
+// below which the ring can be reused; positions only grow, and a position is at its remainder of the ring bytes
 // Tail[0] - TailA
 // Tail[1] - TailB
-// Tail[2] - TailC
+// Synced[0] - TailC
+// Synced[1] - Head
 //
 //
 typedef struct {
-    int Tail[DDS_CACHE_LINE_SIZE_BY_INT];
-    char Buffer[OFFLOAD_RESPONSE_RING_BYTES];
+    _Atomic uint64_t Tail[DDS_CACHE_LINE_SIZE / sizeof(uint64_t)];
+    _Atomic uint64_t Synced[DDS_CACHE_LINE_SIZE / sizeof(uint64_t)];
+    char Buffer[OFFLOAD_RESPONSE_RING_DATA_BYTES];
 } OffloadResponseRingBuffer;
 
 //
-// Allocate a response buffer object
+// The rings, one per network thread that offloads, in DMA-able memory of the network engine,
+// and the buffer they are bound to: a buffer id, or one of the states below
+//
+//
+#define OFFLOAD_RESPONSE_RINGS_UNBOUND -1
+#define OFFLOAD_RESPONSE_RINGS_ABSENT -2
+
+extern OffloadResponseRingBuffer* OffloadResponseRings;
+extern atomic_int OffloadResponseRingsOwner;
+
+//
+// Publish the rings once they are allocated, so that a buffer can bind them
+//
+//
+void
+PublishOffloadResponseRings(
+    OffloadResponseRingBuffer* Rings
+);
+
+//
+// Withdraw the rings before they are freed; return false if a buffer has them, and they must stay
+//
+//
+bool
+WithdrawOffloadResponseRings();
+
+//
+// Bind the rings to a buffer; return false if there are none or another buffer has them
+//
+//
+bool
+BindOffloadResponseRings(
+    int BuffId
+);
+
+//
+// Unbind the rings from a buffer
 //
 //
-OffloadResponseRingBuffer*
-AllocateOffloadResponseBuffer(
-    BufferT BufferAddress
+void
+UnbindOffloadResponseRings(
+    int BuffId
 );
 
 //
-// Deallocate a response queue buffer object
+// Reserve a record of RecordBytes, aligned, in a ring, and write its size at its start;
+// the record ends at *End, after the padding it may need not to wrap; return NULL if there is no room
+//
+//
+char*
+ReserveOffloadResponse(
+    OffloadResponseRingBuffer* RingBuffer,
+    FileIOSizeT RecordBytes,
+    uint64_t* End
+);
+
+//
+// Release the records of a ring up to End, which must be filled in
 //
 //
 void
-DellocateOffloadResponseBuffer(
-    OffloadResponseRingBuffer* RingBuffer
-);
\ No newline at end of file
+CompleteOffloadResponses(
+    OffloadResponseRingBuffer* RingBuffer,
+    uint64_t End
+);
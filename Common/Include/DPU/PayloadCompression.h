@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "../DDSTypes.h"
+
+//
+// Entries of the hash table that the compressor uses to find matches
+//
+//
+#define PAYLOAD_COMPRESSION_HASH_BITS 12
+#define PAYLOAD_COMPRESSION_HASH_ENTRIES (1 << PAYLOAD_COMPRESSION_HASH_BITS)
+
+//
+// Compress SourceBytes bytes of Source into Dest as an LZ4 block;
+// HashTable has PAYLOAD_COMPRESSION_HASH_ENTRIES entries and is only scratch space;
+// return the compressed bytes, or 0 if they would not fit into DestCapacity bytes
+//
+//
+FileIOSizeT
+CompressPayload(
+    const char* Source,
+    FileIOSizeT SourceBytes,
+    char* Dest,
+    FileIOSizeT DestCapacity,
+    uint32_t* HashTable
+);
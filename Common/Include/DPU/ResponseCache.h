@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "BackEndTypes.h"
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+//
+// The versions by which the offload engine tells whether a response it keeps is still good:
+// a response is kept with the version of its location as it was before the data was read, and served only while
+// the version is the same. The thread that updates the cache table bumps the version of the location of every item
+// it adds, so that once the host rewrites an item in place and updates it, or puts another item where one was,
+// the responses of that location are read again. Locations share the RESPONSE_CACHE_VERSION_SLOTS versions,
+// by a hash of their file and offset, which only costs a read now and then.
+// Each file also has a version, which the file service bumps for every write of the file once the write is done
+// and before it is acknowledged, so that the responses of a file are read again after any write to it
+//
+//
+#define RESPONSE_CACHE_VERSION_SLOTS 65536
+
+extern _Atomic uint32_t ResponseCacheVersions[RESPONSE_CACHE_VERSION_SLOTS];
+extern _Atomic uint32_t ResponseCacheFileVersions[DDS_MAX_FILES];
+
+static inline uint32_t
+ResponseCacheVersionSlot(
+    FileIdT FileId,
+    FileSizeT Offset
+) {
+    uint64_t h = (Offset ^ ((uint64_t)FileId << 48)) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(h >> 48) & (RESPONSE_CACHE_VERSION_SLOTS - 1);
+}
+
+//
+// The version of a location, which changes when either that of the location or that of its file does
+//
+//
+static inline uint32_t
+ResponseCacheVersion(
+    FileIdT FileId,
+    FileSizeT Offset
+) {
+    return atomic_load_explicit(&ResponseCacheVersions[ResponseCacheVersionSlot(FileId, Offset)], memory_order_acquire) +
+        atomic_load_explicit(&ResponseCacheFileVersions[FileId % DDS_MAX_FILES], memory_order_acquire);
+}
+
+//
+// Invalidate the responses kept of a location
+//
+//
+static inline void
+InvalidateResponseCache(
+    FileIdT FileId,
+    FileSizeT Offset
+) {
+    atomic_fetch_add_explicit(&ResponseCacheVersions[ResponseCacheVersionSlot(FileId, Offset)], 1, memory_order_release);
+}
+
+//
+// Invalidate the responses kept of a file
+//
+//
+static inline void
+InvalidateResponseCacheFile(
+    FileIdT FileId
+) {
+    atomic_fetch_add_explicit(&ResponseCacheFileVersions[FileId % DDS_MAX_FILES], 1, memory_order_release);
+}
+#endif
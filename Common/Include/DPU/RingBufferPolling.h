@@ -16,6 +16,11 @@
 struct RequestRingBufferBackEnd{
     uint64_t RemoteAddr;
     uint32_t AccessToken;
+
+    //
+    // Bytes of ring data, as negotiated with the host
+    //
+    //
     uint32_t Capacity;
 
     //
@@ -28,18 +33,26 @@ struct RequestRingBufferBackEnd{
     uint32_t WriteMetaSize;
     uint64_t DataBaseAddr;
     int Head;
+
+    //
+    // The parked mark, written right after the head when the ring is parked (RING_BUFFER_REQUEST_DOORBELL)
+    //
+    //
+    int Parked;
 };
 
 //
-// Initialize a buffer
+// Initialize a buffer of Capacity bytes whose ring has RingBytes of data;
+// return -1 if the ring does not fit
 //
 //
-void
+int
 InitializeRequestRingBufferBackEnd(
     struct RequestRingBufferBackEnd* RingBuffer,
     uint64_t RemoteAddr,
     uint32_t AccessToken,
-    uint32_t Capacity
+    uint32_t Capacity,
+    uint32_t RingBytes
 );
 
 //
@@ -85,6 +98,11 @@ InitializeRequestRingBufferLockBasedBackEnd(
 struct ResponseRingBufferBackEnd{
     uint64_t RemoteAddr;
     uint32_t AccessToken;
+
+    //
+    // Bytes of ring data, as negotiated with the host
+    //
+    //
     uint32_t Capacity;
 
     //
@@ -114,29 +132,40 @@ struct ResponseRingBufferBackEnd{
     //
     //
     int TailC;
+
+    //
+    // The handover mark, written to the host right after TailC (DDS_RING_HANDOVER_OFFSET)
+    //
+    //
+    int HandedOver;
 };
 
 //
-// Initialize a buffer
+// Initialize a buffer of Capacity bytes whose ring has RingBytes of data;
+// return -1 if the ring does not fit
 //
 //
-void
+int
 InitializeResponseRingBufferBackEnd(
     struct ResponseRingBufferBackEnd* RingBuffer,
     uint64_t RemoteAddr,
     uint32_t AccessToken,
-    uint32_t Capacity
+    uint32_t Capacity,
+    uint32_t RingBytes
 );
 
 //
-// Initialize a buffer for both request and response buffers
+// Initialize a buffer for both request and response buffers;
+// return -1 if the rings do not fit
 //
 //
-void
+int
 InitializeRingBufferBackEnd(
     struct RequestRingBufferBackEnd* RequestRingBuffer,
     struct ResponseRingBufferBackEnd* ResponseRingBuffer,
     uint64_t RemoteAddr,
     uint32_t AccessToken,
-    uint32_t Capacity
+    uint32_t Capacity,
+    uint32_t RequestRingBytes,
+    uint32_t ResponseRingBytes
 );
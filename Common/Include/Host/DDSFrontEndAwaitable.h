@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "DDSFrontEndInterface.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define DDS_FRONTEND_COROUTINES
+#endif
+#endif
+
+namespace DDS_FrontEnd {
+
+//
+// A read or write whose completion is delivered to the awaiting coroutine;
+// the object lives in the caller (e.g., the coroutine frame), so no memory is allocated per I/O.
+// The I/O is submitted when it is awaited and the coroutine is resumed from the thread that runs
+// PollWait or PollWaitBatch on the file's poll; that loop should ignore the I/O context it gets back.
+// Without coroutine support, submit it with Submit() and check Ready() like a future
+//
+//
+class FileIOAwaitable {
+public:
+    ErrorCodeT Result;
+    FileIOSizeT BytesServiced;
+
+private:
+    DDSFrontEndInterface* FrontEnd;
+    FileIdT FileId;
+    BufferT Buffer;
+    FileSizeT Offset;
+    FileIOSizeT Bytes;
+    bool IsRead;
+    std::atomic<bool> Completed;
+#ifdef DDS_FRONTEND_COROUTINES
+    std::coroutine_handle<> Waiter;
+#endif
+
+    //
+    // Called by the front end when the I/O completes
+    //
+    //
+    static void
+    OnComplete(
+        ErrorCodeT ErrorCode,
+        FileIOSizeT BytesServiced,
+        ContextT Context
+    ) {
+        FileIOAwaitable* io = (FileIOAwaitable*)Context;
+        io->Result = ErrorCode;
+        io->BytesServiced = BytesServiced;
+
+#ifdef DDS_FRONTEND_COROUTINES
+        std::coroutine_handle<> waiter = io->Waiter;
+        io->Completed.store(true, std::memory_order_release);
+        if (waiter) {
+            waiter.resume();
+        }
+#else
+        io->Completed.store(true, std::memory_order_release);
+#endif
+    }
+
+public:
+    FileIOAwaitable(
+        DDSFrontEndInterface* _FrontEnd,
+        FileIdT _FileId,
+        BufferT _Buffer,
+        FileSizeT _Offset,
+        FileIOSizeT _Bytes,
+        bool _IsRead
+    ) : Result(DDS_ERROR_CODE_IO_PENDING), BytesServiced(0), FrontEnd(_FrontEnd), FileId(_FileId),
+        Buffer(_Buffer), Offset(_Offset), Bytes(_Bytes), IsRead(_IsRead), Completed(false) {
+#ifdef DDS_FRONTEND_COROUTINES
+        Waiter = nullptr;
+#endif
+    }
+
+    FileIOAwaitable(const FileIOAwaitable&) = delete;
+    FileIOAwaitable& operator=(const FileIOAwaitable&) = delete;
+
+    //
+    // Submit the I/O; return false if it failed to be submitted,
+    // in which case Result holds the error and no completion follows
+    //
+    //
+    bool
+    Submit() {
+        FileIOSizeT bytesServiced = 0;
+        ErrorCodeT result;
+
+        if (IsRead) {
+            result = FrontEnd->ReadFile(FileId, Buffer, Offset, Bytes, &bytesServiced, OnComplete, this);
+        }
+        else {
+            result = FrontEnd->WriteFile(FileId, Buffer, Offset, Bytes, &bytesServiced, OnComplete, this);
+        }
+
+        if (result != DDS_ERROR_CODE_IO_PENDING) {
+            Result = result;
+            Completed.store(true, std::memory_order_release);
+            return false;
+        }
+
+        return true;
+    }
+
+    //
+    // Check if the I/O has completed
+    //
+    //
+    bool
+    Ready() const {
+        return Completed.load(std::memory_order_acquire);
+    }
+
+#ifdef DDS_FRONTEND_COROUTINES
+    bool
+    await_ready() const noexcept {
+        return false;
+    }
+
+    bool
+    await_suspend(
+        std::coroutine_handle<> Handle
+    ) {
+        //
+        // The waiter is recorded before submitting because the completion may run
+        // on the polling thread before Submit returns; do not touch this object afterwards
+        //
+        //
+        Waiter = Handle;
+        return Submit();
+    }
+
+    ErrorCodeT
+    await_resume() const noexcept {
+        return Result;
+    }
+#endif
+};
+
+#ifdef DDS_FRONTEND_COROUTINES
+//
+// Awaitable read from a file at an offset
+//
+//
+inline FileIOAwaitable
+ReadFileAsync(
+    DDSFrontEndInterface* FrontEnd,
+    FileIdT FileId,
+    BufferT DestBuffer,
+    FileSizeT Offset,
+    FileIOSizeT BytesToRead
+) {
+    return FileIOAwaitable(FrontEnd, FileId, DestBuffer, Offset, BytesToRead, true);
+}
+
+//
+// Awaitable write to a file at an offset
+//
+//
+inline FileIOAwaitable
+WriteFileAsync(
+    DDSFrontEndInterface* FrontEnd,
+    FileIdT FileId,
+    BufferT SourceBuffer,
+    FileSizeT Offset,
+    FileIOSizeT BytesToWrite
+) {
+    return FileIOAwaitable(FrontEnd, FileId, SourceBuffer, Offset, BytesToWrite, false);
+}
+#endif
+
+}
@@ -29,6 +29,185 @@ typedef void (*ReadWriteCallback)(
     ContextT Context
 );
 
+//
+// Called when the back end takes back the lease of a file, before the front end flushes the file and gives it back
+//
+//
+typedef void (*LeaseRevokedCallback)(
+    FileIdT FileId,
+    FileLeaseMode Mode,
+    ContextT Context
+);
+
+//
+// Front-end caching, opted in per file with the attributes given to CreateFile:
+// read-ahead of sequential reads and write-back of adjacent writes on the file pointer;
+// a read or write served by the cache completes synchronously with DDS_ERROR_CODE_SUCCESS
+// and buffered writes reach storage once FlushFileBuffers returns DDS_ERROR_CODE_SUCCESS
+//
+//
+#define DDS_FILE_ATTRIBUTE_READ_AHEAD 0x10000000
+#define DDS_FILE_ATTRIBUTE_WRITE_BACK 0x20000000
+
+//
+// The front end keeps the size of a file, grown by its own writes as they complete;
+// a file that other front ends also write is created with this attribute,
+// and its size is then read from the back end once it is older than a short lease,
+// unless the front end holds a lease of the file (AcquireFileLease)
+//
+//
+#define DDS_FILE_ATTRIBUTE_SHARED 0x08000000
+
+//
+// An opened file, which caches what the I/O path needs
+//
+//
+struct FileHandle;
+typedef FileHandle* FileHandleT;
+
+//
+// A zero-copy view of read data that stays in the response ring until it is released
+//
+//
+typedef struct ZeroCopyReadT {
+    SplittableBufferT Data;
+    PollIdT PollId;
+    size_t Batch;
+} ZeroCopyReadT;
+
+//
+// One read or write of a batch submitted with ReadFileBatch or WriteFileBatch
+//
+//
+typedef struct FileIOBatchEntryT {
+    FileIdT FileId;
+    FileSizeT Offset;
+    FileIOSizeT Bytes;
+    BufferT Buffer;
+    ContextT Context;
+} FileIOBatchEntryT;
+
+//
+// One file of a directory enumeration with FindFiles
+//
+//
+typedef struct DirEntryT {
+    FileIdT FileId;
+    FilePropertiesT Properties;
+} DirEntryT;
+
+//
+// Control operations that can be batched with SubmitControlBatch
+//
+//
+enum ControlOpTypeT {
+    CONTROL_OP_CREATE_FILE,
+    CONTROL_OP_DELETE_FILE,
+    CONTROL_OP_CHANGE_FILE_SIZE,
+    CONTROL_OP_GET_FILE_SIZE,
+    CONTROL_OP_FLUSH_FILE
+};
+
+//
+// One operation of a control batch: a create takes the name, access, share mode and attributes and returns FileId;
+// a delete takes the name; a change of size takes FileId and FileSize, and a get of size takes FileId and returns FileSize;
+// a flush takes FileId and flushes the device under the file, sharing the flush with the flushes that follow it;
+// Result is set once the batch completes, to DDS_ERROR_CODE_NO_COMPLETION if an earlier operation failed
+//
+//
+typedef struct ControlOpT {
+    ControlOpTypeT Type;
+    const char* FileName;
+    FileAccessT DesiredAccess;
+    FileShareModeT ShareMode;
+    FileAttributesT FileAttributes;
+    FileIdT FileId;
+    FileSizeT FileSize;
+    ErrorCodeT Result;
+} ControlOpT;
+
+//
+// How PollWait waits for completions before blocking:
+// spin on the response ring for up to SpinMicroseconds, then yield for YieldMicroseconds;
+// with Adaptive, the spin window follows the observed time between completions;
+// with StageRequests, the reads and writes submitted to the poll, by any thread, are staged and published to the back end
+// in batches, once enough are staged, when a thread waits on the poll, at once while one is waiting, or at FlushRequests;
+// with BacklogRequests, the reads and writes that find no credits left with the back end are queued on the poll
+// and submitted as credits come back, instead of failing with DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+// the data of a queued write is copied, so its buffer can be reused once WriteFile returns, as ever
+//
+//
+typedef struct PollPolicyT {
+    size_t SpinMicroseconds;
+    size_t YieldMicroseconds;
+    bool Adaptive;
+    bool StageRequests;
+    bool BacklogRequests;
+} PollPolicyT;
+
+//
+// A completion harvested by PollWaitBatch
+//
+//
+typedef struct PollCompletionT {
+    ErrorCodeT Result;
+    FileIOSizeT BytesServiced;
+    ContextT FileContext;
+    ContextT IOContext;
+} PollCompletionT;
+
+//
+// Latency histograms are log-linear: latencies below DDS_LATENCY_HISTOGRAM_SUB_BUCKETS ns
+// have a bucket each, and every power of two above is split into DDS_LATENCY_HISTOGRAM_SUB_BUCKETS buckets,
+// so a bucket is within 1 / DDS_LATENCY_HISTOGRAM_SUB_BUCKETS of the latencies it counts
+//
+//
+#define DDS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS 3
+#define DDS_LATENCY_HISTOGRAM_SUB_BUCKETS (1 << DDS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+#define DDS_LATENCY_HISTOGRAM_BUCKETS ((64 - DDS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * DDS_LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+//
+// The smallest latency, in ns, counted by a bucket of a latency histogram
+//
+//
+inline uint64_t
+LatencyBucketLowerBoundNs(
+    size_t Bucket
+) {
+    if (Bucket < DDS_LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return Bucket;
+    }
+
+    size_t shift = Bucket / DDS_LATENCY_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t subBucket = Bucket % DDS_LATENCY_HISTOGRAM_SUB_BUCKETS;
+    return (DDS_LATENCY_HISTOGRAM_SUB_BUCKETS + subBucket) << shift;
+}
+
+//
+// A latency histogram: the number of latencies counted by each bucket, their sum and the largest one
+//
+//
+typedef struct IOLatencyHistogramT {
+    uint64_t Count;
+    uint64_t TotalNs;
+    uint64_t MaxNs;
+    uint64_t Buckets[DDS_LATENCY_HISTOGRAM_BUCKETS];
+} IOLatencyHistogramT;
+
+//
+// Where the time of the reads and writes completed on a poll went:
+// from submission until the request is handed to the back end (inserted into the request ring on the DPU),
+// from then until its response is taken off the response ring, from then until the callback or completion is reported,
+// and from submission until the callback or completion is reported
+//
+//
+typedef struct IOStatisticsT {
+    IOLatencyHistogramT SubmitToRing;
+    IOLatencyHistogramT RingToResponse;
+    IOLatencyHistogramT ResponseToCallback;
+    IOLatencyHistogramT SubmitToCallback;
+} IOStatisticsT;
+
 //
 // The interface of file system control plane
 //
@@ -125,6 +304,129 @@ public:
         FilePointerPosition MoveMethod
     ) = 0;
 
+    //
+    // Set how writes without an offset use the file pointer
+    // 
+    //
+    virtual
+    ErrorCodeT
+    SetFileWriteMode(
+        FileIdT FileId,
+        FileWriteMode Mode
+    ) = 0;
+
+    //
+    // Set whether the back end may compress the data read from a file,
+    // trading its idle cores and the decompression on the host for fewer bytes on the links;
+    // it applies to plain reads into a buffer and is ignored by back ends without compression
+    // 
+    //
+    virtual
+    ErrorCodeT
+    SetFileCompression(
+        FileIdT FileId,
+        bool Enabled
+    ) = 0;
+
+    //
+    // Set when the writes to a file become durable and what FlushFileBuffers does to the device
+    // 
+    //
+    virtual
+    ErrorCodeT
+    SetFileDurability(
+        FileIdT FileId,
+        FileDurability Mode
+    ) = 0;
+
+    //
+    // Limit the I/O of a file on the back end to BytesPerSecond, with bursts of up to BurstBytes
+    // (0 for a default), or lift the limit if BytesPerSecond is 0; requests held back by limits are issued
+    // in proportion to the weights of their files; the limit applies to the I/O of every host
+    // 
+    //
+    virtual
+    ErrorCodeT
+    SetFileQoS(
+        FileIdT FileId,
+        uint64_t BytesPerSecond,
+        uint64_t BurstBytes,
+        uint32_t Weight
+    ) = 0;
+
+    //
+    // Take a read-only snapshot of a file as a new file named SnapshotName, which shares the data of the file
+    // on the back end until either is written; a write to the file after the snapshot doesn't change the snapshot
+    // 
+    //
+    virtual
+    ErrorCodeT
+    CreateSnapshot(
+        FileIdT FileId,
+        const char* SnapshotName,
+        FileIdT* SnapshotFileId
+    ) = 0;
+
+    //
+    // Tell the back end how a file will be read, for it to read ahead into its memory or not;
+    // Offset and Bytes give the range of ACCESS_HINT_WILLNEED and are ignored by the other hints
+    // 
+    //
+    virtual
+    ErrorCodeT
+    SetFileAccessHint(
+        FileIdT FileId,
+        FileAccessHint Hint,
+        FileSizeT Offset,
+        FileSizeT Bytes
+    ) = 0;
+
+    //
+    // Take a lease of a file shared with the other front ends of the back end, or change its mode;
+    // while it lasts, the front end trusts the size it keeps of the file. DDS_ERROR_CODE_LEASE_HELD means
+    // other front ends hold leases in the way, which the back end revokes; ask again after a while.
+    // Callback runs on the thread of RenewFileLeases when the lease is revoked or ends
+    // 
+    //
+    virtual
+    ErrorCodeT
+    AcquireFileLease(
+        FileIdT FileId,
+        FileLeaseMode Mode,
+        LeaseRevokedCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Flush a file and give back its lease
+    // 
+    //
+    virtual
+    ErrorCodeT
+    ReleaseFileLease(
+        FileIdT FileId
+    ) = 0;
+
+    //
+    // Renew the leases of the front end, and give back those the back end revoked once their callbacks ran,
+    // the caches of their files are flushed and dropped; a front end holding leases calls it
+    // every DDS_FILE_LEASE_RENEW_MS or so, or its leases end
+    // 
+    //
+    virtual
+    ErrorCodeT
+    RenewFileLeases() = 0;
+
+    //
+    // Compile and load a scan function on the back end, which names it by ScanId in later scans
+    // 
+    //
+    virtual ErrorCodeT
+    LoadScanFunction(
+        const char* CodePath,
+        uint16_t* ScanId
+    ) = 0;
+
     //
     // Get file size
     // 
@@ -217,6 +519,97 @@ public:
         ContextT Context
     ) = 0;
 
+    //
+    // Async read from a file without copying;
+    // on completion, Response views the data in the response ring until ReleaseResponse
+    // 
+    //
+    virtual
+    ErrorCodeT
+    ReadFileZeroCopy(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT BytesToRead,
+        ZeroCopyReadT* Response,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Release the data of a completed zero-copy read back to the response ring
+    // 
+    //
+    virtual
+    ErrorCodeT
+    ReleaseResponse(
+        ZeroCopyReadT* Response
+    ) = 0;
+
+    //
+    // Async read of the item a key maps to in the cache table on the DPU, which looks the key up
+    // and reads the item in the same step; the completion arrives on the poll PollId
+    // 
+    //
+    virtual
+    ErrorCodeT
+    GetByKey(
+        PollIdT PollId,
+        const CacheKeyT* Key,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        FileIOSizeT* BytesRead,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Async scan of Bytes of a file from Offset in records of RecordBytes with a loaded scan function;
+    // only what the function keeps of the records is read into the destination
+    // 
+    //
+    virtual ErrorCodeT
+    ScanFile(
+        FileIdT FileId,
+        uint16_t ScanId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        FileIOSizeT RecordBytes,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        FileIOSizeT* BytesRead,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Async reads of a batch of entries, submitted to the back end at once;
+    // all entries must be on the same poll, and NumSubmitted tells how many leading
+    // entries were submitted when I/O slots run out
+    // 
+    //
+    virtual
+    ErrorCodeT
+    ReadFileBatch(
+        FileIOBatchEntryT* Entries,
+        size_t NumEntries,
+        size_t* NumSubmitted,
+        ReadWriteCallback Callback
+    ) = 0;
+
+    //
+    // Async writes of a batch of entries, submitted to the back end at once;
+    // same rules as ReadFileBatch
+    // 
+    //
+    virtual
+    ErrorCodeT
+    WriteFileBatch(
+        FileIOBatchEntryT* Entries,
+        size_t NumEntries,
+        size_t* NumSubmitted,
+        ReadWriteCallback Callback
+    ) = 0;
+
     //
     // Async read from a file with scattering
     // 
@@ -266,7 +659,104 @@ public:
     ) = 0;
 
     //
-    // Flush buffered data to storage
+    // Open a handle to a file for I/O;
+    // the handle stays valid until the file is deleted
+    // 
+    //
+    virtual
+    ErrorCodeT
+    OpenFileHandle(
+        FileIdT FileId,
+        FileHandleT* Handle
+    ) = 0;
+
+    //
+    // Async read from an opened file with offset
+    // 
+    //
+    virtual
+    ErrorCodeT
+    ReadFileAt(
+        FileHandleT Handle,
+        BufferT DestBuffer,
+        FileSizeT Offset,
+        FileIOSizeT BytesToRead,
+        FileIOSizeT* BytesRead,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Async write to an opened file with offset
+    // 
+    //
+    virtual
+    ErrorCodeT
+    WriteFileAt(
+        FileHandleT Handle,
+        BufferT SourceBuffer,
+        FileSizeT Offset,
+        FileIOSizeT BytesToWrite,
+        FileIOSizeT* BytesWritten,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Async append to an opened file: the back end writes the data at the end of the file
+    // and grows the file past it in one step, so that concurrent appends never overlap;
+    // on success, AppendedOffset, if not null, takes the offset the data landed at
+    // 
+    //
+    virtual
+    ErrorCodeT
+    AppendFile(
+        FileHandleT Handle,
+        BufferT SourceBuffer,
+        FileIOSizeT BytesToWrite,
+        FileSizeT* AppendedOffset,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Async compare-and-swap of the 8-byte aligned word at Offset of an opened file, run by the back end
+    // one at a time with the other atomic operations of the file: the word becomes Desired if it is Expected;
+    // on success, Prior, if not null, takes the value the word had, which is Expected if it was swapped
+    // 
+    //
+    virtual
+    ErrorCodeT
+    CompareAndSwapFile(
+        FileHandleT Handle,
+        FileSizeT Offset,
+        uint64_t Expected,
+        uint64_t Desired,
+        uint64_t* Prior,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Async fetch-and-add of the 8-byte aligned word at Offset of an opened file, run by the back end
+    // one at a time with the other atomic operations of the file: Addend is added to the word, wrapping around;
+    // on success, Prior, if not null, takes the value the word had
+    // 
+    //
+    virtual
+    ErrorCodeT
+    FetchAndAddFile(
+        FileHandleT Handle,
+        FileSizeT Offset,
+        uint64_t Addend,
+        uint64_t* Prior,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Flush buffered data to storage;
+    // returns DDS_ERROR_CODE_IO_PENDING while write-backs are in flight, keep polling and call it again
     // 
     //
     virtual
@@ -275,6 +765,20 @@ public:
         FileIdT FileId
     ) = 0;
 
+    //
+    // Order the reads of a file issued after this call on the calling thread
+    // behind the writes it issued before that overlap them, from Offset for Bytes;
+    // other reads and writes are not held up and no completion is posted for the fence
+    // 
+    //
+    virtual
+    ErrorCodeT
+    FenceFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes
+    ) = 0;
+
     //
     // Search a directory for a file or subdirectory
     // with a name that matches a specific name
@@ -300,6 +804,25 @@ public:
         FileIdT* FileId
     ) = 0;
 
+    //
+    // Enumerate the files of a directory (the root if PathName is NULL) whose names match Pattern,
+    // where '*' matches any run of characters and '?' any one character (NULL matches every name),
+    // filling up to MaxEntries entries with the properties of the files;
+    // *Cursor is DDS_FILE_INVALID to start and is left at the last file returned while more files match,
+    // or at DDS_FILE_INVALID once the directory is exhausted
+    //
+    //
+    virtual
+    ErrorCodeT
+    FindFiles(
+        const char* PathName,
+        const char* Pattern,
+        FileIdT* Cursor,
+        DirEntryT* Entries,
+        size_t MaxEntries,
+        size_t* NumEntries
+    ) = 0;
+
     //
     // Get file properties by file id
     // 
@@ -383,6 +906,105 @@ public:
         const char* NewFileName
     ) = 0;
 
+    //
+    // Keep the cache table on the DPU in sync with the application's data:
+    // add or update where the data of keys is, or invalidate keys, in one round trip per batch;
+    // the updates are applied in order, stopping at the first that fails, whose error is returned
+    //
+    //
+    virtual
+    ErrorCodeT
+    UpdateCacheTable(
+        const CacheUpdateT* Updates,
+        size_t NumUpdates
+    ) = 0;
+
+    //
+    // Send up to CTRL_MSG_BATCH_MAX_OPS control operations to the back end in one message and return without waiting;
+    // the back end runs them in order and stops at the first that fails;
+    // one batch is outstanding at a time, and other control operations wait for it first
+    //
+    //
+    virtual
+    ErrorCodeT
+    SubmitControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps
+    ) = 0;
+
+    //
+    // Check for the completion of the outstanding batch, or wait for it, and set the results of its operations;
+    // returns the error of the operation that failed, if any
+    //
+    //
+    virtual
+    ErrorCodeT
+    PollControlBatch(
+        bool Wait,
+        bool* Completed
+    ) = 0;
+
+    //
+    // Run any number of control operations in batches, one round trip per CTRL_MSG_BATCH_MAX_OPS of them;
+    // stops at the first that fails and returns its error
+    //
+    //
+    virtual
+    ErrorCodeT
+    RunControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps
+    ) = 0;
+
+    //
+    // Create a file without waiting for the back end: FileId is set at once, and the completion is reported
+    // by the poll PollId, with IOContext set to Context and no file context, once the back end has created it,
+    // or with the file gone again if it could not; the control operations of the async calls of every poll
+    // go to the back end in batches, so that many of them take about one round trip
+    //
+    //
+    virtual
+    ErrorCodeT
+    CreateFileAsync(
+        const char* FileName,
+        FileAccessT DesiredAccess,
+        FileShareModeT ShareMode,
+        FileAttributesT FileAttributes,
+        FileIdT* FileId,
+        PollIdT PollId,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Delete a file without waiting for the back end; the file leaves the front end once the back end has deleted it,
+    // and the completion is reported by the poll PollId as with CreateFileAsync
+    //
+    //
+    virtual
+    ErrorCodeT
+    DeleteFileAsync(
+        const char* FileName,
+        PollIdT PollId,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
+    //
+    // Get the size of a file without waiting for the back end; FileSize is set before the completion is reported
+    // by the poll PollId as with CreateFileAsync, right away if the front end knows the size
+    //
+    //
+    virtual
+    ErrorCodeT
+    GetFileSizeAsync(
+        FileIdT FileId,
+        FileSizeT* FileSize,
+        PollIdT PollId,
+        ReadWriteCallback Callback,
+        ContextT Context
+    ) = 0;
+
     //
     // Get the default poll structure for async I/O
     //
@@ -403,6 +1025,18 @@ public:
         PollIdT* PollId
     ) = 0;
 
+    //
+    // Create a poll structure for async I/O of a priority class;
+    // the poll has its own rings, which the back end serves by priority
+    //
+    //
+    virtual
+    ErrorCodeT
+    PollCreate(
+        PollIdT* PollId,
+        PollPriority Priority
+    ) = 0;
+
     //
     // Delete a poll structure
     //
@@ -414,7 +1048,10 @@ public:
     ) = 0;
 
     //
-    // Add a file to a pool
+    // Add a file to a poll, which its later I/Os are submitted to: they go through the rings of that poll,
+    // and the back end answers them in its response ring, so that every poll, e.g., one per tenant or class of work,
+    // reports only the completions of its own files, with FileContext; I/Os in flight complete on the poll
+    // they were submitted to, and a file goes back to the default poll when its poll is deleted
     //
     //
     virtual
@@ -425,6 +1062,101 @@ public:
         ContextT FileContext
     ) = 0;
 
+    //
+    // Set the waiting policy of a poll
+    //
+    //
+    virtual
+    ErrorCodeT
+    PollSetPolicy(
+        PollIdT PollId,
+        const PollPolicyT* Policy
+    ) = 0;
+
+    //
+    // Publish the reads and writes staged on a poll
+    // whose policy stages requests, and those the poll has queued for lack of credits
+    //
+    //
+    virtual
+    ErrorCodeT
+    FlushRequests(
+        PollIdT PollId
+    ) = 0;
+
+    //
+    // Register an application buffer with a poll so that reads into it,
+    // and scattered reads into its pages, are written in place by the back end;
+    // call it while no I/O is outstanding on the poll
+    //
+    //
+    virtual
+    ErrorCodeT
+    RegisterScatterBuffer(
+        PollIdT PollId,
+        BufferT Buffer,
+        size_t Bytes
+    ) = 0;
+
+    //
+    // Register a GPU buffer, allocated with cudaMalloc or the like, with a poll so that reads into it
+    // are written in place by the back end through GPUDirect RDMA, with no copy through host memory;
+    // it needs the peer memory module of the GPU (nvidia-peermem) on the host, and the DPU back end over Verbs.
+    // A read into it is never cached, compressed, traced, batched, or read by key; a read the back end
+    // cannot write in place completes with DDS_ERROR_CODE_TOO_MANY_REQUESTS to be issued again.
+    // The writes of the NIC may reach the GPU after the completion of the read, so flush them
+    // (cuFlushGPUDirectRDMAWrites) before a kernel reads the data.
+    // Unregister it with UnregisterScatterBuffer; call it while no I/O is outstanding on the poll
+    //
+    //
+    virtual
+    ErrorCodeT
+    RegisterDeviceBuffer(
+        PollIdT PollId,
+        BufferT Buffer,
+        size_t Bytes
+    ) = 0;
+
+    //
+    // Unregister an application buffer from a poll;
+    // call it while no I/O is outstanding on the poll
+    //
+    //
+    virtual
+    ErrorCodeT
+    UnregisterScatterBuffer(
+        PollIdT PollId,
+        BufferT Buffer
+    ) = 0;
+
+    //
+    // Bind the offload response rings of the DPU to a poll: the requests the offload function reads for the host
+    // are then delivered with their data through PollWaitOffload, instead of being forwarded as they are;
+    // one poll has the rings at a time, until it is deleted; call it while no I/O is outstanding on the poll
+    //
+    //
+    virtual
+    ErrorCodeT
+    BindOffloadResponses(
+        PollIdT PollId
+    ) = 0;
+
+    //
+    // Poll a request the DPU has read for: its response, then the request and the data it read, in Buffer;
+    // the data starts at Response->DataOffset
+    //
+    //
+    virtual
+    ErrorCodeT
+    PollWaitOffload(
+        PollIdT PollId,
+        OffloadResponseT* Response,
+        BufferT Buffer,
+        FileIOSizeT BufferBytes,
+        size_t WaitTime,
+        bool* PollResult
+    ) = 0;
+
     //
     // Poll a completion event
     //
@@ -439,6 +1171,33 @@ public:
         size_t WaitTime,
         bool* PollResult
     ) = 0;
+
+    //
+    // Poll up to MaxCompletions completion events;
+    // only the first one is waited for, the rest are those already available
+    //
+    //
+    virtual
+    ErrorCodeT
+    PollWaitBatch(
+        PollIdT PollId,
+        PollCompletionT* Completions,
+        size_t MaxCompletions,
+        size_t WaitTime,
+        size_t* NumCompletions
+    ) = 0;
+
+    //
+    // Read the latency histograms of the I/Os completed on a poll so far;
+    // the counters only grow, so the difference of two reads covers the I/Os in between
+    //
+    //
+    virtual
+    ErrorCodeT
+    GetIOStatistics(
+        PollIdT PollId,
+        IOStatisticsT* Statistics
+    ) = 0;
 };
 
 }
\ No newline at end of file
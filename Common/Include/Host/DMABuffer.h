@@ -5,27 +5,126 @@
 
 #pragma once
 
+#ifdef _WIN32
 #include "RDMC.h"
+#else
+#include "RDMCVerbs.h"
+#endif
 #include "MsgTypes.h"
 
+#define DMA_BUFFER_MAX_EXTERNAL_REGIONS 8
+
+//
+// Queue pairs connected to the back end per buffer, which spreads the DMA of the buffer over them;
+// the first one is the queue pair of the buffer connection and the others are lanes
+//
+//
+#define DMA_BUFFER_QUEUE_PAIRS 2
+
+static_assert(DMA_BUFFER_QUEUE_PAIRS >= 1 && DMA_BUFFER_QUEUE_PAIRS <= BUFF_CONN_MAX_QUEUE_PAIRS, "Invalid number of queue pairs per DMA buffer");
+
+//
+// Placement of the DMA buffer: the NUMA node it is allocated on, where DMA_BUFFER_NUMA_NODE_AUTO
+// takes the node of the allocating thread (run it on the node of the NIC), and whether to try
+// large pages first, which needs SeLockMemoryPrivilege and falls back to normal pages;
+// on Linux the buffer takes hugepages reserved in vm.nr_hugepages and the node of the first touch
+//
+//
+#define DMA_BUFFER_NUMA_NODE_AUTO -1
+#define DMA_BUFFER_NUMA_NODE DMA_BUFFER_NUMA_NODE_AUTO
+#define DMA_BUFFER_LARGE_PAGES
+
+//
+// Buffers kept registered after release, with the adapter they are registered to,
+// so that a reconnect reuses one of the same capacity instead of pinning and registering it again;
+// they stay registered until the process exits, and 0 disables the cache
+//
+//
+#define DMA_BUFFER_CACHED_REGIONS 8
+
+//
+// Receives for the response notifications of the back end (DDS_NOTIFICATION_METHOD_INTERRUPT) are posted again
+// in batches of DMA_BUFFER_RECEIVE_BATCH once that many are consumed, with one post on verbs;
+// enough are posted up front that DDS_MAX_COMPLETION_BUFFERING are always outstanding
+//
+//
+#define DMA_BUFFER_RECEIVE_BATCH 8
+
+static_assert(DMA_BUFFER_RECEIVE_BATCH >= 1, "Invalid batch of receives");
+
+//
+// Loopback in place of the back end, to measure the front end without RDMA hardware:
+// Allocate takes the buffer from process memory, without a NIC, and starts a thread that plays the DPU;
+// it fetches the request ring, waits the simulated latency of the DMA, publishes a response batch in the format
+// of the back end, and signals a completion per batch; the back end bridge answers control messages itself.
+// Only the progressive ring protocol is served, and reads are never direct; benchmarks such as
+// FrontEndBenchmark define it for their own build of the front end rather than here
+//
+//
+// #define DMA_BUFFER_LOOPBACK
+#define DMA_BUFFER_LOOPBACK_LATENCY_NS 2000
+
+#include <atomic>
+#ifdef DMA_BUFFER_LOOPBACK
+#include <thread>
+#endif
+
+//
+// An application buffer registered to the NIC so that the back end can write into it directly;
+// a Device buffer is GPU memory, which the host CPU never reads or writes
+//
+//
+struct ExternalRegionT {
+    char* Base;
+    size_t Bytes;
+    bool Readable;
+    bool Device;
+    uint32_t AccessToken;
+#ifdef _WIN32
+    IND2MemoryRegion* MemRegion;
+    IND2MemoryWindow* MemWindow;
+#else
+    struct ibv_mr* MemRegion;
+#endif
+};
+
 class DMABuffer {
 private:
     size_t Capacity;
+    bool LargePages;
     int ClientId;
     int BufferId;
+    PollPriority Priority;
 
+#ifdef _WIN32
     //
     // RNIC configuration
     //
     //
     IND2Adapter* Adapter;
     HANDLE AdapterFileHandle;
+    ULONG LocalAddr;
     IND2Connector* Connector;
     OVERLAPPED Ov;
     IND2CompletionQueue* CompQ;
     IND2QueuePair* QPair;
     IND2MemoryRegion* MemRegion;
     IND2MemoryWindow* MemWindow;
+    bool NotifyPending;
+
+    //
+    // The notification of a disconnect of the buffer connection, armed once it is connected
+    //
+    //
+    OVERLAPPED DisconnectOv;
+    bool DisconnectArmed;
+
+    //
+    // Lanes, from index 1; they share the completion queue
+    //
+    //
+    IND2Connector* LaneConnectors[DMA_BUFFER_QUEUE_PAIRS];
+    IND2QueuePair* LaneQPairs[DMA_BUFFER_QUEUE_PAIRS];
 
     //
     // Variables for messages
@@ -34,16 +133,132 @@ private:
     ND2_SGE* MsgSgl;
     char MsgBuf[BUFF_MSG_SIZE];
     IND2MemoryRegion* MsgMemRegion;
+#else
+    //
+    // RNIC configuration with libibverbs and rdma-cm; the buffer is registered as a memory region
+    // whose remote key the back end uses, as there are no memory windows to bind
+    //
+    //
+    struct rdma_event_channel* CmChannel;
+    struct rdma_cm_id* CmId;
+    struct ibv_pd* PDomain;
+    struct ibv_cq* CompQ;
+    struct ibv_mr* MemRegion;
+
+    //
+    // Lanes, from index 1; they share the protection domain and the completion queue
+    //
+    //
+    struct rdma_event_channel* LaneCmChannels[DMA_BUFFER_QUEUE_PAIRS];
+    struct rdma_cm_id* LaneCmIds[DMA_BUFFER_QUEUE_PAIRS];
+
+    //
+    // Variables for messages
+    //
+    //
+    RDMCVerbsSgeT* MsgSgl;
+    char MsgBuf[BUFF_MSG_SIZE];
+    struct ibv_mr* MsgMemRegion;
+#endif
+
+    //
+    // Application buffers registered for direct writes from the back end
+    //
+    //
+    ExternalRegionT ExternalRegions[DMA_BUFFER_MAX_EXTERNAL_REGIONS];
+    int NumExternalRegions;
+
+    //
+    // Where the back end resumes the rings, which are in use already if the buffer is being reconnected,
+    // and the application buffers a detached buffer registers again when it is reconnected
+    //
+    //
+    int ResumeRequestHead;
+    int ResumeResponseTail;
+    ExternalRegionT DetachedRegions[DMA_BUFFER_MAX_EXTERNAL_REGIONS];
+    int NumDetachedRegions;
+
+    //
+    // The application buffer the offload response rings are bound to, if any, which a reconnect binds again
+    //
+    //
+    char* OffloadRingsBase;
+    size_t OffloadRingsBytes;
+
+    //
+    // Notification receives consumed since they were last posted again
+    //
+    //
+    int ConsumedReceives;
+
+    //
+    // Whether the connection to the back end is lost, from a failed completion or a disconnect,
+    // and when the disconnect is looked at next, in milliseconds of the steady clock
+    //
+    //
+    std::atomic<bool> Lost;
+    std::atomic<int64_t> NextLivenessCheckMs;
+
+    //
+    // Count a consumed notification receive and post the batch again once it is complete
+    //
+    //
+    void
+    ReplenishReceives();
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+    //
+    // Doorbells are rung by the threads that publish requests, one at a time,
+    // and counted to signal every RING_BUFFER_REQUEST_DOORBELL_SIGNAL_INTERVAL-th
+    //
+    //
+    std::atomic_flag DoorbellLock;
+    uint32_t Doorbells;
+#endif
+
+#ifdef DMA_BUFFER_LOOPBACK
+    //
+    // The thread that plays the DPU, the requests it has fetched, and a count of the response batches
+    // it has published that no one has waited for yet
+    //
+    //
+    std::thread* LoopbackThread;
+    std::atomic<bool> LoopbackStop;
+    char* LoopbackRequests;
+    HANDLE LoopbackCompletions;
+
+    //
+    // Serve the rings of the buffer until LoopbackStop
+    //
+    //
+    void
+    RunLoopback();
+#endif
 
 public:
     char* BufferAddress;
 
+    //
+    // Bytes of the request and response rings in the buffer, the protocol they follow
+    // and the queue depth of the poll they belong to
+    //
+    //
+    RingSizeT RequestRingBytes;
+    RingSizeT ResponseRingBytes;
+    RingProtocolT RingProtocol;
+    uint32_t PollQueueDepth;
+
 public:
     DMABuffer(
         const char* _BackEndAddr,
         const unsigned short _BackEndPort,
         const size_t _Capacity,
-        const int _ClientId
+        const int _ClientId,
+        const PollPriority _Priority,
+        const RingSizeT _RequestRingBytes,
+        const RingSizeT _ResponseRingBytes,
+        const RingProtocolT _RingProtocol,
+        const uint32_t _PollQueueDepth
     );
 
     //
@@ -61,6 +276,34 @@ public:
         const size_t InlineThreshold
     );
 
+    //
+    // Tear the connection to a back end that has handed over to another one (DDS_RING_HANDOVER_OFFSET) down,
+    // without a release, keeping the rings and the application buffers to register again;
+    // must not race with I/O on this buffer's queue pair;
+    // Not thread-safe
+    //
+    //
+    void
+    Detach();
+
+    //
+    // Connect a detached buffer to the back end that took over, which resumes the rings
+    // at RequestRingHead and ResponseRingTail; application buffers are registered again, with new access tokens;
+    // Not thread-safe
+    //
+    //
+    bool
+    Reconnect(
+        struct sockaddr_in* LocalSock,
+        struct sockaddr_in* BackEndSock,
+        const size_t QueueDepth,
+        const size_t MaxSge,
+        const size_t InlineThreshold,
+        const int _ClientId,
+        const int RequestRingHead,
+        const int ResponseRingTail
+    );
+
     //
     // Wait for a completion event
     // Not thread-safe
@@ -71,6 +314,89 @@ public:
         bool Blocking
     );
 
+    //
+    // Wait for a completion event for at most TimeoutMs milliseconds;
+    // return false if no completion arrived in time;
+    // Not thread-safe
+    //
+    //
+    bool
+    WaitForACompletionWithTimeout(
+        DWORD TimeoutMs
+    );
+
+    //
+    // Check whether the connection to the back end is lost: a completion has failed,
+    // or the back end has disconnected, which is looked at every DDS_BACKEND_LIVENESS_CHECK_MS;
+    // the buffer is then detached and reconnected to a back end that resumes its rings;
+    // Thread-safe
+    //
+    //
+    bool
+    ConnectionLost();
+
+    //
+    // Register an application buffer to the NIC and bind a memory window for it,
+    // which the back end can also read if Readable;
+    // a Device buffer is GPU memory registered through GPUDirect RDMA, which only Verbs supports;
+    // must not race with I/O on this buffer's queue pair;
+    // Not thread-safe
+    //
+    //
+    bool
+    RegisterExternalRegion(
+        char* Base,
+        size_t Bytes,
+        bool Readable = false,
+        bool Device = false
+    );
+
+    //
+    // Release a registered application buffer;
+    // Not thread-safe
+    //
+    //
+    bool
+    ReleaseExternalRegion(
+        char* Base
+    );
+
+    //
+    // Find the registered application buffer that covers [Address, Address + Bytes)
+    // and return its remote access token, and whether it is a device buffer if Device is given
+    //
+    //
+    bool
+    FindExternalRegion(
+        const char* Address,
+        size_t Bytes,
+        uint32_t* AccessToken,
+        bool* Device = nullptr
+    ) const;
+
+    //
+    // Register the Bytes at Base for the offload response rings of the back end and bind the rings to this buffer;
+    // the back end writes the rings there and reads the heads from there until the buffer is released;
+    // must not race with I/O on this buffer's queue pair;
+    // Not thread-safe
+    //
+    //
+    bool
+    BindOffloadResponseRings(
+        char* Base,
+        size_t Bytes
+    );
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+    //
+    // Ring the doorbell of the request ring, which the back end polls again if it parked it;
+    // Thread-safe
+    //
+    //
+    void
+    RingRequestDoorbell();
+#endif
+
     //
     // Release the allocated buffer;
     // Not thread-safe
@@ -78,4 +404,15 @@ public:
     //
     void
     Release();
+
+#ifdef DMA_BUFFER_LOOPBACK
+    //
+    // Set the latency the loopback back end simulates for every request batch, for all buffers
+    //
+    //
+    static void
+    SetLoopbackLatency(
+        uint64_t LatencyNs
+    );
+#endif
 };
\ No newline at end of file
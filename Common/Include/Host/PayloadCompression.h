@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include "DDSFrontEndInterface.h"
+
+namespace DDS_FrontEnd {
+
+//
+// Decompress an LZ4 block of SourceBytes bytes into exactly DestBytes bytes of Dest;
+// return false if the block is malformed or does not decompress to DestBytes bytes
+//
+//
+bool
+DecompressPayload(
+    const char* Source,
+    FileIOSizeT SourceBytes,
+    char* Dest,
+    FileIOSizeT DestBytes
+);
+
+}
@@ -67,6 +67,18 @@ void RDMC_WaitForCompletionAndCheckContext(
     void* expected_context,
     bool b_blocking = false);
 
+// wait for CQ entry and check context, for at most timeout_ms milliseconds (or INFINITE);
+// p_notify_pending tracks a CQ notification that is still armed after a timed-out wait;
+// a failed completion, or a notification that cannot be armed, sets p_failed and returns false
+// if p_failed is given, and exits otherwise
+bool RDMC_WaitForCompletionAndCheckContextWithTimeout(
+    IND2CompletionQueue* p_cq,
+    OVERLAPPED* p_ov,
+    void* expected_context,
+    DWORD timeout_ms,
+    bool* p_notify_pending,
+    bool* p_failed = nullptr);
+
 void RDMC_OpenAdapter(
     IND2Adapter * *p_adapter,
     struct sockaddr_in* p_v4_src,
@@ -142,21 +154,24 @@ void RDMC_CreateQueuePairWithSeparateCQ(
     HRESULT expected_result = ND_SUCCESS,
     const char* error_message = "Failed to CreateQueuePairWithSeparateCQ");
 
-void RDMC_CreateMR(
+// the memory region and window calls return the result, and only exit on an unexpected one if exit_on_error is set
+HRESULT RDMC_CreateMR(
     IND2Adapter* p_adapter,
     HANDLE h_adapter_file,
     IND2MemoryRegion** pp_mr,
     HRESULT expected_result = ND_SUCCESS,
-    const char* error_message = "Failed to CreateMR");
+    const char* error_message = "Failed to CreateMR",
+    bool exit_on_error = true);
 
-void RDMC_RegisterDataBuffer(
+HRESULT RDMC_RegisterDataBuffer(
     IND2MemoryRegion* p_mr,
     void* p_buf,
     DWORD buffer_length,
     ULONG type,
     OVERLAPPED* p_ov,
     HRESULT expected_result = ND_SUCCESS,
-    const char* error_message = "Failed to RegisterDataBuffer");
+    const char* error_message = "Failed to RegisterDataBuffer",
+    bool exit_on_error = true);
 
 void RDMC_Accept(
     IND2Connector* p_connector,
@@ -169,13 +184,14 @@ void RDMC_Accept(
     HRESULT expected_result = ND_SUCCESS,
     const char* error_message = "Failed to Accept");
 
-void RDMC_CreateMW(
+HRESULT RDMC_CreateMW(
     IND2Adapter* p_adapter,
     IND2MemoryWindow** pp_mw,
     HRESULT expected_result = ND_SUCCESS,
-    const char* error_message = "Failed to CreateMemoryWindow");
+    const char* error_message = "Failed to CreateMemoryWindow",
+    bool exit_on_error = true);
 
-void RDMC_Bind(
+HRESULT RDMC_Bind(
     IND2QueuePair* p_qp,
     IND2MemoryRegion* p_mr,
     IND2MemoryWindow* p_mw,
@@ -186,7 +202,8 @@ void RDMC_Bind(
     OVERLAPPED* p_ov,
     void* context = (void*)nullptr,
     HRESULT expected_result = ND_SUCCESS,
-    const char* error_message = "Failed to Bind");
+    const char* error_message = "Failed to Bind",
+    bool exit_on_error = true);
 
 void RDMC_Send(
     IND2QueuePair* p_qp,
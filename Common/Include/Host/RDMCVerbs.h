@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+//
+// The RDMA connection helpers of the host on Linux, over libibverbs and rdma-cm, in place of RDMC and NDSPI:
+// connections are made with rdma-cm and carry the private data the back end dispatches them on,
+// completion queues are busy-polled rather than armed for events, and buffers are backed by hugepages if possible
+//
+//
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <infiniband/verbs.h>
+#include <netinet/in.h>
+#include <rdma/rdma_cma.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// The Windows types and calls the front end shares with the NDSPI build
+//
+//
+#ifndef DWORD
+typedef uint32_t DWORD;
+#endif
+
+#ifndef INFINITE
+#define INFINITE 0xFFFFFFFF
+#endif
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define YieldProcessor() _mm_pause()
+#elif defined(__aarch64__)
+#define YieldProcessor() __asm__ volatile("yield")
+#else
+#define YieldProcessor() do { } while (0)
+#endif
+
+//
+// How long rdma-cm may take to resolve the address and the route of the back end
+//
+//
+#define RDMC_VERBS_RESOLVE_TIMEOUT_MS 2000
+
+//
+// Bytes of messages sent inline with the work request rather than read by the NIC
+//
+//
+#define RDMC_VERBS_INLINE_THRESHOLD 64
+
+//
+// The hugepage size that buffers are rounded up to when they are backed by hugepages
+//
+//
+#define RDMC_VERBS_HUGE_PAGE_BYTES (2ULL << 20)
+
+//
+// A scatter/gather entry with the fields of ND2_SGE, so that messages are built the same way on both hosts
+//
+//
+struct RDMCVerbsSgeT {
+    void* Buffer;
+    uint32_t BufferLength;
+    uint32_t MemoryRegionToken;
+};
+
+//
+// Resolve the back end, create a queue pair on the device that reaches it, and connect the queue pair
+// with the private data of the connection, lowering the queue depth and the SGEs to what the device allows;
+// the protection domain and the completion queue are created
+// with the first connection if *PDomain is NULL and shared by the connections that pass them in
+//
+//
+bool
+RDMCVerbs_Connect(
+    struct sockaddr_in* BackEndSock,
+    size_t* QueueDepth,
+    size_t* MaxSge,
+    size_t InlineThreshold,
+    const void* PrivData,
+    uint8_t PrivDataBytes,
+    struct rdma_event_channel** Channel,
+    struct rdma_cm_id** CmId,
+    struct ibv_pd** PDomain,
+    struct ibv_cq** CompQ
+);
+
+//
+// Disconnect a connection and destroy its queue pair, id and event channel;
+// a connection the peer is known to have dropped (PeerLost) is destroyed without waiting for the disconnect
+//
+//
+void
+RDMCVerbs_Disconnect(
+    struct rdma_event_channel* Channel,
+    struct rdma_cm_id* CmId,
+    bool PeerLost = false
+);
+
+//
+// Check without blocking whether the peer of a connection has dropped it, taking the pending events of its channel
+//
+//
+bool
+RDMCVerbs_PollDisconnect(
+    struct rdma_event_channel* Channel
+);
+
+//
+// Post a signaled send of an entry
+//
+//
+bool
+RDMCVerbs_Send(
+    struct rdma_cm_id* CmId,
+    const RDMCVerbsSgeT* Sge,
+    void* Context
+);
+
+//
+// Post a receive into an entry
+//
+//
+bool
+RDMCVerbs_PostReceive(
+    struct rdma_cm_id* CmId,
+    const RDMCVerbsSgeT* Sge,
+    void* Context
+);
+
+//
+// Post Count receives into the same entry, with a single post for every RDMC_VERBS_RECEIVES_PER_POST of them
+//
+//
+#define RDMC_VERBS_RECEIVES_PER_POST 16
+
+bool
+RDMCVerbs_PostReceives(
+    struct rdma_cm_id* CmId,
+    const RDMCVerbsSgeT* Sge,
+    void* Context,
+    int Count
+);
+
+//
+// Busy-poll a completion queue for one completion for at most TimeoutMs milliseconds (or INFINITE);
+// return false if none arrived in time, and exit if the completion failed or has another context, as RDMC does,
+// unless Failed is given, which is set instead of exiting on a failed completion;
+// successful completions of SkippedContext, if any, are consumed on the way
+//
+//
+bool
+RDMCVerbs_WaitForCompletionAndCheckContext(
+    struct ibv_cq* CompQ,
+    void* ExpectedContext,
+    DWORD TimeoutMs,
+    void* SkippedContext = NULL,
+    bool* Failed = NULL
+);
+
+//
+// Allocate zeroed memory for DMA, backed by hugepages if HugePages is set and they are available,
+// and clear HugePages if they are not
+//
+//
+char*
+RDMCVerbs_AllocateBuffer(
+    size_t Bytes,
+    bool* HugePages
+);
+
+//
+// Free memory of RDMCVerbs_AllocateBuffer
+//
+//
+void
+RDMCVerbs_FreeBuffer(
+    char* Buffer,
+    size_t Bytes,
+    bool HugePages
+);
+#endif
@@ -6,8 +6,11 @@
 #pragma once
 
 #include <atomic>
+#include <mutex>
+#include <stddef.h>
 
 #include "DDSFrontEndInterface.h"
+#include "MsgTypes.h"
 
 namespace DDS_FrontEnd {
 
@@ -23,23 +26,36 @@ using Atomic = std::atomic<C>;
 //
 // A ring buffer for exchanging requests from the host to the DPU;
 // This object should be allocated from the DMA area;
-// All members are cache line aligned to avoid false sharing between threads
+// The members are laid out as described at DDS_RING_META_BYTES to avoid false sharing between the host threads and the DPU;
+// Only the first Capacity bytes of Buffer, as negotiated with the back end, are used;
+// Capacity shares the cache line of the tail, which every insertion touches anyway;
+// Parked shares the line of the head, as the DPU writes both when it parks the ring (RING_BUFFER_REQUEST_DOORBELL)
 //
 //
 struct RequestRingBufferProgressive{
     Atomic<int> Progress[DDS_CACHE_LINE_SIZE_BY_INT];
-    Atomic<int> Tail[DDS_CACHE_LINE_SIZE_BY_INT];
-    int Head[DDS_CACHE_LINE_SIZE_BY_INT];
+    Atomic<int> Tail[DDS_CACHE_LINE_SIZE_BY_INT - 1];
+    int Capacity;
+    int Head[1];
+    Atomic<int> Parked;
+    int HeadPadding[DDS_NIC_CACHE_LINE_SIZE / sizeof(int) - 2];
+    char MetaPadding[DDS_RING_META_BYTES - DDS_RING_HEAD_OFFSET - DDS_NIC_CACHE_LINE_SIZE];
     char Buffer[DDS_REQUEST_RING_BYTES];
 };
 
+static_assert(offsetof(RequestRingBufferProgressive, Tail) == DDS_CACHE_LINE_SIZE, "The tail must start the second cache line");
+static_assert(offsetof(RequestRingBufferProgressive, Head) == DDS_RING_HEAD_OFFSET, "The DPU writes the head at DDS_RING_HEAD_OFFSET");
+static_assert(offsetof(RequestRingBufferProgressive, Parked) == DDS_RING_PARKED_OFFSET, "The DPU writes the parked mark at DDS_RING_PARKED_OFFSET");
+static_assert(offsetof(RequestRingBufferProgressive, Buffer) == DDS_RING_META_BYTES, "The DPU reads the data at DDS_RING_META_BYTES");
+
 //
-// Allocate a request buffer object
+// Allocate a request buffer object of Capacity bytes
 //
 //
 RequestRingBufferProgressive*
 AllocateRequestBufferProgressive(
-    BufferT BufferAddress
+    BufferT BufferAddress,
+    RingSizeT Capacity
 );
 
 //
@@ -103,6 +119,165 @@ InsertReadRequest(
     FileIOSizeT Bytes
 );
 
+//
+// Insert a ReadFileScatter request whose data the back end writes directly
+// into the registered destination segments
+//
+//
+bool
+InsertDirectReadRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    uint32_t AccessToken,
+    const BuffMsgDirectReadSegment* Segments,
+    uint32_t NumSegments
+);
+
+//
+// Insert a read of the item of a cache table key, with Bytes the size of the destination
+//
+//
+bool
+InsertKeyReadRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestIdT RequestId,
+    const CacheKeyT* Key,
+    FileIOSizeT Bytes
+);
+
+//
+// Insert a scan of Bytes of a file from Offset, with DestBytes the size of the destination
+//
+//
+bool
+InsertScanRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestIdT RequestId,
+    FileSizeT Offset,
+    FileIOSizeT DestBytes,
+    const BuffMsgF2BScanHeader* Scan
+);
+
+//
+// A request inserted as part of a batch
+//
+//
+struct RequestBatchEntryT {
+    bool IsRead;
+    RequestIdT RequestId;
+    FileIdT FileId;
+    FileSizeT Offset;
+    FileIOSizeT Bytes;
+    BufferT SourceBuffer;
+};
+
+//
+// Insert a batch of ReadFile and WriteFile requests into the request buffer
+// with a single tail advancement and a single progress update
+//
+//
+bool
+InsertRequestBatch(
+    RequestRingBufferProgressive* RingBuffer,
+    const RequestBatchEntryT* Requests,
+    int NumRequests
+);
+
+//
+// The requests staged for a request buffer, laid out exactly as they are in the buffer;
+// every thread that submits to the buffer stages into the same area, so whichever thread publishes
+// takes the requests of all of them; Published, if set, is given the ids of the requests
+// right before they are published, e.g., to time them from then on
+//
+//
+#define RING_BUFFER_REQUEST_STAGING_MAX_REQUESTS (RING_BUFFER_REQUEST_STAGING_BYTES / (sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader)))
+
+typedef void (*StagedRequestsPublishedT)(
+    void* Context,
+    const RequestIdT* RequestIds,
+    size_t NumRequests
+);
+
+struct RequestStagingT {
+    std::mutex Lock;
+    Atomic<RingSizeT> Bytes{ 0 };
+    char* Buffer = nullptr;
+    RequestIdT RequestIds[RING_BUFFER_REQUEST_STAGING_MAX_REQUESTS];
+    size_t NumRequests = 0;
+    StagedRequestsPublishedT Published = nullptr;
+    void* PublishedContext = nullptr;
+
+    ~RequestStagingT() {
+        delete[] Buffer;
+    }
+};
+
+//
+// Stage a ReadFile request for the request buffer instead of inserting it;
+// the staged requests are published together, with a single tail advancement
+// and a single progress update, once RING_BUFFER_REQUEST_STAGING_FLUSH_BYTES are staged,
+// or at FlushStagedRequests
+//
+//
+bool
+StageReadRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+);
+
+//
+// Stage a WriteFile request for the request buffer instead of inserting it;
+// the data is copied into the staging area, so the source buffer can be reused right away
+//
+//
+bool
+StageWriteFileRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    BufferT SourceBuffer
+);
+
+//
+// Publish the requests staged for the request buffer, by any thread;
+// return false if they do not fit into the buffer yet, in which case they stay staged
+//
+//
+bool
+FlushStagedRequests(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging
+);
+
+//
+// Drop the requests staged for a request buffer without publishing them
+//
+//
+void
+DiscardStagedRequests(
+    RequestStagingT* Staging
+);
+
+//
+// The credits the back end has given the host: the bytes that can be inserted into the request buffer now,
+// from the tail and the head the back end writes back as it takes requests out
+//
+//
+RingSizeT
+GetRequestCredits(
+    RequestRingBufferProgressive* RingBuffer
+);
+
 //
 // Fetch requests from the request buffer
 //
@@ -147,23 +322,36 @@ CheckForRequestCompletionProgressive(
 //
 // A ring buffer for exchanging responses from the DPU to the host;
 // This object should be allocated from the DMA area;
-// All members are cache line aligned to avoid false sharing between threads
+// The members are laid out as described at DDS_RING_META_BYTES to avoid false sharing between the host threads and the DPU;
+// Only the first Capacity bytes of Buffer, as negotiated with the back end, are used;
+// Capacity shares the cache line of the head, which every fetch touches anyway;
+// HandedOver shares the line of the tail, as the DPU writes both when it hands the ring over (DDS_RING_HANDOVER_OFFSET)
 //
 //
 struct ResponseRingBufferProgressive{
     Atomic<int> Progress[DDS_CACHE_LINE_SIZE_BY_INT];
-    Atomic<int> Head[DDS_CACHE_LINE_SIZE_BY_INT];
-    int Tail[DDS_CACHE_LINE_SIZE_BY_INT];
+    Atomic<int> Head[DDS_CACHE_LINE_SIZE_BY_INT - 1];
+    int Capacity;
+    int Tail[1];
+    Atomic<int> HandedOver;
+    int TailPadding[DDS_NIC_CACHE_LINE_SIZE / sizeof(int) - 2];
+    char MetaPadding[DDS_RING_META_BYTES - DDS_RING_HEAD_OFFSET - DDS_NIC_CACHE_LINE_SIZE];
     char Buffer[DDS_RESPONSE_RING_BYTES];
 };
 
+static_assert(offsetof(ResponseRingBufferProgressive, Head) == DDS_CACHE_LINE_SIZE, "The head must start the second cache line");
+static_assert(offsetof(ResponseRingBufferProgressive, Tail) == DDS_RING_HEAD_OFFSET, "The DPU writes the tail at DDS_RING_HEAD_OFFSET");
+static_assert(offsetof(ResponseRingBufferProgressive, HandedOver) == DDS_RING_HANDOVER_OFFSET, "The DPU writes the handover mark at DDS_RING_HANDOVER_OFFSET");
+static_assert(offsetof(ResponseRingBufferProgressive, Buffer) == DDS_RING_META_BYTES, "The DPU writes the data at DDS_RING_META_BYTES");
+
 //
-// Allocate a response buffer object
+// Allocate a response buffer object of Capacity bytes
 //
 //
 ResponseRingBufferProgressive*
 AllocateResponseBufferProgressive(
-    BufferT BufferAddress
+    BufferT BufferAddress,
+    RingSizeT Capacity
 );
 
 //
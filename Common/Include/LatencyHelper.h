@@ -6,7 +6,9 @@
 #pragma once
 
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 typedef struct Statistics {
 	double Mean;
@@ -27,134 +29,181 @@ typedef struct Percentiles {
 	double P99p9999;
 } Percentiles;
 
-double square_root(double x) {
-	double guess = x / 2.0;
-	double prev_guess = 0.0;
-	const double tolerance = 0.00001;
+//
+// A log-linear latency histogram, after HdrHistogram: values below 2^LATENCY_HISTOGRAM_VALUE_BITS
+// are counted in buckets of powers of two, each split into linear sub-buckets, so that every value
+// is kept within 1 / 2^(LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1) of its own, in fixed memory;
+// threads record into their own histograms, which are merged with MergeLatencyHistogram
+//
+//
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 8
+#define LATENCY_HISTOGRAM_VALUE_BITS 40
+#define LATENCY_HISTOGRAM_SUB_BUCKET_HALF (1 << (LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1))
+#define LATENCY_HISTOGRAM_BUCKETS (LATENCY_HISTOGRAM_VALUE_BITS - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1)
+#define LATENCY_HISTOGRAM_COUNTS ((LATENCY_HISTOGRAM_BUCKETS + 1) * LATENCY_HISTOGRAM_SUB_BUCKET_HALF)
+#define LATENCY_HISTOGRAM_HIGHEST ((1ULL << LATENCY_HISTOGRAM_VALUE_BITS) - 1)
+
+typedef struct LatencyHistogram {
+	uint64_t Counts[LATENCY_HISTOGRAM_COUNTS];
+	uint64_t TotalCount;
+	uint64_t Min;
+	uint64_t Max;
+	double Sum;
+	double SumOfSquares;
+} LatencyHistogram;
+
+static inline void
+ResetLatencyHistogram(
+		LatencyHistogram* Histogram
+	     ) {
+	memset(Histogram, 0, sizeof(LatencyHistogram));
+	Histogram->Min = UINT64_MAX;
+}
 
-	while (fabs(guess - prev_guess) > tolerance) {
-		prev_guess = guess;
-		guess = (guess + x / guess) / 2.0;
+static inline int
+LatencyHistogramBucket(
+		uint64_t Value
+	     ) {
+	int Log = 0;
+	Value |= (1ULL << LATENCY_HISTOGRAM_SUB_BUCKET_BITS) - 1;
+	while (Value >>= 1) {
+		Log++;
 	}
+	return Log - (LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1);
+}
 
-	return guess;
+static inline int
+LatencyHistogramIndex(
+		uint64_t Value
+	     ) {
+	int Bucket = LatencyHistogramBucket(Value);
+	int SubBucket = (int)(Value >> Bucket);
+	return ((Bucket + 1) << (LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1)) + SubBucket - LATENCY_HISTOGRAM_SUB_BUCKET_HALF;
 }
 
-void quick_sort(double arr[], int left, int right) {
-	if (left < right) {
-		int pivot_index = left + (right - left) / 2;
-		double pivot_value = arr[pivot_index];
-		int i = left;
-		int j = right;
-		while (i <= j) {
-			while (arr[i] < pivot_value) {
-				i++;
-			}
-			while (arr[j] > pivot_value) {
-				j--;
-			}
-			if (i <= j) {
-				// swap arr[i] and arr[j]
-				double temp = arr[i];
-				arr[i] = arr[j];
-				arr[j] = temp;
-				i++;
-				j--;
-			}
-		}
-		quick_sort(arr, left, j);
-		quick_sort(arr, i, right);
+//
+// The highest value counted at an index
+//
+//
+static inline uint64_t
+LatencyHistogramValue(
+		int Index
+	     ) {
+	int Bucket = (Index >> (LATENCY_HISTOGRAM_SUB_BUCKET_BITS - 1)) - 1;
+	int SubBucket = (Index & (LATENCY_HISTOGRAM_SUB_BUCKET_HALF - 1)) + LATENCY_HISTOGRAM_SUB_BUCKET_HALF;
+	if (Bucket < 0) {
+		SubBucket -= LATENCY_HISTOGRAM_SUB_BUCKET_HALF;
+		Bucket = 0;
 	}
+	return ((uint64_t)SubBucket << Bucket) + (1ULL << Bucket) - 1;
 }
 
-double
-ComputeVariance(
-		double* Measurements,
-		size_t Length,
-		double Mean
-	       ) {
-	if (Length <= 1) {
-		return 0;
+//
+// Record a value; values above LATENCY_HISTOGRAM_HIGHEST are recorded as it
+//
+//
+static inline void
+RecordLatency(
+		LatencyHistogram* Histogram,
+		uint64_t Value
+	     ) {
+	if (Value > LATENCY_HISTOGRAM_HIGHEST) {
+		Value = LATENCY_HISTOGRAM_HIGHEST;
 	}
-	double Variance = 0;
-	for (size_t i = 0; i < Length; i++) {
-		uint32_t Value = Measurements[i];
-		Variance += (Value - Mean) * (Value - Mean) / (Length - 1);
+	Histogram->Counts[LatencyHistogramIndex(Value)]++;
+	Histogram->TotalCount++;
+	if (Value < Histogram->Min) {
+		Histogram->Min = Value;
 	}
-	return Variance;
+	if (Value > Histogram->Max) {
+		Histogram->Max = Value;
+	}
+	Histogram->Sum += (double)Value;
+	Histogram->SumOfSquares += (double)Value * (double)Value;
+}
+
+static inline void
+MergeLatencyHistogram(
+		LatencyHistogram* Histogram,
+		const LatencyHistogram* Other
+	     ) {
+	for (int i = 0; i != LATENCY_HISTOGRAM_COUNTS; i++) {
+		Histogram->Counts[i] += Other->Counts[i];
+	}
+	Histogram->TotalCount += Other->TotalCount;
+	if (Other->Min < Histogram->Min) {
+		Histogram->Min = Other->Min;
+	}
+	if (Other->Max > Histogram->Max) {
+		Histogram->Max = Other->Max;
+	}
+	Histogram->Sum += Other->Sum;
+	Histogram->SumOfSquares += Other->SumOfSquares;
 }
 
-int cmpfunc (const void * a, const void * b) {
-	return (*(double*)a - *(double*)b);
+//
+// The value at a percentile, in [0, 100]
+//
+//
+static inline uint64_t
+LatencyAtPercentile(
+		const LatencyHistogram* Histogram,
+		double Percentile
+	     ) {
+	if (Histogram->TotalCount == 0) {
+		return 0;
+	}
+
+	uint64_t CountAtPercentile = (uint64_t)ceil(Percentile / 100.0 * (double)Histogram->TotalCount);
+	if (CountAtPercentile == 0) {
+		CountAtPercentile = 1;
+	}
+
+	uint64_t Cumulative = 0;
+	for (int i = 0; i != LATENCY_HISTOGRAM_COUNTS; i++) {
+		Cumulative += Histogram->Counts[i];
+		if (Cumulative >= CountAtPercentile) {
+			uint64_t Value = LatencyHistogramValue(i);
+			return Value < Histogram->Max ? Value : Histogram->Max;
+		}
+	}
+	return Histogram->Max;
 }
 
+//
+// Get the statistics of the latencies recorded in a histogram, with values divided by Scale
+//
+//
 static void
 GetStatistics(
-		double* Data,
-		size_t DataLength,
+		const LatencyHistogram* Histogram,
+		double Scale,
 		Statistics* AllStatistics,
 		Percentiles* PercentileStats
 	     ) {
-	if (DataLength == 0) {
+	uint64_t Count = Histogram->TotalCount;
+	if (Count == 0) {
 		return;
 	}
 
-	double Sum = 0;
-	double Min = 0xFFFFFFFF;
-	double Max = 0;
-	for (size_t i = 0; i < DataLength; i++) {
-		double Value = Data[i];
-		Sum += Value;
-		if (Value > Max) {
-			Max = Value;
-		}
-		if (Value < Min) {
-			Min = Value;
-		}
+	double Mean = Histogram->Sum / (double)Count;
+	double Variance = Histogram->SumOfSquares / (double)Count - Mean * Mean;
+	if (Variance < 0) {
+		Variance = 0;
 	}
-	double Mean = Sum / (double)DataLength;
-	double Variance =
-		ComputeVariance(
-				Data,
-				DataLength,
-				Mean);
-	double StandardDeviation = square_root(Variance);
-	double StandardError = StandardDeviation / square_root((double)DataLength);
-	AllStatistics->Mean = Mean;
-	AllStatistics->Variance = Variance;
+	double StandardDeviation = sqrt(Variance) / Scale;
+	AllStatistics->Mean = Mean / Scale;
+	AllStatistics->Variance = StandardDeviation * StandardDeviation;
 	AllStatistics->StandardDeviation = StandardDeviation;
-	AllStatistics->StandardError = StandardError;
-	AllStatistics->Min = Min;
-	AllStatistics->Max = Max;
-
-	/*
-	qsort(
-			Data,
-			DataLength,
-			sizeof(double),
-			cmpfunc
-	     );
-	*/
-	quick_sort(Data, 0, DataLength -1);
-
-	uint32_t PercentileIndex = (uint32_t)(DataLength * 0.5);
-	PercentileStats->P50 = Data[PercentileIndex];
-
-	PercentileIndex = (uint32_t)(DataLength * 0.9);
-	PercentileStats->P90 = Data[PercentileIndex];
-
-	PercentileIndex = (uint32_t)(DataLength * 0.99);
-	PercentileStats->P99 = Data[PercentileIndex];
-
-	PercentileIndex = (uint32_t)(DataLength * 0.999);
-	PercentileStats->P99p9 = Data[PercentileIndex];
-
-	PercentileIndex = (uint32_t)(DataLength * 0.9999);
-	PercentileStats->P99p99 = Data[PercentileIndex];
-
-	PercentileIndex = (uint32_t)(DataLength * 0.99999);
-	PercentileStats->P99p999 = Data[PercentileIndex];
-
-	PercentileIndex = (uint32_t)(DataLength * 0.999999);
-	PercentileStats->P99p9999 = Data[PercentileIndex];
+	AllStatistics->StandardError = StandardDeviation / sqrt((double)Count);
+	AllStatistics->Min = (double)Histogram->Min / Scale;
+	AllStatistics->Max = (double)Histogram->Max / Scale;
+
+	PercentileStats->P50 = (double)LatencyAtPercentile(Histogram, 50.0) / Scale;
+	PercentileStats->P90 = (double)LatencyAtPercentile(Histogram, 90.0) / Scale;
+	PercentileStats->P99 = (double)LatencyAtPercentile(Histogram, 99.0) / Scale;
+	PercentileStats->P99p9 = (double)LatencyAtPercentile(Histogram, 99.9) / Scale;
+	PercentileStats->P99p99 = (double)LatencyAtPercentile(Histogram, 99.99) / Scale;
+	PercentileStats->P99p999 = (double)LatencyAtPercentile(Histogram, 99.999) / Scale;
+	PercentileStats->P99p9999 = (double)LatencyAtPercentile(Histogram, 99.9999) / Scale;
 }
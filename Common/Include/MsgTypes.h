@@ -11,10 +11,25 @@
 
 #define MSG_CTXT ((void *) 0x5000)
 
+//
+// Context of the request doorbells of the front end (RING_BUFFER_REQUEST_DOORBELL),
+// whose completions only retire the send queue entries of the doorbells
+//
+//
+#define DOORBELL_CTXT ((void *) 0x6000)
+
 #define CTRL_CONN_PRIV_DATA 42
 #define BUFF_CONN_PRIV_DATA 24
+#define BUFF_LANE_CONN_PRIV_DATA 25
+
+//
+// Queue pairs a buffer can be reached through: the one of its buffer connection
+// and the lanes connected to the same buffer afterwards
+//
+//
+#define BUFF_CONN_MAX_QUEUE_PAIRS 4
 
-#define CTRL_MSG_SIZE 256
+#define CTRL_MSG_SIZE 4096
 #define BUFF_MSG_SIZE 64
 
 #define CTRL_MSG_F2B_REQUEST_ID 0
@@ -40,10 +55,31 @@
 #define CTRL_MSG_B2F_ACK_GET_FREE_SPACE 20
 #define CTRL_MSG_F2B_REQ_MOVE_FILE 21
 #define CTRL_MSG_B2F_ACK_MOVE_FILE 22
+#define CTRL_MSG_F2B_REQ_UPDATE_CACHE 23
+#define CTRL_MSG_B2F_ACK_UPDATE_CACHE 24
+#define CTRL_MSG_F2B_REQ_BATCH 25
+#define CTRL_MSG_B2F_ACK_BATCH 26
+#define CTRL_MSG_F2B_REQ_FLUSH_FILE 27
+#define CTRL_MSG_B2F_ACK_FLUSH_FILE 28
+#define CTRL_MSG_F2B_REQ_SET_FILE_QOS 29
+#define CTRL_MSG_B2F_ACK_SET_FILE_QOS 30
+#define CTRL_MSG_F2B_REQ_LOAD_SCAN 31
+#define CTRL_MSG_B2F_ACK_LOAD_SCAN 32
+#define CTRL_MSG_F2B_REQ_CREATE_SNAPSHOT 33
+#define CTRL_MSG_B2F_ACK_CREATE_SNAPSHOT 34
+#define CTRL_MSG_F2B_REQ_SET_FILE_ACCESS_HINT 35
+#define CTRL_MSG_B2F_ACK_SET_FILE_ACCESS_HINT 36
+#define CTRL_MSG_F2B_REQ_ACQUIRE_LEASE 37
+#define CTRL_MSG_B2F_ACK_ACQUIRE_LEASE 38
+#define CTRL_MSG_F2B_REQ_RELEASE_LEASE 39
+#define CTRL_MSG_B2F_ACK_RELEASE_LEASE 40
+#define CTRL_MSG_F2B_REQ_RENEW_LEASES 41
+#define CTRL_MSG_B2F_ACK_RENEW_LEASES 42
 
 #define BUFF_MSG_F2B_REQUEST_ID 100
 #define BUFF_MSG_B2F_RESPOND_ID 101
 #define BUFF_MSG_F2B_RELEASE 102
+#define BUFF_MSG_F2B_BIND_OFFLOAD_RINGS 103
 
 typedef struct {
     RequestIdT MsgId;
@@ -51,6 +87,10 @@ typedef struct {
 
 typedef struct {
     int Dummy;
+    uint32_t RequestRingBytes;
+    uint32_t ResponseRingBytes;
+    RingProtocolT RingProtocol;
+    uint32_t PollQueueDepth;
 } CtrlMsgF2BRequestId;
 
 typedef struct {
@@ -59,13 +99,29 @@ typedef struct {
 
 typedef struct {
     int ClientId;
+    uint32_t RequestRingBytes;
+    uint32_t ResponseRingBytes;
+    RingProtocolT RingProtocol;
+    uint32_t PollQueueDepth;
 } CtrlMsgB2FRespondId;
 
+//
+// A buffer whose rings are in use already, as after a handover of the back end (DDS_RING_HANDOVER_OFFSET),
+// resumes them at RequestRingHead and ResponseRingTail; a new buffer starts them at 0
+//
+//
 typedef struct {
     int ClientId;
     uint64_t BufferAddress;
     uint32_t AccessToken;
     uint32_t Capacity;
+    uint32_t Priority;
+    uint32_t RequestRingBytes;
+    uint32_t ResponseRingBytes;
+    RingProtocolT RingProtocol;
+    uint32_t PollQueueDepth;
+    int RequestRingHead;
+    int ResponseRingTail;
 } BuffMsgF2BRequestId;
 
 typedef struct {
@@ -77,6 +133,29 @@ typedef struct {
     int BufferId;
 } BuffMsgF2BRelease;
 
+//
+// Bind the offload response rings of the DPU to a buffer: the DPU writes the rings into the Bytes at Address,
+// which it also reads the heads from, until the buffer is released
+//
+//
+typedef struct {
+    int ClientId;
+    int BufferId;
+    uint64_t Address;
+    uint32_t AccessToken;
+    uint32_t Bytes;
+} BuffMsgF2BBindOffloadRings;
+
+//
+// Private data of a lane connection, which adds a queue pair to an assigned buffer
+//
+//
+typedef struct {
+    uint8_t ConnType;
+    uint8_t Lane;
+    uint16_t BufferId;
+} BuffLaneConnPrivData;
+
 typedef struct {
     DirIdT DirId;
     DirIdT ParentDirId;
@@ -171,6 +250,187 @@ typedef struct {
     ErrorCodeT Result;
 } CtrlMsgB2FAckMoveFile;
 
+//
+// A flush of the device under a file, which the back end shares with the flushes that arrive while it runs
+//
+//
+typedef struct {
+    FileIdT FileId;
+} CtrlMsgF2BReqFlushFile;
+
+typedef struct {
+    ErrorCodeT Result;
+} CtrlMsgB2FAckFlushFile;
+
+//
+// The I/O rate limit of a file, in bytes per second with a burst of BurstBytes (0 for unlimited),
+// and its weight against the other limited files when their requests wait on the same worker
+//
+//
+typedef struct {
+    FileIdT FileId;
+    uint32_t Weight;
+    uint64_t BytesPerSecond;
+    uint64_t BurstBytes;
+} CtrlMsgF2BReqSetFileQoS;
+
+typedef struct {
+    ErrorCodeT Result;
+} CtrlMsgB2FAckSetFileQoS;
+
+//
+// Snapshot a file into a new read-only file, whose id the host has assigned
+//
+//
+typedef struct {
+    FileIdT FileId;
+    FileIdT SnapshotFileId;
+    DirIdT DirId;
+    char SnapshotName[DDS_MAX_FILE_PATH];
+} CtrlMsgF2BReqCreateSnapshot;
+
+typedef struct {
+    ErrorCodeT Result;
+} CtrlMsgB2FAckCreateSnapshot;
+
+//
+// How a file will be read (FileAccessHint), with the range of the file for ACCESS_HINT_WILLNEED
+//
+//
+typedef struct {
+    FileIdT FileId;
+    int32_t Hint;
+    FileSizeT Offset;
+    FileSizeT Bytes;
+} CtrlMsgF2BReqSetFileAccessHint;
+
+typedef struct {
+    ErrorCodeT Result;
+} CtrlMsgB2FAckSetFileAccessHint;
+
+//
+// Ask for a lease of a file (FileLeaseMode), or renew it; the ack gives how long the lease lasts
+//
+//
+typedef struct {
+    FileIdT FileId;
+    int32_t Mode;
+} CtrlMsgF2BReqAcquireLease;
+
+typedef struct {
+    ErrorCodeT Result;
+    uint32_t TermMs;
+} CtrlMsgB2FAckAcquireLease;
+
+//
+// Give back the lease of a file
+//
+//
+typedef struct {
+    FileIdT FileId;
+} CtrlMsgF2BReqReleaseLease;
+
+typedef struct {
+    ErrorCodeT Result;
+} CtrlMsgB2FAckReleaseLease;
+
+//
+// Renew every lease of the front end; the ack lists the files whose leases were revoked instead,
+// which the front end gives back once it flushed what it caches of them
+//
+//
+#define CTRL_MSG_RENEW_LEASES_MAX_REVOKED 1024
+
+typedef struct {
+    uint32_t Reserved;
+} CtrlMsgF2BReqRenewLeases;
+
+typedef struct {
+    ErrorCodeT Result;
+    uint32_t TermMs;
+    uint32_t NumRevoked;
+    FileIdT Revoked[CTRL_MSG_RENEW_LEASES_MAX_REVOKED];
+} CtrlMsgB2FAckRenewLeases;
+
+//
+// Load a scan function into the back end, which compiles OffloadScan.c in CodePath on the DPU;
+// the ack gives the id scans name it by, and it stays loaded until the back end exits
+//
+//
+#define CTRL_MSG_LOAD_SCAN_PATH_BYTES 256
+
+typedef struct {
+    char CodePath[CTRL_MSG_LOAD_SCAN_PATH_BYTES];
+} CtrlMsgF2BReqLoadScan;
+
+typedef struct {
+    ErrorCodeT Result;
+    uint16_t ScanId;
+} CtrlMsgB2FAckLoadScan;
+
+//
+// A batch of cache table updates, applied in order by the back end until one fails;
+// the ack says how many were applied; fewer fit with 16-byte keys
+//
+//
+#if DDS_CACHE_KEY_BYTES == 16
+#define CTRL_MSG_UPDATE_CACHE_MAX_UPDATES 7
+#else
+#define CTRL_MSG_UPDATE_CACHE_MAX_UPDATES 10
+#endif
+
+typedef struct {
+    uint32_t NumUpdates;
+    CacheUpdateT Updates[CTRL_MSG_UPDATE_CACHE_MAX_UPDATES];
+} CtrlMsgF2BReqUpdateCache;
+
+typedef struct {
+    ErrorCodeT Result;
+    uint32_t NumApplied;
+} CtrlMsgB2FAckUpdateCache;
+
+//
+// A batch of control operations, run by the back end in order until one fails, in one message each way;
+// the ack says how many ran and carries the ack of each, so that many files are created and sized in one round trip
+//
+//
+#define CTRL_MSG_BATCH_MAX_OPS 48
+
+typedef struct {
+    RequestIdT MsgId;
+    union {
+        CtrlMsgF2BReqCreateDirectory CreateDirectory;
+        CtrlMsgF2BReqRemoveDirectory RemoveDirectory;
+        CtrlMsgF2BReqCreateFile CreateFile;
+        CtrlMsgF2BReqDeleteFile DeleteFile;
+        CtrlMsgF2BReqChangeFileSize ChangeFileSize;
+        CtrlMsgF2BReqGetFileSize GetFileSize;
+        CtrlMsgF2BReqGetFileAttr GetFileAttr;
+        CtrlMsgF2BReqMoveFile MoveFile;
+        CtrlMsgF2BReqFlushFile FlushFile;
+    } Req;
+} CtrlMsgBatchOpReq;
+
+typedef struct {
+    RequestIdT MsgId;
+    union {
+        ErrorCodeT Result;
+        CtrlMsgB2FAckGetFileSize GetFileSize;
+        CtrlMsgB2FAckGetFileAttr GetFileAttr;
+    } Ack;
+} CtrlMsgBatchOpAck;
+
+typedef struct {
+    uint32_t NumOps;
+    CtrlMsgBatchOpReq Ops[CTRL_MSG_BATCH_MAX_OPS];
+} CtrlMsgF2BReqBatch;
+
+typedef struct {
+    ErrorCodeT Result;
+    uint32_t NumCompleted;
+    CtrlMsgBatchOpAck Acks[CTRL_MSG_BATCH_MAX_OPS];
+} CtrlMsgB2FAckBatch;
+
 typedef struct {
     RequestIdT RequestId;
     FileIdT FileId;
@@ -184,6 +444,133 @@ typedef struct {
     FileIOSizeT BytesServiced;
 } BuffMsgB2FAckHeader;
 
+//
+// A read whose data the back end writes directly into registered host memory, a buffer or scattered pages;
+// the request id carries the flag and the request is followed by the target segments
+//
+//
+#define BUFF_MSG_REQUEST_FLAG_DIRECT_READ 0x8000
+#define BUFF_MSG_DIRECT_READ_MAX_SEGMENTS 16
+
+typedef struct {
+    uint32_t AccessToken;
+    uint32_t NumSegments;
+} BuffMsgF2BDirectReadHeader;
+
+typedef struct {
+    uint64_t Address;
+    FileIOSizeT Bytes;
+    uint32_t Reserved;
+} BuffMsgDirectReadSegment;
+
+//
+// A read whose data the back end may compress; if it does, the flag is also set in the request id
+// of the response, whose data then is the |FileIOSizeT| size of an LZ4 block followed by the block,
+// while BytesServiced remains the size of the uncompressed data
+//
+//
+#define BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ 0x4000
+#define BUFF_MSG_RESPONSE_FLAG_COMPRESSED BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ
+
+//
+// A write the back end acknowledges only once it is on the media, with a flush of the device it shares
+// with the durable writes that complete meanwhile; writes are never compressed, so the flag reuses the bit,
+// and the back end clears it from the request id of the response
+//
+//
+#define BUFF_MSG_REQUEST_FLAG_DURABLE_WRITE BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ
+
+//
+// An append: a write whose Offset is BUFF_MSG_REQUEST_OFFSET_APPEND, which the back end places at the end of its file,
+// taking the offset and growing the file past it in one step, so that appends of any number of threads and hosts
+// never overlap; the response of an append carries the |FileSizeT| offset it was given as its data
+//
+//
+#define BUFF_MSG_REQUEST_OFFSET_APPEND ((FileSizeT)-1)
+
+//
+// An atomic operation on an aligned word of a file: a write whose Offset is BUFF_MSG_REQUEST_OFFSET_ATOMIC
+// and whose data is this header; the back end runs the operations of a file one at a time, and the response
+// carries the |uint64_t| value the word had before as its data. A compare-and-swap sets the word to Operand
+// if it is Compare, and a fetch-and-add adds Operand to it
+//
+//
+#define BUFF_MSG_REQUEST_OFFSET_ATOMIC ((FileSizeT)-2)
+#define BUFF_MSG_ATOMIC_COMPARE_SWAP 0
+#define BUFF_MSG_ATOMIC_FETCH_ADD 1
+
+typedef struct {
+    FileSizeT Offset;
+    uint64_t Operand;
+    uint64_t Compare;
+    uint32_t Op;
+    uint32_t Reserved;
+} BuffMsgF2BAtomicHeader;
+
+//
+// The acks of writes: the back end sets the flag in the request id of the response of a completed write,
+// and may pack the successful writes that follow each other in a batch into one response
+// whose request id is BUFF_MSG_RESPONSE_WRITE_ACKS, whose BytesServiced is the number of the writes,
+// and whose data is their |RequestIdT| request ids; each of them has serviced all the bytes it asked for
+//
+//
+#define BUFF_MSG_RESPONSE_FLAG_WRITE 0x8000
+#define BUFF_MSG_RESPONSE_WRITE_ACKS 0xFFFF
+
+//
+// A fence of reads behind writes: a request with this request id and no data, which the back end takes without a response;
+// the reads after it that overlap Bytes from Offset of FileId wait for the writes before it that overlap them,
+// while other reads and writes go on; no I/O carries the id, as direct reads are never compressed
+//
+//
+#define BUFF_MSG_REQUEST_FENCE 0xFFFF
+
+//
+// A request traced end to end (DDSTrace.h): the flag and a tag of the trace are set in the request id,
+// which the back end records its hops under and then clears; the tag tells apart the traced requests
+// that reuse the same request id; the request ids of a poll deeper than DDS_MAX_OUTSTANDING_IO take
+// the low bits of the tag
+//
+//
+#define BUFF_MSG_REQUEST_FLAG_TRACED 0x2000
+#define BUFF_MSG_REQUEST_TRACE_TAG_MASK 0x1F00
+#define BUFF_MSG_REQUEST_TRACE_TAG_SHIFT 8
+#define BUFF_MSG_REQUEST_TRACE_TAG_MASK_OF(PollQueueDepth) (BUFF_MSG_REQUEST_TRACE_TAG_MASK & ~((PollQueueDepth) - 1))
+
+//
+// A read of the item of a key in the cache table of the back end: the file id of the request is
+// BUFF_MSG_REQUEST_FILE_BY_KEY, Bytes is the size of the destination, and the request is followed by
+// the CacheKeyT key; the back end looks the key up and reads the item of it as any other read, or fails
+// the read with DDS_ERROR_CODE_KEY_NOT_FOUND, or with DDS_ERROR_CODE_BUFFER_OVERFLOW if the item does not fit
+//
+//
+#define BUFF_MSG_REQUEST_FILE_BY_KEY 0xFFFE
+
+//
+// A scan of a file that the back end filters: the file id of the request is BUFF_MSG_REQUEST_FILE_SCAN,
+// Offset is where the scan starts, Bytes is the size of the destination, and the request is followed by
+// this header; the back end reads Bytes of file FileId in chunks, runs the scan function ScanId on each whole
+// record of RecordBytes, and responds with what the function keeps of the records, in order; the scan fails
+// with DDS_ERROR_CODE_BUFFER_OVERFLOW if that does not fit in the destination, which the size of the range always does
+//
+//
+#define BUFF_MSG_REQUEST_FILE_SCAN 0xFFFD
+
+typedef struct {
+    FileIdT FileId;
+    uint16_t ScanId;
+    FileIOSizeT Bytes;
+    FileIOSizeT RecordBytes;
+    uint32_t Reserved;
+} BuffMsgF2BScanHeader;
+
+//
+// A response the back end published before its request completed: the flag is set in the size of the
+// response, whose bytes the host skips, and the completed response follows in a later batch
+//
+//
+#define BUFF_MSG_RESPONSE_SIZE_FLAG_DEFERRED 0x80000000
+
 typedef BuffMsgF2BReqHeader OffloadWorkRequest;
 typedef BuffMsgB2FAckHeader OffloadWorkResponse;
 
@@ -208,6 +595,26 @@ typedef BuffMsgB2FAckHeader OffloadWorkResponse;
 //
 AssertStaticMsgTypes(DDS_REQUEST_RING_BYTES % (sizeof(BuffMsgF2BReqHeader) + sizeof(FileIOSizeT)) == 0, 0);
 AssertStaticMsgTypes(DDS_RESPONSE_RING_BYTES % (sizeof(BuffMsgB2FAckHeader) + sizeof(FileIOSizeT)) == 0, 1);
+AssertStaticMsgTypes(DDS_MAX_POLL_QUEUE_DEPTH <= BUFF_MSG_REQUEST_FLAG_DIRECT_READ, 2);
+AssertStaticMsgTypes(DDS_REQUEST_RING_BYTES_ALIGNMENT % (sizeof(BuffMsgF2BReqHeader) + sizeof(FileIOSizeT)) == 0, 3);
+AssertStaticMsgTypes(DDS_RESPONSE_RING_BYTES_ALIGNMENT % (sizeof(BuffMsgB2FAckHeader) + sizeof(FileIOSizeT)) == 0, 4);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(BuffMsgF2BRequestId) <= BUFF_MSG_SIZE, 5);
+AssertStaticMsgTypes(DDS_MAX_POLL_QUEUE_DEPTH <= BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ, 6);
+AssertStaticMsgTypes(DDS_RESPONSE_RING_BYTES < BUFF_MSG_RESPONSE_SIZE_FLAG_DEFERRED, 7);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqUpdateCache) <= CTRL_MSG_SIZE, 8);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(BuffMsgF2BBindOffloadRings) <= BUFF_MSG_SIZE, 9);
+AssertStaticMsgTypes(DDS_MAX_OUTSTANDING_IO <= (1 << BUFF_MSG_REQUEST_TRACE_TAG_SHIFT), 10);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqBatch) <= CTRL_MSG_SIZE, 11);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckBatch) <= CTRL_MSG_SIZE, 12);
+AssertStaticMsgTypes(DDS_MAX_POLL_QUEUE_DEPTH <= BUFF_MSG_RESPONSE_FLAG_COMPRESSED, 13);
+AssertStaticMsgTypes(DDS_MAX_POLL_QUEUE_DEPTH <= BUFF_MSG_REQUEST_FLAG_TRACED, 14);
+AssertStaticMsgTypes(DDS_MAX_FILES <= BUFF_MSG_REQUEST_FILE_BY_KEY, 15);
+AssertStaticMsgTypes(DDS_MAX_FILES <= BUFF_MSG_REQUEST_FILE_SCAN, 16);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqLoadScan) <= CTRL_MSG_SIZE, 17);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqCreateSnapshot) <= CTRL_MSG_SIZE, 18);
+AssertStaticMsgTypes(sizeof(FileSizeT) <= sizeof(BuffMsgB2FAckHeader) + sizeof(FileIOSizeT), 19);
+AssertStaticMsgTypes(sizeof(uint64_t) <= sizeof(BuffMsgB2FAckHeader) + sizeof(FileIOSizeT), 20);
+AssertStaticMsgTypes(sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckRenewLeases) <= CTRL_MSG_SIZE, 21);
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #else
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+//
+// A profiler of named regions for both the host and the DPU: a region is timed in cycles of the
+// cycle counter (rdtsc on x64, cntvct_el0 on arm64), and every thread keeps a log-linear histogram
+// of the cycles of every region, and a counter of its events, so that recording takes no lock.
+// A thread prints and resets its histograms every PROFILER_DUMP_INTERVAL_SECONDS, and ProfilerDump
+// prints those of all threads merged, e.g. when the process stops
+//
+// Regions are timed with PROFILE_REGION_BEGIN and PROFILE_REGION_END in C, and with PROFILE_SCOPE,
+// which times the rest of the scope, in C++; they compile to nothing without PROFILER_ENABLED
+//
+//
+// #define PROFILER_ENABLED
+#define PROFILER_DUMP_INTERVAL_SECONDS 10
+#define PROFILER_MAX_REGIONS 32
+#define PROFILER_MAX_THREADS 256
+#define PROFILER_CALIBRATION_MILLISECONDS 10
+
+//
+// Every power of two of cycles is split into 1 << PROFILER_SUB_BUCKET_BITS buckets,
+// so a percentile is within 1 / (1 << PROFILER_SUB_BUCKET_BITS) of its value
+//
+//
+#define PROFILER_SUB_BUCKET_BITS 3
+#define PROFILER_SUB_BUCKETS (1 << PROFILER_SUB_BUCKET_BITS)
+#define PROFILER_BUCKETS (64 * PROFILER_SUB_BUCKETS)
+
+#define PROFILER_REGION_INVALID -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// Read the cycle counter
+//
+//
+static inline uint64_t
+ProfilerCycles(void) {
+#if defined(_M_X64) || defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t cycles;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(cycles));
+    return cycles;
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+//
+// Nanoseconds per cycle of the cycle counter, measured once
+//
+//
+double
+ProfilerNsPerCycle(void);
+
+//
+// The id of the region of a name, registering it the first time; PROFILER_REGION_INVALID if there are
+// already PROFILER_MAX_REGIONS regions
+//
+//
+int
+ProfilerRegisterRegion(
+    const char* Name
+);
+
+//
+// Record that an event of a region took Cycles cycles
+//
+//
+void
+ProfilerRecord(
+    int Region,
+    uint64_t Cycles
+);
+
+//
+// Count Events events of a region that isn't timed
+//
+//
+void
+ProfilerCount(
+    int Region,
+    uint64_t Events
+);
+
+//
+// Print the histograms of all threads, merged; the threads should be done recording
+//
+//
+void
+ProfilerDump(
+    FILE* Out
+);
+
+//
+// Time how long Operations operations take, e.g. a benchmark
+//
+//
+struct Profiler {
+    uint64_t StartCycles;
+    uint64_t StopCycles;
+    size_t Operations;
+};
+
+void InitProfiler(struct Profiler* Prof, size_t Ops);
+void StartProfiler(struct Profiler* Prof);
+void StopProfiler(struct Profiler* Prof);
+double GetProfilerEllapsed(struct Profiler* Prof);
+void ReportProfiler(struct Profiler* Prof);
+
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_REGION_BEGIN(Var) \
+    uint64_t Var##ProfilerStart = ProfilerCycles()
+
+#define PROFILE_REGION_END(Var, Name) \
+    do { \
+        static int Var##ProfilerRegion = PROFILER_REGION_INVALID; \
+        uint64_t Var##ProfilerCycles = ProfilerCycles() - Var##ProfilerStart; \
+        if (Var##ProfilerRegion == PROFILER_REGION_INVALID) { \
+            Var##ProfilerRegion = ProfilerRegisterRegion(Name); \
+        } \
+        ProfilerRecord(Var##ProfilerRegion, Var##ProfilerCycles); \
+    } while (0)
+
+#define PROFILE_COUNT(Name, Events) \
+    do { \
+        static int profilerCounter = PROFILER_REGION_INVALID; \
+        if (profilerCounter == PROFILER_REGION_INVALID) { \
+            profilerCounter = ProfilerRegisterRegion(Name); \
+        } \
+        ProfilerCount(profilerCounter, (Events)); \
+    } while (0)
+#else
+#define PROFILE_REGION_BEGIN(Var)
+#define PROFILE_REGION_END(Var, Name) do { } while (0)
+#define PROFILE_COUNT(Name, Events) do { } while (0)
+#endif
+
+#ifdef __cplusplus
+//
+// Time the rest of a scope as a region
+//
+//
+class ProfilerScope {
+public:
+    ProfilerScope(
+        int Region
+    ) : region(Region), start(ProfilerCycles()) {
+    }
+
+    ~ProfilerScope() {
+        ProfilerRecord(region, ProfilerCycles() - start);
+    }
+
+private:
+    int region;
+    uint64_t start;
+};
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_SCOPE_CONCAT(A, B) A##B
+#define PROFILE_SCOPE_NAME(A, B) PROFILE_SCOPE_CONCAT(A, B)
+#define PROFILE_SCOPE(Name) \
+    static const int PROFILE_SCOPE_NAME(profilerRegion, __LINE__) = ProfilerRegisterRegion(Name); \
+    ProfilerScope PROFILE_SCOPE_NAME(profilerScope, __LINE__)(PROFILE_SCOPE_NAME(profilerRegion, __LINE__))
+#else
+#define PROFILE_SCOPE(Name)
+#endif
+#endif
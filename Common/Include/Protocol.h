@@ -34,6 +34,12 @@
 #define DDS_ERROR_CODE_SEGMENT_RETRIEVAL_FAILURE 26
 #define DDS_ERROR_CODE_RESERVED_SEGMENT_ERROR 27
 #define DDS_ERROR_CODE_OUT_OF_MEMORY 28
+#define DDS_ERROR_CODE_INVALID_PARAM 29
+#define DDS_ERROR_CODE_CHECKSUM_MISMATCH 30
+#define DDS_ERROR_CODE_KEY_NOT_FOUND 31
+#define DDS_ERROR_CODE_READ_ONLY 32  // a write to a snapshot
+#define DDS_ERROR_CODE_BACKEND_RESTARTED 33  // the back end was lost with the I/O in flight, and it cannot be retried
+#define DDS_ERROR_CODE_LEASE_HELD 34  // another front end holds a lease of the file in the way, and is asked to give it back
 
 #define DDS_CACHE_LINE_SIZE 64
 #define DDS_CACHE_LINE_SIZE_BY_INT 16
@@ -42,13 +48,47 @@
 
 #define DDS_MAX_FILE_PATH 64
 #define DDS_MAX_DEVICE_NAME_LEN 32
-#define DDS_MAX_DIRS 2
-#define DDS_MAX_FILES 1
-#define DDS_MAX_FILES_PER_DIR 1000
-#define DDS_MAX_POLLS 1
+#define DDS_MAX_DIRS 64
+#define DDS_MAX_FILES 4096
+#define DDS_MAX_FILES_PER_DIR DDS_MAX_FILES
+#define DDS_MAX_POLLS 8
 #define DDS_DIR_INVALID 0xFFFFUL
 #define DDS_DIR_ROOT 0
 #define DDS_FILE_INVALID 0xFFFFUL
+
+//
+// A file created with DDS_FILE_ATTRIBUTE_SPARSE is thin provisioned: changing its size allocates nothing,
+// a segment is allocated when a write first touches it, and the holes read as zeros;
+// growing any other file reserves all of its space up front, contiguously where the device has room
+//
+//
+#define DDS_FILE_ATTRIBUTE_SPARSE 0x40000000
+
+//
+// A file created with DDS_FILE_ATTRIBUTE_CHECKSUM has a CRC32C of each 4 KB block, kept by the DPU:
+// a read that finds a block changed fails with DDS_ERROR_CODE_CHECKSUM_MISMATCH,
+// and the DPU scrubs the blocks in the background
+//
+//
+#define DDS_FILE_ATTRIBUTE_CHECKSUM 0x04000000
+
+//
+// A file with DDS_FILE_ATTRIBUTE_SNAPSHOT is a read-only snapshot of another file, made by CreateSnapshot;
+// it shares the segments of the file until the file writes them
+//
+//
+#define DDS_FILE_ATTRIBUTE_SNAPSHOT 0x02000000
+
+//
+// A write of a file created with DDS_FILE_ATTRIBUTE_ATOMIC_WRITES lands whole or not at all across crashes,
+// so that databases need no doublewrite buffer of their own: the DPU stages a write that spans sectors
+// before writing it in place, and rolls it forward when it loads. Such a write is sector aligned
+// and at most DDS_MAX_ATOMIC_WRITE_BYTES, and goes to one DPU in one request
+//
+//
+#define DDS_FILE_ATTRIBUTE_ATOMIC_WRITES 0x01000000
+#define DDS_MAX_ATOMIC_WRITE_BYTES 32768
+
 #define DDS_PAGE_SIZE 4096
 #define DDS_POLL_DEFAULT 0
 #define DDS_POLL_MAX_LATENCY_MICROSECONDS 100
@@ -60,6 +100,30 @@
 #define DDS_RESPONSE_RING_BYTES 125829120
 #define DDS_REQUEST_INVALID 0xFFFFUL
 
+//
+// Ring sizes are negotiated per front end when it connects: DDS_REQUEST_RING_BYTES and
+// DDS_RESPONSE_RING_BYTES are the defaults and the largest the back end accepts;
+// a ring is at least DDS_RING_MIN_BYTES and a multiple of its alignment, which keeps it cache aligned
+// and lets padding and headers wrap exactly at the end of the ring
+//
+//
+#define DDS_RING_MIN_BYTES 2097152
+#define DDS_REQUEST_RING_BYTES_ALIGNMENT 320
+#define DDS_RESPONSE_RING_BYTES_ALIGNMENT 192
+#define DDS_RING_BYTES_VALID(Bytes, MaxBytes, Alignment) \
+    ((Bytes) >= DDS_RING_MIN_BYTES && (Bytes) <= (MaxBytes) && (Bytes) % (Alignment) == 0)
+
+//
+// Ring protocols a front end may ask for when it connects; the back end grants the one asked for
+// if both sides implement it and DDS_RING_PROTOCOL_DEFAULT otherwise;
+// only the progressive rings are implemented, and another protocol gets a value of its own
+// once both sides implement it
+//
+//
+#define DDS_RING_PROTOCOL_PROGRESSIVE 0
+#define DDS_RING_PROTOCOL_DEFAULT DDS_RING_PROTOCOL_PROGRESSIVE
+#define DDS_RING_PROTOCOL_IMPLEMENTED(Protocol) ((Protocol) == DDS_RING_PROTOCOL_PROGRESSIVE)
+
 #define RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT 83886080//1048576
 #define BACKEND_REQUEST_MAX_DMA_SIZE RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT
 #define BACKEND_REQUEST_BUFFER_SIZE DDS_REQUEST_RING_BYTES
@@ -69,38 +133,294 @@
 #define BACKEND_RESPONSE_BUFFER_SIZE DDS_RESPONSE_RING_BYTES
 #define RING_BUFFER_RESPONSE_BATCH_ENABLED
 
+//
+// Out-of-order responses: the DPU publishes a batch without waiting for its slow requests,
+// marking their responses deferred, and sends each of them in a later batch once it completes
+//
+//
+#define RING_BUFFER_RESPONSE_OUT_OF_ORDER
+
+//
+// Per-thread staging of requests on the host: the bytes a thread can stage,
+// and the staged bytes at which they are published without waiting for a flush
+//
+//
+#define RING_BUFFER_REQUEST_STAGING_BYTES 65536
+#define RING_BUFFER_REQUEST_STAGING_FLUSH_BYTES 16384
+
 #define RING_BUFFER_REQUEST_META_DATA_SIZE 128
 #define RING_BUFFER_RESPONSE_META_DATA_SIZE 128
 
+//
+// Request doorbells: after RING_BUFFER_REQUEST_DOORBELL_IDLE_POLLS meta reads in a row find the request ring idle,
+// the DPU parks it, writing DDS_RING_PARKED_OFFSET with the head, reads the meta data once more
+// and stops polling it if it is still idle; a front end that publishes requests and finds the ring parked
+// clears the mark and rings the doorbell, a send without data on the queue pair of the buffer,
+// which makes the DPU poll again; without it, the DPU reads the meta data of idle rings over PCIe all the time.
+// On verbs, every RING_BUFFER_REQUEST_DOORBELL_SIGNAL_INTERVAL-th doorbell is signaled to retire the others
+//
+//
+// #define RING_BUFFER_REQUEST_DOORBELL
+#define RING_BUFFER_REQUEST_DOORBELL_IDLE_POLLS 1024
+#define RING_BUFFER_REQUEST_DOORBELL_SIGNAL_INTERVAL 64
+
+//
+// Layout of a ring in the DMA buffer: the ring starts on a page; the progress and tail lines
+// that the DPU reads in one RING_BUFFER_*_META_DATA_SIZE read come first, then the head line
+// in a block of its own, both sized to DDS_NIC_CACHE_LINE_SIZE so that adjacent-line prefetching
+// and 128-byte PCIe transfers never pull in the lines of the other side;
+// the ring data starts on the next page, so DMA into the data never touches the meta data
+//
+//
+#define DDS_NIC_CACHE_LINE_SIZE 128
+#define DDS_RING_ALIGNMENT DDS_PAGE_SIZE
+#define DDS_RING_META_BYTES DDS_PAGE_SIZE
+#define DDS_RING_HEAD_OFFSET RING_BUFFER_REQUEST_META_DATA_SIZE
+#define DDS_RING_PARKED_OFFSET (DDS_RING_HEAD_OFFSET + sizeof(int))
+
+//
+// Handover of the DPU back end to a new build without dropping the hosts: the back end that hands over
+// stops fetching requests, completes the ones it has fetched, and writes its last tail together with
+// the handover mark at DDS_RING_HANDOVER_OFFSET of every response ring, notifying the host as for a response,
+// and exits once the hosts have closed their control connections; the host then reconnects the buffer,
+// whose rings it keeps, to the back end that takes over, which resumes them at the head and the tail
+// the old one left in them; it keeps trying for DDS_BACKEND_RECONNECT_TIMEOUT_MS, first every DDS_BACKEND_RECONNECT_INTERVAL_MS
+// and backing off to every DDS_BACKEND_RECONNECT_MAX_INTERVAL_MS
+//
+//
+#define DDS_RING_HANDOVER_OFFSET (DDS_RING_HEAD_OFFSET + sizeof(int))
+#define DDS_BACKEND_RECONNECT_TIMEOUT_MS 30000
+#define DDS_BACKEND_RECONNECT_INTERVAL_MS 100
+#define DDS_BACKEND_RECONNECT_MAX_INTERVAL_MS 2000
+
+//
+// A back end that exits without a handover, such as one that crashed, is found by the host from a failed completion
+// or the disconnect of the buffer connection, which it looks at every DDS_BACKEND_LIVENESS_CHECK_MS while it waits;
+// the host reconnects as for a handover, with the rings resumed past every request it has published,
+// and issues the reads in flight again, failing the other I/Os with DDS_ERROR_CODE_BACKEND_RESTARTED
+//
+//
+#define DDS_BACKEND_LIVENESS_CHECK_MS 100
+
+//
+// Bytes a DMA buffer needs besides the data of its rings: the meta data of both rings
+// and the padding that aligns the response ring after the request ring data
+//
+//
+#define DDS_RING_DMA_OVERHEAD_BYTES (2 * DDS_RING_META_BYTES + DDS_RING_ALIGNMENT)
+
 #define DDS_MAX_OUTSTANDING_IO 256
+//
+// I/Os a poll may have outstanding, i.e., its queue depth: DDS_MAX_OUTSTANDING_IO unless the front end asks for
+// another power of two in [DDS_MIN_POLL_QUEUE_DEPTH, DDS_MAX_POLL_QUEUE_DEPTH] and the back end grants it;
+// request ids of a poll stay below its queue depth, so they leave the high bits of RequestIdT to the flags
+// the requests carry in them
+//
+//
+#define DDS_MIN_POLL_QUEUE_DEPTH 64
+#define DDS_MAX_POLL_QUEUE_DEPTH 4096
+#define DDS_POLL_QUEUE_DEPTH_VALID(Depth) ((Depth) >= DDS_MIN_POLL_QUEUE_DEPTH && (Depth) <= DDS_MAX_POLL_QUEUE_DEPTH && \
+    ((Depth) & ((Depth) - 1)) == 0)
 #define DDS_MAX_COMPLETION_BUFFERING 16
-#define DDS_DPU_IO_SLOT_NUMBER_BASE DDS_MAX_OUTSTANDING_IO
-#define DDS_DPU_IO_PARALLELISM 2
-#define DDS_CONTROL_PLANE_IO_SLOT_NUMBER 512
+//
+// Clients and buffers the DPU back end serves at a time; the buffers are shared by the polls of all clients,
+// each of which takes one block of I/O slots, as deep as the deepest poll the back end grants
+//
+//
+#define DDS_BACKEND_MAX_CLIENTS 4
+#define DDS_BACKEND_MAX_BUFFS DDS_MAX_POLLS
+#define DDS_BACKEND_MAX_POLL_QUEUE_DEPTH 1024
+//
+// I/O slots of the back end file service: every host poll has its block first, followed by the DPU slots,
+// the control plane slot, and the slots of the writes replicated from a peer DPU
+//
+//
+#define DDS_HOST_IO_SLOT_NUMBER_BASE(BuffId) ((BuffId) * DDS_BACKEND_MAX_POLL_QUEUE_DEPTH)
+#define DDS_DPU_IO_SLOT_NUMBER_BASE DDS_HOST_IO_SLOT_NUMBER_BASE(DDS_BACKEND_MAX_BUFFS)
+//
+// Network lcores of the DPU that offload at most (all 7 workers of a BF-2 and the main lcore);
+// each takes DDS_DPU_IO_SLOTS_PER_THREAD of the DPU slots and one offload response ring
+//
+//
+#define DDS_DPU_IO_PARALLELISM 8
+#define DDS_DPU_IO_SLOTS_PER_THREAD (DDS_MAX_OUTSTANDING_IO / 2)
+#define DDS_CONTROL_PLANE_IO_SLOT_NUMBER (DDS_DPU_IO_SLOT_NUMBER_BASE + DDS_DPU_IO_SLOTS_PER_THREAD * DDS_DPU_IO_PARALLELISM)
+#define DDS_REPLICA_IO_SLOT_NUMBER_BASE (DDS_CONTROL_PLANE_IO_SLOT_NUMBER + 1)
+#define DDS_IO_SLOT_NUMBER_TOTAL (DDS_REPLICA_IO_SLOT_NUMBER_BASE + DDS_REPLICA_IO_SLOTS)
 #define DDS_BACKEND_SECTOR_SIZE 512
 
 #define DDS_NOTIFICATION_METHOD_INTERRUPT 0
 #define DDS_NOTIFICATION_METHOD_TIMER 1
 #define DDS_NOTIFICATION_METHOD DDS_NOTIFICATION_METHOD_INTERRUPT
 
+//
+// Offload response rings: requests the DPU serves partially for the host are delivered to the host
+// together with the data the DPU has read, one ring per network thread that offloads,
+// each with a page of meta data (the tail the DPU writes, then the head the host writes) before its data;
+// records are aligned and never wrap, and a record with OFFLOAD_RESPONSE_SIZE_FLAG_PADDING in its size skips to the end
+//
+//
 #define OFFLOAD_RESPONSE_RING_BYTES 251658240
+#define OFFLOAD_RESPONSE_RINGS DDS_DPU_IO_PARALLELISM
+#define OFFLOAD_RESPONSE_RING_DATA_BYTES (OFFLOAD_RESPONSE_RING_BYTES / OFFLOAD_RESPONSE_RINGS)
+#define OFFLOAD_RESPONSE_RING_TAIL_OFFSET 0
+#define OFFLOAD_RESPONSE_RING_HEAD_OFFSET DDS_NIC_CACHE_LINE_SIZE
+#define OFFLOAD_RESPONSE_RING_META_BYTES DDS_RING_META_BYTES
+#define OFFLOAD_RESPONSE_RING_STRIDE (OFFLOAD_RESPONSE_RING_META_BYTES + OFFLOAD_RESPONSE_RING_DATA_BYTES)
+#define OFFLOAD_RESPONSE_RECORD_ALIGNMENT 8
+#define OFFLOAD_RESPONSE_SIZE_FLAG_PADDING 0x80000000
 
-#define CACHE_TABLE_OCC_GRANULARITY_ITEM 0
-#define CACHE_TABLE_OCC_GRANULARITY_BUCKET 1
-#define CACHE_TABLE_OCC_GRANULARITY CACHE_TABLE_OCC_GRANULARITY_BUCKET
-
+//
+// The plan of the cores of the DPU. The control plane threads (the main thread, the stats threads and
+// the directing control) sleep most of the time and share the first core with the SPDK reactors
+// of the file service, unless the storage config is given another reactor mask with -m.
+// Every other core runs a single busy-polling thread: the agent of the storage engine that handles
+// connections and control messages, the data plane agents that poll the buffers, one core each
+// from the first one, and, from CORE_ALLOCATION_NETWORK_ENGINE_FIRST_CORE, the lcores of the "core-list"
+// of the network config. CorePlan.h checks the plan as the threads start
+//
+//
+#define CORE_ALLOCATION_CONTROL_PLANE_CORE 0
+#define CORE_ALLOCATION_SPDK_REACTOR_MASK "0x1"
 #define CORE_ALLOCATION_STORAGE_ENGINE_AGENT_CORE 1
+#define CORE_ALLOCATION_STORAGE_ENGINE_DATA_PLANE_FIRST_CORE 2
+#define DDS_BACKEND_DATA_PLANE_AGENTS 2
+#define CORE_ALLOCATION_NETWORK_ENGINE_FIRST_CORE \
+    (CORE_ALLOCATION_STORAGE_ENGINE_DATA_PLANE_FIRST_CORE + DDS_BACKEND_DATA_PLANE_AGENTS)
 
+//
+// How offloaded reads reach the network: copied out of a buffer of each read (NONE),
+// or read by the file service straight into read buffers (rte_mbuf) that are then sent as they are (DYNAMIC)
+//
+//
 #define OFFLOAD_ENGINE_ZERO_COPY_NONE 0
 #define OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC 1
 #define OFFLOAD_ENGINE_ZERO_COPY_STATIC 2
-#define OFFLOAD_ENGINE_ZERO_COPY OFFLOAD_ENGINE_ZERO_COPY_NONE
+#define OFFLOAD_ENGINE_ZERO_COPY OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC
 #define OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
-#define OFFLOAD_ENGINE_BATCH_SIZE 1
-#undef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+//
+// Reads the offload engine gathers from a burst of streams before it submits them to the file service at once
+//
+//
+#define OFFLOAD_ENGINE_BATCH_SIZE 64
+//
+// Offloaded reads that are not sector aligned read the sectors around them
+//
+//
+#define OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+//
+// Offloaded reads are admitted only while the DPU keeps up with them; past that, requests go to the host
+//
+//
+#define OFFLOAD_ENGINE_ADMISSION_CONTROL
+//
+// The responses of the items read most often are kept in the memory of the DPU, and a read of one is answered
+// from there with no I/O; an update of the cache table invalidates the response of the location it adds
+//
+//
+#define OFFLOAD_ENGINE_RESPONSE_CACHE
 
 #define OPT_FILE_SERVICE_ZERO_COPY
 #define OPT_FILE_SERVICE_BATCHING
+#define OPT_FILE_SERVICE_TRIM
+//
+// Checksums of files with DDS_FILE_ATTRIBUTE_CHECKSUM, in an area at the end of the device;
+// turning this on or off changes the layout of the store
+//
+//
+#define OPT_FILE_SERVICE_CHECKSUMS
+//
+// A cache of hot blocks in the memory of the DPU, in front of the reads of the storage engine
+//
+//
+#define OPT_FILE_SERVICE_BLOCK_CACHE
+//
+// The request and response rings of the DPU are mapped twice back to back, so that data wrapping around
+// the end of a ring is contiguous and the storage engine never splits the I/O of a request
+//
+//
+#define OPT_FILE_SERVICE_MIRRORED_RINGS
+//
+// On a zoned bdev, files take whole zones and are written by zone appends at their ends;
+// the metadata must be on conventional zones at the start of the device
+//
+//
+#define OPT_FILE_SERVICE_ZONED
+//
+// Scans of files that the DPU filters with compiled scan functions, reading them in chunks of staging buffers;
+// with zero copy, the staging buffers are reserved for the scans alone
+//
+//
+#define OPT_FILE_SERVICE_SCAN
+//
+// Each offloading network lcore hands its reads to the worker of its I/O slots through its own
+// single-producer dring of libtle_dring, instead of the multi-producer ring that all lcores share
+//
+//
+#define OPT_FILE_SERVICE_OFFLOAD_DRING
+//
+// Copy-on-write snapshots of files: a snapshot maps the segments of its file as they are, and the first write
+// of the file to a shared segment waits for the segment to be copied to a new one and remapped;
+// snapshots of checksummed files or on zoned storage are not supported
+//
+//
+#define OPT_FILE_SERVICE_SNAPSHOTS
+//
+// Inline deduplication of whole segments: the DPU hashes a segment that a file writes from its start to its end
+// in order, with SHA-256 as the writes go by, and remaps the slot to a segment of the same content if there is one,
+// shared as a snapshot shares it; needs OPT_FILE_SERVICE_SNAPSHOTS, and skips checksummed files and zoned storage
+//
+//
+#define OPT_FILE_SERVICE_DEDUP
+//
+// Atomic writes of files with DDS_FILE_ATTRIBUTE_ATOMIC_WRITES, staged in the metadata area of the store
+// before they are written in place; files can't have the attribute without it
+//
+//
+#define OPT_FILE_SERVICE_ATOMIC_WRITES
+//
+// Background defragmentation: the DPU moves segments of files that are not being written next to the segments
+// before them, at a bounded rate, and remaps them as a snapshot copy does; needs OPT_FILE_SERVICE_SNAPSHOTS,
+// and skips checksummed files, snapshots and zoned storage
+//
+//
+#define OPT_FILE_SERVICE_DEFRAG
+//
+// Tiering of cold data to a capacity bdev, such as a namespace of a capacity server over NVMe-oF: the DPU moves
+// the segments of files not read nor written for days there, reads them there until they are moved back,
+// and moves them back once they are read or before they are written; needs OPT_FILE_SERVICE_DEFRAG, whose mover
+// it uses, and skips checksummed files and zoned storage. Without a capacity bdev in the config, nothing is moved
+//
+//
+#define OPT_FILE_SERVICE_TIERING
+//
+// A write buffer in the memory of the DPU: small writes are acknowledged once they are copied there, merge with
+// the writes of the same window of their file, and are written back in the background, and reads of what it holds
+// are answered from it. Writes acknowledged from it are lost if the DPU loses power, so it is only for deployments
+// that protect the DPU memory otherwise; it is off unless the config gives it memory
+//
+//
+#define OPT_FILE_SERVICE_WRITE_BUFFER
+//
+// Synchronous replication of the writes of the host to a peer DPU, which replicates its writes to this one too:
+// every data plane agent forwards the writes of its buffers over its own RDMA connection to the peer
+// as it submits them to the file service, and a write completes once both it and the acknowledgement
+// of the peer are done, which costs a round trip alongside the local write rather than a second write after it.
+// The peer writes them in its replica I/O slots; files must be created on both DPUs, and writes fail
+// while the peer is unreachable, or if they are larger than REPLICATION_MAX_WRITE_BYTES
+//
+//
+#undef OPT_FILE_SERVICE_REPLICATION
+#ifdef OPT_FILE_SERVICE_REPLICATION
+#define REPLICATION_PEER_IP "192.168.200.156"
+#define REPLICATION_PORT 4243
+#define REPLICATION_CHANNEL_DEPTH DDS_MAX_OUTSTANDING_IO
+#define REPLICATION_MAX_WRITE_BYTES 65536
+#define REPLICATION_CONNECT_TIMEOUT_SECONDS 60
+#define DDS_REPLICA_IO_SLOTS (REPLICATION_CHANNEL_DEPTH * DDS_BACKEND_DATA_PLANE_AGENTS)
+#else
+#define DDS_REPLICA_IO_SLOTS 0
+#endif
 
 #define CREATE_DEFAULT_DPU_FILE
 #ifdef CREATE_DEFAULT_DPU_FILE
@@ -135,6 +455,29 @@ AssertStaticProtocol(DDS_REQUEST_RING_BYTES == DDS_REQUEST_RING_SIZE * DDS_REQUE
 AssertStaticProtocol(DDS_REQUEST_RING_BYTES % DDS_CACHE_LINE_SIZE == 0, 3);
 AssertStaticProtocol(DDS_RESPONSE_RING_BYTES == DDS_RESPONSE_RING_SIZE * DDS_RESPONSE_RING_SLOT_SIZE, 4);
 AssertStaticProtocol(DDS_RESPONSE_RING_BYTES % DDS_CACHE_LINE_SIZE == 0, 5);
+AssertStaticProtocol(DDS_POLL_QUEUE_DEPTH_VALID(DDS_MAX_OUTSTANDING_IO) && DDS_POLL_QUEUE_DEPTH_VALID(DDS_BACKEND_MAX_POLL_QUEUE_DEPTH) &&
+    DDS_BACKEND_MAX_POLL_QUEUE_DEPTH >= DDS_MAX_OUTSTANDING_IO, 6);
+AssertStaticProtocol(DDS_IO_SLOT_NUMBER_TOTAL <= 0xFFFF, 7);
+AssertStaticProtocol(DDS_RING_BYTES_VALID(DDS_REQUEST_RING_BYTES, DDS_REQUEST_RING_BYTES, DDS_REQUEST_RING_BYTES_ALIGNMENT), 8);
+AssertStaticProtocol(DDS_RING_BYTES_VALID(DDS_RESPONSE_RING_BYTES, DDS_RESPONSE_RING_BYTES, DDS_RESPONSE_RING_BYTES_ALIGNMENT), 9);
+AssertStaticProtocol(DDS_REQUEST_RING_BYTES_ALIGNMENT % DDS_CACHE_LINE_SIZE == 0, 10);
+AssertStaticProtocol(DDS_RESPONSE_RING_BYTES_ALIGNMENT % DDS_CACHE_LINE_SIZE == 0, 11);
+AssertStaticProtocol(RING_BUFFER_REQUEST_META_DATA_SIZE % DDS_NIC_CACHE_LINE_SIZE == 0, 12);
+AssertStaticProtocol(RING_BUFFER_RESPONSE_META_DATA_SIZE == RING_BUFFER_REQUEST_META_DATA_SIZE, 13);
+AssertStaticProtocol(DDS_RING_HEAD_OFFSET + DDS_NIC_CACHE_LINE_SIZE <= DDS_RING_META_BYTES, 14);
+AssertStaticProtocol(DDS_RING_META_BYTES % DDS_PAGE_SIZE == 0, 15);
+AssertStaticProtocol(DDS_BACKEND_MAX_BUFFS >= DDS_MAX_POLLS && DDS_BACKEND_MAX_BUFFS <= 0xFFFF, 16);
+AssertStaticProtocol(OFFLOAD_RESPONSE_RING_BYTES % (OFFLOAD_RESPONSE_RINGS * OFFLOAD_RESPONSE_RECORD_ALIGNMENT) == 0, 17);
+AssertStaticProtocol(OFFLOAD_RESPONSE_RING_HEAD_OFFSET + DDS_NIC_CACHE_LINE_SIZE <= OFFLOAD_RESPONSE_RING_META_BYTES, 18);
+AssertStaticProtocol(OFFLOAD_RESPONSE_RING_DATA_BYTES < OFFLOAD_RESPONSE_SIZE_FLAG_PADDING, 19);
+AssertStaticProtocol(CORE_ALLOCATION_STORAGE_ENGINE_AGENT_CORE < CORE_ALLOCATION_STORAGE_ENGINE_DATA_PLANE_FIRST_CORE ||
+    CORE_ALLOCATION_STORAGE_ENGINE_AGENT_CORE >= CORE_ALLOCATION_NETWORK_ENGINE_FIRST_CORE, 20);
+AssertStaticProtocol(CORE_ALLOCATION_CONTROL_PLANE_CORE != CORE_ALLOCATION_STORAGE_ENGINE_AGENT_CORE &&
+    (CORE_ALLOCATION_CONTROL_PLANE_CORE < CORE_ALLOCATION_STORAGE_ENGINE_DATA_PLANE_FIRST_CORE ||
+    CORE_ALLOCATION_CONTROL_PLANE_CORE >= CORE_ALLOCATION_NETWORK_ENGINE_FIRST_CORE), 21);
+#ifdef OPT_FILE_SERVICE_REPLICATION
+AssertStaticProtocol(REPLICATION_CHANNEL_DEPTH <= 0xFFFF, 22);
+#endif
 
 #if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
 #ifndef RING_BUFFER_RESPONSE_BATCH_ENABLED
@@ -142,11 +485,50 @@ AssertStaticProtocol(DDS_RESPONSE_RING_BYTES % DDS_CACHE_LINE_SIZE == 0, 5);
 #endif
 #endif
 
+#if defined(RING_BUFFER_RESPONSE_OUT_OF_ORDER) && !defined(RING_BUFFER_RESPONSE_BATCH_ENABLED)
+#error "Out-of-order responses need response batching"
+#endif
+
+#if defined(OPT_FILE_SERVICE_ZONED) && (!defined(OPT_FILE_SERVICE_TRIM) || !defined(OPT_FILE_SERVICE_ZERO_COPY))
+#error "Zoned storage resets zones in the trim queue and appends with zero copy"
+#endif
+
+#if defined(OPT_FILE_SERVICE_DEDUP) && !defined(OPT_FILE_SERVICE_SNAPSHOTS)
+#error "Deduplicated segments are shared as snapshots share them"
+#endif
+
+#if defined(OPT_FILE_SERVICE_DEFRAG) && !defined(OPT_FILE_SERVICE_SNAPSHOTS)
+#error "Defragmentation moves segments by the remapping of snapshot copies"
+#endif
+
+#if defined(OPT_FILE_SERVICE_TIERING) && !defined(OPT_FILE_SERVICE_DEFRAG)
+#error "Tiering moves segments with the mover of the defragmentation"
+#endif
+
+#if defined(OPT_FILE_SERVICE_WRITE_BUFFER) && defined(OPT_FILE_SERVICE_REPLICATION)
+#error "Buffered writes are acknowledged before the peer has them"
+#endif
+
+#if defined(DDS_EMULATION) && defined(OPT_FILE_SERVICE_ENCRYPTION)
+#error "Emulation has no mlx5 accel engines to encrypt the store on"
+#endif
+
+#if defined(OFFLOAD_ENGINE_RESPONSE_CACHE) && OFFLOAD_ENGINE_ZERO_COPY != OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC
+#error "Cached responses are sent in read buffers attached to their data"
+#endif
+
 #ifdef __GNUC__
 #pragma GCC diagnostic pop
 #else
 #pragma warning(pop)
 #endif
 
+//
+// The address of the back end, which the builds can set (BackEndAddr of meson), e.g. to the soft-RoCE netdev
+// of an emulation server (DDS_EMULATION, the Emulation option of meson)
+//
+//
+#ifndef DDS_BACKEND_ADDR
 #define DDS_BACKEND_ADDR "192.168.200.155"
+#endif
 #define DDS_BACKEND_PORT 4242
@@ -6,4 +6,5 @@
 #include "BackEndControl.h"
 
 volatile int ForceQuitStorageEngine = 0;
-volatile int ForceQuitNetworkEngine = 0;
\ No newline at end of file
+volatile int ForceQuitNetworkEngine = 0;
+volatile int HandOverStorageEngine = 0;
\ No newline at end of file
@@ -3,146 +3,591 @@
  * Licensed under the MIT License
  */
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "CacheTable.h"
 #include "HashFunctions.h"
 
+#ifdef CACHE_TABLE_STATS_ENABLED
+//
+// The slot of lookup counters of this thread, taken at its first lookup
+//
+//
+static __thread int LookupStatsSlot = -1;
+
+//
+// Add to a counter that has one writer, without an atomic read-modify-write
+//
+//
+static inline void
+AddToCounter(
+    _Atomic uint64_t* Counter,
+    uint64_t Value
+) {
+    atomic_store_explicit(Counter, atomic_load_explicit(Counter, memory_order_relaxed) + Value,
+        memory_order_relaxed);
+}
+
+//
+// The lookup counters of the calling thread
+//
+//
+static inline CacheTableLookupStatsT*
+GetLookupStats(
+    CacheTableT* CacheTable
+) {
+    if (LookupStatsSlot < 0) {
+        LookupStatsSlot = (int)(atomic_fetch_add_explicit(&CacheTable->NextLookupStats, 1, memory_order_relaxed) %
+            CACHE_TABLE_STATS_SLOTS);
+    }
+    return &CacheTable->LookupStats[LookupStatsSlot];
+}
+
+//
+// Count the lookups of the calling thread
+//
+//
+static inline void
+CountLookups(
+    CacheTableT* CacheTable,
+    uint64_t Lookups,
+    uint64_t Hits,
+    uint64_t Retries
+) {
+    CacheTableLookupStatsT *stats = GetLookupStats(CacheTable);
+    AddToCounter(&stats->Lookups, Lookups);
+    AddToCounter(&stats->Hits, Hits);
+    AddToCounter(&stats->Retries, Retries);
+}
+
+//
+// Count an insertion that displaced Depth items
+//
+//
+static inline void
+CountDepth(
+    CacheTableT* CacheTable,
+    size_t Depth
+) {
+    int bucket = Depth ? 64 - __builtin_clzll(Depth) : 0;
+    if (bucket >= CACHE_TABLE_STATS_DEPTH_BUCKETS) {
+        bucket = CACHE_TABLE_STATS_DEPTH_BUCKETS - 1;
+    }
+    AddToCounter(&CacheTable->WriterStats.Depths[bucket], 1);
+}
+
+#define COUNT_WRITE(CacheTable, Counter) AddToCounter(&(CacheTable)->WriterStats.Counter, 1)
+#define COUNT_DEPTH(CacheTable, Depth) CountDepth(CacheTable, Depth)
+#define COUNT_LOOKUPS(CacheTable, Lookups, Hits, Retries) CountLookups(CacheTable, Lookups, Hits, Retries)
+#else
+#define COUNT_WRITE(CacheTable, Counter)
+#define COUNT_DEPTH(CacheTable, Depth)
+#define COUNT_LOOKUPS(CacheTable, Lookups, Hits, Retries)
+#endif
+
+//
+// Map the buckets up to NumBuckets, on huge pages if hugetlbfs has them or else on transparent huge pages;
+// anonymous mappings are zeroed, so every new bucket starts empty
+//
+//
+static bool
+CommitBuckets(
+    CacheTableT* CacheTable,
+    size_t NumBuckets
+) {
+    size_t bytes = sizeof(CacheBucketT) * NumBuckets;
+    bytes = (bytes + CACHE_TABLE_HUGE_PAGE_SIZE - 1) / CACHE_TABLE_HUGE_PAGE_SIZE * CACHE_TABLE_HUGE_PAGE_SIZE;
+    if (bytes <= CacheTable->TableBytes) {
+        return true;
+    }
+
+    char *start = (char*)CacheTable->Table + CacheTable->TableBytes;
+    size_t length = bytes - CacheTable->TableBytes;
+    void *mapped = mmap(start, length, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+    if (mapped == MAP_FAILED) {
+        mapped = mmap(start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        madvise(mapped, length, MADV_HUGEPAGE);
+        CacheTable->HugePages = false;
+    }
+
+    CacheTable->TableBytes = bytes;
+    return true;
+}
+
 //
 // Initialize the cache table
+// The address space of the largest table is reserved up front, so that the table grows in place
 //
 //
 int
 InitCacheTable(
     CacheTableT** CacheTable
 ) {
-    *CacheTable = malloc(sizeof(CacheTableT*));
+    *CacheTable = malloc(sizeof(CacheTableT));
     if (!(*CacheTable)) {
         return -1;
     }
-    
-    (*CacheTable)->Table = (CacheBucketT**)(malloc(sizeof(CacheBucketT*) * CACHE_TABLE_BUCKET_COUNT));
-    if (!(*CacheTable)->Table) {
+
+#ifdef CACHE_TABLE_STATS_ENABLED
+    memset(&(*CacheTable)->WriterStats, 0, sizeof(CacheTableWriterStatsT));
+    atomic_init(&(*CacheTable)->NextLookupStats, 0);
+    (*CacheTable)->LookupStats = aligned_alloc(DDS_CACHE_LINE_SIZE,
+        sizeof(CacheTableLookupStatsT) * CACHE_TABLE_STATS_SLOTS);
+    if (!(*CacheTable)->LookupStats) {
+        free(*CacheTable);
+        *CacheTable = NULL;
         return -1;
     }
+    memset((*CacheTable)->LookupStats, 0, sizeof(CacheTableLookupStatsT) * CACHE_TABLE_STATS_SLOTS);
+#endif
 
-    for (size_t i = 0; i != CACHE_TABLE_BUCKET_COUNT; i++) {
-        (*CacheTable)->Table[i] = (CacheBucketT*)aligned_alloc(DDS_CACHE_LINE_SIZE, sizeof(CacheBucketT));
-        if (!(*CacheTable)->Table[i]) {
-            return -1;
-        }
-        memset((*CacheTable)->Table[i], 0, sizeof(CacheBucketT));
+    size_t bytes = sizeof(CacheBucketT) * CACHE_TABLE_BUCKET_COUNT + 2 * CACHE_TABLE_HUGE_PAGE_SIZE;
+    void *reservation = mmap(NULL, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED) {
+#ifdef CACHE_TABLE_STATS_ENABLED
+        free((*CacheTable)->LookupStats);
+#endif
+        free(*CacheTable);
+        *CacheTable = NULL;
+        return -1;
+    }
+
+    (*CacheTable)->Reservation = reservation;
+    (*CacheTable)->ReservationBytes = bytes;
+    (*CacheTable)->Table = (CacheBucketT*)(((uintptr_t)reservation + CACHE_TABLE_HUGE_PAGE_SIZE - 1) &
+        ~((uintptr_t)CACHE_TABLE_HUGE_PAGE_SIZE - 1));
+    (*CacheTable)->TableBytes = 0;
+    (*CacheTable)->HugePages = true;
+    (*CacheTable)->NumItems = 0;
+    (*CacheTable)->MaxItems = CACHE_TABLE_DEFAULT_MAX_ITEMS;
+    (*CacheTable)->Changes = 0;
+    (*CacheTable)->ClockHand = 0;
+    (*CacheTable)->EpochAdditions = 0;
+    (*CacheTable)->EvictionRandom = 0x9e3779b97f4a7c15ULL;
+    atomic_init(&(*CacheTable)->Layout, (uint64_t)CACHE_TABLE_INITIAL_BUCKET_COUNT_POWER << 32);
+    atomic_init(&(*CacheTable)->Epoch, 0);
+    atomic_init(&(*CacheTable)->Displacements, 0);
+
+    if (!CommitBuckets(*CacheTable, (size_t)1 << CACHE_TABLE_INITIAL_BUCKET_COUNT_POWER)) {
+        munmap(reservation, bytes);
+#ifdef CACHE_TABLE_STATS_ENABLED
+        free((*CacheTable)->LookupStats);
+#endif
+        free(*CacheTable);
+        *CacheTable = NULL;
+        return -1;
     }
 
     return 0;
 }
 
 //
-// Add an item to the cache table
+// Mark a bucket, or the table for displacements, as being changed, before the first store
 //
 //
-int
-AddToCacheTable(
+static inline void
+BeginWrite(
+    _Atomic uint32_t* Version
+) {
+    uint32_t version = atomic_load_explicit(Version, memory_order_relaxed);
+    atomic_store_explicit(Version, version + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+//
+// Publish the changes to a bucket, or the end of displacements
+//
+//
+static inline void
+EndWrite(
+    _Atomic uint32_t* Version
+) {
+    uint32_t version = atomic_load_explicit(Version, memory_order_relaxed);
+    atomic_store_explicit(Version, version + 1, memory_order_release);
+}
+
+//
+// The mark of the eviction policy for an item used now: its reference bit for CLOCK,
+// or the current epoch for sampled LRU
+//
+//
+static inline uint8_t
+RecencyMark(
+    CacheTableT* CacheTable
+) {
+#if CACHE_TABLE_EVICTION == CACHE_TABLE_EVICTION_SAMPLED_LRU
+    return (uint8_t)atomic_load_explicit(&CacheTable->Epoch, memory_order_relaxed);
+#else
+    (void)CacheTable;
+    return 1;
+#endif
+}
+
+//
+// The mark of the eviction policy on a slot of a bucket
+//
+//
+static inline uint8_t
+SlotRecency(
+    CacheBucketT* Bucket,
+    int Slot
+) {
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    return atomic_load_explicit(&Bucket->Recency[Slot], memory_order_relaxed);
+#else
+    (void)Bucket;
+    (void)Slot;
+    return 0;
+#endif
+}
+
+//
+// Mark a slot of a bucket for the eviction policy, storing only if the mark changes,
+// so that lookups of the same hot items don't keep writing to their buckets
+//
+//
+static inline void
+MarkSlot(
+    CacheBucketT* Bucket,
+    int Slot,
+    uint8_t Mark
+) {
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    if (atomic_load_explicit(&Bucket->Recency[Slot], memory_order_relaxed) != Mark) {
+        atomic_store_explicit(&Bucket->Recency[Slot], Mark, memory_order_relaxed);
+    }
+#else
+    (void)Bucket;
+    (void)Slot;
+    (void)Mark;
+#endif
+}
+
+//
+// Write an element into a slot of a bucket, tagged for the bucket of its Hash1, with the mark Recency,
+// without marking the bucket
+//
+//
+static inline void
+WriteSlot(
+    CacheBucketT* Bucket,
+    int Slot,
+    CacheElementT* Element,
+    uint8_t Recency
+) {
+#ifdef CACHE_TABLE_COMPACT
+    for (int b = 0; b != CACHE_TABLE_COMPACT_SIZE_BITS / 8; b++) {
+        Bucket->Sizes[Slot][b] = (uint8_t)(Element->Item.Size >> (b * 8));
+    }
+    Bucket->Keys[Slot] = Element->Item.Key;
+    Bucket->Locations[Slot] = (Element->Item.Offset << (64 - CACHE_TABLE_COMPACT_OFFSET_BITS)) | Element->Item.FileId;
+#else
+    memcpy(&Bucket->Elements[Slot], Element, sizeof(CacheElementT));
+#endif
+    CacheBucketTags(Bucket)[Slot] = CacheTableTag(Element->Hash1, Element->Hash2);
+    MarkSlot(Bucket, Slot, Recency);
+}
+
+//
+// Empty a slot of a bucket, without marking the bucket
+//
+//
+static inline void
+ClearSlot(
+    CacheBucketT* Bucket,
+    int Slot
+) {
+#ifdef CACHE_TABLE_COMPACT
+    memset(Bucket->Sizes[Slot], 0, sizeof(Bucket->Sizes[Slot]));
+    Bucket->Keys[Slot] = 0;
+    Bucket->Locations[Slot] = 0;
+#else
+    memset(&Bucket->Elements[Slot], 0, sizeof(CacheElementT));
+#endif
+    CacheBucketTags(Bucket)[Slot] = 0;
+    MarkSlot(Bucket, Slot, 0);
+}
+
+//
+// Store an element into a slot of a bucket, under the hash value of that bucket, with the mark Recency
+//
+//
+static inline void
+StoreElement(
+    CacheBucketT* Bucket,
+    int Slot,
+    CacheElementT* Element,
+    uint8_t Recency
+) {
+    BeginWrite(&Bucket->Version);
+    WriteSlot(Bucket, Slot, Element, Recency);
+    EndWrite(&Bucket->Version);
+}
+
+//
+// Compare the tags of a bucket with Tag at once, and return a mask with bit e set if slot e matches;
+// with NEON the four tags are one vector compare
+//
+//
+static inline uint32_t
+MatchTags(
+    CacheBucketT* Bucket,
+    CacheTagT Tag
+) {
+#if defined(__ARM_NEON) && defined(__aarch64__) && CACHE_TABLE_BUCKET_SIZE == 4
+#ifdef CACHE_TABLE_COMPACT
+    static const uint16_t slotBits[4] = { 1, 2, 4, 8 };
+    uint16x4_t matches = vceq_u16(vld1_u16(Bucket->Tags), vdup_n_u16(Tag));
+    return vaddv_u16(vand_u16(matches, vld1_u16(slotBits)));
+#else
+    static const uint32_t slotBits[4] = { 1, 2, 4, 8 };
+    uint32x4_t matches = vceqq_u32(vld1q_u32(Bucket->HashValues), vdupq_n_u32(Tag));
+    return vaddvq_u32(vandq_u32(matches, vld1q_u32(slotBits)));
+#endif
+#else
+    CacheTagT *tags = CacheBucketTags(Bucket);
+    uint32_t mask = 0;
+    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+        mask |= (uint32_t)(tags[e] == Tag) << e;
+    }
+    return mask;
+#endif
+}
+
+//
+// Bring a bucket into the cache ahead of probing it
+//
+//
+static inline void
+PrefetchBucket(
+    CacheBucketT* Bucket
+) {
+    for (size_t b = 0; b < sizeof(CacheBucketT); b += DDS_CACHE_LINE_SIZE) {
+        __builtin_prefetch((char*)Bucket + b, 0, 3);
+    }
+}
+
+//
+// Find the slot of a key in a bucket, or an empty slot if Key is NULL; returns -1 if there is none
+// Only for the writer, which reads the buckets without validation
+//
+//
+static inline int
+FindSlot(
+    CacheBucketT* Bucket,
+    CacheTagT Tag,
+    KeyT* Key
+) {
+    for (uint32_t mask = MatchTags(Bucket, Key ? Tag : 0); mask; mask &= mask - 1) {
+        int e = __builtin_ctz(mask);
+        if (!Key || CacheBucketKey(Bucket, e) == *Key) {
+            return e;
+        }
+    }
+
+    return -1;
+}
+
+//
+// Compute both hash values of a key
+//
+//
+static inline void
+HashKey(
+    KeyT* Key,
+    HashValueT* Hash1,
+    HashValueT* Hash2
+) {
+    HASH_FUNCTION1(Key, sizeof(KeyT), *Hash1);
+    HASH_FUNCTION2(Key, sizeof(KeyT), *Hash2);
+    if (*Hash1 == *Hash2) {
+        *Hash2 = ~*Hash1;
+    }
+}
+
+//
+// Read the element in a slot of a bucket, with Hash1 the hash value of that bucket under Layout;
+// compact buckets don't keep the hash values, so they are computed again from the key
+// Only for the writer
+//
+//
+static inline void
+LoadElement(
     CacheTableT* CacheTable,
-    CacheItemT* Item
+    uint64_t Layout,
+    CacheBucketT* Bucket,
+    int Slot,
+    CacheElementT* Element
+) {
+#ifdef CACHE_TABLE_COMPACT
+    HashValueT hash1, hash2;
+
+    CopyCacheBucketItem(Bucket, Slot, &Element->Item);
+    HashKey(&Element->Item.Key, &hash1, &hash2);
+    if (&CacheTable->Table[CacheTableBucket(Layout, hash1)] == Bucket) {
+        Element->Hash1 = hash1;
+        Element->Hash2 = hash2;
+    }
+    else {
+        Element->Hash1 = hash2;
+        Element->Hash2 = hash1;
+    }
+#else
+    (void)CacheTable;
+    (void)Layout;
+    memcpy(Element, &Bucket->Elements[Slot], sizeof(CacheElementT));
+#endif
+}
+
+//
+// Split the next NumBuckets buckets of the linear hashing, each moving the items that
+// the next power maps elsewhere to its new sibling; returns false if the table is at its largest
+//
+//
+static bool
+SplitBuckets(
+    CacheTableT* CacheTable,
+    int NumBuckets
+) {
+    for (int s = 0; s != NumBuckets; s++) {
+        uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+        uint32_t power = (uint32_t)(layout >> 32);
+        uint32_t next = (uint32_t)layout;
+        uint32_t count = 1U << power;
+
+        if (next == 0) {
+            if (power == CACHE_TABLE_BUCKET_COUNT_POWER || !CommitBuckets(CacheTable, (size_t)count << 1)) {
+                return false;
+            }
+        }
+
+        CacheBucketT *from = &CacheTable->Table[next];
+        CacheBucketT *to = &CacheTable->Table[count + next];
+        CacheElementT element;
+        int slot = 0;
+
+        //
+        // Lookups that used the previous layout and miss retry on Displacements
+        //
+        //
+        BeginWrite(&CacheTable->Displacements);
+        BeginWrite(&from->Version);
+        BeginWrite(&to->Version);
+
+        for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+            if (!CacheBucketTags(from)[e]) {
+                continue;
+            }
+            LoadElement(CacheTable, layout, from, e, &element);
+            if ((element.Hash1 & ((count << 1) - 1)) != next) {
+                WriteSlot(to, slot++, &element, SlotRecency(from, e));
+                ClearSlot(from, e);
+            }
+        }
+
+        atomic_store_explicit(&CacheTable->Layout,
+            next + 1 == count ? (uint64_t)(power + 1) << 32 : layout + 1, memory_order_release);
+
+        EndWrite(&to->Version);
+        EndWrite(&from->Version);
+        EndWrite(&CacheTable->Displacements);
+        COUNT_WRITE(CacheTable, Splits);
+    }
+
+    return true;
+}
+
+//
+// Insert an item whose key is not in the table, moving items to their other buckets if both of its are full,
+// each with its mark of the eviction policy; returns -1 if no slot is found, with the table as it was
+//
+//
+static int
+InsertNewItem(
+    CacheTableT* CacheTable,
+    CacheItemT* Item,
+    HashValueT Hash1,
+    HashValueT Hash2
 ) {
-    size_t maxDepth = (size_t) CACHE_TABLE_BUCKET_COUNT_POWER << 2;
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+    size_t maxDepth = (size_t)((layout >> 32) + 1) << 2;
     if (maxDepth > CACHE_TABLE_CAPACITY) {
         maxDepth = CACHE_TABLE_CAPACITY;
     }
 
-    uint32_t mask = CACHE_TABLE_BUCKET_COUNT - 1;
     uint32_t offset = 0;
     CacheElementT ele1, ele2;
     CacheElementT *carrier = &ele1, *victim = &ele2;
+    uint8_t carrierRecency = RecencyMark(CacheTable), victimRecency;
+    uint8_t tmpR;
     memcpy(&carrier->Item, Item, sizeof(CacheItemT));
-    
-    HASH_FUNCTION1(&Item->Key, sizeof(KeyT), carrier->Hash1);
-    HASH_FUNCTION2(&Item->Key, sizeof(KeyT), carrier->Hash2);
-    if (carrier->Hash1 == carrier->Hash2) {
-        carrier->Hash2 = ~carrier->Hash1;
-    }
+    carrier->Hash1 = Hash1;
+    carrier->Hash2 = Hash2;
 
-    uint32_t bucketPos;
-    HashValueT *hashVector;
+    CacheBucketT *bucket1 = &CacheTable->Table[CacheTableBucket(layout, Hash1)];
+    CacheBucketT *bucket2 = &CacheTable->Table[CacheTableBucket(layout, Hash2)];
     CacheBucketT *targetBucket;
-    CacheElementT *targetElement;
     CacheElementT *tmp;
     HashValueT tmpV;
-    
-    for (size_t depth = 0; depth < maxDepth; ++depth) {
-        bucketPos = carrier->Hash1 & mask;
-        targetBucket = CacheTable->Table[bucketPos];
+    int e;
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-        targetBucket->Occ = 1;
-#endif
+    //
+    // Take an empty slot in either bucket
+    //
+    //
+    if ((e = FindSlot(bucket1, 0, NULL)) >= 0) {
+        StoreElement(bucket1, e, carrier, carrierRecency);
+        COUNT_DEPTH(CacheTable, 0);
+        return 0;
+    }
 
-        hashVector = targetBucket->HashValues;
-        for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
-            if (!hashVector[e]) {
-                //
-                // This slot is available
-                //
-                //
-                targetElement = &CacheTable->Table[bucketPos]->Elements[e];
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                targetElement->Occ = 1;
-#endif
-                memcpy(targetElement, carrier, sizeof(CacheElementT));
-                hashVector[e] = carrier->Hash1;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                targetElement->Occ = 0;
-#endif
+    if ((e = FindSlot(bucket2, 0, NULL)) >= 0) {
+        carrier->Hash1 = Hash2;
+        carrier->Hash2 = Hash1;
+        StoreElement(bucket2, e, carrier, carrierRecency);
+        COUNT_DEPTH(CacheTable, 0);
+        return 0;
+    }
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-                targetBucket->Occ = 0;
-#endif
-                return 0;
-            }
-            else if (hashVector[e] == carrier->Hash1) {
-                //
-                // Check key
-                //
-                //
-                targetElement = &CacheTable->Table[bucketPos]->Elements[e];
-                if (targetElement->Item.Key == carrier->Item.Key) {
-                    //
-                    // Key already exists
-                    // Update the value
-                    //
-                    //
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                    targetElement->Occ = 1;
-#endif
-                    memcpy(&targetElement->Item, &carrier->Item, sizeof(CacheItemT));
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                    targetElement->Occ = 0;
-#endif
+    //
+    // Both buckets are full, so move items to their other buckets until one has an empty slot;
+    // the item being moved is in no bucket meanwhile, which lookups that miss detect by Displacements
+    //
+    //
+    BeginWrite(&CacheTable->Displacements);
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-                    targetBucket->Occ = 0;
-#endif
-                    return 0;
-                }
-            }
+    for (size_t depth = 0; depth < maxDepth; ++depth) {
+        targetBucket = &CacheTable->Table[CacheTableBucket(layout, carrier->Hash1)];
+
+        if ((e = FindSlot(targetBucket, 0, NULL)) >= 0) {
+            StoreElement(targetBucket, e, carrier, carrierRecency);
+            EndWrite(&CacheTable->Displacements);
+            COUNT_DEPTH(CacheTable, depth);
+            return 0;
         }
 
         //
         // This bucket is full, so pick one element as the victim
         //
         //
-        targetElement = &targetBucket->Elements[offset];
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-        targetElement->Occ = 1;
-#endif
-        memcpy(victim, targetElement, sizeof(CacheElementT));
-        memcpy(targetElement, carrier, sizeof(CacheElementT));
-        hashVector[offset] = carrier->Hash1;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-        targetElement->Occ = 0;
-#endif
+        LoadElement(CacheTable, layout, targetBucket, offset, victim);
+        victimRecency = SlotRecency(targetBucket, offset);
+        StoreElement(targetBucket, offset, carrier, carrierRecency);
+
         tmpV = victim->Hash1;
         victim->Hash1 = victim->Hash2;
         victim->Hash2 = tmpV;
@@ -154,14 +599,13 @@ AddToCacheTable(
         tmp = carrier;
         carrier = victim;
         victim = tmp;
+        tmpR = carrierRecency;
+        carrierRecency = victimRecency;
+        victimRecency = tmpR;
 
         if (++offset == CACHE_TABLE_BUCKET_SIZE) {
             offset = 0;
         }
-
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-        targetBucket->Occ = 0;
-#endif
     }
 
     //
@@ -170,20 +614,12 @@ AddToCacheTable(
     //
     //
     for (size_t depth = 0; depth < maxDepth; ++depth) {
-        bucketPos = carrier->Hash2 & mask;
+        targetBucket = &CacheTable->Table[CacheTableBucket(layout, carrier->Hash2)];
 
         if (offset-- == 0) {
             offset = CACHE_TABLE_BUCKET_SIZE - 1;
         }
 
-        targetBucket = CacheTable->Table[bucketPos];
-        hashVector = targetBucket->HashValues;
-        targetElement = &targetBucket->Elements[offset];
-
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-        targetBucket->Occ = 1;
-#endif
-
         //
         // Swap the elements
         //
@@ -191,15 +627,10 @@ AddToCacheTable(
         tmpV = carrier->Hash1;
         carrier->Hash1 = carrier->Hash2;
         carrier->Hash2 = tmpV;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-        targetElement->Occ = 1;
-#endif
-        memcpy(victim, targetElement, sizeof(CacheElementT));
-        memcpy(targetElement, carrier, sizeof(CacheElementT));
-        hashVector[offset] = carrier->Hash2;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-        targetElement->Occ = 0;
-#endif
+
+        LoadElement(CacheTable, layout, targetBucket, offset, victim);
+        victimRecency = SlotRecency(targetBucket, offset);
+        StoreElement(targetBucket, offset, carrier, carrierRecency);
 
         //
         // Victim becomes the carrier
@@ -208,197 +639,738 @@ AddToCacheTable(
         tmp = carrier;
         carrier = victim;
         victim = tmp;
-
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-        targetBucket->Occ = 0;
-#endif
+        tmpR = carrierRecency;
+        carrierRecency = victimRecency;
+        victimRecency = tmpR;
     }
 
-    assert(memcmp(&carrier->Item, Item, sizeof(CacheItemT)) == 0);
+    EndWrite(&CacheTable->Displacements);
+
+    assert(carrier->Item.Key == Item->Key);
 
     return -1;
 }
 
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
 //
-// Delete an item from the cache table
+// How long ago the item in a slot was used, by the marks of the eviction policy;
+// under CLOCK, 1 if it was not referenced since the hand last passed it and 0 if it was
 //
 //
-void
-DeleteFromCacheTable(
+static inline uint8_t
+SlotAge(
+    CacheBucketT* Bucket,
+    int Slot,
+    uint8_t Mark
+) {
+#if CACHE_TABLE_EVICTION == CACHE_TABLE_EVICTION_SAMPLED_LRU
+    return (uint8_t)(Mark - SlotRecency(Bucket, Slot));
+#else
+    (void)Mark;
+    return !SlotRecency(Bucket, Slot);
+#endif
+}
+
+//
+// Remove the item in a slot of a bucket to make room
+//
+//
+static void
+EvictSlot(
     CacheTableT* CacheTable,
-    KeyT* Key
+    CacheBucketT* Bucket,
+    int Slot
 ) {
-    uint32_t mask = CACHE_TABLE_BUCKET_COUNT - 1;
+    BeginWrite(&Bucket->Version);
+    ClearSlot(Bucket, Slot);
+    EndWrite(&Bucket->Version);
+    CacheTable->NumItems--;
+    CacheTable->Changes++;
+    COUNT_WRITE(CacheTable, Evictions);
+}
 
-    HashValueT *hashVector;
-    CacheBucketT *targetBucket;
-    CacheElementT *targetElement;
-    HashValueT hash1, hash2;
-    HASH_FUNCTION1(Key, sizeof(KeyT), hash1);
+//
+// Evict one item of the table, picked by the policy; returns false if none is found
+//
+//
+static bool
+EvictItem(
+    CacheTableT* CacheTable
+) {
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+    size_t numBuckets = ((size_t)1 << (layout >> 32)) + (uint32_t)layout;
+    size_t numSlots = numBuckets * CACHE_TABLE_BUCKET_SIZE;
+    CacheBucketT *bucket;
+
+    if (!CacheTable->NumItems) {
+        return false;
+    }
 
+#if CACHE_TABLE_EVICTION == CACHE_TABLE_EVICTION_SAMPLED_LRU
     //
-    // Check the first hash function
+    // Sample the items of buckets picked at random and evict the oldest;
+    // the number of buckets tried is bounded, for a table with very few items
     //
     //
-    targetBucket = CacheTable->Table[hash1 & mask];
-    hashVector = targetBucket->HashValues;
+    uint8_t mark = RecencyMark(CacheTable);
+    CacheBucketT *oldestBucket = NULL;
+    int oldestSlot = 0;
+    int oldestAge = -1;
+    int sampled = 0;
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    targetBucket->Occ = 1;
-#endif
+    for (size_t b = 0; sampled < CACHE_TABLE_EVICTION_SAMPLES && b != numSlots; b++) {
+        uint64_t x = CacheTable->EvictionRandom;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        CacheTable->EvictionRandom = x;
 
-    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
-        if (hashVector[e] == hash1) {
-            targetElement = &targetBucket->Elements[e];
-            if (targetElement->Item.Key == *Key) {
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                targetElement->Occ = 1;
-#endif
-                memset(targetElement, 0, sizeof(CacheElementT));
-                hashVector[e] = 0;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                targetElement->Occ = 0;
-#endif
+        bucket = &CacheTable->Table[x % numBuckets];
+        for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+            if (!CacheBucketTags(bucket)[e]) {
+                continue;
+            }
+            if (SlotAge(bucket, e, mark) > oldestAge) {
+                oldestBucket = bucket;
+                oldestSlot = e;
+                oldestAge = SlotAge(bucket, e, mark);
+            }
+            sampled++;
+        }
+    }
+
+    if (oldestBucket) {
+        EvictSlot(CacheTable, oldestBucket, oldestSlot);
+        return true;
+    }
+#else
+    //
+    // Sweep the hand over the slots, clearing the reference bits it passes,
+    // until an item is not referenced; two sweeps at most
+    //
+    //
+    for (size_t step = 0; step != 2 * numSlots + 1; step++) {
+        if (CacheTable->ClockHand >= numSlots) {
+            CacheTable->ClockHand = 0;
+        }
+        bucket = &CacheTable->Table[CacheTable->ClockHand / CACHE_TABLE_BUCKET_SIZE];
+        int e = (int)(CacheTable->ClockHand++ % CACHE_TABLE_BUCKET_SIZE);
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-                targetBucket->Occ = 0;
+        if (!CacheBucketTags(bucket)[e]) {
+            continue;
+        }
+        if (SlotRecency(bucket, e)) {
+            MarkSlot(bucket, e, 0);
+            continue;
+        }
+        EvictSlot(CacheTable, bucket, e);
+        return true;
+    }
 #endif
-                return;
+
+    return false;
+}
+
+//
+// Evict the item the policy picks among the full buckets of a key, so that the key has a slot
+//
+//
+static void
+EvictFromBuckets(
+    CacheTableT* CacheTable,
+    CacheBucketT* Bucket1,
+    CacheBucketT* Bucket2
+) {
+    CacheBucketT *buckets[2] = { Bucket1, Bucket2 };
+    uint8_t mark = RecencyMark(CacheTable);
+    CacheBucketT *oldestBucket = Bucket1;
+    int oldestSlot = 0;
+    int oldestAge = -1;
+
+    for (int b = 0; b != 2; b++) {
+        for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+            if (SlotAge(buckets[b], e, mark) > oldestAge) {
+                oldestBucket = buckets[b];
+                oldestSlot = e;
+                oldestAge = SlotAge(buckets[b], e, mark);
             }
         }
     }
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    targetBucket->Occ = 0;
+    EvictSlot(CacheTable, oldestBucket, oldestSlot);
+}
+
+//
+// Advance the epoch of sampled LRU every MaxItems / CACHE_TABLE_LRU_EPOCHS additions
+//
+//
+static inline void
+CountAdditionForEpoch(
+    CacheTableT* CacheTable
+) {
+#if CACHE_TABLE_EVICTION == CACHE_TABLE_EVICTION_SAMPLED_LRU
+    if (++CacheTable->EpochAdditions * CACHE_TABLE_LRU_EPOCHS >= CacheTable->MaxItems) {
+        CacheTable->EpochAdditions = 0;
+        atomic_store_explicit(&CacheTable->Epoch,
+            atomic_load_explicit(&CacheTable->Epoch, memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+#else
+    (void)CacheTable;
+#endif
+}
 #endif
 
+//
+// Add an item to the cache table, or update it if its key is there
+//
+//
+int
+AddToCacheTable(
+    CacheTableT* CacheTable,
+    CacheItemT* Item
+) {
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+    CacheElementT element;
+    HashValueT hash1, hash2;
+    int e;
+
+    if (!CacheTableItemFits(Item)) {
+        COUNT_WRITE(CacheTable, Failures);
+        return -1;
+    }
+
+    memcpy(&element.Item, Item, sizeof(CacheItemT));
+    HashKey(&Item->Key, &hash1, &hash2);
+    CacheBucketT *bucket1 = &CacheTable->Table[CacheTableBucket(layout, hash1)];
+    CacheBucketT *bucket2 = &CacheTable->Table[CacheTableBucket(layout, hash2)];
+
     //
-    // Check the second hash function
+    // A key is in one of its two buckets, and is updated in place
     //
     //
-    HASH_FUNCTION2(Key, sizeof(KeyT), hash2);
-    if (hash1 == hash2) {
-        hash2 = ~hash1;
+    if ((e = FindSlot(bucket1, CacheTableTag(hash1, hash2), &Item->Key)) >= 0) {
+        element.Hash1 = hash1;
+        element.Hash2 = hash2;
+        StoreElement(bucket1, e, &element, RecencyMark(CacheTable));
+        CacheTable->Changes++;
+        COUNT_WRITE(CacheTable, Updates);
+        return 0;
     }
-    targetBucket = CacheTable->Table[hash2 & mask];
-    hashVector = targetBucket->HashValues;
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    targetBucket->Occ = 1;
-#endif
+    if ((e = FindSlot(bucket2, CacheTableTag(hash2, hash1), &Item->Key)) >= 0) {
+        element.Hash1 = hash2;
+        element.Hash2 = hash1;
+        StoreElement(bucket2, e, &element, RecencyMark(CacheTable));
+        CacheTable->Changes++;
+        COUNT_WRITE(CacheTable, Updates);
+        return 0;
+    }
 
-    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
-        if (hashVector[e] == hash2) {
-            targetElement = &targetBucket->Elements[e];
-            if (targetElement->Item.Key == *Key) {
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                targetElement->Occ = 1;
-#endif
-                memset(targetElement, 0, sizeof(CacheElementT));
-                hashVector[e] = 0;
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-                targetElement->Occ = 0;
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    //
+    // Make room at the budget, so that the table holds no more than MaxItems,
+    // and grows no further than the slots they take
+    //
+    //
+    if (CacheTable->NumItems >= CacheTable->MaxItems) {
+        EvictItem(CacheTable);
+    }
 #endif
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-                targetBucket->Occ = 1;
+    //
+    // Grow a few buckets at a time once the table is loaded,
+    // and as much as it takes if the item finds no slot
+    //
+    //
+    size_t slots = (((size_t)1 << (layout >> 32)) + (uint32_t)layout) * CACHE_TABLE_BUCKET_SIZE;
+    if ((CacheTable->NumItems + 1) * 100 > slots * CACHE_TABLE_SPLIT_LOAD_PERCENT) {
+        SplitBuckets(CacheTable, CACHE_TABLE_SPLIT_BUCKETS_PER_ADD);
+    }
+
+    while (InsertNewItem(CacheTable, Item, hash1, hash2)) {
+        if (!SplitBuckets(CacheTable, CACHE_TABLE_SPLIT_BUCKETS_ON_FAILURE)) {
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+            //
+            // The table is at its largest, so free a slot in a bucket of the key itself
+            //
+            //
+            layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+            EvictFromBuckets(CacheTable, &CacheTable->Table[CacheTableBucket(layout, hash1)],
+                &CacheTable->Table[CacheTableBucket(layout, hash2)]);
+#else
+            COUNT_WRITE(CacheTable, Failures);
+            return -1;
 #endif
-                return;
-            }
         }
     }
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    targetBucket->Occ = 0;
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    CountAdditionForEpoch(CacheTable);
 #endif
+    CacheTable->NumItems++;
+    CacheTable->Changes++;
+    COUNT_WRITE(CacheTable, Additions);
+    return 0;
 }
 
 //
-// Look up the cache table given a key
+// Set the budget of items of the cache table, evicting items down to it
 //
 //
-CacheItemT*
-LookUpCacheTable(
+void
+SetCacheTableMaxItems(
     CacheTableT* CacheTable,
-    KeyT* Key
+    size_t MaxItems
 ) {
-    const uint32_t mask = CACHE_TABLE_BUCKET_COUNT - 1;
-    const KeyT key = *Key;
+    if (MaxItems < 1) {
+        MaxItems = 1;
+    }
+    if (MaxItems > CACHE_TABLE_CAPACITY) {
+        MaxItems = CACHE_TABLE_CAPACITY;
+    }
+    CacheTable->MaxItems = MaxItems;
+
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    while (CacheTable->NumItems > CacheTable->MaxItems && EvictItem(CacheTable)) {
+    }
+#endif
+}
 
-    HashValueT *hashVector;
+//
+// Delete an item from the cache table
+//
+//
+void
+DeleteFromCacheTable(
+    CacheTableT* CacheTable,
+    KeyT* Key
+) {
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
     CacheBucketT *targetBucket;
-    CacheElementT *targetElement;
     HashValueT hash1, hash2;
+    int e;
 
     //
-    // Check the first hash function
+    // Check the first hash function, then the second
     //
     //
-    HASH_FUNCTION1(Key, sizeof(KeyT), hash1);
-    targetBucket = CacheTable->Table[hash1 & mask];
+    HashKey(Key, &hash1, &hash2);
+    targetBucket = &CacheTable->Table[CacheTableBucket(layout, hash1)];
+    e = FindSlot(targetBucket, CacheTableTag(hash1, hash2), Key);
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    if (targetBucket->Occ) {
-        goto LookupSecondHash;
+    if (e < 0) {
+        targetBucket = &CacheTable->Table[CacheTableBucket(layout, hash2)];
+        e = FindSlot(targetBucket, CacheTableTag(hash2, hash1), Key);
     }
-#endif
 
-    hashVector = targetBucket->HashValues;
-    
-    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
-        if (hash1 == hashVector[e]) {
-            targetElement = &targetBucket->Elements[e];
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-            if (targetElement->Occ) {
-                continue;
+    if (e >= 0) {
+        BeginWrite(&targetBucket->Version);
+        ClearSlot(targetBucket, e);
+        EndWrite(&targetBucket->Version);
+        CacheTable->NumItems--;
+        CacheTable->Changes++;
+        COUNT_WRITE(CacheTable, Deletions);
+    }
+}
+
+//
+// Copy the item of a key out of a bucket if it's there, and mark its slot with Mark for the eviction policy,
+// retrying while the bucket is being changed or has changed during the copy; Retries counts the retries
+//
+//
+static inline bool
+ReadBucket(
+    CacheBucketT* Bucket,
+    CacheTagT Tag,
+    KeyT Key,
+    uint8_t Mark,
+    CacheItemT* Item,
+    uint64_t* Retries
+) {
+    uint32_t version;
+    int slot;
+
+    for (;;) {
+        while ((version = atomic_load_explicit(&Bucket->Version, memory_order_acquire)) & 1) {
+        }
+
+        slot = -1;
+        for (uint32_t mask = MatchTags(Bucket, Tag); mask; mask &= mask - 1) {
+            int e = __builtin_ctz(mask);
+            if (CacheBucketKey(Bucket, e) == Key) {
+                CopyCacheBucketItem(Bucket, e, Item);
+                slot = e;
+                break;
             }
-#endif
-            if (targetElement->Item.Key == key) {
-                return &targetElement->Item;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&Bucket->Version, memory_order_relaxed) == version) {
+            if (slot >= 0) {
+                MarkSlot(Bucket, slot, Mark);
             }
+            return slot >= 0;
         }
+        (*Retries)++;
     }
+}
+
+//
+// Probe the two buckets of a key and copy its item out if it's there; Retries counts the retries
+//
+//
+static inline bool
+ProbeBuckets(
+    CacheTableT* CacheTable,
+    KeyT Key,
+    HashValueT Hash1,
+    HashValueT Hash2,
+    CacheItemT* Item,
+    uint64_t* Retries
+) {
+    uint8_t mark = RecencyMark(CacheTable);
+    uint32_t displacements;
+    uint64_t layout;
+
+    for (;;) {
+        displacements = atomic_load_explicit(&CacheTable->Displacements, memory_order_acquire);
+        layout = atomic_load_explicit(&CacheTable->Layout, memory_order_acquire);
+
+        //
+        // Check the first hash function
+        //
+        //
+        if (ReadBucket(&CacheTable->Table[CacheTableBucket(layout, Hash1)], CacheTableTag(Hash1, Hash2), Key, mark, Item, Retries)) {
+            return true;
+        }
+
+        //
+        // Check the second hash function
+        //
+        //
+        if (ReadBucket(&CacheTable->Table[CacheTableBucket(layout, Hash2)], CacheTableTag(Hash2, Hash1), Key, mark, Item, Retries)) {
+            return true;
+        }
+
+        //
+        // A miss holds only if no item was being moved between buckets meanwhile
+        //
+        //
+        atomic_thread_fence(memory_order_acquire);
+        if (!(displacements & 1) &&
+            atomic_load_explicit(&CacheTable->Displacements, memory_order_relaxed) == displacements) {
+            return false;
+        }
+        (*Retries)++;
+    }
+}
+
+//
+// Look up the cache table given a key, and copy the item out if it's there
+//
+//
+bool
+LookUpCacheTable(
+    CacheTableT* CacheTable,
+    KeyT* Key,
+    CacheItemT* Item
+) {
+    HashValueT hash1, hash2;
+    uint64_t retries = 0;
+    bool found;
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-LookupSecondHash:
-#endif
     //
-    // Check the second hash function
+    // The second-choice bucket is fetched while the first is probed
     //
     //
-    HASH_FUNCTION2(Key, sizeof(KeyT), hash2);
-    if (hash1 == hash2) {
-        hash2 = ~hash1;
-    }
+    HashKey(Key, &hash1, &hash2);
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+    PrefetchBucket(&CacheTable->Table[CacheTableBucket(layout, hash2)]);
+
+    found = ProbeBuckets(CacheTable, *Key, hash1, hash2, Item, &retries);
+    COUNT_LOOKUPS(CacheTable, 1, found, retries);
+
+    return found;
+}
+
+//
+// Look up a batch of keys, by groups of CACHE_TABLE_LOOKUP_GROUP:
+// every bucket of a group is prefetched before any is probed,
+// so the cache misses of the group overlap instead of following one another
+//
+//
+int
+LookUpCacheTableBatch(
+    CacheTableT* CacheTable,
+    KeyT* Keys,
+    int NumKeys,
+    CacheItemT* Items,
+    bool* Found
+) {
+    HashValueT hash1[CACHE_TABLE_LOOKUP_GROUP];
+    HashValueT hash2[CACHE_TABLE_LOOKUP_GROUP];
+    uint64_t retries = 0;
+    int numFound = 0;
 
-    targetBucket = CacheTable->Table[hash2 & mask];
+    for (int first = 0; first < NumKeys; first += CACHE_TABLE_LOOKUP_GROUP) {
+        int numKeys = NumKeys - first < CACHE_TABLE_LOOKUP_GROUP ? NumKeys - first : CACHE_TABLE_LOOKUP_GROUP;
+        uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+
+        for (int k = 0; k != numKeys; k++) {
+            HashKey(&Keys[first + k], &hash1[k], &hash2[k]);
+            PrefetchBucket(&CacheTable->Table[CacheTableBucket(layout, hash1[k])]);
+            PrefetchBucket(&CacheTable->Table[CacheTableBucket(layout, hash2[k])]);
+        }
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-    if (targetBucket->Occ) {
-        goto LookupFail;
+        for (int k = 0; k != numKeys; k++) {
+            Found[first + k] = ProbeBuckets(CacheTable, Keys[first + k], hash1[k], hash2[k], &Items[first + k],
+                &retries);
+            numFound += Found[first + k];
+        }
     }
-#endif
 
-    hashVector = targetBucket->HashValues;
-    
-    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
-        if (hash2 == hashVector[e]) {
-            targetElement = &targetBucket->Elements[e];
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_ITEM
-            if (targetElement->Occ) {
+    COUNT_LOOKUPS(CacheTable, NumKeys, numFound, retries);
+
+    return numFound;
+}
+
+//
+// The hash values of a fixed key, which tell whether a snapshot was taken with the same hash functions
+//
+//
+static HashValueT
+SnapshotHashCheck() {
+    KeyT key = (KeyT)CACHE_TABLE_SNAPSHOT_MAGIC;
+    HashValueT hash1, hash2;
+
+    HashKey(&key, &hash1, &hash2);
+    return hash1 ^ hash2;
+}
+
+//
+// Write all the bytes to a file, continuing after short writes
+//
+//
+static bool
+WriteAll(
+    int Fd,
+    const void* Buffer,
+    size_t Bytes
+) {
+    const char *next = (const char*)Buffer;
+
+    while (Bytes) {
+        ssize_t written = write(Fd, next, Bytes);
+        if (written < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-#endif
-            if (targetElement->Item.Key == key) {
-                return &targetElement->Item;
+            return false;
+        }
+        next += written;
+        Bytes -= (size_t)written;
+    }
+
+    return true;
+}
+
+//
+// Read all the bytes from a file, continuing after short reads; fails at the end of the file
+//
+//
+static bool
+ReadAll(
+    int Fd,
+    void* Buffer,
+    size_t Bytes
+) {
+    char *next = (char*)Buffer;
+
+    while (Bytes) {
+        ssize_t bytesRead = read(Fd, next, Bytes);
+        if (bytesRead <= 0) {
+            if (bytesRead < 0 && errno == EINTR) {
+                continue;
             }
+            return false;
         }
+        next += bytesRead;
+        Bytes -= (size_t)bytesRead;
+    }
+
+    return true;
+}
+
+//
+// Write a snapshot of the cache table to Path.tmp and rename it to Path once it's on storage,
+// so that a crash while saving leaves the previous snapshot in place
+//
+//
+int
+SaveCacheTable(
+    CacheTableT* CacheTable,
+    const char* Path
+) {
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+    size_t numBuckets = ((size_t)1 << (layout >> 32)) + (uint32_t)layout;
+    char header[CACHE_TABLE_SNAPSHOT_HEADER_BYTES];
+    CacheTableSnapshotHeaderT *snapshot = (CacheTableSnapshotHeaderT*)header;
+    char tmpPath[PATH_MAX];
+    bool saved;
+    int fd;
+
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", Path) >= (int)sizeof(tmpPath)) {
+        return -1;
+    }
+
+    memset(header, 0, sizeof(header));
+    snapshot->Magic = CACHE_TABLE_SNAPSHOT_MAGIC;
+    snapshot->Format = CACHE_TABLE_SNAPSHOT_FORMAT;
+    snapshot->BucketBytes = sizeof(CacheBucketT);
+    snapshot->BucketSize = CACHE_TABLE_BUCKET_SIZE;
+    snapshot->HashCheck = SnapshotHashCheck();
+    snapshot->Layout = layout;
+
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
     }
 
-#if CACHE_TABLE_OCC_GRANULARITY == CACHE_TABLE_OCC_GRANULARITY_BUCKET
-LookupFail:
+    saved = WriteAll(fd, header, sizeof(header)) &&
+        WriteAll(fd, CacheTable->Table, sizeof(CacheBucketT) * numBuckets) &&
+        fsync(fd) == 0;
+
+    if (close(fd) || !saved || rename(tmpPath, Path)) {
+        unlink(tmpPath);
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// Load a snapshot into an empty cache table: the buckets are committed for its layout
+// and read in as they were saved, with the marks of the eviction policy, then counted for NumItems
+//
+//
+int
+LoadCacheTable(
+    CacheTableT* CacheTable,
+    const char* Path
+) {
+    CacheTableSnapshotHeaderT snapshot;
+    char header[CACHE_TABLE_SNAPSHOT_HEADER_BYTES];
+    uint32_t power, split;
+    size_t numBuckets, numItems = 0;
+    int fd;
+
+    fd = open(Path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (!ReadAll(fd, header, sizeof(header))) {
+        close(fd);
+        return -1;
+    }
+
+    //
+    // The snapshot must have been taken by a table with the same buckets and hash functions
+    //
+    //
+    memcpy(&snapshot, header, sizeof(snapshot));
+    power = (uint32_t)(snapshot.Layout >> 32);
+    split = (uint32_t)snapshot.Layout;
+    if (snapshot.Magic != CACHE_TABLE_SNAPSHOT_MAGIC ||
+        snapshot.Format != CACHE_TABLE_SNAPSHOT_FORMAT ||
+        snapshot.BucketBytes != sizeof(CacheBucketT) ||
+        snapshot.BucketSize != CACHE_TABLE_BUCKET_SIZE ||
+        snapshot.HashCheck != SnapshotHashCheck() ||
+        power < CACHE_TABLE_INITIAL_BUCKET_COUNT_POWER ||
+        power > CACHE_TABLE_BUCKET_COUNT_POWER ||
+        split >= (1U << power) ||
+        (split && power == CACHE_TABLE_BUCKET_COUNT_POWER)) {
+        close(fd);
+        return -1;
+    }
+
+    numBuckets = ((size_t)1 << power) + split;
+    if (!CommitBuckets(CacheTable, numBuckets) ||
+        !ReadAll(fd, CacheTable->Table, sizeof(CacheBucketT) * numBuckets)) {
+        memset(CacheTable->Table, 0, CacheTable->TableBytes);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    //
+    // No lookup has started yet, so the versions start over
+    //
+    //
+    for (size_t b = 0; b != numBuckets; b++) {
+        atomic_store_explicit(&CacheTable->Table[b].Version, 0, memory_order_relaxed);
+        for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+            numItems += CacheBucketTags(&CacheTable->Table[b])[e] != 0;
+        }
+    }
+
+    CacheTable->NumItems = numItems;
+    CacheTable->Changes = 0;
+    atomic_store_explicit(&CacheTable->Layout, snapshot.Layout, memory_order_release);
+
+    //
+    // A snapshot of a table with a larger budget is evicted down to this one
+    //
+    //
+#if CACHE_TABLE_EVICTION != CACHE_TABLE_EVICTION_NONE
+    while (CacheTable->NumItems > CacheTable->MaxItems && EvictItem(CacheTable)) {
+    }
+#endif
+
+    return 0;
+}
+
+//
+// Sum up the counters of the cache table, which the other threads keep changing meanwhile
+//
+//
+int
+GetCacheTableStats(
+    CacheTableT* CacheTable,
+    CacheTableStatsT* Stats
+) {
+    uint64_t layout = atomic_load_explicit(&CacheTable->Layout, memory_order_relaxed);
+
+    memset(Stats, 0, sizeof(CacheTableStatsT));
+    Stats->NumItems = CacheTable->NumItems;
+    Stats->MaxItems = CacheTable->MaxItems;
+    Stats->NumSlots = (((size_t)1 << (layout >> 32)) + (uint32_t)layout) * CACHE_TABLE_BUCKET_SIZE;
+    Stats->LoadFactor = (double)Stats->NumItems / Stats->NumSlots;
+
+#ifdef CACHE_TABLE_STATS_ENABLED
+    for (int s = 0; s != CACHE_TABLE_STATS_SLOTS; s++) {
+        CacheTableLookupStatsT *lookupStats = &CacheTable->LookupStats[s];
+        Stats->Lookups += atomic_load_explicit(&lookupStats->Lookups, memory_order_relaxed);
+        Stats->Hits += atomic_load_explicit(&lookupStats->Hits, memory_order_relaxed);
+        Stats->Retries += atomic_load_explicit(&lookupStats->Retries, memory_order_relaxed);
+    }
+    Stats->Misses = Stats->Lookups - Stats->Hits;
+
+    CacheTableWriterStatsT *writerStats = &CacheTable->WriterStats;
+    Stats->Additions = atomic_load_explicit(&writerStats->Additions, memory_order_relaxed);
+    Stats->Updates = atomic_load_explicit(&writerStats->Updates, memory_order_relaxed);
+    Stats->Deletions = atomic_load_explicit(&writerStats->Deletions, memory_order_relaxed);
+    Stats->Failures = atomic_load_explicit(&writerStats->Failures, memory_order_relaxed);
+    Stats->Evictions = atomic_load_explicit(&writerStats->Evictions, memory_order_relaxed);
+    Stats->Splits = atomic_load_explicit(&writerStats->Splits, memory_order_relaxed);
+    for (int d = 0; d != CACHE_TABLE_STATS_DEPTH_BUCKETS; d++) {
+        Stats->Depths[d] = atomic_load_explicit(&writerStats->Depths[d], memory_order_relaxed);
+    }
+
+    return 0;
+#else
+    return -1;
 #endif
-    return (CacheItemT*)NULL;
 }
 
 //
@@ -409,13 +1381,11 @@ void
 DestroyCacheTable(
     CacheTableT* CacheTable
 ) {
-    if (CacheTable && CacheTable->Table) {
-        for (size_t i = 0; i != CACHE_TABLE_BUCKET_COUNT; i++) {
-            if (CacheTable->Table[i]) {
-                free(CacheTable->Table[i]);
-            }
-        }
-
-        free(CacheTable->Table);
+    if (CacheTable) {
+        munmap(CacheTable->Reservation, CacheTable->ReservationBytes);
+#ifdef CACHE_TABLE_STATS_ENABLED
+        free(CacheTable->LookupStats);
+#endif
+        free(CacheTable);
     }
-}
\ No newline at end of file
+}
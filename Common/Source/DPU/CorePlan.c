@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CorePlan.h"
+
+//
+// The busy-polling owner of each core, empty if it has none.
+// The storage and the network engines start on different threads, hence the lock
+//
+//
+static char CorePlanPollers[CORE_PLAN_MAX_CORES][CORE_PLAN_OWNER_CHARS];
+static pthread_mutex_t CorePlanLock = PTHREAD_MUTEX_INITIALIZER;
+
+//
+// Claim a core for an owner
+//
+//
+int
+CorePlanClaim(
+    uint32_t Core,
+    const char* Owner,
+    bool BusyPoll
+) {
+    int result = 0;
+
+    if (Core >= CORE_PLAN_MAX_CORES) {
+        fprintf(stderr, "%s: core %u of %s is beyond the %d cores of the plan\n",
+            __func__, Core, Owner, CORE_PLAN_MAX_CORES);
+        return -EINVAL;
+    }
+
+    if (!BusyPoll) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&CorePlanLock);
+    if (CorePlanPollers[Core][0] == '\0') {
+        snprintf(CorePlanPollers[Core], CORE_PLAN_OWNER_CHARS, "%s", Owner);
+        fprintf(stdout, "Core %u is planned for %s\n", Core, Owner);
+    }
+    else if (strncmp(CorePlanPollers[Core], Owner, CORE_PLAN_OWNER_CHARS - 1) != 0) {
+        fprintf(stderr, "%s: core %u is planned for both %s and %s, fix the core plan\n",
+            __func__, Core, CorePlanPollers[Core], Owner);
+        result = -EBUSY;
+    }
+    pthread_mutex_unlock(&CorePlanLock);
+
+    return result;
+}
+
+//
+// Claim a core for an owner and pin the current thread to it
+//
+//
+int
+CorePlanPin(
+    uint32_t Core,
+    const char* Owner,
+    bool BusyPoll
+) {
+    cpu_set_t cpuset;
+    int result;
+
+    result = CorePlanClaim(Core, Owner, BusyPoll);
+    if (result) {
+        return result;
+    }
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(Core, &cpuset);
+    result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (result) {
+        fprintf(stderr, "%s: failed to pin %s to core %u: %s\n", __func__, Owner, Core, strerror(result));
+        return -result;
+    }
+
+    return 0;
+}
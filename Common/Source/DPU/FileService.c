@@ -4,18 +4,25 @@
  */
 #include <stdlib.h>
 
+#include "spdk/file.h"
+#include "spdk/json.h"
+
 #include "FileService.h"
 #include "Zmalloc.h"
 #include "CacheTable.h"
+#include "CorePlan.h"
+#include "DPUBackEndChecksum.h"
+#include "DPUBackEndBlockCache.h"
+#include "DPUBackEndDefrag.h"
+#include "DPUBackEndTier.h"
+#include "DPUBackEndWriteBuffer.h"
+#include "DPULog.h"
 
-// #undef DEBUG_FILE_SERVICE
-#define DEBUG_FILE_SERVICE
-#ifdef DEBUG_FILE_SERVICE
-#include <stdio.h>
-#define DebugPrint(Fmt, ...) fprintf(stderr, Fmt, ##__VA_ARGS__)
-#else
-static inline void DebugPrint(const char* Fmt, ...) { }
-#endif
+//
+// Debug prints of the file service are compiled in at DPU_LOG_LEVEL_DEBUG
+//
+//
+#define DebugPrint(Fmt, ...) DPULogDebug(Fmt, ##__VA_ARGS__)
 
 #define SPDK_LOG_LEVEL SPDK_LOG_NOTICE
 
@@ -27,10 +34,40 @@ CacheTableT* CacheTable;
 
 struct DPUStorage *Sto;
 char *G_BDEV_NAME = "malloc_delay";
+bool G_FORMAT_OLDER_STORE = false;
+int G_WORKER_THREAD_COUNT = WORKER_THREAD_COUNT;
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+uint64_t G_BLOCK_CACHE_BYTES = DDS_BACKEND_BLOCK_CACHE_BYTES;
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+uint64_t G_WRITE_BUFFER_BYTES = 0;
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+char *G_TIER_BDEV_NAME = NULL;
+uint32_t G_TIER_COLD_DAYS = DDS_BACKEND_TIER_COLD_DAYS;
+#endif
 FileService* FS;
 extern bool G_INITIALIZATION_DONE;
 extern volatile int ForceQuitStorageEngine;
-int WorkerId = 0;
+
+//
+// The worker that serves an I/O slot: every slot of a block belongs to the same buffer connection,
+// so all requests of a connection land on one worker and keep their order;
+// host poll b takes block b, and the DPU slots come in blocks of DDS_MAX_OUTSTANDING_IO after those
+//
+//
+static inline int
+WorkerOfIoSlot(
+    FileService* FS,
+    RequestIdT IoSlot
+) {
+    if (IoSlot < DDS_DPU_IO_SLOT_NUMBER_BASE) {
+        return (int)((IoSlot / DDS_BACKEND_MAX_POLL_QUEUE_DEPTH) % FS->WorkerThreadCount);
+    }
+
+    return (int)((DDS_BACKEND_MAX_BUFFS + (IoSlot - DDS_DPU_IO_SLOT_NUMBER_BASE) / DDS_MAX_OUTSTANDING_IO) %
+        FS->WorkerThreadCount);
+}
 
 //
 // Usage function for printing parameters that are specific to this application, needed for SPDK app start
@@ -54,6 +91,127 @@ DDSParseArg(
     return 0;
 }
 
+//
+// Settings of the storage engine in the "dds_storage" object of the SPDK JSON config,
+// next to "subsystems", which SPDK ignores:
+// the name of the bdev to open, e.g. "Nvme0n1" after bdev_nvme_attach_controller named "Nvme0",
+// the number of I/O channels, one per worker thread, and the megabytes of the block cache, 0 to turn it off;
+// with tiering, the name of the capacity bdev, none by default, and the days after which a file untouched is cold;
+// whether a store of an older layout on the bdev is formatted, which loses its files, rather than refused (no by default).
+// The queue depth of the device is set in the same file with the bdev_nvme_set_options and bdev_set_options methods
+//
+//
+struct DDSStorageConfig {
+    char *BdevName;
+    uint32_t IoChannels;
+    uint32_t BlockCacheMB;
+    char *TierBdevName;
+    uint32_t TierColdDays;
+    uint32_t WriteBufferMB;
+    bool FormatOlderStore;
+};
+
+static const struct spdk_json_object_decoder DDSStorageConfigDecoders[] = {
+    {"bdev_name", offsetof(struct DDSStorageConfig, BdevName), spdk_json_decode_string, true},
+    {"io_channels", offsetof(struct DDSStorageConfig, IoChannels), spdk_json_decode_uint32, true},
+    {"format_older_store", offsetof(struct DDSStorageConfig, FormatOlderStore), spdk_json_decode_bool, true},
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    {"block_cache_mb", offsetof(struct DDSStorageConfig, BlockCacheMB), spdk_json_decode_uint32, true},
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    {"tier_bdev_name", offsetof(struct DDSStorageConfig, TierBdevName), spdk_json_decode_string, true},
+    {"tier_cold_days", offsetof(struct DDSStorageConfig, TierColdDays), spdk_json_decode_uint32, true},
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    {"write_buffer_mb", offsetof(struct DDSStorageConfig, WriteBufferMB), spdk_json_decode_uint32, true},
+#endif
+};
+
+//
+// Read the settings of the storage engine, keeping the defaults for those the config doesn't have
+//
+//
+static void
+LoadStorageConfig(
+    const char *Path
+) {
+    struct DDSStorageConfig config = { NULL, (uint32_t)G_WORKER_THREAD_COUNT, 0, NULL, 0, 0, G_FORMAT_OLDER_STORE };
+    struct spdk_json_val *values = NULL;
+    struct spdk_json_val *storage = NULL;
+    size_t size = 0;
+    void *end;
+    FILE *file;
+    void *json = NULL;
+    ssize_t numValues;
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    config.BlockCacheMB = (uint32_t)(G_BLOCK_CACHE_BYTES / ONE_MB);
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    config.TierColdDays = G_TIER_COLD_DAYS;
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    config.WriteBufferMB = (uint32_t)(G_WRITE_BUFFER_BYTES / ONE_MB);
+#endif
+
+    if (!Path) {
+        return;
+    }
+
+    file = fopen(Path, "r");
+    if (file) {
+        json = spdk_posix_file_load(file, &size);
+        fclose(file);
+    }
+    if (!json) {
+        SPDK_ERRLOG("Failed to read %s, using the default storage settings\n", Path);
+        return;
+    }
+
+    numValues = spdk_json_parse(json, size, NULL, 0, &end, SPDK_JSON_PARSE_FLAG_ALLOW_COMMENTS);
+    if (numValues > 0) {
+        values = calloc(numValues, sizeof(struct spdk_json_val));
+    }
+    if (values && spdk_json_parse(json, size, values, numValues, &end, SPDK_JSON_PARSE_FLAG_ALLOW_COMMENTS) == numValues &&
+        spdk_json_find(values, "dds_storage", NULL, &storage, SPDK_JSON_VAL_OBJECT_BEGIN) == 0) {
+        if (spdk_json_decode_object_relaxed(storage, DDSStorageConfigDecoders,
+            SPDK_COUNTOF(DDSStorageConfigDecoders), &config)) {
+            SPDK_ERRLOG("Invalid dds_storage in %s, using the default storage settings\n", Path);
+        }
+        else {
+            if (config.BdevName) {
+                G_BDEV_NAME = config.BdevName;
+            }
+            G_FORMAT_OLDER_STORE = config.FormatOlderStore;
+            if (config.IoChannels >= 1 && config.IoChannels <= MAX_WORKER_THREAD_COUNT) {
+                G_WORKER_THREAD_COUNT = (int)config.IoChannels;
+            }
+            else {
+                SPDK_ERRLOG("io_channels must be in [1, %d], using %d\n", MAX_WORKER_THREAD_COUNT, G_WORKER_THREAD_COUNT);
+            }
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+            G_BLOCK_CACHE_BYTES = (uint64_t)config.BlockCacheMB * ONE_MB;
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+            G_WRITE_BUFFER_BYTES = (uint64_t)config.WriteBufferMB * ONE_MB;
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+            G_TIER_BDEV_NAME = config.TierBdevName;
+            if (config.TierColdDays >= 1) {
+                G_TIER_COLD_DAYS = config.TierColdDays;
+            }
+            else {
+                SPDK_ERRLOG("tier_cold_days must be at least 1, using %u\n", G_TIER_COLD_DAYS);
+            }
+#endif
+        }
+    }
+
+    SPDK_NOTICELOG("Storage engine uses bdev %s with %d I/O channels\n", G_BDEV_NAME, G_WORKER_THREAD_COUNT);
+    free(values);
+    free(json);
+}
+
 //
 // Allocate the file service object
 //
@@ -61,7 +219,7 @@ DDSParseArg(
 FileService*
 AllocateFileService() {
     DebugPrint("Allocating the file service object...\n");
-    FS = (FileService*)malloc(sizeof(FileService));
+    FS = (FileService*)calloc(1, sizeof(FileService));
     return FS;
 }
 
@@ -75,6 +233,15 @@ void GetIOChannel(void* Ctx) {
         exit(-1);
         return;
     }
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (ctx->tier_bdev_desc) {
+        ctx->tier_bdev_io_channel = spdk_bdev_get_io_channel(ctx->tier_bdev_desc);
+        if (ctx->tier_bdev_io_channel == NULL) {
+            SPDK_ERRLOG("Could not create an I/O channel of the capacity bdev\n");
+            exit(-1);
+        }
+    }
+#endif
 }
 
 //
@@ -99,18 +266,269 @@ void InitializeWorkerThreadIOChannel(FileService *FS) {
 }
 
 
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+//
+// Create the offload channel of a range of DPU slots, with all of its blocks cached on the producer side
+//
+//
+static OffloadChannelT*
+CreateOffloadChannel(
+    FileService* FS,
+    int ChannelId
+) {
+    size_t drbBytes = tle_drb_calc_size(OFFLOAD_CHANNEL_DRB_OBJS);
+    size_t channelBytes = RTE_ALIGN_CEIL(sizeof(OffloadChannelT), RTE_CACHE_LINE_SIZE);
+    OffloadChannelT *channel = aligned_alloc(RTE_CACHE_LINE_SIZE, channelBytes);
+
+    if (channel == NULL) {
+        return NULL;
+    }
+
+    memset(channel, 0, channelBytes);
+    tle_dring_reset(&channel->Ring, RING_F_SP_ENQ | RING_F_SC_DEQ);
+    channel->WorkerId = WorkerOfIoSlot(FS, DDS_DPU_IO_SLOT_NUMBER_BASE + ChannelId * DDS_DPU_IO_SLOTS_PER_THREAD);
+    channel->Drbs = aligned_alloc(RTE_CACHE_LINE_SIZE, drbBytes * OFFLOAD_CHANNEL_DRBS);
+    channel->FreeDrbs = spdk_ring_create(SPDK_RING_TYPE_SP_SC, OFFLOAD_CHANNEL_FREE_DRB_ENTRIES, SPDK_ENV_SOCKET_ID_ANY);
+    if (channel->Drbs == NULL || channel->FreeDrbs == NULL) {
+        spdk_ring_free(channel->FreeDrbs);
+        free(channel->Drbs);
+        free(channel);
+        return NULL;
+    }
+
+    for (int i = 0; i != OFFLOAD_CHANNEL_DRBS; i++) {
+        struct tle_drb *drb = (struct tle_drb*)((char*)channel->Drbs + i * drbBytes);
+        memset(drb, 0, drbBytes);
+        drb->size = OFFLOAD_CHANNEL_DRB_OBJS;
+        drb->udata = channel;
+        channel->CachedDrbs[i] = drb;
+    }
+    channel->NumCachedDrbs = OFFLOAD_CHANNEL_DRBS;
+
+    return channel;
+}
+
+//
+// Free an offload channel once neither its lcore nor its worker uses it
+//
+//
+static void
+FreeOffloadChannel(
+    OffloadChannelT* Channel
+) {
+    spdk_ring_free(Channel->FreeDrbs);
+    free(Channel->Drbs);
+    free(Channel);
+}
+
+//
+// Hand slot contexts to the worker of a channel, on the lcore of the channel
+//
+//
+static void
+OffloadChannelEnqueue(
+    OffloadChannelT* Channel,
+    void** SlotContexts,
+    int Count
+) {
+    uint32_t needed = (Count + OFFLOAD_CHANNEL_DRB_OBJS - 1) / OFFLOAD_CHANNEL_DRB_OBJS;
+    uint32_t base, unused, used;
+
+    //
+    // The worker returns every block it drains, so this only waits if it is far behind
+    //
+    //
+    while (Channel->NumCachedDrbs < needed) {
+        Channel->NumCachedDrbs += spdk_ring_dequeue(Channel->FreeDrbs,
+            (void**)&Channel->CachedDrbs[Channel->NumCachedDrbs], OFFLOAD_CHANNEL_DRBS - Channel->NumCachedDrbs);
+    }
+
+    //
+    // The dring fills its current block first and takes new ones from the front of the array;
+    // those it leaves are moved down over the ones it took
+    //
+    //
+    base = Channel->NumCachedDrbs - needed;
+    unused = needed;
+    tle_dring_sp_enqueue(&Channel->Ring, (const void* const*)SlotContexts, Count, &Channel->CachedDrbs[base], &unused);
+    used = needed - unused;
+    for (uint32_t i = 0; i != unused; i++) {
+        Channel->CachedDrbs[base + i] = Channel->CachedDrbs[base + used + i];
+    }
+    Channel->NumCachedDrbs -= used;
+}
+
+//
+// Serve the reads in the offload channels of a worker, on the worker; returns the number of reads
+//
+//
+static size_t
+PollOffloadChannels(
+    int WorkerId
+) {
+    const void *slotContexts[OFFLOAD_RING_BURST];
+    struct tle_drb *drbs[OFFLOAD_CHANNEL_DRBS];
+    size_t total = 0;
+
+    for (int c = 0; c != OFFLOAD_CHANNELS; c++) {
+        OffloadChannelT *channel = FS->OffloadChannels[c];
+        uint32_t count, numDrbs;
+
+        if (channel == NULL || channel->WorkerId != WorkerId) {
+            continue;
+        }
+
+        numDrbs = OFFLOAD_CHANNEL_DRBS;
+        count = tle_dring_sc_dequeue(&channel->Ring, slotContexts, OFFLOAD_RING_BURST, drbs, &numDrbs);
+        if (numDrbs != 0) {
+            spdk_ring_enqueue(channel->FreeDrbs, (void**)drbs, numDrbs, NULL);
+        }
+
+        for (uint32_t i = 0; i != count; i++) {
+            DataPlaneRequestHandler((void*)slotContexts[i]);
+        }
+        total += count;
+    }
+
+    return total;
+}
+#endif
+
+//
+// Serve the reads in the offload ring of a worker, and in its offload channels, on the worker
+//
+//
+static int
+OffloadRingPoller(
+    void* Ctx
+) {
+    int workerId = (int)(uintptr_t)Ctx;
+    void *slotContexts[OFFLOAD_RING_BURST];
+    size_t count = spdk_ring_dequeue(FS->OffloadRings[workerId], slotContexts, OFFLOAD_RING_BURST);
+
+    for (size_t i = 0; i != count; i++) {
+        DataPlaneRequestHandler(slotContexts[i]);
+    }
+
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+    count += PollOffloadChannels(workerId);
+#endif
+
+    return count ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+}
+
+//
+// Start polling the offload ring of a worker, on the worker
+//
+//
+static void
+StartOffloadPoller(
+    void* Ctx
+) {
+    int workerId = (int)(uintptr_t)Ctx;
+    FS->OffloadPollers[workerId] = spdk_poller_register(OffloadRingPoller, Ctx, 0);
+    if (FS->OffloadPollers[workerId] == NULL) {
+        SPDK_ERRLOG("Could not register the offload poller of worker %d\n", workerId);
+    }
+}
+
+//
+// Start issuing the requests a worker holds back for the rate limits of their files, on the worker
+//
+//
+static void
+StartQoSPoller(
+    void* Ctx
+) {
+    SPDKContextT *SPDKContext = (SPDKContextT*)Ctx;
+    SPDKContext->QoS->Poller = spdk_poller_register(DataPlaneQoSPoller, SPDKContext, DDS_BACKEND_QOS_POLL_PERIOD_US);
+    if (SPDKContext->QoS->Poller == NULL) {
+        SPDK_ERRLOG("Could not register the rate limit poller of a worker\n");
+    }
+}
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+//
+// Start writing back the write buffer, on a worker; the poller idles while the buffer is off
+//
+//
+static void
+StartWriteBufferPoller(
+    void* Ctx
+) {
+    SPDKContextT *SPDKContext = (SPDKContextT*)Ctx;
+    SPDKContext->WriteBufferPoller = spdk_poller_register(WriteBufferPoller, SPDKContext,
+        DDS_BACKEND_WRITE_BUFFER_POLL_PERIOD_US);
+    if (SPDKContext->WriteBufferPoller == NULL) {
+        SPDK_ERRLOG("Could not register the write buffer poller of a worker\n");
+    }
+}
+#endif
+
+//
+// Create the offload rings and have the workers poll them
+//
+//
+static void
+StartOffloadRings(
+    FileService* FS
+) {
+    FS->OffloadRings = calloc(FS->WorkerThreadCount, sizeof(struct spdk_ring*));
+    FS->OffloadPollers = calloc(FS->WorkerThreadCount, sizeof(struct spdk_poller*));
+
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+    //
+    // The reads of a range of slots without a channel go through the ring of its worker
+    //
+    //
+    for (int c = 0; c != OFFLOAD_CHANNELS; c++) {
+        FS->OffloadChannels[c] = CreateOffloadChannel(FS, c);
+        if (FS->OffloadChannels[c] == NULL) {
+            SPDK_ERRLOG("Could not create offload channel %d, its reads go through the offload ring\n", c);
+        }
+    }
+#endif
+
+    for (int i = 0; i < FS->WorkerThreadCount; i++) {
+        FS->OffloadRings[i] = spdk_ring_create(SPDK_RING_TYPE_MP_SC, OFFLOAD_RING_ENTRIES, SPDK_ENV_SOCKET_ID_ANY);
+        if (FS->OffloadRings[i] == NULL) {
+            SPDK_ERRLOG("Could not create the offload ring of worker %d, reads won't be offloaded\n", i);
+            return;
+        }
+        spdk_thread_send_msg(FS->WorkerThreads[i], StartOffloadPoller, (void*)(uintptr_t)i);
+    }
+
+    atomic_store(&FS->OffloadReady, true);
+}
+
 //
 // This is the func supplied to `spdk_app_start()`, will do the actual init work asynchronously
 //
 //
 void StartSPDKFileService(void* Ctx) {
+    struct StartFileServiceCtx* StartCtx = (struct StartFileServiceCtx*)Ctx;
+    FileService* FS = StartCtx->FS;
+    char owner[CORE_PLAN_OWNER_CHARS];
+    uint32_t core;
+
+    //
+    // Every reactor polls its core, which nothing else that polls may have
+    //
+    //
+    SPDK_ENV_FOREACH_CORE(core) {
+        snprintf(owner, sizeof(owner), "SPDK reactor %u", core);
+        if (CorePlanClaim(core, owner, true)) {
+            DPULogError("The reactor mask overlaps the core plan, FATAL, EXITING...\n");
+            spdk_app_stop(-EBUSY);
+            return;
+        }
+    }
+
     //
     // Initialize worker threads and their SPDKContexts
     //
     //
-    struct StartFileServiceCtx* StartCtx = (struct StartFileServiceCtx*)Ctx;
-    FileService* FS = StartCtx->FS;
-    FS->WorkerThreadCount = WORKER_THREAD_COUNT;
+    FS->WorkerThreadCount = G_WORKER_THREAD_COUNT;
     FS->WorkerThreads = calloc(FS->WorkerThreadCount, sizeof(struct spdk_thread*));
     memset(FS->WorkerThreads, 0, FS->WorkerThreadCount * sizeof(struct spdk_thread*));
     FS->WorkerSPDKContexts = calloc(FS->WorkerThreadCount, sizeof(SPDKContextT));
@@ -120,16 +538,78 @@ void StartSPDKFileService(void* Ctx) {
     ret = spdk_bdev_open_ext(G_BDEV_NAME, true, SpdkBdevEventCb, NULL,
             &bdev_desc);
     if (ret) {
-        DebugPrint("spdk_bdev_open_ext FAILED!!! FATAL, EXITING...\n");
+        DPULogError("spdk_bdev_open_ext FAILED!!! FATAL, EXITING...\n");
         exit(-1);
     }
     struct spdk_bdev *bdev = spdk_bdev_desc_get_bdev(bdev_desc);
 
+#ifdef OPT_FILE_SERVICE_ENCRYPTION
+    //
+    // The store is encrypted at rest only if the bdev is a crypto vbdev, which encrypts every block
+    // with its accel key on the way to the bdev below; a plaintext bdev must not be opened by mistake
+    //
+    //
+    if (strcmp(spdk_bdev_get_module_name(bdev), DDS_ENCRYPTION_BDEV_MODULE)) {
+        DPULogError("bdev %s is a %s bdev, not an encrypted one, FATAL, EXITING...\n",
+            G_BDEV_NAME, spdk_bdev_get_module_name(bdev));
+        spdk_bdev_close(bdev_desc);
+        exit(-1);
+    }
+    SPDK_NOTICELOG("bdev %s encrypts the store at rest\n", G_BDEV_NAME);
+#endif
+
+    //
+    // The store is laid out in sectors of DDS_BACKEND_SECTOR_SIZE and segments of DDS_BACKEND_SEGMENT_SIZE;
+    // a striped bdev (raid0) reports its stripe unit as the optimal I/O boundary
+    //
+    //
+    uint32_t blockSize = spdk_bdev_get_block_size(bdev);
+    uint64_t bdevBytes = spdk_bdev_get_num_blocks(bdev) * blockSize;
+    SPDK_NOTICELOG("bdev %s: %lu bytes in blocks of %u, write unit %u blocks, optimal I/O boundary %u blocks\n",
+        G_BDEV_NAME, bdevBytes, blockSize, spdk_bdev_get_write_unit_size(bdev), spdk_bdev_get_optimal_io_boundary(bdev));
+    if (DDS_BACKEND_SECTOR_SIZE % blockSize) {
+        SPDK_ERRLOG("bdev %s can't do I/O in sectors of %d, FATAL, EXITING...\n", G_BDEV_NAME, DDS_BACKEND_SECTOR_SIZE);
+        exit(-1);
+    }
+    uint64_t stripeBytes = (uint64_t)spdk_bdev_get_optimal_io_boundary(bdev) * blockSize;
+    if (stripeBytes && DDS_BACKEND_SEGMENT_SIZE % stripeBytes) {
+        SPDK_WARNLOG("bdev %s has a stripe unit of %lu bytes that doesn't divide segments of %llu, "
+            "segments won't start on a stripe\n", G_BDEV_NAME, stripeBytes, DDS_BACKEND_SEGMENT_SIZE);
+    }
+
     FS->MasterSPDKContext = malloc(sizeof(*FS->MasterSPDKContext));
     FS->MasterSPDKContext->bdev_io_channel = NULL;
     FS->MasterSPDKContext->bdev_name = G_BDEV_NAME;
     FS->MasterSPDKContext->bdev_desc = bdev_desc;
     FS->MasterSPDKContext->bdev = bdev;
+    FS->MasterSPDKContext->AtomicLane = NULL;  // copied to the workers, each takes its own
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    //
+    // The capacity bdev, if any, is a whole of segments in sectors of the store as well
+    //
+    //
+    FS->MasterSPDKContext->tier_bdev = NULL;
+    FS->MasterSPDKContext->tier_bdev_desc = NULL;
+    FS->MasterSPDKContext->tier_bdev_io_channel = NULL;
+    if (G_TIER_BDEV_NAME) {
+        struct spdk_bdev_desc *tierDesc;
+        if (spdk_bdev_open_ext(G_TIER_BDEV_NAME, true, SpdkBdevEventCb, NULL, &tierDesc)) {
+            DPULogError("Can't open the capacity bdev %s, FATAL, EXITING...\n", G_TIER_BDEV_NAME);
+            exit(-1);
+        }
+        struct spdk_bdev *tierBdev = spdk_bdev_desc_get_bdev(tierDesc);
+        if (DDS_BACKEND_SECTOR_SIZE % spdk_bdev_get_block_size(tierBdev)) {
+            SPDK_ERRLOG("bdev %s can't do I/O in sectors of %d, FATAL, EXITING...\n",
+                G_TIER_BDEV_NAME, DDS_BACKEND_SECTOR_SIZE);
+            exit(-1);
+        }
+        FS->MasterSPDKContext->tier_bdev = tierBdev;
+        FS->MasterSPDKContext->tier_bdev_desc = tierDesc;
+        SPDK_NOTICELOG("Cold segments go to bdev %s of %lu bytes after %u days\n", G_TIER_BDEV_NAME,
+            spdk_bdev_get_num_blocks(tierBdev) * spdk_bdev_get_block_size(tierBdev), G_TIER_COLD_DAYS);
+    }
+#endif
 
     SPDK_WARNLOG("bdev buf align = %lu\n", spdk_bdev_get_buf_align(bdev));
 
@@ -137,28 +617,68 @@ void StartSPDKFileService(void* Ctx) {
     AllocateSpace(FS->MasterSPDKContext);  // allocated SPDKSpace will be copied/shared to all worker contexts
 
 
+    //
+    // Spread the workers over the reactor cores, starting from the current one
+    //
+    //
     struct spdk_cpuset tmp_cpumask = {};
+    uint32_t workerCore = spdk_env_get_current_core();
     for (int i = 0; i < FS->WorkerThreadCount; i++) {
-        SPDK_NOTICELOG("creating worker thread %d\n", i);
+        SPDK_NOTICELOG("creating worker thread %d on core %u\n", i, workerCore);
         char threadName[32];
         snprintf(threadName, 32, "worker_thread%d", i);
-        spdk_cpuset_set_cpu(&tmp_cpumask, spdk_env_get_current_core(), true);
+        spdk_cpuset_zero(&tmp_cpumask);
+        spdk_cpuset_set_cpu(&tmp_cpumask, workerCore, true);
+        workerCore = spdk_env_get_next_core(workerCore);
+        if (workerCore == UINT32_MAX) {
+            workerCore = spdk_env_get_first_core();
+        }
         FS->WorkerThreads[i] = spdk_thread_create(threadName, &tmp_cpumask);
         if (FS->WorkerThreads[i] == NULL) {
-            DebugPrint("CANNOT CREATE WORKER THREAD!!! FATAL, EXITING...\n");
+            DPULogError("CANNOT CREATE WORKER THREAD!!! FATAL, EXITING...\n");
             exit(-1);
         }
         SPDK_NOTICELOG("thread id: %lu, thread ptr: %p\n", spdk_thread_get_id(FS->WorkerThreads[i]), FS->WorkerThreads[i]);
         
         SPDKContextT *SPDKContext = &FS->WorkerSPDKContexts[i];
         memcpy(SPDKContext, FS->MasterSPDKContext, sizeof(*SPDKContext));
+
+        //
+        // The writes in flight and the read fences are those of the worker, not shared with the others
+        //
+        //
+        SPDKContext->Order = calloc(1, sizeof(DataPlaneOrderT));
+        if (SPDKContext->Order == NULL) {
+            SPDK_ERRLOG("CANNOT ALLOCATE THE READ ORDER OF A WORKER!!! FATAL, EXITING...\n");
+            exit(-1);
+        }
+
+        SPDKContext->QoS = calloc(1, sizeof(DataPlaneQoST));
+        if (SPDKContext->QoS == NULL) {
+            DPULogError("CANNOT ALLOCATE THE RATE LIMITS OF A WORKER!!! FATAL, EXITING...\n");
+            exit(-1);
+        }
+        spdk_thread_send_msg(FS->WorkerThreads[i], StartQoSPoller, SPDKContext);
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+        SPDKContext->WriteBufferPoller = NULL;
+        spdk_thread_send_msg(FS->WorkerThreads[i], StartWriteBufferPoller, SPDKContext);
+#endif
     }
     FS->MasterSPDKContext->bdev_io_channel = spdk_bdev_get_io_channel(FS->MasterSPDKContext->bdev_desc);
     
     if (FS->MasterSPDKContext->bdev_io_channel == NULL) {
-        DebugPrint("master context can't get IO channel!!! Exiting...\n");
+        DPULogError("master context can't get IO channel!!! Exiting...\n");
         exit(-1);
     }
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (FS->MasterSPDKContext->tier_bdev_desc) {
+        FS->MasterSPDKContext->tier_bdev_io_channel = spdk_bdev_get_io_channel(FS->MasterSPDKContext->tier_bdev_desc);
+        if (FS->MasterSPDKContext->tier_bdev_io_channel == NULL) {
+            DPULogError("master context can't get an I/O channel of the capacity bdev, Exiting...\n");
+            exit(-1);
+        }
+    }
+#endif
     FS->AppThread = spdk_get_thread();
     SPDK_NOTICELOG("FS->AppThread id: %lu\n", spdk_thread_get_id(FS->AppThread));
     SPDK_NOTICELOG("FS->AppThread : %lu\n", spdk_thread_get_id(FS->AppThread));
@@ -167,6 +687,7 @@ void StartSPDKFileService(void* Ctx) {
 
     SPDK_NOTICELOG("Calling InitializeWorkerThreadIOChannel()...\n");
     InitializeWorkerThreadIOChannel(FS);
+    StartOffloadRings(FS);
 
     //
     // Initialize Storage async, we are now using a global DPUStorage *, potentially cross thread
@@ -186,6 +707,17 @@ void StartSPDKFileService(void* Ctx) {
         return;
     }
 
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    //
+    // The scrubber waits for the loading to finish before it reads anything
+    //
+    //
+    ChecksumsStartScrubber(Sto, FS->MasterSPDKContext);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    DefragStart(Sto, FS->MasterSPDKContext);
+#endif
+
     //
     // `Initialize` will be completed async, returning here doesn't mean it's actually started, but assume it's ok.
     //
@@ -216,6 +748,7 @@ StartFileServiceWrapper(
     /* Set default values in opts structure. */
     spdk_app_opts_init(&opts, sizeof(opts));
     opts.name = "dds_bdev";
+    opts.reactor_mask = CORE_ALLOCATION_SPDK_REACTOR_MASK;
     
     //
     // Parse built-in SPDK command line parameters as well
@@ -230,6 +763,8 @@ StartFileServiceWrapper(
         exit(rc);
     }
 
+    LoadStorageConfig(opts.json_config_file);
+
     printf("starting FS, StartSPDKFileService()...\n");
     spdk_app_start(&opts, StartSPDKFileService, StartCtx);
     printf("spdk_app_start returns\n");
@@ -261,8 +796,20 @@ StartFileService(
 //
 void AppThreadExit(void *Ctx) {
     FileService *FS = Ctx;
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    ChecksumsStopScrubber(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    DefragStop(Sto);
+#endif
     spdk_put_io_channel(FS->MasterSPDKContext->bdev_io_channel);
     spdk_bdev_close(FS->MasterSPDKContext->bdev_desc);
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (FS->MasterSPDKContext->tier_bdev_desc) {
+        spdk_put_io_channel(FS->MasterSPDKContext->tier_bdev_io_channel);
+        spdk_bdev_close(FS->MasterSPDKContext->tier_bdev_desc);
+    }
+#endif
     
     //
     // will get "spdk_app_stop() called twice" if we call it here (after Ctrl-C)
@@ -277,7 +824,25 @@ void AppThreadExit(void *Ctx) {
 //
 void WorkerThreadExit(void *Ctx) {
     struct WorkerThreadExitCtx *ExitCtx = Ctx;
+    if (FS->OffloadPollers && FS->OffloadPollers[ExitCtx->i]) {
+        spdk_poller_unregister(&FS->OffloadPollers[ExitCtx->i]);
+    }
+    if (FS->WorkerSPDKContexts[ExitCtx->i].QoS) {
+        spdk_poller_unregister(&FS->WorkerSPDKContexts[ExitCtx->i].QoS->Poller);
+        free(FS->WorkerSPDKContexts[ExitCtx->i].QoS);
+        FS->WorkerSPDKContexts[ExitCtx->i].QoS = NULL;
+    }
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    spdk_poller_unregister(&FS->WorkerSPDKContexts[ExitCtx->i].WriteBufferPoller);
+#endif
     spdk_put_io_channel(ExitCtx->Channel);
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (FS->WorkerSPDKContexts[ExitCtx->i].tier_bdev_io_channel) {
+        spdk_put_io_channel(FS->WorkerSPDKContexts[ExitCtx->i].tier_bdev_io_channel);
+    }
+#endif
+    free(FS->WorkerSPDKContexts[ExitCtx->i].Order);
+    FS->WorkerSPDKContexts[ExitCtx->i].Order = NULL;
     spdk_thread_exit(spdk_get_thread());
     SPDK_NOTICELOG("Worker thread %d exited!\n", ExitCtx->i);
     free(Ctx);
@@ -295,6 +860,7 @@ StopFileService(
     // clean up and free contexts, then worker threads exit
     //
     //
+    atomic_store(&FS->OffloadReady, false);
     printf("Worker thread count = %d\n", FS->WorkerThreadCount);
     for (size_t i = 0; i < FS->WorkerThreadCount; i++) {
         struct WorkerThreadExitCtx *ExitCtx = malloc(sizeof(*ExitCtx));
@@ -316,6 +882,18 @@ void
 DeallocateFileService(
     FileService* FS
 ) {
+    for (int i = 0; FS->OffloadRings && i < FS->WorkerThreadCount; i++) {
+        spdk_ring_free(FS->OffloadRings[i]);
+    }
+    free(FS->OffloadRings);
+    free(FS->OffloadPollers);
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+    for (int c = 0; c != OFFLOAD_CHANNELS; c++) {
+        if (FS->OffloadChannels[c]) {
+            FreeOffloadChannel(FS->OffloadChannels[c]);
+        }
+    }
+#endif
     free(FS);
     DebugPrint("File service object deallocated\n");
 }
@@ -330,16 +908,16 @@ SubmitControlPlaneRequest(
     ControlPlaneRequestContext* Context
 ) {
     //
-    // We only need a single worker thread, though this leaves room for multi-threading
+    // Control plane requests are serialized on one worker
     //
     //
-    struct spdk_thread *worker = FS->WorkerThreads[WorkerId];
-    Context->SPDKContext = &FS->WorkerSPDKContexts[WorkerId];
+    struct spdk_thread *worker = FS->WorkerThreads[CONTROL_PLANE_WORKER_ID];
+    Context->SPDKContext = &FS->WorkerSPDKContexts[CONTROL_PLANE_WORKER_ID];
 
     int ret = spdk_thread_send_msg(worker, ControlPlaneHandler, Context);
 
     if (ret) {
-        fprintf(stderr, "SubmitControlPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
+        DPULogWarning("SubmitControlPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
         
         //
         // busy retry, should be rare if it happens at all (at extremely high throughput)
@@ -348,7 +926,7 @@ SubmitControlPlaneRequest(
         while (1) {
             ret = spdk_thread_send_msg(worker, ControlPlaneHandler, Context);
             if (ret == 0) {
-                fprintf(stderr, "SubmitControlPlaneRequest() retry finished\n");
+                DPULogDebug("SubmitControlPlaneRequest() retry finished\n");
                 return;
             }
         }
@@ -362,22 +940,25 @@ SubmitDataPlaneRequest(
     DataPlaneRequestContext* ContextArray,
     RequestIdT Index,
     RequestIdT BatchSize,
-    RequestIdT IoSlotBase
+    RequestIdT IoSlotBase,
+    RequestIdT IoSlotSpan
 ) {
     //
-    // We don't need multi threading in DDS, but do proper thread selection if doing multi threading
+    // The whole batch goes to the worker of its connection
     //
     //
-    struct spdk_thread *worker = FS->WorkerThreads[WorkerId];
+    int workerId = WorkerOfIoSlot(FS, IoSlotBase);
+    struct spdk_thread *worker = FS->WorkerThreads[workerId];
     
     //
     // Get the head of batch slot
     //
     //
-    SPDKContextT *SPDKContext = &FS->WorkerSPDKContexts[WorkerId];
+    SPDKContextT *SPDKContext = &FS->WorkerSPDKContexts[workerId];
     struct PerSlotContext *headSlotContext = GetFreeSpace(SPDKContext, &ContextArray[Index - IoSlotBase], Index);
     headSlotContext->BatchSize = BatchSize;
     headSlotContext->IndexBase = IoSlotBase;
+    headSlotContext->IndexSpan = IoSlotSpan;
     headSlotContext->SPDKContext = SPDKContext;
     
     //
@@ -385,13 +966,14 @@ SubmitDataPlaneRequest(
     //
     //
     for (RequestIdT i = 1; i < BatchSize; i++) {
-        RequestIdT curIndex = (Index - IoSlotBase + i) % DDS_MAX_OUTSTANDING_IO;
+        RequestIdT curIndex = (Index - IoSlotBase + i) % IoSlotSpan;
         RequestIdT selfIndex = IoSlotBase + curIndex;
         struct PerSlotContext *curSlotContext = &headSlotContext->SPDKContext->SPDKSpace[selfIndex];
         curSlotContext->Ctx = &ContextArray[curIndex];
         curSlotContext->SPDKContext = SPDKContext;
         curSlotContext->BatchSize = BatchSize;
         curSlotContext->IndexBase = IoSlotBase;
+        curSlotContext->IndexSpan = IoSlotSpan;
     }
     
     //
@@ -400,11 +982,11 @@ SubmitDataPlaneRequest(
     //
     int ret = spdk_thread_send_msg(worker, DataPlaneRequestHandler, headSlotContext);
     if (ret) {
-        fprintf(stderr, "SubmitDataPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
+        DPULogWarning("SubmitDataPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
         while (1) {
             ret = spdk_thread_send_msg(worker, DataPlaneRequestHandler, headSlotContext);
             if (ret == 0) {
-                fprintf(stderr, "SubmitDataPlaneRequest() read retry finished\n");
+                DPULogDebug("SubmitDataPlaneRequest() read retry finished\n");
                 return;
             }
         }
@@ -422,21 +1004,22 @@ SubmitDataPlaneRequest(
     bool IsRead,
     RequestIdT Index
 ) {
-    struct spdk_thread *worker = FS->WorkerThreads[WorkerId];
+    int workerId = WorkerOfIoSlot(FS, Index);
+    struct spdk_thread *worker = FS->WorkerThreads[workerId];
 
-    struct PerSlotContext *SlotContext = GetFreeSpace(&FS->WorkerSPDKContexts[WorkerId], Context, Index);
-    SlotContext->SPDKContext = &FS->WorkerSPDKContexts[WorkerId];
+    struct PerSlotContext *SlotContext = GetFreeSpace(&FS->WorkerSPDKContexts[workerId], Context, Index);
+    SlotContext->SPDKContext = &FS->WorkerSPDKContexts[workerId];
 
     int ret;
     if (IsRead) {
         ret = spdk_thread_send_msg(worker, ReadHandler, SlotContext);
         
         if (ret) {
-            fprintf(stderr, "SubmitDataPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
+            DPULogWarning("SubmitDataPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
             while (1) {
                 ret = spdk_thread_send_msg(worker, ReadHandler, SlotContext);
                 if (ret == 0) {
-                    fprintf(stderr, "SubmitDataPlaneRequest() read retry finished\n");
+                    DPULogDebug("SubmitDataPlaneRequest() read retry finished\n");
                     return;
                 }
             }
@@ -446,15 +1029,65 @@ SubmitDataPlaneRequest(
         ret = spdk_thread_send_msg(worker, WriteHandler, SlotContext);
 
         if (ret) {
-            fprintf(stderr, "SubmitDataPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
+            DPULogWarning("SubmitDataPlaneRequest() initial thread send msg failed with %d, retrying\n", ret);
             while (1) {
                 ret = spdk_thread_send_msg(worker, WriteHandler, SlotContext);
                 if (ret == 0) {
-                    fprintf(stderr, "SubmitDataPlaneRequest() write retry finished\n");
+                    DPULogDebug("SubmitDataPlaneRequest() write retry finished\n");
                     return;
                 }
             }
         }
     }
 }
-#endif
\ No newline at end of file
+#endif
+
+//
+// Submit reads offloaded by a network thread directly to the worker of their I/O slots
+//
+//
+bool
+SubmitOffloadRequests(
+    FileService* FS,
+    DataPlaneRequestContext** Contexts,
+    RequestIdT* Indices,
+    int Count
+) {
+    if (!atomic_load(&FS->OffloadReady) || !G_INITIALIZATION_DONE) {
+        return false;
+    }
+
+    int workerId = WorkerOfIoSlot(FS, Indices[0]);
+    SPDKContextT *SPDKContext = &FS->WorkerSPDKContexts[workerId];
+    void *slotContexts[Count];
+
+    for (int i = 0; i != Count; i++) {
+        struct PerSlotContext *slotContext = GetFreeSpace(SPDKContext, Contexts[i], Indices[i]);
+        slotContext->BatchSize = 1;
+        slotContext->IndexBase = Indices[i];
+        slotContext->IndexSpan = 1;
+        slotContext->SPDKContext = SPDKContext;
+        slotContexts[i] = slotContext;
+    }
+
+#ifdef OPT_FILE_SERVICE_OFFLOAD_DRING
+    if (Indices[0] >= DDS_DPU_IO_SLOT_NUMBER_BASE) {
+        RequestIdT channelId = (Indices[0] - DDS_DPU_IO_SLOT_NUMBER_BASE) / DDS_DPU_IO_SLOTS_PER_THREAD;
+        if (channelId < OFFLOAD_CHANNELS && FS->OffloadChannels[channelId]) {
+            OffloadChannelEnqueue(FS->OffloadChannels[channelId], slotContexts, Count);
+            return true;
+        }
+    }
+#endif
+
+    //
+    // The ring has room for every DPU slot, so this only waits if the worker is far behind
+    //
+    //
+    size_t enqueued = 0;
+    while (enqueued != Count) {
+        enqueued += spdk_ring_enqueue(FS->OffloadRings[workerId], &slotContexts[enqueued], Count - enqueued, NULL);
+    }
+
+    return true;
+}
@@ -3,40 +3,112 @@
  * Licensed under the MIT License
  */
 
-#include <string.h>
-
 #include "OffloadResponseRingBuffer.h"
 
+OffloadResponseRingBuffer* OffloadResponseRings = NULL;
+atomic_int OffloadResponseRingsOwner = OFFLOAD_RESPONSE_RINGS_ABSENT;
+
+//
+// Publish the rings once they are allocated, so that a buffer can bind them
+//
+//
+void
+PublishOffloadResponseRings(
+    OffloadResponseRingBuffer* Rings
+) {
+    OffloadResponseRings = Rings;
+    atomic_store(&OffloadResponseRingsOwner, OFFLOAD_RESPONSE_RINGS_UNBOUND);
+}
+
+//
+// Withdraw the rings before they are freed; return false if a buffer has them, and they must stay
+//
+//
+bool
+WithdrawOffloadResponseRings() {
+    int unbound = OFFLOAD_RESPONSE_RINGS_UNBOUND;
+
+    if (!atomic_compare_exchange_strong(&OffloadResponseRingsOwner, &unbound, OFFLOAD_RESPONSE_RINGS_ABSENT)) {
+        return false;
+    }
+    OffloadResponseRings = NULL;
+
+    return true;
+}
+
+//
+// Bind the rings to a buffer; return false if there are none or another buffer has them
+//
+//
+bool
+BindOffloadResponseRings(
+    int BuffId
+) {
+    int unbound = OFFLOAD_RESPONSE_RINGS_UNBOUND;
+
+    return atomic_compare_exchange_strong(&OffloadResponseRingsOwner, &unbound, BuffId);
+}
+
+//
+// Unbind the rings from a buffer
+//
+//
+void
+UnbindOffloadResponseRings(
+    int BuffId
+) {
+    atomic_compare_exchange_strong(&OffloadResponseRingsOwner, &BuffId, OFFLOAD_RESPONSE_RINGS_UNBOUND);
+}
+
 //
-// Allocate a response buffer object
+// Reserve a record of RecordBytes, aligned, in a ring, and write its size at its start;
+// the record ends at *End, after the padding it may need not to wrap; return NULL if there is no room
 //
 //
-OffloadResponseRingBuffer*
-AllocateOffloadResponseBuffer(
-    BufferT BufferAddress
+char*
+ReserveOffloadResponse(
+    OffloadResponseRingBuffer* RingBuffer,
+    FileIOSizeT RecordBytes,
+    uint64_t* End
 ) {
-    OffloadResponseRingBuffer* ringBuffer = (OffloadResponseRingBuffer*)BufferAddress;
-
-    //
-    // Align the buffer by cache line size
-    //
-    //
-    size_t ringBufferAddress = (size_t)ringBuffer;
-    while (ringBufferAddress % DDS_CACHE_LINE_SIZE != 0) {
-        ringBufferAddress++;
+    uint64_t tailA = atomic_load_explicit(&RingBuffer->Tail[0], memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&RingBuffer->Synced[1], memory_order_acquire);
+    uint64_t offset = tailA % OFFLOAD_RESPONSE_RING_DATA_BYTES;
+    uint64_t padding = 0;
+    uint64_t bytes = (RecordBytes + OFFLOAD_RESPONSE_RECORD_ALIGNMENT - 1) & ~(uint64_t)(OFFLOAD_RESPONSE_RECORD_ALIGNMENT - 1);
+
+    if (bytes > OFFLOAD_RESPONSE_RING_DATA_BYTES) {
+        return NULL;
+    }
+
+    if (offset + bytes > OFFLOAD_RESPONSE_RING_DATA_BYTES) {
+        padding = OFFLOAD_RESPONSE_RING_DATA_BYTES - offset;
+    }
+
+    if (tailA + padding + bytes - head > OFFLOAD_RESPONSE_RING_DATA_BYTES) {
+        return NULL;
+    }
+
+    if (padding) {
+        *(FileIOSizeT*)(RingBuffer->Buffer + offset) = (FileIOSizeT)padding | OFFLOAD_RESPONSE_SIZE_FLAG_PADDING;
+        offset = 0;
     }
-    ringBuffer = (OffloadResponseRingBuffer*)ringBufferAddress;
 
-    return ringBuffer;
+    *(FileIOSizeT*)(RingBuffer->Buffer + offset) = (FileIOSizeT)bytes;
+    *End = tailA + padding + bytes;
+    atomic_store_explicit(&RingBuffer->Tail[0], *End, memory_order_relaxed);
+
+    return RingBuffer->Buffer + offset;
 }
 
 //
-// Deallocate a response queue buffer object
+// Release the records of a ring up to End, which must be filled in
 //
 //
 void
-DellocateOffloadResponseBuffer(
-    OffloadResponseRingBuffer* RingBuffer
+CompleteOffloadResponses(
+    OffloadResponseRingBuffer* RingBuffer,
+    uint64_t End
 ) {
-    memset(RingBuffer, 0, sizeof(OffloadResponseRingBuffer));
-}
\ No newline at end of file
+    atomic_store_explicit(&RingBuffer->Tail[1], End, memory_order_release);
+}
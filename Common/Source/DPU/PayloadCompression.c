@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <string.h>
+
+#include "PayloadCompression.h"
+
+//
+// Limits of the LZ4 block format: a match spans at least PAYLOAD_COMPRESSION_MIN_MATCH bytes
+// and reaches back at most PAYLOAD_COMPRESSION_MAX_OFFSET bytes, the last match starts
+// at least PAYLOAD_COMPRESSION_MATCH_LIMIT bytes before the end of the block,
+// and its last PAYLOAD_COMPRESSION_LAST_LITERALS bytes are always literals
+//
+//
+#define PAYLOAD_COMPRESSION_MIN_MATCH 4
+#define PAYLOAD_COMPRESSION_MAX_OFFSET 65535
+#define PAYLOAD_COMPRESSION_MATCH_LIMIT 12
+#define PAYLOAD_COMPRESSION_LAST_LITERALS 5
+
+static inline uint32_t
+Read32(
+    const uint8_t* Source
+) {
+    uint32_t value;
+    memcpy(&value, Source, sizeof(value));
+    return value;
+}
+
+static inline uint32_t
+Hash32(
+    uint32_t Value
+) {
+    return (Value * 2654435761U) >> (32 - PAYLOAD_COMPRESSION_HASH_BITS);
+}
+
+//
+// Write a length that does not fit into its 4 bits of the token
+//
+//
+static inline uint8_t*
+EmitLength(
+    uint8_t* Out,
+    FileIOSizeT Length
+) {
+    for (Length -= 15; Length >= 255; Length -= 255) {
+        *Out++ = 255;
+    }
+    *Out++ = (uint8_t)Length;
+
+    return Out;
+}
+
+//
+// Write a sequence of literals followed by a match, or by nothing if this is the last sequence;
+// return 0 if the sequence would not fit
+//
+//
+static inline int
+EmitSequence(
+    uint8_t** Out,
+    const uint8_t* OutEnd,
+    const uint8_t* Literals,
+    FileIOSizeT LiteralBytes,
+    FileIOSizeT Offset,
+    FileIOSizeT MatchBytes
+) {
+    uint8_t* out = *Out;
+    size_t needed = 1 + LiteralBytes / 255 + 1 + LiteralBytes;
+    if (Offset) {
+        needed += 2 + MatchBytes / 255 + 1;
+    }
+
+    if ((size_t)(OutEnd - out) < needed) {
+        return 0;
+    }
+
+    uint8_t* token = out++;
+    *token = (uint8_t)((LiteralBytes >= 15 ? 15 : LiteralBytes) << 4);
+    if (LiteralBytes >= 15) {
+        out = EmitLength(out, LiteralBytes);
+    }
+
+    memcpy(out, Literals, LiteralBytes);
+    out += LiteralBytes;
+
+    if (Offset) {
+        MatchBytes -= PAYLOAD_COMPRESSION_MIN_MATCH;
+        *out++ = (uint8_t)Offset;
+        *out++ = (uint8_t)(Offset >> 8);
+        *token |= (uint8_t)(MatchBytes >= 15 ? 15 : MatchBytes);
+        if (MatchBytes >= 15) {
+            out = EmitLength(out, MatchBytes);
+        }
+    }
+
+    *Out = out;
+
+    return 1;
+}
+
+//
+// Compress a payload as an LZ4 block
+//
+//
+FileIOSizeT
+CompressPayload(
+    const char* Source,
+    FileIOSizeT SourceBytes,
+    char* Dest,
+    FileIOSizeT DestCapacity,
+    uint32_t* HashTable
+) {
+    const uint8_t* source = (const uint8_t*)Source;
+    uint8_t* out = (uint8_t*)Dest;
+    const uint8_t* outEnd = out + DestCapacity;
+    FileIOSizeT anchor = 0;
+    FileIOSizeT position = 0;
+
+    //
+    // Entries hold positions plus one, so that zero means empty
+    //
+    //
+    memset(HashTable, 0, PAYLOAD_COMPRESSION_HASH_ENTRIES * sizeof(uint32_t));
+
+    if (SourceBytes > PAYLOAD_COMPRESSION_MATCH_LIMIT) {
+        FileIOSizeT lastMatchStart = SourceBytes - PAYLOAD_COMPRESSION_MATCH_LIMIT;
+        FileIOSizeT lastMatchEnd = SourceBytes - PAYLOAD_COMPRESSION_LAST_LITERALS;
+
+        while (position <= lastMatchStart) {
+            uint32_t sequence = Read32(source + position);
+            uint32_t* entry = &HashTable[Hash32(sequence)];
+            FileIOSizeT candidate = *entry;
+            *entry = position + 1;
+
+            if (candidate == 0 || position - (candidate - 1) > PAYLOAD_COMPRESSION_MAX_OFFSET ||
+                Read32(source + candidate - 1) != sequence) {
+                position++;
+                continue;
+            }
+
+            FileIOSizeT match = candidate - 1;
+            FileIOSizeT matchEnd = position + PAYLOAD_COMPRESSION_MIN_MATCH;
+            while (matchEnd < lastMatchEnd && source[matchEnd] == source[match + (matchEnd - position)]) {
+                matchEnd++;
+            }
+
+            if (!EmitSequence(&out, outEnd, source + anchor, position - anchor, position - match, matchEnd - position)) {
+                return 0;
+            }
+
+            position = matchEnd;
+            anchor = position;
+        }
+    }
+
+    if (!EmitSequence(&out, outEnd, source + anchor, SourceBytes - anchor, 0, 0)) {
+        return 0;
+    }
+
+    return (FileIOSizeT)(out - (uint8_t*)Dest);
+}
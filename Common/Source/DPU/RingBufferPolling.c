@@ -12,25 +12,26 @@
 // Initialize a buffer
 //
 //
-void
+int
 InitializeRequestRingBufferBackEnd(
     struct RequestRingBufferBackEnd* RingBuffer,
     uint64_t RemoteAddr,
     uint32_t AccessToken,
-    uint32_t Capacity
+    uint32_t Capacity,
+    uint32_t RingBytes
 ) {
     memset(RingBuffer, 0, sizeof(struct RequestRingBufferBackEnd));
     RingBuffer->RemoteAddr = RemoteAddr;
     RingBuffer->AccessToken = AccessToken;
-    RingBuffer->Capacity = Capacity;
+    RingBuffer->Capacity = RingBytes;
     RingBuffer->Head = 0;
 
     //
-    // Align the buffer by cache line size
+    // Align the buffer as the host does, so that its meta data has a page of its own
     //
     //
     uint64_t ringBufferAddress = (uint64_t)RingBuffer->RemoteAddr;
-    while (ringBufferAddress % DDS_CACHE_LINE_SIZE != 0) {
+    while (ringBufferAddress % DDS_RING_ALIGNMENT != 0) {
         ringBufferAddress++;
     }
 
@@ -45,23 +46,25 @@ InitializeRequestRingBufferBackEnd(
     // Only write the head int
     //
     //
-    RingBuffer->WriteMetaAddr = ringBufferAddress + RingBuffer->ReadMetaSize;
+    RingBuffer->WriteMetaAddr = ringBufferAddress + DDS_RING_HEAD_OFFSET;
     RingBuffer->WriteMetaSize = sizeof(int);
 
     //
-    // The data is after the meta data
+    // The data is on the page after the meta data
     //
     //
-    RingBuffer->DataBaseAddr = ringBufferAddress + DDS_CACHE_LINE_SIZE * 3;
+    RingBuffer->DataBaseAddr = ringBufferAddress + DDS_RING_META_BYTES;
 
     //
     // Check if the buffer is large enough
-    // The error can be better handled by notifying the host
     //
     //
-    if (RingBuffer->DataBaseAddr + DDS_REQUEST_RING_BYTES > RemoteAddr + Capacity) {
+    if (RingBuffer->DataBaseAddr + RingBytes > RemoteAddr + Capacity) {
         fprintf(stderr, "%s [error]: Not enough space for request ring\n", __func__);
+        return -1;
     }
+
+    return 0;
 }
 
 //
@@ -78,7 +81,7 @@ InitializeRequestRingBufferNotAlignedBackEnd(
     memset(RingBuffer, 0, sizeof(struct RequestRingBufferBackEnd));
     RingBuffer->RemoteAddr = RemoteAddr;
     RingBuffer->AccessToken = AccessToken;
-    RingBuffer->Capacity = Capacity;
+    RingBuffer->Capacity = DDS_REQUEST_RING_BYTES;
     RingBuffer->Head = 0;
 
     uint64_t ringBufferAddress = (uint64_t)RingBuffer->RemoteAddr;
@@ -127,7 +130,7 @@ InitializeRequestRingBufferFaRMStyleBackEnd(
     memset(RingBuffer, 0, sizeof(struct RequestRingBufferBackEnd));
     RingBuffer->RemoteAddr = RemoteAddr;
     RingBuffer->AccessToken = AccessToken;
-    RingBuffer->Capacity = Capacity;
+    RingBuffer->Capacity = DDS_REQUEST_RING_BYTES;
     RingBuffer->Head = 0;
 
     uint64_t ringBufferAddress = (uint64_t)RingBuffer->RemoteAddr;
@@ -176,7 +179,7 @@ InitializeRequestRingBufferLockBasedBackEnd(
     memset(RingBuffer, 0, sizeof(struct RequestRingBufferBackEnd));
     RingBuffer->RemoteAddr = RemoteAddr;
     RingBuffer->AccessToken = AccessToken;
-    RingBuffer->Capacity = Capacity;
+    RingBuffer->Capacity = DDS_REQUEST_RING_BYTES;
     RingBuffer->Head = 0;
 
     uint64_t ringBufferAddress = (uint64_t)RingBuffer->RemoteAddr;
@@ -215,27 +218,28 @@ InitializeRequestRingBufferLockBasedBackEnd(
 // Initialize a buffer
 //
 //
-void
+int
 InitializeResponseRingBufferBackEnd(
     struct ResponseRingBufferBackEnd* RingBuffer,
     uint64_t RemoteAddr,
     uint32_t AccessToken,
-    uint32_t Capacity
+    uint32_t Capacity,
+    uint32_t RingBytes
 ) {
     memset(RingBuffer, 0, sizeof(struct ResponseRingBufferBackEnd));
     RingBuffer->RemoteAddr = RemoteAddr;
     RingBuffer->AccessToken = AccessToken;
-    RingBuffer->Capacity = Capacity;
+    RingBuffer->Capacity = RingBytes;
     RingBuffer->TailC = 0;
     RingBuffer->TailB = 0;
     RingBuffer->TailA = 0;
 
-
-    // Align the buffer by cache line size
+    //
+    // Align the buffer as the host does, so that its meta data has a page of its own
     //
     //
     uint64_t ringBufferAddress = (uint64_t)RingBuffer->RemoteAddr;
-    while (ringBufferAddress % DDS_CACHE_LINE_SIZE != 0) {
+    while (ringBufferAddress % DDS_RING_ALIGNMENT != 0) {
         ringBufferAddress++;
     }
 
@@ -250,48 +254,57 @@ InitializeResponseRingBufferBackEnd(
     // Only write the tail int
     //
     //
-    RingBuffer->WriteMetaAddr = ringBufferAddress + RingBuffer->ReadMetaSize;
+    RingBuffer->WriteMetaAddr = ringBufferAddress + DDS_RING_HEAD_OFFSET;
     RingBuffer->WriteMetaSize = sizeof(int);
 
     //
-    // The data is after the meta data
+    // The data is on the page after the meta data
     //
     //
-    RingBuffer->DataBaseAddr = ringBufferAddress + DDS_CACHE_LINE_SIZE * 3;
+    RingBuffer->DataBaseAddr = ringBufferAddress + DDS_RING_META_BYTES;
 
     //
     // Check if the buffer is large enough
-    // The error can be better handled by notifying the host
     //
     //
-    if (RingBuffer->DataBaseAddr + DDS_RESPONSE_RING_BYTES > RemoteAddr + Capacity) {
-        fprintf(stderr, "%s [error]: Not enough space for request ring\n", __func__);
+    if (RingBuffer->DataBaseAddr + RingBytes > RemoteAddr + Capacity) {
+        fprintf(stderr, "%s [error]: Not enough space for response ring\n", __func__);
+        return -1;
     }
+
+    return 0;
 }
 
 //
 // Initialize a buffer for both request and response rings
 //
 //
-void
+int
 InitializeRingBufferBackEnd(
     struct RequestRingBufferBackEnd* RequestRingBuffer,
     struct ResponseRingBufferBackEnd* ResponseRingBuffer,
     uint64_t RemoteAddr,
     uint32_t AccessToken,
-    uint32_t Capacity
+    uint32_t Capacity,
+    uint32_t RequestRingBytes,
+    uint32_t ResponseRingBytes
 ) {
-    InitializeRequestRingBufferBackEnd(
+    int ret = InitializeRequestRingBufferBackEnd(
         RequestRingBuffer,
         RemoteAddr,
         AccessToken,
-        Capacity
+        Capacity,
+        RequestRingBytes
     );
+    if (ret) {
+        return ret;
+    }
     
-    InitializeResponseRingBufferBackEnd(
+    return InitializeResponseRingBufferBackEnd(
         ResponseRingBuffer,
-        RequestRingBuffer->DataBaseAddr + DDS_REQUEST_RING_BYTES,
+        RequestRingBuffer->DataBaseAddr + RequestRingBytes,
         AccessToken,
-        Capacity - (RequestRingBuffer->DataBaseAddr - RemoteAddr) - DDS_REQUEST_RING_BYTES
+        Capacity - (RequestRingBuffer->DataBaseAddr - RemoteAddr) - RequestRingBytes,
+        ResponseRingBytes
     );
 }
@@ -3,21 +3,179 @@
  * Licensed under the MIT License
  */
 
+#include <mutex>
+
 #include "DMABuffer.h"
 
+//
+// The NDSPI implementation; DMABufferVerbs.cpp implements the buffer with libibverbs on Linux
+//
+//
+#ifdef _WIN32
+#ifdef DMA_BUFFER_LOOPBACK
+#include <chrono>
+
+#include "RingBufferProgressive.h"
+
+using namespace DDS_FrontEnd;
+
+static std::atomic<uint64_t> LoopbackLatencyNs(DMA_BUFFER_LOOPBACK_LATENCY_NS);
+#endif
+
+//
+// Enable the privilege that large pages need, once per process
+//
+//
+static bool
+EnableLockMemoryPrivilege() {
+	static int enabled = -1;
+	if (enabled != -1) {
+		return enabled == 1;
+	}
+
+	enabled = 0;
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		return false;
+	}
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+		GetLastError() == ERROR_SUCCESS) {
+		enabled = 1;
+	}
+	CloseHandle(token);
+
+	return enabled == 1;
+}
+
+//
+// The NUMA node to allocate a DMA buffer on
+//
+//
+static DWORD
+DMABufferNumaNode() {
+	if (DMA_BUFFER_NUMA_NODE != DMA_BUFFER_NUMA_NODE_AUTO) {
+		return (DWORD)DMA_BUFFER_NUMA_NODE;
+	}
+
+	PROCESSOR_NUMBER processor;
+	USHORT node;
+	GetCurrentProcessorNumberEx(&processor);
+	if (!GetNumaProcessorNodeEx(&processor, &node) || node == MAXUSHORT) {
+		return 0;
+	}
+
+	return (DWORD)node;
+}
+
+#if DMA_BUFFER_CACHED_REGIONS > 0
+//
+// A released buffer that is still registered to the NIC
+//
+//
+struct CachedRegionT {
+	ULONG LocalAddr;
+	IND2Adapter* Adapter;
+	HANDLE AdapterFileHandle;
+	char* BufferAddress;
+	size_t Capacity;
+	bool LargePages;
+	IND2MemoryRegion* MemRegion;
+};
+
+static std::mutex CachedRegionsLock;
+static CachedRegionT CachedRegions[DMA_BUFFER_CACHED_REGIONS];
+static int NumCachedRegions = 0;
+
+//
+// Take a cached buffer of the given capacity registered through the adapter of the local address
+//
+//
+static bool
+TakeCachedRegion(
+	ULONG LocalAddr,
+	size_t Capacity,
+	CachedRegionT* Region
+) {
+	std::lock_guard<std::mutex> lock(CachedRegionsLock);
+
+	for (int i = 0; i != NumCachedRegions; i++) {
+		if (CachedRegions[i].LocalAddr == LocalAddr && CachedRegions[i].Capacity == Capacity) {
+			*Region = CachedRegions[i];
+			NumCachedRegions--;
+			CachedRegions[i] = CachedRegions[NumCachedRegions];
+
+			//
+			// The cache no longer needs Network Direct once it is empty
+			//
+			//
+			if (NumCachedRegions == 0) {
+				NdCleanup();
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Keep a released buffer registered; return false if the cache is full
+//
+//
+static bool
+PutCachedRegion(
+	const CachedRegionT* Region
+) {
+	std::lock_guard<std::mutex> lock(CachedRegionsLock);
+
+	if (NumCachedRegions == DMA_BUFFER_CACHED_REGIONS) {
+		return false;
+	}
+
+	//
+	// Hold Network Direct up for the cached adapters, past the NdCleanup of the back end bridge
+	//
+	//
+	if (NumCachedRegions == 0 && FAILED(NdStartup())) {
+		return false;
+	}
+
+	CachedRegions[NumCachedRegions] = *Region;
+	NumCachedRegions++;
+
+	return true;
+}
+#endif
+
 DMABuffer::DMABuffer(
 	const char* _BackEndAddr,
 	const unsigned short _BackEndPort,
 	const size_t _Capacity,
-	const int _ClientId
+	const int _ClientId,
+	const PollPriority _Priority,
+	const RingSizeT _RequestRingBytes,
+	const RingSizeT _ResponseRingBytes,
+	const RingProtocolT _RingProtocol,
+	const uint32_t _PollQueueDepth
 ) {
 	//
 	// Record buffer capacity
 	//
 	//
 	Capacity = _Capacity;
+	LargePages = false;
 	ClientId = _ClientId;
 	BufferId = -1;
+	Priority = _Priority;
+	RequestRingBytes = _RequestRingBytes;
+	ResponseRingBytes = _ResponseRingBytes;
+	RingProtocol = _RingProtocol;
+	PollQueueDepth = _PollQueueDepth;
 
 	//
 	// Initialize NDSPI variables
@@ -25,13 +183,41 @@ DMABuffer::DMABuffer(
 	//
 	Adapter = NULL;
 	AdapterFileHandle = NULL;
+	LocalAddr = 0;
 	memset(&Ov, 0, sizeof(Ov));
+	Connector = NULL;
 	CompQ = NULL;
 	QPair = NULL;
 	MemRegion = NULL;
 	MemWindow = NULL;
+	NotifyPending = false;
+	memset(&DisconnectOv, 0, sizeof(DisconnectOv));
+	DisconnectArmed = false;
+	memset(LaneConnectors, 0, sizeof(LaneConnectors));
+	memset(LaneQPairs, 0, sizeof(LaneQPairs));
 	MsgSgl = NULL;
 	memset(MsgBuf, 0, BUFF_MSG_SIZE);
+	MsgMemRegion = NULL;
+	memset(ExternalRegions, 0, sizeof(ExternalRegions));
+	NumExternalRegions = 0;
+	ResumeRequestHead = 0;
+	ResumeResponseTail = 0;
+	NumDetachedRegions = 0;
+	OffloadRingsBase = NULL;
+	OffloadRingsBytes = 0;
+	ConsumedReceives = 0;
+	Lost = false;
+	NextLivenessCheckMs = 0;
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+	DoorbellLock.clear();
+	Doorbells = 0;
+#endif
+#ifdef DMA_BUFFER_LOOPBACK
+	LoopbackThread = NULL;
+	LoopbackStop = false;
+	LoopbackRequests = NULL;
+	LoopbackCompletions = NULL;
+#endif
 
 	BufferAddress = NULL;
 }
@@ -50,6 +236,28 @@ DMABuffer::Allocate(
 	const size_t MaxSge,
 	const size_t InlineThreshold
 ) {
+#ifdef DMA_BUFFER_LOOPBACK
+	//
+	// The loopback back end reads the rings from process memory, which the system zeroes,
+	// and fetches the requests into a copy as the DPU does
+	//
+	//
+	BufferAddress = reinterpret_cast<char*>(VirtualAlloc(NULL, Capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+	LoopbackRequests = (char*)malloc(RequestRingBytes);
+	LoopbackCompletions = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+	if (BufferAddress == nullptr || LoopbackRequests == nullptr || LoopbackCompletions == nullptr) {
+		printf("DMABuffer: failed to allocate a loopback buffer of %llu bytes\n", Capacity);
+		return false;
+	}
+
+	BufferId = 0;
+	LoopbackStop = false;
+	LoopbackThread = new std::thread([this]() { RunLoopback(); });
+	printf("DMABuffer: serving %llu bytes with the loopback back end\n", Capacity);
+
+	return true;
+#endif
+
 	//
 	// Set up RDMA with NDSPI
 	//
@@ -60,25 +268,79 @@ DMABuffer::Allocate(
 		return false;
 	}
 
-	RDMC_OpenAdapter(&Adapter, LocalSock, &AdapterFileHandle, &Ov);
+	//
+	// Reuse a buffer that is still registered from an earlier connection if there is one,
+	// together with its adapter, unless the buffer is reconnected and keeps its own
+	//
+	//
+	bool cached = false;
+	bool kept = BufferAddress != nullptr;
+	LocalAddr = LocalSock->sin_addr.s_addr;
+#if DMA_BUFFER_CACHED_REGIONS > 0
+	CachedRegionT cachedRegion;
+	cached = !kept && TakeCachedRegion(LocalAddr, Capacity, &cachedRegion);
+	if (cached) {
+		Adapter = cachedRegion.Adapter;
+		AdapterFileHandle = cachedRegion.AdapterFileHandle;
+		BufferAddress = cachedRegion.BufferAddress;
+		LargePages = cachedRegion.LargePages;
+		MemRegion = cachedRegion.MemRegion;
+	}
+#endif
+	if (!cached) {
+		RDMC_OpenAdapter(&Adapter, LocalSock, &AdapterFileHandle, &Ov);
+	}
 	RDMC_CreateConnector(Adapter, AdapterFileHandle, &Connector);
 	RDMC_CreateCQ(Adapter, AdapterFileHandle, (DWORD)QueueDepth, &CompQ);
 	RDMC_CreateQueuePair(Adapter, CompQ, (DWORD)QueueDepth, (DWORD)MaxSge, (DWORD)InlineThreshold, &QPair);
 
 	//
-	// Create and register a memory buffer and an additional buffer for messages
+	// Create and register a memory buffer and an additional buffer for messages;
+	// the buffer is NUMA-local and, if possible, backed by large pages,
+	// so that the NIC and the host touch fewer IOTLB and TLB entries;
+	// the memory is zeroed by the system
 	//
 	//
-	BufferAddress = reinterpret_cast<char*>(HeapAlloc(GetProcessHeap(), 0, Capacity));
-	if (BufferAddress == nullptr) {
-		printf("DMABuffer: failed to allocate a buffer of %llu bytes\n", Capacity);
-		return false;
+	unsigned long flags = ND_MR_FLAG_ALLOW_LOCAL_WRITE | ND_MR_FLAG_ALLOW_REMOTE_READ | ND_MR_FLAG_ALLOW_REMOTE_WRITE;
+	if (cached) {
+		//
+		// The rings start out empty, as in a fresh buffer
+		//
+		//
+		memset(BufferAddress, 0, Capacity);
+		printf("DMABuffer: reused a registered buffer of %llu bytes with %s pages\n", Capacity, LargePages ? "large" : "normal");
 	}
-	memset(BufferAddress, 0, Capacity);
+	else if (kept) {
+		//
+		// A reconnected buffer keeps its rings and is only registered with the new adapter
+		//
+		//
+		RDMC_CreateMR(Adapter, AdapterFileHandle, &MemRegion);
+		RDMC_RegisterDataBuffer(MemRegion, BufferAddress, (DWORD)Capacity, flags, &Ov);
+		printf("DMABuffer: registered the buffer of %llu bytes again, keeping its rings\n", Capacity);
+	}
+	else {
+		DWORD numaNode = DMABufferNumaNode();
+#ifdef DMA_BUFFER_LARGE_PAGES
+		SIZE_T largePageBytes = GetLargePageMinimum();
+		if (largePageBytes && EnableLockMemoryPrivilege()) {
+			SIZE_T bytes = (Capacity + largePageBytes - 1) / largePageBytes * largePageBytes;
+			BufferAddress = reinterpret_cast<char*>(VirtualAllocExNuma(GetCurrentProcess(), NULL, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE, numaNode));
+			LargePages = BufferAddress != nullptr;
+		}
+#endif
+		if (BufferAddress == nullptr) {
+			BufferAddress = reinterpret_cast<char*>(VirtualAllocExNuma(GetCurrentProcess(), NULL, Capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, numaNode));
+		}
+		if (BufferAddress == nullptr) {
+			printf("DMABuffer: failed to allocate a buffer of %llu bytes\n", Capacity);
+			return false;
+		}
+		printf("DMABuffer: allocated %llu bytes on NUMA node %lu with %s pages\n", Capacity, numaNode, LargePages ? "large" : "normal");
 	
-	RDMC_CreateMR(Adapter, AdapterFileHandle, &MemRegion);
-	unsigned long flags = ND_MR_FLAG_ALLOW_LOCAL_WRITE | ND_MR_FLAG_ALLOW_REMOTE_READ | ND_MR_FLAG_ALLOW_REMOTE_WRITE;
-	RDMC_RegisterDataBuffer(MemRegion, BufferAddress, (DWORD)Capacity, flags, &Ov);
+		RDMC_CreateMR(Adapter, AdapterFileHandle, &MemRegion);
+		RDMC_RegisterDataBuffer(MemRegion, BufferAddress, (DWORD)Capacity, flags, &Ov);
+	}
 
 	RDMC_CreateMR(Adapter, AdapterFileHandle, &MsgMemRegion);
 	RDMC_RegisterDataBuffer(MsgMemRegion, MsgBuf, BUFF_MSG_SIZE, flags, &Ov);
@@ -110,6 +372,13 @@ DMABuffer::Allocate(
 	msg->ClientId = ClientId;
 	msg->BufferAddress = (uint64_t)BufferAddress;
 	msg->Capacity = (uint32_t)Capacity;
+	msg->Priority = (uint32_t)Priority;
+	msg->RequestRingBytes = RequestRingBytes;
+	msg->ResponseRingBytes = ResponseRingBytes;
+	msg->RingProtocol = RingProtocol;
+	msg->PollQueueDepth = PollQueueDepth;
+	msg->RequestRingHead = ResumeRequestHead;
+	msg->ResponseRingTail = ResumeResponseTail;
 	
 	//
 	// NOTE: translating the token from host encoding to network encoding is necessary for the Linux back end
@@ -127,6 +396,10 @@ DMABuffer::Allocate(
 
 	if (((MsgHeader*)MsgBuf)->MsgId == BUFF_MSG_B2F_RESPOND_ID) {
 		BufferId = ((BuffMsgB2FRespondId*)(MsgBuf + sizeof(MsgHeader)))->BufferId;
+		if (BufferId < 0) {
+			printf("DMABuffer: the back end rejected the buffer\n");
+			return false;
+		}
 		printf("DMABuffer: connected to the back end with assigned buffer id (%d)\n", BufferId);
 	}
 	else {
@@ -134,16 +407,41 @@ DMABuffer::Allocate(
 		return false;
 	}
 
+	//
+	// Connect the lanes to the assigned buffer;
+	// the back end reaches the memory window through them as well,
+	// since windows belong to the adapter rather than to the queue pair they are bound with
+	//
+	//
+	for (int lane = 1; lane != DMA_BUFFER_QUEUE_PAIRS; lane++) {
+		BuffLaneConnPrivData lanePrivData;
+		lanePrivData.ConnType = BUFF_LANE_CONN_PRIV_DATA;
+		lanePrivData.Lane = (uint8_t)lane;
+		lanePrivData.BufferId = (uint16_t)BufferId;
+
+		RDMC_CreateConnector(Adapter, AdapterFileHandle, &LaneConnectors[lane]);
+		RDMC_CreateQueuePair(Adapter, CompQ, (DWORD)QueueDepth, (DWORD)MaxSge, (DWORD)InlineThreshold, &LaneQPairs[lane]);
+		RDMC_Connect(LaneConnectors[lane], LaneQPairs[lane], &Ov, *LocalSock, *BackEndSock, 0, (DWORD)QueueDepth, &lanePrivData, sizeof(lanePrivData));
+		RDMC_CompleteConnect(LaneConnectors[lane], &Ov);
+	}
+	printf("DMABuffer: connected %d queue pair(s) to buffer (%d)\n", DMA_BUFFER_QUEUE_PAIRS, BufferId);
+
 #if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
 	//
 	// Post receives to allow backend to write responses
 	//
 	//
-	for (int i = 0; i != DDS_MAX_COMPLETION_BUFFERING; i++) {
+	for (int i = 0; i != DDS_MAX_COMPLETION_BUFFERING + DMA_BUFFER_RECEIVE_BATCH - 1; i++) {
 		RDMC_PostReceive(QPair, MsgSgl, 1, MSG_CTXT);
 	}
 #endif
 
+	//
+	// Be told when the back end drops the connection
+	//
+	//
+	DisconnectArmed = Connector->NotifyDisconnect(&DisconnectOv) == ND_PENDING;
+
 	//
 	// This buffer is RDMA-accessible from DPU now
 	//
@@ -151,6 +449,97 @@ DMABuffer::Allocate(
 	return true;
 }
 
+//
+// Tear the connection to a back end that has handed over to another one (DDS_RING_HANDOVER_OFFSET) down,
+// without a release, keeping the rings out of the release and the cache, and the application buffers to register again;
+// a buffer that is not connected stays as it is
+//
+//
+void
+DMABuffer::Detach() {
+	if (BufferId < 0) {
+		return;
+	}
+
+	char* rings = BufferAddress;
+	NumDetachedRegions = NumExternalRegions;
+	memcpy(DetachedRegions, ExternalRegions, sizeof(DetachedRegions));
+
+	BufferId = -1;
+	BufferAddress = NULL;
+	Release();
+	BufferAddress = rings;
+}
+
+//
+// Connect a detached buffer to the back end that took over, which resumes the rings where the old one left them
+//
+//
+bool
+DMABuffer::Reconnect(
+	struct sockaddr_in* LocalSock,
+	struct sockaddr_in* BackEndSock,
+	const size_t QueueDepth,
+	const size_t MaxSge,
+	const size_t InlineThreshold,
+	const int _ClientId,
+	const int RequestRingHead,
+	const int ResponseRingTail
+) {
+#ifdef DMA_BUFFER_LOOPBACK
+	//
+	// The loopback back end never hands over
+	//
+	//
+	return false;
+#endif
+
+	ClientId = _ClientId;
+	ConsumedReceives = 0;
+	Lost = false;
+	ResumeRequestHead = RequestRingHead;
+	ResumeResponseTail = ResponseRingTail;
+	bool connected = Allocate(LocalSock, BackEndSock, QueueDepth, MaxSge, InlineThreshold);
+	ResumeRequestHead = 0;
+	ResumeResponseTail = 0;
+	if (!connected) {
+		return false;
+	}
+
+	for (int i = 0; i != NumDetachedRegions; i++) {
+		const ExternalRegionT* region = &DetachedRegions[i];
+		if (region->Base != OffloadRingsBase && !RegisterExternalRegion(region->Base, region->Bytes, region->Readable, region->Device)) {
+			printf("DMABuffer: failed to register an application buffer again\n");
+			return false;
+		}
+	}
+	NumDetachedRegions = 0;
+
+	if (OffloadRingsBase && !BindOffloadResponseRings(OffloadRingsBase, OffloadRingsBytes)) {
+		printf("DMABuffer: failed to bind the offload response rings again\n");
+		return false;
+	}
+
+	printf("DMABuffer: resumed the rings at %d/%d with buffer id (%d)\n", RequestRingHead, ResponseRingTail, BufferId);
+
+	return true;
+}
+
+//
+// Count a consumed notification receive and post the batch again once it is complete;
+// NDSPI posts receives one at a time, so this only keeps the posts off most completions
+//
+//
+void
+DMABuffer::ReplenishReceives() {
+	if (++ConsumedReceives == DMA_BUFFER_RECEIVE_BATCH) {
+		for (int i = 0; i != DMA_BUFFER_RECEIVE_BATCH; i++) {
+			RDMC_PostReceive(QPair, MsgSgl, 1, MSG_CTXT);
+		}
+		ConsumedReceives = 0;
+	}
+}
+
 //
 // Wait for a completion event
 // Not thread-safe
@@ -160,10 +549,279 @@ void
 DMABuffer::WaitForACompletion(
 	bool Blocking
 ) {
-	RDMC_WaitForCompletionAndCheckContext(CompQ, &Ov, MSG_CTXT, Blocking);
-	RDMC_PostReceive(QPair, MsgSgl, 1, MSG_CTXT);
+#ifdef DMA_BUFFER_LOOPBACK
+	WaitForSingleObject(LoopbackCompletions, INFINITE);
+	return;
+#endif
+
+	if (NotifyPending) {
+		//
+		// A timed wait left the CQ notification armed, so wait on that one
+		//
+		//
+		RDMC_WaitForCompletionAndCheckContextWithTimeout(CompQ, &Ov, MSG_CTXT, INFINITE, &NotifyPending);
+	}
+	else {
+		RDMC_WaitForCompletionAndCheckContext(CompQ, &Ov, MSG_CTXT, Blocking);
+	}
+	ReplenishReceives();
+}
+
+//
+// Wait for a completion event for at most TimeoutMs milliseconds;
+// return false if no completion arrived in time;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::WaitForACompletionWithTimeout(
+	DWORD TimeoutMs
+) {
+#ifdef DMA_BUFFER_LOOPBACK
+	return WaitForSingleObject(LoopbackCompletions, TimeoutMs) == WAIT_OBJECT_0;
+#endif
+
+	bool failed = false;
+	if (!RDMC_WaitForCompletionAndCheckContextWithTimeout(CompQ, &Ov, MSG_CTXT, TimeoutMs, &NotifyPending, &failed)) {
+		if (failed) {
+			Lost = true;
+		}
+		return false;
+	}
+	ReplenishReceives();
+
+	return true;
+}
+
+//
+// Check whether the connection to the back end is lost: a completion has failed,
+// or the back end has disconnected, which is looked at every DDS_BACKEND_LIVENESS_CHECK_MS;
+// Thread-safe
+//
+//
+bool
+DMABuffer::ConnectionLost() {
+#ifdef DMA_BUFFER_LOOPBACK
+	return false;
+#endif
+
+	if (Lost.load()) {
+		return true;
+	}
+
+	int64_t now = (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t next = NextLivenessCheckMs.load();
+	if (now < next || !NextLivenessCheckMs.compare_exchange_strong(next, now + DDS_BACKEND_LIVENESS_CHECK_MS)) {
+		return false;
+	}
+
+	if (BufferId >= 0 && DisconnectArmed && Connector->GetOverlappedResult(&DisconnectOv, FALSE) != ND_PENDING) {
+		printf("DMABuffer: the back end has dropped buffer id (%d)\n", BufferId);
+		DisconnectArmed = false;
+		Lost = true;
+	}
+
+	return Lost.load();
+}
+
+//
+// Register an application buffer to the NIC and bind a memory window for it,
+// which the back end can also read if Readable;
+// must not race with I/O on this buffer's queue pair;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::RegisterExternalRegion(
+	char* Base,
+	size_t Bytes,
+	bool Readable,
+	bool Device
+) {
+#ifdef DMA_BUFFER_LOOPBACK
+	//
+	// The loopback back end has no memory windows, so reads are served inline
+	//
+	//
+	return false;
+#endif
+
+	//
+	// NDSPI has no peer memory, so GPU memory cannot be registered
+	//
+	//
+	if (Device) {
+		return false;
+	}
+
+	if (NumExternalRegions == DMA_BUFFER_MAX_EXTERNAL_REGIONS || Bytes == 0 || Bytes > MAXDWORD) {
+		return false;
+	}
+
+	ExternalRegionT* region = &ExternalRegions[NumExternalRegions];
+	unsigned long flags = ND_MR_FLAG_ALLOW_LOCAL_WRITE | ND_MR_FLAG_ALLOW_REMOTE_WRITE;
+	unsigned long bindFlags = ND_OP_FLAG_ALLOW_WRITE;
+	if (Readable) {
+		flags |= ND_MR_FLAG_ALLOW_REMOTE_READ;
+		bindFlags |= ND_OP_FLAG_ALLOW_READ;
+	}
+
+	//
+	// A buffer that cannot be registered is left to the host to copy through, so failures are undone and reported
+	//
+	//
+	if (RDMC_CreateMR(Adapter, AdapterFileHandle, &region->MemRegion, ND_SUCCESS, "Failed to CreateMR", false) != ND_SUCCESS) {
+		region->MemRegion = nullptr;
+		return false;
+	}
+	if (RDMC_RegisterDataBuffer(region->MemRegion, Base, (DWORD)Bytes, flags, &Ov, ND_SUCCESS, "Failed to RegisterDataBuffer", false) != ND_SUCCESS) {
+		region->MemRegion->Release();
+		region->MemRegion = nullptr;
+		return false;
+	}
+	if (RDMC_CreateMW(Adapter, &region->MemWindow, ND_SUCCESS, "Failed to CreateMemoryWindow", false) != ND_SUCCESS) {
+		region->MemWindow = nullptr;
+		region->MemRegion->Deregister(&Ov);
+		region->MemRegion->Release();
+		region->MemRegion = nullptr;
+		return false;
+	}
+	if (RDMC_Bind(QPair, region->MemRegion, region->MemWindow, Base, (DWORD)Bytes, bindFlags, CompQ, &Ov, nullptr, ND_SUCCESS, "Failed to Bind", false) != ND_SUCCESS) {
+		region->MemWindow->Release();
+		region->MemWindow = nullptr;
+		region->MemRegion->Deregister(&Ov);
+		region->MemRegion->Release();
+		region->MemRegion = nullptr;
+		return false;
+	}
+
+	//
+	// NOTE: the token is sent in network encoding, same as the token of the ring buffers
+	//
+	//
+	region->Base = Base;
+	region->Bytes = Bytes;
+	region->Readable = Readable;
+	region->Device = Device;
+	region->AccessToken = htonl(region->MemWindow->GetRemoteToken());
+	NumExternalRegions++;
+
+	return true;
 }
 
+//
+// Release a registered application buffer;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::ReleaseExternalRegion(
+	char* Base
+) {
+	for (int i = 0; i != NumExternalRegions; i++) {
+		ExternalRegionT* region = &ExternalRegions[i];
+		if (region->Base != Base) {
+			continue;
+		}
+
+		region->MemWindow->Release();
+		region->MemRegion->Deregister(&Ov);
+		region->MemRegion->Release();
+
+		NumExternalRegions--;
+		ExternalRegions[i] = ExternalRegions[NumExternalRegions];
+		memset(&ExternalRegions[NumExternalRegions], 0, sizeof(ExternalRegionT));
+
+		return true;
+	}
+
+	return false;
+}
+
+//
+// Find the registered application buffer that covers [Address, Address + Bytes)
+// and return its remote access token, and whether it is a device buffer if Device is given
+//
+//
+bool
+DMABuffer::FindExternalRegion(
+	const char* Address,
+	size_t Bytes,
+	uint32_t* AccessToken,
+	bool* Device
+) const {
+	for (int i = 0; i != NumExternalRegions; i++) {
+		const ExternalRegionT* region = &ExternalRegions[i];
+		if (Address >= region->Base && Address + Bytes <= region->Base + region->Bytes) {
+			*AccessToken = region->AccessToken;
+			if (Device) {
+				*Device = region->Device;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Register the Bytes at Base for the offload response rings of the back end and bind the rings to this buffer;
+// the back end writes the rings there and reads the heads from there until the buffer is released;
+// must not race with I/O on this buffer's queue pair;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::BindOffloadResponseRings(
+	char* Base,
+	size_t Bytes
+) {
+	uint32_t accessToken;
+
+	if (BufferId < 0 || Bytes > UINT32_MAX || !RegisterExternalRegion(Base, Bytes, true) ||
+		!FindExternalRegion(Base, Bytes, &accessToken)) {
+		return false;
+	}
+
+	((MsgHeader*)MsgBuf)->MsgId = BUFF_MSG_F2B_BIND_OFFLOAD_RINGS;
+	BuffMsgF2BBindOffloadRings* msg = (BuffMsgF2BBindOffloadRings*)(MsgBuf + sizeof(MsgHeader));
+	msg->ClientId = ClientId;
+	msg->BufferId = BufferId;
+	msg->Address = (uint64_t)Base;
+	msg->AccessToken = accessToken;
+	msg->Bytes = (uint32_t)Bytes;
+	MsgSgl->BufferLength = sizeof(MsgHeader) + sizeof(BuffMsgF2BBindOffloadRings);
+	RDMC_Send(QPair, MsgSgl, 1, 0, MSG_CTXT);
+	RDMC_WaitForCompletionAndCheckContext(CompQ, &Ov, MSG_CTXT, false);
+
+	OffloadRingsBase = Base;
+	OffloadRingsBytes = Bytes;
+
+	return true;
+}
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+//
+// Ring the doorbell of the request ring with a send without data, whose completion is silent;
+// the loopback back end polls the ring in memory and never parks it
+// Thread-safe
+//
+//
+void
+DMABuffer::RingRequestDoorbell() {
+#ifndef DMA_BUFFER_LOOPBACK
+	while (DoorbellLock.test_and_set(std::memory_order_acquire)) {
+		YieldProcessor();
+	}
+
+	Doorbells++;
+	RDMC_Send(QPair, NULL, 0, ND_OP_FLAG_SILENT_SUCCESS, DOORBELL_CTXT);
+
+	DoorbellLock.clear(std::memory_order_release);
+#endif
+}
+#endif
 
 //
 // Release the allocated buffer;
@@ -172,11 +830,35 @@ DMABuffer::WaitForACompletion(
 //
 void
 DMABuffer::Release() {
+#ifdef DMA_BUFFER_LOOPBACK
+	if (LoopbackThread) {
+		LoopbackStop = true;
+		LoopbackThread->join();
+		delete LoopbackThread;
+		LoopbackThread = NULL;
+	}
+
+	if (LoopbackCompletions) {
+		CloseHandle(LoopbackCompletions);
+		LoopbackCompletions = NULL;
+	}
+
+	free(LoopbackRequests);
+	LoopbackRequests = NULL;
+
+	if (BufferAddress) {
+		VirtualFree(BufferAddress, 0, MEM_RELEASE);
+		BufferAddress = NULL;
+	}
+
+	return;
+#endif
+
 	//
 	// Send the exit message to the back end
 	//
 	//
-	if (BufferId >= 0) {
+	if (BufferId >= 0 && !Lost) {
 		((MsgHeader*)MsgBuf)->MsgId = BUFF_MSG_F2B_RELEASE;
 		BuffMsgF2BRelease* msg = (BuffMsgF2BRelease*)(MsgBuf + sizeof(MsgHeader));
 		msg->ClientId = ClientId;
@@ -188,40 +870,100 @@ DMABuffer::Release() {
 	}
 
 	//
-	// Disconnect and release all resources
+	// Disconnect and release all resources, the lanes first
 	//
 	//
+	for (int lane = 1; lane != DMA_BUFFER_QUEUE_PAIRS; lane++) {
+		if (LaneConnectors[lane]) {
+			LaneConnectors[lane]->Disconnect(&Ov);
+			LaneConnectors[lane]->Release();
+			LaneConnectors[lane] = NULL;
+		}
+
+		if (LaneQPairs[lane]) {
+			LaneQPairs[lane]->Release();
+			LaneQPairs[lane] = NULL;
+		}
+	}
+
 	if (Connector) {
+		if (DisconnectArmed) {
+			Connector->CancelOverlappedRequests();
+			DisconnectArmed = false;
+		}
 		Connector->Disconnect(&Ov);
+		Connector->Release();
+		Connector = NULL;
 	}
 
+#if DMA_BUFFER_CACHED_REGIONS > 0
+	//
+	// Keep the buffer registered for the next connection, which keeps its adapter open too;
+	// the memory window goes away with the queue pair below, so the back end can no longer reach it
+	//
+	//
+	if (MemRegion && BufferAddress) {
+		CachedRegionT region;
+		region.LocalAddr = LocalAddr;
+		region.Adapter = Adapter;
+		region.AdapterFileHandle = AdapterFileHandle;
+		region.BufferAddress = BufferAddress;
+		region.Capacity = Capacity;
+		region.LargePages = LargePages;
+		region.MemRegion = MemRegion;
+		if (PutCachedRegion(&region)) {
+			Adapter = NULL;
+			AdapterFileHandle = NULL;
+			BufferAddress = NULL;
+			MemRegion = NULL;
+		}
+	}
+#endif
+
 	if (MemRegion) {
 		MemRegion->Deregister(&Ov);
 		MemRegion->Release();
+		MemRegion = NULL;
 	}
 
 	if (MemWindow) {
 		MemWindow->Release();
+		MemWindow = NULL;
+	}
+
+	if (MsgMemRegion) {
+		MsgMemRegion->Deregister(&Ov);
+		MsgMemRegion->Release();
+		MsgMemRegion = NULL;
+	}
+
+	while (NumExternalRegions) {
+		ReleaseExternalRegion(ExternalRegions[0].Base);
 	}
 
 	if (CompQ) {
 		CompQ->Release();
+		CompQ = NULL;
 	}
 
 	if (QPair) {
 		QPair->Release();
+		QPair = NULL;
 	}
 	
 	if (AdapterFileHandle) {
 		CloseHandle(AdapterFileHandle);
+		AdapterFileHandle = NULL;
 	}
 
 	if (Adapter) {
 		Adapter->Release();
+		Adapter = NULL;
 	}
 
 	if (Ov.hEvent) {
 		CloseHandle(Ov.hEvent);
+		Ov.hEvent = NULL;
 	}
 
 	//
@@ -230,9 +972,181 @@ DMABuffer::Release() {
 	//
 	if (MsgSgl) {
 		delete[] MsgSgl;
+		MsgSgl = NULL;
 	}
 
 	if (BufferAddress) {
-		HeapFree(GetProcessHeap(), 0, BufferAddress);
+		VirtualFree(BufferAddress, 0, MEM_RELEASE);
+		BufferAddress = NULL;
+	}
+}
+
+#ifdef DMA_BUFFER_LOOPBACK
+//
+// Copy Bytes to an offset of the response ring, wrapping around its end
+//
+//
+static inline void
+CopyToResponseRing(
+	ResponseRingBufferProgressive* Ring,
+	RingSizeT RingBytes,
+	RingSizeT Offset,
+	const void* Source,
+	FileIOSizeT Bytes
+) {
+	FileIOSizeT firstBytes = Offset + Bytes <= RingBytes ? Bytes : RingBytes - Offset;
+
+	memcpy(&Ring->Buffer[Offset], Source, firstBytes);
+	if (firstBytes != Bytes) {
+		memcpy(&Ring->Buffer[0], (const char*)Source + firstBytes, Bytes - firstBytes);
 	}
-}
\ No newline at end of file
+}
+
+//
+// Fill bytes of the response ring, wrapping around its end, as the DMA of read data does
+//
+//
+static inline void
+FillResponseRing(
+	ResponseRingBufferProgressive* Ring,
+	RingSizeT RingBytes,
+	RingSizeT Offset,
+	FileIOSizeT Bytes
+) {
+	FileIOSizeT firstBytes = Offset + Bytes <= RingBytes ? Bytes : RingBytes - Offset;
+
+	memset(&Ring->Buffer[Offset], 0, firstBytes);
+	if (firstBytes != Bytes) {
+		memset(&Ring->Buffer[0], 0, Bytes - firstBytes);
+	}
+}
+
+//
+// Serve the rings of the buffer until LoopbackStop:
+// every fetch of the request ring becomes one response batch laid out as the back end lays it out,
+// i.e., |FileIOSizeT| + |BuffMsgB2FAckHeader| bytes of batch meta data with the size of the batch,
+// followed by the responses, each with its size, its ack and its data padded to the same alignment
+//
+//
+void
+DMABuffer::RunLoopback() {
+	const FileIOSizeT alignment = (FileIOSizeT)(sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+	const RequestIdT requestFlags = (RequestIdT)(BUFF_MSG_REQUEST_FLAG_DIRECT_READ | BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ |
+		BUFF_MSG_REQUEST_FLAG_TRACED | BUFF_MSG_REQUEST_TRACE_TAG_MASK_OF(PollQueueDepth));
+
+	//
+	// The rings are where InitializeRings of the poll puts them
+	//
+	//
+	size_t ringAddress = (size_t)BufferAddress;
+	while (ringAddress % DDS_RING_ALIGNMENT != 0) {
+		ringAddress++;
+	}
+	RequestRingBufferProgressive* requestRing = (RequestRingBufferProgressive*)ringAddress;
+	ringAddress = (size_t)(requestRing->Buffer + RequestRingBytes);
+	while (ringAddress % DDS_RING_ALIGNMENT != 0) {
+		ringAddress++;
+	}
+	ResponseRingBufferProgressive* responseRing = (ResponseRingBufferProgressive*)ringAddress;
+	RingSizeT tail = 0;
+
+	while (!LoopbackStop.load(std::memory_order_relaxed)) {
+		FileIOSizeT requestBytes = 0;
+		if (!FetchFromRequestBufferProgressive(requestRing, LoopbackRequests, &requestBytes)) {
+			YieldProcessor();
+			continue;
+		}
+
+		//
+		// Size the batch before writing it
+		//
+		//
+		FileIOSizeT batchBytes = alignment;
+		BufferT next = LoopbackRequests;
+		FileIOSizeT remaining = requestBytes;
+		while (next && remaining) {
+			BufferT request;
+			FileIOSizeT requestSize;
+			ParseNextRequestProgressive(next, remaining, &request, &requestSize, &next, &remaining);
+
+			BuffMsgF2BReqHeader* header = (BuffMsgF2BReqHeader*)request;
+			if (requestSize > sizeof(BuffMsgF2BReqHeader) && !(header->RequestId & BUFF_MSG_REQUEST_FLAG_DIRECT_READ)) {
+				batchBytes += alignment;
+			}
+			else {
+				batchBytes += (alignment + header->Bytes + alignment - 1) / alignment * alignment;
+			}
+		}
+
+		//
+		// Wait for the simulated DMA, and for the host to free enough of the response ring
+		//
+		//
+		auto ready = std::chrono::steady_clock::now() + std::chrono::nanoseconds(LoopbackLatencyNs.load(std::memory_order_relaxed));
+		while (std::chrono::steady_clock::now() < ready) {
+			YieldProcessor();
+		}
+
+		for (;;) {
+			RingSizeT progress = (RingSizeT)(int)responseRing->Progress[0];
+			RingSizeT used = (tail + ResponseRingBytes - progress) % ResponseRingBytes;
+			if (batchBytes < ResponseRingBytes - used) {
+				break;
+			}
+			if (LoopbackStop.load(std::memory_order_relaxed)) {
+				return;
+			}
+			YieldProcessor();
+		}
+
+		//
+		// Write the responses, then the batch meta data, and publish the tail last
+		//
+		//
+		RingSizeT batchMeta = tail;
+		RingSizeT offset = (tail + alignment) % ResponseRingBytes;
+		next = LoopbackRequests;
+		remaining = requestBytes;
+		while (next && remaining) {
+			BufferT request;
+			FileIOSizeT requestSize;
+			ParseNextRequestProgressive(next, remaining, &request, &requestSize, &next, &remaining);
+
+			BuffMsgF2BReqHeader* header = (BuffMsgF2BReqHeader*)request;
+			bool isWrite = requestSize > sizeof(BuffMsgF2BReqHeader) && !(header->RequestId & BUFF_MSG_REQUEST_FLAG_DIRECT_READ);
+			FileIOSizeT responseSize = isWrite ? alignment : (alignment + header->Bytes + alignment - 1) / alignment * alignment;
+
+			BuffMsgB2FAckHeader ack;
+			ack.RequestId = (RequestIdT)(header->RequestId & ~requestFlags);
+			ack.Result = DDS_ERROR_CODE_SUCCESS;
+			ack.BytesServiced = header->Bytes;
+			CopyToResponseRing(responseRing, ResponseRingBytes, offset, &responseSize, sizeof(FileIOSizeT));
+			CopyToResponseRing(responseRing, ResponseRingBytes, (offset + sizeof(FileIOSizeT)) % ResponseRingBytes, &ack, sizeof(ack));
+			if (!isWrite) {
+				FillResponseRing(responseRing, ResponseRingBytes, (offset + alignment) % ResponseRingBytes, header->Bytes);
+			}
+
+			offset = (offset + responseSize) % ResponseRingBytes;
+		}
+
+		CopyToResponseRing(responseRing, ResponseRingBytes, batchMeta, &batchBytes, sizeof(FileIOSizeT));
+		tail = offset;
+		std::atomic_thread_fence(std::memory_order_release);
+		*(volatile int*)&responseRing->Tail[0] = (int)tail;
+
+		ReleaseSemaphore(LoopbackCompletions, 1, NULL);
+	}
+}
+
+//
+// Set the latency the loopback back end simulates for every request batch, for all buffers
+//
+//
+void
+DMABuffer::SetLoopbackLatency(
+	uint64_t LatencyNs
+) {
+	LoopbackLatencyNs = LatencyNs;
+}
+#endif
+#endif
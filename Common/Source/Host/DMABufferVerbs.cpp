@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include "DMABuffer.h"
+
+//
+// The libibverbs implementation, for hosts on Linux; DMABuffer.cpp implements the buffer with NDSPI on Windows
+//
+//
+#ifndef _WIN32
+#ifdef DMA_BUFFER_LOOPBACK
+#error "The loopback back end is only implemented with NDSPI"
+#endif
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+DMABuffer::DMABuffer(
+	const char* _BackEndAddr,
+	const unsigned short _BackEndPort,
+	const size_t _Capacity,
+	const int _ClientId,
+	const PollPriority _Priority,
+	const RingSizeT _RequestRingBytes,
+	const RingSizeT _ResponseRingBytes,
+	const RingProtocolT _RingProtocol,
+	const uint32_t _PollQueueDepth
+) {
+	//
+	// Record buffer capacity
+	//
+	//
+	Capacity = _Capacity;
+	LargePages = false;
+	ClientId = _ClientId;
+	BufferId = -1;
+	Priority = _Priority;
+	RequestRingBytes = _RequestRingBytes;
+	ResponseRingBytes = _ResponseRingBytes;
+	RingProtocol = _RingProtocol;
+	PollQueueDepth = _PollQueueDepth;
+
+	//
+	// Initialize verbs variables
+	//
+	//
+	CmChannel = NULL;
+	CmId = NULL;
+	PDomain = NULL;
+	CompQ = NULL;
+	MemRegion = NULL;
+	memset(LaneCmChannels, 0, sizeof(LaneCmChannels));
+	memset(LaneCmIds, 0, sizeof(LaneCmIds));
+	MsgSgl = NULL;
+	memset(MsgBuf, 0, BUFF_MSG_SIZE);
+	MsgMemRegion = NULL;
+	memset(ExternalRegions, 0, sizeof(ExternalRegions));
+	NumExternalRegions = 0;
+	ResumeRequestHead = 0;
+	ResumeResponseTail = 0;
+	NumDetachedRegions = 0;
+	OffloadRingsBase = NULL;
+	OffloadRingsBytes = 0;
+	ConsumedReceives = 0;
+	Lost = false;
+	NextLivenessCheckMs = 0;
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+	DoorbellLock.clear();
+	Doorbells = 0;
+#endif
+
+	BufferAddress = NULL;
+}
+
+//
+// Allocate the buffer with the specified capacity
+// and register it to the NIC;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::Allocate(
+	struct sockaddr_in* LocalSock,
+	struct sockaddr_in* BackEndSock,
+	const size_t QueueDepth,
+	const size_t MaxSge,
+	const size_t InlineThreshold
+) {
+	size_t queueDepth = QueueDepth;
+	size_t maxSge = MaxSge;
+
+	//
+	// Connect to the back end; rdma-cm picks the device and the local address that reach it
+	//
+	//
+	uint8_t privData = BUFF_CONN_PRIV_DATA;
+	if (!RDMCVerbs_Connect(BackEndSock, &queueDepth, &maxSge, InlineThreshold, &privData, sizeof(privData),
+		&CmChannel, &CmId, &PDomain, &CompQ)) {
+		printf("DMABuffer: failed to connect to the back end\n");
+		return false;
+	}
+
+	//
+	// Allocate and register a memory buffer and an additional buffer for messages;
+	// the buffer is backed by hugepages if possible, so that the NIC and the host touch fewer IOTLB and TLB entries;
+	// the memory is zeroed by the system; a reconnected buffer keeps its rings and is only registered again
+	//
+	//
+	if (BufferAddress == nullptr) {
+#ifdef DMA_BUFFER_LARGE_PAGES
+		LargePages = true;
+#endif
+		BufferAddress = RDMCVerbs_AllocateBuffer(Capacity, &LargePages);
+		if (BufferAddress == nullptr) {
+			printf("DMABuffer: failed to allocate a buffer of %zu bytes\n", Capacity);
+			return false;
+		}
+		printf("DMABuffer: allocated %zu bytes with %s pages\n", Capacity, LargePages ? "huge" : "normal");
+	}
+
+	MemRegion = ibv_reg_mr(PDomain, BufferAddress, Capacity, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_WRITE);
+	MsgMemRegion = ibv_reg_mr(PDomain, MsgBuf, BUFF_MSG_SIZE, IBV_ACCESS_LOCAL_WRITE);
+	if (!MemRegion || !MsgMemRegion) {
+		printf("DMABuffer: failed to register the buffer\n");
+		return false;
+	}
+
+	MsgSgl = new RDMCVerbsSgeT[1];
+	MsgSgl[0].Buffer = MsgBuf;
+	MsgSgl[0].BufferLength = BUFF_MSG_SIZE;
+	MsgSgl[0].MemoryRegionToken = MsgMemRegion->lkey;
+
+	//
+	// Send buffer address and key to the back end
+	// Wait for response, whose receive is posted first since verbs has no retry window for it
+	//
+	//
+	RDMCVerbs_PostReceive(CmId, MsgSgl, MSG_CTXT);
+
+	((MsgHeader*)MsgBuf)->MsgId = BUFF_MSG_F2B_REQUEST_ID;
+	BuffMsgF2BRequestId* msg = (BuffMsgF2BRequestId*)(MsgBuf + sizeof(MsgHeader));
+	msg->ClientId = ClientId;
+	msg->BufferAddress = (uint64_t)BufferAddress;
+	msg->Capacity = (uint32_t)Capacity;
+	msg->Priority = (uint32_t)Priority;
+	msg->RequestRingBytes = RequestRingBytes;
+	msg->ResponseRingBytes = ResponseRingBytes;
+	msg->RingProtocol = RingProtocol;
+	msg->PollQueueDepth = PollQueueDepth;
+	msg->RequestRingHead = ResumeRequestHead;
+	msg->ResponseRingTail = ResumeResponseTail;
+
+	//
+	// NOTE: verbs keys are in host encoding already, which is what the back end expects
+	//
+	//
+	msg->AccessToken = MemRegion->rkey;
+	MsgSgl->BufferLength = sizeof(MsgHeader) + sizeof(BuffMsgF2BRequestId);
+
+	RDMCVerbs_Send(CmId, MsgSgl, MSG_CTXT);
+	RDMCVerbs_WaitForCompletionAndCheckContext(CompQ, MSG_CTXT, INFINITE, DOORBELL_CTXT);
+	RDMCVerbs_WaitForCompletionAndCheckContext(CompQ, MSG_CTXT, INFINITE, DOORBELL_CTXT);
+	MsgSgl->BufferLength = BUFF_MSG_SIZE;
+
+	if (((MsgHeader*)MsgBuf)->MsgId == BUFF_MSG_B2F_RESPOND_ID) {
+		BufferId = ((BuffMsgB2FRespondId*)(MsgBuf + sizeof(MsgHeader)))->BufferId;
+		if (BufferId < 0) {
+			printf("DMABuffer: the back end rejected the buffer\n");
+			return false;
+		}
+		printf("DMABuffer: connected to the back end with assigned buffer id (%d)\n", BufferId);
+	}
+	else {
+		printf("DMABuffer: wrong message from the back end\n");
+		return false;
+	}
+
+	//
+	// Connect the lanes to the assigned buffer;
+	// the back end reaches the memory region through them as well,
+	// since they are created in the protection domain of the region
+	//
+	//
+	for (int lane = 1; lane != DMA_BUFFER_QUEUE_PAIRS; lane++) {
+		BuffLaneConnPrivData lanePrivData;
+		lanePrivData.ConnType = BUFF_LANE_CONN_PRIV_DATA;
+		lanePrivData.Lane = (uint8_t)lane;
+		lanePrivData.BufferId = (uint16_t)BufferId;
+
+		if (!RDMCVerbs_Connect(BackEndSock, &queueDepth, &maxSge, InlineThreshold, &lanePrivData, sizeof(lanePrivData),
+			&LaneCmChannels[lane], &LaneCmIds[lane], &PDomain, &CompQ)) {
+			printf("DMABuffer: failed to connect lane %d\n", lane);
+			return false;
+		}
+	}
+	printf("DMABuffer: connected %d queue pair(s) to buffer (%d)\n", DMA_BUFFER_QUEUE_PAIRS, BufferId);
+
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+	//
+	// Post receives to allow backend to write responses
+	//
+	//
+	RDMCVerbs_PostReceives(CmId, MsgSgl, MSG_CTXT, DDS_MAX_COMPLETION_BUFFERING + DMA_BUFFER_RECEIVE_BATCH - 1);
+#endif
+
+	//
+	// This buffer is RDMA-accessible from DPU now
+	//
+	//
+	return true;
+}
+
+//
+// Tear the connection to a back end that has handed over to another one (DDS_RING_HANDOVER_OFFSET) down,
+// without a release, keeping the rings out of the release and the cache, and the application buffers to register again;
+// a buffer that is not connected stays as it is
+//
+//
+void
+DMABuffer::Detach() {
+	if (BufferId < 0) {
+		return;
+	}
+
+	char* rings = BufferAddress;
+	NumDetachedRegions = NumExternalRegions;
+	memcpy(DetachedRegions, ExternalRegions, sizeof(DetachedRegions));
+
+	BufferId = -1;
+	BufferAddress = NULL;
+	Release();
+	BufferAddress = rings;
+}
+
+//
+// Connect a detached buffer to the back end that took over, which resumes the rings where the old one left them
+//
+//
+bool
+DMABuffer::Reconnect(
+	struct sockaddr_in* LocalSock,
+	struct sockaddr_in* BackEndSock,
+	const size_t QueueDepth,
+	const size_t MaxSge,
+	const size_t InlineThreshold,
+	const int _ClientId,
+	const int RequestRingHead,
+	const int ResponseRingTail
+) {
+	ClientId = _ClientId;
+	ConsumedReceives = 0;
+	Lost = false;
+	ResumeRequestHead = RequestRingHead;
+	ResumeResponseTail = ResponseRingTail;
+	bool connected = Allocate(LocalSock, BackEndSock, QueueDepth, MaxSge, InlineThreshold);
+	ResumeRequestHead = 0;
+	ResumeResponseTail = 0;
+	if (!connected) {
+		return false;
+	}
+
+	for (int i = 0; i != NumDetachedRegions; i++) {
+		const ExternalRegionT* region = &DetachedRegions[i];
+		if (region->Base != OffloadRingsBase && !RegisterExternalRegion(region->Base, region->Bytes, region->Readable, region->Device)) {
+			printf("DMABuffer: failed to register an application buffer again\n");
+			return false;
+		}
+	}
+	NumDetachedRegions = 0;
+
+	if (OffloadRingsBase && !BindOffloadResponseRings(OffloadRingsBase, OffloadRingsBytes)) {
+		printf("DMABuffer: failed to bind the offload response rings again\n");
+		return false;
+	}
+
+	printf("DMABuffer: resumed the rings at %d/%d with buffer id (%d)\n", RequestRingHead, ResponseRingTail, BufferId);
+
+	return true;
+}
+
+//
+// Count a consumed notification receive and post the batch again once it is complete
+//
+//
+void
+DMABuffer::ReplenishReceives() {
+	if (++ConsumedReceives == DMA_BUFFER_RECEIVE_BATCH) {
+		RDMCVerbs_PostReceives(CmId, MsgSgl, MSG_CTXT, DMA_BUFFER_RECEIVE_BATCH);
+		ConsumedReceives = 0;
+	}
+}
+
+//
+// Wait for a completion event;
+// the completion queue is always busy-polled, so a blocking wait spins as well
+// Not thread-safe
+//
+//
+void
+DMABuffer::WaitForACompletion(
+	bool Blocking
+) {
+	RDMCVerbs_WaitForCompletionAndCheckContext(CompQ, MSG_CTXT, INFINITE, DOORBELL_CTXT);
+	ReplenishReceives();
+}
+
+//
+// Wait for a completion event for at most TimeoutMs milliseconds;
+// return false if no completion arrived in time or the connection is lost;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::WaitForACompletionWithTimeout(
+	DWORD TimeoutMs
+) {
+	bool failed = false;
+	if (!RDMCVerbs_WaitForCompletionAndCheckContext(CompQ, MSG_CTXT, TimeoutMs, DOORBELL_CTXT, &failed)) {
+		if (failed) {
+			Lost = true;
+		}
+		return false;
+	}
+	ReplenishReceives();
+
+	return true;
+}
+
+//
+// Check whether the connection to the back end is lost: a completion has failed,
+// or the back end has disconnected, which is looked at every DDS_BACKEND_LIVENESS_CHECK_MS;
+// Thread-safe
+//
+//
+bool
+DMABuffer::ConnectionLost() {
+	if (Lost.load()) {
+		return true;
+	}
+
+	int64_t now = (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	int64_t next = NextLivenessCheckMs.load();
+	if (now < next || !NextLivenessCheckMs.compare_exchange_strong(next, now + DDS_BACKEND_LIVENESS_CHECK_MS)) {
+		return false;
+	}
+
+	if (BufferId >= 0 && RDMCVerbs_PollDisconnect(CmChannel)) {
+		printf("DMABuffer: the back end has dropped buffer id (%d)\n", BufferId);
+		Lost = true;
+	}
+
+	return Lost.load();
+}
+
+//
+// Register an application buffer to the NIC,
+// which the back end can also read if Readable;
+// the key of its memory region takes the place of a memory window;
+// a Device buffer is registered the same way, the peer memory module of the GPU (nvidia-peermem)
+// pinning its pages for the NIC, and fails to register where the module is not loaded
+// Not thread-safe
+//
+//
+bool
+DMABuffer::RegisterExternalRegion(
+	char* Base,
+	size_t Bytes,
+	bool Readable,
+	bool Device
+) {
+	if (NumExternalRegions == DMA_BUFFER_MAX_EXTERNAL_REGIONS || Bytes == 0 || Bytes > UINT32_MAX) {
+		return false;
+	}
+
+	ExternalRegionT* region = &ExternalRegions[NumExternalRegions];
+	int access = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE;
+	if (Readable) {
+		access |= IBV_ACCESS_REMOTE_READ;
+	}
+
+	region->MemRegion = ibv_reg_mr(PDomain, Base, Bytes, access);
+	if (!region->MemRegion) {
+		return false;
+	}
+
+	region->Base = Base;
+	region->Bytes = Bytes;
+	region->Readable = Readable;
+	region->Device = Device;
+	region->AccessToken = region->MemRegion->rkey;
+	NumExternalRegions++;
+
+	return true;
+}
+
+//
+// Release a registered application buffer;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::ReleaseExternalRegion(
+	char* Base
+) {
+	for (int i = 0; i != NumExternalRegions; i++) {
+		ExternalRegionT* region = &ExternalRegions[i];
+		if (region->Base != Base) {
+			continue;
+		}
+
+		ibv_dereg_mr(region->MemRegion);
+
+		NumExternalRegions--;
+		ExternalRegions[i] = ExternalRegions[NumExternalRegions];
+		memset(&ExternalRegions[NumExternalRegions], 0, sizeof(ExternalRegionT));
+
+		return true;
+	}
+
+	return false;
+}
+
+//
+// Find the registered application buffer that covers [Address, Address + Bytes)
+// and return its remote access token, and whether it is a device buffer if Device is given
+//
+//
+bool
+DMABuffer::FindExternalRegion(
+	const char* Address,
+	size_t Bytes,
+	uint32_t* AccessToken,
+	bool* Device
+) const {
+	for (int i = 0; i != NumExternalRegions; i++) {
+		const ExternalRegionT* region = &ExternalRegions[i];
+		if (Address >= region->Base && Address + Bytes <= region->Base + region->Bytes) {
+			*AccessToken = region->AccessToken;
+			if (Device) {
+				*Device = region->Device;
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//
+// Register the Bytes at Base for the offload response rings of the back end and bind the rings to this buffer;
+// the back end writes the rings there and reads the heads from there until the buffer is released;
+// must not race with I/O on this buffer's queue pair;
+// Not thread-safe
+//
+//
+bool
+DMABuffer::BindOffloadResponseRings(
+	char* Base,
+	size_t Bytes
+) {
+	uint32_t accessToken;
+
+	if (BufferId < 0 || Bytes > UINT32_MAX || !RegisterExternalRegion(Base, Bytes, true) ||
+		!FindExternalRegion(Base, Bytes, &accessToken)) {
+		return false;
+	}
+
+	((MsgHeader*)MsgBuf)->MsgId = BUFF_MSG_F2B_BIND_OFFLOAD_RINGS;
+	BuffMsgF2BBindOffloadRings* msg = (BuffMsgF2BBindOffloadRings*)(MsgBuf + sizeof(MsgHeader));
+	msg->ClientId = ClientId;
+	msg->BufferId = BufferId;
+	msg->Address = (uint64_t)Base;
+	msg->AccessToken = accessToken;
+	msg->Bytes = (uint32_t)Bytes;
+	MsgSgl->BufferLength = sizeof(MsgHeader) + sizeof(BuffMsgF2BBindOffloadRings);
+	RDMCVerbs_Send(CmId, MsgSgl, MSG_CTXT);
+	RDMCVerbs_WaitForCompletionAndCheckContext(CompQ, MSG_CTXT, INFINITE, DOORBELL_CTXT);
+	MsgSgl->BufferLength = BUFF_MSG_SIZE;
+
+	OffloadRingsBase = Base;
+	OffloadRingsBytes = Bytes;
+
+	return true;
+}
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+//
+// Ring the doorbell of the request ring with a send without data;
+// the sends are unsignaled but for every RING_BUFFER_REQUEST_DOORBELL_SIGNAL_INTERVAL-th, which retires them
+// and whose completion the waits for messages skip
+// Thread-safe
+//
+//
+void
+DMABuffer::RingRequestDoorbell() {
+	struct ibv_send_wr wr;
+	struct ibv_send_wr* badWr;
+	memset(&wr, 0, sizeof(wr));
+	wr.wr_id = (uint64_t)DOORBELL_CTXT;
+	wr.sg_list = NULL;
+	wr.num_sge = 0;
+	wr.opcode = IBV_WR_SEND;
+
+	while (DoorbellLock.test_and_set(std::memory_order_acquire)) {
+		YieldProcessor();
+	}
+
+	wr.send_flags = ++Doorbells % RING_BUFFER_REQUEST_DOORBELL_SIGNAL_INTERVAL == 0 ? IBV_SEND_SIGNALED : 0;
+	if (ibv_post_send(CmId->qp, &wr, &badWr)) {
+		printf("DMABuffer: failed to ring the doorbell of buffer (%d)\n", BufferId);
+	}
+
+	DoorbellLock.clear(std::memory_order_release);
+}
+#endif
+
+//
+// Release the allocated buffer;
+// Not thread-safe
+//
+//
+void
+DMABuffer::Release() {
+	//
+	// Send the exit message to the back end
+	//
+	//
+	if (BufferId >= 0 && !Lost) {
+		((MsgHeader*)MsgBuf)->MsgId = BUFF_MSG_F2B_RELEASE;
+		BuffMsgF2BRelease* msg = (BuffMsgF2BRelease*)(MsgBuf + sizeof(MsgHeader));
+		msg->ClientId = ClientId;
+		msg->BufferId = BufferId;
+		MsgSgl->BufferLength = sizeof(MsgHeader) + sizeof(BuffMsgF2BRelease);
+		RDMCVerbs_Send(CmId, MsgSgl, MSG_CTXT);
+		RDMCVerbs_WaitForCompletionAndCheckContext(CompQ, MSG_CTXT, INFINITE, DOORBELL_CTXT);
+		printf("BackEndBridge: released the back end buffer\n");
+	}
+
+	//
+	// Disconnect and release all resources, the lanes first;
+	// the completion queue and the protection domain go last, after every queue pair and region in them
+	//
+	//
+	for (int lane = 1; lane != DMA_BUFFER_QUEUE_PAIRS; lane++) {
+		RDMCVerbs_Disconnect(LaneCmChannels[lane], LaneCmIds[lane], Lost);
+		LaneCmChannels[lane] = NULL;
+		LaneCmIds[lane] = NULL;
+	}
+
+	RDMCVerbs_Disconnect(CmChannel, CmId, Lost);
+	CmChannel = NULL;
+	CmId = NULL;
+
+	if (MemRegion) {
+		ibv_dereg_mr(MemRegion);
+		MemRegion = NULL;
+	}
+
+	if (MsgMemRegion) {
+		ibv_dereg_mr(MsgMemRegion);
+		MsgMemRegion = NULL;
+	}
+
+	while (NumExternalRegions) {
+		ReleaseExternalRegion(ExternalRegions[0].Base);
+	}
+
+	if (CompQ) {
+		ibv_destroy_cq(CompQ);
+		CompQ = NULL;
+	}
+
+	if (PDomain) {
+		ibv_dealloc_pd(PDomain);
+		PDomain = NULL;
+	}
+
+	//
+	// Release memory buffer
+	//
+	//
+	if (MsgSgl) {
+		delete[] MsgSgl;
+		MsgSgl = NULL;
+	}
+
+	if (BufferAddress) {
+		RDMCVerbs_FreeBuffer(BufferAddress, Capacity, LargePages);
+		BufferAddress = NULL;
+	}
+}
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "PayloadCompression.h"
+
+namespace DDS_FrontEnd {
+
+//
+// Shortest match of the LZ4 block format
+//
+//
+#define PAYLOAD_COMPRESSION_MIN_MATCH 4
+
+//
+// Read a length that does not fit into its 4 bits of the token
+//
+//
+static inline bool
+ReadLength(
+    const uint8_t** In,
+    const uint8_t* InEnd,
+    size_t* Length
+) {
+    uint8_t byte;
+
+    do {
+        if (*In == InEnd) {
+            return false;
+        }
+        byte = *(*In)++;
+        *Length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+//
+// Decompress an LZ4 block
+//
+//
+bool
+DecompressPayload(
+    const char* Source,
+    FileIOSizeT SourceBytes,
+    char* Dest,
+    FileIOSizeT DestBytes
+) {
+    const uint8_t* in = (const uint8_t*)Source;
+    const uint8_t* inEnd = in + SourceBytes;
+    uint8_t* out = (uint8_t*)Dest;
+    uint8_t* outEnd = out + DestBytes;
+
+    while (in != inEnd) {
+        uint8_t token = *in++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(&in, inEnd, &literals)) {
+            return false;
+        }
+
+        if ((size_t)(inEnd - in) < literals || (size_t)(outEnd - out) < literals) {
+            return false;
+        }
+        memcpy(out, in, literals);
+        in += literals;
+        out += literals;
+
+        //
+        // The last sequence has no match
+        //
+        //
+        if (in == inEnd) {
+            break;
+        }
+
+        if (inEnd - in < 2) {
+            return false;
+        }
+        size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        if (offset == 0 || offset > (size_t)(out - (uint8_t*)Dest)) {
+            return false;
+        }
+
+        size_t matchBytes = token & 15;
+        if (matchBytes == 15 && !ReadLength(&in, inEnd, &matchBytes)) {
+            return false;
+        }
+        matchBytes += PAYLOAD_COMPRESSION_MIN_MATCH;
+        if ((size_t)(outEnd - out) < matchBytes) {
+            return false;
+        }
+
+        //
+        // A match may overlap the bytes it produces, so copy byte by byte
+        //
+        //
+        const uint8_t* match = out - offset;
+        for (size_t b = 0; b != matchBytes; b++) {
+            out[b] = match[b];
+        }
+        out += matchBytes;
+    }
+
+    return out == outEnd;
+}
+
+}
@@ -67,6 +67,83 @@ void RDMC_WaitForCompletionAndCheckContext(
         }, b_blocking);
 }
 
+// wait for CQ entry and check context, for at most timeout_ms milliseconds (or INFINITE);
+// p_notify_pending tracks a CQ notification that is still armed after a timed-out wait;
+// a failed completion, or a notification that cannot be armed, sets p_failed and returns false
+// if p_failed is given, and exits otherwise
+bool RDMC_WaitForCompletionAndCheckContextWithTimeout(
+    IND2CompletionQueue* p_cq,
+    OVERLAPPED* p_ov,
+    void* expected_context,
+    DWORD timeout_ms,
+    bool* p_notify_pending,
+    bool* p_failed) {
+    ULONGLONG deadline = GetTickCount64() + timeout_ms;
+    for (;;)
+    {
+        ND2_RESULT nd_res;
+        if (p_cq->GetResults(&nd_res, 1) == 1)
+        {
+            if (ND_SUCCESS != nd_res.Status && p_failed)
+            {
+                std::cout << "Unexpected completion status " << std::hex << nd_res.Status << std::dec << std::endl;
+                *p_failed = true;
+                return false;
+            }
+            if (ND_SUCCESS != nd_res.Status)
+            {
+                LogIfErrorExit(nd_res.Status, ND_SUCCESS, "Unexpected completion status", __LINE__);
+            }
+            if (expected_context != nd_res.RequestContext)
+            {
+                std::cout << "Wrong context = " << nd_res.RequestContext << ", expected context = " << expected_context << std::endl;
+                LogErrorExit("Unexpected completion\n", __LINE__);
+            }
+            return true;
+        }
+
+        DWORD wait_ms = INFINITE;
+        if (timeout_ms != INFINITE)
+        {
+            ULONGLONG now = GetTickCount64();
+            if (now >= deadline)
+            {
+                return false;
+            }
+            wait_ms = (DWORD)(deadline - now);
+        }
+
+        if (!*p_notify_pending)
+        {
+            // arm the notification, then check the CQ again for a completion that raced with arming;
+            // a notification that cannot be armed is a failure like a failed completion
+            HRESULT hr = p_cq->Notify(ND_CQ_NOTIFY_ANY, p_ov);
+            if (hr == ND_PENDING)
+            {
+                *p_notify_pending = true;
+            }
+            else if (FAILED(hr) && p_failed)
+            {
+                std::cout << "Failed to arm the CQ notification " << std::hex << hr << std::dec << std::endl;
+                *p_failed = true;
+                return false;
+            }
+            else if (FAILED(hr))
+            {
+                LogIfErrorExit(hr, ND_PENDING, "Failed to arm the CQ notification", __LINE__);
+            }
+            continue;
+        }
+
+        if (WaitForSingleObject(p_ov->hEvent, wait_ms) != WAIT_OBJECT_0)
+        {
+            return false;
+        }
+        p_cq->GetOverlappedResult(p_ov, FALSE);
+        *p_notify_pending = false;
+    }
+}
+
 void RDMC_OpenAdapter(
     IND2Adapter** p_adapter,
     struct sockaddr_in* p_v4_src,
@@ -240,28 +317,46 @@ void RDMC_CreateQueuePairWithSeparateCQ(
     LogIfErrorExit(hr, expected_result, error_message, __LINE__);
 }
 
-void RDMC_CreateMR(
+// exit on an unexpected result, or only report it unless exit_on_error is set
+static HRESULT RDMC_CheckResult(
+    HRESULT hr,
+    HRESULT expected_result,
+    const char* error_message,
+    int line,
+    bool exit_on_error) {
+    if (exit_on_error) {
+        LogIfErrorExit(hr, expected_result, error_message, line);
+    }
+    else if (hr != expected_result) {
+        std::cout << error_message << ": " << std::hex << hr << std::dec << std::endl;
+    }
+    return hr;
+}
+
+HRESULT RDMC_CreateMR(
     IND2Adapter* p_adapter,
     HANDLE h_adapter_file,
     IND2MemoryRegion** pp_mr,
     HRESULT expected_result,
-    const char* error_message) {
+    const char* error_message,
+    bool exit_on_error) {
     HRESULT hr = p_adapter->CreateMemoryRegion(
         IID_IND2MemoryRegion,
         h_adapter_file,
         reinterpret_cast<VOID**>(pp_mr)
     );
-    LogIfErrorExit(hr, expected_result, error_message, __LINE__);
+    return RDMC_CheckResult(hr, expected_result, error_message, __LINE__, exit_on_error);
 }
 
-void RDMC_RegisterDataBuffer(
+HRESULT RDMC_RegisterDataBuffer(
     IND2MemoryRegion* p_mr,
     void* p_buf,
     DWORD buffer_length,
     ULONG type,
     OVERLAPPED* p_ov,
     HRESULT expected_result,
-    const char* error_message) {
+    const char* error_message,
+    bool exit_on_error) {
 #pragma warning(suppress: 6001)
     HRESULT hr = p_mr->Register(
         p_buf,
@@ -272,7 +367,7 @@ void RDMC_RegisterDataBuffer(
     if (hr == ND_PENDING) {
         hr = p_mr->GetOverlappedResult(p_ov, TRUE);
     }
-    LogIfErrorExit(hr, expected_result, error_message, __LINE__);
+    return RDMC_CheckResult(hr, expected_result, error_message, __LINE__, exit_on_error);
 }
 
 void RDMC_Accept(
@@ -303,20 +398,21 @@ void RDMC_Accept(
     LogIfErrorExit(hr, expected_result, error_message, __LINE__);
 }
 
-void RDMC_CreateMW(
+HRESULT RDMC_CreateMW(
     IND2Adapter* p_adapter,
     IND2MemoryWindow** pp_mw,
     HRESULT expected_result,
-    const char* error_message) {
+    const char* error_message,
+    bool exit_on_error) {
     HRESULT hr = p_adapter->CreateMemoryWindow(
         IID_IND2MemoryWindow,
         reinterpret_cast<VOID**>(pp_mw)
     );
 
-    LogIfErrorExit(hr, expected_result, error_message, __LINE__);
+    return RDMC_CheckResult(hr, expected_result, error_message, __LINE__, exit_on_error);
 }
 
-void RDMC_Bind(
+HRESULT RDMC_Bind(
     IND2QueuePair* p_qp,
     IND2MemoryRegion* p_mr,
     IND2MemoryWindow* p_mw,
@@ -327,22 +423,29 @@ void RDMC_Bind(
     OVERLAPPED* p_ov,
     void* context,
     HRESULT expected_result,
-    const char* error_message) {
+    const char* error_message,
+    bool exit_on_error) {
 #pragma warning(suppress: 6001)
     HRESULT hr = p_qp->Bind(context, p_mr, p_mw, p_buf, buffer_length, flags);
-    LogIfErrorExit(hr, expected_result, error_message, __LINE__);
+    if (RDMC_CheckResult(hr, expected_result, error_message, __LINE__, exit_on_error) != expected_result) {
+        return hr;
+    }
 
+    // without exit_on_error, the first completion is the result of the bind
     ND2_RESULT nd_res;
     while (true) {
         RDMC_WaitForCompletion(p_cq, p_ov, &nd_res, true);
-        if (nd_res.Status == expected_result)
+        if (nd_res.Status == expected_result || !exit_on_error)
             break;
     }
-    LogIfErrorExit(nd_res.Status, expected_result, error_message, -1);
+    if (RDMC_CheckResult(nd_res.Status, expected_result, error_message, -1, exit_on_error) != expected_result) {
+        return nd_res.Status;
+    }
     if (nd_res.Status == ND_SUCCESS && nd_res.RequestContext != context)
     {
         LogErrorExit("Invalid context", __LINE__);
     }
+    return nd_res.Status;
 }
 
 void RDMC_Send(
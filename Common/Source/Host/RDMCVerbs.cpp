@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include "RDMCVerbs.h"
+
+#ifndef _WIN32
+#include <algorithm>
+#include <chrono>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+//
+// Wait for the next event of a connection and check that it is the expected one
+//
+//
+static bool
+RDMCVerbs_WaitForCmEvent(
+    struct rdma_event_channel* Channel,
+    enum rdma_cm_event_type ExpectedEvent
+) {
+    struct rdma_cm_event* event;
+
+    if (rdma_get_cm_event(Channel, &event)) {
+        fprintf(stderr, "%s [error]: rdma_get_cm_event failed\n", __func__);
+        return false;
+    }
+
+    enum rdma_cm_event_type type = event->event;
+    int status = event->status;
+    rdma_ack_cm_event(event);
+
+    if (type != ExpectedEvent) {
+        fprintf(stderr, "%s [error]: unexpected event %s (status %d), expected %s\n", __func__,
+            rdma_event_str(type), status, rdma_event_str(ExpectedEvent));
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Resolve the back end, create a queue pair on the device that reaches it, and connect the queue pair
+// with the private data of the connection, lowering the queue depth and the SGEs to what the device allows;
+// the protection domain and the completion queue are created
+// with the first connection if *PDomain is NULL and shared by the connections that pass them in
+//
+//
+bool
+RDMCVerbs_Connect(
+    struct sockaddr_in* BackEndSock,
+    size_t* QueueDepth,
+    size_t* MaxSge,
+    size_t InlineThreshold,
+    const void* PrivData,
+    uint8_t PrivDataBytes,
+    struct rdma_event_channel** Channel,
+    struct rdma_cm_id** CmId,
+    struct ibv_pd** PDomain,
+    struct ibv_cq** CompQ
+) {
+    *Channel = rdma_create_event_channel();
+    if (!*Channel) {
+        fprintf(stderr, "%s [error]: rdma_create_event_channel failed\n", __func__);
+        return false;
+    }
+
+    if (rdma_create_id(*Channel, CmId, NULL, RDMA_PS_TCP)) {
+        fprintf(stderr, "%s [error]: rdma_create_id failed\n", __func__);
+        rdma_destroy_event_channel(*Channel);
+        *Channel = NULL;
+        return false;
+    }
+
+    //
+    // Resolving the address binds the id to the device that reaches the back end
+    //
+    //
+    if (rdma_resolve_addr(*CmId, NULL, (struct sockaddr*)BackEndSock, RDMC_VERBS_RESOLVE_TIMEOUT_MS) ||
+        !RDMCVerbs_WaitForCmEvent(*Channel, RDMA_CM_EVENT_ADDR_RESOLVED) ||
+        rdma_resolve_route(*CmId, RDMC_VERBS_RESOLVE_TIMEOUT_MS) ||
+        !RDMCVerbs_WaitForCmEvent(*Channel, RDMA_CM_EVENT_ROUTE_RESOLVED)) {
+        fprintf(stderr, "%s [error]: failed to resolve the back end\n", __func__);
+        goto DestroyId;
+    }
+
+    struct ibv_device_attr deviceAttr;
+    if (ibv_query_device((*CmId)->verbs, &deviceAttr)) {
+        fprintf(stderr, "%s [error]: ibv_query_device failed\n", __func__);
+        goto DestroyId;
+    }
+
+    //
+    // Every queue pair posts sends and receives to the same completion queue
+    //
+    //
+    *QueueDepth = std::min(*QueueDepth, (size_t)deviceAttr.max_qp_wr);
+    *QueueDepth = std::min(*QueueDepth, (size_t)deviceAttr.max_cqe / 2);
+    *MaxSge = std::min(*MaxSge, (size_t)deviceAttr.max_sge);
+
+    if (!*PDomain) {
+        *PDomain = ibv_alloc_pd((*CmId)->verbs);
+        if (!*PDomain) {
+            fprintf(stderr, "%s [error]: ibv_alloc_pd failed\n", __func__);
+            goto DestroyId;
+        }
+
+        *CompQ = ibv_create_cq((*CmId)->verbs, (int)(*QueueDepth * 2), NULL, NULL, 0);
+        if (!*CompQ) {
+            fprintf(stderr, "%s [error]: ibv_create_cq failed\n", __func__);
+            ibv_dealloc_pd(*PDomain);
+            *PDomain = NULL;
+            goto DestroyId;
+        }
+    }
+
+    struct ibv_qp_init_attr initAttr;
+    memset(&initAttr, 0, sizeof(initAttr));
+    initAttr.send_cq = *CompQ;
+    initAttr.recv_cq = *CompQ;
+    initAttr.qp_type = IBV_QPT_RC;
+    initAttr.cap.max_send_wr = (uint32_t)*QueueDepth;
+    initAttr.cap.max_recv_wr = (uint32_t)*QueueDepth;
+    initAttr.cap.max_send_sge = (uint32_t)*MaxSge;
+    initAttr.cap.max_recv_sge = (uint32_t)*MaxSge;
+    initAttr.cap.max_inline_data = (uint32_t)InlineThreshold;
+    if (rdma_create_qp(*CmId, *PDomain, &initAttr)) {
+        fprintf(stderr, "%s [error]: rdma_create_qp failed\n", __func__);
+        goto DestroyId;
+    }
+
+    //
+    // The back end reads the rings of the host, so take as many inbound reads as the device allows
+    //
+    //
+    struct rdma_conn_param connParam;
+    memset(&connParam, 0, sizeof(connParam));
+    connParam.private_data = PrivData;
+    connParam.private_data_len = PrivDataBytes;
+    connParam.responder_resources = (uint8_t)std::min(deviceAttr.max_qp_rd_atom, 255);
+    connParam.initiator_depth = (uint8_t)std::min(deviceAttr.max_qp_init_rd_atom, 255);
+    connParam.retry_count = 7;
+    connParam.rnr_retry_count = 7;
+    if (rdma_connect(*CmId, &connParam) || !RDMCVerbs_WaitForCmEvent(*Channel, RDMA_CM_EVENT_ESTABLISHED)) {
+        fprintf(stderr, "%s [error]: failed to connect to the back end\n", __func__);
+        rdma_destroy_qp(*CmId);
+        goto DestroyId;
+    }
+
+    return true;
+
+DestroyId:
+    rdma_destroy_id(*CmId);
+    *CmId = NULL;
+    rdma_destroy_event_channel(*Channel);
+    *Channel = NULL;
+
+    return false;
+}
+
+//
+// Disconnect a connection and destroy its queue pair, id and event channel;
+// a connection the peer is known to have dropped (PeerLost) is destroyed without waiting for the disconnect
+//
+//
+void
+RDMCVerbs_Disconnect(
+    struct rdma_event_channel* Channel,
+    struct rdma_cm_id* CmId,
+    bool PeerLost
+) {
+    if (!CmId) {
+        return;
+    }
+
+    if (!PeerLost && !rdma_disconnect(CmId)) {
+        RDMCVerbs_WaitForCmEvent(Channel, RDMA_CM_EVENT_DISCONNECTED);
+    }
+
+    rdma_destroy_qp(CmId);
+    rdma_destroy_id(CmId);
+    rdma_destroy_event_channel(Channel);
+}
+
+//
+// Check without blocking whether the peer of a connection has dropped it, taking the pending events of its channel
+//
+//
+bool
+RDMCVerbs_PollDisconnect(
+    struct rdma_event_channel* Channel
+) {
+    struct pollfd pfd;
+    pfd.fd = Channel->fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    while (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN)) {
+        struct rdma_cm_event* event;
+        if (rdma_get_cm_event(Channel, &event)) {
+            return false;
+        }
+
+        enum rdma_cm_event_type type = event->event;
+        rdma_ack_cm_event(event);
+
+        if (type == RDMA_CM_EVENT_DISCONNECTED || type == RDMA_CM_EVENT_DEVICE_REMOVAL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// Post a signaled send of an entry
+//
+//
+bool
+RDMCVerbs_Send(
+    struct rdma_cm_id* CmId,
+    const RDMCVerbsSgeT* Sge,
+    void* Context
+) {
+    struct ibv_sge sge;
+    sge.addr = (uint64_t)Sge->Buffer;
+    sge.length = Sge->BufferLength;
+    sge.lkey = Sge->MemoryRegionToken;
+
+    struct ibv_send_wr wr;
+    struct ibv_send_wr* badWr;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = (uint64_t)Context;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.opcode = IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED;
+
+    if (ibv_post_send(CmId->qp, &wr, &badWr)) {
+        fprintf(stderr, "%s [error]: ibv_post_send failed\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Post a receive into an entry
+//
+//
+bool
+RDMCVerbs_PostReceive(
+    struct rdma_cm_id* CmId,
+    const RDMCVerbsSgeT* Sge,
+    void* Context
+) {
+    struct ibv_sge sge;
+    sge.addr = (uint64_t)Sge->Buffer;
+    sge.length = Sge->BufferLength;
+    sge.lkey = Sge->MemoryRegionToken;
+
+    struct ibv_recv_wr wr;
+    struct ibv_recv_wr* badWr;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = (uint64_t)Context;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    if (ibv_post_recv(CmId->qp, &wr, &badWr)) {
+        fprintf(stderr, "%s [error]: ibv_post_recv failed\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Post Count receives into the same entry, with a single post for every RDMC_VERBS_RECEIVES_PER_POST of them
+//
+//
+bool
+RDMCVerbs_PostReceives(
+    struct rdma_cm_id* CmId,
+    const RDMCVerbsSgeT* Sge,
+    void* Context,
+    int Count
+) {
+    struct ibv_sge sge;
+    sge.addr = (uint64_t)Sge->Buffer;
+    sge.length = Sge->BufferLength;
+    sge.lkey = Sge->MemoryRegionToken;
+
+    struct ibv_recv_wr wrs[RDMC_VERBS_RECEIVES_PER_POST];
+    struct ibv_recv_wr* badWr;
+    memset(wrs, 0, sizeof(wrs));
+
+    while (Count) {
+        int n = std::min(Count, RDMC_VERBS_RECEIVES_PER_POST);
+        for (int i = 0; i != n; i++) {
+            wrs[i].wr_id = (uint64_t)Context;
+            wrs[i].sg_list = &sge;
+            wrs[i].num_sge = 1;
+            wrs[i].next = i + 1 == n ? NULL : &wrs[i + 1];
+        }
+
+        if (ibv_post_recv(CmId->qp, wrs, &badWr)) {
+            fprintf(stderr, "%s [error]: ibv_post_recv failed\n", __func__);
+            return false;
+        }
+        Count -= n;
+    }
+
+    return true;
+}
+
+//
+// Busy-poll a completion queue for one completion for at most TimeoutMs milliseconds (or INFINITE);
+// return false if none arrived in time, and exit if the completion failed or has another context, as RDMC does,
+// unless Failed is given, which is set instead of exiting on a failed completion;
+// successful completions of SkippedContext, if any, are consumed on the way
+//
+//
+bool
+RDMCVerbs_WaitForCompletionAndCheckContext(
+    struct ibv_cq* CompQ,
+    void* ExpectedContext,
+    DWORD TimeoutMs,
+    void* SkippedContext,
+    bool* Failed
+) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TimeoutMs);
+    struct ibv_wc wc;
+
+    for (;;) {
+        int n = ibv_poll_cq(CompQ, 1, &wc);
+        if (n < 0) {
+            fprintf(stderr, "%s [error]: ibv_poll_cq failed\n", __func__);
+            if (Failed) {
+                *Failed = true;
+                return false;
+            }
+            exit(EXIT_FAILURE);
+        }
+        if (n == 1) {
+            if (SkippedContext && wc.status == IBV_WC_SUCCESS && wc.wr_id == (uint64_t)SkippedContext) {
+                continue;
+            }
+            break;
+        }
+
+        if (TimeoutMs != INFINITE && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        YieldProcessor();
+    }
+
+    if (wc.status != IBV_WC_SUCCESS) {
+        fprintf(stderr, "%s [error]: unexpected completion status %s\n", __func__, ibv_wc_status_str(wc.status));
+        if (Failed) {
+            *Failed = true;
+            return false;
+        }
+        exit(EXIT_FAILURE);
+    }
+    if (wc.wr_id != (uint64_t)ExpectedContext) {
+        fprintf(stderr, "%s [error]: wrong context = %p, expected context = %p\n", __func__, (void*)wc.wr_id, ExpectedContext);
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+}
+
+//
+// Allocate zeroed memory for DMA, backed by hugepages if HugePages is set and they are available,
+// and clear HugePages if they are not
+//
+//
+char*
+RDMCVerbs_AllocateBuffer(
+    size_t Bytes,
+    bool* HugePages
+) {
+    void* buffer = MAP_FAILED;
+
+    //
+    // Pages are populated up front, as the NIC pins them on registration anyway
+    //
+    //
+    if (*HugePages) {
+        size_t bytes = (Bytes + RDMC_VERBS_HUGE_PAGE_BYTES - 1) / RDMC_VERBS_HUGE_PAGE_BYTES * RDMC_VERBS_HUGE_PAGE_BYTES;
+        buffer = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        *HugePages = buffer != MAP_FAILED;
+    }
+
+    if (buffer == MAP_FAILED) {
+        buffer = mmap(NULL, Bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    }
+
+    return buffer == MAP_FAILED ? NULL : (char*)buffer;
+}
+
+//
+// Free memory of RDMCVerbs_AllocateBuffer
+//
+//
+void
+RDMCVerbs_FreeBuffer(
+    char* Buffer,
+    size_t Bytes,
+    bool HugePages
+) {
+    if (HugePages) {
+        Bytes = (Bytes + RDMC_VERBS_HUGE_PAGE_BYTES - 1) / RDMC_VERBS_HUGE_PAGE_BYTES * RDMC_VERBS_HUGE_PAGE_BYTES;
+    }
+
+    munmap(Buffer, Bytes);
+}
+#endif
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include "MsgTypes.h"
 #include "RingBufferProgressive.h"
 
@@ -30,19 +32,21 @@ namespace DDS_FrontEnd {
 //
 RequestRingBufferProgressive*
 AllocateRequestBufferProgressive(
-    BufferT BufferAddress
+    BufferT BufferAddress,
+    RingSizeT Capacity
 ) {
     RequestRingBufferProgressive* ringBuffer = (RequestRingBufferProgressive*)BufferAddress;
 
     //
-    // Align the buffer by cache line size
+    // Align the buffer so that its meta data has a page of its own
     //
     //
     size_t ringBufferAddress = (size_t)ringBuffer;
-    while (ringBufferAddress % DDS_CACHE_LINE_SIZE != 0) {
+    while (ringBufferAddress % DDS_RING_ALIGNMENT != 0) {
         ringBufferAddress++;
     }
     ringBuffer = (RequestRingBufferProgressive*)ringBufferAddress;
+    ringBuffer->Capacity = (int)Capacity;
 
     return ringBuffer;
 }
@@ -55,7 +59,7 @@ void
 DeallocateRequestBufferProgressive(
     RequestRingBufferProgressive* RingBuffer
 ) {
-    memset(RingBuffer, 0, sizeof(RequestRingBufferProgressive));
+    memset(RingBuffer, 0, offsetof(RequestRingBufferProgressive, Buffer) + RingBuffer->Capacity);
 }
 
 //
@@ -77,7 +81,7 @@ InsertToRequestBufferProgressive(
     RingSizeT distance = 0;
 
     if (tail < head) {
-        distance = tail + DDS_REQUEST_RING_BYTES - head;
+        distance = tail + RingBuffer->Capacity - head;
     }
     else {
         distance = tail - head;
@@ -98,11 +102,11 @@ InsertToRequestBufferProgressive(
         return false;
     }
 
-    if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+    if (requestBytes > RingBuffer->Capacity - distance) {
         return false;
     }
 
-    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
 
@@ -114,7 +118,7 @@ InsertToRequestBufferProgressive(
         head = RingBuffer->Head[0];
 
         if (tail <= head) {
-            distance = tail + DDS_REQUEST_RING_BYTES - head;
+            distance = tail + RingBuffer->Capacity - head;
         }
         else {
             distance = tail - head;
@@ -128,7 +132,7 @@ InsertToRequestBufferProgressive(
         // Check space
         //
         //
-        if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+        if (requestBytes > RingBuffer->Capacity - distance) {
             return false;
         }
     }
@@ -137,7 +141,7 @@ InsertToRequestBufferProgressive(
     // Now, both tail and space are good
     //
     //
-    if (tail + sizeof(FileIOSizeT) + RequestSize <= DDS_REQUEST_RING_BYTES) {
+    if (tail + sizeof(FileIOSizeT) + RequestSize <= RingBuffer->Capacity) {
         char* requestAddress = &RingBuffer->Buffer[tail];
 
         //
@@ -157,7 +161,7 @@ InsertToRequestBufferProgressive(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -166,7 +170,7 @@ InsertToRequestBufferProgressive(
         // We need to wrap the buffer around
         //
         //
-        RingSizeT remainingBytes = DDS_REQUEST_RING_BYTES - tail - sizeof(FileIOSizeT);
+        RingSizeT remainingBytes = RingBuffer->Capacity - tail - sizeof(FileIOSizeT);
         char* requestAddress1 = &RingBuffer->Buffer[tail];
         char* requestAddress2 = &RingBuffer->Buffer[0];
 
@@ -190,7 +194,7 @@ InsertToRequestBufferProgressive(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -222,7 +226,7 @@ InsertWriteFileRequest(
     RingSizeT distance = 0;
 
     if (tail < head) {
-        distance = tail + DDS_REQUEST_RING_BYTES - head;
+        distance = tail + RingBuffer->Capacity - head;
     }
     else {
         distance = tail - head;
@@ -244,11 +248,11 @@ InsertWriteFileRequest(
         return false;
     }
 
-    if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+    if (requestBytes > RingBuffer->Capacity - distance) {
         return false;
     }
 
-    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
 
@@ -260,7 +264,7 @@ InsertWriteFileRequest(
         head = RingBuffer->Head[0];
 
         if (tail <= head) {
-            distance = tail + DDS_REQUEST_RING_BYTES - head;
+            distance = tail + RingBuffer->Capacity - head;
         }
         else {
             distance = tail - head;
@@ -270,7 +274,7 @@ InsertWriteFileRequest(
             return false;
         }
 
-        if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+        if (requestBytes > RingBuffer->Capacity - distance) {
             return false;
         }
     }
@@ -279,7 +283,7 @@ InsertWriteFileRequest(
     // Now, both tail and space are good
     //
     //
-    if (tail + sizeof(FileIOSizeT) + requestSize <= DDS_REQUEST_RING_BYTES) {
+    if (tail + sizeof(FileIOSizeT) + requestSize <= RingBuffer->Capacity) {
         char* requestAddress = &RingBuffer->Buffer[tail];
 
         //
@@ -304,7 +308,7 @@ InsertWriteFileRequest(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -313,7 +317,7 @@ InsertWriteFileRequest(
         // We need to wrap the buffer around
         //
         //
-        RingSizeT remainingBytes = DDS_REQUEST_RING_BYTES - tail - sizeof(FileIOSizeT);
+        RingSizeT remainingBytes = RingBuffer->Capacity - tail - sizeof(FileIOSizeT);
         char* requestAddress1 = &RingBuffer->Buffer[tail];
         char* requestAddress2 = &RingBuffer->Buffer[0];
 
@@ -358,7 +362,7 @@ InsertWriteFileRequest(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -390,7 +394,7 @@ InsertWriteFileGatherRequest(
     RingSizeT distance = 0;
 
     if (tail < head) {
-        distance = tail + DDS_REQUEST_RING_BYTES - head;
+        distance = tail + RingBuffer->Capacity - head;
     }
     else {
         distance = tail - head;
@@ -412,11 +416,11 @@ InsertWriteFileGatherRequest(
         return false;
     }
 
-    if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+    if (requestBytes > RingBuffer->Capacity - distance) {
         return false;
     }
 
-    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
 
@@ -428,7 +432,7 @@ InsertWriteFileGatherRequest(
         head = RingBuffer->Head[0];
 
         if (tail <= head) {
-            distance = tail + DDS_REQUEST_RING_BYTES - head;
+            distance = tail + RingBuffer->Capacity - head;
         }
         else {
             distance = tail - head;
@@ -442,7 +446,7 @@ InsertWriteFileGatherRequest(
         // Check space
         //
         //
-        if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+        if (requestBytes > RingBuffer->Capacity - distance) {
             return false;
         }
     }
@@ -451,7 +455,7 @@ InsertWriteFileGatherRequest(
     // Now, both tail and space are good
     //
     //
-    if (tail + sizeof(FileIOSizeT) + requestSize <= DDS_REQUEST_RING_BYTES) {
+    if (tail + sizeof(FileIOSizeT) + requestSize <= RingBuffer->Capacity) {
         char* requestAddress = &RingBuffer->Buffer[tail];
 
         //
@@ -493,7 +497,7 @@ InsertWriteFileGatherRequest(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -502,7 +506,7 @@ InsertWriteFileGatherRequest(
         // We need to wrap the buffer around
         //
         //
-        RingSizeT remainingBytes = DDS_REQUEST_RING_BYTES - tail - sizeof(FileIOSizeT);
+        RingSizeT remainingBytes = RingBuffer->Capacity - tail - sizeof(FileIOSizeT);
         char* requestAddress1 = &RingBuffer->Buffer[tail];
         char* requestAddress2 = &RingBuffer->Buffer[0];
 
@@ -637,7 +641,7 @@ InsertWriteFileGatherRequest(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -668,7 +672,7 @@ InsertReadRequest(
     RingSizeT distance = 0;
 
     if (tail < head) {
-        distance = tail + DDS_REQUEST_RING_BYTES - head;
+        distance = tail + RingBuffer->Capacity - head;
     }
     else {
         distance = tail - head;
@@ -685,11 +689,11 @@ InsertReadRequest(
         return false;
     }
 
-    if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+    if (requestBytes > RingBuffer->Capacity - distance) {
         return false;
     }
 
-    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
 
@@ -701,7 +705,7 @@ InsertReadRequest(
         head = RingBuffer->Head[0];
 
         if (tail <= head) {
-            distance = tail + DDS_REQUEST_RING_BYTES - head;
+            distance = tail + RingBuffer->Capacity - head;
         }
         else {
             distance = tail - head;
@@ -715,7 +719,7 @@ InsertReadRequest(
         // Check space
         //
         //
-        if (requestBytes > DDS_REQUEST_RING_BYTES - distance) {
+        if (requestBytes > RingBuffer->Capacity - distance) {
             return false;
         }
     }
@@ -724,7 +728,7 @@ InsertReadRequest(
     // Now, both tail and space are good
     //
     //
-    if (tail + sizeof(FileIOSizeT) + requestSize <= DDS_REQUEST_RING_BYTES) {
+    if (tail + sizeof(FileIOSizeT) + requestSize <= RingBuffer->Capacity) {
         char* requestAddress = &RingBuffer->Buffer[tail];
 
         //
@@ -748,7 +752,7 @@ InsertReadRequest(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -757,7 +761,7 @@ InsertReadRequest(
         // We need to wrap the buffer around
         //
         //
-        RingSizeT remainingBytes = DDS_REQUEST_RING_BYTES - tail - sizeof(FileIOSizeT);
+        RingSizeT remainingBytes = RingBuffer->Capacity - tail - sizeof(FileIOSizeT);
         char* requestAddress1 = &RingBuffer->Buffer[tail];
         char* requestAddress2 = &RingBuffer->Buffer[0];
 
@@ -786,7 +790,7 @@ InsertReadRequest(
         //
         //
         int progress = RingBuffer->Progress[0];
-        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % DDS_REQUEST_RING_BYTES) == false) {
+        while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
             progress = RingBuffer->Progress[0];
         }
     }
@@ -794,6 +798,578 @@ InsertReadRequest(
     return true;
 }
 
+//
+// Copy bytes into the request buffer at a position, wrapping around if needed;
+// return the position right after the copied bytes
+//
+//
+static inline int
+CopyToRequestBuffer(
+    RequestRingBufferProgressive* RingBuffer,
+    int Position,
+    const void* Source,
+    size_t Bytes
+) {
+    size_t firstBytes = RingBuffer->Capacity - Position;
+
+    if (Bytes <= firstBytes) {
+        memcpy(&RingBuffer->Buffer[Position], Source, Bytes);
+        return (int)((Position + Bytes) % RingBuffer->Capacity);
+    }
+
+    memcpy(&RingBuffer->Buffer[Position], Source, firstBytes);
+    memcpy(&RingBuffer->Buffer[0], (const char*)Source + firstBytes, Bytes - firstBytes);
+
+    return (int)(Bytes - firstBytes);
+}
+
+//
+// Insert a ReadFileScatter request whose data the back end writes directly
+// into the registered destination segments
+//
+//
+bool
+InsertDirectReadRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    uint32_t AccessToken,
+    const BuffMsgDirectReadSegment* Segments,
+    uint32_t NumSegments
+) {
+    //
+    // The request carries the segments instead of data, and the back end
+    // tells it apart from a write by the flag on the request id
+    //
+    //
+    FileIOSizeT segmentBytes = (FileIOSizeT)(NumSegments * sizeof(BuffMsgDirectReadSegment));
+    FileIOSizeT requestSize = sizeof(BuffMsgF2BReqHeader) + sizeof(BuffMsgF2BDirectReadHeader) + segmentBytes;
+
+    //
+    // Check if the tail exceeds the allowable advance
+    //
+    //
+    int tail = RingBuffer->Tail[0];
+    int head = RingBuffer->Head[0];
+    RingSizeT distance = 0;
+
+    if (tail < head) {
+        distance = tail + RingBuffer->Capacity - head;
+    }
+    else {
+        distance = tail - head;
+    }
+
+    //
+    // Append request size to the beginning of the request
+    // Check alignment
+    //
+    //
+    FileIOSizeT requestBytes = sizeof(FileIOSizeT) + requestSize;
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+
+    if (requestBytes % alignment != 0) {
+        requestBytes += (alignment - (requestBytes % alignment));
+    }
+
+    if (distance + requestBytes >= RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT) {
+        return false;
+    }
+
+    if (requestBytes > RingBuffer->Capacity - distance) {
+        return false;
+    }
+
+    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + requestBytes) % RingBuffer->Capacity) == false) {
+        tail = RingBuffer->Tail[0];
+        head = RingBuffer->Head[0];
+
+        if (tail <= head) {
+            distance = tail + RingBuffer->Capacity - head;
+        }
+        else {
+            distance = tail - head;
+        }
+
+        if (distance + requestBytes >= RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT) {
+            return false;
+        }
+
+        if (requestBytes > RingBuffer->Capacity - distance) {
+            return false;
+        }
+    }
+
+    //
+    // Now, both tail and space are good
+    //
+    //
+    BuffMsgF2BReqHeader header;
+    header.RequestId = RequestId | BUFF_MSG_REQUEST_FLAG_DIRECT_READ;
+    header.FileId = FileId;
+    header.Offset = Offset;
+    header.Bytes = Bytes;
+
+    BuffMsgF2BDirectReadHeader directHeader;
+    directHeader.AccessToken = AccessToken;
+    directHeader.NumSegments = NumSegments;
+
+    int cursor = CopyToRequestBuffer(RingBuffer, tail, &requestBytes, sizeof(FileIOSizeT));
+    cursor = CopyToRequestBuffer(RingBuffer, cursor, &header, sizeof(BuffMsgF2BReqHeader));
+    cursor = CopyToRequestBuffer(RingBuffer, cursor, &directHeader, sizeof(BuffMsgF2BDirectReadHeader));
+    CopyToRequestBuffer(RingBuffer, cursor, Segments, segmentBytes);
+
+    //
+    // Increment the progress
+    //
+    //
+    int progress = RingBuffer->Progress[0];
+    while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + requestBytes) % RingBuffer->Capacity) == false) {
+        progress = RingBuffer->Progress[0];
+    }
+
+    return true;
+}
+
+//
+// Reserve Bytes at the tail of the request buffer for requests that are published together;
+// return false if the tail would exceed the allowable advance or the buffer is full
+//
+//
+static inline bool
+ReserveRequestBytes(
+    RequestRingBufferProgressive* RingBuffer,
+    RingSizeT Bytes,
+    int* Position
+) {
+    //
+    // Check if the tail exceeds the allowable advance
+    //
+    //
+    int tail = RingBuffer->Tail[0];
+    int head = RingBuffer->Head[0];
+    RingSizeT distance = 0;
+
+    if (tail < head) {
+        distance = tail + RingBuffer->Capacity - head;
+    }
+    else {
+        distance = tail - head;
+    }
+
+    if (distance + Bytes >= RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT) {
+        return false;
+    }
+
+    if (Bytes > RingBuffer->Capacity - distance) {
+        return false;
+    }
+
+    while (RingBuffer->Tail[0].compare_exchange_weak(tail, (tail + Bytes) % RingBuffer->Capacity) == false) {
+        tail = RingBuffer->Tail[0];
+        head = RingBuffer->Head[0];
+
+        if (tail <= head) {
+            distance = tail + RingBuffer->Capacity - head;
+        }
+        else {
+            distance = tail - head;
+        }
+
+        if (distance + Bytes >= RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT) {
+            return false;
+        }
+
+        if (Bytes > RingBuffer->Capacity - distance) {
+            return false;
+        }
+    }
+
+    *Position = tail;
+
+    return true;
+}
+
+//
+// Publish Bytes written into space reserved by ReserveRequestBytes
+//
+//
+static inline void
+PublishRequestBytes(
+    RequestRingBufferProgressive* RingBuffer,
+    RingSizeT Bytes
+) {
+    int progress = RingBuffer->Progress[0];
+    while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + Bytes) % RingBuffer->Capacity) == false) {
+        progress = RingBuffer->Progress[0];
+    }
+}
+
+//
+// Insert a read of the item of a cache table key, with Bytes the size of the destination
+//
+//
+bool
+InsertKeyReadRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestIdT RequestId,
+    const CacheKeyT* Key,
+    FileIOSizeT Bytes
+) {
+    //
+    // The request carries the key instead of data, and the back end
+    // tells it apart from a write by its file id
+    //
+    //
+    FileIOSizeT requestBytes = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader) + sizeof(CacheKeyT);
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+
+    if (requestBytes % alignment != 0) {
+        requestBytes += (alignment - (requestBytes % alignment));
+    }
+
+    int tail;
+    if (!ReserveRequestBytes(RingBuffer, requestBytes, &tail)) {
+        return false;
+    }
+
+    BuffMsgF2BReqHeader header;
+    header.RequestId = RequestId;
+    header.FileId = BUFF_MSG_REQUEST_FILE_BY_KEY;
+    header.Offset = 0;
+    header.Bytes = Bytes;
+
+    int cursor = CopyToRequestBuffer(RingBuffer, tail, &requestBytes, sizeof(FileIOSizeT));
+    cursor = CopyToRequestBuffer(RingBuffer, cursor, &header, sizeof(BuffMsgF2BReqHeader));
+    CopyToRequestBuffer(RingBuffer, cursor, Key, sizeof(CacheKeyT));
+
+    PublishRequestBytes(RingBuffer, requestBytes);
+
+    return true;
+}
+
+//
+// Insert a scan of Bytes of a file from Offset, with DestBytes the size of the destination
+//
+//
+bool
+InsertScanRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestIdT RequestId,
+    FileSizeT Offset,
+    FileIOSizeT DestBytes,
+    const BuffMsgF2BScanHeader* Scan
+) {
+    //
+    // The request carries the scan instead of data, and the back end
+    // tells it apart from a write by its file id
+    //
+    //
+    FileIOSizeT requestBytes = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader) + sizeof(BuffMsgF2BScanHeader);
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+
+    if (requestBytes % alignment != 0) {
+        requestBytes += (alignment - (requestBytes % alignment));
+    }
+
+    int tail;
+    if (!ReserveRequestBytes(RingBuffer, requestBytes, &tail)) {
+        return false;
+    }
+
+    BuffMsgF2BReqHeader header;
+    header.RequestId = RequestId;
+    header.FileId = BUFF_MSG_REQUEST_FILE_SCAN;
+    header.Offset = Offset;
+    header.Bytes = DestBytes;
+
+    int cursor = CopyToRequestBuffer(RingBuffer, tail, &requestBytes, sizeof(FileIOSizeT));
+    cursor = CopyToRequestBuffer(RingBuffer, cursor, &header, sizeof(BuffMsgF2BReqHeader));
+    CopyToRequestBuffer(RingBuffer, cursor, Scan, sizeof(BuffMsgF2BScanHeader));
+
+    PublishRequestBytes(RingBuffer, requestBytes);
+
+    return true;
+}
+
+//
+// Insert a batch of ReadFile and WriteFile requests into the request buffer
+// with a single tail advancement and a single progress update
+//
+//
+bool
+InsertRequestBatch(
+    RequestRingBufferProgressive* RingBuffer,
+    const RequestBatchEntryT* Requests,
+    int NumRequests
+) {
+    //
+    // Each request is laid out exactly as InsertReadRequest and InsertWriteFileRequest do,
+    // so the back end parses a batch the same way as individually inserted requests
+    //
+    //
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+    RingSizeT batchBytes = 0;
+
+    for (int i = 0; i != NumRequests; i++) {
+        FileIOSizeT requestBytes = alignment;
+        if (!Requests[i].IsRead) {
+            requestBytes += Requests[i].Bytes;
+            if (requestBytes % alignment != 0) {
+                requestBytes += (alignment - (requestBytes % alignment));
+            }
+        }
+        batchBytes += requestBytes;
+    }
+
+    int tail;
+    if (!ReserveRequestBytes(RingBuffer, batchBytes, &tail)) {
+        return false;
+    }
+
+    //
+    // Now, both tail and space are good; write all requests
+    //
+    //
+    int position = tail;
+    for (int i = 0; i != NumRequests; i++) {
+        const RequestBatchEntryT* request = &Requests[i];
+        FileIOSizeT requestBytes = alignment;
+        if (!request->IsRead) {
+            requestBytes += request->Bytes;
+            if (requestBytes % alignment != 0) {
+                requestBytes += (alignment - (requestBytes % alignment));
+            }
+        }
+
+        BuffMsgF2BReqHeader header;
+        header.RequestId = request->RequestId;
+        header.FileId = request->FileId;
+        header.Offset = request->Offset;
+        header.Bytes = request->Bytes;
+
+        int cursor = CopyToRequestBuffer(RingBuffer, position, &requestBytes, sizeof(FileIOSizeT));
+        cursor = CopyToRequestBuffer(RingBuffer, cursor, &header, sizeof(BuffMsgF2BReqHeader));
+        if (!request->IsRead) {
+            CopyToRequestBuffer(RingBuffer, cursor, request->SourceBuffer, request->Bytes);
+        }
+
+        position = (position + requestBytes) % RingBuffer->Capacity;
+    }
+
+    //
+    // Increment the progress
+    //
+    //
+    PublishRequestBytes(RingBuffer, batchBytes);
+
+    return true;
+}
+
+//
+// Publish the staged requests, if any, with the lock of the staging area held
+//
+//
+static bool
+PublishStagedRequests(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging
+) {
+    RingSizeT bytes = Staging->Bytes.load(std::memory_order_relaxed);
+    if (bytes == 0) {
+        return true;
+    }
+
+    int tail;
+    if (!ReserveRequestBytes(RingBuffer, bytes, &tail)) {
+        return false;
+    }
+
+    CopyToRequestBuffer(RingBuffer, tail, Staging->Buffer, bytes);
+    if (Staging->Published) {
+        Staging->Published(Staging->PublishedContext, Staging->RequestIds, Staging->NumRequests);
+    }
+    PublishRequestBytes(RingBuffer, bytes);
+
+    Staging->NumRequests = 0;
+    Staging->Bytes.store(0, std::memory_order_relaxed);
+
+    return true;
+}
+
+//
+// Stage a ReadFile request when SourceBuffer is nullptr and a WriteFile request otherwise
+//
+//
+static bool
+StageRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    BufferT SourceBuffer
+) {
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+    FileIOSizeT requestBytes = alignment;
+
+    if (SourceBuffer) {
+        requestBytes += Bytes;
+        if (requestBytes % alignment != 0) {
+            requestBytes += (alignment - (requestBytes % alignment));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(Staging->Lock);
+    RingSizeT stagedBytes = Staging->Bytes.load(std::memory_order_relaxed);
+
+    //
+    // Publish what is staged first if this request does not fit
+    //
+    //
+    if (stagedBytes && stagedBytes + requestBytes > RING_BUFFER_REQUEST_STAGING_BYTES) {
+        if (!PublishStagedRequests(RingBuffer, Staging)) {
+            return false;
+        }
+        stagedBytes = 0;
+    }
+
+    //
+    // A request larger than the staging area is inserted on its own, after the staged ones
+    //
+    //
+    if (requestBytes > RING_BUFFER_REQUEST_STAGING_BYTES) {
+        return InsertWriteFileRequest(RingBuffer, RequestId, FileId, Offset, Bytes, SourceBuffer);
+    }
+
+    if (!Staging->Buffer) {
+        Staging->Buffer = new char[RING_BUFFER_REQUEST_STAGING_BYTES];
+    }
+
+    BuffMsgF2BReqHeader header;
+    header.RequestId = RequestId;
+    header.FileId = FileId;
+    header.Offset = Offset;
+    header.Bytes = Bytes;
+
+    char* position = &Staging->Buffer[stagedBytes];
+    memcpy(position, &requestBytes, sizeof(FileIOSizeT));
+    memcpy(position + sizeof(FileIOSizeT), &header, sizeof(BuffMsgF2BReqHeader));
+    if (SourceBuffer) {
+        memcpy(position + alignment, SourceBuffer, Bytes);
+    }
+
+    Staging->RequestIds[Staging->NumRequests++] = RequestId;
+    Staging->Bytes.store(stagedBytes + requestBytes);
+
+    //
+    // Reaching the threshold publishes the staged requests; if the ring is full,
+    // they stay staged until the next request or flush
+    //
+    //
+    if (stagedBytes + requestBytes >= RING_BUFFER_REQUEST_STAGING_FLUSH_BYTES) {
+        PublishStagedRequests(RingBuffer, Staging);
+    }
+
+    return true;
+}
+
+//
+// Stage a ReadFile request for the request buffer instead of inserting it
+//
+//
+bool
+StageReadRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    return StageRequest(RingBuffer, Staging, RequestId, FileId, Offset, Bytes, nullptr);
+}
+
+//
+// Stage a WriteFile request for the request buffer instead of inserting it
+//
+//
+bool
+StageWriteFileRequest(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    BufferT SourceBuffer
+) {
+    return StageRequest(RingBuffer, Staging, RequestId, FileId, Offset, Bytes, SourceBuffer);
+}
+
+//
+// Publish the requests staged for the request buffer, by any thread
+//
+//
+bool
+FlushStagedRequests(
+    RequestRingBufferProgressive* RingBuffer,
+    RequestStagingT* Staging
+) {
+    if (Staging->Bytes.load() == 0) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(Staging->Lock);
+
+    return PublishStagedRequests(RingBuffer, Staging);
+}
+
+//
+// Drop the requests staged for a request buffer without publishing them
+//
+//
+void
+DiscardStagedRequests(
+    RequestStagingT* Staging
+) {
+    std::lock_guard<std::mutex> lock(Staging->Lock);
+
+    Staging->NumRequests = 0;
+    Staging->Bytes.store(0);
+}
+
+//
+// The credits the back end has given the host
+//
+//
+RingSizeT
+GetRequestCredits(
+    RequestRingBufferProgressive* RingBuffer
+) {
+    int tail = RingBuffer->Tail[0];
+    int head = RingBuffer->Head[0];
+    RingSizeT distance = tail < head ? tail + RingBuffer->Capacity - head : tail - head;
+    RingSizeT credits = RingBuffer->Capacity - distance;
+
+    //
+    // Insertions also keep the tail within the allowable advance
+    //
+    //
+    if (distance >= RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT) {
+        return 0;
+    }
+
+    if (credits > RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT - distance - 1) {
+        credits = RING_BUFFER_REQUEST_MAXIMUM_TAIL_ADVANCEMENT - distance - 1;
+    }
+
+    return credits;
+}
+
 //
 // Fetch requests from the request buffer
 //
@@ -851,7 +1427,7 @@ FetchFromRequestBufferProgressive(
         sourceBuffer1 = &RingBuffer->Buffer[head];
     }
     else {
-        availBytes = DDS_REQUEST_RING_BYTES - head;
+        availBytes = RingBuffer->Capacity - head;
         *RequestSize = availBytes + progress;
         sourceBuffer1 = &RingBuffer->Buffer[head];
         sourceBuffer2 = &RingBuffer->Buffer[0];
@@ -926,19 +1502,21 @@ CheckForRequestCompletionProgressive(
 //
 ResponseRingBufferProgressive*
 AllocateResponseBufferProgressive(
-    BufferT BufferAddress
+    BufferT BufferAddress,
+    RingSizeT Capacity
 ) {
     ResponseRingBufferProgressive* ringBuffer = (ResponseRingBufferProgressive*)BufferAddress;
 
     //
-    // Align the buffer by cache line size
+    // Align the buffer so that its meta data has a page of its own
     //
     //
     size_t ringBufferAddress = (size_t)ringBuffer;
-    while (ringBufferAddress % DDS_CACHE_LINE_SIZE != 0) {
+    while (ringBufferAddress % DDS_RING_ALIGNMENT != 0) {
         ringBufferAddress++;
     }
     ringBuffer = (ResponseRingBufferProgressive*)ringBufferAddress;
+    ringBuffer->Capacity = (int)Capacity;
 
     return ringBuffer;
 }
@@ -951,7 +1529,7 @@ void
 DeallocateResponseBufferProgressive(
     ResponseRingBufferProgressive* RingBuffer
 ) {
-    memset(RingBuffer, 0, sizeof(ResponseRingBufferProgressive));
+    memset(RingBuffer, 0, offsetof(ResponseRingBufferProgressive, Buffer) + RingBuffer->Capacity);
 }
 
 //
@@ -985,7 +1563,7 @@ FetchFromResponseBufferProgressive(
     // Grab the current head
     //
     //
-    while(RingBuffer->Head[0].compare_exchange_weak(head, (head + responseSize) % DDS_RESPONSE_RING_BYTES) == false) {
+    while(RingBuffer->Head[0].compare_exchange_weak(head, (head + responseSize) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
         responseSize = *(FileIOSizeT*)&RingBuffer->Buffer[head];
@@ -1003,7 +1581,7 @@ FetchFromResponseBufferProgressive(
     // Now, it's safe to copy the response
     //
     //
-    int rTail = (head + responseSize) % DDS_RESPONSE_RING_BYTES;
+    int rTail = (head + responseSize) % RingBuffer->Capacity;
     RingSizeT availBytes = 0;
     char* sourceBuffer1 = nullptr;
     char* sourceBuffer2 = nullptr;
@@ -1014,7 +1592,7 @@ FetchFromResponseBufferProgressive(
         sourceBuffer1 = &RingBuffer->Buffer[head];
     }
     else {
-        availBytes = DDS_RESPONSE_RING_BYTES - head;
+        availBytes = RingBuffer->Capacity - head;
         *ResponseSize = availBytes + rTail;
         sourceBuffer1 = &RingBuffer->Buffer[head];
         sourceBuffer2 = &RingBuffer->Buffer[0];
@@ -1033,7 +1611,7 @@ FetchFromResponseBufferProgressive(
     //
     //
     int progress = RingBuffer->Progress[0];
-    while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + responseSize) % DDS_RESPONSE_RING_BYTES) == false) {
+    while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + responseSize) % RingBuffer->Capacity) == false) {
         progress = RingBuffer->Progress[0];
     }
 
@@ -1074,7 +1652,7 @@ FetchResponse(
     // Grab the current head
     //
     //
-    while(RingBuffer->Head[0].compare_exchange_weak(head, (head + responseSize) % DDS_RESPONSE_RING_BYTES) == false) {
+    while(RingBuffer->Head[0].compare_exchange_weak(head, (head + responseSize) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
         responseSize = *(FileIOSizeT*)&RingBuffer->Buffer[head];
@@ -1097,13 +1675,13 @@ FetchResponse(
     FileIOSizeT offset = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
     
     if (responseSize > offset) {
-        int dataOffset = (head + offset) % DDS_RESPONSE_RING_BYTES;
+        int dataOffset = (head + offset) % RingBuffer->Capacity;
         
         DataBuffer->TotalSize = responseSize - offset;
         DataBuffer->FirstAddr = &RingBuffer->Buffer[dataOffset];
 
-        if (dataOffset + DataBuffer->TotalSize > DDS_RESPONSE_RING_BYTES) {
-            DataBuffer->FirstSize = DDS_RESPONSE_RING_BYTES - dataOffset;
+        if (dataOffset + DataBuffer->TotalSize > RingBuffer->Capacity) {
+            DataBuffer->FirstSize = RingBuffer->Capacity - dataOffset;
             DataBuffer->SecondAddr = &RingBuffer->Buffer[0];
         }
         else {
@@ -1152,7 +1730,7 @@ FetchResponseBatch(
     // Grab the current head
     //
     //
-    while(RingBuffer->Head[0].compare_exchange_weak(head, (head + responseSize) % DDS_RESPONSE_RING_BYTES) == false) {
+    while(RingBuffer->Head[0].compare_exchange_weak(head, (head + responseSize) % RingBuffer->Capacity) == false) {
         tail = RingBuffer->Tail[0];
         head = RingBuffer->Head[0];
         responseSize = *(FileIOSizeT*)&RingBuffer->Buffer[head];
@@ -1172,7 +1750,7 @@ FetchResponseBatch(
     //
     FileIOSizeT batchMetaSize = (FileIOSizeT)(sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
     Responses->TotalSize = responseSize - batchMetaSize;
-    int spillOver = head + (int)batchMetaSize - (int)DDS_RESPONSE_RING_BYTES;
+    int spillOver = head + (int)batchMetaSize - (int)RingBuffer->Capacity;
     if (spillOver >= 0) {
         Responses->FirstAddr = &RingBuffer->Buffer[spillOver];
         Responses->FirstSize = Responses->TotalSize;
@@ -1180,7 +1758,7 @@ FetchResponseBatch(
     else {
         Responses->FirstAddr = &RingBuffer->Buffer[head + batchMetaSize];
 
-        if (head + responseSize > DDS_RESPONSE_RING_BYTES) {
+        if (head + responseSize > RingBuffer->Capacity) {
             Responses->FirstSize = 0 - spillOver;
             Responses->SecondAddr = &RingBuffer->Buffer[0];
         }
@@ -1205,11 +1783,11 @@ IncrementProgress(
 ) {
     int progress = RingBuffer->Progress[0];
 
-    while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + ResponseSize) % DDS_RESPONSE_RING_BYTES) == false) {
+    while (RingBuffer->Progress[0].compare_exchange_weak(progress, (progress + ResponseSize) % RingBuffer->Capacity) == false) {
         progress = RingBuffer->Progress[0];
     }
 
-    DebugPrint("Response progress is incremented by %d. Total progress = %d\n", ResponseSize, (progress + ResponseSize) % DDS_RESPONSE_RING_BYTES);
+    DebugPrint("Response progress is incremented by %d. Total progress = %d\n", ResponseSize, (progress + ResponseSize) % RingBuffer->Capacity);
 }
 
 //
@@ -1252,7 +1830,7 @@ InsertToResponseBufferProgressive(
     RingSizeT distance = 0;
     
     if (tail >= head) {
-        distance = head + DDS_RESPONSE_RING_BYTES - tail;
+        distance = head + RingBuffer->Capacity - tail;
     }
     else {
         distance = head - tail;
@@ -1299,7 +1877,7 @@ InsertToResponseBufferProgressive(
             break;
         }
 
-        if (tail + ResponseSizeList[respIndex] <= DDS_RESPONSE_RING_BYTES) {
+        if (tail + ResponseSizeList[respIndex] <= RingBuffer->Capacity) {
             //
             // Write one response
             // On DPU, these responses should batched and there should be no extra memory copy
@@ -1308,7 +1886,7 @@ InsertToResponseBufferProgressive(
             memcpy(&RingBuffer->Buffer[tail], CopyFromList[respIndex], ResponseSizeList[respIndex]);
         }
         else {
-            FileIOSizeT firstPartBytes = DDS_RESPONSE_RING_BYTES - tail;
+            FileIOSizeT firstPartBytes = RingBuffer->Capacity - tail;
             FileIOSizeT secondPartBytes = ResponseSizeList[respIndex] - firstPartBytes;
 
             //
@@ -1321,7 +1899,7 @@ InsertToResponseBufferProgressive(
         }
         
         totalResponseBytes += responseBytes;
-        tail = (tail + responseBytes) % DDS_RESPONSE_RING_BYTES;
+        tail = (tail + responseBytes) % RingBuffer->Capacity;
     }
 
     if (totalResponseBytes % sizeof(FileIOSizeT) != 0) {
@@ -1352,16 +1930,16 @@ InsertToResponseBufferProgressive(
             break;
         }
 
-        if (tail + sizeof(FileIOSizeT) + ResponseSizeList[respIndex] <= DDS_RESPONSE_RING_BYTES) {
+        if (tail + sizeof(FileIOSizeT) + ResponseSizeList[respIndex] <= RingBuffer->Capacity) {
             //
             // Write one response
             // On DPU, these responses should batched and there should be no extra memory copy
             //
             //
-            memcpy(&RingBuffer->Buffer[(tail + sizeof(FileIOSizeT)) % DDS_RESPONSE_RING_BYTES], CopyFromList[respIndex], ResponseSizeList[respIndex]);
+            memcpy(&RingBuffer->Buffer[(tail + sizeof(FileIOSizeT)) % RingBuffer->Capacity], CopyFromList[respIndex], ResponseSizeList[respIndex]);
         }
         else {
-            FileIOSizeT firstPartBytes = DDS_RESPONSE_RING_BYTES - tail - sizeof(FileIOSizeT);
+            FileIOSizeT firstPartBytes = RingBuffer->Capacity - tail - sizeof(FileIOSizeT);
             FileIOSizeT secondPartBytes = ResponseSizeList[respIndex] - firstPartBytes;
 
             //
@@ -1377,7 +1955,7 @@ InsertToResponseBufferProgressive(
         
         *(FileIOSizeT*)&RingBuffer->Buffer[tail] = responseBytes;
         totalResponseBytes += responseBytes;
-        tail = (tail + responseBytes) % DDS_RESPONSE_RING_BYTES;
+        tail = (tail + responseBytes) % RingBuffer->Capacity;
     }
 #endif
 
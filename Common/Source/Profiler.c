@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Profiler.h"
+
+#ifdef _MSC_VER
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#else
+#define PROFILER_THREAD_LOCAL __thread
+#endif
+
+typedef struct {
+    uint64_t Events;
+    uint64_t Cycles;
+    uint64_t MaxCycles;
+    uint64_t Buckets[PROFILER_BUCKETS];
+} ProfilerRegionStatsT;
+
+typedef struct {
+    uint32_t Index;
+    uint64_t IntervalStart;
+    ProfilerRegionStatsT Regions[PROFILER_MAX_REGIONS];
+} ProfilerThreadT;
+
+static const char* RegionNames[PROFILER_MAX_REGIONS];
+static volatile long NumRegions = 0;
+static volatile long RegistrationLock = 0;
+static ProfilerThreadT* volatile Threads[PROFILER_MAX_THREADS];
+static volatile long NumThreads = 0;
+static PROFILER_THREAD_LOCAL ProfilerThreadT* ThisThread = NULL;
+
+static inline long
+ProfilerIncrement(
+    volatile long* Value
+) {
+#ifdef _MSC_VER
+    return _InterlockedIncrement(Value);
+#else
+    return __sync_add_and_fetch(Value, 1);
+#endif
+}
+
+static inline int
+ProfilerTryLock(
+    volatile long* Lock
+) {
+#ifdef _MSC_VER
+    return _InterlockedCompareExchange(Lock, 1, 0) == 0;
+#else
+    return __sync_bool_compare_and_swap(Lock, 0, 1);
+#endif
+}
+
+static inline void
+ProfilerUnlock(
+    volatile long* Lock
+) {
+#ifdef _MSC_VER
+    _InterlockedExchange(Lock, 0);
+#else
+    __sync_lock_release(Lock);
+#endif
+}
+
+static uint64_t
+ProfilerNowNs(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+double
+ProfilerNsPerCycle(void) {
+    static volatile double nsPerCycle = 0;
+
+    if (nsPerCycle == 0) {
+#if defined(__aarch64__)
+        uint64_t frequency;
+        __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+        nsPerCycle = frequency ? 1e9 / (double)frequency : 1.0;
+#elif defined(_M_X64) || defined(__x86_64__)
+        uint64_t beginNs = ProfilerNowNs();
+        uint64_t beginCycles = ProfilerCycles();
+        uint64_t endNs = beginNs;
+
+        while (endNs - beginNs < PROFILER_CALIBRATION_MILLISECONDS * 1000000ULL) {
+            endNs = ProfilerNowNs();
+        }
+
+        uint64_t cycles = ProfilerCycles() - beginCycles;
+        nsPerCycle = cycles ? (double)(endNs - beginNs) / (double)cycles : 1.0;
+#else
+        nsPerCycle = 1.0;
+#endif
+    }
+
+    return nsPerCycle;
+}
+
+int
+ProfilerRegisterRegion(
+    const char* Name
+) {
+    int region = PROFILER_REGION_INVALID;
+
+    while (!ProfilerTryLock(&RegistrationLock)) {
+    }
+
+    for (long r = 0; r != NumRegions; r++) {
+        if (strcmp(RegionNames[r], Name) == 0) {
+            region = (int)r;
+            break;
+        }
+    }
+
+    if (region == PROFILER_REGION_INVALID && NumRegions != PROFILER_MAX_REGIONS) {
+        RegionNames[NumRegions] = Name;
+        region = (int)NumRegions;
+        NumRegions++;
+    }
+
+    ProfilerUnlock(&RegistrationLock);
+
+    //
+    // Calibrate before anything is timed, not in the middle of it
+    //
+    //
+    ProfilerNsPerCycle();
+
+    return region;
+}
+
+//
+// The bucket of a number of cycles: the power of two below it, and the sub-bucket in that power
+//
+//
+static inline int
+ProfilerBucket(
+    uint64_t Cycles
+) {
+    if (Cycles < PROFILER_SUB_BUCKETS) {
+        return (int)Cycles;
+    }
+
+#ifdef _MSC_VER
+    unsigned long log;
+    _BitScanReverse64(&log, Cycles);
+#else
+    int log = 63 - __builtin_clzll(Cycles);
+#endif
+    int sub = (int)(Cycles >> (log - PROFILER_SUB_BUCKET_BITS)) & (PROFILER_SUB_BUCKETS - 1);
+    return ((int)log - PROFILER_SUB_BUCKET_BITS + 1) * PROFILER_SUB_BUCKETS + sub;
+}
+
+//
+// The highest number of cycles of a bucket
+//
+//
+static inline uint64_t
+ProfilerBucketTop(
+    int Bucket
+) {
+    if (Bucket < PROFILER_SUB_BUCKETS) {
+        return (uint64_t)Bucket;
+    }
+
+    int log = Bucket / PROFILER_SUB_BUCKETS + PROFILER_SUB_BUCKET_BITS - 1;
+    int sub = Bucket % PROFILER_SUB_BUCKETS;
+    uint64_t bottom = (uint64_t)(PROFILER_SUB_BUCKETS + sub) << (log - PROFILER_SUB_BUCKET_BITS);
+    return bottom + (1ULL << (log - PROFILER_SUB_BUCKET_BITS)) - 1;
+}
+
+static uint64_t
+ProfilerPercentile(
+    const ProfilerRegionStatsT* Stats,
+    double Percentile
+) {
+    uint64_t rank = (uint64_t)(Percentile / 100.0 * (double)Stats->Events);
+    uint64_t cumulative = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (int b = 0; b != PROFILER_BUCKETS; b++) {
+        cumulative += Stats->Buckets[b];
+        if (cumulative >= rank) {
+            uint64_t top = ProfilerBucketTop(b);
+            return top < Stats->MaxCycles ? top : Stats->MaxCycles;
+        }
+    }
+
+    return Stats->MaxCycles;
+}
+
+//
+// Print the regions with events of a set of histograms, which cover Seconds
+//
+//
+static void
+ProfilerPrint(
+    FILE* Out,
+    const char* Who,
+    const ProfilerRegionStatsT* Regions,
+    double Seconds
+) {
+    double nsPerCycle = ProfilerNsPerCycle();
+
+    for (long r = 0; r != NumRegions; r++) {
+        const ProfilerRegionStatsT* stats = &Regions[r];
+        if (stats->Events == 0) {
+            continue;
+        }
+
+        if (stats->Cycles == 0) {
+            fprintf(Out, "[profiler] %s %s: %llu events, %.0lf/s\n", Who, RegionNames[r],
+                (unsigned long long)stats->Events, Seconds > 0 ? (double)stats->Events / Seconds : 0.0);
+            continue;
+        }
+
+        fprintf(Out,
+            "[profiler] %s %s: %llu events, %.0lf/s, mean %.0lf ns, p50 %.0lf ns, p99 %.0lf ns, p99.9 %.0lf ns, max %.0lf ns\n",
+            Who,
+            RegionNames[r],
+            (unsigned long long)stats->Events,
+            Seconds > 0 ? (double)stats->Events / Seconds : 0.0,
+            (double)stats->Cycles / (double)stats->Events * nsPerCycle,
+            (double)ProfilerPercentile(stats, 50.0) * nsPerCycle,
+            (double)ProfilerPercentile(stats, 99.0) * nsPerCycle,
+            (double)ProfilerPercentile(stats, 99.9) * nsPerCycle,
+            (double)stats->MaxCycles * nsPerCycle);
+    }
+}
+
+//
+// The histograms of the calling thread, allocated the first time it records
+//
+//
+static ProfilerThreadT*
+ProfilerThisThread(void) {
+    if (ThisThread == NULL) {
+        long index = ProfilerIncrement(&NumThreads) - 1;
+        if (index >= PROFILER_MAX_THREADS) {
+            return NULL;
+        }
+
+        ProfilerThreadT* thread = (ProfilerThreadT*)calloc(1, sizeof(ProfilerThreadT));
+        if (thread == NULL) {
+            return NULL;
+        }
+        thread->Index = (uint32_t)index;
+        thread->IntervalStart = ProfilerCycles();
+        Threads[index] = thread;
+        ThisThread = thread;
+    }
+
+    return ThisThread;
+}
+
+//
+// Print and reset the histograms of a thread once its interval is over
+//
+//
+static inline void
+ProfilerMaybeDumpInterval(
+    ProfilerThreadT* Thread,
+    uint64_t Now
+) {
+    double seconds = (double)(Now - Thread->IntervalStart) * ProfilerNsPerCycle() / 1e9;
+    if (seconds < PROFILER_DUMP_INTERVAL_SECONDS) {
+        return;
+    }
+
+    char who[32];
+    snprintf(who, sizeof(who), "thread %u", Thread->Index);
+    ProfilerPrint(stdout, who, Thread->Regions, seconds);
+    fflush(stdout);
+
+    memset(Thread->Regions, 0, sizeof(Thread->Regions));
+    Thread->IntervalStart = Now;
+}
+
+void
+ProfilerRecord(
+    int Region,
+    uint64_t Cycles
+) {
+    ProfilerThreadT* thread = ProfilerThisThread();
+    if (thread == NULL || Region < 0 || Region >= PROFILER_MAX_REGIONS) {
+        return;
+    }
+
+    ProfilerRegionStatsT* stats = &thread->Regions[Region];
+    stats->Events++;
+    stats->Cycles += Cycles;
+    if (Cycles > stats->MaxCycles) {
+        stats->MaxCycles = Cycles;
+    }
+    stats->Buckets[ProfilerBucket(Cycles)]++;
+
+    ProfilerMaybeDumpInterval(thread, ProfilerCycles());
+}
+
+void
+ProfilerCount(
+    int Region,
+    uint64_t Events
+) {
+    ProfilerThreadT* thread = ProfilerThisThread();
+    if (thread == NULL || Region < 0 || Region >= PROFILER_MAX_REGIONS) {
+        return;
+    }
+
+    thread->Regions[Region].Events += Events;
+
+    ProfilerMaybeDumpInterval(thread, ProfilerCycles());
+}
+
+void
+ProfilerDump(
+    FILE* Out
+) {
+    ProfilerRegionStatsT* merged = (ProfilerRegionStatsT*)calloc(PROFILER_MAX_REGIONS, sizeof(ProfilerRegionStatsT));
+    uint64_t now = ProfilerCycles();
+    uint64_t earliest = now;
+    long numThreads = NumThreads < PROFILER_MAX_THREADS ? NumThreads : PROFILER_MAX_THREADS;
+
+    if (merged == NULL) {
+        return;
+    }
+
+    for (long t = 0; t != numThreads; t++) {
+        const ProfilerThreadT* thread = Threads[t];
+        if (thread == NULL) {
+            continue;
+        }
+        if (thread->IntervalStart < earliest) {
+            earliest = thread->IntervalStart;
+        }
+
+        for (int r = 0; r != PROFILER_MAX_REGIONS; r++) {
+            const ProfilerRegionStatsT* stats = &thread->Regions[r];
+            merged[r].Events += stats->Events;
+            merged[r].Cycles += stats->Cycles;
+            if (stats->MaxCycles > merged[r].MaxCycles) {
+                merged[r].MaxCycles = stats->MaxCycles;
+            }
+            for (int b = 0; b != PROFILER_BUCKETS; b++) {
+                merged[r].Buckets[b] += stats->Buckets[b];
+            }
+        }
+    }
+
+    ProfilerPrint(Out, "all threads", merged, (double)(now - earliest) * ProfilerNsPerCycle() / 1e9);
+    free(merged);
+}
+
+void InitProfiler(struct Profiler* Prof, size_t Ops) {
+    Prof->Operations = Ops;
+    Prof->StartCycles = 0;
+    Prof->StopCycles = 0;
+}
+
+void StartProfiler(struct Profiler* Prof) {
+    Prof->StartCycles = ProfilerCycles();
+}
+
+void StopProfiler(struct Profiler* Prof) {
+    Prof->StopCycles = ProfilerCycles();
+}
+
+//
+// The elapsed time in microseconds
+//
+//
+double GetProfilerEllapsed(struct Profiler* Prof) {
+    return (double)(Prof->StopCycles - Prof->StartCycles) * ProfilerNsPerCycle() / 1000.0;
+}
+
+void ReportProfiler(struct Profiler* Prof) {
+    double latency = GetProfilerEllapsed(Prof);
+    printf("Profiler:\n");
+    printf("-- latency: %.2lf seconds\n", latency / 1000000.0);
+    printf("-- throughput: %.2lf million op/s\n", Prof->Operations * 1.0 / latency);
+}
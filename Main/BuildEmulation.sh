@@ -0,0 +1,9 @@
+# Apply patches
+patch /opt/mellanox/doca/applications/common/src/dpdk_utils.c ../NetworkEngine/Patches/dpdk_utils.patch
+
+BUILD_DIR="./build/"
+if [ -d "$BUILD_DIR" ]; then
+	rm -r $BUILD_DIR
+fi
+meson setup build -Dbuildtype=release -DEmulation=true -DDpdkLib=/opt/mellanox/dpdk/lib/x86_64-linux-gnu $@
+ninja -v -C build
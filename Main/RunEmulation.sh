@@ -0,0 +1 @@
+./build/DDSMain --json StorageConfigEmulation.json --json NetworkConfigEmulation.json 
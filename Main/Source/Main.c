@@ -22,8 +22,8 @@ StorageEngine(
     RunFileBackEnd(
         DDS_BACKEND_ADDR,
         DDS_BACKEND_PORT,
-        1,
-        1,
+        DDS_BACKEND_MAX_CLIENTS,
+        DDS_BACKEND_MAX_BUFFS,
         arg->Argc,
         arg->Argv
     );
@@ -19,10 +19,18 @@ struct DDSBOWConfig {
 	char CoreList[16];			/* List of cores */
 	char HostIPv4[16];			/* Host IPv4 address */
 	uint16_t HostPort; 			/* Host port */
+	char HostBackends[256];		/* Host backends, IPv4:port separated by commas, empty for the host IPv4 and port */
 	char HostMac[18]; 			/* Host MAC address */
 	char DPUIPv4[16];			/* DPU IPv4 address */
 	char UdfPath[64];			/* Path to the offload predicate and function code */
 	uint32_t MaxStreams;		/* Maximum concurrent streams and packets that TLDK can create */
+	uint32_t Mtu;				/* IP MTU of the PEPO port, 0 for the default */
+	uint32_t RtoMinMs;			/* Min TCP retransmission timeout, 0 for the default */
+	uint32_t RtoMaxMs;			/* Max TCP retransmission timeout, 0 for the default */
+	uint32_t TimerTickMs;		/* Tick of the TCP timer wheel, 0 for the default */
+	uint32_t TimerBatch;		/* Expired timers handled per poll, 0 for the default */
+	uint32_t StreamRecvBufs;	/* Receive mbufs per TCP stream, 0 for the default */
+	uint32_t StreamSendBufs;	/* Send mbufs per TCP stream, 0 for the default */
 };
 
 /*
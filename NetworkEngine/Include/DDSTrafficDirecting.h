@@ -6,6 +6,8 @@
 #ifndef DDS_BOW_APP_SIGNATURE_H_
 #define DDS_BOW_APP_SIGNATURE_H_
 
+#include <stdint.h>
+
 //
 // We use IP 5-tuple to identify an application
 // Example 1: "192.168.200.133/32:65535 192.168.200.132/32:65535 TCP"
@@ -112,4 +114,72 @@ int RemoveDirectingRules(
     char* DPUIP
 );
 
+//
+// Apply the directing rules as rte_flow rules in the e-switch instead of with tc, all of them or none;
+// return -ENODEV if DPDK doesn't have the ports of the interfaces, in which case tc is used instead
+//
+//
+int ApplyDirectingRulesFlow(
+    struct DDSBOWAppSignature* Sig,
+    struct DDSBOWFwdRuleList* RuleList,
+    char* HostMac,
+    char* DPUIP
+);
+
+//
+// Remove the directing rules applied with rte_flow
+//
+//
+int RemoveDirectingRulesFlow(void);
+
+//
+// What a rule applied with rte_flow is for, and its hardware counters;
+// the key of a rule is its application signature, or the remote address of its forwarding rule
+//
+//
+#define FLOW_RULE_KEY_LENGTH 64
+
+enum FlowRuleKind {
+    FLOW_RULE_SIGNATURE = 0,
+    FLOW_RULE_HOST,
+    FLOW_RULE_FORWARDING
+};
+
+struct FlowRuleStat {
+    enum FlowRuleKind Kind;
+    char Key[FLOW_RULE_KEY_LENGTH];
+    uint64_t Hits;
+    uint64_t Bytes;
+};
+
+//
+// Add or remove an application signature or a forwarding rule while the engine runs;
+// only rules applied with rte_flow change at runtime
+//
+//
+int AddAppSignatureFlow(
+    struct DDSBOWAppSignature* Sig
+);
+
+int RemoveAppSignatureFlow(
+    struct DDSBOWAppSignature* Sig
+);
+
+int AddFwdRuleFlow(
+    struct DDSBOWFwdRule* Fwd
+);
+
+int RemoveFwdRuleFlow(
+    const char* RemoteIPv4
+);
+
+//
+// Read the rules applied with rte_flow, with their counters
+//
+//
+int GetDirectingRulesFlow(
+    struct FlowRuleStat* Stats,
+    unsigned int MaxRules
+);
+
 #endif /* DDS_BOW_APP_SIGNATURE_H_ */
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#ifndef DDS_BOW_DIRECTING_CONTROL_H_
+#define DDS_BOW_DIRECTING_CONTROL_H_
+
+//
+// A control socket that changes the traffic directing rules while the engine runs, one command per line:
+//   add-signature <src>/<len>:<port> <dst>/<len>:<port> <protocol>   direct an application to DDS BOW
+//   remove-signature <src>/<len>:<port> <dst>/<len>:<port> <protocol>
+//   add-forwarding <remote>/<len> <mac>                              send responses to a client
+//   remove-forwarding <remote>/<len>
+//   list                                                             the rules, with their hardware counters
+// Every command is answered with a line that starts with "ok" or "error", after the lines of a list;
+// e.g., echo "list" | socat - UNIX-CONNECT:/var/run/ddsbow.sock
+//
+//
+#define DIRECTING_CONTROL_SOCKET_PATH "/var/run/ddsbow.sock"
+
+//
+// Start the control thread
+//
+//
+int
+StartDirectingControl(void);
+
+//
+// Stop the control thread
+//
+//
+void
+StopDirectingControl(void);
+
+#endif /* DDS_BOW_DIRECTING_CONTROL_H_ */
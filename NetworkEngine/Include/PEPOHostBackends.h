@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#ifndef PEPO_HOST_BACKENDS_H_
+#define PEPO_HOST_BACKENDS_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// The host server processes that the host legs of spliced connections go to, shared by the lcores.
+// A connection is forwarded as a byte stream, so all of its requests go to the backend of its host leg;
+// the leg is opened to the backend with the fewest requests outstanding, then the fewest connections,
+// so that a slow backend, whose requests pile up, gets fewer of the new connections.
+// A request is counted from the message that forwards it until its backend sends anything on that leg.
+// Backends are checked passively: a host leg that fails before its backend sent anything is a failure,
+// and after PEPO_HOST_BACKEND_MAX_FAILS in a row the backend is down for PEPO_HOST_BACKEND_DOWN_MS,
+// then takes connections again until one more fails
+//
+//
+#define PEPO_HOST_BACKENDS_MAX 16
+#define PEPO_HOST_BACKENDS_LIST_BYTES 256
+#define PEPO_HOST_BACKEND_MAX_FAILS 3
+#define PEPO_HOST_BACKEND_DOWN_MS 1000
+
+struct PEPOHostBackend {
+    char IPv4Addr[16];
+    uint16_t TCPPort;
+    _Atomic uint32_t Outstanding;   /* requests forwarded and not answered yet */
+    _Atomic uint32_t Connections;   /* host legs open */
+    _Atomic uint32_t Failures;      /* host legs failed in a row */
+    _Atomic uint64_t DownUntil;     /* the TSC until which the backend is down */
+};
+
+//
+// Set up the backends from a list of IPv4:port separated by commas, or the one host address and port
+// if the list is empty; return 0 on success
+//
+//
+int
+PEPOHostBackendsInit(
+    const char* List,
+    const char* HostIPv4Addr,
+    uint16_t HostTCPPort
+);
+
+//
+// Pick the backend of a new host leg and count the leg on it; with all of them down,
+// the one that is up the soonest is tried
+//
+//
+struct PEPOHostBackend*
+PEPOHostBackendOpen(void);
+
+//
+// A host leg of a backend is closed, with Awaiting requests not answered; Failed if it failed
+// before the backend sent anything on it
+//
+//
+void
+PEPOHostBackendClose(
+    struct PEPOHostBackend* Backend,
+    uint32_t Awaiting,
+    bool Failed
+);
+
+//
+// Log the load of the backends
+//
+//
+void
+PEPOHostBackendsLog(void);
+
+//
+// Requests forwarded to a backend
+//
+//
+static inline void
+PEPOHostBackendSent(
+    struct PEPOHostBackend* Backend,
+    uint32_t Requests
+) {
+    atomic_fetch_add_explicit(&Backend->Outstanding, Requests, memory_order_relaxed);
+}
+
+//
+// A backend sent on a host leg, answering the Requests the leg forwarded since;
+// the first time on a leg, it is known to be up
+//
+//
+static inline void
+PEPOHostBackendAnswered(
+    struct PEPOHostBackend* Backend,
+    uint32_t Requests,
+    bool First
+) {
+    if (Requests != 0) {
+        atomic_fetch_sub_explicit(&Backend->Outstanding, Requests, memory_order_relaxed);
+    }
+    if (First && atomic_load_explicit(&Backend->Failures, memory_order_relaxed) != 0) {
+        atomic_store_explicit(&Backend->Failures, 0, memory_order_relaxed);
+    }
+}
+
+#endif /* PEPO_HOST_BACKENDS_H_ */
@@ -6,6 +6,30 @@
 #ifndef PEPO_LINUX_TCP_H
 #define PEPO_LINUX_TCP_H
 
+#include <stdint.h>
+
+//
+// Multiplex the clients of a worker over persistent connections to the host instead of opening one for each;
+// every message on them is a frame, a PEPOMuxHeader followed by Bytes bytes. MUX_FRAME_OPEN carries
+// the message size of a new client, MUX_FRAME_DATA a message of a client for the host, or the response to it,
+// which the host sends with the ClientId of the message, and MUX_FRAME_CLOSE, with no bytes, ends a client.
+// A ClientId is not reused while its client is open; the host serves the clients of a connection
+// in any order, and needs no more connections or threads than the PEPO has workers
+//
+//
+#define PEPO_LINUX_MUX_HOST
+
+#define MUX_FRAME_OPEN 0
+#define MUX_FRAME_DATA 1
+#define MUX_FRAME_CLOSE 2
+
+struct PEPOMuxHeader {
+    uint32_t ClientId;
+    uint16_t Type;
+    uint16_t Reserved;
+    uint32_t Bytes;
+};
+
 //
 // Initialize the PEPO based on Linux TCP/IP
 //
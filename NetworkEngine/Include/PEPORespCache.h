@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#ifndef PEPO_RESP_CACHE_H_
+#define PEPO_RESP_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+#include "BackEndTypes.h"
+#include "ResponseCache.h"
+
+//
+// The response cache of an lcore with OFFLOAD_ENGINE_RESPONSE_CACHE: the data of the reads of the hottest locations,
+// in pinned memory that is attached to mbufs as an external buffer, so that a response is the request
+// in a small mbuf chained to the data as it is kept, with no copy and no I/O.
+// A location is kept once it was read PEPO_RESP_CACHE_ADMIT_READS times, if it was read more than the one it replaces
+// in its set and the lcore keeps at most PEPO_RESP_CACHE_BYTES; the read counts are estimated by a sketch of counters
+// and halved every PEPO_RESP_CACHE_AGING_READS reads of the lcore, so that what was hot fades.
+// Responses are kept with the version of their location (see ResponseCache.h) and dropped once it changes
+//
+//
+#define PEPO_RESP_CACHE_SETS 4096
+#define PEPO_RESP_CACHE_WAYS 4
+#define PEPO_RESP_CACHE_BYTES (32ULL * 1024 * 1024)
+#define PEPO_RESP_CACHE_MAX_ITEM_BYTES 16384
+#define PEPO_RESP_CACHE_ADMIT_READS 4
+#define PEPO_RESP_CACHE_SKETCH_COUNTERS 16384
+#define PEPO_RESP_CACHE_AGING_READS (8 * PEPO_RESP_CACHE_SKETCH_COUNTERS)
+
+//
+// The mbufs of each lcore that responses are sent in, the request in one and the data attached to the other;
+// a request larger than PEPO_RESP_CACHE_HEAD_BYTES is not answered from the cache
+//
+//
+#define PEPO_RESP_CACHE_MBUFS 16384
+#define PEPO_RESP_CACHE_HEAD_BYTES 256
+
+struct PEPORespCache;
+
+//
+// Create the response cache of the current lcore, on its socket
+//
+//
+struct PEPORespCache*
+PEPORespCacheCreate(void);
+
+//
+// Free a response cache; the data still attached to mbufs is freed with the last of them
+//
+//
+void
+PEPORespCacheFree(
+    struct PEPORespCache* Cache
+);
+
+//
+// Build the response of a read of Bytes at Offset of a file: the ReqSize bytes of Req, followed by the data kept;
+// return NULL if the data is not kept, with Keep set if it is to be kept once read, at Version
+//
+//
+struct rte_mbuf*
+PEPORespCacheGet(
+    struct PEPORespCache* Cache,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    const char* Req,
+    uint32_t ReqSize,
+    bool* Keep,
+    uint32_t* Version
+);
+
+//
+// Keep the data of a read, at DataOffset of the response Pkt, as it was at Version;
+// return whether it is kept
+//
+//
+bool
+PEPORespCachePut(
+    struct PEPORespCache* Cache,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    uint32_t Version,
+    const struct rte_mbuf* Pkt,
+    uint32_t DataOffset
+);
+
+#endif /* PEPO_RESP_CACHE_H_ */
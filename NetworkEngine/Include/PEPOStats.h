@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#ifndef PEPO_STATS_H_
+#define PEPO_STATS_H_
+
+#include <stdint.h>
+
+#include <rte_common.h>
+#include <rte_lcore.h>
+
+//
+// Counters of a PEPO lcore, always on: the lcore is the only writer of its own cache lines,
+// with plain stores, and readers load them as they are; the depths are sampled every poll
+//
+//
+struct PEPOLcoreStats {
+    uint64_t RxPkts;            /* packets received from the port */
+    uint64_t RxDrops;           /* received packets TLDK didn't take */
+    uint64_t TxPkts;            /* packets sent to the port */
+    uint64_t TxDrops;           /* packets the port didn't take, which are retried */
+    uint64_t TxBursts;          /* bursts sent to the port */
+    uint64_t StreamRxPkts;      /* packets received on streams */
+    uint64_t StreamTxPkts;      /* packets sent on streams */
+    uint64_t StreamTxDrops;     /* packets streams didn't take, which wait in their buffers */
+    uint64_t Accepted;          /* connections accepted */
+    uint64_t Rejected;          /* connections rejected */
+    uint64_t Terminated;        /* streams closed */
+    uint64_t RtoRetransmits;    /* RTO expirations that resent */
+    uint64_t FastRetransmits;   /* fast retransmits entered */
+    uint64_t ReadBufAllocFails; /* read buffers not allocated as the pool was empty */
+    uint64_t ReadsShed;         /* requests sent to the host while the DPU was loaded */
+    uint64_t RespCacheHits;     /* offloaded reads answered from the response cache */
+    uint64_t RespCacheFills;    /* responses kept in the response cache */
+    uint64_t HostLegFails;      /* host legs failed before their backend sent anything */
+    uint64_t UdpRxPkts;         /* datagrams received on the UDP stream */
+    uint64_t UdpTxPkts;         /* responses sent on the UDP stream */
+    uint64_t UdpDeclined;       /* UDP requests dropped for the client to retry over TCP */
+    uint64_t IdlePolls;         /* polls of the main loop that found no work */
+    uint64_t IdleSleeps;        /* sleeps on RX interrupts */
+    uint64_t OfoDrops;          /* out-of-order packets dropped at the limits */
+    uint64_t OfoEvicts;         /* held out-of-order packets dropped for ones nearer the window */
+    uint64_t TlsHandshakes;     /* TLS handshakes completed on client connections */
+    uint64_t TlsErrors;         /* client connections dropped for a failed handshake or a bad record */
+    uint32_t ErEqDepth;         /* armed events of the error queue */
+    uint32_t RxEqDepth;         /* armed events of the receive queue */
+    uint32_t TxEqDepth;         /* armed events of the send queue */
+    uint32_t OfoBytes;          /* out-of-order bytes held by the streams */
+    uint32_t Active;            /* the lcore runs the PEPO */
+} __rte_cache_aligned;
+
+//
+// The counters of all lcores, indexed by lcore id, in the memzone PEPO_STATS_MEMZONE, so that
+// a secondary DPDK process can map them too
+//
+//
+#define PEPO_STATS_MEMZONE "PEPOStats"
+
+extern struct PEPOLcoreStats *PEPOStats;
+
+//
+// The counters are written to PEPO_STATS_PROM_PATH in the Prometheus text format every PEPO_STATS_PERIOD_MS,
+// for the textfile collector of the node exporter
+//
+//
+#define PEPO_STATS_PROM_PATH "/var/run/ddsbow_pepo.prom"
+#define PEPO_STATS_PERIOD_MS 1000
+
+//
+// Allocate the counters
+//
+//
+int
+PEPOStatsInit(void);
+
+//
+// Start the thread that exports the counters
+//
+//
+int
+StartPEPOStatsExport(void);
+
+//
+// Stop the thread that exports the counters
+//
+//
+void
+StopPEPOStatsExport(void);
+
+#endif /* PEPO_STATS_H_ */
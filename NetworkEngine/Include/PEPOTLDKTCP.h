@@ -26,18 +26,108 @@
 #include <rte_lpm.h>
 #include <rte_lpm6.h>
 #include <rte_hash.h>
+#include <rte_interrupts.h>
 #include <rte_ip.h>
 #include <rte_ip_frag.h>
+#include <rte_rcu_qsbr.h>
 #include <rte_tcp.h>
+#include <rte_udp.h>
+#include <rte_thash.h>
 #include <tle_tcp.h>
+#include <tle_udp.h>
 #include <tle_event.h>
+#include <tle_memtank.h>
 
+#include "BackEndTypes.h"
+#include "PEPOHostBackends.h"
+#include "PEPOStats.h"
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+#include "PEPORespCache.h"
+#endif
+#include "PEPOTLS.h"
 #include "Protocol.h"
+#include "UDF.h"
+#ifdef OFFLOAD_ENGINE_UDF_BPF
+#include "UDFBPF.h"
+#endif
 
 #define TLE_DEFAULT_MSS     536
 #define MAX_PKT_BURST       0x20
 #define RSS_HASH_KEY_LENGTH 64
 
+//
+// The IP MTU of the port, up to jumbo frames; TSO and LRO are taken where the NIC has them,
+// so that a value of tens of KB is one packet to TLDK instead of one per MSS
+//
+//
+#define PEPO_MTU_DEFAULT 1500
+#define PEPO_MTU_MIN 576
+#define PEPO_MTU_MAX 9000
+#define PEPO_ENABLE_TSO
+#define PEPO_ENABLE_LRO
+#define PEPO_LRO_MAX_PKT_SIZE 65535
+
+//
+// Split received packets into a header buffer of PEPO_HEADER_SPLIT_BYTES, which fit Ethernet, IPv4 and TCP
+// with timestamps, and a payload buffer, where the NIC can; the RX callbacks move the bytes
+// of headers of other lengths so that the payload starts its own buffer, for the offload predicate,
+// and LRO is not taken with it
+//
+//
+#define PEPO_HEADER_SPLIT
+#define PEPO_HEADER_SPLIT_BYTES (RTE_ETHER_HDR_LEN + 20 + 32)
+#define PEPO_HEADER_MBUF_BUF_SIZE (RTE_PKTMBUF_HEADROOM + 256)
+
+//
+// An lcore that found no work for PEPO_IDLE_PAUSE_ITERS polls in a row pauses after every poll, once more
+// for every further idle poll up to PEPO_IDLE_MAX_PAUSES; with PEPO_IDLE_RX_INTR, after PEPO_IDLE_SLEEP_ITERS idle polls
+// it sleeps on the RX interrupts of its queues for up to PEPO_IDLE_SLEEP_MS instead, which the PMD must support.
+// An lcore with reads outstanding or packets left to send is never idle.
+// The RX burst doubles while the queues return full bursts, up to MAX_PKT_BURST, and halves down to
+// PEPO_RX_BURST_MIN while they return less than half of one
+//
+//
+#define PEPO_IDLE_PAUSE_ITERS 64
+#define PEPO_IDLE_MAX_PAUSES 256
+#undef PEPO_IDLE_RX_INTR
+#define PEPO_IDLE_SLEEP_ITERS 4096
+#define PEPO_IDLE_SLEEP_MS 1
+#define PEPO_RX_BURST_MIN 4
+
+//
+// The packets the streams of an lcore send in a loop are sent with one burst per queue; a queue holds a partial burst
+// for up to PEPO_TX_FLUSH_US after its first packet, so that the packets of the next loops join it
+// and the doorbell of the NIC is rung once for them, and sends a full burst at once. 0 sends every loop
+//
+//
+#define PEPO_TX_FLUSH_US 4
+
+//
+// Out-of-order data a stream and all streams of an lcore hold at most; past these, TLDK drops the held data
+// farthest from the left edge of the window first, then the new data, which the peers resend.
+// This bounds the mbufs that lossy links pin at any number of streams. 0 is unlimited
+//
+//
+#define PEPO_OFO_STREAM_BYTES (256 * 1024)
+#define PEPO_OFO_LCORE_BYTES (64ULL * 1024 * 1024)
+
+//
+// Stream state is not reserved for the max streams of an lcore up front, so that it can hold many mostly idle
+// connections. The front-end streams come from a memtank in chunks of PEPO_STREAM_CHUNK as connections arrive;
+// the free list keeps up to PEPO_FREE_STREAMS_MAX closed ones, and the rest go back to the memtank,
+// which returns whole chunks to the heap, while the lcore has no reads that could still refer to them.
+// TLDK pools its streams the same way, between PEPO_FREE_STREAMS_MIN and PEPO_FREE_STREAMS_MAX free ones,
+// and accepts with SYN cookies, so a SYN storm takes no stream until handshakes complete.
+// The buffers of a stream and the mbufs of the lcore are sized for at most PEPO_MAX_STREAM_BUFS and
+// PEPO_MEMPOOL_MAX_STREAMS, not for the max streams, as idle connections hold no packets
+//
+//
+#define PEPO_STREAM_CHUNK 64
+#define PEPO_FREE_STREAMS_MIN 256
+#define PEPO_FREE_STREAMS_MAX 1024
+#define PEPO_MAX_STREAM_BUFS 1024
+#define PEPO_MEMPOOL_MAX_STREAMS 4096
+
 #undef DDS_VERBOSE
 #undef NETFE_DEBUG
 #undef NETBE_DEBUG
@@ -45,7 +135,82 @@
 #define MAX_REQS_PER_MESSAGE 64
 #define MAX_READ_BUFFER_MBUF_SIZE 65535
 #define MAX_READ_BUFFER_SIZE 65024
-#define MAX_READ_BUFFER_NUM 0x1000
+
+//
+// Offloaded reads outstanding per lcore; every lcore that offloads takes an equal block
+// of the DPU I/O slots of the file service, which end at the control plane slot
+//
+//
+#define MAX_OFFLOAD_LCORES DDS_DPU_IO_PARALLELISM
+#define MAX_READ_OPS_PER_LCORE DDS_DPU_IO_SLOTS_PER_THREAD
+
+//
+// Splice every accepted connection to a connection of its own to the host: the mbufs received on one leg
+// are sent on the other as they are; the local ports of the host legs are picked from
+// [SPLICE_HOST_PORT_MIN, SPLICE_HOST_PORT_MAX) so that RSS brings the packets of the host to the same lcore
+// Without it, the packets a stream receives are sent back on it
+//
+//
+#define PEPO_SPLICE_TO_HOST
+#define SPLICE_HOST_PORT_MIN 32768
+#define SPLICE_HOST_PORT_MAX 61000
+
+//
+// Open the host legs to the host backends of the host-backends parameter, IPv4:port pairs separated by commas,
+// with the fewest requests outstanding, instead of all to the host address and port (see PEPOHostBackends.h)
+//
+//
+#define PEPO_HOST_BACKENDS
+
+#if defined(PEPO_HOST_BACKENDS) && !defined(PEPO_SPLICE_TO_HOST)
+#error "Host backends are picked for the host legs of spliced connections"
+#endif
+
+//
+// Also take requests in UDP datagrams on the service port, for small idempotent reads: every datagram
+// is a message of whole requests, parsed by the offload predicate on its own, and the response to a request
+// the DPU serves is one datagram of up to the MTU to where the request came from. There is no host leg,
+// so the requests for the host are dropped, as are the ones whose responses don't fit a datagram,
+// and the client retries them over TCP; responses carry their requests, which is how a client
+// matches them to its request ids. Every lcore has one UDP stream, with PEPO_UDP_STREAM_BUFS buffers each way
+//
+//
+#define PEPO_UDP_REQUESTS
+#define PEPO_UDP_STREAM_BUFS MAX_READ_OPS_PER_LCORE
+
+#if defined(PEPO_UDP_REQUESTS) && !defined(OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST)
+#error "UDP responses are matched to requests by the requests they include"
+#endif
+
+//
+// Terminate TLS 1.3 on the client legs, so that the offload predicate parses plaintext: the handshake runs
+// in OpenSSL over memory BIOs, with the certificate and key at these paths, then the lcore opens and seals
+// the records itself with the traffic keys, the way kTLS does, in AES-GCM on the crypto extensions of the Arm
+// cores. The host legs stay in the clear. Needs PEPO_SPLICE_TO_HOST, as the plaintext of a client leg
+// is what its host leg sends
+//
+//
+#undef PEPO_TLS
+#define PEPO_TLS_CERT_PATH "/etc/dds/pepo-tls-cert.pem"
+#define PEPO_TLS_KEY_PATH "/etc/dds/pepo-tls-key.pem"
+
+#if defined(PEPO_TLS) && !defined(PEPO_SPLICE_TO_HOST)
+#error "TLS termination forwards the plaintext of a client leg on its host leg"
+#endif
+
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+//
+// An lcore sends the requests the offload predicate gives the DPU to the host while its outstanding reads
+// or the smoothed latency of its reads are past these, and a stream while it has its share of the reads;
+// an lcore with no read outstanding always admits one, which refreshes its latency.
+// The latency is smoothed with a weight of 1 / 2^OFFLOAD_ADMISSION_LATENCY_SHIFT for every read
+//
+//
+#define OFFLOAD_ADMISSION_MAX_QUEUE_DEPTH (MAX_READ_OPS_PER_LCORE * 3 / 4)
+#define OFFLOAD_ADMISSION_MAX_READS_PER_STREAM (MAX_READ_OPS_PER_LCORE / 4)
+#define OFFLOAD_ADMISSION_MAX_LATENCY_US 500
+#define OFFLOAD_ADMISSION_LATENCY_SHIFT 3
+#endif
 
 //
 // TLDK back end
@@ -82,19 +247,11 @@ struct NetbeDev {
     uint16_t TxQid;
     struct NetbePort Port;
     struct tle_dev *Dev;
-    struct PktBuf TxBuf;
-#ifdef DDS_VERBOSE
-    struct {
-        uint64_t In;
-        uint64_t Up;
-        uint64_t Drop;
-    } RxStat;
-    struct {
-        uint64_t Down;
-        uint64_t Out;
-        uint64_t Drop;
-    } TxStat;
+#ifdef PEPO_UDP_REQUESTS
+    struct tle_dev *UdpDev; /* the device of the queue in the UDP context */
 #endif
+    struct PktBuf TxBuf;
+    uint64_t TxDeadlineTsc; /* when the packets held in TxBuf must be sent */
 };
 
 struct NetbeLcore {
@@ -102,10 +259,17 @@ struct NetbeLcore {
     struct rte_lpm *Lpm4;
     struct rte_ip_frag_tbl *Ftbl;
     struct tle_ctx *Ctx;
+#ifdef PEPO_UDP_REQUESTS
+    struct tle_ctx *UdpCtx; /* the context of the UDP streams, which take the UDP packets of the queues */
+#endif
     uint32_t NumPortQueues;
     struct NetbeDev *PortQueues;
     struct tle_dest Dst4;
     struct rte_ip_frag_death_row DeathRow;
+    struct PEPOLcoreStats *Stats; /* the counters of this lcore */
+    uint32_t RxBurst; /* the packets asked of a queue in a poll */
+    uint32_t IdleIters; /* the polls in a row that found no work */
+    uint64_t TxFlushTsc; /* PEPO_TX_FLUSH_US in TSC cycles */
 #ifdef DDS_VERBOSE
     struct {
         uint64_t Flags[UINT8_MAX + 1];
@@ -117,7 +281,8 @@ struct NetbeCfg {
     uint32_t Promisc;
     uint32_t NumPorts;
     uint32_t NumCores;
-    uint32_t NumMempoolBufs;
+    uint32_t NumMempoolBufs;    /* mbufs per lcore, from the queue depths and max streams */
+    uint32_t NumReadBufs;       /* read buffers per lcore, from the reads it can have outstanding */
     struct NetbePort *Ports;
     struct NetbeLcore *Cores;
 };
@@ -159,7 +324,6 @@ struct NetfeListenStream {
     struct tle_event *RxEv;
     struct tle_event *TxEv;
     uint16_t PostErr; /* # of time error event handling was postponed */
-#ifdef DDS_VERBOSE
     struct {
         uint64_t RxPkts;
         uint64_t RxBytes;
@@ -170,7 +334,6 @@ struct NetfeListenStream {
         uint64_t TxEv[TLE_SEV_NUM];
         uint64_t ErEv[TLE_SEV_NUM];
     } Stat;
-#endif
     struct PktBuf Pbuf;
     struct sockaddr_storage Laddr;
     struct sockaddr_storage Raddr;
@@ -182,7 +345,6 @@ struct NetfeStream {
     struct tle_event *RxEv;
     struct tle_event *TxEv;
     uint16_t PostErr; /* # of time error event handling was postponed */
-#ifdef DDS_VERBOSE
     struct {
         uint64_t RxPkts;
         uint64_t RxBytes;
@@ -194,10 +356,31 @@ struct NetfeStream {
         uint64_t TxEv[TLE_SEV_NUM];
         uint64_t ErEv[TLE_SEV_NUM];
     } Stat;
-#endif
     struct PktBuf Pbuf;
     struct sockaddr_storage Laddr;
     struct sockaddr_storage Raddr;
+    uint32_t Generation; /* bumped when the stream is terminated, so late read completions are dropped */
+    OffloadPredStateT PredState; /* the parse state of the offload predicate */
+    bool PredLost; /* bytes went by the predicate, which can't follow the stream anymore */
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    uint32_t OutstandingReads; /* the offloaded reads of this generation of the stream not yet completed */
+#endif
+#ifdef PEPO_SPLICE_TO_HOST
+    struct NetfeStream *Peer; /* the other leg of a spliced connection, whose Pbuf this stream receives into */
+    bool HostLeg; /* the leg to the host, which isn't offloaded */
+#endif
+#ifdef PEPO_HOST_BACKENDS
+    struct PEPOHostBackend *Backend; /* the backend of a host leg */
+    uint32_t HostAwaiting; /* the messages a host leg forwarded since its backend last sent on it */
+    bool HostAnswered; /* the backend of a host leg sent on it */
+#endif
+#ifdef PEPO_UDP_REQUESTS
+    bool Udp; /* the UDP stream of the lcore, whose reads respond to the peers they were received from */
+#endif
+#ifdef PEPO_TLS
+    struct PEPOTlsSession *Tls; /* the TLS session of a client leg, NULL on the host leg */
+    uint32_t TlsSealed; /* the packets at the head of Pbuf that are already sealed records */
+#endif
     LIST_ENTRY(NetfeStream) Link;
 };
 
@@ -206,8 +389,27 @@ struct NetfeStreamList {
     LIST_HEAD(, NetfeStream) Head;
 };
 
+//
+// A version of the offload predicate and function, and the libraries they are in,
+// or their bytecode with OFFLOAD_ENGINE_UDF_BPF
+//
+//
+struct PEPOUdfs {
+    void *PredLib;
+    void *FuncLib;
+    OffloadPred Pred;
+    OffloadFunc Func;
+#ifdef OFFLOAD_ENGINE_UDF_BPF
+    OffloadBPFProgramT *PredProg;
+    OffloadBPFProgramT *FuncProg;
+#endif
+    uint32_t Version;
+};
+
 struct NetfeLcore {
     uint32_t NumStreams;  /* max number of streams */
+    uint32_t NumTankStreams; /* streams taken from StreamTank, in use or on the free list */
+    struct tle_memtank *StreamTank;
     uint32_t NumListeners;
     struct NetfeListenStream *Listeners;
     struct tle_evq *ListenErEq;
@@ -216,15 +418,68 @@ struct NetfeLcore {
     struct tle_evq *ErEq;
     struct tle_evq *RxEq;
     struct tle_evq *TxEq;
-#ifdef DDS_VERBOSE
-    struct {
-        uint64_t Acc;
-        uint64_t Rej;
-        uint64_t Ter;
-    } TcpStat;
-#endif
+    struct PEPOLcoreStats *Stats; /* the counters of this lcore, PEPOStats[lcore id] */
     struct NetfeStreamList Free;
     struct NetfeStreamList Use;
+#ifdef PEPO_SPLICE_TO_HOST
+    uint16_t NextHostPort; /* where the search for the local port of the next host leg starts */
+#endif
+#ifdef PEPO_UDP_REQUESTS
+    //
+    // The UDP stream, the peer of the datagram being offloaded, the peers of the reads by I/O slot,
+    // and the largest response that fits a datagram
+    //
+    //
+    struct NetfeStream UdpStream;
+    struct sockaddr_in UdpPeer;
+    struct sockaddr_in UdpPeers[MAX_READ_OPS_PER_LCORE];
+    uint32_t UdpMaxRespBytes;
+#endif
+
+    //
+    // The UDFs this lcore offloads with until its next quiescent point, where it picks up the ones last loaded;
+    // OffloadId is its thread id for the RCU of the UDFs and the index of its block of I/O slots
+    //
+    //
+    struct PEPOUdfs *Udfs;
+    uint32_t OffloadId;
+
+    //
+    // Reads offloaded to the file service, completed in the order they were issued:
+    // [ReadOpHead, ReadOpSubmitted) are outstanding, [ReadOpSubmitted, ReadOpTail) wait to be submitted in a batch,
+    // ReadCtxts are their I/O slots from IoSlotBase, and ReadOpGenerations the generations of their streams
+    //
+    //
+    RequestIdT IoSlotBase;
+    uint32_t ReadOpHead;
+    uint32_t ReadOpSubmitted;
+    uint32_t ReadOpTail;
+    ReadOpDescriptorT ReadOps[MAX_READ_OPS_PER_LCORE];
+    DataPlaneRequestContext ReadCtxts[MAX_READ_OPS_PER_LCORE];
+    uint32_t ReadOpGenerations[MAX_READ_OPS_PER_LCORE];
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    //
+    // When the reads were submitted, in TSC cycles, and their smoothed latency and its limit
+    //
+    //
+    uint64_t ReadOpSubmitTsc[MAX_READ_OPS_PER_LCORE];
+    uint64_t ReadLatencyTsc;
+    uint64_t MaxReadLatencyTsc;
+#endif
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    struct PEPORespCache *RespCache; /* NULL if it couldn't be created */
+#endif
+
+    //
+    // The segments of a received message, the requests the offload predicate splits it into,
+    // and a request that spans segments, made contiguous for the offload function;
+    // the host also gets the requests the DPU fails to issue and the bytes no request covers
+    //
+    //
+    struct iovec Segs[OFFLOAD_PRED_MAX_SEGS];
+    char ReqBuf[MAX_READ_BUFFER_SIZE];
+    RequestDescriptorT ReqsForHost[2 * MAX_REQS_PER_MESSAGE + 1];
+    RequestDescriptorT ReqsForDPU[MAX_REQS_PER_MESSAGE];
 };
 
 struct LcoreParam {
@@ -306,6 +561,21 @@ int SetupRxCb(
 //
 typedef int (*LCORE_MAIN_FUNCTYPE)(void *Arg);
 
+//
+// TCP tunables of a deployment; 0 takes the default of TLDK, or of the PEPO for the timer batch and buffers
+//
+//
+struct PEPOTcpTunables {
+    uint32_t RtoMinMs;          /* min retransmission timeout */
+    uint32_t RtoMaxMs;          /* max retransmission timeout */
+    uint32_t TimerTickMs;       /* tick of the timer wheel, also the RTO granularity */
+    uint32_t TimerBatch;        /* expired timers and streams to send handled per poll */
+    uint32_t StreamRecvBufs;    /* receive mbufs per stream */
+    uint32_t StreamSendBufs;    /* send mbufs per stream */
+};
+
+#define PEPO_TIMER_BATCH_MAX 0x400
+
 //
 // Initialize the PEPO based on TLDK TCP/IP
 //
@@ -316,9 +586,12 @@ PEPOTLDKTCPInit(
     const char* CoreList,
     const char* HostIPv4Addr,
     uint16_t HostTCPPort,
+    const char* HostBackends,
     const char* DPUIPv4Addr,
     const char* UdfPath,
-    uint32_t MaxStreams
+    uint32_t MaxStreams,
+    uint32_t Mtu,
+    const struct PEPOTcpTunables* Tunables
 );
 
 //
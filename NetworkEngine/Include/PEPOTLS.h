@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#ifndef PEPO_TLS_H_
+#define PEPO_TLS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+
+//
+// TLS 1.3 records of the client legs with PEPO_TLS: only the AES-GCM suites are offered and no session tickets
+// are sent; a KeyUpdate or any alert of the client ends its connection
+//
+//
+#define PEPO_TLS_CIPHERSUITES "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384"
+#define PEPO_TLS_MAX_PLAINTEXT 16384
+#define PEPO_TLS_RECORD_HEADER 5
+#define PEPO_TLS_TAG_BYTES 16
+#define PEPO_TLS_NONCE_BYTES 12
+
+//
+// The ciphertext packets a session holds until their records are whole
+//
+//
+#define PEPO_TLS_RX_PKTS 256
+
+struct PEPOTlsSession;
+
+//
+// Set up the TLS context of all sessions with the certificate chain and the private key at these paths
+//
+//
+int
+PEPOTlsInit(
+    const char* CertPath,
+    const char* KeyPath
+);
+
+//
+// Free the TLS context
+//
+//
+void
+PEPOTlsDestroy(void);
+
+//
+// Start the server side of a TLS session, whose records are built in mbufs of Pool
+//
+//
+struct PEPOTlsSession*
+PEPOTlsSessionCreate(
+    struct rte_mempool* Pool
+);
+
+//
+// Free a session and the packets it holds
+//
+//
+void
+PEPOTlsSessionFree(
+    struct PEPOTlsSession* Session
+);
+
+//
+// The ciphertext packets the session can take now
+//
+//
+uint32_t
+PEPOTlsRxRoom(
+    const struct PEPOTlsSession* Session
+);
+
+//
+// Whether the handshake is done
+//
+//
+bool
+PEPOTlsEstablished(
+    const struct PEPOTlsSession* Session
+);
+
+//
+// Take the NumPkts ciphertext packets in Pkts, and put in their place up to MaxPkts packets of the plaintext
+// of the whole records; the records of the handshake go to the wire packet of the session instead.
+// The session owns the ciphertext packets whatever it returns: the plaintext packets, or a negative errno
+// when the connection must end
+//
+//
+int
+PEPOTlsRecv(
+    struct PEPOTlsSession* Session,
+    struct rte_mbuf** Pkts,
+    uint32_t NumPkts,
+    uint32_t MaxPkts
+);
+
+//
+// Take the handshake records the session has to send, NULL if none
+//
+//
+struct rte_mbuf*
+PEPOTlsTakeWire(
+    struct PEPOTlsSession* Session
+);
+
+//
+// Replace the plaintext packets in Pkts, in order, with packets of their records.
+// Return the packets replaced, fewer than NumPkts if the pool ran out or the handshake isn't done
+//
+//
+uint32_t
+PEPOTlsSeal(
+    struct PEPOTlsSession* Session,
+    struct rte_mbuf** Pkts,
+    uint32_t NumPkts
+);
+
+#endif /* PEPO_TLS_H_ */
@@ -0,0 +1,719 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_flow.h>
+
+#include "DDSTrafficDirecting.h"
+
+extern const char* DPU_INTERFACE;
+extern const char* DDSBOW_INTERFACE;
+extern const char* HOST_INTERFACE;
+extern const char* DDSBOW_L2_ADDRESS;
+
+//
+// The rules between the host and clients have the priority of tc pref 1, and those to clients of pref 2
+//
+//
+#define FLOW_PRIORITY_HOST 0
+#define FLOW_PRIORITY_CLIENTS 1
+#define FLOW_PRIORITY_BROADCAST 2
+#define FLOW_MAX_PATTERN 5
+#define FLOW_MAX_ACTIONS 7
+#define FLOW_MAX_RULES 256
+
+//
+// A traffic directing rule: what it matches on the port packets come in on, in network order, with 0 for any,
+// the headers it rewrites, and the port it sends packets to
+//
+//
+struct FlowDirectingRule {
+    uint16_t InPort;
+    uint16_t OutPort;
+    uint32_t Priority;
+    uint32_t SrcIp;
+    uint32_t SrcIpMask;
+    uint32_t DstIp;
+    uint32_t DstIpMask;
+    uint8_t Protocol;
+    uint16_t SrcPort;
+    uint16_t DstPort;
+    bool SetEthSrc;
+    bool SetEthDst;
+    bool SetIpSrc;
+    bool SetIpDst;
+    struct rte_ether_addr EthSrc;
+    struct rte_ether_addr EthDst;
+    uint32_t IpSrc;
+    uint32_t IpDst;
+};
+
+//
+// A rule applied: what it is for, the port it was created on, so that it is removed by handle, and its counter
+//
+//
+struct FlowRuleEntry {
+    enum FlowRuleKind Kind;
+    char Key[FLOW_RULE_KEY_LENGTH];
+    uint16_t Port;
+    struct rte_flow* Flow;
+};
+
+//
+// The rules applied, and what new rules are made of: the ports of the interfaces and the addresses of the host,
+// DDS BOW and the DPU; Lock serializes the control thread with the pipeline
+//
+//
+static struct {
+    pthread_mutex_t Lock;
+    bool Applied;
+    uint16_t DpuPort;
+    uint16_t BowPort;
+    uint16_t HostPort;
+    uint32_t HostIp;
+    uint32_t DpuIp;
+    uint8_t Protocol;
+    struct rte_ether_addr BowMac;
+    struct rte_ether_addr HostMac;
+    unsigned int NumRules;
+    struct FlowRuleEntry Rules[FLOW_MAX_RULES];
+} FlowCtx = { .Lock = PTHREAD_MUTEX_INITIALIZER };
+
+//
+// Find the DPDK port of a network interface
+//
+//
+static int
+FlowPortOfInterface(
+    const char* Name,
+    uint16_t* PortId
+) {
+    struct rte_eth_dev_info devInfo;
+    unsigned int ifIndex = if_nametoindex(Name);
+    uint16_t p;
+
+    if (ifIndex == 0) {
+        return -ENODEV;
+    }
+
+    RTE_ETH_FOREACH_DEV(p) {
+        if (rte_eth_dev_info_get(p, &devInfo) == 0 && devInfo.if_index == ifIndex) {
+            *PortId = p;
+            return 0;
+        }
+    }
+
+    return -ENODEV;
+}
+
+//
+// Parse an IPv4 prefix, e.g., "192.168.200.132/32", or an address
+//
+//
+static int
+FlowParsePrefix(
+    const char* Str,
+    uint32_t* Addr,
+    uint32_t* Mask
+) {
+    char addr[INET_ADDRSTRLEN];
+    const char* slash = strchr(Str, '/');
+    size_t len = slash ? (size_t)(slash - Str) : strlen(Str);
+    int prefixLen = slash ? atoi(slash + 1) : 32;
+    struct in_addr in;
+
+    if (len >= sizeof(addr) || prefixLen < 0 || prefixLen > 32) {
+        return -EINVAL;
+    }
+    memcpy(addr, Str, len);
+    addr[len] = '\0';
+
+    if (inet_pton(AF_INET, addr, &in) != 1) {
+        return -EINVAL;
+    }
+
+    *Mask = prefixLen == 0 ? 0 : htonl(~0u << (32 - prefixLen));
+    *Addr = in.s_addr & *Mask;
+
+    return 0;
+}
+
+//
+// Parse a port, or "*" for any
+//
+//
+static uint16_t
+FlowParsePort(
+    const char* Str
+) {
+    return strcmp(Str, "*") == 0 ? 0 : htons((uint16_t)atoi(Str));
+}
+
+//
+// Parse a protocol, or "*" for any
+//
+//
+static uint8_t
+FlowParseProtocol(
+    const char* Str
+) {
+    if (strcmp(Str, "*") == 0) {
+        return 0;
+    }
+    if (strcmp(Str, "tcp") == 0) {
+        return IPPROTO_TCP;
+    }
+    if (strcmp(Str, "udp") == 0) {
+        return IPPROTO_UDP;
+    }
+
+    return (uint8_t)atoi(Str);
+}
+
+//
+// Create a rule in the e-switch, on the port that takes transfer rules for its in port
+//
+//
+static struct rte_flow*
+FlowCreateRule(
+    const struct FlowDirectingRule* Rule,
+    uint16_t* ProxyPort
+) {
+    struct rte_flow_attr attr;
+    struct rte_flow_item pattern[FLOW_MAX_PATTERN];
+    struct rte_flow_action actions[FLOW_MAX_ACTIONS];
+    struct rte_flow_item_ethdev inPort;
+    struct rte_flow_item_ipv4 ipSpec, ipMask;
+    struct rte_flow_item_tcp tcpSpec, tcpMask;
+    struct rte_flow_item_udp udpSpec, udpMask;
+    struct rte_flow_action_set_mac ethSrc, ethDst;
+    struct rte_flow_action_set_ipv4 ipSrc, ipDst;
+    struct rte_flow_action_ethdev outPort;
+    struct rte_flow_error error;
+    struct rte_flow* flow;
+    int p = 0, a = 0;
+
+    memset(&error, 0, sizeof(error));
+    if (rte_flow_pick_transfer_proxy(Rule->InPort, ProxyPort, &error) != 0) {
+        printf("No transfer proxy for port %u: %s\n", Rule->InPort, error.message ? error.message : "unknown");
+        return NULL;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.priority = Rule->Priority;
+    attr.transfer = 1;
+
+    memset(pattern, 0, sizeof(pattern));
+    memset(actions, 0, sizeof(actions));
+
+    inPort.port_id = Rule->InPort;
+    pattern[p].type = RTE_FLOW_ITEM_TYPE_REPRESENTED_PORT;
+    pattern[p++].spec = &inPort;
+
+    pattern[p++].type = RTE_FLOW_ITEM_TYPE_ETH;
+
+    memset(&ipSpec, 0, sizeof(ipSpec));
+    memset(&ipMask, 0, sizeof(ipMask));
+    ipSpec.hdr.src_addr = Rule->SrcIp;
+    ipMask.hdr.src_addr = Rule->SrcIpMask;
+    ipSpec.hdr.dst_addr = Rule->DstIp;
+    ipMask.hdr.dst_addr = Rule->DstIpMask;
+    ipSpec.hdr.next_proto_id = Rule->Protocol;
+    ipMask.hdr.next_proto_id = Rule->Protocol ? 0xff : 0;
+    pattern[p].type = RTE_FLOW_ITEM_TYPE_IPV4;
+    pattern[p].spec = &ipSpec;
+    pattern[p++].mask = &ipMask;
+
+    if (Rule->Protocol == IPPROTO_TCP && (Rule->SrcPort || Rule->DstPort)) {
+        memset(&tcpSpec, 0, sizeof(tcpSpec));
+        memset(&tcpMask, 0, sizeof(tcpMask));
+        tcpSpec.hdr.src_port = Rule->SrcPort;
+        tcpMask.hdr.src_port = Rule->SrcPort ? 0xffff : 0;
+        tcpSpec.hdr.dst_port = Rule->DstPort;
+        tcpMask.hdr.dst_port = Rule->DstPort ? 0xffff : 0;
+        pattern[p].type = RTE_FLOW_ITEM_TYPE_TCP;
+        pattern[p].spec = &tcpSpec;
+        pattern[p++].mask = &tcpMask;
+    }
+    else if (Rule->Protocol == IPPROTO_UDP && (Rule->SrcPort || Rule->DstPort)) {
+        memset(&udpSpec, 0, sizeof(udpSpec));
+        memset(&udpMask, 0, sizeof(udpMask));
+        udpSpec.hdr.src_port = Rule->SrcPort;
+        udpMask.hdr.src_port = Rule->SrcPort ? 0xffff : 0;
+        udpSpec.hdr.dst_port = Rule->DstPort;
+        udpMask.hdr.dst_port = Rule->DstPort ? 0xffff : 0;
+        pattern[p].type = RTE_FLOW_ITEM_TYPE_UDP;
+        pattern[p].spec = &udpSpec;
+        pattern[p++].mask = &udpMask;
+    }
+
+    pattern[p].type = RTE_FLOW_ITEM_TYPE_END;
+
+    if (Rule->SetEthSrc) {
+        memcpy(ethSrc.mac_addr, Rule->EthSrc.addr_bytes, RTE_ETHER_ADDR_LEN);
+        actions[a].type = RTE_FLOW_ACTION_TYPE_SET_MAC_SRC;
+        actions[a++].conf = &ethSrc;
+    }
+    if (Rule->SetEthDst) {
+        memcpy(ethDst.mac_addr, Rule->EthDst.addr_bytes, RTE_ETHER_ADDR_LEN);
+        actions[a].type = RTE_FLOW_ACTION_TYPE_SET_MAC_DST;
+        actions[a++].conf = &ethDst;
+    }
+    if (Rule->SetIpSrc) {
+        ipSrc.ipv4_addr = Rule->IpSrc;
+        actions[a].type = RTE_FLOW_ACTION_TYPE_SET_IPV4_SRC;
+        actions[a++].conf = &ipSrc;
+    }
+    if (Rule->SetIpDst) {
+        ipDst.ipv4_addr = Rule->IpDst;
+        actions[a].type = RTE_FLOW_ACTION_TYPE_SET_IPV4_DST;
+        actions[a++].conf = &ipDst;
+    }
+
+    actions[a++].type = RTE_FLOW_ACTION_TYPE_COUNT;
+
+    outPort.port_id = Rule->OutPort;
+    actions[a].type = RTE_FLOW_ACTION_TYPE_REPRESENTED_PORT;
+    actions[a++].conf = &outPort;
+    actions[a].type = RTE_FLOW_ACTION_TYPE_END;
+
+    flow = rte_flow_create(*ProxyPort, &attr, pattern, actions, &error);
+    if (flow == NULL) {
+        printf("rte_flow_create failed on port %u: %s\n", *ProxyPort, error.message ? error.message : "unknown");
+    }
+
+    return flow;
+}
+
+//
+// Create a rule and add it to the table
+//
+//
+static int
+FlowAddEntry(
+    const struct FlowDirectingRule* Rule,
+    enum FlowRuleKind Kind,
+    const char* Key
+) {
+    struct FlowRuleEntry* entry;
+
+    if (FlowCtx.NumRules == FLOW_MAX_RULES) {
+        return -ENOSPC;
+    }
+
+    entry = &FlowCtx.Rules[FlowCtx.NumRules];
+    entry->Flow = FlowCreateRule(Rule, &entry->Port);
+    if (entry->Flow == NULL) {
+        return -EIO;
+    }
+    entry->Kind = Kind;
+    snprintf(entry->Key, sizeof(entry->Key), "%s", Key);
+    FlowCtx.NumRules++;
+
+    return 0;
+}
+
+//
+// Destroy a rule of the table; the last rule takes its place
+//
+//
+static int
+FlowRemoveEntry(
+    unsigned int Index
+) {
+    struct FlowRuleEntry* entry = &FlowCtx.Rules[Index];
+    struct rte_flow_error error;
+    int ret = 0;
+
+    if (rte_flow_destroy(entry->Port, entry->Flow, &error) != 0) {
+        printf("rte_flow_destroy failed on port %u: %s\n", entry->Port, error.message ? error.message : "unknown");
+        ret = -EIO;
+    }
+
+    FlowCtx.NumRules--;
+    if (Index != FlowCtx.NumRules) {
+        *entry = FlowCtx.Rules[FlowCtx.NumRules];
+    }
+
+    return ret;
+}
+
+//
+// Find a rule of the table
+//
+//
+static int
+FlowFindEntry(
+    enum FlowRuleKind Kind,
+    const char* Key
+) {
+    unsigned int r;
+
+    for (r = 0; r != FlowCtx.NumRules; r++) {
+        if (FlowCtx.Rules[r].Kind == Kind && strcmp(FlowCtx.Rules[r].Key, Key) == 0) {
+            return (int)r;
+        }
+    }
+
+    return -1;
+}
+
+//
+// Make the rule that sends packets of an application from clients to DDS BOW, addressed to it
+//
+//
+static int
+FlowSignatureRule(
+    struct DDSBOWAppSignature* Sig,
+    struct FlowDirectingRule* Rule
+) {
+    memset(Rule, 0, sizeof(*Rule));
+    Rule->InPort = FlowCtx.DpuPort;
+    Rule->OutPort = FlowCtx.BowPort;
+    Rule->Priority = FLOW_PRIORITY_HOST;
+    if (FlowParsePrefix(Sig->SourceIPv4, &Rule->SrcIp, &Rule->SrcIpMask) != 0 ||
+        FlowParsePrefix(Sig->DestinationIPv4, &Rule->DstIp, &Rule->DstIpMask) != 0) {
+        return -EINVAL;
+    }
+    Rule->Protocol = FlowParseProtocol(Sig->Protocol);
+    Rule->SrcPort = FlowParsePort(Sig->SourcePort);
+    Rule->DstPort = FlowParsePort(Sig->DestinationPort);
+    Rule->SetEthDst = true;
+    Rule->EthDst = FlowCtx.BowMac;
+    Rule->SetIpDst = true;
+    Rule->IpDst = FlowCtx.DpuIp;
+
+    return 0;
+}
+
+//
+// Make the rule that sends packets from DDS BOW to a client, as if from the host;
+// with no client, packets to any client are broadcast
+//
+//
+static int
+FlowForwardingRule(
+    struct DDSBOWFwdRule* Fwd,
+    struct FlowDirectingRule* Rule
+) {
+    memset(Rule, 0, sizeof(*Rule));
+    Rule->InPort = FlowCtx.BowPort;
+    Rule->OutPort = FlowCtx.DpuPort;
+    Rule->SrcIp = FlowCtx.DpuIp;
+    Rule->SrcIpMask = UINT32_MAX;
+    Rule->Protocol = FlowCtx.Protocol;
+    Rule->SetEthSrc = true;
+    Rule->EthSrc = FlowCtx.HostMac;
+    Rule->SetEthDst = true;
+    Rule->SetIpSrc = true;
+    Rule->IpSrc = FlowCtx.HostIp;
+
+    if (Fwd == NULL) {
+        Rule->Priority = FLOW_PRIORITY_BROADCAST;
+        memset(Rule->EthDst.addr_bytes, 0xff, RTE_ETHER_ADDR_LEN);
+        return 0;
+    }
+
+    Rule->Priority = FLOW_PRIORITY_CLIENTS;
+    if (FlowParsePrefix(Fwd->RemoteIPv4, &Rule->DstIp, &Rule->DstIpMask) != 0 ||
+        rte_ether_unformat_addr(Fwd->RemoteMAC, &Rule->EthDst) != 0) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+//
+// Apply the traffic directing rules of ApplyDirectingRules as rte_flow rules, all of them or none
+//
+//
+int
+ApplyDirectingRulesFlow(
+    struct DDSBOWAppSignature* Sig,
+    struct DDSBOWFwdRuleList* RuleList,
+    char* HostMac,
+    char* DPUIP
+) {
+    struct FlowDirectingRule rule;
+    char sigStr[FLOW_RULE_KEY_LENGTH];
+    uint32_t mask;
+    unsigned int r;
+    int ret;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+
+    if (FlowCtx.Applied) {
+        ret = -EEXIST;
+        goto Exit;
+    }
+
+    if (FlowPortOfInterface(DPU_INTERFACE, &FlowCtx.DpuPort) != 0 ||
+        FlowPortOfInterface(DDSBOW_INTERFACE, &FlowCtx.BowPort) != 0 ||
+        FlowPortOfInterface(HOST_INTERFACE, &FlowCtx.HostPort) != 0) {
+        ret = -ENODEV;
+        goto Exit;
+    }
+
+    if (FlowParsePrefix(Sig->DestinationIPv4, &FlowCtx.HostIp, &mask) != 0 ||
+        FlowParsePrefix(DPUIP, &FlowCtx.DpuIp, &mask) != 0 ||
+        rte_ether_unformat_addr(DDSBOW_L2_ADDRESS, &FlowCtx.BowMac) != 0 ||
+        rte_ether_unformat_addr(HostMac, &FlowCtx.HostMac) != 0) {
+        ret = -EINVAL;
+        goto Exit;
+    }
+    FlowCtx.Protocol = FlowParseProtocol(Sig->Protocol);
+
+    //
+    // #1: packets of the application from clients go to DDS BOW
+    //
+    //
+    GetAppSignatureStr(Sig, sigStr);
+    ret = FlowSignatureRule(Sig, &rule);
+    if (ret == 0) {
+        ret = FlowAddEntry(&rule, FLOW_RULE_SIGNATURE, sigStr);
+    }
+    if (ret != 0) {
+        goto CleanUp;
+    }
+
+    //
+    // #2: packets from DDS BOW to the host
+    //
+    //
+    memset(&rule, 0, sizeof(rule));
+    rule.InPort = FlowCtx.BowPort;
+    rule.OutPort = FlowCtx.HostPort;
+    rule.Priority = FLOW_PRIORITY_HOST;
+    rule.SrcIp = FlowCtx.DpuIp;
+    rule.SrcIpMask = UINT32_MAX;
+    rule.DstIp = FlowCtx.HostIp;
+    rule.DstIpMask = UINT32_MAX;
+    rule.SetEthSrc = true;
+    rule.EthSrc = FlowCtx.BowMac;
+    rule.SetEthDst = true;
+    rule.EthDst = FlowCtx.HostMac;
+    ret = FlowAddEntry(&rule, FLOW_RULE_HOST, "to host");
+    if (ret != 0) {
+        goto CleanUp;
+    }
+
+    //
+    // #3: packets from the host to DDS BOW
+    //
+    //
+    memset(&rule, 0, sizeof(rule));
+    rule.InPort = FlowCtx.HostPort;
+    rule.OutPort = FlowCtx.BowPort;
+    rule.Priority = FLOW_PRIORITY_HOST;
+    rule.SrcIp = FlowCtx.HostIp;
+    rule.SrcIpMask = UINT32_MAX;
+    rule.DstIp = FlowCtx.DpuIp;
+    rule.DstIpMask = UINT32_MAX;
+    ret = FlowAddEntry(&rule, FLOW_RULE_HOST, "from host");
+    if (ret != 0) {
+        goto CleanUp;
+    }
+
+    //
+    // #4 and on: packets from DDS BOW to clients, broadcast unless clients are known
+    //
+    //
+    if (RuleList->NumRules == 0) {
+        ret = FlowForwardingRule(NULL, &rule);
+        if (ret == 0) {
+            ret = FlowAddEntry(&rule, FLOW_RULE_FORWARDING, "*");
+        }
+        if (ret != 0) {
+            goto CleanUp;
+        }
+    }
+    for (r = 0; r != RuleList->NumRules; r++) {
+        ret = FlowForwardingRule(&RuleList->Rules[r], &rule);
+        if (ret == 0) {
+            ret = FlowAddEntry(&rule, FLOW_RULE_FORWARDING, RuleList->Rules[r].RemoteIPv4);
+        }
+        if (ret != 0) {
+            goto CleanUp;
+        }
+    }
+
+    FlowCtx.Applied = true;
+    printf("%u traffic directing rules are applied with rte_flow\n", FlowCtx.NumRules);
+    ret = 0;
+    goto Exit;
+
+CleanUp:
+    while (FlowCtx.NumRules != 0) {
+        FlowRemoveEntry(FlowCtx.NumRules - 1);
+    }
+
+Exit:
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return ret;
+}
+
+//
+// Remove the traffic directing rules applied with rte_flow
+//
+//
+int
+RemoveDirectingRulesFlow(void) {
+    int ret = 0;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+    while (FlowCtx.NumRules != 0) {
+        if (FlowRemoveEntry(FlowCtx.NumRules - 1) != 0) {
+            ret = -EIO;
+        }
+    }
+    FlowCtx.Applied = false;
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return ret;
+}
+
+//
+// Add the rule of an application signature while the engine runs
+//
+//
+int
+AddAppSignatureFlow(
+    struct DDSBOWAppSignature* Sig
+) {
+    struct FlowDirectingRule rule;
+    char sigStr[FLOW_RULE_KEY_LENGTH];
+    int ret;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+    GetAppSignatureStr(Sig, sigStr);
+    if (!FlowCtx.Applied) {
+        ret = -ENODEV;
+    }
+    else if (FlowFindEntry(FLOW_RULE_SIGNATURE, sigStr) >= 0) {
+        ret = -EEXIST;
+    }
+    else {
+        ret = FlowSignatureRule(Sig, &rule);
+        if (ret == 0) {
+            ret = FlowAddEntry(&rule, FLOW_RULE_SIGNATURE, sigStr);
+        }
+    }
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return ret;
+}
+
+//
+// Remove the rule of an application signature while the engine runs
+//
+//
+int
+RemoveAppSignatureFlow(
+    struct DDSBOWAppSignature* Sig
+) {
+    char sigStr[FLOW_RULE_KEY_LENGTH];
+    int ret, r;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+    GetAppSignatureStr(Sig, sigStr);
+    r = FlowFindEntry(FLOW_RULE_SIGNATURE, sigStr);
+    ret = r < 0 ? -ENOENT : FlowRemoveEntry((unsigned int)r);
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return ret;
+}
+
+//
+// Add a forwarding rule while the engine runs
+//
+//
+int
+AddFwdRuleFlow(
+    struct DDSBOWFwdRule* Fwd
+) {
+    struct FlowDirectingRule rule;
+    int ret;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+    if (!FlowCtx.Applied) {
+        ret = -ENODEV;
+    }
+    else if (FlowFindEntry(FLOW_RULE_FORWARDING, Fwd->RemoteIPv4) >= 0) {
+        ret = -EEXIST;
+    }
+    else {
+        ret = FlowForwardingRule(Fwd, &rule);
+        if (ret == 0) {
+            ret = FlowAddEntry(&rule, FLOW_RULE_FORWARDING, Fwd->RemoteIPv4);
+        }
+    }
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return ret;
+}
+
+//
+// Remove a forwarding rule while the engine runs
+//
+//
+int
+RemoveFwdRuleFlow(
+    const char* RemoteIPv4
+) {
+    int ret, r;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+    r = FlowFindEntry(FLOW_RULE_FORWARDING, RemoteIPv4);
+    ret = r < 0 ? -ENOENT : FlowRemoveEntry((unsigned int)r);
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return ret;
+}
+
+//
+// Read the rules applied with their counters, up to MaxRules of them; return the number of rules read
+//
+//
+int
+GetDirectingRulesFlow(
+    struct FlowRuleStat* Stats,
+    unsigned int MaxRules
+) {
+    struct rte_flow_action count = { .type = RTE_FLOW_ACTION_TYPE_COUNT };
+    struct rte_flow_query_count query;
+    struct rte_flow_error error;
+    unsigned int r;
+
+    pthread_mutex_lock(&FlowCtx.Lock);
+    for (r = 0; r != FlowCtx.NumRules && r != MaxRules; r++) {
+        Stats[r].Kind = FlowCtx.Rules[r].Kind;
+        memcpy(Stats[r].Key, FlowCtx.Rules[r].Key, sizeof(Stats[r].Key));
+        memset(&query, 0, sizeof(query));
+        if (rte_flow_query(FlowCtx.Rules[r].Port, FlowCtx.Rules[r].Flow, &count, &query, &error) == 0) {
+            Stats[r].Hits = query.hits_set ? query.hits : 0;
+            Stats[r].Bytes = query.bytes_set ? query.bytes : 0;
+        }
+        else {
+            Stats[r].Hits = 0;
+            Stats[r].Bytes = 0;
+        }
+    }
+    pthread_mutex_unlock(&FlowCtx.Lock);
+
+    return (int)r;
+}
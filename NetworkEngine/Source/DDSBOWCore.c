@@ -179,6 +179,32 @@ HostPortCallback(
     return DOCA_SUCCESS;
 }
 
+/*
+ * Callback function for setting the host backends
+ *
+ * @Param [in]: host backends string to set, IPv4:port separated by commas
+ * @Config [out]: application configuration for setting the host backends string
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+HostBackendsCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+
+    if (strlen((char *)Param) >= sizeof(appConfig->HostBackends)) {
+        DOCA_LOG_ERR("Host backends longer than %zu", sizeof(appConfig->HostBackends) - 1);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    strcpy(appConfig->HostBackends, (char *)Param);
+    RTE_LOG(NOTICE, USER1,
+                "Host backends = %s\n",
+                appConfig->HostBackends);
+    return DOCA_SUCCESS;
+}
+
 /*
  * Callback function for setting core list
  *
@@ -285,6 +311,195 @@ MaxStreamsCallback(
     return DOCA_SUCCESS;
 }
 
+/*
+ * Callback function for setting the MTU
+ *
+ * @Param [in]: MTU to set
+ * @Config [out]: application configuration for setting the MTU
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+MtuCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int mtu = *(int *)Param;
+
+    if (mtu <= 0) {
+        DOCA_LOG_ERR("Invalid MTU %d", mtu);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->Mtu = (uint32_t)mtu;
+    RTE_LOG(NOTICE, USER1,
+                "MTU = %d\n",
+                mtu);
+    return DOCA_SUCCESS;
+}
+
+/*
+ * Callback function for setting the min TCP retransmission timeout
+ *
+ * @Param [in]: value to set, 0 for the default
+ * @Config [out]: application configuration for setting the value
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+RtoMinCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int rtoMin = *(int *)Param;
+
+    if (rtoMin < 0) {
+        DOCA_LOG_ERR("Invalid min rto (ms) %d", rtoMin);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->RtoMinMs = (uint32_t)rtoMin;
+    RTE_LOG(NOTICE, USER1,
+                "Min RTO (ms) = %d\n",
+                rtoMin);
+    return DOCA_SUCCESS;
+}
+
+/*
+ * Callback function for setting the max TCP retransmission timeout
+ *
+ * @Param [in]: value to set, 0 for the default
+ * @Config [out]: application configuration for setting the value
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+RtoMaxCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int rtoMax = *(int *)Param;
+
+    if (rtoMax < 0) {
+        DOCA_LOG_ERR("Invalid max rto (ms) %d", rtoMax);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->RtoMaxMs = (uint32_t)rtoMax;
+    RTE_LOG(NOTICE, USER1,
+                "Max RTO (ms) = %d\n",
+                rtoMax);
+    return DOCA_SUCCESS;
+}
+
+/*
+ * Callback function for setting the tick of the TCP timer wheel
+ *
+ * @Param [in]: value to set, 0 for the default
+ * @Config [out]: application configuration for setting the value
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+TimerTickCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int timerTick = *(int *)Param;
+
+    if (timerTick < 0) {
+        DOCA_LOG_ERR("Invalid timer tick (ms) %d", timerTick);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->TimerTickMs = (uint32_t)timerTick;
+    RTE_LOG(NOTICE, USER1,
+                "Timer tick (ms) = %d\n",
+                timerTick);
+    return DOCA_SUCCESS;
+}
+
+/*
+ * Callback function for setting the expired TCP timers handled per poll
+ *
+ * @Param [in]: value to set, 0 for the default
+ * @Config [out]: application configuration for setting the value
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+TimerBatchCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int timerBatch = *(int *)Param;
+
+    if (timerBatch < 0) {
+        DOCA_LOG_ERR("Invalid timer batch %d", timerBatch);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->TimerBatch = (uint32_t)timerBatch;
+    RTE_LOG(NOTICE, USER1,
+                "Timer batch = %d\n",
+                timerBatch);
+    return DOCA_SUCCESS;
+}
+
+/*
+ * Callback function for setting the receive mbufs per TCP stream
+ *
+ * @Param [in]: value to set, 0 for the default
+ * @Config [out]: application configuration for setting the value
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+StreamRecvBufsCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int streamRecvBufs = *(int *)Param;
+
+    if (streamRecvBufs < 0) {
+        DOCA_LOG_ERR("Invalid stream receive buffers %d", streamRecvBufs);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->StreamRecvBufs = (uint32_t)streamRecvBufs;
+    RTE_LOG(NOTICE, USER1,
+                "Stream receive buffers = %d\n",
+                streamRecvBufs);
+    return DOCA_SUCCESS;
+}
+
+/*
+ * Callback function for setting the send mbufs per TCP stream
+ *
+ * @Param [in]: value to set, 0 for the default
+ * @Config [out]: application configuration for setting the value
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+StreamSendBufsCallback(
+    void *Param,
+    void *Config
+) {
+    struct DDSBOWConfig *appConfig = (struct DDSBOWConfig *)Config;
+    int streamSendBufs = *(int *)Param;
+
+    if (streamSendBufs < 0) {
+        DOCA_LOG_ERR("Invalid stream send buffers %d", streamSendBufs);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    appConfig->StreamSendBufs = (uint32_t)streamSendBufs;
+    RTE_LOG(NOTICE, USER1,
+                "Stream send buffers = %d\n",
+                streamSendBufs);
+    return DOCA_SUCCESS;
+}
+
 /*
  * Registers all flags used by the application for DOCA argument parser, so that when parsing
  * it can be parsed accordingly
@@ -295,8 +510,10 @@ RegisterDDSBOWParams() {
     doca_error_t result;
     struct doca_argp_param *appSignatureParam, *udfPathParam, *fwdRulesParam;
     struct doca_argp_param *useDPDKParam, *numCoresParam, *coreListParam;
-    struct doca_argp_param *hostIPv4Param, *hostPortParam, *hostMacParam;
-    struct doca_argp_param *dpuIPv4Param, *maxStreamsParam;
+    struct doca_argp_param *hostIPv4Param, *hostPortParam, *hostMacParam, *hostBackendsParam;
+    struct doca_argp_param *dpuIPv4Param, *maxStreamsParam, *mtuParam;
+    struct doca_argp_param *rtoMinParam, *rtoMaxParam, *timerTickParam;
+    struct doca_argp_param *timerBatchParam, *streamRecvBufsParam, *streamSendBufsParam;
 
     /* Create and register HW offload param */
     result = doca_argp_param_create(&appSignatureParam);
@@ -475,6 +692,24 @@ RegisterDDSBOWParams() {
         return result;
     }
 
+    /* Create and register host backends param */
+    result = doca_argp_param_create(&hostBackendsParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(hostBackendsParam, "host-backends");
+    doca_argp_param_set_arguments(hostBackendsParam, "<str>");
+    doca_argp_param_set_description(hostBackendsParam,
+        "Set the host server processes to spread connections over, IPv4:port separated by commas");
+    doca_argp_param_set_callback(hostBackendsParam, HostBackendsCallback);
+    doca_argp_param_set_type(hostBackendsParam, DOCA_ARGP_TYPE_STRING);
+    result = doca_argp_register_param(hostBackendsParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
     /* Create and register max streams param */
     result = doca_argp_param_create(&maxStreamsParam);
     if (result != DOCA_SUCCESS) {
@@ -493,6 +728,126 @@ RegisterDDSBOWParams() {
         return result;
     }
 
+    /* Create and register MTU param */
+    result = doca_argp_param_create(&mtuParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_short_name(mtuParam, "t");
+    doca_argp_param_set_long_name(mtuParam, "mtu");
+    doca_argp_param_set_arguments(mtuParam, "<num>");
+    doca_argp_param_set_description(mtuParam, "Set the IP MTU of the PEPO port, up to 9000");
+    doca_argp_param_set_callback(mtuParam, MtuCallback);
+    doca_argp_param_set_type(mtuParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(mtuParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
+    /* Create and register rto-min-ms param */
+    result = doca_argp_param_create(&rtoMinParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(rtoMinParam, "rto-min-ms");
+    doca_argp_param_set_arguments(rtoMinParam, "<num>");
+    doca_argp_param_set_description(rtoMinParam, "Set the min TCP retransmission timeout in ms, 0 for the default");
+    doca_argp_param_set_callback(rtoMinParam, RtoMinCallback);
+    doca_argp_param_set_type(rtoMinParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(rtoMinParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
+    /* Create and register rto-max-ms param */
+    result = doca_argp_param_create(&rtoMaxParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(rtoMaxParam, "rto-max-ms");
+    doca_argp_param_set_arguments(rtoMaxParam, "<num>");
+    doca_argp_param_set_description(rtoMaxParam, "Set the max TCP retransmission timeout in ms, 0 for the default");
+    doca_argp_param_set_callback(rtoMaxParam, RtoMaxCallback);
+    doca_argp_param_set_type(rtoMaxParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(rtoMaxParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
+    /* Create and register timer-tick-ms param */
+    result = doca_argp_param_create(&timerTickParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(timerTickParam, "timer-tick-ms");
+    doca_argp_param_set_arguments(timerTickParam, "<num>");
+    doca_argp_param_set_description(timerTickParam, "Set the tick of the TCP timer wheel in ms, 0 for the default");
+    doca_argp_param_set_callback(timerTickParam, TimerTickCallback);
+    doca_argp_param_set_type(timerTickParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(timerTickParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
+    /* Create and register timer-batch param */
+    result = doca_argp_param_create(&timerBatchParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(timerBatchParam, "timer-batch");
+    doca_argp_param_set_arguments(timerBatchParam, "<num>");
+    doca_argp_param_set_description(timerBatchParam, "Set the expired TCP timers handled per poll, 0 for the default");
+    doca_argp_param_set_callback(timerBatchParam, TimerBatchCallback);
+    doca_argp_param_set_type(timerBatchParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(timerBatchParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
+    /* Create and register stream-rbufs param */
+    result = doca_argp_param_create(&streamRecvBufsParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(streamRecvBufsParam, "stream-rbufs");
+    doca_argp_param_set_arguments(streamRecvBufsParam, "<num>");
+    doca_argp_param_set_description(streamRecvBufsParam, "Set the receive mbufs per TCP stream, 0 for the default");
+    doca_argp_param_set_callback(streamRecvBufsParam, StreamRecvBufsCallback);
+    doca_argp_param_set_type(streamRecvBufsParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(streamRecvBufsParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
+    /* Create and register stream-sbufs param */
+    result = doca_argp_param_create(&streamSendBufsParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+        return result;
+    }
+    doca_argp_param_set_long_name(streamSendBufsParam, "stream-sbufs");
+    doca_argp_param_set_arguments(streamSendBufsParam, "<num>");
+    doca_argp_param_set_description(streamSendBufsParam, "Set the send mbufs per TCP stream, 0 for the default");
+    doca_argp_param_set_callback(streamSendBufsParam, StreamSendBufsCallback);
+    doca_argp_param_set_type(streamSendBufsParam, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(streamSendBufsParam);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s", doca_get_error_string(result));
+        return result;
+    }
+
     /* Register version callback for DOCA SDK & RUNTIME */
     result = doca_argp_register_version_callback(sdk_version_callback);
     if (result != DOCA_SUCCESS) {
@@ -18,6 +18,7 @@
 
 #include "DDSTrafficDirecting.h"
 #include "DDSBOWCore.h"
+#include "DirectingControl.h"
 #include "PEPOLinuxTCP.h"
 #include "PEPOTLDKTCP.h"
 
@@ -25,6 +26,68 @@ DOCA_LOG_REGISTER(DDSBOW_PIPELINE);
 
 struct DDSBOWConfig AppCfg = { 0 };
 
+//
+// Whether the traffic directing rules were applied with rte_flow, or with tc
+//
+//
+static bool DirectingRulesFlow = false;
+
+//
+// Apply the traffic directing rules with rte_flow, which takes microseconds,
+// or with tc if the e-switch ports aren't DPDK ports or the rules can't be created
+//
+//
+static int
+ApplyTrafficDirectingRules(void) {
+#ifdef DDS_EMULATION
+    //
+    // Emulated on a server, the PEPO port is the DPU address itself and has no e-switch to direct traffic with
+    //
+    //
+    DOCA_LOG_INFO("Traffic directing rules are not applied in emulation");
+    return 0;
+#else
+    int result = ApplyDirectingRulesFlow(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
+    if (result == 0) {
+        DirectingRulesFlow = true;
+
+        //
+        // Rules applied with rte_flow also change while the engine runs
+        //
+        //
+        result = StartDirectingControl();
+        if (result != 0) {
+            DOCA_LOG_WARN("Traffic directing rules can't be changed at runtime (%d)", result);
+        }
+
+        return 0;
+    }
+
+    DOCA_LOG_INFO("Traffic directing rules fall back to tc (%d)", result);
+    DirectingRulesFlow = false;
+
+    return ApplyDirectingRules(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
+#endif
+}
+
+//
+// Remove the traffic directing rules
+//
+//
+static void
+RemoveTrafficDirectingRules(void) {
+#ifndef DDS_EMULATION
+    if (DirectingRulesFlow) {
+        StopDirectingControl();
+        RemoveDirectingRulesFlow();
+        DirectingRulesFlow = false;
+    }
+    else {
+        RemoveDirectingRules(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
+    }
+#endif
+}
+
 /*
  * DDS BOW pipeline main function
  *
@@ -77,7 +140,7 @@ RunBOW(
         // Apply application signature to direct traffic to DDS BOW
         //
         //
-        resultInt = ApplyDirectingRules(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
+        resultInt = ApplyTrafficDirectingRules();
         if (resultInt) {
             DOCA_LOG_ERR("Failed to apply traffic directing rules");
             exitStatus = EXIT_FAILURE;
@@ -88,14 +151,26 @@ RunBOW(
         // Init and run TLDK TCP PEPO
         //
         //
+        struct PEPOTcpTunables tunables = {
+            .RtoMinMs = AppCfg.RtoMinMs,
+            .RtoMaxMs = AppCfg.RtoMaxMs,
+            .TimerTickMs = AppCfg.TimerTickMs,
+            .TimerBatch = AppCfg.TimerBatch,
+            .StreamRecvBufs = AppCfg.StreamRecvBufs,
+            .StreamSendBufs = AppCfg.StreamSendBufs
+        };
+
         resultInt = PEPOTLDKTCPInit(
             AppCfg.NumCores,
             AppCfg.CoreList,
             AppCfg.HostIPv4,
             AppCfg.HostPort,
+            AppCfg.HostBackends,
             AppCfg.DPUIPv4,
             AppCfg.UdfPath,
-            AppCfg.MaxStreams
+            AppCfg.MaxStreams,
+            AppCfg.Mtu,
+            &tunables
         );
         
         if (resultInt) {
@@ -116,7 +191,7 @@ RunBOW(
         // Apply traffic directing rules in NIC HW 
         //
         //
-        resultInt = ApplyDirectingRules(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
+        resultInt = ApplyTrafficDirectingRules();
         if (resultInt) {
             DOCA_LOG_ERR("Failed to apply traffic directing rules");
             exitStatus = EXIT_FAILURE;
@@ -144,6 +219,13 @@ RunBOW(
 
 exit_app:
     if (AppCfg.UseDPDK) {
+        //
+        // Delete traffic directing rules first, as rte_flow rules go with the ports PEPO closes
+        //
+        //
+        RemoveTrafficDirectingRules();
+        ReleaseFwdRules(&AppCfg.FwdRules);
+
         //
         // Stop and destroy TLDK TCP PEPO
         //
@@ -154,13 +236,6 @@ exit_app:
             exitStatus = EXIT_FAILURE;
         }
 
-        //
-        // Delete traffic directing rules 
-        //
-        //
-        RemoveDirectingRules(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
-        ReleaseFwdRules(&AppCfg.FwdRules);
-
         // /* DPDK cleanup resources */
         // dpdk_queues_and_ports_fini(&dpdkConfig);
 
@@ -177,7 +252,7 @@ exit_app:
         // Delete traffic directing rules 
         //
         //
-        RemoveDirectingRules(&AppCfg.AppSig, &AppCfg.FwdRules, AppCfg.HostMac, AppCfg.DPUIPv4);
+        RemoveTrafficDirectingRules();
         ReleaseFwdRules(&AppCfg.FwdRules);
     }
 
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "DDSTrafficDirecting.h"
+#include "DirectingControl.h"
+
+#define DIRECTING_CONTROL_LINE_LENGTH 256
+#define DIRECTING_CONTROL_POLL_MS 1000
+#define DIRECTING_CONTROL_MAX_LIST 256
+
+static pthread_t ControlThread;
+static int ControlSocket = -1;
+static volatile int ControlStop = 0;
+
+//
+// Parse an application signature, checking that it fits DDSBOWAppSignature before ParseAppSignature takes it
+//
+//
+static int
+ControlParseSignature(
+    const char* Args,
+    struct DDSBOWAppSignature* Sig
+) {
+    char src[32], dst[32], protocol[8], str[DIRECTING_CONTROL_LINE_LENGTH];
+    const char *srcPort, *dstPort;
+
+    if (sscanf(Args, "%31s %31s %7s", src, dst, protocol) != 3) {
+        return -EINVAL;
+    }
+
+    srcPort = strchr(src, ':');
+    dstPort = strchr(dst, ':');
+    if (srcPort == NULL || dstPort == NULL ||
+        srcPort - src >= (int)sizeof(Sig->SourceIPv4) || strlen(srcPort + 1) >= sizeof(Sig->SourcePort) ||
+        dstPort - dst >= (int)sizeof(Sig->DestinationIPv4) || strlen(dstPort + 1) >= sizeof(Sig->DestinationPort) ||
+        strlen(protocol) >= sizeof(Sig->Protocol)) {
+        return -EINVAL;
+    }
+
+    snprintf(str, sizeof(str), "%s %s %s", src, dst, protocol);
+    memset(Sig, 0, sizeof(*Sig));
+
+    return ParseAppSignature(str, Sig);
+}
+
+//
+// Parse a forwarding rule
+//
+//
+static int
+ControlParseFwdRule(
+    const char* Args,
+    struct DDSBOWFwdRule* Fwd
+) {
+    char remote[32], mac[32];
+
+    if (sscanf(Args, "%31s %31s", remote, mac) != 2 ||
+        strlen(remote) >= sizeof(Fwd->RemoteIPv4) || strlen(mac) >= sizeof(Fwd->RemoteMAC)) {
+        return -EINVAL;
+    }
+
+    strcpy(Fwd->RemoteIPv4, remote);
+    strcpy(Fwd->RemoteMAC, mac);
+
+    return 0;
+}
+
+//
+// Write the rules with their counters
+//
+//
+static int
+ControlList(
+    FILE* Out
+) {
+    static const char* kinds[] = { "signature", "host", "forwarding" };
+    struct FlowRuleStat* stats;
+    int n, r;
+
+    stats = (struct FlowRuleStat*)malloc(sizeof(struct FlowRuleStat) * DIRECTING_CONTROL_MAX_LIST);
+    if (stats == NULL) {
+        return -ENOMEM;
+    }
+
+    n = GetDirectingRulesFlow(stats, DIRECTING_CONTROL_MAX_LIST);
+    for (r = 0; r != n; r++) {
+        fprintf(Out, "%s %s hits %llu bytes %llu\n", kinds[stats[r].Kind], stats[r].Key,
+            (unsigned long long)stats[r].Hits, (unsigned long long)stats[r].Bytes);
+    }
+    free(stats);
+
+    return 0;
+}
+
+//
+// Run a command
+//
+//
+static int
+ControlRun(
+    char* Line,
+    FILE* Out
+) {
+    struct DDSBOWAppSignature sig;
+    struct DDSBOWFwdRule fwd;
+    char remote[32];
+    char* args;
+    int ret;
+
+    Line[strcspn(Line, "\r\n")] = '\0';
+    args = strchr(Line, ' ');
+    if (args != NULL) {
+        *args++ = '\0';
+    }
+    else {
+        args = Line + strlen(Line);
+    }
+
+    if (strcmp(Line, "add-signature") == 0) {
+        ret = ControlParseSignature(args, &sig);
+        return ret != 0 ? ret : AddAppSignatureFlow(&sig);
+    }
+    if (strcmp(Line, "remove-signature") == 0) {
+        ret = ControlParseSignature(args, &sig);
+        return ret != 0 ? ret : RemoveAppSignatureFlow(&sig);
+    }
+    if (strcmp(Line, "add-forwarding") == 0) {
+        ret = ControlParseFwdRule(args, &fwd);
+        return ret != 0 ? ret : AddFwdRuleFlow(&fwd);
+    }
+    if (strcmp(Line, "remove-forwarding") == 0) {
+        if (sscanf(args, "%31s", remote) != 1) {
+            return -EINVAL;
+        }
+        return RemoveFwdRuleFlow(remote);
+    }
+    if (strcmp(Line, "list") == 0) {
+        return ControlList(Out);
+    }
+
+    return -EOPNOTSUPP;
+}
+
+//
+// Serve the commands of a connection until it is closed
+//
+//
+static void
+ControlServe(
+    int Conn
+) {
+    char line[DIRECTING_CONTROL_LINE_LENGTH];
+    struct timeval timeout;
+    FILE* stream;
+    int ret;
+
+    //
+    // An idle connection is closed, so that it doesn't hold the thread when it is stopped
+    //
+    //
+    timeout.tv_sec = DIRECTING_CONTROL_POLL_MS / 1000;
+    timeout.tv_usec = 0;
+    setsockopt(Conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    stream = fdopen(Conn, "r+");
+    if (stream == NULL) {
+        close(Conn);
+        return;
+    }
+
+    while (!ControlStop && fgets(line, sizeof(line), stream) != NULL) {
+        ret = ControlRun(line, stream);
+        if (ret == 0) {
+            fprintf(stream, "ok\n");
+        }
+        else {
+            fprintf(stream, "error %s\n", strerror(-ret));
+        }
+        fflush(stream);
+    }
+
+    fclose(stream);
+}
+
+//
+// The control thread, which serves one connection at a time
+//
+//
+static void*
+ControlMain(
+    void* Arg
+) {
+    struct pollfd pfd;
+    int conn;
+
+    pfd.fd = ControlSocket;
+    pfd.events = POLLIN;
+
+    while (!ControlStop) {
+        if (poll(&pfd, 1, DIRECTING_CONTROL_POLL_MS) <= 0) {
+            continue;
+        }
+
+        conn = accept(ControlSocket, NULL, NULL);
+        if (conn >= 0) {
+            ControlServe(conn);
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Start the control thread
+//
+//
+int
+StartDirectingControl(void) {
+    struct sockaddr_un addr;
+
+    ControlSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ControlSocket < 0) {
+        return -errno;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, DIRECTING_CONTROL_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    unlink(DIRECTING_CONTROL_SOCKET_PATH);
+
+    if (bind(ControlSocket, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(ControlSocket, 1) != 0) {
+        int ret = -errno;
+        close(ControlSocket);
+        ControlSocket = -1;
+        return ret;
+    }
+
+    ControlStop = 0;
+    if (pthread_create(&ControlThread, NULL, ControlMain, NULL) != 0) {
+        close(ControlSocket);
+        ControlSocket = -1;
+        unlink(DIRECTING_CONTROL_SOCKET_PATH);
+        return -EAGAIN;
+    }
+
+    printf("Traffic directing rules can be changed through %s\n", DIRECTING_CONTROL_SOCKET_PATH);
+
+    return 0;
+}
+
+//
+// Stop the control thread
+//
+//
+void
+StopDirectingControl(void) {
+    if (ControlSocket < 0) {
+        return;
+    }
+
+    ControlStop = 1;
+    pthread_join(ControlThread, NULL);
+    close(ControlSocket);
+    ControlSocket = -1;
+    unlink(DIRECTING_CONTROL_SOCKET_PATH);
+}
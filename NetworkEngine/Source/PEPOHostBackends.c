@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+
+#include "PEPOTLDKTCP.h"
+
+#ifdef PEPO_HOST_BACKENDS
+
+static struct PEPOHostBackend HostBackends[PEPO_HOST_BACKENDS_MAX];
+static uint32_t NumHostBackends;
+
+//
+// Add a backend of IPv4:port
+//
+//
+static int
+HostBackendAdd(
+    const char* Addr,
+    uint16_t Port
+) {
+    struct in_addr ip;
+    struct PEPOHostBackend* backend;
+
+    if (NumHostBackends == PEPO_HOST_BACKENDS_MAX) {
+        RTE_LOG(ERR, USER1, "%s: more than %u host backends\n", __func__, PEPO_HOST_BACKENDS_MAX);
+        return -E2BIG;
+    }
+    if (Port == 0 || strlen(Addr) >= sizeof(backend->IPv4Addr) || inet_pton(AF_INET, Addr, &ip) != 1) {
+        RTE_LOG(ERR, USER1, "%s: invalid host backend %s:%u\n", __func__, Addr, Port);
+        return -EINVAL;
+    }
+
+    backend = &HostBackends[NumHostBackends++];
+    strcpy(backend->IPv4Addr, Addr);
+    backend->TCPPort = Port;
+    atomic_init(&backend->Outstanding, 0);
+    atomic_init(&backend->Connections, 0);
+    atomic_init(&backend->Failures, 0);
+    atomic_init(&backend->DownUntil, 0);
+
+    RTE_LOG(NOTICE, USER1, "%s: host backend %u is %s:%u\n", __func__, NumHostBackends - 1, Addr, Port);
+
+    return 0;
+}
+
+//
+// Set up the backends from a list of IPv4:port separated by commas, or the one host address and port
+// if the list is empty; return 0 on success
+//
+//
+int
+PEPOHostBackendsInit(
+    const char* List,
+    const char* HostIPv4Addr,
+    uint16_t HostTCPPort
+) {
+    char list[PEPO_HOST_BACKENDS_LIST_BYTES];
+    char *entry, *colon, *end, *save;
+    unsigned long port;
+    int result;
+
+    NumHostBackends = 0;
+
+    if (List == NULL || List[0] == '\0') {
+        return HostBackendAdd(HostIPv4Addr, HostTCPPort);
+    }
+
+    if (strlen(List) >= sizeof(list)) {
+        RTE_LOG(ERR, USER1, "%s: the list of host backends is longer than %u\n", __func__,
+            PEPO_HOST_BACKENDS_LIST_BYTES - 1);
+        return -EINVAL;
+    }
+    strcpy(list, List);
+
+    for (entry = strtok_r(list, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+        while (*entry == ' ') {
+            entry++;
+        }
+        colon = strchr(entry, ':');
+        if (colon == NULL) {
+            RTE_LOG(ERR, USER1, "%s: host backend %s has no port\n", __func__, entry);
+            return -EINVAL;
+        }
+        *colon = '\0';
+        port = strtoul(colon + 1, &end, 10);
+        if (end == colon + 1 || (*end != '\0' && *end != ' ') || port > UINT16_MAX) {
+            RTE_LOG(ERR, USER1, "%s: host backend %s has an invalid port\n", __func__, entry);
+            return -EINVAL;
+        }
+
+        result = HostBackendAdd(entry, (uint16_t)port);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return NumHostBackends != 0 ? 0 : -EINVAL;
+}
+
+//
+// Pick the backend of a new host leg and count the leg on it; with all of them down,
+// the one that is up the soonest is tried
+// The search starts at a backend of its own for every lcore, so that the lcores spread their legs on ties
+//
+//
+struct PEPOHostBackend*
+PEPOHostBackendOpen(void) {
+    uint64_t now = rte_get_tsc_cycles();
+    struct PEPOHostBackend *best = NULL, *soonest = NULL, *backend;
+    uint32_t outstanding, connections, bestOutstanding = 0, bestConnections = 0;
+    uint32_t start = rte_lcore_id() % NumHostBackends;
+
+    for (uint32_t i = 0; i != NumHostBackends; i++) {
+        backend = &HostBackends[(start + i) % NumHostBackends];
+
+        if (atomic_load_explicit(&backend->DownUntil, memory_order_relaxed) > now) {
+            if (soonest == NULL || backend->DownUntil < soonest->DownUntil) {
+                soonest = backend;
+            }
+            continue;
+        }
+
+        outstanding = atomic_load_explicit(&backend->Outstanding, memory_order_relaxed);
+        connections = atomic_load_explicit(&backend->Connections, memory_order_relaxed);
+        if (best == NULL || outstanding < bestOutstanding ||
+            (outstanding == bestOutstanding && connections < bestConnections)) {
+            best = backend;
+            bestOutstanding = outstanding;
+            bestConnections = connections;
+        }
+    }
+
+    if (best == NULL) {
+        best = soonest;
+    }
+    atomic_fetch_add_explicit(&best->Connections, 1, memory_order_relaxed);
+
+    return best;
+}
+
+//
+// A host leg of a backend is closed, with Awaiting requests not answered; Failed if it failed
+// before the backend sent anything on it
+//
+//
+void
+PEPOHostBackendClose(
+    struct PEPOHostBackend* Backend,
+    uint32_t Awaiting,
+    bool Failed
+) {
+    uint32_t failures;
+
+    if (Awaiting != 0) {
+        atomic_fetch_sub_explicit(&Backend->Outstanding, Awaiting, memory_order_relaxed);
+    }
+    atomic_fetch_sub_explicit(&Backend->Connections, 1, memory_order_relaxed);
+
+    if (!Failed) {
+        return;
+    }
+
+    failures = atomic_fetch_add_explicit(&Backend->Failures, 1, memory_order_relaxed) + 1;
+    if (failures >= PEPO_HOST_BACKEND_MAX_FAILS) {
+        atomic_store_explicit(&Backend->DownUntil,
+            rte_get_tsc_cycles() + rte_get_tsc_hz() / 1000 * PEPO_HOST_BACKEND_DOWN_MS, memory_order_relaxed);
+        if (failures == PEPO_HOST_BACKEND_MAX_FAILS) {
+            RTE_LOG(WARNING, USER1, "%s: host backend %s:%u is down after %u failures\n", __func__,
+                Backend->IPv4Addr, Backend->TCPPort, failures);
+        }
+    }
+}
+
+//
+// Log the load of the backends
+//
+//
+void
+PEPOHostBackendsLog(void) {
+    uint64_t now = rte_get_tsc_cycles();
+
+    for (uint32_t i = 0; i != NumHostBackends; i++) {
+        RTE_LOG(NOTICE, USER1, "host backend %s:%u: outstanding = %u, connections = %u, failures = %u%s\n",
+            HostBackends[i].IPv4Addr, HostBackends[i].TCPPort,
+            atomic_load(&HostBackends[i].Outstanding), atomic_load(&HostBackends[i].Connections),
+            atomic_load(&HostBackends[i].Failures), atomic_load(&HostBackends[i].DownUntil) > now ? ", down" : "");
+    }
+}
+#endif
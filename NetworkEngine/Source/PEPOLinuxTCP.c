@@ -3,15 +3,27 @@
  * Licensed under the MIT License
  */
 
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h> 
+#include <sys/epoll.h>
+#include <sys/queue.h>
+#include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include "BackEndControl.h"
 #include "PEPOLinuxTCP.h"
 
 const char* DPU_IP_ADDRESS = "192.168.200.32";
@@ -20,6 +32,27 @@ const char* HOST_IP_ADDRESS = "192.168.200.132";
 const int HOST_PORT = 3232;
 const int MAX_QUEUE_SIZE = 1000;
 
+//
+// Worker threads, each with its own listening socket on the DPU port, among which the kernel spreads
+// the connections, and its own epoll instance that serves them
+//
+//
+#define PEPO_LINUX_WORKERS 4
+#define PEPO_LINUX_MAX_EVENTS 64
+#define PEPO_LINUX_WAIT_MS 1000
+
+#ifdef PEPO_LINUX_MUX_HOST
+//
+// Connections to the host of every worker, opened when a client needs one, and the clients a worker serves;
+// a ClientId is the slot of its client and the generation of the slot
+//
+//
+#define PEPO_LINUX_HOST_CONNS 1
+#define PEPO_LINUX_MAX_CLIENTS 4096
+#define PEPO_LINUX_MAX_MSG_SIZE (1 << 20)
+#define PEPO_LINUX_CLIENT_SLOT_BITS 16
+#endif
+
 struct MessageHeader {
     uint8_t OffloadedToDPU;
     uint8_t LastMessage;
@@ -27,273 +60,1107 @@ struct MessageHeader {
     char Timestamp[10];
 };
 
-int ServerFd = -1;
+//
+// A client connection and its connection to the host; after the message size, which goes to the host,
+// every message is moved from the client to the host and the response back, or is echoed if it is offloaded to the DPU;
+// bytes move through a pipe of the connection with splice, and never reach user space.
+// Multiplexed, a client has no connection to the host: a message is received whole, and is queued
+// as a frame on a connection to the host shared with other clients, or echoed; the response is sent from where
+// the frame of the host was received
+//
+//
+enum PEPOConnState {
+    CONN_CONNECTING,
+    CONN_RECV_SIZE,
+    CONN_SEND_SIZE,
+    CONN_PEEK_HEADER,
+    CONN_MOVE,
+    CONN_DONE,
+    CONN_RECV_MSG,
+    CONN_WAIT_HOST,
+    CONN_SEND_RESP
+};
 
 //
-// Initialize the PEPO based on Linux TCP/IP
+// What an epoll event is for, the first member of its data
 //
 //
-int
-PEPOLinuxTCPInit(void) {
-    return 0;
-}
+enum PEPOFdKind {
+    PEPO_FD_CLIENT,
+    PEPO_FD_HOST
+};
 
+struct PEPOConn {
+    enum PEPOFdKind Kind;
+    int ClientFd;
+    int HostFd;
+    int Pipe[2];
+    enum PEPOConnState State;
+    enum PEPOConnState NextState; /* where a move goes once it completes */
+    int MsgSize;
+    int SizeBytes; /* of the message size, received or sent */
+    int MoveSrc;
+    int MoveDst;
+    size_t MoveRemaining; /* bytes not yet taken from the source */
+    size_t MoveInPipe; /* bytes in the pipe, not yet given to the destination */
+    bool Closed;
+#ifdef PEPO_LINUX_MUX_HOST
+    uint32_t ClientId;
+    struct PEPOHostConn* Host;
+    char* Buf; /* the message being received, or the response being sent */
+    int BufBytes; /* received of the message, or sent of the response */
+    int RespSize;
+#endif
+    LIST_ENTRY(PEPOConn) Link;
+};
+
+#ifdef PEPO_LINUX_MUX_HOST
 //
-// Run the PEPO
+// A connection to the host; frames are appended to SendBuf, which grows to at most a message per client,
+// and a frame received goes straight to the buffer of its client, or is discarded if the client is gone
 //
 //
-int
-PEPOLinuxTCPRun(void) {
-    int ServerFd, hostServerFd, clientFd;
-    struct sockaddr_in serverAddr, hostServerAddr, clientAddr;
-    socklen_t clientLen;
-    
-    //
-    // create DPU server socket
-    //
-    //
-    ServerFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (ServerFd < 0) {
-        perror("ERROR opening socket");
-        return 1;
-    }
-    
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = inet_addr(DPU_IP_ADDRESS);
-    serverAddr.sin_port = htons(DPU_PORT);
-    if (bind(ServerFd, (struct sockaddr *) &serverAddr, sizeof(serverAddr)) < 0) {
-        perror("ERROR on binding");
-        return 1;
-    }
-    
-    //
-    // listen for connections
-    //
-    //
-    if (listen(ServerFd, MAX_QUEUE_SIZE) < 0) {
-        perror("ERROR on listening");
-        return 1;
-    }
-    
-    printf("Server is listening on %s:%d\n", inet_ntoa(serverAddr.sin_addr), DPU_PORT);
-    
-    while (1) {
-        //
-        // accept connection
-        //
-        //
-        clientLen = sizeof(clientAddr);
-        clientFd = accept(ServerFd, (struct sockaddr *) &clientAddr, &clientLen);
-        if (clientFd < 0) {
-            perror("ERROR on accepting connection");
-            return 1;
-        }
+struct PEPOHostConn {
+    enum PEPOFdKind Kind;
+    int Fd;
+    int NumClients;
+    char* SendBuf;
+    size_t SendHead;
+    size_t SendTail;
+    size_t SendCap;
+    struct PEPOMuxHeader RecvHdr;
+    size_t RecvHdrBytes;
+    uint32_t RecvBytes; /* of the bytes of the frame */
+    struct PEPOConn* RecvConn;
+};
+#endif
 
-        //
-        // Connect to host
-        //
-        //
-        hostServerFd = socket(AF_INET, SOCK_STREAM, 0);
-        if (hostServerFd < 0) {
-            perror("ERROR opening socket");
-            return 1;
-        }
+struct PEPOWorker {
+    pthread_t Thread;
+    int Id;
+    int EpollFd;
+    int ListenFd;
+    LIST_HEAD(, PEPOConn) Conns;
+    LIST_HEAD(, PEPOConn) Closed;
+#ifdef PEPO_LINUX_MUX_HOST
+    struct PEPOHostConn Hosts[PEPO_LINUX_HOST_CONNS];
+    struct PEPOConn* Clients[PEPO_LINUX_MAX_CLIENTS];
+    uint16_t ClientGens[PEPO_LINUX_MAX_CLIENTS];
+    uint32_t NextClient; /* where the search for a free client slot starts */
+#endif
+};
 
-        memset(&hostServerAddr, 0, sizeof(hostServerAddr));
-        hostServerAddr.sin_family = AF_INET;
-        hostServerAddr.sin_addr.s_addr = inet_addr(HOST_IP_ADDRESS);
-        hostServerAddr.sin_port = htons(HOST_PORT);
-        if (connect(hostServerFd, (struct sockaddr *) &hostServerAddr, sizeof(hostServerAddr)) < 0) {
-            perror("ERROR on connecting to host");
-            close(clientFd);
-            return 1;
+static struct PEPOWorker Workers[PEPO_LINUX_WORKERS];
+static volatile int PEPOLinuxStop = 0;
+
+#ifndef PEPO_LINUX_MUX_HOST
+//
+// Move bytes from the source to the destination of a move; return 1 when all are moved,
+// 0 when it has to wait for the sockets, and a negative error otherwise
+//
+//
+static int
+ConnMove(
+    struct PEPOConn* Conn
+) {
+    ssize_t n;
+    bool progress;
+
+    for (;;) {
+        progress = false;
+
+        if (Conn->MoveRemaining != 0) {
+            n = splice(Conn->MoveSrc, NULL, Conn->Pipe[1], NULL, Conn->MoveRemaining, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                Conn->MoveRemaining -= n;
+                Conn->MoveInPipe += n;
+                progress = true;
+            }
+            else if (n == 0) {
+                return -ECONNRESET;
+            }
+            else if (errno != EAGAIN) {
+                return -errno;
+            }
         }
 
-        //
-        // Receive the first message
-        // Forward this message to the host
-        //
-        //
-        int msgSize = 0;
-        int iResult = read(clientFd, (char*)&msgSize, sizeof(int));
-        if (iResult < 0 || iResult != sizeof(int)) {
-            perror("ERROR on reading from client");
-            close(clientFd);
-            close(hostServerFd);
-            return 1;
+        if (Conn->MoveInPipe != 0) {
+            n = splice(Conn->Pipe[0], NULL, Conn->MoveDst, NULL, Conn->MoveInPipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                Conn->MoveInPipe -= n;
+                progress = true;
+            }
+            else if (n < 0 && errno != EAGAIN) {
+                return -errno;
+            }
         }
 
-        iResult = write(hostServerFd, (const char*)&msgSize, sizeof(int));
-        if (iResult < 0 || iResult != sizeof(int)) {
-            perror("ERROR on writing to host");
-            close(clientFd);
-            close(hostServerFd);
+        if (Conn->MoveRemaining == 0 && Conn->MoveInPipe == 0) {
             return 1;
         }
 
-        printf("Starting measurement (%d-byte messages)...\n", msgSize);
-
-        char* recvBuffer = (char*)malloc(msgSize);
-        memset(recvBuffer, 0, msgSize);
-
-        int oneReceive = 0;
-        int remainingBytesToReceive = msgSize;
+        if (!progress) {
+            return 0;
+        }
+    }
+}
 
-        int oneSend = 0;
-        int remainingBytesToSend = msgSize;
-        
-        printf("Client connected from %s:%d\n", inet_ntoa(clientAddr.sin_addr), ntohs(clientAddr.sin_port));
+//
+// Start moving a message
+//
+//
+static void
+ConnStartMove(
+    struct PEPOConn* Conn,
+    int Src,
+    int Dst,
+    enum PEPOConnState Next
+) {
+    Conn->MoveSrc = Src;
+    Conn->MoveDst = Dst;
+    Conn->MoveRemaining = Conn->MsgSize;
+    Conn->MoveInPipe = 0;
+    Conn->NextState = Next;
+    Conn->State = CONN_MOVE;
+}
 
-        while (1) {
-            //
-            // Receive message from client and send response
-            //
-            //
-            while (oneReceive < msgSize) {
-                iResult = read(clientFd, recvBuffer + oneReceive, remainingBytesToReceive);
+//
+// Advance a connection as far as its sockets allow; return 0 to wait for them, and a negative error
+// or 1 once the connection is done, to close it
+//
+//
+static int
+ConnRun(
+    struct PEPOConn* Conn
+) {
+    struct MessageHeader header;
+    struct sockaddr_in peer;
+    socklen_t len;
+    ssize_t n;
+    int err, result;
 
-                if (iResult < 0) {
-                    perror("ERROR on reading from client");
-                    close(clientFd);
-                    close(hostServerFd);
+    for (;;) {
+        switch (Conn->State) {
+            case CONN_CONNECTING:
+            {
+                len = sizeof(err);
+                if (getsockopt(Conn->HostFd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+                    fprintf(stderr, "ERROR on connecting to host: %s\n", strerror(err));
+                    return -ECONNREFUSED;
+                }
+                len = sizeof(peer);
+                if (getpeername(Conn->HostFd, (struct sockaddr *)&peer, &len) != 0) {
+                    return 0;
+                }
+                Conn->State = CONN_RECV_SIZE;
+                break;
+            }
+            case CONN_RECV_SIZE:
+            {
+                n = recv(Conn->ClientFd, (char*)&Conn->MsgSize + Conn->SizeBytes, sizeof(int) - Conn->SizeBytes, 0);
+                if (n == 0) {
                     return 1;
                 }
-
-                oneReceive += iResult;
-                remainingBytesToReceive = msgSize - oneReceive;
+                if (n < 0) {
+                    return errno == EAGAIN ? 0 : -errno;
+                }
+                Conn->SizeBytes += n;
+                if (Conn->SizeBytes == sizeof(int)) {
+                    if (Conn->MsgSize < (int)sizeof(struct MessageHeader)) {
+                        fprintf(stderr, "ERROR on reading from client: %d-byte messages\n", Conn->MsgSize);
+                        return -EINVAL;
+                    }
+                    Conn->SizeBytes = 0;
+                    Conn->State = CONN_SEND_SIZE;
+                }
+                break;
             }
-
-            oneReceive = 0;
-            remainingBytesToReceive = msgSize;
-
-            //
-            // Check if this is the last message
-            //
-            //
-            if (((struct MessageHeader*)recvBuffer)->LastMessage) {
+            case CONN_SEND_SIZE:
+            {
+                n = send(Conn->HostFd, (char*)&Conn->MsgSize + Conn->SizeBytes, sizeof(int) - Conn->SizeBytes, MSG_NOSIGNAL);
+                if (n < 0) {
+                    return errno == EAGAIN ? 0 : -errno;
+                }
+                Conn->SizeBytes += n;
+                if (Conn->SizeBytes == sizeof(int)) {
+                    printf("Client starts measurement (%d-byte messages)\n", Conn->MsgSize);
+                    Conn->State = CONN_PEEK_HEADER;
+                }
+                break;
+            }
+            case CONN_PEEK_HEADER:
+            {
                 //
-                // Forward this message to the host
+                // The header stays in the socket, to be moved with the rest of the message
                 //
                 //
-                while (oneSend < msgSize) {
-                    iResult = write(hostServerFd, recvBuffer + oneSend, remainingBytesToSend);
-                    if (iResult < 0) {
-                        perror("ERROR on writing to host");
-                        close(hostServerFd);
-                        close(clientFd);
-                        return 1;
-                    }
-
-                    oneSend += iResult;
-                    remainingBytesToSend = msgSize - oneSend;
+                n = recv(Conn->ClientFd, &header, sizeof(header), MSG_PEEK);
+                if (n == 0) {
+                    return 1;
+                }
+                if (n < 0) {
+                    return errno == EAGAIN ? 0 : -errno;
+                }
+                if (n != sizeof(header)) {
+                    return 0;
                 }
 
-                oneSend = 0;
-                remainingBytesToSend = msgSize;
-
+                if (header.LastMessage) {
+                    ConnStartMove(Conn, Conn->ClientFd, Conn->HostFd, CONN_DONE);
+                }
+                else if (!header.OffloadedToDPU) {
+                    ConnStartMove(Conn, Conn->ClientFd, Conn->HostFd, CONN_MOVE);
+                }
+                else {
+                    ConnStartMove(Conn, Conn->ClientFd, Conn->ClientFd, CONN_PEEK_HEADER);
+                }
                 break;
             }
+            case CONN_MOVE:
+            {
+                result = ConnMove(Conn);
+                if (result <= 0) {
+                    return result;
+                }
 
-            //
-            // Check if this message is for the host
-            //
-            //
-            if (!((struct MessageHeader*)recvBuffer)->OffloadedToDPU) {
                 //
-                // Send message to host
+                // A message the host got is followed by its response
                 //
                 //
-                while (oneSend < msgSize) {
-                    iResult = write(hostServerFd, recvBuffer + oneSend, remainingBytesToSend);
-                    if (iResult < 0) {
-                        perror("ERROR on writing to host");
-                        close(hostServerFd);
-                        close(clientFd);
-                        return 1;
-                    }
+                if (Conn->NextState == CONN_MOVE) {
+                    ConnStartMove(Conn, Conn->HostFd, Conn->ClientFd, CONN_PEEK_HEADER);
+                }
+                else {
+                    Conn->State = Conn->NextState;
+                }
+                break;
+            }
+            case CONN_DONE:
+            {
+                printf("Client completes measurement\n");
+                return 1;
+            }
+            default:
+            {
+                return -EINVAL;
+            }
+        }
+    }
+}
+
+#else
+//
+// Append a frame to the send buffer of a connection to the host; it is sent with the other frames
+// of the batch of events
+//
+//
+static int
+HostQueue(
+    struct PEPOHostConn* Host,
+    uint32_t ClientId,
+    uint16_t Type,
+    const void* Bytes,
+    uint32_t NumBytes
+) {
+    struct PEPOMuxHeader header;
+    size_t need = sizeof(header) + NumBytes;
+    size_t cap;
+    char* buf;
+
+    if (Host->SendCap - Host->SendTail < need && Host->SendHead != 0) {
+        memmove(Host->SendBuf, Host->SendBuf + Host->SendHead, Host->SendTail - Host->SendHead);
+        Host->SendTail -= Host->SendHead;
+        Host->SendHead = 0;
+    }
+
+    if (Host->SendCap - Host->SendTail < need) {
+        cap = Host->SendCap != 0 ? Host->SendCap : 64 * 1024;
+        while (cap - Host->SendTail < need) {
+            cap *= 2;
+        }
+        buf = (char*)realloc(Host->SendBuf, cap);
+        if (buf == NULL) {
+            return -ENOMEM;
+        }
+        Host->SendBuf = buf;
+        Host->SendCap = cap;
+    }
+
+    header.ClientId = ClientId;
+    header.Type = Type;
+    header.Reserved = 0;
+    header.Bytes = NumBytes;
+    memcpy(Host->SendBuf + Host->SendTail, &header, sizeof(header));
+    if (NumBytes != 0) {
+        memcpy(Host->SendBuf + Host->SendTail + sizeof(header), Bytes, NumBytes);
+    }
+    Host->SendTail += need;
 
-                    oneSend += iResult;
-                    remainingBytesToSend = msgSize - oneSend;
+    return 0;
+}
+
+//
+// Advance a multiplexed client as far as its socket allows; return 0 to wait for it or for the host,
+// and a negative error or 1 once the client is done, to close it
+//
+//
+static int
+ConnRunMux(
+    struct PEPOConn* Conn
+) {
+    struct MessageHeader header;
+    ssize_t n;
+
+    for (;;) {
+        switch (Conn->State) {
+            case CONN_RECV_SIZE:
+            {
+                n = recv(Conn->ClientFd, (char*)&Conn->MsgSize + Conn->SizeBytes, sizeof(int) - Conn->SizeBytes, 0);
+                if (n == 0) {
+                    return 1;
+                }
+                if (n < 0) {
+                    return errno == EAGAIN ? 0 : -errno;
+                }
+                Conn->SizeBytes += n;
+                if (Conn->SizeBytes != sizeof(int)) {
+                    break;
                 }
 
-                oneSend = 0;
-                remainingBytesToSend = msgSize;
+                if (Conn->MsgSize < (int)sizeof(struct MessageHeader) || Conn->MsgSize > PEPO_LINUX_MAX_MSG_SIZE) {
+                    fprintf(stderr, "ERROR on reading from client: %d-byte messages\n", Conn->MsgSize);
+                    return -EINVAL;
+                }
+                Conn->Buf = (char*)malloc(Conn->MsgSize);
+                if (Conn->Buf == NULL ||
+                    HostQueue(Conn->Host, Conn->ClientId, MUX_FRAME_OPEN, &Conn->MsgSize, sizeof(int)) != 0) {
+                    return -ENOMEM;
+                }
 
-                //
-                // Receive response from host
-                //
-                //
-                while (oneReceive < msgSize) {
-                    iResult = read(hostServerFd, recvBuffer + oneReceive, remainingBytesToReceive);
+                printf("Client starts measurement (%d-byte messages)\n", Conn->MsgSize);
+                Conn->BufBytes = 0;
+                Conn->State = CONN_RECV_MSG;
+                break;
+            }
+            case CONN_RECV_MSG:
+            {
+                n = recv(Conn->ClientFd, Conn->Buf + Conn->BufBytes, Conn->MsgSize - Conn->BufBytes, 0);
+                if (n == 0) {
+                    return 1;
+                }
+                if (n < 0) {
+                    return errno == EAGAIN ? 0 : -errno;
+                }
+                Conn->BufBytes += n;
+                if (Conn->BufBytes != Conn->MsgSize) {
+                    break;
+                }
 
-                    if (iResult < 0) {
-                        perror("ERROR on reading from host");
-                        close(hostServerFd);
-                        close(clientFd);
+                memcpy(&header, Conn->Buf, sizeof(header));
+                if (header.LastMessage || !header.OffloadedToDPU) {
+                    if (HostQueue(Conn->Host, Conn->ClientId, MUX_FRAME_DATA, Conn->Buf, Conn->MsgSize) != 0) {
+                        return -ENOMEM;
+                    }
+                    if (header.LastMessage) {
+                        printf("Client completes measurement\n");
                         return 1;
                     }
+                    Conn->State = CONN_WAIT_HOST;
+                    return 0;
+                }
 
-                    oneReceive += iResult;
-                    remainingBytesToReceive = msgSize - oneReceive;
+                Conn->RespSize = Conn->MsgSize;
+                Conn->BufBytes = 0;
+                Conn->State = CONN_SEND_RESP;
+                break;
+            }
+            case CONN_WAIT_HOST:
+            {
+                return 0;
+            }
+            case CONN_SEND_RESP:
+            {
+                n = send(Conn->ClientFd, Conn->Buf + Conn->BufBytes, Conn->RespSize - Conn->BufBytes, MSG_NOSIGNAL);
+                if (n < 0) {
+                    return errno == EAGAIN ? 0 : -errno;
+                }
+                Conn->BufBytes += n;
+                if (Conn->BufBytes == Conn->RespSize) {
+                    Conn->BufBytes = 0;
+                    Conn->State = CONN_RECV_MSG;
                 }
+                break;
+            }
+            default:
+            {
+                return -EINVAL;
+            }
+        }
+    }
+}
+#endif
+
+//
+// Close a connection; it is freed after the events of the batch it was closed in
+//
+//
+static void
+ConnClose(
+    struct PEPOWorker* Worker,
+    struct PEPOConn* Conn
+) {
+    if (Conn->Closed) {
+        return;
+    }
 
-                oneReceive = 0;
-                remainingBytesToReceive = msgSize;
+    epoll_ctl(Worker->EpollFd, EPOLL_CTL_DEL, Conn->ClientFd, NULL);
+    close(Conn->ClientFd);
+#ifdef PEPO_LINUX_MUX_HOST
+    //
+    // The host is told, unless the connection to it is gone, and the frame it may be receiving for the client
+    // is discarded
+    //
+    //
+    if (Conn->Host != NULL) {
+        if (Conn->Host->Fd >= 0) {
+            HostQueue(Conn->Host, Conn->ClientId, MUX_FRAME_CLOSE, NULL, 0);
+        }
+        if (Conn->Host->RecvConn == Conn) {
+            Conn->Host->RecvConn = NULL;
+        }
+        Conn->Host->NumClients--;
+    }
+    Worker->Clients[Conn->ClientId & (PEPO_LINUX_MAX_CLIENTS - 1)] = NULL;
+    free(Conn->Buf);
+    Conn->Buf = NULL;
+#else
+    epoll_ctl(Worker->EpollFd, EPOLL_CTL_DEL, Conn->HostFd, NULL);
+    close(Conn->HostFd);
+    close(Conn->Pipe[0]);
+    close(Conn->Pipe[1]);
+#endif
+
+    Conn->Closed = true;
+    LIST_REMOVE(Conn, Link);
+    LIST_INSERT_HEAD(&Worker->Closed, Conn, Link);
+}
+
+#ifdef PEPO_LINUX_MUX_HOST
+//
+// Send what the send buffer of a connection to the host has; return 0 when it is sent or has to wait
+// for the socket, and a negative error otherwise
+//
+//
+static int
+HostFlush(
+    struct PEPOHostConn* Host
+) {
+    ssize_t n;
+
+    while (Host->SendHead != Host->SendTail) {
+        n = send(Host->Fd, Host->SendBuf + Host->SendHead, Host->SendTail - Host->SendHead, MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno == EAGAIN ? 0 : -errno;
+        }
+        Host->SendHead += n;
+    }
+
+    Host->SendHead = 0;
+    Host->SendTail = 0;
+
+    return 0;
+}
+
+//
+// Close a connection to the host that failed, with its clients, which can't get their responses anymore
+//
+//
+static void
+HostClose(
+    struct PEPOWorker* Worker,
+    struct PEPOHostConn* Host
+) {
+    struct PEPOConn* conn;
+    struct PEPOConn* next;
+
+    if (Host->Fd < 0) {
+        return;
+    }
+
+    epoll_ctl(Worker->EpollFd, EPOLL_CTL_DEL, Host->Fd, NULL);
+    close(Host->Fd);
+    Host->Fd = -1;
+
+    for (conn = LIST_FIRST(&Worker->Conns); conn != NULL; conn = next) {
+        next = LIST_NEXT(conn, Link);
+        if (conn->Host == Host) {
+            ConnClose(Worker, conn);
+        }
+    }
+
+    Host->SendHead = 0;
+    Host->SendTail = 0;
+    Host->RecvHdrBytes = 0;
+    Host->RecvBytes = 0;
+    Host->RecvConn = NULL;
+}
+
+//
+// The client a frame from the host goes to, or NULL to discard it; a client only takes the response
+// it waits for, and a response larger than its messages ends it
+//
+//
+static struct PEPOConn*
+HostRecvTarget(
+    struct PEPOWorker* Worker,
+    struct PEPOHostConn* Host
+) {
+    uint32_t slot = Host->RecvHdr.ClientId & (PEPO_LINUX_MAX_CLIENTS - 1);
+    struct PEPOConn* conn = Worker->Clients[slot];
+
+    if (Host->RecvHdr.Type != MUX_FRAME_DATA || conn == NULL || conn->ClientId != Host->RecvHdr.ClientId ||
+        conn->Host != Host || conn->State != CONN_WAIT_HOST) {
+        return NULL;
+    }
+
+    if (Host->RecvHdr.Bytes > (uint32_t)conn->MsgSize) {
+        fprintf(stderr, "ERROR on reading from host: %u-byte response to %d-byte messages\n",
+            Host->RecvHdr.Bytes, conn->MsgSize);
+        ConnClose(Worker, conn);
+        return NULL;
+    }
+
+    return conn;
+}
+
+//
+// Receive the frames of the host into the buffers of their clients, and start sending the responses;
+// return 0 when the socket has no more, and a negative error otherwise
+//
+//
+static int
+HostRecv(
+    struct PEPOWorker* Worker,
+    struct PEPOHostConn* Host
+) {
+    char discard[4096];
+    struct PEPOConn* conn;
+    ssize_t n;
+
+    for (;;) {
+        if (Host->RecvHdrBytes != sizeof(Host->RecvHdr)) {
+            n = recv(Host->Fd, (char*)&Host->RecvHdr + Host->RecvHdrBytes, sizeof(Host->RecvHdr) - Host->RecvHdrBytes, 0);
+            if (n == 0) {
+                return -ECONNRESET;
+            }
+            if (n < 0) {
+                return errno == EAGAIN ? 0 : -errno;
+            }
+            Host->RecvHdrBytes += n;
+            if (Host->RecvHdrBytes != sizeof(Host->RecvHdr)) {
+                continue;
             }
+            Host->RecvBytes = 0;
+            Host->RecvConn = HostRecvTarget(Worker, Host);
+        }
 
-            //
-            // Send response to client
-            //
-            //
-            while (oneSend < msgSize) {
-                iResult = write(clientFd, recvBuffer + oneSend, remainingBytesToSend);
-                if (iResult < 0) {
-                    perror("ERROR on writing to client");
-                    close(hostServerFd);
-                    close(clientFd);
-                    return 1;
-                }
+        if (Host->RecvBytes != Host->RecvHdr.Bytes) {
+            conn = Host->RecvConn;
+            if (conn != NULL) {
+                n = recv(Host->Fd, conn->Buf + Host->RecvBytes, Host->RecvHdr.Bytes - Host->RecvBytes, 0);
+            }
+            else {
+                n = Host->RecvHdr.Bytes - Host->RecvBytes;
+                n = recv(Host->Fd, discard, n < (ssize_t)sizeof(discard) ? n : (ssize_t)sizeof(discard), 0);
+            }
+            if (n == 0) {
+                return -ECONNRESET;
+            }
+            if (n < 0) {
+                return errno == EAGAIN ? 0 : -errno;
+            }
+            Host->RecvBytes += n;
+            if (Host->RecvBytes != Host->RecvHdr.Bytes) {
+                continue;
+            }
+        }
 
-                oneSend += iResult;
-                remainingBytesToSend = msgSize - oneSend;
+        conn = Host->RecvConn;
+        Host->RecvHdrBytes = 0;
+        Host->RecvConn = NULL;
+        if (conn != NULL) {
+            conn->RespSize = Host->RecvHdr.Bytes;
+            conn->BufBytes = 0;
+            conn->State = CONN_SEND_RESP;
+            if (ConnRunMux(conn) != 0) {
+                ConnClose(Worker, conn);
             }
+        }
+    }
+}
+
+//
+// Connect to the host; the connection is kept for the clients to come
+//
+//
+static int
+HostConnect(
+    struct PEPOWorker* Worker,
+    struct PEPOHostConn* Host
+) {
+    struct sockaddr_in hostServerAddr;
+    struct epoll_event ev;
+    int one = 1;
+
+    Host->Fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (Host->Fd < 0) {
+        perror("ERROR opening socket");
+        return -1;
+    }
 
-            oneSend = 0;
-            remainingBytesToSend = msgSize;
+    memset(&hostServerAddr, 0, sizeof(hostServerAddr));
+    hostServerAddr.sin_family = AF_INET;
+    hostServerAddr.sin_addr.s_addr = inet_addr(HOST_IP_ADDRESS);
+    hostServerAddr.sin_port = htons(HOST_PORT);
+    if (connect(Host->Fd, (struct sockaddr *) &hostServerAddr, sizeof(hostServerAddr)) < 0) {
+        perror("ERROR on connecting to host");
+        close(Host->Fd);
+        Host->Fd = -1;
+        return -1;
+    }
+
+    setsockopt(Host->Fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(Host->Fd, F_SETFL, fcntl(Host->Fd, F_GETFL) | O_NONBLOCK);
+
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = Host;
+    if (epoll_ctl(Worker->EpollFd, EPOLL_CTL_ADD, Host->Fd, &ev) != 0) {
+        perror("ERROR on adding host connection to epoll");
+        close(Host->Fd);
+        Host->Fd = -1;
+        return -1;
+    }
+
+    printf("Connected to host (worker %d)\n", Worker->Id);
+
+    return 0;
+}
+
+//
+// Set up a multiplexed client just accepted, on the connection to the host with the fewest clients
+//
+//
+static void
+ConnOpenMux(
+    struct PEPOWorker* Worker,
+    int ClientFd
+) {
+    struct PEPOConn* conn;
+    struct PEPOHostConn* host = NULL;
+    struct epoll_event ev;
+    uint32_t i, slot;
+    int one = 1;
+
+    for (i = 0; i != PEPO_LINUX_HOST_CONNS; i++) {
+        if (Worker->Hosts[i].Fd < 0 && HostConnect(Worker, &Worker->Hosts[i]) != 0) {
+            continue;
+        }
+        if (host == NULL || Worker->Hosts[i].NumClients < host->NumClients) {
+            host = &Worker->Hosts[i];
         }
+    }
+
+    for (i = 0; i != PEPO_LINUX_MAX_CLIENTS; i++) {
+        slot = (Worker->NextClient + i) & (PEPO_LINUX_MAX_CLIENTS - 1);
+        if (Worker->Clients[slot] == NULL) {
+            break;
+        }
+    }
+
+    if (host == NULL || i == PEPO_LINUX_MAX_CLIENTS) {
+        fprintf(stderr, "ERROR on accepting client: %s\n", host == NULL ? "no connection to host" : "too many clients");
+        close(ClientFd);
+        return;
+    }
+
+    conn = (struct PEPOConn*)calloc(1, sizeof(struct PEPOConn));
+    if (conn == NULL) {
+        close(ClientFd);
+        return;
+    }
+
+    setsockopt(ClientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn->Kind = PEPO_FD_CLIENT;
+    conn->ClientFd = ClientFd;
+    conn->HostFd = -1;
+    conn->State = CONN_RECV_SIZE;
+    conn->ClientId = slot | (uint32_t)(++Worker->ClientGens[slot]) << PEPO_LINUX_CLIENT_SLOT_BITS;
+    conn->Host = host;
+    host->NumClients++;
+    Worker->Clients[slot] = conn;
+    Worker->NextClient = slot + 1;
+
+    LIST_INSERT_HEAD(&Worker->Conns, conn, Link);
 
-        printf("Measurement completes\n");
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(Worker->EpollFd, EPOLL_CTL_ADD, conn->ClientFd, &ev) != 0) {
+        perror("ERROR on adding connection to epoll");
+        ConnClose(Worker, conn);
+        return;
+    }
+
+    if (ConnRunMux(conn) != 0) {
+        ConnClose(Worker, conn);
+    }
+}
+#else
+//
+// Set up a connection for a client just accepted, connecting to the host without blocking
+//
+//
+static void
+ConnOpen(
+    struct PEPOWorker* Worker,
+    int ClientFd
+) {
+    struct PEPOConn* conn;
+    struct sockaddr_in hostServerAddr;
+    struct epoll_event ev;
+    int one = 1;
+
+    conn = (struct PEPOConn*)calloc(1, sizeof(struct PEPOConn));
+    if (conn == NULL) {
+        close(ClientFd);
+        return;
+    }
+
+    conn->ClientFd = ClientFd;
+    conn->HostFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (conn->HostFd < 0) {
+        perror("ERROR opening socket");
+        close(ClientFd);
+        free(conn);
+        return;
+    }
+
+    if (pipe2(conn->Pipe, O_NONBLOCK) != 0) {
+        perror("ERROR opening pipe");
+        close(conn->HostFd);
+        close(ClientFd);
+        free(conn);
+        return;
+    }
+
+    setsockopt(conn->ClientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(conn->HostFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    memset(&hostServerAddr, 0, sizeof(hostServerAddr));
+    hostServerAddr.sin_family = AF_INET;
+    hostServerAddr.sin_addr.s_addr = inet_addr(HOST_IP_ADDRESS);
+    hostServerAddr.sin_port = htons(HOST_PORT);
+
+    conn->State = CONN_RECV_SIZE;
+    if (connect(conn->HostFd, (struct sockaddr *) &hostServerAddr, sizeof(hostServerAddr)) < 0) {
+        if (errno != EINPROGRESS) {
+            perror("ERROR on connecting to host");
+            close(conn->Pipe[0]);
+            close(conn->Pipe[1]);
+            close(conn->HostFd);
+            close(ClientFd);
+            free(conn);
+            return;
+        }
+        conn->State = CONN_CONNECTING;
+    }
+
+    LIST_INSERT_HEAD(&Worker->Conns, conn, Link);
 
     //
-        // Close the socket for this client and host server and handle the next connection
+    // Both sockets wake the connection up whenever they can go on
     //
     //
-        close(clientFd);
-        close(hostServerFd);
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = conn;
+    if (epoll_ctl(Worker->EpollFd, EPOLL_CTL_ADD, conn->ClientFd, &ev) != 0 ||
+        epoll_ctl(Worker->EpollFd, EPOLL_CTL_ADD, conn->HostFd, &ev) != 0) {
+        perror("ERROR on adding connection to epoll");
+        ConnClose(Worker, conn);
+        return;
+    }
+
+    if (ConnRun(conn) != 0) {
+        ConnClose(Worker, conn);
+    }
+}
+#endif
+
+//
+// Accept all pending clients
+//
+//
+static void
+WorkerAccept(
+    struct PEPOWorker* Worker
+) {
+    struct sockaddr_in clientAddr;
+    socklen_t clientLen;
+    int clientFd;
+
+    for (;;) {
+        clientLen = sizeof(clientAddr);
+        clientFd = accept4(Worker->ListenFd, (struct sockaddr *) &clientAddr, &clientLen, SOCK_NONBLOCK);
+        if (clientFd < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                perror("ERROR on accepting connection");
+            }
+            return;
+        }
+
+        printf("Client connected from %s:%d (worker %d)\n",
+            inet_ntoa(clientAddr.sin_addr), ntohs(clientAddr.sin_port), Worker->Id);
+#ifdef PEPO_LINUX_MUX_HOST
+        ConnOpenMux(Worker, clientFd);
+#else
+        ConnOpen(Worker, clientFd);
+#endif
+    }
+}
 
-        free(recvBuffer);
+//
+// Open the listening socket and the epoll instance of a worker
+//
+//
+static int
+WorkerInit(
+    struct PEPOWorker* Worker,
+    int Id
+) {
+    struct sockaddr_in serverAddr;
+    struct epoll_event ev;
+    int one = 1;
+
+    Worker->Id = Id;
+    Worker->EpollFd = -1;
+    LIST_INIT(&Worker->Conns);
+    LIST_INIT(&Worker->Closed);
+#ifdef PEPO_LINUX_MUX_HOST
+    for (int i = 0; i != PEPO_LINUX_HOST_CONNS; i++) {
+        Worker->Hosts[i].Kind = PEPO_FD_HOST;
+        Worker->Hosts[i].Fd = -1;
+    }
+#endif
+
+    Worker->ListenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (Worker->ListenFd < 0) {
+        perror("ERROR opening socket");
+        return -1;
+    }
+
+    setsockopt(Worker->ListenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(Worker->ListenFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = inet_addr(DPU_IP_ADDRESS);
+    serverAddr.sin_port = htons(DPU_PORT);
+    if (bind(Worker->ListenFd, (struct sockaddr *) &serverAddr, sizeof(serverAddr)) < 0) {
+        perror("ERROR on binding");
+        return -1;
+    }
+
+    if (listen(Worker->ListenFd, MAX_QUEUE_SIZE) < 0) {
+        perror("ERROR on listening");
+        return -1;
+    }
+
+    Worker->EpollFd = epoll_create1(0);
+    if (Worker->EpollFd < 0) {
+        perror("ERROR on creating epoll");
+        return -1;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(Worker->EpollFd, EPOLL_CTL_ADD, Worker->ListenFd, &ev) != 0) {
+        perror("ERROR on adding listening socket to epoll");
+        return -1;
     }
 
-    // Close the server socket
-    close(ServerFd);
-    
     return 0;
 }
 
 //
-// Stop the PEPO
+// Close the connections and sockets of a worker
+//
+//
+static void
+WorkerFini(
+    struct PEPOWorker* Worker
+) {
+    struct PEPOConn* conn;
+
+    while ((conn = LIST_FIRST(&Worker->Conns)) != NULL) {
+        ConnClose(Worker, conn);
+    }
+#ifdef PEPO_LINUX_MUX_HOST
+    for (int i = 0; i != PEPO_LINUX_HOST_CONNS; i++) {
+        HostClose(Worker, &Worker->Hosts[i]);
+        free(Worker->Hosts[i].SendBuf);
+        Worker->Hosts[i].SendBuf = NULL;
+        Worker->Hosts[i].SendCap = 0;
+    }
+#endif
+    while ((conn = LIST_FIRST(&Worker->Closed)) != NULL) {
+        LIST_REMOVE(conn, Link);
+        free(conn);
+    }
+
+    if (Worker->EpollFd >= 0) {
+        close(Worker->EpollFd);
+        Worker->EpollFd = -1;
+    }
+    if (Worker->ListenFd >= 0) {
+        close(Worker->ListenFd);
+        Worker->ListenFd = -1;
+    }
+}
+
+//
+// Serve the connections of a worker until the PEPO is stopped
+//
+//
+static void*
+WorkerMain(
+    void* Arg
+) {
+    struct PEPOWorker* worker = (struct PEPOWorker*)Arg;
+    struct epoll_event events[PEPO_LINUX_MAX_EVENTS];
+    struct PEPOConn* conn;
+#ifdef PEPO_LINUX_MUX_HOST
+    struct PEPOHostConn* host;
+#endif
+    int n, i;
+
+    while (!PEPOLinuxStop && !ForceQuitNetworkEngine) {
+        n = epoll_wait(worker->EpollFd, events, PEPO_LINUX_MAX_EVENTS, PEPO_LINUX_WAIT_MS);
+        if (n < 0 && errno != EINTR) {
+            perror("ERROR on waiting for events");
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            conn = (struct PEPOConn*)events[i].data.ptr;
+            if (conn == NULL) {
+                WorkerAccept(worker);
+            }
+#ifdef PEPO_LINUX_MUX_HOST
+            else if (conn->Kind == PEPO_FD_HOST) {
+                host = (struct PEPOHostConn*)events[i].data.ptr;
+                if (host->Fd >= 0 && (HostFlush(host) != 0 || HostRecv(worker, host) != 0)) {
+                    fprintf(stderr, "ERROR on connection to host (worker %d)\n", worker->Id);
+                    HostClose(worker, host);
+                }
+            }
+            else if (!conn->Closed && ConnRunMux(conn) != 0) {
+                ConnClose(worker, conn);
+            }
+#else
+            else if (!conn->Closed && ConnRun(conn) != 0) {
+                ConnClose(worker, conn);
+            }
+#endif
+        }
+
+#ifdef PEPO_LINUX_MUX_HOST
+        //
+        // Send the frames of the batch together
+        //
+        //
+        for (i = 0; i != PEPO_LINUX_HOST_CONNS; i++) {
+            host = &worker->Hosts[i];
+            if (host->Fd >= 0 && HostFlush(host) != 0) {
+                fprintf(stderr, "ERROR on sending to host (worker %d)\n", worker->Id);
+                HostClose(worker, host);
+            }
+        }
+#endif
+
+        while ((conn = LIST_FIRST(&worker->Closed)) != NULL) {
+            LIST_REMOVE(conn, Link);
+            free(conn);
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Initialize the PEPO based on Linux TCP/IP
 //
 //
 int
-PEPOLinuxTCPStop(void) {
-    if (ServerFd < 0) {
-        return 0;
+PEPOLinuxTCPInit(void) {
+    int i;
+
+    PEPOLinuxStop = 0;
+    signal(SIGPIPE, SIG_IGN);
+    for (i = 0; i != PEPO_LINUX_WORKERS; i++) {
+        Workers[i].ListenFd = -1;
+        Workers[i].EpollFd = -1;
+#ifdef PEPO_LINUX_MUX_HOST
+        for (int h = 0; h != PEPO_LINUX_HOST_CONNS; h++) {
+            Workers[i].Hosts[h].Fd = -1;
+        }
+#endif
     }
-    else {
-        close(ServerFd);
-        return 0;
+
+    for (i = 0; i != PEPO_LINUX_WORKERS; i++) {
+        if (WorkerInit(&Workers[i], i) != 0) {
+            PEPOLinuxTCPDestroy();
+            return 1;
+        }
     }
+
+    printf("Server is listening on %s:%d with %d workers\n", DPU_IP_ADDRESS, DPU_PORT, PEPO_LINUX_WORKERS);
+
+    return 0;
+}
+
+//
+// Run the PEPO until it is stopped
+//
+//
+int
+PEPOLinuxTCPRun(void) {
+    int i, result = 0;
+
+    for (i = 0; i != PEPO_LINUX_WORKERS; i++) {
+        if (pthread_create(&Workers[i].Thread, NULL, WorkerMain, &Workers[i]) != 0) {
+            perror("ERROR on creating worker");
+            PEPOLinuxStop = 1;
+            result = 1;
+            break;
+        }
+    }
+
+    while (i-- != 0) {
+        pthread_join(Workers[i].Thread, NULL);
+    }
+
+    return result;
+}
+
+//
+// Stop the PEPO
+//
+//
+int
+PEPOLinuxTCPStop(void) {
+    PEPOLinuxStop = 1;
+
+    return 0;
 }
 
 //
@@ -302,5 +1169,12 @@ PEPOLinuxTCPStop(void) {
 //
 int
 PEPOLinuxTCPDestroy(void) {
-    return PEPOLinuxTCPStop();
+    int i;
+
+    PEPOLinuxTCPStop();
+    for (i = 0; i != PEPO_LINUX_WORKERS; i++) {
+        WorkerFini(&Workers[i]);
+    }
+
+    return 0;
 }
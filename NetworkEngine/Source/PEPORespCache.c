@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_mempool.h>
+
+#include "PEPORespCache.h"
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+
+//
+// The data of a location, and the version it was read at; Data is NULL if the way is empty
+//
+//
+struct PEPORespCacheEntry {
+    FileIdT FileId;
+    FileIOSizeT Bytes;
+    FileSizeT Offset;
+    uint32_t Version;
+    uint32_t Reads;
+    char* Data;
+    rte_iova_t DataIova;
+    uint16_t BufLen;
+    struct rte_mbuf_ext_shared_info* Shinfo;  // at the end of Data, counting the entry and the mbufs attached
+};
+
+struct PEPORespCache {
+    struct rte_mempool* Pool;
+    int SocketId;
+    uint64_t Bytes;
+    uint32_t SketchReads;
+    uint8_t Sketch[PEPO_RESP_CACHE_SKETCH_COUNTERS];
+    struct PEPORespCacheEntry Entries[PEPO_RESP_CACHE_SETS][PEPO_RESP_CACHE_WAYS];
+};
+
+//
+// The set and the counter of a location are taken from the high bits of its hash, which all the bits of it mix into
+//
+//
+static inline uint64_t
+RespCacheHash(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    return (Offset ^ ((uint64_t)FileId << 48) ^ ((uint64_t)Bytes << 24)) * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline struct PEPORespCacheEntry*
+RespCacheSet(
+    struct PEPORespCache* Cache,
+    uint64_t Hash
+) {
+    return Cache->Entries[(Hash >> 32) % PEPO_RESP_CACHE_SETS];
+}
+
+static inline uint8_t*
+RespCacheCounter(
+    struct PEPORespCache* Cache,
+    uint64_t Hash
+) {
+    return &Cache->Sketch[(Hash >> 48) % PEPO_RESP_CACHE_SKETCH_COUNTERS];
+}
+
+//
+// Free the data of an external buffer once its last mbuf is freed
+//
+//
+static void
+RespCacheFreeData(
+    void* Addr,
+    void* Opaque
+) {
+    RTE_SET_USED(Opaque);
+    rte_free(Addr);
+}
+
+//
+// Empty a way, freeing its data unless mbufs are still attached to it
+//
+//
+static void
+RespCacheDrop(
+    struct PEPORespCache* Cache,
+    struct PEPORespCacheEntry* Entry
+) {
+    if (rte_mbuf_ext_refcnt_update(Entry->Shinfo, -1) == 0) {
+        rte_free(Entry->Data);
+    }
+    Cache->Bytes -= Entry->Bytes;
+    Entry->Data = NULL;
+}
+
+//
+// Count a read of a location and return its estimated count, halving all the counts every PEPO_RESP_CACHE_AGING_READS
+//
+//
+static uint32_t
+RespCacheCountRead(
+    struct PEPORespCache* Cache,
+    uint64_t Hash
+) {
+    uint8_t* counter = RespCacheCounter(Cache, Hash);
+
+    if (*counter != UINT8_MAX) {
+        (*counter)++;
+    }
+
+    if (++Cache->SketchReads == PEPO_RESP_CACHE_AGING_READS) {
+        Cache->SketchReads = 0;
+        for (uint32_t i = 0; i != PEPO_RESP_CACHE_SKETCH_COUNTERS; i++) {
+            Cache->Sketch[i] >>= 1;
+        }
+        for (uint32_t s = 0; s != PEPO_RESP_CACHE_SETS; s++) {
+            for (uint32_t w = 0; w != PEPO_RESP_CACHE_WAYS; w++) {
+                Cache->Entries[s][w].Reads >>= 1;
+            }
+        }
+    }
+
+    return *counter;
+}
+
+//
+// Create the response cache of the current lcore, on its socket
+//
+//
+struct PEPORespCache*
+PEPORespCacheCreate(void) {
+    char name[RTE_MEMPOOL_NAMESIZE];
+    uint32_t lcore = rte_lcore_id();
+    int sid = (int)rte_lcore_to_socket_id(lcore);
+    struct PEPORespCache* cache;
+
+    cache = (struct PEPORespCache*)rte_zmalloc_socket(NULL, sizeof(struct PEPORespCache), RTE_CACHE_LINE_SIZE, sid);
+    if (cache == NULL) {
+        RTE_LOG(ERR, USER1, "%s: failed to allocate the response cache of lcore %u\n", __func__, lcore);
+        return NULL;
+    }
+
+    snprintf(name, sizeof(name), "RespCacheMP%u", lcore);
+    cache->Pool = rte_pktmbuf_pool_create(name, PEPO_RESP_CACHE_MBUFS, RTE_MEMPOOL_CACHE_MAX_SIZE, 0,
+        RTE_PKTMBUF_HEADROOM + PEPO_RESP_CACHE_HEAD_BYTES, sid);
+    if (cache->Pool == NULL) {
+        RTE_LOG(ERR, USER1, "%s: failed to create the response mbufs of lcore %u: %d\n", __func__, lcore, rte_errno);
+        rte_free(cache);
+        return NULL;
+    }
+    cache->SocketId = sid;
+
+    return cache;
+}
+
+//
+// Free a response cache; the data still attached to mbufs is freed with the last of them
+//
+//
+void
+PEPORespCacheFree(
+    struct PEPORespCache* Cache
+) {
+    if (Cache == NULL) {
+        return;
+    }
+
+    for (uint32_t s = 0; s != PEPO_RESP_CACHE_SETS; s++) {
+        for (uint32_t w = 0; w != PEPO_RESP_CACHE_WAYS; w++) {
+            if (Cache->Entries[s][w].Data != NULL) {
+                RespCacheDrop(Cache, &Cache->Entries[s][w]);
+            }
+        }
+    }
+
+    //
+    // The pool stays, as mbufs of it may still be in the send buffers of streams
+    //
+    //
+    rte_free(Cache);
+}
+
+//
+// Build the response of a read of Bytes at Offset of a file: the ReqSize bytes of Req, followed by the data kept;
+// return NULL if the data is not kept, with Keep set if it is to be kept once read, at Version
+//
+//
+struct rte_mbuf*
+PEPORespCacheGet(
+    struct PEPORespCache* Cache,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    const char* Req,
+    uint32_t ReqSize,
+    bool* Keep,
+    uint32_t* Version
+) {
+    uint64_t hash = RespCacheHash(FileId, Offset, Bytes);
+    struct PEPORespCacheEntry* set = RespCacheSet(Cache, hash);
+    struct PEPORespCacheEntry* entry = NULL;
+    struct rte_mbuf *head, *data;
+    uint32_t reads;
+
+    *Keep = false;
+    *Version = ResponseCacheVersion(FileId, Offset);
+    reads = RespCacheCountRead(Cache, hash);
+
+    for (uint32_t w = 0; w != PEPO_RESP_CACHE_WAYS; w++) {
+        if (set[w].Data != NULL && set[w].FileId == FileId && set[w].Offset == Offset && set[w].Bytes == Bytes) {
+            entry = &set[w];
+            break;
+        }
+    }
+
+    if (entry != NULL && entry->Version != *Version) {
+        RespCacheDrop(Cache, entry);
+        entry = NULL;
+    }
+
+    if (entry == NULL) {
+        *Keep = reads >= PEPO_RESP_CACHE_ADMIT_READS && Bytes <= PEPO_RESP_CACHE_MAX_ITEM_BYTES;
+        return NULL;
+    }
+
+    //
+    // The count of the mbufs attached to the data is 16 bits
+    //
+    //
+    if (ReqSize > PEPO_RESP_CACHE_HEAD_BYTES || rte_mbuf_ext_refcnt_read(entry->Shinfo) >= UINT16_MAX - 1) {
+        return NULL;
+    }
+
+    data = rte_pktmbuf_alloc(Cache->Pool);
+    if (data == NULL) {
+        return NULL;
+    }
+    rte_mbuf_ext_refcnt_update(entry->Shinfo, 1);
+    rte_pktmbuf_attach_extbuf(data, entry->Data, entry->DataIova, entry->BufLen, entry->Shinfo);
+    data->data_len = Bytes;
+    data->pkt_len = Bytes;
+    entry->Reads++;
+
+    if (ReqSize == 0) {
+        return data;
+    }
+
+    head = rte_pktmbuf_alloc(Cache->Pool);
+    if (head == NULL) {
+        rte_pktmbuf_free(data);
+        return NULL;
+    }
+    rte_memcpy(rte_pktmbuf_append(head, ReqSize), Req, ReqSize);
+    rte_pktmbuf_chain(head, data);
+
+    return head;
+}
+
+//
+// Keep the data of a read, at DataOffset of the response Pkt, as it was at Version;
+// return whether it is kept
+//
+//
+bool
+PEPORespCachePut(
+    struct PEPORespCache* Cache,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    uint32_t Version,
+    const struct rte_mbuf* Pkt,
+    uint32_t DataOffset
+) {
+    uint64_t hash = RespCacheHash(FileId, Offset, Bytes);
+    struct PEPORespCacheEntry* set = RespCacheSet(Cache, hash);
+    struct PEPORespCacheEntry* entry = NULL;
+    struct PEPORespCacheEntry* victim = NULL;
+    uint32_t reads = *RespCacheCounter(Cache, hash);
+    const char* from;
+    char* data;
+    uint16_t bufLen;
+
+    //
+    // The data may have changed while it was read
+    //
+    //
+    if (Bytes > PEPO_RESP_CACHE_MAX_ITEM_BYTES || Version != ResponseCacheVersion(FileId, Offset)) {
+        return false;
+    }
+
+    for (uint32_t w = 0; w != PEPO_RESP_CACHE_WAYS; w++) {
+        if (set[w].Data == NULL) {
+            entry = entry != NULL ? entry : &set[w];
+            continue;
+        }
+        if (set[w].FileId == FileId && set[w].Offset == Offset && set[w].Bytes == Bytes) {
+            return false;
+        }
+        if (victim == NULL || set[w].Reads < victim->Reads) {
+            victim = &set[w];
+        }
+    }
+
+    //
+    // Replace the least read response of the set if it is full, or if the lcore keeps too much
+    //
+    //
+    if (entry == NULL || Cache->Bytes + Bytes > PEPO_RESP_CACHE_BYTES) {
+        if (victim == NULL || victim->Reads >= reads) {
+            return false;
+        }
+        RespCacheDrop(Cache, victim);
+        entry = victim;
+        if (Cache->Bytes + Bytes > PEPO_RESP_CACHE_BYTES) {
+            return false;
+        }
+    }
+
+    bufLen = (uint16_t)(RTE_ALIGN_CEIL(Bytes, sizeof(uint64_t)) + sizeof(struct rte_mbuf_ext_shared_info));
+    data = rte_malloc_socket(NULL, bufLen, RTE_CACHE_LINE_SIZE, Cache->SocketId);
+    if (data == NULL) {
+        return false;
+    }
+
+    from = rte_pktmbuf_read(Pkt, DataOffset, Bytes, data);
+    if (from == NULL) {
+        rte_free(data);
+        return false;
+    }
+    if (from != data) {
+        rte_memcpy(data, from, Bytes);
+    }
+
+    entry->Shinfo = rte_pktmbuf_ext_shinfo_init_helper(data, &bufLen, RespCacheFreeData, NULL);
+    if (entry->Shinfo == NULL) {
+        rte_free(data);
+        return false;
+    }
+    entry->FileId = FileId;
+    entry->Offset = Offset;
+    entry->Bytes = Bytes;
+    entry->Version = Version;
+    entry->Reads = reads;
+    entry->Data = data;
+    entry->DataIova = rte_malloc_virt2iova(data);
+    entry->BufLen = bufLen;
+    Cache->Bytes += Bytes;
+
+    return true;
+}
+#endif
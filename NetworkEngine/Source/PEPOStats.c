@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <rte_memzone.h>
+
+#include "PEPOStats.h"
+
+struct PEPOLcoreStats *PEPOStats = NULL;
+
+static pthread_t ExportThread;
+static volatile int ExportStop = 0;
+static int ExportRunning = 0;
+
+//
+// A counter and where it is in the counters of an lcore
+//
+//
+struct PEPOStatsField {
+    const char* Name;
+    const char* Type;
+    const char* Help;
+    size_t Offset;
+    int Is32;
+};
+
+#define PEPO_STATS_COUNTER(_name, _field, _help) \
+    { "dds_pepo_" _name, "counter", _help, offsetof(struct PEPOLcoreStats, _field), 0 }
+#define PEPO_STATS_GAUGE(_name, _field, _help) \
+    { "dds_pepo_" _name, "gauge", _help, offsetof(struct PEPOLcoreStats, _field), 1 }
+
+static const struct PEPOStatsField StatsFields[] = {
+    PEPO_STATS_COUNTER("rx_packets_total", RxPkts, "Packets received from the port"),
+    PEPO_STATS_COUNTER("rx_drops_total", RxDrops, "Received packets TLDK did not take"),
+    PEPO_STATS_COUNTER("tx_packets_total", TxPkts, "Packets sent to the port"),
+    PEPO_STATS_COUNTER("tx_drops_total", TxDrops, "Packets the port did not take"),
+    PEPO_STATS_COUNTER("tx_bursts_total", TxBursts, "Bursts sent to the port"),
+    PEPO_STATS_COUNTER("stream_rx_packets_total", StreamRxPkts, "Packets received on streams"),
+    PEPO_STATS_COUNTER("stream_tx_packets_total", StreamTxPkts, "Packets sent on streams"),
+    PEPO_STATS_COUNTER("stream_tx_drops_total", StreamTxDrops, "Packets streams did not take"),
+    PEPO_STATS_COUNTER("accepted_total", Accepted, "Connections accepted"),
+    PEPO_STATS_COUNTER("rejected_total", Rejected, "Connections rejected"),
+    PEPO_STATS_COUNTER("terminated_total", Terminated, "Streams closed"),
+    PEPO_STATS_COUNTER("rto_retransmits_total", RtoRetransmits, "RTO expirations that resent"),
+    PEPO_STATS_COUNTER("fast_retransmits_total", FastRetransmits, "Fast retransmits entered"),
+    PEPO_STATS_COUNTER("read_buffer_alloc_fails_total", ReadBufAllocFails, "Read buffers not allocated"),
+    PEPO_STATS_COUNTER("reads_shed_total", ReadsShed, "Requests sent to the host while the DPU was loaded"),
+    PEPO_STATS_COUNTER("response_cache_hits_total", RespCacheHits, "Offloaded reads answered from the response cache"),
+    PEPO_STATS_COUNTER("response_cache_fills_total", RespCacheFills, "Responses kept in the response cache"),
+    PEPO_STATS_COUNTER("host_leg_fails_total", HostLegFails, "Host legs failed before their backend sent anything"),
+    PEPO_STATS_COUNTER("udp_rx_packets_total", UdpRxPkts, "Datagrams received on the UDP stream"),
+    PEPO_STATS_COUNTER("udp_tx_packets_total", UdpTxPkts, "Responses sent on the UDP stream"),
+    PEPO_STATS_COUNTER("udp_declined_total", UdpDeclined, "UDP requests dropped for the client to retry over TCP"),
+    PEPO_STATS_COUNTER("idle_polls_total", IdlePolls, "Polls of the main loop that found no work"),
+    PEPO_STATS_COUNTER("idle_sleeps_total", IdleSleeps, "Sleeps on RX interrupts"),
+    PEPO_STATS_COUNTER("ofo_drops_total", OfoDrops, "Out-of-order packets dropped at the limits"),
+    PEPO_STATS_COUNTER("ofo_evicts_total", OfoEvicts, "Held out-of-order packets dropped for ones nearer the window"),
+    PEPO_STATS_COUNTER("tls_handshakes_total", TlsHandshakes, "TLS handshakes completed on client connections"),
+    PEPO_STATS_COUNTER("tls_errors_total", TlsErrors, "Client connections dropped for a failed TLS handshake or a bad record"),
+    PEPO_STATS_GAUGE("error_event_queue_depth", ErEqDepth, "Armed events of the error queue"),
+    PEPO_STATS_GAUGE("rx_event_queue_depth", RxEqDepth, "Armed events of the receive queue"),
+    PEPO_STATS_GAUGE("tx_event_queue_depth", TxEqDepth, "Armed events of the send queue"),
+    PEPO_STATS_GAUGE("ofo_bytes", OfoBytes, "Out-of-order bytes held by the streams"),
+};
+
+//
+// Allocate the counters
+//
+//
+int
+PEPOStatsInit(void) {
+    const struct rte_memzone *mz;
+
+    if (PEPOStats != NULL) {
+        return 0;
+    }
+
+    mz = rte_memzone_lookup(PEPO_STATS_MEMZONE);
+    if (mz == NULL) {
+        mz = rte_memzone_reserve_aligned(PEPO_STATS_MEMZONE, sizeof(struct PEPOLcoreStats) * RTE_MAX_LCORE,
+            SOCKET_ID_ANY, 0, RTE_CACHE_LINE_SIZE);
+    }
+    if (mz == NULL) {
+        return -ENOMEM;
+    }
+
+    PEPOStats = (struct PEPOLcoreStats*)mz->addr;
+    memset(PEPOStats, 0, sizeof(struct PEPOLcoreStats) * RTE_MAX_LCORE);
+
+    return 0;
+}
+
+//
+// Write the counters of the active lcores in the Prometheus text format
+//
+//
+static int
+PEPOStatsWrite(
+    const char* Path
+) {
+    char tmpPath[256];
+    FILE* out;
+    uint32_t f, lc;
+    const char* stats;
+    uint64_t value;
+
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", Path);
+    out = fopen(tmpPath, "w");
+    if (out == NULL) {
+        return -errno;
+    }
+
+    for (f = 0; f != RTE_DIM(StatsFields); f++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", StatsFields[f].Name, StatsFields[f].Help,
+            StatsFields[f].Name, StatsFields[f].Type);
+        for (lc = 0; lc != RTE_MAX_LCORE; lc++) {
+            if (!PEPOStats[lc].Active) {
+                continue;
+            }
+            stats = (const char*)&PEPOStats[lc] + StatsFields[f].Offset;
+            value = StatsFields[f].Is32 ? *(const volatile uint32_t*)stats : *(const volatile uint64_t*)stats;
+            fprintf(out, "%s{lcore=\"%u\"} %" PRIu64 "\n", StatsFields[f].Name, lc, value);
+        }
+    }
+
+    if (fclose(out) != 0 || rename(tmpPath, Path) != 0) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+//
+// The export thread
+//
+//
+static void*
+PEPOStatsMain(
+    void* Arg
+) {
+    struct timespec period;
+
+    period.tv_sec = PEPO_STATS_PERIOD_MS / 1000;
+    period.tv_nsec = (PEPO_STATS_PERIOD_MS % 1000) * 1000000L;
+
+    while (!ExportStop) {
+        PEPOStatsWrite(PEPO_STATS_PROM_PATH);
+        nanosleep(&period, NULL);
+    }
+
+    //
+    // The final counters of the lcores, which have exited
+    //
+    //
+    PEPOStatsWrite(PEPO_STATS_PROM_PATH);
+
+    return NULL;
+}
+
+//
+// Start the thread that exports the counters
+//
+//
+int
+StartPEPOStatsExport(void) {
+    if (PEPOStats == NULL) {
+        return -EINVAL;
+    }
+
+    ExportStop = 0;
+    if (pthread_create(&ExportThread, NULL, PEPOStatsMain, NULL) != 0) {
+        return -EAGAIN;
+    }
+    ExportRunning = 1;
+
+    printf("PEPO counters are written to %s\n", PEPO_STATS_PROM_PATH);
+
+    return 0;
+}
+
+//
+// Stop the thread that exports the counters
+//
+//
+void
+StopPEPOStatsExport(void) {
+    if (!ExportRunning) {
+        return;
+    }
+
+    ExportStop = 1;
+    pthread_join(ExportThread, NULL);
+    ExportRunning = 0;
+}
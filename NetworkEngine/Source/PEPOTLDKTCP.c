@@ -3,17 +3,27 @@
  * Licensed under the MIT License
  */
 
+#include <pthread.h>
 #include <unistd.h>
 
 #include "BackEndControl.h"
+#include "CorePlan.h"
+#include "FileService.h"
+#include "OffloadResponseRingBuffer.h"
 #include "PEPOTLDKTCP.h"
 
+#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_STATIC
+#error "Offloaded reads take their read buffers when they are issued, use OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC"
+#endif
+
 #define     MAX_RULES                       0x100
 #define     MAX_TBL8                        0x800
 #define     RX_RING_SIZE                    0x400
 #define     TX_RING_SIZE                    0x800
 #define     MPOOL_CACHE_SIZE                0x100
-#define     MPOOL_NB_BUF                    0x10000
+#define     MPOOL_BUFS_PER_STREAM           8
+#define     READ_BUF_CACHE_SIZE             0x20
+#define     READ_BUFS_PER_OP                3
 #define     FRAG_MBUF_BUF_SIZE              (RTE_PKTMBUF_HEADROOM + TLE_DST_MAX_HDR)
 #define     FRAG_TBL_BUCKET_ENTRIES         16
 #define     FRAG_TTL                        MS_PER_S
@@ -29,7 +39,6 @@ typedef uint16_t dpdk_port_t;
 
 static const uint64_t PEPORxOffload = DEV_RX_OFFLOAD_IPV4_CKSUM | DEV_RX_OFFLOAD_UDP_CKSUM | DEV_RX_OFFLOAD_TCP_CKSUM;
 static const uint64_t PEPOTxOffload = DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
-static const uint32_t PEPOMtuSize = RTE_ETHER_MAX_LEN - RTE_ETHER_CRC_LEN;
 static const uint32_t PEPONumPorts = 1;
 static const uint32_t PEPOPortId = 0;
 static const char* ClientIPv4Addr = "0.0.0.0";
@@ -39,12 +48,17 @@ static const char* ClientEtherAddr = "ff:ff:ff:ff:ff:ff";
 static char PEPOIPv4Addr[16];
 static char GlobalHostIPv4Addr[16];
 static uint16_t GlobalHostTCPPort;
+static uint16_t PEPORetaSize = 0;
+static uint32_t PEPOTimerBatch = TCP_MAX_PROCESS;
 
 static const struct rte_eth_conf PortConfDefault = { 0 };
 
 static struct rte_mempool *Mpool[RTE_MAX_NUMA_NODES + 1];
 static struct rte_mempool *FragMpool[RTE_MAX_NUMA_NODES + 1];
 static struct rte_mempool *ReadBufMpool[RTE_MAX_NUMA_NODES + 1];
+#ifdef PEPO_HEADER_SPLIT
+static struct rte_mempool *HdrMpool[RTE_MAX_NUMA_NODES + 1];
+#endif
 
 static struct tle_ctx_param TleCtxParam;
 static struct NetbeCfg BeCfg;
@@ -54,10 +68,29 @@ static struct LcoreParam CoreParam[RTE_MAX_LCORE];
 static int PEPOVerbose = 0;
 extern volatile int ForceQuitNetworkEngine;
 
+//
+// The offload predicate and function, shared by all lcores; without them every message is forwarded
+// On SIGHUP they are compiled and loaded again from PEPOUdfPath, and published in PEPOUdfs;
+// the previous version is unloaded once every lcore that offloads has passed a quiescent point
+//
+//
+#define PEPO_UDF_PATH_LENGTH 256
+static char PEPOUdfPath[PEPO_UDF_PATH_LENGTH];
+static struct PEPOUdfs* PEPOUdfs = NULL;
+static uint32_t PEPOUdfsVersion = 0;
+static struct rte_rcu_qsbr* PEPOUdfsQsbr = NULL;
+static int PEPOUdfsReload = 0;
+static pthread_t PEPOUdfsThread;
+static uint32_t PEPONumOffloadLcores = 0;
+extern CacheTableT* GlobalCacheTable;
+
 //
 // Check out the paper below for the mapping between the hash key and TCP header fields
 // and how to make the hashing symmetric:
 // https://www.ndsl.kaist.edu/~kyoungsoo/papers/TR-symRSS.pdf
+// The key is zero over the IPv4 addresses and repeats 0x6D5A over the ports, so a connection hashes
+// by its ports only, the same in both directions; the leg to the host reuses the host port and the port of the client,
+// so its packets land on the queue, hence the lcore, of the client connection
 //
 //
 uint8_t SymmetricRssKey[40] = {
@@ -90,11 +123,38 @@ UpdateRSSConf(
     const struct rte_eth_dev_info *DevInfo,
     struct rte_eth_conf *PortConf
 ) {
+    //
+    // The whole 4-tuple is hashed, as the key expects; with both L4_SRC_ONLY and L4_DST_ONLY
+    // the PMD hashes the source port only, which isn't symmetric
+    //
+    //
     PortConf->rxmode.mq_mode = ETH_MQ_RX_RSS;
-    PortConf->rx_adv_conf.rss_conf.rss_hf = ETH_RSS_NONFRAG_IPV4_TCP | ETH_RSS_L4_DST_ONLY | ETH_RSS_L4_SRC_ONLY;
+#ifdef PEPO_UDP_REQUESTS
+    PortConf->rx_adv_conf.rss_conf.rss_hf = ETH_RSS_NONFRAG_IPV4_TCP | ETH_RSS_NONFRAG_IPV4_UDP;
+#else
+    PortConf->rx_adv_conf.rss_conf.rss_hf = ETH_RSS_NONFRAG_IPV4_TCP;
+#endif
     PortConf->rx_adv_conf.rss_conf.rss_key = SymmetricRssKey;
     PortConf->rx_adv_conf.rss_conf.rss_key_len = sizeof(SymmetricRssKey);
 
+#ifdef DDS_EMULATION
+    //
+    // A software port (net_af_xdp, virtio) may not hash at all, which is fine with a single queue;
+    // with more, the port must take the symmetric key, or the legs of a connection land on different lcores
+    //
+    //
+    if ((DevInfo->flow_type_rss_offloads & PortConf->rx_adv_conf.rss_conf.rss_hf) !=
+        PortConf->rx_adv_conf.rss_conf.rss_hf || DevInfo->hash_key_size != sizeof(SymmetricRssKey)) {
+        if (BeCfg.NumCores > 1) {
+            RTE_LOG(ERR, USER1,
+                "Port#%u can't hash with the symmetric RSS key, run the PEPO on one core\n", Port->Id);
+            return -EINVAL;
+        }
+        PortConf->rxmode.mq_mode = ETH_MQ_RX_NONE;
+        memset(&PortConf->rx_adv_conf.rss_conf, 0, sizeof(PortConf->rx_adv_conf.rss_conf));
+    }
+#endif
+
     return 0;
 }
 
@@ -117,6 +177,19 @@ PortInit(
     // Handle hardware offloading
     //
     //
+#ifdef DDS_EMULATION
+    //
+    // Software ports checksum little or nothing, which TLDK then does itself
+    //
+    //
+    if ((devInfo.rx_offload_capa & Port->RxOffload) != Port->RxOffload ||
+        (devInfo.tx_offload_capa & Port->TxOffload) != Port->TxOffload) {
+        RTE_LOG(NOTICE, USER1, "Port#%u checksums in software, offloads supported: RX %#" PRIx64 ", TX %#" PRIx64 "\n",
+            Port->Id, (uint64_t)devInfo.rx_offload_capa, (uint64_t)devInfo.tx_offload_capa);
+        Port->RxOffload &= devInfo.rx_offload_capa;
+        Port->TxOffload &= devInfo.tx_offload_capa;
+    }
+#endif
     if ((devInfo.rx_offload_capa & Port->RxOffload) != Port->RxOffload) {
         RTE_LOG(ERR, USER1,
             "Port#%u supported/requested RX offloads don't match, "
@@ -138,11 +211,65 @@ PortInit(
         __func__, Port->Id);
     portConf.rxmode.offloads |= Port->RxOffload;
 
+#ifdef PEPO_IDLE_RX_INTR
+    portConf.intr_conf.rxq = 1;
+#endif
+
     portConf.rxmode.max_rx_pkt_len = Port->Mtu + RTE_ETHER_CRC_LEN;
     if (portConf.rxmode.max_rx_pkt_len > RTE_ETHER_MAX_LEN) {
         portConf.rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME;
     }
 
+    //
+    // TSO and LRO are optional: TLDK falls back to segmenting in software,
+    // and a port without LRO receives a packet per segment
+    //
+    //
+#ifdef PEPO_ENABLE_TSO
+    if ((devInfo.tx_offload_capa & DEV_TX_OFFLOAD_TCP_TSO) != 0) {
+        RTE_LOG(NOTICE, USER1, "%s(%u): Enabling TSO\n", __func__, Port->Id);
+        Port->TxOffload |= DEV_TX_OFFLOAD_TCP_TSO;
+    }
+#endif
+#ifdef PEPO_HEADER_SPLIT
+    if ((devInfo.rx_offload_capa & RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT) != 0 &&
+        (devInfo.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER) != 0 &&
+        devInfo.rx_seg_capa.max_nseg >= 2 && devInfo.rx_seg_capa.multi_pools != 0) {
+        RTE_LOG(NOTICE, USER1, "%s(%u): Enabling header split\n", __func__, Port->Id);
+        Port->RxOffload |= RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT | DEV_RX_OFFLOAD_SCATTER;
+        portConf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT | DEV_RX_OFFLOAD_SCATTER;
+    }
+#endif
+#ifdef PEPO_ENABLE_LRO
+    if ((Port->RxOffload & RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT) == 0 &&
+        (devInfo.rx_offload_capa & DEV_RX_OFFLOAD_TCP_LRO) != 0 &&
+        (devInfo.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER) != 0) {
+        RTE_LOG(NOTICE, USER1, "%s(%u): Enabling LRO\n", __func__, Port->Id);
+        Port->RxOffload |= DEV_RX_OFFLOAD_TCP_LRO;
+        portConf.rxmode.offloads |= DEV_RX_OFFLOAD_TCP_LRO;
+        portConf.rxmode.max_lro_pkt_size = RTE_MIN((uint32_t)PEPO_LRO_MAX_PKT_SIZE, devInfo.max_lro_pkt_size);
+    }
+#endif
+
+    //
+    // Frames that don't fit an mbuf, and merged ones, are received in chains
+    //
+    //
+    if (portConf.rxmode.max_rx_pkt_len > RTE_MBUF_DEFAULT_DATAROOM ||
+        (Port->RxOffload & DEV_RX_OFFLOAD_TCP_LRO) != 0) {
+        if ((devInfo.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER) == 0) {
+            RTE_LOG(ERR, USER1, "Port#%u can't receive frames of %u bytes\n",
+                Port->Id, portConf.rxmode.max_rx_pkt_len);
+            return -EINVAL;
+        }
+        Port->RxOffload |= DEV_RX_OFFLOAD_SCATTER;
+        portConf.rxmode.offloads |= DEV_RX_OFFLOAD_SCATTER;
+    }
+    if ((Port->RxOffload & DEV_RX_OFFLOAD_SCATTER) != 0 &&
+        (devInfo.tx_offload_capa & DEV_TX_OFFLOAD_MULTI_SEGS) != 0) {
+        Port->TxOffload |= DEV_TX_OFFLOAD_MULTI_SEGS;
+    }
+
     RTE_LOG(ERR, USER1, "%s(%u): Enabling TX csum offload\n",
         __func__, Port->Id);
     portConf.txmode.offloads |= Port->TxOffload;
@@ -169,6 +296,13 @@ PortInit(
         "%s (%u): rte_eth_dev_configure (nb_rxq = %u, nb_txq = %u)\n", __func__, Port->Id, BeCfg.NumCores,
         BeCfg.NumCores);
 
+    result = rte_eth_dev_set_mtu(Port->Id, Port->Mtu - RTE_ETHER_HDR_LEN);
+    if (result != 0) {
+        RTE_LOG(ERR, USER1, "Port#%u failed to set MTU %u: %d\n",
+            Port->Id, Port->Mtu - RTE_ETHER_HDR_LEN, result);
+        return result;
+    }
+
     return 0;
 }
 
@@ -191,6 +325,52 @@ CheckLcore(
     return 0;
 }
 
+//
+// The lcores on a socket, which share its pools
+//
+//
+static uint32_t
+LcoresOnSocket(
+    uint32_t Sid
+) {
+    uint32_t j, n = 0;
+
+    for (j = 0; j != BeCfg.NumCores; j++) {
+        if (rte_lcore_to_socket_id(BeCfg.Cores[j].Id) + 1 == Sid) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+//
+// The size of a pool for NumLcores that need NumBufs each: rounded up to 2^n - 1,
+// which is the best fit for the ring of a mempool
+//
+//
+static uint32_t
+PoolSize(
+    uint32_t NumBufs,
+    uint32_t NumLcores
+) {
+    return rte_align32pow2(NumBufs * NumLcores + 1) - 1;
+}
+
+//
+// The per-lcore cache of a pool: at most CacheSize, and small enough that the caches,
+// which may hold 1.5 times their size, can't strand more than half of the pool
+//
+//
+static uint32_t
+PoolCacheSize(
+    uint32_t PoolBufs,
+    uint32_t NumLcores,
+    uint32_t CacheSize
+) {
+    return RTE_MIN(CacheSize, PoolBufs / (3 * NumLcores));
+}
+
 //
 // Init mempools
 //
@@ -203,9 +383,11 @@ PoolInit(
     int32_t result;
     struct rte_mempool *mp;
     char name[RTE_MEMPOOL_NAMESIZE];
+    uint32_t numLcores = LcoresOnSocket(Sid);
+    uint32_t size = PoolSize(NumMpoolBufs, numLcores);
 
     snprintf(name, sizeof(name), "MP%u", Sid);
-    mp = rte_pktmbuf_pool_create(name, NumMpoolBufs, MPOOL_CACHE_SIZE, 0,
+    mp = rte_pktmbuf_pool_create(name, size, PoolCacheSize(size, numLcores, MPOOL_CACHE_SIZE), 0,
         RTE_MBUF_DEFAULT_BUF_SIZE, Sid - 1);
     if (mp == NULL) {
         result = -rte_errno;
@@ -226,10 +408,12 @@ FragPoolInit(
     int32_t result;
     struct rte_mempool *fragMp;
     char fragName[RTE_MEMPOOL_NAMESIZE];
+    uint32_t numLcores = LcoresOnSocket(Sid);
+    uint32_t size = PoolSize(NumMpoolBufs, numLcores);
 
     snprintf(fragName, sizeof(fragName), "FragMP%u", Sid);
-    fragMp = rte_pktmbuf_pool_create(fragName, NumMpoolBufs,
-        MPOOL_CACHE_SIZE, 0, FRAG_MBUF_BUF_SIZE, Sid - 1);
+    fragMp = rte_pktmbuf_pool_create(fragName, size,
+        PoolCacheSize(size, numLcores, MPOOL_CACHE_SIZE), 0, FRAG_MBUF_BUF_SIZE, Sid - 1);
     if (fragMp == NULL) {
         result = -rte_errno;
         RTE_LOG(ERR, USER1, "%s(%d) failed with error code: %d\n",
@@ -241,6 +425,38 @@ FragPoolInit(
     return 0;
 }
 
+#ifdef PEPO_HEADER_SPLIT
+//
+// Init the pool of the header buffers of split packets
+//
+//
+static int
+HdrPoolInit(
+    uint32_t Sid,
+    uint32_t NumMpoolBufs
+) {
+    int32_t result;
+    struct rte_mempool *mp;
+    char name[RTE_MEMPOOL_NAMESIZE];
+    uint32_t numLcores = LcoresOnSocket(Sid);
+    uint32_t size = PoolSize(NumMpoolBufs, numLcores);
+
+    snprintf(name, sizeof(name), "HdrMP%u", Sid);
+    mp = rte_pktmbuf_pool_create(name, size, PoolCacheSize(size, numLcores, MPOOL_CACHE_SIZE), 0,
+        PEPO_HEADER_MBUF_BUF_SIZE, Sid - 1);
+    if (mp == NULL) {
+        result = -rte_errno;
+        RTE_LOG(ERR, USER1, "%s(%d) failed with error code: %d\n",
+            __func__, Sid - 1, result);
+        return result;
+    }
+
+    HdrMpool[Sid] = mp;
+
+    return 0;
+}
+#endif
+
 static int
 ReadBufPoolInit(
     uint32_t Sid,
@@ -249,9 +465,11 @@ ReadBufPoolInit(
     int32_t result;
     struct rte_mempool *mp;
     char name[RTE_MEMPOOL_NAMESIZE];
+    uint32_t numLcores = LcoresOnSocket(Sid);
+    uint32_t size = PoolSize(NumMpoolBufs, numLcores);
 
     snprintf(name, sizeof(name), "ReadBufMP%u", Sid);
-    mp = rte_pktmbuf_pool_create(name, NumMpoolBufs, MPOOL_CACHE_SIZE, 0,
+    mp = rte_pktmbuf_pool_create(name, size, PoolCacheSize(size, numLcores, READ_BUF_CACHE_SIZE), 0,
         MAX_READ_BUFFER_MBUF_SIZE, Sid - 1);
     if (mp == NULL) {
         result = -rte_errno;
@@ -273,12 +491,14 @@ ReadBufPoolInit(
 static int
 QueueInit(
     struct NetbePort *Port,
-    struct rte_mempool *Mp
+    struct rte_mempool *Mp,
+    struct rte_mempool *HdrMp
 ) {
     int32_t sid, result;
     uint16_t q;
     uint32_t numRxd, numTxd;
     struct rte_eth_dev_info devInfo;
+    union rte_eth_rxseg rxSegs[2];
 
     rte_eth_dev_info_get(Port->Id, &devInfo);
 
@@ -291,6 +511,22 @@ QueueInit(
 
     devInfo.default_txconf.tx_free_thresh = numTxd / 2;
 
+    //
+    // With header split, the queues take their buffers from the segments, not from a pool
+    //
+    //
+    if ((Port->RxOffload & RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT) != 0) {
+        memset(rxSegs, 0, sizeof(rxSegs));
+        rxSegs[0].split.mp = HdrMp;
+        rxSegs[0].split.length = PEPO_HEADER_SPLIT_BYTES;
+        rxSegs[1].split.mp = Mp;
+        rxSegs[1].split.length = 0;
+        devInfo.default_rxconf.rx_seg = rxSegs;
+        devInfo.default_rxconf.rx_nseg = RTE_DIM(rxSegs);
+        devInfo.default_rxconf.offloads |= RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT;
+        Mp = NULL;
+    }
+
     for (q = 0; q < BeCfg.NumCores; q++) {
         result = rte_eth_rx_queue_setup(Port->Id, q, numRxd,
             sid, &devInfo.default_rxconf, Mp);
@@ -442,12 +678,22 @@ PEPOPortInit() {
         }
 
         if (ReadBufMpool[sid] == NULL) {
-            result = ReadBufPoolInit(sid, MAX_READ_BUFFER_NUM);
+            result = ReadBufPoolInit(sid, BeCfg.NumReadBufs);
             if (result != 0)
                 return result;
         }
 
-        result = QueueInit(port, Mpool[sid]);
+#ifdef PEPO_HEADER_SPLIT
+        if ((port->RxOffload & RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT) != 0 && HdrMpool[sid] == NULL) {
+            result = HdrPoolInit(sid, BeCfg.NumMempoolBufs);
+            if (result != 0)
+                return result;
+        }
+
+        result = QueueInit(port, Mpool[sid], HdrMpool[sid]);
+#else
+        result = QueueInit(port, Mpool[sid], NULL);
+#endif
 
         if (result != 0) {
             RTE_LOG(ERR, USER1,
@@ -610,6 +856,35 @@ Lpm4DstLookup(
     return 0;
 }
 
+#ifdef PEPO_UDP_REQUESTS
+//
+// The route of the UDP context, which is the route of the TCP context through the device of the same queue
+// in the UDP context
+//
+//
+static int
+Lpm4UdpDstLookup(
+    void *Data,
+    const struct in_addr *Addr,
+    struct tle_dest *Des
+) {
+    struct NetbeLcore *Lc;
+    uint32_t i;
+
+    Lc = (struct NetbeLcore*)Data;
+
+    Lpm4DstLookup(Data, Addr, Des);
+    for (i = 0; i != Lc->NumPortQueues; i++) {
+        if (Lc->PortQueues[i].Dev == Des->dev) {
+            Des->dev = Lc->PortQueues[i].UdpDev;
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+#endif
+
 //
 // Create context
 //
@@ -669,6 +944,24 @@ CreateContext(
         RTE_LOG(NOTICE, USER1, "%s (lcore = %u): tle_ctx has been created\n",
             __func__, Lc->Id);
 
+#ifdef PEPO_UDP_REQUESTS
+        //
+        // The UDP context has the one stream of the lcore, whose datagrams are not reassembled
+        //
+        //
+        ctxParam.proto = TLE_PROTO_UDP;
+        ctxParam.max_streams = 1;
+        ctxParam.max_stream_rbufs = PEPO_UDP_STREAM_BUFS;
+        ctxParam.max_stream_sbufs = PEPO_UDP_STREAM_BUFS;
+        ctxParam.lookup4 = Lpm4UdpDstLookup;
+
+        Lc->UdpCtx = tle_ctx_create(&ctxParam);
+        if (Lc->UdpCtx == NULL) {
+            RTE_LOG(ERR, USER1, "%s (lcore = %u): failed to create the UDP tle_ctx\n",
+                __func__, Lc->Id);
+            return -1;
+        }
+#endif
     }
 
     return result;
@@ -721,6 +1014,22 @@ LcoreInit(
             "%s (lcore = %u, port = %u, Qid = %u) has added dev\n",
             __func__, Lc->Id, Lc->PortQueues[PortQid].Port.Id,
             Lc->PortQueues[PortQid].RxQid);
+
+#ifdef PEPO_UDP_REQUESTS
+        //
+        // The UDP stream is on the service port, which no queue blocks
+        //
+        //
+        devParam.bl4.nb_port = 0;
+        devParam.bl4.port = NULL;
+
+        Lc->PortQueues[PortQid].UdpDev = tle_add_dev(Lc->UdpCtx, &devParam);
+        if (Lc->PortQueues[PortQid].UdpDev == NULL) {
+            RTE_LOG(ERR, USER1, "%s (lcore = %u) failed to add the UDP dev with error code: %d\n",
+                __func__, Lc->Id, rte_errno);
+            return -rte_errno;
+        }
+#endif
     }
 
     return result;
@@ -948,6 +1257,7 @@ UpdateRssReta(
                 "result = %d\n", __func__, result);
             return result;
         }
+        PEPORetaSize = DevInfo->reta_size;
     }
 
     return 0;
@@ -1039,6 +1349,170 @@ NetfeLcoreFill(
     return 0;
 }
 
+//
+// Unload a version of the offload predicate and function
+//
+//
+static void
+PEPOUnloadUDFs(
+    struct PEPOUdfs* Udfs
+) {
+    if (Udfs->PredLib != NULL) {
+        UnloadLibrary(Udfs->PredLib);
+    }
+    if (Udfs->FuncLib != NULL) {
+        UnloadLibrary(Udfs->FuncLib);
+    }
+#ifdef OFFLOAD_ENGINE_UDF_BPF
+    if (Udfs->PredProg != NULL) {
+        UnloadBPFUDF(Udfs->PredProg);
+    }
+    if (Udfs->FuncProg != NULL) {
+        UnloadBPFUDF(Udfs->FuncProg);
+    }
+#endif
+    rte_free(Udfs);
+}
+
+//
+// Compile and load a version of the offload predicate and function in UdfPath
+//
+//
+static struct PEPOUdfs*
+PEPOLoadUDFs(
+    const char* UdfPath,
+    uint32_t Version
+) {
+    struct PEPOUdfs *udfs;
+
+#ifdef OFFLOAD_ENGINE_UDF_BPF
+    //
+    // Bytecode, if the UDF path has it, runs verified and needs no compiler
+    //
+    //
+    if (HasBPFUDF(UdfPath, OFFLOAD_PRED) && HasBPFUDF(UdfPath, OFFLOAD_FUNC)) {
+        udfs = (struct PEPOUdfs*)rte_zmalloc(NULL, sizeof(struct PEPOUdfs), RTE_CACHE_LINE_SIZE);
+        if (udfs == NULL) {
+            return NULL;
+        }
+        udfs->Version = Version;
+
+        udfs->PredProg = LoadBPFUDF(UdfPath, OFFLOAD_PRED);
+        udfs->FuncProg = LoadBPFUDF(UdfPath, OFFLOAD_FUNC);
+        if (udfs->PredProg == NULL || udfs->FuncProg == NULL) {
+            RTE_LOG(ERR, USER1,
+                "%s: failed to load the UDF bytecode in %s\n",
+                __func__, UdfPath);
+            PEPOUnloadUDFs(udfs);
+            return NULL;
+        }
+
+        RTE_LOG(NOTICE, USER1,
+            "%s: offload predicate and function bytecode version %u loaded from %s\n",
+            __func__, Version, UdfPath);
+
+        return udfs;
+    }
+#endif
+
+    if (!CompileUDF(UdfPath, OFFLOAD_PRED, Version) || !CompileUDF(UdfPath, OFFLOAD_FUNC, Version)) {
+        RTE_LOG(ERR, USER1,
+            "%s: failed to compile the UDFs in %s\n",
+            __func__, UdfPath);
+        return NULL;
+    }
+
+    udfs = (struct PEPOUdfs*)rte_zmalloc(NULL, sizeof(struct PEPOUdfs), RTE_CACHE_LINE_SIZE);
+    if (udfs == NULL) {
+        return NULL;
+    }
+    udfs->Version = Version;
+
+    udfs->PredLib = LoadLibrary(UdfPath, OFFLOAD_PRED, Version);
+    udfs->FuncLib = LoadLibrary(UdfPath, OFFLOAD_FUNC, Version);
+    if (udfs->PredLib != NULL) {
+        udfs->Pred = GetOffloadPred(udfs->PredLib);
+    }
+    if (udfs->FuncLib != NULL) {
+        udfs->Func = GetOffloadFunc(udfs->FuncLib);
+    }
+    if (udfs->Pred == NULL || udfs->Func == NULL) {
+        RTE_LOG(ERR, USER1,
+            "%s: failed to load the UDFs in %s\n",
+            __func__, UdfPath);
+        PEPOUnloadUDFs(udfs);
+        return NULL;
+    }
+
+    RTE_LOG(NOTICE, USER1,
+        "%s: offload predicate and function version %u loaded from %s\n",
+        __func__, Version, UdfPath);
+
+    return udfs;
+}
+
+//
+// Switch the lcores to a new version of the UDFs in PEPOUdfPath; the current one stays if it fails to load
+//
+//
+static void
+PEPOReloadUDFs(void) {
+    struct PEPOUdfs *udfs, *prevUdfs;
+    uint64_t token;
+
+    udfs = PEPOLoadUDFs(PEPOUdfPath, ++PEPOUdfsVersion);
+    if (udfs == NULL) {
+        RTE_LOG(ERR, USER1,
+            "%s: keeping the UDFs loaded before\n",
+            __func__);
+        return;
+    }
+
+    prevUdfs = PEPOUdfs;
+    __atomic_store_n(&PEPOUdfs, udfs, __ATOMIC_RELEASE);
+
+    //
+    // An lcore takes the new version at its next quiescent point, after which it no longer runs the previous one
+    //
+    //
+    token = rte_rcu_qsbr_start(PEPOUdfsQsbr);
+    rte_rcu_qsbr_check(PEPOUdfsQsbr, token, true);
+    PEPOUnloadUDFs(prevUdfs);
+
+    RTE_LOG(NOTICE, USER1,
+        "%s: all lcores offload with version %u\n",
+        __func__, udfs->Version);
+}
+
+//
+// Ask for the UDFs to be reloaded
+//
+//
+static void
+UdfsSigHandler(
+    int SigNum
+) {
+    __atomic_store_n(&PEPOUdfsReload, 1, __ATOMIC_RELAXED);
+}
+
+//
+// The control thread that reloads the UDFs when asked to
+//
+//
+static void*
+PEPOUdfsMain(
+    void *Arg
+) {
+    while (ForceQuitNetworkEngine == 0) {
+        sleep(1);
+        if (__atomic_exchange_n(&PEPOUdfsReload, 0, __ATOMIC_RELAXED)) {
+            PEPOReloadUDFs();
+        }
+    }
+
+    return NULL;
+}
+
 //
 // Initialize the PEPO based on TLDK TCP/IP
 //
@@ -1049,9 +1523,12 @@ PEPOTLDKTCPInit(
     const char* CoreList,
     const char* HostIPv4Addr,
     uint16_t HostTCPPort,
+    const char* HostBackends,
     const char* DPUIPv4Addr,
     const char* UdfPath,
-    uint32_t MaxStreams
+    uint32_t MaxStreams,
+    uint32_t Mtu,
+    const struct PEPOTcpTunables* Tunables
 ) {
     //
     // DPDK and TLDK initialization
@@ -1060,31 +1537,148 @@ PEPOTLDKTCPInit(
     int32_t result;
     uint32_t i;
     struct rte_eth_dev_info devInfo;
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    OffloadResponseRingBuffer *rings;
+#endif
 
     strcpy(PEPOIPv4Addr, DPUIPv4Addr);
 
-    memset(CoreParam, 0, sizeof(CoreParam));
-    memset(&TleCtxParam, 0, sizeof(TleCtxParam));
-    memset(&BeCfg, 0, sizeof(BeCfg));
-
     //
-    // Set fixed parameters
+    // Without UDFs, all messages are forwarded
     //
     //
-    TleCtxParam.send_bulk_size = 0;
-    TleCtxParam.flags = TLE_CTX_FLAG_ST;
-    TleCtxParam.max_stream_rbufs = MaxStreams;
-    TleCtxParam.max_stream_sbufs = MaxStreams;
-    TleCtxParam.max_streams = MaxStreams;
-    TleCtxParam.timewait = TLE_TCP_TIMEWAIT_DEFAULT;
-    TleCtxParam.hash_alg = TLE_SIPHASH;
-    TleCtxParam.proto = TLE_PROTO_TCP;
-    memcpy(&TleCtxParam.secret_key, TCP_SEQ_HASH_SEC_KEY,
-                sizeof(TleCtxParam.secret_key));
-    TleCtxParam.icw = 0;
+    if (UdfPath != NULL && UdfPath[0] != '\0') {
+        snprintf(PEPOUdfPath, sizeof(PEPOUdfPath), "%s", UdfPath);
+        PEPOUdfs = PEPOLoadUDFs(PEPOUdfPath, PEPOUdfsVersion);
+        if (PEPOUdfs == NULL) {
+            SigHandler(SIGQUIT);
+            return -EINVAL;
+        }
 
-    BeCfg.Promisc = 1;
-    BeCfg.NumMempoolBufs = MPOOL_NB_BUF;
+        //
+        // Every lcore that offloads is a reader of the UDFs
+        //
+        //
+        PEPOUdfsQsbr = (struct rte_rcu_qsbr*)rte_zmalloc(NULL, rte_rcu_qsbr_get_memsize(MAX_OFFLOAD_LCORES),
+            RTE_CACHE_LINE_SIZE);
+        if (PEPOUdfsQsbr == NULL || rte_rcu_qsbr_init(PEPOUdfsQsbr, MAX_OFFLOAD_LCORES) != 0) {
+            RTE_LOG(ERR, USER1,
+                "%s: failed to initialize the RCU of the UDFs\n",
+                __func__);
+            SigHandler(SIGQUIT);
+            return -ENOMEM;
+        }
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+        //
+        // The offload response rings the back end writes to the host from, in memory the file service reads into;
+        // without them, the requests the offload function reads for the host are forwarded as they are
+        //
+        //
+        rings = (OffloadResponseRingBuffer*)rte_zmalloc(NULL, sizeof(OffloadResponseRingBuffer) * OFFLOAD_RESPONSE_RINGS,
+            RTE_CACHE_LINE_SIZE);
+        if (rings == NULL) {
+            RTE_LOG(WARNING, USER1,
+                "%s: failed to allocate the offload response rings\n",
+                __func__);
+        }
+        else {
+            PublishOffloadResponseRings(rings);
+        }
+#endif
+    }
+
+    memset(CoreParam, 0, sizeof(CoreParam));
+    memset(&TleCtxParam, 0, sizeof(TleCtxParam));
+    memset(&BeCfg, 0, sizeof(BeCfg));
+
+    //
+    // The counters of the lcores, which are always kept
+    //
+    //
+    result = PEPOStatsInit();
+    if (result != 0) {
+        RTE_LOG(ERR, USER1,
+            "%s: failed to allocate the counters: err = %d\n",
+            __func__, result);
+        SigHandler(SIGQUIT);
+        return result;
+    }
+
+#ifdef PEPO_TLS
+    result = PEPOTlsInit(PEPO_TLS_CERT_PATH, PEPO_TLS_KEY_PATH);
+    if (result != 0) {
+        SigHandler(SIGQUIT);
+        return result;
+    }
+#endif
+
+    //
+    // Set fixed parameters
+    //
+    //
+    TleCtxParam.send_bulk_size = 0;
+    TleCtxParam.flags = TLE_CTX_FLAG_ST;
+    TleCtxParam.max_stream_rbufs = RTE_MIN(MaxStreams, PEPO_MAX_STREAM_BUFS);
+    TleCtxParam.max_stream_sbufs = RTE_MIN(MaxStreams, PEPO_MAX_STREAM_BUFS);
+    TleCtxParam.max_streams = MaxStreams;
+    TleCtxParam.free_streams.min = RTE_MIN(MaxStreams, PEPO_FREE_STREAMS_MIN);
+    TleCtxParam.free_streams.max = RTE_MIN(MaxStreams, PEPO_FREE_STREAMS_MAX);
+    TleCtxParam.timewait = TLE_TCP_TIMEWAIT_DEFAULT;
+    TleCtxParam.hash_alg = TLE_SIPHASH;
+    TleCtxParam.proto = TLE_PROTO_TCP;
+    memcpy(&TleCtxParam.secret_key, TCP_SEQ_HASH_SEC_KEY,
+                sizeof(TleCtxParam.secret_key));
+    TleCtxParam.icw = 0;
+    TleCtxParam.ofo_stream_bytes = PEPO_OFO_STREAM_BYTES;
+    TleCtxParam.ofo_ctx_bytes = PEPO_OFO_LCORE_BYTES;
+
+    //
+    // Timers and buffers of the deployment; datacenter links want an RTO far below the 1 s of RFC 6298,
+    // and a tick to match
+    //
+    //
+    if (Tunables != NULL) {
+        if (Tunables->RtoMinMs != 0 && Tunables->RtoMaxMs != 0 && Tunables->RtoMinMs > Tunables->RtoMaxMs) {
+            RTE_LOG(ERR, USER1, "%s: min RTO %u ms is above max RTO %u ms\n",
+                __func__, Tunables->RtoMinMs, Tunables->RtoMaxMs);
+            return -EINVAL;
+        }
+        if (Tunables->TimerBatch > PEPO_TIMER_BATCH_MAX) {
+            RTE_LOG(ERR, USER1, "%s: timer batch %u is above %u\n",
+                __func__, Tunables->TimerBatch, PEPO_TIMER_BATCH_MAX);
+            return -EINVAL;
+        }
+
+        TleCtxParam.rto_min = Tunables->RtoMinMs;
+        TleCtxParam.rto_max = Tunables->RtoMaxMs;
+        TleCtxParam.timer_tick = Tunables->TimerTickMs;
+        if (Tunables->StreamRecvBufs != 0) {
+            TleCtxParam.max_stream_rbufs = Tunables->StreamRecvBufs;
+        }
+        if (Tunables->StreamSendBufs != 0) {
+            TleCtxParam.max_stream_sbufs = Tunables->StreamSendBufs;
+        }
+        if (Tunables->TimerBatch != 0) {
+            PEPOTimerBatch = Tunables->TimerBatch;
+        }
+    }
+    RTE_LOG(NOTICE, USER1, "TCP: RTO = [%u, %u] ms (0 for default), tick = %u ms, timer batch = %u, "
+        "stream buffers = <rx = %u, tx = %u>\n",
+        TleCtxParam.rto_min, TleCtxParam.rto_max, TleCtxParam.timer_tick, PEPOTimerBatch,
+        TleCtxParam.max_stream_rbufs, TleCtxParam.max_stream_sbufs);
+
+    BeCfg.Promisc = 1;
+
+    //
+    // An lcore needs mbufs for its RX and TX descriptors, the bursts it has in hand, its cache,
+    // and a window of packets for each of its busy streams; read buffers for its outstanding reads,
+    // with the request and a chained buffer each, and the responses TLDK keeps until they are acked
+    //
+    //
+    BeCfg.NumMempoolBufs = RX_RING_SIZE + TX_RING_SIZE + 2 * MAX_PKT_BURST + MPOOL_CACHE_SIZE * 3 / 2 +
+        RTE_MIN(MaxStreams, PEPO_MEMPOOL_MAX_STREAMS) * MPOOL_BUFS_PER_STREAM;
+    BeCfg.NumReadBufs = MAX_READ_OPS_PER_LCORE * READ_BUFS_PER_OP + READ_BUF_CACHE_SIZE * 3 / 2;
 
     //
     // Set configurable parameters
@@ -1098,12 +1692,57 @@ PEPOTLDKTCPInit(
     BeCfg.Cores = (struct NetbeLcore*)rte_zmalloc(NULL, sizeof(struct NetbeLcore) * NumCores,
         RTE_CACHE_LINE_SIZE);
     
+    //
+    // Every lcore owns a queue of the port, its tle_ctx, a listener and the streams RSS sends it,
+    // so the core list must name NumCores distinct lcores that EAL runs
+    //
+    //
     char coreList[32];
     strcpy(coreList, CoreList);
     char** coreListArray = StrSplit(coreList, ',');
     for (i = 0; i < NumCores; i++) {
+        uint32_t j;
+
+        if (coreListArray == NULL || coreListArray[i] == NULL) {
+            RTE_LOG(ERR, USER1,
+                "%s: the core list %s has fewer than %u lcores\n",
+                __func__, CoreList, NumCores);
+            SigHandler(SIGQUIT);
+            return -EINVAL;
+        }
+
         BeCfg.Cores[i].Id = atoi(coreListArray[i]);
         BeCfg.Cores[i].NumPortQueues = 0;
+        if (!rte_lcore_is_enabled(BeCfg.Cores[i].Id)) {
+            RTE_LOG(ERR, USER1,
+                "%s: lcore %u of the core list is not enabled\n",
+                __func__, BeCfg.Cores[i].Id);
+            SigHandler(SIGQUIT);
+            return -EINVAL;
+        }
+        for (j = 0; j != i; j++) {
+            if (BeCfg.Cores[j].Id == BeCfg.Cores[i].Id) {
+                RTE_LOG(ERR, USER1,
+                    "%s: lcore %u is in the core list more than once\n",
+                    __func__, BeCfg.Cores[i].Id);
+                SigHandler(SIGQUIT);
+                return -EINVAL;
+            }
+        }
+
+        //
+        // An lcore polls its CPU, which must not be planned for the storage engine
+        //
+        //
+        char owner[CORE_PLAN_OWNER_CHARS];
+        snprintf(owner, sizeof(owner), "PEPO lcore %u", BeCfg.Cores[i].Id);
+        if (CorePlanClaim(rte_lcore_to_cpu_id(BeCfg.Cores[i].Id), owner, true)) {
+            RTE_LOG(ERR, USER1,
+                "%s: lcore %u of the core list is on a core of another engine, the network lcores start at core %u\n",
+                __func__, BeCfg.Cores[i].Id, CORE_ALLOCATION_NETWORK_ENGINE_FIRST_CORE);
+            SigHandler(SIGQUIT);
+            return -EBUSY;
+        }
     }
 
     PEPOVerbose = 9;
@@ -1113,7 +1752,15 @@ PEPOTLDKTCPInit(
     //
     //
     BeCfg.Ports[PEPOPortId].Id = PEPOPortId;
-    BeCfg.Ports[PEPOPortId].Mtu = PEPOMtuSize;
+    if (Mtu == 0) {
+        Mtu = PEPO_MTU_DEFAULT;
+    }
+    if (Mtu < PEPO_MTU_MIN || Mtu > PEPO_MTU_MAX) {
+        RTE_LOG(ERR, USER1, "%s: MTU %u is out of [%u, %u]\n",
+            __func__, Mtu, PEPO_MTU_MIN, PEPO_MTU_MAX);
+        return -EINVAL;
+    }
+    BeCfg.Ports[PEPOPortId].Mtu = Mtu + RTE_ETHER_HDR_LEN;
     BeCfg.Ports[PEPOPortId].RxOffload = PEPORxOffload;
     BeCfg.Ports[PEPOPortId].TxOffload = PEPOTxOffload;
     
@@ -1181,7 +1828,7 @@ PEPOTLDKTCPInit(
             return result;
         }
         rte_eth_dev_info_get(BeCfg.Ports[i].Id, &devInfo);
-        UpdateRssReta(&BeCfg.Ports[i], &devInfo);
+        result = UpdateRssReta(&BeCfg.Ports[i], &devInfo);
         if (result != 0) {
             RTE_LOG(ERR, USER1,
                 "%s: UpdateRssReta returned "
@@ -1216,6 +1863,19 @@ PEPOTLDKTCPInit(
     GlobalHostTCPPort = HostTCPPort;
     strcpy(GlobalHostIPv4Addr, HostIPv4Addr);
 
+#ifdef PEPO_HOST_BACKENDS
+    result = PEPOHostBackendsInit(HostBackends, HostIPv4Addr, HostTCPPort);
+    if (result != 0) {
+        RTE_LOG(ERR, USER1,
+            "%s: PEPOHostBackendsInit returned error code: %d\n",
+            __func__, result);
+        SigHandler(SIGQUIT);
+        return result;
+    }
+#else
+    RTE_SET_USED(HostBackends);
+#endif
+
     //
     // Set DPU stream address
     // Local address: local IP + host TCP port (reuse host port for symmetric RSS)
@@ -1357,6 +2017,158 @@ NetfeGetStream(
     return s;
 }
 
+//
+// Allocate a chunk of streams for the memtank of an lcore, on the socket of the lcore
+//
+//
+static void *
+NetfeStreamChunkAlloc(
+    size_t Size,
+    void *Udata
+) {
+    return rte_zmalloc_socket(NULL, Size, RTE_CACHE_LINE_SIZE, (int)(uintptr_t)Udata);
+}
+
+//
+// Free a chunk of streams of the memtank of an lcore
+//
+//
+static void
+NetfeStreamChunkFree(
+    void *Chunk,
+    void *Udata
+) {
+    RTE_SET_USED(Udata);
+    rte_free(Chunk);
+}
+
+//
+// Create the memtank of the streams of an lcore, with room for its max streams
+//
+//
+static struct tle_memtank *
+NetfeStreamTankCreate(
+    uint32_t MaxStreams,
+    uint32_t SocketId
+) {
+    struct tle_memtank_prm prm;
+
+    memset(&prm, 0, sizeof(prm));
+    prm.min_free = PEPO_STREAM_CHUNK;
+    prm.max_free = PEPO_FREE_STREAMS_MAX;
+    prm.max_obj = MaxStreams;
+    prm.obj_size = sizeof(struct NetfeStream);
+    prm.obj_align = RTE_CACHE_LINE_SIZE;
+    prm.nb_obj_chunk = PEPO_STREAM_CHUNK;
+    prm.alloc = NetfeStreamChunkAlloc;
+    prm.free = NetfeStreamChunkFree;
+    prm.udata = (void*)(uintptr_t)SocketId;
+
+    return tle_memtank_create(&prm);
+}
+
+//
+// Release streams to the memtank, with their events
+//
+//
+static void
+NetfeReleaseStreams(
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStreams[],
+    uint32_t Num
+) {
+    uint32_t i;
+
+    for (i = 0; i != Num; i++) {
+        tle_event_idle(FeStreams[i]->RxEv);
+        tle_event_idle(FeStreams[i]->TxEv);
+        tle_event_idle(FeStreams[i]->ErEv);
+        tle_event_free(FeStreams[i]->RxEv);
+        tle_event_free(FeStreams[i]->TxEv);
+        tle_event_free(FeStreams[i]->ErEv);
+    }
+
+    tle_memtank_free(FeLcore->StreamTank, (void * const *)FeStreams, Num, TLE_MTANK_FREE_SHRINK);
+    FeLcore->NumTankStreams -= Num;
+}
+
+//
+// Take a chunk of streams from the memtank onto the free list
+//
+//
+static void
+NetfeGrowStreams(
+    struct NetfeLcore *FeLcore
+) {
+    struct NetfeStream *feStreams[PEPO_STREAM_CHUNK];
+    uint32_t i, n;
+
+    n = tle_memtank_alloc(FeLcore->StreamTank, (void **)feStreams, RTE_DIM(feStreams),
+        TLE_MTANK_ALLOC_CHUNK | TLE_MTANK_ALLOC_GROW);
+    FeLcore->NumTankStreams += n;
+
+    for (i = 0; i != n; i++) {
+        memset(feStreams[i], 0, sizeof(*feStreams[i]));
+        feStreams[i]->RxEv = tle_event_alloc(FeLcore->RxEq, feStreams[i]);
+        feStreams[i]->TxEv = tle_event_alloc(FeLcore->TxEq, feStreams[i]);
+        feStreams[i]->ErEv = tle_event_alloc(FeLcore->ErEq, feStreams[i]);
+        if (feStreams[i]->RxEv == NULL || feStreams[i]->TxEv == NULL || feStreams[i]->ErEv == NULL) {
+            RTE_LOG(ERR, USER1, "%s: no events left for %u streams\n", __func__, n - i);
+            if (feStreams[i]->RxEv != NULL) {
+                tle_event_free(feStreams[i]->RxEv);
+            }
+            if (feStreams[i]->TxEv != NULL) {
+                tle_event_free(feStreams[i]->TxEv);
+            }
+            if (feStreams[i]->ErEv != NULL) {
+                tle_event_free(feStreams[i]->ErEv);
+            }
+            tle_memtank_free(FeLcore->StreamTank, (void * const *)(feStreams + i), n - i, 0);
+            FeLcore->NumTankStreams -= n - i;
+            n = i;
+            break;
+        }
+    }
+
+    NetfePutStreams(FeLcore, &FeLcore->Free, feStreams, n);
+}
+
+//
+// Get a stream for a new connection, growing the free list from the memtank when it is empty
+//
+//
+static inline struct NetfeStream *
+NetfeNewStream(
+    struct NetfeLcore *FeLcore
+) {
+    if (FeLcore->Free.Num == 0) {
+        NetfeGrowStreams(FeLcore);
+    }
+
+    return NetfeGetStream(&FeLcore->Free);
+}
+
+//
+// Return the closed streams past PEPO_FREE_STREAMS_MAX to the memtank; a read in flight holds on to
+// the stream it was issued for, so this waits for the lcore to have no reads in flight
+//
+//
+static inline void
+NetfeTrimStreams(
+    struct NetfeLcore *FeLcore
+) {
+    struct NetfeStream *feStreams[PEPO_STREAM_CHUNK];
+    uint32_t n;
+
+    if (FeLcore->Free.Num <= PEPO_FREE_STREAMS_MAX || FeLcore->ReadOpHead != FeLcore->ReadOpTail) {
+        return;
+    }
+
+    n = NetfeGetStreams(&FeLcore->Free, feStreams, RTE_MIN(FeLcore->Free.Num - PEPO_FREE_STREAMS_MAX,
+        (uint32_t)RTE_DIM(feStreams)));
+    NetfeReleaseStreams(FeLcore, feStreams, n);
+}
+
 //
 // Empty the packet buffer
 //
@@ -1390,9 +2202,7 @@ NetfeListenStreamTerm(
 ) {
     FeStream->TleStream = NULL;
     FeStream->PostErr = 0;
-#ifdef DDS_VERBOSE
     memset(&FeStream->Stat, 0, sizeof(FeStream->Stat));
-#endif
     PktBufEmpty(&FeStream->Pbuf);
 }
 
@@ -1411,9 +2221,30 @@ NetfeStreamTerm(
 
     FeStream->TleStream = NULL;
     FeStream->PostErr = 0;
-#ifdef DDS_VERBOSE
-    memset(&FeStream->Stat, 0, sizeof(FeStream->Stat));
+    FeStream->Generation++;
+    memset(&FeStream->PredState, 0, sizeof(FeStream->PredState));
+    FeStream->PredLost = false;
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    FeStream->OutstandingReads = 0;
+#endif
+#ifdef PEPO_SPLICE_TO_HOST
+    FeStream->Peer = NULL;
+    FeStream->HostLeg = false;
 #endif
+#ifdef PEPO_HOST_BACKENDS
+    if (FeStream->Backend != NULL) {
+        PEPOHostBackendClose(FeStream->Backend, FeStream->HostAwaiting, false);
+        FeStream->Backend = NULL;
+    }
+    FeStream->HostAwaiting = 0;
+    FeStream->HostAnswered = false;
+#endif
+#ifdef PEPO_TLS
+    PEPOTlsSessionFree(FeStream->Tls);
+    FeStream->Tls = NULL;
+    FeStream->TlsSealed = 0;
+#endif
+    memset(&FeStream->Stat, 0, sizeof(FeStream->Stat));
     PktBufEmpty(&FeStream->Pbuf);
     NetfePutStream(FeLcore, &FeLcore->Free, FeStream);
 }
@@ -1468,19 +2299,13 @@ NetfeListenStreamOpen(
     //
     //
     tle_event_active(FeListenStream->TxEv, TLE_SEV_DOWN);
-#ifdef DDS_VERBOSE
     FeListenStream->Stat.TxEv[TLE_SEV_DOWN]++;
-#endif
 
     tle_event_active(FeListenStream->RxEv, TLE_SEV_DOWN);
-#ifdef DDS_VERBOSE
     FeListenStream->Stat.RxEv[TLE_SEV_DOWN]++;
-#endif
     
     tle_event_active(FeListenStream->ErEv, TLE_SEV_DOWN);
-#ifdef DDS_VERBOSE
     FeListenStream->Stat.ErEv[TLE_SEV_DOWN]++;
-#endif
 
     memset(&tcpStreamParam, 0, sizeof(tcpStreamParam));
     tcpStreamParam.addr.local = SParam->LocalAddr;
@@ -1516,6 +2341,43 @@ NetfeListenStreamOpen(
     return 0;
 }
 
+#ifdef PEPO_UDP_REQUESTS
+//
+// Open the UDP stream of an lcore on the addresses of a listening stream; its datagrams are polled, without events
+//
+//
+static int
+NetfeUdpStreamOpen(
+    struct NetfeLcore *FeLcore,
+    const struct NetfeSParam *SParam,
+    uint32_t Lcore
+) {
+    struct tle_udp_stream_param udpStreamParam;
+    struct NetbeLcore *beLcore = &BeCfg.Cores[SParam->Bidx];
+
+    memset(&udpStreamParam, 0, sizeof(udpStreamParam));
+    udpStreamParam.local_addr = SParam->LocalAddr;
+    udpStreamParam.remote_addr = SParam->RemoteAddr;
+
+    FeLcore->UdpStream.TleStream = tle_udp_stream_open(beLcore->UdpCtx, &udpStreamParam);
+    if (FeLcore->UdpStream.TleStream == NULL) {
+        RTE_LOG(ERR, USER1, "%s (lcore = %u) UDP stream open failed with error code = %d, BeIdx = %u\n",
+            __func__, Lcore, rte_errno, SParam->Bidx);
+        return -rte_errno;
+    }
+
+    FeLcore->UdpStream.Udp = true;
+    FeLcore->UdpStream.Laddr = SParam->LocalAddr;
+    FeLcore->UdpMaxRespBytes = beLcore->PortQueues[0].Port.Mtu - sizeof(struct rte_ipv4_hdr) -
+        sizeof(struct rte_udp_hdr);
+
+    RTE_LOG(NOTICE, USER1, "%s (lcore = %u) UDP stream (%p) created, belcore = %u\n",
+        __func__, Lcore, FeLcore->UdpStream.TleStream, beLcore->Id);
+
+    return 0;
+}
+#endif
+
 //
 // Format an IP address
 //
@@ -1592,7 +2454,6 @@ NetfeStreamDump(
     case LISTENING_STREAM:
     {
         struct NetfeListenStream* feListenStream = (struct NetfeListenStream*)FeStream;
-#ifdef DDS_VERBOSE
     RTE_LOG(INFO, USER1, "TCP listening stream@%p (lcore = %d) = { TLE stream = %p, "
         "Laddr = %s, Lport = %hu, Raddr = %s, Rport = %hu;"
         "Stats = { "
@@ -1607,18 +2468,11 @@ NetfeStreamDump(
         feListenStream->Stat.RxEv[TLE_SEV_IDLE],
         feListenStream->Stat.RxEv[TLE_SEV_DOWN],
         feListenStream->Stat.RxEv[TLE_SEV_UP]);
-#else
-        RTE_LOG(INFO, USER1, "TCP listening stream@%p (lcore = %d) = { TLE stream = %p, "
-        "Laddr = %s, Lport = %hu, Raddr = %s, Rport = %hu }\n",
-        feListenStream, rte_lcore_id(), feListenStream->TleStream,
-        laddr, ntohs(lport), raddr, ntohs(rport));
-#endif
         break;
     }
     case DPU_STREAM:
     {
         struct NetfeStream* feStream = (struct NetfeStream*)FeStream;
-#ifdef DDS_VERBOSE
     RTE_LOG(INFO, USER1, "TCP DPU stream@%p (lcore = %d) = { TLE stream = %p, "
         "Laddr = %s, Lport = %hu, Raddr = %s, Rport = %hu;"
         "Stats = { "
@@ -1638,12 +2492,6 @@ NetfeStreamDump(
         feStream->Stat.TxEv[TLE_SEV_IDLE],
         feStream->Stat.TxEv[TLE_SEV_DOWN],
         feStream->Stat.TxEv[TLE_SEV_UP]);
-#else
-        RTE_LOG(INFO, USER1, "TCP DPU stream@%p (lcore = %d) = { TLE stream = %p, "
-        "Laddr = %s, Lport = %hu, Raddr = %s, Rport = %hu }\n",
-        feStream, rte_lcore_id(), feStream->TleStream,
-        laddr, ntohs(lport), raddr, ntohs(rport));
-#endif
         break;
     }
     default:
@@ -1668,7 +2516,6 @@ NetfeLcoreInit(
     struct NetfeLcore *fe;
     struct tle_evq_param evtParam;
     struct NetfeListenStream *feListenStream;
-    struct NetfeStream *feStream;
     struct NetfeSParam *sParam;
 
     lcore = rte_lcore_id();
@@ -1682,7 +2529,7 @@ NetfeLcoreInit(
     evtParam.socket_id = sid;
     evtParam.max_events = snum;
 
-    sz = sizeof(struct NetfeLcore) + snum * sizeof(struct NetfeStream);
+    sz = sizeof(struct NetfeLcore);
     fe = (struct NetfeLcore*)rte_zmalloc_socket(NULL, sz, RTE_CACHE_LINE_SIZE, sid);
     if (fe == NULL) {
         RTE_LOG(ERR, USER1, "%s:%d failed to allocate %zu bytes for NetfeLcore\n",
@@ -1690,6 +2537,40 @@ NetfeLcoreInit(
         return -ENOMEM;
     }
 
+    fe->Stats = &PEPOStats[lcore];
+    fe->Stats->Active = 1;
+
+    //
+    // Take a block of the DPU I/O slots for the reads this lcore offloads, and read the UDFs from now on
+    //
+    //
+    if (PEPOUdfsQsbr != NULL) {
+        i = __atomic_fetch_add(&PEPONumOffloadLcores, 1, __ATOMIC_RELAXED);
+        if (i >= MAX_OFFLOAD_LCORES) {
+            RTE_LOG(ERR, USER1, "%s:%d no DPU I/O slots left for lcore %u, at most %u lcores offload\n",
+                __func__, __LINE__, lcore, MAX_OFFLOAD_LCORES);
+            rte_free(fe);
+            return -ENOSPC;
+        }
+        fe->OffloadId = i;
+        fe->IoSlotBase = DDS_DPU_IO_SLOT_NUMBER_BASE + i * MAX_READ_OPS_PER_LCORE;
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+        fe->MaxReadLatencyTsc = OFFLOAD_ADMISSION_MAX_LATENCY_US * rte_get_tsc_hz() / US_PER_S;
+#endif
+
+        rte_rcu_qsbr_thread_register(PEPOUdfsQsbr, i);
+        rte_rcu_qsbr_thread_online(PEPOUdfsQsbr, i);
+        fe->Udfs = __atomic_load_n(&PEPOUdfs, __ATOMIC_ACQUIRE);
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+        //
+        // Without a response cache, every offloaded read is read
+        //
+        //
+        fe->RespCache = PEPORespCacheCreate();
+#endif
+    }
+
     RTE_PER_LCORE(_fe) = fe;
 
     fe->NumStreams = snum;
@@ -1731,17 +2612,17 @@ NetfeLcoreInit(
     }
 
     //
-    // Allocate events for all DPU streams
+    // DPU streams and their events are taken from the memtank as connections arrive
     //
     //
-    feStream = (struct NetfeStream *)(fe + 1);
-    for (i = 0; i != snum; i++) {
-        feStream[i].RxEv = tle_event_alloc(fe->RxEq, feStream + i);
-        feStream[i].TxEv = tle_event_alloc(fe->TxEq, feStream + i);
-        feStream[i].ErEv = tle_event_alloc(fe->ErEq, feStream + i);
-        
-        NetfePutStream(fe, &fe->Free, &feStream[i]);
+    fe->StreamTank = NetfeStreamTankCreate(snum, sid);
+    if (fe->StreamTank == NULL) {
+        RTE_LOG(ERR, USER1, "%s:%d failed to create the stream memtank\n",
+            __func__, __LINE__);
+        result = -rte_errno;
+        return result;
     }
+    NetfeGrowStreams(fe);
     
     //
     // Allocate events for all listening streams and open these streams
@@ -1779,6 +2660,12 @@ NetfeLcoreInit(
         }
     }
 
+#ifdef PEPO_UDP_REQUESTS
+    if (result == 0 && fe->NumListeners != 0) {
+        result = NetfeUdpStreamOpen(fe, &Param->Streams[0].DPUStreamParam, lcore);
+    }
+#endif
+
     return result;
 }
 
@@ -1884,6 +2771,49 @@ FillPktHdrLen(
     Pkt->tx_offload = MbufTxOffload(L2, L3, L4, 0, 0, 0);
 }
 
+#ifdef PEPO_HEADER_SPLIT
+//
+// Make the header buffer of a split packet end where its payload starts: pull the rest of a longer header
+// from the payload buffer, or push the payload of a shorter one to the headroom of the payload buffer;
+// a packet whose header can't be made contiguous is marked invalid
+//
+//
+static inline void
+AlignHeaderSplit(
+    struct rte_mbuf *Pkt,
+    uint32_t HdrLen
+) {
+    struct rte_mbuf *next = Pkt->next;
+    uint32_t n;
+
+    if (next == NULL || Pkt->data_len == HdrLen) {
+        return;
+    }
+
+    if (Pkt->data_len < HdrLen) {
+        n = HdrLen - Pkt->data_len;
+        if (next->data_len < n || rte_pktmbuf_tailroom(Pkt) < n) {
+            Pkt->packet_type = RTE_PTYPE_UNKNOWN;
+            return;
+        }
+        rte_memcpy(rte_pktmbuf_mtod_offset(Pkt, char*, Pkt->data_len), rte_pktmbuf_mtod(next, char*), n);
+        Pkt->data_len += n;
+        next->data_off += n;
+        next->data_len -= n;
+    }
+    else {
+        n = Pkt->data_len - HdrLen;
+        if (rte_pktmbuf_headroom(next) < n) {
+            return;
+        }
+        next->data_off -= n;
+        next->data_len += n;
+        rte_memcpy(rte_pktmbuf_mtod(next, char*), rte_pktmbuf_mtod_offset(Pkt, char*, HdrLen), n);
+        Pkt->data_len = HdrLen;
+    }
+}
+#endif
+
 //
 // Get TCP header size
 //
@@ -1956,16 +2886,35 @@ GetIpv4HdrLen(
     return len;
 }
 
+#ifdef PEPO_UDP_REQUESTS
 //
-// HW can recognize L2/L3 with/without extensions/L4 (ixgbe/igb/fm10k)
+// Fill the header lengths of a UDP packet for the UDP context
 //
 //
-static uint16_t
-Type0TcpRxCallback(
-    __rte_unused dpdk_port_t Port,
-    __rte_unused uint16_t Queue,
-    struct rte_mbuf *Pkt[],
-    uint16_t NumPkts,
+static inline void
+FillUdpPktHdrLen(
+    struct rte_mbuf *Pkt,
+    uint32_t L2Len,
+    uint32_t L3Len
+) {
+    FillPktHdrLen(Pkt, L2Len, L3Len, sizeof(struct rte_udp_hdr));
+    AdjustIpv4Pktlen(Pkt, L2Len);
+#ifdef PEPO_HEADER_SPLIT
+    AlignHeaderSplit(Pkt, L2Len + L3Len + sizeof(struct rte_udp_hdr));
+#endif
+}
+#endif
+
+//
+// HW can recognize L2/L3 with/without extensions/L4 (ixgbe/igb/fm10k)
+//
+//
+static uint16_t
+Type0TcpRxCallback(
+    __rte_unused dpdk_port_t Port,
+    __rte_unused uint16_t Queue,
+    struct rte_mbuf *Pkt[],
+    uint16_t NumPkts,
     __rte_unused uint16_t MaxPkts,
     void *UserParam
 ) {
@@ -1994,6 +2943,9 @@ Type0TcpRxCallback(
             FillPktHdrLen(Pkt[j], l2Len,
                 sizeof(struct rte_ipv4_hdr), l4Len);
             AdjustIpv4Pktlen(Pkt[j], l2Len);
+#ifdef PEPO_HEADER_SPLIT
+            AlignHeaderSplit(Pkt[j], l2Len + sizeof(struct rte_ipv4_hdr) + l4Len);
+#endif
             break;
         case (RTE_PTYPE_L4_TCP | RTE_PTYPE_L3_IPV4_EXT |
                 RTE_PTYPE_L2_ETHER):
@@ -2001,7 +2953,21 @@ Type0TcpRxCallback(
             l4Len = GetTcpHeaderSize(Pkt[j], l2Len, l3Len);
             FillPktHdrLen(Pkt[j], l2Len, l3Len, l4Len);
             AdjustIpv4Pktlen(Pkt[j], l2Len);
+#ifdef PEPO_HEADER_SPLIT
+            AlignHeaderSplit(Pkt[j], l2Len + l3Len + l4Len);
+#endif
+            break;
+#ifdef PEPO_UDP_REQUESTS
+        /* non fragmented udp packets. */
+        case (RTE_PTYPE_L4_UDP | RTE_PTYPE_L3_IPV4 |
+                RTE_PTYPE_L2_ETHER):
+            FillUdpPktHdrLen(Pkt[j], l2Len, sizeof(struct rte_ipv4_hdr));
+            break;
+        case (RTE_PTYPE_L4_UDP | RTE_PTYPE_L3_IPV4_EXT |
+                RTE_PTYPE_L2_ETHER):
+            FillUdpPktHdrLen(Pkt[j], l2Len, GetIpv4HdrLen(Pkt[j], l2Len, 0));
             break;
+#endif
         default:
             /* treat packet types as invalid. */
             Pkt[j]->packet_type = RTE_PTYPE_UNKNOWN;
@@ -2068,10 +3034,19 @@ Type1TcpRxCallback(
             l4Len = GetTcpHeaderSize(Pkt[j], l2Len, l3Len);
             FillPktHdrLen(Pkt[j], l2Len, l3Len, l4Len);
             AdjustIpv4Pktlen(Pkt[j], l2Len);
+#ifdef PEPO_HEADER_SPLIT
+            AlignHeaderSplit(Pkt[j], l2Len + l3Len + l4Len);
+#endif
 #ifdef DDS_VERBOSE
             TcpStatUpdate(lc, Pkt[j], l2Len, l3Len);
 #endif
             break;
+#ifdef PEPO_UDP_REQUESTS
+        case (RTE_PTYPE_L4_UDP | RTE_PTYPE_L3_IPV4_EXT_UNKNOWN |
+                RTE_PTYPE_L2_ETHER):
+            FillUdpPktHdrLen(Pkt[j], l2Len, GetIpv4HdrLen(Pkt[j], l2Len, 0));
+            break;
+#endif
         default:
             /* treat packet types as invalid. */
             Pkt[j]->packet_type = RTE_PTYPE_UNKNOWN;
@@ -2110,6 +3085,23 @@ FillEthTcpHdrLen(
     if (etp == rte_be_to_cpu_16(RTE_ETHER_TYPE_VLAN))
         l2Len += sizeof(struct rte_vlan_hdr);
 
+#ifdef PEPO_UDP_REQUESTS
+    if (etp == rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4) &&
+        rte_pktmbuf_mtod_offset(Pkt, const struct rte_ipv4_hdr *, l2Len)->next_proto_id == IPPROTO_UDP) {
+        Pkt->packet_type = RTE_PTYPE_L4_UDP |
+            RTE_PTYPE_L3_IPV4_EXT_UNKNOWN |
+            RTE_PTYPE_L2_ETHER;
+        l3Len = GetIpv4HdrLen(Pkt, l2Len, 1);
+        if ((Pkt->packet_type & RTE_PTYPE_L4_MASK) == RTE_PTYPE_L4_UDP) {
+            FillUdpPktHdrLen(Pkt, l2Len, l3Len);
+        }
+        else {
+            Pkt->packet_type = RTE_PTYPE_UNKNOWN;
+        }
+        return;
+    }
+#endif
+
     if (etp == rte_be_to_cpu_16(RTE_ETHER_TYPE_IPV4)) {
         Pkt->packet_type = RTE_PTYPE_L4_TCP |
             RTE_PTYPE_L3_IPV4_EXT_UNKNOWN |
@@ -2118,6 +3110,11 @@ FillEthTcpHdrLen(
         l4Len = GetTcpHeaderSize(Pkt, l2Len, l3Len);
         FillPktHdrLen(Pkt, l2Len, l3Len, l4Len);
         AdjustIpv4Pktlen(Pkt, l2Len);
+#ifdef PEPO_HEADER_SPLIT
+        if ((Pkt->packet_type & RTE_PTYPE_L4_MASK) == RTE_PTYPE_L4_TCP) {
+            AlignHeaderSplit(Pkt, l2Len + l3Len + l4Len);
+        }
+#endif
     }
     else {
         Pkt->packet_type = RTE_PTYPE_UNKNOWN;
@@ -2216,6 +3213,25 @@ SetupRxCb(
     return -ENOENT;
 }
 
+//
+// Copy the retransmission and out-of-order counters of the TLDK context of a back-end lcore to its counters
+//
+//
+static inline void
+NetbeLcoreStatsUpdate(
+    struct NetbeLcore *BeLcore
+) {
+    struct tle_ctx_stat ctxStat;
+
+    if (tle_ctx_get_stat(BeLcore->Ctx, &ctxStat) == 0) {
+        BeLcore->Stats->RtoRetransmits = ctxStat.rto_retx;
+        BeLcore->Stats->FastRetransmits = ctxStat.fast_retx;
+        BeLcore->Stats->OfoBytes = (uint32_t)ctxStat.ofo_bytes;
+        BeLcore->Stats->OfoDrops = ctxStat.ofo_drops;
+        BeLcore->Stats->OfoEvicts = ctxStat.ofo_evicts;
+    }
+}
+
 //
 // Set up lcore for back end
 //
@@ -2230,6 +3246,12 @@ NetbeLcoreSetup(
     RTE_LOG(NOTICE, USER1, "%s: (lcore = %u, ctx = %p) start\n",
         __func__, BeLcore->Id, BeLcore->Ctx);
 
+    BeLcore->Stats = &PEPOStats[BeLcore->Id];
+    BeLcore->Stats->Active = 1;
+    BeLcore->RxBurst = PEPO_RX_BURST_MIN;
+    BeLcore->IdleIters = 0;
+    BeLcore->TxFlushTsc = PEPO_TX_FLUSH_US * rte_get_tsc_hz() / US_PER_S;
+
     /*
     * ???????
     * wait for FE lcores to start, so BE dont' drop any packets
@@ -2246,6 +3268,18 @@ NetbeLcoreSetup(
         if (result < 0) {
             return result;
         }
+
+#ifdef PEPO_IDLE_RX_INTR
+        //
+        // Without the interrupt, an idle lcore still wakes up every PEPO_IDLE_SLEEP_MS
+        //
+        //
+        if (rte_eth_dev_rx_intr_ctl_q(BeLcore->PortQueues[i].Port.Id, BeLcore->PortQueues[i].RxQid,
+            RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_ADD, NULL) != 0) {
+            RTE_LOG(WARNING, USER1, "%s (lcore = %u, port = %u, q = %u) has no RX interrupt\n",
+                __func__, BeLcore->Id, BeLcore->PortQueues[i].Port.Id, BeLcore->PortQueues[i].RxQid);
+        }
+#endif
     }
 
     if (result == 0) {
@@ -2265,14 +3299,21 @@ NetfeLcoreFiniTcp(void) {
     uint32_t i, snum;
     struct tle_tcp_stream_addr addr;
     void *fes;
-#ifdef DDS_VERBOSE
-    uint32_t acc, rej, ter;
-#endif
 
     fe = RTE_PER_LCORE(_fe);
     if (fe == NULL) {
         return;
     }
+
+    //
+    // Stop reading the UDFs, lest a reload wait for this lcore
+    //
+    //
+    if (fe->IoSlotBase != 0) {
+        fe->Udfs = NULL;
+        rte_rcu_qsbr_thread_offline(PEPOUdfsQsbr, fe->OffloadId);
+        rte_rcu_qsbr_thread_unregister(PEPOUdfsQsbr, fe->OffloadId);
+    }
     
     //
     // Close listening streams
@@ -2298,14 +3339,38 @@ NetfeLcoreFiniTcp(void) {
         NetfeStreamClose(fe, fes, DPU_STREAM);
     }
 
-#ifdef DDS_VERBOSE
-    acc = fe->TcpStat.Acc;
-    rej = fe->TcpStat.Rej;
-    ter = fe->TcpStat.Ter;
-
     RTE_LOG(NOTICE, USER1,
-        "TcpStat = {con_acc = %u, con_rej = %u, con_ter = %u}\n",
-        acc, rej, ter);
+        "TcpStat = {con_acc = %" PRIu64 ", con_rej = %" PRIu64 ", con_ter = %" PRIu64 "}\n",
+        fe->Stats->Accepted, fe->Stats->Rejected, fe->Stats->Terminated);
+
+    if (fe->Stats->ReadBufAllocFails != 0) {
+        RTE_LOG(NOTICE, USER1, "%" PRIu64 " read buffer allocations failed on an empty pool\n",
+            fe->Stats->ReadBufAllocFails);
+    }
+
+    if (fe->Stats->ReadsShed != 0) {
+        RTE_LOG(NOTICE, USER1, "%" PRIu64 " requests went to the host while the DPU was loaded\n",
+            fe->Stats->ReadsShed);
+    }
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    if (fe->RespCache != NULL) {
+        RTE_LOG(NOTICE, USER1, "%" PRIu64 " offloaded reads were answered from the response cache, which kept %" PRIu64
+            " responses\n", fe->Stats->RespCacheHits, fe->Stats->RespCacheFills);
+        PEPORespCacheFree(fe->RespCache);
+        fe->RespCache = NULL;
+    }
+#endif
+
+#ifdef PEPO_UDP_REQUESTS
+    if (fe->UdpStream.TleStream != NULL) {
+        tle_udp_stream_close(fe->UdpStream.TleStream);
+        fe->UdpStream.TleStream = NULL;
+
+        RTE_LOG(NOTICE, USER1,
+            "UdpStat = {rx = %" PRIu64 ", tx = %" PRIu64 ", declined = %" PRIu64 "}\n",
+            fe->Stats->UdpRxPkts, fe->Stats->UdpTxPkts, fe->Stats->UdpDeclined);
+    }
 #endif
 
     tle_evq_destroy(fe->ListenTxEq);
@@ -2315,12 +3380,22 @@ NetfeLcoreFiniTcp(void) {
     tle_evq_destroy(fe->RxEq);
     tle_evq_destroy(fe->ErEq);
 
+    //
+    // The events of the streams went with their queues
+    //
+    //
+    tle_memtank_destroy(fe->StreamTank);
+    fe->StreamTank = NULL;
+    fe->NumTankStreams = 0;
+    LIST_INIT(&fe->Free.Head);
+    fe->Free.Num = 0;
+
     //
     // Release read buffers
     //
     //
 #if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_STATIC    
-    for (i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
+    for (i = 0; i != MAX_READ_OPS_PER_LCORE; i++) {
         rte_pktmbuf_free((struct rte_mbuf*)fe->ReadOps[i].RespBuf);
     }
 #endif
@@ -2344,146 +3419,1525 @@ NetbeLcoreClear(void) {
         __func__, lc->Id, lc->Ctx);
 
     for (i = 0; i != lc->NumPortQueues; i++) {
-#ifdef DDS_VERBOSE
-        RTE_LOG(NOTICE, USER1, "%s: %u (port = %u, q = %u, lcore = %u, dev = %p) "
-            "rx_stats = {"
-            "in = %" PRIu64 ", up = %" PRIu64 ", drop = %" PRIu64 "}, "
-            "tx_stats = {"
-            "in = %" PRIu64 ", up = %" PRIu64 ", drop = %" PRIu64 "}\n",
-            __func__, i, lc->PortQueues[i].Port.Id, lc->PortQueues[i].RxQid,
-            lc->Id,
-            lc->PortQueues[i].Dev,
-            lc->PortQueues[i].RxStat.In,
-            lc->PortQueues[i].RxStat.Up,
-            lc->PortQueues[i].RxStat.Drop,
-            lc->PortQueues[i].TxStat.Down,
-            lc->PortQueues[i].TxStat.Out,
-            lc->PortQueues[i].TxStat.Drop);
-#else
         RTE_LOG(NOTICE, USER1, "%s: %u (port = %u, q = %u, lcore = %u, dev = %p)\n",
             __func__, i, lc->PortQueues[i].Port.Id, lc->PortQueues[i].RxQid,
             lc->Id,
             lc->PortQueues[i].Dev);
+    }
+
+    RTE_LOG(NOTICE, USER1, "%s: lcore = %u "
+        "rx_stats = {in = %" PRIu64 ", drop = %" PRIu64 "}, "
+        "tx_stats = {out = %" PRIu64 ", drop = %" PRIu64 "}, "
+        "retx = {rto = %" PRIu64 ", fast = %" PRIu64 "}\n",
+        __func__, lc->Id,
+        lc->Stats->RxPkts, lc->Stats->RxDrops,
+        lc->Stats->TxPkts, lc->Stats->TxDrops,
+        lc->Stats->RtoRetransmits, lc->Stats->FastRetransmits);
+
+#ifdef DDS_VERBOSE
+    RTE_LOG(NOTICE, USER1, "tcp_stat = {\n");
+    for (i = 0; i != RTE_DIM(lc->TcpStat.Flags); i++) {
+        if (lc->TcpStat.Flags[i] != 0) {
+            RTE_LOG(NOTICE, USER1, "[flag = %#x] == %" PRIu64 "\n",
+                i, lc->TcpStat.Flags[i]);
+        }
+    }
+    RTE_LOG(NOTICE, USER1, "}\n");
+#endif
+
+    for (i = 0; i != lc->NumPortQueues; i++) {
+        for (j = 0; j != lc->PortQueues[i].TxBuf.Num; j++) {
+            rte_pktmbuf_free(lc->PortQueues[i].TxBuf.Pkt[j]);
+        }
+    }
+
+    RTE_PER_LCORE(_be) = NULL;
+}
+
+//
+// Remove a stream from a list
+//
+//
+static inline void
+NetfeRemStream(
+    struct NetfeStreamList *List,
+    struct NetfeStream *Stream
+) {
+    LIST_REMOVE(Stream, Link);
+    List->Num--;
+}
+
+#ifdef PEPO_SPLICE_TO_HOST
+//
+// Check if RSS brings the packets the host sends to a local port to a queue;
+// the key hashes the ports only, as UpdateRssReta spreads the entries of the table over the queues
+//
+//
+static inline bool
+NetfeHostPortOnQueue(
+    const struct sockaddr_in *Local,
+    const struct sockaddr_in *Remote,
+    uint16_t Port,
+    uint32_t Qid
+) {
+    struct rte_ipv4_tuple tuple;
+    uint32_t hash;
+
+    if (BeCfg.NumCores == 1 || PEPORetaSize == 0) {
+        return true;
+    }
+
+    tuple.src_addr = rte_be_to_cpu_32(Remote->sin_addr.s_addr);
+    tuple.dst_addr = rte_be_to_cpu_32(Local->sin_addr.s_addr);
+    tuple.sport = rte_be_to_cpu_16(Remote->sin_port);
+    tuple.dport = Port;
+    hash = rte_softrss((uint32_t*)&tuple, RTE_THASH_V4_L4_LEN, SymmetricRssKey);
+
+    return (hash % PEPORetaSize) % BeCfg.NumCores == Qid;
+}
+
+//
+// Open the host leg of a connection just accepted and pair the two; the leg takes a free stream,
+// and a local port on the queue of this lcore, and connects to the host in the background
+//
+//
+static int
+NetfeSpliceToHost(
+    struct NetfeLcore *FeLcore,
+    struct NetbeLcore *BeLcore,
+    struct NetfeStream *ClientStream
+) {
+    struct NetfeStream *hostStream;
+    struct tle_tcp_stream_param tcpStreamParam;
+    struct sockaddr_in *local, *remote;
+    uint32_t tries;
+    uint16_t port;
+    int32_t result;
+#ifdef PEPO_HOST_BACKENDS
+    struct PEPOHostBackend *backend;
+#endif
+
+    hostStream = NetfeNewStream(FeLcore);
+    if (hostStream == NULL) {
+        return -ENOBUFS;
+    }
+
+    memset(&tcpStreamParam, 0, sizeof(tcpStreamParam));
+    FillAddr(&tcpStreamParam.addr.local, PEPOIPv4Addr, 0);
+#ifdef PEPO_HOST_BACKENDS
+    backend = PEPOHostBackendOpen();
+    FillAddr(&tcpStreamParam.addr.remote, backend->IPv4Addr, backend->TCPPort);
+#else
+    FillAddr(&tcpStreamParam.addr.remote, GlobalHostIPv4Addr, GlobalHostTCPPort);
+#endif
+    tcpStreamParam.cfg.err_ev = hostStream->ErEv;
+    tcpStreamParam.cfg.recv_ev = hostStream->RxEv;
+    tcpStreamParam.cfg.send_ev = hostStream->TxEv;
+    local = (struct sockaddr_in *)&tcpStreamParam.addr.local;
+    remote = (struct sockaddr_in *)&tcpStreamParam.addr.remote;
+
+    if (FeLcore->NextHostPort < SPLICE_HOST_PORT_MIN || FeLcore->NextHostPort >= SPLICE_HOST_PORT_MAX) {
+        FeLcore->NextHostPort = SPLICE_HOST_PORT_MIN;
+    }
+
+    result = -EADDRINUSE;
+    for (tries = 0; tries != SPLICE_HOST_PORT_MAX - SPLICE_HOST_PORT_MIN; tries++) {
+        port = FeLcore->NextHostPort++;
+        if (FeLcore->NextHostPort == SPLICE_HOST_PORT_MAX) {
+            FeLcore->NextHostPort = SPLICE_HOST_PORT_MIN;
+        }
+
+        if (!NetfeHostPortOnQueue(local, remote, port, BeLcore->PortQueues[0].RxQid)) {
+            continue;
+        }
+
+        local->sin_port = rte_cpu_to_be_16(port);
+        hostStream->TleStream = tle_tcp_stream_open(BeLcore->Ctx, &tcpStreamParam);
+        if (hostStream->TleStream != NULL) {
+            result = 0;
+            break;
+        }
+        if (rte_errno != EADDRINUSE && rte_errno != EEXIST) {
+            result = -rte_errno;
+            break;
+        }
+    }
+
+    if (result != 0) {
+        RTE_LOG(ERR, USER1, "%s: failed to open a stream to the host, error = %d\n", __func__, result);
+#ifdef PEPO_HOST_BACKENDS
+        PEPOHostBackendClose(backend, 0, false);
+#endif
+        hostStream->TleStream = NULL;
+        NetfePutStream(FeLcore, &FeLcore->Free, hostStream);
+        return result;
+    }
+
+    tle_event_active(hostStream->ErEv, TLE_SEV_DOWN);
+    tle_event_active(hostStream->TxEv, TLE_SEV_UP);
+    tle_event_active(hostStream->RxEv, TLE_SEV_UP);
+
+    result = tle_tcp_stream_connect(hostStream->TleStream, (const struct sockaddr *)remote);
+    if (result != 0) {
+        RTE_LOG(ERR, USER1, "%s: failed to connect to the host, error = %d\n", __func__, result);
+#ifdef PEPO_HOST_BACKENDS
+        PEPOHostBackendClose(backend, 0, false);
+#endif
+        tle_event_idle(hostStream->RxEv);
+        tle_event_idle(hostStream->TxEv);
+        tle_event_idle(hostStream->ErEv);
+        tle_tcp_stream_close(hostStream->TleStream);
+        hostStream->TleStream = NULL;
+        NetfePutStream(FeLcore, &FeLcore->Free, hostStream);
+        return result;
+    }
+
+    hostStream->HostLeg = true;
+#ifdef PEPO_HOST_BACKENDS
+    hostStream->Backend = backend;
+#endif
+    hostStream->Peer = ClientStream;
+    ClientStream->Peer = hostStream;
+    NetfePutStream(FeLcore, &FeLcore->Use, hostStream);
+
+    return 0;
+}
+#endif
+
+#ifdef PEPO_HOST_BACKENDS
+//
+// Count the messages a stream received into the Pbuf of Sink: what a client leg forwards on its host leg
+// is outstanding on the backend of the leg, until the backend sends on it
+//
+//
+static inline void
+NetfeCountHostMessages(
+    struct NetfeStream *FeStream,
+    struct NetfeStream *Sink,
+    uint32_t NumPkts
+) {
+    if (FeStream->Backend != NULL) {
+        PEPOHostBackendAnswered(FeStream->Backend, FeStream->HostAwaiting, !FeStream->HostAnswered);
+        FeStream->HostAwaiting = 0;
+        FeStream->HostAnswered = true;
+    }
+    else if (Sink->Backend != NULL) {
+        PEPOHostBackendSent(Sink->Backend, NumPkts);
+        Sink->HostAwaiting += NumPkts;
+    }
+}
+#endif
+
+//
+// Close a stream in use, along with the other leg of its connection if it is spliced
+//
+//
+static void
+NetfeStreamDrop(
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStream
+) {
+    struct tle_stream *tleStream[1];
+#ifdef PEPO_SPLICE_TO_HOST
+    struct NetfeStream *peer = FeStream->Peer;
+#endif
+
+    tleStream[0] = FeStream->TleStream;
+    tle_event_idle(FeStream->RxEv);
+    tle_event_idle(FeStream->TxEv);
+    tle_event_idle(FeStream->ErEv);
+    tle_tcp_stream_close_bulk(tleStream, 1);
+
+    NetfeRemStream(&FeLcore->Use, FeStream);
+    NetfeStreamTerm(FeLcore, FeStream);
+    FeLcore->Stats->Terminated++;
+
+#ifdef PEPO_SPLICE_TO_HOST
+    if (peer != NULL) {
+        peer->Peer = NULL;
+        NetfeStreamDrop(FeLcore, peer);
+    }
+#endif
+}
+
+//
+// Process TCP send and receive events: send the Pbuf of a stream, which the stream itself fills,
+// or the other leg of its connection if it is spliced
+//
+//
+static inline int
+NetfeRxTxProcess(
+    __rte_unused uint32_t Lcore,
+    struct NetfeStream *FeStream,
+    struct NetfeLcore *FeLcore
+) {
+    uint32_t i, k, n, total, currentSent;
+    struct rte_mbuf **pkts;
+    struct NetfeStream *feeder = FeStream;
+
+#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC
+    uint32_t sid = rte_lcore_to_socket_id(Lcore);
+#endif
+
+#ifdef PEPO_SPLICE_TO_HOST
+    if (FeStream->Peer != NULL) {
+        feeder = FeStream->Peer;
+    }
+#endif
+
+    total = FeStream->Pbuf.Num;
+    pkts = FeStream->Pbuf.Pkt;
+    n = total;
+
+#ifdef PEPO_TLS
+    //
+    // A client leg only sends records: seal the plaintext behind the packets already sealed,
+    // which can't start before the handshake is done
+    //
+    //
+    if (FeStream->Tls != NULL) {
+        FeStream->TlsSealed += PEPOTlsSeal(FeStream->Tls, &pkts[FeStream->TlsSealed], total - FeStream->TlsSealed);
+        n = FeStream->TlsSealed;
+    }
+#endif
+
+    if (n == 0) {
+#ifdef PEPO_TLS
+        //
+        // A seal that ran out of mbufs is retried on the next poll
+        //
+        //
+        if (total != 0 && PEPOTlsEstablished(FeStream->Tls)) {
+            return 0;
+        }
+#endif
+        tle_event_idle(FeStream->TxEv);
+        FeStream->Stat.TxEv[TLE_SEV_IDLE]++;
+        return 0;
+    }
+
+    //
+    // Send the packets; the stream takes the mbufs and frees them once they are acknowledged,
+    // and takes no more when its send buffer is full, in which case the rest wait here
+    //
+    //
+    k = 0;
+    while (k != n) {
+        currentSent = tle_tcp_stream_send(FeStream->TleStream, &pkts[k], n - k);
+        if (currentSent == 0) {
+            NETFE_TRACE("%s: failed to forward the packet\n", __func__);
+            break;
+        }
+
+        k += currentSent;
+    }
+
+    NETFE_TRACE("%s: tle_tcp_stream_send(%p, %u) returns %u\n",
+        __func__, FeStream->TleStream, n, k);
+
+    FeStream->Stat.TxPkts += k;
+    FeStream->Stat.Drops += n - k;
+    FeLcore->Stats->StreamTxPkts += k;
+    FeLcore->Stats->StreamTxDrops += n - k;
+
+    if (k == 0) {
+        return 0;
+    }
+
+    //
+    // Let the stream that fills the buffer receive again if it stopped because the buffer was full
+    //
+    //
+    if (total == RTE_DIM(FeStream->Pbuf.Pkt)) {
+        tle_event_active(feeder->RxEv, TLE_SEV_UP);
+        feeder->Stat.RxEv[TLE_SEV_UP]++;
+    }
+
+    //
+    // Adjust pbuf array
+    //
+    //
+    FeStream->Pbuf.Num = total - k;
+    for (i = 0; i != total - k; i++) {
+        pkts[i] = pkts[i + k];
+    }
+#ifdef PEPO_TLS
+    if (FeStream->Tls != NULL) {
+        FeStream->TlsSealed -= k;
+    }
+#endif
+
+    if (FeStream->Pbuf.Num == 0) {
+        tle_event_idle(FeStream->TxEv);
+    }
+
+    return k;
+}
+
+//
+// Queue a packet to be sent on a stream and trigger its send event
+//
+//
+static inline void
+NetfeQueuePkt(
+    struct NetfeStream *FeStream,
+    struct rte_mbuf *Pkt
+) {
+    if (FeStream->Pbuf.Num == 0) {
+        tle_event_active(FeStream->TxEv, TLE_SEV_UP);
+    }
+    else {
+        tle_event_raise(FeStream->TxEv);
+    }
+
+    FeStream->Pbuf.Pkt[FeStream->Pbuf.Num++] = Pkt;
+}
+
+#ifdef PEPO_TLS
+//
+// Open the records a client leg received, in place in Pkts; the handshake records of the session are queued
+// ahead of the plaintext its Pbuf holds, which waits for the handshake to be sealed.
+// Return the plaintext packets, or a negative errno when the connection must end
+//
+//
+static int
+NetfeTlsRecv(
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStream,
+    struct rte_mbuf **Pkts,
+    uint32_t NumPkts,
+    uint32_t MaxPkts
+) {
+    struct rte_mbuf *wire;
+    bool established = PEPOTlsEstablished(FeStream->Tls);
+    uint32_t i;
+    int result;
+
+    result = PEPOTlsRecv(FeStream->Tls, Pkts, NumPkts, MaxPkts);
+
+    wire = PEPOTlsTakeWire(FeStream->Tls);
+    if (wire != NULL) {
+        if (FeStream->Pbuf.Num == RTE_DIM(FeStream->Pbuf.Pkt)) {
+            rte_pktmbuf_free(wire);
+            result = -ENOBUFS;
+        }
+        else {
+            if (FeStream->Pbuf.Num == 0) {
+                tle_event_active(FeStream->TxEv, TLE_SEV_UP);
+            }
+            else {
+                tle_event_raise(FeStream->TxEv);
+            }
+            for (i = FeStream->Pbuf.Num; i != FeStream->TlsSealed; i--) {
+                FeStream->Pbuf.Pkt[i] = FeStream->Pbuf.Pkt[i - 1];
+            }
+            FeStream->Pbuf.Pkt[FeStream->TlsSealed++] = wire;
+            FeStream->Pbuf.Num++;
+        }
+    }
+
+    if (result < 0) {
+        RTE_LOG(NOTICE, USER1, "%s: TLS failed on stream %p: err = %d\n", __func__, FeStream, result);
+        FeLcore->Stats->TlsErrors++;
+        return result;
+    }
+
+    //
+    // Send what the host leg had for the client before the handshake was done
+    //
+    //
+    if (!established && PEPOTlsEstablished(FeStream->Tls)) {
+        FeLcore->Stats->TlsHandshakes++;
+        if (FeStream->Pbuf.Num != 0) {
+            tle_event_active(FeStream->TxEv, TLE_SEV_UP);
+        }
+    }
+
+    return result;
+}
+#endif
+
+//
+// Allocate a read buffer, counting the failures of the lcore
+//
+//
+static inline struct rte_mbuf*
+NetfeAllocReadBuf(
+    uint32_t Lcore
+) {
+    struct rte_mbuf *pkt;
+
+    pkt = rte_pktmbuf_alloc(ReadBufMpool[rte_lcore_to_socket_id(Lcore) + 1]);
+    if (unlikely(pkt == NULL)) {
+        RTE_PER_LCORE(_fe)->Stats->ReadBufAllocFails++;
+    }
+
+    return pkt;
+}
+
+//
+// Copy bytes into a read buffer to be sent
+//
+//
+static inline struct rte_mbuf*
+NetfeCopyToMbuf(
+    uint32_t Lcore,
+    const char *Data,
+    uint32_t Bytes
+) {
+    struct rte_mbuf *pkt;
+    char *payload;
+
+    pkt = NetfeAllocReadBuf(Lcore);
+    if (pkt == NULL) {
+        return NULL;
+    }
+
+    payload = rte_pktmbuf_append(pkt, Bytes);
+    if (payload == NULL) {
+        rte_pktmbuf_free(pkt);
+        return NULL;
+    }
+    rte_memcpy(payload, Data, Bytes);
+
+    return pkt;
+}
+
+//
+// The bytes of the request an offloaded read responds with
+//
+//
+static inline FileIOSizeT
+ReadOpReqSize(
+    ReadOpDescriptorT *ReadOp
+) {
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    return ReadOp->ReqSize;
+#else
+    return 0;
+#endif
+}
+
+#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC
+//
+// Allocate the read buffers a response is sent in: the request, then the data, read right after it
+// and continued in a second, chained buffer if it doesn't fit; DataBuffer is where the data is read
+//
+//
+static inline struct rte_mbuf*
+NetfeAllocRespBuf(
+    uint32_t Lcore,
+    const char *Req,
+    FileIOSizeT ReqSize,
+    FileIOSizeT Bytes,
+    SplittableBufferT *DataBuffer
+) {
+    struct rte_mbuf *head, *next;
+    uint32_t room;
+
+    head = NetfeAllocReadBuf(Lcore);
+    if (head == NULL) {
+        return NULL;
+    }
+
+    room = rte_pktmbuf_tailroom(head);
+    if (ReqSize > room) {
+        rte_pktmbuf_free(head);
+        return NULL;
+    }
+    rte_memcpy(rte_pktmbuf_mtod(head, char*), Req, ReqSize);
+
+    DataBuffer->TotalSize = Bytes;
+    DataBuffer->FirstAddr = rte_pktmbuf_mtod_offset(head, char*, ReqSize);
+    DataBuffer->FirstSize = RTE_MIN(Bytes, room - ReqSize);
+    DataBuffer->SecondAddr = NULL;
+
+    if (DataBuffer->FirstSize == Bytes) {
+        return head;
+    }
+
+    //
+    // The chained buffer needs no headroom
+    //
+    //
+    next = NetfeAllocReadBuf(Lcore);
+    if (next == NULL || Bytes - DataBuffer->FirstSize > next->buf_len) {
+        rte_pktmbuf_free(next);
+        rte_pktmbuf_free(head);
+        return NULL;
+    }
+    next->data_off = 0;
+    DataBuffer->SecondAddr = rte_pktmbuf_mtod(next, char*);
+    rte_pktmbuf_chain(head, next);
+
+    return head;
+}
+
+//
+// Take the buffers of a completed read to send them, with the request and the Bytes of data
+//
+//
+static inline struct rte_mbuf*
+NetfeTakeRespBuf(
+    ReadOpDescriptorT *ReadOp,
+    FileIOSizeT Bytes
+) {
+    struct rte_mbuf *head = (struct rte_mbuf*)ReadOp->RespBuf;
+    FileIOSizeT reqSize = ReadOpReqSize(ReadOp);
+    uint32_t first = RTE_MIN(Bytes, rte_pktmbuf_tailroom(head) - reqSize);
+
+    ReadOp->RespBuf = NULL;
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    //
+    // A response from the response cache was built whole when the read was issued
+    //
+    //
+    if (ReadOp->Cached) {
+        return head;
+    }
+#endif
+
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+    //
+    // Slide the request over the bytes read before the data
+    //
+    //
+    if (ReadOp->OffsetAlignment != 0) {
+        memmove(rte_pktmbuf_mtod_offset(head, char*, ReadOp->OffsetAlignment), rte_pktmbuf_mtod(head, char*), reqSize);
+        head->data_off += ReadOp->OffsetAlignment;
+        first = RTE_MIN(Bytes, rte_pktmbuf_tailroom(head) - reqSize);
+    }
+#endif
+
+    if (head->next != NULL && Bytes == first) {
+        rte_pktmbuf_free(head->next);
+        head->next = NULL;
+        head->nb_segs = 1;
+    }
+    if (head->next != NULL) {
+        head->next->data_len = Bytes - first;
+    }
+    head->data_len = reqSize + first;
+    head->pkt_len = reqSize + Bytes;
+
+    return head;
+}
+#endif
+
+//
+// Set up the response of a read the DPU answers: the request followed by the data;
+// return false if there is no buffer for it
+//
+//
+static inline bool
+NetfeSetUpRespBuf(
+    uint32_t Lcore,
+    const char *Req,
+    ReadOpDescriptorT *ReadOp,
+    SplittableBufferT *DataBuffer
+) {
+    FileIOSizeT reqSize = ReadOpReqSize(ReadOp);
+
+#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_NONE
+    if (reqSize + ReadOp->ReadReq.Bytes > MAX_OFFLOAD_READ_SIZE) {
+        return false;
+    }
+
+    memcpy(ReadOp->RespBuf, Req, reqSize);
+    DataBuffer->TotalSize = ReadOp->ReadReq.Bytes;
+    DataBuffer->FirstSize = ReadOp->ReadReq.Bytes;
+    DataBuffer->FirstAddr = ReadOp->RespBuf + reqSize;
+    DataBuffer->SecondAddr = NULL;
+#else
+    ReadOp->RespBuf = NetfeAllocRespBuf(Lcore, Req, reqSize, ReadOp->ReadReq.Bytes, DataBuffer);
+    if (ReadOp->RespBuf == NULL) {
+        return false;
+    }
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+    //
+    // The request slides over the bytes before the data, which must be on the first buffer
+    //
+    //
+    if (DataBuffer->FirstSize < ReadOp->OffsetAlignment) {
+        rte_pktmbuf_free((struct rte_mbuf*)ReadOp->RespBuf);
+        ReadOp->RespBuf = NULL;
+        return false;
+    }
+#endif
+#endif
+
+    return true;
+}
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+#define NETFE_RECORD_HEADER_BYTES (sizeof(FileIOSizeT) + sizeof(OffloadResponseT))
+
+//
+// Reserve the record a read for the host is delivered in, in the offload response ring of this lcore,
+// with the request, after which the data is read; return false if the rings are not bound or this one is full
+//
+//
+static inline bool
+NetfeReserveRecord(
+    struct NetfeLcore *FeLcore,
+    const char *Req,
+    ReadOpDescriptorT *ReadOp,
+    SplittableBufferT *DataBuffer
+) {
+    char *record;
+
+    if (FeLcore->OffloadId >= OFFLOAD_RESPONSE_RINGS ||
+        atomic_load_explicit(&OffloadResponseRingsOwner, memory_order_acquire) < 0) {
+        return false;
+    }
+
+    record = ReserveOffloadResponse(&OffloadResponseRings[FeLcore->OffloadId],
+        NETFE_RECORD_HEADER_BYTES + ReadOp->ReqSize + ReadOp->ReadReq.Bytes, &ReadOp->RecordEnd);
+    if (record == NULL) {
+        return false;
+    }
+
+    rte_memcpy(record + NETFE_RECORD_HEADER_BYTES, Req, ReadOp->ReqSize);
+    ReadOp->Record = record;
+
+    DataBuffer->TotalSize = ReadOp->ReadReq.Bytes;
+    DataBuffer->FirstSize = ReadOp->ReadReq.Bytes;
+    DataBuffer->FirstAddr = record + NETFE_RECORD_HEADER_BYTES + ReadOp->ReqSize;
+    DataBuffer->SecondAddr = NULL;
+
+    return true;
+}
+
+//
+// Fill in the record of a completed read for the host and release it, with the records before it,
+// to the back end; the client is left out if the stream has been closed since
+//
+//
+static inline void
+NetfeCompleteRecord(
+    struct NetfeLcore *FeLcore,
+    ReadOpDescriptorT *ReadOp,
+    uint32_t Generation
+) {
+    OffloadResponseT *resp = (OffloadResponseT*)(ReadOp->Record + sizeof(FileIOSizeT));
+    struct NetfeStream *feStream = (struct NetfeStream*)ReadOp->StreamCtxt;
+    struct sockaddr_in *raddr = (struct sockaddr_in*)&feStream->Raddr;
+    uint32_t bytes;
+
+    bytes = ReadOp->ReadResp.Result == DDS_ERROR_CODE_SUCCESS ? ReadOp->ReadResp.BytesServiced : 0;
+    resp->DataOffset = NETFE_RECORD_HEADER_BYTES + ReadOp->ReqSize;
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+    bytes = bytes > ReadOp->OffsetAlignment ? RTE_MIN(bytes - (uint32_t)ReadOp->OffsetAlignment,
+        ReadOp->ReadReq.Bytes - (uint32_t)ReadOp->OffsetAlignment - ReadOp->BytesAlignment) : 0;
+    resp->DataOffset += ReadOp->OffsetAlignment;
+#endif
+
+    resp->Result = ReadOp->ReadResp.Result;
+    resp->ReqSize = ReadOp->ReqSize;
+    resp->BytesServiced = bytes;
+    resp->ClientAddr = 0;
+    resp->ClientPort = 0;
+    if (Generation == feStream->Generation && raddr->sin_family == AF_INET) {
+        resp->ClientAddr = raddr->sin_addr.s_addr;
+        resp->ClientPort = raddr->sin_port;
+    }
+
+    ReadOp->Record = NULL;
+    CompleteOffloadResponses(&OffloadResponseRings[FeLcore->OffloadId], ReadOp->RecordEnd);
+}
+#endif
+
+//
+// Submit the reads issued since the last submission to the file service, in batches of up to OFFLOAD_ENGINE_BATCH_SIZE
+//
+//
+static void
+NetfeSubmitReadOps(
+    struct NetfeLcore *FeLcore
+) {
+    DataPlaneRequestContext *ctxts[OFFLOAD_ENGINE_BATCH_SIZE];
+    RequestIdT indices[OFFLOAD_ENGINE_BATCH_SIZE];
+    uint32_t slot;
+    int i, count;
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    uint64_t now = rte_rdtsc();
+#endif
+
+    while (FeLcore->ReadOpSubmitted != FeLcore->ReadOpTail) {
+        count = 0;
+        while (count != OFFLOAD_ENGINE_BATCH_SIZE && FeLcore->ReadOpSubmitted != FeLcore->ReadOpTail) {
+            slot = FeLcore->ReadOpSubmitted % MAX_READ_OPS_PER_LCORE;
+            FeLcore->ReadOpSubmitted++;
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+            //
+            // A read answered from the response cache is done already
+            //
+            //
+            if (FeLcore->ReadOps[slot].Cached) {
+                continue;
+            }
+#endif
+            ctxts[count] = &FeLcore->ReadCtxts[slot];
+            indices[count] = FeLcore->IoSlotBase + slot;
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+            FeLcore->ReadOpSubmitTsc[slot] = now;
+#endif
+            count++;
+        }
+
+        //
+        // If the file service doesn't take reads yet, they fail and their requests are sent on as they are
+        //
+        //
+        if (count != 0 && !SubmitOffloadRequests(FS, ctxts, indices, count)) {
+            for (i = 0; i != count; i++) {
+                ctxts[i]->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+            }
+        }
+    }
+}
+
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+//
+// Check if the DPU keeps up well enough to take another read of a stream
+//
+//
+static inline bool
+NetfeAdmitReadOp(
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStream
+) {
+    uint32_t depth = FeLcore->ReadOpTail - FeLcore->ReadOpHead;
+
+    if (depth == 0) {
+        return true;
+    }
+
+    if (depth >= OFFLOAD_ADMISSION_MAX_QUEUE_DEPTH ||
+        FeLcore->ReadLatencyTsc > FeLcore->MaxReadLatencyTsc ||
+        FeStream->OutstandingReads >= OFFLOAD_ADMISSION_MAX_READS_PER_STREAM) {
+        FeLcore->Stats->ReadsShed++;
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Account for a read that is done with: its latency, and its stream if the stream is the same
+//
+//
+static inline void
+NetfeRetireReadOp(
+    struct NetfeLcore *FeLcore,
+    uint32_t Slot,
+    uint64_t Now
+) {
+    struct NetfeStream *feStream = (struct NetfeStream*)FeLcore->ReadOps[Slot].StreamCtxt;
+    uint64_t latency = Now - FeLcore->ReadOpSubmitTsc[Slot];
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    //
+    // A read answered from the response cache says nothing of how the DPU keeps up
+    //
+    //
+    if (!FeLcore->ReadOps[Slot].Cached) {
+        FeLcore->ReadLatencyTsc += ((int64_t)latency - (int64_t)FeLcore->ReadLatencyTsc) >> OFFLOAD_ADMISSION_LATENCY_SHIFT;
+    }
+#else
+    FeLcore->ReadLatencyTsc += ((int64_t)latency - (int64_t)FeLcore->ReadLatencyTsc) >> OFFLOAD_ADMISSION_LATENCY_SHIFT;
+#endif
+
+    if (FeLcore->ReadOpGenerations[Slot] == feStream->Generation && feStream->OutstandingReads != 0) {
+        feStream->OutstandingReads--;
+    }
+}
+#endif
+
+//
+// Set up the read of an offloaded request to be submitted: the sectors it reads and the buffer it reads into;
+// return false if it can't be issued
+//
+//
+static inline bool
+NetfeSetUpReadOp(
+    uint32_t Lcore,
+    struct NetfeLcore *FeLcore,
+    const char *Msg,
+    ReadOpDescriptorT *ReadOp,
+    DataPlaneRequestContext *Ctxt
+) {
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+    //
+    // Read the sectors the data is on; the response takes the data out of them
+    //
+    //
+    ReadOp->OffsetAlignment = ReadOp->ReadReq.Offset & (DDS_BACKEND_SECTOR_SIZE - 1);
+    ReadOp->BytesAlignment = (FileIOSizeT)(-(ReadOp->ReadReq.Offset + ReadOp->ReadReq.Bytes) & (DDS_BACKEND_SECTOR_SIZE - 1));
+    ReadOp->ReadReq.Offset -= ReadOp->OffsetAlignment;
+    ReadOp->ReadReq.Bytes += ReadOp->OffsetAlignment + ReadOp->BytesAlignment;
+#else
+    if ((ReadOp->ReadReq.Offset | ReadOp->ReadReq.Bytes) & (DDS_BACKEND_SECTOR_SIZE - 1)) {
+        return false;
+    }
+#endif
+
+    //
+    // The response is the request followed by the data;
+    // the request of a read for the host goes to the host instead, with the data, which is why it is the last step that fails
+    //
+    //
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    ReadOp->Record = NULL;
+    if (ReadOp->ReadReq.RequestId & OFFLOAD_FUNC_READ_FOR_HOST) {
+        return NetfeReserveRecord(FeLcore, Msg, ReadOp, &Ctxt->DataBuffer);
+    }
+#else
+    RTE_SET_USED(FeLcore);
+#endif
+
+    return NetfeSetUpRespBuf(Lcore, Msg, ReadOp, &Ctxt->DataBuffer);
+}
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+//
+// Build the response of a read from the response cache if it is kept there, or note whether to keep it once read;
+// return whether it was built
+//
+//
+static inline bool
+NetfeGetCachedResp(
+    struct NetfeLcore *FeLcore,
+    const char *Msg,
+    ReadOpDescriptorT *ReadOp
+) {
+    ReadOp->Cached = false;
+    ReadOp->KeepResp = false;
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    if (ReadOp->ReadReq.RequestId & OFFLOAD_FUNC_READ_FOR_HOST) {
+        return false;
+    }
+#endif
+    if (FeLcore->RespCache == NULL) {
+        return false;
+    }
+
+    ReadOp->RespBuf = PEPORespCacheGet(FeLcore->RespCache, ReadOp->ReadReq.FileId, ReadOp->ReadReq.Offset,
+        ReadOp->ReadReq.Bytes, Msg, ReadOpReqSize(ReadOp), &ReadOp->KeepResp, &ReadOp->RespVersion);
+    if (ReadOp->RespBuf == NULL) {
+        return false;
+    }
+
+    ReadOp->Cached = true;
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    ReadOp->Record = NULL;
+#endif
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+    ReadOp->OffsetAlignment = 0;
+    ReadOp->BytesAlignment = 0;
+#endif
+    FeLcore->Stats->RespCacheHits++;
+
+    return true;
+}
+
+//
+// Keep the response of a completed read in the response cache, if it was to be kept and has all its data
+//
+//
+static inline void
+NetfeKeepResp(
+    struct NetfeLcore *FeLcore,
+    ReadOpDescriptorT *ReadOp,
+    struct rte_mbuf *Pkt,
+    uint32_t Bytes
+) {
+    FileSizeT offset = ReadOp->ReadReq.Offset;
+    FileIOSizeT bytes = ReadOp->ReadReq.Bytes;
+
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+    offset += ReadOp->OffsetAlignment;
+    bytes -= ReadOp->OffsetAlignment + ReadOp->BytesAlignment;
+#endif
+
+    if (Bytes == bytes && PEPORespCachePut(FeLcore->RespCache, ReadOp->ReadReq.FileId, offset, bytes,
+        ReadOp->RespVersion, Pkt, ReadOpReqSize(ReadOp))) {
+        FeLcore->Stats->RespCacheFills++;
+    }
+}
+#endif
+
+//
+// Turn a request the DPU serves into a read, to be submitted with the other reads of the burst;
+// return false if the read can't be issued and the request should go to the host
+//
+//
+static bool
+NetfeIssueReadOp(
+    uint32_t Lcore,
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStream,
+    struct rte_mbuf *Pkt,
+    RequestDescriptorT *Req
+) {
+    uint32_t slot;
+    ReadOpDescriptorT *readOp;
+    DataPlaneRequestContext *ctxt;
+    RequestDescriptorT contiguousReq;
+    char *msg;
+
+    if (FeLcore->ReadOpTail - FeLcore->ReadOpHead == MAX_READ_OPS_PER_LCORE) {
+        return false;
+    }
+
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    if (!NetfeAdmitReadOp(FeLcore, FeStream)) {
+        return false;
+    }
+#endif
+
+    //
+    // The request is in place unless it spans segments
+    //
+    //
+    msg = (char*)rte_pktmbuf_read(Pkt, Req->Offset, Req->Bytes, FeLcore->ReqBuf);
+    if (msg == NULL) {
+        return false;
+    }
+    contiguousReq.Offset = 0;
+    contiguousReq.Bytes = Req->Bytes;
+
+    slot = FeLcore->ReadOpTail % MAX_READ_OPS_PER_LCORE;
+    readOp = &FeLcore->ReadOps[slot];
+    ctxt = &FeLcore->ReadCtxts[slot];
+
+    readOp->ReadReq.RequestId = 0;
+#ifdef OFFLOAD_ENGINE_UDF_BPF
+    if (FeLcore->Udfs->FuncProg != NULL) {
+        RunBPFOffloadFunc(FeLcore->Udfs->FuncProg, msg, &contiguousReq, GlobalCacheTable, &readOp->ReadReq);
+    }
+    else {
+        FeLcore->Udfs->Func(msg, &contiguousReq, GlobalCacheTable, &readOp->ReadReq);
+    }
+#else
+    FeLcore->Udfs->Func(msg, &contiguousReq, GlobalCacheTable, &readOp->ReadReq);
+#endif
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    readOp->ReqSize = Req->Bytes;
+#endif
+
+    if (readOp->ReadReq.Bytes == 0) {
+        return false;
+    }
+
+#ifdef PEPO_UDP_REQUESTS
+    //
+    // A UDP response is one datagram, and a read for the host has no host leg to go to
+    //
+    //
+    if (FeStream->Udp && (Req->Bytes + readOp->ReadReq.Bytes > FeLcore->UdpMaxRespBytes ||
+        (readOp->ReadReq.RequestId & OFFLOAD_FUNC_READ_FOR_HOST))) {
+        return false;
+    }
+#endif
+
+    //
+    // A response kept in the response cache is built right away, and sent in its turn among the reads of the lcore
+    //
+    //
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    if (!NetfeGetCachedResp(FeLcore, msg, readOp) && !NetfeSetUpReadOp(Lcore, FeLcore, msg, readOp, ctxt)) {
+        return false;
+    }
+#else
+    if (!NetfeSetUpReadOp(Lcore, FeLcore, msg, readOp, ctxt)) {
+        return false;
+    }
+#endif
+
+    readOp->ReadReq.RequestId = slot;
+    readOp->ReadResp.RequestId = slot;
+    readOp->ReadResp.Result = DDS_ERROR_CODE_IO_PENDING;
+    readOp->ReadResp.BytesServiced = 0;
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    if (readOp->Cached) {
+        readOp->ReadResp.Result = DDS_ERROR_CODE_SUCCESS;
+        readOp->ReadResp.BytesServiced = readOp->ReadReq.Bytes;
+    }
+#endif
+    readOp->StreamCtxt = FeStream;
+    FeLcore->ReadOpGenerations[slot] = FeStream->Generation;
+#ifdef PEPO_UDP_REQUESTS
+    if (FeStream->Udp) {
+        FeLcore->UdpPeers[slot] = FeLcore->UdpPeer;
+    }
+#endif
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    FeStream->OutstandingReads++;
+#endif
+
+    ctxt->IsRead = true;
+    ctxt->Request = &readOp->ReadReq;
+    ctxt->Response = &readOp->ReadResp;
+
+    FeLcore->ReadOpTail++;
+    if (FeLcore->ReadOpTail - FeLcore->ReadOpSubmitted == OFFLOAD_ENGINE_BATCH_SIZE) {
+        NetfeSubmitReadOps(FeLcore);
+    }
+
+    return true;
+}
+
+//
+// Run the offload predicate on a received message and issue reads for the requests the DPU serves;
+// return the packet that forwards the rest to the host, or NULL if nothing is left
+// A message is the payload of one received packet, which carries up to MAX_REQS_PER_MESSAGE requests;
+// the predicate parses it in the segments it was received in, and requests may continue from one message to the next
+//
+//
+static struct rte_mbuf*
+NetfeOffloadPkt(
+    uint32_t Lcore,
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStream,
+    struct rte_mbuf *Pkt
+) {
+    uint16_t numReqsForHost, numReqsForDPU, numSegs, numIssued, i, k;
+    uint32_t bytes, covered, end;
+    struct rte_mbuf *fwdPkt, *seg;
+    RequestDescriptorT req;
+    const char *data;
+    char *payload;
+
+    bytes = Pkt->pkt_len;
+    if (FeStream->PredLost || bytes == 0) {
+        return Pkt;
+    }
+
+    //
+    // The predicate must see every byte of the stream; once it misses a message, the stream is only forwarded
+    //
+    //
+    if (bytes > sizeof(FeLcore->ReqBuf) || Pkt->nb_segs > OFFLOAD_PRED_MAX_SEGS ||
+        GlobalCacheTable == NULL || FS == NULL) {
+        FeStream->PredLost = true;
+        return Pkt;
+    }
+
+    numSegs = 0;
+    for (seg = Pkt; seg != NULL; seg = seg->next) {
+        if (seg->data_len != 0) {
+            FeLcore->Segs[numSegs].iov_base = rte_pktmbuf_mtod(seg, void*);
+            FeLcore->Segs[numSegs].iov_len = seg->data_len;
+            numSegs++;
+        }
+    }
+
+#ifdef OFFLOAD_ENGINE_UDF_BPF
+    if (FeLcore->Udfs->PredProg != NULL) {
+        RunBPFOffloadPred(FeLcore->Udfs->PredProg, FeLcore->Segs, numSegs, (uint16_t)bytes, &FeStream->PredState,
+            GlobalCacheTable, FeLcore->ReqsForHost, FeLcore->ReqsForDPU, &numReqsForHost, &numReqsForDPU);
+    }
+    else {
+        FeLcore->Udfs->Pred(FeLcore->Segs, numSegs, (uint16_t)bytes, &FeStream->PredState, GlobalCacheTable,
+            FeLcore->ReqsForHost, FeLcore->ReqsForDPU, &numReqsForHost, &numReqsForDPU);
+    }
+#else
+    FeLcore->Udfs->Pred(FeLcore->Segs, numSegs, (uint16_t)bytes, &FeStream->PredState, GlobalCacheTable,
+        FeLcore->ReqsForHost, FeLcore->ReqsForDPU, &numReqsForHost, &numReqsForDPU);
+#endif
+
+    if (numReqsForDPU == 0) {
+        return Pkt;
+    }
+
+    //
+    // A request out of the message is a bug of the predicate; the message is forwarded as it is
+    //
+    //
+    for (i = 0; i != numReqsForDPU; i++) {
+        if ((uint32_t)FeLcore->ReqsForDPU[i].Offset + FeLcore->ReqsForDPU[i].Bytes > bytes) {
+            return Pkt;
+        }
+    }
+    for (i = 0; i != numReqsForHost; i++) {
+        if ((uint32_t)FeLcore->ReqsForHost[i].Offset + FeLcore->ReqsForHost[i].Bytes > bytes) {
+            return Pkt;
+        }
+    }
+
+    //
+    // The forwarded packet is no larger than the message; allocate it first so that the reads issued are never undone
+    //
+    //
+    fwdPkt = NetfeAllocReadBuf(Lcore);
+    if (fwdPkt == NULL) {
+        return Pkt;
+    }
+
+    covered = 0;
+    for (i = 0; i != numReqsForHost; i++) {
+        end = FeLcore->ReqsForHost[i].Offset + FeLcore->ReqsForHost[i].Bytes;
+        covered = end > covered ? end : covered;
+    }
+
+    numIssued = 0;
+    for (i = 0; i != numReqsForDPU; i++) {
+        end = FeLcore->ReqsForDPU[i].Offset + FeLcore->ReqsForDPU[i].Bytes;
+        covered = end > covered ? end : covered;
+
+        if (NetfeIssueReadOp(Lcore, FeLcore, FeStream, Pkt, &FeLcore->ReqsForDPU[i])) {
+            numIssued++;
+            continue;
+        }
+
+        //
+        // Keep the requests for the host in the order of the message
+        //
+        //
+        req = FeLcore->ReqsForDPU[i];
+        for (k = numReqsForHost; k != 0 && FeLcore->ReqsForHost[k - 1].Offset > req.Offset; k--) {
+            FeLcore->ReqsForHost[k] = FeLcore->ReqsForHost[k - 1];
+        }
+        FeLcore->ReqsForHost[k] = req;
+        numReqsForHost++;
+    }
+
+    if (numIssued == 0) {
+        rte_pktmbuf_free(fwdPkt);
+        return Pkt;
+    }
+
+    if (covered < bytes) {
+        FeLcore->ReqsForHost[numReqsForHost].Offset = covered;
+        FeLcore->ReqsForHost[numReqsForHost].Bytes = bytes - covered;
+        numReqsForHost++;
+    }
+
+    for (i = 0; i != numReqsForHost; i++) {
+        payload = rte_pktmbuf_append(fwdPkt, FeLcore->ReqsForHost[i].Bytes);
+        data = rte_pktmbuf_read(Pkt, FeLcore->ReqsForHost[i].Offset, FeLcore->ReqsForHost[i].Bytes, payload);
+        if (data != payload) {
+            rte_memcpy(payload, data, FeLcore->ReqsForHost[i].Bytes);
+        }
+    }
+
+    rte_pktmbuf_free(Pkt);
+    if (fwdPkt->pkt_len == 0) {
+        rte_pktmbuf_free(fwdPkt);
+        return NULL;
+    }
+
+    return fwdPkt;
+}
+
+//
+// Offload the requests of the packets a stream just received into Pkts, the Pbuf of the stream or of its peer;
+// return the number of packets left to forward, which are moved to the front
+//
+//
+static uint32_t
+NetfeOffloadPkts(
+    uint32_t Lcore,
+    struct NetfeLcore *FeLcore,
+    struct NetfeStream *FeStream,
+    struct rte_mbuf **Pkts,
+    uint32_t NumPkts
+) {
+    uint32_t i, k;
+    struct rte_mbuf *pkt;
+    struct rte_mbuf **pkts = Pkts;
+
+    k = 0;
+    for (i = 0; i != NumPkts; i++) {
+        pkt = NetfeOffloadPkt(Lcore, FeLcore, FeStream, pkts[i]);
+        if (pkt != NULL) {
+            pkts[k++] = pkt;
+        }
+    }
+
+    return k;
+}
+
+#ifdef PEPO_UDP_REQUESTS
+//
+// Offload the requests of the datagrams the UDP stream received; every datagram is parsed on its own,
+// and what the DPU doesn't serve is dropped for the client to retry over TCP
+//
+//
+static uint32_t
+NetfeUdpRecv(
+    uint32_t Lcore,
+    struct NetfeLcore *FeLcore
+) {
+    uint32_t i, n;
+    struct rte_mbuf *pkts[MAX_PKT_BURST];
+    struct rte_mbuf *pkt;
+    const struct rte_ipv4_hdr *iph;
+    const struct rte_udp_hdr *udph;
+    struct NetfeStream *udpStream = &FeLcore->UdpStream;
+
+    n = tle_udp_stream_recv(udpStream->TleStream, pkts, RTE_DIM(pkts));
+    if (n == 0) {
+        return 0;
+    }
+
+    FeLcore->Stats->UdpRxPkts += n;
+
+    for (i = 0; i != n; i++) {
+        //
+        // The headers are still before the payload, where the response goes
+        //
+        //
+        pkt = pkts[i];
+        iph = rte_pktmbuf_mtod_offset(pkt, const struct rte_ipv4_hdr*, -(int32_t)(pkt->l3_len + pkt->l4_len));
+        udph = rte_pktmbuf_mtod_offset(pkt, const struct rte_udp_hdr*, -(int32_t)pkt->l4_len);
+        FeLcore->UdpPeer.sin_family = AF_INET;
+        FeLcore->UdpPeer.sin_addr.s_addr = iph->src_addr;
+        FeLcore->UdpPeer.sin_port = udph->src_port;
+
+        memset(&udpStream->PredState, 0, sizeof(udpStream->PredState));
+        udpStream->PredLost = false;
+
+        pkt = NetfeOffloadPkt(Lcore, FeLcore, udpStream, pkt);
+        if (pkt != NULL) {
+            rte_pktmbuf_free(pkt);
+            FeLcore->Stats->UdpDeclined++;
+        }
+    }
+
+    NetfeSubmitReadOps(FeLcore);
+
+    return n;
+}
+
+//
+// Send the response of a read to the peer its datagram came from; a response the stream can't take is dropped
+//
+//
+static inline void
+NetfeSendUdpResp(
+    struct NetfeLcore *FeLcore,
+    uint32_t Slot,
+    struct rte_mbuf *Pkt
+) {
+    if (tle_udp_stream_send(FeLcore->UdpStream.TleStream, &Pkt, 1,
+        (const struct sockaddr*)&FeLcore->UdpPeers[Slot]) == 1) {
+        FeLcore->Stats->UdpTxPkts++;
+    }
+    else {
+        rte_pktmbuf_free(Pkt);
+        FeLcore->Stats->UdpDeclined++;
+    }
+}
+#endif
+
+//
+// Send the responses of completed offloaded reads, in the order they were issued;
+// the response of a failed read carries no data, and the stream of a read may have been closed since
+//
+//
+static void
+NetfeCompleteReadOps(
+    uint32_t Lcore,
+    struct NetfeLcore *FeLcore
+) {
+    uint32_t slot, bytes;
+    ReadOpDescriptorT *readOp;
+    OffloadWorkResponse resp;
+    struct NetfeStream *feStream;
+    struct rte_mbuf *pkt;
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+    uint64_t now = rte_rdtsc();
+#endif
+
+    while (FeLcore->ReadOpHead != FeLcore->ReadOpSubmitted) {
+        slot = FeLcore->ReadOpHead % MAX_READ_OPS_PER_LCORE;
+        readOp = &FeLcore->ReadOps[slot];
+        resp = readOp->ReadResp;
+
+        if (resp.Result == DDS_ERROR_CODE_IO_PENDING) {
+            break;
+        }
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+        if (readOp->Record != NULL) {
+            NetfeCompleteRecord(FeLcore, readOp, FeLcore->ReadOpGenerations[slot]);
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+            NetfeRetireReadOp(FeLcore, slot, now);
+#endif
+            FeLcore->ReadOpHead++;
+            continue;
+        }
+#endif
+
+        feStream = (struct NetfeStream*)readOp->StreamCtxt;
+        if (feStream->TleStream != NULL && FeLcore->ReadOpGenerations[slot] == feStream->Generation) {
+            //
+            // Wait for the stream to drain
+            //
+            //
+            if (feStream->Pbuf.Num == RTE_DIM(feStream->Pbuf.Pkt)) {
+                break;
+            }
+
+            bytes = resp.Result == DDS_ERROR_CODE_SUCCESS ? resp.BytesServiced : 0;
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+            bytes = bytes > readOp->OffsetAlignment ? RTE_MIN(bytes - (uint32_t)readOp->OffsetAlignment,
+                readOp->ReadReq.Bytes - (uint32_t)readOp->OffsetAlignment - readOp->BytesAlignment) : 0;
+#endif
+#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_NONE
+#ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
+            pkt = NetfeCopyToMbuf(Lcore, readOp->RespBuf, ReadOpReqSize(readOp) + readOp->OffsetAlignment + bytes);
+            if (pkt == NULL) {
+                break;
+            }
+
+            //
+            // Slide the request over the bytes read before the data
+            //
+            //
+            if (readOp->OffsetAlignment != 0) {
+                memmove(rte_pktmbuf_mtod_offset(pkt, char*, readOp->OffsetAlignment), rte_pktmbuf_mtod(pkt, char*),
+                    ReadOpReqSize(readOp));
+                rte_pktmbuf_adj(pkt, readOp->OffsetAlignment);
+            }
+#else
+            pkt = NetfeCopyToMbuf(Lcore, readOp->RespBuf, ReadOpReqSize(readOp) + bytes);
+            if (pkt == NULL) {
+                break;
+            }
+#endif
+#else
+            pkt = NetfeTakeRespBuf(readOp, bytes);
+#endif
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+            if (readOp->KeepResp && resp.Result == DDS_ERROR_CODE_SUCCESS) {
+                NetfeKeepResp(FeLcore, readOp, pkt, bytes);
+            }
 #endif
 
-    }
-
-#ifdef DDS_VERBOSE
-    RTE_LOG(NOTICE, USER1, "tcp_stat = {\n");
-    for (i = 0; i != RTE_DIM(lc->TcpStat.Flags); i++) {
-        if (lc->TcpStat.Flags[i] != 0) {
-            RTE_LOG(NOTICE, USER1, "[flag = %#x] == %" PRIu64 "\n",
-                i, lc->TcpStat.Flags[i]);
+#ifdef PEPO_UDP_REQUESTS
+            if (feStream->Udp) {
+                NetfeSendUdpResp(FeLcore, slot, pkt);
+            }
+            else {
+                NetfeQueuePkt(feStream, pkt);
+            }
+#else
+            NetfeQueuePkt(feStream, pkt);
+#endif
+        }
+#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC
+        else {
+            rte_pktmbuf_free((struct rte_mbuf*)readOp->RespBuf);
+            readOp->RespBuf = NULL;
         }
-    }
-    RTE_LOG(NOTICE, USER1, "}\n");
 #endif
 
-    for (i = 0; i != lc->NumPortQueues; i++) {
-        for (j = 0; j != lc->PortQueues[i].TxBuf.Num; j++) {
-            rte_pktmbuf_free(lc->PortQueues[i].TxBuf.Pkt[j]);
-        }
+#ifdef OFFLOAD_ENGINE_ADMISSION_CONTROL
+        NetfeRetireReadOp(FeLcore, slot, now);
+#endif
+        FeLcore->ReadOpHead++;
     }
-
-    RTE_PER_LCORE(_be) = NULL;
 }
 
+#ifdef PEPO_UDP_REQUESTS
 //
-// Remove a stream from a list
+// Take the UDP packets of a received burst to the UDP context;
+// return the number of packets left for the TCP context, which are moved to the front
 //
 //
-static inline void
-NetfeRemStream(
-    struct NetfeStreamList *List,
-    struct NetfeStream *Stream
+static uint32_t
+NetbeUdpRxBulk(
+    struct NetbeLcore *BeLcore,
+    struct NetbeDev *BeDev,
+    struct rte_mbuf **Pkts,
+    uint32_t NumPkts,
+    struct rte_mbuf **ReturnedPkts,
+    int32_t *ErrorCodes
 ) {
-    LIST_REMOVE(Stream, Link);
-    List->Num--;
+    uint32_t i, k, numUdpPkts, numTaken;
+    struct rte_mbuf *udpPkts[MAX_PKT_BURST];
+
+    k = 0;
+    numUdpPkts = 0;
+    for (i = 0; i != NumPkts; i++) {
+        if ((Pkts[i]->packet_type & RTE_PTYPE_L4_MASK) == RTE_PTYPE_L4_UDP) {
+            udpPkts[numUdpPkts++] = Pkts[i];
+        }
+        else {
+            Pkts[k++] = Pkts[i];
+        }
+    }
+
+    if (numUdpPkts != 0) {
+        numTaken = tle_udp_rx_bulk(BeDev->UdpDev, udpPkts, ReturnedPkts, ErrorCodes, numUdpPkts);
+        BeLcore->Stats->RxDrops += numUdpPkts - numTaken;
+        for (i = 0; i != numUdpPkts - numTaken; i++) {
+            rte_pktmbuf_free(ReturnedPkts[i]);
+        }
+    }
+
+    return k;
 }
+#endif
 
+#ifdef PEPO_IDLE_RX_INTR
 //
-// Process TCP send and receive events
+// Sleep until a queue of the lcore receives, or for PEPO_IDLE_SLEEP_MS, which keeps the timers of TLDK going
 //
 //
-static inline int
-NetfeRxTxProcess(
-    __rte_unused uint32_t Lcore,
-    struct NetfeStream *FeStream,
-    struct NetfeLcore *FeLcore
+static void
+NetbeLcoreSleep(
+    struct NetbeLcore *BeLcore
 ) {
-    uint32_t i, k, n, currentSent;
-    struct rte_mbuf **pkts;
-
-#if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_DYNAMIC
-    uint32_t sid = rte_lcore_to_socket_id(Lcore);
-#endif
-
-    n = FeStream->Pbuf.Num;
-    pkts = FeStream->Pbuf.Pkt;
+    struct rte_epoll_event events[MAX_PKT_BURST];
+    uint32_t i;
 
-    if (n == 0) {
-        tle_event_idle(FeStream->TxEv);
-#ifdef DDS_VERBOSE
-        FeStream->Stat.TxEv[TLE_SEV_IDLE]++;
-#endif
-        return 0;
+    for (i = 0; i != BeLcore->NumPortQueues; i++) {
+        rte_eth_dev_rx_intr_enable(BeLcore->PortQueues[i].Port.Id, BeLcore->PortQueues[i].RxQid);
     }
 
-    //
-    // Process the received packets
-    //
-    //
-    k = 0;
-    while (k != n) {
-        currentSent = tle_tcp_stream_send(FeStream->TleStream, &pkts[k], n - k);
-        if (currentSent < 0) {
-            NETFE_TRACE("%s: failed to forward the packet\n", __func__);
-            break;
-        }
+    rte_epoll_wait(RTE_EPOLL_PER_THREAD, events, RTE_DIM(events), PEPO_IDLE_SLEEP_MS);
+    BeLcore->Stats->IdleSleeps++;
 
-        k += currentSent;
+    for (i = 0; i != BeLcore->NumPortQueues; i++) {
+        rte_eth_dev_rx_intr_disable(BeLcore->PortQueues[i].Port.Id, BeLcore->PortQueues[i].RxQid);
     }
-
-    NETFE_TRACE("%s: tle_tcp_stream_send(%p, %u) returns %u\n",
-        __func__, FeStream->TleStream, n, k);
-
-#ifdef DDS_VERBOSE
-    FeStream->Stat.TxPkts += k;
-    FeStream->Stat.Drops += n - k;
+}
 #endif
 
-    if (k == 0) {
-        return 0;
-    }
+//
+// Back off after a poll that found no work, so that other threads of the core get its cycles
+//
+//
+static void
+NetbeLcoreIdle(
+    struct NetbeLcore *BeLcore
+) {
+    uint32_t pauses;
 
-    //
-    // Mark stream for reading if:
-    // ECHO: Buffer full
-    // RXTX: All outbound packets successfully dispatched
-    // TODO: handle post-send processing based on PEPO needs
-    //
-    //
-    if (n == RTE_DIM(FeStream->Pbuf.Pkt)) {
-        tle_event_active(FeStream->RxEv, TLE_SEV_UP);
-#ifdef DDS_VERBOSE
-        FeStream->Stat.RxEv[TLE_SEV_UP]++;
-#endif
+    BeLcore->IdleIters++;
+    BeLcore->Stats->IdlePolls++;
+    if (BeLcore->IdleIters < PEPO_IDLE_PAUSE_ITERS) {
+        return;
     }
 
-    //
-    // Adjust pbuf array
-    //
-    //
-    FeStream->Pbuf.Num = n - k;
-    for (i = 0; i != n - k; i++) {
-        pkts[i] = pkts[i + k];
+#ifdef PEPO_IDLE_RX_INTR
+    if (BeLcore->IdleIters >= PEPO_IDLE_SLEEP_ITERS) {
+        NetbeLcoreSleep(BeLcore);
+        return;
     }
+#endif
 
-    if (FeStream->Pbuf.Num == 0) {
-        tle_event_idle(FeStream->TxEv);
+    pauses = RTE_MIN(BeLcore->IdleIters - PEPO_IDLE_PAUSE_ITERS + 1, (uint32_t)PEPO_IDLE_MAX_PAUSES);
+    while (pauses-- != 0) {
+        rte_pause();
     }
-
-    return k;
 }
 
 //
@@ -2496,7 +4950,9 @@ PEPOLcoreMain(
 ) {
     int32_t result;
     struct LcoreParam *param;
-    uint32_t j, jj, n, k, lcore, processedEvents;
+    uint32_t j, jj, n, k, lcore, processedEvents, work;
+    uint64_t now;
+    bool txHeld;
 
     //
     // Front-end state
@@ -2573,11 +5029,23 @@ PEPOLcoreMain(
     signal(SIGTERM, SigHandler);
 
     while (ForceQuitNetworkEngine == 0) {
+        work = 0;
+
+        //
+        // Pass a quiescent point and take the UDFs last loaded
+        //
+        //
+        if (feLcore->IoSlotBase != 0) {
+            rte_rcu_qsbr_quiescent(PEPOUdfsQsbr, feLcore->OffloadId);
+            feLcore->Udfs = __atomic_load_n(&PEPOUdfs, __ATOMIC_ACQUIRE);
+        }
+
         //
         // 1. Process TCP syn events
         //
         //
         n = tle_evq_get(feLcore->ListenRxEq, (const void **)(uintptr_t)feListenStreams, RTE_DIM(feListenStreams));
+        work += n;
         
         if (n > 0) {
             NETFE_TRACE("\n\n%s (%u): tle_evq_get (ListenRxEq = %p) returns %u\n",
@@ -2597,9 +5065,7 @@ PEPOLcoreMain(
                 if (k == 0) {
                     RTE_LOG(ERR, USER1, "%s (%u): failed to accept a new connection\n", __func__, lcore);
                     tle_event_raise(feListenStreams[j]->ErEv);
-#ifdef DDS_VERBOSE
-                    feLcore->TcpStat.Rej++;
-#endif
+                    feLcore->Stats->Rejected++;
                     continue;
                 }
 
@@ -2610,13 +5076,11 @@ PEPOLcoreMain(
 
                 printf("Got a new connection from %s:%u (lcore = %d)\n", strAddr, srcPort, lcore);
 
-                k = NetfeGetStreams(&feLcore->Free, newFeStream, 1);
-                if (k == 0) {
+                newFeStream[0] = NetfeNewStream(feLcore);
+                if (newFeStream[0] == NULL) {
                     RTE_LOG(ERR, USER1, "%s (%u): failed to get a free DPU stream\n", __func__, lcore);
                     tle_tcp_stream_close_bulk(&newTleStream[0], 1);
-#ifdef DDS_VERBOSE
-                    feLcore->TcpStat.Rej++;
-#endif
+                    feLcore->Stats->Rejected++;
                     continue;
                 }
 
@@ -2625,11 +5089,9 @@ PEPOLcoreMain(
                 tle_event_active(newFeStream[0]->ErEv, TLE_SEV_DOWN);
                 tle_event_active(newFeStream[0]->TxEv, TLE_SEV_UP);
                 tle_event_active(newFeStream[0]->RxEv, TLE_SEV_UP);
-#ifdef DDS_VERBOSE
                 newFeStream[0]->Stat.ErEv[TLE_SEV_DOWN]++;
                 newFeStream[0]->Stat.TxEv[TLE_SEV_UP]++;
                 newFeStream[0]->Stat.RxEv[TLE_SEV_DOWN]++;
-#endif
                 memset(&TleStreamCfg[0], 0, sizeof(TleStreamCfg[0]));
                 TleStreamCfg[0].recv_ev = newFeStream[0]->RxEv;
                 TleStreamCfg[0].send_ev = newFeStream[0]->TxEv;
@@ -2637,6 +5099,28 @@ PEPOLcoreMain(
                 tle_tcp_stream_update_cfg(newTleStream, TleStreamCfg, 1);
 
                 NetfePutStream(feLcore, &feLcore->Use, newFeStream[0]);
+                feLcore->Stats->Accepted++;
+
+#ifdef PEPO_TLS
+                newFeStream[0]->Tls = PEPOTlsSessionCreate(Mpool[rte_lcore_to_socket_id(lcore) + 1]);
+                if (newFeStream[0]->Tls == NULL) {
+                    RTE_LOG(ERR, USER1, "%s (%u): failed to start a TLS session\n", __func__, lcore);
+                    NetfeStreamDrop(feLcore, newFeStream[0]);
+                    feLcore->Stats->Rejected++;
+                    continue;
+                }
+#endif
+
+#ifdef PEPO_SPLICE_TO_HOST
+                //
+                // A client isn't served without its host leg
+                //
+                //
+                if (NetfeSpliceToHost(feLcore, beLcore, newFeStream[0]) != 0) {
+                    NetfeStreamDrop(feLcore, newFeStream[0]);
+                    feLcore->Stats->Rejected++;
+                }
+#endif
             }
         }
 
@@ -2645,6 +5129,7 @@ PEPOLcoreMain(
         //
         //
         n = tle_evq_get(feLcore->ErEq, (const void **)(uintptr_t)feStreams, RTE_DIM(feStreams));
+        work += n;
         
         if (n > 0) {
             NETFE_TRACE("%s (%u): tle_evq_get (ErEq = %p) returns %u\n",
@@ -2652,9 +5137,14 @@ PEPOLcoreMain(
 
             for (j = 0; j != n; j++) {
                 //
-                // Process a reset event
+                // Process a reset event, unless the stream was closed with the other leg of its connection
+                // earlier in this burst
                 //
                 //
+                if (feStreams[j]->TleStream == NULL) {
+                    continue;
+                }
+
 #ifdef DDS_VERBOSE
                 struct tle_tcp_stream_addr addr;
                 tle_tcp_stream_get_addr(feStreams[j]->TleStream, &addr);
@@ -2666,18 +5156,18 @@ PEPOLcoreMain(
                         tle_event_state(feStreams[j]->TxEv) == TLE_SEV_UP)) {
                     feStreams[j]->PostErr++;
                 } else {
-                    newTleStream[0] = feStreams[j]->TleStream;
-
-                    tle_event_idle(feStreams[j]->RxEv);
-                    tle_event_idle(feStreams[j]->TxEv);
-                    tle_event_idle(feStreams[j]->ErEv);
-                    tle_tcp_stream_close_bulk(newTleStream, 1);
-                    
-                    NetfeRemStream(&feLcore->Use, feStreams[j]);
-                    NetfeStreamTerm(feLcore, feStreams[j]);
-#ifdef DDS_VERBOSE
-                    feLcore->TcpStat.Ter++;
+#ifdef PEPO_HOST_BACKENDS
+                    //
+                    // A host leg that fails before its backend sent anything counts against the backend
+                    //
+                    //
+                    if (feStreams[j]->Backend != NULL && !feStreams[j]->HostAnswered) {
+                        PEPOHostBackendClose(feStreams[j]->Backend, feStreams[j]->HostAwaiting, true);
+                        feStreams[j]->Backend = NULL;
+                        feLcore->Stats->HostLegFails++;
+                    }
 #endif
+                    NetfeStreamDrop(feLcore, feStreams[j]);
                 }
             }
         }
@@ -2687,6 +5177,7 @@ PEPOLcoreMain(
         //
         //
         n = tle_evq_get(feLcore->RxEq, (const void **)(uintptr_t)feStreams, RTE_DIM(feStreams));
+        work += n;
 
         if (n != 0) {
             NETFE_TRACE("%s (%u): tle_evq_get (RxEq = %p) returns %u\n",
@@ -2696,9 +5187,35 @@ PEPOLcoreMain(
 
             for (j = 0; j != n; j++) {
                 uint32_t numPkts, numCurrentPkts, numAvailPkts;
+                struct NetfeStream *sink = feStreams[j];
 
-                numCurrentPkts = feStreams[j]->Pbuf.Num;
-                numAvailPkts = RTE_DIM(feStreams[j]->Pbuf.Pkt) - numCurrentPkts;
+#ifdef PEPO_TLS
+                //
+                // Skip a stream dropped with the other leg of its connection earlier in this burst
+                //
+                //
+                if (feStreams[j]->TleStream == NULL) {
+                    continue;
+                }
+#endif
+
+                //
+                // A spliced leg receives into the Pbuf of the other leg, which sends the mbufs as they are
+                //
+                //
+#ifdef PEPO_SPLICE_TO_HOST
+                if (feStreams[j]->Peer != NULL) {
+                    sink = feStreams[j]->Peer;
+                }
+#endif
+
+                numCurrentPkts = sink->Pbuf.Num;
+                numAvailPkts = RTE_DIM(sink->Pbuf.Pkt) - numCurrentPkts;
+#ifdef PEPO_TLS
+                if (feStreams[j]->Tls != NULL) {
+                    numAvailPkts = RTE_MIN(numAvailPkts, PEPOTlsRxRoom(feStreams[j]->Tls));
+                }
+#endif
 
                 //
                 // No more space in the receive buffer
@@ -2706,9 +5223,7 @@ PEPOLcoreMain(
                 //
                 if (numAvailPkts == 0) {
                     tle_event_idle(feStreams[j]->RxEv);
-#ifdef DDS_VERBOSE
                     feStreams[j]->Stat.RxEv[TLE_SEV_IDLE]++;
-#endif
                     goto CheckTermination;
                 }
 
@@ -2716,7 +5231,7 @@ PEPOLcoreMain(
                 // Receive packets from the TCP stream
                 //
                 //
-                numPkts = tle_tcp_stream_recv(feStreams[j]->TleStream, &feStreams[j]->Pbuf.Pkt[numCurrentPkts], numAvailPkts);
+                numPkts = tle_tcp_stream_recv(feStreams[j]->TleStream, &sink->Pbuf.Pkt[numCurrentPkts], numAvailPkts);
                 
                 if (numPkts == 0) {
                     goto CheckTermination;
@@ -2725,32 +5240,68 @@ PEPOLcoreMain(
                 NETFE_TRACE("%s (%u): tle_tcp_stream_recv(%p, %u) returns %u\n",
                     __func__, lcore, feStreams[j]->TleStream, numAvailPkts, numPkts);
                 NETFE_TRACE("Received %d packets with %d existing packets\n", numPkts, numCurrentPkts);
+                processedEvents += numPkts;
+
+#ifdef PEPO_TLS
+                //
+                // The predicate and the host leg get the plaintext of the records of a client leg
+                //
+                //
+                if (feStreams[j]->Tls != NULL) {
+                    int opened = NetfeTlsRecv(feLcore, feStreams[j], &sink->Pbuf.Pkt[numCurrentPkts], numPkts,
+                        RTE_DIM(sink->Pbuf.Pkt) - numCurrentPkts);
+                    if (opened < 0) {
+                        NetfeStreamDrop(feLcore, feStreams[j]);
+                        continue;
+                    }
+                    numPkts = opened;
+                    if (numPkts == 0) {
+                        goto CheckTermination;
+                    }
+                }
+#endif
+
+                //
+                // Serve on the DPU what the offload predicate picks from the messages, only the rest is forwarded
+                //
+                //
+                if (feLcore->Udfs != NULL
+#ifdef PEPO_SPLICE_TO_HOST
+                    && !feStreams[j]->HostLeg
+#endif
+                ) {
+                    numPkts = NetfeOffloadPkts(lcore, feLcore, feStreams[j], &sink->Pbuf.Pkt[numCurrentPkts], numPkts);
+                    if (numPkts == 0) {
+                        goto CheckTermination;
+                    }
+                }
 
                 //
                 // Trigger the send event
                 //
                 //
-                if (feStreams[j]->Pbuf.Num == 0) {
+                if (sink->Pbuf.Num == 0) {
                     //
                     // If there was no packet, TxEv was idle
                     //
                     //
-                    tle_event_active(feStreams[j]->TxEv, TLE_SEV_UP);
+                    tle_event_active(sink->TxEv, TLE_SEV_UP);
                 }
                 else {
                     //
                     // Otherwise, TxEv was down
                     //
                     //
-                    tle_event_raise(feStreams[j]->TxEv);
+                    tle_event_raise(sink->TxEv);
                 }
                 
-                feStreams[j]->Pbuf.Num += numPkts;
-#ifdef DDS_VERBOSE
-                feStreams[j]->Stat.TxEv[TLE_SEV_UP]++;
-                feStreams[j]->Stat.RxPkts += numPkts;
+                sink->Pbuf.Num += numPkts;
+                sink->Stat.TxEv[TLE_SEV_UP]++;
+#ifdef PEPO_HOST_BACKENDS
+                NetfeCountHostMessages(feStreams[j], sink, numPkts);
 #endif
-                processedEvents += numPkts;
+                feStreams[j]->Stat.RxPkts += numPkts;
+                feLcore->Stats->StreamRxPkts += numPkts;
                 
 CheckTermination:
                 //
@@ -2761,13 +5312,40 @@ CheckTermination:
                     tle_event_raise(feStreams[j]->ErEv);
                 }
             }
+
+            //
+            // Submit the reads of all streams in the burst together
+            //
+            //
+            if (feLcore->IoSlotBase != 0) {
+                NetfeSubmitReadOps(feLcore);
+            }
+        }
+
+#ifdef PEPO_UDP_REQUESTS
+        //
+        // Serve the requests of UDP datagrams
+        //
+        //
+        if (feLcore->UdpStream.TleStream != NULL && feLcore->Udfs != NULL) {
+            work += NetfeUdpRecv(lcore, feLcore);
+        }
+#endif
+
+        //
+        // 4. Send the responses of offloaded reads
+        //
+        //
+        if (feLcore->IoSlotBase != 0) {
+            NetfeCompleteReadOps(lcore, feLcore);
         }
 
         //
-        // 4. Process TCP Send events
+        // 5. Process TCP Send events
         //
         //
         n = tle_evq_get(feLcore->TxEq, (const void **)(uintptr_t)feStreams, RTE_DIM(feStreams));
+        work += n;
 
         if (n != 0) {
             NETFE_TRACE("%s(%u): tle_evq_get (TxEq = %p) returns %u\n",
@@ -2787,20 +5365,37 @@ CheckTermination:
             }
         }
 
+        //
+        // Sample the events left armed on the queues
+        //
+        //
+        feLcore->Stats->ErEqDepth = feLcore->ErEq->nb_armed;
+        feLcore->Stats->RxEqDepth = feLcore->RxEq->nb_armed;
+        feLcore->Stats->TxEqDepth = feLcore->TxEq->nb_armed;
+
         //
         // 8. Process back end for TCP
         //
         //
+        now = rte_rdtsc();
+        txHeld = false;
         for (j = 0; j != beLcore->NumPortQueues; j++) {
             //
             // Back-end receive
             //
             //
-            n = rte_eth_rx_burst(beLcore->PortQueues[j].Port.Id, beLcore->PortQueues[j].RxQid, bePkts, RTE_DIM(bePkts));
+            n = rte_eth_rx_burst(beLcore->PortQueues[j].Port.Id, beLcore->PortQueues[j].RxQid, bePkts, beLcore->RxBurst);
+            if (n == beLcore->RxBurst && beLcore->RxBurst < RTE_DIM(bePkts)) {
+                beLcore->RxBurst *= 2;
+            }
+            else if (n < beLcore->RxBurst / 2 && beLcore->RxBurst > PEPO_RX_BURST_MIN) {
+                beLcore->RxBurst /= 2;
+            }
+            work += n;
 
             if (n != 0) {
+                beLcore->Stats->RxPkts += n;
 #ifdef DDS_VERBOSE
-                beLcore->PortQueues[j].RxStat.In += n;
                 for (int p = 0; p != n; p++) {
                         printf("RTE receives a packet of %u bytes\n", bePkts[p]->pkt_len);
                 }
@@ -2810,11 +5405,11 @@ CheckTermination:
                     __func__, beLcore->Id, beLcore->PortQueues[j].Port.Id,
                     beLcore->PortQueues[j].RxQid, n);
 
-                k = tle_tcp_rx_bulk(beLcore->PortQueues[j].Dev, bePkts, returnedPkts, errorCodes, n);
-#ifdef DDS_VERBOSE
-                beLcore->PortQueues[j].RxStat.Up += k;
-                beLcore->PortQueues[j].RxStat.Drop += n - k;
+#ifdef PEPO_UDP_REQUESTS
+                n = NetbeUdpRxBulk(beLcore, &beLcore->PortQueues[j], bePkts, n, returnedPkts, errorCodes);
 #endif
+                k = tle_tcp_rx_bulk(beLcore->PortQueues[j].Dev, bePkts, returnedPkts, errorCodes, n);
+                beLcore->Stats->RxDrops += n - k;
                 
                 NETFE_TRACE("%s (%u): tle_tcp_rx_bulk(%p, %u) returns %u\n",
                     __func__, beLcore->Id, beLcore->PortQueues[j].Dev, n, k);
@@ -2827,7 +5422,8 @@ CheckTermination:
                 }
             }
 
-            tle_tcp_process(beLcore->Ctx, TCP_MAX_PROCESS);
+            tle_tcp_process(beLcore->Ctx, PEPOTimerBatch);
+            NetbeLcoreStatsUpdate(beLcore);
 
             //
             // Back-end send
@@ -2837,17 +5433,35 @@ CheckTermination:
             k = RTE_DIM(beLcore->PortQueues[j].TxBuf.Pkt) - n;
             memBufs = beLcore->PortQueues[j].TxBuf.Pkt;
 
-            if (k >= RTE_DIM(beLcore->PortQueues[j].TxBuf.Pkt) / 2) {
+            //
+            // A held burst is topped up with whatever the streams sent since
+            //
+            //
+            if (k >= RTE_DIM(beLcore->PortQueues[j].TxBuf.Pkt) / 2 ||
+                (k != 0 && now < beLcore->PortQueues[j].TxDeadlineTsc)) {
                 jj = tle_tcp_tx_bulk(beLcore->PortQueues[j].Dev, memBufs + n, k);
                 n += jj;
-#ifdef DDS_VERBOSE
-                beLcore->PortQueues[j].TxStat.Down += jj;
-#endif
             }
+#ifdef PEPO_UDP_REQUESTS
+            k = RTE_DIM(beLcore->PortQueues[j].TxBuf.Pkt) - n;
+            if (k != 0) {
+                n += tle_udp_tx_bulk(beLcore->PortQueues[j].UdpDev, memBufs + n, k);
+            }
+#endif
 
             if (n == 0) {
                 continue;
             }
+            work += n - beLcore->PortQueues[j].TxBuf.Num;
+
+            if (beLcore->PortQueues[j].TxBuf.Num == 0) {
+                beLcore->PortQueues[j].TxDeadlineTsc = now + beLcore->TxFlushTsc;
+            }
+            if (n != RTE_DIM(beLcore->PortQueues[j].TxBuf.Pkt) && now < beLcore->PortQueues[j].TxDeadlineTsc) {
+                beLcore->PortQueues[j].TxBuf.Num = n;
+                txHeld = true;
+                continue;
+            }
 
             NETFE_TRACE("%s (%u): tle_tcp_tx_bulk(%p) returns %u, "
                 "total pkts to send: %u\n",
@@ -2862,10 +5476,9 @@ CheckTermination:
             k = rte_eth_tx_burst(beLcore->PortQueues[j].Port.Id,
                     beLcore->PortQueues[j].TxQid, memBufs, n);
 
-#ifdef DDS_VERBOSE
-            beLcore->PortQueues[j].TxStat.Out += k;
-            beLcore->PortQueues[j].TxStat.Drop += n - k;
-#endif
+            beLcore->Stats->TxPkts += k;
+            beLcore->Stats->TxDrops += n - k;
+            beLcore->Stats->TxBursts++;
 
             NETFE_TRACE("%s (%u): rte_eth_tx_burst(%u, %u, %u) returns %u\n",
                 __func__, beLcore->Id, beLcore->PortQueues[j].Port.Id, beLcore->PortQueues[j].TxQid,
@@ -2878,6 +5491,19 @@ CheckTermination:
                 }
             }
         }
+
+        NetfeTrimStreams(feLcore);
+
+        //
+        // 9. Back off while there is no work; reads outstanding are work until they complete
+        //
+        //
+        if (work != 0 || txHeld || feLcore->ReadOpHead != feLcore->ReadOpTail) {
+            beLcore->IdleIters = 0;
+        }
+        else {
+            NetbeLcoreIdle(beLcore);
+        }
     }
 
     RTE_LOG(NOTICE, USER1, "%s (lcore = %u) finish\n",
@@ -2897,11 +5523,32 @@ int
 PEPOTLDKTCPRun() {
     int32_t result;
     uint32_t i;
+    bool udfsThread = false;
 
     RTE_LOG(NOTICE, USER1,
         "%s: Launching PEPO on all configured cores...\n",
         __func__);
 
+    result = StartPEPOStatsExport();
+    if (result != 0) {
+        RTE_LOG(ERR, USER1, "StartPEPOStatsExport failed: err = %d, the counters aren't exported\n", result);
+    }
+
+    //
+    // The UDFs are reloaded on SIGHUP
+    //
+    //
+    if (PEPOUdfsQsbr != NULL) {
+        result = rte_ctrl_thread_create(&PEPOUdfsThread, "pepo-udfs", NULL, PEPOUdfsMain, NULL);
+        if (result != 0) {
+            RTE_LOG(ERR, USER1, "rte_ctrl_thread_create failed: err = %d, UDFs can't be reloaded\n", result);
+        }
+        else {
+            udfsThread = true;
+            signal(SIGHUP, UdfsSigHandler);
+        }
+    }
+
     //
     // Launch all worker lcores
     // Network engine is run worker lcores only (7 of them on BF-2)
@@ -2920,11 +5567,12 @@ PEPOTLDKTCPRun() {
     }
 
     //
-    // Launch on the master core if necessary
+    // Launch on the main lcore too if it is in the core list
     //
     //
-    if (BeCfg.NumCores == 8) {
-        result = PEPOLcoreMain(&CoreParam[0]);
+    i = rte_get_main_lcore();
+    if (CoreParam[i].Be.Lc != NULL || CoreParam[i].Fe.MaxStreams != 0) {
+        result = PEPOLcoreMain(&CoreParam[i]);
         if (result != 0) {
             RTE_LOG(ERR, USER1, "PEPOLcoreMain failed: err = %d, lcore = %u\n", result, i);
         }
@@ -2958,6 +5606,16 @@ PEPOTLDKTCPRun() {
     }
     fprintf(stdout, "All network lcores have exited\n");
 
+#ifdef PEPO_HOST_BACKENDS
+    PEPOHostBackendsLog();
+#endif
+
+    if (udfsThread) {
+        pthread_join(PEPOUdfsThread, NULL);
+    }
+
+    StopPEPOStatsExport();
+
     return 0;
 }
 
@@ -2970,6 +5628,11 @@ NetbeLcoreFini() {
     uint32_t i;
 
     for (i = 0; i != BeCfg.NumCores; i++) {
+#ifdef PEPO_UDP_REQUESTS
+        if (BeCfg.Cores[i].UdpCtx != NULL) {
+            tle_ctx_destroy(BeCfg.Cores[i].UdpCtx);
+        }
+#endif
         tle_ctx_destroy(BeCfg.Cores[i].Ctx);
         rte_ip_frag_table_destroy(BeCfg.Cores[i].Ftbl);
         rte_lpm_free(BeCfg.Cores[i].Lpm4);
@@ -2994,6 +5657,9 @@ int
 PEPOTLDKTCPDestroy(void) {
     uint32_t i, result;
     struct rte_eth_stats stats;
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    OffloadResponseRingBuffer *rings;
+#endif
 
     for (i = 0; i != BeCfg.NumPorts; i++) {
         RTE_LOG(NOTICE, USER1, "%s: Stoping port %u\n",
@@ -3006,7 +5672,8 @@ PEPOTLDKTCPDestroy(void) {
             "imissed = %" PRIu64 ", "
             "opackets = %" PRIu64 ", "
             "obytes = %" PRIu64 ", "
-            "oerrors = %" PRIu64 "\n"
+            "oerrors = %" PRIu64 ", "
+            "rx_nombuf = %" PRIu64 "\n"
             "}\n",
             BeCfg.Ports[i].Id,
             stats.ipackets,
@@ -3015,7 +5682,8 @@ PEPOTLDKTCPDestroy(void) {
             stats.imissed,
             stats.opackets,
             stats.obytes,
-            stats.oerrors);
+            stats.oerrors,
+            stats.rx_nombuf);
         result = rte_eth_dev_stop(BeCfg.Ports[i].Id);
         if (result != 0) {
             RTE_LOG(ERR, USER1, "rte_eth_dev_stop failed: err = %d, port = %u\n", result, BeCfg.Ports[i].Id);
@@ -3028,6 +5696,28 @@ PEPOTLDKTCPDestroy(void) {
 
     NetbeLcoreFini();
 
+    if (PEPOUdfs != NULL) {
+        PEPOUnloadUDFs(PEPOUdfs);
+        PEPOUdfs = NULL;
+    }
+    rte_free(PEPOUdfsQsbr);
+    PEPOUdfsQsbr = NULL;
+
+#ifdef PEPO_TLS
+    PEPOTlsDestroy();
+#endif
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    //
+    // Rings a buffer still has are registered with the back end, and left to the exit of the process
+    //
+    //
+    rings = OffloadResponseRings;
+    if (rings != NULL && WithdrawOffloadResponseRings()) {
+        rte_free(rings);
+    }
+#endif
+
     RTE_LOG(NOTICE, USER1, "PEPO (TLDK TCP) has been stopped\n");
 
     return 0;
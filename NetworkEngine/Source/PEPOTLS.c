@@ -0,0 +1,966 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+
+#include <rte_log.h>
+
+#include "PEPOTLDKTCP.h"
+
+#ifdef PEPO_TLS
+
+#define PEPO_TLS_RECORD_CHANGE_CIPHER_SPEC 20
+#define PEPO_TLS_RECORD_ALERT 21
+#define PEPO_TLS_RECORD_HANDSHAKE 22
+#define PEPO_TLS_RECORD_APPLICATION_DATA 23
+
+//
+// The padding a record may carry past the plaintext and its type, by RFC 8446
+//
+//
+#define PEPO_TLS_MAX_CIPHERTEXT (PEPO_TLS_MAX_PLAINTEXT + 256)
+
+//
+// The key and the IV of one direction, and the sequence number of its next record
+//
+//
+struct PEPOTlsKeys {
+    EVP_CIPHER_CTX* Ctx;
+    uint8_t Iv[PEPO_TLS_NONCE_BYTES];
+    uint64_t Seq;
+};
+
+struct PEPOTlsSession {
+    struct rte_mempool* Pool;
+    SSL* Ssl; /* freed once the handshake is done */
+    BIO* Rbio;
+    BIO* Wbio;
+    bool Established;
+    bool HaveClientSecret;
+    bool HaveServerSecret;
+    uint32_t SecretBytes;
+    uint8_t ClientSecret[EVP_MAX_MD_SIZE];
+    uint8_t ServerSecret[EVP_MAX_MD_SIZE];
+    struct PEPOTlsKeys Rx;
+    struct PEPOTlsKeys Tx;
+    struct rte_mbuf* Wire; /* the handshake records to send */
+    uint32_t RxNum;
+    uint32_t RxOff; /* the bytes of RxPkts[0] already taken */
+    uint32_t RxBytes; /* the bytes held and not taken */
+    struct rte_mbuf* RxPkts[PEPO_TLS_RX_PKTS];
+};
+
+static SSL_CTX* PEPOTlsCtx = NULL;
+
+//
+// A read position in a list of mbuf chains
+//
+//
+struct PEPOTlsCursor {
+    struct rte_mbuf** Pkts;
+    uint32_t NumPkts;
+    uint32_t Pkt;
+    struct rte_mbuf* Seg;
+    uint32_t Off;
+};
+
+//
+// The end of an mbuf chain being built
+//
+//
+struct PEPOTlsWriter {
+    struct rte_mempool* Pool;
+    struct rte_mbuf* Head;
+    struct rte_mbuf* Tail;
+};
+
+//
+// Capture the traffic secrets of the application data through the key log of OpenSSL,
+// which is how TLS 1.3 hands them over
+//
+//
+static void
+PEPOTlsKeyLog(
+    const SSL* Ssl,
+    const char* Line
+) {
+    struct PEPOTlsSession* session = SSL_get_app_data(Ssl);
+    uint8_t* secret;
+    bool* have;
+    const char* hex;
+    size_t hexChars;
+    uint32_t i;
+    unsigned int byte;
+
+    if (strncmp(Line, "CLIENT_TRAFFIC_SECRET_0 ", 24) == 0) {
+        secret = session->ClientSecret;
+        have = &session->HaveClientSecret;
+    }
+    else if (strncmp(Line, "SERVER_TRAFFIC_SECRET_0 ", 24) == 0) {
+        secret = session->ServerSecret;
+        have = &session->HaveServerSecret;
+    }
+    else {
+        return;
+    }
+
+    //
+    // The label is followed by the client random, then the secret
+    //
+    //
+    hex = strchr(Line + 24, ' ');
+    if (hex == NULL) {
+        return;
+    }
+    hex++;
+    hexChars = strlen(hex);
+    if (hexChars == 0 || hexChars % 2 != 0 || hexChars / 2 > EVP_MAX_MD_SIZE) {
+        return;
+    }
+
+    for (i = 0; i != hexChars / 2; i++) {
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            return;
+        }
+        secret[i] = (uint8_t)byte;
+    }
+    session->SecretBytes = hexChars / 2;
+    *have = true;
+}
+
+//
+// HKDF-Expand-Label of RFC 8446
+//
+//
+static int
+PEPOTlsExpandLabel(
+    const EVP_MD* Md,
+    const uint8_t* Secret,
+    uint32_t SecretBytes,
+    const char* Label,
+    uint8_t* Out,
+    uint32_t OutBytes
+) {
+    uint8_t info[2 + 1 + 6 + 16 + 1];
+    size_t labelBytes = strlen(Label);
+    size_t infoBytes = 0;
+    size_t outBytes = OutBytes;
+    EVP_PKEY_CTX* pctx;
+    int result = -1;
+
+    info[infoBytes++] = (uint8_t)(OutBytes >> 8);
+    info[infoBytes++] = (uint8_t)OutBytes;
+    info[infoBytes++] = (uint8_t)(6 + labelBytes);
+    memcpy(info + infoBytes, "tls13 ", 6);
+    infoBytes += 6;
+    memcpy(info + infoBytes, Label, labelBytes);
+    infoBytes += labelBytes;
+    info[infoBytes++] = 0;
+
+    pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    if (pctx != NULL &&
+        EVP_PKEY_derive_init(pctx) > 0 &&
+        EVP_PKEY_CTX_hkdf_mode(pctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+        EVP_PKEY_CTX_set_hkdf_md(pctx, Md) > 0 &&
+        EVP_PKEY_CTX_set1_hkdf_key(pctx, Secret, SecretBytes) > 0 &&
+        EVP_PKEY_CTX_add1_hkdf_info(pctx, info, infoBytes) > 0 &&
+        EVP_PKEY_derive(pctx, Out, &outBytes) > 0 &&
+        outBytes == OutBytes) {
+        result = 0;
+    }
+    EVP_PKEY_CTX_free(pctx);
+
+    return result;
+}
+
+//
+// Derive the key and the IV of a direction from its traffic secret
+//
+//
+static int
+PEPOTlsSetKeys(
+    struct PEPOTlsKeys* Keys,
+    const EVP_CIPHER* Cipher,
+    const EVP_MD* Md,
+    const uint8_t* Secret,
+    uint32_t SecretBytes,
+    int Encrypt
+) {
+    uint8_t key[EVP_MAX_KEY_LENGTH];
+    int result = -1;
+
+    if (PEPOTlsExpandLabel(Md, Secret, SecretBytes, "key", key, EVP_CIPHER_key_length(Cipher)) == 0 &&
+        PEPOTlsExpandLabel(Md, Secret, SecretBytes, "iv", Keys->Iv, PEPO_TLS_NONCE_BYTES) == 0) {
+        Keys->Ctx = EVP_CIPHER_CTX_new();
+        if (Keys->Ctx != NULL && EVP_CipherInit_ex(Keys->Ctx, Cipher, NULL, key, NULL, Encrypt) == 1) {
+            Keys->Seq = 0;
+            result = 0;
+        }
+    }
+    OPENSSL_cleanse(key, sizeof(key));
+
+    return result;
+}
+
+//
+// The nonce of the record with sequence number Seq
+//
+//
+static void
+PEPOTlsNonce(
+    const struct PEPOTlsKeys* Keys,
+    uint64_t Seq,
+    uint8_t* Nonce
+) {
+    uint32_t i;
+
+    memcpy(Nonce, Keys->Iv, PEPO_TLS_NONCE_BYTES);
+    for (i = 0; i != 8; i++) {
+        Nonce[PEPO_TLS_NONCE_BYTES - 1 - i] ^= (uint8_t)(Seq >> (8 * i));
+    }
+}
+
+static void
+PEPOTlsCursorInit(
+    struct PEPOTlsCursor* Cursor,
+    struct rte_mbuf** Pkts,
+    uint32_t NumPkts
+) {
+    Cursor->Pkts = Pkts;
+    Cursor->NumPkts = NumPkts;
+    Cursor->Pkt = 0;
+    Cursor->Seg = NumPkts != 0 ? Pkts[0] : NULL;
+    Cursor->Off = 0;
+}
+
+//
+// Point Data at up to Max contiguous bytes at the cursor and move past them.
+// Return the bytes, 0 at the end
+//
+//
+static uint32_t
+PEPOTlsNext(
+    struct PEPOTlsCursor* Cursor,
+    uint32_t Max,
+    const uint8_t** Data
+) {
+    uint32_t n;
+
+    while (Cursor->Seg != NULL && Cursor->Off == Cursor->Seg->data_len) {
+        Cursor->Seg = Cursor->Seg->next;
+        Cursor->Off = 0;
+        if (Cursor->Seg == NULL && ++Cursor->Pkt != Cursor->NumPkts) {
+            Cursor->Seg = Cursor->Pkts[Cursor->Pkt];
+        }
+    }
+    if (Cursor->Seg == NULL) {
+        return 0;
+    }
+
+    n = RTE_MIN((uint32_t)(Cursor->Seg->data_len - Cursor->Off), Max);
+    *Data = rte_pktmbuf_mtod_offset(Cursor->Seg, const uint8_t*, Cursor->Off);
+    Cursor->Off += n;
+
+    return n;
+}
+
+//
+// Copy Bytes at the cursor to To, or skip them if To is NULL; the bytes must be there
+//
+//
+static void
+PEPOTlsCopy(
+    struct PEPOTlsCursor* Cursor,
+    uint8_t* To,
+    uint32_t Bytes
+) {
+    const uint8_t* data;
+    uint32_t n;
+
+    while (Bytes != 0) {
+        n = PEPOTlsNext(Cursor, Bytes, &data);
+        if (To != NULL) {
+            memcpy(To, data, n);
+            To += n;
+        }
+        Bytes -= n;
+    }
+}
+
+//
+// Reserve up to Max contiguous bytes at the end of the chain, adding a segment if the last one is full.
+// Return where they are, with the bytes reserved in Bytes, or NULL if the pool ran out
+//
+//
+static uint8_t*
+PEPOTlsAppend(
+    struct PEPOTlsWriter* Writer,
+    uint32_t Max,
+    uint32_t* Bytes
+) {
+    struct rte_mbuf* seg;
+    uint8_t* data;
+    uint32_t n;
+
+    if (Writer->Tail == NULL || rte_pktmbuf_tailroom(Writer->Tail) == 0) {
+        seg = rte_pktmbuf_alloc(Writer->Pool);
+        if (seg == NULL) {
+            return NULL;
+        }
+        if (Writer->Head == NULL) {
+            Writer->Head = seg;
+        }
+        else {
+            //
+            // Only the first segment needs headroom for the headers
+            //
+            //
+            seg->data_off = 0;
+            Writer->Tail->next = seg;
+            Writer->Head->nb_segs++;
+        }
+        Writer->Tail = seg;
+    }
+
+    n = RTE_MIN((uint32_t)rte_pktmbuf_tailroom(Writer->Tail), Max);
+    data = rte_pktmbuf_mtod_offset(Writer->Tail, uint8_t*, Writer->Tail->data_len);
+    Writer->Tail->data_len += n;
+    Writer->Head->pkt_len += n;
+    *Bytes = n;
+
+    return data;
+}
+
+static int
+PEPOTlsWrite(
+    struct PEPOTlsWriter* Writer,
+    const uint8_t* Data,
+    uint32_t Bytes
+) {
+    uint8_t* to;
+    uint32_t n;
+
+    while (Bytes != 0) {
+        to = PEPOTlsAppend(Writer, Bytes, &n);
+        if (to == NULL) {
+            return -ENOMEM;
+        }
+        memcpy(to, Data, n);
+        Data += n;
+        Bytes -= n;
+    }
+
+    return 0;
+}
+
+//
+// Run Bytes at the cursor through the cipher into the chain
+//
+//
+static int
+PEPOTlsCrypt(
+    EVP_CIPHER_CTX* Ctx,
+    struct PEPOTlsCursor* Cursor,
+    struct PEPOTlsWriter* Writer,
+    uint32_t Bytes
+) {
+    const uint8_t* data;
+    uint8_t* to;
+    uint32_t n, room;
+    int outBytes;
+
+    while (Bytes != 0) {
+        n = PEPOTlsNext(Cursor, Bytes, &data);
+        Bytes -= n;
+        while (n != 0) {
+            to = PEPOTlsAppend(Writer, n, &room);
+            if (to == NULL) {
+                return -ENOMEM;
+            }
+            if (EVP_CipherUpdate(Ctx, to, &outBytes, data, room) != 1) {
+                return -EIO;
+            }
+            data += room;
+            n -= room;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Drop Bytes from the head of the ciphertext held
+//
+//
+static void
+PEPOTlsRxConsume(
+    struct PEPOTlsSession* Session,
+    uint32_t Bytes
+) {
+    uint32_t done = 0;
+
+    Session->RxOff += Bytes;
+    Session->RxBytes -= Bytes;
+    while (done != Session->RxNum && Session->RxOff >= Session->RxPkts[done]->pkt_len) {
+        Session->RxOff -= Session->RxPkts[done]->pkt_len;
+        rte_pktmbuf_free(Session->RxPkts[done]);
+        done++;
+    }
+    if (done != 0) {
+        Session->RxNum -= done;
+        memmove(Session->RxPkts, Session->RxPkts + done, Session->RxNum * sizeof(Session->RxPkts[0]));
+    }
+}
+
+//
+// Move what OpenSSL wrote to the wire packet
+//
+//
+static int
+PEPOTlsFlushWbio(
+    struct PEPOTlsSession* Session
+) {
+    struct PEPOTlsWriter writer = {
+        Session->Pool,
+        Session->Wire,
+        Session->Wire != NULL ? rte_pktmbuf_lastseg(Session->Wire) : NULL
+    };
+    size_t pending;
+    uint8_t* to;
+    uint32_t n;
+    int result = 0;
+
+    while ((pending = BIO_ctrl_pending(Session->Wbio)) != 0) {
+        to = PEPOTlsAppend(&writer, (uint32_t)RTE_MIN(pending, (size_t)UINT32_MAX), &n);
+        if (to == NULL) {
+            result = -ENOMEM;
+            break;
+        }
+        if (BIO_read(Session->Wbio, to, n) != (int)n) {
+            result = -EIO;
+            break;
+        }
+    }
+    Session->Wire = writer.Head;
+
+    return result;
+}
+
+//
+// Switch to the records once OpenSSL is done with the handshake
+//
+//
+static int
+PEPOTlsFinishHandshake(
+    struct PEPOTlsSession* Session
+) {
+    const EVP_CIPHER* cipher;
+    const EVP_MD* md;
+    struct PEPOTlsWriter writer = { Session->Pool, NULL, NULL };
+    size_t pending;
+    uint8_t* to;
+    uint32_t n;
+
+    switch (SSL_CIPHER_get_id(SSL_get_current_cipher(Session->Ssl)) & 0xffff) {
+        case 0x1301:
+            cipher = EVP_aes_128_gcm();
+            md = EVP_sha256();
+            break;
+        case 0x1302:
+            cipher = EVP_aes_256_gcm();
+            md = EVP_sha384();
+            break;
+        default:
+            return -EPROTO;
+    }
+
+    if (!Session->HaveClientSecret || !Session->HaveServerSecret ||
+        PEPOTlsSetKeys(&Session->Rx, cipher, md, Session->ClientSecret, Session->SecretBytes, 0) ||
+        PEPOTlsSetKeys(&Session->Tx, cipher, md, Session->ServerSecret, Session->SecretBytes, 1)) {
+        return -EPROTO;
+    }
+    OPENSSL_cleanse(Session->ClientSecret, sizeof(Session->ClientSecret));
+    OPENSSL_cleanse(Session->ServerSecret, sizeof(Session->ServerSecret));
+
+    //
+    // The client may have sent records right behind its Finished
+    //
+    //
+    while ((pending = BIO_ctrl_pending(Session->Rbio)) != 0) {
+        to = PEPOTlsAppend(&writer, (uint32_t)RTE_MIN(pending, (size_t)UINT32_MAX), &n);
+        if (to == NULL || BIO_read(Session->Rbio, to, n) != (int)n) {
+            rte_pktmbuf_free(writer.Head);
+            return -ENOMEM;
+        }
+    }
+    if (writer.Head != NULL) {
+        Session->RxPkts[0] = writer.Head;
+        Session->RxNum = 1;
+        Session->RxOff = 0;
+        Session->RxBytes = writer.Head->pkt_len;
+    }
+
+    SSL_free(Session->Ssl);
+    Session->Ssl = NULL;
+    Session->Rbio = NULL;
+    Session->Wbio = NULL;
+    Session->Established = true;
+
+    return 1;
+}
+
+//
+// Feed the ciphertext held to OpenSSL. Return 1 when the handshake is done, 0 while it goes on,
+// or a negative errno if it failed
+//
+//
+static int
+PEPOTlsHandshake(
+    struct PEPOTlsSession* Session
+) {
+    struct PEPOTlsCursor cursor;
+    const uint8_t* data;
+    uint32_t n;
+    int result;
+
+    PEPOTlsCursorInit(&cursor, Session->RxPkts, Session->RxNum);
+    PEPOTlsCopy(&cursor, NULL, Session->RxOff);
+    while ((n = PEPOTlsNext(&cursor, UINT32_MAX, &data)) != 0) {
+        if (BIO_write(Session->Rbio, data, n) != (int)n) {
+            return -ENOMEM;
+        }
+    }
+    PEPOTlsRxConsume(Session, Session->RxBytes);
+
+    result = SSL_do_handshake(Session->Ssl);
+    if (PEPOTlsFlushWbio(Session)) {
+        return -ENOMEM;
+    }
+    if (result != 1) {
+        switch (SSL_get_error(Session->Ssl, result)) {
+            case SSL_ERROR_WANT_READ:
+            case SSL_ERROR_WANT_WRITE:
+                return 0;
+            default:
+                ERR_clear_error();
+                return -EPROTO;
+        }
+    }
+
+    return PEPOTlsFinishHandshake(Session);
+}
+
+//
+// Cut the zero padding and the content type off the plaintext of a record.
+// Return the content type, or a negative errno if the padding reaches past the last segment
+//
+//
+static int
+PEPOTlsTrimType(
+    struct rte_mbuf* Plain
+) {
+    struct rte_mbuf* last = rte_pktmbuf_lastseg(Plain);
+    struct rte_mbuf* prev;
+    uint8_t* data = rte_pktmbuf_mtod(last, uint8_t*);
+    uint8_t type;
+
+    while (last->data_len != 0 && data[last->data_len - 1] == 0) {
+        last->data_len--;
+        Plain->pkt_len--;
+    }
+    if (last->data_len == 0) {
+        return -EPROTO;
+    }
+    type = data[--last->data_len];
+    Plain->pkt_len--;
+
+    if (last->data_len == 0 && last != Plain) {
+        for (prev = Plain; prev->next != last; prev = prev->next) {
+        }
+        prev->next = NULL;
+        Plain->nb_segs--;
+        rte_pktmbuf_free_seg(last);
+    }
+
+    return type;
+}
+
+//
+// Open the record at the head of the ciphertext held into Plain, NULL if it has no application data.
+// Return 1 if a record was taken, 0 if the next one isn't whole yet, or a negative errno
+//
+//
+static int
+PEPOTlsOpen(
+    struct PEPOTlsSession* Session,
+    struct rte_mbuf** Plain
+) {
+    struct PEPOTlsCursor cursor;
+    struct PEPOTlsWriter writer = { Session->Pool, NULL, NULL };
+    uint8_t header[PEPO_TLS_RECORD_HEADER];
+    uint8_t nonce[PEPO_TLS_NONCE_BYTES];
+    uint8_t tag[PEPO_TLS_TAG_BYTES];
+    uint32_t length;
+    int outBytes, result;
+
+    *Plain = NULL;
+    if (Session->RxBytes < PEPO_TLS_RECORD_HEADER) {
+        return 0;
+    }
+
+    PEPOTlsCursorInit(&cursor, Session->RxPkts, Session->RxNum);
+    PEPOTlsCopy(&cursor, NULL, Session->RxOff);
+    PEPOTlsCopy(&cursor, header, PEPO_TLS_RECORD_HEADER);
+    length = (uint32_t)header[3] << 8 | header[4];
+
+    //
+    // Clients in middlebox compatibility mode may still send a ChangeCipherSpec, which is ignored
+    //
+    //
+    if (header[0] == PEPO_TLS_RECORD_CHANGE_CIPHER_SPEC) {
+        if (Session->RxBytes < PEPO_TLS_RECORD_HEADER + length) {
+            return 0;
+        }
+        PEPOTlsRxConsume(Session, PEPO_TLS_RECORD_HEADER + length);
+        return 1;
+    }
+    if (header[0] != PEPO_TLS_RECORD_APPLICATION_DATA ||
+        length <= PEPO_TLS_TAG_BYTES || length > PEPO_TLS_MAX_CIPHERTEXT) {
+        return -EPROTO;
+    }
+    if (Session->RxBytes < PEPO_TLS_RECORD_HEADER + length) {
+        return 0;
+    }
+
+    PEPOTlsNonce(&Session->Rx, Session->Rx.Seq, nonce);
+    if (EVP_DecryptInit_ex(Session->Rx.Ctx, NULL, NULL, NULL, nonce) != 1 ||
+        EVP_DecryptUpdate(Session->Rx.Ctx, NULL, &outBytes, header, PEPO_TLS_RECORD_HEADER) != 1) {
+        return -EIO;
+    }
+    result = PEPOTlsCrypt(Session->Rx.Ctx, &cursor, &writer, length - PEPO_TLS_TAG_BYTES);
+    if (result) {
+        rte_pktmbuf_free(writer.Head);
+        return result;
+    }
+    PEPOTlsCopy(&cursor, tag, PEPO_TLS_TAG_BYTES);
+    if (EVP_CIPHER_CTX_ctrl(Session->Rx.Ctx, EVP_CTRL_GCM_SET_TAG, PEPO_TLS_TAG_BYTES, tag) != 1 ||
+        EVP_DecryptFinal_ex(Session->Rx.Ctx, tag, &outBytes) != 1) {
+        rte_pktmbuf_free(writer.Head);
+        return -EBADMSG;
+    }
+    Session->Rx.Seq++;
+    PEPOTlsRxConsume(Session, PEPO_TLS_RECORD_HEADER + length);
+
+    result = PEPOTlsTrimType(writer.Head);
+    switch (result) {
+        case PEPO_TLS_RECORD_APPLICATION_DATA:
+            if (writer.Head->pkt_len != 0) {
+                *Plain = writer.Head;
+            }
+            else {
+                rte_pktmbuf_free(writer.Head);
+            }
+            return 1;
+        case PEPO_TLS_RECORD_ALERT:
+            rte_pktmbuf_free(writer.Head);
+            return -ECONNRESET;
+        default:
+            rte_pktmbuf_free(writer.Head);
+            return result < 0 ? result : -EPROTO;
+    }
+}
+
+//
+// Seal a plaintext packet into a chain of records of up to PEPO_TLS_MAX_PLAINTEXT bytes each.
+// The sequence number only moves on if all records were built
+//
+//
+static struct rte_mbuf*
+PEPOTlsSealPkt(
+    struct PEPOTlsSession* Session,
+    struct rte_mbuf* Pkt
+) {
+    struct PEPOTlsCursor cursor;
+    struct PEPOTlsWriter writer = { Session->Pool, NULL, NULL };
+    uint8_t header[PEPO_TLS_RECORD_HEADER];
+    uint8_t nonce[PEPO_TLS_NONCE_BYTES];
+    uint8_t tag[PEPO_TLS_TAG_BYTES];
+    uint8_t type = PEPO_TLS_RECORD_APPLICATION_DATA;
+    uint8_t typeSealed;
+    uint64_t seq = Session->Tx.Seq;
+    uint32_t left = Pkt->pkt_len;
+    uint32_t n, length;
+    int outBytes;
+
+    PEPOTlsCursorInit(&cursor, &Pkt, 1);
+    do {
+        n = RTE_MIN(left, (uint32_t)PEPO_TLS_MAX_PLAINTEXT);
+        length = n + 1 + PEPO_TLS_TAG_BYTES;
+        header[0] = PEPO_TLS_RECORD_APPLICATION_DATA;
+        header[1] = 0x03;
+        header[2] = 0x03;
+        header[3] = (uint8_t)(length >> 8);
+        header[4] = (uint8_t)length;
+
+        PEPOTlsNonce(&Session->Tx, seq, nonce);
+        if (PEPOTlsWrite(&writer, header, PEPO_TLS_RECORD_HEADER) ||
+            EVP_EncryptInit_ex(Session->Tx.Ctx, NULL, NULL, NULL, nonce) != 1 ||
+            EVP_EncryptUpdate(Session->Tx.Ctx, NULL, &outBytes, header, PEPO_TLS_RECORD_HEADER) != 1 ||
+            PEPOTlsCrypt(Session->Tx.Ctx, &cursor, &writer, n) ||
+            EVP_EncryptUpdate(Session->Tx.Ctx, &typeSealed, &outBytes, &type, 1) != 1 ||
+            PEPOTlsWrite(&writer, &typeSealed, 1) ||
+            EVP_EncryptFinal_ex(Session->Tx.Ctx, tag, &outBytes) != 1 ||
+            EVP_CIPHER_CTX_ctrl(Session->Tx.Ctx, EVP_CTRL_GCM_GET_TAG, PEPO_TLS_TAG_BYTES, tag) != 1 ||
+            PEPOTlsWrite(&writer, tag, PEPO_TLS_TAG_BYTES)) {
+            rte_pktmbuf_free(writer.Head);
+            return NULL;
+        }
+
+        seq++;
+        left -= n;
+    } while (left != 0);
+
+    Session->Tx.Seq = seq;
+    return writer.Head;
+}
+
+//
+// Set up the TLS context of all sessions
+//
+//
+int
+PEPOTlsInit(
+    const char* CertPath,
+    const char* KeyPath
+) {
+    //
+    // Loading the config of OpenSSL picks up an engine for the handshake, such as the PKA engine of the DPU
+    //
+    //
+    OPENSSL_init_ssl(OPENSSL_INIT_LOAD_CONFIG, NULL);
+
+    PEPOTlsCtx = SSL_CTX_new(TLS_server_method());
+    if (PEPOTlsCtx == NULL) {
+        RTE_LOG(ERR, USER1, "%s: failed to create the TLS context\n", __func__);
+        return -ENOMEM;
+    }
+
+    if (SSL_CTX_set_min_proto_version(PEPOTlsCtx, TLS1_3_VERSION) != 1 ||
+        SSL_CTX_set_ciphersuites(PEPOTlsCtx, PEPO_TLS_CIPHERSUITES) != 1 ||
+        SSL_CTX_set_num_tickets(PEPOTlsCtx, 0) != 1 ||
+        SSL_CTX_use_certificate_chain_file(PEPOTlsCtx, CertPath) != 1 ||
+        SSL_CTX_use_PrivateKey_file(PEPOTlsCtx, KeyPath, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(PEPOTlsCtx) != 1) {
+        RTE_LOG(ERR, USER1, "%s: failed to set up TLS with %s and %s\n", __func__, CertPath, KeyPath);
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(PEPOTlsCtx);
+        PEPOTlsCtx = NULL;
+        return -EINVAL;
+    }
+    SSL_CTX_set_keylog_callback(PEPOTlsCtx, PEPOTlsKeyLog);
+
+    return 0;
+}
+
+//
+// Free the TLS context
+//
+//
+void
+PEPOTlsDestroy(void) {
+    SSL_CTX_free(PEPOTlsCtx);
+    PEPOTlsCtx = NULL;
+}
+
+//
+// Start the server side of a TLS session
+//
+//
+struct PEPOTlsSession*
+PEPOTlsSessionCreate(
+    struct rte_mempool* Pool
+) {
+    struct PEPOTlsSession* session;
+
+    session = calloc(1, sizeof(*session));
+    if (session == NULL) {
+        return NULL;
+    }
+    session->Pool = Pool;
+
+    session->Ssl = SSL_new(PEPOTlsCtx);
+    session->Rbio = BIO_new(BIO_s_mem());
+    session->Wbio = BIO_new(BIO_s_mem());
+    if (session->Ssl == NULL || session->Rbio == NULL || session->Wbio == NULL) {
+        BIO_free(session->Rbio);
+        BIO_free(session->Wbio);
+        SSL_free(session->Ssl);
+        free(session);
+        return NULL;
+    }
+
+    SSL_set_bio(session->Ssl, session->Rbio, session->Wbio);
+    SSL_set_accept_state(session->Ssl);
+    SSL_set_app_data(session->Ssl, session);
+
+    return session;
+}
+
+//
+// Free a session and the packets it holds
+//
+//
+void
+PEPOTlsSessionFree(
+    struct PEPOTlsSession* Session
+) {
+    uint32_t i;
+
+    if (Session == NULL) {
+        return;
+    }
+
+    SSL_free(Session->Ssl);
+    EVP_CIPHER_CTX_free(Session->Rx.Ctx);
+    EVP_CIPHER_CTX_free(Session->Tx.Ctx);
+    for (i = 0; i != Session->RxNum; i++) {
+        rte_pktmbuf_free(Session->RxPkts[i]);
+    }
+    rte_pktmbuf_free(Session->Wire);
+    OPENSSL_cleanse(Session, sizeof(*Session));
+    free(Session);
+}
+
+//
+// The ciphertext packets the session can take now
+//
+//
+uint32_t
+PEPOTlsRxRoom(
+    const struct PEPOTlsSession* Session
+) {
+    return PEPO_TLS_RX_PKTS - Session->RxNum;
+}
+
+//
+// Whether the handshake is done
+//
+//
+bool
+PEPOTlsEstablished(
+    const struct PEPOTlsSession* Session
+) {
+    return Session->Established;
+}
+
+//
+// Take ciphertext packets and give back the plaintext of the whole records
+//
+//
+int
+PEPOTlsRecv(
+    struct PEPOTlsSession* Session,
+    struct rte_mbuf** Pkts,
+    uint32_t NumPkts,
+    uint32_t MaxPkts
+) {
+    struct rte_mbuf* plain;
+    uint32_t i, numPlain = 0;
+    int result;
+
+    for (i = 0; i != NumPkts; i++) {
+        if (Session->RxNum == PEPO_TLS_RX_PKTS) {
+            rte_pktmbuf_free_bulk(Pkts + i, NumPkts - i);
+            return -ENOBUFS;
+        }
+        Session->RxPkts[Session->RxNum++] = Pkts[i];
+        Session->RxBytes += Pkts[i]->pkt_len;
+    }
+
+    if (!Session->Established) {
+        result = PEPOTlsHandshake(Session);
+        if (result <= 0) {
+            return result;
+        }
+    }
+
+    while (numPlain != MaxPkts) {
+        result = PEPOTlsOpen(Session, &plain);
+        if (result < 0) {
+            return result;
+        }
+        if (result == 0) {
+            break;
+        }
+        if (plain != NULL) {
+            Pkts[numPlain++] = plain;
+        }
+    }
+
+    //
+    // A record that doesn't fit in the packets a session holds never completes
+    //
+    //
+    if (numPlain == 0 && Session->RxNum == PEPO_TLS_RX_PKTS) {
+        return -ENOBUFS;
+    }
+
+    return numPlain;
+}
+
+//
+// Take the handshake records to send
+//
+//
+struct rte_mbuf*
+PEPOTlsTakeWire(
+    struct PEPOTlsSession* Session
+) {
+    struct rte_mbuf* wire = Session->Wire;
+
+    Session->Wire = NULL;
+    return wire;
+}
+
+//
+// Replace plaintext packets with packets of their records
+//
+//
+uint32_t
+PEPOTlsSeal(
+    struct PEPOTlsSession* Session,
+    struct rte_mbuf** Pkts,
+    uint32_t NumPkts
+) {
+    struct rte_mbuf* sealed;
+    uint32_t i;
+
+    if (!Session->Established) {
+        return 0;
+    }
+
+    for (i = 0; i != NumPkts; i++) {
+        sealed = PEPOTlsSealPkt(Session, Pkts[i]);
+        if (sealed == NULL) {
+            break;
+        }
+        rte_pktmbuf_free(Pkts[i]);
+        Pkts[i] = sealed;
+    }
+
+    return i;
+}
+
+#endif /* PEPO_TLS */
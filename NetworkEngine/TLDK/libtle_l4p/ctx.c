@@ -146,6 +146,16 @@ tle_ctx_destroy(struct tle_ctx *ctx)
 	rte_free(ctx);
 }
 
+int
+tle_ctx_get_stat(const struct tle_ctx *ctx, struct tle_ctx_stat *stat)
+{
+	if (ctx == NULL || stat == NULL)
+		return -EINVAL;
+
+	*stat = ctx->stat;
+	return 0;
+}
+
 void
 tle_ctx_invalidate(struct tle_ctx *ctx)
 {
@@ -66,6 +66,7 @@ struct tle_ctx {
 	uint32_t nb_dev;
 	struct tle_pbm use[TLE_VNUM]; /* all ports in use. */
 	struct tle_dev dev[RTE_MAX_ETHPORTS];
+	struct tle_ctx_stat stat; /* QZ: retransmission and out-of-order counters */
 };
 
 struct stream_ops {
@@ -129,6 +129,10 @@ empty_rq(struct tle_tcp_stream *s)
 	} while (n != 0);
 
 	tcp_ofo_reset(s->rx.ofo);
+
+	/* QZ: give the out-of-order bytes back to the context */
+	s->s.ctx->stat.ofo_bytes -= s->rx.ofo->nb_bytes;
+	s->rx.ofo->nb_bytes = 0;
 }
 
 /* empty stream's listen queue */
@@ -77,4 +77,5 @@ tcp_ofo_init(struct ofo *ofo, uint32_t nobj, uint32_t ndb)
 	}
 
 	ofo->nb_max = ndb;
+	ofo->nb_bytes = 0;
 }
\ No newline at end of file
@@ -36,9 +36,24 @@ struct ofodb {
 struct ofo {
 	uint32_t nb_elem;
 	uint32_t nb_max;
+	uint32_t nb_bytes; /* QZ: bytes charged to the context */
 	struct ofodb db[];
 };
 
+/*
+ * QZ: bytes of out-of-order data held.
+ */
+static inline uint32_t
+_ofo_bytes(const struct ofo *ofo)
+{
+	uint32_t i, n;
+
+	n = 0;
+	for (i = 0; i != ofo->nb_elem; i++)
+		n += ofo->db[i].sl.len;
+	return n;
+}
+
 static inline void
 _ofodb_move(struct ofodb *dst, struct ofodb *src)
 {
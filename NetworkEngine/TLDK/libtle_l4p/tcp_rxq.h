@@ -31,11 +31,83 @@ struct rxq_objs {
 	uint32_t num;
 };
 
+/*
+ * QZ: charge the out-of-order bytes of a stream to its context.
+ */
+static inline void
+rx_ofo_account(struct tle_tcp_stream *s)
+{
+	uint32_t n;
+	struct ofo *ofo;
+
+	ofo = s->rx.ofo;
+	n = _ofo_bytes(ofo);
+	s->s.ctx->stat.ofo_bytes += n;
+	s->s.ctx->stat.ofo_bytes -= ofo->nb_bytes;
+	ofo->nb_bytes = n;
+}
+
+/*
+ * QZ: make room for len out-of-order bytes at seq within the limits of
+ * the stream and of its context, dropping held data to the right of seq
+ * first: without SACK, the peer resends it after the gap is filled anyway,
+ * and data nearer rcv.nxt is delivered sooner. Returns the bytes that fit.
+ */
+static inline uint32_t
+rx_ofo_make_room(struct tle_tcp_stream *s, uint32_t seq, uint32_t len)
+{
+	uint64_t room;
+	struct ofo *ofo;
+	struct ofodb *db;
+	const struct tle_ctx *ctx;
+
+	ctx = s->s.ctx;
+	ofo = s->rx.ofo;
+
+	for (;;) {
+		room = UINT64_MAX;
+		if (ctx->prm.ofo_stream_bytes != 0)
+			room = (ofo->nb_bytes < ctx->prm.ofo_stream_bytes) ?
+				ctx->prm.ofo_stream_bytes - ofo->nb_bytes : 0;
+		if (ctx->prm.ofo_ctx_bytes != 0)
+			room = RTE_MIN(room,
+				(ctx->stat.ofo_bytes < ctx->prm.ofo_ctx_bytes) ?
+				ctx->prm.ofo_ctx_bytes - ctx->stat.ofo_bytes : 0);
+
+		if (room >= len || ofo->nb_elem == 0)
+			break;
+
+		db = ofo->db + ofo->nb_elem - 1;
+		if (tcp_seq_leq(db->sl.seq, seq))
+			break;
+
+		s->s.ctx->stat.ofo_evicts += db->nb_elem;
+		_ofodb_free(db);
+		_ofo_remove(ofo, ofo->nb_elem - 1, 1);
+		rx_ofo_account(s);
+	}
+
+	return RTE_MIN(room, len);
+}
+
 static inline uint32_t
 rx_ofo_enqueue(struct tle_tcp_stream *s, union seqlen *sl,
 	struct rte_mbuf *mb[], uint32_t num)
 {
-	uint32_t i, n;
+	uint32_t i, n, len, room;
+
+	/* QZ: take only the packets that fit in the out-of-order limits */
+	room = rx_ofo_make_room(s, sl->seq, sl->len);
+	if (room != sl->len) {
+		for (n = 0, len = 0; n != num &&
+				len + mb[n]->pkt_len <= room; n++)
+			len += mb[n]->pkt_len;
+		s->s.ctx->stat.ofo_drops += num - n;
+		num = n;
+		sl->len = len;
+		if (num == 0)
+			return 0;
+	}
 
 	n = 0;
 	do {
@@ -44,6 +116,7 @@ rx_ofo_enqueue(struct tle_tcp_stream *s, union seqlen *sl,
 	} while (i != 0 && n != num);
 
 	_ofo_compact(s->rx.ofo);
+	rx_ofo_account(s);
 	return n;
 }
 
@@ -78,6 +151,7 @@ rx_ofo_reduce(struct tle_tcp_stream *s)
 
 	s->tcb.rcv.nxt = seq;
 	_ofo_remove(ofo, 0, i);
+	rx_ofo_account(s);
 	return n;
 }
 
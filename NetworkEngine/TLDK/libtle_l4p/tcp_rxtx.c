@@ -35,6 +35,13 @@
 
 #define	TCP_MAX_PKT_SEG	0x20
 
+/*
+ * QZ: largest payload of a packet that is handed to the NIC whole
+ * for TCP segmentation offload, so that its IP total length fits.
+ */
+#define	TCP_TSO_MAX_PLEN	\
+	(UINT16_MAX - sizeof(struct rte_ipv6_hdr) - TCP_TX_HDR_MAX)
+
 /*
  * checks if input TCP ports and IP addresses match given stream.
  * returns zero on success.
@@ -383,9 +390,33 @@ tx_data_pkts(struct tle_tcp_stream *s, struct rte_mbuf *const m[], uint32_t num)
 	return i;
 }
 
+/*
+ * QZ: largest payload a packet queued by the user can carry unsegmented:
+ * the MSS, or TCP_TSO_MAX_PLEN if the device does TCP segmentation.
+ */
 static inline uint32_t
-tx_data_bulk(struct tle_tcp_stream *s, union seqlen *sl, struct rte_mbuf *mi[],
-	uint32_t num)
+tcp_tx_max_plen(const struct tle_tcp_stream *s, uint32_t mss)
+{
+	if ((s->tx.dst.dev->prm.tx_offload & DEV_TX_OFFLOAD_TCP_TSO) != 0)
+		return TCP_TSO_MAX_PLEN;
+	return mss;
+}
+
+/*
+ * QZ: ask the NIC to cut a filled packet larger than the MSS into segments.
+ */
+static inline void
+tcp_tx_mark_tso(struct rte_mbuf *m, uint32_t mss)
+{
+	if (PKT_L4_PLEN(m) > mss) {
+		m->ol_flags |= PKT_TX_TCP_SEG;
+		m->tso_segsz = mss;
+	}
+}
+
+static inline uint32_t
+tx_data_bulk(struct tle_tcp_stream *s, union seqlen *sl, uint32_t *rwnd,
+	struct rte_mbuf *mi[], uint32_t num)
 {
 	uint32_t fail, i, k, n, mss, pid, plen, sz, tn, type;
 	struct tle_dev *dev;
@@ -407,19 +438,26 @@ tx_data_bulk(struct tle_tcp_stream *s, union seqlen *sl, struct rte_mbuf *mi[],
 		sz = RTE_MIN(sl->len, mss);
 		plen = PKT_L4_PLEN(mb);
 
-		/*fast path, no need to use indirect mbufs. */
-		if (plen <= sz) {
+		/*
+		 * fast path, no need to use indirect mbufs.
+		 * QZ: a TSO packet goes once a full MSS of the window is
+		 * open and the peer can take all of it, so that cwnd is
+		 * exceeded by less than one packet.
+		 */
+		if (plen <= sz || ((mb->ol_flags & PKT_TX_TCP_SEG) != 0 &&
+				sz == mss && plen <= *rwnd)) {
 
 			/* update pkt TCP header */
 			tcp_update_mbuf(mb, type, &s->tcb, sl->seq, pid + i);
 
 			/* keep mbuf till ACK is received. */
 			rte_pktmbuf_refcnt_update(mb, 1);
-			sl->len -= plen;
+			sl->len -= RTE_MIN(plen, sl->len);
 			sl->seq += plen;
+			*rwnd -= plen;
 			mo[k++] = mb;
 		/* remaining snd.wnd is less them MSS, send nothing */
-		} else if (sz < mss)
+		} else if (sz < mss || (mb->ol_flags & PKT_TX_TCP_SEG) != 0)
 			break;
 		/* packet indirection needed */
 		else
@@ -480,7 +518,7 @@ tx_nxt_data(struct tle_tcp_stream *s, uint32_t tms)
 			break;
 
 		/* queue data packets for TX */
-		n = tx_data_bulk(s, &sl, mi, num);
+		n = tx_data_bulk(s, &sl, &wnd, mi, num);
 		tn += n;
 
 		/* update consumer head */
@@ -542,11 +580,12 @@ calc_smss(uint16_t mss, const struct tle_dest *dst)
 
 	n = dst->mtu - dst->l2_len - dst->l3_len - TCP_TX_HDR_DACK;
 	//
-	// QZ: fix MSS with header len calculation
+	// QZ: fix MSS with header len calculation;
+	// the MSS the peer announced, if any, caps the one of the MTU
 	//
 	//
-	// mss = RTE_MIN(n, mss);
-	// return mss;
+	if (mss != 0 && mss < n)
+		return mss;
 	return n;
 }
 
@@ -915,9 +954,9 @@ accept_prep_stream(struct tle_tcp_stream *ps, struct stbl *st,
 	 */
 	if (cs->tcb.so.ts.ecr) {
 		rtt = tms - cs->tcb.so.ts.ecr;
-		rto_estimate(&cs->tcb, rtt);
+		rto_estimate(&cs->tcb, rtt, cs->s.ctx);
 	} else
-		cs->tcb.snd.rto = TCP_RTO_DEFAULT;
+		cs->tcb.snd.rto = rto_roundup(TCP_RTO_DEFAULT, cs->s.ctx);
 
 	/* copy streams type & flags. */
 	cs->s.type = ps->s.type;
@@ -1410,6 +1449,9 @@ start_fast_retransmit(struct tle_tcp_stream *s)
 	tcp_txq_rst_nxt_head(s);
 	tcb->snd.nxt = tcb->snd.una;
 	tcb->snd.cwnd = tcb->snd.ssthresh + 3 * tcb->snd.mss;
+
+	// QZ: count fast retransmits for the stats of the context
+	s->s.ctx->stat.fast_retx++;
 }
 
 static inline void
@@ -1569,7 +1611,7 @@ rx_process_ack(struct tle_tcp_stream *s, uint32_t ts,
 
 	/* update rto, if fresh packet is here then calculate rtt */
 	if (tack->ts.ecr != 0)
-		rto_estimate(&s->tcb, ts - tack->ts.ecr);
+		rto_estimate(&s->tcb, ts - tack->ts.ecr, s->s.ctx);
 }
 
 /*
@@ -1626,7 +1668,7 @@ rx_synack(struct tle_tcp_stream *s, uint32_t ts, uint32_t state,
 	s->tcb.rcv.wnd = calc_rx_wnd(s, s->tcb.rcv.wscale);
 
 	/* calculate initial rto */
-	rto_estimate(&s->tcb, ts - s->tcb.snd.ts);
+	rto_estimate(&s->tcb, ts - s->tcb.snd.ts, s->s.ctx);
 
 	rsp->flags |= TCP_FLAG_ACK;
 
@@ -2139,7 +2181,7 @@ tx_syn(struct tle_tcp_stream *s, const struct sockaddr *addr)
 	s->tcb.snd.rcvr = seq;
 	s->tcb.snd.una = seq;
 	s->tcb.snd.nxt = seq + 1;
-	s->tcb.snd.rto = TCP_RTO_DEFAULT;
+	s->tcb.snd.rto = rto_roundup(TCP_RTO_DEFAULT, s->s.ctx);
 	s->tcb.snd.ts = tms;
 
 	s->tcb.rcv.mss = s->tcb.so.mss;
@@ -2315,7 +2357,7 @@ tx_segments(struct tle_tcp_stream *s, uint64_t ol_flags,
 uint16_t
 tle_tcp_stream_send(struct tle_stream *ts, struct rte_mbuf *pkt[], uint16_t num)
 {
-	uint32_t i, j, k, mss, n, state;
+	uint32_t i, j, k, max_plen, mss, n, state;
 	int32_t rc;
 	uint64_t ol_flags;
 	struct tle_tcp_stream *s;
@@ -2337,6 +2379,7 @@ tle_tcp_stream_send(struct tle_stream *ts, struct rte_mbuf *pkt[], uint16_t num)
 	}
 
 	mss = s->tcb.snd.mss;
+	max_plen = tcp_tx_max_plen(s, mss);
 	ol_flags = s->tx.dst.ol_flags;
 
 	k = 0;
@@ -2344,13 +2387,14 @@ tle_tcp_stream_send(struct tle_stream *ts, struct rte_mbuf *pkt[], uint16_t num)
 	while (k != num) {
 		/* prepare and check for TX */
 		for (i = k; i != num; i++) {
-			if (pkt[i]->pkt_len > mss ||
+			if (pkt[i]->pkt_len > max_plen ||
 					pkt[i]->nb_segs > TCP_MAX_PKT_SEG)
 				break;
 			rc = tcp_fill_mbuf(pkt[i], s, &s->tx.dst, ol_flags,
 				s->s.port, 0, TCP_FLAG_ACK, 0, 0);
 			if (rc != 0)
 				break;
+			tcp_tx_mark_tso(pkt[i], mss);
 		}
 
 		if (i != k) {
@@ -2364,7 +2408,7 @@ tle_tcp_stream_send(struct tle_stream *ts, struct rte_mbuf *pkt[], uint16_t num)
 			 * remove pkt l2/l3 headers, restore ol_flags
 			 */
 			if (i != k) {
-				ol_flags = ~s->tx.dst.ol_flags;
+				ol_flags = ~(s->tx.dst.ol_flags | PKT_TX_TCP_SEG);
 				for (j = k; j != i; j++) {
 					rte_pktmbuf_adj(pkt[j], pkt[j]->l2_len +
 						pkt[j]->l3_len +
@@ -2416,7 +2460,7 @@ tle_tcp_stream_send(struct tle_stream *ts, struct rte_mbuf *pkt[], uint16_t num)
 uint16_t
 tle_tcp_stream_send_no_free(struct tle_stream *ts, struct rte_mbuf *pkt[], uint16_t num)
 {
-	uint32_t i, j, k, mss, n, state;
+	uint32_t i, j, k, max_plen, mss, n, state;
 	int32_t rc;
 	uint64_t ol_flags;
 	struct tle_tcp_stream *s;
@@ -2438,6 +2482,7 @@ tle_tcp_stream_send_no_free(struct tle_stream *ts, struct rte_mbuf *pkt[], uint1
 	}
 
 	mss = s->tcb.snd.mss;
+	max_plen = tcp_tx_max_plen(s, mss);
 	ol_flags = s->tx.dst.ol_flags;
 
 	k = 0;
@@ -2445,13 +2490,14 @@ tle_tcp_stream_send_no_free(struct tle_stream *ts, struct rte_mbuf *pkt[], uint1
 	while (k != num) {
 		/* prepare and check for TX */
 		for (i = k; i != num; i++) {
-			if (pkt[i]->pkt_len > mss ||
+			if (pkt[i]->pkt_len > max_plen ||
 					pkt[i]->nb_segs > TCP_MAX_PKT_SEG)
 				break;
 			rc = tcp_fill_mbuf(pkt[i], s, &s->tx.dst, ol_flags,
 				s->s.port, 0, TCP_FLAG_ACK, 0, 0);
 			if (rc != 0)
 				break;
+			tcp_tx_mark_tso(pkt[i], mss);
 		}
 
 		if (i != k) {
@@ -2465,7 +2511,7 @@ tle_tcp_stream_send_no_free(struct tle_stream *ts, struct rte_mbuf *pkt[], uint1
 			 * remove pkt l2/l3 headers, restore ol_flags
 			 */
 			if (i != k) {
-				ol_flags = ~s->tx.dst.ol_flags;
+				ol_flags = ~(s->tx.dst.ol_flags | PKT_TX_TCP_SEG);
 				for (j = k; j != i; j++) {
 					rte_pktmbuf_adj(pkt[j], pkt[j]->l2_len +
 						pkt[j]->l3_len +
@@ -2684,6 +2730,9 @@ rto_stream(struct tle_tcp_stream *s, uint32_t tms)
 
 	if (s->tcb.snd.nb_retx < s->tcb.snd.nb_retm) {
 
+		// QZ: count retransmission timeouts for the stats of the context
+		s->s.ctx->stat.rto_retx++;
+
 		if (state >= TCP_ST_ESTABLISHED && state <= TCP_ST_LAST_ACK) {
 
 			/* update SND.CWD and SND.SSTHRESH */
@@ -2721,7 +2770,7 @@ rto_stream(struct tle_tcp_stream *s, uint32_t tms)
 		}
 
 		/* RFC6298:5.5 back off the timer */
-		s->tcb.snd.rto = rto_roundup(2 * s->tcb.snd.rto);
+		s->tcb.snd.rto = rto_roundup(2 * s->tcb.snd.rto, s->s.ctx);
 		s->tcb.snd.nb_retx++;
 		timer_restart(s);
 
@@ -188,7 +188,7 @@ alloc_timers(const struct tle_ctx *ctx)
 	struct tle_timer_wheel *twl;
 	struct tle_timer_wheel_args twprm;
 
-	twprm.tick_size = TCP_RTO_GRANULARITY;
+	twprm.tick_size = ctx->prm.timer_tick;
 	twprm.max_timer = ctx->prm.max_streams;
 	twprm.socket_id = ctx->prm.socket_id;
 
@@ -278,6 +278,16 @@ tcp_init_streams(struct tle_ctx *ctx)
 	f = ((ctx->prm.flags & TLE_CTX_FLAG_ST) == 0) ? 0 :
 		(RING_F_SP_ENQ |  RING_F_SC_DEQ);
 
+	/* QZ: fill in the default timer parameters */
+	if (ctx->prm.rto_min == 0)
+		ctx->prm.rto_min = TCP_RTO_MIN;
+	if (ctx->prm.rto_max == 0)
+		ctx->prm.rto_max = TCP_RTO_MAX;
+	if (ctx->prm.timer_tick == 0)
+		ctx->prm.timer_tick = TCP_RTO_GRANULARITY;
+	if (ctx->prm.rto_min > ctx->prm.rto_max)
+		return -EINVAL;
+
 	calc_stream_szofs(ctx, &szofs);
 	TCP_LOG(NOTICE, "ctx:%p, caluclated stream size: %u\n",
 		ctx, szofs.size);
@@ -81,11 +81,15 @@ timer_reset(struct tle_tcp_stream *s)
 	timer_start(s);
 }
 
+/*
+ * QZ: the RTO bounds and granularity come from the context parameters,
+ * with the defaults above filled in by tcp_init_streams().
+ */
 static inline uint32_t
-rto_roundup(uint32_t rto)
+rto_roundup(uint32_t rto, const struct tle_ctx *ctx)
 {
-	rto = RTE_MAX(rto, TCP_RTO_MIN);
-	rto = RTE_MIN(rto, TCP_RTO_MAX);
+	rto = RTE_MAX(rto, ctx->prm.rto_min);
+	rto = RTE_MIN(rto, ctx->prm.rto_max);
 	return rto;
 }
 
@@ -98,7 +102,7 @@ rto_roundup(uint32_t rto)
  * in the RFC6298
 */
 static inline void
-rto_estimate(struct tcb *tcb, int32_t rtt)
+rto_estimate(struct tcb *tcb, int32_t rtt, const struct tle_ctx *ctx)
 {
 	uint32_t rto;
 
@@ -119,8 +123,8 @@ rto_estimate(struct tcb *tcb, int32_t rtt)
 	}
 
 	rto = (tcb->rcv.srtt >> 3) +
-		RTE_MAX(TCP_RTO_GRANULARITY, tcb->rcv.rttvar);
-	tcb->snd.rto = rto_roundup(rto);
+		RTE_MAX(ctx->prm.timer_tick, tcb->rcv.rttvar);
+	tcb->snd.rto = rto_roundup(rto, ctx);
 }
 
 #ifdef __cplusplus
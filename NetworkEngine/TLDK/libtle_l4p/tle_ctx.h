@@ -149,6 +149,29 @@ struct tle_ctx_param {
 	uint32_t timewait;
 	/**< TCP TIME_WAIT state timeout duration in milliseconds,
 	 * default 2MSL, if UINT32_MAX */
+	uint32_t rto_min; /**< min TCP RTO in ms, default if 0. */
+	uint32_t rto_max; /**< max TCP RTO in ms, default if 0. */
+	uint32_t timer_tick;
+	/**< TCP timer wheel tick and RTO granularity in ms, default if 0. */
+	uint32_t ofo_stream_bytes;
+	/**< QZ: max out-of-order bytes a stream holds, unlimited if 0. */
+	uint64_t ofo_ctx_bytes;
+	/**< QZ: max out-of-order bytes the streams of the context hold,
+	 * unlimited if 0. */
+};
+
+/**
+ * QZ: retransmission and out-of-order counters of a context, updated by
+ * the lcore that runs it, so a reader on another lcore sees them slightly
+ * behind.
+ */
+struct tle_ctx_stat {
+	uint64_t rto_retx;   /**< RTO expirations that resent data. */
+	uint64_t fast_retx;  /**< fast retransmits entered. */
+	uint64_t ofo_bytes;  /**< out-of-order bytes held now. */
+	uint64_t ofo_drops;  /**< out-of-order packets dropped at the limits. */
+	uint64_t ofo_evicts;
+	/**< held out-of-order packets dropped for ones nearer rcv.nxt. */
 };
 
 /**
@@ -179,6 +202,18 @@ tle_ctx_create(const struct tle_ctx_param *ctx_prm);
  */
 void tle_ctx_destroy(struct tle_ctx *ctx);
 
+/**
+ * QZ: get the retransmission and out-of-order counters of the given context.
+ *
+ * @param ctx
+ *   context to read the counters of.
+ * @param stat
+ *   where the counters are copied.
+ * @return
+ *   zero on successful completion, -EINVAL on invalid parameter.
+ */
+int tle_ctx_get_stat(const struct tle_ctx *ctx, struct tle_ctx_stat *stat);
+
 /**
  * Add new device into the given context.
  * This function is not multi-thread safe.
@@ -7,30 +7,55 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "BackEndTypes.h"
 
 #define MAX_OFFLOAD_READ_SIZE 16384
 
+//
+// A message is handed to the offload predicate as the segments it was received in, at most OFFLOAD_PRED_MAX_SEGS
+//
+//
+#define OFFLOAD_PRED_MAX_SEGS 16
+#define OFFLOAD_PRED_STATE_BYTES 64
+
 typedef struct {
     uint16_t Offset;
     uint16_t Bytes;
 } RequestDescriptorT;
 
+//
+// What the offload predicate keeps of a stream from one message to the next,
+// e.g. how much of a request that continues into the next message is left;
+// opaque to the engine, which zeroes it when the stream opens
+//
+//
+typedef struct {
+    uint64_t Words[OFFLOAD_PRED_STATE_BYTES / sizeof(uint64_t)];
+} OffloadPredStateT;
+
 typedef struct {
     OffloadWorkRequest ReadReq;
     OffloadWorkResponse ReadResp;
 #if OFFLOAD_ENGINE_ZERO_COPY == OFFLOAD_ENGINE_ZERO_COPY_NONE
     char RespBuf[MAX_OFFLOAD_READ_SIZE];
+#else
+    void* RespBuf;  // the read buffers (rte_mbuf) the data is read into and sent from
+#endif
 #ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
     uint16_t ReqSize;
-#endif
-#else
-    void* RespBuf;
+    char* Record;  // the record of an offload response ring a read for the host is delivered in, or NULL
+    uint64_t RecordEnd;
 #endif
 #ifdef OFFLOAD_ENGINE_ALLOW_NONALIGNED_IO
     FileSizeT OffsetAlignment;
     FileIOSizeT BytesAlignment;
+#endif
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    bool Cached;  // the response was built from the response cache, and nothing is read
+    bool KeepResp;  // the response is to be kept in the response cache, at RespVersion
+    uint32_t RespVersion;
 #endif
     ContextT StreamCtxt;
 } ReadOpDescriptorT;
@@ -10,19 +10,25 @@
 
 #define OFFLOAD_PRED_NAME "OffloadPred"
 #define OFFLOAD_FUNC_NAME "OffloadFunc"
+#define OFFLOAD_SCAN_NAME "OffloadScan"
 
 enum OffloadType {
     OFFLOAD_PRED,
-    OFFLOAD_FUNC
+    OFFLOAD_FUNC,
+    OFFLOAD_SCAN
 };
 
 //
-// The type of offload predicate
-// 
+// The type of offload predicate: it splits the Bytes of a message in NumSegs segments into the requests
+// for the host and those the DPU serves, in one call, and follows the stream across messages in State;
+// every byte of the stream goes through the predicate in order, and a reloaded predicate takes over the states
+//
 //
 typedef void (*OffloadPred)(
-    void* Msg,
+    const struct iovec* Segs,
+    uint16_t NumSegs,
     uint16_t Bytes,
+    OffloadPredStateT* State,
     CacheTableT* CacheTable,
     RequestDescriptorT* ReqsForHost,
     RequestDescriptorT* ReqsForDPU,
@@ -31,9 +37,14 @@ typedef void (*OffloadPred)(
 );
 
 //
-// The type of offload function
-// 
+// The type of offload function: Msg + Req->Offset is the request, contiguous;
+// it fills in the read of the request, or reads nothing for the host to serve it;
+// with OFFLOAD_FUNC_READ_FOR_HOST in RequestId, the DPU only reads part of what the request needs,
+// and the request goes to the host with that data through the offload response rings instead of being answered
 //
+//
+#define OFFLOAD_FUNC_READ_FOR_HOST 0x8000
+
 typedef void (*OffloadFunc)(
     void* Msg,
     RequestDescriptorT* Req,
@@ -42,23 +53,37 @@ typedef void (*OffloadFunc)(
 );
 
 //
-// Compile either the offload predicate or the offload function
+// The type of scan function, which the storage engine runs on the records of a file a scan reads:
+// it writes what it keeps of the record of RecordBytes at Record to Out, at most RecordBytes,
+// and returns the bytes written, or 0 to drop the record
+//
+//
+typedef FileIOSizeT (*OffloadScan)(
+    const void* Record,
+    FileIOSizeT RecordBytes,
+    void* Out
+);
+
+//
+// Compile a version of a UDF
 //
 //
 bool
 CompileUDF(
     const char *CodePath,
-    enum OffloadType Type
+    enum OffloadType Type,
+    uint32_t Version
 );
 
 //
-// Load the library that implements a UDF
+// Load the library that implements a version of a UDF
 //
 //
 void*
 LoadLibrary(
     const char *CodePath,
-    enum OffloadType Type
+    enum OffloadType Type,
+    uint32_t Version
 );
 
 //
@@ -79,6 +104,15 @@ GetOffloadFunc(
     void *Lib
 );
 
+//
+// Get the scan function
+//
+//
+OffloadScan
+GetOffloadScan(
+    void *Lib
+);
+
 //
 // Unload a library
 //
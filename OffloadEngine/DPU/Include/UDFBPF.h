@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include "UDF.h"
+
+//
+// Offload predicates and functions in eBPF bytecode, run by uBPF (OFFLOAD_ENGINE_UDF_BPF) instead of loaded with dlopen:
+// OffloadPred.bpf and OffloadFunc.bpf in the UDF path are the .text of objects built with clang -target bpf, e.g.
+//   clang -O2 -target bpf -c OffloadPred.c -o OffloadPred.o && llvm-objcopy -O binary -j .text OffloadPred.o OffloadPred.bpf
+// Bytecode is verified before it is loaded: it jumps only forward, so that every run ends, and calls only the helpers;
+// it runs on a context of its own and reaches the message and the cache table through the helpers only.
+// The interpreter checks every memory access of a run; with OFFLOAD_ENGINE_UDF_BPF_JIT, bytecode is compiled instead,
+// which is faster but doesn't check memory accesses, so it is only for trusted UDFs
+//
+//
+#define OFFLOAD_BPF_SUFFIX "bpf"
+#define OFFLOAD_BPF_MAX_INSTS 4096
+#define OFFLOAD_BPF_MAX_REQS 64
+#define OFFLOAD_BPF_SCRATCH_BYTES 256
+
+//
+// The helpers, which return 0 if they fail:
+// ReadMsg(Offset, Bytes, To) copies bytes of the message, or of the request for the offload function, to To,
+// and LookUp(Key, To) copies the item of a key in the cache table to To; To must be in the context
+//
+//
+#define OFFLOAD_BPF_HELPER_READ_MSG 1
+#define OFFLOAD_BPF_HELPER_LOOK_UP 2
+
+//
+// The context an offload predicate runs on: it splits the Bytes of the message into requests as OffloadPred does
+//
+//
+typedef struct {
+    uint16_t Bytes;
+    uint16_t NumReqsForHost;
+    uint16_t NumReqsForDPU;
+    uint16_t Reserved;
+    OffloadPredStateT State;
+    RequestDescriptorT ReqsForHost[OFFLOAD_BPF_MAX_REQS];
+    RequestDescriptorT ReqsForDPU[OFFLOAD_BPF_MAX_REQS];
+    uint8_t Scratch[OFFLOAD_BPF_SCRATCH_BYTES];
+} OffloadPredBPFContextT;
+
+//
+// The context an offload function runs on: it fills in the read of the request of ReqBytes as OffloadFunc does
+//
+//
+typedef struct {
+    uint16_t ReqBytes;
+    uint16_t Reserved[3];
+    OffloadWorkRequest ReadOp;
+    uint8_t Scratch[OFFLOAD_BPF_SCRATCH_BYTES];
+} OffloadFuncBPFContextT;
+
+typedef struct OffloadBPFProgram OffloadBPFProgramT;
+
+//
+// Check if the UDF path has the bytecode of a UDF
+//
+//
+bool
+HasBPFUDF(
+    const char *CodePath,
+    enum OffloadType Type
+);
+
+//
+// Verify and load the bytecode of a UDF
+//
+//
+OffloadBPFProgramT*
+LoadBPFUDF(
+    const char *CodePath,
+    enum OffloadType Type
+);
+
+//
+// Unload the bytecode of a UDF
+//
+//
+void
+UnloadBPFUDF(
+    OffloadBPFProgramT *Prog
+);
+
+//
+// Run an offload predicate in bytecode, with the arguments of OffloadPred;
+// if the run fails, the message goes to the host
+//
+//
+void
+RunBPFOffloadPred(
+    OffloadBPFProgramT *Prog,
+    const struct iovec* Segs,
+    uint16_t NumSegs,
+    uint16_t Bytes,
+    OffloadPredStateT* State,
+    CacheTableT* CacheTable,
+    RequestDescriptorT* ReqsForHost,
+    RequestDescriptorT* ReqsForDPU,
+    uint16_t* NumReqsForHost,
+    uint16_t* NumReqsForDPU
+);
+
+//
+// Run an offload function in bytecode, with the arguments of OffloadFunc;
+// if the run fails, nothing is read and the request goes to the host
+//
+//
+void
+RunBPFOffloadFunc(
+    OffloadBPFProgramT *Prog,
+    void* Msg,
+    RequestDescriptorT* Req,
+    CacheTableT* CacheTable,
+    OffloadWorkRequest* ReadOp
+);
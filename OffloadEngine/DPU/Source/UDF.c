@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "UDF.h"
+
+//
+// UDFs are compiled against the same headers as the engine, so that they see the same cache table layout;
+// the include paths are relative to Main, where the engine runs
+//
+//
+#define UDF_COMPILER "gcc"
+#define UDF_COMPILER_FLAGS "-O3 -fPIC -shared -flax-vector-conversions"
+#define UDF_INCLUDE_FLAGS "-I../Common/Include -I../Common/Include/DPU -I../OffloadEngine/DPU/Include"
+#define UDF_PATH_LENGTH 256
+#define UDF_COMMAND_LENGTH 1024
+
+//
+// The name of the code and the library of a UDF
+//
+//
+static const char*
+UDFName(
+    enum OffloadType Type
+) {
+    switch (Type) {
+        case OFFLOAD_PRED:
+            return OFFLOAD_PRED_NAME;
+        case OFFLOAD_FUNC:
+            return OFFLOAD_FUNC_NAME;
+        default:
+            return OFFLOAD_SCAN_NAME;
+    }
+}
+
+//
+// Compile a UDF;
+// every version is a library of its own, since dlopen doesn't load a path it has loaded again
+//
+//
+bool
+CompileUDF(
+    const char *CodePath,
+    enum OffloadType Type,
+    uint32_t Version
+) {
+    char command[UDF_COMMAND_LENGTH];
+    int ret;
+
+    ret = snprintf(command, sizeof(command), "%s %s %s -o %s/%s.%u.so %s/%s.c",
+        UDF_COMPILER, UDF_COMPILER_FLAGS, UDF_INCLUDE_FLAGS, CodePath, UDFName(Type), Version, CodePath, UDFName(Type));
+    if (ret < 0 || ret >= sizeof(command)) {
+        fprintf(stderr, "%s [error]: UDF path %s is too long\n", __func__, CodePath);
+        return false;
+    }
+
+    ret = system(command);
+    if (ret != 0) {
+        fprintf(stderr, "%s [error]: \"%s\" returned %d\n", __func__, command, ret);
+        return false;
+    }
+
+    return true;
+}
+
+//
+// Load the library that implements a version of a UDF;
+// the file is removed once it is loaded, as it stays mapped until the library is unloaded
+//
+//
+void*
+LoadLibrary(
+    const char *CodePath,
+    enum OffloadType Type,
+    uint32_t Version
+) {
+    char path[UDF_PATH_LENGTH];
+    void *lib;
+    int ret;
+
+    ret = snprintf(path, sizeof(path), "%s/%s.%u.so", CodePath, UDFName(Type), Version);
+    if (ret < 0 || ret >= sizeof(path)) {
+        fprintf(stderr, "%s [error]: UDF path %s is too long\n", __func__, CodePath);
+        return NULL;
+    }
+
+    //
+    // The UDFs call the cache table of the engine, which is linked with -rdynamic
+    //
+    //
+    lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        fprintf(stderr, "%s [error]: dlopen(%s) failed: %s\n", __func__, path, dlerror());
+    }
+    unlink(path);
+
+    return lib;
+}
+
+//
+// Get the offload predicate
+//
+//
+OffloadPred
+GetOffloadPred(
+    void *Lib
+) {
+    OffloadPred pred = (OffloadPred)dlsym(Lib, OFFLOAD_PRED_NAME);
+    if (pred == NULL) {
+        fprintf(stderr, "%s [error]: %s not found: %s\n", __func__, OFFLOAD_PRED_NAME, dlerror());
+    }
+
+    return pred;
+}
+
+//
+// Get the offload function
+//
+//
+OffloadFunc
+GetOffloadFunc(
+    void *Lib
+) {
+    OffloadFunc func = (OffloadFunc)dlsym(Lib, OFFLOAD_FUNC_NAME);
+    if (func == NULL) {
+        fprintf(stderr, "%s [error]: %s not found: %s\n", __func__, OFFLOAD_FUNC_NAME, dlerror());
+    }
+
+    return func;
+}
+
+//
+// Get the scan function
+//
+//
+OffloadScan
+GetOffloadScan(
+    void *Lib
+) {
+    OffloadScan scan = (OffloadScan)dlsym(Lib, OFFLOAD_SCAN_NAME);
+    if (scan == NULL) {
+        fprintf(stderr, "%s [error]: %s not found: %s\n", __func__, OFFLOAD_SCAN_NAME, dlerror());
+    }
+
+    return scan;
+}
+
+//
+// Unload a library
+//
+//
+void
+UnloadLibrary(
+    void *Lib
+) {
+    dlclose(Lib);
+}
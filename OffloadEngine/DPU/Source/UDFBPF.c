@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ubpf.h>
+
+#include "UDFBPF.h"
+
+#define UDF_PATH_LENGTH 256
+
+//
+// eBPF instructions and the opcodes the verifier looks at
+//
+//
+typedef struct {
+    uint8_t Opcode;
+    uint8_t Regs;
+    int16_t Offset;
+    int32_t Imm;
+} BPFInstT;
+
+#define BPF_CLASS_MASK 0x07
+#define BPF_CLASS_JMP 0x05
+#define BPF_CLASS_JMP32 0x06
+#define BPF_OP_MASK 0xf0
+#define BPF_OP_CALL 0x80
+#define BPF_OP_EXIT 0x90
+#define BPF_OPCODE_LDDW 0x18
+#define BPF_OPCODE_EXIT 0x95
+
+struct OffloadBPFProgram {
+    struct ubpf_vm *Vm;
+    ubpf_jit_fn Jit;
+};
+
+//
+// What the helpers of a run see: the message, the cache table and the context of the run
+//
+//
+static __thread struct {
+    const struct iovec *Segs;
+    uint16_t NumSegs;
+    uint32_t Bytes;
+    CacheTableT *CacheTable;
+    uint8_t *Ctx;
+    size_t CtxBytes;
+} BPFRun;
+
+//
+// The path of the bytecode of a UDF
+//
+//
+static bool
+BPFUDFPath(
+    const char *CodePath,
+    enum OffloadType Type,
+    char *Path
+) {
+    int ret = snprintf(Path, UDF_PATH_LENGTH, "%s/%s.%s", CodePath,
+        Type == OFFLOAD_PRED ? OFFLOAD_PRED_NAME : OFFLOAD_FUNC_NAME, OFFLOAD_BPF_SUFFIX);
+    return ret > 0 && ret < UDF_PATH_LENGTH;
+}
+
+//
+// Check that To..To+Bytes is in the context of the run
+//
+//
+static inline bool
+InBPFContext(
+    uint64_t To,
+    uint64_t Bytes
+) {
+    uintptr_t ctx = (uintptr_t)BPFRun.Ctx;
+    return To >= ctx && Bytes <= BPFRun.CtxBytes && To - ctx <= BPFRun.CtxBytes - Bytes;
+}
+
+//
+// ReadMsg(Offset, Bytes, To)
+//
+//
+static uint64_t
+BPFHelperReadMsg(
+    uint64_t Offset,
+    uint64_t Bytes,
+    uint64_t To,
+    uint64_t Unused1,
+    uint64_t Unused2
+) {
+    uint8_t *to = (uint8_t*)(uintptr_t)To;
+    uint32_t segStart = 0;
+    uint64_t inSeg, bytes;
+    uint16_t seg;
+
+    if (Offset > BPFRun.Bytes || Bytes > BPFRun.Bytes - Offset || !InBPFContext(To, Bytes)) {
+        return 0;
+    }
+
+    for (seg = 0; Bytes != 0 && seg != BPFRun.NumSegs; segStart += BPFRun.Segs[seg].iov_len, seg++) {
+        if (Offset >= segStart + BPFRun.Segs[seg].iov_len) {
+            continue;
+        }
+
+        inSeg = Offset - segStart;
+        bytes = BPFRun.Segs[seg].iov_len - inSeg < Bytes ? BPFRun.Segs[seg].iov_len - inSeg : Bytes;
+        memcpy(to, (uint8_t*)BPFRun.Segs[seg].iov_base + inSeg, bytes);
+        to += bytes;
+        Offset += bytes;
+        Bytes -= bytes;
+    }
+
+    return 1;
+}
+
+//
+// LookUp(Key, To)
+//
+//
+static uint64_t
+BPFHelperLookUp(
+    uint64_t Key,
+    uint64_t To,
+    uint64_t Unused1,
+    uint64_t Unused2,
+    uint64_t Unused3
+) {
+    KeyT key = (KeyT)Key;
+    CacheItemT item;
+
+    if (!InBPFContext(To, sizeof(CacheItemT)) || !LookUpCacheTable(BPFRun.CacheTable, &key, &item)) {
+        return 0;
+    }
+
+    memcpy((void*)(uintptr_t)To, &item, sizeof(CacheItemT));
+    return 1;
+}
+
+//
+// Verify bytecode: every jump goes forward, every call is to a helper, and the last instruction exits;
+// so a run executes each instruction at most once
+//
+//
+static bool
+VerifyBPF(
+    const BPFInstT *Insts,
+    uint32_t NumInsts
+) {
+    uint8_t cls, op;
+
+    if (NumInsts == 0 || NumInsts > OFFLOAD_BPF_MAX_INSTS || Insts[NumInsts - 1].Opcode != BPF_OPCODE_EXIT) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i != NumInsts; i++) {
+        if (Insts[i].Opcode == BPF_OPCODE_LDDW) {
+            i++;
+            continue;
+        }
+
+        cls = Insts[i].Opcode & BPF_CLASS_MASK;
+        if (cls != BPF_CLASS_JMP && cls != BPF_CLASS_JMP32) {
+            continue;
+        }
+
+        op = Insts[i].Opcode & BPF_OP_MASK;
+        if (op == BPF_OP_EXIT) {
+            continue;
+        }
+        if (op == BPF_OP_CALL) {
+            if (Insts[i].Regs != 0 ||
+                (Insts[i].Imm != OFFLOAD_BPF_HELPER_READ_MSG && Insts[i].Imm != OFFLOAD_BPF_HELPER_LOOK_UP)) {
+                return false;
+            }
+            continue;
+        }
+        if (Insts[i].Offset < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Check if the UDF path has the bytecode of a UDF
+//
+//
+bool
+HasBPFUDF(
+    const char *CodePath,
+    enum OffloadType Type
+) {
+    char path[UDF_PATH_LENGTH];
+    return BPFUDFPath(CodePath, Type, path) && access(path, R_OK) == 0;
+}
+
+//
+// Verify and load the bytecode of a UDF
+//
+//
+OffloadBPFProgramT*
+LoadBPFUDF(
+    const char *CodePath,
+    enum OffloadType Type
+) {
+    char path[UDF_PATH_LENGTH];
+    OffloadBPFProgramT *prog = NULL;
+    BPFInstT *code = NULL;
+    char *errMsg = NULL;
+    FILE *file;
+    long bytes;
+
+    if (!BPFUDFPath(CodePath, Type, path)) {
+        fprintf(stderr, "%s [error]: UDF path %s is too long\n", __func__, CodePath);
+        return NULL;
+    }
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "%s [error]: failed to open %s\n", __func__, path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    bytes = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (bytes <= 0 || bytes % sizeof(BPFInstT) || (size_t)bytes > OFFLOAD_BPF_MAX_INSTS * sizeof(BPFInstT)) {
+        fprintf(stderr, "%s [error]: %s is not bytecode of at most %d instructions\n",
+            __func__, path, OFFLOAD_BPF_MAX_INSTS);
+        goto Fail;
+    }
+
+    code = malloc(bytes);
+    if (code == NULL || fread(code, 1, bytes, file) != (size_t)bytes) {
+        fprintf(stderr, "%s [error]: failed to read %s\n", __func__, path);
+        goto Fail;
+    }
+
+    if (!VerifyBPF(code, (uint32_t)(bytes / sizeof(BPFInstT)))) {
+        fprintf(stderr, "%s [error]: %s has a backward jump, calls a function that isn't a helper, or doesn't exit\n",
+            __func__, path);
+        goto Fail;
+    }
+
+    prog = calloc(1, sizeof(OffloadBPFProgramT));
+    if (prog == NULL) {
+        goto Fail;
+    }
+    prog->Vm = ubpf_create();
+    if (prog->Vm == NULL) {
+        goto Fail;
+    }
+    ubpf_register(prog->Vm, OFFLOAD_BPF_HELPER_READ_MSG, "ReadMsg", BPFHelperReadMsg);
+    ubpf_register(prog->Vm, OFFLOAD_BPF_HELPER_LOOK_UP, "LookUp", BPFHelperLookUp);
+
+    if (ubpf_load(prog->Vm, code, (uint32_t)bytes, &errMsg) < 0) {
+        fprintf(stderr, "%s [error]: failed to load %s: %s\n", __func__, path, errMsg);
+        goto Fail;
+    }
+
+#ifdef OFFLOAD_ENGINE_UDF_BPF_JIT
+    prog->Jit = ubpf_compile(prog->Vm, &errMsg);
+    if (prog->Jit == NULL) {
+        fprintf(stderr, "%s [error]: failed to compile %s: %s\n", __func__, path, errMsg);
+        goto Fail;
+    }
+#endif
+
+    free(code);
+    fclose(file);
+    return prog;
+
+Fail:
+    free(errMsg);
+    if (prog != NULL) {
+        UnloadBPFUDF(prog);
+    }
+    free(code);
+    fclose(file);
+    return NULL;
+}
+
+//
+// Unload the bytecode of a UDF
+//
+//
+void
+UnloadBPFUDF(
+    OffloadBPFProgramT *Prog
+) {
+    if (Prog->Vm != NULL) {
+        ubpf_destroy(Prog->Vm);
+    }
+    free(Prog);
+}
+
+//
+// Run bytecode on a context; false if the run faulted
+//
+//
+static inline bool
+RunBPF(
+    OffloadBPFProgramT *Prog,
+    void *Ctx,
+    size_t CtxBytes
+) {
+    uint64_t ret;
+
+    BPFRun.Ctx = (uint8_t*)Ctx;
+    BPFRun.CtxBytes = CtxBytes;
+
+    if (Prog->Jit != NULL) {
+        Prog->Jit(Ctx, CtxBytes);
+        return true;
+    }
+
+    return ubpf_exec(Prog->Vm, Ctx, CtxBytes, &ret) == 0;
+}
+
+//
+// Run an offload predicate in bytecode
+//
+//
+void
+RunBPFOffloadPred(
+    OffloadBPFProgramT *Prog,
+    const struct iovec* Segs,
+    uint16_t NumSegs,
+    uint16_t Bytes,
+    OffloadPredStateT* State,
+    CacheTableT* CacheTable,
+    RequestDescriptorT* ReqsForHost,
+    RequestDescriptorT* ReqsForDPU,
+    uint16_t* NumReqsForHost,
+    uint16_t* NumReqsForDPU
+) {
+    OffloadPredBPFContextT ctx;
+
+    //
+    // A run sees nothing of the runs before it but the state of the stream
+    //
+    //
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.Bytes = Bytes;
+    ctx.State = *State;
+
+    BPFRun.Segs = Segs;
+    BPFRun.NumSegs = NumSegs;
+    BPFRun.Bytes = Bytes;
+    BPFRun.CacheTable = CacheTable;
+
+    if (!RunBPF(Prog, &ctx, sizeof(ctx)) ||
+        ctx.NumReqsForHost > OFFLOAD_BPF_MAX_REQS || ctx.NumReqsForDPU > OFFLOAD_BPF_MAX_REQS) {
+        ReqsForHost[0].Offset = 0;
+        ReqsForHost[0].Bytes = Bytes;
+        *NumReqsForHost = 1;
+        *NumReqsForDPU = 0;
+        return;
+    }
+
+    *State = ctx.State;
+    memcpy(ReqsForHost, ctx.ReqsForHost, ctx.NumReqsForHost * sizeof(RequestDescriptorT));
+    memcpy(ReqsForDPU, ctx.ReqsForDPU, ctx.NumReqsForDPU * sizeof(RequestDescriptorT));
+    *NumReqsForHost = ctx.NumReqsForHost;
+    *NumReqsForDPU = ctx.NumReqsForDPU;
+}
+
+//
+// Run an offload function in bytecode
+//
+//
+void
+RunBPFOffloadFunc(
+    OffloadBPFProgramT *Prog,
+    void* Msg,
+    RequestDescriptorT* Req,
+    CacheTableT* CacheTable,
+    OffloadWorkRequest* ReadOp
+) {
+    OffloadFuncBPFContextT ctx;
+    struct iovec seg;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.ReqBytes = Req->Bytes;
+
+    seg.iov_base = (char*)Msg + Req->Offset;
+    seg.iov_len = Req->Bytes;
+    BPFRun.Segs = &seg;
+    BPFRun.NumSegs = 1;
+    BPFRun.Bytes = Req->Bytes;
+    BPFRun.CacheTable = CacheTable;
+
+    if (!RunBPF(Prog, &ctx, sizeof(ctx))) {
+        ReadOp->Bytes = 0;
+        return;
+    }
+
+    ReadOp->RequestId = ctx.ReadOp.RequestId & OFFLOAD_FUNC_READ_FOR_HOST;
+    ReadOp->FileId = ctx.ReadOp.FileId;
+    ReadOp->Offset = ctx.ReadOp.Offset;
+    ReadOp->Bytes = ctx.ReadOp.Bytes;
+}
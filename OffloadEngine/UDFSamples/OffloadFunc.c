@@ -22,8 +22,17 @@ void OffloadFunc(
     OffloadWorkRequest* ReadOp
 )  {
     struct MessageHeader* msg = (struct MessageHeader*)(((char*)Msg) + Req->Offset);
-    CacheItemT* cacheItem = LookUpCacheTable(CacheTable, &msg->Key);
-    ReadOp->FileId = cacheItem->FileId;
-    ReadOp->Bytes = cacheItem->Size;
-    ReadOp->Offset = cacheItem->Offset;
+    CacheItemT cacheItem;
+
+    //
+    // The predicate found the key, but it may have been deleted since; then nothing is read
+    //
+    //
+    if (!LookUpCacheTable(CacheTable, &msg->Key, &cacheItem)) {
+        ReadOp->Bytes = 0;
+        return;
+    }
+    ReadOp->FileId = cacheItem.FileId;
+    ReadOp->Bytes = cacheItem.Size;
+    ReadOp->Offset = cacheItem.Offset;
 }
@@ -5,7 +5,15 @@
 
 #include "CacheTable.h"
 #include "OffloadTypes.h"
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+
+//
+// Keys looked up in one batch, as many as the requests a message carries (MAX_REQS_PER_MESSAGE)
+//
+//
+#define OFFLOAD_PRED_MAX_REQS 64
 
 struct MessageHeader {
 	long long TimeSend;
@@ -15,9 +23,52 @@ struct MessageHeader {
 	uint8_t Operation;
 };
 
+//
+// The parse state of a stream: the bytes left of a request that continues from the previous message
+//
+//
+struct ParseState {
+    uint16_t BytesLeft;
+};
+
+//
+// Copy Size bytes at Offset of a message out of its segments;
+// Seg and SegStart, the segment to look from and where it starts in the message, move on as offsets grow
+//
+//
+static inline void
+CopyFromSegs(
+    const struct iovec* Segs,
+    uint16_t NumSegs,
+    uint16_t* Seg,
+    uint32_t* SegStart,
+    uint32_t Offset,
+    void* To,
+    uint32_t Size
+) {
+    char* to = (char*)To;
+
+    while (Size && *Seg != NumSegs) {
+        if (Offset >= *SegStart + Segs[*Seg].iov_len) {
+            *SegStart += Segs[*Seg].iov_len;
+            (*Seg)++;
+            continue;
+        }
+
+        uint32_t inSeg = Offset - *SegStart;
+        uint32_t bytes = Segs[*Seg].iov_len - inSeg < Size ? Segs[*Seg].iov_len - inSeg : Size;
+        memcpy(to, (char*)Segs[*Seg].iov_base + inSeg, bytes);
+        to += bytes;
+        Offset += bytes;
+        Size -= bytes;
+    }
+}
+
 void OffloadPred(
-    void* Msg,
+    const struct iovec* Segs,
+    uint16_t NumSegs,
     uint16_t Bytes,
+    OffloadPredStateT* State,
     CacheTableT* CacheTable,
     RequestDescriptorT* ReqsForHost,
     RequestDescriptorT* ReqsForDPU,
@@ -25,31 +76,61 @@ void OffloadPred(
     uint16_t* NumReqsForDPU
 ) {
     const uint16_t reqSize = sizeof(struct MessageHeader);
+    struct ParseState* state = (struct ParseState*)State;
+    int numReqsForHost = 0, numReqsForDPU = 0;
+    uint16_t seg = 0;
+    uint32_t segStart = 0;
+    uint32_t offset = 0;
 
-    if (Bytes < sizeof(struct MessageHeader)) {
-        *NumReqsForHost = 1;
-        *NumReqsForDPU = 0;
-        ReqsForHost[0].Offset = 0;
-        ReqsForHost[0].Bytes = Bytes;
-        return;
+    //
+    // The rest of a request that began in the previous message goes to the host, as its beginning did
+    //
+    //
+    if (state->BytesLeft) {
+        offset = state->BytesLeft < Bytes ? state->BytesLeft : Bytes;
+        ReqsForHost[numReqsForHost].Offset = 0;
+        ReqsForHost[numReqsForHost].Bytes = (uint16_t)offset;
+        numReqsForHost++;
+        state->BytesLeft -= (uint16_t)offset;
     }
 
-    const int numReqsTotal = Bytes / reqSize;
-    int numReqsForHost = 0, numReqsForDPU = 0;
+    //
+    // Look up the keys of the whole requests in one batch, straight from the segments
+    //
+    //
+    int numReqs = (Bytes - offset) / reqSize;
+    if (numReqs > OFFLOAD_PRED_MAX_REQS) {
+        numReqs = OFFLOAD_PRED_MAX_REQS;
+    }
 
-    for (int i = 0; i != numReqsTotal; i++) {
-        struct MessageHeader* msg = (struct MessageHeader*)(((char*)Msg) + i * reqSize);
-        CacheItemT* cacheItem = LookUpCacheTable(CacheTable, &msg->Key);
-        if (cacheItem == NULL) {
-            ReqsForHost[numReqsForHost].Offset = i * reqSize;
-            ReqsForHost[numReqsForHost].Bytes = reqSize;
-            numReqsForHost++;
-        }
-        else {
-            ReqsForDPU[numReqsForDPU].Offset = i * reqSize;
-            ReqsForDPU[numReqsForDPU].Bytes = reqSize;
-            numReqsForDPU++;
-        }
+    KeyT keys[OFFLOAD_PRED_MAX_REQS];
+    CacheItemT cacheItems[OFFLOAD_PRED_MAX_REQS];
+    bool found[OFFLOAD_PRED_MAX_REQS];
+
+    for (int i = 0; i != numReqs; i++) {
+        CopyFromSegs(Segs, NumSegs, &seg, &segStart, offset + i * reqSize + offsetof(struct MessageHeader, Key),
+            &keys[i], sizeof(KeyT));
+    }
+    if (numReqs) {
+        LookUpCacheTableBatch(CacheTable, keys, numReqs, cacheItems, found);
+    }
+
+    for (int i = 0; i != numReqs; i++) {
+        RequestDescriptorT* req = found[i] ? &ReqsForDPU[numReqsForDPU++] : &ReqsForHost[numReqsForHost++];
+        req->Offset = (uint16_t)offset;
+        req->Bytes = reqSize;
+        offset += reqSize;
+    }
+
+    //
+    // The requests beyond the batch, and one that continues into the next message, go to the host
+    //
+    //
+    if (offset != Bytes) {
+        ReqsForHost[numReqsForHost].Offset = (uint16_t)offset;
+        ReqsForHost[numReqsForHost].Bytes = (uint16_t)(Bytes - offset);
+        numReqsForHost++;
+        state->BytesLeft = (reqSize - (Bytes - offset) % reqSize) % reqSize;
     }
 
     *NumReqsForHost = numReqsForHost;
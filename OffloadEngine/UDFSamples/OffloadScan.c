@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include "DDSTypes.h"
+#include <string.h>
+
+struct Record {
+	uint64_t Key;
+	uint64_t Value;
+	uint8_t Payload[];
+};
+
+//
+// Keep the key and the value of the records whose value is not 0, and drop their payloads
+//
+//
+FileIOSizeT OffloadScan(
+    const void* Record,
+    FileIOSizeT RecordBytes,
+    void* Out
+) {
+    const struct Record* record = (const struct Record*)Record;
+
+    if (RecordBytes < sizeof(struct Record) || record->Value == 0) {
+        return 0;
+    }
+
+    memcpy(Out, record, sizeof(struct Record));
+    return sizeof(struct Record);
+}
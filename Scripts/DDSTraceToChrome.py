@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT License
+#
+
+#
+# Merge the trace dumps of DDS processes (see Common/Include/DDSTrace.h) into a Chrome trace,
+# to open in chrome://tracing or https://ui.perfetto.dev:
+#
+#   DDSTraceToChrome.py client_trace.csv server_trace.csv dds_frontend_trace.csv \
+#       ddsbow_backend_trace.csv -o trace.json
+#
+# Every line of a dump is "process,core,trace id,hop,time ns,arg". The back end doesn't see trace ids,
+# so it records its hops under a key of the tagged request id that the front end sent it, with the top
+# bit set; each back end request is joined with the front end submission of the same key nearest before it
+# (the front end records the key as the arg of fe_submit), and its completion with that request.
+# Every hop becomes an instant event on the lane of the process and core that recorded it, and the time
+# between consecutive hops of a trace becomes a span named after the two hops
+#
+
+import argparse
+import bisect
+import json
+import sys
+from collections import defaultdict
+
+BACKEND_KEY_BIT = 1 << 63
+
+
+def ReadDumps(Paths):
+    events = []
+    for path in Paths:
+        with open(path) as f:
+            for line in f:
+                fields = line.strip().split(",")
+                if len(fields) != 6:
+                    continue
+                process, core, traceId, hop, timeNs, arg = fields
+                events.append({
+                    "process": process,
+                    "core": int(core),
+                    "trace": int(traceId),
+                    "hop": hop,
+                    "time": int(timeNs),
+                    "arg": int(arg),
+                })
+    return events
+
+
+def JoinBackEndEvents(Events):
+    submits = defaultdict(list)
+    for e in Events:
+        if e["hop"] == "fe_submit":
+            submits[e["arg"]].append((e["time"], e["trace"]))
+    for key in submits:
+        submits[key].sort()
+
+    joined = []
+    lastRequest = {}
+    unmatched = 0
+    for e in sorted(Events, key=lambda e: e["time"]):
+        if not e["trace"] & BACKEND_KEY_BIT:
+            joined.append(e)
+            continue
+
+        key = e["trace"] & 0xFFFF
+        if e["hop"] == "be_request":
+            candidates = submits.get(key, [])
+            if not candidates:
+                unmatched += 1
+                continue
+            # the nearest submission before, or the first if the clocks of the machines disagree
+            i = bisect.bisect_right(candidates, (e["time"], float("inf")))
+            lastRequest[key] = candidates[i - 1 if i else 0][1]
+        if key not in lastRequest:
+            unmatched += 1
+            continue
+        e = dict(e)
+        e["trace"] = lastRequest[key]
+        joined.append(e)
+
+    if unmatched:
+        print("%d back end events without a front end submission" % unmatched, file=sys.stderr)
+    return joined
+
+
+def ToChrome(Events):
+    pids = {}
+    chrome = []
+    for e in Events:
+        if e["process"] not in pids:
+            pids[e["process"]] = len(pids) + 1
+            chrome.append({"ph": "M", "name": "process_name", "pid": pids[e["process"]],
+                           "args": {"name": e["process"]}})
+
+    origin = min((e["time"] for e in Events), default=0)
+    byTrace = defaultdict(list)
+    for e in Events:
+        byTrace[e["trace"]].append(e)
+        chrome.append({
+            "ph": "i",
+            "s": "t",
+            "name": e["hop"],
+            "pid": pids[e["process"]],
+            "tid": e["core"],
+            "ts": (e["time"] - origin) / 1000.0,
+            "args": {"trace": "%016x" % e["trace"], "arg": e["arg"]},
+        })
+
+    for trace, hops in byTrace.items():
+        hops.sort(key=lambda e: e["time"])
+        for prev, cur in zip(hops, hops[1:]):
+            chrome.append({
+                "ph": "X",
+                "name": "%s -> %s" % (prev["hop"], cur["hop"]),
+                "pid": pids[prev["process"]],
+                "tid": prev["core"],
+                "ts": (prev["time"] - origin) / 1000.0,
+                "dur": (cur["time"] - prev["time"]) / 1000.0,
+                "args": {"trace": "%016x" % trace},
+            })
+
+    return {"traceEvents": chrome, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Merge DDS trace dumps into a Chrome trace")
+    parser.add_argument("dumps", nargs="+", help="trace dumps of the client, server, front end and back end")
+    parser.add_argument("-o", "--output", default="trace.json", help="the Chrome trace to write")
+    args = parser.parse_args()
+
+    events = JoinBackEndEvents(ReadDumps(args.dumps))
+    with open(args.output, "w") as f:
+        json.dump(ToChrome(events), f)
+    print("%d events of %d traces written to %s" % (len(events), len({e["trace"] for e in events}), args.output))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,27 @@
+#!/bin/bash
+
+# Set up an x86 server to run DDS without a DPU (meson -DEmulation=true): a soft-RoCE device
+# for the storage engine, and a netdev of its own for the PEPO, which net_af_xdp takes over
+if [ "$#" -lt 1 ] || [ "$#" -gt 3 ]; then
+    echo "Usage: $0 [RDMA netdev] [PEPO netdev (optional)] [rxe|siw (default rxe)]"
+    exit 1
+fi
+
+RDMA_NETDEV=$1
+PEPO_NETDEV=$2
+RDMA_TYPE=${3:-rxe}
+
+# Soft-RoCE over the RDMA netdev; the back end listens on its address (BackEndAddr of meson)
+sudo modprobe rdma_$RDMA_TYPE
+if ! rdma link show | grep -q "netdev $RDMA_NETDEV"; then
+    sudo rdma link add ${RDMA_TYPE}_$RDMA_NETDEV type $RDMA_TYPE netdev $RDMA_NETDEV
+fi
+rdma link show
+
+# One queue for the PEPO on one core, as net_af_xdp binds a socket per queue
+if [ -n "$PEPO_NETDEV" ]; then
+    sudo ethtool -L $PEPO_NETDEV combined 1
+    sudo ip link set dev $PEPO_NETDEV up
+fi
+
+sh $(dirname $0)/ConfigureHugePages.sh
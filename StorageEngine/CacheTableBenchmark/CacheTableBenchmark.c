@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// Microbenchmarks of the cache table and its hash functions on the DPU cores, in one of five modes:
+//
+// lookup: the table is filled to a load factor with random keys, then threads look up random keys,
+// of which a given percentage are in the table, and the run reports lookups/s; keys that are all hits
+// and all misses are looked up the same way; the same buckets are also copied to separately allocated buckets
+// behind a pointer array, the layout the table had before it was one contiguous array, and looked up the same way;
+// the contiguous table is also looked up in batches of CACHE_BENCHMARK_BATCH_KEYS keys, as OffloadPred does
+//
+// insert: an empty table is filled to each load of CACHE_BENCHMARK_INSERT_LOADS, as a percentage of its largest
+// capacity, and each step reports additions/s, the load factor of the table as it has grown, its splits,
+// and how many items each addition displaced (the lengths of the cuckoo kick chains)
+//
+// hash: every hash function of HashFunctions.h hashes random keys of the cache table, and reports ns/hash
+//
+// mixed: the table is filled as for lookup, then the lookup threads run alongside the writer,
+// which keeps deleting a random item and adding a new one, so that the load stays the same;
+// it reports lookups/s, writes/s and the lookups retried because a bucket changed under them
+//
+// evict: keys of a working set of CACHE_BENCHMARK_EVICT_KEYS are looked up, HitPercent of them in its hot part
+// of CACHE_BENCHMARK_EVICT_HOT_PERCENT, and added when they miss, as the offload index is filled, with the budget
+// of the table at each percentage of CACHE_BENCHMARK_EVICT_BUDGETS of the working set; each budget reports
+// the hit rate, the evictions and failed additions, and accesses/s, for the policy CACHE_TABLE_EVICTION
+//
+// Threads are pinned to the cores from FirstCore on, the writer after the lookup threads, if FirstCore is given
+//
+// Usage: CacheTableBenchmark [-m lookup|insert|hash|mixed|evict] [-l LoadPercent] [-h HitPercent] [-t Threads]
+//                            [-s Seconds] [-c FirstCore]
+//
+//
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Affinity.h"
+#include "CacheTable.h"
+#include "HashFunctions.h"
+
+#define CACHE_BENCHMARK_DEFAULT_LOAD_PERCENT 80
+#define CACHE_BENCHMARK_DEFAULT_HIT_PERCENT 90
+#define CACHE_BENCHMARK_DEFAULT_THREADS 1
+#define CACHE_BENCHMARK_DEFAULT_SECONDS 5
+#define CACHE_BENCHMARK_KEYS_PER_THREAD (1 << 20)
+#define CACHE_BENCHMARK_BATCH_KEYS 64
+#define CACHE_BENCHMARK_HASH_ROUNDS 64
+
+#define CACHE_BENCHMARK_EVICT_KEYS (1 << 22)
+#define CACHE_BENCHMARK_EVICT_HOT_PERCENT 20
+#define CACHE_BENCHMARK_EVICT_ACCESSES (1 << 24)
+
+static const int CACHE_BENCHMARK_INSERT_LOADS[] = { 50, 60, 70, 80, 85, 90, 95 };
+static const int CACHE_BENCHMARK_EVICT_BUDGETS[] = { 5, 10, 20, 30, 50, 75, 100 };
+
+//
+// The buckets of the table behind a pointer array, one allocation per bucket
+//
+//
+typedef struct {
+    CacheBucketT** Table;
+    uint64_t Layout;
+    size_t NumBuckets;
+} IndirectCacheTableT;
+
+typedef struct {
+    CacheTableT* Table;
+    IndirectCacheTableT* Indirect;
+    bool Batched;
+    KeyT* Keys;
+    size_t NumKeys;
+    atomic_bool* Stop;
+    int Core;
+    size_t Lookups;
+    size_t Hits;
+} LookupThreadArgT;
+
+//
+// The writer of the mixed runs, which replaces items of Keys with new ones
+//
+//
+typedef struct {
+    CacheTableT* Table;
+    KeyT* Keys;
+    size_t NumKeys;
+    uint64_t Random;
+    atomic_bool* Stop;
+    int Core;
+    size_t Writes;
+} WriterThreadArgT;
+
+static inline uint64_t
+NextRandom(
+    uint64_t* State
+) {
+    uint64_t x = *State;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *State = x;
+    return x;
+}
+
+static double
+NowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+//
+// The probes of LookUpCacheTable over the indirect layout, without version checks
+//
+//
+static bool
+LookUpIndirectCacheTable(
+    IndirectCacheTableT* CacheTable,
+    KeyT* Key,
+    CacheItemT* Item
+) {
+    HashValueT hash1, hash2;
+    CacheBucketT *targetBucket;
+
+    HASH_FUNCTION1(Key, sizeof(KeyT), hash1);
+    HASH_FUNCTION2(Key, sizeof(KeyT), hash2);
+    if (hash1 == hash2) {
+        hash2 = ~hash1;
+    }
+
+    targetBucket = CacheTable->Table[CacheTableBucket(CacheTable->Layout, hash1)];
+    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+        if (CacheTableTag(hash1, hash2) == CacheBucketTags(targetBucket)[e] && CacheBucketKey(targetBucket, e) == *Key) {
+            CopyCacheBucketItem(targetBucket, e, Item);
+            return true;
+        }
+    }
+
+    targetBucket = CacheTable->Table[CacheTableBucket(CacheTable->Layout, hash2)];
+    for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+        if (CacheTableTag(hash2, hash1) == CacheBucketTags(targetBucket)[e] && CacheBucketKey(targetBucket, e) == *Key) {
+            CopyCacheBucketItem(targetBucket, e, Item);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void*
+LookupThread(
+    void* Arg
+) {
+    LookupThreadArgT* args = Arg;
+    size_t lookups = 0;
+    size_t hits = 0;
+    CacheItemT item;
+    CacheItemT items[CACHE_BENCHMARK_BATCH_KEYS];
+    bool found[CACHE_BENCHMARK_BATCH_KEYS];
+
+    if (args->Core >= 0) {
+        BindToCore((size_t)args->Core);
+    }
+
+    while (!atomic_load_explicit(args->Stop, memory_order_relaxed)) {
+        for (size_t k = 0; args->Batched && k != args->NumKeys; k += CACHE_BENCHMARK_BATCH_KEYS) {
+            hits += LookUpCacheTableBatch(args->Table, &args->Keys[k], CACHE_BENCHMARK_BATCH_KEYS, items, found);
+        }
+        for (size_t k = 0; !args->Batched && k != args->NumKeys; k++) {
+            hits += args->Indirect ? LookUpIndirectCacheTable(args->Indirect, &args->Keys[k], &item) :
+                LookUpCacheTable(args->Table, &args->Keys[k], &item);
+        }
+        lookups += args->NumKeys;
+    }
+
+    args->Lookups = lookups;
+    args->Hits = hits;
+    return NULL;
+}
+
+//
+// Replace a random item of Keys with a new key until Stop, keeping the load of the table
+//
+//
+static void*
+WriterThread(
+    void* Arg
+) {
+    WriterThreadArgT* args = Arg;
+    size_t writes = 0;
+
+    if (args->Core >= 0) {
+        BindToCore((size_t)args->Core);
+    }
+
+    while (!atomic_load_explicit(args->Stop, memory_order_relaxed)) {
+        size_t k = NextRandom(&args->Random) % args->NumKeys;
+        CacheItemT item = { 0 };
+
+        DeleteFromCacheTable(args->Table, &args->Keys[k]);
+        item.Key = NextRandom(&args->Random) | 1;
+        item.Size = (FileIOSizeT)(writes & 0xffff);
+        if (AddToCacheTable(args->Table, &item) == 0) {
+            args->Keys[k] = item.Key;
+        }
+        writes++;
+    }
+
+    args->Writes = writes;
+    return NULL;
+}
+
+//
+// Look up with Threads threads for Seconds seconds, alongside a writer if one is given, and print the rates
+//
+//
+static void
+RunLookups(
+    const char* Layout,
+    CacheTableT* Table,
+    IndirectCacheTableT* Indirect,
+    bool Batched,
+    KeyT** ThreadKeys,
+    int Threads,
+    int Seconds,
+    int FirstCore,
+    WriterThreadArgT* Writer
+) {
+    pthread_t threads[Threads];
+    pthread_t writerThread;
+    LookupThreadArgT args[Threads];
+    atomic_bool stop;
+    atomic_init(&stop, false);
+
+    CacheTableStatsT before = { 0 };
+    CacheTableStatsT after = { 0 };
+    if (Table) {
+        GetCacheTableStats(Table, &before);
+    }
+
+    double start = NowSeconds();
+    for (int t = 0; t != Threads; t++) {
+        args[t] = (LookupThreadArgT) { Table, Indirect, Batched, ThreadKeys[t], CACHE_BENCHMARK_KEYS_PER_THREAD, &stop,
+            FirstCore >= 0 ? FirstCore + t : -1, 0, 0 };
+        pthread_create(&threads[t], NULL, LookupThread, &args[t]);
+    }
+    if (Writer) {
+        Writer->Stop = &stop;
+        Writer->Core = FirstCore >= 0 ? FirstCore + Threads : -1;
+        Writer->Writes = 0;
+        pthread_create(&writerThread, NULL, WriterThread, Writer);
+    }
+    sleep(Seconds);
+    atomic_store(&stop, true);
+
+    size_t lookups = 0;
+    size_t hits = 0;
+    for (int t = 0; t != Threads; t++) {
+        pthread_join(threads[t], NULL);
+        lookups += args[t].Lookups;
+        hits += args[t].Hits;
+    }
+    if (Writer) {
+        pthread_join(writerThread, NULL);
+    }
+    double elapsed = NowSeconds() - start;
+
+    fprintf(stdout, "%-10s threads %2d: %.2f M lookups/s, %.1f%% hits",
+        Layout, Threads, lookups / elapsed / 1e6, lookups ? 100.0 * hits / lookups : 0.0);
+    if (Writer) {
+        fprintf(stdout, ", %.2f M writes/s", Writer->Writes / elapsed / 1e6);
+    }
+    if (Table && GetCacheTableStats(Table, &after) == 0) {
+        fprintf(stdout, ", %lu retries", after.Retries - before.Retries);
+    }
+    fprintf(stdout, "\n");
+}
+
+//
+// Print how many items the additions between two counts displaced
+//
+//
+static void
+PrintDisplacements(
+    const CacheTableStatsT* Before,
+    const CacheTableStatsT* After
+) {
+    uint64_t additions = 0;
+
+    for (int d = 0; d != CACHE_TABLE_STATS_DEPTH_BUCKETS; d++) {
+        additions += After->Depths[d] - Before->Depths[d];
+    }
+
+    fprintf(stdout, "    displacements per addition:");
+    for (int d = 0; d != CACHE_TABLE_STATS_DEPTH_BUCKETS; d++) {
+        uint64_t count = After->Depths[d] - Before->Depths[d];
+        if (count) {
+            fprintf(stdout, " %s%d: %.3f%%", d > 1 ? "<" : "", d > 1 ? 1 << d : d, additions ? 100.0 * count / additions : 0.0);
+        }
+    }
+    fprintf(stdout, "\n");
+}
+
+//
+// Fill an empty table step by step to each load of CACHE_BENCHMARK_INSERT_LOADS
+//
+//
+static int
+RunInserts(void) {
+    CacheTableT* table;
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+    size_t numItems = 0;
+    size_t failures = 0;
+
+    if (InitCacheTable(&table)) {
+        fprintf(stderr, "InitCacheTable failed\n");
+        return -1;
+    }
+
+    for (size_t l = 0; l != sizeof(CACHE_BENCHMARK_INSERT_LOADS) / sizeof(CACHE_BENCHMARK_INSERT_LOADS[0]); l++) {
+        size_t targetItems = (size_t)CACHE_TABLE_CAPACITY / 100 * CACHE_BENCHMARK_INSERT_LOADS[l];
+        size_t added = 0;
+        CacheTableStatsT before = { 0 };
+        CacheTableStatsT after = { 0 };
+        bool counted = GetCacheTableStats(table, &before) == 0;
+
+        double start = NowSeconds();
+        while (numItems != targetItems) {
+            CacheItemT item = { 0 };
+            item.Key = NextRandom(&random) | 1;
+            item.Size = (FileIOSizeT)(numItems & 0xffff);
+            if (AddToCacheTable(table, &item) == 0) {
+                added++;
+            }
+            else {
+                failures++;
+            }
+            numItems++;
+        }
+        double elapsed = NowSeconds() - start;
+        counted = GetCacheTableStats(table, &after) == 0 && counted;
+
+        fprintf(stdout, "to %d%% of capacity: %.2f M additions/s, load factor %.1f%% of %lu slots, %lu failed",
+            CACHE_BENCHMARK_INSERT_LOADS[l], added / elapsed / 1e6, 100.0 * after.LoadFactor, after.NumSlots, failures);
+        if (counted) {
+            fprintf(stdout, ", %lu splits\n", after.Splits - before.Splits);
+            PrintDisplacements(&before, &after);
+        }
+        else {
+            fprintf(stdout, "\n");
+        }
+    }
+
+    DestroyCacheTable(table);
+    return 0;
+}
+
+//
+// Look up a skewed stream of keys and add the misses, with the budget of the table
+// at each percentage of CACHE_BENCHMARK_EVICT_BUDGETS of the working set
+//
+//
+static int
+RunEvictions(
+    int HitPercent
+) {
+    static const char* policies[] = { "none", "clock", "sampled-lru" };
+    size_t hotKeys = (size_t)CACHE_BENCHMARK_EVICT_KEYS / 100 * CACHE_BENCHMARK_EVICT_HOT_PERCENT;
+
+    fprintf(stdout, "Working set of %d keys, %d%% of lookups in its hottest %d%%, eviction by %s\n",
+        CACHE_BENCHMARK_EVICT_KEYS, HitPercent, CACHE_BENCHMARK_EVICT_HOT_PERCENT, policies[CACHE_TABLE_EVICTION]);
+
+    for (size_t b = 0; b != sizeof(CACHE_BENCHMARK_EVICT_BUDGETS) / sizeof(CACHE_BENCHMARK_EVICT_BUDGETS[0]); b++) {
+        CacheTableT* table;
+        uint64_t random = 0x9e3779b97f4a7c15ULL;
+        size_t hits = 0;
+        size_t failures = 0;
+
+        if (InitCacheTable(&table)) {
+            fprintf(stderr, "InitCacheTable failed\n");
+            return -1;
+        }
+        SetCacheTableMaxItems(table, (size_t)CACHE_BENCHMARK_EVICT_KEYS / 100 * CACHE_BENCHMARK_EVICT_BUDGETS[b]);
+
+        double start = NowSeconds();
+        for (size_t a = 0; a != CACHE_BENCHMARK_EVICT_ACCESSES; a++) {
+            CacheItemT item = { 0 };
+            KeyT key = (int)(NextRandom(&random) % 100) < HitPercent ? NextRandom(&random) % hotKeys :
+                hotKeys + NextRandom(&random) % (CACHE_BENCHMARK_EVICT_KEYS - hotKeys);
+            key = key << 1 | 1;
+
+            if (LookUpCacheTable(table, &key, &item)) {
+                hits++;
+                continue;
+            }
+            item.Key = key;
+            item.Size = (FileIOSizeT)(a & 0xffff);
+            if (AddToCacheTable(table, &item)) {
+                failures++;
+            }
+        }
+        double elapsed = NowSeconds() - start;
+
+        CacheTableStatsT stats;
+        bool counted = GetCacheTableStats(table, &stats) == 0;
+        fprintf(stdout, "budget %3d%% (%lu items): %.1f%% hits, %.2f M accesses/s, %lu items in %lu slots, %lu failed",
+            CACHE_BENCHMARK_EVICT_BUDGETS[b], stats.MaxItems, 100.0 * hits / CACHE_BENCHMARK_EVICT_ACCESSES,
+            CACHE_BENCHMARK_EVICT_ACCESSES / elapsed / 1e6, stats.NumItems, stats.NumSlots, failures);
+        if (counted) {
+            fprintf(stdout, ", %lu evictions", stats.Evictions);
+        }
+        fprintf(stdout, "\n");
+
+        DestroyCacheTable(table);
+    }
+
+    return 0;
+}
+
+//
+// Hash the keys with one of the hash macros, seeded or not, and print ns/hash;
+// the hash values are summed so that the hashing isn't optimized away
+//
+//
+#define CACHE_BENCHMARK_HASH(Name, Keys, NumKeys, ...)                                       \
+do {                                                                                         \
+    uint32_t _sum = 0;                                                                       \
+    double _start = NowSeconds();                                                            \
+    for (int _r = 0; _r != CACHE_BENCHMARK_HASH_ROUNDS; _r++) {                              \
+        for (size_t _k = 0; _k != (NumKeys); _k++) {                                         \
+            uint32_t _hashv;                                                                 \
+            __VA_ARGS__;                                                                     \
+            _sum += _hashv;                                                                  \
+        }                                                                                    \
+    }                                                                                        \
+    double _elapsed = NowSeconds() - _start;                                                 \
+    fprintf(stdout, "%-8s %6.2f ns/hash (%08x)\n", Name,                                     \
+        _elapsed * 1e9 / ((double)CACHE_BENCHMARK_HASH_ROUNDS * (NumKeys)), _sum);           \
+} while (0)
+
+static int
+RunHashes(void) {
+    KeyT* keys = malloc(sizeof(KeyT) * CACHE_BENCHMARK_KEYS_PER_THREAD);
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+
+    if (!keys) {
+        return -1;
+    }
+    for (size_t k = 0; k != CACHE_BENCHMARK_KEYS_PER_THREAD; k++) {
+        keys[k] = NextRandom(&random);
+    }
+
+    fprintf(stdout, "Hashing %lu keys of %lu bytes %d times\n",
+        (size_t)CACHE_BENCHMARK_KEYS_PER_THREAD, sizeof(KeyT), CACHE_BENCHMARK_HASH_ROUNDS);
+    CACHE_BENCHMARK_HASH("murmur", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_MURMUR(&keys[_k], sizeof(KeyT), _hashv, 0x9747b28c));
+    CACHE_BENCHMARK_HASH("crc32c", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_CRC32C(&keys[_k], sizeof(KeyT), _hashv, 0x9747b28c));
+    CACHE_BENCHMARK_HASH("xxh3", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_XXH3(&keys[_k], sizeof(KeyT), _hashv, 0x9747b28c));
+    CACHE_BENCHMARK_HASH("jenkins", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_JEN(&keys[_k], sizeof(KeyT), _hashv));
+    CACHE_BENCHMARK_HASH("sfh", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_SFH(&keys[_k], sizeof(KeyT), _hashv));
+    CACHE_BENCHMARK_HASH("oat", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_OAT(&keys[_k], sizeof(KeyT), _hashv));
+    CACHE_BENCHMARK_HASH("fnv", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_FNV(&keys[_k], sizeof(KeyT), _hashv));
+    CACHE_BENCHMARK_HASH("sax", keys, CACHE_BENCHMARK_KEYS_PER_THREAD,
+        HASH_SAX(&keys[_k], sizeof(KeyT), _hashv));
+
+    free(keys);
+    return 0;
+}
+
+//
+// Keys for a thread, of which HitPercent are among Keys and the rest are even, so never in the table
+//
+//
+static KeyT*
+MakeLookupKeys(
+    const KeyT* Keys,
+    size_t NumKeys,
+    int HitPercent,
+    uint64_t* Random
+) {
+    KeyT* lookupKeys = malloc(sizeof(KeyT) * CACHE_BENCHMARK_KEYS_PER_THREAD);
+
+    for (size_t k = 0; lookupKeys && k != CACHE_BENCHMARK_KEYS_PER_THREAD; k++) {
+        lookupKeys[k] = (int)(NextRandom(Random) % 100) < HitPercent ?
+            Keys[NextRandom(Random) % NumKeys] : NextRandom(Random) & ~1ULL;
+    }
+
+    return lookupKeys;
+}
+
+int
+main(
+    int Argc,
+    char** Argv
+) {
+    const char* mode = "lookup";
+    int loadPercent = CACHE_BENCHMARK_DEFAULT_LOAD_PERCENT;
+    int hitPercent = CACHE_BENCHMARK_DEFAULT_HIT_PERCENT;
+    int threads = CACHE_BENCHMARK_DEFAULT_THREADS;
+    int seconds = CACHE_BENCHMARK_DEFAULT_SECONDS;
+    int firstCore = -1;
+    int opt;
+
+    while ((opt = getopt(Argc, Argv, "m:l:h:t:s:c:")) != -1) {
+        switch (opt) {
+        case 'm': mode = optarg; break;
+        case 'l': loadPercent = atoi(optarg); break;
+        case 'h': hitPercent = atoi(optarg); break;
+        case 't': threads = atoi(optarg); break;
+        case 's': seconds = atoi(optarg); break;
+        case 'c': firstCore = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-m lookup|insert|hash|mixed|evict] [-l LoadPercent] [-h HitPercent] [-t Threads] "
+                "[-s Seconds] [-c FirstCore]\n", Argv[0]);
+            return -1;
+        }
+    }
+    bool mixed = !strcmp(mode, "mixed");
+    if ((strcmp(mode, "lookup") && strcmp(mode, "insert") && strcmp(mode, "hash") && strcmp(mode, "evict") && !mixed) ||
+        loadPercent < 1 || loadPercent > 95 || hitPercent < 0 || hitPercent > 100 || threads < 1 || seconds < 1 ||
+        firstCore < -1) {
+        fprintf(stderr, "Invalid arguments\n");
+        return -1;
+    }
+
+    if (!strcmp(mode, "insert")) {
+        return RunInserts();
+    }
+    if (!strcmp(mode, "hash")) {
+        return RunHashes();
+    }
+    if (!strcmp(mode, "evict")) {
+        return RunEvictions(hitPercent);
+    }
+
+    //
+    // Fill the table; keys are odd and misses are even, so a miss is never in the table
+    //
+    //
+    double start = NowSeconds();
+    CacheTableT* table;
+    if (InitCacheTable(&table)) {
+        fprintf(stderr, "InitCacheTable failed\n");
+        return -1;
+    }
+    fprintf(stdout, "Initialized %lu bytes on %s huge pages in %.3f s\n",
+        table->TableBytes, table->HugePages ? "hugetlbfs" : "transparent", NowSeconds() - start);
+
+    size_t numItems = (size_t)CACHE_TABLE_CAPACITY / 100 * loadPercent;
+    KeyT* keys = malloc(sizeof(KeyT) * numItems);
+    uint64_t random = 0x9e3779b97f4a7c15ULL;
+    size_t added = 0;
+    for (size_t i = 0; i != numItems; i++) {
+        CacheItemT item = { 0 };
+        item.Key = NextRandom(&random) | 1;
+        item.Size = (FileIOSizeT)(i & 0xffff);
+        if (AddToCacheTable(table, &item) == 0) {
+            keys[added++] = item.Key;
+        }
+    }
+    fprintf(stdout, "Added %lu of %lu items, the table has grown to %lu bytes\n", added, numItems, table->TableBytes);
+
+    KeyT* threadKeys[threads];
+    KeyT* hitKeys[threads];
+    KeyT* missKeys[threads];
+    for (int t = 0; t != threads; t++) {
+        threadKeys[t] = MakeLookupKeys(keys, added, hitPercent, &random);
+        hitKeys[t] = MakeLookupKeys(keys, added, 100, &random);
+        missKeys[t] = MakeLookupKeys(keys, added, 0, &random);
+    }
+
+    if (mixed) {
+        //
+        // The writer replaces items of its own copy of the keys, so the lookups keep the hit rate they started with
+        // only while the keys they look up haven't been replaced yet
+        //
+        //
+        WriterThreadArgT writer = { table, malloc(sizeof(KeyT) * added), added, 0x2545f4914f6cdd1dULL, NULL, -1, 0 };
+        memcpy(writer.Keys, keys, sizeof(KeyT) * added);
+
+        RunLookups("readers", table, NULL, false, threadKeys, threads, seconds, firstCore, NULL);
+        RunLookups("mixed", table, NULL, false, threadKeys, threads, seconds, firstCore, &writer);
+        RunLookups("batched", table, NULL, true, threadKeys, threads, seconds, firstCore, &writer);
+        free(writer.Keys);
+    }
+    else {
+        //
+        // Copy the buckets to the previous layout
+        //
+        //
+        start = NowSeconds();
+        IndirectCacheTableT indirect;
+        indirect.Layout = atomic_load(&table->Layout);
+        indirect.NumBuckets = ((size_t)1 << (indirect.Layout >> 32)) + (uint32_t)indirect.Layout;
+        //
+        // aligned_alloc takes only a multiple of the alignment
+        //
+        //
+        size_t bucketBytes = (sizeof(CacheBucketT) + DDS_CACHE_LINE_SIZE - 1) / DDS_CACHE_LINE_SIZE * DDS_CACHE_LINE_SIZE;
+        indirect.Table = malloc(sizeof(CacheBucketT*) * indirect.NumBuckets);
+        for (size_t i = 0; i != indirect.NumBuckets; i++) {
+            indirect.Table[i] = aligned_alloc(DDS_CACHE_LINE_SIZE, bucketBytes);
+            memcpy(indirect.Table[i], &table->Table[i], sizeof(CacheBucketT));
+        }
+        fprintf(stdout, "Allocated %lu separate buckets in %.3f s\n", indirect.NumBuckets, NowSeconds() - start);
+
+        RunLookups("contiguous", table, NULL, false, threadKeys, threads, seconds, firstCore, NULL);
+        RunLookups("hits", table, NULL, false, hitKeys, threads, seconds, firstCore, NULL);
+        RunLookups("misses", table, NULL, false, missKeys, threads, seconds, firstCore, NULL);
+        RunLookups("batched", table, NULL, true, threadKeys, threads, seconds, firstCore, NULL);
+        RunLookups("indirect", NULL, &indirect, false, threadKeys, threads, seconds, firstCore, NULL);
+
+        for (size_t i = 0; i != indirect.NumBuckets; i++) {
+            free(indirect.Table[i]);
+        }
+        free(indirect.Table);
+    }
+
+    CacheTableStatsT stats;
+    if (GetCacheTableStats(table, &stats) == 0) {
+        fprintf(stdout, "Table counters: %lu lookups, %lu hits, %lu retries, %lu additions, %lu deletions, %lu failures, "
+            "%lu evictions, %lu splits\n", stats.Lookups, stats.Hits, stats.Retries, stats.Additions, stats.Deletions,
+            stats.Failures, stats.Evictions, stats.Splits);
+        fprintf(stdout, "Displacements per addition:");
+        for (int d = 0; d != CACHE_TABLE_STATS_DEPTH_BUCKETS; d++) {
+            fprintf(stdout, " %s%d: %lu", d > 1 ? "<" : "", d > 1 ? 1 << d : d, stats.Depths[d]);
+        }
+        fprintf(stdout, "\n");
+    }
+
+    for (int t = 0; t != threads; t++) {
+        free(threadKeys[t]);
+        free(hitKeys[t]);
+        free(missKeys[t]);
+    }
+    free(keys);
+    DestroyCacheTable(table);
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// Dump a snapshot of the cache table, as saved by the back end (SaveCacheTable):
+// how many items it has and how full it is, how many buckets have 0 to CACHE_TABLE_BUCKET_SIZE items,
+// and how many items are in the bucket of their first hash value rather than their second;
+// with -i, every item too
+// The counters of lookups and additions are printed by the back end itself (CACHE_TABLE_STATS_ENABLED)
+//
+// Usage: CacheTableDump [-i] SnapshotPath
+//
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CacheTable.h"
+#include "HashFunctions.h"
+
+int
+main(
+    int Argc,
+    char** Argv
+) {
+    bool printItems = false;
+    int opt;
+
+    while ((opt = getopt(Argc, Argv, "i")) != -1) {
+        switch (opt) {
+        case 'i': printItems = true; break;
+        default:
+            fprintf(stderr, "Usage: %s [-i] SnapshotPath\n", Argv[0]);
+            return -1;
+        }
+    }
+    if (optind + 1 != Argc) {
+        fprintf(stderr, "Usage: %s [-i] SnapshotPath\n", Argv[0]);
+        return -1;
+    }
+
+    CacheTableT* table;
+    if (InitCacheTable(&table)) {
+        fprintf(stderr, "InitCacheTable failed\n");
+        return -1;
+    }
+    if (LoadCacheTable(table, Argv[optind])) {
+        fprintf(stderr, "Failed to load %s, or it is not a snapshot of this table\n", Argv[optind]);
+        DestroyCacheTable(table);
+        return -1;
+    }
+
+    CacheTableStatsT stats;
+    GetCacheTableStats(table, &stats);
+    fprintf(stdout, "%lu items in %lu slots (load %.1f%%), %lu bytes of buckets\n",
+        stats.NumItems, stats.NumSlots, 100.0 * stats.LoadFactor, table->TableBytes);
+
+    //
+    // Count the buckets by how full they are, and the items by the bucket they are in
+    //
+    //
+    uint64_t layout = atomic_load(&table->Layout);
+    size_t numBuckets = stats.NumSlots / CACHE_TABLE_BUCKET_SIZE;
+    size_t fill[CACHE_TABLE_BUCKET_SIZE + 1] = { 0 };
+    size_t firstChoice = 0;
+
+    for (size_t b = 0; b != numBuckets; b++) {
+        CacheBucketT *bucket = &table->Table[b];
+        int numItems = 0;
+
+        for (int e = 0; e != CACHE_TABLE_BUCKET_SIZE; e++) {
+            if (!CacheBucketTags(bucket)[e]) {
+                continue;
+            }
+            numItems++;
+
+            KeyT key = CacheBucketKey(bucket, e);
+            HashValueT hash1;
+            HASH_FUNCTION1(&key, sizeof(KeyT), hash1);
+            firstChoice += CacheTableBucket(layout, hash1) == b;
+
+            if (printItems) {
+                CacheItemT item;
+                CopyCacheBucketItem(bucket, e, &item);
+                fprintf(stdout, "bucket %lu slot %d: key %lu file %u offset %lu size %u\n",
+                    b, e, (uint64_t)item.Key, item.FileId, item.Offset, item.Size);
+            }
+        }
+        fill[numItems]++;
+    }
+
+    for (int n = 0; n <= CACHE_TABLE_BUCKET_SIZE; n++) {
+        fprintf(stdout, "%lu buckets (%.1f%%) with %d items\n", fill[n], 100.0 * fill[n] / numBuckets, n);
+    }
+    fprintf(stdout, "%lu items (%.1f%%) in the bucket of their first hash value\n",
+        firstChoice, stats.NumItems ? 100.0 * firstChoice / stats.NumItems : 0.0);
+
+    DestroyCacheTable(table);
+    return 0;
+}
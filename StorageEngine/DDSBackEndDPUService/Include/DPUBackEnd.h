@@ -9,6 +9,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "spdk/stdinc.h"
 #include "spdk/thread.h"
@@ -27,27 +29,290 @@
 #define ONE_GB 1073741824ULL
 #define DDS_BACKEND_RESERVED_SEGMENT 0
 #define DDS_BACKEND_PAGE_SIZE DDS_PAGE_SIZE
-#define DDS_BACKEND_SEGMENT_SIZE ONE_GB
 
+//
+// Granularity of space allocation: 1 << DDS_BACKEND_SEGMENT_SHIFT bytes, between 1 MB and 64 MB;
+// a file holds at most DDS_BACKEND_MAX_SEGMENTS_PER_FILE segments, enough for DDS_BACKEND_MAX_FILE_BYTES
+// at any segment size, and records them on disk as at most DDS_BACKEND_MAX_EXTENTS_PER_FILE runs
+//
+//
+#define DDS_BACKEND_SEGMENT_SHIFT 26
+#define DDS_BACKEND_SEGMENT_SIZE (1ULL << DDS_BACKEND_SEGMENT_SHIFT)
+#define DDS_BACKEND_SEGMENT_MASK (DDS_BACKEND_SEGMENT_SIZE - 1)
+
+//
+// Directories and files are kept at the beginning of the disk, in the segments that cover
+// DDS_BACKEND_METADATA_BYTES; these are never allocated to files
+//
+//
+#define DDS_BACKEND_METADATA_BYTES (32 * ONE_MB)
+#define DDS_BACKEND_RESERVED_SEGMENTS \
+    ((DDS_BACKEND_METADATA_BYTES + DDS_BACKEND_SEGMENT_SIZE - 1) / DDS_BACKEND_SEGMENT_SIZE)
+#define DDS_BACKEND_METADATA_ADDRESS(Offset) \
+    ((DiskSizeT)DDS_BACKEND_RESERVED_SEGMENT * DDS_BACKEND_SEGMENT_SIZE + (Offset))
+
+//
+// The metadata journal is a circular log of fixed-size records between the directories and the files;
+// a checkpoint of the directory and file tables starts once DDS_BACKEND_JOURNAL_CHECKPOINT_RECORDS
+// records have been appended since the last one
+//
+//
+#define DDS_BACKEND_JOURNAL_OFFSET ONE_MB
+#define DDS_BACKEND_JOURNAL_BYTES (8 * ONE_MB)
+#define DDS_BACKEND_JOURNAL_RECORD_SIZE 128
+#define DDS_BACKEND_JOURNAL_RECORDS (DDS_BACKEND_JOURNAL_BYTES / DDS_BACKEND_JOURNAL_RECORD_SIZE)
+#define DDS_BACKEND_JOURNAL_CHECKPOINT_RECORDS (DDS_BACKEND_JOURNAL_RECORDS / 2)
+#define DDS_BACKEND_JOURNAL_SEGMENTS_PER_RECORD 24
+
+//
+// Atomic writes are staged after the journal, each in a slot of a sector of header followed by its data;
+// every worker has DDS_BACKEND_ATOMIC_WRITE_SLOTS slots, for up to DDS_BACKEND_ATOMIC_WRITE_LANES workers
+//
+//
+#define DDS_BACKEND_ATOMIC_WRITE_OFFSET (DDS_BACKEND_JOURNAL_OFFSET + DDS_BACKEND_JOURNAL_BYTES)
+#define DDS_BACKEND_ATOMIC_WRITE_SLOT_BYTES (DDS_BACKEND_SECTOR_SIZE + DDS_MAX_ATOMIC_WRITE_BYTES)
+#define DDS_BACKEND_ATOMIC_WRITE_SLOTS 8
+#define DDS_BACKEND_ATOMIC_WRITE_LANES 16
+#define DDS_BACKEND_ATOMIC_WRITE_BYTES \
+    (DDS_BACKEND_ATOMIC_WRITE_LANES * DDS_BACKEND_ATOMIC_WRITE_SLOTS * DDS_BACKEND_ATOMIC_WRITE_SLOT_BYTES)
+
+//
+// Loading reads the directory table in one IO and the file table in IOs of
+// DDS_BACKEND_LOAD_FILES_PER_READ entries, all in flight together
+//
+//
+#define DDS_BACKEND_LOAD_FILES_PER_READ 256
+#define DDS_BACKEND_LOAD_FILE_READS \
+    ((DDS_MAX_FILES + DDS_BACKEND_LOAD_FILES_PER_READ - 1) / DDS_BACKEND_LOAD_FILES_PER_READ)
+
+//
+// The largest store, which sizes the segment tables; a smaller bdev gets a store of its size
+//
+//
 #ifndef TESTING_FS
-#define DDS_BACKEND_CAPACITY (ONE_GB * 130)
+#define DDS_BACKEND_CAPACITY (ONE_GB * 8192)
 #else
 #define DDS_BACKEND_CAPACITY (ONE_GB * 3)
 #endif
 
 #define DDS_BACKEND_QUEUE_DEPTH_PAGE_IO_DEFAULT 1024
 #define DDS_BACKEND_ROOT_DIR_NAME ""
-#define DDS_BACKEND_INITIALIZATION_MARK "Initialized by DDS"
-#define DDS_BACKEND_INITIALIZATION_MARK_LENGTH 19
-#define DDS_BACKEND_MAX_SEGMENTS_PER_FILE 1000
+
+//
+// The first sector of a store starts with the mark of its layout, which changes with the layout;
+// DDS2 has raised the file and directory limits, DDS3 has fine segments, and DDS4 keeps the segments
+// of a file as extents; every mark starts with DDS_BACKEND_INITIALIZATION_MARK_PREFIX, the mark of the first layout,
+// so a disk that has none is blank and is formatted, while one with another mark holds a store
+// of an older layout, which is formatted only if the config asks for it (format_older_store)
+//
+//
+#define DDS_BACKEND_INITIALIZATION_MARK "Initialized by DDS4"
+#define DDS_BACKEND_INITIALIZATION_MARK_LENGTH 20
+#define DDS_BACKEND_INITIALIZATION_MARK_PREFIX "Initialized by DDS"
+#define DDS_BACKEND_MAX_FILE_BYTES (1000 * ONE_GB)
+#define DDS_BACKEND_MAX_SEGMENTS_PER_FILE ((SegmentIdT)(DDS_BACKEND_MAX_FILE_BYTES >> DDS_BACKEND_SEGMENT_SHIFT))
+#define DDS_BACKEND_MAX_EXTENTS_PER_FILE 558
 #define DDS_BACKEND_SEGMENT_INVALID -1
+#define DDS_BACKEND_MAX_SEGMENTS (DDS_BACKEND_CAPACITY / DDS_BACKEND_SEGMENT_SIZE)
+
+//
+// Free segments are found in a two-level bitmap: a bit per segment and a summary bit per word of those
+//
+//
+#define DDS_BACKEND_SEGMENT_BITMAP_WORDS ((DDS_BACKEND_MAX_SEGMENTS + 63) / 64)
+#define DDS_BACKEND_SEGMENT_SUMMARY_WORDS ((DDS_BACKEND_SEGMENT_BITMAP_WORDS + 63) / 64)
+
+//
+// Small writes of a batch that are adjacent on a file, sector aligned and on one segment
+// go out as one bdev write of up to DDS_BACKEND_WRITE_COALESCE_MAX_BYTES
+//
+//
+#define DDS_BACKEND_WRITE_COALESCE_MAX_REQUESTS 8
+#define DDS_BACKEND_WRITE_COALESCE_MAX_BYTES (128 * 1024)
+
+//
+// Fences of reads a worker keeps until the writes before them are done; more merge into the last one
+//
+//
+#define DDS_BACKEND_MAX_READ_FENCES 16
+
+//
+// Rate limits of files: the burst of a limit set without one, in milliseconds of its rate,
+// the bytes a request costs at least, the weight of a file set without one,
+// and how often a worker looks at the requests it holds back
+//
+//
+#define DDS_BACKEND_QOS_DEFAULT_BURST_MS 10
+#define DDS_BACKEND_QOS_MIN_REQUEST_BYTES 4096
+#define DDS_BACKEND_QOS_DEFAULT_WEIGHT 1
+#define DDS_BACKEND_QOS_POLL_PERIOD_US 20
+
+//
+// Leases of files to front ends: how long a lease lasts without a renewal, and how long a front end that asked
+// for a write lease keeps new read leases from being granted while the leases in its way are given back
+//
+//
+#define DDS_BACKEND_LEASE_MS 5000
+#define DDS_BACKEND_LEASE_WRITER_WAIT_MS DDS_BACKEND_LEASE_MS
+
+//
+// Freed segments are unmapped before they are reused, by at most DDS_BACKEND_TRIM_MAX_INFLIGHT unmaps at a time,
+// each covering up to DDS_BACKEND_TRIM_MAX_SEGMENTS adjacent segments
+//
+//
+#define DDS_BACKEND_TRIM_MAX_INFLIGHT 4
+#define DDS_BACKEND_TRIM_MAX_SEGMENTS 16
 #define DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE 32 * ONE_MB
 
+//
+// Reads of at least DDS_BACKEND_READ_STRIPE_MIN_BYTES are striped into bdev I/Os of at most
+// DDS_BACKEND_READ_STRIPE_BYTES that are all in flight at once, so the device works on them in parallel
+//
+//
+#define DDS_BACKEND_READ_STRIPE_MIN_BYTES ONE_MB
+#define DDS_BACKEND_READ_STRIPE_BYTES (256 * ONE_KB)
+
+//
+// Checksummed files have a CRC32C of each block of DDS_BACKEND_CHECKSUM_BLOCK_SIZE, 0 if the block has none;
+// the checksums of a segment are a table in the area at the end of the device, written a page at a time,
+// and loaded DDS_BACKEND_CHECKSUM_LOAD_INFLIGHT tables at a time.
+// The scrubber verifies DDS_BACKEND_SCRUB_IO_BYTES at a time, at DDS_BACKEND_SCRUB_BYTES_PER_SECOND at most
+//
+//
+#define DDS_BACKEND_CHECKSUM_BLOCK_SIZE DDS_BACKEND_PAGE_SIZE
+#define DDS_BACKEND_CHECKSUMS_PER_SEGMENT (DDS_BACKEND_SEGMENT_SIZE / DDS_BACKEND_CHECKSUM_BLOCK_SIZE)
+#define DDS_BACKEND_CHECKSUM_TABLE_BYTES (DDS_BACKEND_CHECKSUMS_PER_SEGMENT * sizeof(uint32_t))
+#define DDS_BACKEND_CHECKSUM_PAGE_BYTES \
+    (DDS_BACKEND_CHECKSUM_TABLE_BYTES < DDS_BACKEND_PAGE_SIZE ? DDS_BACKEND_CHECKSUM_TABLE_BYTES : DDS_BACKEND_PAGE_SIZE)
+#define DDS_BACKEND_CHECKSUMS_PER_PAGE (DDS_BACKEND_CHECKSUM_PAGE_BYTES / sizeof(uint32_t))
+#define DDS_BACKEND_CHECKSUM_PAGES_PER_TABLE (DDS_BACKEND_CHECKSUM_TABLE_BYTES / DDS_BACKEND_CHECKSUM_PAGE_BYTES)
+#define DDS_BACKEND_CHECKSUM_PAGE_SPAN (DDS_BACKEND_CHECKSUMS_PER_PAGE * DDS_BACKEND_CHECKSUM_BLOCK_SIZE)
+#define DDS_BACKEND_CHECKSUM_LOAD_INFLIGHT 32
+#define DDS_BACKEND_SCRUB_IO_BYTES (256 * ONE_KB)
+#define DDS_BACKEND_SCRUB_BYTES_PER_SECOND (64 * ONE_MB)
+
+//
+// The block cache holds blocks of DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE, DDS_BACKEND_BLOCK_CACHE_BYTES of them
+// unless the config sets another size, split into DDS_BACKEND_BLOCK_CACHE_SHARDS shards with a lock each;
+// reads larger than DDS_BACKEND_BLOCK_CACHE_MAX_READ_BYTES bypass it, so that scans don't flush it.
+// A tenth of each shard is the probationary queue that new blocks enter
+//
+//
+#define DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE DDS_BACKEND_PAGE_SIZE
+#define DDS_BACKEND_BLOCK_CACHE_BYTES ONE_GB
+#define DDS_BACKEND_BLOCK_CACHE_SHARDS 64
+#define DDS_BACKEND_BLOCK_CACHE_MAX_READ_BYTES (64 * ONE_KB)
+#define DDS_BACKEND_BLOCK_CACHE_SMALL_PERCENT 10
+
+//
+// A file read with ACCESS_HINT_SEQUENTIAL is read ahead into the block cache a window of
+// DDS_BACKEND_READ_AHEAD_BYTES at a time, the next window once the reads are half way through the last;
+// ACCESS_HINT_WILLNEED reads up to DDS_BACKEND_WILLNEED_MAX_BYTES of a file in windows
+//
+//
+#define DDS_BACKEND_READ_AHEAD_BYTES ONE_MB
+#define DDS_BACKEND_WILLNEED_MAX_BYTES (64 * ONE_MB)
+
+//
+// Staging buffers of the non zero copy paths: DMA-able hugepage memory from spdk_dma_zmalloc,
+// carved into slabs of size classes up to DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE bytes;
+// an I/O takes a buffer of the smallest class that holds it, or of a larger class if that one has run out
+//
+//
+#define DDS_BACKEND_SPDK_BUFF_CLASSES 3
+#define DDS_BACKEND_SPDK_BUFF_CLASS_BYTES { 64 * ONE_KB, ONE_MB, DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE }
+#define DDS_BACKEND_SPDK_BUFF_CLASS_COUNTS { 2 * DDS_MAX_OUTSTANDING_IO, DDS_MAX_OUTSTANDING_IO / 2, 4 }
+#define DDS_BACKEND_SPDK_BUFF_ALIGNMENT 4096
+
+//
+// A scan reads its range in chunks of DDS_BACKEND_SCAN_CHUNK_BYTES rounded down to whole records,
+// each into a staging buffer, and runs the scan function on records of DDS_BACKEND_SCAN_MAX_RECORD_BYTES at most;
+// up to DDS_BACKEND_MAX_SCAN_FUNCTIONS scan functions are loaded at once
+//
+//
+#define DDS_BACKEND_SCAN_CHUNK_BYTES ONE_MB
+#define DDS_BACKEND_SCAN_MAX_RECORD_BYTES (4 * ONE_KB)
+#define DDS_BACKEND_MAX_SCAN_FUNCTIONS 16
+
+//
+// A segment shared with snapshots is copied before the first write of its file to it,
+// in DDS_BACKEND_SNAPSHOT_COPY_LANES chunks of DDS_BACKEND_SNAPSHOT_COPY_BYTES in flight
+//
+//
+#define DDS_BACKEND_SNAPSHOT_COPY_BYTES ONE_MB
+#define DDS_BACKEND_SNAPSHOT_COPY_LANES 4
+
+//
+// Deduplication hashes up to DDS_BACKEND_DEDUP_STREAMS segments being written at a time,
+// and indexes the hashes of the segments in a table of DDS_BACKEND_DEDUP_INDEX_LOAD times as many entries
+//
+//
+#define DDS_BACKEND_DEDUP_STREAMS 64
+#define DDS_BACKEND_DEDUP_INDEX_LOAD 2
+
+//
+// Defragmentation moves a segment DDS_BACKEND_DEFRAG_IO_BYTES at a time, at DDS_BACKEND_DEFRAG_BYTES_PER_SECOND at most,
+// of files with no write in the last DDS_BACKEND_DEFRAG_COLD_MS
+//
+//
+#define DDS_BACKEND_DEFRAG_IO_BYTES ONE_MB
+#define DDS_BACKEND_DEFRAG_BYTES_PER_SECOND (32 * ONE_MB)
+#define DDS_BACKEND_DEFRAG_COLD_MS 10000
+
+//
+// Tiering moves the segments of files not read nor written for DDS_BACKEND_TIER_COLD_DAYS, or the days of the config,
+// to the capacity bdev, where a segment has an id past DDS_BACKEND_MAX_SEGMENTS and a disk address
+// with DDS_BACKEND_TIER_ADDRESS, by which its I/O goes to that bdev
+//
+//
+#define DDS_BACKEND_TIER_COLD_DAYS 30
+#define DDS_BACKEND_TIER_ADDRESS (1ULL << 62)
+#define SegmentIsCold(SegmentId) ((SegmentId) >= (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS)
+#define SegmentDiskAddress(SegmentId) (SegmentIsCold(SegmentId) ? \
+    DDS_BACKEND_TIER_ADDRESS | (DiskSizeT)((SegmentId) - (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS) * DDS_BACKEND_SEGMENT_SIZE : \
+    (DiskSizeT)(SegmentId) * DDS_BACKEND_SEGMENT_SIZE)
+
+//
+// The write buffer keeps writes of up to DDS_BACKEND_WRITE_BUFFER_MAX_WRITE_BYTES in windows of
+// DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES of their files, as much as the config gives it, split into
+// DDS_BACKEND_WRITE_BUFFER_SHARDS shards with a lock each. A window is written back once it has been dirty for
+// DDS_BACKEND_WRITE_BUFFER_FLUSH_US, or at once while fewer than DDS_BACKEND_WRITE_BUFFER_FREE_PERCENT
+// of the windows of its shard are free; each worker looks at the windows every DDS_BACKEND_WRITE_BUFFER_POLL_PERIOD_US
+//
+//
+#define DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES (64 * ONE_KB)
+#define DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS (DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES / DDS_BACKEND_SECTOR_SIZE)
+#define DDS_BACKEND_WRITE_BUFFER_MAX_WRITE_BYTES (16 * ONE_KB)
+#define DDS_BACKEND_WRITE_BUFFER_SHARDS 16
+#define DDS_BACKEND_WRITE_BUFFER_FLUSH_US 1000
+#define DDS_BACKEND_WRITE_BUFFER_FREE_PERCENT 25
+#define DDS_BACKEND_WRITE_BUFFER_POLL_PERIOD_US 100
+
+//
+// Directory and file tables grow by chunks of these many entries
+//
+//
+#define DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES 16
+#define DDS_BACKEND_DIR_TABLE_CHUNKS ((DDS_MAX_DIRS + DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES - 1) / DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES)
+#define DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES 64
+#define DDS_BACKEND_FILE_TABLE_CHUNKS ((DDS_MAX_FILES + DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES - 1) / DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES)
+
+//
+// Buckets of the name index of files, a power of two
+//
+//
+#define DDS_BACKEND_FILE_NAME_INDEX_BUCKETS 4096
+
 #define min(a,b) \
    ({ __typeof__ (a) _a = (a); \
        __typeof__ (b) _b = (b); \
      _a < _b ? _a : _b; })
 
+#define max(a,b) \
+   ({ __typeof__ (a) _a = (a); \
+       __typeof__ (b) _b = (b); \
+     _a > _b ? _a : _b; })
+
 #define min3(x,y,z) \
     ({ __typeof__ (x) _x = (x); \
        __typeof__ (y) _y = (y); \
@@ -72,6 +337,14 @@ typedef struct DPUSegment {
     FileIdT FileId;
     FileSizeT DiskAddress;
     bool Allocatable;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    //
+    // The files that map the segment besides FileId, the snapshots that share it;
+    // FileId is DDS_FILE_INVALID once its file no longer maps a segment still shared
+    //
+    //
+    atomic_int Sharers;
+#endif
 } SegmentT;
 
 //
@@ -81,15 +354,138 @@ typedef struct DPUSegment {
 struct DPUStorage {
     SegmentT* AllSegments;
     SegmentIdT TotalSegments;
-    SegmentIdT AvailableSegments;
+
+    //
+    // Segments not allocated to any file, reserved by a count before their bits are claimed;
+    // a bit of FreeSegmentBits is set while its segment is free, and a bit of FreeSegmentSummary
+    // is set while its word of FreeSegmentBits may have a set bit
+    //
+    //
+    atomic_int AvailableSegments;
+    _Atomic uint64_t FreeSegmentBits[DDS_BACKEND_SEGMENT_BITMAP_WORDS];
+    _Atomic uint64_t FreeSegmentSummary[DDS_BACKEND_SEGMENT_SUMMARY_WORDS];
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // The layout on a zoned bdev, Zoned false on any other: a zone holds SegmentsPerZone segments, of which
+    // the first UsableSegmentsPerZone are within its capacity, and the zones of files start at FirstZonedSegment;
+    // a file takes the usable segments of whole zones, and an append is at most ZoneAppendMaxBytes
+    //
+    //
+    bool Zoned;
+    DiskSizeT ZoneBytes;
+    SegmentIdT SegmentsPerZone;
+    SegmentIdT UsableSegmentsPerZone;
+    SegmentIdT FirstZonedSegment;
+    FileIOSizeT ZoneAppendMaxBytes;
+#endif
     
-    struct DPUDir* AllDirs[DDS_MAX_DIRS];
-    struct DPUFile* AllFiles[DDS_MAX_FILES];
+#ifdef OPT_FILE_SERVICE_TRIM
+    //
+    // Freed segments waiting to be unmapped, in a ring of positions counted from 0:
+    // [FreedHead, FreedSealed) are sealed with a journal sequence at or after the record that freed them,
+    // and are unmapped once it is on the disk and then go back to the bitmap;
+    // [FreedSealed, FreedTail) wait for their record to be appended
+    //
+    //
+    struct {
+        SegmentIdT Id;
+        uint64_t Sequence;
+    } FreedSegments[DDS_BACKEND_MAX_SEGMENTS];
+    unsigned int FreedHead;
+    unsigned int FreedSealed;
+    unsigned int FreedTail;
+    int TrimsInFlight;
+    pthread_mutex_t FreedSegmentsMutex;
+#endif
+
+    //
+    // Directories and files indexed by id, allocated by chunks on demand;
+    // use GetDir/GetFile and ReserveDir/ReserveFile/SetDir/SetFile
+    //
+    //
+    struct DPUDir** DirChunks[DDS_BACKEND_DIR_TABLE_CHUNKS];
+    struct DPUFile** FileChunks[DDS_BACKEND_FILE_TABLE_CHUNKS];
     int TotalDirs;
     int TotalFiles;
 
-    pthread_mutex_t SectorModificationMutex;
-    pthread_mutex_t SegmentAllocationMutex;
+    //
+    // Files chained by the hash of their names;
+    // use FindFileByName and IndexFileName/UnindexFileName
+    //
+    //
+    FileIdT FileNameBuckets[DDS_BACKEND_FILE_NAME_INDEX_BUCKETS];
+    FileIdT FileNameNext[DDS_MAX_FILES];
+
+    //
+    // Metadata journal, see DPUBackEndJournal.h
+    //
+    //
+    struct DPUJournal* Journal;
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    //
+    // Checksums of the blocks of checksummed files, see DPUBackEndChecksum.h
+    //
+    //
+    struct DPUChecksums* Checksums;
+#endif
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    //
+    // Hot blocks of the files, see DPUBackEndBlockCache.h; NULL if the cache is off
+    //
+    //
+    struct DPUBlockCache* BlockCache;
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEDUP
+    //
+    // Fingerprints of the segments and the streams hashing them, see DPUBackEndDedup.h
+    //
+    //
+    struct DPUDedup* Dedup;
+#endif
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    //
+    // The staging slots of atomic writes, see DPUBackEndAtomic.h
+    //
+    //
+    struct DPUAtomicWrites* AtomicWrites;
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    //
+    // The segment being moved by the defragmentation, see DPUBackEndDefrag.h
+    //
+    //
+    struct DPUDefrag* Defrag;
+#endif
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    //
+    // The segments of the capacity bdev, see DPUBackEndTier.h; NULL if there is none
+    //
+    //
+    struct DPUTier* Tier;
+#endif
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    //
+    // Writes acknowledged before they are on the device, see DPUBackEndWriteBuffer.h; NULL if the buffer is off
+    //
+    //
+    struct DPUWriteBuffer* WriteBuffer;
+#endif
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    //
+    // Taken to change the owner and the sharers of a shared segment
+    //
+    //
+    pthread_mutex_t SharedSegmentsMutex;
+#endif
     
     //
     // these are used during `Initialize`, move them to their own context
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+//
+// Atomic writes
+// A write of a file with DDS_FILE_ATTRIBUTE_ATOMIC_WRITES that spans sectors is staged before it goes in place:
+// its data and a header saying where it goes are written to a slot of the worker in the metadata area
+// and flushed, then the write goes in place as any other and is flushed, and the slot is cleared
+// before the write is acknowledged. Loading reads the slots and writes again, in the order they were staged,
+// every write whose header and data are whole, so a write torn in place by a crash is rolled forward,
+// while one torn in its slot never started in place. The host sends its data once, and the doubled write
+// is the DPU's. A write that grows its file keeps what it wrote within the segments the file still has after
+// the crash, and a write to a segment shared with a snapshot is not written again, as it had not started.
+// A worker that has no free slot holds its writes until one is cleared
+//
+//
+AssertStaticDPUStorage(DDS_BACKEND_ATOMIC_WRITE_OFFSET % DDS_BACKEND_PAGE_SIZE == 0 &&
+    DDS_MAX_ATOMIC_WRITE_BYTES % DDS_BACKEND_SECTOR_SIZE == 0 &&
+    DDS_BACKEND_ATOMIC_WRITE_OFFSET + DDS_BACKEND_ATOMIC_WRITE_BYTES <=
+    DDS_BACKEND_METADATA_BYTES - DDS_MAX_FILES * sizeof(DPUFilePropertiesT), 10);
+
+typedef void (*AtomicWriteCallbackT)(bool Success, void *Arg);
+
+//
+// The header of a slot, in its first sector; Sequence is 0 in a slot that holds no write
+//
+//
+typedef struct AtomicWriteHeader {
+    uint64_t Sequence;
+    FileSizeT Offset;
+    FileIOSizeT Bytes;
+    FileIdT FileId;
+    uint16_t Reserved;
+    uint32_t DataCrc;
+    uint32_t HeaderCrc;  // of the header before it
+} AtomicWriteHeaderT;
+
+//
+// A slot and its DMA-able copy, the header sector then the data; Writer is the write it stages
+//
+//
+typedef struct AtomicWriteSlot {
+    struct AtomicWriteLane *Lane;
+    DiskSizeT Address;
+    char *Buffer;
+    struct PerSlotContext *Writer;
+    void *SPDKContext;
+    AtomicWriteCallbackT Callback;
+    bool Success;
+    BdevFlushWaiterT FlushWaiter;
+    struct AtomicWriteSlot *NextFree;
+} AtomicWriteSlotT;
+
+//
+// The slots of a worker, used on its thread alone, and its writes waiting for one, oldest first
+//
+//
+typedef struct AtomicWriteLane {
+    AtomicWriteSlotT Slots[DDS_BACKEND_ATOMIC_WRITE_SLOTS];
+    AtomicWriteSlotT *Free;
+    struct PerSlotContext *WaitingHead;
+    struct PerSlotContext *WaitingTail;
+} AtomicWriteLaneT;
+
+struct DPUAtomicWrites {
+    AtomicWriteLaneT Lanes[DDS_BACKEND_ATOMIC_WRITE_LANES];
+    atomic_int LanesTaken;
+    _Atomic uint64_t NextSequence;
+
+    //
+    // Rolling the staged writes forward when the store loads: the slots as read, the order of the whole ones,
+    // and the one being written again with the writes of it in flight
+    //
+    //
+    char *RecoveryBuffer;
+    int *RecoveryOrder;
+    int RecoveryCount;
+    int RecoveryNext;
+    AtomicWriteHeaderT *RecoveryHeader;
+    struct iovec RecoveryIov;
+    int RecoveryInFlight;
+    bool RecoveryFailed;
+    void *RecoverySPDKContext;
+    AtomicWriteCallbackT RecoveryCallback;
+    void *RecoveryArg;
+    BdevFlushWaiterT RecoveryFlushWaiter;
+};
+
+//
+// Set up the slots of the workers
+//
+//
+ErrorCodeT AtomicWritesInit(
+    struct DPUStorage* Sto
+);
+
+//
+// Release the slots
+//
+//
+void AtomicWritesDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Write again the staged writes that are whole, clear the slots, then run Callback
+//
+//
+void AtomicWritesRecover(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    AtomicWriteCallbackT Callback,
+    void *Arg
+);
+
+//
+// Whether a write of a file is to be staged: the file has DDS_FILE_ATTRIBUTE_ATOMIC_WRITES
+// and the write spans sectors; Result is DDS_ERROR_CODE_INVALID_PARAM if the write can't be atomic
+//
+//
+bool AtomicWriteNeeded(
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    ErrorCodeT* Result
+);
+
+//
+// Stage a write in a slot of the thread, and call SlotContext->AtomicStaged once it is on the disk,
+// or later once a slot is free; a write that fails to be staged is called back with false and holds no slot
+//
+//
+void AtomicWriteStage(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext
+);
+
+//
+// Clear the slot of a write that is done in place, after a flush if it succeeded,
+// then call back if Callback is not NULL
+//
+//
+void AtomicWriteRetire(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext,
+    bool Success,
+    AtomicWriteCallbackT Callback
+);
+#endif
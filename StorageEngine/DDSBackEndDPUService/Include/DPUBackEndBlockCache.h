@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+//
+// Block cache
+// Blocks of the device read by small reads are kept in the memory of the DPU, by their disk address,
+// so that a read of hot blocks is copied to the response without I/O.
+// Each shard evicts with S3-FIFO: a block enters the small queue, and moves to the main queue
+// if it is read again before it leaves; blocks leaving the small queue unread are remembered in the ghost queue,
+// and come back straight into the main queue, which evicts by CLOCK. A scan thus only goes through the small queue.
+// A read that misses reserves the blocks it will read with its ticket, and fills them when it is done
+// if they are still reserved for it: a write drops the blocks it wrote once it is on the device,
+// so that a read racing the write never fills the cache with what the write replaced
+//
+//
+AssertStaticDPUStorage(DDS_BACKEND_SEGMENT_SIZE % DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE == 0, 9);
+
+typedef enum {
+    BlockCacheEntryFree = 0,
+    BlockCacheEntryFilling,  // reserved by the read with Ticket
+    BlockCacheEntryValid,
+    BlockCacheEntryDead  // dropped, but still in a queue
+} BlockCacheEntryStateT;
+
+typedef struct BlockCacheEntry {
+    uint64_t Block;
+    uint64_t Ticket;
+    int32_t Next;  // in the chain of its bucket, or in the free list
+    uint8_t State;
+    uint8_t Freq;
+} BlockCacheEntryT;
+
+//
+// A FIFO of entries; an entry is in at most one, so a ring of as many slots as entries never overflows
+//
+//
+typedef struct BlockCacheQueue {
+    uint32_t *Ring;
+    uint32_t Head;
+    uint32_t Count;
+} BlockCacheQueueT;
+
+typedef struct BlockCacheShard {
+    pthread_mutex_t Mutex;
+    uint32_t NumEntries;
+    BlockCacheEntryT *Entries;
+    char *Data;  // the block of entry e at e * DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE
+    int32_t *Buckets;
+    uint32_t BucketMask;
+    int32_t FreeList;
+    BlockCacheQueueT Small;
+    BlockCacheQueueT Main;
+    uint32_t SmallTarget;
+
+    //
+    // The blocks evicted from the small queue, the oldest overwritten first
+    //
+    //
+    uint32_t GhostSize;
+    uint32_t GhostNextSlot;
+    uint64_t *GhostBlocks;
+    int32_t *GhostNext;
+    int32_t *GhostBuckets;
+} BlockCacheShardT;
+
+struct DPUBlockCache {
+    BlockCacheShardT Shards[DDS_BACKEND_BLOCK_CACHE_SHARDS];
+    _Atomic uint64_t NextTicket;
+};
+
+//
+// The size of the cache, from the config, 0 to turn it off
+//
+//
+extern uint64_t G_BLOCK_CACHE_BYTES;
+
+//
+// Create the cache of Bytes, none if Bytes is too small for a block per shard
+//
+//
+ErrorCodeT BlockCacheInit(
+    struct DPUStorage* Sto,
+    uint64_t Bytes
+);
+
+//
+// Release the cache
+//
+//
+void BlockCacheDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// A ticket for a read that may fill the cache, 0 if the read is too large to go through it
+//
+//
+uint64_t BlockCacheTicket(
+    struct DPUBlockCache* Cache,
+    FileIOSizeT Bytes
+);
+
+//
+// Copy Bytes at DiskAddress from the cache into the I/O vector, Skip bytes into it, if every block of them is there;
+// otherwise reserve the blocks they cover whole for the read with Ticket, and return false
+//
+//
+bool BlockCacheRead(
+    struct DPUBlockCache* Cache,
+    DiskSizeT DiskAddress,
+    FileIOSizeT Bytes,
+    const struct iovec *Iov,
+    int IovCnt,
+    size_t Skip,
+    uint64_t Ticket
+);
+
+//
+// Fill the blocks reserved for the read with Ticket from the data it read of a file
+//
+//
+void BlockCacheFillFile(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    const struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes,
+    uint64_t Ticket
+);
+
+//
+// Drop the blocks of a range of the device, or of a file
+//
+//
+void BlockCacheInvalidate(
+    struct DPUBlockCache* Cache,
+    DiskSizeT DiskAddress,
+    DiskSizeT Bytes
+);
+
+void BlockCacheInvalidateFile(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+);
+
+//
+// Read Bytes of a file at Offset into the cache in the background, on the thread of SPDKContext,
+// a window at a time; the blocks already there are not read again
+//
+//
+ErrorCodeT BlockCachePrefetchFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileSizeT Bytes,
+    void *SPDKContext
+);
+
+//
+// Read ahead of a read of Bytes at Offset of a file read with ACCESS_HINT_SEQUENTIAL,
+// if the reads are half way through the window read ahead last
+//
+//
+void BlockCacheReadAhead(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    void *SPDKContext
+);
+#endif
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+//
+// Block checksums
+// Each block of a file with DDS_FILE_ATTRIBUTE_CHECKSUM has a CRC32C, computed on the DPU from the data a write
+// took from the host and verified against the data a read gives it, so the host spends nothing on them.
+// The checksums of a segment form a table in the area at the end of the device, at ChecksumsBase plus
+// DDS_BACKEND_CHECKSUM_TABLE_BYTES per segment; a table is in memory while its segment belongs to a checksummed file,
+// and a write is acknowledged once the pages of the table it changed are on the disk, one write of a page
+// being in flight at a time and the changes made meanwhile going out together in the next one.
+// A block a write covers only in part has no checksum until a write covers it whole, nor does a block
+// being written, so reads that race a write are not failed for it.
+// A crash between a write and the write of its checksums leaves the blocks it covered mismatching, like a torn write
+//
+//
+AssertStaticDPUStorage(DDS_BACKEND_SEGMENT_SIZE % DDS_BACKEND_CHECKSUM_PAGE_SPAN == 0 &&
+    DDS_BACKEND_CHECKSUM_PAGE_BYTES % DDS_BACKEND_SECTOR_SIZE == 0 &&
+    DDS_BACKEND_SEGMENT_SIZE % DDS_BACKEND_SCRUB_IO_BYTES == 0, 8);
+
+typedef void (*ChecksumCallbackT)(bool Success, void *Arg);
+
+//
+// The checksums of a write, waiting for the writes of the pages they are on;
+// called back on the thread that made them once all are done
+//
+//
+typedef struct ChecksumWaiter {
+    struct ChecksumUpdate *Update;
+    bool Success;
+    struct ChecksumWaiter *Next;
+} ChecksumWaiterT;
+
+typedef struct ChecksumUpdate {
+    ChecksumCallbackT Callback;
+    void *Arg;
+    struct spdk_thread *Thread;
+    int PagesLeft;
+    bool Failed;
+    ChecksumWaiterT Waiters[];
+} ChecksumUpdateT;
+
+//
+// A page of a table: the write in flight covers the waiters in Writing,
+// and the next one covers those in Waiting, or is needed without any if Dirty
+//
+//
+typedef struct ChecksumPage {
+    struct ChecksumTable *Table;
+    int Index;
+    bool InFlight;
+    bool Dirty;
+    ChecksumWaiterT *Writing;
+    ChecksumWaiterT *Waiting;
+    void *SPDKContext;
+} ChecksumPageT;
+
+//
+// The checksums of a segment in DMA-able memory; a table stays allocated once its segment has been checksummed,
+// Active while the segment belongs to a checksummed file, and Generation changes whenever it is reset or dropped
+//
+//
+typedef struct ChecksumTable {
+    SegmentIdT Segment;
+    bool Active;
+    uint32_t Generation;
+    _Atomic uint32_t *Crcs;
+    pthread_mutex_t Mutex;
+    ChecksumPageT Pages[DDS_BACKEND_CHECKSUM_PAGES_PER_TABLE];
+} ChecksumTableT;
+
+struct DPUChecksums {
+    DiskSizeT ChecksumsBase;
+    _Atomic(ChecksumTableT *) *Tables;  // by segment id
+    pthread_mutex_t Mutex;  // taken to create a table
+    _Atomic uint64_t Mismatches;
+
+    //
+    // Loading the tables of the checksummed files, LoadNext being the next segment to look at
+    //
+    //
+    SegmentIdT LoadNext;
+    int LoadsInFlight;
+    void *LoadSPDKContext;
+    ChecksumCallbackT LoadCallback;
+    void *LoadArg;
+
+    //
+    // The scrubber runs on the thread that started it and reads one range at a time, ScrubBytes at ScrubOffset
+    // of ScrubSegment, whose table had ScrubGeneration; a range that mismatches is read again before it is reported
+    //
+    //
+    struct spdk_poller *ScrubPoller;
+    void *ScrubSPDKContext;
+    char *ScrubBuffer;
+    bool ScrubInFlight;
+    bool ScrubRetried;
+    SegmentIdT ScrubSegment;
+    SegmentSizeT ScrubOffset;
+    SegmentSizeT ScrubBytes;
+    uint32_t ScrubGeneration;
+};
+
+//
+// Set aside the checksum area at the end of the device, shrinking Sto->TotalSegments to the segments left for files
+//
+//
+ErrorCodeT ChecksumsInit(
+    struct DPUStorage* Sto
+);
+
+//
+// Release the checksums
+//
+//
+void ChecksumsDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Read the tables of the segments of the checksummed files, then run Callback
+//
+//
+void ChecksumsLoad(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ChecksumCallbackT Callback,
+    void *Arg
+);
+
+//
+// Give a segment newly allocated to a checksummed file an empty table, and write it out
+//
+//
+void ChecksumsReset(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment,
+    void *SPDKContext
+);
+
+//
+// Stop checking a segment taken from a checksummed file
+//
+//
+void ChecksumsDrop(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment
+);
+
+//
+// Forget the checksums of the blocks a write is about to change
+//
+//
+void ChecksumsForget(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+);
+
+//
+// Set the checksums of the blocks a write changed from the data it wrote, and call back once they are on the disk;
+// the callback runs at once if the file is not checksummed
+//
+//
+void ChecksumsPersist(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    const struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes,
+    ChecksumCallbackT Callback,
+    void *Arg,
+    void *SPDKContext
+);
+
+//
+// Whether the data a read got matches the checksums of the blocks it covers whole
+//
+//
+bool ChecksumsVerify(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    const struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes
+);
+
+//
+// Start scrubbing the checksummed segments on the current thread, and stop it
+//
+//
+void ChecksumsStartScrubber(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
+void ChecksumsStopScrubber(
+    struct DPUStorage* Sto
+);
+#endif
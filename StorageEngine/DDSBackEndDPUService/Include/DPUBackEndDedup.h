@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <openssl/sha.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_DEDUP
+//
+// Inline deduplication
+// The unit is the segment, the one unit the store maps by reference. A file writing a segment from its start
+// to its end in order, as a log, a copy or a restore does, has the segment hashed with SHA-256 by a stream
+// as its writes go by, on the DPU from the buffers of the host, so the host spends nothing on it;
+// OpenSSL hashes on the SHA-2 instructions of the Arm cores. Once every write of the segment is done,
+// its fingerprint is looked up: if another file has a segment of the same content, the slot is remapped to it
+// by the journal record of a snapshot copy, and the segment written is freed, the two files sharing the other
+// as a snapshot shares a segment, so that the first write of either to it copies it first; otherwise
+// the segment goes into the index. Any other write drops the segments it covers from the index,
+// by the epoch of the segment that each entry holds, as does freeing a segment, without taking any lock.
+// A stream starts only when no other write of its file is in flight, and a write that is not the next
+// of a stream ends it, so that the hash is of what the segment holds once the last write of the stream is done.
+// The index is in memory only, and starts empty after a restart
+//
+//
+
+//
+// A segment being hashed: the writes of Slot of FileId up to NextOffset have been counted, WritesInFlight of them
+// not done yet. Writes take Tickets in their order, and hash in it, each waiting for HashTurn to be its ticket;
+// a stream is free again once it is not InUse and the writes that took a ticket have hashed
+//
+//
+typedef struct DedupStream {
+    bool InUse;
+    uint32_t Generation;
+    FileIdT FileId;
+    SegmentIdT Slot;
+    SegmentSizeT NextOffset;
+    int WritesInFlight;
+    uint32_t NextTicket;
+    _Atomic uint32_t HashTurn;
+    SHA256_CTX Sha;
+} DedupStreamT;
+
+//
+// An entry of the index, valid while Epoch is the epoch of Segment
+//
+//
+typedef struct DedupIndexEntry {
+    uint8_t Fingerprint[SHA256_DIGEST_LENGTH];
+    SegmentIdT Segment;  // DDS_BACKEND_SEGMENT_INVALID if the entry is empty
+    uint32_t Epoch;
+} DedupIndexEntryT;
+
+struct DPUDedup {
+    pthread_mutex_t Mutex;  // taken to change the streams and the index
+    DedupStreamT Streams[DDS_BACKEND_DEDUP_STREAMS];
+
+    //
+    // The writes of each file in flight that no stream counts, and the streams of each file
+    //
+    //
+    int Untracked[DDS_MAX_FILES];
+    uint8_t ActiveStreams[DDS_MAX_FILES];
+
+    //
+    // Linear probing over IndexMask + 1 entries, with the position of the entry of each segment, -1 if it has none;
+    // the epoch of a segment changes whenever it is written outside a stream or freed
+    //
+    //
+    DedupIndexEntryT *Index;
+    uint32_t IndexMask;
+    int32_t *IndexOf;
+    _Atomic uint32_t *Epochs;
+
+    _Atomic uint64_t SegmentsHashed;
+    _Atomic uint64_t SegmentsDeduplicated;
+};
+
+//
+// Set up the streams and an empty index for the segments of the store
+//
+//
+ErrorCodeT DedupInit(
+    struct DPUStorage* Sto
+);
+
+//
+// Release the index
+//
+//
+void DedupDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Count a write about to be issued: hash it if it is the next write of a stream or starts one,
+// or drop the segments it covers from the index otherwise
+//
+//
+void DedupNoteWrite(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext
+);
+
+//
+// A write that was counted is done; the last write of a stream looks up the hash of its segment,
+// and remaps its slot to a segment of the same content or indexes it
+//
+//
+void DedupWriteDone(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext,
+    bool Success
+);
+
+//
+// Drop a segment that is freed from the index
+//
+//
+void DedupForgetSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment
+);
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "DPUBackEndStorage.h"
+#include "DPUBackEndSnapshot.h"
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+//
+// Background defragmentation
+// Files that grow while others are created and deleted end up with segments scattered over the device,
+// and a free space cut into short runs, so that large reads become many small I/Os and new files find no runs.
+// A poller on the thread that started it looks for a segment of a file that is not right after the segment
+// before it in the file while that place is free, and moves it there: the segment is copied a chunk per period
+// of the poller, one chunk in flight, then the slot is remapped by the journal record of a snapshot copy
+// and the old segment freed, which leaves a free run where it was.
+// Only files with no write in the last DDS_BACKEND_DEFRAG_COLD_MS are moved, and a move gives way to the writes:
+// it starts only if the file has no write in flight, and any write of the file cancels it, so foreground
+// writes never wait for a copy; the writes to the slot wait only for the remapping record to be on the disk.
+// Segments shared with snapshots, and the segments of checksummed files, whose checksums are by segment, stay put
+//
+//
+
+//
+// What a move is for: placing a segment after the one before it, or with tiering,
+// demoting a segment to the capacity bdev or recalling one from it
+//
+//
+typedef enum {
+    DEFRAG_MOVE_PLACE,
+    DEFRAG_MOVE_DEMOTE,
+    DEFRAG_MOVE_RECALL
+} DefragMoveKindT;
+
+//
+// The move of segment Old at Slot of a file to New, of the first Bytes of the segment that the file covers;
+// Cancelled and Remapping are changed under the lock of the file, and the writes to the slot wait in Waiters
+// once it is Remapping. Forgotten is set under the mutex once the file is deleted.
+// A demotion is Flushed once the capacity bdev has the copy, before the slot is remapped
+//
+//
+typedef struct DefragMove {
+    DefragMoveKindT Kind;
+    FileIdT FileId;
+    SegmentIdT Slot;
+    SegmentIdT Old;
+    SegmentIdT New;
+    SegmentSizeT Bytes;
+    SegmentSizeT NextOffset;
+    SegmentSizeT ChunkBytes;
+    bool Cancelled;
+    bool Failed;
+    bool Remapping;
+    bool Remapped;
+    bool Forgotten;
+    bool Flushed;
+    SnapshotWaiterT* WaitersHead;
+    SnapshotWaiterT* WaitersTail;
+} DefragMoveT;
+
+struct DPUDefrag {
+    pthread_mutex_t Mutex;  // taken to start and end the move, and to delete its file
+    struct spdk_poller *Poller;
+    void *SPDKContext;
+    char *Buffer;
+
+    //
+    // The move, if Active, with a chunk or its remapping in flight if InFlight,
+    // and where the search for the next one goes on
+    //
+    //
+    bool Active;
+    bool InFlight;
+    DefragMoveT Move;
+    FileIdT NextFile;
+    SegmentIdT NextSlot;
+
+    _Atomic uint64_t SegmentsMoved;
+    _Atomic uint64_t MovesCancelled;
+};
+
+//
+// Count a write of a file about to be issued
+//
+//
+static inline void
+DefragNoteWrite(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+){
+    struct DPUFile* file = GetFile(Sto, FileId);
+    if (file) {
+        atomic_fetch_add(&file->WritesInFlight, 1);
+        atomic_store_explicit(&file->LastWriteTicks, spdk_get_ticks(), memory_order_relaxed);
+    }
+}
+
+//
+// A write that was counted is done
+//
+//
+static inline void
+DefragWriteDone(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+){
+    struct DPUFile* file = GetFile(Sto, FileId);
+    if (file) {
+        atomic_fetch_sub(&file->WritesInFlight, 1);
+    }
+}
+
+//
+// Set up the defragmentation; there is none on zoned storage
+//
+//
+ErrorCodeT DefragInit(
+    struct DPUStorage* Sto
+);
+
+//
+// Release the defragmentation
+//
+//
+void DefragDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Start moving segments on the current thread, at DDS_BACKEND_DEFRAG_BYTES_PER_SECOND at most
+//
+//
+void DefragStart(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
+//
+// Stop moving segments, on the thread that started it
+//
+//
+void DefragStop(
+    struct DPUStorage* Sto
+);
+
+//
+// A write of a file that is moving a segment: cancel the move, or hold the write if it covers the slot
+// being remapped, and return whether it is held; the caller holds the lock of the file
+//
+//
+bool DefragHoldWrite(
+    struct DPUFile* File,
+    SnapshotWaiterT* Waiter
+);
+
+//
+// Drop the move of a file being deleted, before the file is freed
+//
+//
+void DefragForgetFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+);
+#endif
@@ -23,7 +23,7 @@ typedef struct DPUDirProperties {
     FileNumberT NumFiles;
     char Name[DDS_MAX_FILE_PATH];
     FileIdT Files[DDS_MAX_FILES_PER_DIR];
-    char __pad[488];
+    char __pad[440];
 } DPUDirPropertiesT;
 
 //
@@ -10,17 +10,41 @@
 
 
 //
-// Persistent properties of DPU file
+// A run of the segments of a file on disk: Count segments from First, or Count holes if First is DDS_BACKEND_SEGMENT_INVALID
+//
+//
+typedef struct DPUFileExtent {
+    SegmentIdT First;
+    SegmentIdT Count;
+} DPUFileExtentT;
+
+//
+// Persistent properties of DPU file; the segments are recorded as extents,
+// which EncodeFileExtents fills in before the properties go to the disk
 //
 //
 typedef struct DPUFileProperties {
         FileIdT Id;
         FilePropertiesT FProperties;
-        //remove const before SegmentIdT
-        SegmentIdT Segments[DDS_BACKEND_MAX_SEGMENTS_PER_FILE];
-        char __pad[472];
+        SegmentIdT NumExtents;
+        DPUFileExtentT Extents[DDS_BACKEND_MAX_EXTENTS_PER_FILE];
+        char __pad[4];
 } DPUFilePropertiesT;
 
+//
+// The slots of a file are kept in chunks of DDS_BACKEND_SEGMENT_CHUNK_SLOTS, each allocated when a segment is first
+// mapped in it and kept until the file is deleted, so that I/Os map their offsets without the lock while the file grows
+//
+//
+#define DDS_BACKEND_SEGMENT_CHUNK_SLOTS 1024
+#define DDS_BACKEND_SEGMENT_CHUNKS_PER_FILE \
+    ((DDS_BACKEND_MAX_SEGMENTS_PER_FILE + DDS_BACKEND_SEGMENT_CHUNK_SLOTS - 1) / DDS_BACKEND_SEGMENT_CHUNK_SLOTS)
+
+typedef struct DPUSegmentChunk {
+    SegmentIdT Segments[DDS_BACKEND_SEGMENT_CHUNK_SLOTS];
+    DiskSizeT Addresses[DDS_BACKEND_SEGMENT_CHUNK_SLOTS];
+} DPUSegmentChunkT;
+
 //
 // DPU file, highly similar with DDSBackEndFile
 //
@@ -28,8 +52,101 @@ typedef struct DPUFileProperties {
 struct DPUFile {
     DPUFilePropertiesT Properties;
     SegmentIdT NumSegments;
+
+    //
+    // The segment of each slot, DDS_BACKEND_SEGMENT_INVALID for a hole, and its disk address,
+    // indexed by file offset >> DDS_BACKEND_SEGMENT_SHIFT, so an I/O maps its offset with a shift, two loads and an add;
+    // NumExtents is the number of extents the slots take, kept within DDS_BACKEND_MAX_EXTENTS_PER_FILE
+    //
+    //
+    DPUSegmentChunkT* SegmentChunks[DDS_BACKEND_SEGMENT_CHUNKS_PER_FILE];
+    SegmentIdT NumExtents;
     //remove const before SegmentIdT
     SegmentSizeT AddressOnSegment;
+
+    //
+    // Guards the segments and the name against concurrent growth, shrinking and checkpoints,
+    // so that files don't contend with each other
+    //
+    //
+    pthread_mutex_t ModificationMutex;
+
+    //
+    // The last of the writes that are not sector aligned, which run one at a time, NULL if none is running
+    //
+    //
+    struct RMWContext* RMWTail;
+
+    //
+    // The last of the atomic operations of the file, which run one at a time, NULL if none is running
+    //
+    //
+    struct AtomicOpContext* AtomicOpTail;
+
+    //
+    // Serializes the appends of the file, each of which takes the end of the file as its offset and grows the file past it
+    //
+    //
+    pthread_mutex_t AppendMutex;
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // The last of the appends of the file on a zoned bdev, which run one at a time, NULL if none is running
+    //
+    //
+    struct ZoneAppendContext* AppendTail;
+#endif
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    //
+    // The copies of shared segments the file is making before writing them, with the writes waiting for each;
+    // CopiesInFlight counts them until their remapping is on the disk, and is read without the lock
+    //
+    //
+    struct SnapshotCopy* Copies;
+    atomic_int CopiesInFlight;
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    //
+    // The writes of the file in flight and when the last one was issued, read by the defragmentation without the lock,
+    // and the move of a segment of the file it is making, NULL if none; a move counts in CopiesInFlight
+    //
+    //
+    atomic_int WritesInFlight;
+    _Atomic uint64_t LastWriteTicks;
+    struct DefragMove* Move;
+#endif
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    //
+    // When the file was last read, or loaded, and whether it read a segment on the capacity bdev,
+    // which tiering then moves back; both read without the lock
+    //
+    //
+    _Atomic uint64_t LastReadTicks;
+    atomic_bool RecallWanted;
+#endif
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    //
+    // How the file is read (FileAccessHint), and the end of what was read ahead of its sequential reads
+    //
+    //
+    atomic_int AccessHint;
+    _Atomic FileSizeT ReadAheadEnd;
+#endif
+
+    //
+    // The I/O rate limit of the file in bytes per second, 0 if it has none, with its burst and weight;
+    // the workers of every connection take from the same tokens
+    //
+    //
+    uint64_t QoSBytesPerSecond;
+    uint64_t QoSBurstBytes;
+    uint32_t QoSWeight;
+    _Atomic int64_t QoSTokens;
+    _Atomic uint64_t QoSRefillTicks;
 };
 
 //
@@ -48,6 +165,12 @@ struct DPUFile* BackEndFileI(
     FileAttributesT FileAttributes
 );
 
+//
+// BackEndFile destructor
+//
+//
+void DeBackEndFile(struct DPUFile* File);
+
 const char* GetName(struct DPUFile* File);
 
 FileAttributesT GetAttributes(struct DPUFile* File);
@@ -71,22 +194,103 @@ void SetSize(
 );
 
 //
-// Set number of segments based on the allocation
+// Set the segments, their number and their disk addresses from the extents of the properties read from the disk;
+// the number covers holes up to the last segment; false if the extents are not valid or there is no memory for them
+//
+//
+bool SetNumAllocatedSegments(struct DPUFile* File);
+
+//
+// Record the segments of a file as extents in its properties, before they go to the disk
+// Not thread-safe
 //
 //
-void SetNumAllocatedSegments(struct DPUFile* File);
+void EncodeFileExtents(struct DPUFile* File);
 
 //
 // Allocate a segment
-// Assuming boundries were taken care of when the function is invoked
+// Assuming boundries were taken care of when the function is invoked;
+// false, with the file unchanged, if it would take too many extents or there is no memory for its slot
 // Not thread-safe
 //
 //
-void AllocateSegment(
+bool AllocateSegment(
     SegmentIdT NewSegment,
     struct DPUFile* File
 );
 
+//
+// Map a segment at a slot of a sparse file, the slots skipped up to it becoming holes
+// Assuming boundries were taken care of when the function is invoked;
+// false, with the file unchanged, if it would take too many extents or there is no memory for its slot
+// Not thread-safe
+//
+//
+bool MapSegment(
+    SegmentIdT Slot,
+    SegmentIdT NewSegment,
+    struct DPUFile* File
+);
+
+//
+// The segment at a slot below DDS_BACKEND_MAX_SEGMENTS_PER_FILE, DDS_BACKEND_SEGMENT_INVALID for a hole
+//
+//
+static inline SegmentIdT
+GetSegment(
+    struct DPUFile* File,
+    SegmentIdT Slot
+){
+    DPUSegmentChunkT* chunk = File->SegmentChunks[Slot / DDS_BACKEND_SEGMENT_CHUNK_SLOTS];
+    return chunk ? chunk->Segments[Slot % DDS_BACKEND_SEGMENT_CHUNK_SLOTS] : DDS_BACKEND_SEGMENT_INVALID;
+}
+
+//
+// The disk address of the segment at a slot that is not a hole
+//
+//
+static inline DiskSizeT
+GetSegmentAddress(
+    struct DPUFile* File,
+    SegmentIdT Slot
+){
+    return File->SegmentChunks[Slot / DDS_BACKEND_SEGMENT_CHUNK_SLOTS]->Addresses[Slot % DDS_BACKEND_SEGMENT_CHUNK_SLOTS];
+}
+
+//
+// Whether the segment slot that covers an offset is a hole, which reads as zeros;
+// only sparse files have holes
+//
+//
+static inline bool
+SegmentIsHole(
+    struct DPUFile* File,
+    SegmentIdT Slot
+){
+    return Slot >= File->NumSegments || GetSegment(File, Slot) == DDS_BACKEND_SEGMENT_INVALID;
+}
+
+static inline bool
+FileIsSparse(
+    struct DPUFile* File
+){
+    return (File->Properties.FProperties.FileAttributes & DDS_FILE_ATTRIBUTE_SPARSE) != 0;
+}
+
+static inline bool
+FileIsChecksummed(
+    struct DPUFile* File
+){
+    return (File->Properties.FProperties.FileAttributes & DDS_FILE_ATTRIBUTE_CHECKSUM) != 0;
+}
+
+static inline bool
+FileIsSnapshot(
+    struct DPUFile* File
+){
+    return (File->Properties.FProperties.FileAttributes & DDS_FILE_ATTRIBUTE_SNAPSHOT) != 0;
+}
+
 //
 // Deallocate a segment
 // Assuming boundries were taken care of when the function is invoked
@@ -94,3 +298,41 @@ void AllocateSegment(
 //
 //
 void DeallocateSegment(struct DPUFile* File);
+
+//
+// Set the I/O rate limit of a file, none if BytesPerSecond is 0
+//
+//
+void SetFileQoSLimit(
+    struct DPUFile* File,
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight
+);
+
+//
+// Whether a file may issue a request now: it has no limit or it has tokens left, after adding those of the time passed
+//
+//
+bool FileHasQoSTokens(struct DPUFile* File);
+
+//
+// Take the tokens of a request of a file, which may leave the file owing some
+//
+//
+void TakeFileQoSTokens(
+    struct DPUFile* File,
+    FileIOSizeT Bytes
+);
+
+//
+// Lock the file
+//
+//
+void LockFile(struct DPUFile* File);
+
+//
+// Unlock the file
+//
+//
+void UnlockFile(struct DPUFile* File);
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "DPUBackEndStorage.h"
+
+//
+// Metadata journal
+// Changes to directories and files are appended as compact records to a circular log on disk,
+// and an operation completes once its record is on the disk;
+// records appended while a journal write is in flight go out together in the next one (group commit).
+// The directory and file tables are written to their places by checkpoints in the background,
+// and the sector records the sequence they cover, so loading replays only the records after it.
+// Every record sets state rather than changing it, so replaying one that a checkpoint covers is harmless
+//
+//
+typedef enum {
+    DDS_JOURNAL_RECORD_CREATE_DIR = 1,
+    DDS_JOURNAL_RECORD_REMOVE_DIR,
+    DDS_JOURNAL_RECORD_CREATE_FILE,
+    DDS_JOURNAL_RECORD_DELETE_FILE,
+    DDS_JOURNAL_RECORD_MOVE_FILE,
+    DDS_JOURNAL_RECORD_FILE_SEGMENTS,
+    DDS_JOURNAL_RECORD_REMAP_SEGMENT
+} JournalRecordTypeT;
+
+typedef struct DPUJournalRecord {
+    uint64_t Sequence;
+    uint32_t Checksum;
+    uint16_t Type;
+    uint16_t NumIds;  // segment ids carried by a file segments record
+    union {
+        struct {
+            DirIdT Id;
+            DirIdT Parent;
+            char Name[DDS_MAX_FILE_PATH];
+        } Dir;
+        struct {
+            FileIdT Id;
+            DirIdT DirId;
+            DirIdT NewDirId;  // only for moving a file
+            FileAttributesT Attributes;
+            char Name[DDS_MAX_FILE_PATH];
+        } File;
+
+        //
+        // The file has NumSegments segments, the last NumIds of which are Ids, and Size bytes
+        //
+        //
+        struct {
+            FileIdT Id;
+            SegmentIdT NumSegments;
+            FileSizeT Size;
+            SegmentIdT Ids[DDS_BACKEND_JOURNAL_SEGMENTS_PER_RECORD];
+        } Segments;
+
+        //
+        // The segment at Slot of the file, Old shared with snapshots, is replaced by its copy in New
+        //
+        //
+        struct {
+            FileIdT Id;
+            SegmentIdT Slot;
+            SegmentIdT Old;
+            SegmentIdT New;
+        } Remap;
+        char __pad[DDS_BACKEND_JOURNAL_RECORD_SIZE - 16];
+    };
+} DPUJournalRecordT;
+
+AssertStaticDPUStorage(sizeof(DPUJournalRecordT) == DDS_BACKEND_JOURNAL_RECORD_SIZE, 5);
+AssertStaticDPUStorage(DDS_BACKEND_JOURNAL_OFFSET % DDS_BACKEND_PAGE_SIZE == 0 &&
+    DDS_BACKEND_JOURNAL_BYTES % DDS_BACKEND_PAGE_SIZE == 0, 6);
+AssertStaticDPUStorage(DDS_BACKEND_SECTOR_SIZE + DDS_MAX_DIRS * sizeof(DPUDirPropertiesT) <= DDS_BACKEND_JOURNAL_OFFSET &&
+    DDS_BACKEND_JOURNAL_OFFSET + DDS_BACKEND_JOURNAL_BYTES <=
+    DDS_BACKEND_METADATA_BYTES - DDS_MAX_FILES * sizeof(DPUFilePropertiesT), 7);
+
+//
+// Callback for a journaled operation, run once its record is on the disk
+//
+//
+typedef void (*JournalCallback)(
+    bool Success,
+    ContextT Context
+);
+
+typedef struct JournalWaiter {
+    uint64_t Sequence;
+    JournalCallback Callback;
+    ContextT Context;
+    struct JournalWaiter* Next;
+} JournalWaiterT;
+
+struct DPUJournal {
+    //
+    // A DMA-able copy of the whole journal; record of sequence s is at (s - 1) % DDS_BACKEND_JOURNAL_RECORDS
+    //
+    //
+    DPUJournalRecordT* Records;
+    uint64_t NextSequence;
+    uint64_t FlushedSequence;   // every record up to this is on the disk
+    uint64_t FlushingSequence;  // the journal write in flight covers up to this, 0 if there is none
+    void *FlushSPDKContext;
+    JournalWaiterT* WaitersHead;
+    JournalWaiterT* WaitersTail;
+
+    //
+    // The tables on the disk cover every record up to CheckpointedSequence;
+    // a running checkpoint writes the entries in CheckpointDirs/CheckpointFiles one by one,
+    // then the sector saying they cover CheckpointSequence
+    //
+    //
+    uint64_t CheckpointedSequence;
+    uint64_t CheckpointSequence;
+    bool CheckpointRunning;
+    int CheckpointNext;
+    void *CheckpointSPDKContext;
+    bool DirtyDirs[DDS_MAX_DIRS];
+    bool DirtyFiles[DDS_MAX_FILES];
+    bool CheckpointDirs[DDS_MAX_DIRS];
+    bool CheckpointFiles[DDS_MAX_FILES];
+    char* CheckpointBuffer;  // the table entry being written, copied under Mutex
+    char* Sector;
+
+    //
+    // Taken to append records, and to add or remove directories and files,
+    // so that a checkpoint copies an entry that is not being freed;
+    // it's taken before the lock of a directory or file, never after
+    //
+    //
+    pthread_mutex_t Mutex;
+};
+
+//
+// Set up an empty journal
+//
+//
+ErrorCodeT JournalInit(
+    struct DPUStorage* Sto
+);
+
+//
+// Release the journal
+//
+//
+void JournalDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Apply a directory or file record to the tables in memory;
+// used for both new operations and replay, and tolerant of records already applied
+//
+//
+ErrorCodeT JournalApply(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+);
+
+//
+// Append a record and write it out with the next group;
+// Callback, if not NULL, runs once the record is on the disk
+//
+//
+ErrorCodeT JournalCommit(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record,
+    JournalCallback Callback,
+    ContextT Context,
+    void *SPDKContext
+);
+
+//
+// Journal the segments and size of a file, the segments from FirstSegment on being new;
+// Callback, if not NULL, runs once every record is on the disk
+//
+//
+ErrorCodeT JournalFileSegments(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    struct DPUFile* File,
+    SegmentIdT FirstSegment,
+    JournalCallback Callback,
+    ContextT Context,
+    void *SPDKContext
+);
+
+//
+// Read the journal and apply the records after the checkpoint, then run Callback
+//
+//
+ErrorCodeT JournalReplay(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    JournalCallback Callback,
+    ContextT Context
+);
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "DPUBackEnd.h"
+
+//
+// Leases of files to the front ends connected to the back end, kept by the control plane alone:
+// a file has one write lease or any number of read leases, each lasting DDS_BACKEND_LEASE_MS from its last renewal.
+// A lease in the way of another is revoked rather than broken: its holder learns of it when it renews,
+// flushes what it caches of the file and gives the lease back, and the lease ends on its own if the holder doesn't.
+// Leases are not checked by the data plane; front ends that share files take them before they cache the files
+//
+//
+typedef struct FileLease {
+    uint8_t Mode[DDS_BACKEND_MAX_CLIENTS];  // FileLeaseMode of each client, 0 if it holds none
+    bool Revoked[DDS_BACKEND_MAX_CLIENTS];
+    uint64_t Expiry[DDS_BACKEND_MAX_CLIENTS];  // in ticks
+    uint64_t WriterWaitEnd;  // ticks until which read leases are held for a client waiting to write
+    int WriterWaiting;  // that client, -1 if none
+} FileLeaseT;
+
+//
+// Grant a lease of a file to a client, or renew it, in Mode; the leases of other clients in the way are revoked
+// and DDS_ERROR_CODE_LEASE_HELD returned, for the client to ask again once they are given back
+//
+//
+ErrorCodeT
+LeaseAcquire(
+    FileIdT FileId,
+    int ClientId,
+    int Mode,
+    uint32_t* TermMs
+);
+
+//
+// Give back the lease of a file a client holds
+//
+//
+ErrorCodeT
+LeaseRelease(
+    FileIdT FileId,
+    int ClientId
+);
+
+//
+// Renew the leases a client holds, except the revoked ones, which go in Revoked; returns how many did
+//
+//
+uint32_t
+LeaseRenew(
+    int ClientId,
+    FileIdT* Revoked,
+    uint32_t MaxRevoked,
+    uint32_t* TermMs
+);
+
+//
+// Drop the leases of a client that disconnected
+//
+//
+void
+LeaseDropClient(
+    int ClientId
+);
+
+//
+// Drop the leases of a file that is deleted
+//
+//
+void
+LeaseDropFile(
+    FileIdT FileId
+);
+
+//
+// Release the lease table
+//
+//
+void
+LeasesDestroy();
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "BackEndTypes.h"
+#include "FileService.h"
+
+#ifdef OPT_FILE_SERVICE_REPLICATION
+//
+// A write forwarded to the peer, followed by its data from REPLICA_HEADER_BYTES on,
+// so that the data stays sector aligned; Seq carries the send slot of the write in its low 16 bits
+//
+//
+typedef struct {
+    uint64_t Seq;
+    FileIdT FileId;
+    FileIOSizeT Bytes;
+    FileSizeT Offset;
+    int32_t Durable;
+} ReplicaWriteHeader;
+
+//
+// The acknowledgement of a forwarded write by the peer
+//
+//
+typedef struct {
+    uint64_t Seq;
+    ErrorCodeT Result;
+} ReplicaAckMsg;
+
+#define REPLICA_HEADER_BYTES DDS_BACKEND_SECTOR_SIZE
+#define REPLICA_MSG_BYTES (REPLICA_HEADER_BYTES + REPLICATION_MAX_WRITE_BYTES)
+#define REPLICA_SEQ_SLOT_MASK 0xFFFFull
+
+//
+// Where a write context is: a write that isn't forwarded stays in REPLICA_STATE_NONE; a forwarded one waits
+// for both its local write and the peer, each of which swaps in its outcome, and the one that finds
+// the outcome of the other publishes the response
+//
+//
+#define REPLICA_STATE_NONE 0
+#define REPLICA_STATE_WAIT 1
+#define REPLICA_STATE_LOCAL_DONE 2
+#define REPLICA_STATE_LOCAL_FAILED 3
+#define REPLICA_STATE_PEER_DONE 4
+#define REPLICA_STATE_PEER_FAILED 5
+
+//
+// Take the writes of the peer, and connect every data plane agent to it, waiting up to
+// REPLICATION_CONNECT_TIMEOUT_SECONDS for the peer to come up
+//
+//
+int
+ReplicaStart(
+    FileService* FS
+);
+
+//
+// Stop taking the writes of the peer and close the connections to it
+//
+//
+void
+ReplicaStop(void);
+
+//
+// Forward a write to the peer on the channel of a data plane agent, before the write is submitted;
+// a write that can't be forwarded fails once its local write is done
+//
+//
+void
+ReplicaForward(
+    uint32_t Channel,
+    DataPlaneRequestContext* Context,
+    const BuffMsgF2BReqHeader* Request
+);
+
+//
+// Take the acknowledgements of the peer on the channel of a data plane agent, by that agent.
+// Return 0, or an error if the channel broke
+//
+//
+int
+ReplicaPoll(
+    uint32_t Channel
+);
+
+//
+// Join the local outcome of a forwarded write of Bytes with its copy at the peer.
+// Return whether the caller publishes the response now, with the outcome of both in Success
+//
+//
+bool
+ReplicaJoinLocal(
+    DataPlaneRequestContext* Context,
+    bool* Success,
+    FileIOSizeT Bytes
+);
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+//
+// Copy on write
+// A snapshot maps the segments of its file as they are when it's taken, which the segments count as sharers,
+// so taking one costs the journal records of its segments and no I/O.
+// The first write of the file to a shared segment has the segment copied to a new one, by the thread of the write
+// and in chunks, then the slot remapped to the copy by a journal record; the writes to the segment wait meanwhile
+// and are issued again on their threads once the record is on the disk, while the other writes of the file go on.
+// The old segment stays with the snapshots, and is freed by the last file to drop it
+//
+//
+
+//
+// A write waiting for the copy of a shared segment it covers; a gathered write has Iov rather than SourceBuffer
+//
+//
+typedef struct SnapshotWaiter {
+    FileIdT FileId;
+    FileSizeT Offset;
+    FileIOSizeT Bytes;
+    SplittableBufferT *SourceBuffer;
+    struct iovec *Iov;
+    int IovCnt;
+    DiskIOCallback Callback;
+    ContextT Context;
+    void *SPDKContext;
+    struct spdk_thread *Thread;
+    bool Failed;
+    struct SnapshotWaiter* Next;
+} SnapshotWaiterT;
+
+//
+// Whether a write of Bytes at Offset may need a shared segment copied first, checked without locks:
+// it covers a shared segment, or one on the capacity bdev with tiering, or the file is copying one.
+// The segments are read before the copies, so a write that finds a slot remapped also finds its copy in flight
+//
+//
+static inline bool
+WriteNeedsSegmentCopy(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+){
+    if (!Bytes) {
+        return false;
+    }
+
+    SegmentIdT lastSlot = (SegmentIdT)((Offset + Bytes - 1) >> DDS_BACKEND_SEGMENT_SHIFT);
+    for (SegmentIdT slot = (SegmentIdT)(Offset >> DDS_BACKEND_SEGMENT_SHIFT);
+        slot <= lastSlot && slot < File->NumSegments; slot++) {
+        SegmentIdT segment = GetSegment(File, slot);
+        if (segment != DDS_BACKEND_SEGMENT_INVALID &&
+            (SegmentIsCold(segment) || atomic_load(&Sto->AllSegments[segment].Sharers))) {
+            return true;
+        }
+    }
+
+    return atomic_load(&File->CopiesInFlight) != 0;
+}
+
+//
+// Hold a write until the shared segments it covers are copied, starting the copy of one on this thread if none is;
+// *Held is false if the write may go on now after all
+//
+//
+ErrorCodeT
+HoldWriteForSegmentCopy(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    const SnapshotWaiterT* Write,
+    bool* Held
+);
+
+//
+// Issue held writes again on their threads, or fail them
+//
+//
+void
+ResumeHeldWrites(
+    SnapshotWaiterT* Waiters,
+    bool Success
+);
+#endif
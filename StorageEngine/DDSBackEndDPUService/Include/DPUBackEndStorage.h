@@ -18,6 +18,22 @@
 #include "DPUBackEndFile.h"
 #include "bdev.h"
 
+//
+// Check the layout of the metadata at the compile time:
+// directories grow up from the second sector and files grow down from DDS_BACKEND_METADATA_BYTES
+//
+//
+#define AssertStaticDPUStorage(e, num) \
+    enum { AssertStaticDPUStorage__##num = 1/(e) }
+
+AssertStaticDPUStorage(sizeof(DPUDirPropertiesT) % DDS_BACKEND_SECTOR_SIZE == 0, 0);
+AssertStaticDPUStorage(sizeof(DPUFilePropertiesT) % DDS_BACKEND_SECTOR_SIZE == 0, 1);
+AssertStaticDPUStorage(DDS_BACKEND_SECTOR_SIZE + DDS_MAX_DIRS * sizeof(DPUDirPropertiesT) <=
+    DDS_BACKEND_METADATA_BYTES - DDS_MAX_FILES * sizeof(DPUFilePropertiesT), 2);
+AssertStaticDPUStorage(DDS_BACKEND_SEGMENT_SIZE >= ONE_MB && DDS_BACKEND_SEGMENT_SIZE <= 64 * ONE_MB, 3);
+AssertStaticDPUStorage(DDS_BACKEND_CAPACITY % DDS_BACKEND_SEGMENT_SIZE == 0 &&
+    DDS_BACKEND_RESERVED_SEGMENTS < DDS_BACKEND_MAX_SEGMENTS, 4);
+
 //
 // Used to manage the status of each slot in SPDK buffer
 //
@@ -31,13 +47,137 @@ struct PerSlotContext{
     // e.g. if there are 4 in a batch, the first should have value 4, the last 1.
     RequestIdT BatchSize;
     RequestIdT IndexBase;
+    RequestIdT IndexSpan;  // slots from IndexBase the batch wraps around in
     SPDKContextT *SPDKContext;  // thread specific SPDKContext
     DataPlaneRequestContext *Ctx;
     atomic_ushort CallbacksToRun;
     atomic_ushort CallbacksRan;
     FileIOSizeT BytesIssued;
+    char *Buff;  // staging buffer of a non zero copy I/O
+    int BuffClass;  // size class the staging buffer comes from
+
+    //
+    // The writes of a batch coalesced into one led by this slot, including itself
+    //
+    //
+    RequestIdT NumCoalesced;
+    struct PerSlotContext *Coalesced[DDS_BACKEND_WRITE_COALESCE_MAX_REQUESTS];
+    struct iovec CoalescedIov[2 * DDS_BACKEND_WRITE_COALESCE_MAX_REQUESTS];
+    int CoalescedIovCnt;
+
+    //
+    // The flush a durable write waits for before it is acknowledged
+    //
+    //
+    BdevFlushWaiterT FlushWaiter;
+
+    //
+    // The place of a write in the writes in flight on its thread, which fenced reads wait for
+    //
+    //
+    bool WriteInFlight;
+    uint64_t WriteSeq;
+    struct PerSlotContext *PrevWrite;
+    struct PerSlotContext *NextWrite;
+
+    //
+    // The place of a request held back by the rate limit of its file, and its virtual start time
+    //
+    //
+    struct PerSlotContext *NextHeld;
+    uint64_t QoSStartTime;
+
+    //
+    // The atomic operation the request runs, which holds the other operations of its file until it is done, NULL if none
+    //
+    //
+    struct AtomicOpContext *AtomicOp;
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    //
+    // The ticket of a read that fills the block cache, 0 if it bypasses the cache
+    //
+    //
+    uint64_t CacheTicket;
+#endif
+
+#ifdef OPT_FILE_SERVICE_SCAN
+    //
+    // The progress of a scan: the bytes of its range after the chunk being read, the bytes it has output,
+    // and the chunk, which is read into the staging buffer of the slot
+    //
+    //
+    FileIOSizeT ScanBytesLeft;
+    FileIOSizeT ScanBytesOut;
+    SplittableBufferT ScanChunk;
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEDUP
+    //
+    // Whether the deduplication counted the write, and the stream that hashed it, -1 if none did
+    //
+    //
+    bool DedupNoted;
+    int DedupStream;
+    uint32_t DedupGeneration;
+#endif
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    //
+    // The staging slot of an atomic write, NULL if it has none, and its place among the writes waiting for one;
+    // AtomicStaged goes on with the write once it is staged
+    //
+    //
+    struct AtomicWriteSlot *AtomicSlot;
+    struct PerSlotContext *NextAtomic;
+    void (*AtomicStaged)(bool Success, void *Arg);
+#endif
 };
 
+//
+// The order of reads behind writes on a worker thread: the writes in flight, oldest first,
+// and the fences that came before the writes numbered from WriteSeq on; a fence is dropped
+// once every write before it is done
+//
+//
+typedef struct ActiveReadFence {
+    ReadFenceT Fence;
+    uint64_t WriteSeq;
+} ActiveReadFenceT;
+
+typedef struct DataPlaneOrder {
+    struct PerSlotContext *OldestWrite;
+    struct PerSlotContext *NewestWrite;
+    uint64_t NextWriteSeq;
+    int NumFences;
+    ActiveReadFenceT Fences[DDS_BACKEND_MAX_READ_FENCES];
+} DataPlaneOrderT;
+
+//
+// The requests of a file a worker holds back until the file has tokens, oldest first,
+// and the virtual time at which the last request of the file finishes under its weight
+//
+//
+typedef struct QoSFileQueue {
+    struct PerSlotContext *Head;
+    struct PerSlotContext *Tail;
+    uint64_t FinishTime;
+    FileIdT FileId;
+} QoSFileQueueT;
+
+//
+// The rate limits of files on a worker: the queue of each file and those holding requests,
+// which are issued by start-time fair queueing, the earliest virtual start first among the files with tokens
+//
+//
+typedef struct DataPlaneQoS {
+    QoSFileQueueT Files[DDS_MAX_FILES];
+    QoSFileQueueT *Backlogged[DDS_MAX_FILES];
+    int NumBacklogged;
+    uint64_t VirtualTime;
+    struct spdk_poller *Poller;
+} DataPlaneQoST;
+
 //
 // Context for each Write I/O operation in the back end, same with BackEndIOContext
 // Reason we need this: we may actually need multiple async bdev writes to fulfil the request
@@ -78,6 +218,91 @@ struct DPUStorage* BackEndStorage();
 
 void DeBackEndStorage(struct DPUStorage* Sto);
 
+//
+// Look up a directory by id, NULL if there is none
+//
+//
+struct DPUDir* GetDir(
+    struct DPUStorage* Sto,
+    DirIdT DirId
+);
+
+//
+// Make sure the table has an entry for a directory id
+//
+//
+ErrorCodeT ReserveDir(
+    struct DPUStorage* Sto,
+    DirIdT DirId
+);
+
+//
+// Set the directory of a reserved id
+//
+//
+void SetDir(
+    struct DPUStorage* Sto,
+    DirIdT DirId,
+    struct DPUDir* Dir
+);
+
+//
+// Look up a file by id, NULL if there is none
+//
+//
+struct DPUFile* GetFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+);
+
+//
+// Make sure the table has an entry for a file id
+//
+//
+ErrorCodeT ReserveFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+);
+
+//
+// Set the file of a reserved id
+//
+//
+void SetFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    struct DPUFile* File
+);
+
+//
+// Look up a file by name, DDS_FILE_INVALID if there is none
+//
+//
+FileIdT FindFileByName(
+    struct DPUStorage* Sto,
+    const char* FileName
+);
+
+//
+// Add a file to the name index
+//
+//
+void IndexFileName(
+    struct DPUStorage* Sto,
+    const char* FileName,
+    FileIdT FileId
+);
+
+//
+// Remove a file from the name index
+//
+//
+void UnindexFileName(
+    struct DPUStorage* Sto,
+    const char* FileName,
+    FileIdT FileId
+);
+
 //
 // Context used when Initializing Storage
 //
@@ -91,11 +316,6 @@ struct InitializeCtx {
     //
     SPDKContextT *SPDKContext;
     char *tmpSectorBuf;  // actually the buff that stores the reserved segment
-    char *tmpPageBuf;  // zeroed page to write
-    atomic_size_t TargetProgress;
-    atomic_size_t CurrentProgress;
-    size_t PagesLeft;
-    size_t NumPagesWritten;
     struct DPUDir* RootDir;
     struct InitializeFailureStatus *FailureStatus;
 };
@@ -106,8 +326,7 @@ struct InitializeCtx {
 //
 ErrorCodeT ReadFromDiskAsyncZC(
     BufferT DstBuffer,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     ContextT Context,
@@ -117,8 +336,7 @@ ErrorCodeT ReadFromDiskAsyncZC(
 
 ErrorCodeT ReadFromDiskAsyncNonZC(
     FileIOSizeT NonZCBuffOffset,  // how many we already read
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
@@ -129,8 +347,7 @@ ErrorCodeT ReadFromDiskAsyncNonZC(
 ErrorCodeT ReadvFromDiskAsyncZC(
     struct iovec *Iov,
     int iovcnt,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     ContextT Context,
@@ -142,8 +359,7 @@ ErrorCodeT ReadvFromDiskAsyncNonZC(
     struct iovec *Iov,
     int iovcnt,
     FileIOSizeT NonZCBuffOffset,  // how many we already read
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
@@ -157,8 +373,7 @@ ErrorCodeT ReadvFromDiskAsyncNonZC(
 //
 ErrorCodeT WriteToDiskAsyncZC(
     BufferT SrcBuffer,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     ContextT Context,
@@ -174,8 +389,7 @@ ErrorCodeT WriteToDiskAsyncZC(
 ErrorCodeT WriteToDiskAsyncNonZC(
     BufferT SrcBuffer,
     FileIOSizeT NonZCBuffOffset,  // how many we already read
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
@@ -186,8 +400,7 @@ ErrorCodeT WriteToDiskAsyncNonZC(
 ErrorCodeT WritevToDiskAsyncZC(
     struct iovec *Iov,
     int iovcnt,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
@@ -199,8 +412,7 @@ ErrorCodeT WritevToDiskAsyncNonZC(
     struct iovec *Iov,
     int iovcnt,
     FileIOSizeT NonZCBuffOffset,  // how many we already read
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
@@ -208,6 +420,19 @@ ErrorCodeT WritevToDiskAsyncNonZC(
     void *SPDKContext
 );
 
+//
+// Zero a range on the disk asynchronously
+//
+//
+ErrorCodeT ZeroDiskAsync(
+    DiskSizeT DiskAddress,
+    DiskSizeT Bytes,
+    DiskIOCallback Callback,
+    ContextT Context,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
 //
 // Retrieve all segments on the disk
 //
@@ -220,6 +445,110 @@ ErrorCodeT RetrieveSegments(struct DPUStorage* Sto);
 //
 void ReturnSegments(struct DPUStorage* Sto);
 
+//
+// Take a given segment off the bitmap for a file
+//
+//
+void ClaimSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId,
+    FileIdT FileId
+);
+
+//
+// Give the last segments of a file back to the bitmap, or queue them to be unmapped first
+//
+//
+void DeallocateSegmentsOfFile(
+    struct DPUFile* File,
+    SegmentIdT NumSegments,
+    struct DPUStorage* Sto
+);
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+//
+// Claim a free segment for a file, after the one at Hint if it's free
+//
+//
+ErrorCodeT ClaimNewSegment(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT Hint,
+    SegmentIdT* Segment
+);
+
+//
+// Drop a segment a file no longer maps, giving it back if no other file maps it either
+//
+//
+void ReleaseSegmentOfFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT SegmentId
+);
+
+//
+// Take over a shared segment that only this file maps anymore; return whether the segment is the file's own now
+//
+//
+bool AdoptSharedSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId,
+    FileIdT FileId
+);
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+//
+// Claim the segment at SegmentId for a file if it's free, and no other
+//
+//
+bool ClaimSegmentAt(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT SegmentId
+);
+
+//
+// Whether a segment is free, read without locks
+//
+//
+bool SegmentIsFree(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+);
+#endif
+
+//
+// Whether a segment id is one of the store or, with tiering, of the capacity bdev
+//
+//
+bool SegmentIdIsValid(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+);
+
+#ifdef OPT_FILE_SERVICE_TRIM
+//
+// Mark the segments freed so far as freed by records already appended to the journal,
+// then unmap those whose records are on the disk
+//
+//
+void SealFreedSegments(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
+//
+// Unmap freed segments whose records are on the disk, then give them back to the bitmap
+//
+//
+void TrimFreedSegments(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+#endif
+
 //
 // Load all directories and files from the reserved segment
 //
@@ -287,14 +616,10 @@ struct InitializeFailureStatus {
 //
 //
 struct LoadDirectoriesAndFilesCtx {
-    char *TmpSectorBuffer;  // the reserved segment is read into this
-    size_t DirLoopIndex;
-    size_t FileLoopIndex;
-    DPUDirPropertiesT *DirOnDisk;
-    DPUFilePropertiesT *FileOnDisk;
-    atomic_int *LoadedDirs;
-    atomic_int *LoadedFiles;
-    struct InitializeFailureStatus *FailureStatus;  // points to the member in struct InitializeCtx
+    DPUDirPropertiesT *DirTable;  // DMA-able copies of the tables, file f is at DDS_MAX_FILES - 1 - f
+    DPUFilePropertiesT *FileTable;
+    atomic_int PendingReads;
+    atomic_bool HasFailed;
     SPDKContextT *SPDKContext;
 };
 
@@ -357,6 +682,7 @@ ErrorCodeT ChangeFileSize(
     FileIdT FileId,
     FileSizeT NewSize,
     struct DPUStorage* Sto,
+    void *SPDKContext,
     CtrlMsgB2FAckChangeFileSize *Resp
 );
 
@@ -371,6 +697,61 @@ ErrorCodeT GetFileSize(
     CtrlMsgB2FAckGetFileSize *Resp
 );
 
+//
+// Flush the device under a file, sharing the flush with the other flushes of the thread
+// 
+//
+ErrorCodeT FlushFile(
+    FileIdT FileId,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    CtrlMsgB2FAckFlushFile *Resp
+);
+
+//
+// Set the I/O rate limit of a file
+// 
+//
+ErrorCodeT SetFileQoS(
+    FileIdT FileId,
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight,
+    struct DPUStorage* Sto,
+    CtrlMsgB2FAckSetFileQoS *Resp
+);
+
+//
+// Set how a file is read (FileAccessHint), or read a range of it into the block cache for ACCESS_HINT_WILLNEED
+// 
+//
+ErrorCodeT SetFileAccessHint(
+    FileIdT FileId,
+    int32_t Hint,
+    FileSizeT Offset,
+    FileSizeT Bytes,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    CtrlMsgB2FAckSetFileAccessHint *Resp
+);
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+//
+// Snapshot a file into a new read-only file that shares its segments
+// Assuming the id of the snapshot has been computed by host
+//
+//
+ErrorCodeT CreateSnapshot(
+    FileIdT FileId,
+    FileIdT SnapshotFileId,
+    DirIdT DirId,
+    const char* SnapshotName,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ControlPlaneHandlerCtx *HandlerCtx
+);
+#endif
+
 
 //
 // Async read from a file
@@ -386,6 +767,62 @@ ErrorCodeT ReadFile(
     void *SPDKContext
 );
 
+//
+// Give an append of Bytes the end of a file as its offset, growing the file past it, so that the append is then
+// written as any other write; appends of the file take their offsets one at a time, and so never overlap
+//
+//
+ErrorCodeT ReserveAppend(
+    FileIdT FileId,
+    FileIOSizeT Bytes,
+    FileSizeT* Offset,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
+//
+// Callback of the read of a word by an atomic operation
+//
+//
+typedef void (*AtomicOpCallbackT)(ErrorCodeT Result, uint64_t Word, void *Arg);
+
+//
+// Read the word of a file at Offset for the atomic operation of SlotContext, once the operations of the file
+// before it are done, and call back with it; a word of a hole is 0. The operation holds the next ones
+// until AtomicOpDone, so that it writes the word before they read it
+//
+//
+ErrorCodeT ReadAtomicWord(
+    FileIdT FileId,
+    FileSizeT Offset,
+    AtomicOpCallbackT Callback,
+    struct PerSlotContext* SlotContext,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
+//
+// Let the next atomic operation of the file run; nothing to do if SlotContext has none
+//
+//
+void AtomicOpDone(
+    struct PerSlotContext* SlotContext
+);
+
+//
+// Allocate the segments a write needs and grow the file to cover it
+//
+//
+ErrorCodeT
+ExtendFileForWrite(
+    FileIdT FileId,
+    struct DPUFile* file,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
 //
 // Async write to a file
 // 
@@ -400,6 +837,23 @@ ErrorCodeT WriteFile(
     void *SPDKContext
 );
 
+//
+// Async write of adjacent writes coalesced into one, with zero copy;
+// the range must be sector aligned and on a single segment
+//
+//
+ErrorCodeT WriteFileGather(
+    FileIdT FileId,
+    FileSizeT Offset,
+    struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes,
+    DiskIOCallback Callback,
+    ContextT Context,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+);
+
 //
 // Get file properties by file id
 // 
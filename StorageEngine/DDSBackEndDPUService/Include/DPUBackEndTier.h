@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_TIERING
+//
+// Tiering of cold segments
+// A capacity bdev, such as a namespace of a capacity server attached over NVMe-oF, holds the segments of files
+// that were not read nor written for G_TIER_COLD_DAYS. Its segments have the ids past DDS_BACKEND_MAX_SEGMENTS,
+// which the files map as any other, so the slot of a file is its stub and the journal records the moves;
+// the disk address of such a segment has DDS_BACKEND_TIER_ADDRESS, by which the bdev layer sends its I/O there.
+// The segments are moved by the mover of the defragmentation, a chunk per period, and remapped once the capacity
+// bdev is flushed. A read of a cold segment is served from the capacity bdev at once, and has the file moved back
+// in the background from its first segment; a write of one waits for the segment to be copied back, as a write
+// of a segment shared with a snapshot does. When a file was last read is kept in memory alone,
+// so a restart counts every file as read then
+//
+//
+
+extern uint32_t G_TIER_COLD_DAYS;
+
+struct DPUTier {
+    pthread_mutex_t Mutex;  // taken to claim and release segments
+    SegmentIdT NumSegments;
+    SegmentIdT FreeSegments;
+    SegmentIdT NextFree;
+    uint64_t *FreeBits;  // a bit set for each free segment, from the first of the capacity bdev
+    uint64_t ColdTicks;
+
+    //
+    // Where the search for the next segment to move goes on
+    //
+    //
+    FileIdT NextFile;
+    SegmentIdT NextSlot;
+
+    _Atomic uint64_t SegmentsDemoted;
+    _Atomic uint64_t SegmentsRecalled;
+};
+
+//
+// Note a read of a file, which is to be moved back if it reads a cold segment
+//
+//
+static inline void
+TierNoteRead(
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+){
+    atomic_store_explicit(&File->LastReadTicks, spdk_get_ticks(), memory_order_relaxed);
+    if (!Bytes || atomic_load_explicit(&File->RecallWanted, memory_order_relaxed)) {
+        return;
+    }
+
+    SegmentIdT lastSlot = (SegmentIdT)((Offset + Bytes - 1) >> DDS_BACKEND_SEGMENT_SHIFT);
+    for (SegmentIdT slot = (SegmentIdT)(Offset >> DDS_BACKEND_SEGMENT_SHIFT);
+        slot <= lastSlot && slot < File->NumSegments; slot++) {
+        if (SegmentIsCold(GetSegment(File, slot))) {
+            atomic_store_explicit(&File->RecallWanted, true, memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+//
+// Set up the segments of the capacity bdev of the context, if it has one; there is none on zoned storage
+//
+//
+ErrorCodeT TierInit(
+    struct DPUStorage* Sto,
+    SPDKContextT* SPDKContext
+);
+
+//
+// Release the segments of the capacity bdev
+//
+//
+void TierDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Take a given segment of the capacity bdev off the free ones, used when loading files and replaying the journal
+//
+//
+void TierClaimSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+);
+
+//
+// Claim a free segment of the capacity bdev for a file
+//
+//
+bool TierClaimFreeSegment(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT* Segment
+);
+
+//
+// Give a segment of the capacity bdev back
+//
+//
+void TierReleaseSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+);
+
+//
+// Look for a segment to move, a bounded number of slots per run: a cold segment of a file that was read
+// since it was moved to be moved back, or a segment of a file that is cold to be moved to the capacity bdev;
+// called with the mutex of the defragmentation held
+//
+//
+bool TierFindMove(
+    struct DPUStorage* Sto,
+    struct DPUFile** File,
+    FileIdT* FileId,
+    SegmentIdT* Slot,
+    bool* Recall
+);
+#endif
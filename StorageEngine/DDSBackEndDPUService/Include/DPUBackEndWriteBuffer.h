@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "DPUBackEndStorage.h"
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+//
+// Write buffer
+// A small sector aligned write within a window of its file is copied into the window in the memory of the DPU
+// and acknowledged at once; the writes of a window merge there, and the workers write its dirty sectors back
+// in the background, a run of them at a time, as writes of their own that go through the whole write path,
+// so that snapshots, deduplication, defragmentation, checksums and the block cache see them as any other.
+// A window leaves the buffer once it is clean. A read that the sectors of a window cover whole is answered
+// from there; a read or a write that only partly overlaps what the buffer holds, or that the buffer doesn't take,
+// waits for the windows it overlaps to be written back, which it has done first.
+// The writes of files with a rate limit, durable writes and writes to snapshots or zoned storage
+// are not buffered, and writes are not coalesced while the buffer is on, as it merges them itself
+//
+//
+AssertStaticDPUStorage(DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES % DDS_BACKEND_SECTOR_SIZE == 0 &&
+    DDS_BACKEND_WRITE_BUFFER_MAX_WRITE_BYTES <= DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES, 10);
+
+#define DDS_BACKEND_WRITE_BUFFER_WINDOW_WORDS ((DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS + 63) / 64)
+
+typedef struct WriteBufferWindow {
+    //
+    // The write back in flight, a write of its own in a pool slot of the worker that issued it, which finishes it;
+    // first, as the context is aligned to a cache line
+    //
+    //
+    DataPlaneRequestContext FlushContext;
+    DataPlaneRequestColdContext FlushCold;
+    BuffMsgF2BReqHeader FlushRequest;
+    BuffMsgB2FAckHeader FlushResponse;
+    SPDKContextT *FlushOwner;  // NULL if no write back is in flight
+    struct PerSlotContext *FlushSlot;
+
+    FileIdT FileId;
+    FileSizeT Offset;  // of the window in its file
+    uint64_t Valid[DDS_BACKEND_WRITE_BUFFER_WINDOW_WORDS];  // the sectors held
+    uint64_t Dirty[DDS_BACKEND_WRITE_BUFFER_WINDOW_WORDS];  // the sectors changed since they were written back
+    uint64_t Flushing[DDS_BACKEND_WRITE_BUFFER_WINDOW_WORDS];  // the sectors of the write back in flight
+    uint64_t DirtyTicks;  // when the window got dirty, 0 if it is clean
+    bool Urgent;  // a request waits for the window to be written back
+    int32_t Next;  // in the chain of its bucket, or in the free list
+    uint32_t UsedIndex;  // in the windows used of its shard
+    char *Data;
+} WriteBufferWindowT;
+
+typedef struct WriteBufferShard {
+    pthread_mutex_t Mutex;
+    uint32_t NumWindows;
+    WriteBufferWindowT *Windows;
+    char *Data;  // the data of window w at w * DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES, DMA-able
+    int32_t *Buckets;
+    uint32_t BucketMask;
+    int32_t FreeList;
+    uint32_t NumFree;
+    uint32_t *Used;  // the windows in use, which the workers go through
+    uint32_t NumUsed;
+} WriteBufferShardT;
+
+struct DPUWriteBuffer {
+    WriteBufferShardT Shards[DDS_BACKEND_WRITE_BUFFER_SHARDS];
+    _Atomic uint32_t WindowsUsed;
+    uint64_t FlushTicks;
+};
+
+//
+// What a read finds in the buffer
+//
+//
+typedef enum {
+    WriteBufferReadMiss = 0,  // nothing, the read goes to the device
+    WriteBufferReadHit,  // all of it, copied to the read
+    WriteBufferReadWait  // part of it, the read waits for it to be written back
+} WriteBufferReadT;
+
+//
+// The size of the buffer, from the config, 0 to turn it off
+//
+//
+extern uint64_t G_WRITE_BUFFER_BYTES;
+
+//
+// Create the buffer of Bytes, none if Bytes is too small for a window per shard
+//
+//
+ErrorCodeT WriteBufferInit(
+    struct DPUStorage* Sto,
+    uint64_t Bytes
+);
+
+//
+// Release the buffer; what it holds is lost
+//
+//
+void WriteBufferDestroy(
+    struct DPUStorage* Sto
+);
+
+//
+// Take the write of a request into the buffer and complete it; false if the buffer doesn't take it
+//
+//
+bool WriteBufferAbsorb(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext
+);
+
+//
+// Whether the buffer holds any of Bytes at Offset of a file, having what it holds of them written back soon if so
+//
+//
+bool WriteBufferHolds(
+    struct DPUWriteBuffer* Buffer,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+);
+
+//
+// Copy a read of Dest->TotalSize bytes at Offset of a file from the buffer into Dest if the buffer holds all of it
+//
+//
+WriteBufferReadT WriteBufferRead(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    FileSizeT Offset,
+    SplittableBufferT* Dest
+);
+
+//
+// Drop what the buffer holds of a file from Offset on, as the file is deleted or shrinks
+//
+//
+void WriteBufferForgetFile(
+    struct DPUWriteBuffer* Buffer,
+    FileIdT FileId,
+    FileSizeT Offset
+);
+
+//
+// Poller of a worker that writes back the windows that are due, and finishes the write backs it issued
+//
+//
+int WriteBufferPoller(
+    void* Ctx
+);
+#endif
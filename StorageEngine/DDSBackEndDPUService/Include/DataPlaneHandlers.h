@@ -20,6 +20,28 @@ void DataPlaneRequestHandler(
     void* Ctx
 );
 
+//
+// Poller of a worker that issues the requests it holds back for the rate limits of their files
+//
+//
+int
+DataPlaneQoSPoller(
+    void* Ctx
+);
+
+#ifdef OPT_FILE_SERVICE_SCAN
+//
+// Load a scan function, compiling OffloadScan.c in CodePath; called by the control thread only,
+// and the function stays loaded until the back end exits
+//
+//
+ErrorCodeT
+LoadScanFunction(
+    const char* CodePath,
+    uint16_t* ScanId
+);
+#endif
+
 //
 // Handler for a read request
 //
@@ -61,3 +83,14 @@ void WriteHandlerCallback(
     bool Success,
     ContextT Context
 );
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+//
+// Write back a run of a window of the write buffer, as a write of its own in a pool slot
+//
+//
+void
+WriteBufferFlushHandler(
+    struct PerSlotContext* SlotContext
+);
+#endif
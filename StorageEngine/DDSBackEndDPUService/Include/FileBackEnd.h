@@ -7,6 +7,7 @@
 
 #include <infiniband/ib.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <rdma/rdma_cma.h>
 #include <stdatomic.h>
 #include <stdlib.h>
@@ -15,7 +16,9 @@
 #include "FileService.h"
 #include "ControlPlaneHandler.h"
 #include "DataPlaneHandlers.h"
+#include "DDSTrace.h"
 #include "DDSTypes.h"
+#include "LatencyHelper.h"
 #include "DPUBackEnd.h"
 #include "DPUBackEndDir.h"
 #include "DPUBackEndFile.h"
@@ -24,6 +27,8 @@
 #include "Zmalloc.h"
 
 #include "MsgTypes.h"
+#include "OffloadResponseRingBuffer.h"
+#include "PayloadCompression.h"
 #include "Protocol.h"
 #include "RingBufferPolling.h"
 
@@ -37,8 +42,30 @@
 #define CTRL_RECV_WR_ID 1
 
 #define BUFF_COMPQ_DEPTH 16
-#define BUFF_SENDQ_DEPTH 16
+#define BUFF_DIRECT_READ_SENDQ_DEPTH BUFF_MSG_DIRECT_READ_MAX_SEGMENTS
+#define BUFF_OFFLOAD_RESPONSE_SENDQ_DEPTH (4 * OFFLOAD_RESPONSE_RINGS)
+#define BUFF_SENDQ_DEPTH (16 + BUFF_DIRECT_READ_SENDQ_DEPTH + BUFF_OFFLOAD_RESPONSE_SENDQ_DEPTH)
 #define BUFF_RECVQ_DEPTH 16
+#define BUFF_LANE_RECVQ_DEPTH 1
+#define BUFF_LANE_COMPQ_DEPTH ((BUFF_CONN_MAX_QUEUE_PAIRS - 1) * BUFF_SENDQ_DEPTH)
+
+//
+// Lanes that carry each kind of DMA of a buffer; without that many lanes, requests and responses
+// fall back to the primary queue pair and direct read data to the lane of the responses.
+// Request reads and head writes are ordered among themselves, and so are response writes and
+// tail writes, so each kind stays on one queue pair; direct read data must land before the
+// responses of the reads, so responses wait for it when it goes through another queue pair;
+// responses notify the host with an immediate, which needs the receives of the primary queue pair
+//
+//
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+#define BUFF_REQUEST_LANE 1
+#define BUFF_RESPONSE_LANE 0
+#else
+#define BUFF_REQUEST_LANE 0
+#define BUFF_RESPONSE_LANE 1
+#endif
+#define BUFF_DIRECT_READ_LANE 2
 #define BUFF_SEND_WR_ID 0
 #define BUFF_RECV_WR_ID 1
 #define BUFF_READ_REQUEST_META_WR_ID 2
@@ -53,15 +80,178 @@
 #define BUFF_READ_RESPONSE_DATA_SPLIT_WR_ID 11
 #define BUFF_WRITE_RESPONSE_DATA_WR_ID 12
 #define BUFF_WRITE_RESPONSE_DATA_SPLIT_WR_ID 13
+#define BUFF_WRITE_DIRECT_READ_DATA_WR_ID 14
+#define BUFF_READ_REQUEST_INLINE_WR_ID 15
+#define BUFF_SYNC_OFFLOAD_RESPONSES_WR_ID 16
+#define BUFF_WRITE_REQUEST_PARKED_WR_ID 17
+#define BUFF_WRITE_RESPONSE_HANDOVER_WR_ID 18
+
+//
+// Handover to a new build (DDS_RING_HANDOVER_OFFSET): the signal that starts it, and how long the back end
+// waits for the hosts to disconnect before it quits anyway
+//
+//
+#define BACKEND_HANDOVER_SIGNAL SIGUSR2
+#define BACKEND_HANDOVER_TIMEOUT_SECONDS 60
+
+//
+// Completions handled per round for a buffer of each priority class;
+// high-priority buffers are also handled before the others in every round
+//
+//
+#define BUFF_HIGH_PRIORITY_CQ_BUDGET 4
+#define BUFF_NORMAL_PRIORITY_CQ_BUDGET 1
+
+//
+// Adapt the completions handled per round to the load each agent sees, between the budgets above
+// and BUFF_CQ_BUDGET_MAX: every BUFF_CQ_BUDGET_ADAPT_ROUNDS rounds, the budget of a priority class grows by one
+// if more than BUFF_CQ_BUDGET_GROW_PERCENT of the polls of its buffers used all of it, and shrinks by one
+// if fewer than BUFF_CQ_BUDGET_SHRINK_PERCENT did; both are halved instead if the rounds took longer
+// than BUFF_CQ_ROUND_TARGET_US on average, so that the storage completions and buffer state changes
+// the agent handles once per round are not held up behind long batches of requests
+//
+//
+#define BUFF_CQ_BUDGET_ADAPTIVE
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+#define BUFF_CQ_BUDGET_MAX 32
+#define BUFF_CQ_BUDGET_ADAPT_ROUNDS 1024
+#define BUFF_CQ_BUDGET_GROW_PERCENT 50
+#define BUFF_CQ_BUDGET_SHRINK_PERCENT 10
+#define BUFF_CQ_ROUND_TARGET_US 20
+#endif
+
+//
+// Request bytes at the head of the ring fetched together with the request meta data
+// while requests are arriving, so that a batch of small writes needs no separate data read
+//
+//
+#define BACKEND_REQUEST_INLINE_READ
+#define BACKEND_REQUEST_INLINE_BYTES 1024
+
+//
+// Pipelining of request batches: the meta data read that looks for batch N+1 is posted together with
+// the data read of batch N instead of after its head write, and the requests of a batch are handed to
+// the file service every BACKEND_REQUEST_SUB_BATCH_SIZE requests while the rest are being parsed
+//
+//
+#define BACKEND_REQUEST_PIPELINE
+#define BACKEND_REQUEST_SUB_BATCH_SIZE 16
+
+//
+// Coalescing of response batches: a checked batch waits for the batches behind it while more responses
+// are coming, so that up to BACKEND_RESPONSE_COALESCE_MAX_BATCHES batches of at most
+// BACKEND_RESPONSE_COALESCE_MAX_BYTES bytes in total go out with one poll of the host and one DMA write;
+// the wait of each connection adapts between BACKEND_RESPONSE_COALESCE_MIN_DELAY_US and
+// BACKEND_RESPONSE_COALESCE_MAX_DELAY_US, and a batch with nothing behind it goes out at once
+//
+//
+#define BACKEND_RESPONSE_COALESCING
+#define BACKEND_RESPONSE_COALESCE_MAX_BATCHES 4
+#define BACKEND_RESPONSE_COALESCE_MAX_BYTES 1048576
+#define BACKEND_RESPONSE_COALESCE_MIN_DELAY_US 1
+#define BACKEND_RESPONSE_COALESCE_MAX_DELAY_US 32
+
+#if BACKEND_RESPONSE_COALESCE_MAX_BATCHES > DDS_MAX_COMPLETION_BUFFERING
+#error "Each coalesced batch is notified with a receive the host has posted for completions"
+#endif
+
+//
+// Compression of the data of reads whose hosts ask for it: reads of BACKEND_COMPRESSION_MIN_BYTES
+// to BACKEND_COMPRESSION_MAX_BYTES are compressed on the Arm cores when this saves at least
+// 1 / 2^BACKEND_COMPRESSION_MIN_SAVING_SHIFT of their bytes
+//
+//
+#define BACKEND_COMPRESSION_ENABLED
+
+//
+// Packing of write acks: the successful writes that follow each other in a finished response batch
+// go back to the host as one response carrying their request ids instead of a response each
+//
+//
+#define BACKEND_WRITE_ACK_PACKING
+
+//
+// Where the hops of traced requests (DDSTrace.h) are appended when a connection goes away
+//
+//
+#define BACKEND_TRACE_PATH "/var/run/ddsbow_backend_trace.csv"
+#define BACKEND_COMPRESSION_MIN_BYTES 1024
+#define BACKEND_COMPRESSION_MAX_BYTES 1048576
+#define BACKEND_COMPRESSION_MIN_SAVING_SHIFT 3
 
 #define BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT 1
 #define BUFF_READ_DATA_SPLIT_STATE_SPLIT 0
 
+//
+// Staging space for reads whose data is written directly into host pages
+//
+//
+#define BACKEND_DIRECT_READ_STAGING_SIZE 16777216
+
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+//
+// Mirrored rings are backed by huge pages if they can be, and placed at this alignment
+// so that SPDK can take them as DMA memory
+//
+//
+#define BACKEND_RING_MIRROR_ALIGNMENT 2097152
+#endif
+
+//
+// Let the DMA agent, which handles connections and control messages, sleep on the CM channel and the
+// completion channels of the control connections after DMA_AGENT_IDLE_ROUNDS rounds without work,
+// waking up at least every DMA_AGENT_WAIT_TIMEOUT_MS to check for termination;
+// the data plane agents keep polling, since they find requests by reading the host rings
+//
+//
+// #define DMA_AGENT_EVENT_DRIVEN
+#define DMA_AGENT_IDLE_ROUNDS 65536
+#define DMA_AGENT_WAIT_TIMEOUT_MS 100
+
+//
+// Load the cache table from a snapshot at start, so that offloads hit right after a restart,
+// and let the DMA agent, the one thread that changes the table, save it every
+// CACHE_TABLE_SNAPSHOT_INTERVAL_SECONDS if it has changed, and once more when the back end exits
+//
+//
+#define CACHE_TABLE_SNAPSHOT_ENABLED
+#ifdef CACHE_TABLE_SNAPSHOT_ENABLED
+#define CACHE_TABLE_SNAPSHOT_PATH "/home/ubuntu/DDSCacheTableSnapshot"
+#define CACHE_TABLE_SNAPSHOT_INTERVAL_SECONDS 60
+#endif
+
+//
+// Let the DMA agent print the counters of the cache table every CACHE_TABLE_STATS_INTERVAL_SECONDS
+// if they are compiled in (CACHE_TABLE_STATS_ENABLED), and once more when the back end exits
+//
+//
+#define CACHE_TABLE_STATS_INTERVAL_SECONDS 60
+
+//
+// Count the work of the hot path of every buffer connection (BuffConnStatsT), and serve the counters
+// of all connections as text to whoever connects to BACKEND_STATS_SOCKET_PATH, e.g.
+// "socat - UNIX-CONNECT:/var/run/ddsbow_backend_stats.sock"
+//
+//
+#define BACKEND_STATS_ENABLED
+#ifdef BACKEND_STATS_ENABLED
+#define BACKEND_STATS_SOCKET_PATH "/var/run/ddsbow_backend_stats.sock"
+#define BACKEND_STATS_BATCH_BUCKETS 10
+#define BACKEND_STATS_POLL_MS 100
+#endif
+
+//
+// Contexts of the responses in the ring with out-of-order responses: every context in use can have
+// a response and the response it is sent again with waiting to be checked
+//
+//
+#define BUFF_RESPONSE_CONTEXTS(PollQueueDepth) (2 * (PollQueueDepth))
+#define BUFF_RESPONSE_CONTEXT_RESENT DDS_MAX_POLL_QUEUE_DEPTH
+
 #define CONN_STATE_AVAILABLE 0
 #define CONN_STATE_OCCUPIED 1
 #define CONN_STATE_CONNECTED 2
-
-#define DATA_PLANE_WEIGHT 10
+#define CONN_STATE_CLOSING 3
 
 #define DDS_STORAGE_FILE_BACKEND_VERBOSE
 
@@ -125,6 +315,14 @@ typedef struct {
     //
     ControlPlaneRequestContext PendingControlPlaneRequest;
 
+    //
+    // The batch being run, one operation at a time as the pending request;
+    // no batch is running if BatchNumOps is 0
+    //
+    //
+    uint32_t BatchNumOps;
+    uint32_t BatchNextOp;
+
 #ifdef CREATE_DEFAULT_DPU_FILE
     //
     // Signals, reqs, and responses for creating a default file on DPU with specified size
@@ -138,6 +336,64 @@ typedef struct {
 #endif
 } CtrlConnConfig;
 
+//
+// The state of a direct read, indexed the same as the pending data-plane request
+//
+//
+typedef struct {
+    bool IsDirect;
+    uint32_t AccessToken;
+    uint32_t NumSegments;
+    BuffMsgDirectReadSegment Segments[BUFF_MSG_DIRECT_READ_MAX_SEGMENTS];
+    char* Data;
+    RingSizeT StagingBytes;
+} DirectReadContext;
+
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+//
+// The data of a ring, in a memory file mapped at the start of twice its largest size;
+// once the ring size is known, the file is mapped again right after the ring, so that the bytes
+// past its end are its first ones. Only the first copy is registered with the NIC,
+// since the DMAs of the ring still go to it in two parts
+//
+//
+typedef struct {
+    int Fd;
+    size_t MaxBytes;
+    size_t MirroredBytes;  // the size of the ring once it is mirrored, 0 until then
+    bool Huge;
+    bool SPDKRegistered;
+} MirroredRingT;
+#endif
+
+#ifdef BACKEND_STATS_ENABLED
+//
+// Counters of the hot path of a buffer connection: the agent of the connection is the only writer,
+// and the stats endpoint reads them as they are, so a snapshot may be a few events apart across counters.
+// Ring occupancy is sampled in bytes whenever a batch of requests is executed, and the completion latency
+// is from when the back end takes a request to when its response is ready, in ns
+//
+//
+typedef struct {
+    uint64_t RequestsParsed;
+    uint64_t RequestBatches;
+    uint64_t BatchSizes[BACKEND_STATS_BATCH_BUCKETS];  // batches of up to 1, 2, 4, ... requests, the last of more
+    uint64_t BatchRequestsParsed;  // RequestsParsed when the last batch was counted
+    uint64_t RequestRingBytesSum;
+    uint64_t RequestRingBytesMax;
+    uint64_t ResponseRingBytesSum;
+    uint64_t ResponseRingBytesMax;
+    uint64_t RdmaPosts;
+    uint64_t RdmaWorkRequests;
+    uint64_t CqCompletions;
+    uint64_t EmptyCqPolls;
+    uint64_t IOsSubmitted;
+    uint64_t IOsCompleted;
+    uint64_t RequestStartCycles[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    LatencyHistogram CompletionLatencies;
+} BuffConnStatsT;
+#endif
+
 //
 // The configuration for a buffer connection
 //
@@ -145,7 +401,13 @@ typedef struct {
 typedef struct {
     uint32_t BuffId;
     uint32_t CtrlId;
-    uint8_t State;
+
+    //
+    // Connection events move the state from the control agent, and the data plane agent
+    // that owns a connected buffer tears it down once the control agent marks it closing
+    //
+    //
+    _Atomic uint8_t State;
 
     //
     // Setup for a DMA channel
@@ -157,6 +419,23 @@ typedef struct {
     struct ibv_pd *PDomain;
     struct ibv_qp *QPair;
 
+    //
+    // Lanes: lane 0 is QPair and the others are queue pairs the host connects to this buffer later,
+    // sharing its protection domain and completion queue; NumLanes counts the lanes in a row that are up
+    //
+    //
+    struct rdma_cm_id *LaneCmIds[BUFF_CONN_MAX_QUEUE_PAIRS];
+    struct ibv_qp *LaneQPairs[BUFF_CONN_MAX_QUEUE_PAIRS];
+    int NumLanes;
+
+    //
+    // Lanes of a connected buffer that the control agent saw come up or go down,
+    // for the data plane agent to start or stop using
+    //
+    //
+    atomic_uint LanesOpened;
+    atomic_uint LanesClosed;
+
     //
     // Setup for control messages
     //
@@ -179,10 +458,16 @@ typedef struct {
     struct ibv_sge RequestDMAReadDataSgl;
     struct ibv_mr *RequestDMAReadDataMr;
     char* RequestDMAReadDataBuff;
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    MirroredRingT RequestMirror;
+#endif
     struct ibv_send_wr RequestDMAReadDataSplitWr;
     struct ibv_sge RequestDMAReadDataSplitSgl;
     RingSizeT RequestDMAReadDataSize;
     RingSizeT RequestDMAReadDataSplitState;
+    struct ibv_send_wr RequestDMAReadInlineWr;
+    struct ibv_sge RequestDMAReadInlineSgl;
+    int RequestInlineArmed;
     struct ibv_send_wr RequestDMAReadMetaWr;
     struct ibv_sge RequestDMAReadMetaSgl;
     struct ibv_mr *RequestDMAReadMetaMr;
@@ -191,6 +476,12 @@ typedef struct {
     struct ibv_sge RequestDMAWriteMetaSgl;
     struct ibv_mr *RequestDMAWriteMetaMr;
     char* RequestDMAWriteMetaBuff;
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+    struct ibv_send_wr RequestDMAWriteParkedWr;
+    struct ibv_sge RequestDMAWriteParkedSgl;
+    uint32_t RequestIdlePolls;
+    int RequestSleeping;
+#endif
 
     //
     // Setup for data exchange for responses
@@ -200,6 +491,9 @@ typedef struct {
     struct ibv_sge ResponseDMAWriteDataSgl;
     struct ibv_mr *ResponseDMAWriteDataMr;
     char* ResponseDMAWriteDataBuff;
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    MirroredRingT ResponseMirror;
+#endif
     struct ibv_send_wr ResponseDMAWriteDataSplitWr;
     struct ibv_sge ResponseDMAWriteDataSplitSgl;
     RingSizeT ResponseDMAWriteDataSize;
@@ -212,6 +506,11 @@ typedef struct {
     struct ibv_sge ResponseDMAWriteMetaSgl;
     struct ibv_mr *ResponseDMAWriteMetaMr;
     char* ResponseDMAWriteMetaBuff;
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+    struct ibv_send_wr ResponseDMANotifyWr;
+    struct ibv_send_wr ResponseDMAWriteHandoverWr;
+    struct ibv_sge ResponseDMAWriteHandoverSgl;
+#endif
 
     //
     // Ring buffers
@@ -221,10 +520,18 @@ typedef struct {
     struct ResponseRingBufferBackEnd ResponseRing;
 
     //
-    // Pending data-plane requests
+    // The queue depth of the poll, which the arrays indexed by the contexts of its requests are allocated for
+    // when the buffer is set up
     //
     //
-    DataPlaneRequestContext PendingDataPlaneRequests[DDS_MAX_OUTSTANDING_IO];
+    RequestIdT PollQueueDepth;
+
+    //
+    // Pending data-plane requests, a cache line each, and the parts of them that most requests leave alone
+    //
+    //
+    DataPlaneRequestContext* PendingDataPlaneRequests;
+    DataPlaneRequestColdContext* PendingDataPlaneRequestsCold;
 
     //
     // Next available context for the incoming request
@@ -232,6 +539,132 @@ typedef struct {
     //
     //
     RequestIdT NextRequestContext;
+
+    //
+    // Context of the next response to be checked for completion
+    //
+    //
+    RequestIdT NextCompletionContext;
+
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    //
+    // Out-of-order responses: the contexts of the responses in the ring, in their order, so that contexts
+    // still held by deferred responses can be skipped, with BUFF_RESPONSE_CONTEXT_RESENT for the responses
+    // sent again; the deferred responses, in the ring order, each with
+    // its context, where it starts and whether it is yet to be sent again, since the ring is not reused from
+    // the oldest of them on until it is; and whether the response batch being checked has deferred responses,
+    // which must not be moved
+    //
+    //
+    RequestIdT* ResponseContexts;
+    RequestIdT ResponseContextsHead;
+    RequestIdT ResponseContextsTail;
+    bool* ResponseDeferred;
+    RequestIdT* DeferredResponses;
+    int* DeferredResponseOffsets;
+    bool* DeferredResponsePending;
+    RequestIdT DeferredResponsesHead;
+    RequestIdT NumDeferredResponses;
+    bool ResponseBatchDeferred;
+#endif
+
+    //
+    // Direct reads: per-context state, the staging buffer their data is read into,
+    // and the number of direct writes to the host that are still in flight
+    //
+    //
+    DirectReadContext* DirectReads;
+
+    //
+    // Reads whose data the host asked to be compressed, the bytes of the next response batch
+    // to write back once compression or packed write acks have shrunk it,
+    // and whether the batch being checked has compressed reads or completed writes
+    //
+    //
+    bool* CompressReads;
+    FileIOSizeT ResponseDMAWriteBytes;
+    bool ResponseBatchCompressed;
+    bool ResponseBatchWrites;
+
+    //
+    // The tagged request ids of traced requests, 0 for the others, and the trace ring of the connection,
+    // created with its first traced request; only the agent of the connection records into it
+    //
+    //
+    RequestIdT* TraceKeys;
+    DDSTraceRingT* TraceRing;
+
+    //
+    // Checked response batches held to be sent together, from TailC, or the end of the batches a send
+    // in flight covers, to the start of the batch being checked, the bytes of them to write back,
+    // and when they go out at the latest
+    //
+    //
+    int ResponseHeldEnd;
+    RequestIdT ResponseHeldBatches;
+    FileIOSizeT ResponseHeldWriteBytes;
+    int ResponseSendEnd;
+    RequestIdT ResponseSendBatches;
+    bool ResponseSendInFlight;
+#ifdef BACKEND_RESPONSE_COALESCING
+    uint64_t ResponseHoldDeadline;
+    uint64_t ResponseHoldTicks;
+#endif
+    struct ibv_mr *DirectReadStagingMr;
+    char* DirectReadStagingBuff;
+    RingSizeT DirectReadStagingHead;
+    RingSizeT DirectReadStagingUsed;
+    int DirectReadWritesInFlight;
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    //
+    // Offload response rings bound to this buffer: where the host has them, the rings and the tails and heads
+    // registered, the tail last written and the head last read of each ring, the tails of the sync in flight,
+    // and whether one is
+    //
+    //
+    uint64_t OffloadRingsAddr;
+    uint32_t OffloadRingsAccessToken;
+    struct ibv_mr *OffloadRingsMr;
+    struct ibv_mr *OffloadRingsMetaMr;
+    uint64_t OffloadRingsMeta[OFFLOAD_RESPONSE_RINGS][2];
+    uint64_t OffloadRingsEnd[OFFLOAD_RESPONSE_RINGS];
+    bool OffloadRingsSyncInFlight;
+#endif
+
+#ifdef BACKEND_STATS_ENABLED
+    //
+    // Counters of the hot path, for the stats endpoint
+    //
+    //
+    BuffConnStatsT Stats;
+#endif
+
+    //
+    // Priority class of the host poll behind this buffer
+    //
+    //
+    uint32_t Priority;
+
+    //
+    // The fence of reads taken since the last request, for the next one to carry
+    //
+    //
+    ReadFenceT PendingFence;
+
+    //
+    // Protocol of the rings of this buffer
+    //
+    //
+    RingProtocolT RingProtocol;
+
+    //
+    // Handover: whether the request ring is no longer fetched from, and whether the handover mark is being written (1)
+    // or has been written (2)
+    //
+    //
+    int RequestsQuiesced;
+    int HandedOver;
 } BuffConnConfig;
 
 //
@@ -250,6 +683,37 @@ typedef struct {
     FileService* FS;
 } BackEndConfig;
 
+//
+// A data plane agent: a thread that polls the buffer connections whose ids it owns,
+// i.e., those equal to its id modulo the number of agents
+//
+//
+typedef struct {
+    BackEndConfig* Config;
+    uint32_t AgentId;
+    pthread_t Thread;
+
+    //
+    // The buffer connection the next round of completion polling starts from
+    //
+    //
+    uint32_t NextBuffToPoll;
+
+    //
+    // The completions handled per round for a buffer of each priority class, high first;
+    // with BUFF_CQ_BUDGET_ADAPTIVE, the polls of buffers and those that used all of the budget,
+    // and the rounds and their start since the budgets were last adapted
+    //
+    //
+    int CqBudget[2];
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+    uint32_t CqPolls[2];
+    uint32_t CqSaturated[2];
+    uint32_t Rounds;
+    uint64_t WindowStartTicks;
+#endif
+} DataPlaneAgentConfig;
+
 //
 // The entry point for the back end,
 // but SPDK requires all the parameters be in just one struct, like the following
@@ -6,6 +6,18 @@
 #include "DPUBackEnd.h"
 #include "DPUBackEndStorage.h"
 
+//
+// Slots handed out by FindFreeSpace: the DPU slots between those of the host polls and the control plane slot;
+// host requests take the slots of their indices with GetFreeSpace.
+// Heads of free lists keep an index in their low bits and a tag against ABA in their high bits
+//
+//
+#define ZMALLOC_POOL_SLOT_FIRST DDS_DPU_IO_SLOT_NUMBER_BASE
+#define ZMALLOC_POOL_SLOT_END DDS_CONTROL_PLANE_IO_SLOT_NUMBER
+#define ZMALLOC_NO_SLOT 0xFFFF
+#define ZMALLOC_SLOT_MASK 0xFFFFu
+#define ZMALLOC_TAG_ONE 0x10000u
+
 void AllocateSpace(void *arg);
 
 void FreeSingleSpace(struct PerSlotContext* Ctx);
@@ -23,4 +35,15 @@ GetFreeSpace(
     SPDKContextT *SPDKContext,
     DataPlaneRequestContext* Context,
     RequestIdT Index
-);
\ No newline at end of file
+);
+
+char*
+AcquireSlotBuffer(
+    struct PerSlotContext* Ctx,
+    FileIOSizeT Bytes
+);
+
+void
+ReleaseSlotBuffer(
+    struct PerSlotContext* Ctx
+);
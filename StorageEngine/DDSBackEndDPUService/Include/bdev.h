@@ -6,23 +6,85 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "DPUBackEnd.h"
 
 extern char *G_BDEV_NAME;
+extern bool G_FORMAT_OLDER_STORE;
+#ifdef OPT_FILE_SERVICE_TIERING
+extern char *G_TIER_BDEV_NAME;
+#endif
+
+//
+// A lock-free list of free indices: the head keeps an index in its low bits and a tag against ABA in its high bits,
+// and each index links to the next one
+//
+//
+typedef struct IndexFreeList {
+    atomic_uint Head;
+    atomic_ushort *Next;
+} IndexFreeListT;
+
+//
+// A slab of DMA-able staging buffers of one size class
+//
+//
+typedef struct SPDKBuffSlab {
+    char *Base;
+    uint64_t BufferBytes;
+    IndexFreeListT FreeBuffers;
+} SPDKBuffSlabT;
+
+//
+// A waiter for a flush of the bdev, called back once a flush that started after it was queued completes
+//
+//
+typedef void (*BdevFlushCallbackT)(bool Success, void *Arg);
+
+typedef struct BdevFlushWaiter {
+    BdevFlushCallbackT Callback;
+    void *Arg;
+    struct BdevFlushWaiter *Next;
+} BdevFlushWaiterT;
+
+//
+// Group commit of the flushes of a context: one flush runs at a time and covers the waiters queued before it started,
+// and the waiters queued while it runs share the next one
+//
+//
+typedef struct BdevFlushGroup {
+    bool InFlight;
+    BdevFlushWaiterT *Flushing;
+    BdevFlushWaiterT *WaitingHead;
+    BdevFlushWaiterT *WaitingTail;
+    struct spdk_bdev_io_wait_entry Wait;
+} BdevFlushGroupT;
 
 typedef struct SPDKContext {
 	struct spdk_bdev *bdev;
 	struct spdk_bdev_desc *bdev_desc;
 	struct spdk_io_channel *bdev_io_channel;  // channel would be per thread unique, meaning this whole context should also be
-	char *buff;
-	unsigned long long buff_size;
+	SPDKBuffSlabT *BuffSlabs;  // size classes of staging buffers for the non zero copy paths, shared by all worker contexts
 	char *bdev_name;
 	struct spdk_bdev_io_wait_entry bdev_io_wait;
     void *cookie;  // just in case, a completion cookie that could be anything
-    struct PerSlotContext *SPDKSpace; // an array to record the status of each slot memory inside buff.
-    pthread_mutex_t SpaceMutex; // used for SPDKSpace
+    struct PerSlotContext *SPDKSpace; // an array to record the status of each slot.
+    IndexFreeListT *FreeSlots; // lock-free list of free pool slots in SPDKSpace, shared by all worker contexts
+    BdevFlushGroupT FlushGroup; // flushes of the bdev issued on this thread
+    struct DataPlaneOrder *Order; // the order of reads behind writes on this thread
+    struct DataPlaneQoS *QoS; // the requests this thread holds back for the rate limits of their files
+    struct AtomicWriteLane *AtomicLane; // the staging slots of the atomic writes of this thread, taken by the first one
+#ifdef OPT_FILE_SERVICE_TIERING
+    struct spdk_bdev *tier_bdev; // the capacity bdev that cold segments are moved to, NULL if there is none
+    struct spdk_bdev_desc *tier_bdev_desc;
+    struct spdk_io_channel *tier_bdev_io_channel; // per thread, as bdev_io_channel
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    struct spdk_poller *WriteBufferPoller; // writes back the write buffer on this thread
+#endif
 } SPDKContextT;
 
 //
@@ -99,7 +161,86 @@ int BdevWriteV(
 	void *cb_arg
 );
 
+//
+// Tell the bdev that a range holds no data
+//
+//
+int BdevUnmap(
+    void *Arg,
+    uint64_t Offset,
+    uint64_t NBytes,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+);
+
+//
+// Zero a range of the bdev without transferring data
+//
+//
+int BdevWriteZeroes(
+    void *arg,
+    uint64_t offset,
+    uint64_t nbytes,
+    spdk_bdev_io_completion_cb cb,
+	void *cb_arg
+);
+
+//
+// Append to the zone that starts at Zone, and reset it
+//
+//
+int BdevZoneAppendV(
+    void *Arg,
+    struct iovec *Iov,
+    int IovCnt,
+    uint64_t Zone,
+    uint64_t NBytes,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+);
+
+int BdevZoneReset(
+    void *Arg,
+    uint64_t Zone,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+);
+
+//
+// Get the information of zones, the type and capacity of each
+//
+//
+int BdevGetZoneInfo(
+    void *Arg,
+    uint64_t Zone,
+    size_t NumZones,
+    struct spdk_bdev_zone_info *Info,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+);
+
+//
+// Flush the volatile cache of the bdev for a waiter, sharing the flush with the other waiters of the context;
+// the waiter must stay valid until it is called back, which happens at once if the bdev has no flush
+//
+//
+void BdevFlushShared(
+    SPDKContextT *SPDKContext,
+    BdevFlushWaiterT *Waiter
+);
+
+#ifdef OPT_FILE_SERVICE_TIERING
+//
+// Flush the volatile cache of the capacity bdev, or return -ENOTSUP if it has none
+//
+//
+int BdevFlushTier(
+    void *Arg,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+);
+#endif
+
 void SpdkBdevEventCb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
 		    void *event_ctx);
 
-void BdevResetZone(void *arg);
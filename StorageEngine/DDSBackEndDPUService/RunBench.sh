@@ -0,0 +1 @@
+sudo ./build/DDSBackEndBench "$@" -- --json SpdkDev.json
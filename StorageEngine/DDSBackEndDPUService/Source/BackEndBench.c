@@ -0,0 +1,539 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FileBackEnd.h"
+#include "Profiler.h"
+
+//
+// A benchmark of the storage engine on the DPU alone: bench workers build data plane requests
+// in the I/O slots of the host buffers, as the DMA agent would after parsing the request rings,
+// and hand them in batches to SubmitDataPlaneRequest, so that neither the host front end
+// nor the network is involved. Each bench worker takes the slots of one buffer and has a file of its own,
+// which it fills with sequential writes first, then keeps QueueDepth requests in flight on for Seconds
+//
+// Usage: DDSBackEndBench [bench options] -- [SPDK options], e.g.
+//   sudo ./build/DDSBackEndBench -s 4096 -q 64 -b 16 -w 2 -r 70 -- --json SpdkDev.json
+//
+//
+#define BENCH_DEFAULT_REQUEST_SIZE 4096
+#define BENCH_DEFAULT_QUEUE_DEPTH 32
+#define BENCH_DEFAULT_BATCH_SIZE 8
+#define BENCH_DEFAULT_WORKERS 1
+#define BENCH_DEFAULT_READ_PERCENT 100
+#define BENCH_DEFAULT_FILE_SIZE (1ULL << 30)
+#define BENCH_DEFAULT_SECONDS 10
+#define BENCH_FILE_ID_BASE 1
+#define BENCH_FILE_NAME "DDSBackEndBench"
+#define BENCH_WAIT_MICROSECONDS 1000
+
+typedef struct {
+    FileIOSizeT RequestSize;
+    RequestIdT QueueDepth;
+    RequestIdT BatchSize;
+    int Workers;
+    int ReadPercent;
+    FileSizeT FileSize;
+    int Seconds;
+    bool Fill;
+} BenchConfigT;
+
+//
+// A bench worker: the requests of its I/O slots, in the ring order of a buffer,
+// and what it measured in the timed run
+//
+//
+typedef struct {
+    int Id;
+    RequestIdT IoSlotBase;
+    FileIdT FileId;
+    const BenchConfigT* Config;
+    pthread_t Thread;
+
+    DataPlaneRequestContext Contexts[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    DataPlaneRequestColdContext ColdContexts[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    BuffMsgF2BReqHeader Requests[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    BuffMsgB2FAckHeader Responses[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    char* Buffers[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    uint64_t SubmitCycles[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+    bool Retired[DDS_BACKEND_MAX_POLL_QUEUE_DEPTH];
+
+    uint64_t Reads;
+    uint64_t Writes;
+    uint64_t Bytes;
+    uint64_t Errors;
+    uint64_t Batches;
+    double ElapsedSeconds;
+    LatencyHistogram Latencies;
+} BenchWorkerT;
+
+static BenchConfigT BenchConfig = {
+    BENCH_DEFAULT_REQUEST_SIZE,
+    BENCH_DEFAULT_QUEUE_DEPTH,
+    BENCH_DEFAULT_BATCH_SIZE,
+    BENCH_DEFAULT_WORKERS,
+    BENCH_DEFAULT_READ_PERCENT,
+    BENCH_DEFAULT_FILE_SIZE,
+    BENCH_DEFAULT_SECONDS,
+    true
+};
+
+static BenchWorkerT* BenchWorkers;
+static int BenchResult = 0;
+
+static void
+Usage(
+    const char* Program
+) {
+    fprintf(stderr,
+        "Usage: %s [options] -- [SPDK options]\n"
+        "  -s bytes     request size (default %d)\n"
+        "  -q depth     requests in flight per bench worker, at most %d (default %d)\n"
+        "  -b requests  requests per submission (default %d)\n"
+        "  -w workers   bench workers, each on the I/O slots of one buffer, at most %d (default %d)\n"
+        "  -r percent   percentage of reads, the rest are writes (default %d)\n"
+        "  -f bytes     size of the file of each bench worker (default %llu)\n"
+        "  -t seconds   duration of the timed run (default %d)\n"
+        "  -n           don't fill the files before the timed run, which fails reads past what was written\n",
+        Program, BENCH_DEFAULT_REQUEST_SIZE, DDS_BACKEND_MAX_POLL_QUEUE_DEPTH, BENCH_DEFAULT_QUEUE_DEPTH,
+        BENCH_DEFAULT_BATCH_SIZE, DDS_BACKEND_MAX_BUFFS, BENCH_DEFAULT_WORKERS, BENCH_DEFAULT_READ_PERCENT,
+        (unsigned long long)BENCH_DEFAULT_FILE_SIZE, BENCH_DEFAULT_SECONDS);
+}
+
+//
+// Parse the bench options, which come before "--"; returns the index of the first SPDK option, or -1
+//
+//
+static int
+ParseBenchOptions(
+    int Argc,
+    char** Argv
+) {
+    int opt;
+
+    while ((opt = getopt(Argc, Argv, "s:q:b:w:r:f:t:nh")) != -1) {
+        switch (opt) {
+        case 's':
+            BenchConfig.RequestSize = (FileIOSizeT)strtoul(optarg, NULL, 0);
+            break;
+        case 'q':
+            BenchConfig.QueueDepth = (RequestIdT)atoi(optarg);
+            break;
+        case 'b':
+            BenchConfig.BatchSize = (RequestIdT)atoi(optarg);
+            break;
+        case 'w':
+            BenchConfig.Workers = atoi(optarg);
+            break;
+        case 'r':
+            BenchConfig.ReadPercent = atoi(optarg);
+            break;
+        case 'f':
+            BenchConfig.FileSize = (FileSizeT)strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            BenchConfig.Seconds = atoi(optarg);
+            break;
+        case 'n':
+            BenchConfig.Fill = false;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (BenchConfig.RequestSize == 0 || BenchConfig.RequestSize > BenchConfig.FileSize ||
+        BenchConfig.QueueDepth == 0 || BenchConfig.QueueDepth > DDS_BACKEND_MAX_POLL_QUEUE_DEPTH ||
+        BenchConfig.BatchSize == 0 || BenchConfig.BatchSize > BenchConfig.QueueDepth ||
+        BenchConfig.Workers <= 0 || BenchConfig.Workers > DDS_BACKEND_MAX_BUFFS ||
+        BenchConfig.ReadPercent < 0 || BenchConfig.ReadPercent > 100 || BenchConfig.Seconds <= 0) {
+        return -1;
+    }
+
+    return optind;
+}
+
+//
+// Submit a control plane request and wait for it on the calling thread
+//
+//
+static ErrorCodeT
+RunControlPlaneRequest(
+    RequestIdT RequestId,
+    void* Request,
+    ErrorCodeT* Result,
+    void* Response
+) {
+    ControlPlaneRequestContext context;
+
+    context.RequestId = RequestId;
+    context.Request = (BufferT)Request;
+    context.Response = (BufferT)Response;
+    *Result = DDS_ERROR_CODE_IO_PENDING;
+    SubmitControlPlaneRequest(FS, &context);
+
+    while (*(volatile ErrorCodeT*)Result == DDS_ERROR_CODE_IO_PENDING && !ForceQuitStorageEngine) {
+        usleep(BENCH_WAIT_MICROSECONDS);
+    }
+
+    return *Result;
+}
+
+//
+// Set up the requests of a bench worker and create its file
+//
+//
+static int
+SetUpBenchWorker(
+    BenchWorkerT* Worker
+) {
+    CtrlMsgF2BReqCreateFile req;
+    CtrlMsgB2FAckCreateFile resp;
+
+    for (RequestIdT i = 0; i != DDS_BACKEND_MAX_POLL_QUEUE_DEPTH; i++) {
+        Worker->Buffers[i] = spdk_dma_malloc(Worker->Config->RequestSize, DDS_BACKEND_PAGE_SIZE, NULL);
+        if (!Worker->Buffers[i]) {
+            fprintf(stderr, "%s [error]: failed to allocate the buffers of bench worker %d\n", __func__, Worker->Id);
+            return -1;
+        }
+        memset(Worker->Buffers[i], (int)(i + 1), Worker->Config->RequestSize);
+
+        Worker->Contexts[i].Cold = &Worker->ColdContexts[i];
+        Worker->Contexts[i].Request = &Worker->Requests[i];
+        Worker->Contexts[i].Response = &Worker->Responses[i];
+        Worker->Contexts[i].DataBuffer.TotalSize = Worker->Config->RequestSize;
+        Worker->Contexts[i].DataBuffer.FirstSize = Worker->Config->RequestSize;
+        Worker->Contexts[i].DataBuffer.FirstAddr = Worker->Buffers[i];
+        Worker->Contexts[i].DataBuffer.SecondAddr = NULL;
+        Worker->Requests[i].FileId = Worker->FileId;
+        Worker->Requests[i].Bytes = Worker->Config->RequestSize;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.FileId = Worker->FileId;
+    req.DirId = DDS_DIR_ROOT;
+    req.FileAttributes = 0;
+    snprintf(req.FileName, sizeof(req.FileName), "%s%d", BENCH_FILE_NAME, Worker->Id);
+    if (RunControlPlaneRequest(CTRL_MSG_F2B_REQ_CREATE_FILE, &req, &resp.Result, &resp) != DDS_ERROR_CODE_SUCCESS) {
+        fprintf(stderr, "%s [error]: failed to create the file of bench worker %d: %d\n",
+            __func__, Worker->Id, resp.Result);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+TearDownBenchWorker(
+    BenchWorkerT* Worker
+) {
+    for (RequestIdT i = 0; i != DDS_BACKEND_MAX_POLL_QUEUE_DEPTH; i++) {
+        if (Worker->Buffers[i]) {
+            spdk_dma_free(Worker->Buffers[i]);
+        }
+    }
+}
+
+//
+// Keep QueueDepth requests of a bench worker in flight, in batches of up to BatchSize, until Requests have
+// been issued or Seconds have passed; Fill writes the file sequentially instead of the configured mix.
+// Requests complete in any order but leave their slots in the ring order, as on a buffer
+//
+//
+static void
+RunBenchWorkerPhase(
+    BenchWorkerT* Worker,
+    bool Fill,
+    uint64_t Requests,
+    int Seconds
+) {
+    const BenchConfigT* config = Worker->Config;
+    uint64_t sectors = (config->FileSize - config->RequestSize) / DDS_BACKEND_SECTOR_SIZE + 1;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (uint64_t)(Worker->Id + 1);
+    double nsPerCycle = ProfilerNsPerCycle();
+    uint64_t start = ProfilerCycles();
+    uint64_t deadline = start + (uint64_t)((double)Seconds * 1e9 / nsPerCycle);
+    uint64_t issued = 0;
+    FileSizeT nextOffset = 0;
+    RequestIdT head = 0;
+    RequestIdT tail = 0;
+    RequestIdT inFlight = 0;
+
+    while (!ForceQuitStorageEngine) {
+        bool issuing = issued < Requests && (Seconds == 0 || ProfilerCycles() < deadline);
+        if (!issuing && inFlight == 0) {
+            break;
+        }
+
+        //
+        // Build a batch in the free slots after the tail and submit it
+        //
+        //
+        RequestIdT batchSize = 0;
+        RequestIdT first = tail;
+        while (issuing && inFlight + batchSize < config->QueueDepth && batchSize < config->BatchSize &&
+            issued + batchSize < Requests) {
+            DataPlaneRequestContext* ctx = &Worker->Contexts[tail];
+
+            seed ^= seed << 13;
+            seed ^= seed >> 7;
+            seed ^= seed << 17;
+
+            ctx->IsRead = !Fill && (int)(seed % 100) < config->ReadPercent;
+            if (Fill) {
+                ctx->Request->Offset = nextOffset;
+                nextOffset += config->RequestSize;
+            }
+            else {
+                ctx->Request->Offset = ((seed >> 7) % sectors) * DDS_BACKEND_SECTOR_SIZE;
+            }
+            ctx->Request->RequestId = tail;
+            ctx->Response->RequestId = tail;
+            ctx->Response->Result = DDS_ERROR_CODE_IO_PENDING;
+            ctx->Response->BytesServiced = 0;
+            Worker->Retired[tail] = false;
+            Worker->SubmitCycles[tail] = ProfilerCycles();
+
+            tail = (tail + 1) % DDS_BACKEND_MAX_POLL_QUEUE_DEPTH;
+            batchSize++;
+        }
+
+        if (batchSize) {
+            SubmitDataPlaneRequest(FS, Worker->Contexts, Worker->IoSlotBase + first, batchSize, Worker->IoSlotBase,
+                DDS_BACKEND_MAX_POLL_QUEUE_DEPTH);
+            inFlight += batchSize;
+            issued += batchSize;
+            Worker->Batches++;
+        }
+
+        //
+        // Time every request that completed since the last poll, then free the slots in the ring order
+        //
+        //
+        uint64_t now = ProfilerCycles();
+        for (RequestIdT i = 0, index = head; i != inFlight; i++, index = (index + 1) % DDS_BACKEND_MAX_POLL_QUEUE_DEPTH) {
+            volatile BuffMsgB2FAckHeader* resp = &Worker->Responses[index];
+            if (Worker->Retired[index] || resp->Result == DDS_ERROR_CODE_IO_PENDING) {
+                continue;
+            }
+
+            Worker->Retired[index] = true;
+            if (Fill) {
+                continue;
+            }
+            if (resp->Result == DDS_ERROR_CODE_SUCCESS) {
+                RecordLatency(&Worker->Latencies, (uint64_t)((double)(now - Worker->SubmitCycles[index]) * nsPerCycle));
+                Worker->Bytes += config->RequestSize;
+                if (Worker->Contexts[index].IsRead) {
+                    Worker->Reads++;
+                }
+                else {
+                    Worker->Writes++;
+                }
+            }
+            else {
+                Worker->Errors++;
+            }
+        }
+
+        while (inFlight && Worker->Retired[head]) {
+            head = (head + 1) % DDS_BACKEND_MAX_POLL_QUEUE_DEPTH;
+            inFlight--;
+        }
+    }
+
+    if (!Fill) {
+        Worker->ElapsedSeconds = (double)(ProfilerCycles() - start) * nsPerCycle / 1e9;
+    }
+}
+
+static void*
+BenchWorkerThread(
+    void* Arg
+) {
+    BenchWorkerT* worker = (BenchWorkerT*)Arg;
+    const BenchConfigT* config = worker->Config;
+
+    if (config->Fill) {
+        RunBenchWorkerPhase(worker, true, config->FileSize / config->RequestSize, 0);
+    }
+    RunBenchWorkerPhase(worker, false, UINT64_MAX, config->Seconds);
+
+    return NULL;
+}
+
+//
+// Print what the bench workers measured, merged
+//
+//
+static void
+ReportBench(
+    const BenchConfigT* Config
+) {
+    LatencyHistogram* latencies = malloc(sizeof(LatencyHistogram));
+    uint64_t reads = 0, writes = 0, bytes = 0, errors = 0, batches = 0;
+    double seconds = 0;
+    Statistics stats;
+    Percentiles percentiles;
+
+    if (!latencies) {
+        return;
+    }
+    ResetLatencyHistogram(latencies);
+
+    for (int w = 0; w != Config->Workers; w++) {
+        BenchWorkerT* worker = &BenchWorkers[w];
+        reads += worker->Reads;
+        writes += worker->Writes;
+        bytes += worker->Bytes;
+        errors += worker->Errors;
+        batches += worker->Batches;
+        if (worker->ElapsedSeconds > seconds) {
+            seconds = worker->ElapsedSeconds;
+        }
+        MergeLatencyHistogram(latencies, &worker->Latencies);
+    }
+
+    fprintf(stdout, "%d bench workers, %u bytes per request, queue depth %u, batches of up to %u, %d%% reads\n",
+        Config->Workers, Config->RequestSize, Config->QueueDepth, Config->BatchSize, Config->ReadPercent);
+    fprintf(stdout, "%lu reads, %lu writes, %lu errors in %.2f seconds (%.1f requests per submission)\n",
+        reads, writes, errors, seconds, batches ? (double)(reads + writes + errors) / batches : 0.0);
+    if (seconds > 0) {
+        fprintf(stdout, "IOPS: %.0f, bandwidth: %.2f MB/s\n",
+            (double)(reads + writes) / seconds, (double)bytes / seconds / (1024.0 * 1024.0));
+    }
+    if (latencies->TotalCount) {
+        GetStatistics(latencies, 1000.0, &stats, &percentiles);
+        fprintf(stdout, "Latency (us): mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n",
+            stats.Mean, percentiles.P50, percentiles.P90, percentiles.P99, percentiles.P99p9, stats.Max);
+    }
+
+    free(latencies);
+}
+
+//
+// Wait for the file service, run the bench workers, report and stop the file service
+//
+//
+static void*
+BenchThread(
+    void* Arg
+) {
+    const BenchConfigT* config = (const BenchConfigT*)Arg;
+    int started = 0;
+
+    while ((!G_INITIALIZATION_DONE || !atomic_load(&FS->OffloadReady)) && !ForceQuitStorageEngine) {
+        usleep(BENCH_WAIT_MICROSECONDS);
+    }
+
+    for (int w = 0; w != config->Workers && !ForceQuitStorageEngine; w++) {
+        BenchWorkers[w].Id = w;
+        BenchWorkers[w].IoSlotBase = DDS_HOST_IO_SLOT_NUMBER_BASE(w);
+        BenchWorkers[w].FileId = (FileIdT)(BENCH_FILE_ID_BASE + w);
+        BenchWorkers[w].Config = config;
+        ResetLatencyHistogram(&BenchWorkers[w].Latencies);
+        if (SetUpBenchWorker(&BenchWorkers[w])) {
+            BenchResult = -1;
+            break;
+        }
+    }
+
+    if (BenchResult == 0) {
+        fprintf(stdout, "Running %d bench workers%s for %d seconds...\n",
+            config->Workers, config->Fill ? " after filling their files" : "", config->Seconds);
+        for (; started != config->Workers; started++) {
+            if (pthread_create(&BenchWorkers[started].Thread, NULL, BenchWorkerThread, &BenchWorkers[started])) {
+                fprintf(stderr, "%s [error]: failed to start bench worker %d\n", __func__, started);
+                BenchResult = -1;
+                break;
+            }
+        }
+        for (int w = 0; w != started; w++) {
+            pthread_join(BenchWorkers[w].Thread, NULL);
+        }
+        if (BenchResult == 0) {
+            ReportBench(config);
+        }
+    }
+
+    for (int w = 0; w != config->Workers; w++) {
+        TearDownBenchWorker(&BenchWorkers[w]);
+    }
+
+    //
+    // Unless the file service is already gone, e.g. after Ctrl-C
+    //
+    //
+    if (!ForceQuitStorageEngine) {
+        StopFileService(FS);
+        sleep(1);
+        spdk_app_start_shutdown();
+    }
+
+    return NULL;
+}
+
+int
+main(
+    int Argc,
+    char** Argv
+) {
+    pthread_t benchThread;
+    int spdkArgc;
+    char** spdkArgv;
+    int first = ParseBenchOptions(Argc, Argv);
+
+    if (first < 0) {
+        Usage(Argv[0]);
+        return -1;
+    }
+
+    //
+    // SPDK parses the options after "--", with the name of the program
+    //
+    //
+    spdkArgv = malloc(sizeof(char*) * (Argc - first + 2));
+    if (!spdkArgv) {
+        return -1;
+    }
+    spdkArgv[0] = Argv[0];
+    spdkArgc = 1;
+    for (int i = first; i != Argc; i++) {
+        spdkArgv[spdkArgc++] = Argv[i];
+    }
+    spdkArgv[spdkArgc] = NULL;
+    optind = 1;
+
+    BenchWorkers = aligned_alloc(DDS_CACHE_LINE_SIZE, BenchConfig.Workers * sizeof(BenchWorkerT));
+    if (!BenchWorkers || !AllocateFileService()) {
+        fprintf(stderr, "Failed to allocate the bench\n");
+        return -1;
+    }
+    memset(BenchWorkers, 0, BenchConfig.Workers * sizeof(BenchWorkerT));
+
+    if (pthread_create(&benchThread, NULL, BenchThread, &BenchConfig)) {
+        fprintf(stderr, "Failed to start the bench thread\n");
+        return -1;
+    }
+
+    //
+    // Run the file service on the current thread until the bench stops it
+    //
+    //
+    StartFileService(spdkArgc, spdkArgv, FS);
+    ForceQuitStorageEngine = 1;
+    pthread_join(benchThread, NULL);
+
+    DeallocateFileService(FS);
+    free(BenchWorkers);
+    free(spdkArgv);
+
+    return BenchResult;
+}
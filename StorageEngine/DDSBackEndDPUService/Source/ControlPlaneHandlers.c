@@ -95,6 +95,7 @@ void ControlPlaneHandler(
                 Req->FileId,
                 Req->NewSize,
                 Sto,
+                Context->SPDKContext,
                 Resp
             );
         }
@@ -110,6 +111,44 @@ void ControlPlaneHandler(
             );
         }
             break;
+        case CTRL_MSG_F2B_REQ_FLUSH_FILE: {
+            CtrlMsgF2BReqFlushFile *Req = (CtrlMsgF2BReqFlushFile *)Context->Request;
+            CtrlMsgB2FAckFlushFile *Resp = (CtrlMsgB2FAckFlushFile *)Context->Response;
+            FlushFile(
+                Req->FileId,
+                Sto,
+                Context->SPDKContext,
+                Resp
+            );
+        }
+            break;
+        case CTRL_MSG_F2B_REQ_SET_FILE_QOS: {
+            CtrlMsgF2BReqSetFileQoS *Req = (CtrlMsgF2BReqSetFileQoS *)Context->Request;
+            CtrlMsgB2FAckSetFileQoS *Resp = (CtrlMsgB2FAckSetFileQoS *)Context->Response;
+            SetFileQoS(
+                Req->FileId,
+                Req->BytesPerSecond,
+                Req->BurstBytes,
+                Req->Weight,
+                Sto,
+                Resp
+            );
+        }
+            break;
+        case CTRL_MSG_F2B_REQ_SET_FILE_ACCESS_HINT: {
+            CtrlMsgF2BReqSetFileAccessHint *Req = (CtrlMsgF2BReqSetFileAccessHint *)Context->Request;
+            CtrlMsgB2FAckSetFileAccessHint *Resp = (CtrlMsgB2FAckSetFileAccessHint *)Context->Response;
+            SetFileAccessHint(
+                Req->FileId,
+                Req->Hint,
+                Req->Offset,
+                Req->Bytes,
+                Sto,
+                Context->SPDKContext,
+                Resp
+            );
+        }
+            break;
         case CTRL_MSG_F2B_REQ_GET_FILE_INFO: {
             CtrlMsgF2BReqGetFileInfo *Req = (CtrlMsgF2BReqGetFileInfo *)Context->Request;
             CtrlMsgB2FAckGetFileInfo *Resp = (CtrlMsgB2FAckGetFileInfo *)Context->Response;
@@ -157,6 +196,24 @@ void ControlPlaneHandler(
             );
         }
             break;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+        case CTRL_MSG_F2B_REQ_CREATE_SNAPSHOT: {
+            CtrlMsgF2BReqCreateSnapshot *Req = (CtrlMsgF2BReqCreateSnapshot *)Context->Request;
+            CtrlMsgB2FAckCreateSnapshot *Resp = (CtrlMsgB2FAckCreateSnapshot *)Context->Response;
+            ControlPlaneHandlerCtx *HandlerCtx = malloc(sizeof(*HandlerCtx));
+            HandlerCtx->Result = &Resp->Result;
+            CreateSnapshot(
+                Req->FileId,
+                Req->SnapshotFileId,
+                Req->DirId,
+                Req->SnapshotName,
+                Sto,
+                Context->SPDKContext,
+                HandlerCtx
+            );
+        }
+            break;
+#endif
         default: {
             printf("UNKNOWN CONTROL PLANE REQUEST: %d\n", Context->RequestId);
         }
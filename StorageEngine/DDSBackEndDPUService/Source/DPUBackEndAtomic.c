@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spdk/crc32.h"
+
+#include "DPUBackEndAtomic.h"
+#include "DPUBackEndChecksum.h"
+#include "DPUBackEndSnapshot.h"
+#include "DPULog.h"
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+#define DDS_BACKEND_ATOMIC_WRITE_TOTAL_SLOTS (DDS_BACKEND_ATOMIC_WRITE_LANES * DDS_BACKEND_ATOMIC_WRITE_SLOTS)
+
+static inline uint32_t
+HeaderCrc(
+    const AtomicWriteHeaderT* Header
+){
+    return spdk_crc32c_update(Header, offsetof(AtomicWriteHeaderT, HeaderCrc), ~0u) ^ ~0u;
+}
+
+//
+// Set up the slots of the workers
+//
+//
+ErrorCodeT AtomicWritesInit(
+    struct DPUStorage* Sto
+){
+    struct DPUAtomicWrites* atomicWrites = calloc(1, sizeof(struct DPUAtomicWrites));
+    if (!atomicWrites) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    Sto->AtomicWrites = atomicWrites;
+
+    for (int l = 0; l != DDS_BACKEND_ATOMIC_WRITE_LANES; l++) {
+        AtomicWriteLaneT* lane = &atomicWrites->Lanes[l];
+        for (int s = 0; s != DDS_BACKEND_ATOMIC_WRITE_SLOTS; s++) {
+            AtomicWriteSlotT* slot = &lane->Slots[s];
+            slot->Lane = lane;
+            slot->Address = DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_ATOMIC_WRITE_OFFSET +
+                (DiskSizeT)(l * DDS_BACKEND_ATOMIC_WRITE_SLOTS + s) * DDS_BACKEND_ATOMIC_WRITE_SLOT_BYTES);
+            slot->Buffer = spdk_dma_zmalloc(DDS_BACKEND_ATOMIC_WRITE_SLOT_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+            if (!slot->Buffer) {
+                AtomicWritesDestroy(Sto);
+                return DDS_ERROR_CODE_OUT_OF_MEMORY;
+            }
+            slot->NextFree = lane->Free;
+            lane->Free = slot;
+        }
+    }
+
+    atomic_init(&atomicWrites->LanesTaken, 0);
+    atomic_init(&atomicWrites->NextSequence, 1);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the slots
+//
+//
+void AtomicWritesDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUAtomicWrites* atomicWrites = Sto->AtomicWrites;
+    if (!atomicWrites) {
+        return;
+    }
+
+    for (int l = 0; l != DDS_BACKEND_ATOMIC_WRITE_LANES; l++) {
+        for (int s = 0; s != DDS_BACKEND_ATOMIC_WRITE_SLOTS; s++) {
+            spdk_dma_free(atomicWrites->Lanes[l].Slots[s].Buffer);
+        }
+    }
+    spdk_dma_free(atomicWrites->RecoveryBuffer);
+    free(atomicWrites->RecoveryOrder);
+    free(atomicWrites);
+    Sto->AtomicWrites = NULL;
+}
+
+//
+// The header of the I-th slot as the recovery read it
+//
+//
+static inline AtomicWriteHeaderT*
+RecoveredHeader(
+    struct DPUAtomicWrites* AtomicWrites,
+    int I
+){
+    return (AtomicWriteHeaderT*)(AtomicWrites->RecoveryBuffer + (size_t)I * DDS_BACKEND_ATOMIC_WRITE_SLOT_BYTES);
+}
+
+static int
+CompareRecoveredSequences(
+    const void *A,
+    const void *B
+){
+    uint64_t a = RecoveredHeader(Sto->AtomicWrites, *(const int*)A)->Sequence;
+    uint64_t b = RecoveredHeader(Sto->AtomicWrites, *(const int*)B)->Sequence;
+    return a < b ? -1 : a > b;
+}
+
+static void
+FinishRecovery(
+    struct DPUAtomicWrites* AtomicWrites,
+    bool Success
+){
+    SPDK_NOTICELOG("Rolled %d staged atomic writes forward\n", AtomicWrites->RecoveryCount);
+
+    spdk_dma_free(AtomicWrites->RecoveryBuffer);
+    free(AtomicWrites->RecoveryOrder);
+    AtomicWrites->RecoveryBuffer = NULL;
+    AtomicWrites->RecoveryOrder = NULL;
+    AtomicWrites->RecoveryCallback(Success && !AtomicWrites->RecoveryFailed, AtomicWrites->RecoveryArg);
+}
+
+static void
+RecoveryClearedCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    spdk_bdev_free_io(bdev_io);
+    FinishRecovery(Context, Success);
+}
+
+//
+// The writes rolled forward are on the media, so the slots can go
+//
+//
+static void
+RecoveryFlushedCallback(
+    bool Success,
+    void *Arg
+){
+    struct DPUAtomicWrites* atomicWrites = Arg;
+
+    if (!Success) {
+        FinishRecovery(atomicWrites, false);
+        return;
+    }
+
+    if (ZeroDiskAsync(DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_ATOMIC_WRITE_OFFSET), DDS_BACKEND_ATOMIC_WRITE_BYTES,
+        RecoveryClearedCallback, atomicWrites, Sto, atomicWrites->RecoverySPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        FinishRecovery(atomicWrites, false);
+    }
+}
+
+static bool RedoWrite(struct DPUAtomicWrites* AtomicWrites, AtomicWriteHeaderT* Header);
+
+//
+// Write again the staged writes one at a time, oldest first, then flush them
+//
+//
+static void
+RedoNextWrites(
+    struct DPUAtomicWrites* AtomicWrites
+){
+    while (AtomicWrites->RecoveryNext != AtomicWrites->RecoveryCount) {
+        AtomicWriteHeaderT* header = RecoveredHeader(AtomicWrites, AtomicWrites->RecoveryOrder[AtomicWrites->RecoveryNext++]);
+        if (RedoWrite(AtomicWrites, header)) {
+            return;
+        }
+    }
+
+    AtomicWrites->RecoveryFlushWaiter.Callback = RecoveryFlushedCallback;
+    AtomicWrites->RecoveryFlushWaiter.Arg = AtomicWrites;
+    BdevFlushShared(AtomicWrites->RecoverySPDKContext, &AtomicWrites->RecoveryFlushWaiter);
+}
+
+static void
+RedoPersistedCallback(
+    bool Success,
+    void *Arg
+){
+    struct DPUAtomicWrites* atomicWrites = Arg;
+
+    if (!Success) {
+        atomicWrites->RecoveryFailed = true;
+    }
+    RedoNextWrites(atomicWrites);
+}
+
+static void
+RedoCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUAtomicWrites* atomicWrites = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        atomicWrites->RecoveryFailed = true;
+    }
+    if (--atomicWrites->RecoveryInFlight) {
+        return;
+    }
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    AtomicWriteHeaderT* header = atomicWrites->RecoveryHeader;
+    struct DPUFile* file = GetFile(Sto, header->FileId);
+    if (file) {
+        atomicWrites->RecoveryIov.iov_base = (char*)header + DDS_BACKEND_SECTOR_SIZE;
+        atomicWrites->RecoveryIov.iov_len = header->Bytes;
+        ChecksumsPersist(Sto, file, header->Offset, &atomicWrites->RecoveryIov, 1, header->Bytes,
+            RedoPersistedCallback, atomicWrites, atomicWrites->RecoverySPDKContext);
+        return;
+    }
+#endif
+    RedoPersistedCallback(true, atomicWrites);
+}
+
+//
+// Write a staged write again over the segments its file has; returns whether any of it is in flight
+//
+//
+static bool
+RedoWrite(
+    struct DPUAtomicWrites* AtomicWrites,
+    AtomicWriteHeaderT* Header
+){
+    struct DPUFile* file = GetFile(Sto, Header->FileId);
+    if (!file || !(GetAttributes(file) & DDS_FILE_ATTRIBUTE_ATOMIC_WRITES)) {
+        return false;
+    }
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    //
+    // A write to a shared segment waits for its copy before it goes in place, so this one never did
+    //
+    //
+    if (WriteNeedsSegmentCopy(Sto, file, Header->Offset, Header->Bytes)) {
+        return false;
+    }
+#endif
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    ChecksumsForget(Sto, file, Header->Offset, Header->Bytes);
+#endif
+
+    char* data = (char*)Header + DDS_BACKEND_SECTOR_SIZE;
+    FileSizeT offset = Header->Offset;
+    FileSizeT end = offset + Header->Bytes;
+    AtomicWrites->RecoveryHeader = Header;
+    AtomicWrites->RecoveryInFlight = 1;
+
+    while (offset != end) {
+        SegmentIdT slot = (SegmentIdT)(offset >> DDS_BACKEND_SEGMENT_SHIFT);
+        FileSizeT pieceEnd = min(end, ((FileSizeT)slot + 1) << DDS_BACKEND_SEGMENT_SHIFT);
+        if (!SegmentIsHole(file, slot)) {
+            AtomicWrites->RecoveryInFlight++;
+            if (WriteToDiskAsyncZC(data + (offset - Header->Offset),
+                GetSegmentAddress(file, slot) + (offset & DDS_BACKEND_SEGMENT_MASK), (FileIOSizeT)(pieceEnd - offset),
+                RedoCallback, AtomicWrites, Sto, AtomicWrites->RecoverySPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+                AtomicWrites->RecoveryInFlight--;
+                AtomicWrites->RecoveryFailed = true;
+            }
+        }
+        offset = pieceEnd;
+    }
+
+    //
+    // The count held one more while the pieces were issued, so that none of them finishes the write early
+    //
+    //
+    if (--AtomicWrites->RecoveryInFlight) {
+        return true;
+    }
+    return false;
+}
+
+static void
+RecoveryReadCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUAtomicWrites* atomicWrites = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        FinishRecovery(atomicWrites, false);
+        return;
+    }
+
+    //
+    // A slot torn by the crash fails its checksums and was never written in place
+    //
+    //
+    for (int s = 0; s != DDS_BACKEND_ATOMIC_WRITE_TOTAL_SLOTS; s++) {
+        AtomicWriteHeaderT* header = RecoveredHeader(atomicWrites, s);
+        if (!header->Sequence || header->HeaderCrc != HeaderCrc(header) ||
+            !header->Bytes || header->Bytes > DDS_MAX_ATOMIC_WRITE_BYTES) {
+            continue;
+        }
+        uint32_t dataCrc = spdk_crc32c_update((char*)header + DDS_BACKEND_SECTOR_SIZE, header->Bytes, ~0u) ^ ~0u;
+        if (dataCrc == header->DataCrc) {
+            atomicWrites->RecoveryOrder[atomicWrites->RecoveryCount++] = s;
+        }
+    }
+
+    if (!atomicWrites->RecoveryCount) {
+        FinishRecovery(atomicWrites, true);
+        return;
+    }
+
+    qsort(atomicWrites->RecoveryOrder, atomicWrites->RecoveryCount, sizeof(int), CompareRecoveredSequences);
+    RedoNextWrites(atomicWrites);
+}
+
+//
+// Write again the staged writes that are whole, clear the slots, then run Callback
+//
+//
+void AtomicWritesRecover(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    AtomicWriteCallbackT Callback,
+    void *Arg
+){
+    struct DPUAtomicWrites* atomicWrites = Sto->AtomicWrites;
+
+    atomicWrites->RecoveryBuffer = spdk_dma_malloc(DDS_BACKEND_ATOMIC_WRITE_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+    atomicWrites->RecoveryOrder = malloc(DDS_BACKEND_ATOMIC_WRITE_TOTAL_SLOTS * sizeof(int));
+    atomicWrites->RecoveryCount = 0;
+    atomicWrites->RecoveryNext = 0;
+    atomicWrites->RecoveryFailed = false;
+    atomicWrites->RecoverySPDKContext = SPDKContext;
+    atomicWrites->RecoveryCallback = Callback;
+    atomicWrites->RecoveryArg = Arg;
+
+    if (!atomicWrites->RecoveryBuffer || !atomicWrites->RecoveryOrder) {
+        SPDK_ERRLOG("No memory to read the staged atomic writes\n");
+        FinishRecovery(atomicWrites, false);
+        return;
+    }
+
+    if (ReadFromDiskAsyncZC(atomicWrites->RecoveryBuffer, DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_ATOMIC_WRITE_OFFSET),
+        DDS_BACKEND_ATOMIC_WRITE_BYTES, RecoveryReadCallback, atomicWrites, Sto, SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        FinishRecovery(atomicWrites, false);
+    }
+}
+
+//
+// Whether a write of a file is to be staged: the file has DDS_FILE_ATTRIBUTE_ATOMIC_WRITES
+// and the write spans sectors; a write within a sector is atomic on the device already
+//
+//
+bool AtomicWriteNeeded(
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    ErrorCodeT* Result
+){
+    *Result = DDS_ERROR_CODE_SUCCESS;
+    if (!(GetAttributes(File) & DDS_FILE_ATTRIBUTE_ATOMIC_WRITES) || !Bytes ||
+        Offset / DDS_BACKEND_SECTOR_SIZE == (Offset + Bytes - 1) / DDS_BACKEND_SECTOR_SIZE) {
+        return false;
+    }
+
+    if (Bytes > DDS_MAX_ATOMIC_WRITE_BYTES || ((Offset | Bytes) & (DDS_BACKEND_SECTOR_SIZE - 1))) {
+        *Result = DDS_ERROR_CODE_INVALID_PARAM;
+        return false;
+    }
+    return true;
+}
+
+static void StageInSlot(struct DPUStorage* Sto, AtomicWriteSlotT* Slot, struct PerSlotContext* SlotContext);
+
+//
+// A slot is free once it is cleared: it goes to the oldest write waiting for one, if any
+//
+//
+static void
+ReleaseSlot(
+    AtomicWriteSlotT* Slot
+){
+    AtomicWriteLaneT* lane = Slot->Lane;
+    struct PerSlotContext* waiter = lane->WaitingHead;
+
+    if (waiter) {
+        lane->WaitingHead = waiter->NextAtomic;
+        if (!lane->WaitingHead) {
+            lane->WaitingTail = NULL;
+        }
+        StageInSlot(Sto, Slot, waiter);
+        return;
+    }
+
+    Slot->NextFree = lane->Free;
+    lane->Free = Slot;
+}
+
+static void
+ClearCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    AtomicWriteSlotT* slot = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    AtomicWriteCallbackT callback = slot->Callback;
+    struct PerSlotContext* writer = slot->Writer;
+    bool success = slot->Success;
+    slot->Writer = NULL;
+
+    //
+    // A slot that can't be cleared would write its data again after a crash, so it is not used again
+    //
+    //
+    if (Success) {
+        ReleaseSlot(slot);
+    }
+    else {
+        SPDK_ERRLOG("Failed to clear the atomic write slot at %llu, it's out of service\n", slot->Address);
+    }
+
+    if (callback) {
+        callback(success, writer);
+    }
+}
+
+static void
+ClearSlot(
+    AtomicWriteSlotT* Slot
+){
+    memset(Slot->Buffer, 0, sizeof(AtomicWriteHeaderT));
+    if (WriteToDiskAsyncZC(Slot->Buffer, Slot->Address, DDS_BACKEND_SECTOR_SIZE, ClearCallback, Slot, Sto,
+        Slot->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to clear the atomic write slot at %llu, it's out of service\n", Slot->Address);
+        struct PerSlotContext* writer = Slot->Writer;
+        Slot->Writer = NULL;
+        if (Slot->Callback) {
+            Slot->Callback(Slot->Success, writer);
+        }
+    }
+}
+
+//
+// A write that failed to be staged goes on failing, while its slot, which may be whole, is cleared
+//
+//
+static void
+FailStaging(
+    AtomicWriteSlotT* Slot
+){
+    struct PerSlotContext* writer = Slot->Writer;
+
+    writer->AtomicSlot = NULL;
+    Slot->Writer = NULL;
+    Slot->Callback = NULL;
+    ClearSlot(Slot);
+    writer->AtomicStaged(false, writer);
+}
+
+static void
+StageFlushedCallback(
+    bool Success,
+    void *Arg
+){
+    AtomicWriteSlotT* slot = Arg;
+
+    if (!Success) {
+        FailStaging(slot);
+        return;
+    }
+    slot->Writer->AtomicStaged(true, slot->Writer);
+}
+
+static void
+StageCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    AtomicWriteSlotT* slot = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        FailStaging(slot);
+        return;
+    }
+
+    slot->FlushWaiter.Callback = StageFlushedCallback;
+    slot->FlushWaiter.Arg = slot;
+    BdevFlushShared(slot->SPDKContext, &slot->FlushWaiter);
+}
+
+//
+// Copy the data of a write into a slot behind its header and write them out together
+//
+//
+static void
+StageInSlot(
+    struct DPUStorage* Sto,
+    AtomicWriteSlotT* Slot,
+    struct PerSlotContext* SlotContext
+){
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    SplittableBufferT* buffer = &context->DataBuffer;
+    FileIOSizeT bytesOnFirst = min(buffer->FirstSize, buffer->TotalSize);
+    char* data = Slot->Buffer + DDS_BACKEND_SECTOR_SIZE;
+
+    memcpy(data, buffer->FirstAddr, bytesOnFirst);
+    if (buffer->TotalSize > bytesOnFirst) {
+        memcpy(data + bytesOnFirst, buffer->SecondAddr, buffer->TotalSize - bytesOnFirst);
+    }
+
+    AtomicWriteHeaderT* header = (AtomicWriteHeaderT*)Slot->Buffer;
+    header->Sequence = atomic_fetch_add(&Sto->AtomicWrites->NextSequence, 1);
+    header->Offset = context->Request->Offset;
+    header->Bytes = buffer->TotalSize;
+    header->FileId = context->Request->FileId;
+    header->Reserved = 0;
+    header->DataCrc = spdk_crc32c_update(data, buffer->TotalSize, ~0u) ^ ~0u;
+    header->HeaderCrc = HeaderCrc(header);
+
+    Slot->Writer = SlotContext;
+    Slot->SPDKContext = SlotContext->SPDKContext;
+    SlotContext->AtomicSlot = Slot;
+
+    if (WriteToDiskAsyncZC(Slot->Buffer, Slot->Address, DDS_BACKEND_SECTOR_SIZE + buffer->TotalSize,
+        StageCallback, Slot, Sto, Slot->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        SlotContext->AtomicSlot = NULL;
+        Slot->Writer = NULL;
+        ReleaseSlot(Slot);
+        SlotContext->AtomicStaged(false, SlotContext);
+    }
+}
+
+//
+// The slots of the calling thread, taken by its first atomic write; NULL if there are more workers than lanes
+//
+//
+static AtomicWriteLaneT*
+LaneOfThread(
+    struct DPUStorage* Sto,
+    SPDKContextT* SPDKContext
+){
+    if (!SPDKContext->AtomicLane) {
+        int lane = atomic_fetch_add(&Sto->AtomicWrites->LanesTaken, 1);
+        if (lane >= DDS_BACKEND_ATOMIC_WRITE_LANES) {
+            return NULL;
+        }
+        SPDKContext->AtomicLane = &Sto->AtomicWrites->Lanes[lane];
+    }
+    return SPDKContext->AtomicLane;
+}
+
+//
+// Stage a write in a slot of the thread, and call SlotContext->AtomicStaged once it is on the disk,
+// or later once a slot is free; a write that fails to be staged is called back with false and holds no slot
+//
+//
+void AtomicWriteStage(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext
+){
+    AtomicWriteLaneT* lane = LaneOfThread(Sto, SlotContext->SPDKContext);
+    SlotContext->AtomicSlot = NULL;
+
+    if (!lane) {
+        SPDK_ERRLOG("More than %d workers write atomically, the others fail\n", DDS_BACKEND_ATOMIC_WRITE_LANES);
+        SlotContext->AtomicStaged(false, SlotContext);
+        return;
+    }
+
+    AtomicWriteSlotT* slot = lane->Free;
+    if (!slot) {
+        SlotContext->NextAtomic = NULL;
+        if (lane->WaitingTail) {
+            lane->WaitingTail->NextAtomic = SlotContext;
+        }
+        else {
+            lane->WaitingHead = SlotContext;
+        }
+        lane->WaitingTail = SlotContext;
+        return;
+    }
+
+    lane->Free = slot->NextFree;
+    StageInSlot(Sto, slot, SlotContext);
+}
+
+static void
+RetireFlushedCallback(
+    bool Success,
+    void *Arg
+){
+    AtomicWriteSlotT* slot = Arg;
+
+    slot->Success = Success;
+    ClearSlot(slot);
+}
+
+//
+// Clear the slot of a write that is done in place, once what it wrote in place is on the media,
+// then call back if Callback is not NULL
+//
+//
+void AtomicWriteRetire(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext,
+    bool Success,
+    AtomicWriteCallbackT Callback
+){
+    AtomicWriteSlotT* slot = SlotContext->AtomicSlot;
+    SlotContext->AtomicSlot = NULL;
+    slot->Callback = Callback;
+    slot->Success = Success;
+
+    if (!Success) {
+        ClearSlot(slot);
+        return;
+    }
+
+    slot->FlushWaiter.Callback = RetireFlushedCallback;
+    slot->FlushWaiter.Arg = slot;
+    BdevFlushShared(slot->SPDKContext, &slot->FlushWaiter);
+}
+#endif
@@ -0,0 +1,740 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DPUBackEndBlockCache.h"
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+#define DDS_BACKEND_BLOCK_CACHE_MAX_FREQ 3
+#define DDS_BACKEND_BLOCK_CACHE_NONE -1
+
+static inline uint64_t
+HashOfBlock(
+    uint64_t Block
+){
+    return Block * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline BlockCacheShardT*
+ShardOfBlock(
+    struct DPUBlockCache* Cache,
+    uint64_t Block
+){
+    return &Cache->Shards[(HashOfBlock(Block) >> 32) % DDS_BACKEND_BLOCK_CACHE_SHARDS];
+}
+
+static inline int32_t*
+BucketOfBlock(
+    BlockCacheShardT* Shard,
+    uint64_t Block
+){
+    return &Shard->Buckets[HashOfBlock(Block) & Shard->BucketMask];
+}
+
+static inline int32_t*
+GhostBucketOfBlock(
+    BlockCacheShardT* Shard,
+    uint64_t Block
+){
+    return &Shard->GhostBuckets[HashOfBlock(Block) & Shard->BucketMask];
+}
+
+static inline void
+PushQueue(
+    BlockCacheShardT* Shard,
+    BlockCacheQueueT* Queue,
+    uint32_t Entry
+){
+    Queue->Ring[(Queue->Head + Queue->Count++) % Shard->NumEntries] = Entry;
+}
+
+static inline uint32_t
+PopQueue(
+    BlockCacheShardT* Shard,
+    BlockCacheQueueT* Queue
+){
+    uint32_t entry = Queue->Ring[Queue->Head];
+    Queue->Head = (Queue->Head + 1) % Shard->NumEntries;
+    Queue->Count--;
+    return entry;
+}
+
+//
+// The entry of a block, NULL if it has none
+//
+//
+static BlockCacheEntryT*
+FindEntry(
+    BlockCacheShardT* Shard,
+    uint64_t Block
+){
+    for (int32_t e = *BucketOfBlock(Shard, Block); e != DDS_BACKEND_BLOCK_CACHE_NONE; e = Shard->Entries[e].Next) {
+        if (Shard->Entries[e].Block == Block) {
+            return &Shard->Entries[e];
+        }
+    }
+    return NULL;
+}
+
+static void
+UnlinkEntry(
+    BlockCacheShardT* Shard,
+    BlockCacheEntryT* Entry
+){
+    int32_t* link = BucketOfBlock(Shard, Entry->Block);
+    int32_t self = (int32_t)(Entry - Shard->Entries);
+    while (*link != self) {
+        link = &Shard->Entries[*link].Next;
+    }
+    *link = Entry->Next;
+}
+
+static bool
+GhostHas(
+    BlockCacheShardT* Shard,
+    uint64_t Block
+){
+    for (int32_t g = *GhostBucketOfBlock(Shard, Block); g != DDS_BACKEND_BLOCK_CACHE_NONE; g = Shard->GhostNext[g]) {
+        if (Shard->GhostBlocks[g] == Block) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Remember a block evicted from the small queue in place of the oldest one remembered
+//
+//
+static void
+GhostAdd(
+    BlockCacheShardT* Shard,
+    uint64_t Block
+){
+    int32_t slot = (int32_t)Shard->GhostNextSlot;
+    Shard->GhostNextSlot = (Shard->GhostNextSlot + 1) % Shard->GhostSize;
+
+    if (Shard->GhostBlocks[slot] != UINT64_MAX) {
+        int32_t* link = GhostBucketOfBlock(Shard, Shard->GhostBlocks[slot]);
+        while (*link != slot) {
+            link = &Shard->GhostNext[*link];
+        }
+        *link = Shard->GhostNext[slot];
+    }
+
+    int32_t* bucket = GhostBucketOfBlock(Shard, Block);
+    Shard->GhostBlocks[slot] = Block;
+    Shard->GhostNext[slot] = *bucket;
+    *bucket = slot;
+}
+
+//
+// An entry for a new block, evicting one if none is free: a block leaving the small queue goes to the main queue
+// if it was read there, or else to the ghost queue; a block at the end of the main queue goes around again
+// as long as it has reads left; dropped entries are taken as they come
+//
+//
+static BlockCacheEntryT*
+TakeEntry(
+    BlockCacheShardT* Shard
+){
+    if (Shard->FreeList != DDS_BACKEND_BLOCK_CACHE_NONE) {
+        BlockCacheEntryT* entry = &Shard->Entries[Shard->FreeList];
+        Shard->FreeList = entry->Next;
+        return entry;
+    }
+
+    for (;;) {
+        if (Shard->Small.Count > Shard->SmallTarget || !Shard->Main.Count) {
+            BlockCacheEntryT* entry = &Shard->Entries[PopQueue(Shard, &Shard->Small)];
+            if (entry->State == BlockCacheEntryDead) {
+                return entry;
+            }
+            if (entry->Freq) {
+                entry->Freq = 0;
+                PushQueue(Shard, &Shard->Main, (uint32_t)(entry - Shard->Entries));
+                continue;
+            }
+            UnlinkEntry(Shard, entry);
+            GhostAdd(Shard, entry->Block);
+            return entry;
+        }
+
+        BlockCacheEntryT* entry = &Shard->Entries[PopQueue(Shard, &Shard->Main)];
+        if (entry->State == BlockCacheEntryDead) {
+            return entry;
+        }
+        if (entry->Freq) {
+            entry->Freq--;
+            PushQueue(Shard, &Shard->Main, (uint32_t)(entry - Shard->Entries));
+            continue;
+        }
+        UnlinkEntry(Shard, entry);
+        return entry;
+    }
+}
+
+//
+// Reserve a block for a read, or take over the reservation of an earlier read, which then fills nothing
+//
+//
+static void
+ReserveBlock(
+    BlockCacheShardT* Shard,
+    uint64_t Block,
+    uint64_t Ticket
+){
+    BlockCacheEntryT* entry = FindEntry(Shard, Block);
+    if (entry) {
+        if (entry->State == BlockCacheEntryFilling) {
+            entry->Ticket = Ticket;
+        }
+        return;
+    }
+
+    bool seen = GhostHas(Shard, Block);
+    entry = TakeEntry(Shard);
+    entry->Block = Block;
+    entry->Ticket = Ticket;
+    entry->State = BlockCacheEntryFilling;
+    entry->Freq = 0;
+
+    int32_t* bucket = BucketOfBlock(Shard, Block);
+    entry->Next = *bucket;
+    *bucket = (int32_t)(entry - Shard->Entries);
+    PushQueue(Shard, seen ? &Shard->Main : &Shard->Small, (uint32_t)(entry - Shard->Entries));
+}
+
+//
+// Copy Bytes between a buffer and an I/O vector, Skip bytes into the vector
+//
+//
+static void
+CopyIov(
+    const struct iovec *Iov,
+    int IovCnt,
+    size_t Skip,
+    char *Buffer,
+    size_t Bytes,
+    bool ToIov
+){
+    int v = 0;
+    while (v != IovCnt && Skip >= Iov[v].iov_len) {
+        Skip -= Iov[v].iov_len;
+        v++;
+    }
+
+    while (Bytes) {
+        size_t bytes = min(Bytes, Iov[v].iov_len - Skip);
+        char *iovBytes = (char*)Iov[v].iov_base + Skip;
+        if (ToIov) {
+            memcpy(iovBytes, Buffer, bytes);
+        }
+        else {
+            memcpy(Buffer, iovBytes, bytes);
+        }
+        Buffer += bytes;
+        Bytes -= bytes;
+        v++;
+        Skip = 0;
+    }
+}
+
+static ErrorCodeT
+InitShard(
+    BlockCacheShardT* Shard,
+    uint32_t NumEntries
+){
+    uint32_t numBuckets = 1;
+    while (numBuckets < NumEntries) {
+        numBuckets <<= 1;
+    }
+
+    Shard->NumEntries = NumEntries;
+    Shard->SmallTarget = max(1U, (uint32_t)(NumEntries * DDS_BACKEND_BLOCK_CACHE_SMALL_PERCENT / 100));
+    Shard->GhostSize = max(1U, NumEntries - Shard->SmallTarget);
+    Shard->BucketMask = numBuckets - 1;
+    Shard->Entries = calloc(NumEntries, sizeof(BlockCacheEntryT));
+    Shard->Data = aligned_alloc(DDS_BACKEND_PAGE_SIZE, (size_t)NumEntries * DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE);
+    Shard->Buckets = malloc(numBuckets * sizeof(int32_t));
+    Shard->Small.Ring = malloc(NumEntries * sizeof(uint32_t));
+    Shard->Main.Ring = malloc(NumEntries * sizeof(uint32_t));
+    Shard->GhostBlocks = malloc(Shard->GhostSize * sizeof(uint64_t));
+    Shard->GhostNext = malloc(Shard->GhostSize * sizeof(int32_t));
+    Shard->GhostBuckets = malloc(numBuckets * sizeof(int32_t));
+    if (!Shard->Entries || !Shard->Data || !Shard->Buckets || !Shard->Small.Ring || !Shard->Main.Ring ||
+        !Shard->GhostBlocks || !Shard->GhostNext || !Shard->GhostBuckets) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    for (uint32_t b = 0; b != numBuckets; b++) {
+        Shard->Buckets[b] = DDS_BACKEND_BLOCK_CACHE_NONE;
+        Shard->GhostBuckets[b] = DDS_BACKEND_BLOCK_CACHE_NONE;
+    }
+    for (uint32_t e = 0; e != NumEntries; e++) {
+        Shard->Entries[e].Next = e + 1 == NumEntries ? DDS_BACKEND_BLOCK_CACHE_NONE : (int32_t)(e + 1);
+    }
+    for (uint32_t g = 0; g != Shard->GhostSize; g++) {
+        Shard->GhostBlocks[g] = UINT64_MAX;
+    }
+    Shard->FreeList = 0;
+    Shard->GhostNextSlot = 0;
+    pthread_mutex_init(&Shard->Mutex, NULL);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static void
+DestroyShard(
+    BlockCacheShardT* Shard
+){
+    free(Shard->Entries);
+    free(Shard->Data);
+    free(Shard->Buckets);
+    free(Shard->Small.Ring);
+    free(Shard->Main.Ring);
+    free(Shard->GhostBlocks);
+    free(Shard->GhostNext);
+    free(Shard->GhostBuckets);
+    if (Shard->NumEntries) {
+        pthread_mutex_destroy(&Shard->Mutex);
+    }
+}
+
+//
+// Create the cache of Bytes, none if Bytes is too small for a block per shard
+//
+//
+ErrorCodeT BlockCacheInit(
+    struct DPUStorage* Sto,
+    uint64_t Bytes
+){
+    uint64_t entriesPerShard = Bytes / DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE / DDS_BACKEND_BLOCK_CACHE_SHARDS;
+    if (!entriesPerShard) {
+        SPDK_NOTICELOG("The block cache is off\n");
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+    if (entriesPerShard > INT32_MAX) {
+        entriesPerShard = INT32_MAX;
+    }
+
+    struct DPUBlockCache* cache = calloc(1, sizeof(struct DPUBlockCache));
+    if (!cache) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    Sto->BlockCache = cache;
+
+    for (int s = 0; s != DDS_BACKEND_BLOCK_CACHE_SHARDS; s++) {
+        if (InitShard(&cache->Shards[s], (uint32_t)entriesPerShard) != DDS_ERROR_CODE_SUCCESS) {
+            BlockCacheDestroy(Sto);
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+
+    atomic_init(&cache->NextTicket, 1);
+    SPDK_NOTICELOG("The block cache holds %llu blocks of %llu bytes\n",
+        (unsigned long long)entriesPerShard * DDS_BACKEND_BLOCK_CACHE_SHARDS,
+        (unsigned long long)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the cache
+//
+//
+void BlockCacheDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUBlockCache* cache = Sto->BlockCache;
+    if (!cache) {
+        return;
+    }
+
+    for (int s = 0; s != DDS_BACKEND_BLOCK_CACHE_SHARDS; s++) {
+        DestroyShard(&cache->Shards[s]);
+    }
+    free(cache);
+    Sto->BlockCache = NULL;
+}
+
+//
+// A ticket for a read that may fill the cache, 0 if the read is too large to go through it
+//
+//
+uint64_t BlockCacheTicket(
+    struct DPUBlockCache* Cache,
+    FileIOSizeT Bytes
+){
+    if (!Cache || Bytes > DDS_BACKEND_BLOCK_CACHE_MAX_READ_BYTES) {
+        return 0;
+    }
+    return atomic_fetch_add_explicit(&Cache->NextTicket, 1, memory_order_relaxed);
+}
+
+//
+// Copy Bytes at DiskAddress from the cache into the I/O vector, Skip bytes into it, if every block of them is there;
+// otherwise reserve the blocks they cover whole for the read with Ticket, and return false.
+// Blocks are copied until the first miss; the read from the device then overwrites them
+//
+//
+bool BlockCacheRead(
+    struct DPUBlockCache* Cache,
+    DiskSizeT DiskAddress,
+    FileIOSizeT Bytes,
+    const struct iovec *Iov,
+    int IovCnt,
+    size_t Skip,
+    uint64_t Ticket
+){
+    DiskSizeT end = DiskAddress + Bytes;
+    bool hit = true;
+
+    for (DiskSizeT block = DiskAddress & ~((DiskSizeT)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1); block < end;
+        block += DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE) {
+        uint64_t blockId = block / DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE;
+        DiskSizeT from = max(block, DiskAddress);
+        DiskSizeT to = min(block + DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE, end);
+        BlockCacheShardT* shard = ShardOfBlock(Cache, blockId);
+
+        pthread_mutex_lock(&shard->Mutex);
+        BlockCacheEntryT* entry = FindEntry(shard, blockId);
+        bool valid = entry && entry->State == BlockCacheEntryValid;
+        if (valid && hit) {
+            if (entry->Freq < DDS_BACKEND_BLOCK_CACHE_MAX_FREQ) {
+                entry->Freq++;
+            }
+            CopyIov(Iov, IovCnt, Skip + (size_t)(from - DiskAddress),
+                shard->Data + (size_t)(entry - shard->Entries) * DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE + (from - block),
+                (size_t)(to - from), true);
+        }
+        else if (!valid && from == block && to == block + DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE) {
+            ReserveBlock(shard, blockId, Ticket);
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+
+        hit = hit && valid;
+    }
+
+    return hit;
+}
+
+//
+// Reserve the blocks of a range of the device that are not there for the prefetch with Ticket;
+// return whether any was
+//
+//
+static bool
+ReserveBlocks(
+    struct DPUBlockCache* Cache,
+    DiskSizeT DiskAddress,
+    FileIOSizeT Bytes,
+    uint64_t Ticket
+){
+    DiskSizeT end = DiskAddress + Bytes;
+    bool reserved = false;
+
+    for (DiskSizeT block = DiskAddress; block < end; block += DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE) {
+        uint64_t blockId = block / DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE;
+        BlockCacheShardT* shard = ShardOfBlock(Cache, blockId);
+
+        pthread_mutex_lock(&shard->Mutex);
+        BlockCacheEntryT* entry = FindEntry(shard, blockId);
+        if (!entry || entry->State != BlockCacheEntryValid) {
+            ReserveBlock(shard, blockId, Ticket);
+            reserved = true;
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+    }
+
+    return reserved;
+}
+
+//
+// Fill the blocks of a range of the device reserved for the read with Ticket
+//
+//
+static void
+FillBlocks(
+    struct DPUBlockCache* Cache,
+    DiskSizeT DiskAddress,
+    FileIOSizeT Bytes,
+    const struct iovec *Iov,
+    int IovCnt,
+    size_t Skip,
+    uint64_t Ticket
+){
+    DiskSizeT end = DiskAddress + Bytes;
+
+    for (DiskSizeT block = (DiskAddress + DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1) &
+        ~((DiskSizeT)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1);
+        block + DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE <= end; block += DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE) {
+        uint64_t blockId = block / DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE;
+        BlockCacheShardT* shard = ShardOfBlock(Cache, blockId);
+
+        pthread_mutex_lock(&shard->Mutex);
+        BlockCacheEntryT* entry = FindEntry(shard, blockId);
+        if (entry && entry->State == BlockCacheEntryFilling && entry->Ticket == Ticket) {
+            CopyIov(Iov, IovCnt, Skip + (size_t)(block - DiskAddress),
+                shard->Data + (size_t)(entry - shard->Entries) * DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE,
+                DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE, false);
+            entry->State = BlockCacheEntryValid;
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+    }
+}
+
+//
+// Fill the blocks reserved for the read with Ticket from the data it read of a file, segment by segment
+//
+//
+void BlockCacheFillFile(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    const struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes,
+    uint64_t Ticket
+){
+    FileSizeT end = Offset + Bytes;
+
+    if (!Sto->BlockCache || !Ticket) {
+        return;
+    }
+
+    for (FileSizeT cur = Offset; cur < end;) {
+        SegmentIdT slot = (SegmentIdT)(cur >> DDS_BACKEND_SEGMENT_SHIFT);
+        FileSizeT next = min(((FileSizeT)slot + 1) << DDS_BACKEND_SEGMENT_SHIFT, end);
+        if (!SegmentIsHole(File, slot)) {
+            FillBlocks(Sto->BlockCache, GetSegmentAddress(File, slot) + (cur & DDS_BACKEND_SEGMENT_MASK),
+                (FileIOSizeT)(next - cur), Iov, IovCnt, (size_t)(cur - Offset), Ticket);
+        }
+        cur = next;
+    }
+}
+
+//
+// Drop the blocks of a range of the device; a dropped entry stays in its queue until eviction reaches it
+//
+//
+void BlockCacheInvalidate(
+    struct DPUBlockCache* Cache,
+    DiskSizeT DiskAddress,
+    DiskSizeT Bytes
+){
+    DiskSizeT end = DiskAddress + Bytes;
+
+    if (!Cache) {
+        return;
+    }
+
+    for (DiskSizeT block = DiskAddress & ~((DiskSizeT)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1); block < end;
+        block += DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE) {
+        uint64_t blockId = block / DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE;
+        BlockCacheShardT* shard = ShardOfBlock(Cache, blockId);
+
+        pthread_mutex_lock(&shard->Mutex);
+        BlockCacheEntryT* entry = FindEntry(shard, blockId);
+        if (entry) {
+            UnlinkEntry(shard, entry);
+            entry->State = BlockCacheEntryDead;
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+    }
+}
+
+//
+// Drop the blocks of a range of a file, segment by segment
+//
+//
+void BlockCacheInvalidateFile(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+){
+    FileSizeT end = Offset + Bytes;
+
+    if (!Sto->BlockCache) {
+        return;
+    }
+
+    for (FileSizeT cur = Offset; cur < end;) {
+        SegmentIdT slot = (SegmentIdT)(cur >> DDS_BACKEND_SEGMENT_SHIFT);
+        FileSizeT next = min(((FileSizeT)slot + 1) << DDS_BACKEND_SEGMENT_SHIFT, end);
+        if (!SegmentIsHole(File, slot)) {
+            BlockCacheInvalidate(Sto->BlockCache, GetSegmentAddress(File, slot) + (cur & DDS_BACKEND_SEGMENT_MASK),
+                next - cur);
+        }
+        cur = next;
+    }
+}
+
+//
+// A read of a file into the cache, a window at a time into Buffer; it holds the id of the file
+// rather than the file, so that a file deleted meanwhile just ends it
+//
+//
+typedef struct BlockCachePrefetch {
+    struct DPUStorage* Sto;
+    FileIdT FileId;
+    void *SPDKContext;
+    char *Buffer;
+    FileSizeT Offset;
+    FileSizeT End;
+    DiskSizeT DiskAddress;
+    FileIOSizeT Bytes;
+    uint64_t Ticket;
+} BlockCachePrefetchT;
+
+static void PrefetchNextWindow(BlockCachePrefetchT* Prefetch);
+
+static void
+PrefetchReadCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    BlockCachePrefetchT* prefetch = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        spdk_dma_free(prefetch->Buffer);
+        free(prefetch);
+        return;
+    }
+
+    struct iovec iov = { .iov_base = prefetch->Buffer, .iov_len = prefetch->Bytes };
+    FillBlocks(prefetch->Sto->BlockCache, prefetch->DiskAddress, prefetch->Bytes, &iov, 1, 0, prefetch->Ticket);
+    prefetch->Offset += prefetch->Bytes;
+    PrefetchNextWindow(prefetch);
+}
+
+//
+// Read the next window of a prefetch that has blocks missing from the cache, stopping at the end of the file;
+// a window doesn't cross segments, and holes are skipped
+//
+//
+static void
+PrefetchNextWindow(
+    BlockCachePrefetchT* Prefetch
+){
+    struct DPUStorage* sto = Prefetch->Sto;
+
+    while (Prefetch->Offset < Prefetch->End) {
+        struct DPUFile* file = GetFile(sto, Prefetch->FileId);
+        if (!file) {
+            break;
+        }
+
+        FileSizeT end = min(Prefetch->End, (GetSize(file) + DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1) &
+            ~((FileSizeT)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1));
+        if (Prefetch->Offset >= end) {
+            break;
+        }
+
+        SegmentIdT slot = (SegmentIdT)(Prefetch->Offset >> DDS_BACKEND_SEGMENT_SHIFT);
+        FileSizeT next = min(min(((FileSizeT)slot + 1) << DDS_BACKEND_SEGMENT_SHIFT, end),
+            Prefetch->Offset + DDS_BACKEND_READ_AHEAD_BYTES);
+        Prefetch->Bytes = (FileIOSizeT)(next - Prefetch->Offset);
+        if (SegmentIsHole(file, slot)) {
+            Prefetch->Offset = next;
+            continue;
+        }
+
+        Prefetch->DiskAddress = GetSegmentAddress(file, slot) + (Prefetch->Offset & DDS_BACKEND_SEGMENT_MASK);
+        if (!ReserveBlocks(sto->BlockCache, Prefetch->DiskAddress, Prefetch->Bytes, Prefetch->Ticket)) {
+            Prefetch->Offset = next;
+            continue;
+        }
+
+        if (ReadFromDiskAsyncZC(Prefetch->Buffer, Prefetch->DiskAddress, Prefetch->Bytes, PrefetchReadCallback,
+            Prefetch, sto, Prefetch->SPDKContext) == DDS_ERROR_CODE_SUCCESS) {
+            return;
+        }
+        break;
+    }
+
+    spdk_dma_free(Prefetch->Buffer);
+    free(Prefetch);
+}
+
+//
+// Read Bytes of a file at Offset into the cache in the background, on the thread of SPDKContext,
+// a window at a time; the blocks already there are not read again
+//
+//
+ErrorCodeT BlockCachePrefetchFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileSizeT Bytes,
+    void *SPDKContext
+){
+    if (!Sto->BlockCache || !Bytes) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    BlockCachePrefetchT* prefetch = malloc(sizeof(BlockCachePrefetchT));
+    if (!prefetch) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    prefetch->Buffer = spdk_dma_malloc(DDS_BACKEND_READ_AHEAD_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+    if (!prefetch->Buffer) {
+        free(prefetch);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    //
+    // Only whole blocks are cached, so the range is widened to blocks
+    //
+    //
+    prefetch->Sto = Sto;
+    prefetch->FileId = FileId;
+    prefetch->SPDKContext = SPDKContext;
+    prefetch->Offset = Offset & ~((FileSizeT)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1);
+    prefetch->End = (Offset + Bytes + DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1) &
+        ~((FileSizeT)DDS_BACKEND_BLOCK_CACHE_BLOCK_SIZE - 1);
+    prefetch->Ticket = atomic_fetch_add_explicit(&Sto->BlockCache->NextTicket, 1, memory_order_relaxed);
+    PrefetchNextWindow(prefetch);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Read ahead of a read of Bytes at Offset of a file read with ACCESS_HINT_SEQUENTIAL,
+// if the reads are half way through the window read ahead last; a read far from the window starts a new one
+//
+//
+void BlockCacheReadAhead(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    void *SPDKContext
+){
+    FileSizeT end = Offset + Bytes;
+    FileSizeT ahead = atomic_load_explicit(&File->ReadAheadEnd, memory_order_relaxed);
+    FileSizeT from = ahead;
+
+    if (ahead < end || ahead > end + 2 * DDS_BACKEND_READ_AHEAD_BYTES) {
+        from = end;
+    }
+    else if (ahead >= end + DDS_BACKEND_READ_AHEAD_BYTES / 2) {
+        return;
+    }
+
+    //
+    // One of the reads that get here at the same time moves the window
+    //
+    //
+    if (atomic_compare_exchange_strong(&File->ReadAheadEnd, &ahead, from + DDS_BACKEND_READ_AHEAD_BYTES)) {
+        BlockCachePrefetchFile(Sto, File->Properties.Id, from, DDS_BACKEND_READ_AHEAD_BYTES, SPDKContext);
+    }
+}
+#endif
@@ -0,0 +1,801 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "spdk/crc32.h"
+
+#include "DPUBackEndChecksum.h"
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+#define DDS_BACKEND_SCRUB_PERIOD_US (DDS_BACKEND_SCRUB_IO_BYTES * 1000000 / DDS_BACKEND_SCRUB_BYTES_PER_SECOND)
+#define DDS_BACKEND_SCRUB_STEPS_PER_POLL 256
+
+static inline DiskSizeT
+TableAddress(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment
+){
+    return Sto->Checksums->ChecksumsBase + (DiskSizeT)Segment * DDS_BACKEND_CHECKSUM_TABLE_BYTES;
+}
+
+static inline size_t
+EntryOfOffset(
+    FileSizeT Offset
+){
+    return (size_t)((Offset & DDS_BACKEND_SEGMENT_MASK) / DDS_BACKEND_CHECKSUM_BLOCK_SIZE);
+}
+
+//
+// The table of the segment that holds an offset of a file, NULL on a hole or if the segment has none
+//
+//
+static inline ChecksumTableT*
+TableOfOffset(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset
+){
+    SegmentIdT slot = (SegmentIdT)(Offset >> DDS_BACKEND_SEGMENT_SHIFT);
+    if (SegmentIsHole(File, slot)) {
+        return NULL;
+    }
+    return atomic_load(&Sto->Checksums->Tables[GetSegment(File, slot)]);
+}
+
+//
+// The table of a segment, created empty if it has none yet
+//
+//
+static ChecksumTableT*
+TableOfSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+    ChecksumTableT* table = atomic_load(&checksums->Tables[Segment]);
+    if (table) {
+        return table;
+    }
+
+    pthread_mutex_lock(&checksums->Mutex);
+    table = atomic_load(&checksums->Tables[Segment]);
+    if (!table) {
+        table = calloc(1, sizeof(ChecksumTableT));
+        if (table) {
+            table->Crcs = spdk_dma_zmalloc(DDS_BACKEND_CHECKSUM_TABLE_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+            if (!table->Crcs) {
+                free(table);
+                table = NULL;
+            }
+        }
+        if (table) {
+            table->Segment = Segment;
+            pthread_mutex_init(&table->Mutex, NULL);
+            for (int p = 0; p != DDS_BACKEND_CHECKSUM_PAGES_PER_TABLE; p++) {
+                table->Pages[p].Table = table;
+                table->Pages[p].Index = p;
+            }
+            atomic_store(&checksums->Tables[Segment], table);
+        }
+    }
+    pthread_mutex_unlock(&checksums->Mutex);
+
+    if (!table) {
+        SPDK_ERRLOG("No memory for the checksums of segment %d, its blocks won't be checked\n", Segment);
+    }
+    return table;
+}
+
+//
+// CRC32C of NumBlocks blocks from Skip bytes into the data, with the CRC instructions of the cores;
+// 0 marks a block without a checksum, so a block whose CRC is 0 gets 1
+//
+//
+static void
+ComputeBlockChecksums(
+    const struct iovec *Iov,
+    int IovCnt,
+    size_t Skip,
+    uint32_t *Crcs,
+    size_t NumBlocks
+){
+    int v = 0;
+    while (v != IovCnt && Skip >= Iov[v].iov_len) {
+        Skip -= Iov[v].iov_len;
+        v++;
+    }
+
+    for (size_t b = 0; b != NumBlocks; b++) {
+        uint32_t crc = ~0u;
+        size_t bytesLeft = DDS_BACKEND_CHECKSUM_BLOCK_SIZE;
+        while (bytesLeft) {
+            size_t bytes = min(bytesLeft, Iov[v].iov_len - Skip);
+            crc = spdk_crc32c_update((const char*)Iov[v].iov_base + Skip, bytes, crc);
+            bytesLeft -= bytes;
+            Skip += bytes;
+            if (Skip == Iov[v].iov_len) {
+                v++;
+                Skip = 0;
+            }
+        }
+        crc ^= ~0u;
+        Crcs[b] = crc ? crc : 1;
+    }
+}
+
+//
+// Set aside the checksum area at the end of the device, shrinking Sto->TotalSegments to the segments left for files;
+// the C segments of the area hold the tables of the T - C segments before it, so (T - C) * table <= C * segment
+//
+//
+ErrorCodeT ChecksumsInit(
+    struct DPUStorage* Sto
+){
+    struct DPUChecksums* checksums = calloc(1, sizeof(struct DPUChecksums));
+    if (!checksums) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    DiskSizeT totalSegments = (DiskSizeT)Sto->TotalSegments;
+    SegmentIdT checksumSegments = (SegmentIdT)((totalSegments * DDS_BACKEND_CHECKSUM_TABLE_BYTES +
+        DDS_BACKEND_SEGMENT_SIZE + DDS_BACKEND_CHECKSUM_TABLE_BYTES - 1) /
+        (DDS_BACKEND_SEGMENT_SIZE + DDS_BACKEND_CHECKSUM_TABLE_BYTES));
+    Sto->TotalSegments -= checksumSegments;
+
+    checksums->ChecksumsBase = (DiskSizeT)Sto->TotalSegments * DDS_BACKEND_SEGMENT_SIZE;
+    checksums->Tables = calloc(Sto->TotalSegments > 0 ? Sto->TotalSegments : 1, sizeof(*checksums->Tables));
+    checksums->ScrubBuffer = spdk_dma_zmalloc(DDS_BACKEND_SCRUB_IO_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+    if (!checksums->Tables || !checksums->ScrubBuffer) {
+        free(checksums->Tables);
+        spdk_dma_free(checksums->ScrubBuffer);
+        free(checksums);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    atomic_init(&checksums->Mismatches, 0);
+    pthread_mutex_init(&checksums->Mutex, NULL);
+    Sto->Checksums = checksums;
+
+    SPDK_NOTICELOG("The last %d segments of the store hold the checksums\n", checksumSegments);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the checksums
+//
+//
+void ChecksumsDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+    if (!checksums) {
+        return;
+    }
+
+    for (SegmentIdT s = 0; s < Sto->TotalSegments; s++) {
+        ChecksumTableT* table = atomic_load(&checksums->Tables[s]);
+        if (table) {
+            spdk_dma_free(table->Crcs);
+            pthread_mutex_destroy(&table->Mutex);
+            free(table);
+        }
+    }
+
+    free(checksums->Tables);
+    spdk_dma_free(checksums->ScrubBuffer);
+    pthread_mutex_destroy(&checksums->Mutex);
+    free(checksums);
+    Sto->Checksums = NULL;
+}
+
+//
+// Read the next tables, at most DDS_BACKEND_CHECKSUM_LOAD_INFLIGHT at a time, and call back once all are read
+//
+//
+static void LoadNextTables(struct DPUStorage* Sto);
+
+static void
+LoadTableCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    ChecksumTableT* table = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    //
+    // A table that can't be read leaves its blocks unchecked rather than failing every read of them
+    //
+    //
+    if (!Success) {
+        SPDK_WARNLOG("Failed to read the checksums of segment %d, its blocks won't be checked\n", table->Segment);
+        memset((void*)table->Crcs, 0, DDS_BACKEND_CHECKSUM_TABLE_BYTES);
+    }
+
+    Sto->Checksums->LoadsInFlight--;
+    LoadNextTables(Sto);
+}
+
+static void
+LoadNextTables(
+    struct DPUStorage* Sto
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+
+    while (checksums->LoadsInFlight < DDS_BACKEND_CHECKSUM_LOAD_INFLIGHT && checksums->LoadNext < Sto->TotalSegments) {
+        ChecksumTableT* table = atomic_load(&checksums->Tables[checksums->LoadNext++]);
+        if (!table || !table->Active) {
+            continue;
+        }
+
+        checksums->LoadsInFlight++;
+        if (ReadFromDiskAsyncZC((BufferT)table->Crcs, TableAddress(Sto, table->Segment),
+            DDS_BACKEND_CHECKSUM_TABLE_BYTES, LoadTableCallback, table, Sto,
+            checksums->LoadSPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+            SPDK_WARNLOG("Failed to read the checksums of segment %d, its blocks won't be checked\n", table->Segment);
+            checksums->LoadsInFlight--;
+        }
+    }
+
+    if (!checksums->LoadsInFlight && checksums->LoadNext == Sto->TotalSegments) {
+        checksums->LoadCallback(true, checksums->LoadArg);
+    }
+}
+
+//
+// Read the tables of the segments of the checksummed files, then run Callback
+//
+//
+void ChecksumsLoad(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ChecksumCallbackT Callback,
+    void *Arg
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+
+    for (FileIdT f = 0; f != DDS_MAX_FILES; f++) {
+        struct DPUFile* file = GetFile(Sto, f);
+        if (!file || !FileIsChecksummed(file)) {
+            continue;
+        }
+
+        for (SegmentIdT s = 0; s != GetNumSegments(file); s++) {
+            SegmentIdT segment = GetSegment(file, s);
+            if (segment == DDS_BACKEND_SEGMENT_INVALID) {
+                continue;
+            }
+            ChecksumTableT* table = TableOfSegment(Sto, segment);
+            if (table) {
+                table->Active = true;
+            }
+        }
+    }
+
+    checksums->LoadNext = 0;
+    checksums->LoadsInFlight = 0;
+    checksums->LoadSPDKContext = SPDKContext;
+    checksums->LoadCallback = Callback;
+    checksums->LoadArg = Arg;
+    LoadNextTables(Sto);
+}
+
+//
+// Call back a write once the last page it waits for is on the disk
+//
+//
+static void
+FinishChecksumUpdate(
+    ChecksumUpdateT* Update
+){
+    if (--Update->PagesLeft == 0) {
+        Update->Callback(!Update->Failed, Update->Arg);
+        free(Update);
+    }
+}
+
+static void
+ChecksumWaiterDone(
+    void *Arg
+){
+    ChecksumWaiterT* waiter = Arg;
+    if (!waiter->Success) {
+        waiter->Update->Failed = true;
+    }
+    FinishChecksumUpdate(waiter->Update);
+}
+
+//
+// A waiter is done on the thread of its write, which the write of a page may not have been issued on
+//
+//
+static void
+NotifyChecksumWaiter(
+    ChecksumWaiterT* Waiter,
+    bool Success
+){
+    struct spdk_thread *thread = Waiter->Update->Thread;
+    Waiter->Success = Success;
+
+    if (thread == spdk_get_thread()) {
+        ChecksumWaiterDone(Waiter);
+        return;
+    }
+
+    //
+    // busy retry, as with the requests sent to workers
+    //
+    //
+    while (spdk_thread_send_msg(thread, ChecksumWaiterDone, Waiter)) {
+    }
+}
+
+//
+// Take the waiters of a page for its next write if none is in flight; the table lock must be held
+//
+//
+static bool
+StartPageWrite(
+    ChecksumPageT* Page,
+    void *SPDKContext
+){
+    if (Page->InFlight || (!Page->Waiting && !Page->Dirty)) {
+        return false;
+    }
+
+    Page->InFlight = true;
+    Page->Dirty = false;
+    Page->Writing = Page->Waiting;
+    Page->Waiting = NULL;
+    Page->SPDKContext = SPDKContext;
+    return true;
+}
+
+static void SubmitPageWrite(ChecksumPageT* Page);
+
+//
+// Call back the waiters of a page write, and start the next one if changes came in meanwhile
+//
+//
+static void
+PageWritten(
+    ChecksumPageT* Page,
+    bool Success
+){
+    ChecksumTableT* table = Page->Table;
+
+    pthread_mutex_lock(&table->Mutex);
+    ChecksumWaiterT* done = Page->Writing;
+    Page->Writing = NULL;
+    Page->InFlight = false;
+    bool restart = StartPageWrite(Page, Page->SPDKContext);
+    pthread_mutex_unlock(&table->Mutex);
+
+    if (!Success) {
+        SPDK_ERRLOG("Failed to write the checksums of segment %d\n", table->Segment);
+    }
+
+    if (restart) {
+        SubmitPageWrite(Page);
+    }
+
+    while (done) {
+        ChecksumWaiterT* next = done->Next;
+        NotifyChecksumWaiter(done, Success);
+        done = next;
+    }
+}
+
+static void
+PageWriteCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    spdk_bdev_free_io(bdev_io);
+    PageWritten(Context, Success);
+}
+
+//
+// Write a page from the table itself; a change made while it is in flight marks the page for the next write
+//
+//
+static void
+SubmitPageWrite(
+    ChecksumPageT* Page
+){
+    ChecksumTableT* table = Page->Table;
+    ErrorCodeT result = WriteToDiskAsyncZC((BufferT)(table->Crcs + (size_t)Page->Index * DDS_BACKEND_CHECKSUMS_PER_PAGE),
+        TableAddress(Sto, table->Segment) + (DiskSizeT)Page->Index * DDS_BACKEND_CHECKSUM_PAGE_BYTES,
+        DDS_BACKEND_CHECKSUM_PAGE_BYTES, PageWriteCallback, Page, Sto, Page->SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        PageWritten(Page, false);
+    }
+}
+
+//
+// Give a segment newly allocated to a checksummed file an empty table, and write it out,
+// so that what its last owner left there is never loaded as its checksums
+//
+//
+void ChecksumsReset(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment,
+    void *SPDKContext
+){
+    ChecksumTableT* table = TableOfSegment(Sto, Segment);
+    if (!table) {
+        return;
+    }
+
+    ChecksumPageT* started[DDS_BACKEND_CHECKSUM_PAGES_PER_TABLE];
+    int numStarted = 0;
+
+    pthread_mutex_lock(&table->Mutex);
+    memset((void*)table->Crcs, 0, DDS_BACKEND_CHECKSUM_TABLE_BYTES);
+    table->Active = true;
+    table->Generation++;
+    for (int p = 0; p != DDS_BACKEND_CHECKSUM_PAGES_PER_TABLE; p++) {
+        table->Pages[p].Dirty = true;
+        if (StartPageWrite(&table->Pages[p], SPDKContext)) {
+            started[numStarted++] = &table->Pages[p];
+        }
+    }
+    pthread_mutex_unlock(&table->Mutex);
+
+    for (int p = 0; p != numStarted; p++) {
+        SubmitPageWrite(started[p]);
+    }
+}
+
+//
+// Stop checking a segment taken from a checksummed file; page writes in flight still finish
+//
+//
+void ChecksumsDrop(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment
+){
+    ChecksumTableT* table = atomic_load(&Sto->Checksums->Tables[Segment]);
+    if (!table) {
+        return;
+    }
+
+    pthread_mutex_lock(&table->Mutex);
+    table->Active = false;
+    table->Generation++;
+    pthread_mutex_unlock(&table->Mutex);
+}
+
+//
+// Forget the checksums of the blocks a write is about to change, so that a read meanwhile is not checked against them
+//
+//
+void ChecksumsForget(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+){
+    if (!FileIsChecksummed(File)) {
+        return;
+    }
+
+    FileSizeT end = Offset + Bytes;
+    for (FileSizeT block = Offset & ~((FileSizeT)DDS_BACKEND_CHECKSUM_BLOCK_SIZE - 1); block < end;
+        block += DDS_BACKEND_CHECKSUM_BLOCK_SIZE) {
+        ChecksumTableT* table = TableOfOffset(Sto, File, block);
+        if (table) {
+            atomic_store_explicit(&table->Crcs[EntryOfOffset(block)], 0, memory_order_relaxed);
+        }
+    }
+}
+
+//
+// Set the checksums of the blocks a write changed from the data it wrote, and call back once they are on the disk;
+// the blocks it covers whole get checksums and those at its ends that it covers in part get none.
+// The data is checksummed a page of the table at a time, outside the lock of the table
+//
+//
+void ChecksumsPersist(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    const struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes,
+    ChecksumCallbackT Callback,
+    void *Arg,
+    void *SPDKContext
+){
+    if (!FileIsChecksummed(File) || !Bytes) {
+        Callback(true, Arg);
+        return;
+    }
+
+    const FileSizeT blockMask = ~((FileSizeT)DDS_BACKEND_CHECKSUM_BLOCK_SIZE - 1);
+    FileSizeT end = Offset + Bytes;
+    FileSizeT fullBegin = (Offset + DDS_BACKEND_CHECKSUM_BLOCK_SIZE - 1) & blockMask;
+    FileSizeT fullEnd = end & blockMask;
+    FileSizeT firstSpan = Offset & ~((FileSizeT)DDS_BACKEND_CHECKSUM_PAGE_SPAN - 1);
+    int numPages = (int)((end - firstSpan + DDS_BACKEND_CHECKSUM_PAGE_SPAN - 1) / DDS_BACKEND_CHECKSUM_PAGE_SPAN);
+
+    ChecksumUpdateT* update = malloc(sizeof(ChecksumUpdateT) + numPages * sizeof(ChecksumWaiterT));
+    if (!update) {
+        Callback(false, Arg);
+        return;
+    }
+
+    update->Callback = Callback;
+    update->Arg = Arg;
+    update->Thread = spdk_get_thread();
+    update->Failed = false;
+
+    //
+    // The extra count keeps a page written early from finishing the update
+    //
+    //
+    update->PagesLeft = numPages + 1;
+
+    uint32_t crcs[DDS_BACKEND_CHECKSUMS_PER_PAGE];
+    int w = 0;
+    for (FileSizeT span = firstSpan; span < end; span += DDS_BACKEND_CHECKSUM_PAGE_SPAN, w++) {
+        ChecksumWaiterT* waiter = &update->Waiters[w];
+        waiter->Update = update;
+
+        ChecksumTableT* table = TableOfOffset(Sto, File, span);
+        if (!table) {
+            update->PagesLeft--;
+            continue;
+        }
+
+        FileSizeT begin = max(span, Offset) & blockMask;
+        FileSizeT stop = min(span + DDS_BACKEND_CHECKSUM_PAGE_SPAN, end);
+        FileSizeT fullFrom = max(begin, fullBegin);
+        FileSizeT fullTo = min(stop & blockMask, fullEnd);
+        if (fullTo > fullFrom) {
+            ComputeBlockChecksums(Iov, IovCnt, (size_t)(fullFrom - Offset), crcs,
+                (size_t)((fullTo - fullFrom) / DDS_BACKEND_CHECKSUM_BLOCK_SIZE));
+        }
+
+        ChecksumPageT* page = &table->Pages[(span & DDS_BACKEND_SEGMENT_MASK) / DDS_BACKEND_CHECKSUM_PAGE_SPAN];
+        pthread_mutex_lock(&table->Mutex);
+        for (FileSizeT block = begin; block < stop; block += DDS_BACKEND_CHECKSUM_BLOCK_SIZE) {
+            uint32_t crc = block >= fullFrom && block < fullTo ?
+                crcs[(block - fullFrom) / DDS_BACKEND_CHECKSUM_BLOCK_SIZE] : 0;
+            atomic_store_explicit(&table->Crcs[EntryOfOffset(block)], crc, memory_order_relaxed);
+        }
+        waiter->Next = page->Waiting;
+        page->Waiting = waiter;
+        bool start = StartPageWrite(page, SPDKContext);
+        pthread_mutex_unlock(&table->Mutex);
+
+        if (start) {
+            SubmitPageWrite(page);
+        }
+    }
+
+    FinishChecksumUpdate(update);
+}
+
+//
+// Whether the data a read got matches the checksums of the blocks it covers whole;
+// blocks without a checksum are taken as they are
+//
+//
+bool ChecksumsVerify(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileSizeT Offset,
+    const struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes
+){
+    if (!FileIsChecksummed(File)) {
+        return true;
+    }
+
+    FileSizeT end = Offset + Bytes;
+    for (FileSizeT block = (Offset + DDS_BACKEND_CHECKSUM_BLOCK_SIZE - 1) & ~((FileSizeT)DDS_BACKEND_CHECKSUM_BLOCK_SIZE - 1);
+        block + DDS_BACKEND_CHECKSUM_BLOCK_SIZE <= end; block += DDS_BACKEND_CHECKSUM_BLOCK_SIZE) {
+        ChecksumTableT* table = TableOfOffset(Sto, File, block);
+        if (!table) {
+            continue;
+        }
+
+        uint32_t expected = atomic_load_explicit(&table->Crcs[EntryOfOffset(block)], memory_order_relaxed);
+        if (!expected) {
+            continue;
+        }
+
+        uint32_t crc;
+        ComputeBlockChecksums(Iov, IovCnt, (size_t)(block - Offset), &crc, 1);
+        if (crc != expected) {
+            atomic_fetch_add(&Sto->Checksums->Mismatches, 1);
+            SPDK_ERRLOG("The block at %lu of file %hu doesn't match its checksum\n", block, File->Properties.Id);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Move the scrubber to the next range, and to the next segment past the end of one
+//
+//
+static void
+AdvanceScrub(
+    struct DPUStorage* Sto
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+    checksums->ScrubOffset += DDS_BACKEND_SCRUB_IO_BYTES;
+    if (checksums->ScrubOffset == DDS_BACKEND_SEGMENT_SIZE) {
+        checksums->ScrubOffset = 0;
+        checksums->ScrubSegment = (checksums->ScrubSegment + 1) % Sto->TotalSegments;
+    }
+}
+
+static void
+IssueScrubRead(
+    struct DPUStorage* Sto,
+    ChecksumTableT* Table
+);
+
+//
+// Check the range read against its table, if the table still has the same segment;
+// a range that mismatches is read once more, lest a write that raced the read be taken for corruption
+//
+//
+static void
+ScrubReadCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    ChecksumTableT* table = Context;
+    struct DPUChecksums* checksums = Sto->Checksums;
+    spdk_bdev_free_io(bdev_io);
+
+    pthread_mutex_lock(&table->Mutex);
+    bool current = table->Active && table->Generation == checksums->ScrubGeneration;
+    pthread_mutex_unlock(&table->Mutex);
+
+    if (!Success) {
+        SPDK_WARNLOG("Failed to read segment %d at %u to scrub it\n", table->Segment, checksums->ScrubOffset);
+    }
+
+    int mismatches = 0;
+    SegmentSizeT firstMismatch = 0;
+    if (Success && current) {
+        struct iovec iov = { .iov_base = checksums->ScrubBuffer, .iov_len = checksums->ScrubBytes };
+        size_t firstEntry = checksums->ScrubOffset / DDS_BACKEND_CHECKSUM_BLOCK_SIZE;
+        for (size_t b = 0; b != checksums->ScrubBytes / DDS_BACKEND_CHECKSUM_BLOCK_SIZE; b++) {
+            uint32_t expected = atomic_load_explicit(&table->Crcs[firstEntry + b], memory_order_relaxed);
+            if (!expected) {
+                continue;
+            }
+
+            uint32_t crc;
+            ComputeBlockChecksums(&iov, 1, b * DDS_BACKEND_CHECKSUM_BLOCK_SIZE, &crc, 1);
+            if (crc != expected && !mismatches++) {
+                firstMismatch = checksums->ScrubOffset + (SegmentSizeT)(b * DDS_BACKEND_CHECKSUM_BLOCK_SIZE);
+            }
+        }
+    }
+
+    if (mismatches && !checksums->ScrubRetried) {
+        checksums->ScrubRetried = true;
+        IssueScrubRead(Sto, table);
+        return;
+    }
+
+    if (mismatches) {
+        atomic_fetch_add(&checksums->Mismatches, mismatches);
+        SPDK_ERRLOG("Scrubbing found %d blocks of segment %d of file %hu that don't match their checksums, the first at %u\n",
+            mismatches, table->Segment, Sto->AllSegments[table->Segment].FileId, firstMismatch);
+    }
+
+    AdvanceScrub(Sto);
+    checksums->ScrubInFlight = false;
+}
+
+static void
+IssueScrubRead(
+    struct DPUStorage* Sto,
+    ChecksumTableT* Table
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+
+    if (ReadFromDiskAsyncZC(checksums->ScrubBuffer,
+        Sto->AllSegments[Table->Segment].DiskAddress + checksums->ScrubOffset, checksums->ScrubBytes,
+        ScrubReadCallback, Table, Sto, checksums->ScrubSPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        AdvanceScrub(Sto);
+        checksums->ScrubInFlight = false;
+    }
+}
+
+//
+// Read the next range of a checksummed segment that has any checksum, one range per period of the poller,
+// skipping ranges and segments without checksums a bounded number of steps per run
+//
+//
+static int
+ChecksumsScrubPoller(
+    void *Ctx
+){
+    struct DPUStorage* sto = Ctx;
+    struct DPUChecksums* checksums = sto->Checksums;
+
+    if (!G_INITIALIZATION_DONE || checksums->ScrubInFlight || sto->TotalSegments <= 0) {
+        return SPDK_POLLER_IDLE;
+    }
+
+    for (int step = 0; step != DDS_BACKEND_SCRUB_STEPS_PER_POLL; step++) {
+        ChecksumTableT* table = atomic_load(&checksums->Tables[checksums->ScrubSegment]);
+        if (!table || !table->Active) {
+            checksums->ScrubOffset = 0;
+            checksums->ScrubSegment = (checksums->ScrubSegment + 1) % sto->TotalSegments;
+            continue;
+        }
+
+        size_t firstEntry = checksums->ScrubOffset / DDS_BACKEND_CHECKSUM_BLOCK_SIZE;
+        bool any = false;
+        for (size_t e = 0; e != DDS_BACKEND_SCRUB_IO_BYTES / DDS_BACKEND_CHECKSUM_BLOCK_SIZE && !any; e++) {
+            any = atomic_load_explicit(&table->Crcs[firstEntry + e], memory_order_relaxed) != 0;
+        }
+        if (!any) {
+            AdvanceScrub(sto);
+            continue;
+        }
+
+        pthread_mutex_lock(&table->Mutex);
+        checksums->ScrubGeneration = table->Generation;
+        pthread_mutex_unlock(&table->Mutex);
+
+        checksums->ScrubInFlight = true;
+        checksums->ScrubRetried = false;
+        checksums->ScrubBytes = DDS_BACKEND_SCRUB_IO_BYTES;
+        IssueScrubRead(sto, table);
+        return SPDK_POLLER_BUSY;
+    }
+
+    return SPDK_POLLER_IDLE;
+}
+
+//
+// Start scrubbing the checksummed segments on the current thread, at DDS_BACKEND_SCRUB_BYTES_PER_SECOND at most
+//
+//
+void ChecksumsStartScrubber(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    struct DPUChecksums* checksums = Sto->Checksums;
+    if (!checksums) {
+        return;
+    }
+
+    checksums->ScrubSPDKContext = SPDKContext;
+    checksums->ScrubPoller = spdk_poller_register(ChecksumsScrubPoller, Sto, DDS_BACKEND_SCRUB_PERIOD_US);
+    if (checksums->ScrubPoller == NULL) {
+        SPDK_ERRLOG("Could not register the checksum scrubber\n");
+    }
+}
+
+//
+// Stop scrubbing, on the thread that started it
+//
+//
+void ChecksumsStopScrubber(
+    struct DPUStorage* Sto
+){
+    if (Sto && Sto->Checksums && Sto->Checksums->ScrubPoller) {
+        spdk_poller_unregister(&Sto->Checksums->ScrubPoller);
+    }
+}
+#endif
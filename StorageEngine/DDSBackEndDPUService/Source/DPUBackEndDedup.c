@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DPUBackEndDedup.h"
+#include "DPUBackEndJournal.h"
+#include "DPULog.h"
+
+#ifdef OPT_FILE_SERVICE_DEDUP
+static inline uint32_t
+HomeOfFingerprint(
+    struct DPUDedup* Dedup,
+    const uint8_t* Fingerprint
+){
+    uint32_t hash;
+    memcpy(&hash, Fingerprint, sizeof(hash));
+    return hash & Dedup->IndexMask;
+}
+
+//
+// Take the entry at Position out of the index, shifting the entries probed past it back into the hole
+//
+//
+static void
+RemoveIndexEntry(
+    struct DPUDedup* Dedup,
+    uint32_t Position
+){
+    DedupIndexEntryT* index = Dedup->Index;
+    uint32_t mask = Dedup->IndexMask;
+    uint32_t hole = Position;
+
+    Dedup->IndexOf[index[Position].Segment] = -1;
+    for (uint32_t next = (Position + 1) & mask; index[next].Segment != DDS_BACKEND_SEGMENT_INVALID;
+        next = (next + 1) & mask) {
+        uint32_t home = HomeOfFingerprint(Dedup, index[next].Fingerprint);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index[hole] = index[next];
+            Dedup->IndexOf[index[hole].Segment] = (int32_t)hole;
+            hole = next;
+        }
+    }
+    index[hole].Segment = DDS_BACKEND_SEGMENT_INVALID;
+}
+
+//
+// The segment indexed with a fingerprint and the epoch it was indexed at, or DDS_BACKEND_SEGMENT_INVALID;
+// an entry whose segment has changed since is dropped
+//
+//
+static SegmentIdT
+FindIndexedSegment(
+    struct DPUDedup* Dedup,
+    const uint8_t* Fingerprint,
+    uint32_t* Epoch
+){
+    DedupIndexEntryT* index = Dedup->Index;
+
+    for (uint32_t pos = HomeOfFingerprint(Dedup, Fingerprint); index[pos].Segment != DDS_BACKEND_SEGMENT_INVALID;
+        pos = (pos + 1) & Dedup->IndexMask) {
+        if (memcmp(index[pos].Fingerprint, Fingerprint, SHA256_DIGEST_LENGTH)) {
+            continue;
+        }
+        if (index[pos].Epoch != atomic_load(&Dedup->Epochs[index[pos].Segment])) {
+            RemoveIndexEntry(Dedup, pos);
+            return DDS_BACKEND_SEGMENT_INVALID;
+        }
+        *Epoch = index[pos].Epoch;
+        return index[pos].Segment;
+    }
+
+    return DDS_BACKEND_SEGMENT_INVALID;
+}
+
+//
+// Index a segment by its fingerprint, in place of what it was indexed by before;
+// no valid entry has the fingerprint, and a segment has one entry at most, so the index always has room
+//
+//
+static void
+IndexSegment(
+    struct DPUDedup* Dedup,
+    const uint8_t* Fingerprint,
+    SegmentIdT Segment
+){
+    DedupIndexEntryT* index = Dedup->Index;
+
+    if (Dedup->IndexOf[Segment] >= 0) {
+        RemoveIndexEntry(Dedup, (uint32_t)Dedup->IndexOf[Segment]);
+    }
+
+    uint32_t pos = HomeOfFingerprint(Dedup, Fingerprint);
+    while (index[pos].Segment != DDS_BACKEND_SEGMENT_INVALID) {
+        pos = (pos + 1) & Dedup->IndexMask;
+    }
+    memcpy(index[pos].Fingerprint, Fingerprint, SHA256_DIGEST_LENGTH);
+    index[pos].Segment = Segment;
+    index[pos].Epoch = atomic_load(&Dedup->Epochs[Segment]);
+    Dedup->IndexOf[Segment] = (int32_t)pos;
+}
+
+//
+// End a stream; its writes still in flight count as untracked writes of its file
+//
+//
+static void
+EndStream(
+    struct DPUDedup* Dedup,
+    DedupStreamT* Stream
+){
+    Dedup->Untracked[Stream->FileId] += Stream->WritesInFlight;
+    Dedup->ActiveStreams[Stream->FileId]--;
+    Stream->WritesInFlight = 0;
+    Stream->InUse = false;
+    Stream->Generation++;
+}
+
+//
+// Start a stream at the start of a slot, on a free one, or return NULL if all are busy
+//
+//
+static DedupStreamT*
+StartStream(
+    struct DPUDedup* Dedup,
+    FileIdT FileId,
+    SegmentIdT Slot
+){
+    for (int s = 0; s != DDS_BACKEND_DEDUP_STREAMS; s++) {
+        DedupStreamT* stream = &Dedup->Streams[s];
+        if (stream->InUse || atomic_load(&stream->HashTurn) != stream->NextTicket) {
+            continue;
+        }
+
+        stream->InUse = true;
+        stream->FileId = FileId;
+        stream->Slot = Slot;
+        stream->NextOffset = 0;
+        stream->WritesInFlight = 0;
+        stream->NextTicket = 0;
+        atomic_store(&stream->HashTurn, 0);
+        SHA256_Init(&stream->Sha);
+        Dedup->ActiveStreams[FileId]++;
+        return stream;
+    }
+
+    return NULL;
+}
+
+//
+// Take a reference to a segment of another file for the time of a remap, as a sharer, so that it is not freed
+// meanwhile; the lock of its owner keeps the owner from dropping it while it is checked
+//
+//
+static bool
+PinSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId,
+    FileIdT FileId
+){
+    SegmentT* segment = &Sto->AllSegments[SegmentId];
+    FileIdT owner = segment->FileId;
+    struct DPUFile* ownerFile = NULL;
+    bool pinned;
+
+    if (owner == FileId) {
+        return false;
+    }
+    if (owner != DDS_FILE_INVALID) {
+        ownerFile = GetFile(Sto, owner);
+        if (!ownerFile) {
+            return false;
+        }
+        LockFile(ownerFile);
+    }
+
+    pthread_mutex_lock(&Sto->SharedSegmentsMutex);
+    pinned = segment->FileId == owner && (owner != DDS_FILE_INVALID || atomic_load(&segment->Sharers));
+    if (pinned) {
+        atomic_fetch_add(&segment->Sharers, 1);
+    }
+    pthread_mutex_unlock(&Sto->SharedSegmentsMutex);
+
+    if (ownerFile) {
+        UnlockFile(ownerFile);
+    }
+    return pinned;
+}
+
+static void
+SegmentDeduplicatedCallback(
+    bool Success,
+    ContextT Context
+){
+    if (!Success) {
+        SPDK_ERRLOG("Failed to journal the remap of a deduplicated segment\n");
+    }
+}
+
+//
+// Remap the slot a stream hashed to the indexed segment of the same content, or index the segment of the slot;
+// only a segment the file owns alone is either. The caller holds the mutex of the deduplication
+//
+//
+static void
+DeduplicateSegment(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT Slot,
+    const uint8_t* Fingerprint,
+    void *SPDKContext
+){
+    struct DPUDedup* dedup = Sto->Dedup;
+    struct DPUFile* file = GetFile(Sto, FileId);
+    if (!file || SegmentIsHole(file, Slot) || atomic_load(&file->CopiesInFlight)) {
+        return;
+    }
+
+    SegmentIdT old = GetSegment(file, Slot);
+    if (SegmentIsCold(old) || Sto->AllSegments[old].FileId != FileId || atomic_load(&Sto->AllSegments[old].Sharers)) {
+        return;
+    }
+
+    uint32_t epoch;
+    SegmentIdT match = FindIndexedSegment(dedup, Fingerprint, &epoch);
+    if (match == DDS_BACKEND_SEGMENT_INVALID) {
+        IndexSegment(dedup, Fingerprint, old);
+        return;
+    }
+    if (match == old || !PinSegment(Sto, match, FileId)) {
+        return;
+    }
+
+    //
+    // A segment freed before it was pinned has a new epoch
+    //
+    //
+    if (atomic_load(&dedup->Epochs[match]) == epoch) {
+        DPUJournalRecordT record;
+        memset(&record, 0, sizeof(record));
+        record.Type = DDS_JOURNAL_RECORD_REMAP_SEGMENT;
+        record.Remap.Id = FileId;
+        record.Remap.Slot = Slot;
+        record.Remap.Old = old;
+        record.Remap.New = match;
+
+        if (JournalApply(Sto, &record) == DDS_ERROR_CODE_SUCCESS) {
+            ErrorCodeT result = JournalCommit(Sto, &record, SegmentDeduplicatedCallback, NULL, SPDKContext);
+#ifdef OPT_FILE_SERVICE_TRIM
+            if (result == DDS_ERROR_CODE_SUCCESS) {
+                SealFreedSegments(Sto, SPDKContext);
+            }
+#endif
+            if (result != DDS_ERROR_CODE_SUCCESS) {
+                SPDK_ERRLOG("Failed to journal the remap of slot %d of file %hu with %d\n", Slot, FileId, result);
+            }
+            atomic_fetch_add(&dedup->SegmentsDeduplicated, 1);
+        }
+    }
+
+    LockFile(file);
+    ReleaseSegmentOfFile(Sto, FileId, match);
+    UnlockFile(file);
+}
+
+//
+// Set up the streams and an empty index for the segments of the store
+//
+//
+ErrorCodeT DedupInit(
+    struct DPUStorage* Sto
+){
+    struct DPUDedup* dedup = calloc(1, sizeof(struct DPUDedup));
+    if (!dedup) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    uint32_t indexEntries = 1;
+    while (indexEntries < (uint32_t)Sto->TotalSegments * DDS_BACKEND_DEDUP_INDEX_LOAD) {
+        indexEntries <<= 1;
+    }
+
+    dedup->Index = malloc(indexEntries * sizeof(DedupIndexEntryT));
+    dedup->IndexOf = malloc(Sto->TotalSegments * sizeof(int32_t));
+    dedup->Epochs = calloc(Sto->TotalSegments, sizeof(*dedup->Epochs));
+    if (!dedup->Index || !dedup->IndexOf || !dedup->Epochs) {
+        free(dedup->Index);
+        free(dedup->IndexOf);
+        free(dedup->Epochs);
+        free(dedup);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    dedup->IndexMask = indexEntries - 1;
+    for (uint32_t e = 0; e != indexEntries; e++) {
+        dedup->Index[e].Segment = DDS_BACKEND_SEGMENT_INVALID;
+    }
+    for (SegmentIdT s = 0; s != Sto->TotalSegments; s++) {
+        dedup->IndexOf[s] = -1;
+    }
+    for (int s = 0; s != DDS_BACKEND_DEDUP_STREAMS; s++) {
+        atomic_init(&dedup->Streams[s].HashTurn, 0);
+    }
+    atomic_init(&dedup->SegmentsHashed, 0);
+    atomic_init(&dedup->SegmentsDeduplicated, 0);
+    pthread_mutex_init(&dedup->Mutex, NULL);
+    Sto->Dedup = dedup;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the index
+//
+//
+void DedupDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUDedup* dedup = Sto->Dedup;
+    if (!dedup) {
+        return;
+    }
+
+    SPDK_NOTICELOG("Deduplication hashed %lu segments and remapped %lu of them\n",
+        atomic_load(&dedup->SegmentsHashed), atomic_load(&dedup->SegmentsDeduplicated));
+
+    free(dedup->Index);
+    free(dedup->IndexOf);
+    free(dedup->Epochs);
+    pthread_mutex_destroy(&dedup->Mutex);
+    free(dedup);
+    Sto->Dedup = NULL;
+}
+
+//
+// Count a write about to be issued: hash it if it is the next write of a stream or starts one,
+// or drop the segments it covers from the index otherwise
+//
+//
+void DedupNoteWrite(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext
+){
+    struct DPUDedup* dedup = Sto->Dedup;
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    FileIdT fileId = context->Request->FileId;
+    FileSizeT offset = context->Request->Offset;
+    FileIOSizeT bytes = context->DataBuffer.TotalSize;
+
+    SlotContext->DedupNoted = false;
+    struct DPUFile* file = dedup ? GetFile(Sto, fileId) : NULL;
+    if (!file || !bytes) {
+        return;
+    }
+
+    SegmentIdT firstSlot = (SegmentIdT)(offset >> DDS_BACKEND_SEGMENT_SHIFT);
+    SegmentIdT lastSlot = (SegmentIdT)((offset + bytes - 1) >> DDS_BACKEND_SEGMENT_SHIFT);
+    SegmentSizeT offsetOnSegment = (SegmentSizeT)(offset & DDS_BACKEND_SEGMENT_MASK);
+    bool streamable = firstSlot == lastSlot && !((offset | bytes) & (DDS_BACKEND_SECTOR_SIZE - 1)) &&
+        !FileIsChecksummed(file);
+#ifdef OPT_FILE_SERVICE_ZONED
+    streamable = streamable && !Sto->Zoned;
+#endif
+    DedupStreamT* stream = NULL;
+    uint32_t ticket = 0;
+
+    pthread_mutex_lock(&dedup->Mutex);
+
+    for (SegmentIdT slot = firstSlot; slot <= lastSlot; slot++) {
+        if (!SegmentIsHole(file, slot)) {
+            atomic_fetch_add(&dedup->Epochs[GetSegment(file, slot)], 1);
+        }
+    }
+
+    if (dedup->ActiveStreams[fileId]) {
+        for (int s = 0; s != DDS_BACKEND_DEDUP_STREAMS; s++) {
+            DedupStreamT* other = &dedup->Streams[s];
+            if (!other->InUse || other->FileId != fileId || other->Slot < firstSlot || other->Slot > lastSlot) {
+                continue;
+            }
+            if (streamable && other->NextOffset == offsetOnSegment) {
+                stream = other;
+            }
+            else {
+                EndStream(dedup, other);
+            }
+        }
+    }
+    if (!stream && streamable && !offsetOnSegment && !dedup->Untracked[fileId]) {
+        stream = StartStream(dedup, fileId, firstSlot);
+    }
+
+    if (stream) {
+        stream->NextOffset += bytes;
+        stream->WritesInFlight++;
+        ticket = stream->NextTicket++;
+        SlotContext->DedupStream = (int)(stream - dedup->Streams);
+        SlotContext->DedupGeneration = stream->Generation;
+    }
+    else {
+        dedup->Untracked[fileId]++;
+        SlotContext->DedupStream = -1;
+    }
+    SlotContext->DedupNoted = true;
+
+    pthread_mutex_unlock(&dedup->Mutex);
+
+    if (!stream) {
+        return;
+    }
+
+    //
+    // Hash in the order of the stream, after the writes before this one
+    //
+    //
+    while (atomic_load_explicit(&stream->HashTurn, memory_order_acquire) != ticket) {
+    }
+
+    SplittableBufferT* buffer = &context->DataBuffer;
+    FileIOSizeT bytesOnFirst = min(buffer->FirstSize, bytes);
+    SHA256_Update(&stream->Sha, buffer->FirstAddr, bytesOnFirst);
+    if (bytes > bytesOnFirst) {
+        SHA256_Update(&stream->Sha, buffer->SecondAddr, bytes - bytesOnFirst);
+    }
+
+    atomic_store_explicit(&stream->HashTurn, ticket + 1, memory_order_release);
+}
+
+//
+// A write that was counted is done; the last write of a stream looks up the hash of its segment,
+// and remaps its slot to a segment of the same content or indexes it
+//
+//
+void DedupWriteDone(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext,
+    bool Success
+){
+    struct DPUDedup* dedup = Sto->Dedup;
+    if (!dedup || !SlotContext->DedupNoted) {
+        return;
+    }
+    SlotContext->DedupNoted = false;
+
+    FileIdT fileId = SlotContext->Ctx->Request->FileId;
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+
+    pthread_mutex_lock(&dedup->Mutex);
+
+    DedupStreamT* stream = SlotContext->DedupStream >= 0 ? &dedup->Streams[SlotContext->DedupStream] : NULL;
+    if (!stream || !stream->InUse || stream->Generation != SlotContext->DedupGeneration) {
+        dedup->Untracked[fileId]--;
+        pthread_mutex_unlock(&dedup->Mutex);
+        return;
+    }
+
+    stream->WritesInFlight--;
+    if (!Success) {
+        EndStream(dedup, stream);
+    }
+    else if (stream->NextOffset == DDS_BACKEND_SEGMENT_SIZE && !stream->WritesInFlight) {
+        SegmentIdT slot = stream->Slot;
+        SHA256_Final(fingerprint, &stream->Sha);
+        EndStream(dedup, stream);
+        atomic_fetch_add(&dedup->SegmentsHashed, 1);
+        DeduplicateSegment(Sto, fileId, slot, fingerprint, SlotContext->SPDKContext);
+    }
+
+    pthread_mutex_unlock(&dedup->Mutex);
+}
+
+//
+// Drop a segment that is freed from the index
+//
+//
+void DedupForgetSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT Segment
+){
+    if (Sto->Dedup) {
+        atomic_fetch_add(&Sto->Dedup->Epochs[Segment], 1);
+    }
+}
+#endif
@@ -0,0 +1,599 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DPUBackEndDefrag.h"
+#include "DPUBackEndJournal.h"
+#include "DPUBackEndTier.h"
+#include "DPULog.h"
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+#define DDS_BACKEND_DEFRAG_PERIOD_US (DDS_BACKEND_DEFRAG_IO_BYTES * 1000000 / DDS_BACKEND_DEFRAG_BYTES_PER_SECOND)
+#define DDS_BACKEND_DEFRAG_STEPS_PER_POLL 256
+
+//
+// Set up the defragmentation; there is none on zoned storage
+//
+//
+ErrorCodeT DefragInit(
+    struct DPUStorage* Sto
+){
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+#endif
+
+    struct DPUDefrag* defrag = calloc(1, sizeof(struct DPUDefrag));
+    if (!defrag) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    defrag->Buffer = spdk_dma_zmalloc(DDS_BACKEND_DEFRAG_IO_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+    if (!defrag->Buffer) {
+        free(defrag);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    defrag->NextSlot = 1;
+    atomic_init(&defrag->SegmentsMoved, 0);
+    atomic_init(&defrag->MovesCancelled, 0);
+    pthread_mutex_init(&defrag->Mutex, NULL);
+    Sto->Defrag = defrag;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the defragmentation
+//
+//
+void DefragDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    if (!defrag) {
+        return;
+    }
+
+    SPDK_NOTICELOG("Defragmentation moved %lu segments, and gave way to writes %lu times\n",
+        atomic_load(&defrag->SegmentsMoved), atomic_load(&defrag->MovesCancelled));
+
+    spdk_dma_free(defrag->Buffer);
+    pthread_mutex_destroy(&defrag->Mutex);
+    free(defrag);
+    Sto->Defrag = NULL;
+}
+
+//
+// A write of a file that is moving a segment: cancel the move, or hold the write if it covers the slot
+// being remapped, and return whether it is held; the caller holds the lock of the file
+//
+//
+bool DefragHoldWrite(
+    struct DPUFile* File,
+    SnapshotWaiterT* Waiter
+){
+    DefragMoveT* move = File->Move;
+
+    if (!move->Remapping) {
+        move->Cancelled = true;
+        return false;
+    }
+
+    if ((SegmentIdT)(Waiter->Offset >> DDS_BACKEND_SEGMENT_SHIFT) > move->Slot ||
+        (SegmentIdT)((Waiter->Offset + Waiter->Bytes - 1) >> DDS_BACKEND_SEGMENT_SHIFT) < move->Slot) {
+        return false;
+    }
+
+    if (move->WaitersTail) {
+        move->WaitersTail->Next = Waiter;
+    }
+    else {
+        move->WaitersHead = Waiter;
+    }
+    move->WaitersTail = Waiter;
+
+    return true;
+}
+
+//
+// Drop the move of a file being deleted, before the file is freed
+//
+//
+void DefragForgetFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    if (!defrag) {
+        return;
+    }
+
+    pthread_mutex_lock(&defrag->Mutex);
+    if (defrag->Active && defrag->Move.FileId == FileId) {
+        defrag->Move.Forgotten = true;
+    }
+    pthread_mutex_unlock(&defrag->Mutex);
+}
+
+//
+// End the move once nothing of it is in flight: give the new segment back unless the slot was remapped to it,
+// and let the writes held for the remapping go again, or fail them if the remapping or the file is lost
+//
+//
+static void
+EndMove(
+    struct DPUStorage* Sto,
+    bool Success
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    DefragMoveT* move = &defrag->Move;
+
+    pthread_mutex_lock(&defrag->Mutex);
+    SnapshotWaiterT* waiters = move->WaitersHead;
+    bool forgotten = move->Forgotten;
+    bool remapped = move->Remapped;
+
+    if (!forgotten) {
+        struct DPUFile* file = GetFile(Sto, move->FileId);
+        LockFile(file);
+        if (!remapped) {
+            ReleaseSegmentOfFile(Sto, move->FileId, move->New);
+        }
+        file->Move = NULL;
+        atomic_fetch_sub(&file->CopiesInFlight, 1);
+        UnlockFile(file);
+    }
+    else if (!remapped) {
+        ReleaseSegmentOfFile(Sto, move->FileId, move->New);
+    }
+
+    if (remapped && Success) {
+        _Atomic uint64_t* moved = &defrag->SegmentsMoved;
+#ifdef OPT_FILE_SERVICE_TIERING
+        if (move->Kind == DEFRAG_MOVE_DEMOTE) {
+            moved = &Sto->Tier->SegmentsDemoted;
+        }
+        else if (move->Kind == DEFRAG_MOVE_RECALL) {
+            moved = &Sto->Tier->SegmentsRecalled;
+        }
+#endif
+        atomic_fetch_add(moved, 1);
+    }
+    else if (move->Cancelled) {
+        atomic_fetch_add(&defrag->MovesCancelled, 1);
+    }
+    defrag->Active = false;
+    pthread_mutex_unlock(&defrag->Mutex);
+
+    ResumeHeldWrites(waiters, !forgotten && (Success || !remapped));
+}
+
+static void
+DefragRemappedCallback(
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    DefragMoveT* move = &sto->Defrag->Move;
+    if (!Success) {
+        SPDK_ERRLOG("Failed to journal the move of segment %d of file %hu\n", move->Slot, move->FileId);
+    }
+
+    sto->Defrag->InFlight = false;
+    EndMove(sto, Success);
+}
+
+//
+// Map the new segment at the slot and free the old one, unless a write cancelled the move, then journal it;
+// from here on the writes to the slot wait for the record to be on the disk
+//
+//
+static void
+RemapMovedSegment(
+    struct DPUStorage* Sto
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    DefragMoveT* move = &defrag->Move;
+    DPUJournalRecordT record;
+    ErrorCodeT result;
+
+    pthread_mutex_lock(&defrag->Mutex);
+    bool cancelled = move->Forgotten || move->Failed;
+    if (!cancelled) {
+        struct DPUFile* file = GetFile(Sto, move->FileId);
+        LockFile(file);
+        cancelled = move->Cancelled;
+        move->Remapping = !cancelled;
+        UnlockFile(file);
+    }
+
+    if (!cancelled) {
+        memset(&record, 0, sizeof(record));
+        record.Type = DDS_JOURNAL_RECORD_REMAP_SEGMENT;
+        record.Remap.Id = move->FileId;
+        record.Remap.Slot = move->Slot;
+        record.Remap.Old = move->Old;
+        record.Remap.New = move->New;
+
+        //
+        // A slot the file has dropped or refilled meanwhile is left alone, and the new segment given back
+        //
+        //
+        move->Remapped = JournalApply(Sto, &record) == DDS_ERROR_CODE_SUCCESS;
+    }
+    pthread_mutex_unlock(&defrag->Mutex);
+
+    if (!move->Remapped) {
+        EndMove(Sto, !cancelled);
+        return;
+    }
+
+    defrag->InFlight = true;
+    result = JournalCommit(Sto, &record, DefragRemappedCallback, Sto, defrag->SPDKContext);
+#ifdef OPT_FILE_SERVICE_TRIM
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        SealFreedSegments(Sto, defrag->SPDKContext);
+    }
+#endif
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to journal the move of segment %d of file %hu with %d\n", move->Slot, move->FileId, result);
+        defrag->InFlight = false;
+        EndMove(Sto, false);
+    }
+}
+
+static void
+ChunkWrittenCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    DefragMoveT* move = &sto->Defrag->Move;
+    spdk_bdev_free_io(bdev_io);
+
+    if (Success) {
+        move->NextOffset += move->ChunkBytes;
+    }
+    else {
+        move->Failed = true;
+    }
+    sto->Defrag->InFlight = false;
+}
+
+static void
+ChunkReadCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    struct DPUDefrag* defrag = sto->Defrag;
+    DefragMoveT* move = &defrag->Move;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success || WriteToDiskAsyncZC(defrag->Buffer, sto->AllSegments[move->New].DiskAddress + move->NextOffset,
+        move->ChunkBytes, ChunkWrittenCallback, sto, sto, defrag->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        move->Failed = true;
+        defrag->InFlight = false;
+    }
+}
+
+#ifdef OPT_FILE_SERVICE_TIERING
+static void
+TierFlushedCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (Success) {
+        sto->Defrag->Move.Flushed = true;
+    }
+    else {
+        sto->Defrag->Move.Failed = true;
+    }
+    sto->Defrag->InFlight = false;
+}
+
+//
+// Flush the capacity bdev once a demoted segment is copied, so that the copy is there before the remapping;
+// a flush the bdev has no room for is tried again by the next poll
+//
+//
+static void
+FlushDemotedSegment(
+    struct DPUStorage* Sto
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+
+    defrag->InFlight = true;
+    int rc = BdevFlushTier(defrag->SPDKContext, TierFlushedCallback, Sto);
+    if (rc) {
+        defrag->InFlight = false;
+        if (rc == -ENOTSUP) {
+            defrag->Move.Flushed = true;
+        }
+        else if (rc != -ENOMEM) {
+            defrag->Move.Failed = true;
+        }
+    }
+}
+#endif
+
+//
+// Copy the next chunk of the segment
+//
+//
+static void
+CopyNextChunk(
+    struct DPUStorage* Sto
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    DefragMoveT* move = &defrag->Move;
+
+    move->ChunkBytes = min(move->Bytes - move->NextOffset, (SegmentSizeT)DDS_BACKEND_DEFRAG_IO_BYTES);
+    defrag->InFlight = true;
+    if (ReadFromDiskAsyncZC(defrag->Buffer, Sto->AllSegments[move->Old].DiskAddress + move->NextOffset,
+        move->ChunkBytes, ChunkReadCallback, Sto, Sto, defrag->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        move->Failed = true;
+        defrag->InFlight = false;
+    }
+}
+
+//
+// Whether the move goes on: its file is still there, no write cancelled it and no chunk failed;
+// called with the mutex held
+//
+//
+static bool
+MoveGoesOn(
+    struct DPUStorage* Sto,
+    DefragMoveT* Move
+){
+    if (Move->Forgotten || Move->Failed) {
+        return false;
+    }
+
+    struct DPUFile* file = GetFile(Sto, Move->FileId);
+    LockFile(file);
+    bool cancelled = Move->Cancelled;
+    UnlockFile(file);
+
+    return !cancelled;
+}
+
+//
+// Claim the segment a move of the segment Old at Slot of a file goes to: Target to place it,
+// a free one of the capacity bdev to demote it, and one after the segment before it if that's free to recall it;
+// called with the lock of the file held
+//
+//
+static bool
+ClaimMoveTarget(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileIdT FileId,
+    SegmentIdT Slot,
+    SegmentIdT Old,
+    DefragMoveKindT Kind,
+    SegmentIdT* Target
+){
+    if (SegmentIsCold(Old) != (Kind == DEFRAG_MOVE_RECALL)) {
+        return false;
+    }
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (Kind == DEFRAG_MOVE_DEMOTE) {
+        return TierClaimFreeSegment(Sto, FileId, Target);
+    }
+    if (Kind == DEFRAG_MOVE_RECALL) {
+        SegmentIdT prev = Slot > 0 && !SegmentIsHole(File, Slot - 1) ?
+            GetSegment(File, Slot - 1) : DDS_BACKEND_SEGMENT_INVALID;
+        SegmentIdT hint = prev != DDS_BACKEND_SEGMENT_INVALID && !SegmentIsCold(prev) ? prev + 1 : DDS_BACKEND_SEGMENT_INVALID;
+        return ClaimNewSegment(Sto, FileId, hint, Target) == DDS_ERROR_CODE_SUCCESS;
+    }
+#endif
+
+    return ClaimSegmentAt(Sto, FileId, *Target);
+}
+
+//
+// Start moving the segment at Slot of a file, to Target if it is placed after the segment before it:
+// claim where it goes, then make the writes of the file go by the move, and give way if one is in flight already;
+// called with the mutex held
+//
+//
+static bool
+StartMove(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    FileIdT FileId,
+    SegmentIdT Slot,
+    DefragMoveKindT Kind,
+    SegmentIdT Target
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    DefragMoveT* move = &defrag->Move;
+
+    LockFile(File);
+    SegmentIdT old = SegmentIsHole(File, Slot) ? DDS_BACKEND_SEGMENT_INVALID : GetSegment(File, Slot);
+    if (old == DDS_BACKEND_SEGMENT_INVALID || File->Copies || File->Move ||
+        Sto->AllSegments[old].FileId != FileId || atomic_load(&Sto->AllSegments[old].Sharers) ||
+        !ClaimMoveTarget(Sto, File, FileId, Slot, old, Kind, &Target)) {
+        UnlockFile(File);
+        return false;
+    }
+
+    //
+    // Only the part of the segment the file covers has data worth copying
+    //
+    //
+    FileSizeT slotStart = (FileSizeT)Slot << DDS_BACKEND_SEGMENT_SHIFT;
+    FileSizeT size = GetSize(File);
+    memset(move, 0, sizeof(DefragMoveT));
+    move->Kind = Kind;
+    move->FileId = FileId;
+    move->Slot = Slot;
+    move->Old = old;
+    move->New = Target;
+    move->Bytes = size > slotStart ? (SegmentSizeT)min(DDS_BACKEND_SEGMENT_SIZE,
+        (size - slotStart + DDS_BACKEND_SECTOR_SIZE - 1) & ~((FileSizeT)DDS_BACKEND_SECTOR_SIZE - 1)) : 0;
+    File->Move = move;
+    atomic_fetch_add(&File->CopiesInFlight, 1);
+    UnlockFile(File);
+
+    //
+    // The writes counted from here on find the move and cancel it; one counted before may be writing the segment
+    //
+    //
+    if (atomic_load(&File->WritesInFlight)) {
+        LockFile(File);
+        move->Cancelled = true;
+        UnlockFile(File);
+    }
+
+    defrag->Active = true;
+    return true;
+}
+
+//
+// Look for a segment to move, a bounded number of slots per run: with tiering, one to move to or from
+// the capacity bdev first, then one that doesn't follow the segment before it in a cold file
+// that isn't checksummed nor a snapshot, while the place after that one is free; called with the mutex held
+//
+//
+static bool
+FindMove(
+    struct DPUStorage* Sto
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    uint64_t now = spdk_get_ticks();
+    uint64_t coldTicks = spdk_get_ticks_hz() / 1000 * DDS_BACKEND_DEFRAG_COLD_MS;
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    struct DPUFile* tierFile;
+    FileIdT tierFileId;
+    SegmentIdT tierSlot;
+    bool recall;
+    if (Sto->Tier && TierFindMove(Sto, &tierFile, &tierFileId, &tierSlot, &recall) &&
+        StartMove(Sto, tierFile, tierFileId, tierSlot, recall ? DEFRAG_MOVE_RECALL : DEFRAG_MOVE_DEMOTE,
+        DDS_BACKEND_SEGMENT_INVALID)) {
+        return true;
+    }
+#endif
+
+    for (int step = 0; step != DDS_BACKEND_DEFRAG_STEPS_PER_POLL; step++) {
+        if (defrag->NextFile >= DDS_MAX_FILES) {
+            defrag->NextFile = 0;
+        }
+
+        FileIdT fileId = defrag->NextFile;
+        struct DPUFile* file = GetFile(Sto, fileId);
+        if (!file || defrag->NextSlot >= GetNumSegments(file) || FileIsSnapshot(file) || FileIsChecksummed(file) ||
+            now - atomic_load_explicit(&file->LastWriteTicks, memory_order_relaxed) < coldTicks) {
+            defrag->NextFile++;
+            defrag->NextSlot = 1;
+            continue;
+        }
+
+        SegmentIdT slot = defrag->NextSlot++;
+        SegmentIdT prev = GetSegment(file, slot - 1);
+        SegmentIdT segment = GetSegment(file, slot);
+        if (prev == DDS_BACKEND_SEGMENT_INVALID || segment == DDS_BACKEND_SEGMENT_INVALID || segment == prev + 1 ||
+            SegmentIsCold(segment) || !SegmentIsFree(Sto, prev + 1)) {
+            continue;
+        }
+
+        if (StartMove(Sto, file, fileId, slot, DEFRAG_MOVE_PLACE, prev + 1)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// Take the next step of the move, one chunk per period of the poller, or look for the next move
+//
+//
+static int
+DefragPoller(
+    void *Ctx
+){
+    struct DPUStorage* sto = Ctx;
+    struct DPUDefrag* defrag = sto->Defrag;
+    DefragMoveT* move = &defrag->Move;
+
+    if (!G_INITIALIZATION_DONE || defrag->InFlight) {
+        return SPDK_POLLER_IDLE;
+    }
+
+    pthread_mutex_lock(&defrag->Mutex);
+    if (!defrag->Active) {
+        bool found = FindMove(sto);
+        pthread_mutex_unlock(&defrag->Mutex);
+        return found ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+    }
+
+    bool goesOn = MoveGoesOn(sto, move);
+    pthread_mutex_unlock(&defrag->Mutex);
+
+    if (!goesOn) {
+        EndMove(sto, !move->Failed);
+    }
+    else if (move->NextOffset != move->Bytes) {
+        CopyNextChunk(sto);
+    }
+#ifdef OPT_FILE_SERVICE_TIERING
+    else if (move->Kind == DEFRAG_MOVE_DEMOTE && !move->Flushed) {
+        FlushDemotedSegment(sto);
+    }
+#endif
+    else {
+        RemapMovedSegment(sto);
+    }
+
+    return SPDK_POLLER_BUSY;
+}
+
+//
+// Start moving segments on the current thread, at DDS_BACKEND_DEFRAG_BYTES_PER_SECOND at most
+//
+//
+void DefragStart(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    struct DPUDefrag* defrag = Sto->Defrag;
+    if (!defrag) {
+        return;
+    }
+
+    defrag->SPDKContext = SPDKContext;
+    defrag->Poller = spdk_poller_register(DefragPoller, Sto, DDS_BACKEND_DEFRAG_PERIOD_US);
+    if (defrag->Poller == NULL) {
+        SPDK_ERRLOG("Could not register the defragmentation\n");
+    }
+}
+
+//
+// Stop moving segments, on the thread that started it
+//
+//
+void DefragStop(
+    struct DPUStorage* Sto
+){
+    if (Sto && Sto->Defrag && Sto->Defrag->Poller) {
+        spdk_poller_unregister(&Sto->Defrag->Poller);
+    }
+}
+#endif
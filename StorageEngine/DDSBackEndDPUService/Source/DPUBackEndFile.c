@@ -11,15 +11,46 @@
 struct DPUFile* BackEndFileX(){
     struct DPUFile *tmp;
     tmp = malloc(sizeof(struct DPUFile));
+    if (!tmp) {
+        return NULL;
+    }
     tmp->Properties.Id = DDS_FILE_INVALID;
     tmp->Properties.FProperties.FileAttributes = 0;
     tmp->Properties.FProperties.FileSize = 0;
+    tmp->Properties.NumExtents = 0;
 
-    for (size_t s = 0; s != DDS_BACKEND_MAX_SEGMENTS_PER_FILE; s++) {
-        tmp->Properties.Segments[s] = DDS_BACKEND_SEGMENT_INVALID;
-    }
-
+    memset(tmp->SegmentChunks, 0, sizeof(tmp->SegmentChunks));
     tmp->NumSegments = 0;
+    tmp->NumExtents = 0;
+    pthread_mutex_init(&tmp->ModificationMutex, NULL);
+    tmp->RMWTail = NULL;
+    tmp->AtomicOpTail = NULL;
+    pthread_mutex_init(&tmp->AppendMutex, NULL);
+#ifdef OPT_FILE_SERVICE_ZONED
+    tmp->AppendTail = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    tmp->Copies = NULL;
+    atomic_init(&tmp->CopiesInFlight, 0);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    atomic_init(&tmp->WritesInFlight, 0);
+    atomic_init(&tmp->LastWriteTicks, 0);
+    tmp->Move = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    atomic_init(&tmp->LastReadTicks, spdk_get_ticks());
+    atomic_init(&tmp->RecallWanted, false);
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    atomic_init(&tmp->AccessHint, ACCESS_HINT_NORMAL);
+    atomic_init(&tmp->ReadAheadEnd, 0);
+#endif
+    tmp->QoSBytesPerSecond = 0;
+    tmp->QoSBurstBytes = 0;
+    tmp->QoSWeight = DDS_BACKEND_QOS_DEFAULT_WEIGHT;
+    atomic_init(&tmp->QoSTokens, 0);
+    atomic_init(&tmp->QoSRefillTicks, 0);
     tmp->AddressOnSegment = 0;
     return tmp;
 }
@@ -31,20 +62,60 @@ struct DPUFile* BackEndFileI(
 ){
     struct DPUFile *tmp;
     tmp = malloc(sizeof(struct DPUFile));
+    if (!tmp) {
+        return NULL;
+    }
     tmp->Properties.Id = FileId;
     strcpy(tmp->Properties.FProperties.FileName, FileName);
     tmp->Properties.FProperties.FileAttributes = FileAttributes;
     tmp->Properties.FProperties.FileSize = 0;
+    tmp->Properties.NumExtents = 0;
 
-    for (size_t s = 0; s != DDS_BACKEND_MAX_SEGMENTS_PER_FILE; s++) {
-        tmp->Properties.Segments[s] = DDS_BACKEND_SEGMENT_INVALID;
-    }
-
+    memset(tmp->SegmentChunks, 0, sizeof(tmp->SegmentChunks));
     tmp->NumSegments = 0;
-    tmp->AddressOnSegment = DDS_BACKEND_SEGMENT_SIZE - FileId * sizeof(DPUFilePropertiesT);
+    tmp->NumExtents = 0;
+    pthread_mutex_init(&tmp->ModificationMutex, NULL);
+    tmp->RMWTail = NULL;
+    tmp->AtomicOpTail = NULL;
+    pthread_mutex_init(&tmp->AppendMutex, NULL);
+#ifdef OPT_FILE_SERVICE_ZONED
+    tmp->AppendTail = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    tmp->Copies = NULL;
+    atomic_init(&tmp->CopiesInFlight, 0);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    atomic_init(&tmp->WritesInFlight, 0);
+    atomic_init(&tmp->LastWriteTicks, 0);
+    tmp->Move = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    atomic_init(&tmp->LastReadTicks, spdk_get_ticks());
+    atomic_init(&tmp->RecallWanted, false);
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    atomic_init(&tmp->AccessHint, ACCESS_HINT_NORMAL);
+    atomic_init(&tmp->ReadAheadEnd, 0);
+#endif
+    tmp->QoSBytesPerSecond = 0;
+    tmp->QoSBurstBytes = 0;
+    tmp->QoSWeight = DDS_BACKEND_QOS_DEFAULT_WEIGHT;
+    atomic_init(&tmp->QoSTokens, 0);
+    atomic_init(&tmp->QoSRefillTicks, 0);
+    tmp->AddressOnSegment = DDS_BACKEND_METADATA_BYTES - (FileId + 1) * sizeof(DPUFilePropertiesT);
     return tmp;
 }
 
+void DeBackEndFile(
+    struct DPUFile* File
+){
+    for (size_t c = 0; c != DDS_BACKEND_SEGMENT_CHUNKS_PER_FILE; c++) {
+        free(File->SegmentChunks[c]);
+    }
+    free(File);
+}
+
 const char* GetName(
     struct DPUFile* File
 ){
@@ -95,29 +166,221 @@ void SetSize(
     File->Properties.FProperties.FileSize = FileSize;
 }
 
-void SetNumAllocatedSegments(
+//
+// Whether a slot holding Next continues the extent of the slot before it, which holds Prev
+//
+//
+static inline bool
+ExtentContinues(
+    SegmentIdT Prev,
+    SegmentIdT Next
+){
+    return Prev == DDS_BACKEND_SEGMENT_INVALID ? Next == DDS_BACKEND_SEGMENT_INVALID : Next == Prev + 1;
+}
+
+bool SetNumAllocatedSegments(
     struct DPUFile* File
 ){
+    DPUFilePropertiesT* properties = &File->Properties;
+    SegmentIdT slot = 0;
+
     File->NumSegments = 0;
-    for (size_t s = 0; s != DDS_BACKEND_MAX_SEGMENTS_PER_FILE; s++) {
-        if (File->Properties.Segments[s] == DDS_BACKEND_SEGMENT_INVALID) {
-            break;
+    File->NumExtents = 0;
+    if (properties->NumExtents < 0 || properties->NumExtents > DDS_BACKEND_MAX_EXTENTS_PER_FILE) {
+        return false;
+    }
+
+    for (SegmentIdT e = 0; e != properties->NumExtents; e++) {
+        DPUFileExtentT* extent = &properties->Extents[e];
+        if (extent->Count <= 0 || extent->Count > DDS_BACKEND_MAX_SEGMENTS_PER_FILE - slot) {
+            return false;
+        }
+        for (SegmentIdT s = 0; s != extent->Count; s++, slot++) {
+            if (extent->First != DDS_BACKEND_SEGMENT_INVALID && !MapSegment(slot, extent->First + s, File)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void EncodeFileExtents(
+    struct DPUFile* File
+){
+    DPUFilePropertiesT* properties = &File->Properties;
+    DPUFileExtentT* extent = NULL;
+
+    properties->NumExtents = 0;
+    for (SegmentIdT slot = 0; slot != File->NumSegments; slot++) {
+        SegmentIdT segment = GetSegment(File, slot);
+        if (extent && ExtentContinues(extent->First == DDS_BACKEND_SEGMENT_INVALID ?
+            DDS_BACKEND_SEGMENT_INVALID : extent->First + extent->Count - 1, segment)) {
+            extent->Count++;
+            continue;
         }
-        File->NumSegments++;
+        extent = &properties->Extents[properties->NumExtents++];
+        extent->First = segment;
+        extent->Count = 1;
     }
 }
 
-void AllocateSegment(
+bool AllocateSegment(
+    SegmentIdT NewSegment,
+    struct DPUFile* File
+){
+    return MapSegment(File->NumSegments, NewSegment, File);
+}
+
+bool MapSegment(
+    SegmentIdT Slot,
     SegmentIdT NewSegment,
     struct DPUFile* File
 ){
-    File->Properties.Segments[File->NumSegments] = NewSegment;
-    File->NumSegments++;
+    SegmentIdT numExtents = File->NumExtents;
+
+    //
+    // Only the extents around the slot change: the slot may join or split those of its neighbours,
+    // and mapping past the end adds a run of holes before it
+    //
+    //
+    if (Slot < File->NumSegments) {
+        SegmentIdT old = GetSegment(File, Slot);
+        if (Slot > 0) {
+            SegmentIdT prev = GetSegment(File, Slot - 1);
+            numExtents += (int)ExtentContinues(prev, old) - (int)ExtentContinues(prev, NewSegment);
+        }
+        if (Slot + 1 < File->NumSegments) {
+            SegmentIdT next = GetSegment(File, Slot + 1);
+            numExtents += (int)ExtentContinues(old, next) - (int)ExtentContinues(NewSegment, next);
+        }
+    }
+    else {
+        SegmentIdT prev = File->NumSegments > 0 ? GetSegment(File, File->NumSegments - 1) : DDS_BACKEND_SEGMENT_INVALID;
+        bool started = File->NumSegments > 0;
+        if (Slot > File->NumSegments) {
+            if (!started || !ExtentContinues(prev, DDS_BACKEND_SEGMENT_INVALID)) {
+                numExtents++;
+            }
+            prev = DDS_BACKEND_SEGMENT_INVALID;
+            started = true;
+        }
+        if (!started || !ExtentContinues(prev, NewSegment)) {
+            numExtents++;
+        }
+    }
+    if (numExtents > DDS_BACKEND_MAX_EXTENTS_PER_FILE) {
+        return false;
+    }
+
+    DPUSegmentChunkT** chunk = &File->SegmentChunks[Slot / DDS_BACKEND_SEGMENT_CHUNK_SLOTS];
+    if (!*chunk) {
+        DPUSegmentChunkT* newChunk = malloc(sizeof(DPUSegmentChunkT));
+        if (!newChunk) {
+            return false;
+        }
+        for (size_t s = 0; s != DDS_BACKEND_SEGMENT_CHUNK_SLOTS; s++) {
+            newChunk->Segments[s] = DDS_BACKEND_SEGMENT_INVALID;
+        }
+        *chunk = newChunk;
+    }
+
+    (*chunk)->Segments[Slot % DDS_BACKEND_SEGMENT_CHUNK_SLOTS] = NewSegment;
+    if (NewSegment != DDS_BACKEND_SEGMENT_INVALID) {
+        (*chunk)->Addresses[Slot % DDS_BACKEND_SEGMENT_CHUNK_SLOTS] = SegmentDiskAddress(NewSegment);
+    }
+    if (Slot >= File->NumSegments) {
+        File->NumSegments = Slot + 1;
+    }
+    File->NumExtents = numExtents;
+
+    return true;
 }
 
 void DeallocateSegment(
     struct DPUFile* File
 ){
-    File->NumSegments--;
-    File->Properties.Segments[File->NumSegments] = DDS_BACKEND_SEGMENT_INVALID;
-}
\ No newline at end of file
+    SegmentIdT last = File->NumSegments - 1;
+    SegmentIdT segment = GetSegment(File, last);
+
+    if (last == 0 || !ExtentContinues(GetSegment(File, last - 1), segment)) {
+        File->NumExtents--;
+    }
+    if (segment != DDS_BACKEND_SEGMENT_INVALID) {
+        File->SegmentChunks[last / DDS_BACKEND_SEGMENT_CHUNK_SLOTS]->Segments[last % DDS_BACKEND_SEGMENT_CHUNK_SLOTS] =
+            DDS_BACKEND_SEGMENT_INVALID;
+    }
+    File->NumSegments = last;
+}
+
+void SetFileQoSLimit(
+    struct DPUFile* File,
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight
+){
+    if (BytesPerSecond && !BurstBytes) {
+        BurstBytes = BytesPerSecond * DDS_BACKEND_QOS_DEFAULT_BURST_MS / 1000;
+    }
+    if (BurstBytes < DDS_BACKEND_QOS_MIN_REQUEST_BYTES) {
+        BurstBytes = DDS_BACKEND_QOS_MIN_REQUEST_BYTES;
+    }
+
+    File->QoSBurstBytes = BurstBytes;
+    File->QoSWeight = Weight ? Weight : DDS_BACKEND_QOS_DEFAULT_WEIGHT;
+    atomic_store(&File->QoSTokens, (int64_t)BurstBytes);
+    atomic_store(&File->QoSRefillTicks, spdk_get_ticks());
+    File->QoSBytesPerSecond = BytesPerSecond;
+}
+
+bool FileHasQoSTokens(
+    struct DPUFile* File
+){
+    uint64_t rate = File->QoSBytesPerSecond;
+    if (!rate) {
+        return true;
+    }
+
+    //
+    // One worker adds the tokens of the ticks since the last refill, the others see them
+    //
+    //
+    uint64_t now = spdk_get_ticks();
+    uint64_t last = atomic_load(&File->QoSRefillTicks);
+    if (now > last && atomic_compare_exchange_strong(&File->QoSRefillTicks, &last, now)) {
+        int64_t burst = (int64_t)File->QoSBurstBytes;
+        int64_t added = (int64_t)((double)(now - last) / spdk_get_ticks_hz() * rate);
+        if (added > burst) {
+            added = burst;
+        }
+        int64_t tokens = atomic_fetch_add(&File->QoSTokens, added) + added;
+        if (tokens > burst) {
+            atomic_fetch_sub(&File->QoSTokens, tokens - burst);
+        }
+    }
+
+    return atomic_load(&File->QoSTokens) > 0;
+}
+
+void TakeFileQoSTokens(
+    struct DPUFile* File,
+    FileIOSizeT Bytes
+){
+    if (!File->QoSBytesPerSecond) {
+        return;
+    }
+
+    atomic_fetch_sub(&File->QoSTokens, (int64_t)(Bytes > DDS_BACKEND_QOS_MIN_REQUEST_BYTES ? Bytes : DDS_BACKEND_QOS_MIN_REQUEST_BYTES));
+}
+
+void LockFile(
+    struct DPUFile* File
+){
+    pthread_mutex_lock(&File->ModificationMutex);
+}
+
+void UnlockFile(
+    struct DPUFile* File
+){
+    pthread_mutex_unlock(&File->ModificationMutex);
+}
@@ -0,0 +1,1053 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "DPUBackEndJournal.h"
+#include "DPUBackEndDefrag.h"
+#include "DPUBackEndWriteBuffer.h"
+
+#define DDS_BACKEND_JOURNAL_CHECKPOINT_ENTRIES (DDS_MAX_DIRS + DDS_MAX_FILES)
+#define DDS_BACKEND_JOURNAL_CHECKPOINT_BUFFER_SIZE \
+    (sizeof(DPUDirPropertiesT) > sizeof(DPUFilePropertiesT) ? sizeof(DPUDirPropertiesT) : sizeof(DPUFilePropertiesT))
+
+struct JournalReplayCtx {
+    JournalCallback Callback;
+    ContextT Context;
+};
+
+//
+// FNV-1a over a record, skipping its checksum
+//
+//
+static uint32_t
+RecordChecksum(
+    const DPUJournalRecordT* Record
+){
+    const unsigned char* bytes = (const unsigned char*)Record;
+    const size_t checksumBegin = offsetof(DPUJournalRecordT, Checksum);
+    const size_t checksumEnd = checksumBegin + sizeof(Record->Checksum);
+    uint32_t hash = 2166136261u;
+
+    for (size_t b = 0; b != sizeof(DPUJournalRecordT); b++) {
+        if (b >= checksumBegin && b < checksumEnd) {
+            continue;
+        }
+        hash = (hash ^ bytes[b]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static inline DPUJournalRecordT*
+RecordOfSequence(
+    struct DPUJournal* Journal,
+    uint64_t Sequence
+){
+    return &Journal->Records[(Sequence - 1) % DDS_BACKEND_JOURNAL_RECORDS];
+}
+
+//
+// Note the table entries a record changes, for the next checkpoint
+//
+//
+static void
+MarkDirty(
+    struct DPUJournal* Journal,
+    DPUJournalRecordT* Record
+){
+    switch (Record->Type) {
+        case DDS_JOURNAL_RECORD_CREATE_DIR:
+        case DDS_JOURNAL_RECORD_REMOVE_DIR: {
+            if (Record->Dir.Id < DDS_MAX_DIRS) {
+                Journal->DirtyDirs[Record->Dir.Id] = true;
+            }
+        }
+            break;
+        case DDS_JOURNAL_RECORD_MOVE_FILE: {
+            if (Record->File.NewDirId < DDS_MAX_DIRS) {
+                Journal->DirtyDirs[Record->File.NewDirId] = true;
+            }
+        }
+        // fall through
+        case DDS_JOURNAL_RECORD_CREATE_FILE:
+        case DDS_JOURNAL_RECORD_DELETE_FILE: {
+            if (Record->File.DirId < DDS_MAX_DIRS) {
+                Journal->DirtyDirs[Record->File.DirId] = true;
+            }
+            if (Record->File.Id < DDS_MAX_FILES) {
+                Journal->DirtyFiles[Record->File.Id] = true;
+            }
+        }
+            break;
+        case DDS_JOURNAL_RECORD_FILE_SEGMENTS: {
+            if (Record->Segments.Id < DDS_MAX_FILES) {
+                Journal->DirtyFiles[Record->Segments.Id] = true;
+            }
+        }
+            break;
+        case DDS_JOURNAL_RECORD_REMAP_SEGMENT: {
+            if (Record->Remap.Id < DDS_MAX_FILES) {
+                Journal->DirtyFiles[Record->Remap.Id] = true;
+            }
+        }
+            break;
+        default:
+            break;
+    }
+}
+
+//
+// Set up an empty journal
+//
+//
+ErrorCodeT JournalInit(
+    struct DPUStorage* Sto
+){
+    struct DPUJournal* journal = calloc(1, sizeof(struct DPUJournal));
+    if (!journal) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    journal->Records = spdk_dma_zmalloc(DDS_BACKEND_JOURNAL_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+    journal->CheckpointBuffer = spdk_dma_zmalloc(DDS_BACKEND_JOURNAL_CHECKPOINT_BUFFER_SIZE, DDS_BACKEND_PAGE_SIZE, NULL);
+    journal->Sector = spdk_dma_zmalloc(DDS_BACKEND_SECTOR_SIZE, DDS_BACKEND_SECTOR_SIZE, NULL);
+    if (!journal->Records || !journal->CheckpointBuffer || !journal->Sector) {
+        spdk_dma_free(journal->Records);
+        spdk_dma_free(journal->CheckpointBuffer);
+        spdk_dma_free(journal->Sector);
+        free(journal);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    journal->NextSequence = 1;
+    pthread_mutex_init(&journal->Mutex, NULL);
+    Sto->Journal = journal;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the journal
+//
+//
+void JournalDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUJournal* journal = Sto->Journal;
+    if (!journal) {
+        return;
+    }
+
+    while (journal->WaitersHead) {
+        JournalWaiterT* waiter = journal->WaitersHead;
+        journal->WaitersHead = waiter->Next;
+        free(waiter);
+    }
+
+    spdk_dma_free(journal->Records);
+    spdk_dma_free(journal->CheckpointBuffer);
+    spdk_dma_free(journal->Sector);
+    pthread_mutex_destroy(&journal->Mutex);
+    free(journal);
+    Sto->Journal = NULL;
+}
+
+//
+// Apply the records
+//
+//
+static bool
+DirHasFile(
+    struct DPUDir* Dir,
+    FileIdT FileId
+){
+    for (size_t f = 0; f != DDS_MAX_FILES_PER_DIR; f++) {
+        if (GetDirProperties(Dir)->Files[f] == FileId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static ErrorCodeT
+ApplyCreateDir(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    if (Record->Dir.Id >= DDS_MAX_DIRS) {
+        return DDS_ERROR_CODE_TOO_MANY_DIRS;
+    }
+    if (GetDir(Sto, Record->Dir.Id)) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    ErrorCodeT result = ReserveDir(Sto, Record->Dir.Id);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    struct DPUDir* dir = BackEndDirI(Record->Dir.Id, Record->Dir.Parent, Record->Dir.Name);
+    if (!dir) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    SetDir(Sto, Record->Dir.Id, dir);
+    Sto->TotalDirs++;
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static ErrorCodeT
+ApplyRemoveDir(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    struct DPUDir* dir = GetDir(Sto, Record->Dir.Id);
+    if (dir) {
+        pthread_mutex_lock(&Sto->Journal->Mutex);
+        SetDir(Sto, Record->Dir.Id, NULL);
+        Sto->TotalDirs--;
+        pthread_mutex_unlock(&Sto->Journal->Mutex);
+        free(dir);
+    }
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static ErrorCodeT
+ApplyCreateFile(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    if (Record->File.Id >= DDS_MAX_FILES) {
+        return DDS_ERROR_CODE_TOO_MANY_FILES;
+    }
+    if (GetFile(Sto, Record->File.Id)) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    struct DPUDir* dir = GetDir(Sto, Record->File.DirId);
+    if (!dir) {
+        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+
+    ErrorCodeT result = ReserveFile(Sto, Record->File.Id);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    struct DPUFile* file = BackEndFileI(Record->File.Id, Record->File.Name, Record->File.Attributes);
+    if (!file) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    Lock(dir);
+    if (!DirHasFile(dir, Record->File.Id)) {
+        result = AddFile(Record->File.Id, dir);
+    }
+    Unlock(dir);
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        DeBackEndFile(file);
+        return result;
+    }
+
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    SetFile(Sto, Record->File.Id, file);
+    IndexFileName(Sto, GetName(file), Record->File.Id);
+    Sto->TotalFiles++;
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static ErrorCodeT
+ApplyDeleteFile(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    struct DPUFile* file = GetFile(Sto, Record->File.Id);
+    struct DPUDir* dir = GetDir(Sto, Record->File.DirId);
+
+    if (dir) {
+        Lock(dir);
+        DeleteFile(Record->File.Id, dir);
+        Unlock(dir);
+    }
+
+    if (file) {
+#ifdef OPT_FILE_SERVICE_DEFRAG
+        DefragForgetFile(Sto, Record->File.Id);
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+        WriteBufferForgetFile(Sto->WriteBuffer, Record->File.Id, 0);
+#endif
+        pthread_mutex_lock(&Sto->Journal->Mutex);
+        UnindexFileName(Sto, GetName(file), Record->File.Id);
+        SetFile(Sto, Record->File.Id, NULL);
+        Sto->TotalFiles--;
+        pthread_mutex_unlock(&Sto->Journal->Mutex);
+
+        DeallocateSegmentsOfFile(file, GetNumSegments(file), Sto);
+        DeBackEndFile(file);
+    }
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static ErrorCodeT
+ApplyMoveFile(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    struct DPUFile* file = GetFile(Sto, Record->File.Id);
+    struct DPUDir* oldDir = GetDir(Sto, Record->File.DirId);
+    struct DPUDir* newDir = GetDir(Sto, Record->File.NewDirId);
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if (!oldDir || !newDir) {
+        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+
+    bool inOldDir = DirHasFile(oldDir, Record->File.Id);
+    bool inNewDir = DirHasFile(newDir, Record->File.Id);
+    if (!inOldDir && !inNewDir) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    if (!inNewDir) {
+        Lock(newDir);
+        ErrorCodeT result = AddFile(Record->File.Id, newDir);
+        Unlock(newDir);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (inOldDir && oldDir != newDir) {
+        Lock(oldDir);
+        DeleteFile(Record->File.Id, oldDir);
+        Unlock(oldDir);
+    }
+
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    UnindexFileName(Sto, GetName(file), Record->File.Id);
+    LockFile(file);
+    SetName(Record->File.Name, file);
+    UnlockFile(file);
+    IndexFileName(Sto, GetName(file), Record->File.Id);
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static ErrorCodeT
+ApplyFileSegments(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    struct DPUFile* file = GetFile(Sto, Record->Segments.Id);
+    SegmentIdT numSegments = Record->Segments.NumSegments;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if (numSegments < Record->NumIds || numSegments > DDS_BACKEND_MAX_SEGMENTS_PER_FILE ||
+        Record->NumIds > DDS_BACKEND_JOURNAL_SEGMENTS_PER_RECORD) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    if (GetNumSegments(file) > numSegments) {
+        DeallocateSegmentsOfFile(file, GetNumSegments(file) - numSegments, Sto);
+    }
+
+    LockFile(file);
+
+    //
+    // Segments the file already has are left alone, and so are the holes of a sparse file;
+    // the rest are mapped at their slots
+    //
+    //
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    SegmentIdT firstSegment = numSegments - Record->NumIds;
+    for (SegmentIdT s = 0; s != Record->NumIds; s++) {
+        SegmentIdT segment = Record->Segments.Ids[s];
+        if (segment == DDS_BACKEND_SEGMENT_INVALID || !SegmentIsHole(file, firstSegment + s)) {
+            continue;
+        }
+        if (segment < 0 || segment >= Sto->TotalSegments) {
+            break;
+        }
+        if (!MapSegment(firstSegment + s, segment, file)) {
+            result = DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+            break;
+        }
+        ClaimSegment(Sto, segment, Record->Segments.Id);
+    }
+
+    SetSize(Record->Segments.Size, file);
+    UnlockFile(file);
+    return result;
+}
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+static ErrorCodeT
+ApplyRemapSegment(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    struct DPUFile* file = GetFile(Sto, Record->Remap.Id);
+    SegmentIdT slot = Record->Remap.Slot;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if (slot < 0 || slot >= DDS_BACKEND_MAX_SEGMENTS_PER_FILE ||
+        !SegmentIdIsValid(Sto, Record->Remap.New)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    //
+    // A slot already remapped is left alone, and so is one the file has dropped or refilled since
+    //
+    //
+    LockFile(file);
+    SegmentIdT current = SegmentIsHole(file, slot) ? DDS_BACKEND_SEGMENT_INVALID : GetSegment(file, slot);
+    if (current == Record->Remap.Old && current != DDS_BACKEND_SEGMENT_INVALID) {
+        //
+        // A remap that would split the extents of the file past DDS_BACKEND_MAX_EXTENTS_PER_FILE is refused
+        //
+        //
+        if (MapSegment(slot, Record->Remap.New, file)) {
+            ClaimSegment(Sto, Record->Remap.New, Record->Remap.Id);
+            ReleaseSegmentOfFile(Sto, Record->Remap.Id, Record->Remap.Old);
+        }
+        else {
+            result = DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+        }
+    }
+    else if (current != Record->Remap.New) {
+        result = DDS_ERROR_CODE_INVALID_PARAM;
+    }
+    UnlockFile(file);
+
+    return result;
+}
+#endif
+
+//
+// Apply a directory or file record to the tables in memory;
+// a directory or file is changed under its own lock, and the journal mutex is taken
+// only to add or remove one, so operations on different directories and files don't serialize
+//
+//
+ErrorCodeT JournalApply(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record
+){
+    ErrorCodeT result;
+
+    switch (Record->Type) {
+        case DDS_JOURNAL_RECORD_CREATE_DIR:
+            result = ApplyCreateDir(Sto, Record);
+            break;
+        case DDS_JOURNAL_RECORD_REMOVE_DIR:
+            result = ApplyRemoveDir(Sto, Record);
+            break;
+        case DDS_JOURNAL_RECORD_CREATE_FILE:
+            result = ApplyCreateFile(Sto, Record);
+            break;
+        case DDS_JOURNAL_RECORD_DELETE_FILE:
+            result = ApplyDeleteFile(Sto, Record);
+            break;
+        case DDS_JOURNAL_RECORD_MOVE_FILE:
+            result = ApplyMoveFile(Sto, Record);
+            break;
+        case DDS_JOURNAL_RECORD_FILE_SEGMENTS:
+            result = ApplyFileSegments(Sto, Record);
+            break;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+        case DDS_JOURNAL_RECORD_REMAP_SEGMENT:
+            result = ApplyRemapSegment(Sto, Record);
+            break;
+#endif
+        default:
+            result = DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    return result;
+}
+
+//
+// Group commit
+//
+//
+static void JournalFlushCallback(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context);
+static void CheckpointNextEntry(struct DPUStorage* Sto);
+
+//
+// Write out the records appended since the last journal write, up to the end of the journal if they wrap;
+// called with the mutex held and no journal write in flight
+//
+//
+static ErrorCodeT
+FlushJournal(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    struct DPUJournal* journal = Sto->Journal;
+    uint64_t first = journal->FlushedSequence + 1;
+    uint64_t last = journal->NextSequence - 1;
+    if (first > last) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    size_t firstSlot = (first - 1) % DDS_BACKEND_JOURNAL_RECORDS;
+    size_t lastSlot = (last - 1) % DDS_BACKEND_JOURNAL_RECORDS;
+    if (lastSlot < firstSlot) {
+        last = first + (DDS_BACKEND_JOURNAL_RECORDS - 1 - firstSlot);
+        lastSlot = DDS_BACKEND_JOURNAL_RECORDS - 1;
+    }
+
+    DiskSizeT firstByte = firstSlot * DDS_BACKEND_JOURNAL_RECORD_SIZE / DDS_BACKEND_PAGE_SIZE * DDS_BACKEND_PAGE_SIZE;
+    DiskSizeT endByte = (lastSlot * DDS_BACKEND_JOURNAL_RECORD_SIZE / DDS_BACKEND_PAGE_SIZE + 1) * DDS_BACKEND_PAGE_SIZE;
+
+    journal->FlushingSequence = last;
+    journal->FlushSPDKContext = SPDKContext;
+
+    ErrorCodeT result = WriteToDiskAsyncZC(
+        (BufferT)journal->Records + firstByte,
+        DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_JOURNAL_OFFSET + firstByte),
+        (FileIOSizeT)(endByte - firstByte),
+        JournalFlushCallback,
+        Sto,
+        Sto,
+        SPDKContext
+    );
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Journal write failed with %d\n", result);
+        journal->FlushingSequence = 0;
+    }
+    return result;
+}
+
+//
+// Take the waiters up to a sequence off the list, with the mutex held
+//
+//
+static JournalWaiterT*
+DetachWaiters(
+    struct DPUJournal* Journal,
+    uint64_t Sequence
+){
+    JournalWaiterT* head = Journal->WaitersHead;
+    JournalWaiterT* last = NULL;
+    JournalWaiterT* waiter = head;
+
+    while (waiter && waiter->Sequence <= Sequence) {
+        last = waiter;
+        waiter = waiter->Next;
+    }
+    if (!last) {
+        return NULL;
+    }
+
+    last->Next = NULL;
+    Journal->WaitersHead = waiter;
+    if (!waiter) {
+        Journal->WaitersTail = NULL;
+    }
+    return head;
+}
+
+static void
+RunWaiters(
+    JournalWaiterT* Waiters,
+    bool Success
+){
+    while (Waiters) {
+        JournalWaiterT* next = Waiters->Next;
+        Waiters->Callback(Success, Waiters->Context);
+        free(Waiters);
+        Waiters = next;
+    }
+}
+
+//
+// Start a checkpoint of the entries changed so far, with the mutex held
+//
+//
+static void
+StartCheckpoint(
+    struct DPUJournal* Journal,
+    void *SPDKContext
+){
+    Journal->CheckpointRunning = true;
+    Journal->CheckpointSequence = Journal->NextSequence - 1;
+    Journal->CheckpointNext = 0;
+    Journal->CheckpointSPDKContext = SPDKContext;
+    memcpy(Journal->CheckpointDirs, Journal->DirtyDirs, sizeof(Journal->DirtyDirs));
+    memcpy(Journal->CheckpointFiles, Journal->DirtyFiles, sizeof(Journal->DirtyFiles));
+    memset(Journal->DirtyDirs, 0, sizeof(Journal->DirtyDirs));
+    memset(Journal->DirtyFiles, 0, sizeof(Journal->DirtyFiles));
+}
+
+//
+// Give up a checkpoint, leaving its entries to the next one
+//
+//
+static void
+AbortCheckpoint(
+    struct DPUJournal* Journal
+){
+    pthread_mutex_lock(&Journal->Mutex);
+
+    for (size_t d = 0; d != DDS_MAX_DIRS; d++) {
+        Journal->DirtyDirs[d] |= Journal->CheckpointDirs[d];
+        Journal->CheckpointDirs[d] = false;
+    }
+    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
+        Journal->DirtyFiles[f] |= Journal->CheckpointFiles[f];
+        Journal->CheckpointFiles[f] = false;
+    }
+    Journal->CheckpointRunning = false;
+
+    pthread_mutex_unlock(&Journal->Mutex);
+}
+
+static void
+JournalFlushCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    struct DPUJournal* journal = sto->Journal;
+    spdk_bdev_free_io(bdev_io);
+
+    pthread_mutex_lock(&journal->Mutex);
+
+    uint64_t flushed = journal->FlushingSequence;
+    void *spdkContext = journal->FlushSPDKContext;
+    journal->FlushingSequence = 0;
+
+    if (Success) {
+        journal->FlushedSequence = flushed;
+    }
+    else {
+        SPDK_ERRLOG("Journal write up to %lu failed\n", flushed);
+    }
+
+    JournalWaiterT* done = DetachWaiters(journal, flushed);
+
+    //
+    // Records appended meanwhile go out together now
+    //
+    //
+    JournalWaiterT* failed = NULL;
+    if (Success && FlushJournal(sto, spdkContext) != DDS_ERROR_CODE_SUCCESS) {
+        failed = DetachWaiters(journal, journal->NextSequence);
+    }
+
+    bool checkpoint = !journal->CheckpointRunning &&
+        journal->FlushedSequence - journal->CheckpointedSequence >= DDS_BACKEND_JOURNAL_CHECKPOINT_RECORDS;
+    if (checkpoint) {
+        StartCheckpoint(journal, spdkContext);
+    }
+
+    pthread_mutex_unlock(&journal->Mutex);
+
+    RunWaiters(done, Success);
+    RunWaiters(failed, false);
+
+#ifdef OPT_FILE_SERVICE_TRIM
+    if (Success) {
+        TrimFreedSegments(sto, spdkContext);
+    }
+#endif
+
+    if (checkpoint) {
+        CheckpointNextEntry(sto);
+    }
+}
+
+//
+// Append a record and write it out with the next group
+//
+//
+ErrorCodeT JournalCommit(
+    struct DPUStorage* Sto,
+    DPUJournalRecordT* Record,
+    JournalCallback Callback,
+    ContextT Context,
+    void *SPDKContext
+){
+    struct DPUJournal* journal = Sto->Journal;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    JournalWaiterT* waiter = NULL;
+
+    if (Callback) {
+        waiter = malloc(sizeof(JournalWaiterT));
+        if (!waiter) {
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+        waiter->Callback = Callback;
+        waiter->Context = Context;
+        waiter->Next = NULL;
+    }
+
+    pthread_mutex_lock(&journal->Mutex);
+
+    //
+    // The slot of a record that no checkpoint covers yet must not be reused
+    //
+    //
+    if (journal->NextSequence - journal->CheckpointedSequence > DDS_BACKEND_JOURNAL_RECORDS) {
+        pthread_mutex_unlock(&journal->Mutex);
+        SPDK_ERRLOG("The metadata journal is full\n");
+        free(waiter);
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+    Record->Sequence = journal->NextSequence++;
+    Record->Checksum = RecordChecksum(Record);
+    *RecordOfSequence(journal, Record->Sequence) = *Record;
+    MarkDirty(journal, Record);
+
+    if (waiter) {
+        waiter->Sequence = Record->Sequence;
+        if (journal->WaitersTail) {
+            journal->WaitersTail->Next = waiter;
+        }
+        else {
+            journal->WaitersHead = waiter;
+        }
+        journal->WaitersTail = waiter;
+    }
+
+    if (!journal->FlushingSequence) {
+        result = FlushJournal(Sto, SPDKContext);
+        if (result != DDS_ERROR_CODE_SUCCESS && waiter) {
+            //
+            // No journal write is in flight, so this is the only waiter; its callback won't run
+            //
+            //
+            journal->WaitersHead = NULL;
+            journal->WaitersTail = NULL;
+            free(waiter);
+        }
+    }
+
+    pthread_mutex_unlock(&journal->Mutex);
+
+    return result;
+}
+
+//
+// Journal the segments and size of a file, the segments from FirstSegment on being new
+//
+//
+ErrorCodeT JournalFileSegments(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    struct DPUFile* File,
+    SegmentIdT FirstSegment,
+    JournalCallback Callback,
+    ContextT Context,
+    void *SPDKContext
+){
+    SegmentIdT numSegments;
+    SegmentIdT nextSegment = FirstSegment;
+    ErrorCodeT result;
+    bool last;
+
+    //
+    // Each record is filled under the lock of the file, and committed after releasing it
+    //
+    //
+    do {
+        DPUJournalRecordT record;
+        memset(&record, 0, sizeof(record));
+        record.Type = DDS_JOURNAL_RECORD_FILE_SEGMENTS;
+        record.Segments.Id = FileId;
+
+        LockFile(File);
+        numSegments = GetNumSegments(File);
+        if (nextSegment > numSegments) {
+            nextSegment = numSegments;
+        }
+        record.Segments.Size = GetSize(File);
+        while (nextSegment != numSegments && record.NumIds != DDS_BACKEND_JOURNAL_SEGMENTS_PER_RECORD) {
+            record.Segments.Ids[record.NumIds++] = GetSegment(File, nextSegment++);
+        }
+        record.Segments.NumSegments = nextSegment;
+        last = nextSegment == numSegments;
+        UnlockFile(File);
+
+        result = JournalCommit(Sto, &record, last ? Callback : NULL, Context, SPDKContext);
+    } while (result == DDS_ERROR_CODE_SUCCESS && !last);
+
+    return result;
+}
+
+//
+// Checkpoint
+//
+//
+static void
+CheckpointSectorCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    struct DPUJournal* journal = sto->Journal;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        SPDK_ERRLOG("Journal checkpoint failed to write the sector\n");
+        AbortCheckpoint(journal);
+        return;
+    }
+
+    pthread_mutex_lock(&journal->Mutex);
+    journal->CheckpointedSequence = journal->CheckpointSequence;
+    journal->CheckpointRunning = false;
+    pthread_mutex_unlock(&journal->Mutex);
+}
+
+static void
+CheckpointEntryCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct DPUStorage* sto = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        SPDK_ERRLOG("Journal checkpoint failed to write an entry\n");
+        AbortCheckpoint(sto->Journal);
+        return;
+    }
+
+    CheckpointNextEntry(sto);
+}
+
+//
+// Write the next changed entry of the checkpoint, or the sector once there is none left;
+// an entry is copied under the mutex and its own lock, and a removed one is written as an invalid record
+//
+//
+static void
+CheckpointNextEntry(
+    struct DPUStorage* Sto
+){
+    struct DPUJournal* journal = Sto->Journal;
+    ErrorCodeT result;
+
+    while (journal->CheckpointNext != DDS_BACKEND_JOURNAL_CHECKPOINT_ENTRIES) {
+        int entry = journal->CheckpointNext++;
+        SegmentSizeT address;
+        FileIOSizeT bytes;
+
+        pthread_mutex_lock(&journal->Mutex);
+
+        if (entry < DDS_MAX_DIRS) {
+            if (!journal->CheckpointDirs[entry]) {
+                pthread_mutex_unlock(&journal->Mutex);
+                continue;
+            }
+            journal->CheckpointDirs[entry] = false;
+
+            struct DPUDir* dir = GetDir(Sto, (DirIdT)entry);
+            bytes = sizeof(DPUDirPropertiesT);
+            address = DDS_BACKEND_SECTOR_SIZE + entry * sizeof(DPUDirPropertiesT);
+            if (dir) {
+                Lock(dir);
+                memcpy(journal->CheckpointBuffer, GetDirProperties(dir), bytes);
+                Unlock(dir);
+            }
+            else {
+                memset(journal->CheckpointBuffer, 0, bytes);
+                ((DPUDirPropertiesT*)journal->CheckpointBuffer)->Id = DDS_DIR_INVALID;
+            }
+        }
+        else {
+            int f = entry - DDS_MAX_DIRS;
+            if (!journal->CheckpointFiles[f]) {
+                pthread_mutex_unlock(&journal->Mutex);
+                continue;
+            }
+            journal->CheckpointFiles[f] = false;
+
+            struct DPUFile* file = GetFile(Sto, (FileIdT)f);
+            bytes = sizeof(DPUFilePropertiesT);
+            address = DDS_BACKEND_METADATA_BYTES - (f + 1) * sizeof(DPUFilePropertiesT);
+            if (file) {
+                LockFile(file);
+                EncodeFileExtents(file);
+                memcpy(journal->CheckpointBuffer, GetFileProperties(file), bytes);
+                UnlockFile(file);
+            }
+            else {
+                memset(journal->CheckpointBuffer, 0, bytes);
+                ((DPUFilePropertiesT*)journal->CheckpointBuffer)->Id = DDS_FILE_INVALID;
+            }
+        }
+
+        pthread_mutex_unlock(&journal->Mutex);
+
+        result = WriteToDiskAsyncZC(
+            journal->CheckpointBuffer,
+            DDS_BACKEND_METADATA_ADDRESS(address),
+            bytes,
+            CheckpointEntryCallback,
+            Sto,
+            Sto,
+            journal->CheckpointSPDKContext
+        );
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            SPDK_ERRLOG("Journal checkpoint failed with %d\n", result);
+            AbortCheckpoint(journal);
+        }
+
+        //
+        // The checkpoint goes on in the callback
+        //
+        //
+        return;
+    }
+
+    result = SyncReservedInformationToDisk(Sto, journal->CheckpointSPDKContext, CheckpointSectorCallback, Sto);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Journal checkpoint failed to write the sector with %d\n", result);
+        AbortCheckpoint(journal);
+    }
+}
+
+//
+// Replay
+//
+//
+static void
+JournalReplayedCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct JournalReplayCtx *ctx = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    ctx->Callback(Success, ctx->Context);
+    free(ctx);
+}
+
+static void
+JournalReplayCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    struct JournalReplayCtx *ctx = Context;
+    struct DPUJournal* journal = Sto->Journal;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        SPDK_ERRLOG("Failed to read the metadata journal\n");
+        ctx->Callback(false, ctx->Context);
+        free(ctx);
+        return;
+    }
+
+    //
+    // Apply the records after the checkpoint up to the first one that is missing or torn
+    //
+    //
+    uint64_t sequence = journal->CheckpointedSequence + 1;
+    while (sequence - journal->CheckpointedSequence <= DDS_BACKEND_JOURNAL_RECORDS) {
+        DPUJournalRecordT* record = RecordOfSequence(journal, sequence);
+        if (record->Sequence != sequence || record->Checksum != RecordChecksum(record)) {
+            break;
+        }
+
+        JournalApply(Sto, record);
+        MarkDirty(journal, record);
+        sequence++;
+    }
+
+    SPDK_NOTICELOG("Replayed %lu metadata journal records\n", sequence - journal->CheckpointedSequence - 1);
+
+    journal->NextSequence = sequence;
+    journal->FlushedSequence = sequence - 1;
+    journal->CheckpointSequence = journal->CheckpointedSequence;
+
+    //
+    // Records past the end were never completed; they are cleared on the disk,
+    // lest a later replay take one of them for the record of its sequence
+    //
+    //
+    bool stale = false;
+    for (size_t r = 0; r != DDS_BACKEND_JOURNAL_RECORDS; r++) {
+        if (journal->Records[r].Sequence >= sequence) {
+            memset(&journal->Records[r], 0, sizeof(DPUJournalRecordT));
+            stale = true;
+        }
+    }
+
+    if (stale) {
+        ErrorCodeT result = WriteToDiskAsyncZC(
+            (BufferT)journal->Records,
+            DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_JOURNAL_OFFSET),
+            DDS_BACKEND_JOURNAL_BYTES,
+            JournalReplayedCallback,
+            ctx,
+            Sto,
+            journal->FlushSPDKContext
+        );
+        if (result == DDS_ERROR_CODE_SUCCESS) {
+            return;
+        }
+        SPDK_ERRLOG("Failed to clear the metadata journal with %d\n", result);
+        Success = false;
+    }
+
+    ctx->Callback(Success, ctx->Context);
+    free(ctx);
+}
+
+//
+// Read the journal and apply the records after the checkpoint, then run Callback
+//
+//
+ErrorCodeT JournalReplay(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    JournalCallback Callback,
+    ContextT Context
+){
+    struct JournalReplayCtx *ctx = malloc(sizeof(*ctx));
+    if (!ctx) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    ctx->Callback = Callback;
+    ctx->Context = Context;
+    Sto->Journal->FlushSPDKContext = SPDKContext;
+
+    ErrorCodeT result = ReadFromDiskAsyncZC(
+        (BufferT)Sto->Journal->Records,
+        DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_JOURNAL_OFFSET),
+        DDS_BACKEND_JOURNAL_BYTES,
+        JournalReplayCallback,
+        ctx,
+        Sto,
+        SPDKContext
+    );
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        free(ctx);
+    }
+    return result;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DPUBackEndLease.h"
+
+//
+// The leases of each file, allocated once the file is first leased
+//
+//
+static FileLeaseT* Leases[DDS_MAX_FILES];
+
+static inline uint64_t
+LeaseTicks(
+    uint32_t Ms
+){
+    return spdk_get_ticks_hz() / 1000 * Ms;
+}
+
+//
+// End the leases of a file that were not renewed in time
+//
+//
+static void
+ExpireLeases(
+    FileLeaseT* Lease,
+    uint64_t Now
+){
+    for (int c = 0; c != DDS_BACKEND_MAX_CLIENTS; c++) {
+        if (Lease->Mode[c] && Lease->Expiry[c] <= Now) {
+            Lease->Mode[c] = LEASE_NONE;
+            Lease->Revoked[c] = false;
+        }
+    }
+    if (Lease->WriterWaiting >= 0 && Lease->WriterWaitEnd <= Now) {
+        Lease->WriterWaiting = -1;
+    }
+}
+
+//
+// Grant or renew a lease
+//
+//
+ErrorCodeT
+LeaseAcquire(
+    FileIdT FileId,
+    int ClientId,
+    int Mode,
+    uint32_t* TermMs
+){
+    if (FileId >= DDS_MAX_FILES) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if ((Mode != LEASE_READ && Mode != LEASE_WRITE) || ClientId < 0 || ClientId >= DDS_BACKEND_MAX_CLIENTS) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    FileLeaseT* lease = Leases[FileId];
+    if (!lease) {
+        lease = calloc(1, sizeof(FileLeaseT));
+        if (!lease) {
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+        lease->WriterWaiting = -1;
+        Leases[FileId] = lease;
+    }
+
+    uint64_t now = spdk_get_ticks();
+    ExpireLeases(lease, now);
+
+    //
+    // Writers before readers: once a client waits to write, only it and the holders of leases go on reading
+    //
+    //
+    bool blocked = Mode == LEASE_READ && !lease->Mode[ClientId] &&
+        lease->WriterWaiting >= 0 && lease->WriterWaiting != ClientId;
+    for (int c = 0; c != DDS_BACKEND_MAX_CLIENTS; c++) {
+        if (c != ClientId && lease->Mode[c] && (Mode == LEASE_WRITE || lease->Mode[c] == LEASE_WRITE)) {
+            lease->Revoked[c] = true;
+            blocked = true;
+        }
+    }
+
+    if (blocked) {
+        if (Mode == LEASE_WRITE && lease->WriterWaiting < 0) {
+            lease->WriterWaiting = ClientId;
+            lease->WriterWaitEnd = now + LeaseTicks(DDS_BACKEND_LEASE_WRITER_WAIT_MS);
+        }
+        return DDS_ERROR_CODE_LEASE_HELD;
+    }
+
+    if (lease->WriterWaiting == ClientId) {
+        lease->WriterWaiting = -1;
+    }
+    lease->Mode[ClientId] = (uint8_t)Mode;
+    lease->Revoked[ClientId] = false;
+    lease->Expiry[ClientId] = now + LeaseTicks(DDS_BACKEND_LEASE_MS);
+    *TermMs = DDS_BACKEND_LEASE_MS;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Give a lease back
+//
+//
+ErrorCodeT
+LeaseRelease(
+    FileIdT FileId,
+    int ClientId
+){
+    if (FileId >= DDS_MAX_FILES || ClientId < 0 || ClientId >= DDS_BACKEND_MAX_CLIENTS) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    FileLeaseT* lease = Leases[FileId];
+    if (lease) {
+        lease->Mode[ClientId] = LEASE_NONE;
+        lease->Revoked[ClientId] = false;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Renew the leases of a client, reporting the revoked ones
+//
+//
+uint32_t
+LeaseRenew(
+    int ClientId,
+    FileIdT* Revoked,
+    uint32_t MaxRevoked,
+    uint32_t* TermMs
+){
+    uint32_t numRevoked = 0;
+    uint64_t now = spdk_get_ticks();
+    uint64_t expiry = now + LeaseTicks(DDS_BACKEND_LEASE_MS);
+
+    *TermMs = DDS_BACKEND_LEASE_MS;
+    if (ClientId < 0 || ClientId >= DDS_BACKEND_MAX_CLIENTS) {
+        return 0;
+    }
+
+    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
+        FileLeaseT* lease = Leases[f];
+        if (!lease || !lease->Mode[ClientId]) {
+            continue;
+        }
+
+        ExpireLeases(lease, now);
+        if (!lease->Mode[ClientId]) {
+            continue;
+        }
+
+        //
+        // A revoked lease is not renewed, so it ends by itself if it is not given back
+        //
+        //
+        if (lease->Revoked[ClientId]) {
+            if (numRevoked != MaxRevoked) {
+                Revoked[numRevoked++] = (FileIdT)f;
+            }
+            continue;
+        }
+        lease->Expiry[ClientId] = expiry;
+    }
+
+    return numRevoked;
+}
+
+void
+LeaseDropClient(
+    int ClientId
+){
+    if (ClientId < 0 || ClientId >= DDS_BACKEND_MAX_CLIENTS) {
+        return;
+    }
+
+    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
+        if (Leases[f]) {
+            LeaseRelease((FileIdT)f, ClientId);
+            if (Leases[f]->WriterWaiting == ClientId) {
+                Leases[f]->WriterWaiting = -1;
+            }
+        }
+    }
+}
+
+void
+LeaseDropFile(
+    FileIdT FileId
+){
+    if (FileId < DDS_MAX_FILES && Leases[FileId]) {
+        free(Leases[FileId]);
+        Leases[FileId] = NULL;
+    }
+}
+
+void
+LeasesDestroy() {
+    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
+        LeaseDropFile((FileIdT)f);
+    }
+}
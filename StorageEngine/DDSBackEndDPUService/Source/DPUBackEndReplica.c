@@ -0,0 +1,1072 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <infiniband/verbs.h>
+#include <rdma/rdma_cma.h>
+
+#include "spdk/env.h"
+
+#include "CorePlan.h"
+#include "DPUBackEnd.h"
+#include "DPUBackEndReplica.h"
+
+#ifdef OPT_FILE_SERVICE_REPLICATION
+#define REPLICA_RESOLVE_TIMEOUT_MS 2000
+#define REPLICA_POLL_BATCH 32
+#define REPLICA_SERVER_WAIT_MS 100
+
+//
+// The channel of a data plane agent to the peer: the writes it forwarded wait in their send slots for their acks
+//
+//
+typedef struct {
+    struct rdma_event_channel* CmChannel;
+    struct rdma_cm_id* CmId;
+    struct ibv_pd* PDomain;
+    struct ibv_cq* CompQ;
+    char* SendBuffs;
+    struct ibv_mr* SendMr;
+    ReplicaAckMsg* Acks;
+    struct ibv_mr* AckMr;
+    DataPlaneRequestContext* Writes[REPLICATION_CHANNEL_DEPTH];
+    uint64_t Seqs[REPLICATION_CHANNEL_DEPTH];
+    uint16_t FreeSlots[REPLICATION_CHANNEL_DEPTH];
+    uint32_t NumFreeSlots;
+    uint64_t NextSeq;
+    bool Broken;
+} ReplicaChannelT;
+
+//
+// The end of a channel of the peer: each write of the peer lands in a receive buffer, is written from there
+// through its own I/O slot, and is acknowledged once it completes
+//
+//
+typedef struct {
+    uint32_t Id;
+    struct rdma_cm_id* CmId;
+    struct ibv_pd* PDomain;
+    struct ibv_comp_channel* CompChannel;
+    struct ibv_cq* CompQ;
+    char* RecvBuffs;
+    struct ibv_mr* RecvMr;
+    ReplicaAckMsg* Acks;
+    struct ibv_mr* AckMr;
+    DataPlaneRequestContext Contexts[REPLICATION_CHANNEL_DEPTH];
+    DataPlaneRequestColdContext ColdContexts[REPLICATION_CHANNEL_DEPTH];
+    BuffMsgF2BReqHeader Requests[REPLICATION_CHANNEL_DEPTH];
+    BuffMsgB2FAckHeader Responses[REPLICATION_CHANNEL_DEPTH];
+    uint64_t Seqs[REPLICATION_CHANNEL_DEPTH];
+    uint16_t InFlight[REPLICATION_CHANNEL_DEPTH];
+    uint32_t NumInFlight;
+    uint16_t Pending[REPLICATION_CHANNEL_DEPTH];
+    uint32_t NumPending;
+    bool Closing;
+} ReplicaPeerT;
+
+static ReplicaChannelT ReplicaChannels[DDS_BACKEND_DATA_PLANE_AGENTS];
+static ReplicaPeerT* ReplicaPeers[DDS_BACKEND_DATA_PLANE_AGENTS];
+static struct rdma_event_channel* ReplicaServerCmChannel;
+static struct rdma_cm_id* ReplicaServerCmId;
+static FileService* ReplicaFS;
+static pthread_t ReplicaServerThread;
+static volatile bool ReplicaServerStopping;
+static bool ReplicaServerRunning;
+
+//
+// Wait for the next event of a blocking CM channel, which must be Expected
+//
+//
+static int
+ReplicaWaitCmEvent(
+    struct rdma_event_channel* Channel,
+    enum rdma_cm_event_type Expected
+) {
+    struct rdma_cm_event* event;
+    int ret;
+
+    if (rdma_get_cm_event(Channel, &event)) {
+        return -errno;
+    }
+
+    ret = event->event == Expected ? 0 : -ECONNREFUSED;
+    rdma_ack_cm_event(event);
+
+    return ret;
+}
+
+//
+// Post the receive of an ack into its buffer
+//
+//
+static int
+ReplicaPostAckRecv(
+    ReplicaChannelT* Channel,
+    uint32_t Index
+) {
+    struct ibv_sge sge;
+    struct ibv_recv_wr wr;
+    struct ibv_recv_wr* badWr;
+
+    sge.addr = (uint64_t)&Channel->Acks[Index];
+    sge.length = sizeof(ReplicaAckMsg);
+    sge.lkey = Channel->AckMr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = Index;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    return ibv_post_recv(Channel->CmId->qp, &wr, &badWr);
+}
+
+//
+// Release what a channel holds, however far its connection got
+//
+//
+static void
+ReplicaCloseChannel(
+    ReplicaChannelT* Channel
+) {
+    if (Channel->CmId && Channel->CmId->qp) {
+        rdma_disconnect(Channel->CmId);
+        rdma_destroy_qp(Channel->CmId);
+    }
+    if (Channel->AckMr) {
+        ibv_dereg_mr(Channel->AckMr);
+    }
+    if (Channel->SendMr) {
+        ibv_dereg_mr(Channel->SendMr);
+    }
+    if (Channel->CompQ) {
+        ibv_destroy_cq(Channel->CompQ);
+    }
+    if (Channel->PDomain) {
+        ibv_dealloc_pd(Channel->PDomain);
+    }
+    if (Channel->CmId) {
+        rdma_destroy_id(Channel->CmId);
+    }
+    if (Channel->CmChannel) {
+        rdma_destroy_event_channel(Channel->CmChannel);
+    }
+    free(Channel->Acks);
+    free(Channel->SendBuffs);
+
+    memset(Channel, 0, sizeof(ReplicaChannelT));
+}
+
+//
+// Connect the channel of a data plane agent to the peer
+//
+//
+static int
+ReplicaConnectChannel(
+    ReplicaChannelT* Channel,
+    uint32_t Id,
+    struct sockaddr_in* Peer
+) {
+    struct ibv_qp_init_attr initAttr;
+    struct rdma_conn_param connParam;
+    size_t sendBytes = (size_t)REPLICATION_CHANNEL_DEPTH * REPLICA_MSG_BYTES;
+    int ret;
+
+    Channel->CmChannel = rdma_create_event_channel();
+    if (!Channel->CmChannel) {
+        return -errno;
+    }
+
+    if (rdma_create_id(Channel->CmChannel, &Channel->CmId, Channel, RDMA_PS_TCP)) {
+        return -errno;
+    }
+
+    if (rdma_resolve_addr(Channel->CmId, NULL, (struct sockaddr*)Peer, REPLICA_RESOLVE_TIMEOUT_MS)) {
+        return -errno;
+    }
+    ret = ReplicaWaitCmEvent(Channel->CmChannel, RDMA_CM_EVENT_ADDR_RESOLVED);
+    if (ret) {
+        return ret;
+    }
+
+    if (rdma_resolve_route(Channel->CmId, REPLICA_RESOLVE_TIMEOUT_MS)) {
+        return -errno;
+    }
+    ret = ReplicaWaitCmEvent(Channel->CmChannel, RDMA_CM_EVENT_ROUTE_RESOLVED);
+    if (ret) {
+        return ret;
+    }
+
+    Channel->PDomain = ibv_alloc_pd(Channel->CmId->verbs);
+    if (!Channel->PDomain) {
+        return -ENOMEM;
+    }
+
+    Channel->CompQ = ibv_create_cq(Channel->CmId->verbs, REPLICATION_CHANNEL_DEPTH * 3, Channel, NULL, 0);
+    if (!Channel->CompQ) {
+        return -ENOMEM;
+    }
+
+    memset(&initAttr, 0, sizeof(initAttr));
+    initAttr.cap.max_send_wr = REPLICATION_CHANNEL_DEPTH * 2;
+    initAttr.cap.max_recv_wr = REPLICATION_CHANNEL_DEPTH;
+    initAttr.cap.max_send_sge = 1;
+    initAttr.cap.max_recv_sge = 1;
+    initAttr.qp_type = IBV_QPT_RC;
+    initAttr.send_cq = Channel->CompQ;
+    initAttr.recv_cq = Channel->CompQ;
+    if (rdma_create_qp(Channel->CmId, Channel->PDomain, &initAttr)) {
+        return -errno;
+    }
+
+    Channel->SendBuffs = aligned_alloc(DDS_BACKEND_PAGE_SIZE, sendBytes);
+    Channel->Acks = calloc(REPLICATION_CHANNEL_DEPTH, sizeof(ReplicaAckMsg));
+    if (!Channel->SendBuffs || !Channel->Acks) {
+        return -ENOMEM;
+    }
+
+    Channel->SendMr = ibv_reg_mr(Channel->PDomain, Channel->SendBuffs, sendBytes, IBV_ACCESS_LOCAL_WRITE);
+    Channel->AckMr = ibv_reg_mr(Channel->PDomain, Channel->Acks,
+        REPLICATION_CHANNEL_DEPTH * sizeof(ReplicaAckMsg), IBV_ACCESS_LOCAL_WRITE);
+    if (!Channel->SendMr || !Channel->AckMr) {
+        return -ENOMEM;
+    }
+
+    for (uint32_t i = 0; i != REPLICATION_CHANNEL_DEPTH; i++) {
+        if (ReplicaPostAckRecv(Channel, i)) {
+            return -EIO;
+        }
+    }
+
+    memset(&connParam, 0, sizeof(connParam));
+    connParam.private_data = &Id;
+    connParam.private_data_len = sizeof(Id);
+    connParam.retry_count = 7;
+    connParam.rnr_retry_count = 7;
+    if (rdma_connect(Channel->CmId, &connParam)) {
+        return -errno;
+    }
+    ret = ReplicaWaitCmEvent(Channel->CmChannel, RDMA_CM_EVENT_ESTABLISHED);
+    if (ret) {
+        return ret;
+    }
+
+    for (uint32_t i = 0; i != REPLICATION_CHANNEL_DEPTH; i++) {
+        Channel->FreeSlots[i] = (uint16_t)(REPLICATION_CHANNEL_DEPTH - 1 - i);
+    }
+    Channel->NumFreeSlots = REPLICATION_CHANNEL_DEPTH;
+    Channel->NextSeq = 1;
+    Channel->Broken = false;
+
+    return 0;
+}
+
+//
+// The peer is done with a forwarded write: publish the response if the local write is done too
+//
+//
+static void
+ReplicaJoinPeer(
+    DataPlaneRequestContext* Context,
+    uint64_t Seq,
+    bool Success
+) {
+    //
+    // A write that failed locally before it could join was published then, and its context may be reused since
+    //
+    //
+    if (Context->Cold->ReplicaSeq != Seq) {
+        return;
+    }
+
+    int old = __atomic_exchange_n(&Context->Cold->ReplicaState,
+        Success ? REPLICA_STATE_PEER_DONE : REPLICA_STATE_PEER_FAILED, __ATOMIC_ACQ_REL);
+    if (old == REPLICA_STATE_LOCAL_DONE || old == REPLICA_STATE_LOCAL_FAILED) {
+        bool success = old == REPLICA_STATE_LOCAL_DONE && Success;
+        Context->Response->BytesServiced = success ? Context->Cold->ReplicaBytes : 0;
+        Context->Response->Result = success ? DDS_ERROR_CODE_SUCCESS : DDS_ERROR_CODE_IO_FAILURE;
+    }
+}
+
+//
+// Fail every write waiting on a channel whose connection broke; writes fail on it from now on
+//
+//
+static void
+ReplicaBreakChannel(
+    ReplicaChannelT* Channel,
+    uint32_t Id
+) {
+    if (!Channel->Broken) {
+        fprintf(stderr, "%s [error]: replication channel %u to the peer broke, writes fail from now on\n",
+            __func__, Id);
+    }
+    Channel->Broken = true;
+
+    for (uint32_t slot = 0; slot != REPLICATION_CHANNEL_DEPTH; slot++) {
+        DataPlaneRequestContext* context = Channel->Writes[slot];
+        if (context) {
+            Channel->Writes[slot] = NULL;
+            Channel->FreeSlots[Channel->NumFreeSlots++] = (uint16_t)slot;
+            ReplicaJoinPeer(context, Channel->Seqs[slot], false);
+        }
+    }
+}
+
+//
+// Forward a write to the peer on the channel of a data plane agent;
+// an append is not, as it has no offset yet, nor is an atomic operation, whose new value is not known yet, and both fail
+//
+//
+void
+ReplicaForward(
+    uint32_t Channel,
+    DataPlaneRequestContext* Context,
+    const BuffMsgF2BReqHeader* Request
+) {
+    ReplicaChannelT* channel = &ReplicaChannels[Channel];
+    const SplittableBufferT* data = &Context->DataBuffer;
+    struct ibv_sge sge;
+    struct ibv_send_wr wr;
+    struct ibv_send_wr* badWr;
+
+    Context->Cold->ReplicaSeq = 0;
+    Context->Cold->ReplicaBytes = 0;
+    if (channel->Broken || !channel->CmId || !channel->NumFreeSlots || data->TotalSize > REPLICATION_MAX_WRITE_BYTES ||
+        Request->Offset == BUFF_MSG_REQUEST_OFFSET_APPEND || Context->AtomicOp) {
+        __atomic_store_n(&Context->Cold->ReplicaState, REPLICA_STATE_PEER_FAILED, __ATOMIC_RELEASE);
+        return;
+    }
+
+    uint16_t slot = channel->FreeSlots[--channel->NumFreeSlots];
+    char* msg = channel->SendBuffs + (size_t)slot * REPLICA_MSG_BYTES;
+    ReplicaWriteHeader* header = (ReplicaWriteHeader*)msg;
+    FileIOSizeT bytesOnFirst = data->FirstSize < data->TotalSize ? data->FirstSize : data->TotalSize;
+    uint64_t seq = (channel->NextSeq++ << 16) | slot;
+
+    header->Seq = seq;
+    header->FileId = Request->FileId;
+    header->Bytes = data->TotalSize;
+    header->Offset = Request->Offset;
+    header->Durable = Context->Durable;
+    memcpy(msg + REPLICA_HEADER_BYTES, data->FirstAddr, bytesOnFirst);
+    if (data->TotalSize > bytesOnFirst) {
+        memcpy(msg + REPLICA_HEADER_BYTES + bytesOnFirst, data->SecondAddr, data->TotalSize - bytesOnFirst);
+    }
+
+    Context->Cold->ReplicaSeq = seq;
+    __atomic_store_n(&Context->Cold->ReplicaState, REPLICA_STATE_WAIT, __ATOMIC_RELEASE);
+    channel->Writes[slot] = Context;
+    channel->Seqs[slot] = seq;
+
+    sge.addr = (uint64_t)msg;
+    sge.length = REPLICA_HEADER_BYTES + data->TotalSize;
+    sge.lkey = channel->SendMr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = slot;
+    wr.opcode = IBV_WR_SEND;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.send_flags = IBV_SEND_SIGNALED;
+
+    if (ibv_post_send(channel->CmId->qp, &wr, &badWr)) {
+        channel->Writes[slot] = NULL;
+        channel->FreeSlots[channel->NumFreeSlots++] = slot;
+        __atomic_store_n(&Context->Cold->ReplicaState, REPLICA_STATE_PEER_FAILED, __ATOMIC_RELEASE);
+    }
+}
+
+//
+// Take the acks of the peer on the channel of a data plane agent
+//
+//
+int
+ReplicaPoll(
+    uint32_t Channel
+) {
+    ReplicaChannelT* channel = &ReplicaChannels[Channel];
+    struct ibv_wc wcs[REPLICA_POLL_BATCH];
+
+    if (!channel->CompQ) {
+        return 0;
+    }
+
+    int n = ibv_poll_cq(channel->CompQ, REPLICA_POLL_BATCH, wcs);
+    if (n < 0) {
+        ReplicaBreakChannel(channel, Channel);
+        return -EIO;
+    }
+
+    for (int i = 0; i != n; i++) {
+        if (wcs[i].status != IBV_WC_SUCCESS) {
+            ReplicaBreakChannel(channel, Channel);
+            return -EIO;
+        }
+
+        //
+        // Send completions carry nothing: the ack of a write is what frees its slot
+        //
+        //
+        if (wcs[i].opcode != IBV_WC_RECV) {
+            continue;
+        }
+
+        ReplicaAckMsg* ack = &channel->Acks[wcs[i].wr_id];
+        uint64_t slot = ack->Seq & REPLICA_SEQ_SLOT_MASK;
+        if (slot < REPLICATION_CHANNEL_DEPTH && channel->Writes[slot] && channel->Seqs[slot] == ack->Seq) {
+            DataPlaneRequestContext* context = channel->Writes[slot];
+            channel->Writes[slot] = NULL;
+            channel->FreeSlots[channel->NumFreeSlots++] = (uint16_t)slot;
+            ReplicaJoinPeer(context, ack->Seq, ack->Result == DDS_ERROR_CODE_SUCCESS);
+        }
+
+        if (ReplicaPostAckRecv(channel, (uint32_t)wcs[i].wr_id)) {
+            ReplicaBreakChannel(channel, Channel);
+            return -EIO;
+        }
+    }
+
+    return channel->Broken ? -ENOTCONN : 0;
+}
+
+//
+// The local write of a forwarded write is done
+//
+//
+bool
+ReplicaJoinLocal(
+    DataPlaneRequestContext* Context,
+    bool* Success,
+    FileIOSizeT Bytes
+) {
+    if (__atomic_load_n(&Context->Cold->ReplicaState, __ATOMIC_ACQUIRE) == REPLICA_STATE_NONE) {
+        return true;
+    }
+
+    Context->Cold->ReplicaBytes = Bytes;
+    int old = __atomic_exchange_n(&Context->Cold->ReplicaState,
+        *Success ? REPLICA_STATE_LOCAL_DONE : REPLICA_STATE_LOCAL_FAILED, __ATOMIC_ACQ_REL);
+    if (old == REPLICA_STATE_WAIT) {
+        return false;
+    }
+
+    if (old == REPLICA_STATE_PEER_FAILED) {
+        *Success = false;
+    }
+
+    return true;
+}
+
+//
+// Post the receive of a write of the peer into its buffer
+//
+//
+static int
+ReplicaPostWriteRecv(
+    ReplicaPeerT* Peer,
+    uint32_t Index
+) {
+    struct ibv_sge sge;
+    struct ibv_recv_wr wr;
+    struct ibv_recv_wr* badWr;
+
+    sge.addr = (uint64_t)(Peer->RecvBuffs + (size_t)Index * REPLICA_MSG_BYTES);
+    sge.length = REPLICA_MSG_BYTES;
+    sge.lkey = Peer->RecvMr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = Index;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+
+    return ibv_post_recv(Peer->CmId->qp, &wr, &badWr);
+}
+
+//
+// Ack a write of the peer and take the next one into its buffer
+//
+//
+static int
+ReplicaAckWrite(
+    ReplicaPeerT* Peer,
+    uint32_t Index,
+    ErrorCodeT Result
+) {
+    struct ibv_sge sge;
+    struct ibv_send_wr wr;
+    struct ibv_send_wr* badWr;
+
+    Peer->Acks[Index].Seq = Peer->Seqs[Index];
+    Peer->Acks[Index].Result = Result;
+
+    sge.addr = (uint64_t)&Peer->Acks[Index];
+    sge.length = sizeof(ReplicaAckMsg);
+    sge.lkey = Peer->AckMr->lkey;
+
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = Index;
+    wr.opcode = IBV_WR_SEND;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    wr.send_flags = IBV_SEND_SIGNALED;
+
+    if (ibv_post_send(Peer->CmId->qp, &wr, &badWr)) {
+        return -EIO;
+    }
+
+    return ReplicaPostWriteRecv(Peer, Index) ? -EIO : 0;
+}
+
+//
+// Free a channel of the peer, once none of its writes is in flight
+//
+//
+static void
+ReplicaFreePeer(
+    ReplicaPeerT* Peer
+) {
+    if (Peer->CmId && Peer->CmId->qp) {
+        rdma_destroy_qp(Peer->CmId);
+    }
+    if (Peer->AckMr) {
+        ibv_dereg_mr(Peer->AckMr);
+    }
+    if (Peer->RecvMr) {
+        ibv_dereg_mr(Peer->RecvMr);
+    }
+    if (Peer->CompQ) {
+        ibv_destroy_cq(Peer->CompQ);
+    }
+    if (Peer->CompChannel) {
+        ibv_destroy_comp_channel(Peer->CompChannel);
+    }
+    if (Peer->PDomain) {
+        ibv_dealloc_pd(Peer->PDomain);
+    }
+    if (Peer->CmId) {
+        rdma_destroy_id(Peer->CmId);
+    }
+    if (Peer->RecvBuffs) {
+        spdk_dma_free(Peer->RecvBuffs);
+    }
+    free(Peer->Acks);
+    free(Peer);
+}
+
+//
+// Take a channel of the peer
+//
+//
+static int
+ReplicaAcceptPeer(
+    struct rdma_cm_id* CmId,
+    uint32_t Id
+) {
+    struct ibv_qp_init_attr initAttr;
+    struct rdma_conn_param connParam;
+    size_t recvBytes = (size_t)REPLICATION_CHANNEL_DEPTH * REPLICA_MSG_BYTES;
+    ReplicaPeerT* peer = aligned_alloc(DDS_CACHE_LINE_SIZE, sizeof(ReplicaPeerT));
+    int flags;
+
+    if (!peer) {
+        return -ENOMEM;
+    }
+    memset(peer, 0, sizeof(ReplicaPeerT));
+    peer->Id = Id;
+
+    peer->PDomain = ibv_alloc_pd(CmId->verbs);
+    if (!peer->PDomain) {
+        goto AcceptPeerFail;
+    }
+
+    peer->CompChannel = ibv_create_comp_channel(CmId->verbs);
+    if (!peer->CompChannel) {
+        goto AcceptPeerFail;
+    }
+    flags = fcntl(peer->CompChannel->fd, F_GETFL);
+    if (fcntl(peer->CompChannel->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        goto AcceptPeerFail;
+    }
+
+    peer->CompQ = ibv_create_cq(CmId->verbs, REPLICATION_CHANNEL_DEPTH * 3, peer, peer->CompChannel, 0);
+    if (!peer->CompQ) {
+        goto AcceptPeerFail;
+    }
+
+    memset(&initAttr, 0, sizeof(initAttr));
+    initAttr.cap.max_send_wr = REPLICATION_CHANNEL_DEPTH * 2;
+    initAttr.cap.max_recv_wr = REPLICATION_CHANNEL_DEPTH;
+    initAttr.cap.max_send_sge = 1;
+    initAttr.cap.max_recv_sge = 1;
+    initAttr.qp_type = IBV_QPT_RC;
+    initAttr.send_cq = peer->CompQ;
+    initAttr.recv_cq = peer->CompQ;
+    if (rdma_create_qp(CmId, peer->PDomain, &initAttr)) {
+        goto AcceptPeerFail;
+    }
+    peer->CmId = CmId;
+
+    //
+    // The writes are issued right from their receive buffers, so they are DMA-able
+    //
+    //
+    peer->RecvBuffs = spdk_dma_zmalloc(recvBytes, DDS_BACKEND_PAGE_SIZE, NULL);
+    peer->Acks = calloc(REPLICATION_CHANNEL_DEPTH, sizeof(ReplicaAckMsg));
+    if (!peer->RecvBuffs || !peer->Acks) {
+        goto AcceptPeerFail;
+    }
+
+    peer->RecvMr = ibv_reg_mr(peer->PDomain, peer->RecvBuffs, recvBytes, IBV_ACCESS_LOCAL_WRITE);
+    peer->AckMr = ibv_reg_mr(peer->PDomain, peer->Acks,
+        REPLICATION_CHANNEL_DEPTH * sizeof(ReplicaAckMsg), IBV_ACCESS_LOCAL_WRITE);
+    if (!peer->RecvMr || !peer->AckMr) {
+        goto AcceptPeerFail;
+    }
+
+    for (uint32_t i = 0; i != REPLICATION_CHANNEL_DEPTH; i++) {
+        if (ReplicaPostWriteRecv(peer, i)) {
+            goto AcceptPeerFail;
+        }
+    }
+
+    memset(&connParam, 0, sizeof(connParam));
+    connParam.retry_count = 7;
+    connParam.rnr_retry_count = 7;
+    if (rdma_accept(CmId, &connParam)) {
+        goto AcceptPeerFail;
+    }
+
+    CmId->context = peer;
+    ReplicaPeers[Id] = peer;
+    fprintf(stdout, "Replication channel %u of the peer is connected\n", Id);
+
+    return 0;
+
+AcceptPeerFail:
+    //
+    // The id of the request belongs to the CM until it is rejected
+    //
+    //
+    if (peer->CmId && peer->CmId->qp) {
+        rdma_destroy_qp(peer->CmId);
+    }
+    peer->CmId = NULL;
+    ReplicaFreePeer(peer);
+    return -ENOMEM;
+}
+
+//
+// Handle the connection events of the channels of the peer
+//
+//
+static bool
+ReplicaServerCmEvents(void) {
+    struct rdma_cm_event* event;
+    bool busy = false;
+
+    while (rdma_get_cm_event(ReplicaServerCmChannel, &event) == 0) {
+        struct rdma_cm_id* cmId = event->id;
+        uint32_t id = DDS_BACKEND_DATA_PLANE_AGENTS;
+        ReplicaPeerT* peer;
+
+        busy = true;
+        switch (event->event) {
+            case RDMA_CM_EVENT_CONNECT_REQUEST:
+                if (event->param.conn.private_data_len >= sizeof(id)) {
+                    memcpy(&id, event->param.conn.private_data, sizeof(id));
+                }
+                if (id >= DDS_BACKEND_DATA_PLANE_AGENTS || ReplicaPeers[id] || ReplicaAcceptPeer(cmId, id)) {
+                    fprintf(stderr, "%s [error]: rejected replication channel %u of the peer\n", __func__, id);
+                    rdma_reject(cmId, NULL, 0);
+                }
+                break;
+            case RDMA_CM_EVENT_DISCONNECTED:
+                peer = cmId->context;
+                if (peer && !peer->Closing) {
+                    fprintf(stdout, "Replication channel %u of the peer is disconnected\n", peer->Id);
+                    peer->Closing = true;
+                    peer->NumPending = 0;
+                }
+                break;
+            default:
+                break;
+        }
+
+        rdma_ack_cm_event(event);
+    }
+
+    return busy;
+}
+
+//
+// Whether a write of the peer must wait for an earlier one: the two overlap and the other one has a lower Seq,
+// so that the later one lands last, as it did on the primary
+//
+//
+static bool
+ReplicaWriteMustWait(
+    ReplicaPeerT* Peer,
+    uint16_t Index,
+    uint16_t Other
+) {
+    const BuffMsgF2BReqHeader* request = &Peer->Requests[Index];
+    const BuffMsgF2BReqHeader* other = &Peer->Requests[Other];
+
+    return Peer->Seqs[Other] < Peer->Seqs[Index] && other->FileId == request->FileId &&
+        request->Bytes && other->Bytes &&
+        other->Offset < request->Offset + request->Bytes && request->Offset < other->Offset + other->Bytes;
+}
+
+//
+// Submit the writes of a channel of the peer that the file service didn't take yet; Pending is in Seq order,
+// as the writes land in the order the primary sent them, and a write is held while an earlier one
+// that overlaps it is pending or in flight
+//
+//
+static void
+ReplicaSubmitPending(
+    ReplicaPeerT* Peer
+) {
+    uint32_t kept = 0;
+    uint32_t p = 0;
+
+    for (; p != Peer->NumPending; p++) {
+        uint16_t index = Peer->Pending[p];
+        DataPlaneRequestContext* context = &Peer->Contexts[index];
+        RequestIdT ioSlot = DDS_REPLICA_IO_SLOT_NUMBER_BASE + Peer->Id * REPLICATION_CHANNEL_DEPTH + index;
+        bool held = false;
+
+        for (uint32_t i = 0; i != Peer->NumInFlight && !held; i++) {
+            held = ReplicaWriteMustWait(Peer, index, Peer->InFlight[i]);
+        }
+        for (uint32_t i = 0; i != kept && !held; i++) {
+            held = ReplicaWriteMustWait(Peer, index, Peer->Pending[i]);
+        }
+
+        if (held) {
+            Peer->Pending[kept++] = index;
+            continue;
+        }
+
+        if (!SubmitOffloadRequests(ReplicaFS, &context, &ioSlot, 1)) {
+            break;
+        }
+
+        Peer->InFlight[Peer->NumInFlight++] = index;
+    }
+
+    memmove(&Peer->Pending[kept], &Peer->Pending[p], (Peer->NumPending - p) * sizeof(uint16_t));
+    Peer->NumPending = kept + (Peer->NumPending - p);
+}
+
+//
+// Take a write of the peer that landed in a receive buffer
+//
+//
+static int
+ReplicaTakeWrite(
+    ReplicaPeerT* Peer,
+    uint32_t Index,
+    uint32_t Length
+) {
+    char* msg = Peer->RecvBuffs + (size_t)Index * REPLICA_MSG_BYTES;
+    ReplicaWriteHeader* header = (ReplicaWriteHeader*)msg;
+    DataPlaneRequestContext* context = &Peer->Contexts[Index];
+
+    if (Length < REPLICA_HEADER_BYTES) {
+        return -EPROTO;
+    }
+
+    Peer->Seqs[Index] = header->Seq;
+    if (header->Bytes > REPLICATION_MAX_WRITE_BYTES || Length != REPLICA_HEADER_BYTES + header->Bytes) {
+        return ReplicaAckWrite(Peer, Index, DDS_ERROR_CODE_INVALID_PARAM);
+    }
+
+    memset(context, 0, sizeof(DataPlaneRequestContext));
+    context->Cold = &Peer->ColdContexts[Index];
+    memset(context->Cold, 0, sizeof(DataPlaneRequestColdContext));
+    Peer->Requests[Index].RequestId = (RequestIdT)Index;
+    Peer->Requests[Index].FileId = header->FileId;
+    Peer->Requests[Index].Bytes = header->Bytes;
+    Peer->Requests[Index].Offset = header->Offset;
+    Peer->Responses[Index].RequestId = (RequestIdT)Index;
+    Peer->Responses[Index].BytesServiced = 0;
+    Peer->Responses[Index].Result = DDS_ERROR_CODE_IO_PENDING;
+
+    context->IsRead = 0;
+    context->Durable = header->Durable;
+    context->Request = &Peer->Requests[Index];
+    context->Response = &Peer->Responses[Index];
+    context->DataBuffer.TotalSize = header->Bytes;
+    context->DataBuffer.FirstSize = header->Bytes;
+    context->DataBuffer.FirstAddr = msg + REPLICA_HEADER_BYTES;
+    context->DataBuffer.SecondAddr = NULL;
+
+    Peer->Pending[Peer->NumPending++] = (uint16_t)Index;
+    ReplicaSubmitPending(Peer);
+
+    return 0;
+}
+
+//
+// Take the writes of a channel of the peer and ack the ones that completed.
+// Return whether there was anything to do
+//
+//
+static bool
+ReplicaPollPeer(
+    ReplicaPeerT* Peer
+) {
+    struct ibv_wc wcs[REPLICA_POLL_BATCH];
+    struct ibv_cq* eventCq;
+    void* eventContext;
+    bool busy = false;
+    int n;
+
+    while (ibv_get_cq_event(Peer->CompChannel, &eventCq, &eventContext) == 0) {
+        ibv_ack_cq_events(eventCq, 1);
+    }
+    ibv_req_notify_cq(Peer->CompQ, 0);
+
+    while ((n = ibv_poll_cq(Peer->CompQ, REPLICA_POLL_BATCH, wcs)) > 0) {
+        busy = true;
+        for (int i = 0; i != n; i++) {
+            if (wcs[i].status != IBV_WC_SUCCESS) {
+                Peer->Closing = true;
+                Peer->NumPending = 0;
+                continue;
+            }
+            if (wcs[i].opcode == IBV_WC_RECV && !Peer->Closing &&
+                ReplicaTakeWrite(Peer, (uint32_t)wcs[i].wr_id, wcs[i].byte_len)) {
+                fprintf(stderr, "%s [error]: bad write on replication channel %u of the peer\n", __func__, Peer->Id);
+                Peer->Closing = true;
+                Peer->NumPending = 0;
+                rdma_disconnect(Peer->CmId);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < Peer->NumInFlight;) {
+        uint16_t index = Peer->InFlight[i];
+        ErrorCodeT result = *(volatile ErrorCodeT*)&Peer->Responses[index].Result;
+
+        if (result == DDS_ERROR_CODE_IO_PENDING) {
+            i++;
+            continue;
+        }
+
+        busy = true;
+        Peer->InFlight[i] = Peer->InFlight[--Peer->NumInFlight];
+        if (!Peer->Closing && ReplicaAckWrite(Peer, index, result)) {
+            Peer->Closing = true;
+            Peer->NumPending = 0;
+        }
+    }
+
+    //
+    // Writes held behind the ones that just completed may go now
+    //
+    //
+    if (!Peer->Closing) {
+        ReplicaSubmitPending(Peer);
+    }
+
+    return busy;
+}
+
+//
+// The server of the writes of the peer: it sleeps while the peer is idle and polls while its writes are in flight
+//
+//
+static void*
+ReplicaServerThreadFunc(
+    void* Arg
+) {
+    struct pollfd fds[DDS_BACKEND_DATA_PLANE_AGENTS + 1];
+
+    if (CorePlanPin(CORE_ALLOCATION_CONTROL_PLANE_CORE, "replica server", false)) {
+        fprintf(stderr, "%s [error]: failed to pin the replica server\n", __func__);
+    }
+
+    while (!ReplicaServerStopping) {
+        bool busy = ReplicaServerCmEvents();
+        bool inFlight = false;
+        nfds_t numFds = 0;
+
+        fds[numFds].fd = ReplicaServerCmChannel->fd;
+        fds[numFds++].events = POLLIN;
+
+        for (uint32_t c = 0; c != DDS_BACKEND_DATA_PLANE_AGENTS; c++) {
+            ReplicaPeerT* peer = ReplicaPeers[c];
+            if (!peer) {
+                continue;
+            }
+
+            busy |= ReplicaPollPeer(peer);
+            if (peer->Closing && !peer->NumInFlight) {
+                ReplicaPeers[c] = NULL;
+                ReplicaFreePeer(peer);
+                continue;
+            }
+
+            inFlight |= peer->NumInFlight || peer->NumPending;
+            fds[numFds].fd = peer->CompChannel->fd;
+            fds[numFds++].events = POLLIN;
+        }
+
+        if (!busy && !inFlight) {
+            poll(fds, numFds, REPLICA_SERVER_WAIT_MS);
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Listen for the channels of the peer
+//
+//
+static int
+ReplicaListen(void) {
+    struct sockaddr_in sin;
+    int flags;
+
+    ReplicaServerCmChannel = rdma_create_event_channel();
+    if (!ReplicaServerCmChannel) {
+        return -errno;
+    }
+
+    flags = fcntl(ReplicaServerCmChannel->fd, F_GETFL);
+    if (fcntl(ReplicaServerCmChannel->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -errno;
+    }
+
+    if (rdma_create_id(ReplicaServerCmChannel, &ReplicaServerCmId, NULL, RDMA_PS_TCP)) {
+        return -errno;
+    }
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(REPLICATION_PORT);
+    if (rdma_bind_addr(ReplicaServerCmId, (struct sockaddr*)&sin)) {
+        return -errno;
+    }
+
+    if (rdma_listen(ReplicaServerCmId, DDS_BACKEND_DATA_PLANE_AGENTS)) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+//
+// Start replication
+//
+//
+int
+ReplicaStart(
+    FileService* FS
+) {
+    struct sockaddr_in peer;
+    time_t deadline;
+    int ret;
+
+    ReplicaFS = FS;
+    ret = ReplicaListen();
+    if (ret) {
+        fprintf(stderr, "%s [error]: failed to listen for the peer on port %d: %d\n", __func__, REPLICATION_PORT, ret);
+        ReplicaStop();
+        return ret;
+    }
+
+    ReplicaServerStopping = false;
+    ret = pthread_create(&ReplicaServerThread, NULL, ReplicaServerThreadFunc, NULL);
+    if (ret) {
+        fprintf(stderr, "%s [error]: failed to start the replica server: %d\n", __func__, ret);
+        ReplicaStop();
+        return -ret;
+    }
+    ReplicaServerRunning = true;
+
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(REPLICATION_PORT);
+    inet_pton(AF_INET, REPLICATION_PEER_IP, &peer.sin_addr);
+
+    //
+    // Both DPUs start at about the same time, so the peer may not listen yet
+    //
+    //
+    deadline = time(NULL) + REPLICATION_CONNECT_TIMEOUT_SECONDS;
+    for (uint32_t c = 0; c != DDS_BACKEND_DATA_PLANE_AGENTS; c++) {
+        while ((ret = ReplicaConnectChannel(&ReplicaChannels[c], c, &peer)) != 0) {
+            ReplicaCloseChannel(&ReplicaChannels[c]);
+            if (time(NULL) >= deadline) {
+                fprintf(stderr, "%s [error]: failed to connect replication channel %u to %s:%d: %d\n",
+                    __func__, c, REPLICATION_PEER_IP, REPLICATION_PORT, ret);
+                ReplicaStop();
+                return ret;
+            }
+            sleep(1);
+        }
+    }
+
+    fprintf(stdout, "Writes are replicated to %s:%d\n", REPLICATION_PEER_IP, REPLICATION_PORT);
+
+    return 0;
+}
+
+//
+// Stop replication
+//
+//
+void
+ReplicaStop(void) {
+    if (ReplicaServerRunning) {
+        ReplicaServerStopping = true;
+        pthread_join(ReplicaServerThread, NULL);
+        ReplicaServerRunning = false;
+    }
+
+    for (uint32_t c = 0; c != DDS_BACKEND_DATA_PLANE_AGENTS; c++) {
+        ReplicaCloseChannel(&ReplicaChannels[c]);
+
+        //
+        // The buffers of writes still in flight stay with the file service
+        //
+        //
+        ReplicaPeerT* peer = ReplicaPeers[c];
+        if (peer) {
+            ReplicaPeers[c] = NULL;
+            if (!peer->NumInFlight) {
+                ReplicaFreePeer(peer);
+            }
+        }
+    }
+
+    if (ReplicaServerCmId) {
+        rdma_destroy_id(ReplicaServerCmId);
+        ReplicaServerCmId = NULL;
+    }
+    if (ReplicaServerCmChannel) {
+        rdma_destroy_event_channel(ReplicaServerCmChannel);
+        ReplicaServerCmChannel = NULL;
+    }
+}
+#endif
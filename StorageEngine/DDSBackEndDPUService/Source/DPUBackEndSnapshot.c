@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DPUBackEndSnapshot.h"
+#include "DPUBackEndJournal.h"
+#include "DPUBackEndDefrag.h"
+#include "DPULog.h"
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+struct SnapshotCopy;
+
+//
+// A chunk of the copy in flight, read into its buffer then written out
+//
+//
+typedef struct SnapshotCopyLane {
+    struct SnapshotCopy* Copy;
+    char* Buffer;
+    SegmentSizeT Offset;
+    SegmentSizeT Bytes;
+} SnapshotCopyLaneT;
+
+//
+// The copy of the shared segment Old at Slot of a file to New, of the first Bytes of the segment that the file covers
+//
+//
+typedef struct SnapshotCopy {
+    struct DPUStorage* Sto;
+    struct DPUFile* File;
+    FileIdT FileId;
+    SegmentIdT Slot;
+    SegmentIdT Old;
+    SegmentIdT New;
+    SegmentIdT Hint;
+    SegmentSizeT Bytes;
+    SegmentSizeT NextOffset;
+    int LanesBusy;
+    bool Failed;
+    void *SPDKContext;
+    SnapshotCopyLaneT Lanes[DDS_BACKEND_SNAPSHOT_COPY_LANES];
+    SnapshotWaiterT* WaitersHead;
+    SnapshotWaiterT* WaitersTail;
+    struct SnapshotCopy* Next;
+} SnapshotCopyT;
+
+//
+// Fail a held write as WriteFile would have; a gathered write fails every write coalesced into it
+//
+//
+static void
+FailHeldWrite(
+    SnapshotWaiterT* Waiter
+){
+    struct PerSlotContext* slotContext = Waiter->Context;
+
+    if (Waiter->SourceBuffer) {
+        slotContext->Ctx->Response->BytesServiced = 0;
+        slotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+        return;
+    }
+
+    for (RequestIdT r = 0; r != slotContext->NumCoalesced; r++) {
+        slotContext->Coalesced[r]->Ctx->Response->BytesServiced = 0;
+        slotContext->Coalesced[r]->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+    }
+}
+
+//
+// Issue a held write again on its thread; it may wait for the copy of another segment it covers
+//
+//
+static void
+ResumeHeldWrite(
+    void *Arg
+){
+    SnapshotWaiterT* waiter = Arg;
+    ErrorCodeT result = DDS_ERROR_CODE_IO_FAILURE;
+
+    if (!waiter->Failed) {
+        if (waiter->SourceBuffer) {
+            result = WriteFile(waiter->FileId, waiter->Offset, waiter->SourceBuffer, waiter->Callback,
+                waiter->Context, Sto, waiter->SPDKContext);
+        }
+        else {
+            result = WriteFileGather(waiter->FileId, waiter->Offset, waiter->Iov, waiter->IovCnt, waiter->Bytes,
+                waiter->Callback, waiter->Context, Sto, waiter->SPDKContext);
+        }
+    }
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        DPULogWarning("Write held for a segment copy of file %hu failed with %d\n", waiter->FileId, result);
+        FailHeldWrite(waiter);
+    }
+    free(waiter);
+}
+
+//
+// Issue held writes again on their threads, or fail them
+//
+//
+void
+ResumeHeldWrites(
+    SnapshotWaiterT* Waiters,
+    bool Success
+){
+    while (Waiters) {
+        SnapshotWaiterT* next = Waiters->Next;
+        Waiters->Failed = !Success;
+        spdk_thread_send_msg(Waiters->Thread, ResumeHeldWrite, Waiters);
+        Waiters = next;
+    }
+}
+
+//
+// End a copy, letting its writes go again, or fail them
+//
+//
+static void
+FinishSegmentCopy(
+    SnapshotCopyT* Copy,
+    bool Success
+){
+    struct DPUFile* file = Copy->File;
+
+    LockFile(file);
+    SnapshotCopyT** link = &file->Copies;
+    while (*link != Copy) {
+        link = &(*link)->Next;
+    }
+    *link = Copy->Next;
+    SnapshotWaiterT* waiter = Copy->WaitersHead;
+    atomic_fetch_sub(&file->CopiesInFlight, 1);
+    UnlockFile(file);
+
+    ResumeHeldWrites(waiter, Success);
+
+    for (int l = 0; l != DDS_BACKEND_SNAPSHOT_COPY_LANES; l++) {
+        spdk_dma_free(Copy->Lanes[l].Buffer);
+    }
+    free(Copy);
+}
+
+static void
+SegmentRemappedCallback(
+    bool Success,
+    ContextT Context
+){
+    SnapshotCopyT* copy = Context;
+    if (!Success) {
+        SPDK_ERRLOG("Failed to journal the copy of segment %d of file %hu\n", copy->Slot, copy->FileId);
+    }
+    FinishSegmentCopy(copy, Success);
+}
+
+//
+// Map the copy at the slot and drop the old segment, then journal it; a slot the file dropped meanwhile
+// gives the copy back, and its writes go again to find the file as it is now
+//
+//
+static void
+RemapCopiedSegment(
+    SnapshotCopyT* Copy
+){
+    struct DPUStorage* sto = Copy->Sto;
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_REMAP_SEGMENT;
+    record.Remap.Id = Copy->FileId;
+    record.Remap.Slot = Copy->Slot;
+    record.Remap.Old = Copy->Old;
+    record.Remap.New = Copy->New;
+
+    ErrorCodeT result = JournalApply(sto, &record);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        LockFile(Copy->File);
+        ReleaseSegmentOfFile(sto, Copy->FileId, Copy->New);
+        UnlockFile(Copy->File);
+        FinishSegmentCopy(Copy, true);
+        return;
+    }
+
+    result = JournalCommit(sto, &record, SegmentRemappedCallback, Copy, Copy->SPDKContext);
+#ifdef OPT_FILE_SERVICE_TRIM
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        SealFreedSegments(sto, Copy->SPDKContext);
+    }
+#endif
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to journal the copy of segment %d of file %hu with %d\n", Copy->Slot, Copy->FileId, result);
+        FinishSegmentCopy(Copy, false);
+    }
+}
+
+static void CopyNextChunk(SnapshotCopyLaneT* Lane);
+
+static void
+CopyLaneDone(
+    SnapshotCopyLaneT* Lane,
+    bool Success
+){
+    if (!Success) {
+        Lane->Copy->Failed = true;
+    }
+    CopyNextChunk(Lane);
+}
+
+static void
+CopyChunkWrittenCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    spdk_bdev_free_io(bdev_io);
+    CopyLaneDone(Context, Success);
+}
+
+static void
+CopyChunkReadCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    SnapshotCopyLaneT* lane = Context;
+    SnapshotCopyT* copy = lane->Copy;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success || copy->Failed) {
+        CopyLaneDone(lane, false);
+        return;
+    }
+
+    ErrorCodeT result = WriteToDiskAsyncZC(lane->Buffer, copy->Sto->AllSegments[copy->New].DiskAddress + lane->Offset,
+        lane->Bytes, CopyChunkWrittenCallback, lane, copy->Sto, copy->SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        CopyLaneDone(lane, false);
+    }
+}
+
+//
+// Take the next chunk of the segment on a lane; the last lane to find none left remaps the slot,
+// or gives the new segment back if a chunk failed
+//
+//
+static void
+CopyNextChunk(
+    SnapshotCopyLaneT* Lane
+){
+    SnapshotCopyT* copy = Lane->Copy;
+
+    if (copy->Failed || copy->NextOffset == copy->Bytes) {
+        if (--copy->LanesBusy != 0) {
+            return;
+        }
+        if (!copy->Failed) {
+            RemapCopiedSegment(copy);
+            return;
+        }
+
+        LockFile(copy->File);
+        ReleaseSegmentOfFile(copy->Sto, copy->FileId, copy->New);
+        UnlockFile(copy->File);
+        FinishSegmentCopy(copy, false);
+        return;
+    }
+
+    Lane->Offset = copy->NextOffset;
+    Lane->Bytes = min(copy->Bytes - copy->NextOffset, (SegmentSizeT)DDS_BACKEND_SNAPSHOT_COPY_BYTES);
+    copy->NextOffset += Lane->Bytes;
+
+    ErrorCodeT result = ReadFromDiskAsyncZC(Lane->Buffer, copy->Sto->AllSegments[copy->Old].DiskAddress + Lane->Offset,
+        Lane->Bytes, CopyChunkReadCallback, Lane, copy->Sto, copy->SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        CopyLaneDone(Lane, false);
+    }
+}
+
+//
+// Claim the new segment and start the lanes, on the thread of the write that found the segment shared
+//
+//
+static void
+StartSegmentCopy(
+    SnapshotCopyT* Copy
+){
+    FileSizeT slotStart = (FileSizeT)Copy->Slot << DDS_BACKEND_SEGMENT_SHIFT;
+    FileSizeT size = GetSize(Copy->File);
+
+    //
+    // Only the part of the segment the file covers has data worth copying
+    //
+    //
+    Copy->Bytes = size > slotStart ? (SegmentSizeT)min(DDS_BACKEND_SEGMENT_SIZE,
+        (size - slotStart + DDS_BACKEND_SECTOR_SIZE - 1) & ~((FileSizeT)DDS_BACKEND_SECTOR_SIZE - 1)) : 0;
+
+    for (int l = 0; l != DDS_BACKEND_SNAPSHOT_COPY_LANES; l++) {
+        Copy->Lanes[l].Copy = Copy;
+        Copy->Lanes[l].Buffer = spdk_dma_malloc(DDS_BACKEND_SNAPSHOT_COPY_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+        if (!Copy->Lanes[l].Buffer) {
+            SPDK_ERRLOG("Failed to allocate the buffers to copy segment %d\n", Copy->Old);
+            FinishSegmentCopy(Copy, false);
+            return;
+        }
+    }
+
+    ErrorCodeT result = ClaimNewSegment(Copy->Sto, Copy->FileId, Copy->Hint, &Copy->New);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("No segment left to copy segment %d of file %hu\n", Copy->Old, Copy->FileId);
+        FinishSegmentCopy(Copy, false);
+        return;
+    }
+
+    Copy->LanesBusy = DDS_BACKEND_SNAPSHOT_COPY_LANES;
+    for (int l = 0; l != DDS_BACKEND_SNAPSHOT_COPY_LANES; l++) {
+        CopyNextChunk(&Copy->Lanes[l]);
+    }
+}
+
+//
+// Hold a write until the shared segments it covers are copied, starting the copy of one on this thread if none is;
+// *Held is false if the write may go on now after all
+//
+//
+ErrorCodeT
+HoldWriteForSegmentCopy(
+    struct DPUStorage* Sto,
+    struct DPUFile* File,
+    const SnapshotWaiterT* Write,
+    bool* Held
+){
+    SnapshotCopyT* copy = NULL;
+    bool start = false;
+
+    SnapshotWaiterT* waiter = malloc(sizeof(SnapshotWaiterT));
+    if (!waiter) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    *waiter = *Write;
+    waiter->Thread = spdk_get_thread();
+    waiter->Failed = false;
+    waiter->Next = NULL;
+
+    //
+    // The write waits for the copy of the first slot it covers that is being copied or is shared,
+    // and checks the others once that is done
+    //
+    //
+    LockFile(File);
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    if (File->Move && DefragHoldWrite(File, waiter)) {
+        UnlockFile(File);
+        *Held = true;
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+#endif
+
+    SegmentIdT lastSlot = (SegmentIdT)((Write->Offset + Write->Bytes - 1) >> DDS_BACKEND_SEGMENT_SHIFT);
+    for (SegmentIdT slot = (SegmentIdT)(Write->Offset >> DDS_BACKEND_SEGMENT_SHIFT);
+        !copy && slot <= lastSlot && slot < GetNumSegments(File); slot++) {
+        for (copy = File->Copies; copy && copy->Slot != slot; copy = copy->Next);
+        if (copy) {
+            break;
+        }
+
+        //
+        // A segment on the capacity bdev is copied back as a shared one is, whether it's shared or not
+        //
+        //
+        SegmentIdT segment = GetSegment(File, slot);
+        if (segment == DDS_BACKEND_SEGMENT_INVALID || (!SegmentIsCold(segment) &&
+            (!atomic_load(&Sto->AllSegments[segment].Sharers) || AdoptSharedSegment(Sto, segment, Write->FileId)))) {
+            continue;
+        }
+
+        copy = calloc(1, sizeof(SnapshotCopyT));
+        if (!copy) {
+            UnlockFile(File);
+            free(waiter);
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+        copy->Sto = Sto;
+        copy->File = File;
+        copy->FileId = Write->FileId;
+        copy->Slot = slot;
+        copy->Old = segment;
+        copy->New = DDS_BACKEND_SEGMENT_INVALID;
+        SegmentIdT prev = slot > 0 && !SegmentIsHole(File, slot - 1) ?
+            GetSegment(File, slot - 1) : DDS_BACKEND_SEGMENT_INVALID;
+        copy->Hint = prev != DDS_BACKEND_SEGMENT_INVALID && !SegmentIsCold(prev) ? prev + 1 : DDS_BACKEND_SEGMENT_INVALID;
+        copy->SPDKContext = Write->SPDKContext;
+        copy->Next = File->Copies;
+        File->Copies = copy;
+        atomic_fetch_add(&File->CopiesInFlight, 1);
+        start = true;
+    }
+
+    if (copy) {
+        if (copy->WaitersTail) {
+            copy->WaitersTail->Next = waiter;
+        }
+        else {
+            copy->WaitersHead = waiter;
+        }
+        copy->WaitersTail = waiter;
+    }
+
+    UnlockFile(File);
+
+    *Held = copy != NULL;
+    if (!copy) {
+        free(waiter);
+    }
+    else if (start) {
+        StartSegmentCopy(copy);
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+#endif
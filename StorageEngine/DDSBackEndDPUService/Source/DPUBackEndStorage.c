@@ -4,6 +4,17 @@
  */
 
 #include "DPUBackEndStorage.h"
+#include "DPUBackEndJournal.h"
+#include "DPUBackEndChecksum.h"
+#include "DPUBackEndBlockCache.h"
+#include "DPUBackEndSnapshot.h"
+#include "DPUBackEndDedup.h"
+#include "DPUBackEndAtomic.h"
+#include "DPUBackEndDefrag.h"
+#include "DPUBackEndTier.h"
+#include "DPUBackEndWriteBuffer.h"
+#include "DPULog.h"
+#include "Zmalloc.h"
 
 //
 // Constructor
@@ -13,22 +24,61 @@ struct DPUStorage* BackEndStorage(){
     struct DPUStorage *tmp;
     tmp = malloc(sizeof(struct DPUStorage));
     tmp->AllSegments = NULL;
-    tmp->AvailableSegments = 0;
+    tmp->Journal = NULL;
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    tmp->Checksums = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    tmp->BlockCache = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    tmp->Defrag = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    tmp->Tier = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    tmp->WriteBuffer = NULL;
+#endif
+#ifdef OPT_FILE_SERVICE_ZONED
+    tmp->Zoned = false;
+    tmp->ZoneBytes = 0;
+    tmp->SegmentsPerZone = 1;
+    tmp->UsableSegmentsPerZone = 1;
+    tmp->FirstZonedSegment = 0;
+    tmp->ZoneAppendMaxBytes = 0;
+#endif
+    atomic_init(&tmp->AvailableSegments, 0);
+#ifdef OPT_FILE_SERVICE_TRIM
+    tmp->FreedHead = 0;
+    tmp->FreedSealed = 0;
+    tmp->FreedTail = 0;
+    tmp->TrimsInFlight = 0;
+    pthread_mutex_init(&tmp->FreedSegmentsMutex, NULL);
+#endif
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    pthread_mutex_init(&tmp->SharedSegmentsMutex, NULL);
+#endif
 
-    for (size_t d = 0; d != DDS_MAX_DIRS; d++) {
-        tmp->AllDirs[d] = NULL;
+    for (size_t c = 0; c != DDS_BACKEND_DIR_TABLE_CHUNKS; c++) {
+        tmp->DirChunks[c] = NULL;
     }
 
-    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
-        tmp->AllFiles[f] = NULL;
+    for (size_t c = 0; c != DDS_BACKEND_FILE_TABLE_CHUNKS; c++) {
+        tmp->FileChunks[c] = NULL;
     }
 
     tmp->TotalDirs = 0;
     tmp->TotalFiles = 0;
 
+    for (size_t b = 0; b != DDS_BACKEND_FILE_NAME_INDEX_BUCKETS; b++) {
+        tmp->FileNameBuckets[b] = DDS_FILE_INVALID;
+    }
+    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
+        tmp->FileNameNext[f] = DDS_FILE_INVALID;
+    }
+
     tmp->TotalSegments = DDS_BACKEND_CAPACITY / DDS_BACKEND_SEGMENT_SIZE;
-    pthread_mutex_init(&tmp->SectorModificationMutex, NULL);
-    pthread_mutex_init(&tmp->SegmentAllocationMutex, NULL);
     return tmp;
 }
 
@@ -43,15 +93,25 @@ void DeBackEndStorage(
     // Free all bufffers
     //
     //
-    for (size_t d = 0; d != DDS_MAX_DIRS; d++) {
-        if (Sto->AllDirs[d] != NULL) {
-            free(Sto->AllDirs[d]);
+    for (size_t c = 0; c != DDS_BACKEND_DIR_TABLE_CHUNKS; c++) {
+        if (Sto->DirChunks[c] != NULL) {
+            for (size_t d = 0; d != DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES; d++) {
+                if (Sto->DirChunks[c][d] != NULL) {
+                    free(Sto->DirChunks[c][d]);
+                }
+            }
+            free(Sto->DirChunks[c]);
         }
     }
 
-    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
-        if (Sto->AllFiles[f] != NULL) {
-            free(Sto->AllFiles[f]);
+    for (size_t c = 0; c != DDS_BACKEND_FILE_TABLE_CHUNKS; c++) {
+        if (Sto->FileChunks[c] != NULL) {
+            for (size_t f = 0; f != DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES; f++) {
+                if (Sto->FileChunks[c][f] != NULL) {
+                    DeBackEndFile(Sto->FileChunks[c][f]);
+                }
+            }
+            free(Sto->FileChunks[c]);
         }
     }
 
@@ -60,27 +120,231 @@ void DeBackEndStorage(
     //
     //
     ReturnSegments(Sto);
+    JournalDestroy(Sto);
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    ChecksumsDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    BlockCacheDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_DEDUP
+    DedupDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    AtomicWritesDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    DefragDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    TierDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    WriteBufferDestroy(Sto);
+#endif
+#ifdef OPT_FILE_SERVICE_TRIM
+    pthread_mutex_destroy(&Sto->FreedSegmentsMutex);
+#endif
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    pthread_mutex_destroy(&Sto->SharedSegmentsMutex);
+#endif
+}
+
+//
+// Look up a directory by id, NULL if there is none
+//
+//
+struct DPUDir* GetDir(
+    struct DPUStorage* Sto,
+    DirIdT DirId
+){
+    if (DirId >= DDS_MAX_DIRS) {
+        return NULL;
+    }
+
+    struct DPUDir** chunk = Sto->DirChunks[DirId / DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES];
+    if (!chunk) {
+        return NULL;
+    }
+
+    return chunk[DirId % DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES];
+}
+
+//
+// Make sure the table has an entry for a directory id
+//
+//
+ErrorCodeT ReserveDir(
+    struct DPUStorage* Sto,
+    DirIdT DirId
+){
+    if (DirId >= DDS_MAX_DIRS) {
+        return DDS_ERROR_CODE_TOO_MANY_DIRS;
+    }
+
+    size_t c = DirId / DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES;
+    if (!Sto->DirChunks[c]) {
+        Sto->DirChunks[c] = calloc(DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES, sizeof(struct DPUDir*));
+        if (!Sto->DirChunks[c]) {
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Set the directory of a reserved id
+//
+//
+void SetDir(
+    struct DPUStorage* Sto,
+    DirIdT DirId,
+    struct DPUDir* Dir
+){
+    Sto->DirChunks[DirId / DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES][DirId % DDS_BACKEND_DIR_TABLE_CHUNK_ENTRIES] = Dir;
+}
+
+//
+// Look up a file by id, NULL if there is none
+//
+//
+struct DPUFile* GetFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+){
+    if (FileId >= DDS_MAX_FILES) {
+        return NULL;
+    }
+
+    struct DPUFile** chunk = Sto->FileChunks[FileId / DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES];
+    if (!chunk) {
+        return NULL;
+    }
+
+    return chunk[FileId % DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES];
+}
+
+//
+// Make sure the table has an entry for a file id
+//
+//
+ErrorCodeT ReserveFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId
+){
+    if (FileId >= DDS_MAX_FILES) {
+        return DDS_ERROR_CODE_TOO_MANY_FILES;
+    }
+
+    size_t c = FileId / DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES;
+    if (!Sto->FileChunks[c]) {
+        Sto->FileChunks[c] = calloc(DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES, sizeof(struct DPUFile*));
+        if (!Sto->FileChunks[c]) {
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Set the file of a reserved id
+//
+//
+void SetFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    struct DPUFile* File
+){
+    Sto->FileChunks[FileId / DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES][FileId % DDS_BACKEND_FILE_TABLE_CHUNK_ENTRIES] = File;
+}
+
+//
+// The bucket of a file name, by FNV-1a
+//
+//
+static size_t
+FileNameBucket(
+    const char* FileName
+){
+    uint32_t hash = 2166136261u;
+    for (const char* c = FileName; *c; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+    return hash & (DDS_BACKEND_FILE_NAME_INDEX_BUCKETS - 1);
+}
+
+//
+// Look up a file by name, DDS_FILE_INVALID if there is none
+//
+//
+FileIdT FindFileByName(
+    struct DPUStorage* Sto,
+    const char* FileName
+){
+    FileIdT id = Sto->FileNameBuckets[FileNameBucket(FileName)];
+    while (id != DDS_FILE_INVALID) {
+        struct DPUFile* file = GetFile(Sto, id);
+        if (file && strcmp(FileName, GetName(file)) == 0) {
+            return id;
+        }
+        id = Sto->FileNameNext[id];
+    }
+    return DDS_FILE_INVALID;
+}
+
+//
+// Add a file to the name index
+//
+//
+void IndexFileName(
+    struct DPUStorage* Sto,
+    const char* FileName,
+    FileIdT FileId
+){
+    size_t bucket = FileNameBucket(FileName);
+    Sto->FileNameNext[FileId] = Sto->FileNameBuckets[bucket];
+    Sto->FileNameBuckets[bucket] = FileId;
+}
+
+//
+// Remove a file from the name index
+//
+//
+void UnindexFileName(
+    struct DPUStorage* Sto,
+    const char* FileName,
+    FileIdT FileId
+){
+    FileIdT* link = &Sto->FileNameBuckets[FileNameBucket(FileName)];
+    while (*link != DDS_FILE_INVALID) {
+        if (*link == FileId) {
+            *link = Sto->FileNameNext[FileId];
+            Sto->FileNameNext[FileId] = DDS_FILE_INVALID;
+            return;
+        }
+        link = &Sto->FileNameNext[*link];
+    }
 }
 
 ErrorCodeT ReadvFromDiskAsyncZC(
     struct iovec *Iov,
     int IovCnt,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     ContextT Context,
     struct DPUStorage* Sto,
     void *SPDKContext
 ) {
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
-    rc = BdevReadV(SPDKContext, Iov, IovCnt, seg->DiskAddress + SegmentOffset, Bytes, 
+    rc = BdevReadV(SPDKContext, Iov, IovCnt, DiskAddress, Bytes, 
         Callback, Context);
 
     if (rc)
     {
-        printf("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
+        DPULogWarning("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
         return DDS_ERROR_CODE_INVALID_FILE_POSITION;  // there should be an SPDK error log before this
     }
 
@@ -91,28 +355,24 @@ ErrorCodeT ReadvFromDiskAsyncNonZC(
     struct iovec *Iov,
     int IovCnt,
     FileIOSizeT NonZCBuffOffset,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
     struct DPUStorage* Sto,
     void *SPDKContext
 ) {
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
-    int position = SlotContext->Position;
-    SPDKContextT *arg = SPDKContext;
     if (Bytes > DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE) {
         SPDK_WARNLOG("A read with %u bytes exceeds buff block space: %llu\n", Bytes, DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE);
     }
 
-    rc = BdevRead(SPDKContext, (&arg->buff[position * DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE]), 
-    seg->DiskAddress + SegmentOffset, Bytes, Callback, SlotContext);
+    rc = BdevRead(SPDKContext, SlotContext->Buff + NonZCBuffOffset, 
+    DiskAddress, Bytes, Callback, SlotContext);
 
     if (rc)
     {
-        printf("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
+        DPULogWarning("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
         return DDS_ERROR_CODE_INVALID_FILE_POSITION;  // there should be an SPDK error log before this
     }
 
@@ -122,22 +382,20 @@ ErrorCodeT ReadvFromDiskAsyncNonZC(
 
 ErrorCodeT ReadFromDiskAsyncZC(
     BufferT DstBuffer,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     ContextT Context,
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
-    rc = BdevRead(SPDKContext, DstBuffer, seg->DiskAddress + SegmentOffset, Bytes, 
+    rc = BdevRead(SPDKContext, DstBuffer, DiskAddress, Bytes, 
         Callback, Context);
 
     if (rc)
     {
-        printf("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
+        DPULogWarning("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
         return DDS_ERROR_CODE_INVALID_FILE_POSITION;  // there should be an SPDK error log before this
     }
 
@@ -150,27 +408,23 @@ ErrorCodeT ReadFromDiskAsyncZC(
 //
 ErrorCodeT ReadFromDiskAsyncNonZC(
     FileIOSizeT NonZCBuffOffset,  // how many we already read
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
-    int position = SlotContext->Position;
-    SPDKContextT *arg = SPDKContext;
     if (Bytes > DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE) {
         SPDK_WARNLOG("A read with %u bytes exceeds buff block space: %llu\n", Bytes, DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE);
     }
-    rc = BdevRead(SPDKContext, (&arg->buff[position * DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE]) + NonZCBuffOffset, 
-    seg->DiskAddress + SegmentOffset, Bytes, Callback, SlotContext);
+    rc = BdevRead(SPDKContext, SlotContext->Buff + NonZCBuffOffset, 
+    DiskAddress, Bytes, Callback, SlotContext);
 
     if (rc)
     {
-        printf("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
+        DPULogWarning("ReadFromDiskAsync called BdevRead(), but failed with: %d\n", rc);
         return DDS_ERROR_CODE_INVALID_FILE_POSITION;  // there should be an SPDK error log before this
     }
 
@@ -181,23 +435,21 @@ ErrorCodeT ReadFromDiskAsyncNonZC(
 ErrorCodeT WritevToDiskAsyncZC(
     struct iovec *Iov,
     int IovCnt,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,  // this should be the callback arg
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
     
-    rc = BdevWriteV(SPDKContext, Iov, IovCnt, seg->DiskAddress + SegmentOffset, Bytes, 
+    rc = BdevWriteV(SPDKContext, Iov, IovCnt, DiskAddress, Bytes, 
         Callback, SlotContext);
 
     if (rc)
     {
-        printf("WritevToDiskAsyncZC called BdevWrite(), but failed with: %d\n", rc);
+        DPULogWarning("WritevToDiskAsyncZC called BdevWrite(), but failed with: %d\n", rc);
         return rc;  // there should be an SPDK error log before this?
     }
 
@@ -208,31 +460,27 @@ ErrorCodeT WritevToDiskAsyncNonZC(
     struct iovec *Iov,
     int IovCnt,
     FileIOSizeT NonZCBuffOffset,  // how many we already read
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     struct PerSlotContext *SlotContext,  // this should be the callback arg
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
 
-    int position = SlotContext->Position;
-    SPDKContextT *arg = SPDKContext;
     if (Bytes > DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE) {
         SPDK_WARNLOG("A write with %u bytes exceeds buff block space: %llu\n", Bytes, DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE);
     }
-    char *toCopy = (&arg->buff[position * DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE]) + NonZCBuffOffset;
+    char *toCopy = SlotContext->Buff + NonZCBuffOffset;
     memcpy(toCopy, Iov[0].iov_base, Iov[0].iov_len);
     memcpy(toCopy + Iov[0].iov_len, Iov[1].iov_base, Iov[1].iov_len);
     rc = BdevWrite(SPDKContext, toCopy,
-        seg->DiskAddress + SegmentOffset, Bytes, Callback, SlotContext);
+        DiskAddress, Bytes, Callback, SlotContext);
 
     if (rc)
     {
-        printf("WritevToDiskAsyncNonZC called BdevWrite(), but failed with: %d\n", rc);
+        DPULogWarning("WritevToDiskAsyncNonZC called BdevWrite(), but failed with: %d\n", rc);
         return rc;  // there should be an SPDK error log before this?
     }
 
@@ -245,23 +493,21 @@ ErrorCodeT WritevToDiskAsyncNonZC(
 //
 ErrorCodeT WriteToDiskAsyncZC(
     BufferT SrcBuffer,
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     ContextT Context,  // this should be the callback arg
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
 
-    rc = BdevWrite(SPDKContext, SrcBuffer, seg->DiskAddress + SegmentOffset, Bytes, 
+    rc = BdevWrite(SPDKContext, SrcBuffer, DiskAddress, Bytes, 
         Callback, Context);
 
     if (rc)
     {
-        printf("WriteToDiskAsyncZC called BdevWrite(), but failed with: %d\n", rc);
+        DPULogWarning("WriteToDiskAsyncZC called BdevWrite(), but failed with: %d\n", rc);
         return rc;  // there should be an SPDK error log before this?
     }
 
@@ -271,8 +517,7 @@ ErrorCodeT WriteToDiskAsyncZC(
 ErrorCodeT WriteToDiskAsyncNonZC(
     BufferT SrcBuffer,
     FileIOSizeT NonZCBuffOffset,  // how many we've already written (i.e. the progress)
-    SegmentIdT SegmentId,
-    SegmentSizeT SegmentOffset,
+    DiskSizeT DiskAddress,
     FileIOSizeT Bytes,
     DiskIOCallback Callback,
     // ContextT Context,  // this should be the callback arg
@@ -280,24 +525,21 @@ ErrorCodeT WriteToDiskAsyncNonZC(
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    SegmentT* seg = &Sto->AllSegments[SegmentId];
     int rc;
     
-    int position = SlotContext->Position;
-    SPDKContextT *arg = SPDKContext;
     if (Bytes > DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE) {
         SPDK_WARNLOG("A write with %u bytes exceeds buff block space: %llu\n", Bytes, DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE);
     }
 
     // copy into our own buffer, then write
-    char *toCopy = (&arg->buff[position * DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE]) + NonZCBuffOffset;
+    char *toCopy = SlotContext->Buff + NonZCBuffOffset;
     memcpy(toCopy, SrcBuffer, Bytes);
     rc = BdevWrite(SPDKContext, toCopy, 
-        seg->DiskAddress + SegmentOffset, Bytes, Callback, SlotContext);
+        DiskAddress, Bytes, Callback, SlotContext);
 
     if (rc)
     {
-        printf("WriteToDiskAsyncNonZC called BdevWrite(), but failed with: %d\n", rc);
+        DPULogWarning("WriteToDiskAsyncNonZC called BdevWrite(), but failed with: %d\n", rc);
         return rc;  // there should be an SPDK error log before this?
     }
 
@@ -305,1408 +547,3602 @@ ErrorCodeT WriteToDiskAsyncNonZC(
 }
 
 //
-// Retrieve all segments on the disk, replace all new... by malloc() inside
-// This initializes Sto->AllSegments
+// Zero a range on the disk asynchronously
 //
 //
-ErrorCodeT RetrieveSegments(
-    struct DPUStorage* Sto
+ErrorCodeT ZeroDiskAsync(
+    DiskSizeT DiskAddress,
+    DiskSizeT Bytes,
+    DiskIOCallback Callback,
+    ContextT Context,
+    struct DPUStorage* Sto,
+    void *SPDKContext
 ){
-    //
-    // We should get data from the disk,
-    // but just create all segments using memory for now
-    //
-    //
-    Sto->AllSegments = malloc(sizeof(SegmentT) * Sto->TotalSegments);
+    int rc;
 
-    for (SegmentIdT i = 0; i != Sto->TotalSegments; i++) {
-        Sto->AllSegments[i].Id = i;
-        Sto->AllSegments[i].FileId = DDS_FILE_INVALID;
-        
-        //
-        // We dont allocate memory to newSegment. Instead, we calculate 
-        // the start position of each segment by i*DDS_BACKEND_SEGMENT_SIZE
-        // and use this position as disk address
-        //
-        //
-        DiskSizeT newSegment = i * DDS_BACKEND_SEGMENT_SIZE;
+    rc = BdevWriteZeroes(SPDKContext, DiskAddress, Bytes, Callback, Context);
 
-        Sto->AllSegments[i].DiskAddress = newSegment;
-        
-        if (i == DDS_BACKEND_RESERVED_SEGMENT) {
-            Sto->AllSegments[i].Allocatable = false;
-        }
-        else {
-            Sto->AllSegments[i].Allocatable = true;
-            Sto->AvailableSegments++;
-        }
+    if (rc)
+    {
+        DPULogWarning("ZeroDiskAsync called BdevWriteZeroes(), but failed with: %d\n", rc);
+        return rc;
     }
 
     return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
-// Return all segments back to the disk
+// Mark a segment free in the bitmap: its bit first, then the summary bit of its word
 //
 //
-void ReturnSegments(
+static inline void
+ReleaseFreeSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+){
+    size_t word = (size_t)SegmentId / 64;
+    atomic_fetch_or(&Sto->FreeSegmentBits[word], 1ULL << (SegmentId % 64));
+    atomic_fetch_or(&Sto->FreeSegmentSummary[word / 64], 1ULL << (word % 64));
+}
+
+//
+// Take a free segment off the bitmap, without locks: the summary finds a word with a free segment
+// and a CAS claims its lowest bit; a word found empty has its summary bit cleared,
+// and set again if a segment was released into it meanwhile.
+// The caller must have reserved the segment in AvailableSegments, so there is always one to find
+//
+//
+static SegmentIdT
+ClaimFreeSegment(
     struct DPUStorage* Sto
 ){
-    //
-    // Release the memory buffers
-    //
-    //
-    if (Sto->AllSegments) {
-        for (size_t i = 0; i != Sto->TotalSegments; i++) {
+    for (;;) {
+        for (size_t sw = 0; sw != DDS_BACKEND_SEGMENT_SUMMARY_WORDS; sw++) {
+            uint64_t summary = atomic_load(&Sto->FreeSegmentSummary[sw]);
+            while (summary) {
+                size_t word = sw * 64 + (size_t)__builtin_ctzll(summary);
+                uint64_t bits = atomic_load(&Sto->FreeSegmentBits[word]);
+                while (bits) {
+                    uint64_t lowest = bits & (~bits + 1);
+                    if (atomic_compare_exchange_weak(&Sto->FreeSegmentBits[word], &bits, bits & ~lowest)) {
+                        return (SegmentIdT)(word * 64 + (size_t)__builtin_ctzll(lowest));
+                    }
+                }
 
-            if (Sto->AllSegments[i].Allocatable) {
-                Sto->AvailableSegments--;
+                atomic_fetch_and(&Sto->FreeSegmentSummary[sw], ~(1ULL << (word % 64)));
+                if (atomic_load(&Sto->FreeSegmentBits[word])) {
+                    atomic_fetch_or(&Sto->FreeSegmentSummary[sw], 1ULL << (word % 64));
+                }
+                summary &= summary - 1;
             }
         }
-
-        free(Sto->AllSegments);
     }
 }
 
-void LoadFilesCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    struct LoadDirectoriesAndFilesCtx *Ctx = Context;
-
-
-    if (Ctx->FileOnDisk->Id != DDS_DIR_INVALID) {
-        SPDK_NOTICELOG("Initializing file with ID %hu\n", Ctx->FileOnDisk->Id);
-        Sto->AllFiles[Ctx->FileLoopIndex] =
-            BackEndFileI(Ctx->FileOnDisk->Id, Ctx->FileOnDisk->FProperties.FileName, Ctx->FileOnDisk->FProperties.FileAttributes);
-        printf("********** Sto->AllFiles[%d] = %p\n", Ctx->FileOnDisk->Id, Sto->AllFiles[Ctx->FileLoopIndex]);
-        if (Sto->AllFiles[Ctx->FileLoopIndex]) {
-            memcpy(GetFileProperties(Sto->AllFiles[Ctx->FileLoopIndex]), Ctx->FileOnDisk, sizeof(DPUFilePropertiesT));
-            SetNumAllocatedSegments(Sto->AllFiles[Ctx->FileLoopIndex]);
-        }
-        else {
-            Ctx->FailureStatus->HasFailed = true;
-            Ctx->FailureStatus->HasAborted = true;
-            // call FS app stop func
-        }
-
-        *(Ctx->LoadedFiles)++;
-        if (*(Ctx->LoadedFiles) == Sto->TotalFiles) {
-            SPDK_NOTICELOG("Loaded all files, total: %d\n", Sto->TotalFiles);
-        }
+//
+// Take a given segment off the bitmap for a file, used when loading files and replaying the journal;
+// with snapshots, a segment another file maps already is shared with this one
+//
+//
+void
+ClaimSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId,
+    FileIdT FileId
+){
+    uint64_t bit = 1ULL << (SegmentId % 64);
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (SegmentIsCold(SegmentId)) {
+        TierClaimSegment(Sto, SegmentId);
     }
-    free(Ctx->FileOnDisk);
-    free(Ctx);
-
-    if (Ctx->FileLoopIndex == DDS_MAX_FILES - 1) {
-        return;
+    else if (atomic_fetch_and(&Sto->FreeSegmentBits[SegmentId / 64], ~bit) & bit) {
+        atomic_fetch_sub(&Sto->AvailableSegments, 1);
+    }
+#else
+    if (atomic_fetch_and(&Sto->FreeSegmentBits[SegmentId / 64], ~bit) & bit) {
+        atomic_fetch_sub(&Sto->AvailableSegments, 1);
     }
+#endif
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    SegmentT* segment = &Sto->AllSegments[SegmentId];
+    pthread_mutex_lock(&Sto->SharedSegmentsMutex);
+    if (segment->FileId == DDS_FILE_INVALID && !atomic_load(&segment->Sharers)) {
+        segment->FileId = FileId;
+    }
+    else if (segment->FileId != FileId) {
+        atomic_fetch_add(&segment->Sharers, 1);
+    }
+    pthread_mutex_unlock(&Sto->SharedSegmentsMutex);
+#else
+    Sto->AllSegments[SegmentId].FileId = FileId;
+#endif
 }
 
-void LoadDirectoriesCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    struct LoadDirectoriesAndFilesCtx *Ctx = Context;
-    SPDKContextT *SPDKContext = Ctx->SPDKContext;
-
-    if (Ctx->DirOnDisk->Id != DDS_DIR_INVALID) {
-        SPDK_NOTICELOG("Initializing Dir with ID: %hu\n", Ctx->DirOnDisk->Id);
-        Sto->AllDirs[Ctx->DirLoopIndex] = BackEndDirI(Ctx->DirOnDisk->Id, DDS_DIR_ROOT, Ctx->DirOnDisk->Name);
-        if (Sto->AllDirs[Ctx->DirLoopIndex]) {
-            memcpy(GetDirProperties(Sto->AllDirs[Ctx->DirLoopIndex]), Ctx->DirOnDisk, sizeof(DPUDirPropertiesT));
-        }
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+//
+// Drop the mapping of a segment by a file, and return whether no file maps it anymore;
+// a segment that isn't shared is unmapped only by its owner, as one replay found claimed by another file stays claimed
+//
+//
+static bool
+UnmapSegmentOfFile(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId,
+    FileIdT FileId
+){
+    SegmentT* segment = &Sto->AllSegments[SegmentId];
+    bool unmapped;
 
-        *(Ctx->LoadedDirs) += 1;
-        if (*(Ctx->LoadedDirs) == Sto->TotalDirs) {
-            SPDK_NOTICELOG("Loaded all directories, total: %d\n", Sto->TotalDirs);
+    if (!atomic_load(&segment->Sharers)) {
+        if (segment->FileId != FileId) {
+            return false;
         }
+        segment->FileId = DDS_FILE_INVALID;
+        return true;
     }
-    free(Ctx->DirOnDisk);
-    free(Ctx);
 
-    //
-    // This is the last callback
-    //
-    //
-    if (Ctx->DirLoopIndex == DDS_MAX_DIRS - 1) {
-        //
-        // Load the files
-        //
-        //
-        int result;
-        DPUFilePropertiesT *fileOnDisk = malloc(sizeof(*fileOnDisk));
-        SegmentSizeT nextAddress = DDS_BACKEND_SEGMENT_SIZE - sizeof(DPUFilePropertiesT);
-        Ctx->FileOnDisk = fileOnDisk;
-        Ctx->LoadedFiles = 0;
-        for (size_t f = 0; f != DDS_MAX_FILES; f++) {
-            struct LoadDirectoriesAndFilesCtx *CallbackCtx = malloc(sizeof(*CallbackCtx));
-            memcpy(CallbackCtx, Ctx, sizeof(*Ctx));
-            CallbackCtx->FileLoopIndex = f;
-            CallbackCtx->FileOnDisk = malloc(sizeof(*CallbackCtx->FileOnDisk));
-
-            result = ReadFromDiskAsyncZC(
-                (BufferT) fileOnDisk,
-                DDS_BACKEND_RESERVED_SEGMENT,
-                nextAddress,
-                sizeof(DPUFilePropertiesT),
-                LoadFilesCallback,
-                CallbackCtx,
-                Sto,
-                SPDKContext
-            );
+    pthread_mutex_lock(&Sto->SharedSegmentsMutex);
+    if (segment->FileId == FileId) {
+        segment->FileId = DDS_FILE_INVALID;
+        unmapped = false;
+    }
+    else {
+        unmapped = atomic_fetch_sub(&segment->Sharers, 1) == 1 && segment->FileId == DDS_FILE_INVALID;
+    }
+    pthread_mutex_unlock(&Sto->SharedSegmentsMutex);
 
-            if (result != DDS_ERROR_CODE_SUCCESS) {
-                Ctx->FailureStatus->HasFailed = true;
-                Ctx->FailureStatus->HasAborted = true;
-                SPDK_ERRLOG("Read failed with %d, exiting...\n", result);
-                exit(-1);
-            }
+    return unmapped;
+}
 
-            nextAddress -= sizeof(DPUFilePropertiesT);
-        }
+//
+// Take over a shared segment that only this file maps anymore, its owner and the other sharers having dropped it;
+// return whether the segment is the file's own now, so that writing it needs no copy
+//
+//
+bool
+AdoptSharedSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId,
+    FileIdT FileId
+){
+    SegmentT* segment = &Sto->AllSegments[SegmentId];
+    bool adopted = false;
+
+    pthread_mutex_lock(&Sto->SharedSegmentsMutex);
+    if (segment->FileId == DDS_FILE_INVALID && atomic_load(&segment->Sharers) == 1) {
+        segment->FileId = FileId;
+        atomic_store(&segment->Sharers, 0);
+        adopted = true;
     }
+    pthread_mutex_unlock(&Sto->SharedSegmentsMutex);
+
+    return adopted;
 }
+#endif
 
 //
-// Load the directories, in other future callbacks will then load the files
+// Reserve a number of segments in AvailableSegments, so that claiming them always finds them
 //
 //
-void LoadDirectoriesAndFilesCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    struct LoadDirectoriesAndFilesCtx *Ctx = Context;
-    SPDKContextT *SPDKContext = Ctx->SPDKContext;
-
-    Sto->TotalDirs = *((int*)(Ctx->TmpSectorBuffer + DDS_BACKEND_INITIALIZATION_MARK_LENGTH));
-    Sto->TotalFiles = *((int*)(Ctx->TmpSectorBuffer + DDS_BACKEND_INITIALIZATION_MARK_LENGTH + sizeof(int)));
-    SPDK_NOTICELOG("Got Sto->TotalDirs: %d, Sto->TotalFiles: %d\n", Sto->TotalDirs, Sto->TotalFiles);
-
-    //
-    // Load the directories
-    //
-    //
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    SegmentSizeT nextAddress = DDS_BACKEND_SECTOR_SIZE;
-
-    Ctx->LoadedDirs = malloc(sizeof(Ctx->LoadedDirs));
-    *(Ctx->LoadedDirs) = 0;
-    for (size_t d = 0; d != DDS_MAX_DIRS; d++) {
-        struct LoadDirectoriesAndFilesCtx *CallbackCtx = malloc(sizeof(*CallbackCtx));
-        memcpy(CallbackCtx, Ctx, sizeof(*Ctx));
-        CallbackCtx->DirLoopIndex = d;
-        CallbackCtx->DirOnDisk = malloc(sizeof(*CallbackCtx->DirOnDisk));
-        result = ReadFromDiskAsyncZC(
-            (BufferT) CallbackCtx->DirOnDisk,
-            DDS_BACKEND_RESERVED_SEGMENT,
-            nextAddress,
-            sizeof(DPUDirPropertiesT),
-            LoadDirectoriesCallback,
-            CallbackCtx,
-            Sto,
-            SPDKContext
-        );
-
-        if (result != DDS_ERROR_CODE_SUCCESS) {
-            Ctx->FailureStatus->HasFailed = true;
-            Ctx->FailureStatus->HasAborted = true;
-            SPDK_ERRLOG("Read failed with %d, exiting...\n", result);
-            exit(-1);
+static bool
+ReserveSegments(
+    struct DPUStorage* Sto,
+    SegmentIdT NumSegments
+){
+    int available = atomic_load(&Sto->AvailableSegments);
+    do {
+        if (available < NumSegments) {
+            return false;
         }
-       
-        nextAddress += sizeof(DPUDirPropertiesT);
-    }
+    } while (!atomic_compare_exchange_weak(&Sto->AvailableSegments, &available, available - NumSegments));
+
+    return true;
 }
 
 //
-// Load all directories and files from the reserved segment
+// Take a run of segments starting at First off the bitmap, or none of them
 //
 //
-ErrorCodeT LoadDirectoriesAndFiles(
+static bool
+ClaimSegmentRun(
     struct DPUStorage* Sto,
-    void *Arg,
-    struct InitializeCtx *InitializeCtx
+    SegmentIdT First,
+    SegmentIdT NumSegments
 ){
-    if (!Sto->AllSegments || Sto->TotalSegments == 0) {
-        return DDS_ERROR_CODE_RESERVED_SEGMENT_ERROR;
+    if (First < 0 || First + NumSegments > Sto->TotalSegments) {
+        return false;
     }
 
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    //
-    // Read the first sector
-    //
-    //
-    char tmpSectorBuffer[DDS_BACKEND_SECTOR_SIZE];
-    struct LoadDirectoriesAndFilesCtx *Ctx = malloc(sizeof(*Ctx));
-    Ctx->TmpSectorBuffer = tmpSectorBuffer;
-    Ctx->FailureStatus = InitializeCtx->FailureStatus;
-    Ctx->SPDKContext = InitializeCtx->SPDKContext;
-    result = ReadFromDiskAsyncZC(
-        tmpSectorBuffer,
-        DDS_BACKEND_RESERVED_SEGMENT,
-        0,
-        DDS_BACKEND_SECTOR_SIZE,
-        LoadDirectoriesAndFilesCallback,
-        Ctx,
-        Sto,
-        Arg
-    );
-
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        Ctx->FailureStatus->HasFailed = true;
-        Ctx->FailureStatus->HasAborted = true;
-        SPDK_ERRLOG("ReadFromDiskAsync reserved seg failed with %d, EXITING...\n", result);
-        exit(-1);
+    for (SegmentIdT s = 0; s != NumSegments; s++) {
+        uint64_t bit = 1ULL << ((First + s) % 64);
+        if (!(atomic_fetch_and(&Sto->FreeSegmentBits[(First + s) / 64], ~bit) & bit)) {
+            //
+            // Claimed by someone else meanwhile; give back what this run has taken
+            //
+            //
+            while (s--) {
+                ReleaseFreeSegment(Sto, First + s);
+            }
+            return false;
+        }
     }
-    return DDS_ERROR_CODE_SUCCESS;
+
+    return true;
 }
 
 //
-// Synchronize a directory to the disk
+// Claim reserved segments, contiguously where possible so that large IOs on them stay sequential:
+// first the run starting at Hint, which is right after the segments a file already has,
+// then the first free run of the bitmap, and segments wherever they are free otherwise
 //
 //
-ErrorCodeT SyncDirToDisk(
-    struct DPUDir* Dir, 
+static void
+ClaimSegments(
     struct DPUStorage* Sto,
-    void *SPDKContext,
-    DiskIOCallback Callback,
-    ContextT Context
+    SegmentIdT NumSegments,
+    SegmentIdT Hint,
+    SegmentIdT* Segments
 ){
-    return WriteToDiskAsyncZC(
-        (BufferT)GetDirProperties(Dir),
-        DDS_BACKEND_RESERVED_SEGMENT,
-        GetDirAddressOnSegment(Dir),
-        sizeof(DPUDirPropertiesT),
-        Callback,
-        Context,
-        Sto,
-        SPDKContext
-    );
+    SegmentIdT first = DDS_BACKEND_SEGMENT_INVALID;
+    SegmentIdT runLength = 0;
+
+    if (Hint != DDS_BACKEND_SEGMENT_INVALID && ClaimSegmentRun(Sto, Hint, NumSegments)) {
+        first = Hint;
+    }
+
+    for (SegmentIdT segment = 0; first == DDS_BACKEND_SEGMENT_INVALID && segment < Sto->TotalSegments; segment++) {
+        uint64_t bits = atomic_load(&Sto->FreeSegmentBits[segment / 64]);
+        if (segment % 64 == 0 && !bits) {
+            runLength = 0;
+            segment += 63;
+            continue;
+        }
+        if (!(bits & (1ULL << (segment % 64)))) {
+            runLength = 0;
+            continue;
+        }
+        if (++runLength == NumSegments) {
+            if (ClaimSegmentRun(Sto, segment - NumSegments + 1, NumSegments)) {
+                first = segment - NumSegments + 1;
+            }
+            runLength = 0;
+        }
+    }
+
+    for (SegmentIdT s = 0; s != NumSegments; s++) {
+        Segments[s] = first != DDS_BACKEND_SEGMENT_INVALID ? first + s : ClaimFreeSegment(Sto);
+    }
 }
 
+#ifdef OPT_FILE_SERVICE_ZONED
 //
-// Synchronize a file to the disk
+// Claim reserved segments on a zoned bdev, a multiple of the usable segments of a zone: the usable segments
+// of whole free zones, in their order, so that the file writes each zone from its start.
+// Segments go back to the bitmap by whole zones once reset, so the reservation always finds free zones
 //
 //
-ErrorCodeT SyncFileToDisk(
-    struct DPUFile* File,
+static void
+ClaimZones(
     struct DPUStorage* Sto,
-    void *SPDKContext,
-    DiskIOCallback Callback,
-    ContextT Context
+    SegmentIdT NumSegments,
+    SegmentIdT* Segments
 ){
-    return WriteToDiskAsyncZC(
-        (BufferT)GetFileProperties(File),
-        DDS_BACKEND_RESERVED_SEGMENT,
-        GetFileAddressOnSegment(File),
-        sizeof(DPUFilePropertiesT),
-        Callback,
-        Context,
-        Sto,
-        SPDKContext
-    );
+    SegmentIdT claimed = 0;
+
+    while (claimed != NumSegments) {
+        for (SegmentIdT zone = Sto->FirstZonedSegment;
+            claimed != NumSegments && zone + Sto->SegmentsPerZone <= Sto->TotalSegments;
+            zone += Sto->SegmentsPerZone) {
+            if (ClaimSegmentRun(Sto, zone, Sto->UsableSegmentsPerZone)) {
+                for (SegmentIdT s = 0; s != Sto->UsableSegmentsPerZone; s++) {
+                    Segments[claimed++] = zone + s;
+                }
+            }
+        }
+    }
 }
+#endif
 
 //
-// Synchronize the first sector on the reserved segment
+// Allocate segments to the end of a file: the count is reserved and the segments are claimed without locks,
+// and the lock of the file is held only to append them to it
 //
 //
-ErrorCodeT SyncReservedInformationToDisk(
+static ErrorCodeT
+AllocateSegmentsToFile(
+    FileIdT FileId,
+    struct DPUFile* File,
+    SegmentIdT NumSegments,
     struct DPUStorage* Sto,
-    void *SPDKContext,
-    DiskIOCallback Callback,
-    ContextT Context
+    void *SPDKContext
 ){
-    char tmpSectorBuf[DDS_BACKEND_SECTOR_SIZE];
+    SegmentIdT* segments;
 
-    memset(tmpSectorBuf, 0, DDS_BACKEND_SECTOR_SIZE);
-    strcpy(tmpSectorBuf, DDS_BACKEND_INITIALIZATION_MARK);
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        NumSegments = (NumSegments + Sto->UsableSegmentsPerZone - 1) /
+            Sto->UsableSegmentsPerZone * Sto->UsableSegmentsPerZone;
+    }
+#endif
 
-    int* numDirs = (int*)(tmpSectorBuf + DDS_BACKEND_INITIALIZATION_MARK_LENGTH);
-    *numDirs = Sto->TotalDirs;
-    int* numFiles = numDirs + 1;
-    *numFiles = Sto->TotalFiles;
+    if (NumSegments > DDS_BACKEND_MAX_SEGMENTS_PER_FILE) {
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
 
-    SPDK_NOTICELOG("Sto->TotalDirs %d, Sto->TotalFiles: %d\n", Sto->TotalDirs, Sto->TotalFiles);
+    segments = malloc(NumSegments * sizeof(SegmentIdT));
+    if (!segments) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
 
-    return WriteToDiskAsyncZC(
-        tmpSectorBuf,
-        DDS_BACKEND_RESERVED_SEGMENT,
-        0,
-        DDS_BACKEND_SECTOR_SIZE,
-        Callback,
-        Context,
-        Sto,
-        SPDKContext
-    );
-}
+    if (!ReserveSegments(Sto, NumSegments)) {
+        free(segments);
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
 
-void InitializeSyncReservedInfoCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    spdk_bdev_free_io(bdev_io);
-    if (!Success) {
-        SPDK_ERRLOG("Initialize() SyncReservedInformationToDisk IO failed...\n");
-        exit(-1);
+    //
+    // The last segment is read without the lock; it only hints where the new ones should go
+    //
+    //
+    SegmentIdT numExisting = GetNumSegments(File);
+    SegmentIdT hint = numExisting > 0 ? GetSegment(File, numExisting - 1) : DDS_BACKEND_SEGMENT_INVALID;
+    if (hint != DDS_BACKEND_SEGMENT_INVALID) {
+        hint++;
     }
 
-    SPDK_NOTICELOG("Initialize() done!\n");
-    G_INITIALIZATION_DONE = true;
-}
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        ClaimZones(Sto, NumSegments, segments);
+    }
+    else {
+        ClaimSegments(Sto, NumSegments, hint, segments);
+    }
+#else
+    ClaimSegments(Sto, NumSegments, hint, segments);
+#endif
+    for (SegmentIdT s = 0; s != NumSegments; s++) {
+        Sto->AllSegments[segments[s]].FileId = FileId;
+    }
 
-void InitializeSyncDirToDiskCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    spdk_bdev_free_io(bdev_io);
-    struct InitializeCtx *Ctx = Context;
-    if (!Success) {
-        SPDK_NOTICELOG("Initialize() SyncDirToDisk IO failed...\n");
-        exit(-1);
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    //
+    // The tables are reset before reads can reach the segments
+    //
+    //
+    if (FileIsChecksummed(File)) {
+        for (SegmentIdT s = 0; s != NumSegments; s++) {
+            ChecksumsReset(Sto, segments[s], SPDKContext);
+        }
     }
+#endif
 
-    Sto->AllDirs[DDS_DIR_ROOT] = Ctx->RootDir;
+    LockFile(File);
 
     //
-    // Set the formatted mark and the numbers of dirs and files
+    // Segments that would take the file past its slots or its extents are all given back
     //
     //
-    ErrorCodeT result;
-    Sto->TotalDirs = 1;
-    Sto->TotalFiles = 0;
-    result = SyncReservedInformationToDisk(Sto, Ctx->SPDKContext, InitializeSyncReservedInfoCallback, Ctx);
+    bool fits = GetNumSegments(File) + NumSegments <= DDS_BACKEND_MAX_SEGMENTS_PER_FILE;
+    SegmentIdT allocated = 0;
+    while (fits && allocated != NumSegments) {
+        fits = AllocateSegment(segments[allocated], File);
+        if (fits) {
+            allocated++;
+        }
+    }
+    if (!fits) {
+        while (allocated--) {
+            DeallocateSegment(File);
+        }
+    }
 
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        SPDK_ERRLOG("Initialize() SyncReservedInformationToDisk failed!!!\n");
-        exit(-1);
+    UnlockFile(File);
+
+    if (!fits) {
+        for (SegmentIdT s = 0; s != NumSegments; s++) {
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+            if (FileIsChecksummed(File)) {
+                ChecksumsDrop(Sto, segments[s]);
+            }
+#endif
+            Sto->AllSegments[segments[s]].FileId = DDS_FILE_INVALID;
+            ReleaseFreeSegment(Sto, segments[s]);
+        }
+        atomic_fetch_add(&Sto->AvailableSegments, NumSegments);
+        free(segments);
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
     }
 
+    free(segments);
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
-void RemainingPagesProgressCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    spdk_bdev_free_io(bdev_io);
-    struct InitializeCtx *Ctx = Context;
-    if (Ctx->FailureStatus->HasAborted) {
-        SPDK_ERRLOG("HasAborted, exiting\n");
-        exit(-1);
-        return;
+//
+// Allocate the holes among the slots [FirstSlot, LastSlot] of a sparse file, as a write to them does;
+// *FirstNewSlot is the first slot that got a segment, or LastSlot + 1 if none did
+//
+//
+static ErrorCodeT
+AllocateSegmentsInRange(
+    FileIdT FileId,
+    struct DPUFile* File,
+    SegmentIdT FirstSlot,
+    SegmentIdT LastSlot,
+    struct DPUStorage* Sto,
+    SegmentIdT* FirstNewSlot,
+    void *SPDKContext
+){
+    SegmentIdT* segments;
+    SegmentIdT* slots;
+    SegmentIdT numHoles = 0;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    *FirstNewSlot = LastSlot + 1;
+    if (LastSlot >= DDS_BACKEND_MAX_SEGMENTS_PER_FILE) {
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
     }
-    if (!Success) {
-        Ctx->FailureStatus->HasFailed = true;
-        SPDK_ERRLOG("HasFailed!\n");
+
+    //
+    // Concurrent writes to the same holes must not both fill them, so the lock of the file is held throughout;
+    // claiming from the bitmap takes no other lock
+    //
+    //
+    LockFile(File);
+
+    for (SegmentIdT slot = FirstSlot; slot <= LastSlot; slot++) {
+        if (SegmentIsHole(File, slot)) {
+            numHoles++;
+        }
     }
 
-    if (Ctx->CurrentProgress == Ctx->TargetProgress) {
-        SPDK_NOTICELOG("Initialize() RemainingPagesProgressCallback last one running\n");
-        if (Ctx->FailureStatus->HasFailed) {
-            //
-            // something went wrong, can't continue to do work
-            //
-            //
-            SPDK_ERRLOG("Initialize() RemainingPagesProgressCallback has failed IO, stopping...\n");
-            exit(-1);
+    if (!numHoles) {
+        UnlockFile(File);
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    segments = malloc(2 * numHoles * sizeof(SegmentIdT));
+    if (!segments) {
+        UnlockFile(File);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    slots = segments + numHoles;
+
+    if (ReserveSegments(Sto, numHoles)) {
+        SegmentIdT hint = FirstSlot > 0 && !SegmentIsHole(File, FirstSlot - 1) ?
+            GetSegment(File, FirstSlot - 1) + 1 : DDS_BACKEND_SEGMENT_INVALID;
+        SegmentIdT numSegments = GetNumSegments(File);
+        SegmentIdT next = 0;
+
+        ClaimSegments(Sto, numHoles, hint, segments);
+        for (SegmentIdT slot = FirstSlot; slot <= LastSlot; slot++) {
+            if (!SegmentIsHole(File, slot)) {
+                continue;
+            }
+            if (!MapSegment(slot, segments[next], File)) {
+                result = DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+                break;
+            }
+            if (*FirstNewSlot > slot) {
+                *FirstNewSlot = slot;
+            }
+            Sto->AllSegments[segments[next]].FileId = FileId;
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+            if (FileIsChecksummed(File)) {
+                ChecksumsReset(Sto, segments[next], SPDKContext);
+            }
+#endif
+            slots[next++] = slot;
         }
-        else {
+
+        if (result != DDS_ERROR_CODE_SUCCESS) {
             //
-            // Create the root directory, which is on the second sector on the segment
+            // The file has run out of extents: the holes filled so far become holes again, the last first,
+            // so that the file goes back through the states it went through, and every claimed segment is given back
             //
             //
-            ErrorCodeT result;
-            struct DPUDir* rootDir = BackEndDirI(DDS_DIR_ROOT, DDS_DIR_INVALID, DDS_BACKEND_ROOT_DIR_NAME);
-            Ctx->RootDir = rootDir;
-            result = SyncDirToDisk(rootDir, Sto, Ctx->SPDKContext, InitializeSyncDirToDiskCallback, Ctx);
-
-            if (result != DDS_ERROR_CODE_SUCCESS) {
-                Ctx->FailureStatus->HasFailed = true;
-                Ctx->FailureStatus->HasAborted = true;
-                SPDK_ERRLOG("Initialize() SyncDirToDisk early fail!\n");
-                exit(-1);
+            SegmentIdT numMapped = next;
+            while (GetNumSegments(File) > numSegments) {
+                DeallocateSegment(File);
+            }
+            while (next--) {
+                if (slots[next] < numSegments) {
+                    MapSegment(slots[next], DDS_BACKEND_SEGMENT_INVALID, File);
+                }
+            }
+            for (SegmentIdT s = 0; s != numHoles; s++) {
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+                if (s < numMapped && FileIsChecksummed(File)) {
+                    ChecksumsDrop(Sto, segments[s]);
+                }
+#endif
+                Sto->AllSegments[segments[s]].FileId = DDS_FILE_INVALID;
+                ReleaseFreeSegment(Sto, segments[s]);
             }
+            atomic_fetch_add(&Sto->AvailableSegments, numHoles);
+            *FirstNewSlot = LastSlot + 1;
         }
     }
+    else {
+        result = DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+    UnlockFile(File);
+    free(segments);
+
+    return result;
 }
 
+#ifdef OPT_FILE_SERVICE_TRIM
+typedef struct TrimCtx {
+    struct DPUStorage* Sto;
+    SegmentIdT FirstSegment;
+    SegmentIdT NumSegments;
+    void *SPDKContext;
+} TrimCtxT;
+
 //
-// Increment progress callback
+// Give trimmed segments back to the bitmap
 //
 //
-void
-IncrementProgressCallback(
+static void
+FinishTrim(
+    struct DPUStorage* Sto,
+    SegmentIdT FirstSegment,
+    SegmentIdT NumSegments
+){
+    for (SegmentIdT s = 0; s != NumSegments; s++) {
+        ReleaseFreeSegment(Sto, FirstSegment + s);
+    }
+    atomic_fetch_add(&Sto->AvailableSegments, NumSegments);
+
+    pthread_mutex_lock(&Sto->FreedSegmentsMutex);
+    Sto->TrimsInFlight--;
+    pthread_mutex_unlock(&Sto->FreedSegmentsMutex);
+}
+
+static void
+TrimCallback(
     struct spdk_bdev_io *bdev_io,
     bool Success,
-    ContextT Context)
-{
+    ContextT Context
+){
+    TrimCtxT* ctx = Context;
     spdk_bdev_free_io(bdev_io);
-    struct InitializeCtx *Ctx = Context;
-    
-    if (!Success) {
-        SPDK_ERRLOG("HasFailed!\n");
-        Ctx->FailureStatus->HasFailed = true;
-        exit(-1);
-    }
-    ErrorCodeT result;
-    if (Ctx->PagesLeft == 0) {
-        //
-        // All done, continue initialization
-        // Create the root directory, which is on the second sector on the segment
-        //
-        //
-        SPDK_NOTICELOG("Last of writing zeroed page to reserved seg!\n");
-        struct DPUDir* rootDir = BackEndDirI(DDS_DIR_ROOT, DDS_DIR_INVALID, DDS_BACKEND_ROOT_DIR_NAME);
-        Ctx->RootDir = rootDir;
-        result = SyncDirToDisk(rootDir, Sto, Ctx->SPDKContext, InitializeSyncDirToDiskCallback, Ctx);
 
-        if (result != DDS_ERROR_CODE_SUCCESS) {
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // A zone that failed to reset can't be written from its start again, so its segments are never reused
+    //
+    //
+    if (!Success && ctx->Sto->Zoned) {
+        SPDK_ERRLOG("Failed to reset the zone of segments %d to %d, it is left out of the store\n",
+            ctx->FirstSegment, ctx->FirstSegment + ctx->NumSegments - 1);
+        ctx->NumSegments = 0;
+    }
+#endif
+
+    //
+    // Unmapping is advisory; a failed one still frees the segments
+    //
+    //
+    if (!Success && ctx->NumSegments) {
+        SPDK_WARNLOG("Failed to unmap %d segments from %d\n", ctx->NumSegments, ctx->FirstSegment);
+    }
+
+    FinishTrim(ctx->Sto, ctx->FirstSegment, ctx->NumSegments);
+    TrimFreedSegments(ctx->Sto, ctx->SPDKContext);
+    free(ctx);
+}
+
+//
+// Queue freed segments to be unmapped, together so that the zones they free stay whole in the queue
+//
+//
+static void
+QueueFreedSegments(
+    struct DPUStorage* Sto,
+    SegmentIdT* Segments,
+    SegmentIdT NumSegments
+){
+    pthread_mutex_lock(&Sto->FreedSegmentsMutex);
+    for (SegmentIdT s = 0; s != NumSegments; s++) {
+        Sto->FreedSegments[Sto->FreedTail % DDS_BACKEND_MAX_SEGMENTS].Id = Segments[s];
+        Sto->FreedTail++;
+    }
+    pthread_mutex_unlock(&Sto->FreedSegmentsMutex);
+}
+
+//
+// Seal the freed segments with the last sequence appended to the journal,
+// which the records that freed them are at or before, then unmap those already safe to
+//
+//
+void
+SealFreedSegments(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    uint64_t sequence = Sto->Journal->NextSequence - 1;
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+
+    pthread_mutex_lock(&Sto->FreedSegmentsMutex);
+    for (; Sto->FreedSealed != Sto->FreedTail; Sto->FreedSealed++) {
+        Sto->FreedSegments[Sto->FreedSealed % DDS_BACKEND_MAX_SEGMENTS].Sequence = sequence;
+    }
+    pthread_mutex_unlock(&Sto->FreedSegmentsMutex);
+
+    TrimFreedSegments(Sto, SPDKContext);
+}
+
+//
+// Unmap the sealed segments whose records are on the disk, batching adjacent ones,
+// with at most DDS_BACKEND_TRIM_MAX_INFLIGHT unmaps in flight; each completion issues the next.
+// A segment is never unmapped before the record freeing it is durable, so replay can't find a file
+// whose data has been dropped, and never reused before its unmap completes
+//
+//
+void
+TrimFreedSegments(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    uint64_t flushed = Sto->Journal->FlushedSequence;
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+
+    pthread_mutex_lock(&Sto->FreedSegmentsMutex);
+    while (Sto->TrimsInFlight < DDS_BACKEND_TRIM_MAX_INFLIGHT && Sto->FreedHead != Sto->FreedSealed &&
+        Sto->FreedSegments[Sto->FreedHead % DDS_BACKEND_MAX_SEGMENTS].Sequence <= flushed) {
+        SegmentIdT first = Sto->FreedSegments[Sto->FreedHead % DDS_BACKEND_MAX_SEGMENTS].Id;
+        SegmentIdT numSegments = 1;
+
+#ifdef OPT_FILE_SERVICE_ZONED
+        if (Sto->Zoned) {
+            //
+            // Files free whole zones, one segment at a time and in any order; a zone is reset once all of them
+            // are here, and the segments go back from its start
+            //
+            //
+            SegmentIdT zone = first - (first - Sto->FirstZonedSegment) % Sto->SegmentsPerZone;
+            numSegments = Sto->UsableSegmentsPerZone;
+            if (Sto->FreedSealed - Sto->FreedHead < (unsigned int)numSegments ||
+                Sto->FreedSegments[(Sto->FreedHead + numSegments - 1) % DDS_BACKEND_MAX_SEGMENTS].Sequence > flushed) {
+                break;
+            }
+
+            //
+            // A segment freed without the rest of its zone, as one replay found claimed by two files,
+            // can't go back alone; it is left out of the store
+            //
+            //
+            bool wholeZone = true;
+            for (SegmentIdT s = 1; s != numSegments; s++) {
+                SegmentIdT segment = Sto->FreedSegments[(Sto->FreedHead + s) % DDS_BACKEND_MAX_SEGMENTS].Id;
+                wholeZone = wholeZone && segment >= zone && segment < zone + numSegments;
+            }
+            if (!wholeZone) {
+                SPDK_ERRLOG("Segment %d was freed without its zone, it is left out of the store\n", first);
+                Sto->FreedHead++;
+                continue;
+            }
+            Sto->FreedHead += numSegments;
+            Sto->TrimsInFlight++;
+            pthread_mutex_unlock(&Sto->FreedSegmentsMutex);
+
+            TrimCtxT* ctx = malloc(sizeof(TrimCtxT));
+            int rc = -ENOMEM;
+            if (ctx) {
+                ctx->Sto = Sto;
+                ctx->FirstSegment = zone;
+                ctx->NumSegments = numSegments;
+                ctx->SPDKContext = SPDKContext;
+                rc = BdevZoneReset(SPDKContext, Sto->AllSegments[zone].DiskAddress, TrimCallback, ctx);
+            }
+            if (rc) {
+                SPDK_ERRLOG("Failed to reset the zone of segment %d with %d, it is left out of the store\n", zone, rc);
+                free(ctx);
+                FinishTrim(Sto, zone, 0);
+            }
+
+            pthread_mutex_lock(&Sto->FreedSegmentsMutex);
+            continue;
+        }
+#endif
+
+        Sto->FreedHead++;
+
+        while (numSegments != DDS_BACKEND_TRIM_MAX_SEGMENTS && Sto->FreedHead != Sto->FreedSealed &&
+            Sto->FreedSegments[Sto->FreedHead % DDS_BACKEND_MAX_SEGMENTS].Sequence <= flushed &&
+            Sto->FreedSegments[Sto->FreedHead % DDS_BACKEND_MAX_SEGMENTS].Id == first + numSegments) {
+            numSegments++;
+            Sto->FreedHead++;
+        }
+        Sto->TrimsInFlight++;
+        pthread_mutex_unlock(&Sto->FreedSegmentsMutex);
+
+        TrimCtxT* ctx = malloc(sizeof(TrimCtxT));
+        int rc = -ENOMEM;
+        if (ctx) {
+            ctx->Sto = Sto;
+            ctx->FirstSegment = first;
+            ctx->NumSegments = numSegments;
+            ctx->SPDKContext = SPDKContext;
+            rc = BdevUnmap(SPDKContext, Sto->AllSegments[first].DiskAddress,
+                (uint64_t)numSegments * DDS_BACKEND_SEGMENT_SIZE, TrimCallback, ctx);
+        }
+        if (rc) {
+            free(ctx);
+            FinishTrim(Sto, first, numSegments);
+        }
+
+        pthread_mutex_lock(&Sto->FreedSegmentsMutex);
+    }
+    pthread_mutex_unlock(&Sto->FreedSegmentsMutex);
+}
+#endif
+
+//
+// Give the last segments of a file back to the bitmap, or queue them to be unmapped first;
+// a segment the file does not own, as one replay found claimed by another file, stays claimed,
+// as does one a snapshot still shares, and the holes of a sparse file have none to give back
+//
+//
+void
+DeallocateSegmentsOfFile(
+    struct DPUFile* File,
+    SegmentIdT NumSegments,
+    struct DPUStorage* Sto
+){
+    SegmentIdT released = 0;
+
+    LockFile(File);
+
+    for (SegmentIdT s = 0; s != NumSegments; s++) {
+        SegmentIdT segment = GetSegment(File, GetNumSegments(File) - 1);
+        DeallocateSegment(File);
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+        if (segment != DDS_BACKEND_SEGMENT_INVALID && UnmapSegmentOfFile(Sto, segment, File->Properties.Id)) {
+#else
+        if (segment != DDS_BACKEND_SEGMENT_INVALID && Sto->AllSegments[segment].FileId == File->Properties.Id) {
+            Sto->AllSegments[segment].FileId = DDS_FILE_INVALID;
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+            //
+            // A segment of the capacity bdev goes back to it at once, as it is never trimmed
+            //
+            //
+            if (SegmentIsCold(segment)) {
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+                BlockCacheInvalidate(Sto->BlockCache, Sto->AllSegments[segment].DiskAddress, DDS_BACKEND_SEGMENT_SIZE);
+#endif
+                TierReleaseSegment(Sto, segment);
+                continue;
+            }
+#endif
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+            if (FileIsChecksummed(File)) {
+                ChecksumsDrop(Sto, segment);
+            }
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+            //
+            // The next file to get the segment must not read what this one left in the cache
+            //
+            //
+            BlockCacheInvalidate(Sto->BlockCache, Sto->AllSegments[segment].DiskAddress, DDS_BACKEND_SEGMENT_SIZE);
+#endif
+#ifdef OPT_FILE_SERVICE_DEDUP
+            DedupForgetSegment(Sto, segment);
+#endif
+#ifdef OPT_FILE_SERVICE_TRIM
+            QueueFreedSegments(Sto, &segment, 1);
+#else
+            ReleaseFreeSegment(Sto, segment);
+            released++;
+#endif
+        }
+    }
+
+    UnlockFile(File);
+
+    atomic_fetch_add(&Sto->AvailableSegments, released);
+}
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+//
+// Claim a free segment for a file, after the one at Hint if it's free
+//
+//
+ErrorCodeT
+ClaimNewSegment(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT Hint,
+    SegmentIdT* Segment
+){
+    if (!ReserveSegments(Sto, 1)) {
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+    ClaimSegments(Sto, 1, Hint, Segment);
+    Sto->AllSegments[*Segment].FileId = FileId;
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Drop a segment a file no longer maps at any slot, and give it back as DeallocateSegmentsOfFile does
+// if no other file maps it either; the caller holds the lock of the file
+//
+//
+void
+ReleaseSegmentOfFile(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT SegmentId
+){
+    if (!UnmapSegmentOfFile(Sto, SegmentId, FileId)) {
+        return;
+    }
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    BlockCacheInvalidate(Sto->BlockCache, Sto->AllSegments[SegmentId].DiskAddress, DDS_BACKEND_SEGMENT_SIZE);
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (SegmentIsCold(SegmentId)) {
+        TierReleaseSegment(Sto, SegmentId);
+        return;
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_DEDUP
+    DedupForgetSegment(Sto, SegmentId);
+#endif
+#ifdef OPT_FILE_SERVICE_TRIM
+    QueueFreedSegments(Sto, &SegmentId, 1);
+#else
+    ReleaseFreeSegment(Sto, SegmentId);
+    atomic_fetch_add(&Sto->AvailableSegments, 1);
+#endif
+}
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEFRAG
+//
+// Claim the segment at SegmentId for a file if it's free, and no other
+//
+//
+bool
+ClaimSegmentAt(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT SegmentId
+){
+    if (!ReserveSegments(Sto, 1)) {
+        return false;
+    }
+
+    if (!ClaimSegmentRun(Sto, SegmentId, 1)) {
+        atomic_fetch_add(&Sto->AvailableSegments, 1);
+        return false;
+    }
+
+    Sto->AllSegments[SegmentId].FileId = FileId;
+    return true;
+}
+
+//
+// Whether a segment is free, read without locks
+//
+//
+bool
+SegmentIsFree(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+){
+    return SegmentId >= 0 && SegmentId < Sto->TotalSegments &&
+        (atomic_load(&Sto->FreeSegmentBits[SegmentId / 64]) & (1ULL << (SegmentId % 64))) != 0;
+}
+#endif
+
+//
+// Whether a segment id is one of the store or, with tiering, of the capacity bdev
+//
+//
+bool
+SegmentIdIsValid(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+){
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (SegmentIsCold(SegmentId)) {
+        return Sto->Tier && SegmentId - (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS < Sto->Tier->NumSegments;
+    }
+#endif
+    return SegmentId >= 0 && SegmentId < Sto->TotalSegments;
+}
+
+//
+// Whether a segment may be allocated to files: not one of the metadata, nor on a zoned bdev
+// one past the capacity of its zone or in a zone the store doesn't cover whole
+//
+//
+static inline bool
+SegmentIsAllocatable(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+){
+    if (SegmentId < DDS_BACKEND_RESERVED_SEGMENT + DDS_BACKEND_RESERVED_SEGMENTS) {
+        return false;
+    }
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        SegmentIdT onZone = (SegmentId - Sto->FirstZonedSegment) % Sto->SegmentsPerZone;
+        return SegmentId >= Sto->FirstZonedSegment && onZone < Sto->UsableSegmentsPerZone &&
+            SegmentId - onZone + Sto->SegmentsPerZone <= Sto->TotalSegments;
+    }
+#endif
+
+    return true;
+}
+
+//
+// Retrieve all segments on the disk, replace all new... by malloc() inside
+// This initializes Sto->AllSegments
+//
+//
+ErrorCodeT RetrieveSegments(
+    struct DPUStorage* Sto
+){
+    //
+    // We should get data from the disk,
+    // but just create all segments using memory for now
+    //
+    //
+    SegmentIdT numSegments = Sto->TotalSegments;
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (Sto->Tier) {
+        numSegments = (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS + Sto->Tier->NumSegments;
+    }
+#endif
+    Sto->AllSegments = malloc(sizeof(SegmentT) * numSegments);
+    if (!Sto->AllSegments) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    for (size_t w = 0; w != DDS_BACKEND_SEGMENT_BITMAP_WORDS; w++) {
+        atomic_init(&Sto->FreeSegmentBits[w], 0);
+    }
+    for (size_t w = 0; w != DDS_BACKEND_SEGMENT_SUMMARY_WORDS; w++) {
+        atomic_init(&Sto->FreeSegmentSummary[w], 0);
+    }
+
+    for (SegmentIdT i = 0; i != Sto->TotalSegments; i++) {
+        Sto->AllSegments[i].Id = i;
+        Sto->AllSegments[i].FileId = DDS_FILE_INVALID;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+        atomic_init(&Sto->AllSegments[i].Sharers, 0);
+#endif
+        
+        //
+        // We dont allocate memory to newSegment. Instead, we calculate 
+        // the start position of each segment by i*DDS_BACKEND_SEGMENT_SIZE
+        // and use this position as disk address
+        //
+        //
+        DiskSizeT newSegment = i * DDS_BACKEND_SEGMENT_SIZE;
+
+        Sto->AllSegments[i].DiskAddress = newSegment;
+        
+        if (!SegmentIsAllocatable(Sto, i)) {
+            Sto->AllSegments[i].Allocatable = false;
+        }
+        else {
+            Sto->AllSegments[i].Allocatable = true;
+            ReleaseFreeSegment(Sto, i);
+            atomic_fetch_add(&Sto->AvailableSegments, 1);
+        }
+    }
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    //
+    // The segments past those of the store up to the capacity bdev are never allocated,
+    // and those of the capacity bdev are claimed from the tier
+    //
+    //
+    for (SegmentIdT i = Sto->TotalSegments; i < numSegments; i++) {
+        Sto->AllSegments[i].Id = i;
+        Sto->AllSegments[i].FileId = DDS_FILE_INVALID;
+        atomic_init(&Sto->AllSegments[i].Sharers, 0);
+        Sto->AllSegments[i].DiskAddress = SegmentDiskAddress(i);
+        Sto->AllSegments[i].Allocatable = false;
+    }
+#endif
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Return all segments back to the disk
+//
+//
+void ReturnSegments(
+    struct DPUStorage* Sto
+){
+    //
+    // Release the memory buffers
+    //
+    //
+    if (Sto->AllSegments) {
+        atomic_store(&Sto->AvailableSegments, 0);
+
+        free(Sto->AllSegments);
+    }
+}
+
+#ifdef OPT_FILE_SERVICE_ZONED
+//
+// The free zones are reset before the store serves requests, as a crash or an earlier store
+// may have written them; a zone held by a file or waiting in the trim queue is not free
+//
+//
+typedef struct ZoneSweepCtx {
+    struct DPUStorage* Sto;
+    SegmentIdT NextZone;
+    int ResetsInFlight;
+    void *SPDKContext;
+} ZoneSweepCtxT;
+
+typedef struct ZoneResetCtx {
+    ZoneSweepCtxT* Sweep;
+    SegmentIdT Zone;
+} ZoneResetCtxT;
+
+static void
+SweepFreeZones(
+    ZoneSweepCtxT* Ctx
+);
+
+static void
+SweepZoneResetCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    ZoneResetCtxT* ctx = Context;
+    ZoneSweepCtxT* sweep = ctx->Sweep;
+    spdk_bdev_free_io(bdev_io);
+
+    if (Success) {
+        for (SegmentIdT s = 0; s != sweep->Sto->UsableSegmentsPerZone; s++) {
+            ReleaseFreeSegment(sweep->Sto, ctx->Zone + s);
+        }
+        atomic_fetch_add(&sweep->Sto->AvailableSegments, sweep->Sto->UsableSegmentsPerZone);
+    }
+    else {
+        SPDK_ERRLOG("Failed to reset the zone of segment %d, it is left out of the store\n", ctx->Zone);
+    }
+
+    free(ctx);
+    sweep->ResetsInFlight--;
+    SweepFreeZones(sweep);
+}
+
+//
+// Take the free zones off the bitmap and reset them, DDS_BACKEND_TRIM_MAX_INFLIGHT at a time;
+// each goes back once reset, and the store is ready once all are
+//
+//
+static void
+SweepFreeZones(
+    ZoneSweepCtxT* Ctx
+){
+    struct DPUStorage* sto = Ctx->Sto;
+
+    while (Ctx->ResetsInFlight < DDS_BACKEND_TRIM_MAX_INFLIGHT &&
+        Ctx->NextZone + sto->SegmentsPerZone <= sto->TotalSegments) {
+        SegmentIdT zone = Ctx->NextZone;
+        Ctx->NextZone += sto->SegmentsPerZone;
+        if (!ClaimSegmentRun(sto, zone, sto->UsableSegmentsPerZone)) {
+            continue;
+        }
+        atomic_fetch_sub(&sto->AvailableSegments, sto->UsableSegmentsPerZone);
+
+        ZoneResetCtxT* ctx = malloc(sizeof(ZoneResetCtxT));
+        int rc = -ENOMEM;
+        if (ctx) {
+            ctx->Sweep = Ctx;
+            ctx->Zone = zone;
+            rc = BdevZoneReset(Ctx->SPDKContext, sto->AllSegments[zone].DiskAddress, SweepZoneResetCallback, ctx);
+        }
+        if (rc) {
+            SPDK_ERRLOG("Failed to reset the zone of segment %d with %d, it is left out of the store\n", zone, rc);
+            free(ctx);
+            continue;
+        }
+        Ctx->ResetsInFlight++;
+    }
+
+    if (!Ctx->ResetsInFlight && Ctx->NextZone + sto->SegmentsPerZone > sto->TotalSegments) {
+        SPDK_NOTICELOG("Reset the free zones, %d segments are available\n", atomic_load(&sto->AvailableSegments));
+        free(Ctx);
+        G_INITIALIZATION_DONE = true;
+    }
+}
+
+static void
+ResetFreeZones(
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    ZoneSweepCtxT* ctx = malloc(sizeof(ZoneSweepCtxT));
+    if (!ctx) {
+        SPDK_ERRLOG("No memory to reset the free zones, exiting...\n");
+        exit(-1);
+    }
+
+    ctx->Sto = Sto;
+    ctx->NextZone = Sto->FirstZonedSegment;
+    ctx->ResetsInFlight = 0;
+    ctx->SPDKContext = SPDKContext;
+    SweepFreeZones(ctx);
+}
+#endif
+
+//
+// Loading is done once the checksums of the loaded files are read
+//
+//
+static void
+LoadingDoneCallback(
+    bool Success,
+    void *Arg
+){
+    SPDK_NOTICELOG("Loaded %d directories and %d files\n", Sto->TotalDirs, Sto->TotalFiles);
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        ResetFreeZones(Sto, Arg);
+        return;
+    }
+#endif
+    G_INITIALIZATION_DONE = true;
+}
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+static void
+LoadingAtomicWritesDoneCallback(
+    bool Success,
+    void *Arg
+){
+    if (!Success) {
+        SPDK_ERRLOG("Failed to roll the staged atomic writes forward, exiting...\n");
+        exit(-1);
+    }
+    LoadingDoneCallback(true, Arg);
+}
+#endif
+
+//
+// The files are loaded once the staged atomic writes are rolled forward over them
+//
+//
+static void
+LoadingFilesDoneCallback(
+    bool Success,
+    void *Arg
+){
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    AtomicWritesRecover(Sto, Arg, LoadingAtomicWritesDoneCallback, Arg);
+#else
+    LoadingDoneCallback(Success, Arg);
+#endif
+}
+
+static void
+LoadingReplayedCallback(
+    bool Success,
+    ContextT Context
+){
+    if (!Success) {
+        SPDK_ERRLOG("Failed to replay the metadata journal, exiting...\n");
+        exit(-1);
+    }
+
+#ifdef OPT_FILE_SERVICE_TRIM
+    //
+    // Segments replay freed are free on the disk already
+    //
+    //
+    SealFreedSegments(Sto, Context);
+#endif
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    ChecksumsLoad(Sto, Context, LoadingFilesDoneCallback, Context);
+#else
+    LoadingFilesDoneCallback(true, Context);
+#endif
+}
+
+//
+// Claim the segments of the loaded files, then replay the journal over them
+//
+//
+static void
+FinishLoading(
+    SPDKContextT *SPDKContext
+){
+    for (FileIdT f = 0; f != DDS_MAX_FILES; f++) {
+        struct DPUFile* file = GetFile(Sto, f);
+        if (file) {
+            for (SegmentIdT s = 0; s != GetNumSegments(file); s++) {
+                SegmentIdT segment = GetSegment(file, s);
+                if (segment == DDS_BACKEND_SEGMENT_INVALID) {
+                    continue;
+                }
+                if (!SegmentIdIsValid(Sto, segment)) {
+                    SPDK_ERRLOG("File %hu maps segment %d, which the store doesn't have; is its capacity bdev missing? "
+                        "Exiting...\n", f, segment);
+                    exit(-1);
+                }
+                ClaimSegment(Sto, segment, f);
+            }
+        }
+    }
+
+    ErrorCodeT result = JournalReplay(Sto, SPDKContext, LoadingReplayedCallback, SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to read the metadata journal with %d, exiting...\n", result);
+        exit(-1);
+    }
+}
+
+//
+// An entry of the tables is valid only if it is at the slot of its id;
+// a file entry that was never written is zeroed, which also puts its first segment in the reserved segments
+//
+//
+static inline bool
+DirEntryIsValid(
+    DPUDirPropertiesT *DirOnDisk,
+    DirIdT DirId
+){
+    return DirOnDisk->Id == DirId;
+}
+
+static inline bool
+FileEntryIsValid(
+    DPUFilePropertiesT *FileOnDisk,
+    FileIdT FileId
+){
+    SegmentIdT firstSegment = FileOnDisk->NumExtents > 0 ? FileOnDisk->Extents[0].First : DDS_BACKEND_SEGMENT_INVALID;
+    return FileOnDisk->Id == FileId && (firstSegment == DDS_BACKEND_SEGMENT_INVALID ||
+        firstSegment >= DDS_BACKEND_RESERVED_SEGMENT + DDS_BACKEND_RESERVED_SEGMENTS);
+}
+
+//
+// Build the directories and files from the tables that have been read
+//
+//
+static void
+BuildDirectoriesAndFiles(
+    struct LoadDirectoriesAndFilesCtx *Ctx
+){
+    int loadedDirs = 0;
+    int loadedFiles = 0;
+
+    for (DirIdT d = 0; d != DDS_MAX_DIRS; d++) {
+        DPUDirPropertiesT *dirOnDisk = &Ctx->DirTable[d];
+        if (!DirEntryIsValid(dirOnDisk, d)) {
+            continue;
+        }
+
+        struct DPUDir* dir = NULL;
+        if (ReserveDir(Sto, d) == DDS_ERROR_CODE_SUCCESS) {
+            dir = BackEndDirI(dirOnDisk->Id, DDS_DIR_ROOT, dirOnDisk->Name);
+        }
+        if (!dir) {
+            SPDK_ERRLOG("Failed to load directory %hu, exiting...\n", d);
+            exit(-1);
+        }
+        memcpy(GetDirProperties(dir), dirOnDisk, sizeof(DPUDirPropertiesT));
+        SetDir(Sto, d, dir);
+        loadedDirs++;
+    }
+
+    //
+    // File f is the f-th record from the end of the table
+    //
+    //
+    for (FileIdT f = 0; f != DDS_MAX_FILES; f++) {
+        DPUFilePropertiesT *fileOnDisk = &Ctx->FileTable[DDS_MAX_FILES - 1 - f];
+        if (!FileEntryIsValid(fileOnDisk, f)) {
+            continue;
+        }
+
+        struct DPUFile* file = NULL;
+        if (ReserveFile(Sto, f) == DDS_ERROR_CODE_SUCCESS) {
+            file = BackEndFileI(fileOnDisk->Id, fileOnDisk->FProperties.FileName, fileOnDisk->FProperties.FileAttributes);
+        }
+        if (!file) {
+            SPDK_ERRLOG("Failed to load file %hu, exiting...\n", f);
+            exit(-1);
+        }
+        memcpy(GetFileProperties(file), fileOnDisk, sizeof(DPUFilePropertiesT));
+        if (!SetNumAllocatedSegments(file)) {
+            SPDK_ERRLOG("Failed to load the extents of file %hu, exiting...\n", f);
+            exit(-1);
+        }
+        SetFile(Sto, f, file);
+        IndexFileName(Sto, GetName(file), f);
+        loadedFiles++;
+    }
+
+    if (loadedDirs != Sto->TotalDirs || loadedFiles != Sto->TotalFiles) {
+        SPDK_WARNLOG("The sector counts %d dirs and %d files, but the tables have %d and %d\n",
+            Sto->TotalDirs, Sto->TotalFiles, loadedDirs, loadedFiles);
+    }
+    Sto->TotalDirs = loadedDirs;
+    Sto->TotalFiles = loadedFiles;
+}
+
+//
+// Count a completed table read; the last one builds the directories and files
+//
+//
+void LoadTablesCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    struct LoadDirectoriesAndFilesCtx *Ctx = Context;
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        atomic_store(&Ctx->HasFailed, true);
+    }
+
+    if (atomic_fetch_sub(&Ctx->PendingReads, 1) != 1) {
+        return;
+    }
+
+    if (atomic_load(&Ctx->HasFailed)) {
+        SPDK_ERRLOG("Failed to read the directory and file tables, exiting...\n");
+        exit(-1);
+    }
+
+    BuildDirectoriesAndFiles(Ctx);
+    spdk_dma_free(Ctx->DirTable);
+    spdk_dma_free(Ctx->FileTable);
+
+    FinishLoading(Ctx->SPDKContext);
+    free(Ctx);
+}
+
+//
+// Load all directories and files from the reserved segment, whose first sector has been read;
+// the tables are read in a few large IOs that are all in flight together
+//
+//
+ErrorCodeT LoadDirectoriesAndFiles(
+    struct DPUStorage* Sto,
+    void *Arg,
+    struct InitializeCtx *InitializeCtx
+){
+    if (!Sto->AllSegments || Sto->TotalSegments == 0) {
+        return DDS_ERROR_CODE_RESERVED_SEGMENT_ERROR;
+    }
+
+    char *sector = InitializeCtx->tmpSectorBuf;
+    Sto->TotalDirs = *((int*)(sector + DDS_BACKEND_INITIALIZATION_MARK_LENGTH));
+    Sto->TotalFiles = *((int*)(sector + DDS_BACKEND_INITIALIZATION_MARK_LENGTH + sizeof(int)));
+    memcpy(&Sto->Journal->CheckpointedSequence, sector + DDS_BACKEND_INITIALIZATION_MARK_LENGTH + 2 * sizeof(int),
+        sizeof(Sto->Journal->CheckpointedSequence));
+    Sto->Journal->CheckpointSequence = Sto->Journal->CheckpointedSequence;
+    SPDK_NOTICELOG("Got Sto->TotalDirs: %d, Sto->TotalFiles: %d, checkpointed journal sequence: %lu\n",
+        Sto->TotalDirs, Sto->TotalFiles, Sto->Journal->CheckpointedSequence);
+
+    struct LoadDirectoriesAndFilesCtx *Ctx = malloc(sizeof(*Ctx));
+    if (!Ctx) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    Ctx->DirTable = spdk_dma_malloc(DDS_MAX_DIRS * sizeof(DPUDirPropertiesT), DDS_BACKEND_PAGE_SIZE, NULL);
+    Ctx->FileTable = spdk_dma_malloc(DDS_MAX_FILES * sizeof(DPUFilePropertiesT), DDS_BACKEND_PAGE_SIZE, NULL);
+    if (!Ctx->DirTable || !Ctx->FileTable) {
+        SPDK_ERRLOG("Failed to allocate the buffers of the directory and file tables\n");
+        spdk_dma_free(Ctx->DirTable);
+        spdk_dma_free(Ctx->FileTable);
+        free(Ctx);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    atomic_init(&Ctx->HasFailed, false);
+    atomic_init(&Ctx->PendingReads, 1 + DDS_BACKEND_LOAD_FILE_READS);
+    Ctx->SPDKContext = InitializeCtx->SPDKContext;
+
+    //
+    // The directory table in one read
+    //
+    //
+    ErrorCodeT result = ReadFromDiskAsyncZC(
+        (BufferT)Ctx->DirTable,
+        DDS_BACKEND_METADATA_ADDRESS(DDS_BACKEND_SECTOR_SIZE),
+        DDS_MAX_DIRS * sizeof(DPUDirPropertiesT),
+        LoadTablesCallback,
+        Ctx,
+        Sto,
+        Arg
+    );
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Reading the directory table failed with %d, exiting...\n", result);
+        exit(-1);
+    }
+
+    //
+    // The file table, which ends at the end of the metadata, in batches
+    //
+    //
+    SegmentSizeT tableAddress = DDS_BACKEND_METADATA_BYTES - DDS_MAX_FILES * sizeof(DPUFilePropertiesT);
+    for (size_t r = 0; r != DDS_BACKEND_LOAD_FILE_READS; r++) {
+        size_t firstEntry = r * DDS_BACKEND_LOAD_FILES_PER_READ;
+        size_t entries = DDS_MAX_FILES - firstEntry < DDS_BACKEND_LOAD_FILES_PER_READ ?
+            DDS_MAX_FILES - firstEntry : DDS_BACKEND_LOAD_FILES_PER_READ;
+
+        result = ReadFromDiskAsyncZC(
+            (BufferT)&Ctx->FileTable[firstEntry],
+            DDS_BACKEND_METADATA_ADDRESS(tableAddress + firstEntry * sizeof(DPUFilePropertiesT)),
+            (FileIOSizeT)(entries * sizeof(DPUFilePropertiesT)),
+            LoadTablesCallback,
+            Ctx,
+            Sto,
+            Arg
+        );
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            SPDK_ERRLOG("Reading the file table failed with %d, exiting...\n", result);
+            exit(-1);
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Synchronize a directory to the disk
+//
+//
+ErrorCodeT SyncDirToDisk(
+    struct DPUDir* Dir, 
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    DiskIOCallback Callback,
+    ContextT Context
+){
+    return WriteToDiskAsyncZC(
+        (BufferT)GetDirProperties(Dir),
+        DDS_BACKEND_METADATA_ADDRESS(GetDirAddressOnSegment(Dir)),
+        sizeof(DPUDirPropertiesT),
+        Callback,
+        Context,
+        Sto,
+        SPDKContext
+    );
+}
+
+//
+// Synchronize a file to the disk
+//
+//
+ErrorCodeT SyncFileToDisk(
+    struct DPUFile* File,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    DiskIOCallback Callback,
+    ContextT Context
+){
+    EncodeFileExtents(File);
+    return WriteToDiskAsyncZC(
+        (BufferT)GetFileProperties(File),
+        DDS_BACKEND_METADATA_ADDRESS(GetFileAddressOnSegment(File)),
+        sizeof(DPUFilePropertiesT),
+        Callback,
+        Context,
+        Sto,
+        SPDKContext
+    );
+}
+
+//
+// Synchronize the first sector on the reserved segment
+//
+//
+ErrorCodeT SyncReservedInformationToDisk(
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    DiskIOCallback Callback,
+    ContextT Context
+){
+    //
+    // The sector must stay valid until the write completes, so it's the DMA-able one of the journal
+    //
+    //
+    char* tmpSectorBuf = Sto->Journal->Sector;
+
+    memset(tmpSectorBuf, 0, DDS_BACKEND_SECTOR_SIZE);
+    strcpy(tmpSectorBuf, DDS_BACKEND_INITIALIZATION_MARK);
+
+    int* numDirs = (int*)(tmpSectorBuf + DDS_BACKEND_INITIALIZATION_MARK_LENGTH);
+    *numDirs = Sto->TotalDirs;
+    int* numFiles = numDirs + 1;
+    *numFiles = Sto->TotalFiles;
+
+    //
+    // The journal sequence the tables on the disk cover
+    //
+    //
+    memcpy(tmpSectorBuf + DDS_BACKEND_INITIALIZATION_MARK_LENGTH + 2 * sizeof(int),
+        &Sto->Journal->CheckpointSequence, sizeof(Sto->Journal->CheckpointSequence));
+
+    SPDK_NOTICELOG("Sto->TotalDirs %d, Sto->TotalFiles: %d\n", Sto->TotalDirs, Sto->TotalFiles);
+
+    return WriteToDiskAsyncZC(
+        tmpSectorBuf,
+        DDS_BACKEND_METADATA_ADDRESS(0),
+        DDS_BACKEND_SECTOR_SIZE,
+        Callback,
+        Context,
+        Sto,
+        SPDKContext
+    );
+}
+
+void InitializeSyncReservedInfoCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    spdk_bdev_free_io(bdev_io);
+    if (!Success) {
+        SPDK_ERRLOG("Initialize() SyncReservedInformationToDisk IO failed...\n");
+        exit(-1);
+    }
+
+    SPDK_NOTICELOG("Initialize() done!\n");
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        ResetFreeZones(Sto, ((struct InitializeCtx *)Context)->SPDKContext);
+        return;
+    }
+#endif
+    G_INITIALIZATION_DONE = true;
+}
+
+void InitializeSyncDirToDiskCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    spdk_bdev_free_io(bdev_io);
+    struct InitializeCtx *Ctx = Context;
+    if (!Success) {
+        SPDK_NOTICELOG("Initialize() SyncDirToDisk IO failed...\n");
+        exit(-1);
+    }
+
+    if (ReserveDir(Sto, DDS_DIR_ROOT) != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Initialize() failed to allocate the directory table\n");
+        exit(-1);
+    }
+    SetDir(Sto, DDS_DIR_ROOT, Ctx->RootDir);
+
+    //
+    // Set the formatted mark and the numbers of dirs and files
+    //
+    //
+    ErrorCodeT result;
+    Sto->TotalDirs = 1;
+    Sto->TotalFiles = 0;
+    result = SyncReservedInformationToDisk(Sto, Ctx->SPDKContext, InitializeSyncReservedInfoCallback, Ctx);
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Initialize() SyncReservedInformationToDisk failed!!!\n");
+        exit(-1);
+    }
+
+}
+
+//
+// The metadata has been zeroed; create the root directory, which is on the second sector on the segment
+//
+//
+void InitializeZeroMetadataCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    spdk_bdev_free_io(bdev_io);
+    struct InitializeCtx *Ctx = Context;
+
+    if (!Success) {
+        SPDK_ERRLOG("Initialize() failed to zero the metadata, exiting...\n");
+        exit(-1);
+    }
+
+    SPDK_NOTICELOG("Zeroed the metadata\n");
+    struct DPUDir* rootDir = BackEndDirI(DDS_DIR_ROOT, DDS_DIR_INVALID, DDS_BACKEND_ROOT_DIR_NAME);
+    Ctx->RootDir = rootDir;
+    ErrorCodeT result = SyncDirToDisk(rootDir, Sto, Ctx->SPDKContext, InitializeSyncDirToDiskCallback, Ctx);
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        Ctx->FailureStatus->HasFailed = true;
+        Ctx->FailureStatus->HasAborted = true;
+        SPDK_ERRLOG("Initialize() SyncDirToDisk early fail!\n");
+        exit(-1);
+    }
+}
+
+void InitializeReadReservedSectorCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    struct InitializeCtx *Ctx = Context;
+    ErrorCodeT result;
+
+    if (!Success) {
+        SPDK_ERRLOG("Initialization failed! Exiting...\n");
+        exit(-1);
+    }
+    if (strcmp(DDS_BACKEND_INITIALIZATION_MARK, Ctx->tmpSectorBuf)) {
+        //
+        // A store of an older layout is not read as one of this layout, and is not wiped unless asked
+        //
+        //
+        if (!strncmp(DDS_BACKEND_INITIALIZATION_MARK_PREFIX, Ctx->tmpSectorBuf, strlen(DDS_BACKEND_INITIALIZATION_MARK_PREFIX))) {
+            Ctx->tmpSectorBuf[DDS_BACKEND_INITIALIZATION_MARK_LENGTH - 1] = '\0';
+            if (!G_FORMAT_OLDER_STORE) {
+                SPDK_ERRLOG("The bdev holds a store of an older layout (\"%s\", expected \"%s\"); "
+                    "set format_older_store in dds_storage to format it, losing its files, exiting...\n",
+                    Ctx->tmpSectorBuf, DDS_BACKEND_INITIALIZATION_MARK);
+                exit(-1);
+            }
+            SPDK_WARNLOG("Formatting the store of an older layout (\"%s\") as format_older_store is set\n",
+                Ctx->tmpSectorBuf);
+        }
+        SPDK_NOTICELOG("Backend is NOT initialized!\n");
+        //
+        // Empty every byte of the metadata with a single write zeroes, which the device does without data transfer
+        //
+        //
+        result = ZeroDiskAsync(
+            DDS_BACKEND_METADATA_ADDRESS(0),
+            DDS_BACKEND_METADATA_BYTES,
+            InitializeZeroMetadataCallback,
+            Ctx,
+            Sto,
+            Ctx->SPDKContext
+        );
+        if (result != DDS_ERROR_CODE_SUCCESS) {
             Ctx->FailureStatus->HasFailed = true;
-            Ctx->FailureStatus->HasAborted = true;
-            SPDK_ERRLOG("Initialize() SyncDirToDisk early fail!!\n");
-            // FS app stop func
+            Ctx->FailureStatus->HasAborted = true;  // don't need to run callbacks anymore
+            SPDK_ERRLOG("Clearing backend metadata failed with %d\n", result);
+            exit(-1);
+        }
+    }
+    else {
+        SPDK_NOTICELOG("Backend is initialized! Load directories and files...\n");
+        //
+        // Load directories and files;
+        // the segments of the files are claimed and the journal is replayed once they are all loaded
+        //
+        //
+        result = LoadDirectoriesAndFiles(Sto, Ctx->SPDKContext, Ctx);
+
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            SPDK_ERRLOG("LoadDirectoriesAndFiles() failed with %d, exiting...\n", result);
+            exit(-1);
+        }
+    }
+    spdk_bdev_free_io(bdev_io);
+}
+
+//
+// Set up the segments and read the reserved sector, which goes on with formatting or loading the store
+//
+//
+static ErrorCodeT
+InitializeStore(
+    struct DPUStorage* Sto,
+    SPDKContextT *SPDKContext
+){
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    //
+    // The checksums take the end of the store
+    //
+    //
+    ErrorCodeT checksumsResult = ChecksumsInit(Sto);
+    if (checksumsResult != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to set up the checksums with %d\n", checksumsResult);
+        return checksumsResult;
+    }
+#endif
+
+    if (Sto->TotalSegments <= DDS_BACKEND_RESERVED_SEGMENT + DDS_BACKEND_RESERVED_SEGMENTS) {
+        SPDK_ERRLOG("The bdev has %d segments, too few for the store\n", Sto->TotalSegments);
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    //
+    // The store works without the cache if there is no memory for it
+    //
+    //
+    if (BlockCacheInit(Sto, G_BLOCK_CACHE_BYTES) != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_WARNLOG("No memory for a block cache of %lu bytes, reads won't be cached\n", G_BLOCK_CACHE_BYTES);
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    if (WriteBufferInit(Sto, G_WRITE_BUFFER_BYTES) != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_WARNLOG("No memory for a write buffer of %lu bytes, writes won't be buffered\n", G_WRITE_BUFFER_BYTES);
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_DEDUP
+    if (DedupInit(Sto) != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_WARNLOG("No memory for the deduplication index, writes won't be deduplicated\n");
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    ErrorCodeT atomicResult = AtomicWritesInit(Sto);
+    if (atomicResult != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to set up the atomic write slots with %d\n", atomicResult);
+        return atomicResult;
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    if (DefragInit(Sto) != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_WARNLOG("No memory for the defragmentation, segments won't be moved\n");
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_TIERING
+    ErrorCodeT tierResult = TierInit(Sto, SPDKContext);
+    if (tierResult != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Failed to set up the capacity bdev with %d\n", tierResult);
+        return tierResult;
+    }
+#endif
+    SPDK_NOTICELOG("The store has %d segments of %llu bytes\n", Sto->TotalSegments, DDS_BACKEND_SEGMENT_SIZE);
+
+    //
+    // Retrieve all segments on disk
+    //
+    //
+    ErrorCodeT result = RetrieveSegments(Sto);
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    result = JournalInit(Sto);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    //
+    // The first sector on the reserved segment contains initialization information
+    //
+    //
+    char *tmpSectorBuf = malloc(DDS_BACKEND_SECTOR_SIZE + 1);
+    memset(tmpSectorBuf, 0, DDS_BACKEND_SECTOR_SIZE + 1);
+
+    // read reserved sector
+    struct InitializeCtx *InitializeCtx = malloc(sizeof(*InitializeCtx));
+    InitializeCtx->tmpSectorBuf = tmpSectorBuf;
+    struct InitializeFailureStatus *FailureStatus = malloc(sizeof(*FailureStatus));
+    InitializeCtx->FailureStatus = FailureStatus;
+    InitializeCtx->FailureStatus->HasFailed = false;
+    InitializeCtx->FailureStatus->HasStopped = false;
+    InitializeCtx->FailureStatus->HasStopped = false;
+    InitializeCtx->SPDKContext = SPDKContext;
+    result = ReadFromDiskAsyncZC(
+        tmpSectorBuf,
+        DDS_BACKEND_METADATA_ADDRESS(0),
+        DDS_BACKEND_SECTOR_SIZE,
+        InitializeReadReservedSectorCallback,
+        InitializeCtx,
+        Sto,
+        SPDKContext
+    );
+    SPDK_NOTICELOG("Reserved segment has been read\n");
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        printf("Initialize read reserved sector failed!!!\n");
+        return result;
+    }
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+#ifdef OPT_FILE_SERVICE_ZONED
+//
+// The zones of the metadata and the first zone after them, whose capacity all the zones of files are taken to have
+//
+//
+typedef struct ZoneProbeCtx {
+    struct DPUStorage* Sto;
+    SPDKContextT *SPDKContext;
+    SegmentIdT MetadataZones;
+    struct spdk_bdev_zone_info Info[];
+} ZoneProbeCtxT;
+
+static void
+ZonesProbedCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    ZoneProbeCtxT* ctx = Context;
+    struct DPUStorage* sto = ctx->Sto;
+    uint32_t blockSize = spdk_bdev_get_block_size(ctx->SPDKContext->bdev);
+    spdk_bdev_free_io(bdev_io);
+
+    if (!Success) {
+        SPDK_ERRLOG("Failed to get the information of the zones, exiting...\n");
+        exit(-1);
+    }
+
+    //
+    // The metadata and the journal are written in place
+    //
+    //
+    for (SegmentIdT z = 0; z != ctx->MetadataZones; z++) {
+        if (ctx->Info[z].type != SPDK_BDEV_ZONE_TYPE_CNV) {
+            SPDK_ERRLOG("Zone %d holds metadata but isn't conventional, exiting...\n", z);
             exit(-1);
         }
     }
-    else {
-        //
-        // Else not last, issue more zeroing writes
-        //
-        //
-        Ctx->NumPagesWritten += 1;
-        Ctx->PagesLeft -= 1;
-        
-        result = WriteToDiskAsyncZC(
-            Ctx->tmpPageBuf,
-            DDS_BACKEND_RESERVED_SEGMENT,
-            (SegmentSizeT)((Ctx->NumPagesWritten - 1) * DDS_BACKEND_PAGE_SIZE),
-            DDS_BACKEND_PAGE_SIZE,
-            IncrementProgressCallback,
-            Ctx,
-            Sto,
-            Ctx->SPDKContext
-        );
+
+    struct spdk_bdev_zone_info* first = &ctx->Info[ctx->MetadataZones];
+    sto->UsableSegmentsPerZone = (SegmentIdT)(first->capacity * blockSize / DDS_BACKEND_SEGMENT_SIZE);
+    if (first->type == SPDK_BDEV_ZONE_TYPE_CNV || !sto->UsableSegmentsPerZone) {
+        SPDK_ERRLOG("The zones of files must be sequential and hold a segment, exiting...\n");
+        exit(-1);
+    }
+
+    sto->Zoned = true;
+    sto->FirstZonedSegment = ctx->MetadataZones * sto->SegmentsPerZone;
+    sto->TotalSegments -= sto->TotalSegments % sto->SegmentsPerZone;
+    SPDK_NOTICELOG("Zoned store: zones of %d segments with %d usable, files from segment %d, appends of %u bytes\n",
+        sto->SegmentsPerZone, sto->UsableSegmentsPerZone, sto->FirstZonedSegment, sto->ZoneAppendMaxBytes);
+
+    ErrorCodeT result = InitializeStore(sto, ctx->SPDKContext);
+    free(ctx);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("Initialize() failed with %d, exiting...\n", result);
+        exit(-1);
+    }
+}
+
+//
+// Lay the store out on the zones of a zoned bdev: zones of whole segments, after conventional zones
+// holding the metadata; the store goes on initializing once their information is read
+//
+//
+static ErrorCodeT
+ProbeZones(
+    struct DPUStorage* Sto,
+    SPDKContextT *SPDKContext
+){
+    uint32_t blockSize = spdk_bdev_get_block_size(SPDKContext->bdev);
+    DiskSizeT zoneBytes = spdk_bdev_get_zone_size(SPDKContext->bdev) * blockSize;
+    if (!zoneBytes || zoneBytes % DDS_BACKEND_SEGMENT_SIZE) {
+        SPDK_ERRLOG("Zones of %llu bytes don't hold whole segments of %llu\n", zoneBytes, DDS_BACKEND_SEGMENT_SIZE);
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    Sto->ZoneBytes = zoneBytes;
+    Sto->SegmentsPerZone = (SegmentIdT)(zoneBytes / DDS_BACKEND_SEGMENT_SIZE);
+    Sto->ZoneAppendMaxBytes = (FileIOSizeT)min((uint64_t)spdk_bdev_get_max_zone_append_size(SPDKContext->bdev) *
+        blockSize, (uint64_t)DDS_BACKEND_SEGMENT_SIZE);
+    if (Sto->ZoneAppendMaxBytes < DDS_BACKEND_SECTOR_SIZE) {
+        SPDK_ERRLOG("The bdev can't append a sector of %d bytes\n", DDS_BACKEND_SECTOR_SIZE);
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    SegmentIdT metadataZones = (DDS_BACKEND_RESERVED_SEGMENT + DDS_BACKEND_RESERVED_SEGMENTS +
+        Sto->SegmentsPerZone - 1) / Sto->SegmentsPerZone;
+    if ((metadataZones + 1) * Sto->SegmentsPerZone > Sto->TotalSegments) {
+        SPDK_ERRLOG("The bdev has %d segments, too few for zones of %d\n", Sto->TotalSegments, Sto->SegmentsPerZone);
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+    ZoneProbeCtxT* ctx = malloc(sizeof(ZoneProbeCtxT) + (metadataZones + 1) * sizeof(struct spdk_bdev_zone_info));
+    if (!ctx) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    ctx->Sto = Sto;
+    ctx->SPDKContext = SPDKContext;
+    ctx->MetadataZones = metadataZones;
+
+    if (BdevGetZoneInfo(SPDKContext, 0, metadataZones + 1, ctx->Info, ZonesProbedCallback, ctx)) {
+        free(ctx);
+        return DDS_ERROR_CODE_IO_FAILURE;
+    }
+    return DDS_ERROR_CODE_SUCCESS;
+}
+#endif
+
+//
+// Initialize the backend service
+// This needs to be async, so using callback chains to accomplish this
+//
+//
+ErrorCodeT Initialize(
+    struct DPUStorage* Sto,
+    void *Arg // NOTE: this is currently an spdkContext, but depending on the callbacks, they need different arg than this
+){
+    SPDKContextT *SPDKContext = Arg;
+
+    //
+    // The store spans the bdev, up to the DDS_BACKEND_CAPACITY its tables are sized for,
+    // so that it grows with the drives striped under a raid bdev
+    //
+    //
+    DiskSizeT bdevSegments = spdk_bdev_get_num_blocks(SPDKContext->bdev) *
+        spdk_bdev_get_block_size(SPDKContext->bdev) / DDS_BACKEND_SEGMENT_SIZE;
+    if (bdevSegments < DDS_BACKEND_MAX_SEGMENTS) {
+        Sto->TotalSegments = (SegmentIdT)bdevSegments;
+    }
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (spdk_bdev_is_zoned(SPDKContext->bdev)) {
+        return ProbeZones(Sto, SPDKContext);
+    }
+#endif
+
+    return InitializeStore(Sto, SPDKContext);
+}
+
+//
+// Complete a control plane operation once its journal record is on the disk
+//
+//
+static void
+ControlPlaneJournalCallback(
+    bool Success,
+    ContextT Context
+){
+    ControlPlaneHandlerCtx *HandlerCtx = Context;
+    if (Success) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_SUCCESS;
+    }
+    else {
+        SPDK_ERRLOG("Journal write failed, the operation is not persistent\n");
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+    }
+
+    //
+    // We should free the handler ctx at the end of the last callback
+    //
+    //
+    free(HandlerCtx);
+}
+
+//
+// Apply a record to the tables in memory and journal it;
+// the operation completes in ControlPlaneJournalCallback, or here on failure
+//
+//
+static ErrorCodeT
+CommitControlPlaneRecord(
+    DPUJournalRecordT* Record,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ControlPlaneHandlerCtx *HandlerCtx
+){
+    ErrorCodeT result = JournalApply(Sto, Record);
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        result = JournalCommit(Sto, Record, ControlPlaneJournalCallback, HandlerCtx, SPDKContext);
+    }
+#ifdef OPT_FILE_SERVICE_TRIM
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        SealFreedSegments(Sto, SPDKContext);
+    }
+#endif
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        *(HandlerCtx->Result) = result;
+        free(HandlerCtx);
     }
+    return result;
 }
 
-void InitializeReadReservedSectorCallback(
-    struct spdk_bdev_io *bdev_io,
+//
+// Create a diretory
+// Assuming id and parent id have been computed by host
+// 
+//
+ErrorCodeT CreateDirectory(
+    const char* PathName,
+    DirIdT DirId,
+    DirIdT ParentId,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ControlPlaneHandlerCtx *HandlerCtx
+){
+    HandlerCtx->SPDKContext = SPDKContext;
+
+    if (GetDir(Sto, DirId)) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_EXISTS;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_DIR_EXISTS;
+    }
+
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_CREATE_DIR;
+    record.Dir.Id = DirId;
+    record.Dir.Parent = ParentId;
+    strncpy(record.Dir.Name, PathName, DDS_MAX_FILE_PATH - 1);
+
+    return CommitControlPlaneRecord(&record, Sto, SPDKContext, HandlerCtx);
+}
+
+//
+// Delete a directory
+// 
+//
+ErrorCodeT RemoveDirectory(
+    DirIdT DirId,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ControlPlaneHandlerCtx *HandlerCtx
+){
+    HandlerCtx->SPDKContext = SPDKContext;
+    if (!GetDir(Sto, DirId)) {
+       *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
+       free(HandlerCtx);
+       return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_REMOVE_DIR;
+    record.Dir.Id = DirId;
+
+    return CommitControlPlaneRecord(&record, Sto, SPDKContext, HandlerCtx);
+}
+
+//
+// Create a file
+// 
+//
+ErrorCodeT CreateFile(
+    const char* FileName,
+    FileAttributesT FileAttributes,
+    FileIdT FileId,
+    DirIdT DirId,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ControlPlaneHandlerCtx *HandlerCtx
+){
+    HandlerCtx->SPDKContext = SPDKContext;
+    if (!GetDir(Sto, DirId)) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
+        SPDK_ERRLOG("DDS_ERROR_CODE_DIR_NOT_FOUND\n");
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    bool exists = GetFile(Sto, FileId) || FindFileByName(Sto, FileName) != DDS_FILE_INVALID;
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+    if (exists) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_FILE_EXISTS;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_FILE_EXISTS;
+    }
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // Zones are written only at their write pointers: there are no holes to fill later,
+    // nor checksum tables or staged atomic writes to rewrite in place
+    //
+    //
+    if (Sto->Zoned &&
+        (FileAttributes & (DDS_FILE_ATTRIBUTE_SPARSE | DDS_FILE_ATTRIBUTE_CHECKSUM | DDS_FILE_ATTRIBUTE_ATOMIC_WRITES))) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_INVALID_PARAM;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+#endif
+#ifndef OPT_FILE_SERVICE_ATOMIC_WRITES
+    if (FileAttributes & DDS_FILE_ATTRIBUTE_ATOMIC_WRITES) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+#endif
+
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_CREATE_FILE;
+    record.File.Id = FileId;
+    record.File.DirId = DirId;
+    record.File.NewDirId = DDS_DIR_INVALID;
+    record.File.Attributes = FileAttributes;
+    strncpy(record.File.Name, FileName, DDS_MAX_FILE_PATH - 1);
+
+    ErrorCodeT result = CommitControlPlaneRecord(&record, Sto, SPDKContext, HandlerCtx);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("CreateFile() failed with %hu\n", result);
+    }
+    return result;
+}
+
+//
+// Delete a file
+// 
+//
+ErrorCodeT DeleteFileOnSto(
+    FileIdT FileId,
+    DirIdT DirId,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    ControlPlaneHandlerCtx *HandlerCtx
+){
+    HandlerCtx->SPDKContext = SPDKContext;
+    if (!GetFile(Sto, FileId)) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if (!GetDir(Sto, DirId)) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_DELETE_FILE;
+    record.File.Id = FileId;
+    record.File.DirId = DirId;
+    record.File.NewDirId = DDS_DIR_INVALID;
+
+    return CommitControlPlaneRecord(&record, Sto, SPDKContext, HandlerCtx);
+}
+
+//
+// Complete a change of file size once it is journaled
+//
+//
+static void
+ChangeFileSizeJournalCallback(
     bool Success,
     ContextT Context
-) {
-    struct InitializeCtx *Ctx = Context;
-    ErrorCodeT result;
+){
+    ErrorCodeT *result = Context;
+    *result = Success ? DDS_ERROR_CODE_SUCCESS : DDS_ERROR_CODE_IO_FAILURE;
+}
 
-    if (!Success) {
-        SPDK_ERRLOG("Initialization failed! Exiting...\n");
-        exit(-1);
+//
+// Change the size of a file
+// 
+//
+ErrorCodeT ChangeFileSize(
+    FileIdT FileId,
+    FileSizeT NewSize,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    CtrlMsgB2FAckChangeFileSize *Resp
+){
+    struct DPUFile* file = GetFile(Sto, FileId);
+    SegmentIdT firstNewSegment;
+
+    if (!file) {
+        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
-    if (strcmp(DDS_BACKEND_INITIALIZATION_MARK, Ctx->tmpSectorBuf)) {
-        SPDK_NOTICELOG("Backend is NOT initialized!\n");
-        //
-        // Empty every byte on the reserved segment
-        //
-        //
-        char *tmpPageBuf = malloc(DDS_BACKEND_PAGE_SIZE);
-        memset(tmpPageBuf, 0, DDS_BACKEND_PAGE_SIZE);
-        Ctx->tmpPageBuf = tmpPageBuf;
-        
-        size_t pagesPerSegment = DDS_BACKEND_SEGMENT_SIZE / DDS_BACKEND_PAGE_SIZE;
 
-        size_t numPagesWritten = 1;
-        Ctx->NumPagesWritten = numPagesWritten;
-        Ctx->PagesLeft = pagesPerSegment - numPagesWritten;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    if (FileIsSnapshot(file)) {
+        Resp->Result = DDS_ERROR_CODE_READ_ONLY;
+        return DDS_ERROR_CODE_READ_ONLY;
+    }
+#endif
+
+    //
+    // There might be concurrent writes, hoping apps will handle the concurrency
+    //
+    //
+    FileSizeT currentFileSize = GetFileProperties(file)->FProperties.FileSize;
+    long long sizeToChange = NewSize - currentFileSize;
+    firstNewSegment = GetNumSegments(file);
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // A file on zones grows by its appends, and shrinks by whole zones, whose write pointers go back with it
+    //
+    //
+    if (Sto->Zoned && (sizeToChange > 0 ||
+        (sizeToChange < 0 && NewSize % ((FileSizeT)Sto->UsableSegmentsPerZone * DDS_BACKEND_SEGMENT_SIZE)))) {
+        Resp->Result = DDS_ERROR_CODE_INVALID_FILE_POSITION;
+        return DDS_ERROR_CODE_INVALID_FILE_POSITION;
+    }
+#endif
 
+    if (sizeToChange >= 0 && FileIsSparse(file)) {
         //
-        // Issue writes with the maximum queue depth
+        // A sparse file gets its segments when they are written
         //
         //
-        Ctx->TargetProgress = pagesPerSegment;
-        
+    }
+    else if (sizeToChange >= 0) {
+        //
+        // The previous code was "(size_t)GetNumSegments(file)", but it cannot be
+        // understood by compiler, so I rewrite in this format
+        // 
+        //
+        size_t numSeg = GetNumSegments(file); 
+        FileSizeT remainingAllocatedSize = (FileSizeT)numSeg * DDS_BACKEND_SEGMENT_SIZE - currentFileSize;
+        long long bytesToBeAllocated = sizeToChange - (long long)remainingAllocatedSize;
         
-        Ctx->CurrentProgress = 1;
-
-        result = WriteToDiskAsyncZC(
-            tmpPageBuf,
-            DDS_BACKEND_RESERVED_SEGMENT,
-            (SegmentSizeT)(numPagesWritten * DDS_BACKEND_PAGE_SIZE),
-            DDS_BACKEND_PAGE_SIZE,
-            IncrementProgressCallback,
-            Ctx,
-            Sto,
-            Ctx->SPDKContext
-        );
-        if (result != DDS_ERROR_CODE_SUCCESS) {
-            Ctx->FailureStatus->HasFailed = true;
-            Ctx->FailureStatus->HasAborted = true;  // don't need to run callbacks anymore
-            SPDK_ERRLOG("Clearing backend pages failed with %d\n", result);
-            exit(-1);
+        if (bytesToBeAllocated > 0) {
+            SegmentIdT numSegmentsToAllocate = (SegmentIdT)(
+                bytesToBeAllocated / DDS_BACKEND_SEGMENT_SIZE +
+                (bytesToBeAllocated % DDS_BACKEND_SEGMENT_SIZE == 0 ? 0 : 1)
+            );
+
+            //
+            // Reserve all the segments now, which a file that isn't sparse is never short of later
+            //
+            //
+            ErrorCodeT result = AllocateSegmentsToFile(FileId, file, numSegmentsToAllocate, Sto, SPDKContext);
+            if (result != DDS_ERROR_CODE_SUCCESS) {
+                Resp->Result = result;
+                return result;
+            }
         }
     }
     else {
-        SPDK_NOTICELOG("Backend is initialized! Load directories and files...\n");
-        //
-        // Load directories and files
-        //
-        //
-        result = LoadDirectoriesAndFiles(Sto, Ctx->SPDKContext, Ctx);
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+        WriteBufferForgetFile(Sto->WriteBuffer, FileId, NewSize);
+#endif
+        SegmentIdT newSegments = (SegmentIdT)(NewSize / DDS_BACKEND_SEGMENT_SIZE + (NewSize % DDS_BACKEND_SEGMENT_SIZE == 0 ? 0 : 1));
+        SegmentIdT numSegmentsToDeallocate = GetNumSegments(file) - newSegments;
+        if (numSegmentsToDeallocate > 0) {
 
-        if (result != DDS_ERROR_CODE_SUCCESS) {
-            return;
+            //
+            // Deallocate segments
+            //
+            //
+            DeallocateSegmentsOfFile(file, numSegmentsToDeallocate, Sto);
         }
+    }
 
-        //
-        // Update segment information
-        //
-        //
-        int checkedFiles = 0;
-        for (FileIdT f = 0; f != DDS_MAX_FILES; f++) {
-            struct DPUFile* file = Sto->AllFiles[f];
-            if (file) {
-                SegmentIdT* segments = GetFileProperties(file)->Segments;
-                for (size_t s = 0; s != DDS_BACKEND_MAX_SEGMENTS_PER_FILE; s++) {
-                    SegmentIdT currentSeg = segments[s];
-                    if (currentSeg == DDS_BACKEND_SEGMENT_INVALID) {
-                        break;
-                    }
-                    else {
-                        Sto->AllSegments[currentSeg].FileId = f;
-                    }
-                }
+    //
+    // Segment (de)allocation has been taken care of;
+    // the response is set once the new segments and size are journaled
+    //
+    //
+    SetSize(NewSize, file);
+    ErrorCodeT result = JournalFileSegments(Sto, FileId, file, firstNewSegment,
+        ChangeFileSizeJournalCallback, &Resp->Result, SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        Resp->Result = result;
+    }
+#ifdef OPT_FILE_SERVICE_TRIM
+    else {
+        SealFreedSegments(Sto, SPDKContext);
+    }
+#endif
+    return result;
+}
+
+//
+// Get file size
+// 
+//
+ErrorCodeT GetFileSize(
+    FileIdT FileId,
+    FileSizeT* FileSize,
+    struct DPUStorage* Sto,
+    CtrlMsgB2FAckGetFileSize *Resp
+) {
+    struct DPUFile* file = GetFile(Sto, FileId);
+
+    if (!file) {
+        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    *FileSize = GetSize(file);
+    Resp->Result = DDS_ERROR_CODE_SUCCESS;
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// A flush of a file waiting for the shared flush of the device
+//
+//
+typedef struct FlushFileCtx {
+    BdevFlushWaiterT Waiter;
+    ErrorCodeT *Result;
+} FlushFileCtxT;
+
+static void
+FlushFileCallback(
+    bool Success,
+    void *Arg
+) {
+    FlushFileCtxT *ctx = (FlushFileCtxT *)Arg;
 
-                checkedFiles++;
-                if (checkedFiles == Sto->TotalFiles) {
-                    break;
-                }
-            }
-        }
-    }
-    spdk_bdev_free_io(bdev_io);
+    *ctx->Result = Success ? DDS_ERROR_CODE_SUCCESS : DDS_ERROR_CODE_IO_FAILURE;
+    free(ctx);
 }
 
 //
-// Initialize the backend service
-// This needs to be async, so using callback chains to accomplish this
+// Flush the device under a file, sharing the flush with the other flushes of the thread;
+// the bdev has one volatile cache for all files, so the flush covers the whole device
 //
 //
-ErrorCodeT Initialize(
+ErrorCodeT FlushFile(
+    FileIdT FileId,
     struct DPUStorage* Sto,
-    void *Arg // NOTE: this is currently an spdkContext, but depending on the callbacks, they need different arg than this
-){
-    SPDKContextT *SPDKContext = Arg;
-    //
-    // Retrieve all segments on disk
-    //
-    //
-    ErrorCodeT result = RetrieveSegments(Sto);
-
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        return result;
+    void *SPDKContext,
+    CtrlMsgB2FAckFlushFile *Resp
+) {
+    if (!GetFile(Sto, FileId)) {
+        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
 
-    //
-    // The first sector on the reserved segment contains initialization information
-    //
-    //
-    char *tmpSectorBuf = malloc(DDS_BACKEND_SECTOR_SIZE + 1);
-    memset(tmpSectorBuf, 0, DDS_BACKEND_SECTOR_SIZE + 1);
+    FlushFileCtxT *ctx = malloc(sizeof(FlushFileCtxT));
+    if (!ctx) {
+        Resp->Result = DDS_ERROR_CODE_OUT_OF_MEMORY;
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
 
-    // read reserved sector
-    struct InitializeCtx *InitializeCtx = malloc(sizeof(*InitializeCtx));
-    InitializeCtx->tmpSectorBuf = tmpSectorBuf;
-    struct InitializeFailureStatus *FailureStatus = malloc(sizeof(*FailureStatus));
-    InitializeCtx->FailureStatus = FailureStatus;
-    InitializeCtx->FailureStatus->HasFailed = false;
-    InitializeCtx->FailureStatus->HasStopped = false;
-    InitializeCtx->FailureStatus->HasStopped = false;
-    InitializeCtx->CurrentProgress = 0;
-    InitializeCtx->TargetProgress = 0;
-    InitializeCtx->SPDKContext = SPDKContext;
-    result = ReadFromDiskAsyncZC(
-        tmpSectorBuf,
-        DDS_BACKEND_RESERVED_SEGMENT,
-        0,
-        DDS_BACKEND_SECTOR_SIZE,
-        InitializeReadReservedSectorCallback,
-        InitializeCtx,
-        Sto,
-        Arg
-    );
-    SPDK_NOTICELOG("Reserved segment has been read\n");
+    ctx->Waiter.Callback = FlushFileCallback;
+    ctx->Waiter.Arg = ctx;
+    ctx->Result = &Resp->Result;
+    BdevFlushShared((SPDKContextT *)SPDKContext, &ctx->Waiter);
 
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        printf("Initialize read reserved sector failed!!!\n");
-        return result;
-    }
-    return DDS_ERROR_CODE_SUCCESS;
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
-void CreateDirectorySyncReservedInformationToDiskCallback(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        //
-        // This is basically the last line of the original CreateDirectory()
-        //
-        //
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_SUCCESS;
-    }
-    else {
-        SPDK_ERRLOG("CreateDirectorySyncReservedInformationToDiskCallback failed\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+//
+// Set the I/O rate limit of a file; the workers apply it to the requests they take from now on
+// 
+//
+ErrorCodeT SetFileQoS(
+    FileIdT FileId,
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight,
+    struct DPUStorage* Sto,
+    CtrlMsgB2FAckSetFileQoS *Resp
+) {
+    struct DPUFile* file = GetFile(Sto, FileId);
+
+    if (!file) {
+        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
 
-    //
-    // We should free the handler ctx at the end of the last callback
-    //
-    //
-    free(HandlerCtx);
-    pthread_mutex_unlock(&Sto->SectorModificationMutex);
+    SetFileQoSLimit(file, BytesPerSecond, BurstBytes, Weight);
+    Resp->Result = DDS_ERROR_CODE_SUCCESS;
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
-void CreateDirectorySyncDirToDiskCallback(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
+//
+// Set how a file is read; ACCESS_HINT_WILLNEED keeps the plan of the file and reads the range into the block cache.
+// Hints only steer the block cache, so without it they are taken and ignored
+// 
+//
+ErrorCodeT SetFileAccessHint(
+    FileIdT FileId,
+    int32_t Hint,
+    FileSizeT Offset,
+    FileSizeT Bytes,
+    struct DPUStorage* Sto,
+    void *SPDKContext,
+    CtrlMsgB2FAckSetFileAccessHint *Resp
 ) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        Sto->AllDirs[HandlerCtx->DirId] = HandlerCtx->dir;
+    struct DPUFile* file = GetFile(Sto, FileId);
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-        pthread_mutex_lock(&Sto->SectorModificationMutex);
-        Sto->TotalDirs++;
-        ErrorCodeT result = SyncReservedInformationToDisk(Sto, HandlerCtx->SPDKContext,
-            CreateDirectorySyncReservedInformationToDiskCallback, HandlerCtx);
-        if (result != 0) {
-            //
-            // Fatal, can't continue, and the callback won't run
-            //
-            //
-            SPDK_ERRLOG("SyncReservedInformationToDisk() returned %hu\n", result);
-            pthread_mutex_unlock(&Sto->SectorModificationMutex);
-            *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-        }
-        //
-        // Else, the callback passed to it should be guaranteed to run
-        //
-        //
+    if (!file) {
+        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    if (Hint < ACCESS_HINT_NORMAL || Hint > ACCESS_HINT_WILLNEED) {
+        Resp->Result = DDS_ERROR_CODE_INVALID_PARAM;
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    if (Hint == ACCESS_HINT_WILLNEED) {
+        result = BlockCachePrefetchFile(Sto, FileId, Offset, min(Bytes, (FileSizeT)DDS_BACKEND_WILLNEED_MAX_BYTES),
+            SPDKContext);
     }
     else {
-        SPDK_ERRLOG("CreateDirectorySyncDirToDisk failed, can't create directory\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+        atomic_store(&file->AccessHint, Hint);
+        atomic_store(&file->ReadAheadEnd, 0);
     }
+#endif
+
+    Resp->Result = result;
+    return result;
 }
 
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
 //
-// Create a diretory
-// Assuming id and parent id have been computed by host
-// 
+// Snapshot a file into a new read-only file that shares its segments, see DPUBackEndSnapshot.h;
+// the snapshot is created, then given the segments and the size of the file as they are under its lock,
+// and the operation completes once the records of both are on the disk
 //
-ErrorCodeT CreateDirectory(
-    const char* PathName,
+//
+ErrorCodeT CreateSnapshot(
+    FileIdT FileId,
+    FileIdT SnapshotFileId,
     DirIdT DirId,
-    DirIdT ParentId,
+    const char* SnapshotName,
     struct DPUStorage* Sto,
     void *SPDKContext,
     ControlPlaneHandlerCtx *HandlerCtx
 ){
     HandlerCtx->SPDKContext = SPDKContext;
+    struct DPUFile* file = GetFile(Sto, FileId);
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    struct DPUDir* dir = BackEndDirI(DirId, ParentId, PathName);
-    if (!dir) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_OUT_OF_MEMORY;
-        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    if (!file) {
+        result = DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    else if (!GetDir(Sto, DirId)) {
+        result = DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+#ifdef OPT_FILE_SERVICE_ZONED
+    else if (Sto->Zoned) {
+        result = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+#endif
+    else if (FileIsChecksummed(file)) {
+        //
+        // The checksum tables belong to segments, which a copy would have to carry over
+        //
+        //
+        result = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+    else {
+        pthread_mutex_lock(&Sto->Journal->Mutex);
+        if (GetFile(Sto, SnapshotFileId) || FindFileByName(Sto, SnapshotName) != DDS_FILE_INVALID) {
+            result = DDS_ERROR_CODE_FILE_EXISTS;
+        }
+        pthread_mutex_unlock(&Sto->Journal->Mutex);
     }
-    HandlerCtx->DirId = DirId;
-    HandlerCtx->dir = dir;
-    ErrorCodeT result = SyncDirToDisk(dir, Sto, SPDKContext, CreateDirectorySyncDirToDiskCallback, HandlerCtx);
 
     if (result != DDS_ERROR_CODE_SUCCESS) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+        *(HandlerCtx->Result) = result;
+        free(HandlerCtx);
         return result;
     }
-    return result;
-}
 
-void RemoveDirectoryCallback2(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_SUCCESS;
-        free(HandlerCtx);
-    }
-    else {
-        SPDK_ERRLOG("RemoveDirectoryCallback2() failed\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_CREATE_FILE;
+    record.File.Id = SnapshotFileId;
+    record.File.DirId = DirId;
+    record.File.NewDirId = DDS_DIR_INVALID;
+    record.File.Attributes = GetAttributes(file) | DDS_FILE_ATTRIBUTE_SNAPSHOT;
+    strncpy(record.File.Name, SnapshotName, DDS_MAX_FILE_PATH - 1);
+
+    result = JournalApply(Sto, &record);
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        result = JournalCommit(Sto, &record, NULL, NULL, SPDKContext);
     }
 
-    pthread_mutex_unlock(&Sto->SectorModificationMutex);
-}
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        struct DPUFile* snapshot = GetFile(Sto, SnapshotFileId);
 
-void RemoveDirectoryCallback1(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {  
         //
-        // Continue to do work
+        // Nothing else locks the new file yet; the writes that find a segment shared from here on copy it
         //
         //
-        free(Sto->AllDirs[HandlerCtx->DirId]);
-        Sto->AllDirs[HandlerCtx->DirId] = NULL;
-
-        pthread_mutex_lock(&Sto->SectorModificationMutex);
+        LockFile(file);
+        LockFile(snapshot);
+        for (SegmentIdT s = 0; s != GetNumSegments(file); s++) {
+            SegmentIdT segment = GetSegment(file, s);
+            if (segment == DDS_BACKEND_SEGMENT_INVALID) {
+                continue;
+            }
+            if (!MapSegment(s, segment, snapshot)) {
+                result = DDS_ERROR_CODE_OUT_OF_MEMORY;
+                break;
+            }
+            ClaimSegment(Sto, segment, SnapshotFileId);
+        }
+        SetSize(GetSize(file), snapshot);
+        UnlockFile(snapshot);
+        UnlockFile(file);
 
-        Sto->TotalDirs--;
-        ErrorCodeT result = SyncReservedInformationToDisk(Sto, HandlerCtx->SPDKContext,
-            RemoveDirectoryCallback2, HandlerCtx);
-        if (result != 0) {
+        if (result == DDS_ERROR_CODE_SUCCESS) {
+            result = JournalFileSegments(Sto, SnapshotFileId, snapshot, 0, ControlPlaneJournalCallback, HandlerCtx,
+                SPDKContext);
+        }
+        else {
             //
-            // Fatal, can't continue, and the callback won't run
+            // A snapshot that could not take every segment is deleted, which gives back those it took
             //
             //
-            SPDK_ERRLOG("RemoveDirectoryCallback1() returned %hu\n", result);
-            pthread_mutex_unlock(&Sto->SectorModificationMutex);
-            *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+            record.Type = DDS_JOURNAL_RECORD_DELETE_FILE;
+            if (JournalApply(Sto, &record) == DDS_ERROR_CODE_SUCCESS) {
+                JournalCommit(Sto, &record, NULL, NULL, SPDKContext);
+            }
         }
-        //
-        // else, the callback passed to it should be guaranteed to run
-        //
-        //
     }
-    else {
-        SPDK_ERRLOG("RemoveDirectoryCallback1() failed, can't create directory\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        SPDK_ERRLOG("CreateSnapshot() failed with %hu\n", result);
+        *(HandlerCtx->Result) = result;
+        free(HandlerCtx);
     }
+    return result;
 }
+#endif
 
 //
-// Delete a directory
-// 
+// Fill the part of a read that falls on a hole of a sparse file with zeros
 //
-ErrorCodeT RemoveDirectory(
-    DirIdT DirId,
-    struct DPUStorage* Sto,
-    void *SPDKContext,
-    ControlPlaneHandlerCtx *HandlerCtx
+//
+static void
+ZeroHoleOfRead(
+    struct PerSlotContext* SlotContext,
+    SplittableBufferT *DestBuffer,
+    FileIOSizeT BytesRead,
+    FileIOSizeT Bytes
 ){
-    HandlerCtx->SPDKContext = SPDKContext;
-    if (!Sto->AllDirs[DirId]) {
-       *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
-       return DDS_ERROR_CODE_DIR_NOT_FOUND;
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+    if (BytesRead < DestBuffer->FirstSize) {
+        FileIOSizeT bytesOnFirst = min(Bytes, DestBuffer->FirstSize - BytesRead);
+        memset(DestBuffer->FirstAddr + BytesRead, 0, bytesOnFirst);
+        BytesRead += bytesOnFirst;
+        Bytes -= bytesOnFirst;
+    }
+    if (Bytes) {
+        memset(DestBuffer->SecondAddr + (BytesRead - DestBuffer->FirstSize), 0, Bytes);
     }
+#else
+    memset(SlotContext->Buff + BytesRead, 0, Bytes);
+#endif
+}
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+//
+// Where a read puts its data, as an I/O vector
+//
+//
+static int
+IovOfRead(
+    struct PerSlotContext* SlotContext,
+    SplittableBufferT *DestBuffer,
+    struct iovec *Iov
+){
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+    FileIOSizeT bytesOnFirst = min(DestBuffer->FirstSize, DestBuffer->TotalSize);
+    Iov[0].iov_base = DestBuffer->FirstAddr;
+    Iov[0].iov_len = bytesOnFirst;
+    Iov[1].iov_base = DestBuffer->SecondAddr;
+    Iov[1].iov_len = DestBuffer->TotalSize - bytesOnFirst;
+    return 2;
+#else
+    Iov[0].iov_base = SlotContext->Buff;
+    Iov[0].iov_len = DestBuffer->TotalSize;
+    return 1;
+#endif
+}
+#endif
+
+//
+// Async read from a file
+// requires block aligned IO;
+// holes of a sparse file read as zeros without IO
+// 
+//
+ErrorCodeT ReadFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    SplittableBufferT *DestBuffer,
+    DiskIOCallback Callback,
+    ContextT Context,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    struct DPUFile* file = GetFile(Sto, FileId);
+    struct PerSlotContext* SlotContext = (struct PerSlotContext*)Context;
+    SlotContext->DestBuffer = DestBuffer;
+    FileSizeT remainingBytes = GetSize(file) - Offset;
 
-    GetDirProperties(Sto->AllDirs[DirId])->Id = DDS_DIR_INVALID;
-    HandlerCtx->DirId = DirId;
-    ErrorCodeT result = SyncDirToDisk(Sto->AllDirs[DirId], Sto, SPDKContext, RemoveDirectoryCallback1, HandlerCtx);
+    FileIOSizeT bytesLeftToRead = DestBuffer->TotalSize;
+    FileSizeT fileSize = GetSize(file);
 
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+    if (Offset > GetSize(file)) {
+        DPULogWarning("Offset %lu > GetSize(file) %lu !\n", Offset, GetSize(file));
         return DDS_ERROR_CODE_IO_FAILURE;
     }
-    return result;
-}
 
-void CreateFileCallback3(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_SUCCESS;
-        free(HandlerCtx);
+    if (remainingBytes < DestBuffer->TotalSize) {
+        //
+        // bytes serviced can be smaller than requested, probably a client side issue, should not happen
+        //
+        //
+        DPULogDebug("found remainingBytes < DestBuffer->TotalSize, GetSize(file): %lu, Offset: %lu\n", fileSize, Offset);
+        bytesLeftToRead = (FileIOSizeT)remainingBytes;
     }
-    else {
-        SPDK_ERRLOG("CreateFileCallback3() failed\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+
+    SlotContext->BytesIssued = bytesLeftToRead;
+
+    //
+    // The sector that the file ends in is read whole, as a read of a sector aligned superset of the data may reach it
+    //
+    //
+    bytesLeftToRead = min(DestBuffer->TotalSize,
+        (bytesLeftToRead + DDS_BACKEND_SECTOR_SIZE - 1) & ~((FileIOSizeT)DDS_BACKEND_SECTOR_SIZE - 1));
+    FileIOSizeT bytesToRead = bytesLeftToRead;
+
+#ifdef OPT_FILE_SERVICE_TIERING
+    TierNoteRead(file, Offset, bytesToRead);
+#endif
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    //
+    // Small reads go through the block cache, the parts of them that are all there being copied without I/O
+    //
+    //
+    struct iovec cacheIov[2];
+    int cacheIovCnt = 0;
+    SlotContext->CacheTicket = BlockCacheTicket(Sto->BlockCache, bytesToRead);
+    if (SlotContext->CacheTicket) {
+        cacheIovCnt = IovOfRead(SlotContext, DestBuffer, cacheIov);
+        if (atomic_load_explicit(&file->AccessHint, memory_order_relaxed) == ACCESS_HINT_SEQUENTIAL) {
+            BlockCacheReadAhead(Sto, file, Offset, bytesToRead, SPDKContext);
+        }
     }
-    pthread_mutex_unlock(&Sto->SectorModificationMutex);
-}
+#endif
+
+    //
+    // Large reads go out in stripes, each counted in CallbacksToRun like a segment crossing
+    //
+    //
+    SegmentSizeT maxBytesToIssue = bytesLeftToRead >= DDS_BACKEND_READ_STRIPE_MIN_BYTES ?
+        (SegmentSizeT)DDS_BACKEND_READ_STRIPE_BYTES : (SegmentSizeT)DDS_BACKEND_SEGMENT_SIZE;
 
-void CreateFileCallback2(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        Unlock(HandlerCtx->dir);
+    FileSizeT curOffset = Offset;
+    DiskSizeT diskAddress;
+    SegmentSizeT offsetOnSegment;
+    SegmentSizeT bytesToIssue;
+    SegmentSizeT remainingBytesOnCurSeg;
+    BufferT DestAddr;
+    
+    while (bytesLeftToRead) {
         //
-        // Finally, file is added
+        // Cross-boundary detection
         //
         //
-        Sto->AllFiles[HandlerCtx->FileId] = HandlerCtx->File;
+        offsetOnSegment = (SegmentSizeT)(curOffset & DDS_BACKEND_SEGMENT_MASK);
+        diskAddress = GetSegmentAddress(file, curOffset >> DDS_BACKEND_SEGMENT_SHIFT) + offsetOnSegment;
+        remainingBytesOnCurSeg = DDS_BACKEND_SEGMENT_SIZE - offsetOnSegment;
 
-        Sto->TotalFiles++;
-        ErrorCodeT result = SyncReservedInformationToDisk(Sto, HandlerCtx->SPDKContext,
-            CreateFileCallback3, HandlerCtx);
-        if (result != 0) {
-            //
-            // Fatal, can't continue, and the callback won't run
+        FileIOSizeT bytesRead = bytesToRead - bytesLeftToRead;
+        int firstSplitLeftToRead = DestBuffer->FirstSize - bytesRead;
+
+        if (DestBuffer->FirstSize <= bytesRead) {
+            DPULogTrace("firstSplitLeftToRead should be <= 0, is: %d, total size is: %u\n",
+                firstSplitLeftToRead, DestBuffer->TotalSize);
+        }
+
+        if (DestBuffer->FirstSize - bytesRead < 0) {
+            // 
+            // this shall not happen
             //
             //
-            SPDK_ERRLOG("CreateFileCallback2() returned %hu\n", result);
-            pthread_mutex_unlock(&Sto->SectorModificationMutex);
-            *(HandlerCtx->Result) =  DDS_ERROR_CODE_IO_FAILURE;
+            DPULogError("int firstSplitLeftToRead = DestBuffer->FirstSize - bytesRead, underflow, %u - %u = %d\n",
+                DestBuffer->FirstSize, bytesRead, firstSplitLeftToRead);
         }
+
         //
-        // Else, the callback passed to it should be guaranteed to run
+        // May be 1st or 2nd split, the no. of bytes left to read onto it
         //
         //
-    }
-    else {
-        SPDK_ERRLOG("CreateFileCallback2() failed\n");
-        *(HandlerCtx->Result) =  DDS_ERROR_CODE_IO_FAILURE;
-    }
-        
-    pthread_mutex_lock(&Sto->SectorModificationMutex);
-}
+        FileIOSizeT bytesLeftOnCurrSplit;
+        FileIOSizeT splitBufferOffset;
 
-void CreateFileCallback1(
-    struct spdk_bdev_io *bdev_io,
-    bool Success,
-    ContextT Context
-) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
         //
-        // Continue to do work
-        // Add this file to its directory and make the update persistent
+        // it is assumed that both are block size aligned, so that bytesToIssue is always block size aligned
+        // also, bytesToIssue >= bytesLeftOnCurrSplit should always hold true
         //
         //
-        Lock(HandlerCtx->dir);
-    
-        AddFile(HandlerCtx->FileId, HandlerCtx->dir);
-        ErrorCodeT result = SyncDirToDisk(HandlerCtx->dir, Sto, HandlerCtx->SPDKContext,
-            CreateFileCallback2, HandlerCtx);
-        if (result != 0) {
+        bytesToIssue = min3(bytesLeftToRead, remainingBytesOnCurSeg, maxBytesToIssue);
+
+        if (SegmentIsHole(file, (SegmentIdT)(curOffset >> DDS_BACKEND_SEGMENT_SHIFT))) {
+            ZeroHoleOfRead(SlotContext, DestBuffer, bytesRead, bytesToIssue);
+            curOffset += bytesToIssue;
+            bytesLeftToRead -= bytesToIssue;
+            continue;
+        }
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+        if (SlotContext->CacheTicket && BlockCacheRead(Sto->BlockCache, diskAddress, bytesToIssue,
+            cacheIov, cacheIovCnt, bytesRead, SlotContext->CacheTicket)) {
+            curOffset += bytesToIssue;
+            bytesLeftToRead -= bytesToIssue;
+            continue;
+        }
+#endif
+
+        if (firstSplitLeftToRead > 0) {
+            //
+            // First addr
+            //
+            //
+            DestAddr = DestBuffer->FirstAddr;
+            bytesLeftOnCurrSplit = firstSplitLeftToRead;
+            splitBufferOffset = bytesRead;
+        }
+        else {
             //
-            // Fatal, can't continue, and the callback won't run
+            // Second addr
             //
             //
-            SPDK_ERRLOG("CreateFileCallback1() returned %hu\n", result);
-            Unlock(HandlerCtx->dir);
-            *(HandlerCtx->Result) =  DDS_ERROR_CODE_IO_FAILURE;
+            DPULogTrace("reading into second split, bytesLeftToRead: %d\n", bytesLeftToRead);
+            DestAddr = DestBuffer->SecondAddr;
+            bytesLeftOnCurrSplit = bytesLeftToRead;
+            splitBufferOffset = bytesRead - DestBuffer->FirstSize;
         }
+
         //
-        // Else, the callback passed to it should be guaranteed to run
+        // If bytes to issue can all fit on curr split, then we don't need sg IO
         //
         //
+        if (bytesLeftOnCurrSplit >= bytesToIssue) {
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+                result = ReadFromDiskAsyncZC(
+                    DestAddr + splitBufferOffset,
+                    diskAddress,
+                    bytesToIssue,
+                    Callback,
+                    Context,
+                    Sto,
+                    SPDKContext
+                );
+#else
+                result = ReadFromDiskAsyncNonZC(
+                    bytesRead,
+                    diskAddress,
+                    bytesToIssue,
+                    Callback,
+                    Context,
+                    Sto,
+                    SPDKContext
+                );
+#endif
+        }
+        else {
+            //
+            // We need sg, and exactly 2 iovec's, one on 1st split, the other on 2nd split
+            //
+            //
+            if (!(DestAddr == DestBuffer->FirstAddr)) {
+                DPULogError("SG start addr is not FirstAddr\n");
+            }
+            SlotContext->Iov[0].iov_base = DestAddr + splitBufferOffset;
+            SlotContext->Iov[0].iov_len = bytesLeftOnCurrSplit;
+
+            SlotContext->Iov[1].iov_base = DestBuffer->SecondAddr;
+            SlotContext->Iov[1].iov_len = bytesToIssue - bytesLeftOnCurrSplit;
+
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+                result = ReadvFromDiskAsyncZC(
+                    SlotContext->Iov,
+                    2,
+                    diskAddress,
+                    bytesToIssue,
+                    Callback,
+                    Context,
+                    Sto,
+                    SPDKContext
+                );
+#else
+                result = ReadvFromDiskAsyncNonZC(
+                    SlotContext->Iov,
+                    2,
+                    bytesRead,
+                    diskAddress,
+                    bytesToIssue,
+                    Callback,
+                    Context,
+                    Sto,
+                    SPDKContext
+                );
+#endif
+        }
+
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            DPULogWarning("ReadFromDiskAsync() failed with ret: %d\n", result);
+            SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+            SlotContext->Ctx->Response->BytesServiced = 0;
+            return result;
+        }
+        else {
+            SlotContext->CallbacksToRun += 1;
+        }
+
+        curOffset += bytesToIssue;
+        bytesLeftToRead -= bytesToIssue;
     }
-    else {
-        SPDK_ERRLOG("CreateFileCallback1() failed, can't create directory\n");
-        *(HandlerCtx->Result) =  DDS_ERROR_CODE_IO_FAILURE;
-    }
+
+    return result;
 }
 
+
 //
-// Create a file
-// 
+// A write that is not sector aligned: the partial sectors at its ends are read into a bounce buffer,
+// the data is copied over them and the aligned range is written back.
+// Such writes to a file run one at a time, lest two of them read the same sector before either writes it
 //
-ErrorCodeT CreateFile(
-    const char* FileName,
-    FileAttributesT FileAttributes,
-    FileIdT FileId,
-    DirIdT DirId,
-    struct DPUStorage* Sto,
-    void *SPDKContext,
-    ControlPlaneHandlerCtx *HandlerCtx
+//
+typedef struct RMWContext {
+    struct DPUStorage* Sto;
+    struct DPUFile* File;
+    FileSizeT Offset;
+    FileSizeT OldSize;
+    SplittableBufferT *SourceBuffer;
+    FileSizeT AlignedOffset;
+    FileIOSizeT AlignedBytes;
+    char* Bounce;
+    int ReadsLeft;
+    int WritesLeft;
+    bool Failed;
+    DiskIOCallback Callback;
+    struct PerSlotContext* SlotContext;
+    void *SPDKContext;
+    struct spdk_thread *Thread;
+    struct RMWContext* Next;
+} RMWCtxT;
+
+static void
+StartRMW(
+    void *Arg
+);
+
+//
+// Let the next unaligned write of the file run, on the thread that issued it
+//
+//
+static void
+FinishRMW(
+    RMWCtxT* Ctx
 ){
-    HandlerCtx->SPDKContext = SPDKContext;
-    struct DPUDir* dir = Sto->AllDirs[DirId];
-    if (!dir) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
-        SPDK_ERRLOG("DDS_ERROR_CODE_DIR_NOT_FOUND\n");
-        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    LockFile(Ctx->File);
+    RMWCtxT* next = Ctx->Next;
+    if (Ctx->File->RMWTail == Ctx) {
+        Ctx->File->RMWTail = NULL;
     }
+    UnlockFile(Ctx->File);
 
-    struct DPUFile* file = BackEndFileI(FileId, FileName, FileAttributes);
-    if (!file) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_OUT_OF_MEMORY;
-        SPDK_ERRLOG("DDS_ERROR_CODE_OUT_OF_MEMORY\n");
-        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    if (next) {
+        spdk_thread_send_msg(next->Thread, StartRMW, next);
     }
 
-    //
-    // Make file persistent
-    //
-    //
-    HandlerCtx->DirId = DirId;
-    HandlerCtx->dir = dir;
-    HandlerCtx->FileId = FileId;
-    HandlerCtx->File = file;
-    ErrorCodeT result = SyncFileToDisk(file, Sto, SPDKContext, CreateFileCallback1, HandlerCtx);
-
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        SPDK_ERRLOG("DDS_ERROR_CODE_IO_FAILURE\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-    }
-    return result;
+    spdk_dma_free(Ctx->Bounce);
+    free(Ctx);
 }
-void DeleteFileCallback3(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_SUCCESS;
-        free(HandlerCtx);
-    }
-    else {
-        SPDK_ERRLOG("DeleteFileCallback3() failed\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-    }
 
-    pthread_mutex_unlock(&Sto->SectorModificationMutex);
+static void
+FailRMW(
+    RMWCtxT* Ctx
+){
+    Ctx->SlotContext->Ctx->Response->BytesServiced = 0;
+    Ctx->SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+    FinishRMW(Ctx);
 }
 
-void DeleteFileCallback2(
+//
+// The write of the aligned range is counted in the callbacks of the slot like any other write
+//
+//
+static void
+RMWWriteCallback(
     struct spdk_bdev_io *bdev_io,
     bool Success,
     ContextT Context
-) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        Unlock(HandlerCtx->dir);
+){
+    RMWCtxT* ctx = Context;
+    ctx->Callback(bdev_io, Success, ctx->SlotContext);
+    if (--ctx->WritesLeft == 0) {
+        FinishRMW(ctx);
+    }
+}
 
-        //
-        // Finally, delete the file
-        //
-        //
-        free(HandlerCtx->File);
-        Sto->AllFiles[HandlerCtx->FileId] = NULL;
+static void
+RMWWrite(
+    RMWCtxT* Ctx
+){
+    SplittableBufferT *source = Ctx->SourceBuffer;
+    char* data = Ctx->Bounce + (Ctx->Offset - Ctx->AlignedOffset);
+    FileIOSizeT bytesOnFirst = min(source->FirstSize, source->TotalSize);
+
+    memcpy(data, source->FirstAddr, bytesOnFirst);
+    memcpy(data + bytesOnFirst, source->SecondAddr, source->TotalSize - bytesOnFirst);
+
+    FileSizeT curOffset = Ctx->AlignedOffset;
+    FileIOSizeT bytesLeftToWrite = Ctx->AlignedBytes;
+    Ctx->WritesLeft = 0;
 
-        pthread_mutex_lock(&Sto->SectorModificationMutex);
+    while (bytesLeftToWrite) {
+        SegmentSizeT offsetOnSegment = (SegmentSizeT)(curOffset & DDS_BACKEND_SEGMENT_MASK);
+        SegmentSizeT bytesToIssue = min(bytesLeftToWrite, DDS_BACKEND_SEGMENT_SIZE - offsetOnSegment);
+        DiskSizeT diskAddress = GetSegmentAddress(Ctx->File, curOffset >> DDS_BACKEND_SEGMENT_SHIFT) + offsetOnSegment;
+
+        ErrorCodeT result = WriteToDiskAsyncZC(Ctx->Bounce + (curOffset - Ctx->AlignedOffset), diskAddress,
+            bytesToIssue, RMWWriteCallback, Ctx, Ctx->Sto, Ctx->SPDKContext);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            DPULogWarning("WriteToDiskAsync() failed with ret: %d\n", result);
+            if (!Ctx->WritesLeft) {
+                FailRMW(Ctx);
+                return;
+            }
 
-        Sto->TotalFiles--;
-        ErrorCodeT result = SyncReservedInformationToDisk(Sto, HandlerCtx->SPDKContext,
-            DeleteFileCallback3, HandlerCtx);
-        if (result != 0) {
             //
-            // Fatal, can't continue, and the callback won't run
+            // The writes already issued finish the request as failed
             //
             //
-            SPDK_ERRLOG("DeleteFileCallback2() returned %hu\n", result);
-            pthread_mutex_unlock(&Sto->SectorModificationMutex);
-            *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+            Ctx->SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+            Ctx->SlotContext->Ctx->Response->BytesServiced = 0;
+            break;
         }
-        // 
-        // Else, the callback passed to it should be guaranteed to run
-        //
-        //
-    }
-    else {
-        SPDK_ERRLOG("DeleteFileCallback2() failed\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+        Ctx->WritesLeft++;
+        Ctx->SlotContext->CallbacksToRun += 1;
+
+        curOffset += bytesToIssue;
+        bytesLeftToWrite -= bytesToIssue;
     }
 }
 
-void DeleteFileCallback1(
+static void
+RMWReadCallback(
     struct spdk_bdev_io *bdev_io,
     bool Success,
     ContextT Context
-) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
+){
+    RMWCtxT* ctx = Context;
     spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        //
-        // Continue to do work
-        // Delete this file from its directory and make the update persistent
-        //
-        //
-        Lock(HandlerCtx->dir);
 
-        DeleteFile(HandlerCtx->FileId, HandlerCtx->dir);
-        ErrorCodeT result = SyncDirToDisk(HandlerCtx->dir, Sto, HandlerCtx->SPDKContext,
-            DeleteFileCallback2, HandlerCtx);
-        if (result != 0) {
-            //
-            // Fatal, can't continue, and the callback won't run
-            //
-            //
-            SPDK_ERRLOG("DeleteFileCallback1() returned %hu\n", result);
-            Unlock(HandlerCtx->dir);
-            *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-        }
-        //
-        // Else, the callback passed to it should be guaranteed to run
-        //
-        //
+    if (!Success) {
+        ctx->Failed = true;
     }
-    else {
-        SPDK_ERRLOG("DeleteFileCallback1() failed, can't create directory\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+    if (--ctx->ReadsLeft == 0) {
+        if (ctx->Failed) {
+            FailRMW(ctx);
+        }
+        else {
+            RMWWrite(ctx);
+        }
     }
 }
 
 //
-// Delete a file
-// 
+// Read the partial sectors at the ends, except those entirely past the old end of the file,
+// which are zeros; an append that starts on a sector boundary reads nothing
 //
-ErrorCodeT DeleteFileOnSto(
-    FileIdT FileId,
-    DirIdT DirId,
+//
+static void
+StartRMW(
+    void *Arg
+){
+    RMWCtxT* ctx = Arg;
+    FileSizeT sectors[2];
+    int numSectors = 0;
+    FileSizeT end = ctx->Offset + ctx->SourceBuffer->TotalSize;
+    FileSizeT lastSector = ctx->AlignedOffset + ctx->AlignedBytes - DDS_BACKEND_SECTOR_SIZE;
+
+    if (ctx->Offset != ctx->AlignedOffset) {
+        sectors[numSectors++] = ctx->AlignedOffset;
+    }
+    if (end != ctx->AlignedOffset + ctx->AlignedBytes && (!numSectors || lastSector != ctx->AlignedOffset)) {
+        sectors[numSectors++] = lastSector;
+    }
+
+    ctx->ReadsLeft = 1;
+    for (int s = 0; s != numSectors; s++) {
+        char* sectorBuffer = ctx->Bounce + (sectors[s] - ctx->AlignedOffset);
+        if (sectors[s] >= ctx->OldSize) {
+            memset(sectorBuffer, 0, DDS_BACKEND_SECTOR_SIZE);
+            continue;
+        }
+
+        DiskSizeT diskAddress = GetSegmentAddress(ctx->File, sectors[s] >> DDS_BACKEND_SEGMENT_SHIFT) +
+            (sectors[s] & DDS_BACKEND_SEGMENT_MASK);
+        ctx->ReadsLeft++;
+        if (ReadFromDiskAsyncZC(sectorBuffer, diskAddress, DDS_BACKEND_SECTOR_SIZE,
+            RMWReadCallback, ctx, ctx->Sto, ctx->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+            ctx->ReadsLeft--;
+            ctx->Failed = true;
+        }
+    }
+
+    //
+    // The extra count keeps a read that completes early from finishing the request
+    //
+    //
+    if (--ctx->ReadsLeft == 0) {
+        if (ctx->Failed) {
+            FailRMW(ctx);
+        }
+        else {
+            RMWWrite(ctx);
+        }
+    }
+}
+
+static ErrorCodeT
+WriteFileUnaligned(
+    struct DPUFile* File,
+    FileSizeT Offset,
+    FileSizeT OldSize,
+    SplittableBufferT *SourceBuffer,
+    DiskIOCallback Callback,
+    ContextT Context,
     struct DPUStorage* Sto,
-    void *SPDKContext,
-    ControlPlaneHandlerCtx *HandlerCtx
+    void *SPDKContext
 ){
-    HandlerCtx->SPDKContext = SPDKContext;
-    struct DPUFile* file = Sto->AllFiles[FileId];
-    struct DPUDir* dir = Sto->AllDirs[DirId];
-    if (!file) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_FILE_NOT_FOUND;
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    struct PerSlotContext* SlotContext = (struct PerSlotContext*)Context;
+    RMWCtxT* ctx = malloc(sizeof(RMWCtxT));
+    if (!ctx) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
     }
-    if (!dir) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
-        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+
+    ctx->AlignedOffset = Offset & ~((FileSizeT)DDS_BACKEND_SECTOR_SIZE - 1);
+    ctx->AlignedBytes = (FileIOSizeT)(((Offset + SourceBuffer->TotalSize + DDS_BACKEND_SECTOR_SIZE - 1) &
+        ~((FileSizeT)DDS_BACKEND_SECTOR_SIZE - 1)) - ctx->AlignedOffset);
+    ctx->Bounce = spdk_dma_malloc(ctx->AlignedBytes, DDS_BACKEND_PAGE_SIZE, NULL);
+    if (!ctx->Bounce) {
+        free(ctx);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
     }
 
-    GetFileProperties(file)->Id = DDS_FILE_INVALID;
-    
+    ctx->Sto = Sto;
+    ctx->File = File;
+    ctx->Offset = Offset;
+    ctx->OldSize = OldSize;
+    ctx->SourceBuffer = SourceBuffer;
+    ctx->Failed = false;
+    ctx->Callback = Callback;
+    ctx->SlotContext = SlotContext;
+    ctx->SPDKContext = SPDKContext;
+    ctx->Thread = spdk_get_thread();
+    ctx->Next = NULL;
+    SlotContext->BytesIssued = SourceBuffer->TotalSize;
+
+#ifndef OPT_FILE_SERVICE_ZERO_COPY
     //
-    // Make the change persistent
+    // The bounce buffer stages the data instead
     //
     //
-    HandlerCtx->DirId = DirId;
-    HandlerCtx->dir = dir;
-    HandlerCtx->FileId = FileId;
-    HandlerCtx->File = file;
-    ErrorCodeT result = SyncFileToDisk(file, Sto, SPDKContext, DeleteFileCallback1, HandlerCtx);
+    ReleaseSlotBuffer(SlotContext);
+#endif
 
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
+    LockFile(File);
+    RMWCtxT* previous = File->RMWTail;
+    if (previous) {
+        previous->Next = ctx;
     }
-    return result;
+    File->RMWTail = ctx;
+    UnlockFile(File);
+
+    if (!previous) {
+        StartRMW(ctx);
+    }
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
-// Change the size of a file
-// 
+// Allocate the segments a write needs and grow the file to cover it
 //
-ErrorCodeT ChangeFileSize(
+//
+ErrorCodeT
+ExtendFileForWrite(
     FileIdT FileId,
-    FileSizeT NewSize,
+    struct DPUFile* file,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
     struct DPUStorage* Sto,
-    CtrlMsgB2FAckChangeFileSize *Resp
+    void *SPDKContext
 ){
-    struct DPUFile* file = Sto->AllFiles[FileId];
-
-    if (!file) {
-        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
-    }
-
     //
-    // There might be concurrent writes, hoping apps will handle the concurrency
+    // Check if allocation is needed
     //
     //
+    FileSizeT newSize = Offset + Bytes;
     FileSizeT currentFileSize = GetFileProperties(file)->FProperties.FileSize;
-    long long sizeToChange = NewSize - currentFileSize;
-    if (sizeToChange >= 0) {
+    long long sizeToChange = newSize - currentFileSize;
+
+    if (FileIsSparse(file) && Bytes) {
         //
-        // The previous code was "(size_t)GetNumSegments(file)", but it cannot be
-        // understood by compiler, so I rewrite in this format
-        // 
+        // The holes the write covers get their segments first
         //
-        size_t numSeg = GetNumSegments(file); 
-        SegmentSizeT remainingAllocatedSize = (SegmentSizeT)(numSeg * DDS_BACKEND_SEGMENT_SIZE - currentFileSize);
+        //
+        SegmentIdT firstNewSlot;
+        ErrorCodeT result = AllocateSegmentsInRange(FileId, file, (SegmentIdT)(Offset >> DDS_BACKEND_SEGMENT_SHIFT),
+            (SegmentIdT)((newSize - 1) >> DDS_BACKEND_SEGMENT_SHIFT), Sto, &firstNewSlot, SPDKContext);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            SPDK_ERRLOG("Need to allocate seg for sparse file, but not enough available segs left!\n");
+            return result;
+        }
+
+        if (sizeToChange > 0) {
+            SetSize(newSize, file);
+        }
+
+        if (sizeToChange > 0 || firstNewSlot < GetNumSegments(file)) {
+            ErrorCodeT journalResult = JournalFileSegments(Sto, FileId, file, firstNewSlot, NULL, NULL, SPDKContext);
+            if (journalResult != DDS_ERROR_CODE_SUCCESS) {
+                SPDK_WARNLOG("Failed to journal the segments of file %hu with %d\n", FileId, journalResult);
+            }
+        }
+    }
+    else if (sizeToChange >= 0) {
+        // SPDK_NOTICELOG("file size changed, new size: %llu\n", newSize);
+        SegmentIdT numSeg = GetNumSegments(file);
+        FileSizeT remainingAllocatedSize = (FileSizeT)numSeg * DDS_BACKEND_SEGMENT_SIZE - currentFileSize;
         long long bytesToBeAllocated = sizeToChange - (long long)remainingAllocatedSize;
-        
+
         if (bytesToBeAllocated > 0) {
             SegmentIdT numSegmentsToAllocate = (SegmentIdT)(
                 bytesToBeAllocated / DDS_BACKEND_SEGMENT_SIZE +
                 (bytesToBeAllocated % DDS_BACKEND_SEGMENT_SIZE == 0 ? 0 : 1)
-            );
+                );
 
             //
             // Allocate segments
             //
             //
-            pthread_mutex_lock(&Sto->SegmentAllocationMutex);
-
-            if (numSegmentsToAllocate > Sto->AvailableSegments) {
-                pthread_mutex_unlock(&Sto->SegmentAllocationMutex);
-                Resp->Result = DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
-                return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+            ErrorCodeT result = AllocateSegmentsToFile(FileId, file, numSegmentsToAllocate, Sto, SPDKContext);
+            if (result != DDS_ERROR_CODE_SUCCESS) {
+                SPDK_ERRLOG("Need to allocate seg for file, but not enough available segs left!\n");
+                return result;
             }
+        }
 
-            SegmentIdT allocatedSegments = 0;
-            for (SegmentIdT s = 0; s != Sto->TotalSegments; s++) {
-                SegmentT* seg = &Sto->AllSegments[s];
-                if (seg->Allocatable && seg->FileId == DDS_FILE_INVALID) {
-                    AllocateSegment(s,file);
-                    seg->FileId = FileId;
-                    allocatedSegments++;
-                    if (allocatedSegments == numSegmentsToAllocate) {
-                        break;
-                    }
-                }
-            }
+        SetSize(newSize,file);
 
-            pthread_mutex_unlock(&Sto->SegmentAllocationMutex);
+        //
+        // Journal the growth without waiting for it; the write doesn't depend on it
+        //
+        //
+        if (sizeToChange > 0) {
+            ErrorCodeT journalResult = JournalFileSegments(Sto, FileId, file, numSeg, NULL, NULL, SPDKContext);
+            if (journalResult != DDS_ERROR_CODE_SUCCESS) {
+                SPDK_WARNLOG("Failed to journal the growth of file %hu with %d\n", FileId, journalResult);
+            }
         }
     }
-    else {
-        SegmentIdT newSegments = (SegmentIdT)(NewSize / DDS_BACKEND_SEGMENT_SIZE + (NewSize % DDS_BACKEND_SEGMENT_SIZE == 0 ? 0 : 1));
-        SegmentIdT numSegmentsToDeallocate = GetNumSegments(file) - newSegments;
-        if (numSegmentsToDeallocate > 0) {
 
-            //
-            // Deallocate segments
-            //
-            //
-            pthread_mutex_lock(&Sto->SegmentAllocationMutex);
+    return DDS_ERROR_CODE_SUCCESS;
+}
 
-            for (SegmentIdT s = 0; s != numSegmentsToDeallocate; s++) {
-                DeallocateSegment(file);
-            }
+#ifdef OPT_FILE_SERVICE_ZONED
+//
+// An append to a file on a zoned bdev, issued as zone appends of at most ZoneAppendMaxBytes on one zone each,
+// one after the other. The appends of a file run one at a time too, as zone appends in flight together
+// could land in any order; each is checked to have landed at the end of the file, where its data is expected
+//
+//
+typedef struct ZoneAppendContext {
+    struct DPUStorage* Sto;
+    struct DPUFile* File;
+    FileSizeT Offset;
+    SplittableBufferT *SourceBuffer;
+    FileIOSizeT BytesDone;
+    FileIOSizeT BytesOnPiece;
+    DiskSizeT Expected;
+    struct iovec Iov[2];
+    DiskIOCallback Callback;
+    struct PerSlotContext* SlotContext;
+    void *SPDKContext;
+    struct spdk_thread *Thread;
+    struct ZoneAppendContext* Next;
+} ZoneAppendCtxT;
+
+static void
+StartZoneAppend(
+    void *Arg
+);
 
-            pthread_mutex_unlock(&Sto->SegmentAllocationMutex);
-        }
+//
+// Let the next append of the file run, on the thread that issued it
+//
+//
+static void
+FinishZoneAppend(
+    ZoneAppendCtxT* Ctx
+){
+    LockFile(Ctx->File);
+    ZoneAppendCtxT* next = Ctx->Next;
+    if (Ctx->File->AppendTail == Ctx) {
+        Ctx->File->AppendTail = NULL;
     }
+    UnlockFile(Ctx->File);
 
-    //
-    // Segment (de)allocation has been taken care of
-    //
-    //
-    SetSize(NewSize, file);
-    Resp->Result = DDS_ERROR_CODE_SUCCESS;
+    if (next) {
+        spdk_thread_send_msg(next->Thread, StartZoneAppend, next);
+    }
+
+    free(Ctx);
+}
+
+static void
+ZoneAppendCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+);
+
+//
+// Append the next piece, up to the end of its zone and to ZoneAppendMaxBytes;
+// it is counted in the callbacks of the slot like any other write
+//
+//
+static ErrorCodeT
+AppendPiece(
+    ZoneAppendCtxT* Ctx
+){
+    struct DPUStorage* sto = Ctx->Sto;
+    SplittableBufferT *source = Ctx->SourceBuffer;
+    FileSizeT offset = Ctx->Offset + Ctx->BytesDone;
+    DiskSizeT diskAddress = GetSegmentAddress(Ctx->File, offset >> DDS_BACKEND_SEGMENT_SHIFT) +
+        (offset & DDS_BACKEND_SEGMENT_MASK);
+    DiskSizeT zone = diskAddress - diskAddress % sto->ZoneBytes;
+    DiskSizeT zoneEnd = zone + (DiskSizeT)sto->UsableSegmentsPerZone * DDS_BACKEND_SEGMENT_SIZE;
+    FileIOSizeT bytes = (FileIOSizeT)min3((DiskSizeT)(source->TotalSize - Ctx->BytesDone), zoneEnd - diskAddress,
+        (DiskSizeT)sto->ZoneAppendMaxBytes);
+
+    FileIOSizeT bytesOnFirst = Ctx->BytesDone < source->FirstSize ?
+        min(bytes, source->FirstSize - Ctx->BytesDone) : 0;
+    int iovCnt = 0;
+    if (bytesOnFirst) {
+        Ctx->Iov[iovCnt].iov_base = source->FirstAddr + Ctx->BytesDone;
+        Ctx->Iov[iovCnt++].iov_len = bytesOnFirst;
+    }
+    if (bytes > bytesOnFirst) {
+        Ctx->Iov[iovCnt].iov_base = source->SecondAddr + (Ctx->BytesDone + bytesOnFirst - source->FirstSize);
+        Ctx->Iov[iovCnt++].iov_len = bytes - bytesOnFirst;
+    }
+
+    Ctx->BytesOnPiece = bytes;
+    Ctx->Expected = diskAddress;
+    if (BdevZoneAppendV(Ctx->SPDKContext, Ctx->Iov, iovCnt, zone, bytes, ZoneAppendCallback, Ctx)) {
+        return DDS_ERROR_CODE_IO_FAILURE;
+    }
+    Ctx->SlotContext->CallbacksToRun += 1;
     return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
-// Get file size
-// 
+// A piece landing anywhere but where the file expects it fails the append; the next piece is issued
+// before the slot hears of this one, so that the slot doesn't take the append for done
 //
-ErrorCodeT GetFileSize(
-    FileIdT FileId,
-    FileSizeT* FileSize,
-    struct DPUStorage* Sto,
-    CtrlMsgB2FAckGetFileSize *Resp
-) {
-    struct DPUFile* file = Sto->AllFiles[FileId];
+//
+static void
+ZoneAppendCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    ZoneAppendCtxT* ctx = Context;
+    uint32_t blockSize = spdk_bdev_get_block_size(((SPDKContextT *)ctx->SPDKContext)->bdev);
 
-    if (!file) {
-        Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    if (Success && spdk_bdev_io_get_append_location(bdev_io) * blockSize != ctx->Expected) {
+        DPULogError("An append of file %hu landed at %lu instead of %llu\n", ctx->File->Properties.Id,
+            spdk_bdev_io_get_append_location(bdev_io) * blockSize, ctx->Expected);
+        Success = false;
     }
 
-    *FileSize = GetSize(file);
-    Resp->Result = DDS_ERROR_CODE_SUCCESS;
-    return DDS_ERROR_CODE_SUCCESS;
+    ctx->BytesDone += ctx->BytesOnPiece;
+    bool last = !Success || ctx->BytesDone == ctx->SourceBuffer->TotalSize;
+    if (!last && AppendPiece(ctx) != DDS_ERROR_CODE_SUCCESS) {
+        ctx->SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+        ctx->SlotContext->Ctx->Response->BytesServiced = 0;
+        last = true;
+    }
+
+    ctx->Callback(bdev_io, Success, ctx->SlotContext);
+    if (last) {
+        FinishZoneAppend(ctx);
+    }
+}
+
+static void
+StartZoneAppend(
+    void *Arg
+){
+    ZoneAppendCtxT* ctx = Arg;
+
+    if (AppendPiece(ctx) != DDS_ERROR_CODE_SUCCESS) {
+        ctx->SlotContext->Ctx->Response->BytesServiced = 0;
+        ctx->SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+        FinishZoneAppend(ctx);
+    }
 }
 
 //
-// Async read from a file
-// requires block aligned IO
-// 
+// Write to a file on a zoned bdev, which must be a sector aligned append at the end of the file
 //
-ErrorCodeT ReadFile(
+//
+static ErrorCodeT
+AppendFileOnZones(
     FileIdT FileId,
+    struct DPUFile* File,
     FileSizeT Offset,
-    SplittableBufferT *DestBuffer,
+    SplittableBufferT *SourceBuffer,
     DiskIOCallback Callback,
     ContextT Context,
     struct DPUStorage* Sto,
     void *SPDKContext
-) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-    struct DPUFile* file = Sto->AllFiles[FileId];
+){
     struct PerSlotContext* SlotContext = (struct PerSlotContext*)Context;
-    SlotContext->DestBuffer = DestBuffer;
-    FileSizeT remainingBytes = GetSize(file) - Offset;
 
-    FileIOSizeT bytesLeftToRead = DestBuffer->TotalSize;
-    FileSizeT fileSize = GetSize(file);
+    if ((Offset | SourceBuffer->TotalSize) & (DDS_BACKEND_SECTOR_SIZE - 1)) {
+        DPULogWarning("A write of %u bytes at %lu to file %hu on zones is not sector aligned\n",
+            SourceBuffer->TotalSize, Offset, FileId);
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+    if (Offset != GetSize(File)) {
+        DPULogWarning("A write at %lu to file %hu on zones is not at its end, %lu\n", Offset, FileId, GetSize(File));
+        return DDS_ERROR_CODE_INVALID_FILE_POSITION;
+    }
 
-    if (Offset > GetSize(file)) {
-        SPDK_WARNLOG("Offset %lu > GetSize(file) %lu !\n", Offset, GetSize(file));
-        return DDS_ERROR_CODE_IO_FAILURE;
+    ErrorCodeT result = ExtendFileForWrite(FileId, File, Offset, SourceBuffer->TotalSize, Sto, SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS || !SourceBuffer->TotalSize) {
+        return result;
     }
 
-    if (remainingBytes < DestBuffer->TotalSize) {
-        //
-        // bytes serviced can be smaller than requested, probably a client side issue, should not happen
-        //
-        //
-        SPDK_WARNLOG("found remainingBytes < DestBuffer->TotalSize, GetSize(file): %lu, Offset: %lu\n", fileSize, Offset);
-        bytesLeftToRead = (FileIOSizeT)remainingBytes;
+    ZoneAppendCtxT* ctx = malloc(sizeof(ZoneAppendCtxT));
+    if (!ctx) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
     }
 
-    SlotContext->BytesIssued = bytesLeftToRead;
+    ctx->Sto = Sto;
+    ctx->File = File;
+    ctx->Offset = Offset;
+    ctx->SourceBuffer = SourceBuffer;
+    ctx->BytesDone = 0;
+    ctx->Callback = Callback;
+    ctx->SlotContext = SlotContext;
+    ctx->SPDKContext = SPDKContext;
+    ctx->Thread = spdk_get_thread();
+    ctx->Next = NULL;
+    SlotContext->BytesIssued = SourceBuffer->TotalSize;
+
+    LockFile(File);
+    ZoneAppendCtxT* previous = File->AppendTail;
+    if (previous) {
+        previous->Next = ctx;
+    }
+    File->AppendTail = ctx;
+    UnlockFile(File);
 
-    FileSizeT curOffset = Offset;
-    SegmentIdT curSegment;
-    SegmentSizeT offsetOnSegment;
-    SegmentSizeT bytesToIssue;
-    SegmentSizeT remainingBytesOnCurSeg;
-    BufferT DestAddr;
-    
-    while (bytesLeftToRead) {
-        //
-        // Cross-boundary detection
-        //
-        //
-        curSegment = (SegmentIdT)(curOffset / DDS_BACKEND_SEGMENT_SIZE);
-        offsetOnSegment = curOffset % DDS_BACKEND_SEGMENT_SIZE;
-        remainingBytesOnCurSeg = DDS_BACKEND_SEGMENT_SIZE - offsetOnSegment;
+    if (!previous) {
+        StartZoneAppend(ctx);
+    }
+    return DDS_ERROR_CODE_SUCCESS;
+}
+#endif
 
-        FileIOSizeT bytesRead = DestBuffer->TotalSize - bytesLeftToRead;
-        int firstSplitLeftToRead = DestBuffer->FirstSize - bytesRead;
+//
+// Give an append the end of a file as its offset, growing the file past it
+//
+//
+ErrorCodeT ReserveAppend(
+    FileIdT FileId,
+    FileIOSizeT Bytes,
+    FileSizeT* Offset,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    struct DPUFile* file = GetFile(Sto, FileId);
 
-        if (DestBuffer->FirstSize <= bytesRead) {
-            printf("firstSplitLeftToWrite should be <= 0, is: %d\n", firstSplitLeftToRead);
-            printf("total size is: %u\n", DestBuffer->TotalSize);
-        }
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
 
-        if (DestBuffer->FirstSize - bytesRead < 0) {
-            // 
-            // this shall not happen
-            //
-            //
-            SPDK_ERRLOG("int firstSplitLeftToRead = DestBuffer->FirstSize - bytesRead, underflow, %u - %u = %d\n",
-                DestBuffer->FirstSize, bytesRead, firstSplitLeftToRead);
-        }
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // A write on zones must already be at the end of its file when it is issued, which appends placed ahead of
+    // the zone appends of their file cannot promise
+    //
+    //
+    if (Sto->Zoned) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+#endif
 
-        //
-        // May be 1st or 2nd split, the no. of bytes left to read onto it
-        //
-        //
-        FileIOSizeT bytesLeftOnCurrSplit;
-        FileIOSizeT splitBufferOffset;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    if (FileIsSnapshot(file)) {
+        return DDS_ERROR_CODE_READ_ONLY;
+    }
+#endif
 
-        //
-        // it is assumed that both are block size aligned, so that bytesToIssue is always block size aligned
-        // also, bytesToIssue >= bytesLeftOnCurrSplit should always hold true
-        //
-        //
-        bytesToIssue = min(bytesLeftToRead, remainingBytesOnCurSeg);
+    //
+    // The file grows under the lock of its appends, as growing takes the lock of the file itself
+    //
+    //
+    pthread_mutex_lock(&file->AppendMutex);
+    FileSizeT offset = GetSize(file);
+    ErrorCodeT result = ExtendFileForWrite(FileId, file, offset, Bytes, Sto, SPDKContext);
+    pthread_mutex_unlock(&file->AppendMutex);
+
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        *Offset = offset;
+    }
+    return result;
+}
+
+//
+// An atomic operation on a word of a file, which reads the word into a sector of its own;
+// the operations of a file run one at a time, each from the read of its word to the write of the new one
+//
+//
+typedef struct AtomicOpContext {
+    struct DPUStorage* Sto;
+    struct DPUFile* File;
+    FileSizeT Offset;
+    char* Sector;
+    AtomicOpCallbackT Callback;
+    struct PerSlotContext* SlotContext;
+    void *SPDKContext;
+    struct spdk_thread *Thread;
+    struct AtomicOpContext* Next;
+} AtomicOpCtxT;
+
+static void
+AtomicWordReadCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+){
+    AtomicOpCtxT* ctx = Context;
+    uint64_t word;
+
+    spdk_bdev_free_io(bdev_io);
+    memcpy(&word, ctx->Sector + (ctx->Offset & (DDS_BACKEND_SECTOR_SIZE - 1)), sizeof(uint64_t));
+    ctx->Callback(Success ? DDS_ERROR_CODE_SUCCESS : DDS_ERROR_CODE_IO_FAILURE, word, ctx->SlotContext);
+}
+
+//
+// Read the word, on the thread that issued the operation; the file may have shrunk since
+//
+//
+static void
+StartAtomicOp(
+    void *Arg
+){
+    AtomicOpCtxT* ctx = Arg;
+
+    if (ctx->Offset + sizeof(uint64_t) > GetSize(ctx->File)) {
+        ctx->Callback(DDS_ERROR_CODE_INVALID_FILE_POSITION, 0, ctx->SlotContext);
+        return;
+    }
+    if (SegmentIsHole(ctx->File, (SegmentIdT)(ctx->Offset >> DDS_BACKEND_SEGMENT_SHIFT))) {
+        ctx->Callback(DDS_ERROR_CODE_SUCCESS, 0, ctx->SlotContext);
+        return;
+    }
 
+    FileSizeT sector = ctx->Offset & ~((FileSizeT)DDS_BACKEND_SECTOR_SIZE - 1);
+    DiskSizeT diskAddress = GetSegmentAddress(ctx->File, sector >> DDS_BACKEND_SEGMENT_SHIFT) +
+        (sector & DDS_BACKEND_SEGMENT_MASK);
+    if (ReadFromDiskAsyncZC(ctx->Sector, diskAddress, DDS_BACKEND_SECTOR_SIZE,
+        AtomicWordReadCallback, ctx, ctx->Sto, ctx->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        ctx->Callback(DDS_ERROR_CODE_IO_FAILURE, 0, ctx->SlotContext);
+    }
+}
 
-        if (firstSplitLeftToRead > 0) {
-            //
-            // First addr
-            //
-            //
-            DestAddr = DestBuffer->FirstAddr;
-            bytesLeftOnCurrSplit = firstSplitLeftToRead;
-            splitBufferOffset = bytesRead;
-        }
-        else {
-            //
-            // Second addr
-            //
-            //
-            SPDK_NOTICELOG("reading into second split, bytesLeftToRead: %d\n", bytesLeftToRead);
-            DestAddr = DestBuffer->SecondAddr;
-            bytesLeftOnCurrSplit = bytesLeftToRead;
-            splitBufferOffset = bytesRead - DestBuffer->FirstSize;
-        }
+//
+// Read the word of a file for an atomic operation
+//
+//
+ErrorCodeT ReadAtomicWord(
+    FileIdT FileId,
+    FileSizeT Offset,
+    AtomicOpCallbackT Callback,
+    struct PerSlotContext* SlotContext,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    struct DPUFile* file = GetFile(Sto, FileId);
 
-        //
-        // If bytes to issue can all fit on curr split, then we don't need sg IO
-        //
-        //
-        if (bytesLeftOnCurrSplit >= bytesToIssue) {
-#ifdef OPT_FILE_SERVICE_ZERO_COPY
-                result = ReadFromDiskAsyncZC(
-                    DestAddr + splitBufferOffset,
-                    curSegment,
-                    offsetOnSegment,
-                    bytesToIssue,
-                    Callback,
-                    Context,
-                    Sto,
-                    SPDKContext
-                );
-#else
-                result = ReadFromDiskAsyncNonZC(
-                    bytesRead,
-                    curSegment,
-                    offsetOnSegment,
-                    bytesToIssue,
-                    Callback,
-                    Context,
-                    Sto,
-                    SPDKContext
-                );
-#endif
-        }
-        else {
-            //
-            // We need sg, and exactly 2 iovec's, one on 1st split, the other on 2nd split
-            //
-            //
-            if (!(DestAddr == DestBuffer->FirstAddr)) {
-                SPDK_ERRLOG("ERROR: SG start addr is not FirstAddr\n");
-            }
-            SlotContext->Iov[0].iov_base = DestAddr + splitBufferOffset;
-            SlotContext->Iov[0].iov_len = bytesLeftOnCurrSplit;
+    SlotContext->AtomicOp = NULL;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
 
-            SlotContext->Iov[1].iov_base = DestBuffer->SecondAddr;
-            SlotContext->Iov[1].iov_len = bytesToIssue - bytesLeftOnCurrSplit;
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // Files on zones are only appended to
+    //
+    //
+    if (Sto->Zoned) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+#endif
 
-#ifdef OPT_FILE_SERVICE_ZERO_COPY
-                result = ReadvFromDiskAsyncZC(
-                    SlotContext->Iov,
-                    2,
-                    curSegment,
-                    offsetOnSegment,
-                    bytesToIssue,
-                    Callback,
-                    Context,
-                    Sto,
-                    SPDKContext
-                );
-#else
-                result = ReadvFromDiskAsyncNonZC(
-                    SlotContext->Iov,
-                    2,
-                    bytesRead,
-                    curSegment,
-                    offsetOnSegment,
-                    bytesToIssue,
-                    Callback,
-                    Context,
-                    Sto,
-                    SPDKContext
-                );
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    if (FileIsSnapshot(file)) {
+        return DDS_ERROR_CODE_READ_ONLY;
+    }
 #endif
-        }
 
-        if (result != DDS_ERROR_CODE_SUCCESS) {
-            SPDK_WARNLOG("ReadFromDiskAsync() failed with ret: %d\n", result);
-            SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
-            SlotContext->Ctx->Response->BytesServiced = 0;
-            return result;
-        }
-        else {
-            SlotContext->CallbacksToRun += 1;
-        }
+    AtomicOpCtxT* ctx = malloc(sizeof(AtomicOpCtxT));
+    if (!ctx) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    ctx->Sector = spdk_dma_malloc(DDS_BACKEND_SECTOR_SIZE, DDS_BACKEND_SECTOR_SIZE, NULL);
+    if (!ctx->Sector) {
+        free(ctx);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
 
-        curOffset += bytesToIssue;
-        bytesLeftToRead -= bytesToIssue;
+    ctx->Sto = Sto;
+    ctx->File = file;
+    ctx->Offset = Offset;
+    ctx->Callback = Callback;
+    ctx->SlotContext = SlotContext;
+    ctx->SPDKContext = SPDKContext;
+    ctx->Thread = spdk_get_thread();
+    ctx->Next = NULL;
+    SlotContext->AtomicOp = ctx;
+
+    LockFile(file);
+    AtomicOpCtxT* previous = file->AtomicOpTail;
+    if (previous) {
+        previous->Next = ctx;
     }
+    file->AtomicOpTail = ctx;
+    UnlockFile(file);
 
-    return result;
+    if (!previous) {
+        StartAtomicOp(ctx);
+    }
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
+//
+// Let the next atomic operation of the file run, on the thread that issued it
+//
+//
+void AtomicOpDone(
+    struct PerSlotContext* SlotContext
+){
+    AtomicOpCtxT* ctx = SlotContext->AtomicOp;
+    if (!ctx) {
+        return;
+    }
+    SlotContext->AtomicOp = NULL;
+
+    LockFile(ctx->File);
+    AtomicOpCtxT* next = ctx->Next;
+    if (ctx->File->AtomicOpTail == ctx) {
+        ctx->File->AtomicOpTail = NULL;
+    }
+    UnlockFile(ctx->File);
+
+    if (next) {
+        spdk_thread_send_msg(next->Thread, StartAtomicOp, next);
+    }
+
+    spdk_dma_free(ctx->Sector);
+    free(ctx);
+}
 
 //
-// Async write to a file
+// Async write to a file;
+// a write that is not sector aligned goes through WriteFileUnaligned
 // 
 //
 ErrorCodeT WriteFile(
@@ -1718,66 +4154,58 @@ ErrorCodeT WriteFile(
     struct DPUStorage* Sto,
     void *SPDKContext
 ){
-    struct DPUFile* file = Sto->AllFiles[FileId];
-    FileSizeT newSize = Offset + SourceBuffer->TotalSize;
+    struct DPUFile* file = GetFile(Sto, FileId);
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
     struct PerSlotContext* SlotContext = (struct PerSlotContext*)Context;
+    FileSizeT oldSize = GetSize(file);
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        return AppendFileOnZones(FileId, file, Offset, SourceBuffer, Callback, Context, Sto, SPDKContext);
+    }
+#endif
+
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    if (FileIsSnapshot(file)) {
+        return DDS_ERROR_CODE_READ_ONLY;
+    }
 
     //
-    // Check if allocation is needed
+    // A write to segments shared with snapshots goes again once they are copied
     //
     //
-    FileSizeT currentFileSize = GetFileProperties(file)->FProperties.FileSize;
-    long long sizeToChange = newSize - currentFileSize;
-
-    if (sizeToChange >= 0) {
-        // SPDK_NOTICELOG("file size changed, new size: %llu\n", newSize);
-        size_t numSeg = GetNumSegments(file);
-        SegmentSizeT remainingAllocatedSize = (SegmentSizeT)(numSeg * DDS_BACKEND_SEGMENT_SIZE - currentFileSize);
-        long long bytesToBeAllocated = sizeToChange - (long long)remainingAllocatedSize;
-
-        if (bytesToBeAllocated > 0) {
-            SegmentIdT numSegmentsToAllocate = (SegmentIdT)(
-                bytesToBeAllocated / DDS_BACKEND_SEGMENT_SIZE +
-                (bytesToBeAllocated % DDS_BACKEND_SEGMENT_SIZE == 0 ? 0 : 1)
-                );
-
-            //
-            // Allocate segments
-            //
-            //
-            pthread_mutex_lock(&Sto->SegmentAllocationMutex);
-
-            if (numSegmentsToAllocate > Sto->AvailableSegments) {
-                SPDK_ERRLOG("Need to allocate seg for file, but not enough available segs left!\n");
-                pthread_mutex_unlock(&Sto->SegmentAllocationMutex);
-                return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
-            }
-
-            SegmentIdT allocatedSegments = 0;
-            for (SegmentIdT s = 0; s != Sto->TotalSegments; s++) {
-                SegmentT* seg = &Sto->AllSegments[s];
-                if (seg->Allocatable && seg->FileId == DDS_FILE_INVALID) {
-                    AllocateSegment(s,file);
-                    seg->FileId = FileId;
-                    allocatedSegments++;
-                    if (allocatedSegments == numSegmentsToAllocate) {
-                        break;
-                    }
-                }
-            }
-
-            pthread_mutex_unlock(&Sto->SegmentAllocationMutex);
+    if (WriteNeedsSegmentCopy(Sto, file, Offset, SourceBuffer->TotalSize)) {
+        SnapshotWaiterT write = {
+            .FileId = FileId,
+            .Offset = Offset,
+            .Bytes = SourceBuffer->TotalSize,
+            .SourceBuffer = SourceBuffer,
+            .Callback = Callback,
+            .Context = Context,
+            .SPDKContext = SPDKContext
+        };
+        bool held;
+        result = HoldWriteForSegmentCopy(Sto, file, &write, &held);
+        if (result != DDS_ERROR_CODE_SUCCESS || held) {
+            return result;
         }
+    }
+#endif
 
-        SetSize(newSize,file);
+    result = ExtendFileForWrite(FileId, file, Offset, SourceBuffer->TotalSize, Sto, SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    if ((Offset | SourceBuffer->TotalSize) & (DDS_BACKEND_SECTOR_SIZE - 1)) {
+        return WriteFileUnaligned(file, Offset, oldSize, SourceBuffer, Callback, Context, Sto, SPDKContext);
     }
 
     FileIOSizeT bytesLeftToWrite = SourceBuffer->TotalSize;
     SlotContext->BytesIssued = bytesLeftToWrite;
 
     FileSizeT curOffset = Offset;
-    SegmentIdT curSegment;
+    DiskSizeT diskAddress;
     SegmentSizeT offsetOnSegment;
     SegmentSizeT bytesToIssue;
     SegmentSizeT remainingBytesOnCurSeg;
@@ -1788,16 +4216,16 @@ ErrorCodeT WriteFile(
         // Cross-boundary detection
         //
         //
-        curSegment = (SegmentIdT)(curOffset / DDS_BACKEND_SEGMENT_SIZE);
-        offsetOnSegment = curOffset % DDS_BACKEND_SEGMENT_SIZE;
+        offsetOnSegment = (SegmentSizeT)(curOffset & DDS_BACKEND_SEGMENT_MASK);
+        diskAddress = GetSegmentAddress(file, curOffset >> DDS_BACKEND_SEGMENT_SHIFT) + offsetOnSegment;
         remainingBytesOnCurSeg = DDS_BACKEND_SEGMENT_SIZE - offsetOnSegment;
 
         FileIOSizeT bytesWritten = SourceBuffer->TotalSize - bytesLeftToWrite;
         int firstSplitLeftToWrite = SourceBuffer->FirstSize - bytesWritten;
 
         if (SourceBuffer->FirstSize <= bytesWritten) {
-            printf("firstSplitLeftToWrite should be <= 0, is: %d\n", firstSplitLeftToWrite);
-            printf("total size is: %u\n", SourceBuffer->TotalSize);
+            DPULogTrace("firstSplitLeftToWrite should be <= 0, is: %d, total size is: %u\n",
+                firstSplitLeftToWrite, SourceBuffer->TotalSize);
         }
 
         //
@@ -1823,7 +4251,7 @@ ErrorCodeT WriteFile(
             // Writing from second addr
             //
             //
-            SPDK_NOTICELOG("Writing from second split, bytesLeftToWrite: %d\n", bytesLeftToWrite);
+            DPULogTrace("Writing from second split, bytesLeftToWrite: %d\n", bytesLeftToWrite);
             SourceAddr = SourceBuffer->SecondAddr;
             bytesLeftOnCurrSplit = bytesLeftToWrite;
             splitBufferOffset = bytesWritten - SourceBuffer->FirstSize;
@@ -1837,8 +4265,7 @@ ErrorCodeT WriteFile(
 #ifdef OPT_FILE_SERVICE_ZERO_COPY
             result = WriteToDiskAsyncZC(
                 SourceAddr + splitBufferOffset,
-                curSegment,
-                offsetOnSegment,
+                diskAddress,
                 bytesToIssue,
                 Callback,
                 SlotContext,
@@ -1849,8 +4276,7 @@ ErrorCodeT WriteFile(
                 result = WriteToDiskAsyncNonZC(
                     SourceAddr + splitBufferOffset,
                     bytesWritten,
-                    curSegment,
-                    offsetOnSegment,
+                    diskAddress,
                     bytesToIssue,
                     Callback,
                     SlotContext,
@@ -1874,8 +4300,7 @@ ErrorCodeT WriteFile(
                 result = WritevToDiskAsyncZC(
                     &SlotContext->Iov[0],
                     2,
-                    curSegment,
-                    offsetOnSegment,
+                    diskAddress,
                     bytesToIssue,
                     Callback,
                     Context,
@@ -1887,8 +4312,7 @@ ErrorCodeT WriteFile(
                     &SlotContext->Iov[0],
                     2,
                     bytesWritten,
-                    curSegment,
-                    offsetOnSegment,
+                    diskAddress,
                     bytesToIssue,
                     Callback,
                     Context,
@@ -1899,7 +4323,7 @@ ErrorCodeT WriteFile(
         }
 
         if (result != DDS_ERROR_CODE_SUCCESS) {
-            SPDK_WARNLOG("WriteToDiskAsync() failed with ret: %d\n", result);
+            DPULogWarning("WriteToDiskAsync() failed with ret: %d\n", result);
             SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
             SlotContext->Ctx->Response->BytesServiced = 0;
             return result;
@@ -1915,6 +4339,68 @@ ErrorCodeT WriteFile(
     return result;
 }
 
+//
+// Async write of adjacent writes coalesced into one, with zero copy;
+// the range must be sector aligned and on a single segment
+//
+//
+ErrorCodeT WriteFileGather(
+    FileIdT FileId,
+    FileSizeT Offset,
+    struct iovec *Iov,
+    int IovCnt,
+    FileIOSizeT Bytes,
+    DiskIOCallback Callback,
+    ContextT Context,
+    struct DPUStorage* Sto,
+    void *SPDKContext
+){
+    struct DPUFile* file = GetFile(Sto, FileId);
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // Writes to zones are not coalesced, see CoalesceWrites
+    //
+    //
+    if (Sto->Zoned) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+#endif
+
+    ErrorCodeT result;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    if (FileIsSnapshot(file)) {
+        return DDS_ERROR_CODE_READ_ONLY;
+    }
+    if (WriteNeedsSegmentCopy(Sto, file, Offset, Bytes)) {
+        SnapshotWaiterT write = {
+            .FileId = FileId,
+            .Offset = Offset,
+            .Bytes = Bytes,
+            .Iov = Iov,
+            .IovCnt = IovCnt,
+            .Callback = Callback,
+            .Context = Context,
+            .SPDKContext = SPDKContext
+        };
+        bool held;
+        result = HoldWriteForSegmentCopy(Sto, file, &write, &held);
+        if (result != DDS_ERROR_CODE_SUCCESS || held) {
+            return result;
+        }
+    }
+#endif
+
+    result = ExtendFileForWrite(FileId, file, Offset, Bytes, Sto, SPDKContext);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    DiskSizeT diskAddress = GetSegmentAddress(file, Offset >> DDS_BACKEND_SEGMENT_SHIFT) +
+        (Offset & DDS_BACKEND_SEGMENT_MASK);
+    return WritevToDiskAsyncZC(Iov, IovCnt, diskAddress, Bytes, Callback, Context, Sto, SPDKContext);
+}
+
 //
 // Get file properties by file id
 // 
@@ -1925,7 +4411,7 @@ ErrorCodeT GetFileInformationById(
     struct DPUStorage* Sto,
     CtrlMsgB2FAckGetFileInfo *Resp
 ){
-    struct DPUFile* file = Sto->AllFiles[FileId];
+    struct DPUFile* file = GetFile(Sto, FileId);
     if (!file) {
         Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
         return DDS_ERROR_CODE_FILE_NOT_FOUND;
@@ -1949,7 +4435,7 @@ GetFileAttributes(
     struct DPUStorage* Sto,
     CtrlMsgB2FAckGetFileAttr *Resp
 ){
-    struct DPUFile* file = Sto->AllFiles[FileId];
+    struct DPUFile* file = GetFile(Sto, FileId);
     if (!file) {
         Resp->Result = DDS_ERROR_CODE_FILE_NOT_FOUND;
         return DDS_ERROR_CODE_FILE_NOT_FOUND;
@@ -1969,71 +4455,11 @@ ErrorCodeT GetStorageFreeSpace(
     struct DPUStorage* Sto,
     CtrlMsgB2FAckGetFreeSpace *Resp
 ){
-    pthread_mutex_lock(&Sto->SegmentAllocationMutex);
-
-    *StorageFreeSpace = Sto->AvailableSegments * (FileSizeT)DDS_BACKEND_SEGMENT_SIZE;
-
-    pthread_mutex_unlock(&Sto->SegmentAllocationMutex);
+    *StorageFreeSpace = atomic_load(&Sto->AvailableSegments) * (FileSizeT)DDS_BACKEND_SEGMENT_SIZE;
     Resp->Result = DDS_ERROR_CODE_SUCCESS;
     return DDS_ERROR_CODE_SUCCESS;
 }
 
-void MoveFileCallback2(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {
-        Unlock(HandlerCtx->NewDir);
-        SetName(HandlerCtx->NewFileName, HandlerCtx->File);
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_SUCCESS;
-        free(HandlerCtx);
-    }
-    else {
-        SPDK_ERRLOG("RemoveDirectoryCallback2() failed\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-    }
-}
-
-void MoveFileCallback1(struct spdk_bdev_io *bdev_io, bool Success, ContextT Context) {
-    ControlPlaneHandlerCtx *HandlerCtx = Context;
-    spdk_bdev_free_io(bdev_io);
-    if (Success) {  
-        Unlock(HandlerCtx->dir);
-
-        //
-        // Update new directory
-        //
-        //
-        Lock(HandlerCtx->NewDir);
-    
-        ErrorCodeT result = AddFile(HandlerCtx->FileId, HandlerCtx->NewDir);
-
-        if (result != DDS_ERROR_CODE_SUCCESS) {
-            Unlock(HandlerCtx->NewDir);
-            *(HandlerCtx->Result) = result;
-        }
-        result = SyncDirToDisk(HandlerCtx->NewDir, Sto, HandlerCtx->SPDKContext,
-            MoveFileCallback2, HandlerCtx);
-        if (result != 0) {
-            //
-            // Fatal, can't continue, and the callback won't run
-            //
-            //
-            SPDK_ERRLOG("MoveFileCallback1() returned %hu\n", result);
-            Unlock(HandlerCtx->NewDir);
-            *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-        }
-        //
-        // Else, the callback passed to it should be guaranteed to run
-        //
-        //
-    }
-    else {
-        Unlock(HandlerCtx->dir);
-        SPDK_ERRLOG("MoveFileCallback1() failed, can't create directory\n");
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-    }
-}
-
 //
 // Move an existing file or a directory,
 // including its children
@@ -2049,40 +4475,32 @@ ErrorCodeT MoveFile(
     ControlPlaneHandlerCtx *HandlerCtx
 ){
     HandlerCtx->SPDKContext = SPDKContext;
-    struct DPUFile* file = Sto->AllFiles[FileId];
-    struct DPUDir* OldDir = Sto->AllDirs[OldDirId];
-    struct DPUDir* NewDir = Sto->AllDirs[NewDirId];
-    if (!file) {
+    if (!GetFile(Sto, FileId)) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_FILE_NOT_FOUND;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if (!GetDir(Sto, OldDirId) || !GetDir(Sto, NewDirId)) {
         *(HandlerCtx->Result) = DDS_ERROR_CODE_DIR_NOT_FOUND;
+        free(HandlerCtx);
         return DDS_ERROR_CODE_DIR_NOT_FOUND;
     }
-    if (!OldDir || !NewDir) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_FILE_NOT_FOUND;
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    pthread_mutex_lock(&Sto->Journal->Mutex);
+    FileIdT existing = FindFileByName(Sto, NewFileName);
+    pthread_mutex_unlock(&Sto->Journal->Mutex);
+    if (existing != DDS_FILE_INVALID && existing != FileId) {
+        *(HandlerCtx->Result) = DDS_ERROR_CODE_FILE_EXISTS;
+        free(HandlerCtx);
+        return DDS_ERROR_CODE_FILE_EXISTS;
     }
 
-    //
-    // Update old directory
-    //
-    //
-    Lock(OldDir);
-
-    ErrorCodeT result = DeleteFile(FileId, OldDir);
-
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        Unlock(OldDir);
-        *(HandlerCtx->Result) = result;
-        return result;
-    }
-    HandlerCtx->dir = OldDir;
-    HandlerCtx->NewDir = NewDir;
-    HandlerCtx->FileId = FileId;
-    HandlerCtx->File = file;
-    strcpy(HandlerCtx->NewFileName, NewFileName);
-    result = SyncDirToDisk(OldDir, Sto, SPDKContext, MoveFileCallback1, HandlerCtx);
+    DPUJournalRecordT record;
+    memset(&record, 0, sizeof(record));
+    record.Type = DDS_JOURNAL_RECORD_MOVE_FILE;
+    record.File.Id = FileId;
+    record.File.DirId = OldDirId;
+    record.File.NewDirId = NewDirId;
+    strncpy(record.File.Name, NewFileName, DDS_MAX_FILE_PATH - 1);
 
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        *(HandlerCtx->Result) = DDS_ERROR_CODE_IO_FAILURE;
-    }
-    return result;
+    return CommitControlPlaneRecord(&record, Sto, SPDKContext, HandlerCtx);
 }
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "DPUBackEndTier.h"
+#include "DPULog.h"
+
+#ifdef OPT_FILE_SERVICE_TIERING
+#define DDS_BACKEND_TIER_STEPS_PER_RUN 256
+
+//
+// Set up the segments of the capacity bdev of the context, if it has one; there is none on zoned storage
+//
+//
+ErrorCodeT TierInit(
+    struct DPUStorage* Sto,
+    SPDKContextT* SPDKContext
+){
+    if (!SPDKContext->tier_bdev) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        SPDK_WARNLOG("The store is zoned, nothing will be moved to the capacity bdev\n");
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+#endif
+
+    DiskSizeT tierSegments = spdk_bdev_get_num_blocks(SPDKContext->tier_bdev) *
+        spdk_bdev_get_block_size(SPDKContext->tier_bdev) / DDS_BACKEND_SEGMENT_SIZE;
+    tierSegments = min(tierSegments, (DiskSizeT)(INT_MAX - DDS_BACKEND_MAX_SEGMENTS));
+    if (!tierSegments) {
+        SPDK_WARNLOG("The capacity bdev is smaller than a segment, nothing will be moved to it\n");
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    struct DPUTier* tier = calloc(1, sizeof(struct DPUTier));
+    if (!tier) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    size_t words = (tierSegments + 63) / 64;
+    tier->FreeBits = malloc(words * sizeof(uint64_t));
+    if (!tier->FreeBits) {
+        free(tier);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    memset(tier->FreeBits, 0xFF, words * sizeof(uint64_t));
+    if (tierSegments % 64) {
+        tier->FreeBits[words - 1] = (1ULL << (tierSegments % 64)) - 1;
+    }
+
+    tier->NumSegments = (SegmentIdT)tierSegments;
+    tier->FreeSegments = tier->NumSegments;
+    tier->ColdTicks = spdk_get_ticks_hz() * 86400 * G_TIER_COLD_DAYS;
+    atomic_init(&tier->SegmentsDemoted, 0);
+    atomic_init(&tier->SegmentsRecalled, 0);
+    pthread_mutex_init(&tier->Mutex, NULL);
+    Sto->Tier = tier;
+
+    SPDK_NOTICELOG("The capacity bdev has %d segments\n", tier->NumSegments);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the segments of the capacity bdev
+//
+//
+void TierDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUTier* tier = Sto->Tier;
+    if (!tier) {
+        return;
+    }
+
+    SPDK_NOTICELOG("Tiering moved %lu segments to the capacity bdev and %lu back, %d of %d are free\n",
+        atomic_load(&tier->SegmentsDemoted), atomic_load(&tier->SegmentsRecalled), tier->FreeSegments, tier->NumSegments);
+
+    free(tier->FreeBits);
+    pthread_mutex_destroy(&tier->Mutex);
+    free(tier);
+    Sto->Tier = NULL;
+}
+
+//
+// Take a given segment of the capacity bdev off the free ones, used when loading files and replaying the journal
+//
+//
+void TierClaimSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+){
+    struct DPUTier* tier = Sto->Tier;
+    SegmentIdT s = SegmentId - (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS;
+    uint64_t bit = 1ULL << (s % 64);
+
+    pthread_mutex_lock(&tier->Mutex);
+    if (tier->FreeBits[s / 64] & bit) {
+        tier->FreeBits[s / 64] &= ~bit;
+        tier->FreeSegments--;
+    }
+    pthread_mutex_unlock(&tier->Mutex);
+}
+
+//
+// Claim a free segment of the capacity bdev for a file, the first one from where the last was claimed
+//
+//
+bool TierClaimFreeSegment(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    SegmentIdT* Segment
+){
+    struct DPUTier* tier = Sto->Tier;
+    SegmentIdT words = (tier->NumSegments + 63) / 64;
+    SegmentIdT found = DDS_BACKEND_SEGMENT_INVALID;
+
+    pthread_mutex_lock(&tier->Mutex);
+    if (tier->FreeSegments) {
+        for (SegmentIdT w = 0, word = tier->NextFree / 64; w <= words; w++, word = (word + 1) % words) {
+            if (tier->FreeBits[word]) {
+                found = word * 64 + __builtin_ctzll(tier->FreeBits[word]);
+                tier->FreeBits[word] &= tier->FreeBits[word] - 1;
+                tier->FreeSegments--;
+                tier->NextFree = found;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&tier->Mutex);
+
+    if (found == DDS_BACKEND_SEGMENT_INVALID) {
+        return false;
+    }
+
+    *Segment = (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS + found;
+    Sto->AllSegments[*Segment].FileId = FileId;
+    return true;
+}
+
+//
+// Give a segment of the capacity bdev back
+//
+//
+void TierReleaseSegment(
+    struct DPUStorage* Sto,
+    SegmentIdT SegmentId
+){
+    struct DPUTier* tier = Sto->Tier;
+    SegmentIdT s = SegmentId - (SegmentIdT)DDS_BACKEND_MAX_SEGMENTS;
+    uint64_t bit = 1ULL << (s % 64);
+
+    pthread_mutex_lock(&tier->Mutex);
+    if (!(tier->FreeBits[s / 64] & bit)) {
+        tier->FreeBits[s / 64] |= bit;
+        tier->FreeSegments++;
+    }
+    pthread_mutex_unlock(&tier->Mutex);
+}
+
+//
+// Look for a segment to move, a bounded number of slots per run: a cold segment of a file that was read
+// since it was moved to be moved back, or a segment of a file that is cold to be moved to the capacity bdev;
+// called with the mutex of the defragmentation held
+//
+//
+bool TierFindMove(
+    struct DPUStorage* Sto,
+    struct DPUFile** File,
+    FileIdT* FileId,
+    SegmentIdT* Slot,
+    bool* Recall
+){
+    struct DPUTier* tier = Sto->Tier;
+    uint64_t now = spdk_get_ticks();
+
+    for (int step = 0; step != DDS_BACKEND_TIER_STEPS_PER_RUN; step++) {
+        if (tier->NextFile >= DDS_MAX_FILES) {
+            tier->NextFile = 0;
+        }
+
+        FileIdT fileId = tier->NextFile;
+        struct DPUFile* file = GetFile(Sto, fileId);
+        if (!file || FileIsChecksummed(file)) {
+            tier->NextFile++;
+            tier->NextSlot = 0;
+            continue;
+        }
+
+        //
+        // A file is moved back from its first segment, so that its reads start on the fast path first
+        //
+        //
+        bool recall = atomic_load_explicit(&file->RecallWanted, memory_order_relaxed);
+        uint64_t lastTouched = max(atomic_load_explicit(&file->LastReadTicks, memory_order_relaxed),
+            atomic_load_explicit(&file->LastWriteTicks, memory_order_relaxed));
+        if (tier->NextSlot >= GetNumSegments(file) || (!recall && now - lastTouched < tier->ColdTicks)) {
+            if (recall && tier->NextSlot >= GetNumSegments(file)) {
+                atomic_store_explicit(&file->RecallWanted, false, memory_order_relaxed);
+            }
+            tier->NextFile++;
+            tier->NextSlot = 0;
+            continue;
+        }
+
+        SegmentIdT slot = tier->NextSlot++;
+        SegmentIdT segment = GetSegment(file, slot);
+        if (segment == DDS_BACKEND_SEGMENT_INVALID || SegmentIsCold(segment) != recall ||
+            (!recall && !tier->FreeSegments)) {
+            continue;
+        }
+
+        *File = file;
+        *FileId = fileId;
+        *Slot = slot;
+        *Recall = recall;
+        return true;
+    }
+
+    return false;
+}
+#endif
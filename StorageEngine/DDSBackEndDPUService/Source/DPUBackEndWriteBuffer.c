@@ -0,0 +1,723 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "DPUBackEndWriteBuffer.h"
+#include "DataPlaneHandlers.h"
+#include "DPULog.h"
+#include "ResponseCache.h"
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+#define DDS_BACKEND_WRITE_BUFFER_NONE -1
+#define DDS_BACKEND_WRITE_BUFFER_FLUSHES_PER_SHARD 32
+
+static inline uint64_t
+HashOfWindow(
+    FileIdT FileId,
+    FileSizeT Offset
+){
+    return ((Offset / DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES) ^ ((uint64_t)FileId << 48)) * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline WriteBufferShardT*
+ShardOfWindow(
+    struct DPUWriteBuffer* Buffer,
+    FileIdT FileId,
+    FileSizeT Offset
+){
+    return &Buffer->Shards[(HashOfWindow(FileId, Offset) >> 32) % DDS_BACKEND_WRITE_BUFFER_SHARDS];
+}
+
+static inline int32_t*
+BucketOfWindow(
+    WriteBufferShardT* Shard,
+    FileIdT FileId,
+    FileSizeT Offset
+){
+    return &Shard->Buckets[(HashOfWindow(FileId, Offset) >> 16) & Shard->BucketMask];
+}
+
+static inline bool
+TestSector(
+    const uint64_t* Bits,
+    uint32_t Sector
+){
+    return (Bits[Sector / 64] >> (Sector % 64)) & 1;
+}
+
+static inline void
+SetSectors(
+    uint64_t* Bits,
+    uint32_t First,
+    uint32_t End
+){
+    for (uint32_t s = First; s < End; s++) {
+        Bits[s / 64] |= 1ULL << (s % 64);
+    }
+}
+
+static inline void
+ClearSectors(
+    uint64_t* Bits,
+    uint32_t First,
+    uint32_t End
+){
+    for (uint32_t s = First; s < End; s++) {
+        Bits[s / 64] &= ~(1ULL << (s % 64));
+    }
+}
+
+static inline bool
+AllSectors(
+    const uint64_t* Bits,
+    uint32_t First,
+    uint32_t End
+){
+    for (uint32_t s = First; s < End; s++) {
+        if (!TestSector(Bits, s)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline bool
+AnySectors(
+    const uint64_t* Bits,
+    uint32_t First,
+    uint32_t End
+){
+    for (uint32_t s = First; s < End; s++) {
+        if (TestSector(Bits, s)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool
+AnyBits(
+    const uint64_t* Bits
+){
+    for (int w = 0; w != DDS_BACKEND_WRITE_BUFFER_WINDOW_WORDS; w++) {
+        if (Bits[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// The window of a file at Offset, NULL if the buffer has none
+//
+//
+static WriteBufferWindowT*
+FindWindow(
+    WriteBufferShardT* Shard,
+    FileIdT FileId,
+    FileSizeT Offset
+){
+    for (int32_t w = *BucketOfWindow(Shard, FileId, Offset); w != DDS_BACKEND_WRITE_BUFFER_NONE;
+        w = Shard->Windows[w].Next) {
+        if (Shard->Windows[w].FileId == FileId && Shard->Windows[w].Offset == Offset) {
+            return &Shard->Windows[w];
+        }
+    }
+    return NULL;
+}
+
+//
+// A free window for the window of a file at Offset, NULL if the shard has none left
+//
+//
+static WriteBufferWindowT*
+TakeWindow(
+    struct DPUWriteBuffer* Buffer,
+    WriteBufferShardT* Shard,
+    FileIdT FileId,
+    FileSizeT Offset
+){
+    if (Shard->FreeList == DDS_BACKEND_WRITE_BUFFER_NONE) {
+        return NULL;
+    }
+
+    int32_t self = Shard->FreeList;
+    WriteBufferWindowT* window = &Shard->Windows[self];
+    int32_t* bucket = BucketOfWindow(Shard, FileId, Offset);
+
+    Shard->FreeList = window->Next;
+    Shard->NumFree--;
+    window->FileId = FileId;
+    window->Offset = Offset;
+    memset(window->Valid, 0, sizeof(window->Valid));
+    memset(window->Dirty, 0, sizeof(window->Dirty));
+    memset(window->Flushing, 0, sizeof(window->Flushing));
+    window->DirtyTicks = 0;
+    window->Urgent = false;
+    window->FlushOwner = NULL;
+    window->FlushSlot = NULL;
+    window->Next = *bucket;
+    *bucket = self;
+    window->UsedIndex = Shard->NumUsed;
+    Shard->Used[Shard->NumUsed++] = (uint32_t)self;
+    atomic_fetch_add_explicit(&Buffer->WindowsUsed, 1, memory_order_relaxed);
+
+    return window;
+}
+
+//
+// Give a window back if it is clean and no write back of it is in flight; return whether it is given back,
+// which moves the last window in use to its place among them
+//
+//
+static bool
+DropWindowIfClean(
+    struct DPUWriteBuffer* Buffer,
+    WriteBufferShardT* Shard,
+    WriteBufferWindowT* Window
+){
+    if (Window->FlushOwner || AnyBits(Window->Dirty)) {
+        return false;
+    }
+
+    int32_t self = (int32_t)(Window - Shard->Windows);
+    int32_t* link = BucketOfWindow(Shard, Window->FileId, Window->Offset);
+    while (*link != self) {
+        link = &Shard->Windows[*link].Next;
+    }
+    *link = Window->Next;
+
+    uint32_t last = Shard->Used[--Shard->NumUsed];
+    Shard->Used[Window->UsedIndex] = last;
+    Shard->Windows[last].UsedIndex = Window->UsedIndex;
+
+    Window->Next = Shard->FreeList;
+    Shard->FreeList = self;
+    Shard->NumFree++;
+    atomic_fetch_sub_explicit(&Buffer->WindowsUsed, 1, memory_order_relaxed);
+
+    return true;
+}
+
+static ErrorCodeT
+InitShard(
+    WriteBufferShardT* Shard,
+    uint32_t NumWindows
+){
+    uint32_t numBuckets = 1;
+    while (numBuckets < NumWindows) {
+        numBuckets <<= 1;
+    }
+
+    Shard->NumWindows = NumWindows;
+    Shard->BucketMask = numBuckets - 1;
+    Shard->Windows = aligned_alloc(DDS_CACHE_LINE_SIZE, (size_t)NumWindows * sizeof(WriteBufferWindowT));
+    Shard->Data = spdk_dma_zmalloc((size_t)NumWindows * DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES, DDS_BACKEND_PAGE_SIZE, NULL);
+    Shard->Buckets = malloc(numBuckets * sizeof(int32_t));
+    Shard->Used = malloc(NumWindows * sizeof(uint32_t));
+    if (!Shard->Windows || !Shard->Data || !Shard->Buckets || !Shard->Used) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    memset(Shard->Windows, 0, (size_t)NumWindows * sizeof(WriteBufferWindowT));
+    for (uint32_t b = 0; b != numBuckets; b++) {
+        Shard->Buckets[b] = DDS_BACKEND_WRITE_BUFFER_NONE;
+    }
+    for (uint32_t w = 0; w != NumWindows; w++) {
+        Shard->Windows[w].Data = Shard->Data + (size_t)w * DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES;
+        Shard->Windows[w].Next = w + 1 == NumWindows ? DDS_BACKEND_WRITE_BUFFER_NONE : (int32_t)(w + 1);
+    }
+    Shard->FreeList = 0;
+    Shard->NumFree = NumWindows;
+    Shard->NumUsed = 0;
+    pthread_mutex_init(&Shard->Mutex, NULL);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+static void
+DestroyShard(
+    WriteBufferShardT* Shard
+){
+    free(Shard->Windows);
+    if (Shard->Data) {
+        spdk_dma_free(Shard->Data);
+    }
+    free(Shard->Buckets);
+    free(Shard->Used);
+    if (Shard->NumWindows) {
+        pthread_mutex_destroy(&Shard->Mutex);
+    }
+}
+
+//
+// Create the buffer of Bytes, none if Bytes is too small for a window per shard
+//
+//
+ErrorCodeT WriteBufferInit(
+    struct DPUStorage* Sto,
+    uint64_t Bytes
+){
+    uint64_t windowsPerShard = Bytes / DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES / DDS_BACKEND_WRITE_BUFFER_SHARDS;
+    if (!windowsPerShard) {
+        SPDK_NOTICELOG("The write buffer is off\n");
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+    if (windowsPerShard > INT32_MAX) {
+        windowsPerShard = INT32_MAX;
+    }
+
+    struct DPUWriteBuffer* buffer = calloc(1, sizeof(struct DPUWriteBuffer));
+    if (!buffer) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    Sto->WriteBuffer = buffer;
+
+    for (int s = 0; s != DDS_BACKEND_WRITE_BUFFER_SHARDS; s++) {
+        if (InitShard(&buffer->Shards[s], (uint32_t)windowsPerShard) != DDS_ERROR_CODE_SUCCESS) {
+            WriteBufferDestroy(Sto);
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+
+    atomic_init(&buffer->WindowsUsed, 0);
+    buffer->FlushTicks = spdk_get_ticks_hz() * DDS_BACKEND_WRITE_BUFFER_FLUSH_US / 1000000;
+    SPDK_NOTICELOG("The write buffer holds %llu windows of %llu bytes\n",
+        (unsigned long long)windowsPerShard * DDS_BACKEND_WRITE_BUFFER_SHARDS,
+        (unsigned long long)DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release the buffer; what it holds is lost
+//
+//
+void WriteBufferDestroy(
+    struct DPUStorage* Sto
+){
+    struct DPUWriteBuffer* buffer = Sto->WriteBuffer;
+    if (!buffer) {
+        return;
+    }
+
+    for (int s = 0; s != DDS_BACKEND_WRITE_BUFFER_SHARDS; s++) {
+        DestroyShard(&buffer->Shards[s]);
+    }
+    free(buffer);
+    Sto->WriteBuffer = NULL;
+}
+
+//
+// Take the write of a request into the buffer and complete it; false if the buffer doesn't take it
+//
+//
+bool WriteBufferAbsorb(
+    struct DPUStorage* Sto,
+    struct PerSlotContext* SlotContext
+){
+    struct DPUWriteBuffer* buffer = Sto->WriteBuffer;
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    SplittableBufferT* source = &context->DataBuffer;
+    FileIdT fileId = context->Request->FileId;
+    FileSizeT offset = context->Request->Offset;
+    FileIOSizeT bytes = source->TotalSize;
+    FileSizeT windowOffset = offset - offset % DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES;
+    struct DPUFile* file;
+
+    if (!buffer || context->Durable || !bytes || bytes > DDS_BACKEND_WRITE_BUFFER_MAX_WRITE_BYTES ||
+        ((offset | bytes) & (DDS_BACKEND_SECTOR_SIZE - 1)) ||
+        offset + bytes > windowOffset + DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES || !(file = GetFile(Sto, fileId))) {
+        return false;
+    }
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
+    if (FileIsSnapshot(file)) {
+        return false;
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_ZONED
+    if (Sto->Zoned) {
+        return false;
+    }
+#endif
+
+    //
+    // The segments of the write are allocated before it is acknowledged, so that its write back never runs out of space;
+    // if they can't be, the write goes to the device and fails there
+    //
+    //
+    if (ExtendFileForWrite(fileId, file, offset, bytes, Sto, SlotContext->SPDKContext) != DDS_ERROR_CODE_SUCCESS) {
+        return false;
+    }
+
+    WriteBufferShardT* shard = ShardOfWindow(buffer, fileId, windowOffset);
+    pthread_mutex_lock(&shard->Mutex);
+
+    WriteBufferWindowT* window = FindWindow(shard, fileId, windowOffset);
+    if (!window) {
+        window = TakeWindow(buffer, shard, fileId, windowOffset);
+        if (!window) {
+            pthread_mutex_unlock(&shard->Mutex);
+            return false;
+        }
+    }
+
+    char* to = window->Data + (offset - windowOffset);
+    FileIOSizeT bytesOnFirst = min(source->FirstSize, bytes);
+    memcpy(to, source->FirstAddr, bytesOnFirst);
+    if (bytes > bytesOnFirst) {
+        memcpy(to + bytesOnFirst, source->SecondAddr, bytes - bytesOnFirst);
+    }
+
+    uint32_t first = (uint32_t)((offset - windowOffset) / DDS_BACKEND_SECTOR_SIZE);
+    uint32_t end = first + bytes / DDS_BACKEND_SECTOR_SIZE;
+    SetSectors(window->Valid, first, end);
+    SetSectors(window->Dirty, first, end);
+    if (!window->DirtyTicks) {
+        window->DirtyTicks = spdk_get_ticks();
+    }
+    pthread_mutex_unlock(&shard->Mutex);
+
+    //
+    // Reads after the acknowledgement are served from the buffer, not from what the offload engine keeps
+    //
+    //
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    InvalidateResponseCacheFile(fileId);
+#endif
+    context->Response->BytesServiced = bytes;
+    context->Response->Result = DDS_ERROR_CODE_SUCCESS;
+    return true;
+}
+
+//
+// Whether the buffer holds any of Bytes at Offset of a file, having what it holds of them written back soon if so
+//
+//
+bool WriteBufferHolds(
+    struct DPUWriteBuffer* Buffer,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+){
+    FileSizeT end = Offset + Bytes;
+    bool holds = false;
+
+    if (!Buffer || !Bytes || !atomic_load_explicit(&Buffer->WindowsUsed, memory_order_relaxed)) {
+        return false;
+    }
+
+    for (FileSizeT windowOffset = Offset - Offset % DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES; windowOffset < end;
+        windowOffset += DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES) {
+        WriteBufferShardT* shard = ShardOfWindow(Buffer, FileId, windowOffset);
+        pthread_mutex_lock(&shard->Mutex);
+
+        WriteBufferWindowT* window = FindWindow(shard, FileId, windowOffset);
+        if (window) {
+            uint32_t first = (uint32_t)((max(Offset, windowOffset) - windowOffset) / DDS_BACKEND_SECTOR_SIZE);
+            uint32_t last = (uint32_t)((min(end, windowOffset + DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES) - windowOffset +
+                DDS_BACKEND_SECTOR_SIZE - 1) / DDS_BACKEND_SECTOR_SIZE);
+            if (AnySectors(window->Valid, first, last)) {
+                window->Urgent = true;
+                holds = true;
+            }
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+    }
+
+    return holds;
+}
+
+//
+// Copy a read of Dest->TotalSize bytes at Offset of a file from the buffer into Dest if the buffer holds all of it
+//
+//
+WriteBufferReadT WriteBufferRead(
+    struct DPUStorage* Sto,
+    FileIdT FileId,
+    FileSizeT Offset,
+    SplittableBufferT* Dest
+){
+    struct DPUWriteBuffer* buffer = Sto->WriteBuffer;
+    FileIOSizeT bytes = Dest->TotalSize;
+    FileSizeT windowOffset = Offset - Offset % DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES;
+    WriteBufferReadT result = WriteBufferReadMiss;
+
+    if (!buffer || !bytes || !atomic_load_explicit(&buffer->WindowsUsed, memory_order_relaxed)) {
+        return WriteBufferReadMiss;
+    }
+
+    //
+    // A read of more than a window is served from the device
+    //
+    //
+    if (Offset + bytes > windowOffset + DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES) {
+        return WriteBufferHolds(buffer, FileId, Offset, bytes) ? WriteBufferReadWait : WriteBufferReadMiss;
+    }
+
+    struct DPUFile* file = GetFile(Sto, FileId);
+    uint32_t first = (uint32_t)((Offset - windowOffset) / DDS_BACKEND_SECTOR_SIZE);
+    uint32_t end = (uint32_t)((Offset - windowOffset + bytes + DDS_BACKEND_SECTOR_SIZE - 1) / DDS_BACKEND_SECTOR_SIZE);
+    WriteBufferShardT* shard = ShardOfWindow(buffer, FileId, windowOffset);
+    pthread_mutex_lock(&shard->Mutex);
+
+    WriteBufferWindowT* window = FindWindow(shard, FileId, windowOffset);
+    if (window) {
+        //
+        // A read past the end of the file is left to the device, which knows where the file ends
+        //
+        //
+        if (AllSectors(window->Valid, first, end) && file && Offset + bytes <= GetSize(file)) {
+            char* from = window->Data + (Offset - windowOffset);
+            FileIOSizeT bytesOnFirst = min(Dest->FirstSize, bytes);
+            memcpy(Dest->FirstAddr, from, bytesOnFirst);
+            if (bytes > bytesOnFirst) {
+                memcpy(Dest->SecondAddr, from + bytesOnFirst, bytes - bytesOnFirst);
+            }
+            result = WriteBufferReadHit;
+        }
+        else if (AnySectors(window->Valid, first, end)) {
+            window->Urgent = true;
+            result = WriteBufferReadWait;
+        }
+    }
+    pthread_mutex_unlock(&shard->Mutex);
+
+    return result;
+}
+
+//
+// Drop what the buffer holds of a file from Offset on, as the file is deleted or shrinks
+//
+//
+void WriteBufferForgetFile(
+    struct DPUWriteBuffer* Buffer,
+    FileIdT FileId,
+    FileSizeT Offset
+){
+    if (!Buffer || !atomic_load_explicit(&Buffer->WindowsUsed, memory_order_relaxed)) {
+        return;
+    }
+
+    for (int s = 0; s != DDS_BACKEND_WRITE_BUFFER_SHARDS; s++) {
+        WriteBufferShardT* shard = &Buffer->Shards[s];
+        pthread_mutex_lock(&shard->Mutex);
+
+        for (uint32_t u = 0; u < shard->NumUsed;) {
+            WriteBufferWindowT* window = &shard->Windows[shard->Used[u]];
+            if (window->FileId != FileId || window->Offset + DDS_BACKEND_WRITE_BUFFER_WINDOW_BYTES <= Offset) {
+                u++;
+                continue;
+            }
+
+            //
+            // The sectors that start at Offset or after it go; a write back in flight lands anyway
+            //
+            //
+            uint32_t first = Offset > window->Offset ?
+                (uint32_t)((Offset - window->Offset + DDS_BACKEND_SECTOR_SIZE - 1) / DDS_BACKEND_SECTOR_SIZE) : 0;
+            ClearSectors(window->Valid, first, DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS);
+            ClearSectors(window->Dirty, first, DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS);
+            if (!AnyBits(window->Dirty)) {
+                window->DirtyTicks = 0;
+            }
+            if (!DropWindowIfClean(Buffer, shard, window)) {
+                u++;
+            }
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+    }
+}
+
+//
+// Start writing back the first run of dirty sectors of a window, in a pool slot of the worker;
+// return the slot to issue once the shard is unlocked, NULL if there is nothing to issue,
+// with NoSlot set if the worker has no pool slot left
+//
+//
+static struct PerSlotContext*
+StartFlush(
+    WriteBufferWindowT* Window,
+    SPDKContextT* SPDKContext,
+    bool* NoSlot
+){
+    struct DPUFile* file = GetFile(Sto, Window->FileId);
+    FileSizeT fileSize = file ? GetSize(file) : 0;
+    uint32_t first = 0;
+    uint32_t end;
+
+    while (first != DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS && !TestSector(Window->Dirty, first)) {
+        first++;
+    }
+    end = first;
+    while (end != DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS && TestSector(Window->Dirty, end)) {
+        end++;
+    }
+
+    //
+    // What is past the end of its file, or of a file that is gone, is dropped;
+    // a run over the end of the file is written up to there
+    //
+    //
+    FileSizeT offset = Window->Offset + (FileSizeT)first * DDS_BACKEND_SECTOR_SIZE;
+    if (offset >= fileSize) {
+        ClearSectors(Window->Valid, first, DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS);
+        ClearSectors(Window->Dirty, first, DDS_BACKEND_WRITE_BUFFER_WINDOW_SECTORS);
+        if (!AnyBits(Window->Dirty)) {
+            Window->DirtyTicks = 0;
+        }
+        return NULL;
+    }
+    FileIOSizeT bytes = (FileIOSizeT)min((FileSizeT)(end - first) * DDS_BACKEND_SECTOR_SIZE, fileSize - offset);
+
+    struct PerSlotContext* slot = FindFreeSpace(SPDKContext, &Window->FlushContext);
+    if (!slot) {
+        *NoSlot = true;
+        return NULL;
+    }
+
+    Window->FlushRequest.RequestId = 0;
+    Window->FlushRequest.FileId = Window->FileId;
+    Window->FlushRequest.Offset = offset;
+    Window->FlushRequest.Bytes = bytes;
+    Window->FlushResponse.RequestId = 0;
+    Window->FlushResponse.Result = DDS_ERROR_CODE_IO_PENDING;
+    Window->FlushResponse.BytesServiced = 0;
+    memset(&Window->FlushCold, 0, sizeof(Window->FlushCold));
+    memset(&Window->FlushContext, 0, sizeof(Window->FlushContext));
+    Window->FlushContext.Request = &Window->FlushRequest;
+    Window->FlushContext.Response = &Window->FlushResponse;
+    Window->FlushContext.DataBuffer.TotalSize = bytes;
+    Window->FlushContext.DataBuffer.FirstSize = bytes;
+    Window->FlushContext.DataBuffer.FirstAddr = Window->Data + (offset - Window->Offset);
+    Window->FlushContext.DataBuffer.SecondAddr = NULL;
+    Window->FlushContext.Cold = &Window->FlushCold;
+    slot->CallbacksRan = 0;
+    slot->CallbacksToRun = 0;
+
+    //
+    // Sectors written again while the write back is in flight are dirty again
+    //
+    //
+    ClearSectors(Window->Dirty, first, end);
+    SetSectors(Window->Flushing, first, end);
+    if (!AnyBits(Window->Dirty)) {
+        Window->DirtyTicks = 0;
+    }
+    Window->Urgent = false;
+    Window->FlushOwner = SPDKContext;
+    Window->FlushSlot = slot;
+
+    return slot;
+}
+
+//
+// Whether the write back in flight of a window is done, with none of its I/O left
+//
+//
+static inline bool
+FlushDone(
+    WriteBufferWindowT* Window
+){
+    return Window->FlushResponse.Result != DDS_ERROR_CODE_IO_PENDING &&
+        Window->FlushSlot->CallbacksRan == Window->FlushSlot->CallbacksToRun;
+}
+
+//
+// Finish the write back of a window; the sectors of a write back that failed are dirty again, to be tried later.
+// Return whether the window is given back
+//
+//
+static bool
+FinishFlush(
+    struct DPUWriteBuffer* Buffer,
+    WriteBufferShardT* Shard,
+    WriteBufferWindowT* Window
+){
+    if (Window->FlushResponse.Result != DDS_ERROR_CODE_SUCCESS) {
+        DPULogWarning("Write back of %u bytes at %llu of file %hu failed with %d, trying again\n",
+            Window->FlushRequest.Bytes, (unsigned long long)Window->FlushRequest.Offset, Window->FileId,
+            Window->FlushResponse.Result);
+        for (int w = 0; w != DDS_BACKEND_WRITE_BUFFER_WINDOW_WORDS; w++) {
+            Window->Dirty[w] |= Window->Flushing[w] & Window->Valid[w];
+        }
+        if (AnyBits(Window->Dirty) && !Window->DirtyTicks) {
+            Window->DirtyTicks = spdk_get_ticks();
+        }
+    }
+
+    memset(Window->Flushing, 0, sizeof(Window->Flushing));
+    FreeSingleSpace(Window->FlushSlot);
+    Window->FlushOwner = NULL;
+    Window->FlushSlot = NULL;
+
+    return DropWindowIfClean(Buffer, Shard, Window);
+}
+
+//
+// Poller of a worker that writes back the windows that are due, and finishes the write backs it issued;
+// a window is due once it has been dirty for long enough, if a request waits for it,
+// or at once while its shard is short of free windows. A shard that another worker is on is left to it
+//
+//
+int WriteBufferPoller(
+    void* Ctx
+){
+    SPDKContextT* SPDKContext = (SPDKContextT*)Ctx;
+    struct DPUWriteBuffer* buffer = Sto ? Sto->WriteBuffer : NULL;
+    struct PerSlotContext* toIssue[DDS_BACKEND_WRITE_BUFFER_FLUSHES_PER_SHARD];
+    bool noSlot = false;
+    int work = 0;
+
+    if (!buffer || !atomic_load_explicit(&buffer->WindowsUsed, memory_order_relaxed)) {
+        return SPDK_POLLER_IDLE;
+    }
+
+    uint64_t now = spdk_get_ticks();
+    for (int s = 0; s != DDS_BACKEND_WRITE_BUFFER_SHARDS; s++) {
+        WriteBufferShardT* shard = &buffer->Shards[s];
+        int numToIssue = 0;
+
+        if (pthread_mutex_trylock(&shard->Mutex)) {
+            continue;
+        }
+
+        bool pressed = (uint64_t)shard->NumFree * 100 < (uint64_t)shard->NumWindows * DDS_BACKEND_WRITE_BUFFER_FREE_PERCENT;
+        for (uint32_t u = 0; u < shard->NumUsed;) {
+            WriteBufferWindowT* window = &shard->Windows[shard->Used[u]];
+
+            if (window->FlushOwner == SPDKContext && FlushDone(window)) {
+                work++;
+                if (FinishFlush(buffer, shard, window)) {
+                    continue;
+                }
+            }
+
+            if (!window->FlushOwner && window->DirtyTicks && !noSlot &&
+                numToIssue != DDS_BACKEND_WRITE_BUFFER_FLUSHES_PER_SHARD &&
+                (window->Urgent || pressed || now - window->DirtyTicks >= buffer->FlushTicks)) {
+                struct PerSlotContext* slot = StartFlush(window, SPDKContext, &noSlot);
+                if (slot) {
+                    toIssue[numToIssue++] = slot;
+                }
+                else if (DropWindowIfClean(buffer, shard, window)) {
+                    continue;
+                }
+            }
+            u++;
+        }
+        pthread_mutex_unlock(&shard->Mutex);
+
+        for (int i = 0; i != numToIssue; i++) {
+            WriteBufferFlushHandler(toIssue[i]);
+        }
+        work += numToIssue;
+    }
+
+    return work ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+}
+#endif
@@ -5,40 +5,1218 @@
 
 #include "DataPlaneHandlers.h"
 #include "CacheTable.h"
+#include "DPUBackEndChecksum.h"
+#include "DPUBackEndBlockCache.h"
+#include "DPUBackEndDedup.h"
+#include "DPUBackEndAtomic.h"
+#include "DPUBackEndDefrag.h"
+#include "DPUBackEndWriteBuffer.h"
+#include "DPULog.h"
+#include "ResponseCache.h"
+#ifdef OPT_FILE_SERVICE_REPLICATION
+#include "DPUBackEndReplica.h"
+#endif
+#ifdef OPT_FILE_SERVICE_SCAN
+#include "UDF.h"
+#endif
+
+#undef DEBUG_DATAPLANE_HANDLERS
+#ifdef DEBUG_DATAPLANE_HANDLERS
+#include <stdio.h>
+#define DebugPrint(Fmt, ...) fprintf(stderr, Fmt, __VA_ARGS__)
+#else
+static inline void DebugPrint(const char* Fmt, ...) { }
+#endif
+
+//
+// The global cache table
+//
+//
+extern CacheTableT* CacheTable;
+
+//
+// The I-th slot of the batch led by Head, handles wrap around indices
+//
+//
+static inline struct PerSlotContext*
+SlotOfBatch(
+    struct PerSlotContext* Head,
+    RequestIdT I
+) {
+    RequestIdT selfIndex = Head->IndexBase + (Head->Position - Head->IndexBase + I) % Head->IndexSpan;
+    return &Head->SPDKContext->SPDKSpace[selfIndex];
+}
+
+//
+// Publish the outcome of a write that is on the device, once its copy is at the peer if it was forwarded
+//
+//
+static inline void
+PublishWrite(
+    DataPlaneRequestContext* Context,
+    bool Success,
+    FileIOSizeT Bytes
+) {
+#ifdef OPT_FILE_SERVICE_REPLICATION
+    if (!ReplicaJoinLocal(Context, &Success, Bytes)) {
+        return;
+    }
+#endif
+    Context->Response->BytesServiced = Success ? Bytes : 0;
+    Context->Response->Result = Success ? DDS_ERROR_CODE_SUCCESS : DDS_ERROR_CODE_IO_FAILURE;
+}
+
+#if defined(OPT_FILE_SERVICE_CHECKSUMS) || defined(OPT_FILE_SERVICE_BLOCK_CACHE)
+//
+// The first Bytes of a splittable buffer as an iovec
+//
+//
+static inline int
+IovOfBuffer(
+    SplittableBufferT* Buffer,
+    FileIOSizeT Bytes,
+    struct iovec* Iov
+) {
+    FileIOSizeT bytesOnFirst = min(Buffer->FirstSize, Bytes);
+
+    Iov[0].iov_base = Buffer->FirstAddr;
+    Iov[0].iov_len = bytesOnFirst;
+    if (Bytes > bytesOnFirst) {
+        Iov[1].iov_base = Buffer->SecondAddr;
+        Iov[1].iov_len = Bytes - bytesOnFirst;
+        return 2;
+    }
+    return 1;
+}
+#endif
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+//
+// Forget the checksums of the blocks a write is about to change
+//
+//
+static inline void
+ForgetWriteChecksums(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    struct DPUFile* file = GetFile(Sto, FileId);
+    if (file) {
+        ChecksumsForget(Sto, file, Offset, Bytes);
+    }
+}
+
+//
+// Whether the data of a read that is done matches the checksums of its file, failing the read if not
+//
+//
+static bool
+ReadMatchesChecksums(
+    struct PerSlotContext* SlotContext,
+    const struct iovec* Iov,
+    int IovCnt
+) {
+    BuffMsgF2BReqHeader* request = SlotContext->Ctx->Request;
+    struct DPUFile* file = GetFile(Sto, request->FileId);
+
+    if (!file || ChecksumsVerify(Sto, file, request->Offset, Iov, IovCnt, SlotContext->BytesIssued)) {
+        return true;
+    }
+
+    SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_CHECKSUM_MISMATCH;
+    SlotContext->Ctx->Response->BytesServiced = 0;
+    return false;
+}
+#endif
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+//
+// Fill the block cache with the blocks a read that is done reserved
+//
+//
+static inline void
+FillBlockCache(
+    struct PerSlotContext* SlotContext,
+    const struct iovec* Iov,
+    int IovCnt
+) {
+    BuffMsgF2BReqHeader* request = SlotContext->Ctx->Request;
+    struct DPUFile* file;
+
+    if (SlotContext->CacheTicket && (file = GetFile(Sto, request->FileId))) {
+        BlockCacheFillFile(Sto, file, request->Offset, Iov, IovCnt, SlotContext->BytesIssued, SlotContext->CacheTicket);
+    }
+}
+
+//
+// Drop the blocks a write put on the device from the block cache
+//
+//
+static inline void
+InvalidateWrittenBlocks(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    struct DPUFile* file = GetFile(Sto, FileId);
+    if (file) {
+        BlockCacheInvalidateFile(Sto, file, Offset, Bytes);
+    }
+}
+#endif
+
+//
+// Add a write to the writes in flight on its thread, after the ones issued before it,
+// and have the deduplication and the defragmentation count it
+//
+//
+static inline void
+TrackWrite(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneOrderT* order = SlotContext->SPDKContext->Order;
+
+    SlotContext->WriteInFlight = true;
+    SlotContext->WriteSeq = order->NextWriteSeq++;
+    SlotContext->PrevWrite = order->NewestWrite;
+    SlotContext->NextWrite = NULL;
+    if (order->NewestWrite) {
+        order->NewestWrite->NextWrite = SlotContext;
+    }
+    else {
+        order->OldestWrite = SlotContext;
+    }
+    order->NewestWrite = SlotContext;
+
+#ifdef OPT_FILE_SERVICE_DEDUP
+    DedupNoteWrite(Sto, SlotContext);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    DefragNoteWrite(Sto, SlotContext->Ctx->Request->FileId);
+#endif
+}
+
+//
+// Take a write that is done off the writes in flight, telling the deduplication whether it is on the device;
+// the responses the offload engine keeps of its file are read again
+//
+//
+static inline void
+UntrackWrite(
+    struct PerSlotContext* SlotContext,
+    bool Success
+) {
+    DataPlaneOrderT* order = SlotContext->SPDKContext->Order;
+
+    if (!SlotContext->WriteInFlight) {
+        return;
+    }
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+    InvalidateResponseCacheFile(SlotContext->Ctx->Request->FileId);
+#endif
+
+#ifdef OPT_FILE_SERVICE_DEDUP
+    DedupWriteDone(Sto, SlotContext, Success);
+#endif
+#ifdef OPT_FILE_SERVICE_DEFRAG
+    DefragWriteDone(Sto, SlotContext->Ctx->Request->FileId);
+#endif
+
+    if (SlotContext->PrevWrite) {
+        SlotContext->PrevWrite->NextWrite = SlotContext->NextWrite;
+    }
+    else {
+        order->OldestWrite = SlotContext->NextWrite;
+    }
+    if (SlotContext->NextWrite) {
+        SlotContext->NextWrite->PrevWrite = SlotContext->PrevWrite;
+    }
+    else {
+        order->NewestWrite = SlotContext->PrevWrite;
+    }
+    SlotContext->WriteInFlight = false;
+
+    if (SlotContext->Ctx->AtomicOp) {
+        AtomicOpDone(SlotContext);
+    }
+}
+
+//
+// Hold the reads under a fence until the writes issued before it are done;
+// a fence with no write in flight before it has nothing to wait for,
+// and one that finds no room merges into the last, which then waits for the writes before either
+//
+//
+static void
+AddReadFence(
+    DataPlaneOrderT* Order,
+    ReadFenceT* Fence
+) {
+    if (!Order->OldestWrite) {
+        return;
+    }
+
+    if (Order->NumFences == DDS_BACKEND_MAX_READ_FENCES) {
+        ActiveReadFenceT* last = &Order->Fences[DDS_BACKEND_MAX_READ_FENCES - 1];
+        MergeReadFence(&last->Fence, Fence);
+        last->WriteSeq = Order->NextWriteSeq;
+        return;
+    }
+
+    Order->Fences[Order->NumFences].Fence = *Fence;
+    Order->Fences[Order->NumFences].WriteSeq = Order->NextWriteSeq;
+    Order->NumFences++;
+}
+
+//
+// Whether Bytes from Offset of a file overlap those of another
+//
+//
+static inline bool
+RangesOverlap(
+    FileSizeT Offset,
+    FileSizeT Bytes,
+    FileSizeT OtherOffset,
+    FileSizeT OtherBytes
+) {
+    return Offset < OtherOffset + OtherBytes && OtherOffset < Offset + Bytes;
+}
+
+//
+// Whether a read must wait for a write in flight before a fence over it;
+// fences whose writes are all done are dropped on the way
+//
+//
+static bool
+ReadIsFenced(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneOrderT* order = SlotContext->SPDKContext->Order;
+    BuffMsgF2BReqHeader* read = SlotContext->Ctx->Request;
+    FileIOSizeT readBytes = SlotContext->Ctx->Scanned ?
+        SlotContext->Ctx->Cold->Scan.Bytes : SlotContext->Ctx->DataBuffer.TotalSize;
+    uint64_t oldestSeq = order->OldestWrite ? order->OldestWrite->WriteSeq : order->NextWriteSeq;
+    int f = 0;
+
+    while (f != order->NumFences) {
+        ActiveReadFenceT* active = &order->Fences[f];
+        if (active->WriteSeq <= oldestSeq) {
+            order->Fences[f] = order->Fences[--order->NumFences];
+            continue;
+        }
+
+        if ((active->Fence.FileId == DDS_FILE_INVALID || active->Fence.FileId == read->FileId) &&
+            RangesOverlap(active->Fence.Offset, active->Fence.Bytes, read->Offset, readBytes)) {
+            for (struct PerSlotContext* write = order->OldestWrite;
+                write && write->WriteSeq < active->WriteSeq; write = write->NextWrite) {
+                BuffMsgF2BReqHeader* request = write->Ctx->Request;
+                if (request->FileId == read->FileId &&
+                    RangesOverlap(request->Offset, write->Ctx->DataBuffer.TotalSize, read->Offset, readBytes)) {
+                    return true;
+                }
+            }
+        }
+        f++;
+    }
+
+    return false;
+}
+
+//
+// Issue a fenced read once the writes it waits for are done, looking again on the next turn of the thread
+//
+//
+static void
+FencedReadHandler(
+    void* Ctx
+) {
+    struct PerSlotContext* SlotContext = (struct PerSlotContext*)Ctx;
+
+    if (ReadIsFenced(SlotContext)) {
+        spdk_thread_send_msg(spdk_get_thread(), FencedReadHandler, SlotContext);
+        return;
+    }
+
+    ReadHandler(SlotContext);
+}
+
+//
+// Issue a read, or have it wait for the writes before a fence over it
+//
+//
+static inline void
+IssueRead(
+    struct PerSlotContext* SlotContext
+) {
+    if (SlotContext->SPDKContext->Order->NumFences && ReadIsFenced(SlotContext)) {
+        spdk_thread_send_msg(spdk_get_thread(), FencedReadHandler, SlotContext);
+        return;
+    }
+
+    ReadHandler(SlotContext);
+}
+
+//
+// Hold a request of a file back if the file has requests held or no tokens left, or else take its tokens;
+// either way the request gets its virtual start time, after the last request of the file finishes under its weight
+//
+//
+static bool
+HoldForQoS(
+    struct PerSlotContext* SlotContext,
+    struct DPUFile* File
+) {
+    DataPlaneQoST* qos = SlotContext->SPDKContext->QoS;
+    QoSFileQueueT* queue = &qos->Files[SlotContext->Ctx->Request->FileId];
+    FileIOSizeT bytes = SlotContext->Ctx->DataBuffer.TotalSize;
+    uint64_t start = max(qos->VirtualTime, queue->FinishTime);
+
+    queue->FinishTime = start + max(bytes, DDS_BACKEND_QOS_MIN_REQUEST_BYTES) / File->QoSWeight;
+    if (!queue->Head && FileHasQoSTokens(File)) {
+        TakeFileQoSTokens(File, bytes);
+        qos->VirtualTime = start;
+        return false;
+    }
+
+    SlotContext->QoSStartTime = start;
+    SlotContext->NextHeld = NULL;
+    if (queue->Tail) {
+        queue->Tail->NextHeld = SlotContext;
+    }
+    else {
+        queue->Head = SlotContext;
+        queue->FileId = SlotContext->Ctx->Request->FileId;
+        qos->Backlogged[qos->NumBacklogged++] = queue;
+    }
+    queue->Tail = SlotContext;
+
+    return true;
+}
+
+//
+// Issue the requests held back for the rate limits of their files, the earliest virtual start first
+// among the files with tokens; a file that is gone or no longer limited issues what it holds
+//
+//
+int
+DataPlaneQoSPoller(
+    void* Ctx
+) {
+    SPDKContextT* SPDKContext = (SPDKContextT*)Ctx;
+    DataPlaneQoST* qos = SPDKContext->QoS;
+    int issued = 0;
+
+    while (qos->NumBacklogged) {
+        int next = -1;
+        for (int b = 0; b != qos->NumBacklogged; b++) {
+            QoSFileQueueT* queue = qos->Backlogged[b];
+            if (next >= 0 && queue->Head->QoSStartTime >= qos->Backlogged[next]->Head->QoSStartTime) {
+                continue;
+            }
+
+            struct DPUFile* file = GetFile(Sto, queue->FileId);
+            if (!file || FileHasQoSTokens(file)) {
+                next = b;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+
+        QoSFileQueueT* queue = qos->Backlogged[next];
+        struct PerSlotContext* slotContext = queue->Head;
+        queue->Head = slotContext->NextHeld;
+        if (!queue->Head) {
+            queue->Tail = NULL;
+            qos->Backlogged[next] = qos->Backlogged[--qos->NumBacklogged];
+        }
+
+        struct DPUFile* file = GetFile(Sto, queue->FileId);
+        if (file) {
+            TakeFileQoSTokens(file, slotContext->Ctx->DataBuffer.TotalSize);
+        }
+        qos->VirtualTime = max(qos->VirtualTime, slotContext->QoSStartTime);
+
+        if (slotContext->Ctx->IsRead) {
+            IssueRead(slotContext);
+        }
+        else {
+            WriteHandler(slotContext);
+        }
+        issued++;
+    }
+
+    return issued ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+}
+
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+//
+// A write can be coalesced if it's small and sector aligned
+//
+//
+static inline bool
+WriteIsCoalescible(
+    DataPlaneRequestContext* Context
+) {
+    FileSizeT offset = Context->Request->Offset;
+    FileIOSizeT bytes = Context->DataBuffer.TotalSize;
+    return !Context->IsRead && bytes && bytes < DDS_BACKEND_WRITE_COALESCE_MAX_BYTES &&
+        !((offset | bytes) & (DDS_BACKEND_SECTOR_SIZE - 1));
+}
+
+//
+// Gather into the I-th slot of the batch the writes right after it that continue it on the same file and segment;
+// returns how many were gathered, including the I-th
+//
+//
+static RequestIdT
+CoalesceWrites(
+    struct PerSlotContext* Head,
+    RequestIdT I,
+    RequestIdT BatchSize
+) {
+    struct PerSlotContext* leader = SlotOfBatch(Head, I);
+    DataPlaneRequestContext* first = leader->Ctx;
+    if (!WriteIsCoalescible(first)) {
+        return 1;
+    }
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    //
+    // Each atomic write is staged alone
+    //
+    //
+    struct DPUFile* file = GetFile(Sto, first->Request->FileId);
+    if (file && (GetAttributes(file) & DDS_FILE_ATTRIBUTE_ATOMIC_WRITES)) {
+        return 1;
+    }
+#endif
+
+#ifdef OPT_FILE_SERVICE_ZONED
+    //
+    // Appends to zones run one at a time per file already, each split at zones and at the largest append
+    //
+    //
+    if (Sto->Zoned) {
+        return 1;
+    }
+#endif
+
+    FileSizeT end = first->Request->Offset + first->DataBuffer.TotalSize;
+    FileIOSizeT bytes = first->DataBuffer.TotalSize;
+    RequestIdT numCoalesced = 1;
+    leader->Coalesced[0] = leader;
+
+    while (I + numCoalesced < BatchSize && numCoalesced != DDS_BACKEND_WRITE_COALESCE_MAX_REQUESTS) {
+        struct PerSlotContext* next = SlotOfBatch(Head, I + numCoalesced);
+        DataPlaneRequestContext* context = next->Ctx;
+        FileIOSizeT nextBytes = context->DataBuffer.TotalSize;
+        if (!WriteIsCoalescible(context) || context->Request->FileId != first->Request->FileId ||
+            context->Request->Offset != end || bytes + nextBytes > DDS_BACKEND_WRITE_COALESCE_MAX_BYTES ||
+            (end + nextBytes - 1) >> DDS_BACKEND_SEGMENT_SHIFT != first->Request->Offset >> DDS_BACKEND_SEGMENT_SHIFT) {
+            break;
+        }
+
+        leader->Coalesced[numCoalesced++] = next;
+        end += nextBytes;
+        bytes += nextBytes;
+    }
+
+    leader->NumCoalesced = numCoalesced;
+    return numCoalesced;
+}
+
+//
+// Complete every write coalesced into the leader
+//
+//
+static void
+CompleteCoalescedWrites(
+    bool Success,
+    void *Context
+) {
+    struct PerSlotContext* leader = Context;
+
+    for (RequestIdT r = 0; r != leader->NumCoalesced; r++) {
+        DataPlaneRequestContext* context = leader->Coalesced[r]->Ctx;
+        PublishWrite(context, Success, context->DataBuffer.TotalSize);
+    }
+}
+
+//
+// Complete the coalesced writes that are on the device, after a shared flush if any of them is durable
+//
+//
+static void
+FlushCoalescedWrites(
+    bool Success,
+    void *Context
+) {
+    struct PerSlotContext* leader = Context;
+
+    if (Success) {
+        for (RequestIdT r = 0; r != leader->NumCoalesced; r++) {
+            if (leader->Coalesced[r]->Ctx->Durable) {
+                leader->FlushWaiter.Callback = CompleteCoalescedWrites;
+                leader->FlushWaiter.Arg = leader;
+                BdevFlushShared(leader->SPDKContext, &leader->FlushWaiter);
+                return;
+            }
+        }
+    }
+
+    CompleteCoalescedWrites(Success, leader);
+}
+
+//
+// Complete the coalesced writes once the checksums of what they wrote are on the device, if their file has them
+//
+//
+static void
+WriteCoalescedCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    struct PerSlotContext* leader = Context;
+    spdk_bdev_free_io(bdev_io);
+
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    InvalidateWrittenBlocks(leader->Ctx->Request->FileId, leader->Ctx->Request->Offset, leader->BytesIssued);
+#endif
+    for (RequestIdT r = 0; r != leader->NumCoalesced; r++) {
+        UntrackWrite(leader->Coalesced[r], Success);
+    }
+
+    if (!Success) {
+        DPULogWarning("failed coalesced bdev write of %hu requests\n", leader->NumCoalesced);
+        CompleteCoalescedWrites(false, leader);
+        return;
+    }
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    struct DPUFile* file = GetFile(Sto, leader->Ctx->Request->FileId);
+    if (file) {
+        ChecksumsPersist(Sto, file, leader->Ctx->Request->Offset, leader->CoalescedIov, leader->CoalescedIovCnt,
+            leader->BytesIssued, FlushCoalescedWrites, leader, leader->SPDKContext);
+        return;
+    }
+#endif
+
+    FlushCoalescedWrites(true, leader);
+}
+
+//
+// Handler for writes coalesced by CoalesceWrites, issued as one bdev write over the splits of all of them
+//
+//
+static void
+WriteCoalescedHandler(
+    struct PerSlotContext* Leader
+) {
+    DataPlaneRequestContext* first = Leader->Ctx;
+    FileIOSizeT bytes = 0;
+    int iovCnt = 0;
+
+    for (RequestIdT r = 0; r != Leader->NumCoalesced; r++) {
+        SplittableBufferT *buffer = &Leader->Coalesced[r]->Ctx->DataBuffer;
+        FileIOSizeT bytesOnFirst = min(buffer->FirstSize, buffer->TotalSize);
+
+        Leader->CoalescedIov[iovCnt].iov_base = buffer->FirstAddr;
+        Leader->CoalescedIov[iovCnt++].iov_len = bytesOnFirst;
+        if (buffer->TotalSize > bytesOnFirst) {
+            Leader->CoalescedIov[iovCnt].iov_base = buffer->SecondAddr;
+            Leader->CoalescedIov[iovCnt++].iov_len = buffer->TotalSize - bytesOnFirst;
+        }
+        bytes += buffer->TotalSize;
+    }
+    Leader->CoalescedIovCnt = iovCnt;
+    Leader->BytesIssued = bytes;
+
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    ForgetWriteChecksums(first->Request->FileId, first->Request->Offset, bytes);
+#endif
+
+    ErrorCodeT ret = WriteFileGather(first->Request->FileId, first->Request->Offset, Leader->CoalescedIov, iovCnt,
+        bytes, WriteCoalescedCallback, Leader, Sto, Leader->SPDKContext);
+    if (ret) {
+        DPULogError("WriteFileGather failed: %d\n", ret);
+        for (RequestIdT r = 0; r != Leader->NumCoalesced; r++) {
+            DataPlaneRequestContext* context = Leader->Coalesced[r]->Ctx;
+            UntrackWrite(Leader->Coalesced[r], false);
+            context->Response->BytesServiced = 0;
+            context->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+        }
+    }
+}
+#endif
+
+//
+// Place an append at the end of its file before anything looks at its range, and put the offset in its response;
+// an append the file cannot take completes with the error
+//
+//
+static bool
+PlaceAppend(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    FileSizeT offset = 0;
+
+    //
+    // The copy at the peer is forwarded before the append has its offset
+    //
+    //
+#ifdef OPT_FILE_SERVICE_REPLICATION
+    ErrorCodeT result = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+#else
+    ErrorCodeT result = ReserveAppend(context->Request->FileId, context->DataBuffer.TotalSize, &offset,
+        Sto, SlotContext->SPDKContext);
+#endif
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        context->Response->BytesServiced = 0;
+        context->Response->Result = result;
+        return false;
+    }
+
+    context->Request->Offset = offset;
+    memcpy(context->Cold->ResponseValue, &offset, sizeof(FileSizeT));
+    return true;
+}
+
+//
+// Complete an atomic operation that writes nothing, with the prior value of the word if it succeeded
+//
+//
+static void
+FinishAtomicOp(
+    struct PerSlotContext* SlotContext,
+    ErrorCodeT Result
+) {
+    UntrackWrite(SlotContext, false);
+    SlotContext->Ctx->Response->BytesServiced = Result == DDS_ERROR_CODE_SUCCESS ? sizeof(uint64_t) : 0;
+    SlotContext->Ctx->Response->Result = Result;
+}
+
+//
+// Put the prior value of the word in the response and write the new one as any other write,
+// unless a compare-and-swap finds another value
+//
+//
+static void
+AtomicWordRead(
+    ErrorCodeT Result,
+    uint64_t Word,
+    void *Arg
+) {
+    struct PerSlotContext* SlotContext = Arg;
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    BuffMsgF2BAtomicHeader* atomicOp = &context->Cold->Atomic;
+
+    if (Result != DDS_ERROR_CODE_SUCCESS) {
+        FinishAtomicOp(SlotContext, Result);
+        return;
+    }
+
+    memcpy(context->Cold->ResponseValue, &Word, sizeof(uint64_t));
+    if (atomicOp->Op == BUFF_MSG_ATOMIC_COMPARE_SWAP) {
+        if (Word != atomicOp->Compare) {
+            FinishAtomicOp(SlotContext, DDS_ERROR_CODE_SUCCESS);
+            return;
+        }
+    }
+    else {
+        atomicOp->Operand += Word;
+    }
+
+    context->DataBuffer.TotalSize = sizeof(uint64_t);
+    context->DataBuffer.FirstSize = sizeof(uint64_t);
+    context->DataBuffer.FirstAddr = (BufferT)&atomicOp->Operand;
+    context->DataBuffer.SecondAddr = NULL;
+    WriteHandler(SlotContext);
+}
+
+//
+// Start an atomic operation, which is tracked as a write from the read of its word on
+//
+//
+static void
+IssueAtomicOp(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    BuffMsgF2BAtomicHeader* atomicOp = &context->Cold->Atomic;
+
+    TrackWrite(SlotContext);
+
+    //
+    // The peer would apply the operation to its own copy of the word, which may differ
+    //
+    //
+#ifdef OPT_FILE_SERVICE_REPLICATION
+    ErrorCodeT result = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+#else
+    ErrorCodeT result = DDS_ERROR_CODE_INVALID_PARAM;
+    if ((atomicOp->Op == BUFF_MSG_ATOMIC_COMPARE_SWAP || atomicOp->Op == BUFF_MSG_ATOMIC_FETCH_ADD) &&
+        atomicOp->Offset % sizeof(uint64_t) == 0) {
+        result = ReadAtomicWord(context->Request->FileId, atomicOp->Offset, AtomicWordRead, SlotContext,
+            Sto, SlotContext->SPDKContext);
+    }
+#endif
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        FinishAtomicOp(SlotContext, result);
+    }
+}
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+//
+// Issue a write or an atomic operation once the write buffer no longer holds any of its range,
+// asking again on its thread until then
+//
+//
+static void
+WriteAfterBufferHandler(
+    void* Ctx
+) {
+    struct PerSlotContext* SlotContext = (struct PerSlotContext*)Ctx;
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+
+    if (WriteBufferHolds(Sto->WriteBuffer, context->Request->FileId, context->Request->Offset,
+        context->DataBuffer.TotalSize)) {
+        spdk_thread_send_msg(spdk_get_thread(), WriteAfterBufferHandler, SlotContext);
+        return;
+    }
+
+    if (context->AtomicOp) {
+        IssueAtomicOp(SlotContext);
+        return;
+    }
+    TrackWrite(SlotContext);
+    WriteHandler(SlotContext);
+}
+
+//
+// Write back a run of a window of the write buffer, as a write of its own in a pool slot
+//
+//
+void
+WriteBufferFlushHandler(
+    struct PerSlotContext* SlotContext
+) {
+    TrackWrite(SlotContext);
+    WriteHandler(SlotContext);
+}
+#endif
+
+void DataPlaneRequestHandler(
+    void* Ctx
+) {
+    struct PerSlotContext* HeadSlotContext = (struct PerSlotContext*) Ctx;  // head of batch
+    RequestIdT batchSize = HeadSlotContext->BatchSize;
+            
+    // iterate through all in the batch and call the corresponding RW handler
+    for (RequestIdT i = 0; i < batchSize; i++) {
+        struct PerSlotContext* ThisSlotContext = SlotOfBatch(HeadSlotContext, i);
+        DataPlaneOrderT* order = ThisSlotContext->SPDKContext->Order;
+        if (ThisSlotContext->Ctx->Fenced) {
+            AddReadFence(order, &ThisSlotContext->Ctx->Cold->Fence);
+        }
+
+        //
+        // The requests of a file with a rate limit, or with requests still held from one, go through its queue
+        //
+        //
+        FileIdT fileId = ThisSlotContext->Ctx->Request->FileId;
+        struct DPUFile* file = GetFile(Sto, fileId);
+        bool limited = file && (file->QoSBytesPerSecond || ThisSlotContext->SPDKContext->QoS->Files[fileId].Head);
+
+        if (ThisSlotContext->Ctx->IsRead) {
+            //
+            // A read behind a fence waits for the overlapping writes before the fence, other requests go on
+            //
+            //
+            if (!limited || !HoldForQoS(ThisSlotContext, file)) {
+                IssueRead(ThisSlotContext);
+            }
+            continue;
+        }
+
+        if (ThisSlotContext->Ctx->Appended && !PlaceAppend(ThisSlotContext)) {
+            continue;
+        }
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+        //
+        // A write the write buffer takes is done, and one that overlaps what it holds waits for it to be written back;
+        // the writes of a file with a rate limit are not buffered, as they would skip it
+        //
+        //
+        if (Sto->WriteBuffer) {
+            if (!limited && !ThisSlotContext->Ctx->AtomicOp && WriteBufferAbsorb(Sto, ThisSlotContext)) {
+                continue;
+            }
+            if (WriteBufferHolds(Sto->WriteBuffer, fileId, ThisSlotContext->Ctx->Request->Offset,
+                ThisSlotContext->Ctx->DataBuffer.TotalSize)) {
+                spdk_thread_send_msg(spdk_get_thread(), WriteAfterBufferHandler, ThisSlotContext);
+                continue;
+            }
+        }
+#endif
+
+        //
+        // An atomic operation is neither held by rate limits nor coalesced
+        //
+        //
+        if (ThisSlotContext->Ctx->AtomicOp) {
+            IssueAtomicOp(ThisSlotContext);
+            continue;
+        }
+
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+        //
+        // Adjacent small writes, as appends of a log, go out together, unless they wait for a rate limit
+        // or the write buffer is on, which merges them itself
+        //
+        //
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+        RequestIdT numCoalesced = limited || Sto->WriteBuffer ? 1 : CoalesceWrites(HeadSlotContext, i, batchSize);
+#else
+        RequestIdT numCoalesced = limited ? 1 : CoalesceWrites(HeadSlotContext, i, batchSize);
+#endif
+        if (numCoalesced > 1) {
+            for (RequestIdT r = 0; r != numCoalesced; r++) {
+                struct PerSlotContext* coalesced = ThisSlotContext->Coalesced[r];
+                if (r && coalesced->Ctx->Fenced) {
+                    AddReadFence(order, &coalesced->Ctx->Cold->Fence);
+                }
+                TrackWrite(coalesced);
+            }
+            WriteCoalescedHandler(ThisSlotContext);
+            i += numCoalesced - 1;
+            continue;
+        }
+#endif
+        TrackWrite(ThisSlotContext);
+        if (!limited || !HoldForQoS(ThisSlotContext, file)) {
+            WriteHandler(ThisSlotContext);
+        }
+    }
+}
+
+//
+// Non zc, copy the data read from our buff to the dest splittable buffer and mark resp success
+//
+//
+static void
+CompleteNonZCRead(
+    struct PerSlotContext* SlotContext
+) {
+    char *toCopy = SlotContext->Buff;
+#if defined(OPT_FILE_SERVICE_CHECKSUMS) || defined(OPT_FILE_SERVICE_BLOCK_CACHE)
+    struct iovec iov = { .iov_base = toCopy, .iov_len = SlotContext->BytesIssued };
+#endif
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    if (!ReadMatchesChecksums(SlotContext, &iov, 1)) {
+        return;
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    FillBlockCache(SlotContext, &iov, 1);
+#endif
+    memcpy(SlotContext->DestBuffer->FirstAddr, toCopy, SlotContext->DestBuffer->FirstSize);
+    toCopy += SlotContext->DestBuffer->FirstSize;
+    memcpy(SlotContext->DestBuffer->SecondAddr, toCopy, SlotContext->DestBuffer->TotalSize - SlotContext->DestBuffer->FirstSize);
+    SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_SUCCESS;
+    SlotContext->Ctx->Response->BytesServiced = SlotContext->BytesIssued;
+}
+
+#ifdef OPT_FILE_SERVICE_SCAN
+//
+// The scan functions loaded, which the control thread publishes to the workers by their count
+//
+//
+static OffloadScan ScanFunctions[DDS_BACKEND_MAX_SCAN_FUNCTIONS];
+static atomic_int NumScanFunctions;
+
+//
+// Load a scan function, compiling OffloadScan.c in CodePath
+//
+//
+ErrorCodeT
+LoadScanFunction(
+    const char* CodePath,
+    uint16_t* ScanId
+) {
+    int id = atomic_load_explicit(&NumScanFunctions, memory_order_relaxed);
+    if (id == DDS_BACKEND_MAX_SCAN_FUNCTIONS) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    //
+    // Each function is a version of its own, as dlopen doesn't load a path it has loaded again
+    //
+    //
+    if (!CompileUDF(CodePath, OFFLOAD_SCAN, (uint32_t)id)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    void* lib = LoadLibrary(CodePath, OFFLOAD_SCAN, (uint32_t)id);
+    if (!lib) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    OffloadScan scan = GetOffloadScan(lib);
+    if (!scan) {
+        UnloadLibrary(lib);
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    ScanFunctions[id] = scan;
+    atomic_store_explicit(&NumScanFunctions, id + 1, memory_order_release);
+    *ScanId = (uint16_t)id;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Copy Bytes into a splittable buffer, Offset bytes into it
+//
+//
+static inline void
+CopyToSplittableBuffer(
+    SplittableBufferT* Buffer,
+    FileIOSizeT Offset,
+    const char* Source,
+    FileIOSizeT Bytes
+) {
+    if (Offset < Buffer->FirstSize) {
+        FileIOSizeT bytesOnFirst = min(Bytes, Buffer->FirstSize - Offset);
+        memcpy(Buffer->FirstAddr + Offset, Source, bytesOnFirst);
+        Offset += bytesOnFirst;
+        Source += bytesOnFirst;
+        Bytes -= bytesOnFirst;
+    }
+    if (Bytes) {
+        memcpy(Buffer->SecondAddr + (Offset - Buffer->FirstSize), Source, Bytes);
+    }
+}
 
-#undef DEBUG_DATAPLANE_HANDLERS
-#ifdef DEBUG_DATAPLANE_HANDLERS
-#include <stdio.h>
-#define DebugPrint(Fmt, ...) fprintf(stderr, Fmt, __VA_ARGS__)
-#else
-static inline void DebugPrint(const char* Fmt, ...) { }
-#endif
+//
+// Finish a scan, giving its staging buffer back
+//
+//
+static void
+CompleteScan(
+    struct PerSlotContext* SlotContext,
+    ErrorCodeT Result
+) {
+    ReleaseSlotBuffer(SlotContext);
+    SlotContext->Ctx->Response->BytesServiced = Result == DDS_ERROR_CODE_SUCCESS ? SlotContext->ScanBytesOut : 0;
+    SlotContext->Ctx->Response->Result = Result;
+}
 
 //
-// The global cache table
+// Run the scan function on the whole records of a chunk that is read, appending what it keeps of them
+// to the destination; false if that does not fit
 //
 //
-extern CacheTableT* CacheTable;
+static bool
+FilterScanChunk(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    OffloadScan scan = ScanFunctions[context->Cold->Scan.ScanId];
+    FileIOSizeT recordBytes = context->Cold->Scan.RecordBytes;
+    const char* record = SlotContext->Buff;
+    const char* end = record + SlotContext->BytesIssued - SlotContext->BytesIssued % recordBytes;
+    char out[DDS_BACKEND_SCAN_MAX_RECORD_BYTES];
 
-void DataPlaneRequestHandler(
-    void* Ctx
+    for (; record != end; record += recordBytes) {
+        FileIOSizeT kept = scan(record, recordBytes, out);
+        if (!kept) {
+            continue;
+        }
+        if (kept > recordBytes || SlotContext->ScanBytesOut + kept > context->DataBuffer.TotalSize) {
+            return false;
+        }
+
+        CopyToSplittableBuffer(&context->DataBuffer, SlotContext->ScanBytesOut, out, kept);
+        SlotContext->ScanBytesOut += kept;
+    }
+
+    return true;
+}
+
+//
+// Filter a chunk of a scan that is read and move the scan past it; a chunk cut short by the end of the file ends the scan.
+// False if the scan has failed
+//
+//
+static bool
+FinishScanChunk(
+    struct PerSlotContext* SlotContext
 ) {
-    struct PerSlotContext* HeadSlotContext = (struct PerSlotContext*) Ctx;  // head of batch
-    RequestIdT batchSize = HeadSlotContext->BatchSize;
-    RequestIdT ioSlotBase = HeadSlotContext->IndexBase;
-            
-    // iterate through all in the batch and call the corresponding RW handler, handles wrap around indices
-    for (RequestIdT i = 0; i < batchSize; i++) {
-        RequestIdT selfIndex = ioSlotBase + (HeadSlotContext->Position - ioSlotBase + i) % DDS_MAX_OUTSTANDING_IO;
-        struct PerSlotContext* ThisSlotContext = &HeadSlotContext->SPDKContext->SPDKSpace[selfIndex];
-        if (ThisSlotContext->Ctx->IsRead) {
-            ReadHandler(ThisSlotContext);
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+
+#if defined(OPT_FILE_SERVICE_CHECKSUMS) || defined(OPT_FILE_SERVICE_BLOCK_CACHE)
+    struct iovec iov = { .iov_base = SlotContext->Buff, .iov_len = SlotContext->BytesIssued };
+#endif
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    if (!ReadMatchesChecksums(SlotContext, &iov, 1)) {
+        ReleaseSlotBuffer(SlotContext);
+        return false;
+    }
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+    FillBlockCache(SlotContext, &iov, 1);
+#endif
+
+    if (!FilterScanChunk(SlotContext)) {
+        CompleteScan(SlotContext, DDS_ERROR_CODE_BUFFER_OVERFLOW);
+        return false;
+    }
+
+    if (SlotContext->BytesIssued < SlotContext->ScanChunk.TotalSize) {
+        SlotContext->ScanBytesLeft = 0;
+    }
+    context->Request->Offset += SlotContext->ScanChunk.TotalSize;
+
+    return true;
+}
+
+static void
+ScanChunkCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+);
+
+//
+// Read the chunks of a scan one after another, each into the staging buffer of the slot;
+// a chunk that issues no I/O, such as one in a hole of a sparse file, is filtered right away
+//
+//
+static void
+ScanNextChunks(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    FileIOSizeT recordBytes = context->Cold->Scan.RecordBytes;
+    FileIOSizeT chunkBytes = DDS_BACKEND_SCAN_CHUNK_BYTES - DDS_BACKEND_SCAN_CHUNK_BYTES % recordBytes;
+
+    while (SlotContext->ScanBytesLeft) {
+        FileIOSizeT bytes = min(SlotContext->ScanBytesLeft, chunkBytes);
+        SlotContext->ScanChunk.FirstAddr = SlotContext->Buff;
+        SlotContext->ScanChunk.FirstSize = bytes;
+        SlotContext->ScanChunk.SecondAddr = NULL;
+        SlotContext->ScanChunk.TotalSize = bytes;
+        SlotContext->ScanBytesLeft -= bytes;
+        SlotContext->CallbacksRan = 0;
+        SlotContext->CallbacksToRun = 0;
+
+        ErrorCodeT ret = ReadFile(context->Request->FileId, context->Request->Offset, &SlotContext->ScanChunk,
+            ScanChunkCallback, SlotContext, Sto, SlotContext->SPDKContext);
+        if (ret) {
+            //
+            // The reads already issued still call back, and the last of them gives the buffer back
+            //
+            //
+            DPULogError("ReadFile() Failed for a scan: %d\n", ret);
+            if (SlotContext->CallbacksToRun) {
+                context->Response->BytesServiced = 0;
+                context->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+            }
+            else {
+                CompleteScan(SlotContext, DDS_ERROR_CODE_IO_FAILURE);
+            }
+            return;
         }
-        else {
-            WriteHandler(ThisSlotContext);
+
+        if (SlotContext->CallbacksToRun) {
+            return;
+        }
+        if (!FinishScanChunk(SlotContext)) {
+            return;
         }
     }
+
+    CompleteScan(SlotContext, DDS_ERROR_CODE_SUCCESS);
+}
+
+//
+// Callback of the reads of a chunk of a scan, which goes on to the next chunk once all of them are done
+//
+//
+static void
+ScanChunkCallback(
+    struct spdk_bdev_io *bdev_io,
+    bool Success,
+    ContextT Context
+) {
+    struct PerSlotContext* SlotContext = Context;
+
+    spdk_bdev_free_io(bdev_io);
+    SlotContext->CallbacksRan += 1;
+
+    if (!Success) {
+        DPULogWarning("failed bdev read of a scan for RequestId %hu\n", SlotContext->Ctx->Response->RequestId);
+        SlotContext->Ctx->Response->BytesServiced = 0;
+        SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+    }
+
+    if (SlotContext->CallbacksRan != SlotContext->CallbacksToRun) {
+        return;
+    }
+
+    if (SlotContext->Ctx->Response->Result != DDS_ERROR_CODE_IO_PENDING) {
+        ReleaseSlotBuffer(SlotContext);
+        return;
+    }
+
+    if (FinishScanChunk(SlotContext)) {
+        ScanNextChunks(SlotContext);
+    }
+}
+
+//
+// Handler for a scan: read the range in chunks of whole records and respond with what the scan function keeps of them
+//
+//
+static void
+ScanHandler(
+    struct PerSlotContext* SlotContext
+) {
+    DataPlaneRequestContext* context = SlotContext->Ctx;
+    BuffMsgF2BScanHeader* scan = &context->Cold->Scan;
+    struct DPUFile* file = GetFile(Sto, context->Request->FileId);
+
+    SlotContext->ScanBytesOut = 0;
+
+    if (!file) {
+        CompleteScan(SlotContext, DDS_ERROR_CODE_FILE_NOT_FOUND);
+        return;
+    }
+    if (scan->ScanId >= atomic_load_explicit(&NumScanFunctions, memory_order_acquire) ||
+        scan->RecordBytes > DDS_BACKEND_SCAN_MAX_RECORD_BYTES) {
+        CompleteScan(SlotContext, DDS_ERROR_CODE_INVALID_PARAM);
+        return;
+    }
+    if (context->Request->Offset > GetSize(file)) {
+        CompleteScan(SlotContext, DDS_ERROR_CODE_INVALID_FILE_POSITION);
+        return;
+    }
+    if (!AcquireSlotBuffer(SlotContext, DDS_BACKEND_SCAN_CHUNK_BYTES)) {
+        DPULogError("No staging buffer left for a scan\n");
+        CompleteScan(SlotContext, DDS_ERROR_CODE_OUT_OF_MEMORY);
+        return;
+    }
+
+    SlotContext->ScanBytesLeft = scan->Bytes;
+    ScanNextChunks(SlotContext);
 }
+#endif
 
 //
 // Handler for a read request
@@ -53,11 +1231,59 @@ void ReadHandler(
     SlotContext->CallbacksRan = 0;  // incremented in callbacks
     SlotContext->CallbacksToRun = 0;  // incremented in ReadFile when async writes are issued successfully
 
+    //
+    // A read by key whose key did not resolve carries the error in its offset
+    //
+    //
+    if (Context->Request->FileId == BUFF_MSG_REQUEST_FILE_BY_KEY) {
+        Context->Response->BytesServiced = 0;
+        Context->Response->Result = (ErrorCodeT)Context->Request->Offset;
+        return;
+    }
+
+    if (Context->Scanned) {
+#ifdef OPT_FILE_SERVICE_SCAN
+        ScanHandler(SlotContext);
+#else
+        Context->Response->BytesServiced = 0;
+        Context->Response->Result = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+#endif
+        return;
+    }
+
+#ifdef OPT_FILE_SERVICE_WRITE_BUFFER
+    //
+    // A read of what the write buffer holds is answered from there, or waits for it to be written back
+    // if the buffer holds only part of it
+    //
+    //
+    if (Sto->WriteBuffer) {
+        WriteBufferReadT buffered = WriteBufferRead(Sto, Context->Request->FileId, Context->Request->Offset,
+            &Context->DataBuffer);
+        if (buffered == WriteBufferReadHit) {
+            Context->Response->BytesServiced = Context->DataBuffer.TotalSize;
+            Context->Response->Result = DDS_ERROR_CODE_SUCCESS;
+            return;
+        }
+        if (buffered == WriteBufferReadWait) {
+            spdk_thread_send_msg(spdk_get_thread(), ReadHandler, SlotContext);
+            return;
+        }
+    }
+#endif
+
     ErrorCodeT ret;
 #ifdef OPT_FILE_SERVICE_ZERO_COPY
     ret = ReadFile(Context->Request->FileId, Context->Request->Offset, &Context->DataBuffer,
         ReadHandlerZCCallback, SlotContext, Sto, SlotContext->SPDKContext);
 #else
+    if (!AcquireSlotBuffer(SlotContext, Context->DataBuffer.TotalSize)) {
+        DPULogError("No staging buffer left for a read of %u bytes\n", Context->DataBuffer.TotalSize);
+        Context->Response->BytesServiced = 0;
+        Context->Response->Result = DDS_ERROR_CODE_OUT_OF_MEMORY;
+        return;
+    }
+
     ret = ReadFile(Context->Request->FileId, Context->Request->Offset, &Context->DataBuffer,
         ReadHandlerNonZCCallback, SlotContext, Sto, SlotContext->SPDKContext);
 #endif
@@ -67,11 +1293,30 @@ void ReadHandler(
         // Fatal, some callbacks won't be called
         //
         //
-        SPDK_ERRLOG("ReadFile() Failed: %d\n", ret);
+        DPULogError("ReadFile() Failed: %d\n", ret);
         Context->Response->BytesServiced = 0;
         Context->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+#ifndef OPT_FILE_SERVICE_ZERO_COPY
+        if (!SlotContext->CallbacksToRun) {
+            ReleaseSlotBuffer(SlotContext);
+        }
+#endif
         return;
     }
+
+    //
+    // A read that only covers holes of a sparse file, or nothing, issued no IO and is done
+    //
+    //
+    if (!SlotContext->CallbacksToRun) {
+#ifdef OPT_FILE_SERVICE_ZERO_COPY
+        Context->Response->Result = DDS_ERROR_CODE_SUCCESS;
+        Context->Response->BytesServiced = SlotContext->BytesIssued;
+#else
+        CompleteNonZCRead(SlotContext);
+        ReleaseSlotBuffer(SlotContext);
+#endif
+    }
 }
 
 //
@@ -99,6 +1344,18 @@ void ReadHandlerZCCallback(
                 // All callbacks done and successful, mark resp success
                 //
                 //
+#if defined(OPT_FILE_SERVICE_CHECKSUMS) || defined(OPT_FILE_SERVICE_BLOCK_CACHE)
+                struct iovec iov[2];
+                int iovCnt = IovOfBuffer(&SlotContext->Ctx->DataBuffer, SlotContext->BytesIssued, iov);
+#endif
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+                if (!ReadMatchesChecksums(SlotContext, iov, iovCnt)) {
+                    return;
+                }
+#endif
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+                FillBlockCache(SlotContext, iov, iovCnt);
+#endif
                 SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_SUCCESS;
                 SlotContext->Ctx->Response->BytesServiced = SlotContext->BytesIssued;
             }
@@ -140,15 +1397,9 @@ void ReadHandlerNonZCCallback(
             if (SlotContext->CallbacksRan == SlotContext->CallbacksToRun) {
                 //
                 // All callbacks done and successful, mark resp success
-                // Non zc, we need to copy read data from our buff to the dest splittable buffer
                 //
                 //
-                char *toCopy = &SlotContext->SPDKContext->buff[SlotContext->Position * DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE];
-                memcpy(SlotContext->DestBuffer->FirstAddr, toCopy, SlotContext->DestBuffer->FirstSize);
-                toCopy += SlotContext->DestBuffer->FirstSize;
-                memcpy(SlotContext->DestBuffer->SecondAddr, toCopy, SlotContext->DestBuffer->TotalSize - SlotContext->DestBuffer->FirstSize);
-                SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_SUCCESS;
-                SlotContext->Ctx->Response->BytesServiced = SlotContext->BytesIssued;
+                CompleteNonZCRead(SlotContext);
             }
             //
             // Else this isn't the last, nothing more to do
@@ -160,7 +1411,7 @@ void ReadHandlerNonZCCallback(
             // Unsuccessful, mark resp with failure
             //
             //
-            SPDK_WARNLOG("failed bdev read (callback ran with fail param) encountered for RequestId %hu\n",
+            DPULogWarning("failed bdev read (callback ran with fail param) encountered for RequestId %hu\n",
                 SlotContext->Ctx->Response->RequestId);
             SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
             SlotContext->Ctx->Response->BytesServiced = 0;
@@ -170,6 +1421,14 @@ void ReadHandlerNonZCCallback(
     // Else previously failed, no useful work to do
     //
     //
+
+    //
+    // The staging buffer is free once no read is using it
+    //
+    //
+    if (SlotContext->CallbacksRan == SlotContext->CallbacksToRun) {
+        ReleaseSlotBuffer(SlotContext);
+    }
 }
 
 //
@@ -216,7 +1475,7 @@ void CacheOnWrite(
 
         // if an uint64 is actually split in mem
         if (recordKeyOffset < WriteBuffer->FirstSize && recordKeyOffset + sizeof(uint64_t) > WriteBuffer->FirstSize) {
-            printf("split buffer, key is split\n");
+            DPULogTrace("split buffer, key is split\n");
             RingSizeT firstPartLen = WriteBuffer->FirstSize - recordKeyOffset;
             memcpy(&recordKey, recordKeyPtr, firstPartLen);
             memcpy(&recordKey + firstPartLen, recordKeyPtr + firstPartLen, sizeof(uint64_t) - firstPartLen);
@@ -226,7 +1485,7 @@ void CacheOnWrite(
         }
 
         if (recordValueOffset < WriteBuffer->FirstSize && recordValueOffset + sizeof(uint64_t) > WriteBuffer->FirstSize) {
-            printf("split buffer, value is split\n");
+            DPULogTrace("split buffer, value is split\n");
             RingSizeT firstPartLen = WriteBuffer->FirstSize - recordValueOffset;
             memcpy(&recordValue, recordValuePtr, firstPartLen);
             memcpy(&recordValue + firstPartLen, recordValuePtr + firstPartLen, sizeof(uint64_t) - firstPartLen);
@@ -236,7 +1495,7 @@ void CacheOnWrite(
         }
 
         if (recordValue != 42) {
-            printf("!!!!!!!! ERROR CacheOnWrite: recordValue %llu != 42, recordValueOffset: %u\n", recordValue, recordValueOffset);
+            DPULogWarning("recordValue %llu != 42, recordValueOffset: %u\n", (unsigned long long)recordValue, recordValueOffset);
         }
 
         cacheItem->Version = 0;
@@ -246,7 +1505,7 @@ void CacheOnWrite(
         cacheItem->Size = sizeof(uint64_t);
 
         if (AddToCacheTable(cacheItem)) {
-            printf("cache on write AddToCacheTable() FAILED!!!\n");
+            DPULogWarning("cache on write AddToCacheTable() failed\n");
         }
 
         offsetInBuffer += 24;  // a record consists of 3 uint64's
@@ -256,17 +1515,18 @@ void CacheOnWrite(
 
 
 //
-// Handler for a write request
+// Write a request in place
 //
 //
-void WriteHandler(
-    void* Ctx
+static void
+IssueWrite(
+    struct PerSlotContext* SlotContext
 ) {
-    struct PerSlotContext* SlotContext = (struct PerSlotContext*)Ctx;
     DataPlaneRequestContext* Context = SlotContext->Ctx;
 
-    SlotContext->CallbacksRan = 0;  // incremented in callbacks
-    SlotContext->CallbacksToRun = 0;  // incremented in WriteFile when async writes are issued successfully
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+    ForgetWriteChecksums(Context->Request->FileId, Context->Request->Offset, Context->DataBuffer.TotalSize);
+#endif
 
     ErrorCodeT ret = WriteFile(Context->Request->FileId, Context->Request->Offset, &Context->DataBuffer,
         WriteHandlerCallback, SlotContext, Sto, SlotContext->SPDKContext);
@@ -275,11 +1535,153 @@ void WriteHandler(
         // Fatal, some callbacks won't be called
         //
         //
-        SPDK_ERRLOG("WriteFile failed: %d\n", ret);
+        DPULogError("WriteFile failed: %d\n", ret);
+        if (!SlotContext->CallbacksToRun) {
+            UntrackWrite(SlotContext, false);
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+            if (SlotContext->AtomicSlot) {
+                AtomicWriteRetire(Sto, SlotContext, false, NULL);
+            }
+#endif
+        }
         Context->Response->BytesServiced = 0;
         Context->Response->Result = DDS_ERROR_CODE_IO_FAILURE;
+#ifndef OPT_FILE_SERVICE_ZERO_COPY
+        if (!SlotContext->CallbacksToRun) {
+            ReleaseSlotBuffer(SlotContext);
+        }
+#endif
+        return;
+    }
+}
+
+//
+// Fail a write that never went in place
+//
+//
+static void
+FailWrite(
+    struct PerSlotContext* SlotContext,
+    ErrorCodeT Result
+) {
+    UntrackWrite(SlotContext, false);
+    SlotContext->Ctx->Response->BytesServiced = 0;
+    SlotContext->Ctx->Response->Result = Result;
+#ifndef OPT_FILE_SERVICE_ZERO_COPY
+    ReleaseSlotBuffer(SlotContext);
+#endif
+}
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+//
+// An atomic write goes in place once it is staged
+//
+//
+static void
+AtomicWriteStaged(
+    bool Success,
+    void *Context
+) {
+    struct PerSlotContext* SlotContext = Context;
+
+    if (!Success) {
+        DPULogError("Failed to stage an atomic write of %u bytes\n", SlotContext->Ctx->DataBuffer.TotalSize);
+        FailWrite(SlotContext, DDS_ERROR_CODE_IO_FAILURE);
+        return;
+    }
+    IssueWrite(SlotContext);
+}
+#endif
+
+//
+// Handler for a write request
+//
+//
+void WriteHandler(
+    void* Ctx
+) {
+    struct PerSlotContext* SlotContext = (struct PerSlotContext*)Ctx;
+    DataPlaneRequestContext* Context = SlotContext->Ctx;
+
+    SlotContext->CallbacksRan = 0;  // incremented in callbacks
+    SlotContext->CallbacksToRun = 0;  // incremented in WriteFile when async writes are issued successfully
+
+#ifndef OPT_FILE_SERVICE_ZERO_COPY
+    if (!AcquireSlotBuffer(SlotContext, Context->DataBuffer.TotalSize)) {
+        DPULogError("No staging buffer left for a write of %u bytes\n", Context->DataBuffer.TotalSize);
+        UntrackWrite(SlotContext, false);
+        Context->Response->BytesServiced = 0;
+        Context->Response->Result = DDS_ERROR_CODE_OUT_OF_MEMORY;
+        return;
+    }
+#endif
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    SlotContext->AtomicSlot = NULL;
+    struct DPUFile* file = GetFile(Sto, Context->Request->FileId);
+    if (file) {
+        ErrorCodeT result;
+        bool staged = AtomicWriteNeeded(file, Context->Request->Offset, Context->DataBuffer.TotalSize, &result);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            FailWrite(SlotContext, result);
+            return;
+        }
+        if (staged) {
+            SlotContext->AtomicStaged = AtomicWriteStaged;
+            AtomicWriteStage(Sto, SlotContext);
+            return;
+        }
+    }
+#endif
+
+    IssueWrite(SlotContext);
+}
+
+//
+// Acknowledge a durable write once the flush it waited for is done
+//
+//
+static void
+WriteFlushedCallback(
+    bool Success,
+    void *Context
+) {
+    struct PerSlotContext* SlotContext = Context;
+
+    PublishWrite(SlotContext->Ctx, Success, SlotContext->BytesIssued);
+}
+
+//
+// Acknowledge a write that is on the device, or flush first, with the other durable writes of the thread,
+// if the write is durable
+//
+//
+static void
+AcknowledgeWrite(
+    bool Success,
+    void *Context
+) {
+    struct PerSlotContext* SlotContext = Context;
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    //
+    // An atomic write is flushed before its slot is cleared, so it is durable once the slot is
+    //
+    //
+    if (SlotContext->AtomicSlot) {
+        AtomicWriteRetire(Sto, SlotContext, Success, WriteFlushedCallback);
         return;
     }
+#endif
+
+    if (Success && SlotContext->Ctx->Durable) {
+        SlotContext->FlushWaiter.Callback = WriteFlushedCallback;
+        SlotContext->FlushWaiter.Arg = SlotContext;
+        BdevFlushShared(SlotContext->SPDKContext, &SlotContext->FlushWaiter);
+    }
+    else {
+        PublishWrite(SlotContext->Ctx, Success, SlotContext->BytesIssued);
+    }
 }
 
 //
@@ -295,6 +1697,19 @@ void WriteHandlerCallback(
     spdk_bdev_free_io(bdev_io);
     SlotContext->CallbacksRan += 1;
 
+    //
+    // Reads fenced behind the write may go once all of it is on the device, ahead of any flush,
+    // and the blocks it replaced leave the block cache first
+    //
+    //
+    if (SlotContext->CallbacksRan == SlotContext->CallbacksToRun) {
+#ifdef OPT_FILE_SERVICE_BLOCK_CACHE
+        InvalidateWrittenBlocks(SlotContext->Ctx->Request->FileId, SlotContext->Ctx->Request->Offset,
+            SlotContext->Ctx->DataBuffer.TotalSize);
+#endif
+        UntrackWrite(SlotContext, Success && SlotContext->Ctx->Response->Result != DDS_ERROR_CODE_IO_FAILURE);
+    }
+
     if (SlotContext->Ctx->Response->Result != DDS_ERROR_CODE_IO_FAILURE) {
         //
         // Did not previously fail, should actually == IO_PENDING here
@@ -303,11 +1718,24 @@ void WriteHandlerCallback(
         if (Success) {
             if (SlotContext->CallbacksRan == SlotContext->CallbacksToRun) {
                 //
-                // All callbacks done and successful, mark resp success
+                // All callbacks done and successful, acknowledge the write,
+                // once the checksums of what it wrote are on the device if its file has them
                 //
                 //
-                SlotContext->Ctx->Response->Result = DDS_ERROR_CODE_SUCCESS;
-                SlotContext->Ctx->Response->BytesServiced = SlotContext->BytesIssued;
+#ifdef OPT_FILE_SERVICE_CHECKSUMS
+                struct DPUFile* file = GetFile(Sto, SlotContext->Ctx->Request->FileId);
+                if (file) {
+                    FileIOSizeT bytes = SlotContext->Ctx->DataBuffer.TotalSize;
+                    int iovCnt = IovOfBuffer(&SlotContext->Ctx->DataBuffer, bytes, SlotContext->Iov);
+                    ChecksumsPersist(Sto, file, SlotContext->Ctx->Request->Offset, SlotContext->Iov, iovCnt, bytes,
+                        AcknowledgeWrite, SlotContext, SlotContext->SPDKContext);
+                }
+                else {
+                    AcknowledgeWrite(true, SlotContext);
+                }
+#else
+                AcknowledgeWrite(true, SlotContext);
+#endif
             }
             //
             // Else this isn't the last, nothing more to do
@@ -327,4 +1755,21 @@ void WriteHandlerCallback(
     // Else previously failed, no useful work to do
     //
     //
+
+#ifdef OPT_FILE_SERVICE_ATOMIC_WRITES
+    if (SlotContext->CallbacksRan == SlotContext->CallbacksToRun && SlotContext->AtomicSlot &&
+        SlotContext->Ctx->Response->Result == DDS_ERROR_CODE_IO_FAILURE) {
+        AtomicWriteRetire(Sto, SlotContext, false, NULL);
+    }
+#endif
+
+#ifndef OPT_FILE_SERVICE_ZERO_COPY
+    //
+    // The staging buffer is free once no write is using it
+    //
+    //
+    if (SlotContext->CallbacksRan == SlotContext->CallbacksToRun) {
+        ReleaseSlotBuffer(SlotContext);
+    }
+#endif
 }
@@ -10,17 +10,30 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "CacheTable.h"
+#include "CorePlan.h"
 #include "DDSTypes.h"
 #include "FileBackEnd.h"
 #include "Debug.h"
+#include "Profiler.h"
+#include "ResponseCache.h"
+#ifdef OPT_FILE_SERVICE_REPLICATION
+#include "DPUBackEndLease.h"
+#include "DPUBackEndReplica.h"
+#endif
 #ifdef PRELOAD_CACHE_TABLE_ITEMS
 #include <stdlib.h>
 #endif
@@ -36,6 +49,7 @@ static inline void DebugPrint(const char* Fmt, ...) { }
 #endif
 
 extern volatile int ForceQuitStorageEngine;
+extern volatile int HandOverStorageEngine;
 bool G_INITIALIZATION_DONE = false;
 
 //
@@ -44,6 +58,25 @@ bool G_INITIALIZATION_DONE = false;
 //
 CacheTableT* GlobalCacheTable;
 
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+//
+// The versions of the responses the offload engine keeps
+//
+//
+_Atomic uint32_t ResponseCacheVersions[RESPONSE_CACHE_VERSION_SLOTS];
+_Atomic uint32_t ResponseCacheFileVersions[DDS_MAX_FILES];
+#endif
+
+#ifdef BACKEND_COMPRESSION_ENABLED
+//
+// Scratch space for compressing responses, one per data plane agent
+//
+//
+static __thread char CompressionInput[BACKEND_COMPRESSION_MAX_BYTES];
+static __thread char CompressionOutput[BACKEND_COMPRESSION_MAX_BYTES];
+static __thread uint32_t CompressionHashTable[PAYLOAD_COMPRESSION_HASH_ENTRIES];
+#endif
+
 //
 // Set a CM channel to be non-blocking
 //
@@ -173,16 +206,17 @@ AllocConns(BackEndConfig* Config) {
 #endif
     }
 
-    Config->BuffConns = (BuffConnConfig*)malloc(sizeof(BuffConnConfig) * Config->MaxClients);
+    Config->BuffConns = (BuffConnConfig*)malloc(sizeof(BuffConnConfig) * Config->MaxBuffs);
     if (!Config->BuffConns) {
         fprintf(stderr, "Failed to allocate BuffConns\n");
         free(Config->CtrlConns);
         return ENOMEM;
     }
-    memset(Config->BuffConns, 0, sizeof(BuffConnConfig) * Config->MaxClients);
+    memset(Config->BuffConns, 0, sizeof(BuffConnConfig) * Config->MaxBuffs);
     for (int c = 0; c < Config->MaxBuffs; c++) {
         Config->BuffConns[c].BuffId = c;
         Config->BuffConns[c].NextRequestContext = 0;
+        Config->BuffConns[c].NextCompletionContext = 0;
     }
 
     return 0;
@@ -215,6 +249,10 @@ SignalHandler(
         fprintf(stdout, "Received signal to exit\n");
         ForceQuitStorageEngine = 1;
     }
+    else if (SigNum == BACKEND_HANDOVER_SIGNAL) {
+        fprintf(stdout, "Received signal to hand over\n");
+        HandOverStorageEngine = 1;
+    }
 }
 
 //
@@ -414,7 +452,7 @@ SetUpBuffQPair(
 
     BuffConn->CompQ = ibv_create_cq(
         BuffConn->RemoteCmId->verbs,
-        BUFF_COMPQ_DEPTH * 2,
+        BUFF_COMPQ_DEPTH * 2 + BUFF_DIRECT_READ_SENDQ_DEPTH + BUFF_LANE_COMPQ_DEPTH,
         BuffConn,
         BuffConn->Channel,
         0
@@ -443,6 +481,9 @@ SetUpBuffQPair(
     ret = rdma_create_qp(BuffConn->RemoteCmId, BuffConn->PDomain, &initAttr);
     if (!ret) {
         BuffConn->QPair = BuffConn->RemoteCmId->qp;
+        BuffConn->LaneCmIds[0] = BuffConn->RemoteCmId;
+        BuffConn->LaneQPairs[0] = BuffConn->QPair;
+        BuffConn->NumLanes = 1;
     }
     else {
         fprintf(stderr, "%s [error]: rdma_create_qp failed\n", __func__);
@@ -469,14 +510,131 @@ SetUpBuffQPairReturn:
 // Destrory queue pairs for a buffer connection
 //
 //
+static void
+DestroyBuffLane(
+    BuffConnConfig* BuffConn,
+    int Lane
+);
+
 static void
 DestroyBuffQPair(
     BuffConnConfig* BuffConn
 ) {
+    //
+    // Lanes use the completion queue, so they go first
+    //
+    //
+    for (int lane = 1; lane != BUFF_CONN_MAX_QUEUE_PAIRS; lane++) {
+        DestroyBuffLane(BuffConn, lane);
+    }
+
     rdma_destroy_qp(BuffConn->RemoteCmId);
     ibv_destroy_cq(BuffConn->CompQ);
     ibv_destroy_comp_channel(BuffConn->Channel);
     ibv_dealloc_pd(BuffConn->PDomain);
+    BuffConn->LaneCmIds[0] = NULL;
+    BuffConn->LaneQPairs[0] = NULL;
+    BuffConn->NumLanes = 0;
+}
+
+//
+// Count the lanes in a row that are up, starting from the primary queue pair
+//
+//
+static void
+CountBuffLanes(
+    BuffConnConfig* BuffConn
+) {
+    int numLanes = 1;
+    while (numLanes != BUFF_CONN_MAX_QUEUE_PAIRS && BuffConn->LaneQPairs[numLanes]) {
+        numLanes++;
+    }
+    BuffConn->NumLanes = numLanes;
+}
+
+//
+// Set up the queue pair of a lane of a buffer connection;
+// the lane is used once its connection is established
+//
+//
+static int
+SetUpBuffLane(
+    BuffConnConfig* BuffConn,
+    int Lane,
+    struct rdma_cm_id* CmId
+) {
+    int ret = 0;
+    struct ibv_qp_init_attr initAttr;
+
+    memset(&initAttr, 0, sizeof(initAttr));
+    initAttr.cap.max_send_wr = BUFF_SENDQ_DEPTH;
+    initAttr.cap.max_recv_wr = BUFF_LANE_RECVQ_DEPTH;
+    initAttr.cap.max_recv_sge = 1;
+    initAttr.cap.max_send_sge = 1;
+    initAttr.qp_type = IBV_QPT_RC;
+    initAttr.send_cq = BuffConn->CompQ;
+    initAttr.recv_cq = BuffConn->CompQ;
+
+    ret = rdma_create_qp(CmId, BuffConn->PDomain, &initAttr);
+    if (ret) {
+        fprintf(stderr, "%s [error]: rdma_create_qp failed\n", __func__);
+        return -1;
+    }
+
+    BuffConn->LaneCmIds[Lane] = CmId;
+    return 0;
+}
+
+//
+// Destroy the queue pair of a lane of a buffer connection
+//
+//
+static void
+DestroyBuffLane(
+    BuffConnConfig* BuffConn,
+    int Lane
+) {
+    if (!BuffConn->LaneCmIds[Lane]) {
+        return;
+    }
+
+    rdma_destroy_qp(BuffConn->LaneCmIds[Lane]);
+    BuffConn->LaneCmIds[Lane] = NULL;
+    BuffConn->LaneQPairs[Lane] = NULL;
+    CountBuffLanes(BuffConn);
+}
+
+//
+// The queue pair that carries request reads and head writes
+//
+//
+static inline struct ibv_qp*
+RequestQPair(
+    BuffConnConfig* BuffConn
+) {
+    return BuffConn->LaneQPairs[BUFF_REQUEST_LANE < BuffConn->NumLanes ? BUFF_REQUEST_LANE : 0];
+}
+
+//
+// The queue pair that carries response writes and tail writes
+//
+//
+static inline struct ibv_qp*
+ResponseQPair(
+    BuffConnConfig* BuffConn
+) {
+    return BuffConn->LaneQPairs[BUFF_RESPONSE_LANE < BuffConn->NumLanes ? BUFF_RESPONSE_LANE : 0];
+}
+
+//
+// The queue pair that carries the data of direct reads
+//
+//
+static inline struct ibv_qp*
+DirectReadQPair(
+    BuffConnConfig* BuffConn
+) {
+    return BUFF_DIRECT_READ_LANE < BuffConn->NumLanes ? BuffConn->LaneQPairs[BUFF_DIRECT_READ_LANE] : ResponseQPair(BuffConn);
 }
 
 //
@@ -566,6 +724,140 @@ DestroyForCtrlMsgs(
     memset(&BuffConn->RecvWr, 0, sizeof(BuffConn->RecvWr));
 }
 
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+//
+// Map the data of a ring of at most MaxBytes from a memory file, in huge pages if Huge,
+// at the start of an aligned reservation of twice MaxBytes where MirrorRingData maps it again
+//
+//
+static char*
+MapRingData(
+    MirroredRingT* Mirror,
+    size_t MaxBytes,
+    bool Huge
+) {
+    size_t reservedBytes = 2 * MaxBytes + BACKEND_RING_MIRROR_ALIGNMENT;
+    char* reserved;
+    char* data;
+
+    Mirror->Fd = memfd_create("ddsbow_ring", Huge ? (MFD_CLOEXEC | MFD_HUGETLB) : MFD_CLOEXEC);
+    if (Mirror->Fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(Mirror->Fd, MaxBytes)) {
+        goto CloseFdReturn;
+    }
+
+    reserved = mmap(NULL, reservedBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        goto CloseFdReturn;
+    }
+
+    //
+    // Keep the aligned part of the reservation only
+    //
+    //
+    data = (char*)(((uintptr_t)reserved + BACKEND_RING_MIRROR_ALIGNMENT - 1) & ~((uintptr_t)BACKEND_RING_MIRROR_ALIGNMENT - 1));
+    if (data != reserved) {
+        munmap(reserved, data - reserved);
+    }
+    if (data + 2 * MaxBytes != reserved + reservedBytes) {
+        munmap(data + 2 * MaxBytes, reserved + reservedBytes - (data + 2 * MaxBytes));
+    }
+
+    if (mmap(data, MaxBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | MAP_POPULATE, Mirror->Fd, 0) == MAP_FAILED) {
+        munmap(data, 2 * MaxBytes);
+        goto CloseFdReturn;
+    }
+
+    Mirror->MaxBytes = MaxBytes;
+    Mirror->MirroredBytes = 0;
+    Mirror->Huge = Huge;
+    Mirror->SPDKRegistered = false;
+    return data;
+
+CloseFdReturn:
+    close(Mirror->Fd);
+    Mirror->Fd = -1;
+    return NULL;
+}
+
+//
+// Allocate the data of a ring of at most MaxBytes, in huge pages if there are enough of them
+//
+//
+static char*
+AllocateRingData(
+    MirroredRingT* Mirror,
+    size_t MaxBytes
+) {
+    char* data = MapRingData(Mirror, MaxBytes, true);
+
+    if (!data) {
+        data = MapRingData(Mirror, MaxBytes, false);
+    }
+
+    return data;
+}
+
+//
+// Map the first RingBytes of the ring again right after them, and hand both copies to SPDK
+// if they are in huge pages; the part of the first mapping this replaces is past the end of the ring,
+// where no DMA goes. A ring that cannot be mirrored keeps wrapping in two parts
+//
+//
+static bool
+MirrorRingData(
+    MirroredRingT* Mirror,
+    char* Data,
+    size_t RingBytes
+) {
+    size_t granularity = Mirror->Huge ? BACKEND_RING_MIRROR_ALIGNMENT : (size_t)sysconf(_SC_PAGESIZE);
+
+    if (Mirror->MirroredBytes == RingBytes) {
+        return true;
+    }
+    if (Mirror->Fd < 0 || Mirror->MirroredBytes || RingBytes > Mirror->MaxBytes || RingBytes % granularity) {
+        return false;
+    }
+
+    if (mmap(Data + RingBytes, RingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | MAP_POPULATE,
+        Mirror->Fd, 0) == MAP_FAILED) {
+        fprintf(stderr, "%s [warning]: failed to mirror a ring of %zu bytes: %d\n", __func__, RingBytes, errno);
+        return false;
+    }
+    Mirror->MirroredBytes = RingBytes;
+
+    if (Mirror->Huge && RingBytes % BACKEND_RING_MIRROR_ALIGNMENT == 0) {
+        Mirror->SPDKRegistered = spdk_mem_register(Data, 2 * RingBytes) == 0;
+        if (!Mirror->SPDKRegistered) {
+            fprintf(stderr, "%s [warning]: failed to register a mirrored ring with SPDK\n", __func__);
+        }
+    }
+
+    return true;
+}
+
+//
+// Release the data of a ring
+//
+//
+static void
+FreeRingData(
+    MirroredRingT* Mirror,
+    char* Data
+) {
+    if (Mirror->SPDKRegistered) {
+        spdk_mem_unregister(Data, 2 * Mirror->MirroredBytes);
+        Mirror->SPDKRegistered = false;
+    }
+    munmap(Data, 2 * Mirror->MaxBytes);
+    close(Mirror->Fd);
+    Mirror->Fd = -1;
+    Mirror->MirroredBytes = 0;
+}
+#endif
+
 //
 // Set up regions and buffers for the request buffer
 //
@@ -580,7 +872,11 @@ SetUpForRequests(
     // Read data buffer and region
     //
     //
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    BuffConn->RequestDMAReadDataBuff = AllocateRingData(&BuffConn->RequestMirror, BACKEND_REQUEST_BUFFER_SIZE);
+#else
     BuffConn->RequestDMAReadDataBuff = malloc(BACKEND_REQUEST_BUFFER_SIZE);
+#endif
     if (!BuffConn->RequestDMAReadDataBuff) {
         fprintf(stderr, "%s [error]: OOM for DMA read data buffer\n", __func__);
         ret = -1;
@@ -616,14 +912,18 @@ SetUpForRequests(
     }
 
     //
-    // Write meta buffer and region
+    // Write meta buffer and region; with doorbells, the region also covers the parked mark after the head
     //
     //
     BuffConn->RequestDMAWriteMetaBuff = (char*)&BuffConn->RequestRing.Head;
     BuffConn->RequestDMAWriteMetaMr = ibv_reg_mr(
         BuffConn->PDomain,
         BuffConn->RequestDMAWriteMetaBuff,
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+        DDS_RING_PARKED_OFFSET - DDS_RING_HEAD_OFFSET + sizeof(int),
+#else
         sizeof(int),
+#endif
         IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ
     );
     if (!BuffConn->RequestDMAWriteMetaMr) {
@@ -654,6 +954,16 @@ SetUpForRequests(
     BuffConn->RequestDMAReadDataSplitWr.num_sge = 1;
     BuffConn->RequestDMAReadDataSplitWr.wr_id = BUFF_READ_REQUEST_DATA_SPLIT_WR_ID;
 
+    BuffConn->RequestDMAReadInlineSgl.addr = (uint64_t)BuffConn->RequestDMAReadDataBuff;
+    BuffConn->RequestDMAReadInlineSgl.length = BACKEND_REQUEST_INLINE_BYTES;
+    BuffConn->RequestDMAReadInlineSgl.lkey = BuffConn->RequestDMAReadDataMr->lkey;
+    BuffConn->RequestDMAReadInlineWr.opcode = IBV_WR_RDMA_READ;
+    BuffConn->RequestDMAReadInlineWr.send_flags = IBV_SEND_SIGNALED | IBV_SEND_FENCE;
+    BuffConn->RequestDMAReadInlineWr.sg_list = &BuffConn->RequestDMAReadInlineSgl;
+    BuffConn->RequestDMAReadInlineWr.num_sge = 1;
+    BuffConn->RequestDMAReadInlineWr.wr_id = BUFF_READ_REQUEST_INLINE_WR_ID;
+    BuffConn->RequestInlineArmed = 0;
+
     BuffConn->RequestDMAReadMetaSgl.addr = (uint64_t)BuffConn->RequestDMAReadMetaBuff;
     BuffConn->RequestDMAReadMetaSgl.length = RING_BUFFER_REQUEST_META_DATA_SIZE;
     BuffConn->RequestDMAReadMetaSgl.lkey = BuffConn->RequestDMAReadMetaMr->lkey;
@@ -672,6 +982,23 @@ SetUpForRequests(
     BuffConn->RequestDMAWriteMetaWr.num_sge = 1;
     BuffConn->RequestDMAWriteMetaWr.wr_id = BUFF_WRITE_REQUEST_META_WR_ID;
 
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+    //
+    // Parking writes the head and the mark together, unsignaled, as the meta read behind it is signaled
+    //
+    //
+    BuffConn->RequestDMAWriteParkedSgl.addr = (uint64_t)BuffConn->RequestDMAWriteMetaBuff;
+    BuffConn->RequestDMAWriteParkedSgl.length = DDS_RING_PARKED_OFFSET - DDS_RING_HEAD_OFFSET + sizeof(int);
+    BuffConn->RequestDMAWriteParkedSgl.lkey = BuffConn->RequestDMAWriteMetaMr->lkey;
+    BuffConn->RequestDMAWriteParkedWr.opcode = IBV_WR_RDMA_WRITE;
+    BuffConn->RequestDMAWriteParkedWr.send_flags = 0;
+    BuffConn->RequestDMAWriteParkedWr.sg_list = &BuffConn->RequestDMAWriteParkedSgl;
+    BuffConn->RequestDMAWriteParkedWr.num_sge = 1;
+    BuffConn->RequestDMAWriteParkedWr.wr_id = BUFF_WRITE_REQUEST_PARKED_WR_ID;
+    BuffConn->RequestIdlePolls = 0;
+    BuffConn->RequestSleeping = 0;
+#endif
+
     return 0;
 
 DeregisterBuffReadMetaMrForRequestsReturn:
@@ -681,7 +1008,11 @@ DeregisterBuffReadDataMrForRequestsReturn:
     ibv_dereg_mr(BuffConn->RequestDMAReadDataMr);
 
 FreeBuffDMAReadDataBuffForRequestsReturn:
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    FreeRingData(&BuffConn->RequestMirror, BuffConn->RequestDMAReadDataBuff);
+#else
     free(BuffConn->RequestDMAReadDataBuff);
+#endif
 
 SetUpForRequestsReturn:
     return ret;
@@ -695,7 +1026,11 @@ static void
 DestroyForRequests(
     BuffConnConfig* BuffConn
 ) {
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    FreeRingData(&BuffConn->RequestMirror, BuffConn->RequestDMAReadDataBuff);
+#else
     free(BuffConn->RequestDMAReadDataBuff);
+#endif
 
     ibv_dereg_mr(BuffConn->RequestDMAWriteMetaMr);
     ibv_dereg_mr(BuffConn->RequestDMAReadMetaMr);
@@ -705,13 +1040,101 @@ DestroyForRequests(
     memset(&BuffConn->RequestDMAReadMetaSgl, 0, sizeof(BuffConn->RequestDMAReadMetaSgl));
     memset(&BuffConn->RequestDMAReadDataSgl, 0, sizeof(BuffConn->RequestDMAReadDataSgl));
     memset(&BuffConn->RequestDMAReadDataSplitSgl, 0, sizeof(BuffConn->RequestDMAReadDataSplitSgl));
+    memset(&BuffConn->RequestDMAReadInlineSgl, 0, sizeof(BuffConn->RequestDMAReadInlineSgl));
     
     memset(&BuffConn->RequestDMAWriteMetaWr, 0, sizeof(BuffConn->RequestDMAWriteMetaWr));
     memset(&BuffConn->RequestDMAReadMetaWr, 0, sizeof(BuffConn->RequestDMAReadMetaWr));
     memset(&BuffConn->RequestDMAReadDataWr, 0, sizeof(BuffConn->RequestDMAReadDataWr));
     memset(&BuffConn->RequestDMAReadDataSplitWr, 0, sizeof(BuffConn->RequestDMAReadDataSplitWr));
+    memset(&BuffConn->RequestDMAReadInlineWr, 0, sizeof(BuffConn->RequestDMAReadInlineWr));
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+    memset(&BuffConn->RequestDMAWriteParkedSgl, 0, sizeof(BuffConn->RequestDMAWriteParkedSgl));
+    memset(&BuffConn->RequestDMAWriteParkedWr, 0, sizeof(BuffConn->RequestDMAWriteParkedWr));
+    BuffConn->RequestRing.Parked = 0;
+#endif
     
     BuffConn->RequestRing.Head = 0;
+    BuffConn->RequestInlineArmed = 0;
+}
+
+//
+// Free the arrays indexed by the contexts of the requests of a poll
+//
+//
+static void
+FreePollContexts(
+    BuffConnConfig* BuffConn
+) {
+    free(BuffConn->PendingDataPlaneRequests);
+    free(BuffConn->PendingDataPlaneRequestsCold);
+    free(BuffConn->DirectReads);
+    free(BuffConn->CompressReads);
+    free(BuffConn->TraceKeys);
+    BuffConn->PendingDataPlaneRequests = NULL;
+    BuffConn->PendingDataPlaneRequestsCold = NULL;
+    BuffConn->DirectReads = NULL;
+    BuffConn->CompressReads = NULL;
+    BuffConn->TraceKeys = NULL;
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    free(BuffConn->ResponseContexts);
+    free(BuffConn->ResponseDeferred);
+    free(BuffConn->DeferredResponses);
+    free(BuffConn->DeferredResponseOffsets);
+    free(BuffConn->DeferredResponsePending);
+    BuffConn->ResponseContexts = NULL;
+    BuffConn->ResponseDeferred = NULL;
+    BuffConn->DeferredResponses = NULL;
+    BuffConn->DeferredResponseOffsets = NULL;
+    BuffConn->DeferredResponsePending = NULL;
+#endif
+    BuffConn->PollQueueDepth = 0;
+}
+
+//
+// Allocate the arrays indexed by the contexts of the requests of a poll for its queue depth,
+// with no direct reads, compressed reads, traces or deferred responses
+//
+//
+static int
+AllocatePollContexts(
+    BuffConnConfig* BuffConn,
+    RequestIdT PollQueueDepth
+) {
+    FreePollContexts(BuffConn);
+
+    //
+    // The contexts start on a cache line, so that each takes one
+    //
+    //
+    BuffConn->PendingDataPlaneRequests = aligned_alloc(DDS_CACHE_LINE_SIZE, PollQueueDepth * sizeof(DataPlaneRequestContext));
+    BuffConn->PendingDataPlaneRequestsCold = calloc(PollQueueDepth, sizeof(DataPlaneRequestColdContext));
+    BuffConn->DirectReads = calloc(PollQueueDepth, sizeof(DirectReadContext));
+    BuffConn->CompressReads = calloc(PollQueueDepth, sizeof(bool));
+    BuffConn->TraceKeys = calloc(PollQueueDepth, sizeof(RequestIdT));
+    if (!BuffConn->PendingDataPlaneRequests || !BuffConn->PendingDataPlaneRequestsCold || !BuffConn->DirectReads ||
+        !BuffConn->CompressReads || !BuffConn->TraceKeys) {
+        FreePollContexts(BuffConn);
+        return -1;
+    }
+    memset(BuffConn->PendingDataPlaneRequests, 0, PollQueueDepth * sizeof(DataPlaneRequestContext));
+    for (RequestIdT c = 0; c != PollQueueDepth; c++) {
+        BuffConn->PendingDataPlaneRequests[c].Cold = &BuffConn->PendingDataPlaneRequestsCold[c];
+    }
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    BuffConn->ResponseContexts = calloc(BUFF_RESPONSE_CONTEXTS(PollQueueDepth), sizeof(RequestIdT));
+    BuffConn->ResponseDeferred = calloc(PollQueueDepth, sizeof(bool));
+    BuffConn->DeferredResponses = calloc(PollQueueDepth, sizeof(RequestIdT));
+    BuffConn->DeferredResponseOffsets = calloc(PollQueueDepth, sizeof(int));
+    BuffConn->DeferredResponsePending = calloc(PollQueueDepth, sizeof(bool));
+    if (!BuffConn->ResponseContexts || !BuffConn->ResponseDeferred || !BuffConn->DeferredResponses ||
+        !BuffConn->DeferredResponseOffsets || !BuffConn->DeferredResponsePending) {
+        FreePollContexts(BuffConn);
+        return -1;
+    }
+#endif
+    BuffConn->PollQueueDepth = PollQueueDepth;
+
+    return 0;
 }
 
 //
@@ -728,7 +1151,11 @@ SetUpForResponses(
     // Read data buffer and region
     //
     //
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    BuffConn->ResponseDMAWriteDataBuff = AllocateRingData(&BuffConn->ResponseMirror, BACKEND_RESPONSE_BUFFER_SIZE);
+#else
     BuffConn->ResponseDMAWriteDataBuff = malloc(BACKEND_RESPONSE_BUFFER_SIZE);
+#endif
     if (!BuffConn->ResponseDMAWriteDataBuff) {
         fprintf(stderr, "%s [error]: OOM for DMA read data buffer\n", __func__);
         ret = -1;
@@ -771,7 +1198,7 @@ SetUpForResponses(
     BuffConn->ResponseDMAWriteMetaMr = ibv_reg_mr(
         BuffConn->PDomain,
         BuffConn->ResponseDMAWriteMetaBuff,
-        sizeof(int),
+        DDS_RING_HANDOVER_OFFSET - DDS_RING_HEAD_OFFSET + sizeof(int),
         IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ
     );
     if (!BuffConn->ResponseDMAWriteMetaMr) {
@@ -824,8 +1251,101 @@ SetUpForResponses(
     BuffConn->ResponseDMAWriteMetaWr.num_sge = 1;
     BuffConn->ResponseDMAWriteMetaWr.wr_id = BUFF_WRITE_RESPONSE_META_WR_ID;
 
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+    //
+    // Notifications of coalesced batches after the first carry no data, so the tail is not written again
+    //
+    //
+    BuffConn->ResponseDMANotifyWr.opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+    BuffConn->ResponseDMANotifyWr.send_flags = IBV_SEND_SIGNALED;
+    BuffConn->ResponseDMANotifyWr.sg_list = NULL;
+    BuffConn->ResponseDMANotifyWr.num_sge = 0;
+    BuffConn->ResponseDMANotifyWr.wr_id = BUFF_WRITE_RESPONSE_META_WR_ID;
+#endif
+
+    //
+    // The handover writes the tail and the mark together, notifying the host as for a response
+    //
+    //
+    BuffConn->ResponseDMAWriteHandoverSgl.addr = (uint64_t)BuffConn->ResponseDMAWriteMetaBuff;
+    BuffConn->ResponseDMAWriteHandoverSgl.length = DDS_RING_HANDOVER_OFFSET - DDS_RING_HEAD_OFFSET + sizeof(int);
+    BuffConn->ResponseDMAWriteHandoverSgl.lkey = BuffConn->ResponseDMAWriteMetaMr->lkey;
+    BuffConn->ResponseDMAWriteHandoverWr.opcode = BuffConn->ResponseDMAWriteMetaWr.opcode;
+    BuffConn->ResponseDMAWriteHandoverWr.send_flags = IBV_SEND_SIGNALED;
+    BuffConn->ResponseDMAWriteHandoverWr.sg_list = &BuffConn->ResponseDMAWriteHandoverSgl;
+    BuffConn->ResponseDMAWriteHandoverWr.num_sge = 1;
+    BuffConn->ResponseDMAWriteHandoverWr.wr_id = BUFF_WRITE_RESPONSE_HANDOVER_WR_ID;
+    BuffConn->ResponseRing.HandedOver = 0;
+    BuffConn->RequestsQuiesced = 0;
+    BuffConn->HandedOver = 0;
+
+    //
+    // Staging buffer and region for direct reads
+    //
+    //
+    BuffConn->DirectReadStagingBuff = malloc(BACKEND_DIRECT_READ_STAGING_SIZE);
+    if (!BuffConn->DirectReadStagingBuff) {
+        fprintf(stderr, "%s [error]: OOM for direct read staging buffer\n", __func__);
+        ret = -1;
+        goto DeregisterBuffWriteMetaMrForResponsesReturn;
+    }
+
+    BuffConn->DirectReadStagingMr = ibv_reg_mr(
+        BuffConn->PDomain,
+        BuffConn->DirectReadStagingBuff,
+        BACKEND_DIRECT_READ_STAGING_SIZE,
+        IBV_ACCESS_LOCAL_WRITE
+    );
+    if (!BuffConn->DirectReadStagingMr) {
+        fprintf(stderr, "%s [error]: ibv_reg_mr for direct read staging failed\n", __func__);
+        ret = -1;
+        goto FreeDirectReadStagingBuffForResponsesReturn;
+    }
+
+    //
+    // A new connection starts from the first context; the arrays indexed by the contexts
+    // come with the queue depth of the poll
+    //
+    //
+#ifdef BACKEND_STATS_ENABLED
+    memset(&BuffConn->Stats, 0, sizeof(BuffConn->Stats));
+    ResetLatencyHistogram(&BuffConn->Stats.CompletionLatencies);
+#endif
+    BuffConn->ResponseDMAWriteBytes = 0;
+    BuffConn->ResponseBatchCompressed = false;
+    BuffConn->ResponseBatchWrites = false;
+    BuffConn->ResponseHeldEnd = 0;
+    BuffConn->ResponseHeldBatches = 0;
+    BuffConn->ResponseHeldWriteBytes = 0;
+    BuffConn->ResponseSendEnd = 0;
+    BuffConn->ResponseSendBatches = 0;
+    BuffConn->ResponseSendInFlight = false;
+#ifdef BACKEND_RESPONSE_COALESCING
+    BuffConn->ResponseHoldDeadline = 0;
+    BuffConn->ResponseHoldTicks = BACKEND_RESPONSE_COALESCE_MIN_DELAY_US * spdk_get_ticks_hz() / 1000000;
+#endif
+    BuffConn->DirectReadStagingHead = 0;
+    BuffConn->DirectReadStagingUsed = 0;
+    BuffConn->DirectReadWritesInFlight = 0;
+    BuffConn->NextRequestContext = 0;
+    BuffConn->NextCompletionContext = 0;
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    BuffConn->ResponseContextsHead = 0;
+    BuffConn->ResponseContextsTail = 0;
+    BuffConn->DeferredResponsesHead = 0;
+    BuffConn->NumDeferredResponses = 0;
+    BuffConn->ResponseBatchDeferred = false;
+#endif
+
     return 0;
 
+FreeDirectReadStagingBuffForResponsesReturn:
+    free(BuffConn->DirectReadStagingBuff);
+    BuffConn->DirectReadStagingBuff = NULL;
+
+DeregisterBuffWriteMetaMrForResponsesReturn:
+    ibv_dereg_mr(BuffConn->ResponseDMAWriteMetaMr);
+
 DeregisterBuffReadMetaMrForResponsesReturn:
     ibv_dereg_mr(BuffConn->ResponseDMAReadMetaMr);
 
@@ -833,7 +1353,11 @@ DeregisterBuffReadDataMrForResponsesReturn:
     ibv_dereg_mr(BuffConn->ResponseDMAWriteDataMr);
 
 FreeBuffDMAReadDataBuffForResponsesReturn:
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    FreeRingData(&BuffConn->ResponseMirror, BuffConn->ResponseDMAWriteDataBuff);
+#else
     free(BuffConn->ResponseDMAWriteDataBuff);
+#endif
 
 SetUpForResponsesReturn:
     return ret;
@@ -847,7 +1371,32 @@ static void
 DestroyForResponses(
     BuffConnConfig* BuffConn
 ) {
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    FreeRingData(&BuffConn->ResponseMirror, BuffConn->ResponseDMAWriteDataBuff);
+#else
     free(BuffConn->ResponseDMAWriteDataBuff);
+#endif
+
+    FreePollContexts(BuffConn);
+
+    //
+    // Keep the hops of the traced requests of this connection
+    //
+    //
+    if (BuffConn->TraceRing) {
+        FILE* traceFile = fopen(BACKEND_TRACE_PATH, "a");
+        if (traceFile) {
+            DDSTraceDump(BuffConn->TraceRing, "backend", traceFile);
+            fclose(traceFile);
+        }
+        free(BuffConn->TraceRing);
+        BuffConn->TraceRing = NULL;
+    }
+
+    ibv_dereg_mr(BuffConn->DirectReadStagingMr);
+    free(BuffConn->DirectReadStagingBuff);
+    BuffConn->DirectReadStagingMr = NULL;
+    BuffConn->DirectReadStagingBuff = NULL;
 
     ibv_dereg_mr(BuffConn->ResponseDMAWriteMetaMr);
     ibv_dereg_mr(BuffConn->ResponseDMAReadMetaMr);
@@ -858,12 +1407,18 @@ DestroyForResponses(
     memset(&BuffConn->ResponseDMAWriteDataSgl, 0, sizeof(BuffConn->ResponseDMAWriteDataSgl));
     
     memset(&BuffConn->ResponseDMAWriteMetaWr, 0, sizeof(BuffConn->ResponseDMAWriteMetaWr));
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+    memset(&BuffConn->ResponseDMANotifyWr, 0, sizeof(BuffConn->ResponseDMANotifyWr));
+    memset(&BuffConn->ResponseDMAWriteHandoverSgl, 0, sizeof(BuffConn->ResponseDMAWriteHandoverSgl));
+    memset(&BuffConn->ResponseDMAWriteHandoverWr, 0, sizeof(BuffConn->ResponseDMAWriteHandoverWr));
+#endif
     memset(&BuffConn->ResponseDMAReadMetaWr, 0, sizeof(BuffConn->ResponseDMAReadMetaWr));
     memset(&BuffConn->ResponseDMAWriteDataWr, 0, sizeof(BuffConn->RequestDMAReadDataWr));
 
     BuffConn->ResponseRing.TailC = 0;
     BuffConn->ResponseRing.TailB = 0;
     BuffConn->ResponseRing.TailA = 0;
+    BuffConn->PendingFence.Bytes = 0;
 }
 
 //
@@ -918,33 +1473,110 @@ SetUpBuffRegionsAndBuffersReturn:
     return ret;
 }
 
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
 //
-// Destrory regions and buffers for a buffer connection
-//
-//
-static void
-DestroyBuffRegionsAndBuffers(
-    BuffConnConfig* BuffConn
-) {
-    DestroyForCtrlMsgs(BuffConn);
-    DestroyForRequests(BuffConn);
-    DestroyForResponses(BuffConn);
-}
-
-//
-// Find the id of a control connection
+// Bind the offload response rings to a buffer connection, which writes them to the host from now on;
+// return -1 if they can't be bound, which leaves the requests they are for to the host
 //
 //
 static int
-FindConnId(
-    BackEndConfig *Config,
-    struct rdma_cm_id *CmId,
-    uint8_t *IsCtrl
+SetUpForOffloadResponses(
+    BuffConnConfig* BuffConn,
+    BuffMsgF2BBindOffloadRings* Req
 ) {
-    int i;
-        for (i = 0; i < Config->MaxClients; i++) {
-            if (Config->CtrlConns[i].RemoteCmId == CmId) {
-                *IsCtrl = TRUE;
+    if (Req->ClientId != BuffConn->CtrlId || Req->BufferId != BuffConn->BuffId ||
+        Req->Bytes < (uint64_t)OFFLOAD_RESPONSE_RINGS * OFFLOAD_RESPONSE_RING_STRIDE || BuffConn->OffloadRingsMr) {
+        return -1;
+    }
+
+    if (!BindOffloadResponseRings(BuffConn->BuffId)) {
+        return -1;
+    }
+
+    BuffConn->OffloadRingsMr = ibv_reg_mr(BuffConn->PDomain, OffloadResponseRings,
+        sizeof(OffloadResponseRingBuffer) * OFFLOAD_RESPONSE_RINGS, IBV_ACCESS_LOCAL_WRITE);
+    if (!BuffConn->OffloadRingsMr) {
+        fprintf(stderr, "%s [error]: ibv_reg_mr for offload response rings failed\n", __func__);
+        UnbindOffloadResponseRings(BuffConn->BuffId);
+        return -1;
+    }
+
+    BuffConn->OffloadRingsMetaMr = ibv_reg_mr(BuffConn->PDomain, BuffConn->OffloadRingsMeta,
+        sizeof(BuffConn->OffloadRingsMeta), IBV_ACCESS_LOCAL_WRITE);
+    if (!BuffConn->OffloadRingsMetaMr) {
+        fprintf(stderr, "%s [error]: ibv_reg_mr for offload response ring meta failed\n", __func__);
+        ibv_dereg_mr(BuffConn->OffloadRingsMr);
+        BuffConn->OffloadRingsMr = NULL;
+        UnbindOffloadResponseRings(BuffConn->BuffId);
+        return -1;
+    }
+
+    //
+    // The first write of each ring is its tail, which is where the host starts from
+    //
+    //
+    for (int r = 0; r != OFFLOAD_RESPONSE_RINGS; r++) {
+        BuffConn->OffloadRingsMeta[r][0] = UINT64_MAX;
+        BuffConn->OffloadRingsMeta[r][1] = UINT64_MAX;
+    }
+    BuffConn->OffloadRingsAddr = Req->Address;
+    BuffConn->OffloadRingsAccessToken = Req->AccessToken;
+    BuffConn->OffloadRingsSyncInFlight = false;
+
+    return 0;
+}
+
+//
+// Unbind the offload response rings from a buffer connection
+//
+//
+static void
+DestroyForOffloadResponses(
+    BuffConnConfig* BuffConn
+) {
+    if (!BuffConn->OffloadRingsMr) {
+        return;
+    }
+
+    ibv_dereg_mr(BuffConn->OffloadRingsMetaMr);
+    ibv_dereg_mr(BuffConn->OffloadRingsMr);
+    BuffConn->OffloadRingsMetaMr = NULL;
+    BuffConn->OffloadRingsMr = NULL;
+    BuffConn->OffloadRingsSyncInFlight = false;
+    UnbindOffloadResponseRings(BuffConn->BuffId);
+}
+#endif
+
+//
+// Destrory regions and buffers for a buffer connection
+//
+//
+static void
+DestroyBuffRegionsAndBuffers(
+    BuffConnConfig* BuffConn
+) {
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    DestroyForOffloadResponses(BuffConn);
+#endif
+    DestroyForCtrlMsgs(BuffConn);
+    DestroyForRequests(BuffConn);
+    DestroyForResponses(BuffConn);
+}
+
+//
+// Find the id of a control connection
+//
+//
+static int
+FindConnId(
+    BackEndConfig *Config,
+    struct rdma_cm_id *CmId,
+    uint8_t *IsCtrl
+) {
+    int i;
+        for (i = 0; i < Config->MaxClients; i++) {
+            if (Config->CtrlConns[i].RemoteCmId == CmId) {
+                *IsCtrl = TRUE;
                 return i;
             }
         }
@@ -958,6 +1590,28 @@ FindConnId(
     return -1;
 }
 
+//
+// Find the buffer connection and the lane of a lane connection
+//
+//
+static int
+FindLaneId(
+    BackEndConfig *Config,
+    struct rdma_cm_id *CmId,
+    int *Lane
+) {
+    for (int i = 0; i < Config->MaxBuffs; i++) {
+        for (int lane = 1; lane != BUFF_CONN_MAX_QUEUE_PAIRS; lane++) {
+            if (Config->BuffConns[i].LaneCmIds[lane] == CmId) {
+                *Lane = lane;
+                return i;
+            }
+        }
+    }
+
+    return -1;
+}
+
 //
 // Process communication channel events
 //
@@ -992,6 +1646,17 @@ ProcessCmEvents(
         }
         case RDMA_CM_EVENT_CONNECT_REQUEST:
         {
+            //
+            // Hosts connect to the new build once this one has handed over
+            //
+            //
+            if (HandOverStorageEngine) {
+                fprintf(stdout, "Rejecting a connection during the handover\n");
+                rdma_reject(Event->id, NULL, 0);
+                rdma_ack_cm_event(Event);
+                break;
+            }
+
             //
             // Check the type of this connection
             //
@@ -1082,7 +1747,7 @@ ProcessCmEvents(
                     BuffConnConfig *buffConn = NULL;
                     int index;
 
-                    for (index = 0; index < Config->MaxClients; index++) {
+                    for (index = 0; index < Config->MaxBuffs; index++) {
                         if (Config->BuffConns[index].State == CONN_STATE_AVAILABLE) {
                             buffConn = &Config->BuffConns[index];
                             break;
@@ -1157,6 +1822,57 @@ ProcessCmEvents(
 
                     break;
                 }
+                case BUFF_LANE_CONN_PRIV_DATA:
+                {
+                    BuffConnConfig *buffConn = NULL;
+                    BuffLaneConnPrivData lanePrivData;
+
+                    memset(&lanePrivData, 0, sizeof(lanePrivData));
+                    if (Event->param.conn.private_data_len >= sizeof(lanePrivData)) {
+                        memcpy(&lanePrivData, Event->param.conn.private_data, sizeof(lanePrivData));
+                    }
+
+                    //
+                    // A lane joins a buffer that is in use and whose lane is free
+                    //
+                    //
+                    if (lanePrivData.Lane > 0 && lanePrivData.Lane < BUFF_CONN_MAX_QUEUE_PAIRS && lanePrivData.BufferId < Config->MaxBuffs) {
+                        buffConn = &Config->BuffConns[lanePrivData.BufferId];
+                        if (buffConn->State == CONN_STATE_AVAILABLE || buffConn->LaneCmIds[lanePrivData.Lane]) {
+                            buffConn = NULL;
+                        }
+                    }
+
+                    if (buffConn) {
+                        struct rdma_conn_param connParam;
+                        struct rdma_cm_id *laneCmId = Event->id;
+                        rdma_ack_cm_event(Event);
+
+                        ret = SetUpBuffLane(buffConn, lanePrivData.Lane, laneCmId);
+                        if (ret) {
+                            fprintf(stderr, "%s [error]: SetUpBuffLane failed\n", __func__);
+                            break;
+                        }
+
+                        memset(&connParam, 0, sizeof(connParam));
+                        connParam.responder_resources = BUFF_RECVQ_DEPTH;
+                        connParam.initiator_depth = BUFF_SENDQ_DEPTH;
+                        ret = rdma_accept(laneCmId, &connParam);
+                        if (ret) {
+                            fprintf(stderr, "%s [error]: rdma_accept failed %d\n", __func__, ret);
+                            DestroyBuffLane(buffConn, lanePrivData.Lane);
+                            break;
+                        }
+
+                        fprintf(stdout, "Lane #%d of buffer connection #%d is accepted\n", lanePrivData.Lane, buffConn->BuffId);
+                    }
+                    else {
+                        fprintf(stderr, "No buffer connection for lane #%d of buffer #%d\n", lanePrivData.Lane, lanePrivData.BufferId);
+                        rdma_ack_cm_event(Event);
+                    }
+
+                    break;
+                }
                 default:
                 {
                     fprintf(stderr, "CM: unrecognized connection type\n");
@@ -1169,8 +1885,27 @@ ProcessCmEvents(
         case RDMA_CM_EVENT_ESTABLISHED:
         {
             uint8_t isCtrl;
+            int lane;
             int connId = FindConnId(Config, Event->id, &isCtrl);
-            if (connId >= 0) {
+            int laneConnId = connId < 0 ? FindLaneId(Config, Event->id, &lane) : -1;
+            if (laneConnId >= 0) {
+                //
+                // The lane can carry DMA from now on, once the agent of a connected buffer picks it up
+                //
+                //
+                BuffConnConfig* buffConn = &Config->BuffConns[laneConnId];
+                buffConn->LaneQPairs[lane] = buffConn->LaneCmIds[lane]->qp;
+                if (buffConn->State == CONN_STATE_CONNECTED) {
+                    atomic_fetch_or(&buffConn->LanesOpened, 1u << lane);
+                }
+                else {
+                    CountBuffLanes(buffConn);
+                }
+#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
+                fprintf(stdout, "CM: RDMA_CM_EVENT_ESTABLISHED for lane #%d of Buffer Conn#%d\n", lane, laneConnId);
+#endif
+            }
+            else if (connId >= 0) {
                 if (isCtrl) {
 #ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
                     fprintf(stdout, "CM: RDMA_CM_EVENT_ESTABLISHED for Control Conn#%d\n", connId);
@@ -1211,11 +1946,30 @@ ProcessCmEvents(
         case RDMA_CM_EVENT_DISCONNECTED:
         {
             uint8_t isCtrl;
+            int lane;
             int connId = FindConnId(Config, Event->id, &isCtrl);
-            if (connId >= 0) {
+            int laneConnId = connId < 0 ? FindLaneId(Config, Event->id, &lane) : -1;
+            if (laneConnId >= 0) {
+                //
+                // The agent of a connected buffer may be posting to the lane, so it destroys the lane itself
+                //
+                //
+                BuffConnConfig* buffConn = &Config->BuffConns[laneConnId];
+                if (buffConn->State == CONN_STATE_CONNECTED) {
+                    atomic_fetch_or(&buffConn->LanesClosed, 1u << lane);
+                }
+                else {
+                    DestroyBuffLane(buffConn, lane);
+                }
+#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
+                fprintf(stdout, "CM: RDMA_CM_EVENT_DISCONNECTED for lane #%d of Buffer Conn#%d\n", lane, laneConnId);
+#endif
+            }
+            else if (connId >= 0) {
                 if (isCtrl) {
                         if (Config->CtrlConns[connId].State != CONN_STATE_AVAILABLE) {
                             CtrlConnConfig *ctrlConn = &Config->CtrlConns[connId];
+                            LeaseDropClient(connId);
                             DestroyCtrlRegionsAndBuffers(ctrlConn);
                             DestroyCtrlQPair(ctrlConn);
                             ctrlConn->State = CONN_STATE_AVAILABLE;
@@ -1225,8 +1979,14 @@ ProcessCmEvents(
 #endif
                 }
                 else {
-                        if (Config->BuffConns[connId].State != CONN_STATE_AVAILABLE) {
-                            BuffConnConfig *buffConn = &Config->BuffConns[connId];
+                        //
+                        // A connected buffer is torn down by its agent, which may be using it
+                        //
+                        //
+                        BuffConnConfig *buffConn = &Config->BuffConns[connId];
+                        uint8_t connected = CONN_STATE_CONNECTED;
+                        if (!atomic_compare_exchange_strong(&buffConn->State, &connected, CONN_STATE_CLOSING) &&
+                            buffConn->State == CONN_STATE_OCCUPIED) {
                             DestroyBuffRegionsAndBuffers(buffConn);
                             DestroyBuffQPair(buffConn);
                             buffConn->State = CONN_STATE_AVAILABLE;
@@ -1264,6 +2024,102 @@ ProcessCmEvents(
     return ret;
 }
 
+//
+// The ring size granted to a front end: the size it asked for if that is valid here,
+// or the largest ring this back end supports
+//
+//
+static inline uint32_t
+GrantRingBytes(
+    uint32_t RequestedBytes,
+    uint32_t MaxBytes,
+    uint32_t Alignment
+) {
+    return DDS_RING_BYTES_VALID(RequestedBytes, MaxBytes, Alignment) ? RequestedBytes : MaxBytes;
+}
+
+//
+// The queue depth the back end grants a poll of a client: what the client asked for if the back end can have it,
+// or else the deepest the back end has slots for
+//
+//
+static inline uint32_t
+GrantPollQueueDepth(
+    uint32_t RequestedDepth
+) {
+    return DDS_POLL_QUEUE_DEPTH_VALID(RequestedDepth) && RequestedDepth <= DDS_BACKEND_MAX_POLL_QUEUE_DEPTH ?
+        RequestedDepth : DDS_BACKEND_MAX_POLL_QUEUE_DEPTH;
+}
+
+//
+// Submit the next operation of the batch of a control connection as its pending request
+//
+//
+static inline void
+SubmitBatchOp(
+    CtrlConnConfig *CtrlConn,
+    FileService* FS
+) {
+    CtrlMsgF2BReqBatch *req = (CtrlMsgF2BReqBatch *)(CtrlConn->RecvBuff + sizeof(MsgHeader));
+    CtrlMsgB2FAckBatch *resp = (CtrlMsgB2FAckBatch *)(CtrlConn->SendBuff + sizeof(MsgHeader));
+    CtrlMsgBatchOpReq *op = &req->Ops[CtrlConn->BatchNextOp];
+    CtrlMsgBatchOpAck *ack = &resp->Acks[CtrlConn->BatchNextOp];
+
+    ack->MsgId = op->MsgId + 1;
+    ack->Ack.Result = DDS_ERROR_CODE_IO_PENDING;
+    if (op->MsgId == CTRL_MSG_F2B_REQ_DELETE_FILE) {
+        LeaseDropFile(((CtrlMsgF2BReqDeleteFile *)&op->Req)->FileId);
+    }
+    CtrlConn->PendingControlPlaneRequest.RequestId = op->MsgId;
+    CtrlConn->PendingControlPlaneRequest.Request = (BufferT)&op->Req;
+    CtrlConn->PendingControlPlaneRequest.Response = (BufferT)&ack->Ack;
+    SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
+}
+
+//
+// Account for the completed operation of a batch and submit the next one;
+// the flushes of the same file right after a flush are done with it, as nothing ran in between;
+// return true once the batch is done and its ack is ready to send
+//
+//
+static inline bool
+ContinueBatch(
+    CtrlConnConfig *CtrlConn,
+    FileService* FS
+) {
+    CtrlMsgF2BReqBatch *req = (CtrlMsgF2BReqBatch *)(CtrlConn->RecvBuff + sizeof(MsgHeader));
+    CtrlMsgB2FAckBatch *resp = (CtrlMsgB2FAckBatch *)(CtrlConn->SendBuff + sizeof(MsgHeader));
+    ErrorCodeT result = resp->Acks[CtrlConn->BatchNextOp].Ack.Result;
+
+    resp->NumCompleted++;
+    CtrlConn->BatchNextOp++;
+    CtrlMsgBatchOpReq *op = &req->Ops[CtrlConn->BatchNextOp - 1];
+    if (result == DDS_ERROR_CODE_SUCCESS && op->MsgId == CTRL_MSG_F2B_REQ_FLUSH_FILE) {
+        while (CtrlConn->BatchNextOp != CtrlConn->BatchNumOps &&
+            req->Ops[CtrlConn->BatchNextOp].MsgId == CTRL_MSG_F2B_REQ_FLUSH_FILE &&
+            req->Ops[CtrlConn->BatchNextOp].Req.FlushFile.FileId == op->Req.FlushFile.FileId) {
+            CtrlMsgBatchOpAck *ack = &resp->Acks[CtrlConn->BatchNextOp];
+            ack->MsgId = CTRL_MSG_B2F_ACK_FLUSH_FILE;
+            ack->Ack.Result = DDS_ERROR_CODE_SUCCESS;
+            resp->NumCompleted++;
+            CtrlConn->BatchNextOp++;
+        }
+    }
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        resp->Result = result;
+    }
+    else if (CtrlConn->BatchNextOp != CtrlConn->BatchNumOps) {
+        SubmitBatchOp(CtrlConn, FS);
+        return false;
+    }
+
+    CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + offsetof(CtrlMsgB2FAckBatch, Acks) +
+        resp->NumCompleted * sizeof(CtrlMsgBatchOpAck);
+    CtrlConn->BatchNumOps = 0;
+    return true;
+}
+
 //
 // Control message handler
 //
@@ -1283,6 +2139,7 @@ CtrlMsgHandler(
         //
         //
         case CTRL_MSG_F2B_REQUEST_ID: {
+            CtrlMsgF2BRequestId *req = (CtrlMsgF2BRequestId *)(msgIn + 1);
             CtrlMsgB2FRespondId *resp = (CtrlMsgB2FRespondId *)(msgOut + 1);
             struct ibv_send_wr *badSendWr = NULL;
             struct ibv_recv_wr *badRecvWr = NULL;
@@ -1303,6 +2160,18 @@ CtrlMsgHandler(
             //
             msgOut->MsgId = CTRL_MSG_B2F_RESPOND_ID;
             resp->ClientId = CtrlConn->CtrlId;
+            resp->RequestRingBytes = GrantRingBytes(
+                req->RequestRingBytes,
+                BACKEND_REQUEST_BUFFER_SIZE,
+                DDS_REQUEST_RING_BYTES_ALIGNMENT
+            );
+            resp->ResponseRingBytes = GrantRingBytes(
+                req->ResponseRingBytes,
+                BACKEND_RESPONSE_BUFFER_SIZE,
+                DDS_RESPONSE_RING_BYTES_ALIGNMENT
+            );
+            resp->RingProtocol = DDS_RING_PROTOCOL_IMPLEMENTED(req->RingProtocol) ? req->RingProtocol : DDS_RING_PROTOCOL_DEFAULT;
+            resp->PollQueueDepth = GrantPollQueueDepth(req->PollQueueDepth);
             CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FRespondId);
             ret = ibv_post_send(CtrlConn->QPair, &CtrlConn->SendWr, &badSendWr);
             if (ret) {
@@ -1319,6 +2188,7 @@ CtrlMsgHandler(
             CtrlMsgF2BTerminate *req = (CtrlMsgF2BTerminate *)(msgIn + 1);
 
             if (req->ClientId == CtrlConn->CtrlId) {
+                LeaseDropClient(CtrlConn->CtrlId);
                 DestroyCtrlRegionsAndBuffers(CtrlConn);
                 DestroyCtrlQPair(CtrlConn);
                 CtrlConn->State = CONN_STATE_AVAILABLE;
@@ -1453,9 +2323,10 @@ CtrlMsgHandler(
             }
 
             //
-            // Delete the file
+            // Delete the file, whose leases go with it
             //
             //
+            LeaseDropFile(req->FileId);
             CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_DELETE_FILE;
             CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
             CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
@@ -1500,12 +2371,12 @@ CtrlMsgHandler(
         }
             break;
         //
-        // GetFileSize request
+        // FlushFile request
         //
         //
-        case CTRL_MSG_F2B_REQ_GET_FILE_SIZE: {
-            CtrlMsgF2BReqGetFileSize *req = (CtrlMsgF2BReqGetFileSize *)(msgIn + 1);
-            CtrlMsgB2FAckGetFileSize *resp = (CtrlMsgB2FAckGetFileSize *)(msgOut + 1);
+        case CTRL_MSG_F2B_REQ_FLUSH_FILE: {
+            CtrlMsgF2BReqFlushFile *req = (CtrlMsgF2BReqFlushFile *)(msgIn + 1);
+            CtrlMsgB2FAckFlushFile *resp = (CtrlMsgB2FAckFlushFile *)(msgOut + 1);
             struct ibv_recv_wr *badRecvWr = NULL;
 
             //
@@ -1519,26 +2390,26 @@ CtrlMsgHandler(
             }
 
             //
-            // Get the file size
+            // Flush the device
             //
             //
-            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FILE_SIZE;
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_FLUSH_FILE;
             CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
             CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
             resp->Result = DDS_ERROR_CODE_IO_PENDING;
             SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FILE_SIZE;
-            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFileSize);
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_FLUSH_FILE;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckFlushFile);
         }
             break;
         //
-        // GetFileInformationById request
+        // SetFileQoS request
         //
         //
-        case CTRL_MSG_F2B_REQ_GET_FILE_INFO: {
-            CtrlMsgF2BReqGetFileInfo *req = (CtrlMsgF2BReqGetFileInfo *)(msgIn + 1);
-            CtrlMsgB2FAckGetFileInfo *resp = (CtrlMsgB2FAckGetFileInfo *)(msgOut + 1);
+        case CTRL_MSG_F2B_REQ_SET_FILE_QOS: {
+            CtrlMsgF2BReqSetFileQoS *req = (CtrlMsgF2BReqSetFileQoS *)(msgIn + 1);
+            CtrlMsgB2FAckSetFileQoS *resp = (CtrlMsgB2FAckSetFileQoS *)(msgOut + 1);
             struct ibv_recv_wr *badRecvWr = NULL;
 
             //
@@ -1552,26 +2423,26 @@ CtrlMsgHandler(
             }
 
             //
-            // Get the file info
+            // Set the rate limit of the file
             //
             //
-            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FILE_INFO;
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_SET_FILE_QOS;
             CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
             CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
             resp->Result = DDS_ERROR_CODE_IO_PENDING;
             SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FILE_INFO;
-            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFileInfo);
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_SET_FILE_QOS;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckSetFileQoS);
         }
             break;
         //
-        // GetFileAttributes request
+        // SetFileAccessHint request
         //
         //
-        case CTRL_MSG_F2B_REQ_GET_FILE_ATTR: {
-            CtrlMsgF2BReqGetFileAttr *req = (CtrlMsgF2BReqGetFileAttr *)(msgIn + 1);
-            CtrlMsgB2FAckGetFileAttr *resp = (CtrlMsgB2FAckGetFileAttr *)(msgOut + 1);
+        case CTRL_MSG_F2B_REQ_SET_FILE_ACCESS_HINT: {
+            CtrlMsgF2BReqSetFileAccessHint *req = (CtrlMsgF2BReqSetFileAccessHint *)(msgIn + 1);
+            CtrlMsgB2FAckSetFileAccessHint *resp = (CtrlMsgB2FAckSetFileAccessHint *)(msgOut + 1);
             struct ibv_recv_wr *badRecvWr = NULL;
 
             //
@@ -1585,26 +2456,27 @@ CtrlMsgHandler(
             }
 
             //
-            // Get the file attributes
+            // Set how the file is read
             //
             //
-            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FILE_ATTR;
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_SET_FILE_ACCESS_HINT;
             CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
             CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
             resp->Result = DDS_ERROR_CODE_IO_PENDING;
             SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FILE_ATTR;
-            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFileAttr);
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_SET_FILE_ACCESS_HINT;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckSetFileAccessHint);
         }
             break;
+#ifdef OPT_FILE_SERVICE_SNAPSHOTS
         //
-        // GetStorageFreeSpace request
+        // CreateSnapshot request
         //
         //
-        case CTRL_MSG_F2B_REQ_GET_FREE_SPACE: {
-            CtrlMsgF2BReqGetFreeSpace *req = (CtrlMsgF2BReqGetFreeSpace *)(msgIn + 1);
-            CtrlMsgB2FAckGetFreeSpace *resp = (CtrlMsgB2FAckGetFreeSpace *)(msgOut + 1);
+        case CTRL_MSG_F2B_REQ_CREATE_SNAPSHOT: {
+            CtrlMsgF2BReqCreateSnapshot *req = (CtrlMsgF2BReqCreateSnapshot *)(msgIn + 1);
+            CtrlMsgB2FAckCreateSnapshot *resp = (CtrlMsgB2FAckCreateSnapshot *)(msgOut + 1);
             struct ibv_recv_wr *badRecvWr = NULL;
 
             //
@@ -1618,26 +2490,27 @@ CtrlMsgHandler(
             }
 
             //
-            // Get the free storage space
+            // Snapshot the file
             //
             //
-            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FREE_SPACE;
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_CREATE_SNAPSHOT;
             CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
             CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
             resp->Result = DDS_ERROR_CODE_IO_PENDING;
             SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FREE_SPACE;
-            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFreeSpace);
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_CREATE_SNAPSHOT;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckCreateSnapshot);
         }
             break;
+#endif
         //
-        // MoveFile request
+        // GetFileSize request
         //
         //
-        case CTRL_MSG_F2B_REQ_MOVE_FILE: {
-            CtrlMsgF2BReqMoveFile *req = (CtrlMsgF2BReqMoveFile *)(msgIn + 1);
-            CtrlMsgB2FAckMoveFile *resp = (CtrlMsgB2FAckMoveFile *)(msgOut + 1);
+        case CTRL_MSG_F2B_REQ_GET_FILE_SIZE: {
+            CtrlMsgF2BReqGetFileSize *req = (CtrlMsgF2BReqGetFileSize *)(msgIn + 1);
+            CtrlMsgB2FAckGetFileSize *resp = (CtrlMsgB2FAckGetFileSize *)(msgOut + 1);
             struct ibv_recv_wr *badRecvWr = NULL;
 
             //
@@ -1651,1177 +2524,3846 @@ CtrlMsgHandler(
             }
 
             //
-            // Move the file
+            // Get the file size
             //
             //
-            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_MOVE_FILE;
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FILE_SIZE;
             CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
             CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
             resp->Result = DDS_ERROR_CODE_IO_PENDING;
             SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-            msgOut->MsgId = CTRL_MSG_B2F_ACK_MOVE_FILE;
-            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckMoveFile);
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FILE_SIZE;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFileSize);
         }
             break;
-        default:
-            fprintf(stderr, "%s [error]: unrecognized control message\n", __func__);
-            ret = -1;
-            break;
-    }
+        //
+        // GetFileInformationById request
+        //
+        //
+        case CTRL_MSG_F2B_REQ_GET_FILE_INFO: {
+            CtrlMsgF2BReqGetFileInfo *req = (CtrlMsgF2BReqGetFileInfo *)(msgIn + 1);
+            CtrlMsgB2FAckGetFileInfo *resp = (CtrlMsgB2FAckGetFileInfo *)(msgOut + 1);
+            struct ibv_recv_wr *badRecvWr = NULL;
 
-    return ret;
-}
+            //
+            // Post a receive first
+            //
+            //
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
+                ret = -1;
+            }
 
-//
-// Process communication channel events for contorl connections
-//
-//
-static int inline
-ProcessCtrlCqEvents(
-    BackEndConfig *Config
-) {
-    int ret = 0;
-    CtrlConnConfig *ctrlConn = NULL;
-    struct ibv_wc wc;
+            //
+            // Get the file info
+            //
+            //
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FILE_INFO;
+            CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
+            CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-    for (int i = 0; i != Config->MaxClients; i++) {
-        ctrlConn = &Config->CtrlConns[i];
-        if (ctrlConn->State != CONN_STATE_CONNECTED) {
-            continue;
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FILE_INFO;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFileInfo);
         }
+            break;
+        //
+        // GetFileAttributes request
+        //
+        //
+        case CTRL_MSG_F2B_REQ_GET_FILE_ATTR: {
+            CtrlMsgF2BReqGetFileAttr *req = (CtrlMsgF2BReqGetFileAttr *)(msgIn + 1);
+            CtrlMsgB2FAckGetFileAttr *resp = (CtrlMsgB2FAckGetFileAttr *)(msgOut + 1);
+            struct ibv_recv_wr *badRecvWr = NULL;
 
-        if ((ret = ibv_poll_cq(ctrlConn->CompQ, 1, &wc)) == 1) {
-            ret = 0;
-            if (wc.status != IBV_WC_SUCCESS) {
-                fprintf(stderr, "%s [error]: ibv_poll_cq failed status %d\n", __func__, wc.status);
+            //
+            // Post a receive first
+            //
+            //
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
                 ret = -1;
-                continue;
             }
 
             //
-            // Only receive events are expected
+            // Get the file attributes
             //
             //
-            switch(wc.opcode) {
-                case IBV_WC_RECV: {
-                    ret = CtrlMsgHandler(ctrlConn, Config->FS);
-                    if (ret) {
-                        fprintf(stderr, "%s [error]: CtrlMsgHandler failed\n", __func__);
-                        goto ProcessCtrlCqEventsReturn;
-                    }
-                }
-                    break;
-                case IBV_WC_SEND:
-                case IBV_WC_RDMA_WRITE:
-                case IBV_WC_RDMA_READ:
-                    break;
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FILE_ATTR;
+            CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
+            CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-                default:
-                    fprintf(stderr, "%s [error]: unknown completion\n", __func__);
-                    ret = -1;
-                    break;
-            }
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FILE_ATTR;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFileAttr);
         }
-    }
+            break;
+        //
+        // GetStorageFreeSpace request
+        //
+        //
+        case CTRL_MSG_F2B_REQ_GET_FREE_SPACE: {
+            CtrlMsgF2BReqGetFreeSpace *req = (CtrlMsgF2BReqGetFreeSpace *)(msgIn + 1);
+            CtrlMsgB2FAckGetFreeSpace *resp = (CtrlMsgB2FAckGetFreeSpace *)(msgOut + 1);
+            struct ibv_recv_wr *badRecvWr = NULL;
 
-ProcessCtrlCqEventsReturn:
-    return ret;
-}
+            //
+            // Post a receive first
+            //
+            //
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
+                ret = -1;
+            }
 
-//
-// Buffer message handler
-//
-//
-static inline int
-BuffMsgHandler(
-    BuffConnConfig *BuffConn
-) {
-    int ret = 0;
-    MsgHeader* msgIn = (MsgHeader*)BuffConn->RecvBuff;
-    MsgHeader* msgOut = (MsgHeader*)BuffConn->SendBuff;
+            //
+            // Get the free storage space
+            //
+            //
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_GET_FREE_SPACE;
+            CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
+            CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-    switch(msgIn->MsgId) {
-        case BUFF_MSG_F2B_REQUEST_ID: {
-            BuffMsgF2BRequestId *req = (BuffMsgF2BRequestId *)(msgIn + 1);
-            BuffMsgB2FRespondId *resp = (BuffMsgB2FRespondId *)(msgOut + 1);
-            struct ibv_send_wr *badSendWr = NULL;
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_GET_FREE_SPACE;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckGetFreeSpace);
+        }
+            break;
+        //
+        // MoveFile request
+        //
+        //
+        case CTRL_MSG_F2B_REQ_MOVE_FILE: {
+            CtrlMsgF2BReqMoveFile *req = (CtrlMsgF2BReqMoveFile *)(msgIn + 1);
+            CtrlMsgB2FAckMoveFile *resp = (CtrlMsgB2FAckMoveFile *)(msgOut + 1);
             struct ibv_recv_wr *badRecvWr = NULL;
 
             //
             // Post a receive first
             //
             //
-            ret = ibv_post_recv(BuffConn->QPair, &BuffConn->RecvWr, &badRecvWr);
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
             if (ret) {
-                fprintf(stderr, "%s [error]: ibv_post_recv failed %d\n", __func__, ret);
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
                 ret = -1;
             }
 
             //
-            // Update config and send the buffer id
+            // Move the file
             //
             //
-            BuffConn->CtrlId = req->ClientId;
-            InitializeRingBufferBackEnd(
-                &BuffConn->RequestRing,
-                &BuffConn->ResponseRing,
-                req->BufferAddress,
-                req->AccessToken,
-                req->Capacity
-            );
+            CtrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_MOVE_FILE;
+            CtrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
+            CtrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            SubmitControlPlaneRequest(FS, &CtrlConn->PendingControlPlaneRequest);
 
-            BuffConn->RequestDMAReadMetaWr.wr.rdma.remote_addr = BuffConn->RequestRing.ReadMetaAddr;
-            BuffConn->RequestDMAReadMetaWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
-            BuffConn->RequestDMAWriteMetaWr.wr.rdma.remote_addr = BuffConn->RequestRing.WriteMetaAddr;
-            BuffConn->RequestDMAWriteMetaWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
-            BuffConn->RequestDMAReadDataWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
-            BuffConn->RequestDMAReadDataSplitWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
-            
-            BuffConn->ResponseDMAReadMetaWr.wr.rdma.remote_addr = BuffConn->ResponseRing.ReadMetaAddr;
-            BuffConn->ResponseDMAReadMetaWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
-            BuffConn->ResponseDMAWriteMetaWr.wr.rdma.remote_addr = BuffConn->ResponseRing.WriteMetaAddr;
-            BuffConn->ResponseDMAWriteMetaWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
-            BuffConn->ResponseDMAWriteDataWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
-            BuffConn->ResponseDMAWriteDataSplitWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_MOVE_FILE;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckMoveFile);
+        }
+            break;
+        //
+        // UpdateCache request
+        //
+        //
+        case CTRL_MSG_F2B_REQ_UPDATE_CACHE: {
+            CtrlMsgF2BReqUpdateCache *req = (CtrlMsgF2BReqUpdateCache *)(msgIn + 1);
+            CtrlMsgB2FAckUpdateCache *resp = (CtrlMsgB2FAckUpdateCache *)(msgOut + 1);
+            struct ibv_send_wr *badSendWr = NULL;
+            struct ibv_recv_wr *badRecvWr = NULL;
 
-            msgOut->MsgId = BUFF_MSG_B2F_RESPOND_ID;
-            resp->BufferId = BuffConn->BuffId;
-            BuffConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(BuffMsgB2FRespondId);
-            ret = ibv_post_send(BuffConn->QPair, &BuffConn->SendWr, &badSendWr);
+            //
+            // Post a receive first
+            //
+            //
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
             if (ret) {
-                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
                 ret = -1;
             }
-            
-#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
-            fprintf(stdout, "%s [info]: Buffer Conn#%d is for Client#%d\n", __func__, BuffConn->BuffId, BuffConn->CtrlId);
-            fprintf(stdout, "- Buffer address: %p\n", (void*)BuffConn->RequestRing.RemoteAddr);
-            fprintf(stdout, "- Buffer capacity: %u\n", BuffConn->RequestRing.Capacity);
-            fprintf(stdout, "- Access token: %x\n", BuffConn->RequestRing.AccessToken);
-            fprintf(stdout, "- Request ring data base address: %p\n", (void*)BuffConn->RequestRing.DataBaseAddr);
-            fprintf(stdout, "- Response ring data base address: %p\n", (void*)BuffConn->ResponseRing.DataBaseAddr);
+
+            //
+            // Apply the updates right here; this thread is the only one that changes the cache table,
+            // while the offload workers keep looking it up
+            //
+            //
+            resp->Result = DDS_ERROR_CODE_SUCCESS;
+            resp->NumApplied = 0;
+            if (req->NumUpdates > CTRL_MSG_UPDATE_CACHE_MAX_UPDATES) {
+                resp->Result = DDS_ERROR_CODE_INVALID_PARAM;
+            }
+            for (uint32_t u = 0; resp->Result == DDS_ERROR_CODE_SUCCESS && u != req->NumUpdates; u++) {
+                CacheUpdateT *update = &req->Updates[u];
+                KeyT key = update->Key;
+#if DDS_CACHE_KEY_BYTES == 16
+                key |= (KeyT)update->KeyHigh << 64;
+#endif
+
+                if (update->Type == CACHE_UPDATE_ADD) {
+                    CacheItemT item = { 0 };
+                    item.Key = key;
+                    item.FileId = update->FileId;
+                    item.Offset = update->Offset;
+                    item.Size = update->Size;
+                    if (!CacheTableItemFits(&item)) {
+                        resp->Result = DDS_ERROR_CODE_INVALID_PARAM;
+                        break;
+                    }
+                    if (AddToCacheTable(GlobalCacheTable, &item)) {
+                        resp->Result = DDS_ERROR_CODE_OUT_OF_MEMORY;
+                        break;
+                    }
+#ifdef OFFLOAD_ENGINE_RESPONSE_CACHE
+                    InvalidateResponseCache(item.FileId, item.Offset);
 #endif
+                }
+                else if (update->Type == CACHE_UPDATE_DELETE) {
+                    DeleteFromCacheTable(GlobalCacheTable, &key);
+                }
+                else {
+                    resp->Result = DDS_ERROR_CODE_INVALID_PARAM;
+                    break;
+                }
+                resp->NumApplied++;
+            }
+
             //
-            // Start polling requests
+            // Send the ack
             //
             //
-            ret = ibv_post_send(BuffConn->QPair, &BuffConn->RequestDMAReadMetaWr, &badSendWr);
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_UPDATE_CACHE;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckUpdateCache);
+            ret = ibv_post_send(CtrlConn->QPair, &CtrlConn->SendWr, &badSendWr);
             if (ret) {
                 fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
                 ret = -1;
             }
         }
             break;
-        case BUFF_MSG_F2B_RELEASE: {
-            BuffMsgF2BRelease *req = (BuffMsgF2BRelease *)(msgIn + 1);
+        //
+        // Load scan request
+        //
+        //
+        case CTRL_MSG_F2B_REQ_LOAD_SCAN: {
+            CtrlMsgF2BReqLoadScan *req = (CtrlMsgF2BReqLoadScan *)(msgIn + 1);
+            CtrlMsgB2FAckLoadScan *resp = (CtrlMsgB2FAckLoadScan *)(msgOut + 1);
+            struct ibv_send_wr *badSendWr = NULL;
+            struct ibv_recv_wr *badRecvWr = NULL;
 
-            if (req->BufferId == BuffConn->BuffId && req->ClientId == BuffConn->CtrlId) {
-                DestroyBuffRegionsAndBuffers(BuffConn);
-                DestroyBuffQPair(BuffConn);
-                BuffConn->State = CONN_STATE_AVAILABLE;
-#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
-                fprintf(stdout, "%s [info]: Buffer Conn#%d (Client#%d) is disconnected\n", __func__, req->BufferId, req->ClientId);
-#endif
+            //
+            // Take the path before the receive is posted again, which may overwrite the message
+            //
+            //
+            char codePath[CTRL_MSG_LOAD_SCAN_PATH_BYTES];
+            memcpy(codePath, req->CodePath, CTRL_MSG_LOAD_SCAN_PATH_BYTES);
+            codePath[CTRL_MSG_LOAD_SCAN_PATH_BYTES - 1] = '\0';
+
+            //
+            // Post a receive first
+            //
+            //
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
+                ret = -1;
             }
-            else {
-                fprintf(stderr, "%s [error]: mismatched client id\n", __func__);
+
+            //
+            // Compile and load the function right here; this thread is the only one that adds scan functions,
+            // while the workers keep running the ones loaded
+            //
+            //
+            resp->ScanId = 0;
+#ifdef OPT_FILE_SERVICE_SCAN
+            resp->Result = LoadScanFunction(codePath, &resp->ScanId);
+#else
+            resp->Result = DDS_ERROR_CODE_NOT_IMPLEMENTED;
+#endif
+
+            //
+            // Send the ack
+            //
+            //
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_LOAD_SCAN;
+            CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckLoadScan);
+            ret = ibv_post_send(CtrlConn->QPair, &CtrlConn->SendWr, &badSendWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                ret = -1;
             }
         }
             break;
-        default:
-            fprintf(stderr, "%s [error]: unrecognized control message\n", __func__);
-            ret = -1;
-            break;
-    }
-
-    return ret;
-}
-
-//
-// Execute received requests
-//
-//
-static inline void
-ExecuteRequests(
-    BuffConnConfig* BuffConn,
-    FileService* FS
-) {
-    char* buffReq;
-    char* buffResp;
-    char* curReq;
-    BuffMsgF2BReqHeader* curReqObj;
-    FileIOSizeT curReqSize;
-    FileIOSizeT bytesParsed = 0;
-    FileIOSizeT bytesTotal = BuffConn->RequestDMAReadDataSize;
-
-    int tailReq = BuffConn->RequestRing.Head;
-    int headReq = tailReq >= bytesTotal ? tailReq - bytesTotal : BACKEND_REQUEST_BUFFER_SIZE + tailReq - bytesTotal;
-    int tailResp = BuffConn->ResponseRing.TailA;
-    int headResp = BuffConn->ResponseRing.TailB;
-    int respRingCapacity = tailResp >= headResp ? (BACKEND_RESPONSE_BUFFER_SIZE - tailResp + headResp) : (headResp - tailResp);
-    
-    int progressReqForParsing;
-    FileIOSizeT reqSize;
-    FileIOSizeT respSize = 0;
-    FileIOSizeT totalRespSize = 0;
-    int progressReq = headReq;
-    int progressResp = tailResp;
-    
-    DataPlaneRequestContext* ctxt = NULL;
-    SplittableBufferT* dataBuff = NULL;
-
-    buffReq = BuffConn->RequestDMAReadDataBuff;
-    buffResp = BuffConn->ResponseDMAWriteDataBuff;
-
-#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
-    //
-    // We only need |FileIOSizeT| bytes but use |FileIOSizeT| + |BuffMsgB2FAckHeader| for alignment
-    //
-    //
-    BufferT batchMeta = buffResp + progressResp;
-    progressResp += (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
-    totalRespSize += (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
-    if (progressResp >= BACKEND_RESPONSE_BUFFER_SIZE) {
-        progressResp %= BACKEND_RESPONSE_BUFFER_SIZE;
-    }
-#endif
-
-    DebugPrint("Requests have been received: total request bytes = %d\n", bytesTotal);
-
-    //
-    // Enables batching, will only submit once, will include a batch size with it
-    // the submitted context will be the first one, subsequent processing should handle all in the batch
-    // will also need to handle the wrap around of slots/indices
-    //
-    //
-    RequestIdT batchSize = 0;
-
-    //
-    // the head of batch, will be the one submitted
-    //
-    //
-    RequestIdT firstIndex = BuffConn->NextRequestContext;
-    
-    //
-    // Parse all file requests in the batch
-    //
-    //
-    while (bytesParsed != bytesTotal) {
-        curReq = buffReq + progressReq;
-        reqSize = *(FileIOSizeT*)(curReq);
-        
-        progressReqForParsing = progressReq;
-        bytesParsed += reqSize;
-        progressReq += reqSize;
-        if (progressReq >= BACKEND_REQUEST_BUFFER_SIZE) {
-            progressReq %= BACKEND_REQUEST_BUFFER_SIZE;
-        }
-        progressReqForParsing += sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
-        if (progressReqForParsing >= BACKEND_REQUEST_BUFFER_SIZE) {
-            progressReqForParsing %= BACKEND_REQUEST_BUFFER_SIZE;
-        }
-
-        curReqSize = *(FileIOSizeT*)(curReq) - sizeof(FileIOSizeT);
-        curReq += sizeof(FileIOSizeT);
-
-        if (curReqSize > sizeof(BuffMsgF2BReqHeader)) {
-            //
-            // Process a write request
-            // Allocate a response first, no need to check alignment
-            //
-            //
-            DebugPrint("%s: get a write request\n", __func__);
-            respSize = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
+        //
+        // Batch request: its operations run one at a time as the pending request,
+        // and CheckAndProcessControlPlaneCompletions sends the ack once the last is done
+        //
+        //
+        case CTRL_MSG_F2B_REQ_BATCH: {
+            CtrlMsgF2BReqBatch *req = (CtrlMsgF2BReqBatch *)(msgIn + 1);
+            CtrlMsgB2FAckBatch *resp = (CtrlMsgB2FAckBatch *)(msgOut + 1);
+            struct ibv_send_wr *badSendWr = NULL;
+            struct ibv_recv_wr *badRecvWr = NULL;
 
             //
-            // Extract write source buffer from the request ring
+            // Post a receive first
             //
             //
-            RequestIdT currIndex = BuffConn->NextRequestContext;
-            ctxt = &BuffConn->PendingDataPlaneRequests[currIndex];
-            BuffConn->NextRequestContext++;
-            batchSize++;
-            if (BuffConn->NextRequestContext == DDS_MAX_OUTSTANDING_IO) {
-                BuffConn->NextRequestContext = 0;
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
+                ret = -1;
             }
-            dataBuff = &ctxt->DataBuffer;
 
-            curReqObj = (BuffMsgF2BReqHeader*)curReq;
-            dataBuff->TotalSize = curReqObj->Bytes;
-            dataBuff->FirstAddr = buffReq + progressReqForParsing;
-            if (progressReqForParsing + dataBuff->TotalSize >= BACKEND_REQUEST_BUFFER_SIZE) {
-                dataBuff->FirstSize = BACKEND_REQUEST_BUFFER_SIZE - progressReqForParsing;
-                dataBuff->SecondAddr = buffReq;
-            }
-            else {
-                dataBuff->FirstSize = curReqObj->Bytes;
-                dataBuff->SecondAddr = NULL;
-            }
+            msgOut->MsgId = CTRL_MSG_B2F_ACK_BATCH;
+            resp->Result = DDS_ERROR_CODE_SUCCESS;
+            resp->NumCompleted = 0;
 
             //
-            // Record the size of the this response on the response ring
+            // Only operations that complete through the file service and carry their result first can be batched
             //
             //
-            *(FileIOSizeT*)(buffResp + progressResp) = respSize;
-
-            BuffMsgB2FAckHeader *resp = (BuffMsgB2FAckHeader *)(buffResp + progressResp + sizeof(FileIOSizeT));
-            resp->RequestId = curReqObj->RequestId;
-            resp->Result = DDS_ERROR_CODE_IO_PENDING;
-            
-            progressResp += respSize;
-            totalRespSize += respSize;
-            if (progressResp >= BACKEND_RESPONSE_BUFFER_SIZE) {
-                progressResp %= BACKEND_RESPONSE_BUFFER_SIZE;
+            bool valid = req->NumOps != 0 && req->NumOps <= CTRL_MSG_BATCH_MAX_OPS;
+            for (uint32_t o = 0; valid && o != req->NumOps; o++) {
+                switch (req->Ops[o].MsgId) {
+                    case CTRL_MSG_F2B_REQ_CREATE_DIR:
+                    case CTRL_MSG_F2B_REQ_REMOVE_DIR:
+                    case CTRL_MSG_F2B_REQ_CREATE_FILE:
+                    case CTRL_MSG_F2B_REQ_DELETE_FILE:
+                    case CTRL_MSG_F2B_REQ_CHANGE_FILE_SIZE:
+                    case CTRL_MSG_F2B_REQ_GET_FILE_SIZE:
+                    case CTRL_MSG_F2B_REQ_GET_FILE_ATTR:
+                    case CTRL_MSG_F2B_REQ_MOVE_FILE:
+                    case CTRL_MSG_F2B_REQ_FLUSH_FILE:
+                        break;
+                    default:
+                        valid = false;
+                        break;
+                }
             }
 
-#ifdef OPT_FILE_SERVICE_BATCHING
-            //
-            // Don't submit this request yet, will be batched
-            //
-            //
-            ctxt->Request = curReqObj;
-            ctxt->Response = resp;
-            ctxt->IsRead = false;
-#else
-            //
-            // Submit this request
-            //
-            //
-            ctxt->Request = curReqObj;
-            ctxt->Response = resp;
-            SubmitDataPlaneRequest(FS, ctxt, false, currIndex);
-#endif
-        }
-        else {
-            //
-            // Process a read request
-            // Allocate a response first, need to check alignment
-            //
-            //
-            DebugPrint("%s: get a read request\n", __func__);
-            RingSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
-            curReqObj = (BuffMsgF2BReqHeader*)curReq;
-            respSize = alignment + curReqObj->Bytes;
-            if (respSize % alignment != 0) {
-                respSize += (alignment - (respSize % alignment));
+            if (!valid) {
+                resp->Result = DDS_ERROR_CODE_INVALID_PARAM;
+                CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + offsetof(CtrlMsgB2FAckBatch, Acks);
+                ret = ibv_post_send(CtrlConn->QPair, &CtrlConn->SendWr, &badSendWr);
+                if (ret) {
+                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                    ret = -1;
+                }
+                break;
             }
 
-            //
-            // Record the size of the this response on the response ring
-            //
-            //
-            *(FileIOSizeT*)(buffResp + progressResp) = respSize;
-
-            BuffMsgB2FAckHeader *resp = (BuffMsgB2FAckHeader *)(buffResp + progressResp + sizeof(FileIOSizeT));
-            resp->RequestId = curReqObj->RequestId;
-            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            CtrlConn->BatchNumOps = req->NumOps;
+            CtrlConn->BatchNextOp = 0;
+            SubmitBatchOp(CtrlConn, FS);
+        }
+            break;
+        //
+        // Lease requests, which the control plane answers by itself
+        //
+        //
+        case CTRL_MSG_F2B_REQ_ACQUIRE_LEASE:
+        case CTRL_MSG_F2B_REQ_RELEASE_LEASE:
+        case CTRL_MSG_F2B_REQ_RENEW_LEASES: {
+            struct ibv_send_wr *badSendWr = NULL;
+            struct ibv_recv_wr *badRecvWr = NULL;
 
             //
-            // Extract read destination buffer from the response ring
+            // Post a receive first
             //
             //
-            RequestIdT currIndex = BuffConn->NextRequestContext;
-            ctxt = &BuffConn->PendingDataPlaneRequests[currIndex];
-            BuffConn->NextRequestContext++;
-            batchSize++;
-            if (BuffConn->NextRequestContext == DDS_MAX_OUTSTANDING_IO) {
-                BuffConn->NextRequestContext = 0;
+            ret = ibv_post_recv(CtrlConn->QPair, &CtrlConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed: %d\n", __func__, ret);
+                ret = -1;
             }
-            dataBuff = &ctxt->DataBuffer;
 
-            dataBuff->TotalSize = curReqObj->Bytes;
-            if (progressResp + respSize <= BACKEND_RESPONSE_BUFFER_SIZE) {
-                dataBuff->FirstAddr = buffResp + (progressResp + alignment);
-                dataBuff->FirstSize = dataBuff->TotalSize;
-                dataBuff->SecondAddr = NULL;
+            if (msgIn->MsgId == CTRL_MSG_F2B_REQ_ACQUIRE_LEASE) {
+                CtrlMsgF2BReqAcquireLease *req = (CtrlMsgF2BReqAcquireLease *)(msgIn + 1);
+                CtrlMsgB2FAckAcquireLease *resp = (CtrlMsgB2FAckAcquireLease *)(msgOut + 1);
+                resp->TermMs = 0;
+                resp->Result = LeaseAcquire(req->FileId, CtrlConn->CtrlId, req->Mode, &resp->TermMs);
+                msgOut->MsgId = CTRL_MSG_B2F_ACK_ACQUIRE_LEASE;
+                CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckAcquireLease);
             }
-            else {
-                if (progressResp + alignment < BACKEND_RESPONSE_BUFFER_SIZE) {
-                    dataBuff->FirstAddr = buffResp + (progressResp + alignment);
-                    dataBuff->FirstSize = BACKEND_RESPONSE_BUFFER_SIZE - progressResp - alignment;
-                    dataBuff->SecondAddr = buffResp;
-                }
-                else {
-                    dataBuff->FirstAddr = buffResp;
-                    dataBuff->FirstSize = dataBuff->TotalSize;
-                    dataBuff->SecondAddr = NULL;
-                }
+            else if (msgIn->MsgId == CTRL_MSG_F2B_REQ_RELEASE_LEASE) {
+                CtrlMsgF2BReqReleaseLease *req = (CtrlMsgF2BReqReleaseLease *)(msgIn + 1);
+                CtrlMsgB2FAckReleaseLease *resp = (CtrlMsgB2FAckReleaseLease *)(msgOut + 1);
+                resp->Result = LeaseRelease(req->FileId, CtrlConn->CtrlId);
+                msgOut->MsgId = CTRL_MSG_B2F_ACK_RELEASE_LEASE;
+                CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(CtrlMsgB2FAckReleaseLease);
             }
-            
-            progressResp += respSize;
-            totalRespSize += respSize;
-            if (progressResp >= BACKEND_RESPONSE_BUFFER_SIZE) {
-                progressResp %= BACKEND_RESPONSE_BUFFER_SIZE;
+            else {
+                CtrlMsgB2FAckRenewLeases *resp = (CtrlMsgB2FAckRenewLeases *)(msgOut + 1);
+                resp->NumRevoked = LeaseRenew(CtrlConn->CtrlId, resp->Revoked, CTRL_MSG_RENEW_LEASES_MAX_REVOKED,
+                    &resp->TermMs);
+                resp->Result = DDS_ERROR_CODE_SUCCESS;
+                msgOut->MsgId = CTRL_MSG_B2F_ACK_RENEW_LEASES;
+                CtrlConn->SendWr.sg_list->length = sizeof(MsgHeader) + offsetof(CtrlMsgB2FAckRenewLeases, Revoked) +
+                    resp->NumRevoked * sizeof(FileIdT);
             }
 
-#ifdef OPT_FILE_SERVICE_BATCHING
-            //
-            // Don't submit just yet
-            //
-            //
-            ctxt->Request = curReqObj;
-            ctxt->Response = resp;
-            ctxt->IsRead = true;
-#else
-            //
-            // Submit this request
-            //
-            //
-            ctxt->Request = curReqObj;
-            ctxt->Response = resp;
-            SubmitDataPlaneRequest(FS, ctxt, true, currIndex);
-#endif
+            ret = ibv_post_send(CtrlConn->QPair, &CtrlConn->SendWr, &badSendWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                ret = -1;
+            }
         }
+            break;
+        default:
+            fprintf(stderr, "%s [error]: unrecognized control message\n", __func__);
+            ret = -1;
+            break;
     }
 
-#ifdef OPT_FILE_SERVICE_BATCHING
-    //
-    // Now submit in a batch, this is the host, IoSlotBase should be 0; for the DPU it would be DDS_DPU_IO_SLOT_NUMBER_BASE
-    //
-    //
-    SubmitDataPlaneRequest(
-        FS,
-        BuffConn->PendingDataPlaneRequests,
-        firstIndex,
-        batchSize,
-        0
-    );
-#endif
-
-    //
-    // Update response buffer tail
-    //
-    //
-    if (totalRespSize >= respRingCapacity) {
-        //
-        // If this happens, increase response buffer size
-        // TODO: a mechanism that holds the execution of requests
-        //       until responses are drained and enough space is available
-        //
-        //
-        fprintf(stderr, "%s [error]: Response buffer is corrupted!\n", __func__);
-        exit(-1);
-    }
-    DebugPrint("All requests have been executed. Response size = %d\n", totalRespSize);
-    DebugPrint("%s: AggressiveTail %d -> %d\n", __func__, BuffConn->ResponseRing.TailA, progressResp);
-    BuffConn->ResponseRing.TailA = progressResp;
-
-#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
-    *((FileIOSizeT*)batchMeta) = totalRespSize;
-#endif
+    return ret;
 }
 
 //
-// Compute the distance between two pointers on a ring buffer
+// Process communication channel events for contorl connections
 //
 //
-static inline int
-DistanceBetweenPointers(
-    int Tail,
-    int Head,
-    size_t Capacity
-) {
-    if (Tail >= Head) {
-        return Tail - Head;
-    }
-    else {
-        return Capacity - Head + Tail;
-    }
-}
-
-//
-// Process communication channel events for buffer connections
-//
-//
-static inline int
-ProcessBuffCqEvents(
-    BackEndConfig *Config
+static int inline
+ProcessCtrlCqEvents(
+    BackEndConfig *Config,
+    int *NumCompletions
 ) {
     int ret = 0;
-    BuffConnConfig *buffConn = NULL;
-    struct ibv_send_wr *badSendWr = NULL;
+    CtrlConnConfig *ctrlConn = NULL;
     struct ibv_wc wc;
 
-    for (int i = 0; i != Config->MaxBuffs; i++) {
-        buffConn = &Config->BuffConns[i];
-        if (buffConn->State != CONN_STATE_CONNECTED) {
+    for (int i = 0; i != Config->MaxClients; i++) {
+        ctrlConn = &Config->CtrlConns[i];
+        if (ctrlConn->State != CONN_STATE_CONNECTED) {
             continue;
         }
 
-        if ((ret = ibv_poll_cq(buffConn->CompQ, 1, &wc)) == 1) {
+        if ((ret = ibv_poll_cq(ctrlConn->CompQ, 1, &wc)) == 1) {
             ret = 0;
+            (*NumCompletions)++;
             if (wc.status != IBV_WC_SUCCESS) {
-                fprintf(stderr, "%s [error]: ibv_poll_cq failed status %d (%s)\n", __func__, wc.status, ibv_wc_status_str(wc.status));
+                fprintf(stderr, "%s [error]: ibv_poll_cq failed status %d\n", __func__, wc.status);
                 ret = -1;
                 continue;
             }
 
+            //
+            // Only receive events are expected
+            //
+            //
             switch(wc.opcode) {
                 case IBV_WC_RECV: {
-                    ret = BuffMsgHandler(buffConn);
+                    ret = CtrlMsgHandler(ctrlConn, Config->FS);
                     if (ret) {
-                        fprintf(stderr, "%s [error]: BuffMsgHandler failed\n", __func__);
-                        goto ProcessBuffCqEventsReturn;
+                        fprintf(stderr, "%s [error]: CtrlMsgHandler failed\n", __func__);
+                        goto ProcessCtrlCqEventsReturn;
                     }
                 }
                     break;
-                case IBV_WC_RDMA_READ: {
-                    switch (wc.wr_id)
-                    {
-                    case BUFF_READ_REQUEST_META_WR_ID: {
-                        //
-                        // Process a meta read
-                        //
-                        //
-                        int* pointers = (int*)buffConn->RequestDMAReadMetaBuff;
-                        int progress = pointers[0];
-                        int tail = pointers[DDS_CACHE_LINE_SIZE_BY_INT];
-                        if (tail == buffConn->RequestRing.Head || tail != progress) {
-                            //
-                            // Not ready to read, poll again
-                            //
-                            //
-                            ret = ibv_post_send(buffConn->QPair, &buffConn->RequestDMAReadMetaWr, &badSendWr);
-                            if (ret) {
-                                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                ret = -1;
-                            }
-                        }
-                        else {
-                            //
-                            // Ready to read
-                            //
-                            //
-                            RingSizeT availBytes = 0;
-                            uint64_t sourceBuffer1 = 0;
-                            uint64_t sourceBuffer2 = 0;
-                            uint64_t destBuffer1 = 0;
-                            uint64_t destBuffer2 = 0;
-                            int head = buffConn->RequestRing.Head;
-
-                            if (progress > head) {
-                                availBytes = progress - head;
-                                buffConn->RequestDMAReadDataSize = availBytes;
-                                sourceBuffer1 = buffConn->RequestRing.DataBaseAddr + head;
-                                destBuffer1 = (uint64_t)(buffConn->RequestDMAReadDataBuff + head);
-                            }
-                            else {
-                                availBytes = DDS_REQUEST_RING_BYTES - head;
-                                buffConn->RequestDMAReadDataSize = availBytes + progress;
-                                sourceBuffer1 = buffConn->RequestRing.DataBaseAddr + head;
-                                sourceBuffer2 = buffConn->RequestRing.DataBaseAddr;
-                                destBuffer1 = (uint64_t)(buffConn->RequestDMAReadDataBuff + head);
-                                destBuffer2 = (uint64_t)(buffConn->RequestDMAReadDataBuff);
-                            }
+                case IBV_WC_SEND:
+                case IBV_WC_RDMA_WRITE:
+                case IBV_WC_RDMA_READ:
+                    break;
 
-                            //
-                            // Post a DMA read, by making DPU buffer a mirror of the host buffer
-                            //
-                            //
-                            buffConn->RequestDMAReadDataWr.wr.rdma.remote_addr = sourceBuffer1;
-                            buffConn->RequestDMAReadDataWr.sg_list->addr = destBuffer1;
-                            buffConn->RequestDMAReadDataWr.sg_list->length = availBytes;
+                default:
+                    fprintf(stderr, "%s [error]: unknown completion\n", __func__);
+                    ret = -1;
+                    break;
+            }
+        }
+    }
 
-                            if (sourceBuffer2) {
-                                buffConn->RequestDMAReadDataSplitState = BUFF_READ_DATA_SPLIT_STATE_SPLIT;
+ProcessCtrlCqEventsReturn:
+    return ret;
+}
 
-                                buffConn->RequestDMAReadDataSplitWr.sg_list->addr = destBuffer2;
-                                buffConn->RequestDMAReadDataSplitWr.sg_list->length = progress;
-                                buffConn->RequestDMAReadDataSplitWr.wr.rdma.remote_addr = sourceBuffer2;
-                                ret = ibv_post_send(buffConn->QPair, &buffConn->RequestDMAReadDataSplitWr, &badSendWr);
-                                if (ret) {
-                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                    ret = -1;
-                                }
+//
+// Post work requests of a buffer connection, counting them for the stats endpoint
+//
+//
+static inline int
+PostBuffSend(
+    BuffConnConfig* BuffConn,
+    struct ibv_qp* QPair,
+    struct ibv_send_wr* Wr,
+    struct ibv_send_wr** BadWr
+) {
+#ifdef BACKEND_STATS_ENABLED
+    BuffConn->Stats.RdmaPosts++;
+    for (struct ibv_send_wr* wr = Wr; wr; wr = wr->next) {
+        BuffConn->Stats.RdmaWorkRequests++;
+    }
+#endif
+    return ibv_post_send(QPair, Wr, BadWr);
+}
 
-                                ret = ibv_post_send(buffConn->QPair, &buffConn->RequestDMAReadDataWr, &badSendWr);
-                                if (ret) {
-                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                    ret = -1;
-                                }
-                            }
-                            else {
-                                buffConn->RequestDMAReadDataSplitState = BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT;
+//
+// Poll the meta data of the request ring;
+// while the buffer is armed, the request bytes at the head are read in the same post,
+// fenced behind the meta data so that they are no older than the progress it carries,
+// and only the inline read signals its completion
+//
+//
+static inline int
+PostRequestMetaRead(
+    BuffConnConfig* BuffConn
+) {
+    struct ibv_send_wr *badSendWr = NULL;
 
-                                ret = ibv_post_send(buffConn->QPair, &buffConn->RequestDMAReadDataWr, &badSendWr);
-                                if (ret) {
-                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                    ret = -1;
-                                }
-                            }
+#ifdef BACKEND_REQUEST_INLINE_READ
+    if (BuffConn->RequestInlineArmed) {
+        int head = BuffConn->RequestRing.Head;
+        RingSizeT inlineBytes = BuffConn->RequestRing.Capacity - head;
+        if (inlineBytes > BACKEND_REQUEST_INLINE_BYTES) {
+            inlineBytes = BACKEND_REQUEST_INLINE_BYTES;
+        }
 
-                            buffConn->RequestRing.Head = progress;
-                            
-                            //
-                            // Immediately update remote head, assuming DMA requests are exected in order
-                            //
-                            //
-                            ret = ibv_post_send(buffConn->QPair, &buffConn->RequestDMAWriteMetaWr, &badSendWr);
-                            if (ret) {
-                                fprintf(stderr, "%s [error]: ibv_post_send failed: %d (%s)\n", __func__, ret, strerror(ret));
-                                ret = -1;
-                            }
-                        }
-                    }
-                        break;
-                    case BUFF_READ_REQUEST_DATA_WR_ID: {
-                        //
-                        // Check splitting and update the head
-                        //
-                        //
-                        if (buffConn->RequestDMAReadDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
-                            //
-                            // Execute all the requests
-                            //
-                            //
-                            ExecuteRequests(buffConn, Config->FS);
-                        }
-                        else {
-                            buffConn->RequestDMAReadDataSplitState++;
-                        }
-                    }
-                        break;
-                    case BUFF_READ_REQUEST_DATA_SPLIT_WR_ID: {
-                        //
-                        // Check splitting and update the head
-                        //
-                        //
-                        if (buffConn->RequestDMAReadDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
-                            //
-                            // Execute all the requests
-                            //
-                            //
-                            ExecuteRequests(buffConn, Config->FS);
-                        }
-                        else {
-                            buffConn->RequestDMAReadDataSplitState++;
-                        }
-                    }
-                        break;
-                    case BUFF_READ_RESPONSE_META_WR_ID: {
-                        //
-                        // Process a response meta read
-                        //
-                        //
-                        int* pointers = (int*)buffConn->ResponseDMAReadMetaBuff;
-                        int progress = pointers[0];
-                        int head = pointers[DDS_CACHE_LINE_SIZE_BY_INT];
-                        int tailStart = buffConn->ResponseRing.TailC;
-                        int tailEnd = buffConn->ResponseRing.TailB;
-                        
-                        DebugPrint("head = %d, progress = %d, tail = %d\n", head, progress, tailStart);
+        BuffConn->RequestDMAReadInlineSgl.addr = (uint64_t)(BuffConn->RequestDMAReadDataBuff + head);
+        BuffConn->RequestDMAReadInlineSgl.length = inlineBytes;
+        BuffConn->RequestDMAReadInlineWr.wr.rdma.remote_addr = BuffConn->RequestRing.DataBaseAddr + head;
+        BuffConn->RequestDMAReadMetaWr.send_flags = 0;
+        BuffConn->RequestDMAReadMetaWr.next = &BuffConn->RequestDMAReadInlineWr;
+    }
+    else {
+        BuffConn->RequestDMAReadMetaWr.send_flags = IBV_SEND_SIGNALED;
+        BuffConn->RequestDMAReadMetaWr.next = NULL;
+    }
+#endif
 
-                        if (tailStart == tailEnd) {
-                            //
-                            // No response to send
-                            //
-                            //
-                            break;
-                        }
+    return PostBuffSend(BuffConn, RequestQPair(BuffConn), &BuffConn->RequestDMAReadMetaWr, &badSendWr);
+}
 
-                        const FileIOSizeT totalResponseBytes = DistanceBetweenPointers(tailEnd, tailStart, BACKEND_RESPONSE_BUFFER_SIZE);
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+//
+// Poll an idle request ring again, parking it once RING_BUFFER_REQUEST_DOORBELL_IDLE_POLLS reads in a row found it idle;
+// the mark is written ahead of one more meta read, which the queue pair executes after the write,
+// so the host either published before that read, which then sees the requests, or sees the mark and rings the doorbell;
+// a parked ring that is still idle sleeps until the doorbell
+//
+//
+static inline int
+PollIdleRequestRing(
+    BuffConnConfig* BuffConn
+) {
+    struct ibv_send_wr *badSendWr = NULL;
+    int ret;
 
-                        
-                        RingSizeT distance = 0;
-                        if (head != progress) {
-                            //
-                            // Not ready to write, poll again
-                            //
-                            //
-                            DebugPrint("progress %d != head %d, keep polling\n", progress, head);
-                            ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAReadMetaWr, &badSendWr);
-                            if (ret) {
-                                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                ret = -1;
-                            }
-                            break;
-                        }
+    if (BuffConn->RequestRing.Parked) {
+        BuffConn->RequestSleeping = 1;
+        return 0;
+    }
 
-                        if (tailStart >= head) {
-                            distance = head + DDS_RESPONSE_RING_BYTES - tailStart;
-                        }
-                        else {
-                            distance = head - tailStart;
-                        }
+    if (++BuffConn->RequestIdlePolls >= RING_BUFFER_REQUEST_DOORBELL_IDLE_POLLS) {
+        BuffConn->RequestRing.Parked = 1;
+        ret = PostBuffSend(BuffConn, RequestQPair(BuffConn), &BuffConn->RequestDMAWriteParkedWr, &badSendWr);
+        if (ret) {
+            return ret;
+        }
+    }
 
-                        if (distance < totalResponseBytes) {
-                            //
-                            // Not ready to write, poll again
-                            //
-                            //
-                            ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAReadMetaWr, &badSendWr);
-                            if (ret) {
-                                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                ret = -1;
-                            }
-                            break;
-                        }
-                        else {
-                            //
-                            // Ready to write
-                            //
-                            //
-                            RingSizeT availBytes = 0;
-                            uint64_t sourceBuffer1 = 0;
-                            uint64_t sourceBuffer2 = 0;
-                            uint64_t destBuffer1 = 0;
-                            uint64_t destBuffer2 = 0;
+    return PostRequestMetaRead(BuffConn);
+}
 
-                            DebugPrint("Total response bytes = %d\n", totalResponseBytes);
+//
+// Take a request ring out of the parked state once it has requests again;
+// a mark the host has not cleared costs it one doorbell that is ignored
+//
+//
+static inline void
+UnparkRequestRing(
+    BuffConnConfig* BuffConn
+) {
+    BuffConn->RequestRing.Parked = 0;
+    BuffConn->RequestIdlePolls = 0;
+}
 
-                            if (tailStart + totalResponseBytes <= DDS_RESPONSE_RING_BYTES) {
-                                //
-                                // No split
-                                //
-                                //
-                                availBytes = totalResponseBytes;
-                                sourceBuffer1 = (uint64_t)(buffConn->ResponseDMAWriteDataBuff + tailStart);
-                                destBuffer1 = (uint64_t)(buffConn->ResponseRing.DataBaseAddr + tailStart);
-                            }
-                            else {
-                                //
-                                // Split
-                                //
-                                //
-                                availBytes = DDS_RESPONSE_RING_BYTES - tailStart;
-                                sourceBuffer1 = (uint64_t)(buffConn->ResponseDMAWriteDataBuff + tailStart);
-                                sourceBuffer2 = (uint64_t)(buffConn->ResponseDMAWriteDataBuff);
-                                destBuffer1 = (uint64_t)(buffConn->ResponseRing.DataBaseAddr + tailStart);
-                                destBuffer2 = (uint64_t)(buffConn->ResponseRing.DataBaseAddr);
-                            }
+//
+// Handle a doorbell of the host, a receive without data: wake the request ring if it sleeps,
+// and ignore the doorbell otherwise
+//
+//
+static inline int
+HandleRequestDoorbell(
+    BuffConnConfig* BuffConn
+) {
+    struct ibv_recv_wr *badRecvWr = NULL;
+    int ret;
 
-                            //
-                            // Post DMA writes
-                            //
-                            //
-                            buffConn->ResponseDMAWriteDataWr.wr.rdma.remote_addr = destBuffer1;
-                            buffConn->ResponseDMAWriteDataWr.sg_list->addr = sourceBuffer1;
-                            buffConn->ResponseDMAWriteDataWr.sg_list->length = availBytes;
+    ret = ibv_post_recv(BuffConn->QPair, &BuffConn->RecvWr, &badRecvWr);
+    if (ret) {
+        fprintf(stderr, "%s [error]: ibv_post_recv failed %d\n", __func__, ret);
+        return -1;
+    }
 
-                            if (sourceBuffer2) {
-                                buffConn->ResponseDMAWriteDataSplitState = BUFF_READ_DATA_SPLIT_STATE_SPLIT;
+    //
+    // A ring that sleeps through a handover stays asleep
+    //
+    //
+    if (!BuffConn->RequestSleeping || HandOverStorageEngine) {
+        return 0;
+    }
 
-                                buffConn->ResponseDMAWriteDataSplitWr.sg_list->addr = sourceBuffer2;
-                                buffConn->ResponseDMAWriteDataSplitWr.sg_list->length = totalResponseBytes - availBytes;
-                                buffConn->ResponseDMAWriteDataSplitWr.wr.rdma.remote_addr = destBuffer2;
+    BuffConn->RequestSleeping = 0;
+    BuffConn->RequestInlineArmed = 0;
+    UnparkRequestRing(BuffConn);
 
-                                ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAWriteDataSplitWr, &badSendWr);
-                                if (ret) {
-                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                    ret = -1;
-                                }
+    return PostRequestMetaRead(BuffConn);
+}
+#endif
 
-                                ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAWriteDataWr, &badSendWr);
-                                if (ret) {
-                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                    ret = -1;
-                                }
-                            }
-                            else {
-                                buffConn->ResponseDMAWriteDataSplitState = BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT;
+//
+// Buffer message handler
+//
+//
+static inline int
+BuffMsgHandler(
+    BuffConnConfig *BuffConn
+) {
+    int ret = 0;
+    MsgHeader* msgIn = (MsgHeader*)BuffConn->RecvBuff;
+    MsgHeader* msgOut = (MsgHeader*)BuffConn->SendBuff;
 
-                                ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAWriteDataWr, &badSendWr);
-                                if (ret) {
-                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                                    ret = -1;
-                                }
-                            }
+    switch(msgIn->MsgId) {
+        case BUFF_MSG_F2B_REQUEST_ID: {
+            BuffMsgF2BRequestId *req = (BuffMsgF2BRequestId *)(msgIn + 1);
+            BuffMsgB2FRespondId *resp = (BuffMsgB2FRespondId *)(msgOut + 1);
+            struct ibv_send_wr *badSendWr = NULL;
+            struct ibv_recv_wr *badRecvWr = NULL;
 
-                            DebugPrint("%s: buffConn->ResponseRing.TailC %d -> %d\n", __func__, buffConn->ResponseRing.TailC, (tailStart + totalResponseBytes) % DDS_RESPONSE_RING_BYTES);
-                            buffConn->ResponseRing.TailC = (tailStart + totalResponseBytes) % DDS_RESPONSE_RING_BYTES;
-                            
-                            //
-                            // Immediately update remote tail, assuming DMA requests are exected in order
-                            //
-                            //
-                            ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAWriteMetaWr, &badSendWr);
-                            if (ret) {
-                                fprintf(stderr, "%s [error]: ibv_post_send failed: %d (%s)\n", __func__, ret, strerror(ret));
-                                ret = -1;
-                            }
+            //
+            // Post a receive first
+            //
+            //
+            ret = ibv_post_recv(BuffConn->QPair, &BuffConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed %d\n", __func__, ret);
+                ret = -1;
+            }
+
+            //
+            // Update config and send the buffer id
+            //
+            //
+            BuffConn->CtrlId = req->ClientId;
+            BuffConn->Priority = req->Priority == POLL_PRIORITY_HIGH ? POLL_PRIORITY_HIGH : POLL_PRIORITY_NORMAL;
+            if (!DDS_RING_PROTOCOL_IMPLEMENTED(req->RingProtocol) ||
+                !DDS_RING_BYTES_VALID(req->RequestRingBytes, BACKEND_REQUEST_BUFFER_SIZE, DDS_REQUEST_RING_BYTES_ALIGNMENT) ||
+                !DDS_RING_BYTES_VALID(req->ResponseRingBytes, BACKEND_RESPONSE_BUFFER_SIZE, DDS_RESPONSE_RING_BYTES_ALIGNMENT) ||
+                !DDS_POLL_QUEUE_DEPTH_VALID(req->PollQueueDepth) || req->PollQueueDepth > DDS_BACKEND_MAX_POLL_QUEUE_DEPTH ||
+                req->RequestRingHead < 0 || (uint32_t)req->RequestRingHead >= req->RequestRingBytes ||
+                req->ResponseRingTail < 0 || (uint32_t)req->ResponseRingTail >= req->ResponseRingBytes ||
+                AllocatePollContexts(BuffConn, (RequestIdT)req->PollQueueDepth) ||
+                InitializeRingBufferBackEnd(
+                    &BuffConn->RequestRing,
+                    &BuffConn->ResponseRing,
+                    req->BufferAddress,
+                    req->AccessToken,
+                    req->Capacity,
+                    req->RequestRingBytes,
+                    req->ResponseRingBytes
+                )) {
+                //
+                // Reject the buffer without polling it
+                //
+                //
+                fprintf(stderr, "%s [error]: invalid rings (%u/%u bytes, protocol %u, queue depth %u) for Buffer Conn#%d\n",
+                    __func__, req->RequestRingBytes, req->ResponseRingBytes, req->RingProtocol, req->PollQueueDepth,
+                    BuffConn->BuffId);
+                msgOut->MsgId = BUFF_MSG_B2F_RESPOND_ID;
+                resp->BufferId = -1;
+                BuffConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(BuffMsgB2FRespondId);
+                ret = PostBuffSend(BuffConn, BuffConn->QPair, &BuffConn->SendWr, &badSendWr);
+                if (ret) {
+                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                    ret = -1;
+                }
+                break;
+            }
+
+            BuffConn->RingProtocol = req->RingProtocol;
+
+            //
+            // A buffer handed over by another build resumes its rings where that build left them
+            //
+            //
+            BuffConn->RequestRing.Head = req->RequestRingHead;
+            BuffConn->ResponseRing.TailA = req->ResponseRingTail;
+            BuffConn->ResponseRing.TailB = req->ResponseRingTail;
+            BuffConn->ResponseRing.TailC = req->ResponseRingTail;
+            if (req->RequestRingHead || req->ResponseRingTail) {
+                fprintf(stdout, "Buffer Conn#%d resumes its rings at %d/%d\n", BuffConn->BuffId, req->RequestRingHead, req->ResponseRingTail);
+            }
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+            MirrorRingData(&BuffConn->RequestMirror, BuffConn->RequestDMAReadDataBuff, req->RequestRingBytes);
+            MirrorRingData(&BuffConn->ResponseMirror, BuffConn->ResponseDMAWriteDataBuff, req->ResponseRingBytes);
+#endif
+
+            BuffConn->RequestDMAReadMetaWr.wr.rdma.remote_addr = BuffConn->RequestRing.ReadMetaAddr;
+            BuffConn->RequestDMAReadMetaWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
+            BuffConn->RequestDMAWriteMetaWr.wr.rdma.remote_addr = BuffConn->RequestRing.WriteMetaAddr;
+            BuffConn->RequestDMAWriteMetaWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
+            BuffConn->RequestDMAReadDataWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
+            BuffConn->RequestDMAReadDataSplitWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
+            BuffConn->RequestDMAReadInlineWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+            BuffConn->RequestDMAWriteParkedWr.wr.rdma.remote_addr = BuffConn->RequestRing.WriteMetaAddr;
+            BuffConn->RequestDMAWriteParkedWr.wr.rdma.rkey = BuffConn->RequestRing.AccessToken;
+#endif
+            
+            BuffConn->ResponseDMAReadMetaWr.wr.rdma.remote_addr = BuffConn->ResponseRing.ReadMetaAddr;
+            BuffConn->ResponseDMAReadMetaWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+            BuffConn->ResponseDMAWriteMetaWr.wr.rdma.remote_addr = BuffConn->ResponseRing.WriteMetaAddr;
+            BuffConn->ResponseDMAWriteMetaWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+            BuffConn->ResponseDMANotifyWr.wr.rdma.remote_addr = BuffConn->ResponseRing.WriteMetaAddr;
+            BuffConn->ResponseDMANotifyWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+#endif
+            BuffConn->ResponseDMAWriteHandoverWr.wr.rdma.remote_addr = BuffConn->ResponseRing.WriteMetaAddr;
+            BuffConn->ResponseDMAWriteHandoverWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+            BuffConn->ResponseDMAWriteDataWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+            BuffConn->ResponseDMAWriteDataSplitWr.wr.rdma.rkey = BuffConn->ResponseRing.AccessToken;
+
+            msgOut->MsgId = BUFF_MSG_B2F_RESPOND_ID;
+            resp->BufferId = BuffConn->BuffId;
+            BuffConn->SendWr.sg_list->length = sizeof(MsgHeader) + sizeof(BuffMsgB2FRespondId);
+            ret = PostBuffSend(BuffConn, BuffConn->QPair, &BuffConn->SendWr, &badSendWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                ret = -1;
+            }
+            
+#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
+            fprintf(stdout, "%s [info]: Buffer Conn#%d is for Client#%d\n", __func__, BuffConn->BuffId, BuffConn->CtrlId);
+            fprintf(stdout, "- Buffer address: %p\n", (void*)BuffConn->RequestRing.RemoteAddr);
+            fprintf(stdout, "- Buffer capacity: %u\n", BuffConn->RequestRing.Capacity);
+            fprintf(stdout, "- Access token: %x\n", BuffConn->RequestRing.AccessToken);
+            fprintf(stdout, "- Request ring bytes: %u\n", req->RequestRingBytes);
+            fprintf(stdout, "- Response ring bytes: %u\n", req->ResponseRingBytes);
+            fprintf(stdout, "- Ring protocol: %u\n", BuffConn->RingProtocol);
+            fprintf(stdout, "- Poll queue depth: %u\n", BuffConn->PollQueueDepth);
+            fprintf(stdout, "- Request ring data base address: %p\n", (void*)BuffConn->RequestRing.DataBaseAddr);
+            fprintf(stdout, "- Response ring data base address: %p\n", (void*)BuffConn->ResponseRing.DataBaseAddr);
+#endif
+            //
+            // Start polling requests
+            //
+            //
+            BuffConn->RequestInlineArmed = 0;
+            ret = PostRequestMetaRead(BuffConn);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                ret = -1;
+            }
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+            //
+            // Keep a receive for the doorbell besides the one for messages
+            //
+            //
+            ret = ibv_post_recv(BuffConn->QPair, &BuffConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed %d\n", __func__, ret);
+                ret = -1;
+            }
+#endif
+        }
+            break;
+        case BUFF_MSG_F2B_RELEASE: {
+            BuffMsgF2BRelease *req = (BuffMsgF2BRelease *)(msgIn + 1);
+
+            if (req->BufferId == BuffConn->BuffId && req->ClientId == BuffConn->CtrlId) {
+                DestroyBuffRegionsAndBuffers(BuffConn);
+                DestroyBuffQPair(BuffConn);
+                BuffConn->State = CONN_STATE_AVAILABLE;
+#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
+                fprintf(stdout, "%s [info]: Buffer Conn#%d (Client#%d) is disconnected\n", __func__, req->BufferId, req->ClientId);
+#endif
+            }
+            else {
+                fprintf(stderr, "%s [error]: mismatched client id\n", __func__);
+            }
+        }
+            break;
+        case BUFF_MSG_F2B_BIND_OFFLOAD_RINGS: {
+            struct ibv_recv_wr *badRecvWr = NULL;
+
+            ret = ibv_post_recv(BuffConn->QPair, &BuffConn->RecvWr, &badRecvWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_recv failed %d\n", __func__, ret);
+                ret = -1;
+            }
+
+            //
+            // The host finds out from the tails whether the rings are bound
+            //
+            //
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+            if (SetUpForOffloadResponses(BuffConn, (BuffMsgF2BBindOffloadRings *)(msgIn + 1))) {
+                fprintf(stderr, "%s [error]: offload response rings are not bound to Buffer Conn#%d\n", __func__, BuffConn->BuffId);
+            }
+#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
+            else {
+                fprintf(stdout, "%s [info]: offload response rings are bound to Buffer Conn#%d\n", __func__, BuffConn->BuffId);
+            }
+#endif
+#else
+            fprintf(stderr, "%s [error]: offload response rings are not supported\n", __func__);
+#endif
+        }
+            break;
+        default:
+            fprintf(stderr, "%s [error]: unrecognized control message\n", __func__);
+            ret = -1;
+            break;
+    }
+
+    return ret;
+}
+
+//
+// Copy bytes out of the request buffer at a position, wrapping around if needed
+//
+//
+static inline void
+CopyFromRequestBuffer(
+    char* BuffReq,
+    int RingBytes,
+    int Position,
+    void* Dest,
+    size_t Bytes
+) {
+    Position %= RingBytes;
+    size_t firstBytes = RingBytes - Position;
+
+    if (Bytes <= firstBytes) {
+        memcpy(Dest, BuffReq + Position, Bytes);
+    }
+    else {
+        memcpy(Dest, BuffReq + Position, firstBytes);
+        memcpy((char*)Dest + firstBytes, BuffReq, Bytes - firstBytes);
+    }
+}
+
+//
+// Turn a read by key into the read of the item the key maps to in the cache table, so it goes on as any other read;
+// a key that is not in the table, or an item larger than the destination, leaves the read empty
+// and without a file, with the error in its offset for ReadHandler to respond with
+//
+//
+static inline void
+ResolveKeyRead(
+    char* BuffReq,
+    int RingBytes,
+    int Position,
+    BuffMsgF2BReqHeader* Request
+) {
+    CacheKeyT cacheKey;
+    CacheItemT item;
+
+    CopyFromRequestBuffer(BuffReq, RingBytes, Position, &cacheKey, sizeof(CacheKeyT));
+    KeyT key = cacheKey.Key;
+#if DDS_CACHE_KEY_BYTES == 16
+    key |= (KeyT)cacheKey.KeyHigh << 64;
+#endif
+
+    if (!LookUpCacheTable(GlobalCacheTable, &key, &item)) {
+        Request->Offset = DDS_ERROR_CODE_KEY_NOT_FOUND;
+        Request->Bytes = 0;
+        return;
+    }
+    if (item.Size > Request->Bytes) {
+        Request->Offset = DDS_ERROR_CODE_BUFFER_OVERFLOW;
+        Request->Bytes = 0;
+        return;
+    }
+
+    Request->FileId = item.FileId;
+    Request->Offset = item.Offset;
+    Request->Bytes = item.Size;
+}
+
+//
+// Recycle the direct read state of a context before it is reused;
+// the host reuses a context only after it has consumed the earlier response,
+// so staging space is returned in the same order as it was reserved
+//
+//
+static inline void
+RecycleDirectReadContext(
+    BuffConnConfig* BuffConn,
+    RequestIdT Index
+) {
+    DirectReadContext* direct = &BuffConn->DirectReads[Index];
+
+    BuffConn->DirectReadStagingUsed -= direct->StagingBytes;
+    direct->StagingBytes = 0;
+    direct->IsDirect = false;
+}
+
+//
+// Reserve contiguous staging space for a direct read;
+// return NULL if the staging buffer is full
+//
+//
+static inline char*
+ReserveDirectReadStaging(
+    BuffConnConfig* BuffConn,
+    RingSizeT Bytes,
+    RingSizeT* ReservedBytes
+) {
+    RingSizeT head = BuffConn->DirectReadStagingHead;
+    RingSizeT skipped = 0;
+
+    if (Bytes > BACKEND_DIRECT_READ_STAGING_SIZE) {
+        return NULL;
+    }
+
+    if (head + Bytes > BACKEND_DIRECT_READ_STAGING_SIZE) {
+        skipped = BACKEND_DIRECT_READ_STAGING_SIZE - head;
+        head = 0;
+    }
+
+    if (BuffConn->DirectReadStagingUsed + skipped + Bytes > BACKEND_DIRECT_READ_STAGING_SIZE) {
+        return NULL;
+    }
+
+    BuffConn->DirectReadStagingHead = head + Bytes;
+    BuffConn->DirectReadStagingUsed += skipped + Bytes;
+    *ReservedBytes = skipped + Bytes;
+
+    return BuffConn->DirectReadStagingBuff + head;
+}
+
+#ifdef OPT_FILE_SERVICE_BATCHING
+//
+// Hand the requests parsed since the last submission to the file service once there are
+// BACKEND_REQUEST_SUB_BATCH_SIZE of them, or whatever is left at the end of a batch or a run of contexts;
+// all sub-batches of a buffer go to the same worker and are executed in order
+//
+//
+static inline void
+SubmitRequestSubBatch(
+    BuffConnConfig* BuffConn,
+    FileService* FS,
+    RequestIdT* FirstIndex,
+    RequestIdT* BatchSize,
+    bool EndOfBatch
+) {
+    if (*BatchSize == 0) {
+        return;
+    }
+#ifdef BACKEND_REQUEST_PIPELINE
+    if (!EndOfBatch && *BatchSize < BACKEND_REQUEST_SUB_BATCH_SIZE) {
+        return;
+    }
+#else
+    if (!EndOfBatch) {
+        return;
+    }
+#endif
+
+    SubmitDataPlaneRequest(
+        FS,
+        BuffConn->PendingDataPlaneRequests,
+        DDS_HOST_IO_SLOT_NUMBER_BASE(BuffConn->BuffId) + *FirstIndex,
+        *BatchSize,
+        DDS_HOST_IO_SLOT_NUMBER_BASE(BuffConn->BuffId),
+        BuffConn->PollQueueDepth
+    );
+
+    *FirstIndex = BuffConn->NextRequestContext;
+    *BatchSize = 0;
+}
+#endif
+
+//
+// Compute the distance between two pointers on a ring buffer
+//
+//
+static inline int
+DistanceBetweenPointers(
+    int Tail,
+    int Head,
+    size_t Capacity
+) {
+    if (Tail >= Head) {
+        return Tail - Head;
+    }
+    else {
+        return Capacity - Head + Tail;
+    }
+}
+
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+//
+// Record the context of the next response in the ring
+//
+//
+static inline void
+PushResponseContext(
+    BuffConnConfig* BuffConn,
+    RequestIdT Context
+) {
+    BuffConn->ResponseContexts[BuffConn->ResponseContextsTail] = Context;
+    BuffConn->ResponseContextsTail++;
+    if (BuffConn->ResponseContextsTail == BUFF_RESPONSE_CONTEXTS(BuffConn->PollQueueDepth)) {
+        BuffConn->ResponseContextsTail = 0;
+    }
+}
+
+//
+// Skip the contexts that deferred responses still hold, ending the run of contexts
+// submitted together before the gap, and record the context of the next response
+//
+//
+static inline RequestIdT
+TakeRequestContext(
+    BuffConnConfig* BuffConn,
+    FileService* FS,
+    RequestIdT* FirstIndex,
+    RequestIdT* BatchSize
+) {
+    if (BuffConn->ResponseDeferred[BuffConn->NextRequestContext]) {
+#ifdef OPT_FILE_SERVICE_BATCHING
+        SubmitRequestSubBatch(BuffConn, FS, FirstIndex, BatchSize, true);
+#endif
+        while (BuffConn->ResponseDeferred[BuffConn->NextRequestContext]) {
+            BuffConn->NextRequestContext++;
+            if (BuffConn->NextRequestContext == BuffConn->PollQueueDepth) {
+                BuffConn->NextRequestContext = 0;
+            }
+        }
+        *FirstIndex = BuffConn->NextRequestContext;
+    }
+
+    PushResponseContext(BuffConn, BuffConn->NextRequestContext);
+
+    return BuffConn->NextRequestContext;
+}
+
+//
+// Where the response ring stops being free for new responses:
+// at the oldest deferred response, whose request may still write into it, or else at the responses not sent yet,
+// whichever is further behind
+//
+//
+static inline int
+ResponseRingReuseBoundary(
+    BuffConnConfig* BuffConn
+) {
+    int boundary = BuffConn->ResponseRing.TailC;
+
+    if (BuffConn->NumDeferredResponses) {
+        int deferred = BuffConn->DeferredResponseOffsets[BuffConn->DeferredResponsesHead];
+        int ringBytes = (int)BuffConn->ResponseRing.Capacity;
+        int tail = BuffConn->ResponseRing.TailA;
+
+        if (DistanceBetweenPointers(tail, deferred, ringBytes) > DistanceBetweenPointers(tail, boundary, ringBytes)) {
+            boundary = deferred;
+        }
+    }
+
+    return boundary;
+}
+#endif
+
+//
+// Take the trace of a request from its request id, which carries only the request id afterwards,
+// and record that the back end got it
+//
+//
+static inline void
+TakeRequestTrace(
+    BuffConnConfig* BuffConn,
+    RequestIdT Context,
+    BuffMsgF2BReqHeader* Request
+) {
+    if (!(Request->RequestId & BUFF_MSG_REQUEST_FLAG_TRACED)) {
+        BuffConn->TraceKeys[Context] = 0;
+        return;
+    }
+
+    RequestIdT tagMask = BUFF_MSG_REQUEST_TRACE_TAG_MASK_OF(BuffConn->PollQueueDepth);
+    BuffConn->TraceKeys[Context] = Request->RequestId & (BUFF_MSG_REQUEST_FLAG_TRACED | tagMask |
+        (BuffConn->PollQueueDepth - 1));
+    Request->RequestId &= ~(BUFF_MSG_REQUEST_FLAG_TRACED | tagMask);
+
+    if (!BuffConn->TraceRing) {
+        BuffConn->TraceRing = DDSTraceRingCreate(BuffConn->BuffId);
+    }
+    DDSTraceRecord(BuffConn->TraceRing, DDS_TRACE_REQUEST_KEY(BuffConn->TraceKeys[Context]), DDS_TRACE_HOP_BE_REQUEST,
+        BuffConn->BuffId);
+}
+
+//
+// Record that the response of a traced request is ready to go back to the host
+//
+//
+static inline void
+TraceResponseReady(
+    BuffConnConfig* BuffConn,
+    RequestIdT Context
+) {
+    if (BuffConn->TraceKeys[Context]) {
+        DDSTraceRecord(BuffConn->TraceRing, DDS_TRACE_REQUEST_KEY(BuffConn->TraceKeys[Context]), DDS_TRACE_HOP_BE_COMPLETE,
+            BuffConn->BuffId);
+        BuffConn->TraceKeys[Context] = 0;
+    }
+}
+
+//
+// Count a request the back end took, which storage serves from now on
+//
+//
+static inline void
+CountRequest(
+    BuffConnConfig* BuffConn,
+    RequestIdT Context
+) {
+#ifdef BACKEND_STATS_ENABLED
+    BuffConn->Stats.RequestsParsed++;
+    BuffConn->Stats.IOsSubmitted++;
+    BuffConn->Stats.RequestStartCycles[Context] = ProfilerCycles();
+#endif
+}
+
+//
+// Give a request the fence that came right before it, if any; only a fenced request touches its cold context
+//
+//
+static inline void
+TakePendingFence(
+    BuffConnConfig* BuffConn,
+    DataPlaneRequestContext* Context
+) {
+    Context->Fenced = BuffConn->PendingFence.Bytes != 0;
+    if (Context->Fenced) {
+        Context->Cold->Fence = BuffConn->PendingFence;
+        BuffConn->PendingFence.Bytes = 0;
+    }
+}
+
+//
+// Count that the response of a request is ready, once per request
+//
+//
+static inline void
+CountResponse(
+    BuffConnConfig* BuffConn,
+    RequestIdT Context
+) {
+#ifdef BACKEND_STATS_ENABLED
+    uint64_t start = BuffConn->Stats.RequestStartCycles[Context];
+    if (start) {
+        BuffConn->Stats.IOsCompleted++;
+        RecordLatency(&BuffConn->Stats.CompletionLatencies,
+            (uint64_t)((double)(ProfilerCycles() - start) * ProfilerNsPerCycle()));
+        BuffConn->Stats.RequestStartCycles[Context] = 0;
+    }
+#endif
+}
+
+//
+// Count a batch of requests that was executed, and the bytes of the request and response rings in use
+//
+//
+static inline void
+CountRequestBatch(
+    BuffConnConfig* BuffConn,
+    uint64_t RequestRingBytes,
+    uint64_t ResponseRingBytes
+) {
+#ifdef BACKEND_STATS_ENABLED
+    BuffConnStatsT* stats = &BuffConn->Stats;
+    uint64_t requests = stats->RequestsParsed - stats->BatchRequestsParsed;
+    int bucket = 0;
+
+    while (bucket != BACKEND_STATS_BATCH_BUCKETS - 1 && (1ULL << bucket) < requests) {
+        bucket++;
+    }
+    stats->BatchSizes[bucket]++;
+    stats->RequestBatches++;
+    stats->BatchRequestsParsed = stats->RequestsParsed;
+
+    stats->RequestRingBytesSum += RequestRingBytes;
+    if (RequestRingBytes > stats->RequestRingBytesMax) {
+        stats->RequestRingBytesMax = RequestRingBytes;
+    }
+    stats->ResponseRingBytesSum += ResponseRingBytes;
+    if (ResponseRingBytes > stats->ResponseRingBytesMax) {
+        stats->ResponseRingBytesMax = ResponseRingBytes;
+    }
+#endif
+}
+
+//
+// Execute received requests
+//
+//
+static inline void
+ExecuteRequests(
+    BuffConnConfig* BuffConn,
+    FileService* FS
+) {
+    PROFILE_REGION_BEGIN(execute);
+    char* buffReq;
+    char* buffResp;
+    char* curReq;
+    BuffMsgF2BReqHeader* curReqObj;
+    FileIOSizeT curReqSize;
+    FileIOSizeT bytesParsed = 0;
+    FileIOSizeT bytesTotal = BuffConn->RequestDMAReadDataSize;
+    int reqRingBytes = (int)BuffConn->RequestRing.Capacity;
+    int respRingBytes = (int)BuffConn->ResponseRing.Capacity;
+
+    int tailReq = BuffConn->RequestRing.Head;
+    int headReq = tailReq >= bytesTotal ? tailReq - bytesTotal : reqRingBytes + tailReq - bytesTotal;
+    int tailResp = BuffConn->ResponseRing.TailA;
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    int headResp = ResponseRingReuseBoundary(BuffConn);
+#else
+    int headResp = BuffConn->ResponseRing.TailC;
+#endif
+    int respRingCapacity = tailResp >= headResp ? (respRingBytes - tailResp + headResp) : (headResp - tailResp);
+    
+    int progressReqForParsing;
+    FileIOSizeT reqSize;
+    FileIOSizeT respSize = 0;
+    FileIOSizeT totalRespSize = 0;
+    int progressReq = headReq;
+    int progressResp = tailResp;
+    
+    DataPlaneRequestContext* ctxt = NULL;
+    SplittableBufferT* dataBuff = NULL;
+
+    buffReq = BuffConn->RequestDMAReadDataBuff;
+    buffResp = BuffConn->ResponseDMAWriteDataBuff;
+
+    //
+    // Data wrapping around the end of a mirrored ring goes on in its second copy
+    //
+    //
+#ifdef OPT_FILE_SERVICE_MIRRORED_RINGS
+    const bool reqMirrored = BuffConn->RequestMirror.MirroredBytes != 0;
+    const bool respMirrored = BuffConn->ResponseMirror.MirroredBytes != 0;
+#else
+    const bool reqMirrored = false;
+    const bool respMirrored = false;
+#endif
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    //
+    // We only need |FileIOSizeT| bytes but use |FileIOSizeT| + |BuffMsgB2FAckHeader| for alignment
+    //
+    //
+    BufferT batchMeta = buffResp + progressResp;
+    progressResp += (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+    totalRespSize += (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+    if (progressResp >= respRingBytes) {
+        progressResp %= respRingBytes;
+    }
+#endif
+
+    DebugPrint("Requests have been received: total request bytes = %d\n", bytesTotal);
+
+    //
+    // Enables batching, will only submit once, will include a batch size with it
+    // the submitted context will be the first one, subsequent processing should handle all in the batch
+    // will also need to handle the wrap around of slots/indices
+    //
+    //
+    RequestIdT batchSize = 0;
+
+    //
+    // the head of batch, will be the one submitted
+    //
+    //
+    RequestIdT firstIndex = BuffConn->NextRequestContext;
+    
+    //
+    // Parse all file requests in the batch
+    //
+    //
+    while (bytesParsed != bytesTotal) {
+        curReq = buffReq + progressReq;
+        reqSize = *(FileIOSizeT*)(curReq);
+        
+        progressReqForParsing = progressReq;
+        bytesParsed += reqSize;
+        progressReq += reqSize;
+        if (progressReq >= reqRingBytes) {
+            progressReq %= reqRingBytes;
+        }
+        progressReqForParsing += sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+        if (progressReqForParsing >= reqRingBytes) {
+            progressReqForParsing %= reqRingBytes;
+        }
+
+        curReqSize = *(FileIOSizeT*)(curReq) - sizeof(FileIOSizeT);
+        curReq += sizeof(FileIOSizeT);
+        curReqObj = (BuffMsgF2BReqHeader*)curReq;
+
+        //
+        // A fence takes no context and gets no response, it rides on the next request to the workers
+        //
+        //
+        if (curReqObj->RequestId == BUFF_MSG_REQUEST_FENCE) {
+            ReadFenceT fence = { curReqObj->FileId, curReqObj->Offset, curReqObj->Bytes };
+            if (fence.Bytes) {
+                MergeReadFence(&BuffConn->PendingFence, &fence);
+            }
+            continue;
+        }
+
+        if (curReqSize > sizeof(BuffMsgF2BReqHeader) && !(curReqObj->RequestId & BUFF_MSG_REQUEST_FLAG_DIRECT_READ) &&
+            curReqObj->FileId != BUFF_MSG_REQUEST_FILE_BY_KEY && curReqObj->FileId != BUFF_MSG_REQUEST_FILE_SCAN) {
+            //
+            // Process a write request
+            // Allocate a response first, no need to check alignment
+            //
+            //
+            DebugPrint("%s: get a write request\n", __func__);
+            respSize = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
+
+            //
+            // Extract write source buffer from the request ring
+            //
+            //
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+            RequestIdT currIndex = TakeRequestContext(BuffConn, FS, &firstIndex, &batchSize);
+#else
+            RequestIdT currIndex = BuffConn->NextRequestContext;
+#endif
+            ctxt = &BuffConn->PendingDataPlaneRequests[currIndex];
+            RecycleDirectReadContext(BuffConn, currIndex);
+            BuffConn->CompressReads[currIndex] = false;
+            ctxt->Durable = (curReqObj->RequestId & BUFF_MSG_REQUEST_FLAG_DURABLE_WRITE) != 0;
+            curReqObj->RequestId &= ~BUFF_MSG_REQUEST_FLAG_DURABLE_WRITE;
+            TakeRequestTrace(BuffConn, currIndex, curReqObj);
+            CountRequest(BuffConn, currIndex);
+            TakePendingFence(BuffConn, ctxt);
+            BuffConn->NextRequestContext++;
+            batchSize++;
+            if (BuffConn->NextRequestContext == BuffConn->PollQueueDepth) {
+                BuffConn->NextRequestContext = 0;
+            }
+            dataBuff = &ctxt->DataBuffer;
+
+            dataBuff->TotalSize = curReqObj->Bytes;
+            dataBuff->FirstAddr = buffReq + progressReqForParsing;
+            if (!reqMirrored && progressReqForParsing + dataBuff->TotalSize >= reqRingBytes) {
+                dataBuff->FirstSize = reqRingBytes - progressReqForParsing;
+                dataBuff->SecondAddr = buffReq;
+            }
+            else {
+                dataBuff->FirstSize = curReqObj->Bytes;
+                dataBuff->SecondAddr = NULL;
+            }
+
+            //
+            // The response of an append takes the offset it is given, and that of an atomic operation the value
+            // the word had, right after the header; responses are at multiples of the alignment, which the value
+            // fits in, so it never wraps around the end of the ring.
+            // An atomic operation carries its header as data, and is a write of its word from then on
+            //
+            //
+            ctxt->Appended = curReqObj->Offset == BUFF_MSG_REQUEST_OFFSET_APPEND;
+            ctxt->AtomicOp = curReqObj->Offset == BUFF_MSG_REQUEST_OFFSET_ATOMIC &&
+                curReqObj->Bytes == sizeof(BuffMsgF2BAtomicHeader);
+            if (ctxt->AtomicOp) {
+                CopyFromRequestBuffer(buffReq, reqRingBytes, progressReqForParsing, &ctxt->Cold->Atomic,
+                    sizeof(BuffMsgF2BAtomicHeader));
+                curReqObj->Offset = ctxt->Cold->Atomic.Offset;
+                curReqObj->Bytes = sizeof(uint64_t);
+                dataBuff->TotalSize = sizeof(uint64_t);
+                dataBuff->FirstSize = min(dataBuff->FirstSize, sizeof(uint64_t));
+            }
+            if (ctxt->Appended || ctxt->AtomicOp) {
+                ctxt->Cold->ResponseValue = buffResp + (progressResp + respSize) % respRingBytes;
+                respSize += respSize;
+            }
+
+            //
+            // Record the size of the this response on the response ring
+            //
+            //
+            *(FileIOSizeT*)(buffResp + progressResp) = respSize;
+
+            BuffMsgB2FAckHeader *resp = (BuffMsgB2FAckHeader *)(buffResp + progressResp + sizeof(FileIOSizeT));
+            resp->RequestId = curReqObj->RequestId;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            
+            progressResp += respSize;
+            totalRespSize += respSize;
+            if (progressResp >= respRingBytes) {
+                progressResp %= respRingBytes;
+            }
+
+#ifdef OPT_FILE_SERVICE_REPLICATION
+            //
+            // Forward the write to the peer before it is submitted, so both copies are written at the same time
+            //
+            //
+            ReplicaForward(BuffConn->BuffId % DDS_BACKEND_DATA_PLANE_AGENTS, ctxt, curReqObj);
+#endif
+
+#ifdef OPT_FILE_SERVICE_BATCHING
+            //
+            // Don't submit this request yet, will be batched
+            //
+            //
+            ctxt->Request = curReqObj;
+            ctxt->Response = resp;
+            ctxt->IsRead = false;
+#ifdef BACKEND_REQUEST_PIPELINE
+            SubmitRequestSubBatch(BuffConn, FS, &firstIndex, &batchSize, false);
+#endif
+#else
+            //
+            // Submit this request
+            //
+            //
+            ctxt->Request = curReqObj;
+            ctxt->Response = resp;
+            ctxt->IsRead = false;
+            SubmitDataPlaneRequest(FS, ctxt, false, DDS_HOST_IO_SLOT_NUMBER_BASE(BuffConn->BuffId) + currIndex);
+#endif
+        }
+        else {
+            //
+            // Process a read request
+            // Allocate a response first, need to check alignment
+            //
+            //
+            DebugPrint("%s: get a read request\n", __func__);
+            RingSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+            RequestIdT currIndex = TakeRequestContext(BuffConn, FS, &firstIndex, &batchSize);
+#else
+            RequestIdT currIndex = BuffConn->NextRequestContext;
+#endif
+            DirectReadContext* direct = &BuffConn->DirectReads[currIndex];
+            BuffMsgF2BScanHeader scan;
+            memset(&scan, 0, sizeof(BuffMsgF2BScanHeader));
+            RecycleDirectReadContext(BuffConn, currIndex);
+            BuffConn->CompressReads[currIndex] = (curReqObj->RequestId & BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ) != 0;
+            curReqObj->RequestId &= ~BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ;
+            TakeRequestTrace(BuffConn, currIndex, curReqObj);
+            CountRequest(BuffConn, currIndex);
+
+            if (curReqObj->RequestId & BUFF_MSG_REQUEST_FLAG_DIRECT_READ) {
+                //
+                // A direct read: read into the staging buffer and write the data into the host pages
+                // once it completes, so the response carries no data;
+                // fall back to an inline response if the staging buffer is full
+                //
+                //
+                BuffMsgF2BDirectReadHeader directHeader;
+                curReqObj->RequestId &= ~BUFF_MSG_REQUEST_FLAG_DIRECT_READ;
+                CopyFromRequestBuffer(buffReq, reqRingBytes, progressReqForParsing, &directHeader, sizeof(BuffMsgF2BDirectReadHeader));
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+                if (directHeader.NumSegments <= BUFF_MSG_DIRECT_READ_MAX_SEGMENTS) {
+                    direct->Data = ReserveDirectReadStaging(BuffConn, curReqObj->Bytes, &direct->StagingBytes);
+                    direct->IsDirect = direct->Data != NULL;
+                }
+#endif
+                if (direct->IsDirect) {
+                    direct->AccessToken = directHeader.AccessToken;
+                    direct->NumSegments = directHeader.NumSegments;
+                    CopyFromRequestBuffer(
+                        buffReq,
+                        reqRingBytes,
+                        progressReqForParsing + sizeof(BuffMsgF2BDirectReadHeader),
+                        direct->Segments,
+                        directHeader.NumSegments * sizeof(BuffMsgDirectReadSegment)
+                    );
+                }
+            }
+            else if (curReqObj->FileId == BUFF_MSG_REQUEST_FILE_BY_KEY) {
+                //
+                // A read by key: the lookup shrinks the response to the item before it is reserved
+                //
+                //
+                ResolveKeyRead(buffReq, reqRingBytes, progressReqForParsing, curReqObj);
+            }
+            else if (curReqObj->FileId == BUFF_MSG_REQUEST_FILE_SCAN) {
+                //
+                // A scan: the response is reserved for all of the destination, of which it fills what it keeps
+                //
+                //
+                CopyFromRequestBuffer(buffReq, reqRingBytes, progressReqForParsing, &scan, sizeof(BuffMsgF2BScanHeader));
+                curReqObj->FileId = scan.FileId;
+            }
+
+            respSize = alignment;
+            if (!direct->IsDirect) {
+                respSize += curReqObj->Bytes;
+                if (respSize % alignment != 0) {
+                    respSize += (alignment - (respSize % alignment));
+                }
+            }
+
+            //
+            // Record the size of the this response on the response ring
+            //
+            //
+            *(FileIOSizeT*)(buffResp + progressResp) = respSize;
+
+            BuffMsgB2FAckHeader *resp = (BuffMsgB2FAckHeader *)(buffResp + progressResp + sizeof(FileIOSizeT));
+            resp->RequestId = curReqObj->RequestId;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+
+            //
+            // Extract read destination buffer from the staging buffer or the response ring
+            //
+            //
+            ctxt = &BuffConn->PendingDataPlaneRequests[currIndex];
+            ctxt->Scanned = scan.RecordBytes != 0;
+            if (ctxt->Scanned) {
+                ctxt->Cold->Scan = scan;
+            }
+            TakePendingFence(BuffConn, ctxt);
+            BuffConn->NextRequestContext++;
+            batchSize++;
+            if (BuffConn->NextRequestContext == BuffConn->PollQueueDepth) {
+                BuffConn->NextRequestContext = 0;
+            }
+            dataBuff = &ctxt->DataBuffer;
+
+            dataBuff->TotalSize = curReqObj->Bytes;
+            if (direct->IsDirect) {
+                dataBuff->FirstAddr = direct->Data;
+                dataBuff->FirstSize = dataBuff->TotalSize;
+                dataBuff->SecondAddr = NULL;
+            }
+            else if (respMirrored || progressResp + respSize <= respRingBytes) {
+                dataBuff->FirstAddr = buffResp + (progressResp + alignment);
+                dataBuff->FirstSize = dataBuff->TotalSize;
+                dataBuff->SecondAddr = NULL;
+            }
+            else {
+                if (progressResp + alignment < respRingBytes) {
+                    dataBuff->FirstAddr = buffResp + (progressResp + alignment);
+                    dataBuff->FirstSize = respRingBytes - progressResp - alignment;
+                    dataBuff->SecondAddr = buffResp;
+                }
+                else {
+                    dataBuff->FirstAddr = buffResp;
+                    dataBuff->FirstSize = dataBuff->TotalSize;
+                    dataBuff->SecondAddr = NULL;
+                }
+            }
+            
+            progressResp += respSize;
+            totalRespSize += respSize;
+            if (progressResp >= respRingBytes) {
+                progressResp %= respRingBytes;
+            }
+
+#ifdef OPT_FILE_SERVICE_BATCHING
+            //
+            // Don't submit just yet
+            //
+            //
+            ctxt->Request = curReqObj;
+            ctxt->Response = resp;
+            ctxt->IsRead = true;
+#ifdef BACKEND_REQUEST_PIPELINE
+            SubmitRequestSubBatch(BuffConn, FS, &firstIndex, &batchSize, false);
+#endif
+#else
+            //
+            // Submit this request
+            //
+            //
+            ctxt->Request = curReqObj;
+            ctxt->Response = resp;
+            ctxt->IsRead = true;
+            SubmitDataPlaneRequest(FS, ctxt, true, DDS_HOST_IO_SLOT_NUMBER_BASE(BuffConn->BuffId) + currIndex);
+#endif
+        }
+    }
+
+#ifdef OPT_FILE_SERVICE_BATCHING
+    //
+    // Now submit in a batch what is left after the last sub-batch, this is the host, so each buffer
+    // (i.e., host poll) has its own IoSlotBase; for the DPU it would be DDS_DPU_IO_SLOT_NUMBER_BASE
+    //
+    //
+    SubmitRequestSubBatch(BuffConn, FS, &firstIndex, &batchSize, true);
+#endif
+
+    //
+    // Update response buffer tail
+    //
+    //
+    if (totalRespSize >= respRingCapacity) {
+        //
+        // If this happens, increase response buffer size
+        // TODO: a mechanism that holds the execution of requests
+        //       until responses are drained and enough space is available
+        //
+        //
+        fprintf(stderr, "%s [error]: Response buffer is corrupted!\n", __func__);
+        exit(-1);
+    }
+    DebugPrint("All requests have been executed. Response size = %d\n", totalRespSize);
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    //
+    // Requests that were all fences leave no responses, and the host takes no empty batch
+    //
+    //
+    if (totalRespSize != sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader)) {
+        DebugPrint("%s: AggressiveTail %d -> %d\n", __func__, BuffConn->ResponseRing.TailA, progressResp);
+        BuffConn->ResponseRing.TailA = progressResp;
+        *((FileIOSizeT*)batchMeta) = totalRespSize;
+    }
+#else
+    DebugPrint("%s: AggressiveTail %d -> %d\n", __func__, BuffConn->ResponseRing.TailA, progressResp);
+    BuffConn->ResponseRing.TailA = progressResp;
+#endif
+    CountRequestBatch(BuffConn, bytesTotal, respRingBytes - respRingCapacity);
+    PROFILE_REGION_END(execute, "ExecuteRequests");
+}
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+//
+// Write the data of a completed direct read into the host pages;
+// the writes are posted before the response so the host sees the data first;
+// return 1 if the send queue has no room for them yet
+//
+//
+static inline int
+PostDirectReadWrites(
+    BuffConnConfig* BuffConn,
+    DirectReadContext* Direct,
+    BuffMsgB2FAckHeader* Resp
+) {
+    struct ibv_send_wr wrs[BUFF_MSG_DIRECT_READ_MAX_SEGMENTS];
+    struct ibv_sge sgls[BUFF_MSG_DIRECT_READ_MAX_SEGMENTS];
+    struct ibv_send_wr *badSendWr = NULL;
+    FileIOSizeT bytesLeft = Resp->Result == DDS_ERROR_CODE_SUCCESS ? Resp->BytesServiced : 0;
+    char* source = Direct->Data;
+    int numWrs = 0;
+    int ret = 0;
+
+    for (uint32_t i = 0; i != Direct->NumSegments && bytesLeft; i++) {
+        FileIOSizeT bytes = Direct->Segments[i].Bytes < bytesLeft ? Direct->Segments[i].Bytes : bytesLeft;
+
+        sgls[numWrs].addr = (uint64_t)source;
+        sgls[numWrs].length = bytes;
+        sgls[numWrs].lkey = BuffConn->DirectReadStagingMr->lkey;
+
+        memset(&wrs[numWrs], 0, sizeof(struct ibv_send_wr));
+        wrs[numWrs].wr_id = BUFF_WRITE_DIRECT_READ_DATA_WR_ID;
+        wrs[numWrs].opcode = IBV_WR_RDMA_WRITE;
+        wrs[numWrs].send_flags = IBV_SEND_SIGNALED;
+        wrs[numWrs].sg_list = &sgls[numWrs];
+        wrs[numWrs].num_sge = 1;
+        wrs[numWrs].wr.rdma.remote_addr = Direct->Segments[i].Address;
+        wrs[numWrs].wr.rdma.rkey = Direct->AccessToken;
+        if (numWrs) {
+            wrs[numWrs - 1].next = &wrs[numWrs];
+        }
+
+        source += bytes;
+        bytesLeft -= bytes;
+        numWrs++;
+    }
+
+    if (numWrs == 0) {
+        return 0;
+    }
+
+    if (BuffConn->DirectReadWritesInFlight + numWrs > BUFF_DIRECT_READ_SENDQ_DEPTH) {
+        return 1;
+    }
+
+    ret = PostBuffSend(BuffConn, DirectReadQPair(BuffConn), wrs, &badSendWr);
+    if (ret) {
+        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+        return -1;
+    }
+    BuffConn->DirectReadWritesInFlight += numWrs;
+
+    return 0;
+}
+#endif
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+//
+// Add a DMA of a sync of the offload response rings
+//
+//
+static inline void
+AddOffloadResponseSyncWr(
+    struct ibv_send_wr* Wrs,
+    struct ibv_sge* Sgls,
+    int* NumWrs,
+    enum ibv_wr_opcode Opcode,
+    uint64_t Local,
+    uint32_t LocalKey,
+    uint64_t Remote,
+    uint32_t RemoteKey,
+    uint32_t Bytes
+) {
+    int n = *NumWrs;
+
+    Sgls[n].addr = Local;
+    Sgls[n].length = Bytes;
+    Sgls[n].lkey = LocalKey;
+
+    memset(&Wrs[n], 0, sizeof(struct ibv_send_wr));
+    Wrs[n].wr_id = BUFF_SYNC_OFFLOAD_RESPONSES_WR_ID;
+    Wrs[n].opcode = Opcode;
+    Wrs[n].sg_list = &Sgls[n];
+    Wrs[n].num_sge = 1;
+    Wrs[n].wr.rdma.remote_addr = Remote;
+    Wrs[n].wr.rdma.rkey = RemoteKey;
+    if (n) {
+        Wrs[n - 1].next = &Wrs[n];
+    }
+
+    *NumWrs = n + 1;
+}
+
+//
+// Sync the offload response rings with the host: write the records released since the last sync, then the tail,
+// and read back the head of every ring the host hasn't caught up with; one sync is in flight at a time,
+// and only its last DMA is signaled
+//
+//
+static inline int
+SyncOffloadResponses(
+    BuffConnConfig* BuffConn
+) {
+    struct ibv_send_wr wrs[BUFF_OFFLOAD_RESPONSE_SENDQ_DEPTH];
+    struct ibv_sge sgls[BUFF_OFFLOAD_RESPONSE_SENDQ_DEPTH];
+    struct ibv_send_wr *badSendWr = NULL;
+    int numWrs = 0;
+    int ret = 0;
+
+    if (!BuffConn->OffloadRingsMr || BuffConn->OffloadRingsSyncInFlight) {
+        return 0;
+    }
+
+    for (int r = 0; r != OFFLOAD_RESPONSE_RINGS; r++) {
+        OffloadResponseRingBuffer* ring = &OffloadResponseRings[r];
+        uint64_t tailB = atomic_load_explicit(&ring->Tail[1], memory_order_acquire);
+        uint64_t tailC = atomic_load_explicit(&ring->Synced[0], memory_order_relaxed);
+        uint64_t remote = BuffConn->OffloadRingsAddr + (uint64_t)r * OFFLOAD_RESPONSE_RING_STRIDE;
+
+        BuffConn->OffloadRingsEnd[r] = tailB;
+        if (tailB != BuffConn->OffloadRingsMeta[r][0]) {
+            for (uint64_t position = tailC; position != tailB;) {
+                uint64_t offset = position % OFFLOAD_RESPONSE_RING_DATA_BYTES;
+                uint64_t bytes = tailB - position < OFFLOAD_RESPONSE_RING_DATA_BYTES - offset ?
+                    tailB - position : OFFLOAD_RESPONSE_RING_DATA_BYTES - offset;
+
+                AddOffloadResponseSyncWr(wrs, sgls, &numWrs, IBV_WR_RDMA_WRITE,
+                    (uint64_t)(ring->Buffer + offset), BuffConn->OffloadRingsMr->lkey,
+                    remote + OFFLOAD_RESPONSE_RING_META_BYTES + offset, BuffConn->OffloadRingsAccessToken, (uint32_t)bytes);
+                position += bytes;
+            }
+
+            BuffConn->OffloadRingsMeta[r][0] = tailB;
+            AddOffloadResponseSyncWr(wrs, sgls, &numWrs, IBV_WR_RDMA_WRITE,
+                (uint64_t)&BuffConn->OffloadRingsMeta[r][0], BuffConn->OffloadRingsMetaMr->lkey,
+                remote + OFFLOAD_RESPONSE_RING_TAIL_OFFSET, BuffConn->OffloadRingsAccessToken, sizeof(uint64_t));
+        }
+
+        if (atomic_load_explicit(&ring->Synced[1], memory_order_relaxed) != tailB) {
+            AddOffloadResponseSyncWr(wrs, sgls, &numWrs, IBV_WR_RDMA_READ,
+                (uint64_t)&BuffConn->OffloadRingsMeta[r][1], BuffConn->OffloadRingsMetaMr->lkey,
+                remote + OFFLOAD_RESPONSE_RING_HEAD_OFFSET, BuffConn->OffloadRingsAccessToken, sizeof(uint64_t));
+        }
+    }
+
+    if (numWrs == 0) {
+        return 0;
+    }
+
+    wrs[numWrs - 1].send_flags = IBV_SEND_SIGNALED;
+    ret = PostBuffSend(BuffConn, DirectReadQPair(BuffConn), wrs, &badSendWr);
+    if (ret) {
+        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+        return -1;
+    }
+    BuffConn->OffloadRingsSyncInFlight = true;
+
+    return 0;
+}
+
+//
+// Finish a sync of the offload response rings: the records it wrote can be consumed by the host,
+// and the ring is free up to the head the host has consumed; a head the host hasn't set yet is ignored
+//
+//
+static inline void
+CompleteOffloadResponseSync(
+    BuffConnConfig* BuffConn
+) {
+    for (int r = 0; r != OFFLOAD_RESPONSE_RINGS; r++) {
+        OffloadResponseRingBuffer* ring = &OffloadResponseRings[r];
+        uint64_t head = BuffConn->OffloadRingsMeta[r][1];
+
+        atomic_store_explicit(&ring->Synced[0], BuffConn->OffloadRingsEnd[r], memory_order_relaxed);
+        if (head != UINT64_MAX && head <= BuffConn->OffloadRingsEnd[r] &&
+            head > atomic_load_explicit(&ring->Synced[1], memory_order_relaxed)) {
+            atomic_store_explicit(&ring->Synced[1], head, memory_order_release);
+        }
+    }
+
+    BuffConn->OffloadRingsSyncInFlight = false;
+}
+
+//
+// Sync the offload response rings if a buffer of a data plane agent has them
+//
+//
+static inline int
+ProcessOffloadResponses(
+    DataPlaneAgentConfig *Agent
+) {
+    int owner = atomic_load_explicit(&OffloadResponseRingsOwner, memory_order_acquire);
+    BuffConnConfig *buffConn;
+
+    if (owner < 0 || owner % DDS_BACKEND_DATA_PLANE_AGENTS != Agent->AgentId) {
+        return 0;
+    }
+
+    buffConn = &Agent->Config->BuffConns[owner];
+    if (buffConn->State != CONN_STATE_CONNECTED) {
+        return 0;
+    }
+
+    return SyncOffloadResponses(buffConn);
+}
+#endif
+
+//
+// Process communication channel events for buffer connections
+//
+//
+static inline int
+ProcessBuffCqEvents(
+    DataPlaneAgentConfig *Agent
+) {
+    BackEndConfig *Config = Agent->Config;
+    int ret = 0;
+    BuffConnConfig *buffConn = NULL;
+    struct ibv_send_wr *badSendWr = NULL;
+    struct ibv_wc wc;
+
+    //
+    // Handle high-priority buffers first and with a larger share of completions,
+    // so that their requests are executed ahead of bulk I/O on the other buffers;
+    // within a priority, each round starts from the next buffer, so that buffers of
+    // different clients take turns being served first
+    //
+    //
+    const uint32_t firstBuff = Agent->NextBuffToPoll;
+    Agent->NextBuffToPoll = firstBuff + 1 == Config->MaxBuffs ? 0 : firstBuff + 1;
+
+    for (int pass = 0; pass != 2; pass++) {
+        uint32_t priority = pass == 0 ? POLL_PRIORITY_HIGH : POLL_PRIORITY_NORMAL;
+        int budget = Agent->CqBudget[pass];
+
+        for (uint32_t b = 0; b != Config->MaxBuffs; b++) {
+            uint32_t i = firstBuff + b < Config->MaxBuffs ? firstBuff + b : firstBuff + b - Config->MaxBuffs;
+            buffConn = &Config->BuffConns[i];
+            if (i % DDS_BACKEND_DATA_PLANE_AGENTS != Agent->AgentId ||
+                buffConn->State != CONN_STATE_CONNECTED || buffConn->Priority != priority) {
+                continue;
+            }
+
+            //
+            // A release message tears the buffer down, so stop at it
+            //
+            //
+            int n;
+            for (n = 0; n != budget && buffConn->State == CONN_STATE_CONNECTED && (ret = ibv_poll_cq(buffConn->CompQ, 1, &wc)) == 1; n++) {
+                ret = 0;
+                if (wc.status != IBV_WC_SUCCESS) {
+                    fprintf(stderr, "%s [error]: ibv_poll_cq failed status %d (%s)\n", __func__, wc.status, ibv_wc_status_str(wc.status));
+                    ret = -1;
+                    continue;
+                }
+
+                switch(wc.opcode) {
+                    case IBV_WC_RECV: {
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+                        if (wc.byte_len == 0) {
+                            ret = HandleRequestDoorbell(buffConn);
+                            if (ret) {
+                                fprintf(stderr, "%s [error]: HandleRequestDoorbell failed\n", __func__);
+                                goto ProcessBuffCqEventsReturn;
+                            }
+                            break;
+                        }
+#endif
+                        ret = BuffMsgHandler(buffConn);
+                        if (ret) {
+                            fprintf(stderr, "%s [error]: BuffMsgHandler failed\n", __func__);
+                            goto ProcessBuffCqEventsReturn;
+                        }
+                    }
+                        break;
+                    case IBV_WC_RDMA_READ: {
+                        switch (wc.wr_id)
+                        {
+                        case BUFF_READ_REQUEST_META_WR_ID:
+                        case BUFF_READ_REQUEST_INLINE_WR_ID: {
+                            if (HandOverStorageEngine) {
+                                //
+                                // Stop fetching for the handover; what is left in the ring is fetched by the new build
+                                //
+                                //
+                                buffConn->RequestsQuiesced = 1;
+                                break;
+                            }
+
+                            //
+                            // Process a meta read
+                            //
+                            //
+                            int* pointers = (int*)buffConn->RequestDMAReadMetaBuff;
+                            int progress = pointers[0];
+                            int tail = pointers[DDS_CACHE_LINE_SIZE_BY_INT];
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+                            if (tail != buffConn->RequestRing.Head) {
+                                UnparkRequestRing(buffConn);
+                            }
+#endif
+                            if (tail == buffConn->RequestRing.Head || tail != progress) {
+                                //
+                                // Not ready to read, poll again;
+                                // an idle ring is polled without the inline read
+                                //
+                                //
+                                if (tail == buffConn->RequestRing.Head) {
+                                    buffConn->RequestInlineArmed = 0;
+                                }
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+                                ret = tail == buffConn->RequestRing.Head ? PollIdleRequestRing(buffConn) : PostRequestMetaRead(buffConn);
+#else
+                                ret = PostRequestMetaRead(buffConn);
+#endif
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                    ret = -1;
+                                }
+                            }
+#ifdef BACKEND_REQUEST_INLINE_READ
+                            else if (wc.wr_id == BUFF_READ_REQUEST_INLINE_WR_ID &&
+                                progress > buffConn->RequestRing.Head &&
+                                (RingSizeT)(progress - buffConn->RequestRing.Head) <= buffConn->RequestDMAReadInlineSgl.length) {
+                                //
+                                // The inline read already mirrored all the new requests
+                                //
+                                //
+                                buffConn->RequestDMAReadDataSize = progress - buffConn->RequestRing.Head;
+                                buffConn->RequestRing.Head = progress;
+
+                                ret = PostBuffSend(buffConn, RequestQPair(buffConn), &buffConn->RequestDMAWriteMetaWr, &badSendWr);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d (%s)\n", __func__, ret, strerror(ret));
+                                    ret = -1;
+                                }
+
+#ifdef BACKEND_REQUEST_PIPELINE
+                                //
+                                // Look for the next batch while this one is executed
+                                //
+                                //
+                                ret = PostRequestMetaRead(buffConn);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                    ret = -1;
+                                }
+#endif
+
+                                ExecuteRequests(buffConn, Config->FS);
+                            }
+#endif
+                            else {
+                                //
+                                // Ready to read
+                                //
+                                //
+                                RingSizeT availBytes = 0;
+                                uint64_t sourceBuffer1 = 0;
+                                uint64_t sourceBuffer2 = 0;
+                                uint64_t destBuffer1 = 0;
+                                uint64_t destBuffer2 = 0;
+                                int head = buffConn->RequestRing.Head;
+
+                                if (progress > head) {
+                                    availBytes = progress - head;
+                                    buffConn->RequestDMAReadDataSize = availBytes;
+                                    sourceBuffer1 = buffConn->RequestRing.DataBaseAddr + head;
+                                    destBuffer1 = (uint64_t)(buffConn->RequestDMAReadDataBuff + head);
+                                }
+                                else {
+                                    availBytes = (int)buffConn->RequestRing.Capacity - head;
+                                    buffConn->RequestDMAReadDataSize = availBytes + progress;
+                                    sourceBuffer1 = buffConn->RequestRing.DataBaseAddr + head;
+                                    sourceBuffer2 = buffConn->RequestRing.DataBaseAddr;
+                                    destBuffer1 = (uint64_t)(buffConn->RequestDMAReadDataBuff + head);
+                                    destBuffer2 = (uint64_t)(buffConn->RequestDMAReadDataBuff);
+                                }
+
+                                //
+                                // Post a DMA read, by making DPU buffer a mirror of the host buffer
+                                //
+                                //
+                                buffConn->RequestDMAReadDataWr.wr.rdma.remote_addr = sourceBuffer1;
+                                buffConn->RequestDMAReadDataWr.sg_list->addr = destBuffer1;
+                                buffConn->RequestDMAReadDataWr.sg_list->length = availBytes;
+
+                                if (sourceBuffer2) {
+                                    buffConn->RequestDMAReadDataSplitState = BUFF_READ_DATA_SPLIT_STATE_SPLIT;
+
+                                    buffConn->RequestDMAReadDataSplitWr.sg_list->addr = destBuffer2;
+                                    buffConn->RequestDMAReadDataSplitWr.sg_list->length = progress;
+                                    buffConn->RequestDMAReadDataSplitWr.wr.rdma.remote_addr = sourceBuffer2;
+                                    ret = PostBuffSend(buffConn, RequestQPair(buffConn), &buffConn->RequestDMAReadDataSplitWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                        ret = -1;
+                                    }
+
+                                    ret = PostBuffSend(buffConn, RequestQPair(buffConn), &buffConn->RequestDMAReadDataWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                        ret = -1;
+                                    }
+                                }
+                                else {
+                                    buffConn->RequestDMAReadDataSplitState = BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT;
+
+                                    ret = PostBuffSend(buffConn, RequestQPair(buffConn), &buffConn->RequestDMAReadDataWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                        ret = -1;
+                                    }
+                                }
+
+                                buffConn->RequestRing.Head = progress;
+                                buffConn->RequestInlineArmed = 1;
+                            
+                                //
+                                // Immediately update remote head, assuming DMA requests are exected in order
+                                //
+                                //
+                                ret = PostBuffSend(buffConn, RequestQPair(buffConn), &buffConn->RequestDMAWriteMetaWr, &badSendWr);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d (%s)\n", __func__, ret, strerror(ret));
+                                    ret = -1;
+                                }
+
+#ifdef BACKEND_REQUEST_PIPELINE
+                                //
+                                // Look for the next batch while this one is read and executed;
+                                // completions of the queue pair come in order, so this batch is executed
+                                // before the meta data of the next one is looked at, and the head written
+                                // above has been sent before the next batch moves it
+                                //
+                                //
+                                ret = PostRequestMetaRead(buffConn);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                    ret = -1;
+                                }
+#endif
+                            }
+                        }
+                            break;
+                        case BUFF_READ_REQUEST_DATA_WR_ID: {
+                            //
+                            // Check splitting and update the head
+                            //
+                            //
+                            if (buffConn->RequestDMAReadDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
+                                //
+                                // Execute all the requests
+                                //
+                                //
+                                ExecuteRequests(buffConn, Config->FS);
+                            }
+                            else {
+                                buffConn->RequestDMAReadDataSplitState++;
+                            }
+                        }
+                            break;
+                        case BUFF_READ_REQUEST_DATA_SPLIT_WR_ID: {
+                            //
+                            // Check splitting and update the head
+                            //
+                            //
+                            if (buffConn->RequestDMAReadDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
+                                //
+                                // Execute all the requests
+                                //
+                                //
+                                ExecuteRequests(buffConn, Config->FS);
+                            }
+                            else {
+                                buffConn->RequestDMAReadDataSplitState++;
+                            }
+                        }
+                            break;
+                        case BUFF_READ_RESPONSE_META_WR_ID: {
+                            //
+                            // Process a response meta read
+                            //
+                            //
+                            int* pointers = (int*)buffConn->ResponseDMAReadMetaBuff;
+                            int progress = pointers[0];
+                            int head = pointers[DDS_CACHE_LINE_SIZE_BY_INT];
+                            int tailStart = buffConn->ResponseRing.TailC;
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+                            int tailEnd = buffConn->ResponseSendEnd;
+#else
+                            int tailEnd = buffConn->ResponseRing.TailB;
+#endif
+                        
+                            DebugPrint("head = %d, progress = %d, tail = %d\n", head, progress, tailStart);
+
+                            if (tailStart == tailEnd) {
+                                //
+                                // No response to send
+                                //
+                                //
+                                break;
+                            }
+
+                            const FileIOSizeT totalResponseBytes = DistanceBetweenPointers(tailEnd, tailStart, (int)buffConn->ResponseRing.Capacity);
+
+                        
+                            RingSizeT distance = 0;
+                            if (head != progress) {
+                                //
+                                // Not ready to write, poll again
+                                //
+                                //
+                                DebugPrint("progress %d != head %d, keep polling\n", progress, head);
+                                ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAReadMetaWr, &badSendWr);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                    ret = -1;
+                                }
+                                break;
+                            }
+
+                            if (tailStart >= head) {
+                                distance = head + (int)buffConn->ResponseRing.Capacity - tailStart;
+                            }
+                            else {
+                                distance = head - tailStart;
+                            }
+
+                            //
+                            // Responses may cover direct reads whose data is still on its way through another lane
+                            //
+                            //
+                            if (distance < totalResponseBytes ||
+                                (buffConn->DirectReadWritesInFlight && DirectReadQPair(buffConn) != ResponseQPair(buffConn))) {
+                                //
+                                // Not ready to write, poll again
+                                //
+                                //
+                                ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAReadMetaWr, &badSendWr);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                    ret = -1;
+                                }
+                                break;
+                            }
+                            else {
+                                //
+                                // Ready to write
+                                //
+                                //
+                                RingSizeT availBytes = 0;
+                                uint64_t sourceBuffer1 = 0;
+                                uint64_t sourceBuffer2 = 0;
+                                uint64_t destBuffer1 = 0;
+                                uint64_t destBuffer2 = 0;
+
+                                //
+                                // Compaction may leave bytes at the end of the batch that the host never reads
+                                //
+                                //
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+                                const FileIOSizeT writeBytes = buffConn->ResponseDMAWriteBytes;
+#else
+                                const FileIOSizeT writeBytes = totalResponseBytes;
+#endif
+
+                                DebugPrint("Total response bytes = %d\n", totalResponseBytes);
+
+                                if (tailStart + writeBytes <= (int)buffConn->ResponseRing.Capacity) {
+                                    //
+                                    // No split
+                                    //
+                                    //
+                                    availBytes = writeBytes;
+                                    sourceBuffer1 = (uint64_t)(buffConn->ResponseDMAWriteDataBuff + tailStart);
+                                    destBuffer1 = (uint64_t)(buffConn->ResponseRing.DataBaseAddr + tailStart);
+                                }
+                                else {
+                                    //
+                                    // Split
+                                    //
+                                    //
+                                    availBytes = (int)buffConn->ResponseRing.Capacity - tailStart;
+                                    sourceBuffer1 = (uint64_t)(buffConn->ResponseDMAWriteDataBuff + tailStart);
+                                    sourceBuffer2 = (uint64_t)(buffConn->ResponseDMAWriteDataBuff);
+                                    destBuffer1 = (uint64_t)(buffConn->ResponseRing.DataBaseAddr + tailStart);
+                                    destBuffer2 = (uint64_t)(buffConn->ResponseRing.DataBaseAddr);
+                                }
+
+                                //
+                                // Post DMA writes
+                                //
+                                //
+                                buffConn->ResponseDMAWriteDataWr.wr.rdma.remote_addr = destBuffer1;
+                                buffConn->ResponseDMAWriteDataWr.sg_list->addr = sourceBuffer1;
+                                buffConn->ResponseDMAWriteDataWr.sg_list->length = availBytes;
+
+                                if (sourceBuffer2) {
+                                    buffConn->ResponseDMAWriteDataSplitState = BUFF_READ_DATA_SPLIT_STATE_SPLIT;
+
+                                    buffConn->ResponseDMAWriteDataSplitWr.sg_list->addr = sourceBuffer2;
+                                    buffConn->ResponseDMAWriteDataSplitWr.sg_list->length = writeBytes - availBytes;
+                                    buffConn->ResponseDMAWriteDataSplitWr.wr.rdma.remote_addr = destBuffer2;
+
+                                    ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAWriteDataSplitWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                        ret = -1;
+                                    }
+
+                                    ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAWriteDataWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                        ret = -1;
+                                    }
+                                }
+                                else {
+                                    buffConn->ResponseDMAWriteDataSplitState = BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT;
+
+                                    ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAWriteDataWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                        ret = -1;
+                                    }
+                                }
+
+                                DebugPrint("%s: buffConn->ResponseRing.TailC %d -> %d\n", __func__, buffConn->ResponseRing.TailC, (tailStart + totalResponseBytes) % (int)buffConn->ResponseRing.Capacity);
+                                buffConn->ResponseRing.TailC = (tailStart + totalResponseBytes) % (int)buffConn->ResponseRing.Capacity;
+                            
+                                //
+                                // Immediately update remote tail, assuming DMA requests are exected in order;
+                                // with interrupts, the write carries the tail in its immediate as well
+                                //
+                                //
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+                                buffConn->ResponseDMAWriteMetaWr.imm_data = htonl((uint32_t)buffConn->ResponseRing.TailC);
+#endif
+                                ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAWriteMetaWr, &badSendWr);
+                                if (ret) {
+                                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d (%s)\n", __func__, ret, strerror(ret));
+                                    ret = -1;
+                                }
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+                                //
+                                // The host takes one completion for each batch it fetches,
+                                // so every other coalesced batch is notified with the same tail, without writing it again
+                                //
+                                //
+                                buffConn->ResponseDMANotifyWr.imm_data = buffConn->ResponseDMAWriteMetaWr.imm_data;
+                                for (RequestIdT b = 1; b < buffConn->ResponseSendBatches; b++) {
+                                    ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMANotifyWr, &badSendWr);
+                                    if (ret) {
+                                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d (%s)\n", __func__, ret, strerror(ret));
+                                        ret = -1;
+                                    }
+                                }
+#endif
+                                buffConn->ResponseSendInFlight = false;
+#endif
+                            }
+                        }
+                            break;
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+                        case BUFF_SYNC_OFFLOAD_RESPONSES_WR_ID: {
+                            CompleteOffloadResponseSync(buffConn);
+                        }
+                            break;
+#endif
+                        default:
+                            fprintf(stderr, "%s [error]: unknown read completion\n", __func__);
+                            break;
+                        }
+                    }
+                        break;
+                    case IBV_WC_RDMA_WRITE: {
+                        switch (wc.wr_id)
+                        {
+                        case BUFF_WRITE_REQUEST_META_WR_ID: {
+#ifndef BACKEND_REQUEST_PIPELINE
+                            //
+                            // Ready to poll
+                            //
+                            //
+                            ret = PostRequestMetaRead(buffConn);
+                            if (ret) {
+                                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                                ret = -1;
+                            }
+#endif
+                        }
+                            break;
+                        case BUFF_WRITE_RESPONSE_META_WR_ID: {
+                            //
+                            // There is nothing to do here because response completions are checked in the big loop
+                            //
+                            //
+                        }
+                            break;
+                        case BUFF_WRITE_RESPONSE_HANDOVER_WR_ID: {
+                            buffConn->HandedOver = 2;
+                            fprintf(stdout, "Buffer #%u is handed over at %d/%d\n", buffConn->BuffId, buffConn->RequestRing.Head, buffConn->ResponseRing.TailC);
+                        }
+                            break;
+                        case BUFF_WRITE_RESPONSE_DATA_WR_ID: {
+                            //
+                            // Check splitting and update the head
+                            //
+                            //
+                            if (buffConn->ResponseDMAWriteDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
+                                //
+                                // There is nothing to do here because response completions are checked in the big loop
+                                //
+                                //
+                                DebugPrint("Responses have been written back: TailA = %d, TailB = %d, TailC = %d\n", buffConn->ResponseRing.TailA, buffConn->ResponseRing.TailB, buffConn->ResponseRing.TailC);
+                            }
+                            else {
+                                buffConn->ResponseDMAWriteDataSplitState++;
+                            }
+                        }
+                            break;
+                        case BUFF_WRITE_RESPONSE_DATA_SPLIT_WR_ID: {
+                            //
+                            // Check splitting and update the head
+                            //
+                            //
+                            if (buffConn->ResponseDMAWriteDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
+                                //
+                                // There is nothing to do here because response completions are checked in the big loop
+                                //
+                                //
+                                DebugPrint("Responses have been written back: TailA = %d, TailB = %d, TailC = %d\n", buffConn->ResponseRing.TailA, buffConn->ResponseRing.TailB, buffConn->ResponseRing.TailC);
+                            }
+                            else {
+                                buffConn->ResponseDMAWriteDataSplitState++;
+                            }
+                        }
+                            break;
+                        case BUFF_WRITE_DIRECT_READ_DATA_WR_ID: {
+                            //
+                            // A direct read has been written into the host pages
+                            //
+                            //
+                            buffConn->DirectReadWritesInFlight--;
+                        }
+                            break;
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+                        case BUFF_SYNC_OFFLOAD_RESPONSES_WR_ID: {
+                            //
+                            // A sync that reads no head ends with a write
+                            //
+                            //
+                            CompleteOffloadResponseSync(buffConn);
+                        }
+                            break;
+#endif
+                        default:
+                            fprintf(stderr, "%s [error]: unknown write completion\n", __func__);
+                            ret = -1;
+                            break;
                         }
                     }
                         break;
+                    case IBV_WC_SEND:
+                        break;
                     default:
-                        fprintf(stderr, "%s [error]: unknown read completion\n", __func__);
+                        fprintf(stderr, "%s [error]: unknown completion\n", __func__);
+                        ret = -1;
                         break;
-                    }
+                }
+            }
+
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+            Agent->CqPolls[pass]++;
+            Agent->CqSaturated[pass] += n == budget;
+#endif
+
+#ifdef BACKEND_STATS_ENABLED
+            buffConn->Stats.CqCompletions += n;
+            if (n == 0) {
+                buffConn->Stats.EmptyCqPolls++;
+            }
+#endif
+        }
+    }
+
+ProcessBuffCqEventsReturn:
+    return ret;
+}
+
+struct runFileBackEndArgs {
+    const char* ServerIpStr;
+    const int ServerPort;
+    const uint32_t MaxClients;
+    const uint32_t MaxBuffs;
+};
+
+
+#ifdef BACKEND_COMPRESSION_ENABLED
+//
+// Compress the data of a completed read in place if that saves enough bytes,
+// prefixing the compressed data with its size and flagging the response
+//
+//
+static inline void
+CompressResponse(
+    BuffConnConfig* BuffConn,
+    BuffMsgB2FAckHeader* Resp,
+    SplittableBufferT* DataBuff
+) {
+    FileIOSizeT bytes = Resp->BytesServiced;
+    if (Resp->Result != DDS_ERROR_CODE_SUCCESS || bytes < BACKEND_COMPRESSION_MIN_BYTES || bytes > BACKEND_COMPRESSION_MAX_BYTES) {
+        return;
+    }
+
+    const char* source = DataBuff->FirstAddr;
+    if (DataBuff->SecondAddr && bytes > DataBuff->FirstSize) {
+        memcpy(CompressionInput, DataBuff->FirstAddr, DataBuff->FirstSize);
+        memcpy(CompressionInput + DataBuff->FirstSize, DataBuff->SecondAddr, bytes - DataBuff->FirstSize);
+        source = CompressionInput;
+    }
+
+    FileIOSizeT capacity = bytes - (bytes >> BACKEND_COMPRESSION_MIN_SAVING_SHIFT) - sizeof(FileIOSizeT);
+    FileIOSizeT compressedBytes = CompressPayload(
+        source,
+        bytes,
+        CompressionOutput + sizeof(FileIOSizeT),
+        capacity,
+        CompressionHashTable
+    );
+    if (!compressedBytes) {
+        return;
+    }
+
+    *(FileIOSizeT*)CompressionOutput = compressedBytes;
+    compressedBytes += sizeof(FileIOSizeT);
+    if (DataBuff->SecondAddr && compressedBytes > DataBuff->FirstSize) {
+        memcpy(DataBuff->FirstAddr, CompressionOutput, DataBuff->FirstSize);
+        memcpy(DataBuff->SecondAddr, CompressionOutput + DataBuff->FirstSize, compressedBytes - DataBuff->FirstSize);
+    }
+    else {
+        memcpy(DataBuff->FirstAddr, CompressionOutput, compressedBytes);
+    }
+
+    Resp->RequestId |= BUFF_MSG_RESPONSE_FLAG_COMPRESSED;
+    BuffConn->ResponseBatchCompressed = true;
+}
+#endif
+
+#if defined(BACKEND_COMPRESSION_ENABLED) || defined(BACKEND_WRITE_ACK_PACKING)
+//
+// Move bytes of the response buffer towards its head, wrapping around its end
+//
+//
+static inline void
+MoveWithinResponseBuffer(
+    char* BuffResp,
+    int RingBytes,
+    int From,
+    int To,
+    FileIOSizeT Bytes
+) {
+    From %= RingBytes;
+    To %= RingBytes;
+
+    while (Bytes) {
+        FileIOSizeT chunk = Bytes;
+        if (chunk > (FileIOSizeT)(RingBytes - From)) {
+            chunk = RingBytes - From;
+        }
+        if (chunk > (FileIOSizeT)(RingBytes - To)) {
+            chunk = RingBytes - To;
+        }
+
+        memmove(BuffResp + To, BuffResp + From, chunk);
+        From = (From + chunk) % RingBytes;
+        To = (To + chunk) % RingBytes;
+        Bytes -= chunk;
+    }
+}
+
+#ifdef BACKEND_WRITE_ACK_PACKING
+//
+// Pack the acks of the successful writes that follow each other from a response of a finished batch
+// into one response at Packed, unless there are fewer than two of them;
+// return the number of acks packed and set the bytes of the packed response
+//
+//
+static inline FileIOSizeT
+PackWriteAcks(
+    BuffConnConfig* BuffConn,
+    int BatchStart,
+    FileIOSizeT Parsed,
+    FileIOSizeT BatchBytes,
+    FileIOSizeT Packed,
+    FileIOSizeT* PackedBytes
+) {
+    char* buffResp = BuffConn->ResponseDMAWriteDataBuff;
+    int ringBytes = (int)BuffConn->ResponseRing.Capacity;
+    const FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
+    RequestIdT requestIds[DDS_MAX_OUTSTANDING_IO];
+    FileIOSizeT numAcks = 0;
+
+    //
+    // Take the request ids first, as the packed response may cover the acks it replaces
+    //
+    //
+    while (Parsed != BatchBytes && numAcks != DDS_MAX_OUTSTANDING_IO) {
+        int position = (BatchStart + Parsed) % ringBytes;
+        BuffMsgB2FAckHeader* resp = (BuffMsgB2FAckHeader*)(buffResp + position + sizeof(FileIOSizeT));
+
+        if (*(FileIOSizeT*)(buffResp + position) != alignment ||
+            !(resp->RequestId & BUFF_MSG_RESPONSE_FLAG_WRITE) ||
+            resp->Result != DDS_ERROR_CODE_SUCCESS) {
+            break;
+        }
+
+        requestIds[numAcks++] = resp->RequestId & ~BUFF_MSG_RESPONSE_FLAG_WRITE;
+        Parsed += alignment;
+    }
+
+    if (numAcks < 2) {
+        return 0;
+    }
+
+    *PackedBytes = alignment + numAcks * sizeof(RequestIdT);
+    if (*PackedBytes % alignment != 0) {
+        *PackedBytes += (alignment - (*PackedBytes % alignment));
+    }
+
+    int position = (BatchStart + Packed) % ringBytes;
+    BuffMsgB2FAckHeader* packedResp = (BuffMsgB2FAckHeader*)(buffResp + position + sizeof(FileIOSizeT));
+    *(FileIOSizeT*)(buffResp + position) = *PackedBytes;
+    packedResp->RequestId = BUFF_MSG_RESPONSE_WRITE_ACKS;
+    packedResp->Result = DDS_ERROR_CODE_SUCCESS;
+    packedResp->BytesServiced = numAcks;
+
+    for (FileIOSizeT a = 0; a != numAcks; a++) {
+        *(RequestIdT*)(buffResp + (position + alignment + a * sizeof(RequestIdT)) % ringBytes) = requestIds[a];
+    }
+
+    return numAcks;
+}
+#endif
+
+//
+// Close the gaps that compression has left in a finished batch of responses by moving the responses up,
+// and pack its write acks; the last response takes over the freed bytes, so that the batch keeps its size
+// on the host, and only the bytes before them are written back;
+// return the bytes of the batch to write back
+//
+//
+static inline FileIOSizeT
+CompactResponseBatch(
+    BuffConnConfig* BuffConn,
+    int BatchStart,
+    FileIOSizeT BatchBytes
+) {
+    char* buffResp = BuffConn->ResponseDMAWriteDataBuff;
+    int ringBytes = (int)BuffConn->ResponseRing.Capacity;
+    const FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
+    FileIOSizeT parsed = alignment;
+    FileIOSizeT packed = alignment;
+    FileIOSizeT* lastSize = NULL;
+
+    if (!BuffConn->ResponseBatchCompressed && !BuffConn->ResponseBatchWrites) {
+        return BatchBytes;
+    }
+    BuffConn->ResponseBatchCompressed = false;
+    BuffConn->ResponseBatchWrites = false;
+
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    //
+    // Requests of deferred responses may still be writing into them, so nothing is moved
+    //
+    //
+    if (BuffConn->ResponseBatchDeferred) {
+        return BatchBytes;
+    }
+#endif
+
+    //
+    // A last response without data, such as that of a direct read, cannot take over the freed bytes,
+    // since the host tells direct reads by their data being shorter than the bytes serviced;
+    // the host ignores the data of a write ack, so that one can
+    //
+    //
+    FileIOSizeT lastStart = alignment;
+    for (FileIOSizeT offset = alignment; offset != BatchBytes; offset += *(FileIOSizeT*)(buffResp + (BatchStart + offset) % ringBytes)) {
+        lastStart = offset;
+    }
+    int lastPosition = (BatchStart + lastStart) % ringBytes;
+    BuffMsgB2FAckHeader* lastResp = (BuffMsgB2FAckHeader*)(buffResp + lastPosition + sizeof(FileIOSizeT));
+    if (*(FileIOSizeT*)(buffResp + lastPosition) == alignment && !(lastResp->RequestId & BUFF_MSG_RESPONSE_FLAG_WRITE)) {
+        return BatchBytes;
+    }
+
+    while (parsed != BatchBytes) {
+        int position = (BatchStart + parsed) % ringBytes;
+        FileIOSizeT respSize = *(FileIOSizeT*)(buffResp + position);
+        BuffMsgB2FAckHeader* resp = (BuffMsgB2FAckHeader*)(buffResp + position + sizeof(FileIOSizeT));
+        FileIOSizeT liveSize = respSize;
+
+#ifdef BACKEND_WRITE_ACK_PACKING
+        FileIOSizeT packedBytes;
+        FileIOSizeT numAcks = PackWriteAcks(BuffConn, BatchStart, parsed, BatchBytes, packed, &packedBytes);
+        if (numAcks) {
+            lastSize = (FileIOSizeT*)(buffResp + (BatchStart + packed) % ringBytes);
+            parsed += numAcks * alignment;
+            packed += packedBytes;
+            continue;
+        }
+#endif
+
+        if (resp->RequestId & BUFF_MSG_RESPONSE_FLAG_COMPRESSED) {
+            FileIOSizeT compressedBytes;
+            CopyFromRequestBuffer(buffResp, ringBytes, position + alignment, &compressedBytes, sizeof(FileIOSizeT));
+            liveSize = alignment + sizeof(FileIOSizeT) + compressedBytes;
+            if (liveSize % alignment != 0) {
+                liveSize += (alignment - (liveSize % alignment));
+            }
+        }
+
+        if (packed != parsed) {
+            MoveWithinResponseBuffer(buffResp, ringBytes, BatchStart + parsed, BatchStart + packed, liveSize);
+        }
+
+        lastSize = (FileIOSizeT*)(buffResp + (BatchStart + packed) % ringBytes);
+        *lastSize = liveSize;
+        parsed += respSize;
+        packed += liveSize;
+    }
+
+    *lastSize += BatchBytes - packed;
+
+    return packed;
+}
+#endif
+
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+//
+// Check if a pending response holds back a completed one: one later in its batch,
+// or any in the batches received after it
+//
+//
+static inline bool
+LaterResponseCompleted(
+    BuffConnConfig* BuffConn,
+    int Pending,
+    int BatchStart,
+    FileIOSizeT BatchBytes
+) {
+    char* buffResp = BuffConn->ResponseDMAWriteDataBuff;
+    int ringBytes = (int)BuffConn->ResponseRing.Capacity;
+    int batchEnd = (BatchStart + (int)BatchBytes) % ringBytes;
+
+    if (batchEnd != BuffConn->ResponseRing.TailA) {
+        return true;
+    }
+
+    int position = (Pending + (int)*(FileIOSizeT*)(buffResp + Pending)) % ringBytes;
+    while (position != batchEnd) {
+        BuffMsgB2FAckHeader* resp = (BuffMsgB2FAckHeader*)(buffResp + position + sizeof(FileIOSizeT));
+        if (resp->Result != DDS_ERROR_CODE_IO_PENDING) {
+            return true;
+        }
+        position = (position + (int)*(FileIOSizeT*)(buffResp + position)) % ringBytes;
+    }
+
+    return false;
+}
+
+//
+// Publish a pending response as deferred: the host skips it, and its context and bytes in the ring
+// stay reserved until the request completes and the response is sent again
+//
+//
+static inline void
+DeferResponse(
+    BuffConnConfig* BuffConn,
+    RequestIdT Context,
+    int Offset
+) {
+    RequestIdT slot = (BuffConn->DeferredResponsesHead + BuffConn->NumDeferredResponses) % BuffConn->PollQueueDepth;
+
+    *(FileIOSizeT*)(BuffConn->ResponseDMAWriteDataBuff + Offset) |= BUFF_MSG_RESPONSE_SIZE_FLAG_DEFERRED;
+    BuffConn->ResponseDeferred[Context] = true;
+    BuffConn->DeferredResponses[slot] = Context;
+    BuffConn->DeferredResponseOffsets[slot] = Offset;
+    BuffConn->DeferredResponsePending[slot] = true;
+    BuffConn->NumDeferredResponses++;
+    BuffConn->ResponseBatchDeferred = true;
+    BuffConn->CompressReads[Context] = false;
+}
+
+//
+// Copy bytes into the response buffer, wrapping around its end
+//
+//
+static inline void
+CopyIntoResponseBuffer(
+    char* BuffResp,
+    int RingBytes,
+    int Position,
+    const void* Source,
+    size_t Bytes
+) {
+    Position %= RingBytes;
+    size_t firstBytes = RingBytes - Position;
+
+    if (Bytes <= firstBytes) {
+        memcpy(BuffResp + Position, Source, Bytes);
+    }
+    else {
+        memcpy(BuffResp + Position, Source, firstBytes);
+        memcpy(BuffResp, (const char*)Source + firstBytes, Bytes - firstBytes);
+    }
+}
+
+//
+// Append a response batch with the deferred responses whose requests have completed, copying the data
+// of reads out of their reserved bytes, and give back the contexts and bytes no deferred response holds any more
+//
+//
+static int
+SendCompletedDeferredResponses(
+    BuffConnConfig* BuffConn
+) {
+    char* buffResp = BuffConn->ResponseDMAWriteDataBuff;
+    int ringBytes = (int)BuffConn->ResponseRing.Capacity;
+    const FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
+    int batchStart = BuffConn->ResponseRing.TailA;
+    int reuseBoundary = ResponseRingReuseBoundary(BuffConn);
+    int freeBytes = batchStart >= reuseBoundary ? (ringBytes - batchStart + reuseBoundary) : (reuseBoundary - batchStart);
+    FileIOSizeT batchBytes = alignment;
+    int ret = 0;
+
+    for (RequestIdT d = 0; d != BuffConn->NumDeferredResponses; d++) {
+        RequestIdT slot = (BuffConn->DeferredResponsesHead + d) % BuffConn->PollQueueDepth;
+        if (!BuffConn->DeferredResponsePending[slot]) {
+            continue;
+        }
+
+        RequestIdT context = BuffConn->DeferredResponses[slot];
+        DataPlaneRequestContext* ctxt = &BuffConn->PendingDataPlaneRequests[context];
+        DirectReadContext* direct = &BuffConn->DirectReads[context];
+        BuffMsgB2FAckHeader done = *ctxt->Response;
+
+        if (done.Result == DDS_ERROR_CODE_IO_PENDING) {
+            continue;
+        }
+
+        FileIOSizeT dataBytes = 0;
+        FileIOSizeT respSize = alignment;
+        if (ctxt->IsRead && !direct->IsDirect) {
+            dataBytes = done.Result == DDS_ERROR_CODE_SUCCESS ? done.BytesServiced : 0;
+            respSize += dataBytes;
+            if (respSize % alignment != 0) {
+                respSize += (alignment - (respSize % alignment));
+            }
+        }
+
+        //
+        // Leave the rest for later if the ring has no room for them
+        //
+        //
+        if ((int)(batchBytes + respSize) >= freeBytes) {
+            break;
+        }
+
+        if (direct->IsDirect) {
+            int directRet = PostDirectReadWrites(BuffConn, direct, &done);
+            if (directRet == 1) {
+                break;
+            }
+            else if (directRet) {
+                ret = -1;
+            }
+            direct->IsDirect = false;
+        }
+
+        int position = (batchStart + (int)batchBytes) % ringBytes;
+        CopyIntoResponseBuffer(buffResp, ringBytes, position, &respSize, sizeof(FileIOSizeT));
+        CopyIntoResponseBuffer(buffResp, ringBytes, position + sizeof(FileIOSizeT), &done, sizeof(BuffMsgB2FAckHeader));
+        if (dataBytes) {
+            SplittableBufferT* dataBuff = &ctxt->DataBuffer;
+            FileIOSizeT firstBytes = dataBytes < dataBuff->FirstSize ? dataBytes : dataBuff->FirstSize;
+            CopyIntoResponseBuffer(buffResp, ringBytes, position + alignment, dataBuff->FirstAddr, firstBytes);
+            if (dataBytes > firstBytes) {
+                CopyIntoResponseBuffer(buffResp, ringBytes, position + alignment + firstBytes, dataBuff->SecondAddr, dataBytes - firstBytes);
+            }
+        }
+
+        batchBytes += respSize;
+        TraceResponseReady(BuffConn, context);
+        CountResponse(BuffConn, context);
+        PushResponseContext(BuffConn, BUFF_RESPONSE_CONTEXT_RESENT);
+        BuffConn->ResponseDeferred[context] = false;
+        BuffConn->DeferredResponsePending[slot] = false;
+    }
+
+    //
+    // The bytes of the ring are given back up to the oldest deferred response still to be sent
+    //
+    //
+    while (BuffConn->NumDeferredResponses && !BuffConn->DeferredResponsePending[BuffConn->DeferredResponsesHead]) {
+        BuffConn->DeferredResponsesHead = (BuffConn->DeferredResponsesHead + 1) % BuffConn->PollQueueDepth;
+        BuffConn->NumDeferredResponses--;
+    }
+
+    if (batchBytes == alignment) {
+        return ret;
+    }
+
+    CopyIntoResponseBuffer(buffResp, ringBytes, batchStart, &batchBytes, sizeof(FileIOSizeT));
+    BuffConn->ResponseRing.TailA = (batchStart + (int)batchBytes) % ringBytes;
+
+    return ret;
+}
+#endif
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+//
+// Where the held response batches start: after the batches a send in flight covers, or else at TailC
+//
+//
+static inline int
+ResponseHeldStart(
+    BuffConnConfig* BuffConn
+) {
+    return BuffConn->ResponseSendInFlight ? BuffConn->ResponseSendEnd : BuffConn->ResponseRing.TailC;
+}
+
+//
+// Check if a checked batch of responses can be held together with the batches already held;
+// a compacted batch is written back short of its end, so no batch can follow it in the same write
+//
+//
+static inline bool
+CanHoldResponseBatch(
+    BuffConnConfig* BuffConn,
+    FileIOSizeT BatchBytes
+) {
+    if (!BuffConn->ResponseHeldBatches) {
+        return true;
+    }
+
+#ifdef BACKEND_RESPONSE_COALESCING
+    FileIOSizeT heldBytes = DistanceBetweenPointers(BuffConn->ResponseHeldEnd, ResponseHeldStart(BuffConn), (int)BuffConn->ResponseRing.Capacity);
+
+    return BuffConn->ResponseHeldBatches < BACKEND_RESPONSE_COALESCE_MAX_BATCHES &&
+        BuffConn->ResponseHeldWriteBytes == heldBytes &&
+        heldBytes + BatchBytes <= BACKEND_RESPONSE_COALESCE_MAX_BYTES;
+#else
+    return false;
+#endif
+}
+
+//
+// Hold a batch of responses that has been checked, compacting it first if no other batch is held
+//
+//
+static inline void
+HoldResponseBatch(
+    BuffConnConfig* BuffConn,
+    int BatchStart,
+    FileIOSizeT BatchBytes
+) {
+    FileIOSizeT writeBytes = BatchBytes;
+
+#if defined(BACKEND_COMPRESSION_ENABLED) || defined(BACKEND_WRITE_ACK_PACKING)
+    if (BuffConn->ResponseHeldBatches) {
+        BuffConn->ResponseBatchCompressed = false;
+        BuffConn->ResponseBatchWrites = false;
+    }
+    else {
+        writeBytes = CompactResponseBatch(BuffConn, BatchStart, BatchBytes);
+    }
+#endif
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    BuffConn->ResponseBatchDeferred = false;
+#endif
+#ifdef BACKEND_RESPONSE_COALESCING
+    if (!BuffConn->ResponseHeldBatches) {
+        BuffConn->ResponseHoldDeadline = spdk_get_ticks() + BuffConn->ResponseHoldTicks;
+    }
+#endif
+
+    BuffConn->ResponseHeldWriteBytes += writeBytes;
+    BuffConn->ResponseHeldBatches++;
+    BuffConn->ResponseHeldEnd = (BatchStart + (int)BatchBytes) % (int)BuffConn->ResponseRing.Capacity;
+}
+
+//
+// Send the held response batches back to the host unless a send is in flight or they are worth holding:
+// they wait while a batch being checked behind them can still join them, for at most the hold delay;
+// the delay of the connection halves when a lone batch has waited for nothing,
+// and doubles when batches have filled up a send before it passed
+//
+//
+static inline int
+SendHeldResponseBatches(
+    BuffConnConfig* BuffConn
+) {
+    struct ibv_send_wr *badSendWr = NULL;
+    int ret = 0;
+
+    if (!BuffConn->ResponseHeldBatches || BuffConn->ResponseSendInFlight) {
+        return 0;
+    }
+
+#ifdef BACKEND_RESPONSE_COALESCING
+    if (BuffConn->ResponseRing.TailA != BuffConn->ResponseHeldEnd) {
+        FileIOSizeT nextBatchBytes = *(FileIOSizeT*)(BuffConn->ResponseDMAWriteDataBuff + BuffConn->ResponseHeldEnd);
+        uint64_t ticksPerUs = spdk_get_ticks_hz() / 1000000;
+
+        if (CanHoldResponseBatch(BuffConn, nextBatchBytes)) {
+            if (spdk_get_ticks() < BuffConn->ResponseHoldDeadline) {
+                return 0;
+            }
+
+            if (BuffConn->ResponseHeldBatches == 1) {
+                BuffConn->ResponseHoldTicks /= 2;
+                if (BuffConn->ResponseHoldTicks < BACKEND_RESPONSE_COALESCE_MIN_DELAY_US * ticksPerUs) {
+                    BuffConn->ResponseHoldTicks = BACKEND_RESPONSE_COALESCE_MIN_DELAY_US * ticksPerUs;
+                }
+            }
+        }
+        else if (BuffConn->ResponseHeldBatches > 1) {
+            BuffConn->ResponseHoldTicks *= 2;
+            if (BuffConn->ResponseHoldTicks > BACKEND_RESPONSE_COALESCE_MAX_DELAY_US * ticksPerUs) {
+                BuffConn->ResponseHoldTicks = BACKEND_RESPONSE_COALESCE_MAX_DELAY_US * ticksPerUs;
+            }
+        }
+    }
+#endif
+
+    DebugPrint("%d response batches of %d bytes have finished. Polling host response progress\n", (int)BuffConn->ResponseHeldBatches, (int)BuffConn->ResponseHeldWriteBytes);
+
+    BuffConn->ResponseSendEnd = BuffConn->ResponseHeldEnd;
+    BuffConn->ResponseSendBatches = BuffConn->ResponseHeldBatches;
+    BuffConn->ResponseDMAWriteBytes = BuffConn->ResponseHeldWriteBytes;
+    BuffConn->ResponseSendInFlight = true;
+    BuffConn->ResponseHeldBatches = 0;
+    BuffConn->ResponseHeldWriteBytes = 0;
+
+    //
+    // Poll the distance from the host
+    //
+    //
+    ret = PostBuffSend(BuffConn, ResponseQPair(BuffConn), &BuffConn->ResponseDMAReadMetaWr, &badSendWr);
+    if (ret) {
+        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+        ret = -1;
+    }
+
+    return ret;
+}
+#endif
+
+//
+// Check and process I/O completions
+//
+//
+static inline int
+CheckAndProcessIOCompletions(
+    DataPlaneAgentConfig *Agent
+) {
+    // SPDK_NOTICELOG("CheckAndProcessIOCompletions() running\n");
+    BackEndConfig *Config = Agent->Config;
+    int ret = 0;
+    BuffConnConfig *buffConn = NULL;
+
+    for (int i = Agent->AgentId; i < Config->MaxBuffs; i += DDS_BACKEND_DATA_PLANE_AGENTS) {
+        buffConn = &Config->BuffConns[i];
+        if (buffConn->State != CONN_STATE_CONNECTED) {
+            continue;
+        }
+
+        //
+        // Check the error code of each response, sequentially
+        //
+        //
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+        int head1 = buffConn->ResponseRing.TailB;
+        int head2 = buffConn->ResponseHeldEnd;
+        int tail = buffConn->ResponseRing.TailA;
+        char* buffResp = buffConn->ResponseDMAWriteDataBuff;
+        char* curResp;
+        FileIOSizeT curRespSize;
+
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+        //
+        // Deferred responses that have completed go out in a batch of their own
+        //
+        //
+        if (buffConn->NumDeferredResponses) {
+            if (SendCompletedDeferredResponses(buffConn)) {
+                ret = -1;
+            }
+            tail = buffConn->ResponseRing.TailA;
+        }
+#endif
+
+        //
+        // Held batches may go out before any more responses are checked
+        //
+        //
+        if (SendHeldResponseBatches(buffConn)) {
+            ret = -1;
+        }
+
+        if (tail == head1) {
+            continue;
+        }
+
+        const FileIOSizeT totalRespSize = *(FileIOSizeT*)(buffResp + head2);
+
+        if (head1 == head2) {
+            //
+            // A batch that cannot join the held ones waits until they have gone out
+            //
+            //
+            if (!CanHoldResponseBatch(buffConn, totalRespSize)) {
+                continue;
+            }
+
+            head1 += (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+            if (head1 >= (int)buffConn->ResponseRing.Capacity) {
+                head1 %= (int)buffConn->ResponseRing.Capacity;
+            }
+        }
+
+        while (DistanceBetweenPointers(head1, head2, (int)buffConn->ResponseRing.Capacity) != totalRespSize) {
+            // SPDK_NOTICELOG("head1: %d, head2: %d\n", head1, head2);
+            curResp = buffResp + head1;
+            curRespSize = *(FileIOSizeT*)curResp;
+            if (curRespSize == 0) {
+                SPDK_ERRLOG("impossible, curRespSize == 0\n");
+            }
+
+            // if (curRespSize != 12) {
+            //     SPDK_NOTICELOG("curRespSize: %u\n", curRespSize);
+            // }
+            
+            curResp += sizeof(FileIOSizeT);
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+            RequestIdT completionContext = buffConn->ResponseContexts[buffConn->ResponseContextsHead];
+            if (((BuffMsgB2FAckHeader*)curResp)->Result == DDS_ERROR_CODE_IO_PENDING) {
+                if (buffConn->NumDeferredResponses == buffConn->PollQueueDepth ||
+                    !LaterResponseCompleted(buffConn, head1, head2, totalRespSize)) {
+                    break;
+                }
+
+                DeferResponse(buffConn, completionContext, head1);
+            }
+            else if (completionContext != BUFF_RESPONSE_CONTEXT_RESENT) {
+#else
+            RequestIdT completionContext = buffConn->NextCompletionContext;
+            if (((BuffMsgB2FAckHeader*)curResp)->Result == DDS_ERROR_CODE_IO_PENDING) {
+                break;
+            }
+#endif
+
+            //
+            // Write a direct read into the host pages before its response
+            //
+            //
+            DirectReadContext* direct = &buffConn->DirectReads[completionContext];
+            TraceResponseReady(buffConn, completionContext);
+            CountResponse(buffConn, completionContext);
+#ifdef BACKEND_COMPRESSION_ENABLED
+            if (buffConn->CompressReads[completionContext] && !direct->IsDirect) {
+                CompressResponse(
+                    buffConn,
+                    (BuffMsgB2FAckHeader*)curResp,
+                    &buffConn->PendingDataPlaneRequests[completionContext].DataBuffer
+                );
+                buffConn->CompressReads[completionContext] = false;
+            }
+#endif
+#ifdef BACKEND_WRITE_ACK_PACKING
+            if (!buffConn->PendingDataPlaneRequests[completionContext].IsRead) {
+                ((BuffMsgB2FAckHeader*)curResp)->RequestId |= BUFF_MSG_RESPONSE_FLAG_WRITE;
+                buffConn->ResponseBatchWrites = true;
+            }
+#endif
+            if (direct->IsDirect) {
+                int directRet = PostDirectReadWrites(buffConn, direct, (BuffMsgB2FAckHeader*)curResp);
+                if (directRet == 1) {
+                    break;
+                }
+                else if (directRet) {
+                    ret = -1;
+                }
+                direct->IsDirect = false;
+            }
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+            }
+
+            buffConn->ResponseContextsHead++;
+            if (buffConn->ResponseContextsHead == BUFF_RESPONSE_CONTEXTS(buffConn->PollQueueDepth)) {
+                buffConn->ResponseContextsHead = 0;
+            }
+#else
+            buffConn->NextCompletionContext++;
+            if (buffConn->NextCompletionContext == buffConn->PollQueueDepth) {
+                buffConn->NextCompletionContext = 0;
+            }
+#endif
+
+            head1 += curRespSize;
+            if (head1 >= (int)buffConn->ResponseRing.Capacity) {
+                head1 %= (int)buffConn->ResponseRing.Capacity;
+            }
+        }
+
+        if (head1 != buffConn->ResponseRing.TailB) {
+            //
+            // Update TailB immediately
+            //
+            //
+            buffConn->ResponseRing.TailB = head1;
+
+            if (DistanceBetweenPointers(head1, head2, (int)buffConn->ResponseRing.Capacity) == totalRespSize) {
+                //
+                // Hold the batch and send the batches held so far back to the host when the policy says so
+                //
+                //
+                HoldResponseBatch(buffConn, head2, totalRespSize);
+                if (SendHeldResponseBatches(buffConn)) {
+                    ret = -1;
+                }
+            }
+        }
+#else
+        int head = buffConn->ResponseRing.TailB;
+        int tail = buffConn->ResponseRing.TailA;
+        char* buffResp = buffConn->ResponseDMAWriteDataBuff;
+        char* curResp;
+        FileIOSizeT curRespSize;
+
+        if (head == tail) {
+            continue;
+        }
+
+        while (head != tail) {
+            curResp = buffResp + head;
+            curRespSize = *(FileIOSizeT*)curResp;
+            curResp += sizeof(FileIOSizeT);
+            if (((BuffMsgB2FAckHeader*)curResp)->Result == DDS_ERROR_CODE_IO_PENDING) {
+                //
+                // DO NOT USE: testing
+                //
+                //
+                ((BuffMsgB2FAckHeader*)curResp)->Result = DDS_ERROR_CODE_SUCCESS;
+                ((BuffMsgB2FAckHeader*)curResp)->BytesServiced = 4;
+
+                // break;
+            }
+
+            head += curRespSize;
+            if (head >= (int)buffConn->ResponseRing.Capacity) {
+                head %= (int)buffConn->ResponseRing.Capacity;
+            }
+        }
+
+        //
+        // No batching needed here
+        //
+        //
+        if (head != buffConn->ResponseRing.TailB) {
+            //
+            // Send the response back to the host
+            //
+            //
+            struct ibv_send_wr *badSendWr = NULL;
+
+            //
+            // Update TailB immediately
+            //
+            //
+            buffConn->ResponseRing.TailB = head;
+            
+            //
+            // Poll the distance from the host
+            //
+            //
+            printf("%s: Polling response ring meta\n", __func__);
+            ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAReadMetaWr, &badSendWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                ret = -1;
+            }
+        }
+#endif
+    }
+    // SPDK_NOTICELOG("CheckAndProcessIOCompletions() returned\n");
+    return ret;
+}
+
+//
+// Check and process control plane completions
+//
+//
+static inline int
+CheckAndProcessControlPlaneCompletions(
+    BackEndConfig *Config
+) {
+    int ret = 0;
+    CtrlConnConfig *ctrlConn = NULL;
+    struct ibv_send_wr *badSendWr = NULL;
+
+    for (int i = 0; i != Config->MaxClients; i++) {
+        ctrlConn = &Config->CtrlConns[i];
+#ifdef CREATE_DEFAULT_DPU_FILE
+        if (ctrlConn->State != CONN_STATE_CONNECTED && i != DEFAULT_DPU_FILE_CREATION_CTRL_CONN) {
+            continue;
+        }
+#else
+        if (ctrlConn->State != CONN_STATE_CONNECTED) {
+            continue;
+        }
+#endif
+
+        if (ctrlConn->PendingControlPlaneRequest.RequestId == DDS_REQUEST_INVALID) {
+            continue;
+        }
+
+        //
+        // The first field of response should always be the error code
+        //
+        //
+        if (*(ErrorCodeT*)(ctrlConn->PendingControlPlaneRequest.Response) != DDS_ERROR_CODE_IO_PENDING) {
+            // SPDK_NOTICELOG("Responding back... and NULLing ctrl plane request\n");
+            ctrlConn->PendingControlPlaneRequest.RequestId = DDS_REQUEST_INVALID;
+            ctrlConn->PendingControlPlaneRequest.Request = NULL;
+            ctrlConn->PendingControlPlaneRequest.Response = NULL;
+
+            //
+            // An operation of a batch is done; the ack waits for the rest of the batch
+            //
+            //
+            if (ctrlConn->BatchNumOps && !ContinueBatch(ctrlConn, Config->FS)) {
+                continue;
+            }
+
+#ifdef CREATE_DEFAULT_DPU_FILE
+            if (i == DEFAULT_DPU_FILE_CREATION_CTRL_CONN) {
+                switch (ctrlConn->DefaultDpuFileCreationState)
+                {
+                case FILE_CREATION_SUBMITTED:
+                {
+                    CtrlMsgF2BReqChangeFileSize *req = &ctrlConn->DefaultChangeFileRequest;
+                    CtrlMsgB2FAckChangeFileSize *resp = &ctrlConn->DefaultChangeFileResponse;
+
+                    ctrlConn->DefaultDpuFileCreationState = FILE_CREATED;
+                    fprintf(stdout, "DPU default file has been created\n");
+
+                    //
+                    // Change file size
+                    //
+                    //
+                    req->FileId = DEFAULT_DPU_FILE_ID;
+                    req->NewSize = DEFAULT_DPU_FILE_SIZE;
+
+                    ctrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_CHANGE_FILE_SIZE;
+                    ctrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
+                    ctrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
+                    resp->Result = DDS_ERROR_CODE_IO_PENDING;
+                    SubmitControlPlaneRequest(Config->FS, &ctrlConn->PendingControlPlaneRequest);
                 }
                     break;
-                case IBV_WC_RDMA_WRITE: {
-                    switch (wc.wr_id)
-                    {
-                    case BUFF_WRITE_REQUEST_META_WR_ID: {
-                        //
-                        // Ready to poll
-                        //
-                        //
-                        ret = ibv_post_send(buffConn->QPair, &buffConn->RequestDMAReadMetaWr, &badSendWr);
-                        if (ret) {
-                            fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                            ret = -1;
-                        }
-                    }
-                        break;
-                    case BUFF_WRITE_RESPONSE_META_WR_ID: {
-                        //
-                        // There is nothing to do here because response completions are checked in the big loop
-                        //
-                        //
-                    }
-                        break;
-                    case BUFF_WRITE_RESPONSE_DATA_WR_ID: {
-                        //
-                        // Check splitting and update the head
-                        //
-                        //
-                        if (buffConn->ResponseDMAWriteDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
-                            //
-                            // There is nothing to do here because response completions are checked in the big loop
-                            //
-                            //
-                            DebugPrint("Responses have been written back: TailA = %d, TailB = %d, TailC = %d\n", buffConn->ResponseRing.TailA, buffConn->ResponseRing.TailB, buffConn->ResponseRing.TailC);
-                        }
-                        else {
-                            buffConn->ResponseDMAWriteDataSplitState++;
-                        }
-                    }
-                        break;
-                    case BUFF_WRITE_RESPONSE_DATA_SPLIT_WR_ID: {
-                        //
-                        // Check splitting and update the head
-                        //
-                        //
-                        if (buffConn->ResponseDMAWriteDataSplitState == BUFF_READ_DATA_SPLIT_STATE_NOT_SPLIT) {
-                            //
-                            // There is nothing to do here because response completions are checked in the big loop
-                            //
-                            //
-                            DebugPrint("Responses have been written back: TailA = %d, TailB = %d, TailC = %d\n", buffConn->ResponseRing.TailA, buffConn->ResponseRing.TailB, buffConn->ResponseRing.TailC);
-                        }
-                        else {
-                            buffConn->ResponseDMAWriteDataSplitState++;
-                        }
-                    }
-                        break;
-                    default:
-                        fprintf(stderr, "%s [error]: unknown write completion\n", __func__);
+                case FILE_CREATED:
+                {
+                    ctrlConn->DefaultDpuFileCreationState = FILE_CHANGED;
+                    fprintf(stdout, "DPU default file size has been changed to %llu\n", DEFAULT_DPU_FILE_SIZE);
+                }
+                    break;
+                default:
+                {
+                    //
+                    // Regular control operation. Respond back to the host
+                    //
+                    //
+                    ret = ibv_post_send(ctrlConn->QPair, &ctrlConn->SendWr, &badSendWr);
+                    if (ret) {
+                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
                         ret = -1;
-                        break;
                     }
                 }
                     break;
-                case IBV_WC_SEND:
-                    break;
-                default:
-                    fprintf(stderr, "%s [error]: unknown completion\n", __func__);
+                }
+            }
+            else {
+                //
+                // It's complete. Respond back to the host
+                //
+                //
+                ret = ibv_post_send(ctrlConn->QPair, &ctrlConn->SendWr, &badSendWr);
+                if (ret) {
+                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
                     ret = -1;
-                    break;
+                }
+            }
+#else
+            //
+            // It's complete. Respond back to the host
+            //
+            //
+            ret = ibv_post_send(ctrlConn->QPair, &ctrlConn->SendWr, &badSendWr);
+            if (ret) {
+                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+                ret = -1;
+            }
+#endif
+        }
+    }
+
+    return ret;
+}
+
+//
+// Apply what the control agent saw happen to the connected buffers of a data plane agent:
+// tear down closing buffers, and start or stop using lanes
+//
+//
+static inline void
+ProcessBuffStateChanges(
+    DataPlaneAgentConfig *Agent
+) {
+    BackEndConfig *Config = Agent->Config;
+
+    for (int i = Agent->AgentId; i < Config->MaxBuffs; i += DDS_BACKEND_DATA_PLANE_AGENTS) {
+        BuffConnConfig *buffConn = &Config->BuffConns[i];
+        uint8_t state = buffConn->State;
+
+        if (state == CONN_STATE_CLOSING) {
+            DestroyBuffRegionsAndBuffers(buffConn);
+            DestroyBuffQPair(buffConn);
+            atomic_store(&buffConn->LanesOpened, 0);
+            atomic_store(&buffConn->LanesClosed, 0);
+            buffConn->State = CONN_STATE_AVAILABLE;
+#ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
+            fprintf(stdout, "%s [info]: Buffer Conn#%d is torn down by data plane agent #%u\n", __func__, i, Agent->AgentId);
+#endif
+        }
+        else if (state == CONN_STATE_CONNECTED) {
+            unsigned int lanesClosed = atomic_exchange(&buffConn->LanesClosed, 0);
+            for (int lane = 1; lanesClosed && lane != BUFF_CONN_MAX_QUEUE_PAIRS; lane++) {
+                if (lanesClosed & (1u << lane)) {
+                    DestroyBuffLane(buffConn, lane);
+                }
+            }
+
+            if (atomic_exchange(&buffConn->LanesOpened, 0)) {
+                CountBuffLanes(buffConn);
             }
         }
     }
+}
+
+#ifdef DMA_AGENT_EVENT_DRIVEN
+//
+// Check if any control plane request is still in the file service,
+// whose completion is only found by polling
+//
+//
+static inline bool
+ControlPlaneRequestsPending(
+    BackEndConfig *Config
+) {
+    for (int i = 0; i != Config->MaxClients; i++) {
+        if (Config->CtrlConns[i].PendingControlPlaneRequest.RequestId != DDS_REQUEST_INVALID) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// Ask for an event on the next completion of every control connection
+//
+//
+static inline int
+ArmCtrlCompQueues(
+    BackEndConfig *Config
+) {
+    int ret = 0;
+
+    for (int i = 0; i != Config->MaxClients; i++) {
+        CtrlConnConfig *ctrlConn = &Config->CtrlConns[i];
+        if (ctrlConn->State != CONN_STATE_CONNECTED) {
+            continue;
+        }
+
+        ret = ibv_req_notify_cq(ctrlConn->CompQ, 0);
+        if (ret) {
+            fprintf(stderr, "%s [error]: ibv_req_notify_cq failed %d\n", __func__, ret);
+            return -1;
+        }
+    }
 
-ProcessBuffCqEventsReturn:
-    return ret;
+    return 0;
 }
 
-struct runFileBackEndArgs {
-    const char* ServerIpStr;
-    const int ServerPort;
-    const uint32_t MaxClients;
-    const uint32_t MaxBuffs;
-};
-
-
 //
-// Check and process I/O completions
+// Sleep until a CM event or a control completion arrives, or the wait times out;
+// the completion queues must have been armed and polled empty after that
 //
 //
-static inline int
-CheckAndProcessIOCompletions(
+static int
+WaitForDMAAgentEvents(
     BackEndConfig *Config
 ) {
-    // SPDK_NOTICELOG("CheckAndProcessIOCompletions() running\n");
+    struct pollfd fds[Config->MaxClients + 1];
+    CtrlConnConfig *ctrlConns[Config->MaxClients + 1];
+    nfds_t numFds = 0;
+    struct ibv_cq *cq;
+    void *cqContext;
     int ret = 0;
-    BuffConnConfig *buffConn = NULL;
 
-    for (int i = 0; i != Config->MaxBuffs; i++) {
-        buffConn = &Config->BuffConns[i];
-        if (buffConn->State != CONN_STATE_CONNECTED) {
+    fds[numFds].fd = Config->DMAConf.CmChannel->fd;
+    fds[numFds].events = POLLIN;
+    fds[numFds].revents = 0;
+    ctrlConns[numFds] = NULL;
+    numFds++;
+
+    for (int i = 0; i != Config->MaxClients; i++) {
+        CtrlConnConfig *ctrlConn = &Config->CtrlConns[i];
+        if (ctrlConn->State != CONN_STATE_CONNECTED) {
             continue;
         }
 
-        //
-        // Check the error code of each response, sequentially
-        //
-        //
-#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
-        int head1 = buffConn->ResponseRing.TailB;
-        int head2 = buffConn->ResponseRing.TailC;
-        int tail = buffConn->ResponseRing.TailA;
-        char* buffResp = buffConn->ResponseDMAWriteDataBuff;
-        char* curResp;
-        FileIOSizeT curRespSize;
-        const FileIOSizeT totalRespSize = *(FileIOSizeT*)(buffResp + head2);
+        fds[numFds].fd = ctrlConn->Channel->fd;
+        fds[numFds].events = POLLIN;
+        fds[numFds].revents = 0;
+        ctrlConns[numFds] = ctrlConn;
+        numFds++;
+    }
 
-        if (tail == head1) {
+    ret = poll(fds, numFds, DMA_AGENT_WAIT_TIMEOUT_MS);
+    if (ret < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        fprintf(stderr, "%s [error]: poll failed %d\n", __func__, errno);
+        return -1;
+    }
+
+    //
+    // Consume and acknowledge the completion events; the completions themselves are polled by the next round
+    //
+    //
+    for (nfds_t f = 1; f < numFds; f++) {
+        if (!(fds[f].revents & POLLIN)) {
             continue;
         }
 
-        if (head1 == head2) {
-            head1 += (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
-            if (head1 >= BACKEND_RESPONSE_BUFFER_SIZE) {
-                head1 %= BACKEND_RESPONSE_BUFFER_SIZE;
-            }
+        ret = ibv_get_cq_event(ctrlConns[f]->Channel, &cq, &cqContext);
+        if (ret) {
+            fprintf(stderr, "%s [error]: ibv_get_cq_event failed %d\n", __func__, ret);
+            return -1;
         }
+        ibv_ack_cq_events(cq, 1);
+    }
 
-        while (DistanceBetweenPointers(head1, head2, BACKEND_RESPONSE_BUFFER_SIZE) != totalRespSize) {
-            // SPDK_NOTICELOG("head1: %d, head2: %d\n", head1, head2);
-            curResp = buffResp + head1;
-            curRespSize = *(FileIOSizeT*)curResp;
-            if (curRespSize == 0) {
-                SPDK_ERRLOG("impossible, curRespSize == 0\n");
-            }
+    return 0;
+}
+#endif
 
-            // if (curRespSize != 12) {
-            //     SPDK_NOTICELOG("curRespSize: %u\n", curRespSize);
-            // }
-            
-            curResp += sizeof(FileIOSizeT);
-            if (((BuffMsgB2FAckHeader*)curResp)->Result == DDS_ERROR_CODE_IO_PENDING) {
-                break;
-            }
+#ifdef CACHE_TABLE_STATS_ENABLED
+//
+// Print the counters of the cache table
+//
+//
+static void
+PrintCacheTableStats() {
+    CacheTableStatsT stats;
+
+    GetCacheTableStats(GlobalCacheTable, &stats);
+    fprintf(stdout, "Cache table: %lu items of a budget of %lu in %lu slots (load %.1f%%), "
+        "%lu lookups, %lu hits (%.1f%%), %lu misses, %lu retries, "
+        "%lu additions, %lu updates, %lu deletions, %lu failures, %lu evictions, %lu splits\n",
+        stats.NumItems, stats.MaxItems, stats.NumSlots, 100.0 * stats.LoadFactor,
+        stats.Lookups, stats.Hits, stats.Lookups ? 100.0 * stats.Hits / stats.Lookups : 0.0, stats.Misses,
+        stats.Retries, stats.Additions, stats.Updates, stats.Deletions, stats.Failures, stats.Evictions, stats.Splits);
+    fprintf(stdout, "Cache table displacements per addition:");
+    for (int d = 0; d != CACHE_TABLE_STATS_DEPTH_BUCKETS; d++) {
+        fprintf(stdout, " %s%d: %lu", d > 1 ? "<" : "", d > 1 ? 1 << d : d, stats.Depths[d]);
+    }
+    fprintf(stdout, "\n");
+}
+#endif
 
-            head1 += curRespSize;
-            if (head1 >= BACKEND_RESPONSE_BUFFER_SIZE) {
-                head1 %= BACKEND_RESPONSE_BUFFER_SIZE;
-            }
+#ifdef BACKEND_STATS_ENABLED
+//
+// Write the counters of the connected buffers
+//
+//
+static void
+WriteBuffConnStats(
+    BackEndConfig* Config,
+    FILE* Out
+) {
+    for (uint32_t b = 0; b != Config->MaxBuffs; b++) {
+        BuffConnConfig* buffConn = &Config->BuffConns[b];
+        if (buffConn->State != CONN_STATE_CONNECTED) {
+            continue;
         }
 
-        if (head1 != buffConn->ResponseRing.TailB) {
-            //
-            // Update TailB immediately
-            //
-            //
-            buffConn->ResponseRing.TailB = head1;
-
-            if (DistanceBetweenPointers(head1, head2, BACKEND_RESPONSE_BUFFER_SIZE) == totalRespSize) {
-                //
-                // Send the response back to the host
-                //
-                //
-                DebugPrint("A response batch of %d bytes have finished. Polling host response progress\n", totalRespSize);
-                struct ibv_send_wr *badSendWr = NULL;
-                
-                //
-                // Poll the distance from the host
-                //
-                //
-                ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAReadMetaWr, &badSendWr);
-                if (ret) {
-                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                    ret = -1;
-                }
-            }
+        const BuffConnStatsT* stats = &buffConn->Stats;
+        uint64_t batches = stats->RequestBatches ? stats->RequestBatches : 1;
+        Statistics latency;
+        Percentiles percentiles;
+
+        fprintf(Out, "buff %u: %lu requests in %lu batches, %lu I/Os in flight, "
+            "%lu RDMA posts of %lu work requests, %lu completions, %lu empty completion polls\n",
+            b, stats->RequestsParsed, stats->RequestBatches, stats->IOsSubmitted - stats->IOsCompleted,
+            stats->RdmaPosts, stats->RdmaWorkRequests, stats->CqCompletions, stats->EmptyCqPolls);
+        fprintf(Out, "buff %u: request ring bytes mean %.0f, max %lu of %u; response ring bytes mean %.0f, max %lu of %u\n",
+            b, (double)stats->RequestRingBytesSum / batches, stats->RequestRingBytesMax, buffConn->RequestRing.Capacity,
+            (double)stats->ResponseRingBytesSum / batches, stats->ResponseRingBytesMax, buffConn->ResponseRing.Capacity);
+        fprintf(Out, "buff %u: requests per batch", b);
+        for (int s = 0; s != BACKEND_STATS_BATCH_BUCKETS; s++) {
+            fprintf(Out, " %s%d: %lu", s == BACKEND_STATS_BATCH_BUCKETS - 1 ? ">" : "<=",
+                1 << (s == BACKEND_STATS_BATCH_BUCKETS - 1 ? s - 1 : s), stats->BatchSizes[s]);
         }
-#else
-        int head = buffConn->ResponseRing.TailB;
-        int tail = buffConn->ResponseRing.TailA;
-        char* buffResp = buffConn->ResponseDMAWriteDataBuff;
-        char* curResp;
-        FileIOSizeT curRespSize;
+        fprintf(Out, "\n");
 
-        if (head == tail) {
-            continue;
-        }
+        GetStatistics(&stats->CompletionLatencies, 1000.0, &latency, &percentiles);
+        fprintf(Out, "buff %u: completion latency (us) mean %.2f, p50 %.2f, p99 %.2f, p99.9 %.2f, max %.2f\n",
+            b, latency.Mean, percentiles.P50, percentiles.P99, percentiles.P99p9, latency.Max);
+    }
+}
 
-        while (head != tail) {
-            curResp = buffResp + head;
-            curRespSize = *(FileIOSizeT*)curResp;
-            curResp += sizeof(FileIOSizeT);
-            if (((BuffMsgB2FAckHeader*)curResp)->Result == DDS_ERROR_CODE_IO_PENDING) {
-                //
-                // DO NOT USE: testing
-                //
-                //
-                ((BuffMsgB2FAckHeader*)curResp)->Result = DDS_ERROR_CODE_SUCCESS;
-                ((BuffMsgB2FAckHeader*)curResp)->BytesServiced = 4;
+//
+// Serve the counters of the buffers to every client of the stats socket, until the back end stops
+//
+//
+static void*
+StatsEndpointThread(
+    void* Arg
+) {
+    BackEndConfig* config = (BackEndConfig*)Arg;
+    struct sockaddr_un addr;
+    int listenFd;
 
-                // break;
-            }
+    //
+    // The thread starts on the core of the DMA agent, which it must not share
+    //
+    //
+    CorePlanPin(CORE_ALLOCATION_CONTROL_PLANE_CORE, "backend stats", false);
 
-            head += curRespSize;
-            if (head >= BACKEND_RESPONSE_BUFFER_SIZE) {
-                head %= BACKEND_RESPONSE_BUFFER_SIZE;
-            }
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listenFd < 0) {
+        fprintf(stderr, "%s [error]: socket failed: %d\n", __func__, errno);
+        return NULL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, BACKEND_STATS_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    unlink(BACKEND_STATS_SOCKET_PATH);
+    if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) || listen(listenFd, LISTEN_BACKLOG)) {
+        fprintf(stderr, "%s [error]: failed to listen on %s: %d\n", __func__, BACKEND_STATS_SOCKET_PATH, errno);
+        close(listenFd);
+        return NULL;
+    }
+
+    while (ForceQuitStorageEngine == 0) {
+        struct pollfd pollFd = { .fd = listenFd, .events = POLLIN };
+        if (poll(&pollFd, 1, BACKEND_STATS_POLL_MS) <= 0) {
+            continue;
+        }
+
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            continue;
         }
 
         //
-        // No batching needed here
+        // Write the text out in one go, and without SIGPIPE if the client has gone
         //
         //
-        if (head != buffConn->ResponseRing.TailB) {
-            //
-            // Send the response back to the host
-            //
-            //
-            struct ibv_send_wr *badSendWr = NULL;
-
-            //
-            // Update TailB immediately
-            //
-            //
-            buffConn->ResponseRing.TailB = head;
-            
-            //
-            // Poll the distance from the host
-            //
-            //
-            printf("%s: Polling response ring meta\n", __func__);
-            ret = ibv_post_send(buffConn->QPair, &buffConn->ResponseDMAReadMetaWr, &badSendWr);
-            if (ret) {
-                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                ret = -1;
+        char* text = NULL;
+        size_t textBytes = 0;
+        FILE* out = open_memstream(&text, &textBytes);
+        if (out) {
+            WriteBuffConnStats(config, out);
+            fclose(out);
+            for (size_t sent = 0; sent < textBytes; ) {
+                ssize_t bytes = send(fd, text + sent, textBytes - sent, MSG_NOSIGNAL);
+                if (bytes <= 0) {
+                    break;
+                }
+                sent += (size_t)bytes;
             }
+            free(text);
         }
-#endif
+        close(fd);
     }
-    // SPDK_NOTICELOG("CheckAndProcessIOCompletions() returned\n");
-    return ret;
+
+    close(listenFd);
+    unlink(BACKEND_STATS_SOCKET_PATH);
+
+    return NULL;
 }
+#endif
 
 //
-// Check and process control plane completions
+// Hand the buffers of a data plane agent over to a new build: once a buffer no longer fetches requests
+// and every request it fetched has been responded to and synchronized, write its last tail together
+// with the handover mark, after which the host reconnects the buffer to the new build
 //
 //
 static inline int
-CheckAndProcessControlPlaneCompletions(
-    BackEndConfig *Config
+HandOverBuffs(
+    DataPlaneAgentConfig *Agent
 ) {
-    int ret = 0;
-    CtrlConnConfig *ctrlConn = NULL;
+    BackEndConfig *Config = Agent->Config;
     struct ibv_send_wr *badSendWr = NULL;
+    int ret;
 
-    for (int i = 0; i != Config->MaxClients; i++) {
-        ctrlConn = &Config->CtrlConns[i];
-#ifdef CREATE_DEFAULT_DPU_FILE
-        if (ctrlConn->State != CONN_STATE_CONNECTED && i != DEFAULT_DPU_FILE_CREATION_CTRL_CONN) {
+    for (int i = Agent->AgentId; i < Config->MaxBuffs; i += DDS_BACKEND_DATA_PLANE_AGENTS) {
+        BuffConnConfig *buffConn = &Config->BuffConns[i];
+
+        if (buffConn->State != CONN_STATE_CONNECTED || buffConn->HandedOver) {
+            continue;
+        }
+
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+        if (!buffConn->RequestsQuiesced && !buffConn->RequestSleeping) {
             continue;
         }
 #else
-        if (ctrlConn->State != CONN_STATE_CONNECTED) {
+        if (!buffConn->RequestsQuiesced) {
             continue;
         }
 #endif
 
-        if (ctrlConn->PendingControlPlaneRequest.RequestId == DDS_REQUEST_INVALID) {
+        if (buffConn->NextRequestContext != buffConn->NextCompletionContext ||
+            buffConn->ResponseRing.TailA != buffConn->ResponseRing.TailC ||
+            buffConn->ResponseSendInFlight || buffConn->ResponseHeldBatches ||
+            buffConn->DirectReadWritesInFlight) {
             continue;
         }
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+        if (buffConn->NumDeferredResponses) {
+            continue;
+        }
+#endif
+
+        buffConn->ResponseRing.HandedOver = 1;
+        buffConn->ResponseDMAWriteHandoverWr.imm_data = htonl((uint32_t)buffConn->ResponseRing.TailC);
+        ret = PostBuffSend(buffConn, ResponseQPair(buffConn), &buffConn->ResponseDMAWriteHandoverWr, &badSendWr);
+        if (ret) {
+            fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
+            return -1;
+        }
+        buffConn->HandedOver = 1;
+    }
+
+    return 0;
+}
+
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+//
+// Adapt the completion budgets of an agent once every BUFF_CQ_BUDGET_ADAPT_ROUNDS rounds:
+// additive increase while the buffers have more completions than the budgets let through,
+// and multiplicative decrease once the rounds get long
+//
+//
+static void
+AdaptCqBudgets(
+    DataPlaneAgentConfig* Agent
+) {
+    static const int minBudgets[2] = { BUFF_HIGH_PRIORITY_CQ_BUDGET, BUFF_NORMAL_PRIORITY_CQ_BUDGET };
+
+    if (++Agent->Rounds != BUFF_CQ_BUDGET_ADAPT_ROUNDS) {
+        return;
+    }
+
+    uint64_t now = spdk_get_ticks();
+    uint64_t targetTicks = (uint64_t)BUFF_CQ_ROUND_TARGET_US * BUFF_CQ_BUDGET_ADAPT_ROUNDS * spdk_get_ticks_hz() / 1000000;
+    bool slow = now - Agent->WindowStartTicks > targetTicks;
+
+    for (int p = 0; p != 2; p++) {
+        int budget = Agent->CqBudget[p];
+
+        if (slow) {
+            budget /= 2;
+        }
+        else if (Agent->CqSaturated[p] * 100 > Agent->CqPolls[p] * BUFF_CQ_BUDGET_GROW_PERCENT) {
+            budget++;
+        }
+        else if (Agent->CqSaturated[p] * 100 < Agent->CqPolls[p] * BUFF_CQ_BUDGET_SHRINK_PERCENT) {
+            budget--;
+        }
+
+        Agent->CqBudget[p] = budget < minBudgets[p] ? minBudgets[p] :
+            budget > BUFF_CQ_BUDGET_MAX ? BUFF_CQ_BUDGET_MAX : budget;
+        Agent->CqPolls[p] = 0;
+        Agent->CqSaturated[p] = 0;
+    }
+
+    Agent->Rounds = 0;
+    Agent->WindowStartTicks = now;
+}
+#endif
+
+//
+// A data plane agent thread is a pthread that polls the buffers it owns
+//
+//
+static void* DataPlaneAgentThread(
+    void* Arg
+) {
+    DataPlaneAgentConfig* agent = (DataPlaneAgentConfig*)Arg;
+    char owner[CORE_PLAN_OWNER_CHARS];
+    int ret = 0;
+
+    snprintf(owner, sizeof(owner), "data plane agent %u", agent->AgentId);
+    ret = CorePlanPin(CORE_ALLOCATION_STORAGE_ENGINE_DATA_PLANE_FIRST_CORE + agent->AgentId, owner, true);
+    if (ret) {
+        fprintf(stderr, "Data plane agent #%u has no core of its own\n", agent->AgentId);
+        SignalHandler(SIGTERM);
+        return NULL;
+    }
+
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+    agent->WindowStartTicks = spdk_get_ticks();
+#endif
+
+    while (ForceQuitStorageEngine == 0) {
+        ProcessBuffStateChanges(agent);
+
+        if (HandOverStorageEngine && HandOverBuffs(agent)) {
+            fprintf(stderr, "HandOverBuffs error\n");
+            SignalHandler(SIGTERM);
+        }
 
         //
-        // The first field of response should always be the error code
+        // Process RDMA events for buffer connections
         //
         //
-        if (*(ErrorCodeT*)(ctrlConn->PendingControlPlaneRequest.Response) != DDS_ERROR_CODE_IO_PENDING) {
-            // SPDK_NOTICELOG("Responding back... and NULLing ctrl plane request\n");
-            ctrlConn->PendingControlPlaneRequest.RequestId = DDS_REQUEST_INVALID;
-            ctrlConn->PendingControlPlaneRequest.Request = NULL;
-            ctrlConn->PendingControlPlaneRequest.Response = NULL;
+        ret = ProcessBuffCqEvents(agent);
+        if (ret) {
+            fprintf(stderr, "ProcessBuffCqEvents error %d\n", ret);
+            SignalHandler(SIGTERM);
+        }
 
-#ifdef CREATE_DEFAULT_DPU_FILE
-            if (i == DEFAULT_DPU_FILE_CREATION_CTRL_CONN) {
-                switch (ctrlConn->DefaultDpuFileCreationState)
-                {
-                case FILE_CREATION_SUBMITTED:
-                {
-                    CtrlMsgF2BReqChangeFileSize *req = &ctrlConn->DefaultChangeFileRequest;
-                    CtrlMsgB2FAckChangeFileSize *resp = &ctrlConn->DefaultChangeFileResponse;
+        //
+        // Check and process I/O completions
+        //
+        //
+#ifdef OPT_FILE_SERVICE_REPLICATION
+        //
+        // Take the acks of the peer before the completions, so the writes they complete go out right away;
+        // a broken channel fails its writes but doesn't stop the back end
+        //
+        //
+        ReplicaPoll(agent->AgentId);
+#endif
 
-                    ctrlConn->DefaultDpuFileCreationState = FILE_CREATED;
-                    fprintf(stdout, "DPU default file has been created\n");
+        ret = CheckAndProcessIOCompletions(agent);
+        if (ret) {
+            fprintf(stderr, "CheckAndProcessIOCompletions error %d\n", ret);
+            SignalHandler(SIGTERM);
+        }
 
-                    //
-                    // Change file size
-                    //
-                    //
-                    req->FileId = DEFAULT_DPU_FILE_ID;
-                    req->NewSize = DEFAULT_DPU_FILE_SIZE;
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+        //
+        // Write the offload responses released by the network engine to the host
+        //
+        //
+        ret = ProcessOffloadResponses(agent);
+        if (ret) {
+            fprintf(stderr, "ProcessOffloadResponses error %d\n", ret);
+            SignalHandler(SIGTERM);
+        }
+#endif
 
-                    ctrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_CHANGE_FILE_SIZE;
-                    ctrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
-                    ctrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
-                    resp->Result = DDS_ERROR_CODE_IO_PENDING;
-                    SubmitControlPlaneRequest(Config->FS, &ctrlConn->PendingControlPlaneRequest);
-                }
-                    break;
-                case FILE_CREATED:
-                {
-                    ctrlConn->DefaultDpuFileCreationState = FILE_CHANGED;
-                    fprintf(stdout, "DPU default file size has been changed to %llu\n", DEFAULT_DPU_FILE_SIZE);
-                }
-                    break;
-                default:
-                {
-                    //
-                    // Regular control operation. Respond back to the host
-                    //
-                    //
-                    ret = ibv_post_send(ctrlConn->QPair, &ctrlConn->SendWr, &badSendWr);
-                    if (ret) {
-                        fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                        ret = -1;
-                    }
-                }
-                    break;
-                }
-            }
-            else {
-                //
-                // It's complete. Respond back to the host
-                //
-                //
-                ret = ibv_post_send(ctrlConn->QPair, &ctrlConn->SendWr, &badSendWr);
-                if (ret) {
-                    fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                    ret = -1;
-                }
-            }
-#else
-            //
-            // It's complete. Respond back to the host
-            //
-            //
-            ret = ibv_post_send(ctrlConn->QPair, &ctrlConn->SendWr, &badSendWr);
-            if (ret) {
-                fprintf(stderr, "%s [error]: ibv_post_send failed: %d\n", __func__, ret);
-                ret = -1;
-            }
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+        AdaptCqBudgets(agent);
 #endif
-        }
     }
 
-    return ret;
+    return NULL;
 }
 
 //
-// CPU affinity
+// Whether every host has let this back end go for the new build: its control connections are closed,
+// and every buffer it still has is closed or has been told about the handover
 //
 //
-int
-AffinitizeCurrentThread(
-    int CoreId
+static bool
+HostsHandedOver(
+    BackEndConfig *Config
 ) {
-   cpu_set_t cpuset;
-   CPU_ZERO(&cpuset);
-   CPU_SET(CoreId, &cpuset);
+    for (int i = 0; i != Config->MaxClients; i++) {
+        if (Config->CtrlConns[i].State != CONN_STATE_AVAILABLE) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i != Config->MaxBuffs; i++) {
+        if (Config->BuffConns[i].State != CONN_STATE_AVAILABLE && Config->BuffConns[i].HandedOver != 2) {
+            return false;
+        }
+    }
 
-   pthread_t currentThread = pthread_self();    
-   return pthread_setaffinity_np(currentThread, sizeof(cpu_set_t), &cpuset);
+    return true;
 }
 
 //
-// DMA agent thread is a pthread
+// DMA agent thread is a pthread that handles connections and control messages,
+// and runs the data plane agents
 //
 //
 void* DMAAgentThread(
@@ -2829,15 +6371,37 @@ void* DMAAgentThread(
 ) {
     struct rdma_cm_event *event;
     int ret = 0;
-    int dataPlaneCounter = 0;
+    DataPlaneAgentConfig agents[DDS_BACKEND_DATA_PLANE_AGENTS];
+    uint32_t numAgents = 0;
+    int progress = 0;
+    time_t handOverStart = 0;
+#ifdef DMA_AGENT_EVENT_DRIVEN
+    uint32_t idleRounds = 0;
+#endif
+#ifdef CACHE_TABLE_SNAPSHOT_ENABLED
+    time_t lastSnapshot = time(NULL);
+    size_t snapshotChanges = GlobalCacheTable->Changes;
+#endif
+#ifdef CACHE_TABLE_STATS_ENABLED
+    time_t lastStats = time(NULL);
+#endif
+#ifdef BACKEND_STATS_ENABLED
+    pthread_t statsThread;
+    bool statsThreadStarted = false;
+#endif
 
     BackEndConfig* config = (BackEndConfig*)Arg;
 
     //
-    // Affinitize the current thread
+    // Pin the current thread to its core of the plan
     //
     //
-    AffinitizeCurrentThread(CORE_ALLOCATION_STORAGE_ENGINE_AGENT_CORE);
+    ret = CorePlanPin(CORE_ALLOCATION_STORAGE_ENGINE_AGENT_CORE, "DMA agent", true);
+    if (ret) {
+        fprintf(stderr, "DMA agent has no core of its own\n");
+        SignalHandler(SIGTERM);
+        return NULL;
+    }
 
     //
     // Initialize DMA
@@ -2860,6 +6424,21 @@ void* DMAAgentThread(
         return NULL;
     }
 
+#ifdef OPT_FILE_SERVICE_REPLICATION
+    //
+    // Connect to the peer before the host can connect, so that no write misses it
+    //
+    //
+    ret = ReplicaStart(config->FS);
+    if (ret) {
+        fprintf(stderr, "ReplicaStart failed with %d\n", ret);
+        DeallocConns(config);
+        TermDMA(&config->DMAConf);
+        SignalHandler(SIGTERM);
+        return NULL;
+    }
+#endif
+
     //
     // Listen for incoming connections
     //
@@ -2871,120 +6450,240 @@ void* DMAAgentThread(
         return NULL;
     }
 
+    //
+    // Start the data plane agents
+    //
+    //
+    for (; numAgents != DDS_BACKEND_DATA_PLANE_AGENTS; numAgents++) {
+        agents[numAgents].Config = config;
+        agents[numAgents].AgentId = numAgents;
+        agents[numAgents].NextBuffToPoll = numAgents;
+        agents[numAgents].CqBudget[0] = BUFF_HIGH_PRIORITY_CQ_BUDGET;
+        agents[numAgents].CqBudget[1] = BUFF_NORMAL_PRIORITY_CQ_BUDGET;
+#ifdef BUFF_CQ_BUDGET_ADAPTIVE
+        memset(agents[numAgents].CqPolls, 0, sizeof(agents[numAgents].CqPolls));
+        memset(agents[numAgents].CqSaturated, 0, sizeof(agents[numAgents].CqSaturated));
+        agents[numAgents].Rounds = 0;
+#endif
+        ret = pthread_create(&agents[numAgents].Thread, NULL, DataPlaneAgentThread, (void*)&agents[numAgents]);
+        if (ret) {
+            fprintf(stderr, "Failed to start data plane agent #%u\n", numAgents);
+            SignalHandler(SIGTERM);
+            break;
+        }
+    }
+
+#ifdef BACKEND_STATS_ENABLED
+    //
+    // Start the stats endpoint; the back end runs without it if it can't
+    //
+    //
+    statsThreadStarted = pthread_create(&statsThread, NULL, StatsEndpointThread, (void*)config) == 0;
+    if (!statsThreadStarted) {
+        fprintf(stderr, "Failed to start the stats endpoint\n");
+    }
+#endif
+
     while (ForceQuitStorageEngine == 0) {
-        if (dataPlaneCounter == 0) {
-            //
-            // Process connection events
-            //
-            //
-            ret = rdma_get_cm_event(config->DMAConf.CmChannel, &event);
-            if (ret && errno != EAGAIN) {
-                ret = errno;
-                fprintf(stderr, "rdma_get_cm_event error %d\n", ret);
+        progress = 0;
+
+        //
+        // Quit once the hosts have left for the new build, or when they take too long
+        //
+        //
+        if (HandOverStorageEngine) {
+            if (!handOverStart) {
+                handOverStart = time(NULL);
+            }
+            if (HostsHandedOver(config)) {
+                fprintf(stdout, "All hosts are handed over, exiting\n");
+                SignalHandler(SIGTERM);
+                break;
+            }
+            if (time(NULL) - handOverStart >= BACKEND_HANDOVER_TIMEOUT_SECONDS) {
+                fprintf(stderr, "Hosts are still connected %d seconds into the handover, exiting\n", BACKEND_HANDOVER_TIMEOUT_SECONDS);
                 SignalHandler(SIGTERM);
+                break;
             }
-            else if (!ret) {
+        }
+
+        //
+        // Process connection events
+        //
+        //
+        ret = rdma_get_cm_event(config->DMAConf.CmChannel, &event);
+        if (ret && errno != EAGAIN) {
+            ret = errno;
+            fprintf(stderr, "rdma_get_cm_event error %d\n", ret);
+            SignalHandler(SIGTERM);
+        }
+        else if (!ret) {
+            progress++;
 #ifdef DDS_STORAGE_FILE_BACKEND_VERBOSE
-                fprintf(stdout, "cma_event type %s cma_id %p (%s)\n",
-                    rdma_event_str(event->event), event->id,
-                    (event->id == config->DMAConf.CmId) ? "parent" : "child");
+            fprintf(stdout, "cma_event type %s cma_id %p (%s)\n",
+                rdma_event_str(event->event), event->id,
+                (event->id == config->DMAConf.CmId) ? "parent" : "child");
 #endif
 
-                ret = ProcessCmEvents(config, event);
-                if (ret) {
-                    fprintf(stderr, "ProcessCmEvents error %d\n", ret);
-                    SignalHandler(SIGTERM);
-                }
+            ret = ProcessCmEvents(config, event);
+            if (ret) {
+                fprintf(stderr, "ProcessCmEvents error %d\n", ret);
+                SignalHandler(SIGTERM);
             }
-            // SPDK_NOTICELOG("Process connection events completed\n");
+        }
+        // SPDK_NOTICELOG("Process connection events completed\n");
+
+        //
+        // Process RDMA events for control connections
+        //
+        //
+        ret = ProcessCtrlCqEvents(config, &progress);
+        if (ret) {
+            fprintf(stderr, "ProcessCtrlCqEvents error %d\n", ret);
+            SignalHandler(SIGTERM);
+        }
+        // SPDK_NOTICELOG("Process control conn completed\n");
+
+        //
+        // Check and process control plane completions
+        //
+        //
+        ret = CheckAndProcessControlPlaneCompletions(config);
+        if (ret) {
+            fprintf(stderr, "CheckAndProcessControlPlaneCompletions error %d\n", ret);
+            SignalHandler(SIGTERM);
+        }
+        // SPDK_NOTICELOG("control plane completion completed\n");
+
+#ifdef CREATE_DEFAULT_DPU_FILE
+        if (config->CtrlConns[DEFAULT_DPU_FILE_CREATION_CTRL_CONN].DefaultDpuFileCreationState == FILE_NULL) {
+            CtrlConnConfig *ctrlConn = &config->CtrlConns[DEFAULT_DPU_FILE_CREATION_CTRL_CONN];
+            CtrlMsgF2BReqCreateFile *req = &ctrlConn->DefaultCreateFileRequest;
+            CtrlMsgB2FAckCreateFile *resp = &ctrlConn->DefaultCreateFileResponse;
 
             //
-            // Process RDMA events for control connections
+            // Wait for the file service to get ready
             //
             //
-            ret = ProcessCtrlCqEvents(config);
-            if (ret) {
-                fprintf(stderr, "ProcessCtrlCqEvents error %d\n", ret);
-                SignalHandler(SIGTERM);
-            }
-            // SPDK_NOTICELOG("Process control conn completed\n");
-
+            sleep(2);
+            
             //
-            // Check and process control plane completions
+            // Create the file
             //
             //
-            ret = CheckAndProcessControlPlaneCompletions(config);
-            if (ret) {
-                fprintf(stderr, "CheckAndProcessControlPlaneCompletions error %d\n", ret);
-                SignalHandler(SIGTERM);
-            }
-            // SPDK_NOTICELOG("control plane completion completed\n");
-
-#ifdef CREATE_DEFAULT_DPU_FILE
-            if (config->CtrlConns[DEFAULT_DPU_FILE_CREATION_CTRL_CONN].DefaultDpuFileCreationState == FILE_NULL) {
-                CtrlConnConfig *ctrlConn = &config->CtrlConns[DEFAULT_DPU_FILE_CREATION_CTRL_CONN];
-                CtrlMsgF2BReqCreateFile *req = &ctrlConn->DefaultCreateFileRequest;
-                CtrlMsgB2FAckCreateFile *resp = &ctrlConn->DefaultCreateFileResponse;
+            req->DirId = DDS_DIR_ROOT;
+            req->FileAttributes = 0;
+            req->FileId = DEFAULT_DPU_FILE_ID;
+            strcpy(req->FileName, "DpuDefaulFile");
 
-                //
-                // Wait for the file service to get ready
-                //
-                //
-                sleep(2);
-                
-                //
-                // Create the file
-                //
-                //
-                req->DirId = DDS_DIR_ROOT;
-                req->FileAttributes = 0;
-                req->FileId = DEFAULT_DPU_FILE_ID;
-                strcpy(req->FileName, "DpuDefaulFile");
-
-                ctrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_CREATE_FILE;
-                ctrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
-                ctrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
-                resp->Result = DDS_ERROR_CODE_IO_PENDING;
-                SubmitControlPlaneRequest(config->FS, &ctrlConn->PendingControlPlaneRequest);
+            ctrlConn->PendingControlPlaneRequest.RequestId = CTRL_MSG_F2B_REQ_CREATE_FILE;
+            ctrlConn->PendingControlPlaneRequest.Request = (BufferT)req;
+            ctrlConn->PendingControlPlaneRequest.Response = (BufferT)resp;
+            resp->Result = DDS_ERROR_CODE_IO_PENDING;
+            SubmitControlPlaneRequest(config->FS, &ctrlConn->PendingControlPlaneRequest);
 		ctrlConn->DefaultDpuFileCreationState = FILE_CREATION_SUBMITTED;
-            }
-#endif
         }
+#endif
 
+#ifdef CACHE_TABLE_SNAPSHOT_ENABLED
         //
-        // Process RDMA events for buffer connections
+        // Save the cache table periodically if it has changed
         //
         //
-        // SPDK_NOTICELOG("buffer connections started\n");
-        ret = ProcessBuffCqEvents(config);
-        if (ret) {
-            fprintf(stderr, "ProcessBuffCqEvents error %d\n", ret);
-            SignalHandler(SIGTERM);
+        if (time(NULL) - lastSnapshot >= CACHE_TABLE_SNAPSHOT_INTERVAL_SECONDS) {
+            if (GlobalCacheTable->Changes != snapshotChanges) {
+                if (SaveCacheTable(GlobalCacheTable, CACHE_TABLE_SNAPSHOT_PATH)) {
+                    fprintf(stderr, "%s [error]: SaveCacheTable failed\n", __func__);
+                }
+                else {
+                    snapshotChanges = GlobalCacheTable->Changes;
+                }
+            }
+            lastSnapshot = time(NULL);
         }
-        // SPDK_NOTICELOG("buffer connections completed\n");
+#endif
+
+#ifdef CACHE_TABLE_STATS_ENABLED
+        if (time(NULL) - lastStats >= CACHE_TABLE_STATS_INTERVAL_SECONDS) {
+            PrintCacheTableStats();
+            lastStats = time(NULL);
+        }
+#endif
 
+#ifdef DMA_AGENT_EVENT_DRIVEN
         //
-        // Check and process I/O completions
+        // After enough idle rounds, arm the control completion queues and take one more round
+        // to poll the completions that raced the arming, then sleep if that round was idle too;
+        // requests in the file service keep the agent polling for their completions
         //
         //
-        ret = CheckAndProcessIOCompletions(config);
-        if (ret) {
-            fprintf(stderr, "CheckAndProcessIOCompletions error %d\n", ret);
-            SignalHandler(SIGTERM);
+        if (progress || ControlPlaneRequestsPending(config)) {
+            idleRounds = 0;
         }
-        // SPDK_NOTICELOG("io completions completed\n");
+        else if (++idleRounds == DMA_AGENT_IDLE_ROUNDS) {
+            ret = ArmCtrlCompQueues(config);
+            if (ret) {
+                fprintf(stderr, "ArmCtrlCompQueues error %d\n", ret);
+                SignalHandler(SIGTERM);
+            }
+        }
+        else if (idleRounds > DMA_AGENT_IDLE_ROUNDS) {
+            ret = WaitForDMAAgentEvents(config);
+            if (ret) {
+                fprintf(stderr, "WaitForDMAAgentEvents error %d\n", ret);
+                SignalHandler(SIGTERM);
+            }
 
-        dataPlaneCounter++;
-        if (dataPlaneCounter == DATA_PLANE_WEIGHT) {
-            dataPlaneCounter = 0;
+            //
+            // Re-arm and sleep again unless the next round finds work
+            //
+            //
+            idleRounds = DMA_AGENT_IDLE_ROUNDS - 1;
         }
+#endif
+    }
+
+    //
+    // Wait for the data plane agents
+    //
+    //
+    for (uint32_t a = 0; a != numAgents; a++) {
+        pthread_join(agents[a].Thread, NULL);
     }
+#ifdef BACKEND_STATS_ENABLED
+    if (statsThreadStarted) {
+        pthread_join(statsThread, NULL);
+    }
+#endif
+
+#ifdef CACHE_TABLE_SNAPSHOT_ENABLED
+    //
+    // Save the cache table for the next start
+    //
+    //
+    if (GlobalCacheTable->Changes != snapshotChanges &&
+        SaveCacheTable(GlobalCacheTable, CACHE_TABLE_SNAPSHOT_PATH)) {
+        fprintf(stderr, "%s [error]: SaveCacheTable failed\n", __func__);
+    }
+#endif
+
+#ifdef CACHE_TABLE_STATS_ENABLED
+    PrintCacheTableStats();
+#endif
+
+#ifdef PROFILER_ENABLED
+    ProfilerDump(stdout);
+#endif
 
     //
     // Clean up
     //
     //
+#ifdef OPT_FILE_SERVICE_REPLICATION
+    ReplicaStop();
+#endif
     DeallocConns(config);
+    LeasesDestroy();
     TermDMA(&config->DMAConf);
     StopFileService(config->FS);
     sleep(1);
@@ -3025,6 +6724,19 @@ int RunFileBackEnd(
     config.DMAConf.CmId = NULL;
     config.FS = NULL;
 
+    //
+    // SPDK takes SIGINT and SIGTERM; the handover signal is the back end's own
+    //
+    //
+    struct sigaction handOverAction;
+    memset(&handOverAction, 0, sizeof(handOverAction));
+    handOverAction.sa_handler = SignalHandler;
+    sigemptyset(&handOverAction.sa_mask);
+    if (sigaction(BACKEND_HANDOVER_SIGNAL, &handOverAction, NULL)) {
+        fprintf(stderr, "Failed to install the handover signal handler\n");
+        return -1;
+    }
+
     //
     // Initialize Cache Table
     //
@@ -3034,6 +6746,18 @@ int RunFileBackEnd(
         fprintf(stderr, "InitCacheTable failed\n");
         return -1;
     }
+    fprintf(stdout, "Cache table has %lu bytes on %s huge pages\n", GlobalCacheTable->TableBytes,
+        GlobalCacheTable->HugePages ? "hugetlbfs" : "transparent");
+
+#ifdef CACHE_TABLE_SNAPSHOT_ENABLED
+    if (!LoadCacheTable(GlobalCacheTable, CACHE_TABLE_SNAPSHOT_PATH)) {
+        fprintf(stdout, "Cache table has been loaded with %lu items from %s\n", GlobalCacheTable->NumItems,
+            CACHE_TABLE_SNAPSHOT_PATH);
+    }
+    else {
+        fprintf(stdout, "No cache table snapshot to load from %s\n", CACHE_TABLE_SNAPSHOT_PATH);
+    }
+#endif
 
 #ifdef PRELOAD_CACHE_TABLE_ITEMS
     FILE *file = fopen(CACHE_TABLE_FILE_PATH, "rb");
@@ -3062,7 +6786,7 @@ int RunFileBackEnd(
         items = (CacheItemT*)readBuffer;
         for (int i = 0; i != numItemsInABatch; i++) {
             if (AddToCacheTable(GlobalCacheTable, &items[i])) {
-                fprintf(stderr, "Failed to add item %lu into cache table\n", items[i].Key);
+                fprintf(stderr, "Failed to add item %lu into cache table\n", (uint64_t)items[i].Key);
                 fclose(file);
                 return -1;
             }
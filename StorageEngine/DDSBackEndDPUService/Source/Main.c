@@ -15,8 +15,8 @@ main(
      ret = RunFileBackEnd(
         DDS_BACKEND_ADDR,
         DDS_BACKEND_PORT,
-        1,
-        1,
+        DDS_BACKEND_MAX_CLIENTS,
+        DDS_BACKEND_MAX_BUFFS,
         Argc,
         Argv
     );
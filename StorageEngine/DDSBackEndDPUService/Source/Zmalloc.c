@@ -5,64 +5,185 @@
 
 #include "Zmalloc.h"
 
+//
+// Set up a free list of indices [First, End) in a link array covering [0, End)
+//
+//
+static bool
+InitIndexFreeList(
+    IndexFreeListT *List,
+    int First,
+    int End
+){
+    List->Next = malloc(End * sizeof(atomic_ushort));
+    if (!List->Next) {
+        return false;
+    }
+
+    for (int i = 0; i < End; i++){
+        atomic_init(&List->Next[i], i + 1 < End ? i + 1 : ZMALLOC_NO_SLOT);
+    }
+    atomic_init(&List->Head, First < End ? First : ZMALLOC_NO_SLOT);
+
+    return true;
+}
+
+//
+// Take the index at the head of a free list, without locks, in O(1);
+// the tag of the head makes a pop fail if the index has been taken and given back meanwhile;
+// returns ZMALLOC_NO_SLOT if the list is empty
+//
+//
+static inline unsigned int
+PopFreeIndex(
+    IndexFreeListT *List
+){
+    unsigned int head = atomic_load_explicit(&List->Head, memory_order_acquire);
+    unsigned int index;
+    unsigned int newHead;
+    do {
+        index = head & ZMALLOC_SLOT_MASK;
+        if (index == ZMALLOC_NO_SLOT) {
+            return ZMALLOC_NO_SLOT;
+        }
+        newHead = ((head & ~ZMALLOC_SLOT_MASK) + ZMALLOC_TAG_ONE) | atomic_load_explicit(&List->Next[index], memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&List->Head, &head, newHead, memory_order_acquire, memory_order_acquire));
+
+    return index;
+}
+
+//
+// Give an index back to the head of a free list, without locks, in O(1)
+//
+//
+static inline void
+PushFreeIndex(
+    IndexFreeListT *List,
+    unsigned int Index
+){
+    unsigned int head = atomic_load_explicit(&List->Head, memory_order_relaxed);
+    unsigned int newHead;
+    do {
+        atomic_store_explicit(&List->Next[Index], (unsigned short)(head & ZMALLOC_SLOT_MASK), memory_order_relaxed);
+        newHead = ((head & ~ZMALLOC_SLOT_MASK) + ZMALLOC_TAG_ONE) | Index;
+    } while (!atomic_compare_exchange_weak_explicit(&List->Head, &head, newHead, memory_order_release, memory_order_relaxed));
+}
+
+//
+// Carve the slabs of staging buffers out of DMA-able hugepage memory;
+// only the non zero copy paths and scans stage their data, so nothing is reserved with zero copy and no scans
+//
+//
+static void
+AllocateBuffSlabs(
+    SPDKContextT *SPDKContext
+){
+    SPDKContext->BuffSlabs = NULL;
+
+#if !defined(OPT_FILE_SERVICE_ZERO_COPY) || defined(OPT_FILE_SERVICE_SCAN)
+    const uint64_t classBytes[DDS_BACKEND_SPDK_BUFF_CLASSES] = DDS_BACKEND_SPDK_BUFF_CLASS_BYTES;
+    const int classCounts[DDS_BACKEND_SPDK_BUFF_CLASSES] = DDS_BACKEND_SPDK_BUFF_CLASS_COUNTS;
+
+    SPDKContext->BuffSlabs = calloc(DDS_BACKEND_SPDK_BUFF_CLASSES, sizeof(SPDKBuffSlabT));
+    if (!SPDKContext->BuffSlabs) {
+        SPDK_ERRLOG("Failed to allocate buffer slabs\n");
+        exit(-1);
+    }
+
+    for (int c = 0; c < DDS_BACKEND_SPDK_BUFF_CLASSES; c++){
+        SPDKBuffSlabT *slab = &SPDKContext->BuffSlabs[c];
+        slab->BufferBytes = classBytes[c];
+        slab->Base = spdk_dma_zmalloc(classBytes[c] * classCounts[c], DDS_BACKEND_SPDK_BUFF_ALIGNMENT, NULL);
+        if (!slab->Base || !InitIndexFreeList(&slab->FreeBuffers, 0, classCounts[c])) {
+            SPDK_ERRLOG("Failed to allocate %d buffers of %lu bytes\n", classCounts[c], classBytes[c]);
+            exit(-1);
+        }
+        SPDK_NOTICELOG("Allocated %d DMA-able buffers of %lu bytes\n", classCounts[c], classBytes[c]);
+    }
+#endif
+}
+
 void AllocateSpace(void *arg){
     SPDKContextT *SPDKContext = arg;
-    SPDKContext->buff_size = (DDS_MAX_OUTSTANDING_IO * (DDS_DPU_IO_PARALLELISM + 1)) * DDS_BACKEND_SPDK_BUFF_BLOCK_SPACE;
-    SPDKContext->buff = malloc(SPDKContext->buff_size);
-	if (!SPDKContext->buff) {
-		SPDK_ERRLOG("Failed to allocate buffer\n");
-        exit(-1);
-		return;
-	}
 
-    SPDKContext->SPDKSpace = malloc((DDS_MAX_OUTSTANDING_IO * (DDS_DPU_IO_PARALLELISM + 1)) * sizeof(struct PerSlotContext));
-    for (int i = 0; i < (DDS_MAX_OUTSTANDING_IO * (DDS_DPU_IO_PARALLELISM + 1)); i++){
+    AllocateBuffSlabs(SPDKContext);
+
+    SPDKContext->SPDKSpace = malloc(DDS_IO_SLOT_NUMBER_TOTAL * sizeof(struct PerSlotContext));
+    for (int i = 0; i < DDS_IO_SLOT_NUMBER_TOTAL; i++){
         SPDKContext->SPDKSpace[i].Available = true;
         SPDKContext->SPDKSpace[i].Position = i;
+        SPDKContext->SPDKSpace[i].Buff = NULL;
     }
-    if(spdk_bdev_is_zoned(SPDKContext->bdev)){
-        BdevResetZone(arg);
-        return;
+
+    //
+    // All pool slots start on the free list
+    //
+    //
+    SPDKContext->FreeSlots = malloc(sizeof(IndexFreeListT));
+    if (!SPDKContext->FreeSlots || !InitIndexFreeList(SPDKContext->FreeSlots, ZMALLOC_POOL_SLOT_FIRST, ZMALLOC_POOL_SLOT_END)) {
+        SPDK_ERRLOG("Failed to allocate the slot free list\n");
+        exit(-1);
     }
 
-    pthread_mutex_init(&SPDKContext->SpaceMutex, NULL);
+    memset(&SPDKContext->FlushGroup, 0, sizeof(BdevFlushGroupT));
 }
 
+//
+// Give a slot back; a pool slot goes back to the head of the free list, without locks
+//
+//
 void FreeSingleSpace(
     struct PerSlotContext* Ctx
 ){
     Ctx->Available = true;
 
+    if (Ctx->Position < ZMALLOC_POOL_SLOT_FIRST || Ctx->Position >= ZMALLOC_POOL_SLOT_END) {
+        return;
+    }
+
+    PushFreeIndex(Ctx->SPDKContext->FreeSlots, (unsigned int)Ctx->Position);
 }
 
 void FreeAllSpace(void *arg){
     SPDKContextT *SPDKContext = arg;
-    spdk_dma_free(SPDKContext->buff);
+    if (SPDKContext->BuffSlabs) {
+        for (int c = 0; c < DDS_BACKEND_SPDK_BUFF_CLASSES; c++){
+            spdk_dma_free(SPDKContext->BuffSlabs[c].Base);
+            free(SPDKContext->BuffSlabs[c].FreeBuffers.Next);
+        }
+        free(SPDKContext->BuffSlabs);
+    }
     free(SPDKContext->SPDKSpace);
+    free(SPDKContext->FreeSlots->Next);
+    free(SPDKContext->FreeSlots);
 }
 
+//
+// Take a pool slot off the free list for the Request Context, without locks, in O(1);
+// returns NULL if every pool slot is in use
+//
+//
 struct PerSlotContext*
 FindFreeSpace(
     SPDKContextT *SPDKContext,
     DataPlaneRequestContext* Context
 ){
-    pthread_mutex_lock(&SPDKContext->SpaceMutex);
-    for (int i = 0; i < (DDS_MAX_OUTSTANDING_IO * 2); i++){
-        if(SPDKContext->SPDKSpace[i].Available){
-            SPDKContext->SPDKSpace[i].Available = false;
-            SPDKContext->SPDKSpace[i].Ctx = Context;
-            pthread_mutex_unlock(&SPDKContext->SpaceMutex);
-            return &SPDKContext->SPDKSpace[i];
-        }
+    unsigned int index = PopFreeIndex(SPDKContext->FreeSlots);
+    if (index == ZMALLOC_NO_SLOT) {
+        return NULL;
     }
-    pthread_mutex_unlock(&SPDKContext->SpaceMutex);
-    return NULL;
+
+    struct PerSlotContext* slot = &SPDKContext->SPDKSpace[index];
+    slot->Available = false;
+    slot->Ctx = Context;
+    slot->SPDKContext = SPDKContext;
+    return slot;
 }
 
 //
 // Puts the Request Context into a slot context, and returns the slot ctx ptr
 // Note: should be always called from app thread.
-// Due to the fact that we have `(DDS_MAX_OUTSTANDING_IO * 2)`, the index of IO request can be used as the index
+// Since every host poll has its own block of slots, the index of IO request can be used as the index
 // for per slot context, since they have a 1 to 1 relation, therefore no need for searching and freeing;
 //
 //
@@ -75,3 +196,53 @@ GetFreeSpace(
     SPDKContext->SPDKSpace[Index].Ctx = Context;
     return &SPDKContext->SPDKSpace[Index];
 }
+
+//
+// Give a slot a staging buffer of at least Bytes bytes from the smallest size class that has one left;
+// returns NULL if none has
+//
+//
+char*
+AcquireSlotBuffer(
+    struct PerSlotContext* Ctx,
+    FileIOSizeT Bytes
+){
+    SPDKBuffSlabT *slabs = Ctx->SPDKContext->BuffSlabs;
+
+    Ctx->Buff = NULL;
+    if (!slabs) {
+        return NULL;
+    }
+
+    for (int c = 0; c < DDS_BACKEND_SPDK_BUFF_CLASSES; c++){
+        if (slabs[c].BufferBytes < Bytes) {
+            continue;
+        }
+
+        unsigned int index = PopFreeIndex(&slabs[c].FreeBuffers);
+        if (index != ZMALLOC_NO_SLOT) {
+            Ctx->Buff = slabs[c].Base + index * slabs[c].BufferBytes;
+            Ctx->BuffClass = c;
+            break;
+        }
+    }
+
+    return Ctx->Buff;
+}
+
+//
+// Give the staging buffer of a slot back to its size class
+//
+//
+void
+ReleaseSlotBuffer(
+    struct PerSlotContext* Ctx
+){
+    if (!Ctx->Buff) {
+        return;
+    }
+
+    SPDKBuffSlabT *slab = &Ctx->SPDKContext->BuffSlabs[Ctx->BuffClass];
+    PushFreeIndex(&slab->FreeBuffers, (unsigned int)((Ctx->Buff - slab->Base) / slab->BufferBytes));
+    Ctx->Buff = NULL;
+}
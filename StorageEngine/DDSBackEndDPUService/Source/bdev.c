@@ -5,6 +5,153 @@
 
 #include "../Include/bdev.h"
 
+//
+// An I/O the bdev had no room for, resubmitted once an spdk_bdev_io is free;
+// each one waits with its own entry, so any number of them can be queued on a channel
+//
+//
+typedef enum {
+    BDEV_IO_READ,
+    BDEV_IO_READV,
+    BDEV_IO_WRITE,
+    BDEV_IO_WRITEV,
+    BDEV_IO_ZONE_APPENDV,
+    BDEV_IO_ZONE_RESET
+} BdevIOTypeT;
+
+typedef struct BdevDeferredIO {
+    struct spdk_bdev_io_wait_entry Wait;
+    SPDKContextT *SPDKContext;
+    BdevIOTypeT Type;
+    char *Buffer;
+    uint64_t Offset;
+    uint64_t NBytes;
+    spdk_bdev_io_completion_cb Cb;
+    void *CbArg;
+    int IovCnt;
+    struct iovec Iov[];
+} BdevDeferredIOT;
+
+//
+// The bdev an address is on, with its descriptor and the channel of the context, and the address on it:
+// the capacity bdev for an address with DDS_BACKEND_TIER_ADDRESS, the bdev of the store otherwise
+//
+//
+static inline uint64_t
+RouteBdevIO(
+    SPDKContextT *SPDKContext,
+    uint64_t Offset,
+    struct spdk_bdev **Bdev,
+    struct spdk_bdev_desc **Desc,
+    struct spdk_io_channel **Channel
+) {
+#ifdef OPT_FILE_SERVICE_TIERING
+    if (Offset & DDS_BACKEND_TIER_ADDRESS) {
+        *Bdev = SPDKContext->tier_bdev;
+        *Desc = SPDKContext->tier_bdev_desc;
+        *Channel = SPDKContext->tier_bdev_io_channel;
+        return Offset & ~DDS_BACKEND_TIER_ADDRESS;
+    }
+#endif
+    *Bdev = SPDKContext->bdev;
+    *Desc = SPDKContext->bdev_desc;
+    *Channel = SPDKContext->bdev_io_channel;
+    return Offset;
+}
+
+static void
+ResubmitBdevIO(
+    void *Arg
+) {
+    BdevDeferredIOT *io = (BdevDeferredIOT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(io->SPDKContext, io->Offset, &bdev, &desc, &channel);
+    uint32_t blockSize = spdk_bdev_get_block_size(bdev);
+    int rc = 0;
+
+    switch (io->Type) {
+        case BDEV_IO_READ:
+            rc = spdk_bdev_read(desc, channel, io->Buffer, offset, io->NBytes, io->Cb, io->CbArg);
+            break;
+        case BDEV_IO_READV:
+            rc = spdk_bdev_readv(desc, channel, io->Iov, io->IovCnt, offset, io->NBytes, io->Cb, io->CbArg);
+            break;
+        case BDEV_IO_WRITE:
+            rc = spdk_bdev_write(desc, channel, io->Buffer, offset, io->NBytes, io->Cb, io->CbArg);
+            break;
+        case BDEV_IO_WRITEV:
+            rc = spdk_bdev_writev(desc, channel, io->Iov, io->IovCnt, offset, io->NBytes, io->Cb, io->CbArg);
+            break;
+        case BDEV_IO_ZONE_APPENDV:
+            rc = spdk_bdev_zone_appendv(desc, channel,
+                io->Iov, io->IovCnt, offset / blockSize, io->NBytes / blockSize, io->Cb, io->CbArg);
+            break;
+        case BDEV_IO_ZONE_RESET:
+            rc = spdk_bdev_zone_management(desc, channel, offset / blockSize, SPDK_BDEV_ZONE_RESET, io->Cb, io->CbArg);
+            break;
+    }
+
+    if (rc == -ENOMEM) {
+        spdk_bdev_queue_io_wait(bdev, channel, &io->Wait);
+        return;
+    }
+    if (rc) {
+        SPDK_ERRLOG("%s error while resubmitting a queued I/O at %lu: %d\n", spdk_strerror(-rc), io->Offset, rc);
+    }
+    free(io);
+}
+
+//
+// Queue an I/O to be resubmitted when the channel has an spdk_bdev_io free;
+// the iovecs, if any, are copied, the buffers must stay valid until it completes
+//
+//
+static int
+DeferBdevIO(
+    SPDKContextT *SPDKContext,
+    BdevIOTypeT Type,
+    char *Buffer,
+    struct iovec *Iov,
+    int IovCnt,
+    uint64_t Offset,
+    uint64_t NBytes,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    BdevDeferredIOT *io = malloc(sizeof(BdevDeferredIOT) + IovCnt * sizeof(struct iovec));
+    if (!io) {
+        return -ENOMEM;
+    }
+
+    io->SPDKContext = SPDKContext;
+    io->Type = Type;
+    io->Buffer = Buffer;
+    io->Offset = Offset;
+    io->NBytes = NBytes;
+    io->Cb = Cb;
+    io->CbArg = CbArg;
+    io->IovCnt = IovCnt;
+    if (IovCnt) {
+        memcpy(io->Iov, Iov, IovCnt * sizeof(struct iovec));
+    }
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    RouteBdevIO(SPDKContext, Offset, &bdev, &desc, &channel);
+    io->Wait.bdev = bdev;
+    io->Wait.cb_fn = ResubmitBdevIO;
+    io->Wait.cb_arg = io;
+
+    int rc = spdk_bdev_queue_io_wait(bdev, channel, &io->Wait);
+    if (rc) {
+        SPDK_ERRLOG("%s error while queueing I/O: %d\n", spdk_strerror(-rc), rc);
+        free(io);
+    }
+    return rc;
+}
+
 //
 // Perform a list of reads (scattered reads)
 //
@@ -20,14 +167,18 @@ BdevReadV(
     void *CbArg
 ) {
     SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(spdkContext, Offset, &bdev, &desc, &channel);
     int rc = 0;
 
     rc = spdk_bdev_readv(
-        spdkContext->bdev_desc,
-        spdkContext->bdev_io_channel,
+        desc,
+        channel,
         Iov,
         IovCnt,
-        Offset,
+        offset,
         NBytes,
         Cb,
         CbArg
@@ -36,25 +187,11 @@ BdevReadV(
     if (rc == 0) {
         return 0;
     } else if ((rc == -ENOMEM)) {
-        // 
-        // In case we cannot perform I/O now, queue I/O
         //
+        // In case we cannot perform I/O now, queue it until the channel has room
         //
-        SPDK_NOTICELOG("Queueing IO\n");
-        spdkContext->bdev_io_wait.bdev = spdkContext->bdev;
-        spdkContext->bdev_io_wait.cb_fn = BdevRead;
-        spdkContext->bdev_io_wait.cb_arg = spdkContext;
-        spdk_bdev_queue_io_wait(
-            spdkContext->bdev,
-            spdkContext->bdev_io_channel,
-            &spdkContext->bdev_io_wait
-        );
-
-        //
-        // Eventually this IO should finish successfully
         //
-        //
-        return 0;
+        return DeferBdevIO(spdkContext, BDEV_IO_READV, NULL, Iov, IovCnt, Offset, NBytes, Cb, CbArg);
     }
     else if ((rc == -EINVAL)) {
         SPDK_ERRLOG("Offset: %lu and/or NBytes: %lu are not aligned or out of range\n", Offset, NBytes);
@@ -84,13 +221,17 @@ BdevRead(
     void *CbArg
 ) {
     SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(spdkContext, Offset, &bdev, &desc, &channel);
     int rc = 0;
 
     rc = spdk_bdev_read(
-        spdkContext->bdev_desc,
-        spdkContext->bdev_io_channel,
+        desc,
+        channel,
         DstBuffer,
-        Offset,
+        offset,
         NBytes,
         Cb,
         CbArg
@@ -100,24 +241,10 @@ BdevRead(
     }
     else if (rc == -ENOMEM) {
         //
-        // In case we cannot perform I/O now, queue I/O
-        //
-        //
-        SPDK_NOTICELOG("Queueing IO\n");
-        spdkContext->bdev_io_wait.bdev = spdkContext->bdev;
-        spdkContext->bdev_io_wait.cb_fn = BdevRead;
-        spdkContext->bdev_io_wait.cb_arg = spdkContext;
-        spdk_bdev_queue_io_wait(
-            spdkContext->bdev,
-            spdkContext->bdev_io_channel,
-            &spdkContext->bdev_io_wait
-        );
-        
+        // In case we cannot perform I/O now, queue it until the channel has room
         //
-        // Eventually this IO should finish successfully
         //
-        //
-        return 0;
+        return DeferBdevIO(spdkContext, BDEV_IO_READ, DstBuffer, NULL, 0, Offset, NBytes, Cb, CbArg);
     } else if (rc == -EINVAL) {
         SPDK_ERRLOG("Offset: %lu and/or NBytes: %lu are not aligned or out of range\n", Offset, NBytes);
         return rc;
@@ -146,14 +273,18 @@ BdevWriteV(
     void *CbArg
 ){
     SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(spdkContext, Offset, &bdev, &desc, &channel);
     int rc = 0;
 
     rc = spdk_bdev_writev(
-        spdkContext->bdev_desc,
-        spdkContext->bdev_io_channel,
+        desc,
+        channel,
         Iov,
         IovCnt,
-        Offset,
+        offset,
         NBytes,
         Cb,
         CbArg
@@ -164,24 +295,10 @@ BdevWriteV(
     }
     else if (rc == -ENOMEM) {
         //
-        // In case we cannot perform I/O now, queue I/O
+        // In case we cannot perform I/O now, queue it until the channel has room
         //
         //
-        SPDK_NOTICELOG("Queueing IO\n");
-        spdkContext->bdev_io_wait.bdev = spdkContext->bdev;
-        spdkContext->bdev_io_wait.cb_fn = BdevWrite;
-        spdkContext->bdev_io_wait.cb_arg = spdkContext;
-        spdk_bdev_queue_io_wait(
-            spdkContext->bdev,
-            spdkContext->bdev_io_channel,
-            &spdkContext->bdev_io_wait
-        );
-
-        //
-        // Eventually this IO should finish successfully
-        //
-        //
-        return 0;
+        return DeferBdevIO(spdkContext, BDEV_IO_WRITEV, NULL, Iov, IovCnt, Offset, NBytes, Cb, CbArg);
     } else if (rc == -EINVAL) {
         SPDK_ERRLOG("Offset: %lu and/or NBytes: %lu are not aligned or out of range\n", Offset, NBytes);
         return rc;
@@ -209,40 +326,30 @@ BdevWrite(
     void *CbArg
 ) {
     SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(spdkContext, Offset, &bdev, &desc, &channel);
     int rc = 0;
 
     rc = spdk_bdev_write(
-        spdkContext->bdev_desc,
-	spdkContext->bdev_io_channel,
+        desc,
+        channel,
         SrcBuffer,
-	Offset,
-	NBytes,
-	Cb,
-	CbArg
+        offset,
+        NBytes,
+        Cb,
+        CbArg
     );
 
     if (rc == 0) {
         return 0;
     } else if (rc == -ENOMEM) {
         //
-        // In case we cannot perform I/O now, queue I/O
-        //
-        //
-        SPDK_NOTICELOG("Queueing IO\n");
-        spdkContext->bdev_io_wait.bdev = spdkContext->bdev;
-        spdkContext->bdev_io_wait.cb_fn = BdevWrite;
-        spdkContext->bdev_io_wait.cb_arg = spdkContext;
-        spdk_bdev_queue_io_wait(
-            spdkContext->bdev,
-            spdkContext->bdev_io_channel,
-            &spdkContext->bdev_io_wait
-        );
-
-        //
-        // Eventually this IO should finish successfully
+        // In case we cannot perform I/O now, queue it until the channel has room
         //
         //
-        return 0;
+        return DeferBdevIO(spdkContext, BDEV_IO_WRITE, SrcBuffer, NULL, 0, Offset, NBytes, Cb, CbArg);
     } else if (rc == -EINVAL) {
         SPDK_ERRLOG("Offset: %lu and/or NBytes: %lu are not aligned or out of range\n", Offset, NBytes);
         return rc;
@@ -256,66 +363,349 @@ BdevWrite(
     }
 }
 
-void
-ResetZoneComplete(
+//
+// Zero a range without transferring data; SPDK emulates it
+// with zeroed writes if the device has no write zeroes command
+//
+//
+int
+BdevWriteZeroes(
+    void *Arg,
+    uint64_t Offset,
+    uint64_t NBytes,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(spdkContext, Offset, &bdev, &desc, &channel);
+    int rc = 0;
+
+    rc = spdk_bdev_write_zeroes(
+        desc,
+        channel,
+        offset,
+        NBytes,
+        Cb,
+        CbArg
+    );
+
+    if (rc == 0) {
+        return 0;
+    } else if (rc == -EINVAL) {
+        SPDK_ERRLOG("Offset: %lu and/or NBytes: %lu are not aligned or out of range\n", Offset, NBytes);
+        return rc;
+    } else {
+        SPDK_ERRLOG("%s error while zeroing bdev: %d\n", spdk_strerror(-rc), rc);
+        return rc;
+    }
+}
+
+//
+// Unmap a range; returns -ENOTSUP without logging if the device can't,
+// so that callers can treat unmapping as advisory
+//
+//
+int
+BdevUnmap(
+    void *Arg,
+    uint64_t Offset,
+    uint64_t NBytes,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    struct spdk_bdev *bdev;
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *channel;
+    uint64_t offset = RouteBdevIO(spdkContext, Offset, &bdev, &desc, &channel);
+    int rc = 0;
+
+    if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_UNMAP)) {
+        return -ENOTSUP;
+    }
+
+    rc = spdk_bdev_unmap(
+        desc,
+        channel,
+        offset,
+        NBytes,
+        Cb,
+        CbArg
+    );
+
+    if (rc == 0) {
+        return 0;
+    } else if (rc == -EINVAL) {
+        SPDK_ERRLOG("Offset: %lu and/or NBytes: %lu are not aligned or out of range\n", Offset, NBytes);
+        return rc;
+    } else {
+        SPDK_ERRLOG("%s error while unmapping bdev: %d\n", spdk_strerror(-rc), rc);
+        return rc;
+    }
+}
+
+//
+// Append to a zone, which the device writes at its write pointer; Zone is the address of the start of the zone,
+// and where the data went is spdk_bdev_io_get_append_location of the completed I/O
+//
+//
+int
+BdevZoneAppendV(
+    void *Arg,
+    struct iovec *Iov,
+    int IovCnt,
+    uint64_t Zone,
+    uint64_t NBytes,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    uint32_t blockSize = spdk_bdev_get_block_size(spdkContext->bdev);
+    int rc = 0;
+
+    rc = spdk_bdev_zone_appendv(
+        spdkContext->bdev_desc,
+        spdkContext->bdev_io_channel,
+        Iov,
+        IovCnt,
+        Zone / blockSize,
+        NBytes / blockSize,
+        Cb,
+        CbArg
+    );
+
+    if (rc == 0) {
+        return 0;
+    } else if (rc == -ENOMEM) {
+        return DeferBdevIO(spdkContext, BDEV_IO_ZONE_APPENDV, NULL, Iov, IovCnt, Zone, NBytes, Cb, CbArg);
+    } else if (rc == -EINVAL) {
+        SPDK_ERRLOG("Zone: %lu and/or NBytes: %lu are not aligned or out of range\n", Zone, NBytes);
+        return rc;
+    } else {
+        SPDK_ERRLOG("%s error while appending to a zone: %d\n", spdk_strerror(-rc), rc);
+        return rc;
+    }
+}
+
+//
+// Reset a zone, emptying it and moving its write pointer back to its start
+//
+//
+int
+BdevZoneReset(
+    void *Arg,
+    uint64_t Zone,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    int rc = 0;
+
+    rc = spdk_bdev_zone_management(
+        spdkContext->bdev_desc,
+        spdkContext->bdev_io_channel,
+        Zone / spdk_bdev_get_block_size(spdkContext->bdev),
+        SPDK_BDEV_ZONE_RESET,
+        Cb,
+        CbArg
+    );
+
+    if (rc == 0) {
+        return 0;
+    } else if (rc == -ENOMEM) {
+        return DeferBdevIO(spdkContext, BDEV_IO_ZONE_RESET, NULL, NULL, 0, Zone, 0, Cb, CbArg);
+    } else {
+        SPDK_ERRLOG("%s error while resetting the zone at %lu: %d\n", spdk_strerror(-rc), Zone, rc);
+        return rc;
+    }
+}
+
+//
+// Get the information of NumZones zones from the one at Zone
+//
+//
+int
+BdevGetZoneInfo(
+    void *Arg,
+    uint64_t Zone,
+    size_t NumZones,
+    struct spdk_bdev_zone_info *Info,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    int rc = spdk_bdev_get_zone_info(
+        spdkContext->bdev_desc,
+        spdkContext->bdev_io_channel,
+        Zone / spdk_bdev_get_block_size(spdkContext->bdev),
+        NumZones,
+        Info,
+        Cb,
+        CbArg
+    );
+
+    if (rc) {
+        SPDK_ERRLOG("%s error while getting the information of zones: %d\n", spdk_strerror(-rc), rc);
+    }
+    return rc;
+}
+
+static void
+StartBdevFlush(
+    void *Arg
+);
+
+//
+// Complete the waiters the flush covered, after starting the flush of the waiters queued meanwhile
+//
+//
+static void
+BdevFlushComplete(
     struct spdk_bdev_io *BdevIo,
     bool Success,
     void *CbArg
 ) {
-    SPDKContextT *SPDKContext = (SPDKContextT *)CbArg;
+    SPDKContextT *spdkContext = (SPDKContextT *)CbArg;
+    BdevFlushGroupT *group = &spdkContext->FlushGroup;
+    BdevFlushWaiterT *waiter = group->Flushing;
 
-    //
-    // Complete the I/O
-    //
-    //
     spdk_bdev_free_io(BdevIo);
 
     if (!Success) {
-        SPDK_ERRLOG("bdev io reset zone error: %d\n", EIO);
-        spdk_put_io_channel(SPDKContext->bdev_io_channel);
-        spdk_bdev_close(SPDKContext->bdev_desc);
-        spdk_app_stop(-1);
+        SPDK_ERRLOG("bdev flush error\n");
+    }
+
+    group->Flushing = NULL;
+    if (group->WaitingHead) {
+        StartBdevFlush(spdkContext);
+    }
+    else {
+        group->InFlight = false;
+    }
+
+    while (waiter) {
+        BdevFlushWaiterT *next = waiter->Next;
+        waiter->Callback(Success, waiter->Arg);
+        waiter = next;
+    }
+}
+
+//
+// Flush the whole bdev for the waiters queued so far; a flush the bdev has no room for
+// is retried with the waiters queued by then
+//
+//
+static void
+StartBdevFlush(
+    void *Arg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+    BdevFlushGroupT *group = &spdkContext->FlushGroup;
+
+    group->InFlight = true;
+
+    int rc = spdk_bdev_flush_blocks(
+        spdkContext->bdev_desc,
+        spdkContext->bdev_io_channel,
+        0,
+        spdk_bdev_get_num_blocks(spdkContext->bdev),
+        BdevFlushComplete,
+        spdkContext
+    );
+
+    if (rc == -ENOMEM) {
+        group->Wait.bdev = spdkContext->bdev;
+        group->Wait.cb_fn = StartBdevFlush;
+        group->Wait.cb_arg = spdkContext;
+        rc = spdk_bdev_queue_io_wait(spdkContext->bdev, spdkContext->bdev_io_channel, &group->Wait);
+        if (rc == 0) {
+            return;
+        }
+    }
+
+    BdevFlushWaiterT *waiter = group->WaitingHead;
+    group->WaitingHead = NULL;
+    group->WaitingTail = NULL;
+
+    if (rc == 0) {
+        group->Flushing = waiter;
         return;
     }
+
+    SPDK_ERRLOG("%s error while flushing bdev: %d\n", spdk_strerror(-rc), rc);
+    group->InFlight = false;
+    while (waiter) {
+        BdevFlushWaiterT *next = waiter->Next;
+        waiter->Callback(false, waiter->Arg);
+        waiter = next;
+    }
 }
 
+//
+// Flush the volatile cache of the bdev for a waiter, sharing the flush with the other waiters of the context
+//
+//
 void
-BdevResetZone(
-	void *Arg
+BdevFlushShared(
+    SPDKContextT *SPDKContext,
+    BdevFlushWaiterT *Waiter
 ) {
-    SPDKContextT *SPDKContext = (SPDKContextT *)Arg;
-    int rc = 0;
+    BdevFlushGroupT *group = &SPDKContext->FlushGroup;
 
-    rc = spdk_bdev_zone_management(
-        SPDKContext->bdev_desc,
-        SPDKContext->bdev_io_channel,
+    if (!spdk_bdev_io_type_supported(SPDKContext->bdev, SPDK_BDEV_IO_TYPE_FLUSH)) {
+        Waiter->Callback(true, Waiter->Arg);
+        return;
+    }
+
+    Waiter->Next = NULL;
+    if (group->WaitingTail) {
+        group->WaitingTail->Next = Waiter;
+    }
+    else {
+        group->WaitingHead = Waiter;
+    }
+    group->WaitingTail = Waiter;
+
+    if (!group->InFlight) {
+        StartBdevFlush(SPDKContext);
+    }
+}
+
+#ifdef OPT_FILE_SERVICE_TIERING
+//
+// Flush the volatile cache of the capacity bdev; returns -ENOTSUP without logging if it has none
+//
+//
+int
+BdevFlushTier(
+    void *Arg,
+    spdk_bdev_io_completion_cb Cb,
+    void *CbArg
+) {
+    SPDKContextT *spdkContext = (SPDKContextT *)Arg;
+
+    if (!spdk_bdev_io_type_supported(spdkContext->tier_bdev, SPDK_BDEV_IO_TYPE_FLUSH)) {
+        return -ENOTSUP;
+    }
+
+    int rc = spdk_bdev_flush_blocks(
+        spdkContext->tier_bdev_desc,
+        spdkContext->tier_bdev_io_channel,
         0,
-        SPDK_BDEV_ZONE_RESET,
-        ResetZoneComplete,
-        SPDKContext
+        spdk_bdev_get_num_blocks(spdkContext->tier_bdev),
+        Cb,
+        CbArg
     );
 
-    if (rc == -ENOMEM) {
-        //
-        // In case we cannot perform I/O now, queue I/O
-        //
-        //
-        SPDK_NOTICELOG("Queueing io\n");
-        SPDKContext->bdev_io_wait.bdev = SPDKContext->bdev;
-        SPDKContext->bdev_io_wait.cb_fn = BdevResetZone;
-        SPDKContext->bdev_io_wait.cb_arg = SPDKContext;
-        spdk_bdev_queue_io_wait(
-            SPDKContext->bdev,
-            SPDKContext->bdev_io_channel,
-            &SPDKContext->bdev_io_wait
-        );
-    } else if (rc) {
-        SPDK_ERRLOG("%s error while resetting zone: %d\n", spdk_strerror(-rc), rc);
-        spdk_put_io_channel(SPDKContext->bdev_io_channel);
-        spdk_bdev_close(SPDKContext->bdev_desc);
-        spdk_app_stop(-1);
+    if (rc && rc != -ENOMEM) {
+        SPDK_ERRLOG("%s error while flushing the capacity bdev: %d\n", spdk_strerror(-rc), rc);
     }
+    return rc;
 }
+#endif
 
 //
 // This seems to be called when Ctrl-C'd, and gets type 0
@@ -3,53 +3,70 @@
  * Licensed under the MIT License
  */
 
+#include <algorithm>
+#include <chrono>
 #include <string.h>
-
-#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_TIMER
 #include <thread>
-#endif
+#include <vector>
 
 #include "DDSBackEndBridge.h"
+#include "PayloadCompression.h"
+#include "Profiler.h"
 
 namespace DDS_FrontEnd {
 
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
-
-DDSBackEndBridge::DDSBackEndBridge() {
+DDSBackEndBridge::DDSBackEndBridge(
+    RingSizeT RequestRingBytes,
+    RingSizeT ResponseRingBytes,
+    RingProtocolT RingProtocol,
+    uint32_t PollQueueDepth
+) {
     //
-    // Record buffer capacity and back end address and port
+    // Record the ring sizes, protocol and poll queue depth to ask for and back end address and port
     //
     //
+    this->RequestRingBytes = RequestRingBytes;
+    this->ResponseRingBytes = ResponseRingBytes;
+    this->RingProtocol = RingProtocol;
+    this->PollQueueDepth = PollQueueDepth;
     strcpy(BackEndAddr, DDS_BACKEND_ADDR);
     BackEndPort = DDS_BACKEND_PORT;
     memset(&BackEndSock, 0, sizeof(BackEndSock));
 
     //
-    // Initialize NDSPI variables
+    // Initialize NDSPI or verbs variables
     //
     //
+#ifdef _WIN32
     Adapter = NULL;
     AdapterFileHandle = NULL;
     memset(&AdapterInfo, 0, sizeof(ND2_ADAPTER_INFO));
     memset(&Ov, 0, sizeof(Ov));
+#endif
     QueueDepth = 0;
     MaxSge = 0;
     InlineThreshold = 0;
     memset(&LocalSock, 0, sizeof(LocalSock));
 
+#ifdef _WIN32
     CtrlConnector = NULL;
     CtrlCompQ = NULL;
     CtrlQPair = NULL;
+#else
+    CtrlCmChannel = NULL;
+    CtrlCmId = NULL;
+    CtrlPDomain = NULL;
+    CtrlCompQ = NULL;
+#endif
     CtrlMemRegion = NULL;
     CtrlSgl = NULL;
-    memset(CtrlMsgBuf, 0, CTRL_MSG_SIZE);
+    memset(CtrlMsgBuf, 0, sizeof(CtrlMsgBuf));
+    CtrlBatchOps = NULL;
+    CtrlBatchNumOps = 0;
+    CtrlBatchCompletions = 0;
+    CtrlBatchResult = DDS_ERROR_CODE_SUCCESS;
 
     ClientId = -1;
-
-#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
-    ProcessedBytes = 0;
-    NextResponse = NULL;
-#endif
 }
 
 //
@@ -58,6 +75,35 @@ DDSBackEndBridge::DDSBackEndBridge() {
 //
 ErrorCodeT
 DDSBackEndBridge::Connect() {
+    if (!DDS_RING_BYTES_VALID(RequestRingBytes, DDS_REQUEST_RING_BYTES, DDS_REQUEST_RING_BYTES_ALIGNMENT) ||
+        !DDS_RING_BYTES_VALID(ResponseRingBytes, DDS_RESPONSE_RING_BYTES, DDS_RESPONSE_RING_BYTES_ALIGNMENT)) {
+        printf("DDSBackEndBridge: invalid ring sizes (%u, %u)\n", RequestRingBytes, ResponseRingBytes);
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    if (!DDS_RING_PROTOCOL_IMPLEMENTED(RingProtocol)) {
+        printf("DDSBackEndBridge: ring protocol %u is not implemented\n", RingProtocol);
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (!DDS_POLL_QUEUE_DEPTH_VALID(PollQueueDepth)) {
+        printf("DDSBackEndBridge: invalid poll queue depth (%u)\n", PollQueueDepth);
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+#ifdef DMA_BUFFER_LOOPBACK
+    //
+    // The loopback back end takes the ring sizes and the queue depth as they are and serves the progressive protocol
+    //
+    //
+    ClientId = 0;
+    RingProtocol = DDS_RING_PROTOCOL_PROGRESSIVE;
+    printf("DDSBackEndBridge: connected to the loopback back end\n");
+
+    return DDS_ERROR_CODE_SUCCESS;
+#endif
+
+#ifdef _WIN32
     //
     // Set up RDMA with NDSPI
     //
@@ -225,15 +271,17 @@ DDSBackEndBridge::Connect() {
 #endif
 
     unsigned long flags = ND_MR_FLAG_ALLOW_LOCAL_WRITE | ND_MR_FLAG_ALLOW_REMOTE_READ | ND_MR_FLAG_ALLOW_REMOTE_WRITE;
-    RDMC_RegisterDataBuffer(CtrlMemRegion, CtrlMsgBuf, CTRL_MSG_SIZE, flags, &Ov);
+    RDMC_RegisterDataBuffer(CtrlMemRegion, CtrlMsgBuf, sizeof(CtrlMsgBuf), flags, &Ov);
 #ifdef BACKEND_BRIDGE_VERBOSE
     printf("RDMC_RegisterDataBuffer succeeded\n");
 #endif
 
-    CtrlSgl = new ND2_SGE[1];
-    CtrlSgl[0].Buffer = CtrlMsgBuf;
-    CtrlSgl[0].BufferLength = CTRL_MSG_SIZE;
-    CtrlSgl[0].MemoryRegionToken = CtrlMemRegion->GetLocalToken();
+    CtrlSgl = new ND2_SGE[2];
+    for (int b = 0; b != 2; b++) {
+        CtrlSgl[b].Buffer = CtrlMsgBuf + b * CTRL_MSG_SIZE;
+        CtrlSgl[b].BufferLength = CTRL_MSG_SIZE;
+        CtrlSgl[b].MemoryRegionToken = CtrlMemRegion->GetLocalToken();
+    }
 
     uint8_t privData = CTRL_CONN_PRIV_DATA;
     RDMC_Connect(CtrlConnector, CtrlQPair, &Ov, LocalSock, BackEndSock, 0, (DWORD)QueueDepth, &privData, sizeof(privData));
@@ -245,13 +293,63 @@ DDSBackEndBridge::Connect() {
 #ifdef BACKEND_BRIDGE_VERBOSE
     printf("RDMC_CompleteConnect succeeded\n");
 #endif
+#else
+    //
+    // Set up RDMA with libibverbs and rdma-cm;
+    // the host only posts messages, as the DMA of the back end is one-sided,
+    // so the queue pairs are no deeper than the I/Os a poll can have outstanding
+    //
+    //
+    BackEndSock.sin_family = AF_INET;
+    if (inet_pton(AF_INET, BackEndAddr, &BackEndSock.sin_addr) != 1 || BackEndSock.sin_addr.s_addr == 0) {
+        printf("DDSBackEndBridge: bad address for the backend\n");
+        return DDS_ERROR_CODE_FAILED_CONNECTION;
+    }
+    BackEndSock.sin_port = htons(BackEndPort);
+
+    QueueDepth = DDS_MAX_OUTSTANDING_IO;
+    MaxSge = 1;
+    InlineThreshold = RDMC_VERBS_INLINE_THRESHOLD;
+
+    uint8_t privData = CTRL_CONN_PRIV_DATA;
+    if (!RDMCVerbs_Connect(&BackEndSock, &QueueDepth, &MaxSge, InlineThreshold, &privData, sizeof(privData),
+        &CtrlCmChannel, &CtrlCmId, &CtrlPDomain, &CtrlCompQ)) {
+        printf("DDSBackEndBridge: failed to connect to the back end\n");
+        return DDS_ERROR_CODE_FAILED_CONNECTION;
+    }
+    memcpy(&LocalSock, rdma_get_local_addr(CtrlCmId), sizeof(LocalSock));
+
+    printf("DDSBackEndBridge: adapter information\n");
+    printf("- Queue depth = %zu\n", QueueDepth);
+    printf("- Max SGE = %zu\n", MaxSge);
+    printf("- Inline threshold = %zu\n", InlineThreshold);
+
+    CtrlMemRegion = ibv_reg_mr(CtrlPDomain, CtrlMsgBuf, sizeof(CtrlMsgBuf), IBV_ACCESS_LOCAL_WRITE);
+    if (!CtrlMemRegion) {
+        printf("DDSBackEndBridge: failed to register the control buffer\n");
+        return DDS_ERROR_CODE_FAILED_CONNECTION;
+    }
+
+    CtrlSgl = new RDMCVerbsSgeT[2];
+    for (int b = 0; b != 2; b++) {
+        CtrlSgl[b].Buffer = CtrlMsgBuf + b * CTRL_MSG_SIZE;
+        CtrlSgl[b].BufferLength = CTRL_MSG_SIZE;
+        CtrlSgl[b].MemoryRegionToken = CtrlMemRegion->lkey;
+    }
+#endif
 
     //
-    // Request client id and wait for response
+    // Request client id, the ring sizes, the ring protocol and the poll queue depth, and wait for response
     //
     //
+    CtrlMsgF2BRequestId* req = (CtrlMsgF2BRequestId*)(CtrlMsgBuf + sizeof(MsgHeader));
     ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQUEST_ID;
-    ((CtrlMsgF2BRequestId*)(CtrlMsgBuf + sizeof(MsgHeader)))->Dummy = 42;
+    req->Dummy = 42;
+    req->RequestRingBytes = RequestRingBytes;
+    req->ResponseRingBytes = ResponseRingBytes;
+    req->RingProtocol = RingProtocol;
+    req->PollQueueDepth = PollQueueDepth;
+#ifdef _WIN32
     CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BRequestId);
     RDMC_Send(CtrlQPair, CtrlSgl, 1, 0, MSG_CTXT);
 #ifdef BACKEND_BRIDGE_VERBOSE
@@ -273,10 +371,60 @@ DDSBackEndBridge::Connect() {
 #ifdef BACKEND_BRIDGE_VERBOSE
     printf("RDMC_WaitForCompletionAndCheckContext succeeded\n");
 #endif
+#else
+    //
+    // The receive of the response is posted before the request, since verbs has no retry window for it
+    //
+    //
+    RDMCVerbs_PostReceive(CtrlCmId, CtrlSgl, MSG_CTXT);
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BRequestId);
+    RDMCVerbs_Send(CtrlCmId, CtrlSgl, MSG_CTXT);
+    RDMCVerbs_WaitForCompletionAndCheckContext(CtrlCompQ, MSG_CTXT, INFINITE);
+    RDMCVerbs_WaitForCompletionAndCheckContext(CtrlCompQ, MSG_CTXT, INFINITE);
+#endif
 
     if (((MsgHeader*)CtrlMsgBuf)->MsgId == CTRL_MSG_B2F_RESPOND_ID) {
-        ClientId = ((CtrlMsgB2FRespondId*)(CtrlMsgBuf + sizeof(MsgHeader)))->ClientId;
+        CtrlMsgB2FRespondId* resp = (CtrlMsgB2FRespondId*)(CtrlMsgBuf + sizeof(MsgHeader));
+        ClientId = resp->ClientId;
         printf("DDSBackEndBridge: connected to the back end with assigned id (%d)\n", ClientId);
+
+        //
+        // The back end may lower the ring sizes, never raise them
+        //
+        //
+        if (resp->RequestRingBytes > RequestRingBytes || resp->ResponseRingBytes > ResponseRingBytes ||
+            !DDS_RING_BYTES_VALID(resp->RequestRingBytes, DDS_REQUEST_RING_BYTES, DDS_REQUEST_RING_BYTES_ALIGNMENT) ||
+            !DDS_RING_BYTES_VALID(resp->ResponseRingBytes, DDS_RESPONSE_RING_BYTES, DDS_RESPONSE_RING_BYTES_ALIGNMENT)) {
+            printf("DDSBackEndBridge: unexpected ring sizes from the back end (%u, %u)\n", resp->RequestRingBytes, resp->ResponseRingBytes);
+            return DDS_ERROR_CODE_UNEXPECTED_MSG;
+        }
+        RequestRingBytes = resp->RequestRingBytes;
+        ResponseRingBytes = resp->ResponseRingBytes;
+        printf("DDSBackEndBridge: request ring = %u bytes, response ring = %u bytes\n", RequestRingBytes, ResponseRingBytes);
+
+        //
+        // The back end may fall back to another protocol, which must be one the host implements
+        //
+        //
+        if (!DDS_RING_PROTOCOL_IMPLEMENTED(resp->RingProtocol)) {
+            printf("DDSBackEndBridge: unexpected ring protocol from the back end (%u)\n", resp->RingProtocol);
+            return DDS_ERROR_CODE_UNEXPECTED_MSG;
+        }
+        if (resp->RingProtocol != RingProtocol) {
+            printf("DDSBackEndBridge: the back end uses ring protocol %u instead of %u\n", resp->RingProtocol, RingProtocol);
+        }
+        RingProtocol = resp->RingProtocol;
+
+        //
+        // The back end may lower the queue depth of the polls, never raise it
+        //
+        //
+        if (resp->PollQueueDepth > PollQueueDepth || !DDS_POLL_QUEUE_DEPTH_VALID(resp->PollQueueDepth)) {
+            printf("DDSBackEndBridge: unexpected poll queue depth from the back end (%u)\n", resp->PollQueueDepth);
+            return DDS_ERROR_CODE_UNEXPECTED_MSG;
+        }
+        PollQueueDepth = resp->PollQueueDepth;
+        printf("DDSBackEndBridge: poll queue depth = %u\n", PollQueueDepth);
     }
     else {
         printf("DDSBackEndBridge: wrong message from the back end\n");
@@ -292,6 +440,11 @@ DDSBackEndBridge::Connect() {
 //
 ErrorCodeT
 DDSBackEndBridge::Disconnect() {
+#ifdef DMA_BUFFER_LOOPBACK
+    ClientId = -1;
+    return DDS_ERROR_CODE_SUCCESS;
+#endif
+
     //
     // Send the exit message to the back end
     //
@@ -300,43 +453,57 @@ DDSBackEndBridge::Disconnect() {
         ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_TERMINATE;
         ((CtrlMsgF2BTerminate*)(CtrlMsgBuf + sizeof(MsgHeader)))->ClientId = ClientId;
         CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BTerminate);
+#ifdef _WIN32
         RDMC_Send(CtrlQPair, CtrlSgl, 1, 0, MSG_CTXT);
         RDMC_WaitForCompletionAndCheckContext(CtrlCompQ, &Ov, MSG_CTXT, false);
+#else
+        RDMCVerbs_Send(CtrlCmId, CtrlSgl, MSG_CTXT);
+        RDMCVerbs_WaitForCompletionAndCheckContext(CtrlCompQ, MSG_CTXT, INFINITE);
+#endif
         printf("DDSBackEndBridge: disconnected from the back end\n");
+        ClientId = -1;
     }
 
     //
     // Disconnect and release all resources
     //
     //
+#ifdef _WIN32
     if (CtrlConnector) {
         CtrlConnector->Disconnect(&Ov);
         CtrlConnector->Release();
+        CtrlConnector = NULL;
     }
 
     if (CtrlMemRegion) {
         CtrlMemRegion->Deregister(&Ov);
         CtrlMemRegion->Release();
+        CtrlMemRegion = NULL;
     }
 
     if (CtrlCompQ) {
         CtrlCompQ->Release();
+        CtrlCompQ = NULL;
     }
 
     if (CtrlQPair) {
         CtrlQPair->Release();
+        CtrlQPair = NULL;
     }
 
     if (AdapterFileHandle) {
         CloseHandle(AdapterFileHandle);
+        AdapterFileHandle = NULL;
     }
 
     if (Adapter) {
         Adapter->Release();
+        Adapter = NULL;
     }
 
     if (Ov.hEvent) {
         CloseHandle(Ov.hEvent);
+        Ov.hEvent = NULL;
     }
 
     //
@@ -345,6 +512,7 @@ DDSBackEndBridge::Disconnect() {
     //
     if (CtrlSgl) {
         delete[] CtrlSgl;
+        CtrlSgl = NULL;
     }
 
     //
@@ -359,10 +527,179 @@ DDSBackEndBridge::Disconnect() {
 
     _fcloseall();
     WSACleanup();
+#else
+    RDMCVerbs_Disconnect(CtrlCmChannel, CtrlCmId);
+    CtrlCmChannel = NULL;
+    CtrlCmId = NULL;
+
+    if (CtrlMemRegion) {
+        ibv_dereg_mr(CtrlMemRegion);
+        CtrlMemRegion = NULL;
+    }
+
+    if (CtrlCompQ) {
+        ibv_destroy_cq(CtrlCompQ);
+        CtrlCompQ = NULL;
+    }
+
+    if (CtrlPDomain) {
+        ibv_dealloc_pd(CtrlPDomain);
+        CtrlPDomain = NULL;
+    }
+
+    if (CtrlSgl) {
+        delete[] CtrlSgl;
+        CtrlSgl = NULL;
+    }
+#endif
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Connect to the back end that took over from the one this bridge was connected to (DDS_RING_HANDOVER_OFFSET),
+// which comes up once the old one has let all hosts go, or to the one started in place of a lost back end,
+// which is not told that this host leaves; the rings of the polls are in use already,
+// so the new back end must take them as they are
+//
+//
+ErrorCodeT
+DDSBackEndBridge::Reconnect(
+    bool BackEndLost
+) {
+    const RingSizeT requestRingBytes = RequestRingBytes;
+    const RingSizeT responseRingBytes = ResponseRingBytes;
+    const RingProtocolT ringProtocol = RingProtocol;
+    const uint32_t pollQueueDepth = PollQueueDepth;
+    ErrorCodeT result = DDS_ERROR_CODE_FAILED_CONNECTION;
+    int interval = DDS_BACKEND_RECONNECT_INTERVAL_MS;
+
+    if (BackEndLost) {
+        ClientId = -1;
+    }
+    Disconnect();
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(DDS_BACKEND_RECONNECT_TIMEOUT_MS);
+    while (std::chrono::steady_clock::now() < end) {
+        result = Connect();
+        if (result == DDS_ERROR_CODE_SUCCESS) {
+            break;
+        }
+
+        //
+        // Release what the failed attempt set up and try again with the rings as they are
+        //
+        //
+        Disconnect();
+        RequestRingBytes = requestRingBytes;
+        ResponseRingBytes = responseRingBytes;
+        RingProtocol = ringProtocol;
+        PollQueueDepth = pollQueueDepth;
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+        interval = interval * 2 > DDS_BACKEND_RECONNECT_MAX_INTERVAL_MS ? DDS_BACKEND_RECONNECT_MAX_INTERVAL_MS : interval * 2;
+    }
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        printf("DDSBackEndBridge: no back end took over within %d ms\n", DDS_BACKEND_RECONNECT_TIMEOUT_MS);
+        return result;
+    }
+
+    if (RequestRingBytes != requestRingBytes || ResponseRingBytes != responseRingBytes ||
+        RingProtocol != ringProtocol || PollQueueDepth != pollQueueDepth) {
+        printf("DDSBackEndBridge: the back end that took over cannot take the rings as they are\n");
+        Disconnect();
+        RequestRingBytes = requestRingBytes;
+        ResponseRingBytes = responseRingBytes;
+        RingProtocol = ringProtocol;
+        PollQueueDepth = pollQueueDepth;
+        return DDS_ERROR_CODE_UNEXPECTED_MSG;
+    }
+
+    printf("DDSBackEndBridge: reconnected to the back end that took over\n");
 
     return DDS_ERROR_CODE_SUCCESS;
 }
 
+//
+// Check for one completion of the control queue pair, or wait for it
+//
+//
+static inline bool
+PollCtrlCompletion(
+    DDSBackEndBridge* BackEnd,
+    bool Wait
+) {
+#ifdef _WIN32
+    if (Wait) {
+        RDMC_WaitForCompletionAndCheckContext(BackEnd->CtrlCompQ, &BackEnd->Ov, MSG_CTXT, true);
+        return true;
+    }
+
+    ND2_RESULT ndRes;
+    if (BackEnd->CtrlCompQ->GetResults(&ndRes, 1) != 1) {
+        return false;
+    }
+
+    if (ndRes.Status != ND_SUCCESS || ndRes.RequestContext != MSG_CTXT) {
+        printf("DDSBackEndBridge: unexpected control completion (status %08x)\n", ndRes.Status);
+        exit(EXIT_FAILURE);
+    }
+
+    return true;
+#else
+    return RDMCVerbs_WaitForCompletionAndCheckContext(BackEnd->CtrlCompQ, MSG_CTXT, Wait ? INFINITE : 0);
+#endif
+}
+
+//
+// Take the completions of the outstanding control batch, waiting for them if asked,
+// and apply its ack to its operations once; return true once the ack has been applied
+//
+//
+static inline bool
+CompleteControlBatch(
+    DDSBackEndBridge* BackEnd,
+    bool Wait
+) {
+    while (BackEnd->CtrlBatchCompletions) {
+        if (!PollCtrlCompletion(BackEnd, Wait)) {
+            return false;
+        }
+        BackEnd->CtrlBatchCompletions--;
+    }
+
+    if (BackEnd->CtrlBatchResult != DDS_ERROR_CODE_IO_PENDING) {
+        return true;
+    }
+
+    char* batchBuf = BackEnd->CtrlMsgBuf + CTRL_MSG_SIZE;
+    CtrlMsgB2FAckBatch* resp = (CtrlMsgB2FAckBatch*)(batchBuf + sizeof(MsgHeader));
+    size_t numCompleted = 0;
+
+    if (((MsgHeader*)batchBuf)->MsgId != CTRL_MSG_B2F_ACK_BATCH) {
+        BackEnd->CtrlBatchResult = DDS_ERROR_CODE_UNEXPECTED_MSG;
+    }
+    else {
+        BackEnd->CtrlBatchResult = resp->Result;
+        numCompleted = std::min((size_t)resp->NumCompleted, BackEnd->CtrlBatchNumOps);
+    }
+
+    for (size_t o = 0; o != BackEnd->CtrlBatchNumOps; o++) {
+        ControlOpT* op = &BackEnd->CtrlBatchOps[o];
+        if (o >= numCompleted) {
+            op->Result = DDS_ERROR_CODE_NO_COMPLETION;
+            continue;
+        }
+
+        op->Result = resp->Acks[o].Ack.Result;
+        if (op->Type == CONTROL_OP_GET_FILE_SIZE && op->Result == DDS_ERROR_CODE_SUCCESS) {
+            op->FileSize = resp->Acks[o].Ack.GetFileSize.FileSize;
+        }
+    }
+
+    return true;
+}
+
 //
 // Send a control message and wait (w/ blocking) for response
 //
@@ -373,13 +710,53 @@ SendCtrlMsgAndWait(
     RequestIdT ExpectedMsgId
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    std::lock_guard<std::mutex> lock(BackEnd->CtrlLock);
+
+    //
+    // The back end takes one control message at a time, so the outstanding batch goes first
+    //
+    //
+    if (BackEnd->CtrlBatchOps) {
+        CompleteControlBatch(BackEnd, true);
+    }
+
+#ifdef DMA_BUFFER_LOOPBACK
+    //
+    // The loopback back end keeps no files and acknowledges every control message;
+    // every ack starts with its result
+    //
+    //
+    uint32_t numUpdates = ((CtrlMsgF2BReqUpdateCache*)(BackEnd->CtrlMsgBuf + sizeof(MsgHeader)))->NumUpdates;
+    memset(BackEnd->CtrlMsgBuf, 0, CTRL_MSG_SIZE);
+    ((MsgHeader*)BackEnd->CtrlMsgBuf)->MsgId = ExpectedMsgId;
+    *(ErrorCodeT*)(BackEnd->CtrlMsgBuf + sizeof(MsgHeader)) = DDS_ERROR_CODE_SUCCESS;
+    if (ExpectedMsgId == CTRL_MSG_B2F_ACK_UPDATE_CACHE) {
+        ((CtrlMsgB2FAckUpdateCache*)(BackEnd->CtrlMsgBuf + sizeof(MsgHeader)))->NumApplied = numUpdates;
+    }
+
+    return result;
+#endif
 
+#ifdef _WIN32
     RDMC_Send(BackEnd->CtrlQPair, BackEnd->CtrlSgl, 1, 0, MSG_CTXT);
     RDMC_WaitForCompletionAndCheckContext(BackEnd->CtrlCompQ, &BackEnd->Ov, MSG_CTXT, true);
 
     BackEnd->CtrlSgl->BufferLength = CTRL_MSG_SIZE;
     RDMC_PostReceive(BackEnd->CtrlQPair, BackEnd->CtrlSgl, 1, MSG_CTXT);
     RDMC_WaitForCompletionAndCheckContext(BackEnd->CtrlCompQ, &BackEnd->Ov, MSG_CTXT, true);
+#else
+    //
+    // The receive of the ack is posted with the whole buffer before the request goes out
+    //
+    //
+    RDMCVerbsSgeT recvSge = *BackEnd->CtrlSgl;
+    recvSge.BufferLength = CTRL_MSG_SIZE;
+    RDMCVerbs_PostReceive(BackEnd->CtrlCmId, &recvSge, MSG_CTXT);
+    RDMCVerbs_Send(BackEnd->CtrlCmId, BackEnd->CtrlSgl, MSG_CTXT);
+    RDMCVerbs_WaitForCompletionAndCheckContext(BackEnd->CtrlCompQ, MSG_CTXT, INFINITE);
+    RDMCVerbs_WaitForCompletionAndCheckContext(BackEnd->CtrlCompQ, MSG_CTXT, INFINITE);
+    BackEnd->CtrlSgl->BufferLength = CTRL_MSG_SIZE;
+#endif
 
     if (((MsgHeader*)BackEnd->CtrlMsgBuf)->MsgId != ExpectedMsgId) {
         result = DDS_ERROR_CODE_UNEXPECTED_MSG;
@@ -585,97 +962,921 @@ DDSBackEndBridge::GetFileSize(
 }
 
 //
-// Async read from a file
+// Flush the device under a file
 // 
 //
 ErrorCodeT
-DDSBackEndBridge::ReadFile(
-    FileIdT FileId,
-    FileSizeT Offset,
-    BufferT DestBuffer,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ContextT Context,
-    PollT* Poll
+DDSBackEndBridge::FlushFile(
+    FileIdT FileId
 ) {
-    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    bool bufferResult = InsertReadRequest(
-        Poll->RequestRing,
-        requestId,
-        FileId,
-        Offset,
-        BytesToRead
-    );
+    //
+    // Send a flush file request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_FLUSH_FILE;
 
-    if (!bufferResult) {
-        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    CtrlMsgF2BReqFlushFile* req = (CtrlMsgF2BReqFlushFile*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+    
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqFlushFile);
+    
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_FLUSH_FILE);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
     }
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    CtrlMsgB2FAckFlushFile* resp = (CtrlMsgB2FAckFlushFile*)(CtrlMsgBuf + sizeof(MsgHeader));
+    return resp->Result;
 }
 
 //
-// Async read from a file with scattering
+// Limit the I/O of a file, or lift the limit if BytesPerSecond is 0
 // 
 //
 ErrorCodeT
-DDSBackEndBridge::ReadFileScatter(
+DDSBackEndBridge::SetFileQoS(
     FileIdT FileId,
-    FileSizeT Offset,
-    BufferT* DestBufferArray,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ContextT Context,
-    PollT* Poll
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight
 ) {
-    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    bool bufferResult = InsertReadRequest(
-        Poll->RequestRing,
-        requestId,
-        FileId,
-        Offset,
-        BytesToRead
-    );
+    //
+    // Send a set file QoS request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_SET_FILE_QOS;
 
-    if (!bufferResult) {
-        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    CtrlMsgF2BReqSetFileQoS* req = (CtrlMsgF2BReqSetFileQoS*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+    req->Weight = Weight;
+    req->BytesPerSecond = BytesPerSecond;
+    req->BurstBytes = BurstBytes;
+    
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqSetFileQoS);
+    
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_SET_FILE_QOS);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
     }
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    CtrlMsgB2FAckSetFileQoS* resp = (CtrlMsgB2FAckSetFileQoS*)(CtrlMsgBuf + sizeof(MsgHeader));
+    return resp->Result;
 }
 
 //
-// Async write to a file
+// Share the segments of a file with a new read-only file, the snapshot of the file
 // 
 //
 ErrorCodeT
-DDSBackEndBridge::WriteFile(
+DDSBackEndBridge::CreateSnapshot(
     FileIdT FileId,
-    FileSizeT Offset,
-    BufferT SourceBuffer,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
-    ContextT Context,
-    PollT* Poll
+    FileIdT SnapshotFileId,
+    DirIdT DirId,
+    const char* SnapshotName
 ) {
-    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    bool bufferResult = InsertWriteFileRequest(
-        Poll->RequestRing,
-        requestId,
-        FileId,
-        Offset,
-        BytesToWrite,
-        SourceBuffer
-    );
+    //
+    // Send a create snapshot request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_CREATE_SNAPSHOT;
 
-    if (!bufferResult) {
-        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    CtrlMsgF2BReqCreateSnapshot* req = (CtrlMsgF2BReqCreateSnapshot*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+    req->SnapshotFileId = SnapshotFileId;
+    req->DirId = DirId;
+    strcpy(req->SnapshotName, SnapshotName);
+    
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqCreateSnapshot);
+    
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_CREATE_SNAPSHOT);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
     }
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    CtrlMsgB2FAckCreateSnapshot* resp = (CtrlMsgB2FAckCreateSnapshot*)(CtrlMsgBuf + sizeof(MsgHeader));
+    return resp->Result;
+}
+
+//
+// Tell the back end how a file will be read
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::SetFileAccessHint(
+    FileIdT FileId,
+    FileAccessHint Hint,
+    FileSizeT Offset,
+    FileSizeT Bytes
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    //
+    // Send a set file access hint request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_SET_FILE_ACCESS_HINT;
+
+    CtrlMsgF2BReqSetFileAccessHint* req = (CtrlMsgF2BReqSetFileAccessHint*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+    req->Hint = (int32_t)Hint;
+    req->Offset = Offset;
+    req->Bytes = Bytes;
+    
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqSetFileAccessHint);
+    
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_SET_FILE_ACCESS_HINT);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    CtrlMsgB2FAckSetFileAccessHint* resp = (CtrlMsgB2FAckSetFileAccessHint*)(CtrlMsgBuf + sizeof(MsgHeader));
+    return resp->Result;
+}
+
+//
+// Take or renew the lease of a file on the back end
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::AcquireFileLease(
+    FileIdT FileId,
+    FileLeaseMode Mode,
+    uint32_t* TermMs
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    //
+    // Send an acquire lease request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_ACQUIRE_LEASE;
+
+    CtrlMsgF2BReqAcquireLease* req = (CtrlMsgF2BReqAcquireLease*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+    req->Mode = (int32_t)Mode;
+
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqAcquireLease);
+
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_ACQUIRE_LEASE);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    CtrlMsgB2FAckAcquireLease* resp = (CtrlMsgB2FAckAcquireLease*)(CtrlMsgBuf + sizeof(MsgHeader));
+    *TermMs = resp->TermMs;
+    return resp->Result;
+}
+
+//
+// Give back the lease of a file
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::ReleaseFileLease(
+    FileIdT FileId
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    //
+    // Send a release lease request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_RELEASE_LEASE;
+
+    CtrlMsgF2BReqReleaseLease* req = (CtrlMsgF2BReqReleaseLease*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqReleaseLease);
+
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_RELEASE_LEASE);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    CtrlMsgB2FAckReleaseLease* resp = (CtrlMsgB2FAckReleaseLease*)(CtrlMsgBuf + sizeof(MsgHeader));
+    return resp->Result;
+}
+
+//
+// Renew the leases of the front end on the back end
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::RenewFileLeases(
+    FileIdT* Revoked,
+    uint32_t MaxRevoked,
+    uint32_t* NumRevoked,
+    uint32_t* TermMs
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    //
+    // Send a renew leases request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_RENEW_LEASES;
+
+    CtrlMsgF2BReqRenewLeases* req = (CtrlMsgF2BReqRenewLeases*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->Reserved = 0;
+
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqRenewLeases);
+
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_RENEW_LEASES);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    CtrlMsgB2FAckRenewLeases* resp = (CtrlMsgB2FAckRenewLeases*)(CtrlMsgBuf + sizeof(MsgHeader));
+    uint32_t numRevoked = resp->NumRevoked < MaxRevoked ? resp->NumRevoked : MaxRevoked;
+    memcpy(Revoked, resp->Revoked, numRevoked * sizeof(FileIdT));
+    *NumRevoked = numRevoked;
+    *TermMs = resp->TermMs;
+    return resp->Result;
+}
+
+//
+// Compile and load a scan function on the back end, which names it by ScanId in later scans
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::LoadScanFunction(
+    const char* CodePath,
+    uint16_t* ScanId
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    if (strlen(CodePath) >= CTRL_MSG_LOAD_SCAN_PATH_BYTES) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    //
+    // Send a load scan request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_LOAD_SCAN;
+
+    CtrlMsgF2BReqLoadScan* req = (CtrlMsgF2BReqLoadScan*)(CtrlMsgBuf + sizeof(MsgHeader));
+    strcpy(req->CodePath, CodePath);
+
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqLoadScan);
+
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_LOAD_SCAN);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    CtrlMsgB2FAckLoadScan* resp = (CtrlMsgB2FAckLoadScan*)(CtrlMsgBuf + sizeof(MsgHeader));
+    if (resp->Result == DDS_ERROR_CODE_SUCCESS) {
+        *ScanId = resp->ScanId;
+    }
+    return resp->Result;
+}
+
+//
+// A thread publishing requests on a poll for as long as it is in scope; recovery from a lost back end
+// (DDSFrontEnd::RecoverLostStripes) marks the poll first and then waits for the publishers to leave,
+// so that a publisher either sees the mark and publishes nothing, or is done before the rings are taken
+//
+//
+class RequestPublisherT {
+public:
+    RequestPublisherT(
+        PollT* Poll
+    ) : Poll(Poll) {
+        Poll->Publishers.fetch_add(1);
+    }
+
+    ~RequestPublisherT() {
+        Poll->Publishers.fetch_sub(1);
+    }
+
+    bool
+    BackEndLost() const {
+        return Poll->BackEndLost.load();
+    }
+
+private:
+    PollT* Poll;
+};
+
+//
+// Queue a read or write that found no credits left in the request ring,
+// or fail it if the poll policy does not queue requests;
+// the data of a write is copied, as the caller may reuse its buffer once the write returns
+//
+//
+static inline ErrorCodeT
+BacklogRequest(
+    PollT* Poll,
+    bool IsRead,
+    RequestIdT RequestId,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    BufferT SourceBuffer
+) {
+    //
+    // A write that would not fit even into an empty ring can never be inserted
+    //
+    //
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+    if (!Poll->Policy.BacklogRequests || (RingSizeT)Bytes + 2 * alignment >= (RingSizeT)Poll->RequestRing->Capacity) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+
+    BacklogEntryT entry;
+    entry.Request.IsRead = IsRead;
+    entry.Request.RequestId = RequestId;
+    entry.Request.FileId = FileId;
+    entry.Request.Offset = Offset;
+    entry.Request.Bytes = Bytes;
+    entry.Request.SourceBuffer = SourceBuffer;
+    if (!IsRead && Bytes) {
+        entry.Data.reset(new (std::nothrow) char[Bytes]);
+        if (!entry.Data) {
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+        memcpy(entry.Data.get(), SourceBuffer, Bytes);
+        entry.Request.SourceBuffer = entry.Data.get();
+    }
+
+    std::lock_guard<std::mutex> lock(Poll->BacklogLock);
+    Poll->Backlog.push_back(std::move(entry));
+    Poll->BacklogSize.fetch_add(1, std::memory_order_relaxed);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Ring the doorbell of the back end after publishing requests on a poll if it parked the request ring;
+// the mark is read after the progress is published, and only the thread that clears it rings
+//
+//
+static inline void
+RingRequestDoorbell(
+    PollT* Poll
+) {
+#ifdef RING_BUFFER_REQUEST_DOORBELL
+    if (Poll->RequestRing->Parked.load() && Poll->RequestRing->Parked.exchange(0)) {
+        Poll->MsgBuffer->RingRequestDoorbell();
+    }
+#endif
+}
+
+//
+// Publish what is staged on a poll at once while a thread is getting responses from it:
+// that thread may be waiting for the staged requests, and no other thread may come to publish them;
+// if the ring is full, they are published by the next request or flush
+//
+//
+static inline void
+PublishStagedForWaiters(
+    PollT* Poll
+) {
+    if (Poll->ResponseWaiters.load()) {
+        FlushStagedRequests(Poll->RequestRing, &Poll->RequestStaging);
+    }
+}
+
+//
+// Insert queued requests in order for as long as the back end has credits for them;
+// return true if none is left queued, and in Result, if given, whether the ring failed to take one it had credits for
+//
+//
+static inline bool
+InsertBacklog(
+    PollT* Poll,
+    ErrorCodeT* Result = nullptr
+) {
+    if (Poll->BackEndLost.load()) {
+        return false;
+    }
+
+    if (!Poll->BacklogSize.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    FileIOSizeT alignment = sizeof(FileIOSizeT) + sizeof(BuffMsgF2BReqHeader);
+    std::lock_guard<std::mutex> lock(Poll->BacklogLock);
+
+    while (!Poll->Backlog.empty()) {
+        const RequestBatchEntryT* request = &Poll->Backlog.front().Request;
+        RingSizeT requestBytes = alignment;
+        if (!request->IsRead) {
+            requestBytes += request->Bytes;
+            if (requestBytes % alignment != 0) {
+                requestBytes += (alignment - (requestBytes % alignment));
+            }
+        }
+
+        FileIOT* io = request->RequestId == BUFF_MSG_REQUEST_FENCE ? nullptr : Poll->OutstandingRequests[request->RequestId & (Poll->QueueDepth - 1)];
+        if (io) {
+            io->AtBackEnd = Poll;
+        }
+
+        if (GetRequestCredits(Poll->RequestRing) < requestBytes) {
+            if (io) {
+                io->AtBackEnd = nullptr;
+            }
+            break;
+        }
+        if (!InsertRequestBatch(Poll->RequestRing, request, 1)) {
+            if (io) {
+                io->AtBackEnd = nullptr;
+            }
+            if (Result) {
+                *Result = DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+            }
+            break;
+        }
+
+        Poll->Backlog.pop_front();
+        Poll->BacklogSize.fetch_sub(1, std::memory_order_relaxed);
+        RingRequestDoorbell(Poll);
+    }
+
+    return Poll->Backlog.empty();
+}
+
+//
+// Mark the request of a traced I/O with the flag and a tag of its trace, which the back end records
+// its hops under, and record that the I/O goes to the back end
+//
+//
+static inline RequestIdT
+TraceRequest(
+    FileIOT* IO,
+    RequestIdT RequestId,
+    PollT* Poll
+) {
+    if (!IO->TraceId) {
+        return RequestId;
+    }
+
+    RequestIdT traced = BUFF_MSG_REQUEST_FLAG_TRACED |
+        (RequestIdT)((IO->TraceId << BUFF_MSG_REQUEST_TRACE_TAG_SHIFT) & BUFF_MSG_REQUEST_TRACE_TAG_MASK_OF(Poll->QueueDepth));
+    IO->TraceKey = IO->RequestId | traced;
+    RecordIOTrace(IO->TraceId, DDS_TRACE_HOP_FE_SUBMIT, IO->TraceKey);
+
+    return RequestId | traced;
+}
+
+//
+// Order later reads of a file behind the earlier writes that overlap them:
+// a request with the fence id and no data, which the back end takes without a response
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::FenceFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    bool bufferResult;
+
+    if (!InsertBacklog(Poll)) {
+        ErrorCodeT result = BacklogRequest(Poll, true, BUFF_MSG_REQUEST_FENCE, FileId, Offset, Bytes, nullptr);
+        return result == DDS_ERROR_CODE_IO_PENDING ? DDS_ERROR_CODE_SUCCESS : result;
+    }
+
+    if (Poll->Policy.StageRequests) {
+        bufferResult = StageReadRequest(
+            Poll->RequestRing,
+            &Poll->RequestStaging,
+            BUFF_MSG_REQUEST_FENCE,
+            FileId,
+            Offset,
+            Bytes
+        );
+        PublishStagedForWaiters(Poll);
+    }
+    else {
+        bufferResult = InsertReadRequest(
+            Poll->RequestRing,
+            BUFF_MSG_REQUEST_FENCE,
+            FileId,
+            Offset,
+            Bytes
+        );
+    }
+
+    if (!bufferResult) {
+        ErrorCodeT result = BacklogRequest(Poll, true, BUFF_MSG_REQUEST_FENCE, FileId, Offset, Bytes, nullptr);
+        return result == DDS_ERROR_CODE_IO_PENDING ? DDS_ERROR_CODE_SUCCESS : result;
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Async read from a file
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::ReadFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    BufferT DestBuffer,
+    FileIOSizeT BytesToRead,
+    FileIOSizeT* BytesRead,
+    ContextT Context,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+    uint32_t accessToken;
+    bool device = false;
+    bool bufferResult;
+
+    //
+    // A read into a registered application buffer is written in place by the back end,
+    // unless it asks for compression or tracing, which direct reads do not carry;
+    // a read into a device buffer is always direct, as the host cannot copy into it,
+    // and so drops both
+    //
+    //
+    bool direct = BytesToRead && Poll->MsgBuffer->FindExternalRegion(DestBuffer, BytesToRead, &accessToken, &device);
+    if (device) {
+        ((FileIOT*)Context)->CompressRead = false;
+        ((FileIOT*)Context)->TraceId = 0;
+    }
+    else if (((FileIOT*)Context)->CompressRead || ((FileIOT*)Context)->TraceId) {
+        direct = false;
+    }
+    ((FileIOT*)Context)->DeviceRead = device;
+
+    if (((FileIOT*)Context)->CompressRead) {
+        requestId |= BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ;
+    }
+    requestId = TraceRequest((FileIOT*)Context, requestId, Poll);
+
+    //
+    // Queue behind earlier requests that are still waiting for credits;
+    // the backlog replays reads as plain reads, so a read into a device buffer is refused instead
+    //
+    //
+    if (!InsertBacklog(Poll)) {
+        if (device) {
+            return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+        }
+        return BacklogRequest(Poll, true, requestId, FileId, Offset, BytesToRead, nullptr);
+    }
+    ((FileIOT*)Context)->AtBackEnd = Poll;
+
+    ((FileIOT*)Context)->DirectRead = direct;
+    if (direct) {
+        BuffMsgDirectReadSegment segment;
+        segment.Address = (uint64_t)DestBuffer;
+        segment.Bytes = BytesToRead;
+        segment.Reserved = 0;
+
+        bufferResult = InsertDirectReadRequest(
+            Poll->RequestRing,
+            requestId,
+            FileId,
+            Offset,
+            BytesToRead,
+            accessToken,
+            &segment,
+            1
+        );
+    }
+    else if (Poll->Policy.StageRequests) {
+        bufferResult = StageReadRequest(
+            Poll->RequestRing,
+            &Poll->RequestStaging,
+            requestId,
+            FileId,
+            Offset,
+            BytesToRead
+        );
+        PublishStagedForWaiters(Poll);
+    }
+    else {
+        bufferResult = InsertReadRequest(
+            Poll->RequestRing,
+            requestId,
+            FileId,
+            Offset,
+            BytesToRead
+        );
+    }
+
+    if (!bufferResult) {
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        if (device) {
+            return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+        }
+        return BacklogRequest(Poll, true, requestId, FileId, Offset, BytesToRead, nullptr);
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Async read of the item of a key in the cache table of the back end:
+// a read request that carries the key, which the back end resolves to the file, offset, and size of the item
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::ReadFileByKey(
+    const CacheKeyT* Key,
+    BufferT DestBuffer,
+    FileIOSizeT BufferSize,
+    ContextT Context,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+
+    if (((FileIOT*)Context)->CompressRead) {
+        requestId |= BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ;
+    }
+    requestId = TraceRequest((FileIOT*)Context, requestId, Poll);
+
+    //
+    // The backlog does not keep keys, so a read by key does not pass the requests queued for credits
+    //
+    //
+    if (!InsertBacklog(Poll)) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    ((FileIOT*)Context)->AtBackEnd = Poll;
+
+    if (!InsertKeyReadRequest(Poll->RequestRing, requestId, Key, BufferSize)) {
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Async scan of Bytes of a file from Offset in records of RecordBytes:
+// a read request that carries the scan, whose response holds only what the scan function keeps of the records
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::ScanFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    FileIOSizeT RecordBytes,
+    uint16_t ScanId,
+    BufferT DestBuffer,
+    FileIOSizeT BufferSize,
+    ContextT Context,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+
+    if (((FileIOT*)Context)->CompressRead) {
+        requestId |= BUFF_MSG_REQUEST_FLAG_COMPRESSED_READ;
+    }
+    requestId = TraceRequest((FileIOT*)Context, requestId, Poll);
+
+    BuffMsgF2BScanHeader scan;
+    scan.FileId = FileId;
+    scan.ScanId = ScanId;
+    scan.Bytes = Bytes;
+    scan.RecordBytes = RecordBytes;
+    scan.Reserved = 0;
+
+    //
+    // The backlog does not keep scans, so a scan does not pass the requests queued for credits
+    //
+    //
+    if (!InsertBacklog(Poll)) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    ((FileIOT*)Context)->AtBackEnd = Poll;
+
+    if (!InsertScanRequest(Poll->RequestRing, requestId, Offset, BufferSize, &scan)) {
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Map the pages of a scattered read onto registered application buffers,
+// merging adjacent pages; return false if any page is not registered
+// or the pages do not fit into the segments of a direct read
+//
+//
+static inline bool
+BuildDirectReadSegments(
+    PollT* Poll,
+    BufferT* DestBufferArray,
+    FileIOSizeT BytesToRead,
+    uint32_t* AccessToken,
+    BuffMsgDirectReadSegment* Segments,
+    uint32_t* NumSegments
+) {
+    uint32_t numSegments = 0;
+    FileIOSizeT bytesMapped = 0;
+
+    for (int p = 0; bytesMapped != BytesToRead; p++) {
+        FileIOSizeT pageBytes = BytesToRead - bytesMapped;
+        if (pageBytes > DDS_PAGE_SIZE) {
+            pageBytes = DDS_PAGE_SIZE;
+        }
+
+        uint32_t token;
+        if (!Poll->MsgBuffer->FindExternalRegion(DestBufferArray[p], pageBytes, &token)) {
+            return false;
+        }
+
+        uint64_t address = (uint64_t)DestBufferArray[p];
+        if (numSegments && token == *AccessToken &&
+            Segments[numSegments - 1].Address + Segments[numSegments - 1].Bytes == address) {
+            Segments[numSegments - 1].Bytes += pageBytes;
+        }
+        else {
+            if (numSegments == BUFF_MSG_DIRECT_READ_MAX_SEGMENTS || (numSegments && token != *AccessToken)) {
+                return false;
+            }
+            *AccessToken = token;
+            Segments[numSegments].Address = address;
+            Segments[numSegments].Bytes = pageBytes;
+            Segments[numSegments].Reserved = 0;
+            numSegments++;
+        }
+
+        bytesMapped += pageBytes;
+    }
+
+    *NumSegments = numSegments;
+
+    return numSegments != 0;
+}
+
+//
+// Whether any page of a scattered read is in a device buffer
+//
+//
+static inline bool
+ScatterTouchesDevice(
+    PollT* Poll,
+    BufferT* DestBufferArray,
+    FileIOSizeT BytesToRead
+) {
+    for (FileIOSizeT p = 0; p * (FileIOSizeT)DDS_PAGE_SIZE < BytesToRead; p++) {
+        uint32_t token;
+        bool device = false;
+        if (Poll->MsgBuffer->FindExternalRegion(DestBufferArray[p], 1, &token, &device) && device) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//
+// Async read from a file with scattering
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::ReadFileScatter(
+    FileIdT FileId,
+    FileSizeT Offset,
+    BufferT* DestBufferArray,
+    FileIOSizeT BytesToRead,
+    FileIOSizeT* BytesRead,
+    ContextT Context,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+    uint32_t accessToken = 0;
+    BuffMsgDirectReadSegment segments[BUFF_MSG_DIRECT_READ_MAX_SEGMENTS];
+    uint32_t numSegments = 0;
+    bool bufferResult;
+
+    if (publisher.BackEndLost()) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    ((FileIOT*)Context)->AtBackEnd = Poll;
+
+    bool device = ScatterTouchesDevice(Poll, DestBufferArray, BytesToRead);
+    ((FileIOT*)Context)->DeviceRead = device;
+
+    ((FileIOT*)Context)->DirectRead = BuildDirectReadSegments(Poll, DestBufferArray, BytesToRead, &accessToken, segments, &numSegments);
+    if (((FileIOT*)Context)->DirectRead) {
+        //
+        // All pages are registered, so the back end writes them in place
+        //
+        //
+        bufferResult = InsertDirectReadRequest(
+            Poll->RequestRing,
+            requestId,
+            FileId,
+            Offset,
+            BytesToRead,
+            accessToken,
+            segments,
+            numSegments
+        );
+    }
+    else if (device) {
+        //
+        // The host cannot copy the pages in a device buffer, so they must all go in place
+        //
+        //
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+    else {
+        bufferResult = InsertReadRequest(
+            Poll->RequestRing,
+            requestId,
+            FileId,
+            Offset,
+            BytesToRead
+        );
+    }
+
+    if (!bufferResult) {
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Async write to a file
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::WriteFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    BufferT SourceBuffer,
+    FileIOSizeT BytesToWrite,
+    FileIOSizeT* BytesWritten,
+    ContextT Context,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    RequestIdT requestId = ((FileIOT*)Context)->RequestId;
+
+    if (((FileIOT*)Context)->DurableWrite) {
+        requestId |= BUFF_MSG_REQUEST_FLAG_DURABLE_WRITE;
+    }
+    requestId = TraceRequest((FileIOT*)Context, requestId, Poll);
+    bool bufferResult;
+
+    if (!InsertBacklog(Poll)) {
+        return BacklogRequest(Poll, false, requestId, FileId, Offset, BytesToWrite, SourceBuffer);
+    }
+    ((FileIOT*)Context)->AtBackEnd = Poll;
+
+    if (Poll->Policy.StageRequests) {
+        bufferResult = StageWriteFileRequest(
+            Poll->RequestRing,
+            &Poll->RequestStaging,
+            requestId,
+            FileId,
+            Offset,
+            BytesToWrite,
+            SourceBuffer
+        );
+        PublishStagedForWaiters(Poll);
+    }
+    else {
+        bufferResult = InsertWriteFileRequest(
+            Poll->RequestRing,
+            requestId,
+            FileId,
+            Offset,
+            BytesToWrite,
+            SourceBuffer
+        );
+    }
+
+    if (!bufferResult) {
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        return BacklogRequest(Poll, false, requestId, FileId, Offset, BytesToWrite, SourceBuffer);
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
@@ -692,8 +1893,18 @@ DDSBackEndBridge::WriteFileGather(
     ContextT Context,
     PollT* Poll
 ) {
+    RequestPublisherT publisher(Poll);
     RequestIdT requestId = ((FileIOT*)Context)->RequestId;
 
+    if (((FileIOT*)Context)->DurableWrite) {
+        requestId |= BUFF_MSG_REQUEST_FLAG_DURABLE_WRITE;
+    }
+
+    if (publisher.BackEndLost()) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    ((FileIOT*)Context)->AtBackEnd = Poll;
+
     bool bufferResult = InsertWriteFileGatherRequest(
         Poll->RequestRing,
         requestId,
@@ -704,12 +1915,94 @@ DDSBackEndBridge::WriteFileGather(
     );
 
     if (!bufferResult) {
+        ((FileIOT*)Context)->AtBackEnd = nullptr;
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    RingRequestDoorbell(Poll);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Async reads and writes of a batch of file I/O slots on a poll,
+// inserted into the request ring with a single tail advancement
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::SubmitFileIOBatch(
+    FileIOT** IOs,
+    size_t NumIOs,
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+    RequestBatchEntryT requests[DDS_MAX_OUTSTANDING_IO];
+
+    if (NumIOs > DDS_MAX_OUTSTANDING_IO) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    if (publisher.BackEndLost()) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+
+    for (size_t i = 0; i != NumIOs; i++) {
+        FileIOT* io = IOs[i];
+        io->AtBackEnd = Poll;
+        requests[i].IsRead = io->IsRead;
+        requests[i].RequestId = io->DurableWrite ? io->RequestId | BUFF_MSG_REQUEST_FLAG_DURABLE_WRITE : io->RequestId;
+        requests[i].FileId = io->FileId;
+        requests[i].Offset = io->Offset;
+        requests[i].Bytes = io->NextCoalesced ? io->CoalescedBytes : io->BytesDesired;
+        requests[i].SourceBuffer = io->IsRead ? nullptr : io->AppBuffer;
+    }
+
+    bool bufferResult = InsertRequestBatch(
+        Poll->RequestRing,
+        requests,
+        (int)NumIOs
+    );
+
+    if (!bufferResult) {
+        for (size_t i = 0; i != NumIOs; i++) {
+            IOs[i]->AtBackEnd = nullptr;
+        }
         return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
     }
+    RingRequestDoorbell(Poll);
 
     return DDS_ERROR_CODE_IO_PENDING;
 }
 
+//
+// Publish the reads and writes staged on a poll,
+// and those the poll has queued for as long as there are credits
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::FlushRequests(
+    PollT* Poll
+) {
+    RequestPublisherT publisher(Poll);
+
+    //
+    // Nothing is published to a lost back end; what is queued goes to the one that replaces it
+    //
+    //
+    if (publisher.BackEndLost()) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    if (!FlushStagedRequests(Poll->RequestRing, &Poll->RequestStaging)) {
+        return DDS_ERROR_CODE_REQUEST_RING_FAILURE;
+    }
+    RingRequestDoorbell(Poll);
+
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    InsertBacklog(Poll, &result);
+
+    return result;
+}
+
 //
 // Get file properties by file id
 // 
@@ -800,42 +2093,300 @@ DDSBackEndBridge::GetStorageFreeSpace(
         return result;
     }
 
-    CtrlMsgB2FAckGetFreeSpace* resp = (CtrlMsgB2FAckGetFreeSpace*)(CtrlMsgBuf + sizeof(MsgHeader));
-    *StorageFreeSpace = resp->FreeSpace;
-    return resp->Result;
+    CtrlMsgB2FAckGetFreeSpace* resp = (CtrlMsgB2FAckGetFreeSpace*)(CtrlMsgBuf + sizeof(MsgHeader));
+    *StorageFreeSpace = resp->FreeSpace;
+    return resp->Result;
+}
+
+//
+// Move an existing file or a directory,
+// including its children
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::MoveFile(
+    FileIdT FileId,
+    const char* NewFileName
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    //
+    // Send a move file request to the back end
+    //
+    //
+    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_MOVE_FILE;
+
+    CtrlMsgF2BReqMoveFile* req = (CtrlMsgF2BReqMoveFile*)(CtrlMsgBuf + sizeof(MsgHeader));
+    req->FileId = FileId;
+    strcpy(req->NewFileName, NewFileName);
+    
+    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqMoveFile);
+    
+    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_GET_FREE_SPACE);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    CtrlMsgB2FAckMoveFile* resp = (CtrlMsgB2FAckMoveFile*)(CtrlMsgBuf + sizeof(MsgHeader));
+    return resp->Result;
+}
+
+//
+// Apply a batch of updates to the cache table on the back end,
+// sending as many updates in each control message as it holds
+//
+//
+ErrorCodeT
+DDSBackEndBridge::UpdateCacheTable(
+    const CacheUpdateT* Updates,
+    size_t NumUpdates
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    for (size_t first = 0; first < NumUpdates; first += CTRL_MSG_UPDATE_CACHE_MAX_UPDATES) {
+        uint32_t numUpdates = (uint32_t)std::min(NumUpdates - first, (size_t)CTRL_MSG_UPDATE_CACHE_MAX_UPDATES);
+
+        //
+        // Send an update cache request to the back end
+        //
+        //
+        ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_UPDATE_CACHE;
+
+        CtrlMsgF2BReqUpdateCache* req = (CtrlMsgF2BReqUpdateCache*)(CtrlMsgBuf + sizeof(MsgHeader));
+        req->NumUpdates = numUpdates;
+        memcpy(req->Updates, &Updates[first], numUpdates * sizeof(CacheUpdateT));
+
+        CtrlSgl->BufferLength = sizeof(MsgHeader) + offsetof(CtrlMsgF2BReqUpdateCache, Updates) +
+            numUpdates * sizeof(CacheUpdateT);
+
+        result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_UPDATE_CACHE);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            return result;
+        }
+
+        CtrlMsgB2FAckUpdateCache* resp = (CtrlMsgB2FAckUpdateCache*)(CtrlMsgBuf + sizeof(MsgHeader));
+        if (resp->Result != DDS_ERROR_CODE_SUCCESS) {
+            return resp->Result;
+        }
+    }
+
+    return result;
+}
+
+//
+// Send a batch of control operations without waiting for the ack
+//
+//
+ErrorCodeT
+DDSBackEndBridge::SubmitControlBatch(
+    ControlOpT* Ops,
+    size_t NumOps,
+    DirIdT DirId
+) {
+    if (NumOps == 0 || NumOps > CTRL_MSG_BATCH_MAX_OPS) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    std::lock_guard<std::mutex> lock(CtrlLock);
+    if (CtrlBatchOps) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    char* batchBuf = CtrlMsgBuf + CTRL_MSG_SIZE;
+    ((MsgHeader*)batchBuf)->MsgId = CTRL_MSG_F2B_REQ_BATCH;
+
+    CtrlMsgF2BReqBatch* req = (CtrlMsgF2BReqBatch*)(batchBuf + sizeof(MsgHeader));
+    req->NumOps = (uint32_t)NumOps;
+    for (size_t o = 0; o != NumOps; o++) {
+        ControlOpT* op = &Ops[o];
+        CtrlMsgBatchOpReq* opReq = &req->Ops[o];
+
+        switch (op->Type) {
+            case CONTROL_OP_CREATE_FILE:
+                opReq->MsgId = CTRL_MSG_F2B_REQ_CREATE_FILE;
+                opReq->Req.CreateFile.FileId = op->FileId;
+                opReq->Req.CreateFile.DirId = DirId;
+                opReq->Req.CreateFile.FileAttributes = op->FileAttributes;
+                strcpy(opReq->Req.CreateFile.FileName, op->FileName);
+                break;
+            case CONTROL_OP_DELETE_FILE:
+                opReq->MsgId = CTRL_MSG_F2B_REQ_DELETE_FILE;
+                opReq->Req.DeleteFile.FileId = op->FileId;
+                opReq->Req.DeleteFile.DirId = DirId;
+                break;
+            case CONTROL_OP_CHANGE_FILE_SIZE:
+                opReq->MsgId = CTRL_MSG_F2B_REQ_CHANGE_FILE_SIZE;
+                opReq->Req.ChangeFileSize.FileId = op->FileId;
+                opReq->Req.ChangeFileSize.NewSize = op->FileSize;
+                break;
+            case CONTROL_OP_GET_FILE_SIZE:
+                opReq->MsgId = CTRL_MSG_F2B_REQ_GET_FILE_SIZE;
+                opReq->Req.GetFileSize.FileId = op->FileId;
+                break;
+            case CONTROL_OP_FLUSH_FILE:
+                opReq->MsgId = CTRL_MSG_F2B_REQ_FLUSH_FILE;
+                opReq->Req.FlushFile.FileId = op->FileId;
+                break;
+            default:
+                return DDS_ERROR_CODE_INVALID_PARAM;
+        }
+    }
+
+    CtrlBatchOps = Ops;
+    CtrlBatchNumOps = NumOps;
+    CtrlBatchResult = DDS_ERROR_CODE_IO_PENDING;
+
+#ifdef DMA_BUFFER_LOOPBACK
+    //
+    // The loopback back end acknowledges every operation
+    //
+    //
+    CtrlMsgB2FAckBatch* resp = (CtrlMsgB2FAckBatch*)(batchBuf + sizeof(MsgHeader));
+    ((MsgHeader*)batchBuf)->MsgId = CTRL_MSG_B2F_ACK_BATCH;
+    memset(resp, 0, sizeof(CtrlMsgB2FAckBatch));
+    resp->Result = DDS_ERROR_CODE_SUCCESS;
+    resp->NumCompleted = (uint32_t)NumOps;
+    CtrlBatchCompletions = 0;
+
+    return DDS_ERROR_CODE_SUCCESS;
+#endif
+
+    //
+    // The receive of the ack is posted before the batch goes out; the send and the receive complete in turn
+    //
+    //
+    CtrlBatchCompletions = 2;
+    CtrlSgl[1].BufferLength = CTRL_MSG_SIZE;
+#ifdef _WIN32
+    RDMC_PostReceive(CtrlQPair, &CtrlSgl[1], 1, MSG_CTXT);
+#else
+    RDMCVerbs_PostReceive(CtrlCmId, &CtrlSgl[1], MSG_CTXT);
+#endif
+
+    CtrlSgl[1].BufferLength = (uint32_t)(sizeof(MsgHeader) + offsetof(CtrlMsgF2BReqBatch, Ops) + NumOps * sizeof(CtrlMsgBatchOpReq));
+#ifdef _WIN32
+    RDMC_Send(CtrlQPair, &CtrlSgl[1], 1, 0, MSG_CTXT);
+#else
+    RDMCVerbs_Send(CtrlCmId, &CtrlSgl[1], MSG_CTXT);
+#endif
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Check for the ack of the outstanding batch, or wait for it
+//
+//
+ErrorCodeT
+DDSBackEndBridge::PollControlBatch(
+    bool Wait,
+    bool* Completed
+) {
+    *Completed = false;
+
+    std::lock_guard<std::mutex> lock(CtrlLock);
+    if (!CtrlBatchOps) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    if (!CompleteControlBatch(this, Wait)) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    CtrlBatchOps = NULL;
+    CtrlBatchNumOps = 0;
+    *Completed = true;
+
+    return CtrlBatchResult;
+}
+
+//
+// Copy a range of the data of a response, which may wrap around the response ring
+//
+//
+static inline void
+CopyFromResponseData(
+    BufferT Dest,
+    SplittableBufferT* DataBuff,
+    FileIOSizeT DataOffset,
+    FileIOSizeT Bytes
+) {
+    if (DataOffset >= DataBuff->FirstSize) {
+        memcpy(Dest, DataBuff->SecondAddr + (DataOffset - DataBuff->FirstSize), Bytes);
+    }
+    else if (DataOffset + Bytes > DataBuff->FirstSize) {
+        FileIOSizeT firstBytes = DataBuff->FirstSize - DataOffset;
+        memcpy(Dest, DataBuff->FirstAddr + DataOffset, firstBytes);
+        memcpy(Dest + firstBytes, DataBuff->SecondAddr, Bytes - firstBytes);
+    }
+    else {
+        memcpy(Dest, DataBuff->FirstAddr + DataOffset, Bytes);
+    }
+}
+
+//
+// Split the response of merged reads back into the reads of the chain,
+// recording the share of each read for the front end to report
+//
+//
+static inline void
+CompleteCoalescedIO(
+    FileIOT* IO,
+    BuffMsgB2FAckHeader* Resp,
+    SplittableBufferT* DataBuff
+) {
+    FileIOSizeT dataOffset = 0;
+
+    for (FileIOT* io = IO; io; io = io->NextCoalesced) {
+        FileIOSizeT bytes = 0;
+        if (Resp->BytesServiced > dataOffset) {
+            bytes = Resp->BytesServiced - dataOffset;
+            if (bytes > io->BytesDesired) {
+                bytes = io->BytesDesired;
+            }
+            CopyFromResponseData(io->AppBuffer, DataBuff, dataOffset, bytes);
+        }
+
+        io->CoalescedResult = Resp->Result;
+        io->CoalescedBytesServiced = bytes;
+        dataOffset += io->BytesDesired;
+    }
 }
 
 //
-// Move an existing file or a directory,
-// including its children
-// 
+// Decompress the data of a compressed read into the application buffer;
+// a compressed block that wraps around the response ring is gathered first
 //
-ErrorCodeT
-DDSBackEndBridge::MoveFile(
-    FileIdT FileId,
-    const char* NewFileName
+//
+static inline ErrorCodeT
+DecompressResponseData(
+    BufferT Dest,
+    FileIOSizeT DestBytes,
+    SplittableBufferT* DataBuff
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    static thread_local std::vector<char> gathered;
+    FileIOSizeT compressedBytes;
 
-    //
-    // Send a move file request to the back end
-    //
-    //
-    ((MsgHeader*)CtrlMsgBuf)->MsgId = CTRL_MSG_F2B_REQ_MOVE_FILE;
+    if (DataBuff->TotalSize < sizeof(FileIOSizeT)) {
+        return DDS_ERROR_CODE_IO_FAILURE;
+    }
+    CopyFromResponseData((BufferT)&compressedBytes, DataBuff, 0, sizeof(FileIOSizeT));
+    if (compressedBytes > DataBuff->TotalSize - sizeof(FileIOSizeT)) {
+        return DDS_ERROR_CODE_IO_FAILURE;
+    }
 
-    CtrlMsgF2BReqMoveFile* req = (CtrlMsgF2BReqMoveFile*)(CtrlMsgBuf + sizeof(MsgHeader));
-    req->FileId = FileId;
-    strcpy(req->NewFileName, NewFileName);
-    
-    CtrlSgl->BufferLength = sizeof(MsgHeader) + sizeof(CtrlMsgF2BReqMoveFile);
-    
-    result = SendCtrlMsgAndWait(this, CTRL_MSG_B2F_ACK_GET_FREE_SPACE);
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        return result;
+    const char* source = DataBuff->FirstAddr + sizeof(FileIOSizeT);
+    if (DataBuff->SecondAddr && sizeof(FileIOSizeT) + compressedBytes > DataBuff->FirstSize) {
+        gathered.resize(compressedBytes);
+        CopyFromResponseData(gathered.data(), DataBuff, sizeof(FileIOSizeT), compressedBytes);
+        source = gathered.data();
     }
 
-    CtrlMsgB2FAckMoveFile* resp = (CtrlMsgB2FAckMoveFile*)(CtrlMsgBuf + sizeof(MsgHeader));
-    return resp->Result;
+    if (!DecompressPayload(source, compressedBytes, Dest, DestBytes)) {
+        return DDS_ERROR_CODE_IO_FAILURE;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
@@ -844,12 +2395,64 @@ DDSBackEndBridge::MoveFile(
 //
 static inline void
 CompleteIO (
+    PollT* Poll,
+    size_t Batch,
     FileIOT* IO,
     BuffMsgB2FAckHeader* Resp,
     SplittableBufferT* DataBuff
 ) {
     if (IO->IsRead) {
-        if (IO->AppBuffer) {
+        if (IO->NextCoalesced) {
+            CompleteCoalescedIO(IO, Resp, DataBuff);
+        }
+        else if (IO->ZeroCopyResponse) {
+            //
+            // A zero-copy read: hand out a view into the response ring and
+            // keep the current batch pinned until the app releases the view
+            //
+            //
+            ZeroCopyReadT* view = IO->ZeroCopyResponse;
+            FileIOSizeT bytesServiced = Resp->BytesServiced;
+            view->Data.TotalSize = bytesServiced;
+            view->Data.FirstAddr = DataBuff->FirstAddr;
+            if (DataBuff->FirstSize >= bytesServiced) {
+                view->Data.FirstSize = bytesServiced;
+                view->Data.SecondAddr = NULL;
+            }
+            else {
+                view->Data.FirstSize = DataBuff->FirstSize;
+                view->Data.SecondAddr = DataBuff->SecondAddr;
+            }
+            view->Batch = Batch;
+            Poll->PinResponseBatch(view->Batch);
+        }
+        else if (IO->AppBuffer && (Resp->RequestId & BUFF_MSG_RESPONSE_FLAG_COMPRESSED)) {
+            //
+            // The back end has compressed the data; a block that does not decompress fails the read
+            //
+            //
+            Resp->Result = DecompressResponseData(IO->AppBuffer, Resp->BytesServiced, DataBuff);
+        }
+        else if (IO->DirectRead && DataBuff->TotalSize < Resp->BytesServiced) {
+            //
+            // A direct read: the back end has written the data into
+            // the registered buffer or pages before this response, so there is nothing to copy;
+            // one that fell back to an inline response carries its data and is handled below
+            //
+            //
+        }
+        else if (IO->DeviceRead) {
+            //
+            // The back end had no staging room for a direct read and answered inline;
+            // the host cannot copy into a device buffer, so the read is to be retried
+            //
+            //
+            if (Resp->BytesServiced) {
+                Resp->Result = DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+                Resp->BytesServiced = 0;
+            }
+        }
+        else if (IO->AppBuffer) {
             //
             // Due to alignment, DataBuff.TotalSize might be larger than the actual data
             // Hence, use Resp->BytesServiced as the bytes to copy
@@ -926,7 +2529,7 @@ CompleteIO (
                     //
                     FileIOSizeT secondRightResidual = secondSize % DDS_PAGE_SIZE;
                     if (secondRightResidual) {
-                        memcpy(IO->AppBufferArray[segIndex], DataBuff->SecondAddr + secondRightResidual + numWholePagesInSecond * (size_t)DDS_PAGE_SIZE, secondRightResidual);
+                        memcpy(IO->AppBufferArray[segIndex], DataBuff->SecondAddr + secondLeftResidual + numWholePagesInSecond * (size_t)DDS_PAGE_SIZE, secondRightResidual);
                     }
                 }
                 else {
@@ -935,81 +2538,295 @@ CompleteIO (
             }
         }
     }
+    else if (IO->Append && Resp->Result == DDS_ERROR_CODE_SUCCESS) {
+        //
+        // An append: the back end has put the offset it was given in the response
+        //
+        //
+        CopyFromResponseData((BufferT)&IO->Offset, DataBuff, 0, sizeof(FileSizeT));
+    }
+    else if (IO->AtomicOp && Resp->Result == DDS_ERROR_CODE_SUCCESS) {
+        //
+        // An atomic operation: the back end has put the value the word had in the response
+        //
+        //
+        CopyFromResponseData((BufferT)&IO->AtomicValue, DataBuff, 0, sizeof(uint64_t));
+    }
+}
+
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+//
+// Wait on the completion queue of a poll for the notification of a response batch,
+// looking at the connection to the back end every DDS_BACKEND_LIVENESS_CHECK_MS;
+// return false if the connection is lost, which would never notify
+//
+//
+static inline bool
+WaitForNotification(
+    PollT* Poll
+) {
+    while (!Poll->MsgBuffer->WaitForACompletionWithTimeout(DDS_BACKEND_LIVENESS_CHECK_MS)) {
+        if (Poll->MsgBuffer->ConnectionLost()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+#endif
+
+#ifndef RING_BUFFER_RESPONSE_BATCH_ENABLED
+//
+// Fetch a response of a poll and queue it as a batch of its own,
+// in one step, so that the queue is in ring order
+//
+//
+static inline bool
+FetchAndOpenResponse(
+    PollT* Poll,
+    BuffMsgB2FAckHeader** Response,
+    SplittableBufferT* DataBuff,
+    size_t* Batch
+) {
+    std::lock_guard<std::mutex> lock(Poll->ResponseBatchLock);
+
+    if (!Poll->CanOpenResponseBatch() || !FetchResponse(Poll->ResponseRing, Response, DataBuff)) {
+        return false;
+    }
+
+    *Batch = Poll->OpenResponseBatch(DataBuff->TotalSize + sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+
+    return true;
+}
+
+//
+// Complete the request of a response fetched on its own and release its batch;
+// the flags are cleared from its request id, and CompleteIO decompresses a compressed read
+//
+//
+static inline ErrorCodeT
+CompleteFetchedResponse(
+    PollT* Poll,
+    BuffMsgB2FAckHeader* Response,
+    SplittableBufferT* DataBuff,
+    size_t Batch,
+    FileIOSizeT* BytesServiced,
+    RequestIdT* ReqId
+) {
+    RequestIdT requestId = Response->RequestId & ~(BUFF_MSG_RESPONSE_FLAG_COMPRESSED | BUFF_MSG_RESPONSE_FLAG_WRITE);
+    FileIOT* io = Poll->OutstandingRequests[requestId];
+    io->AtBackEnd = nullptr;
+    *ReqId = requestId;
+    *BytesServiced = Response->BytesServiced;
+
+    CompleteIO(Poll, Batch, io, Response, DataBuff);
+    ErrorCodeT result = Response->Result;
+    Poll->ReleaseResponseBatch(Batch);
+
+    return result;
 }
+#endif
 
 #ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
 //
-// Retrieve a response from the cached batch
+// Fetch a batch of responses of a poll into a cursor,
+// unless too many earlier batches are still held by zero-copy reads;
+// the batch is taken from the ring and queued in one step, so that the queue is in ring order
+//
+//
+static inline bool
+FetchAndOpenResponseBatch(
+    PollT* Poll,
+    ResponseCursorT* Cursor
+) {
+    std::lock_guard<std::mutex> lock(Poll->ResponseBatchLock);
+
+    if (!Poll->CanOpenResponseBatch()) {
+        return false;
+    }
+
+    if (!FetchResponseBatch(Poll->ResponseRing, &Cursor->BatchRef)) {
+        return false;
+    }
+
+    //
+    // Additional |BuffMsgB2FAckHeader| bytes in meta data because of alignment
+    //
+    //
+    Cursor->NextResponse = Cursor->BatchRef.FirstAddr;
+    Cursor->Batch = Poll->OpenResponseBatch(Cursor->BatchRef.TotalSize + sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+
+    return true;
+}
+
+//
+// Spin and then yield on the response ring for the windows given by the poll policy,
+// fetching a batch of responses into the cursor if one arrives meanwhile
+//
+//
+static inline bool
+SpinForResponseBatch(
+    PollT* Poll,
+    ResponseCursorT* Cursor
+) {
+    if (!Poll->SpinWindowNs && !Poll->Policy.YieldMicroseconds) {
+        return false;
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    auto spinEnd = begin + std::chrono::nanoseconds(Poll->SpinWindowNs);
+    auto yieldEnd = spinEnd + std::chrono::microseconds(Poll->Policy.YieldMicroseconds);
+
+    while (std::chrono::steady_clock::now() < spinEnd) {
+        if (FetchAndOpenResponseBatch(Poll, Cursor)) {
+            return true;
+        }
+        YieldProcessor();
+    }
+
+    while (std::chrono::steady_clock::now() < yieldEnd) {
+        if (FetchAndOpenResponseBatch(Poll, Cursor)) {
+            return true;
+        }
+        std::this_thread::yield();
+    }
+
+    return false;
+}
+
+//
+// Move a cursor past a response of its batch, releasing the batch after the last one;
+// returns whether the batch has been released
+//
+//
+static inline bool
+AdvanceResponseCursor(
+    PollT* Poll,
+    ResponseCursorT* Cursor,
+    FileIOSizeT RespSize
+) {
+    Cursor->ProcessedBytes += RespSize;
+    if (Cursor->BatchRef.TotalSize - Cursor->ProcessedBytes < (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader))) {
+        //
+        // Release the batch, which advances the response ring progress unless
+        // zero-copy reads still hold it, and reset the cursor
+        //
+        //
+        Poll->ReleaseResponseBatch(Cursor->Batch);
+
+        Cursor->NextResponse = NULL;
+        Cursor->ProcessedBytes = 0;
+
+        return true;
+    }
+
+    //
+    // Move to the next response
+    //
+    //
+    if (Cursor->ProcessedBytes >= Cursor->BatchRef.FirstSize) {
+        Cursor->NextResponse = Cursor->BatchRef.SecondAddr + Cursor->ProcessedBytes - Cursor->BatchRef.FirstSize;
+    }
+    else {
+        Cursor->NextResponse = Cursor->BatchRef.FirstAddr + Cursor->ProcessedBytes;
+    }
+
+    return false;
+}
+
+//
+// Retrieve a response from the batch of a cursor
 //
 //
 ErrorCodeT
 DDSBackEndBridge::GetResponseFromCachedBatch(
     PollT* Poll,
+    ResponseCursorT* Cursor,
     FileIOSizeT* BytesServiced,
     RequestIdT* ReqId
 ) {
-    FileIOSizeT respSize = *((FileIOSizeT*)NextResponse);
-    BuffMsgB2FAckHeader* resp = (BuffMsgB2FAckHeader*)(NextResponse + sizeof(FileIOSizeT));
-    
-    FileIOT* io = Poll->OutstandingRequests[resp->RequestId];
-    *ReqId = resp->RequestId;
-    *BytesServiced = resp->BytesServiced;
+    FileIOSizeT respSize = *((FileIOSizeT*)Cursor->NextResponse);
+
+#ifdef RING_BUFFER_RESPONSE_OUT_OF_ORDER
+    //
+    // Skip the responses the back end has deferred; each of them comes again in a later batch
+    //
+    //
+    while (respSize & BUFF_MSG_RESPONSE_SIZE_FLAG_DEFERRED) {
+        if (AdvanceResponseCursor(Poll, Cursor, respSize & ~BUFF_MSG_RESPONSE_SIZE_FLAG_DEFERRED)) {
+            return DDS_ERROR_CODE_NO_COMPLETION;
+        }
+        respSize = *((FileIOSizeT*)Cursor->NextResponse);
+    }
+#endif
+
+    BuffMsgB2FAckHeader* resp = (BuffMsgB2FAckHeader*)(Cursor->NextResponse + sizeof(FileIOSizeT));
 
     SplittableBufferT dataBuff;
     dataBuff.TotalSize = respSize - sizeof(FileIOSizeT) - sizeof(BuffMsgB2FAckHeader);
-    int delta = (int)ProcessedBytes + (int)sizeof(FileIOSizeT) + (int)sizeof(BuffMsgB2FAckHeader) - (int)BatchRef.FirstSize;
+    int delta = (int)Cursor->ProcessedBytes + (int)sizeof(FileIOSizeT) + (int)sizeof(BuffMsgB2FAckHeader) - (int)Cursor->BatchRef.FirstSize;
     if (delta >= 0) {
-        dataBuff.FirstAddr = BatchRef.SecondAddr + delta;
+        dataBuff.FirstAddr = Cursor->BatchRef.SecondAddr + delta;
         dataBuff.FirstSize = dataBuff.TotalSize;
         dataBuff.SecondAddr = NULL;
     }
     else {
-        dataBuff.FirstAddr = BatchRef.FirstAddr + ((int)(BatchRef.FirstSize) + delta);
+        dataBuff.FirstAddr = Cursor->BatchRef.FirstAddr + ((int)(Cursor->BatchRef.FirstSize) + delta);
         
         if (((int)dataBuff.TotalSize + delta) > 0) {
             dataBuff.FirstSize = 0 - delta;
-            dataBuff.SecondAddr = BatchRef.SecondAddr;
+            dataBuff.SecondAddr = Cursor->BatchRef.SecondAddr;
         }
         else {
             dataBuff.FirstSize = dataBuff.TotalSize;
             dataBuff.SecondAddr = NULL;
         }
     }
-    CompleteIO(io, resp, &dataBuff);
 
-    ProcessedBytes += respSize;
-    if (BatchRef.TotalSize - ProcessedBytes < (sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader))) {
+    if (resp->RequestId == BUFF_MSG_RESPONSE_WRITE_ACKS) {
         //
-        // Advance the response ring progress and reset the batch cache
-        // Additional |BuffMsgB2FAckHeader| bytes in meta data because of alignment
+        // Packed acks of successful writes, taken one at a time;
+        // each write has serviced all its bytes and has nothing to complete
         //
         //
-        IncrementProgress(Poll->ResponseRing, BatchRef.TotalSize + sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
+        RequestIdT requestId;
+        FileIOSizeT numAcks = resp->BytesServiced;
+        CopyFromResponseData((BufferT)&requestId, &dataBuff, Cursor->WriteAcksTaken * sizeof(RequestIdT), sizeof(RequestIdT));
+        *ReqId = requestId;
+        *BytesServiced = Poll->OutstandingRequests[requestId]->BytesDesired;
+        Poll->OutstandingRequests[requestId]->AtBackEnd = nullptr;
+
+        Cursor->WriteAcksTaken++;
+        if (Cursor->WriteAcksTaken == numAcks) {
+            Cursor->WriteAcksTaken = 0;
+            AdvanceResponseCursor(Poll, Cursor, respSize);
+        }
 
-        NextResponse = NULL;
-        ProcessedBytes = 0;
+        return DDS_ERROR_CODE_SUCCESS;
     }
-    else {
-        //
-        // Move to the next response
-        //
-        //
-        if (ProcessedBytes >= BatchRef.FirstSize) {
-            NextResponse = BatchRef.SecondAddr + ProcessedBytes - BatchRef.FirstSize;
-        }
-        else {
-            NextResponse = BatchRef.FirstAddr + ProcessedBytes;
-        }
+
+    RequestIdT requestId = resp->RequestId & ~(BUFF_MSG_RESPONSE_FLAG_COMPRESSED | BUFF_MSG_RESPONSE_FLAG_WRITE);
+    FileIOT* io = Poll->OutstandingRequests[requestId];
+    ErrorCodeT result = resp->Result;
+    io->AtBackEnd = nullptr;
+    *ReqId = requestId;
+    *BytesServiced = resp->BytesServiced;
+
+    if (io->IsRead || io->Append || io->AtomicOp) {
+        CompleteIO(Poll, Cursor->Batch, io, resp, &dataBuff);
+        result = resp->Result;
     }
+    AdvanceResponseCursor(Poll, Cursor, respSize);
 
-    return resp->Result;
+    return result;
 }
 #endif
 
 //
-// Retrieve a response from the response ring
-// Thread-safe for DDS_NOTIFICATION_METHOD_TIMER
-// Not thread-safe for DDS_NOTIFICATION_METHOD_INTERRUPT
+// Retrieve a response from the response ring;
+// several threads may retrieve responses of the same poll, each through a cursor of its own,
+// when they do not block or with DDS_NOTIFICATION_METHOD_TIMER;
+// blocking on the completion queue with DDS_NOTIFICATION_METHOD_INTERRUPT is for a single thread
 // 
 //
 ErrorCodeT
@@ -1018,35 +2835,85 @@ DDSBackEndBridge::GetResponse(
     size_t WaitTime,
     FileIOSizeT* BytesServiced,
     RequestIdT* ReqId
+) {
+    PROFILE_SCOPE("GetResponse");
+
+    //
+    // Requests staged by any thread are published before waiting, and the ones staged while this thread waits
+    // are published as they are staged
+    //
+    //
+    Poll->ResponseWaiters.fetch_add(1);
+    if (Poll->Policy.StageRequests) {
+        RequestPublisherT publisher(Poll);
+        if (!publisher.BackEndLost() && FlushStagedRequests(Poll->RequestRing, &Poll->RequestStaging)) {
+            RingRequestDoorbell(Poll);
+        }
+    }
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    ResponseCursorT* cursor = Poll->AcquireResponseCursor();
+    ErrorCodeT result = GetResponseWithCursor(Poll, cursor, WaitTime, BytesServiced, ReqId);
+    Poll->ReleaseResponseCursor(cursor);
+#else
+    ErrorCodeT result = GetResponseWithCursor(Poll, nullptr, WaitTime, BytesServiced, ReqId);
+#endif
+
+    Poll->ResponseWaiters.fetch_sub(1);
+
+    return result;
+}
+
+//
+// Retrieve a response from the response ring through a cursor
+// 
+//
+ErrorCodeT
+DDSBackEndBridge::GetResponseWithCursor(
+    PollT* Poll,
+    ResponseCursorT* Cursor,
+    size_t WaitTime,
+    FileIOSizeT* BytesServiced,
+    RequestIdT* ReqId
 ) {
 #ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
     //
     // First, check if there are any unprocessed completions in the previous batch
     //
     //
-    if (NextResponse) {
-        return GetResponseFromCachedBatch(Poll, BytesServiced, ReqId);
+    if (Cursor->NextResponse) {
+        return GetResponseFromCachedBatch(Poll, Cursor, BytesServiced, ReqId);
     }
 
     //
     // Check if there is a batch of incoming responses
     //
     //
-    if (FetchResponseBatch(Poll->ResponseRing, &BatchRef)) {
-        NextResponse = BatchRef.FirstAddr;
-        
-        ErrorCodeT result = GetResponseFromCachedBatch(Poll, BytesServiced, ReqId);
+    if (FetchAndOpenResponseBatch(Poll, Cursor)) {
+        ErrorCodeT result = GetResponseFromCachedBatch(Poll, Cursor, BytesServiced, ReqId);
 
 #if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
         //
-        // There must be a completion
+        // There must be a completion, unless the back end was lost right after the batch
         //
         //
-        Poll->MsgBuffer->WaitForACompletion(true);
+        WaitForNotification(Poll);
 #endif
 
         return result;
     }
+
+    //
+    // Finish a batch another thread has left behind in its cursor
+    //
+    //
+    ResponseCursorT* pending = Poll->AcquirePendingResponseCursor();
+    if (pending) {
+        ErrorCodeT result = GetResponseFromCachedBatch(Poll, pending, BytesServiced, ReqId);
+        Poll->ReleaseResponseCursor(pending);
+
+        return result;
+    }
 #else
     BuffMsgB2FAckHeader* response;
     SplittableBufferT dataBuff;
@@ -1055,16 +2922,9 @@ DDSBackEndBridge::GetResponse(
     // First, check if there is any incoming response
     //
     //
-    if (FetchResponse(Poll->ResponseRing, &response, &dataBuff)) {
-        FileIOT* io = Poll->OutstandingRequests[response->RequestId];
-        *ReqId = response->RequestId;
-        *BytesServiced = response->BytesServiced;
-        
-        CompleteIO(io, response, &dataBuff);
-
-        IncrementProgress(Poll->ResponseRing, dataBuff.TotalSize + sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader));
-
-        return response->Result;
+    size_t batch;
+    if (FetchAndOpenResponse(Poll, &response, &dataBuff, &batch)) {
+        return CompleteFetchedResponse(Poll, response, &dataBuff, batch, BytesServiced, ReqId);
     }
 #endif
 
@@ -1073,66 +2933,103 @@ DDSBackEndBridge::GetResponse(
     // Check wait time
     //
     //
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    //
+    // Before blocking, spin and then yield on the response ring as the poll policy allows
+    //
+    //
+    if (WaitTime > 0 && SpinForResponseBatch(Poll, Cursor)) {
+        ErrorCodeT result = GetResponseFromCachedBatch(Poll, Cursor, BytesServiced, ReqId);
+
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+        //
+        // There must be a completion, unless the back end was lost right after the batch
+        //
+        //
+        WaitForNotification(Poll);
+#endif
+
+        return result;
+    }
+#endif
+
 #if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
     if (WaitTime == INFINITE) {
         //
-        // Wait on the completion queue
+        // Nothing can arrive while zero-copy reads hold every batch slot
+        //
+        //
+        if (!Poll->CanOpenResponseBatch()) {
+            return DDS_ERROR_CODE_NO_COMPLETION;
+        }
+
+        //
+        // Wait on the completion queue until the back end is found lost
         //
         //
-        Poll->MsgBuffer->WaitForACompletion(true);
+        if (!WaitForNotification(Poll)) {
+            return DDS_ERROR_CODE_NO_COMPLETION;
+        }
 
         //
         // Now, there should be a batch of responses
         //
         //
-        if (FetchResponseBatch(Poll->ResponseRing, &BatchRef)) {
-            NextResponse = BatchRef.FirstAddr;
-            return GetResponseFromCachedBatch(Poll, BytesServiced, ReqId);
+        if (FetchAndOpenResponseBatch(Poll, Cursor)) {
+            return GetResponseFromCachedBatch(Poll, Cursor, BytesServiced, ReqId);
         }
-        else {
+        else if (!Poll->ResponseRing->HandedOver.load()) {
             //
-            // Should never hit this branch
+            // Should never hit this branch, but for the notification of a handover
             //
             //
             printf("[Error] Expecting a response\n");
         }
     }
     else if (WaitTime > 0) {
+        if (!Poll->CanOpenResponseBatch()) {
+            return DDS_ERROR_CODE_NO_COMPLETION;
+        }
+
         //
-        // TODO: implement waiting for specific time
+        // Wait on the completion queue for at most WaitTime milliseconds
         //
         //
-        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+        if (Poll->MsgBuffer->WaitForACompletionWithTimeout((DWORD)WaitTime)) {
+            if (FetchAndOpenResponseBatch(Poll, Cursor)) {
+                return GetResponseFromCachedBatch(Poll, Cursor, BytesServiced, ReqId);
+            }
+            else if (!Poll->ResponseRing->HandedOver.load()) {
+                //
+                // Should never hit this branch, but for the notification of a handover
+                //
+                //
+                printf("[Error] Expecting a response\n");
+            }
+        }
     }
 #elif DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_TIMER
     size_t sleptMs = 0;
     
     while (sleptMs < WaitTime) {
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        sleptMs++;
 
 #ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
         //
         // Check if there is a batch of incoming responses
         //
         //
-        if (FetchResponseBatch(Poll->ResponseRing, &BatchRef)) {
-            NextResponse = BatchRef.FirstAddr;
-            return GetResponseFromCachedBatch(Poll, BytesServiced, ReqId);
+        if (FetchAndOpenResponseBatch(Poll, Cursor)) {
+            return GetResponseFromCachedBatch(Poll, Cursor, BytesServiced, ReqId);
         }
 #else
         //
         // Check if there is an incoming response
         //
         //
-        if (FetchResponse(Poll->ResponseRing, &response, &dataBuff)) {
-            FileIOT* io = Poll->OutstandingRequests[response->RequestId];
-            *ReqId = response->RequestId;
-            *BytesServiced = response->BytesServiced;
-            
-            CompleteIO(io, response, &dataBuff);
-            IncrementProgress(Poll->ResponseRing, dataBuff.TotalSize + sizeof(FileIOSizeT) + sizeof(BuffMsgB2FAckHeader);
-            
-            return response->Result;
+        if (FetchAndOpenResponse(Poll, &response, &dataBuff, &batch)) {
+            return CompleteFetchedResponse(Poll, response, &dataBuff, batch, BytesServiced, ReqId);
         }
 #endif
     }
@@ -1143,6 +3040,4 @@ DDSBackEndBridge::GetResponse(
     return DDS_ERROR_CODE_NO_COMPLETION;
 }
 
-#endif
-
 }
\ No newline at end of file
@@ -5,8 +5,14 @@
 
 #pragma once
 
+#include <mutex>
+
 #include "DDSBackEndBridgeBase.h"
+#ifdef _WIN32
 #include "RDMC.h"
+#else
+#include "RDMCVerbs.h"
+#endif
 
 #undef CreateDirectory
 #undef RemoveDirectory
@@ -24,7 +30,7 @@ namespace DDS_FrontEnd {
 // Connector that fowards requests to and receives responses from the back end
 //
 //
-class DDSBackEndBridge : public DDSBackEndBridgeBase {
+class DDSBackEndBridge final : public DDSBackEndBridgeBase {
 public:
     //
     // Back end configuration
@@ -38,36 +44,74 @@ public:
     // RNIC configuration
     //
     //
+#ifdef _WIN32
     IND2Adapter* Adapter;
     HANDLE AdapterFileHandle;
     ND2_ADAPTER_INFO AdapterInfo;
     OVERLAPPED Ov;
+#endif
     size_t QueueDepth;
     size_t MaxSge;
     size_t InlineThreshold;
     struct sockaddr_in LocalSock;
 
+#ifdef _WIN32
     IND2Connector* CtrlConnector;
     IND2CompletionQueue* CtrlCompQ;
     IND2QueuePair* CtrlQPair;
     IND2MemoryRegion* CtrlMemRegion;
     ND2_SGE* CtrlSgl;
-    char CtrlMsgBuf[CTRL_MSG_SIZE];
+#else
+    struct rdma_event_channel* CtrlCmChannel;
+    struct rdma_cm_id* CtrlCmId;
+    struct ibv_pd* CtrlPDomain;
+    struct ibv_cq* CtrlCompQ;
+    struct ibv_mr* CtrlMemRegion;
+    RDMCVerbsSgeT* CtrlSgl;
+#endif
+    //
+    // The first half carries single control messages and the second the outstanding batch,
+    // so that a single message can be built while a batch is in flight
+    //
+    //
+    char CtrlMsgBuf[2 * CTRL_MSG_SIZE];
+
+    //
+    // The outstanding control batch, which needs CtrlBatchCompletions more completions;
+    // CtrlBatchResult stays DDS_ERROR_CODE_IO_PENDING until its ack has been applied to its operations
+    //
+    //
+    ControlOpT* CtrlBatchOps;
+    size_t CtrlBatchNumOps;
+    int CtrlBatchCompletions;
+    ErrorCodeT CtrlBatchResult;
+
+    //
+    // Serializes the use of the control connection, as polls take the acks of batches
+    // while the application makes control calls
+    //
+    //
+    std::mutex CtrlLock;
 
     int ClientId;
 
-#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
     //
-    // Caching a received batch
+    // Bytes of the request and response rings of every poll, their protocol and the queue depth of every poll,
+    // as negotiated by Connect
     //
     //
-    SplittableBufferT BatchRef;
-    FileIOSizeT ProcessedBytes;
-    BufferT NextResponse;
-#endif
+    RingSizeT RequestRingBytes;
+    RingSizeT ResponseRingBytes;
+    RingProtocolT RingProtocol;
+    uint32_t PollQueueDepth;
 
 public:
-    DDSBackEndBridge();
+    DDSBackEndBridge(
+        RingSizeT RequestRingBytes,
+        RingSizeT ResponseRingBytes,
+        RingProtocolT RingProtocol,
+        uint32_t PollQueueDepth
+    );
 
     //
     // Connect to the backend
@@ -83,6 +127,17 @@ public:
     ErrorCodeT
     Disconnect();
 
+    //
+    // Connect to the back end that took over from the one this bridge was connected to,
+    // or that was started again if that one was lost (BackEndLost),
+    // keeping the ring sizes, the protocol and the queue depth the polls were set up with
+    //
+    //
+    ErrorCodeT
+    Reconnect(
+        bool BackEndLost = false
+    );
+
 	//
     // Create a diretory
     // 
@@ -145,6 +200,105 @@ public:
         FileSizeT* FileSize
     );
 
+    //
+    // Flush the device under a file
+    // 
+    //
+    ErrorCodeT
+    FlushFile(
+        FileIdT FileId
+    );
+
+    //
+    // Limit the I/O of a file, or lift the limit if BytesPerSecond is 0
+    // 
+    //
+    ErrorCodeT
+    SetFileQoS(
+        FileIdT FileId,
+        uint64_t BytesPerSecond,
+        uint64_t BurstBytes,
+        uint32_t Weight
+    );
+
+    //
+    // Share the segments of a file with a new read-only file, the snapshot of the file
+    // 
+    //
+    ErrorCodeT
+    CreateSnapshot(
+        FileIdT FileId,
+        FileIdT SnapshotFileId,
+        DirIdT DirId,
+        const char* SnapshotName
+    );
+
+    //
+    // Tell the back end how a file will be read
+    // 
+    //
+    ErrorCodeT
+    SetFileAccessHint(
+        FileIdT FileId,
+        FileAccessHint Hint,
+        FileSizeT Offset,
+        FileSizeT Bytes
+    );
+
+    //
+    // Take or renew the lease of a file on the back end, which says how long it lasts
+    // 
+    //
+    ErrorCodeT
+    AcquireFileLease(
+        FileIdT FileId,
+        FileLeaseMode Mode,
+        uint32_t* TermMs
+    );
+
+    //
+    // Give back the lease of a file
+    // 
+    //
+    ErrorCodeT
+    ReleaseFileLease(
+        FileIdT FileId
+    );
+
+    //
+    // Renew the leases of the front end on the back end, except the revoked ones, whose files go in Revoked
+    // 
+    //
+    ErrorCodeT
+    RenewFileLeases(
+        FileIdT* Revoked,
+        uint32_t MaxRevoked,
+        uint32_t* NumRevoked,
+        uint32_t* TermMs
+    );
+
+    //
+    // Compile and load a scan function on the back end, which names it by ScanId in later scans
+    // 
+    //
+    ErrorCodeT
+    LoadScanFunction(
+        const char* CodePath,
+        uint16_t* ScanId
+    );
+
+    //
+    // Order later reads of a file behind the earlier writes that overlap them
+    // 
+    //
+    ErrorCodeT
+    FenceFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        PollT* Poll
+    );
+
     //
     // Async read from a file
     // 
@@ -160,6 +314,37 @@ public:
         PollT* Poll
     );
 
+    //
+    // Async read of the item of a key in the cache table of the back end
+    // 
+    //
+    ErrorCodeT
+    ReadFileByKey(
+        const CacheKeyT* Key,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        ContextT Context,
+        PollT* Poll
+    );
+
+    //
+    // Async scan of Bytes of a file from Offset in records of RecordBytes,
+    // which reads only what the scan function keeps of the records into the destination
+    // 
+    //
+    ErrorCodeT
+    ScanFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        FileIOSizeT RecordBytes,
+        uint16_t ScanId,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        ContextT Context,
+        PollT* Poll
+    );
+
     //
     // Async read from a file with scattering
     // 
@@ -205,6 +390,26 @@ public:
         PollT* Poll
     );
 
+    //
+    // Async reads and writes of a batch of file I/O slots on a poll
+    // 
+    //
+    ErrorCodeT
+    SubmitFileIOBatch(
+        FileIOT** IOs,
+        size_t NumIOs,
+        PollT* Poll
+    );
+
+    //
+    // Publish the reads and writes staged on a poll
+    // 
+    //
+    ErrorCodeT
+    FlushRequests(
+        PollT* Poll
+    );
+
     //
     // Get file properties by file id
     // 
@@ -245,6 +450,38 @@ public:
         const char* NewFileName
     );
 
+    //
+    // Apply a batch of updates, in order, to the cache table the back end serves offloaded reads from;
+    // stops at the first update that fails and returns its error
+    //
+    //
+    ErrorCodeT
+    UpdateCacheTable(
+        const CacheUpdateT* Updates,
+        size_t NumUpdates
+    );
+
+    //
+    // Send a batch of control operations without waiting for the ack
+    //
+    //
+    ErrorCodeT
+    SubmitControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps,
+        DirIdT DirId
+    );
+
+    //
+    // Check for the ack of the outstanding batch, or wait for it
+    //
+    //
+    ErrorCodeT
+    PollControlBatch(
+        bool Wait,
+        bool* Completed
+    );
+
     //
     // Retrieve a response from the response ring
     // 
@@ -257,14 +494,28 @@ public:
         RequestIdT* ReqId
     );
 
+    //
+    // Retrieve a response from the response ring through a cursor
+    //
+    //
+    ErrorCodeT
+    GetResponseWithCursor(
+        PollT* Poll,
+        ResponseCursorT* Cursor,
+        size_t WaitTime,
+        FileIOSizeT* BytesServiced,
+        RequestIdT* ReqId
+    );
+
 #ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
     //
-    // Retrieve a response from the cached batch
+    // Retrieve a response from the batch of a cursor
     //
     //
     ErrorCodeT
     GetResponseFromCachedBatch(
         PollT* Poll,
+        ResponseCursorT* Cursor,
         FileIOSizeT* BytesServiced,
         RequestIdT* ReqId
     );
@@ -104,6 +104,105 @@ public:
         FileSizeT* FileSize
     ) = 0;
 
+    //
+    // Flush the device under a file
+    // 
+    //
+    virtual ErrorCodeT
+    FlushFile(
+        FileIdT FileId
+    ) = 0;
+
+    //
+    // Limit the I/O of a file, or lift the limit if BytesPerSecond is 0
+    // 
+    //
+    virtual ErrorCodeT
+    SetFileQoS(
+        FileIdT FileId,
+        uint64_t BytesPerSecond,
+        uint64_t BurstBytes,
+        uint32_t Weight
+    ) = 0;
+
+    //
+    // Share the segments of a file with a new read-only file, the snapshot of the file
+    // 
+    //
+    virtual ErrorCodeT
+    CreateSnapshot(
+        FileIdT FileId,
+        FileIdT SnapshotFileId,
+        DirIdT DirId,
+        const char* SnapshotName
+    ) = 0;
+
+    //
+    // Tell the back end how a file will be read
+    // 
+    //
+    virtual ErrorCodeT
+    SetFileAccessHint(
+        FileIdT FileId,
+        FileAccessHint Hint,
+        FileSizeT Offset,
+        FileSizeT Bytes
+    ) = 0;
+
+    //
+    // Take or renew the lease of a file on the back end, which says how long it lasts
+    // 
+    //
+    virtual ErrorCodeT
+    AcquireFileLease(
+        FileIdT FileId,
+        FileLeaseMode Mode,
+        uint32_t* TermMs
+    ) = 0;
+
+    //
+    // Give back the lease of a file
+    // 
+    //
+    virtual ErrorCodeT
+    ReleaseFileLease(
+        FileIdT FileId
+    ) = 0;
+
+    //
+    // Renew the leases of the front end on the back end, except the revoked ones, whose files go in Revoked
+    // 
+    //
+    virtual ErrorCodeT
+    RenewFileLeases(
+        FileIdT* Revoked,
+        uint32_t MaxRevoked,
+        uint32_t* NumRevoked,
+        uint32_t* TermMs
+    ) = 0;
+
+    //
+    // Compile and load a scan function on the back end, which names it by ScanId in later scans
+    // 
+    //
+    virtual ErrorCodeT
+    LoadScanFunction(
+        const char* CodePath,
+        uint16_t* ScanId
+    ) = 0;
+
+    //
+    // Order later reads of a file behind the earlier writes that overlap them
+    // 
+    //
+    virtual ErrorCodeT
+    FenceFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        PollT* Poll
+    ) = 0;
+
     //
     // Async read from a file
     // 
@@ -119,6 +218,37 @@ public:
         PollT* Poll
     ) = 0;
 
+    //
+    // Async read of the item of a key in the cache table of the back end
+    // 
+    //
+    virtual ErrorCodeT
+    ReadFileByKey(
+        const CacheKeyT* Key,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        ContextT Context,
+        PollT* Poll
+    ) = 0;
+
+    //
+    // Async scan of Bytes of a file from Offset in records of RecordBytes,
+    // which reads only what the scan function keeps of the records into the destination
+    // 
+    //
+    virtual ErrorCodeT
+    ScanFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        FileIOSizeT RecordBytes,
+        uint16_t ScanId,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        ContextT Context,
+        PollT* Poll
+    ) = 0;
+
     //
     // Async read from a file with scattering
     // 
@@ -164,6 +294,26 @@ public:
         PollT* Poll
     ) = 0;
 
+    //
+    // Async reads and writes of a batch of file I/O slots on a poll
+    // 
+    //
+    virtual ErrorCodeT
+    SubmitFileIOBatch(
+        FileIOT** IOs,
+        size_t NumIOs,
+        PollT* Poll
+    ) = 0;
+
+    //
+    // Publish the reads and writes staged on a poll
+    // 
+    //
+    virtual ErrorCodeT
+    FlushRequests(
+        PollT* Poll
+    ) = 0;
+
     //
     // Get file properties by file id
     // 
@@ -204,6 +354,39 @@ public:
         const char* NewFileName
     ) = 0;
 
+    //
+    // Apply a batch of updates, in order, to the cache table the back end serves offloaded reads from;
+    // stops at the first update that fails and returns its error
+    //
+    //
+    virtual ErrorCodeT
+    UpdateCacheTable(
+        const CacheUpdateT* Updates,
+        size_t NumUpdates
+    ) = 0;
+
+    //
+    // Send a batch of control operations, whose files the front end has resolved to ids, without waiting for the ack;
+    // one batch is outstanding at a time
+    //
+    //
+    virtual ErrorCodeT
+    SubmitControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps,
+        DirIdT DirId
+    ) = 0;
+
+    //
+    // Check for the ack of the outstanding batch, or wait for it, and set the results of its operations
+    //
+    //
+    virtual ErrorCodeT
+    PollControlBatch(
+        bool Wait,
+        bool* Completed
+    ) = 0;
+
     //
     // Retrieve a response
     // 
@@ -3,72 +3,378 @@
  * Licensed under the MIT License
  */
 
+#include <chrono>
+#include <new>
 #include <string.h>
 
 #include "DDSBackEndBridgeForLocalMemory.h"
 
 namespace DDS_FrontEnd {
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
+DDSBackEndBridgeForLocalMemory::DDSBackEndBridgeForLocalMemory()
+    : CommittedBytes(0), Stopping(false), ControlBatchOutstanding(false), ControlBatchResult(DDS_ERROR_CODE_SUCCESS) {
+    for (size_t t = 0; t != DDS_LOCAL_MEMORY_IO_THREADS; t++) {
+        IOThreads[t] = nullptr;
+    }
+}
+
+DDSBackEndBridgeForLocalMemory::~DDSBackEndBridgeForLocalMemory() {
+    Disconnect();
+}
+
+//
+// Connect to the backend
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::Connect() {
+    Stopping = false;
+
+    for (size_t t = 0; t != DDS_LOCAL_MEMORY_IO_THREADS; t++) {
+        if (!IOThreads[t]) {
+            IOThreads[t] = new (std::nothrow) std::thread(&DDSBackEndBridgeForLocalMemory::IOThreadLoop, this);
+            if (!IOThreads[t]) {
+                Disconnect();
+                return DDS_ERROR_CODE_OUT_OF_MEMORY;
+            }
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Disconnect from the backend
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::Disconnect() {
+    {
+        std::lock_guard<std::mutex> lock(ReadsLock);
+        Stopping = true;
+    }
+    ReadsSignal.notify_all();
+
+    for (size_t t = 0; t != DDS_LOCAL_MEMORY_IO_THREADS; t++) {
+        if (IOThreads[t]) {
+            IOThreads[t]->join();
+            delete IOThreads[t];
+            IOThreads[t] = nullptr;
+        }
+    }
+
+    //
+    // Reads and writes still copying keep their files until they are done
+    //
+    //
+    for (size_t id = 0; id != Files.Capacity(); id++) {
+        LocalFileT* file;
+        {
+            std::lock_guard<std::mutex> lock(FilesLock);
+            file = Files[id];
+            Files[id] = nullptr;
+        }
+        if (file) {
+            DereferenceFile(file);
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
 //
-// A callback for back end
+// Serve pending reads until the bridge disconnects
 //
 //
 void
-BackEndReadWriteCallbackHandler(
-    ErrorCodeT ErrorCode,
-    FileIOSizeT BytesServiced,
-    ContextT Context
-) {
-    FileIOT* pIO = (FileIOT*)Context;
+DDSBackEndBridgeForLocalMemory::IOThreadLoop() {
+    while (true) {
+        LocalReadT read;
+
+        {
+            std::unique_lock<std::mutex> lock(ReadsLock);
+            ReadsSignal.wait(lock, [this] { return Stopping || !PendingReads.empty(); });
+
+            if (PendingReads.empty()) {
+                return;
+            }
 
-    if (pIO->AppCallback) {
-        pIO->AppCallback(
-            ErrorCode,
-            BytesServiced,
-            pIO->Context
-        );
+            read = PendingReads.front();
+            PendingReads.pop_front();
+        }
 
-        pIO->IsComplete = true;
+        ExecuteRead(&read);
     }
-    else {
-        pIO->IsReadyForPoll = true;
+}
+
+//
+// Hold a file of the table for a copy, so that deleting the file meanwhile doesn't unmap it under the copy
+//
+//
+LocalFileT*
+DDSBackEndBridgeForLocalMemory::ReferenceFile(
+    FileIdT FileId
+) {
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (file) {
+        file->References.fetch_add(1, std::memory_order_relaxed);
     }
+
+    return file;
 }
 
-DDSBackEndBridgeForLocalMemory::DDSBackEndBridgeForLocalMemory()
-    : BackEnd(NULL) { }
+//
+// Release a file; the last release gives back its memory
+//
+//
+void
+DDSBackEndBridgeForLocalMemory::DereferenceFile(
+    LocalFileT* File
+) {
+    if (File->References.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    CommittedBytes -= File->CommittedBytes;
+    UnmapViewOfFile(File->Base);
+    CloseHandle(File->Mapping);
+    delete File;
+}
 
 //
-// Connect to the backend
+// Commit the memory of a file up to a size
 //
 //
 ErrorCodeT
-DDSBackEndBridgeForLocalMemory::Connect() {
-    if (!BackEnd) {
-        BackEnd = new DDS_BackEnd::BackEndInMemory();
+DDSBackEndBridgeForLocalMemory::CommitFile(
+    LocalFileT* File,
+    FileSizeT Size
+) {
+    if (Size > DDS_LOCAL_MEMORY_MAX_FILE_BYTES) {
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+    FileSizeT target = (Size + DDS_LOCAL_MEMORY_COMMIT_BYTES - 1) / DDS_LOCAL_MEMORY_COMMIT_BYTES * DDS_LOCAL_MEMORY_COMMIT_BYTES;
+    if (target > DDS_LOCAL_MEMORY_MAX_FILE_BYTES) {
+        target = DDS_LOCAL_MEMORY_MAX_FILE_BYTES;
+    }
+
+    if (target <= File->CommittedBytes) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    FileSizeT growth = target - File->CommittedBytes;
+    if (CommittedBytes + growth > DDS_LOCAL_MEMORY_CAPACITY_BYTES) {
+        return DDS_ERROR_CODE_STORAGE_OUT_OF_SPACE;
+    }
+
+    if (!VirtualAlloc(File->Base + File->CommittedBytes, (SIZE_T)growth, MEM_COMMIT, PAGE_READWRITE)) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
     }
 
+    File->CommittedBytes = target;
+    CommittedBytes += growth;
+
     return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
-// Disconnect from the backend
+// Copy into a file, extending it if needed; an append is copied to the end of the file,
+// which AppendedOffset takes
 //
 //
 ErrorCodeT
-DDSBackEndBridgeForLocalMemory::Disconnect() {
-    if (BackEnd) {
-        delete BackEnd;
-        BackEnd = nullptr;
+DDSBackEndBridgeForLocalMemory::WriteToFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    BufferT SourceBuffer,
+    BufferT* SourceBufferArray,
+    FileIOSizeT BytesToWrite,
+    FileIOSizeT* BytesWritten,
+    FileSizeT* AppendedOffset
+) {
+    *BytesWritten = 0;
+
+    LocalFileT* file = ReferenceFile(FileId);
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    //
+    // An append takes the end of the file and grows it in one step, so appends never overlap
+    //
+    //
+    if (Offset == BUFF_MSG_REQUEST_OFFSET_APPEND) {
+        std::lock_guard<std::mutex> lock(FilesLock);
+
+        Offset = file->FileSize.load(std::memory_order_relaxed);
+        ErrorCodeT result = CommitFile(file, Offset + BytesToWrite);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            DereferenceFile(file);
+            return result;
+        }
+
+        file->FileSize.store(Offset + BytesToWrite, std::memory_order_release);
+        *AppendedOffset = Offset;
     }
 
+    FileSizeT end = Offset + BytesToWrite;
+    if (end > file->FileSize.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(FilesLock);
+
+        ErrorCodeT result = CommitFile(file, end);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            DereferenceFile(file);
+            return result;
+        }
+
+        if (end > file->FileSize.load(std::memory_order_relaxed)) {
+            file->FileSize.store(end, std::memory_order_release);
+        }
+    }
+
+    if (SourceBuffer) {
+        memcpy(file->Base + Offset, SourceBuffer, BytesToWrite);
+    }
+    else {
+        for (FileIOSizeT copied = 0, p = 0; copied != BytesToWrite; p++) {
+            FileIOSizeT pageBytes = BytesToWrite - copied < DDS_PAGE_SIZE ? BytesToWrite - copied : DDS_PAGE_SIZE;
+            memcpy(file->Base + Offset + copied, SourceBufferArray[p], pageBytes);
+            copied += pageBytes;
+        }
+    }
+
+    file->LastWriteTime = time(NULL);
+    *BytesWritten = BytesToWrite;
+    DereferenceFile(file);
+
     return DDS_ERROR_CODE_SUCCESS;
 }
 
+//
+// Run an atomic operation on a word of a file; the operations of all files run one at a time
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::ExecuteAtomicOp(
+    FileIdT FileId,
+    const BuffMsgF2BAtomicHeader* Op,
+    uint64_t* Prior
+) {
+    if (Op->Offset % sizeof(uint64_t) != 0 ||
+        (Op->Op != BUFF_MSG_ATOMIC_COMPARE_SWAP && Op->Op != BUFF_MSG_ATOMIC_FETCH_ADD)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    if (Op->Offset + sizeof(uint64_t) > file->FileSize.load(std::memory_order_relaxed)) {
+        return DDS_ERROR_CODE_INVALID_FILE_POSITION;
+    }
+
+    uint64_t* word = (uint64_t*)(file->Base + Op->Offset);
+    *Prior = *word;
+    if (Op->Op == BUFF_MSG_ATOMIC_FETCH_ADD) {
+        *word += Op->Operand;
+    }
+    else if (*word == Op->Compare) {
+        *word = Op->Operand;
+    }
+
+    file->LastWriteTime = time(NULL);
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Execute a read and complete it on its poll;
+// reads past the end of the file are cut short like on the DPU
+//
+//
+void
+DDSBackEndBridgeForLocalMemory::ExecuteRead(
+    LocalReadT* Read
+) {
+    LocalFileT* file = ReferenceFile(Read->FileId);
+    if (!file) {
+        CompleteRequest(Read->Poll, Read->IO, DDS_ERROR_CODE_FILE_NOT_FOUND, 0);
+        return;
+    }
+
+    FileSizeT fileSize = file->FileSize.load(std::memory_order_acquire);
+    FileIOSizeT bytesServiced = 0;
+    if (Read->Offset < fileSize) {
+        bytesServiced = fileSize - Read->Offset < Read->Bytes ? (FileIOSizeT)(fileSize - Read->Offset) : Read->Bytes;
+    }
+
+    if (Read->IO->NextCoalesced) {
+        //
+        // Merged reads: give each read of the chain its share
+        //
+        //
+        FileIOSizeT dataOffset = 0;
+        for (FileIOT* io = Read->IO; io; io = io->NextCoalesced) {
+            FileIOSizeT bytes = 0;
+            if (bytesServiced > dataOffset) {
+                bytes = bytesServiced - dataOffset < io->BytesDesired ? bytesServiced - dataOffset : io->BytesDesired;
+                memcpy(io->AppBuffer, file->Base + Read->Offset + dataOffset, bytes);
+            }
+
+            io->CoalescedResult = DDS_ERROR_CODE_SUCCESS;
+            io->CoalescedBytesServiced = bytes;
+            dataOffset += io->BytesDesired;
+        }
+    }
+    else if (Read->DestBuffer) {
+        memcpy(Read->DestBuffer, file->Base + Read->Offset, bytesServiced);
+    }
+    else {
+        for (FileIOSizeT copied = 0, p = 0; copied != bytesServiced; p++) {
+            FileIOSizeT pageBytes = bytesServiced - copied < DDS_PAGE_SIZE ? bytesServiced - copied : DDS_PAGE_SIZE;
+            memcpy(Read->DestBufferArray[p], file->Base + Read->Offset + copied, pageBytes);
+            copied += pageBytes;
+        }
+    }
+
+    file->LastAccessTime = time(NULL);
+    DereferenceFile(file);
+
+    CompleteRequest(Read->Poll, Read->IO, DDS_ERROR_CODE_SUCCESS, bytesServiced);
+}
+
+//
+// Queue a completion on a poll
+//
+//
+void
+DDSBackEndBridgeForLocalMemory::CompleteRequest(
+    PollT* Poll,
+    FileIOT* IO,
+    ErrorCodeT Result,
+    FileIOSizeT BytesServiced
+) {
+    LocalCompletionT completion;
+    completion.RequestId = IO->RequestId;
+    completion.Result = Result;
+    completion.BytesServiced = BytesServiced;
+
+    {
+        std::lock_guard<std::mutex> lock(Poll->CompletionLock);
+        Poll->CompletedRequests.push_back(completion);
+    }
+    Poll->CompletionSignal.notify_one();
+}
+
 //
 // Create a diretory
-// 
+// Note: the directory tree is kept by the front end
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::CreateDirectory(
@@ -76,29 +382,24 @@ DDSBackEndBridgeForLocalMemory::CreateDirectory(
     DirIdT DirId,
     DirIdT ParentId
 ) {
-    return BackEnd->CreateDirectory(
-        PathName,
-        DirId,
-        ParentId
-    );
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Delete a directory
-// 
+// Note: the directory tree is kept by the front end
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::RemoveDirectory(
     DirIdT DirId
 ) {
-    return BackEnd->RemoveDirectory(
-        DirId
-    );
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Create a file
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::CreateFile(
@@ -107,62 +408,272 @@ DDSBackEndBridgeForLocalMemory::CreateFile(
     FileIdT FileId,
     DirIdT DirId
 ) {
-    return BackEnd->CreateFile(
-        FileName,
-        FileAttributes,
-        FileId,
-        DirId
+    LocalFileT* file = new (std::nothrow) LocalFileT();
+    if (!file) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    //
+    // Reserve the address space of the largest file; memory is committed as the file grows
+    //
+    //
+    file->Mapping = CreateFileMappingA(
+        INVALID_HANDLE_VALUE,
+        NULL,
+        PAGE_READWRITE | SEC_RESERVE,
+        (DWORD)(DDS_LOCAL_MEMORY_MAX_FILE_BYTES >> 32),
+        (DWORD)(DDS_LOCAL_MEMORY_MAX_FILE_BYTES & 0xffffffff),
+        NULL
     );
+    if (!file->Mapping) {
+        delete file;
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    file->Base = (char*)MapViewOfFile(file->Mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)DDS_LOCAL_MEMORY_MAX_FILE_BYTES);
+    if (!file->Base) {
+        CloseHandle(file->Mapping);
+        delete file;
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    strncpy(file->FileName, FileName, DDS_MAX_FILE_PATH - 1);
+    file->FileName[DDS_MAX_FILE_PATH - 1] = '\0';
+    file->FileAttributes = FileAttributes;
+    file->DirId = DirId;
+    file->FileSize = 0;
+    file->CommittedBytes = 0;
+    file->References = 1;
+    file->CreationTime = time(NULL);
+    file->LastAccessTime = file->CreationTime;
+    file->LastWriteTime = file->CreationTime;
+
+    std::lock_guard<std::mutex> lock(FilesLock);
+    if (!Files.Reserve(FileId)) {
+        UnmapViewOfFile(file->Base);
+        CloseHandle(file->Mapping);
+        delete file;
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+    Files[FileId] = file;
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Delete a file
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::DeleteFile(
     FileIdT FileId,
     DirIdT DirId
 ) {
-    return BackEnd->DeleteFile(
-        FileId,
-        DirId
-    );
+    LocalFileT* file;
+    {
+        std::lock_guard<std::mutex> lock(FilesLock);
+
+        file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+        if (!file) {
+            return DDS_ERROR_CODE_FILE_NOT_FOUND;
+        }
+        Files[FileId] = nullptr;
+    }
+
+    //
+    // Reads and writes still copying keep the file until they are done
+    //
+    //
+    DereferenceFile(file);
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Change the size of a file
-// 
+// Note: memory stays committed when a file shrinks, so that it can grow again cheaply
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::ChangeFileSize(
     FileIdT FileId,
     FileSizeT NewSize
 ) {
-    return BackEnd->ChangeFileSize(
-        FileId,
-        NewSize
-    );
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    ErrorCodeT result = CommitFile(file, NewSize);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    file->FileSize.store(NewSize, std::memory_order_release);
+    file->LastWriteTime = time(NULL);
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Get file size
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::GetFileSize(
     FileIdT FileId,
     FileSizeT* FileSize
 ) {
-    return BackEnd->GetFileSize(
-        FileId,
-        FileSize
-    );
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    *FileSize = file->FileSize.load(std::memory_order_acquire);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Flush the device under a file; memory has nothing to flush
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::FlushFile(
+    FileIdT FileId
+) {
+    if (FileId >= Files.Capacity() || !Files[FileId]) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Limit the I/O of a file; local memory is not shared with other tenants, so there is nothing to limit
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::SetFileQoS(
+    FileIdT FileId,
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight
+) {
+    if (FileId >= Files.Capacity() || !Files[FileId]) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Take a snapshot of a file; local memory shares no data between files
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::CreateSnapshot(
+    FileIdT FileId,
+    FileIdT SnapshotFileId,
+    DirIdT DirId,
+    const char* SnapshotName
+) {
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+}
+
+//
+// Tell the back end how a file will be read; local memory reads nothing ahead, so hints change nothing
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::SetFileAccessHint(
+    FileIdT FileId,
+    FileAccessHint Hint,
+    FileSizeT Offset,
+    FileSizeT Bytes
+) {
+    if (FileId >= Files.Capacity() || !Files[FileId]) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Take the lease of a file; local memory serves one front end, so its leases are never in the way or revoked
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::AcquireFileLease(
+    FileIdT FileId,
+    FileLeaseMode Mode,
+    uint32_t* TermMs
+) {
+    if (FileId >= Files.Capacity() || !Files[FileId]) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    *TermMs = UINT32_MAX;
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::ReleaseFileLease(
+    FileIdT FileId
+) {
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::RenewFileLeases(
+    FileIdT* Revoked,
+    uint32_t MaxRevoked,
+    uint32_t* NumRevoked,
+    uint32_t* TermMs
+) {
+    *NumRevoked = 0;
+    *TermMs = UINT32_MAX;
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Compile and load a scan function on the back end; local memory runs no scan functions
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::LoadScanFunction(
+    const char* CodePath,
+    uint16_t* ScanId
+) {
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+}
+
+//
+// Order later reads of a file behind the earlier writes that overlap them;
+// writes to local memory are done before they return, so later reads already see them
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::FenceFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    PollT* Poll
+) {
+    if (FileId >= Files.Capacity() || !Files[FileId]) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Async read from a file
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::ReadFile(
@@ -174,20 +685,62 @@ DDSBackEndBridgeForLocalMemory::ReadFile(
     ContextT Context,
     PollT* Poll
 ) {
-    return BackEnd->ReadFile(
-        FileId,
-        Offset,
-        DestBuffer,
-        BytesToRead,
-        BytesRead,
-        (DDS_BackEnd::ReadWriteCallback)BackEndReadWriteCallbackHandler,
-        Context
-    );
+    LocalReadT read;
+    read.Poll = Poll;
+    read.IO = (FileIOT*)Context;
+    read.FileId = FileId;
+    read.Offset = Offset;
+    read.DestBuffer = DestBuffer;
+    read.DestBufferArray = nullptr;
+    read.Bytes = BytesToRead;
+
+    {
+        std::lock_guard<std::mutex> lock(ReadsLock);
+        PendingReads.push_back(read);
+    }
+    ReadsSignal.notify_one();
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Async read of the item of a key in the cache table of the back end;
+// local memory keeps no cache table
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::ReadFileByKey(
+    const CacheKeyT* Key,
+    BufferT DestBuffer,
+    FileIOSizeT BufferSize,
+    ContextT Context,
+    PollT* Poll
+) {
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+}
+
+//
+// Async scan of a file with a scan function; local memory runs no scan functions
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::ScanFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    FileIOSizeT RecordBytes,
+    uint16_t ScanId,
+    BufferT DestBuffer,
+    FileIOSizeT BufferSize,
+    ContextT Context,
+    PollT* Poll
+) {
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
 }
 
 //
 // Async read from a file with scattering
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::ReadFileScatter(
@@ -199,20 +752,29 @@ DDSBackEndBridgeForLocalMemory::ReadFileScatter(
     ContextT Context,
     PollT* Poll
 ) {
-    return BackEnd->ReadFileScatter(
-        FileId,
-        Offset,
-        DestBufferArray,
-        BytesToRead,
-        BytesRead,
-        (DDS_BackEnd::ReadWriteCallback)BackEndReadWriteCallbackHandler,
-        Context
-    );
+    LocalReadT read;
+    read.Poll = Poll;
+    read.IO = (FileIOT*)Context;
+    read.FileId = FileId;
+    read.Offset = Offset;
+    read.DestBuffer = nullptr;
+    read.DestBufferArray = DestBufferArray;
+    read.Bytes = BytesToRead;
+
+    {
+        std::lock_guard<std::mutex> lock(ReadsLock);
+        PendingReads.push_back(read);
+    }
+    ReadsSignal.notify_one();
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
 // Async write to a file
-// 
+// Note: the data is copied before returning, so the source buffer can be reused
+// right away as with the DPU back end; the completion is still delivered by polling
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::WriteFile(
@@ -224,20 +786,28 @@ DDSBackEndBridgeForLocalMemory::WriteFile(
     ContextT Context,
     PollT* Poll
 ) {
-    return BackEnd->WriteFile(
-        FileId,
-        Offset,
-        SourceBuffer,
-        BytesToWrite,
-        BytesWritten,
-        (DDS_BackEnd::ReadWriteCallback)BackEndReadWriteCallbackHandler,
-        Context
-    );
+    FileIOSizeT bytesWritten = 0;
+    ErrorCodeT result;
+
+    if (Offset == BUFF_MSG_REQUEST_OFFSET_ATOMIC) {
+        result = ExecuteAtomicOp(FileId, (const BuffMsgF2BAtomicHeader*)SourceBuffer, &((FileIOT*)Context)->AtomicValue);
+        if (result == DDS_ERROR_CODE_SUCCESS) {
+            bytesWritten = sizeof(uint64_t);
+        }
+    }
+    else {
+        result = WriteToFile(FileId, Offset, SourceBuffer, nullptr, BytesToWrite, &bytesWritten,
+            &((FileIOT*)Context)->Offset);
+    }
+
+    CompleteRequest(Poll, (FileIOT*)Context, result, bytesWritten);
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
 // Async write to a file with gathering
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::WriteFileGather(
@@ -249,94 +819,287 @@ DDSBackEndBridgeForLocalMemory::WriteFileGather(
     ContextT Context,
     PollT* Poll
 ) {
-    return BackEnd->WriteFileGather(
-        FileId,
-        Offset,
-        SourceBufferArray,
-        BytesToWrite,
-        BytesWritten,
-        (DDS_BackEnd::ReadWriteCallback)BackEndReadWriteCallbackHandler,
-        Context
-    );
+    FileIOSizeT bytesWritten;
+    ErrorCodeT result = WriteToFile(FileId, Offset, nullptr, SourceBufferArray, BytesToWrite, &bytesWritten,
+        &((FileIOT*)Context)->Offset);
+
+    CompleteRequest(Poll, (FileIOT*)Context, result, bytesWritten);
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
-// Get file properties by file id
+// Async reads and writes of a batch of file I/O slots on a poll
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::SubmitFileIOBatch(
+    FileIOT** IOs,
+    size_t NumIOs,
+    PollT* Poll
+) {
+    size_t numReads = 0;
+
+    for (size_t i = 0; i != NumIOs; i++) {
+        FileIOT* io = IOs[i];
+
+        if (io->IsRead) {
+            LocalReadT read;
+            read.Poll = Poll;
+            read.IO = io;
+            read.FileId = io->FileId;
+            read.Offset = io->Offset;
+            read.DestBuffer = io->AppBuffer;
+            read.DestBufferArray = nullptr;
+            read.Bytes = io->NextCoalesced ? io->CoalescedBytes : io->BytesDesired;
+
+            std::lock_guard<std::mutex> lock(ReadsLock);
+            PendingReads.push_back(read);
+            numReads++;
+        }
+        else {
+            FileIOSizeT bytesWritten;
+            ErrorCodeT result = WriteToFile(io->FileId, io->Offset, io->AppBuffer, nullptr, io->BytesDesired, &bytesWritten,
+                &io->Offset);
+
+            CompleteRequest(Poll, io, result, bytesWritten);
+        }
+    }
+
+    if (numReads) {
+        ReadsSignal.notify_all();
+    }
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Publish the reads and writes staged on a poll;
+// requests are never staged with local memory
 // 
 //
 ErrorCodeT
+DDSBackEndBridgeForLocalMemory::FlushRequests(
+    PollT* Poll
+) {
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Get file properties by file id
+//
+//
+ErrorCodeT
 DDSBackEndBridgeForLocalMemory::GetFileInformationById(
     FileIdT FileId,
     FilePropertiesT* FileProperties
 ) {
-    DDS_BackEnd::FilePropertiesT fileProperties;
-    ErrorCodeT result = BackEnd->GetFileInformationById(
-        FileId,
-        &fileProperties
-    );
-    strcpy(FileProperties->FileName, fileProperties.FileName);
-    FileProperties->FileSize = fileProperties.FileSize;
-    FileProperties->FileAttributes = fileProperties.FileAttributes;
-    FileProperties->CreationTime = fileProperties.CreationTime;
-    FileProperties->LastAccessTime = fileProperties.LastAccessTime;
-    FileProperties->LastWriteTime = fileProperties.LastWriteTime;
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    strcpy(FileProperties->FileName, file->FileName);
+    FileProperties->FileSize = file->FileSize.load(std::memory_order_acquire);
+    FileProperties->FileAttributes = file->FileAttributes;
+    FileProperties->CreationTime = file->CreationTime;
+    FileProperties->LastAccessTime = file->LastAccessTime;
+    FileProperties->LastWriteTime = file->LastWriteTime;
 
-    return result;
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Get file attributes by file name
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::GetFileAttributes(
     FileIdT FileId,
     FileAttributesT* FileAttributes
 ) {
-    return BackEnd->GetFileAttributes(
-        FileId,
-        FileAttributes
-    );
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    *FileAttributes = file->FileAttributes;
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Get the size of free space on the storage
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::GetStorageFreeSpace(
     FileSizeT* StorageFreeSpace
 ) {
-    return BackEnd->GetStorageFreeSpace(
-        StorageFreeSpace
-    );
+    *StorageFreeSpace = DDS_LOCAL_MEMORY_CAPACITY_BYTES - CommittedBytes;
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
 // Move an existing file or a directory,
 // including its children
-// 
+//
 //
 ErrorCodeT
 DDSBackEndBridgeForLocalMemory::MoveFile(
     FileIdT FileId,
     const char* NewFileName
 ) {
-    return BackEnd->MoveFile(FileId, NewFileName);
+    std::lock_guard<std::mutex> lock(FilesLock);
+
+    LocalFileT* file = FileId < Files.Capacity() ? Files[FileId] : nullptr;
+    if (!file) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    strncpy(file->FileName, NewFileName, DDS_MAX_FILE_PATH - 1);
+    file->FileName[DDS_MAX_FILE_PATH - 1] = '\0';
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Apply a batch of updates to the cache table;
+// reads are served from memory without one, so there is nothing to update
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::UpdateCacheTable(
+    const CacheUpdateT* Updates,
+    size_t NumUpdates
+) {
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Run a batch of control operations
+// The operations run here, in order until one fails, as the DPU back end runs them
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::SubmitControlBatch(
+    ControlOpT* Ops,
+    size_t NumOps,
+    DirIdT DirId
+) {
+    if (NumOps == 0 || NumOps > CTRL_MSG_BATCH_MAX_OPS) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    if (ControlBatchOutstanding) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    for (size_t o = 0; o != NumOps; o++) {
+        ControlOpT* op = &Ops[o];
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            op->Result = DDS_ERROR_CODE_NO_COMPLETION;
+            continue;
+        }
+
+        switch (op->Type) {
+            case CONTROL_OP_CREATE_FILE:
+                op->Result = CreateFile(op->FileName, op->FileAttributes, op->FileId, DirId);
+                break;
+            case CONTROL_OP_DELETE_FILE:
+                op->Result = DeleteFile(op->FileId, DirId);
+                break;
+            case CONTROL_OP_CHANGE_FILE_SIZE:
+                op->Result = ChangeFileSize(op->FileId, op->FileSize);
+                break;
+            case CONTROL_OP_GET_FILE_SIZE:
+                op->Result = GetFileSize(op->FileId, &op->FileSize);
+                break;
+            case CONTROL_OP_FLUSH_FILE:
+                op->Result = FlushFile(op->FileId);
+                break;
+            default:
+                op->Result = DDS_ERROR_CODE_INVALID_PARAM;
+                break;
+        }
+        result = op->Result;
+    }
+
+    ControlBatchOutstanding = true;
+    ControlBatchResult = result;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Return the result of the batch that was run
+//
+//
+ErrorCodeT
+DDSBackEndBridgeForLocalMemory::PollControlBatch(
+    bool Wait,
+    bool* Completed
+) {
+    *Completed = ControlBatchOutstanding;
+
+    if (!ControlBatchOutstanding) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    ControlBatchOutstanding = false;
+
+    return ControlBatchResult;
 }
 
 //
 // Retrieve a response
-// 
+// Like the DPU back end, spin for the window given by the poll policy before blocking
+//
 //
 ErrorCodeT
-GetResponse(
+DDSBackEndBridgeForLocalMemory::GetResponse(
     PollT* Poll,
     size_t WaitTime,
     FileIOSizeT* BytesServiced,
     RequestIdT* ReqId
-) { }
+) {
+    std::unique_lock<std::mutex> lock(Poll->CompletionLock);
+
+    if (Poll->CompletedRequests.empty() && WaitTime > 0) {
+        auto spinEnd = std::chrono::steady_clock::now() + std::chrono::nanoseconds(Poll->SpinWindowNs);
+
+        while (Poll->CompletedRequests.empty() && std::chrono::steady_clock::now() < spinEnd) {
+            lock.unlock();
+            YieldProcessor();
+            lock.lock();
+        }
+
+        auto hasCompletion = [Poll] { return !Poll->CompletedRequests.empty(); };
+        if (WaitTime == INFINITE) {
+            Poll->CompletionSignal.wait(lock, hasCompletion);
+        }
+        else {
+            Poll->CompletionSignal.wait_for(lock, std::chrono::milliseconds(WaitTime), hasCompletion);
+        }
+    }
 
-#endif
+    if (Poll->CompletedRequests.empty()) {
+        return DDS_ERROR_CODE_NO_COMPLETION;
+    }
+
+    LocalCompletionT completion = Poll->CompletedRequests.front();
+    Poll->CompletedRequests.pop_front();
+
+    *ReqId = completion.RequestId;
+    *BytesServiced = completion.BytesServiced;
 
-}
\ No newline at end of file
+    return completion.Result;
+}
+
+}
@@ -5,7 +5,14 @@
 
 #pragma once
 
-#include "BackEndInMemory.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <windows.h>
+
 #include "DDSBackEndBridgeBase.h"
 
 #undef CreateDirectory
@@ -21,27 +28,152 @@
 namespace DDS_FrontEnd {
 
 //
-// A callback for back end
+// A file of the local-memory back end: a mapping of DDS_LOCAL_MEMORY_MAX_FILE_BYTES
+// that is reserved at creation and committed as the file grows;
+// the mapping goes once neither the table nor a copy in progress holds the file
+//
+//
+typedef struct LocalFileT {
+    char FileName[DDS_MAX_FILE_PATH];
+    FileAttributesT FileAttributes;
+    DirIdT DirId;
+    std::atomic<FileSizeT> FileSize;
+    FileSizeT CommittedBytes;
+    HANDLE Mapping;
+    char* Base;
+    std::atomic<uint32_t> References;
+    time_t CreationTime;
+    time_t LastAccessTime;
+    time_t LastWriteTime;
+} LocalFileT;
+
+//
+// A read handed to the back-end threads
 //
 //
-void
-BackEndReadWriteCallbackHandler(
-    ErrorCodeT ErrorCode,
-    FileIOSizeT BytesServiced,
-    ContextT Context
-);
+typedef struct LocalReadT {
+    PollT* Poll;
+    FileIOT* IO;
+    FileIdT FileId;
+    FileSizeT Offset;
+    BufferT DestBuffer;
+    BufferT* DestBufferArray;
+    FileIOSizeT Bytes;
+} LocalReadT;
 
 //
-// Connector that fowards requests to and receives responses from the back end
+// Connector that serves requests from memory on the host, as a baseline for the DPU back end:
+// files live in memory mappings, reads are served by a pool of threads,
+// and completions are delivered through the polls like responses from the DPU
 //
 //
-class DDSBackEndBridgeForLocalMemory : public DDSBackEndBridgeBase {
+class DDSBackEndBridgeForLocalMemory final : public DDSBackEndBridgeBase {
 private:
-	DDS_BackEnd::BackEndInMemory* BackEnd;
+    IdTable<LocalFileT*, DDS_MAX_FILES, DDS_FILE_TABLE_CHUNK_ENTRIES> Files;
+    std::mutex FilesLock;
+    std::atomic<FileSizeT> CommittedBytes;
+
+    //
+    // Pool of threads serving reads
+    //
+    //
+    std::thread* IOThreads[DDS_LOCAL_MEMORY_IO_THREADS];
+    std::mutex ReadsLock;
+    std::condition_variable ReadsSignal;
+    std::deque<LocalReadT> PendingReads;
+    bool Stopping;
+
+    //
+    // A control batch runs as it is submitted, and its result waits for PollControlBatch
+    //
+    //
+    bool ControlBatchOutstanding;
+    ErrorCodeT ControlBatchResult;
+
+    //
+    // Serve pending reads until the bridge disconnects
+    //
+    //
+    void
+    IOThreadLoop();
+
+    //
+    // Hold a file of the table for a copy, or release one; the last release unmaps the file
+    //
+    //
+    LocalFileT*
+    ReferenceFile(
+        FileIdT FileId
+    );
+
+    void
+    DereferenceFile(
+        LocalFileT* File
+    );
+
+    //
+    // Commit the memory of a file up to a size
+    //
+    //
+    ErrorCodeT
+    CommitFile(
+        LocalFileT* File,
+        FileSizeT Size
+    );
+
+    //
+    // Copy into a file, extending it if needed; an append is copied to the end of the file,
+    // which AppendedOffset takes
+    //
+    //
+    ErrorCodeT
+    WriteToFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        BufferT SourceBuffer,
+        BufferT* SourceBufferArray,
+        FileIOSizeT BytesToWrite,
+        FileIOSizeT* BytesWritten,
+        FileSizeT* AppendedOffset
+    );
+
+    //
+    // Run an atomic operation on a word of a file, which Prior takes the value of
+    //
+    //
+    ErrorCodeT
+    ExecuteAtomicOp(
+        FileIdT FileId,
+        const BuffMsgF2BAtomicHeader* Op,
+        uint64_t* Prior
+    );
+
+    //
+    // Execute a read and complete it on its poll
+    //
+    //
+    void
+    ExecuteRead(
+        LocalReadT* Read
+    );
+
+    //
+    // Queue a completion on a poll
+    //
+    //
+    void
+    CompleteRequest(
+        PollT* Poll,
+        FileIOT* IO,
+        ErrorCodeT Result,
+        FileIOSizeT BytesServiced
+    );
 
 public:
     DDSBackEndBridgeForLocalMemory();
 
+    ~DDSBackEndBridgeForLocalMemory();
+
     //
     // Connect to the backend
     //
@@ -118,6 +250,105 @@ public:
         FileSizeT* FileSize
     );
 
+    //
+    // Flush the device under a file
+    // 
+    //
+    ErrorCodeT
+    FlushFile(
+        FileIdT FileId
+    );
+
+    //
+    // Limit the I/O of a file, or lift the limit if BytesPerSecond is 0
+    // 
+    //
+    ErrorCodeT
+    SetFileQoS(
+        FileIdT FileId,
+        uint64_t BytesPerSecond,
+        uint64_t BurstBytes,
+        uint32_t Weight
+    );
+
+    //
+    // Share the segments of a file with a new read-only file, the snapshot of the file
+    // 
+    //
+    ErrorCodeT
+    CreateSnapshot(
+        FileIdT FileId,
+        FileIdT SnapshotFileId,
+        DirIdT DirId,
+        const char* SnapshotName
+    );
+
+    //
+    // Tell the back end how a file will be read
+    // 
+    //
+    ErrorCodeT
+    SetFileAccessHint(
+        FileIdT FileId,
+        FileAccessHint Hint,
+        FileSizeT Offset,
+        FileSizeT Bytes
+    );
+
+    //
+    // Take or renew the lease of a file on the back end, which says how long it lasts
+    // 
+    //
+    ErrorCodeT
+    AcquireFileLease(
+        FileIdT FileId,
+        FileLeaseMode Mode,
+        uint32_t* TermMs
+    );
+
+    //
+    // Give back the lease of a file
+    // 
+    //
+    ErrorCodeT
+    ReleaseFileLease(
+        FileIdT FileId
+    );
+
+    //
+    // Renew the leases of the front end on the back end, except the revoked ones, whose files go in Revoked
+    // 
+    //
+    ErrorCodeT
+    RenewFileLeases(
+        FileIdT* Revoked,
+        uint32_t MaxRevoked,
+        uint32_t* NumRevoked,
+        uint32_t* TermMs
+    );
+
+    //
+    // Compile and load a scan function on the back end, which names it by ScanId in later scans
+    // 
+    //
+    ErrorCodeT
+    LoadScanFunction(
+        const char* CodePath,
+        uint16_t* ScanId
+    );
+
+    //
+    // Order later reads of a file behind the earlier writes that overlap them
+    // 
+    //
+    ErrorCodeT
+    FenceFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        PollT* Poll
+    );
+
     //
     // Async read from a file
     // 
@@ -133,6 +364,37 @@ public:
         PollT* Poll
     );
 
+    //
+    // Async read of the item of a key in the cache table of the back end
+    // 
+    //
+    ErrorCodeT
+    ReadFileByKey(
+        const CacheKeyT* Key,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        ContextT Context,
+        PollT* Poll
+    );
+
+    //
+    // Async scan of Bytes of a file from Offset in records of RecordBytes,
+    // which reads only what the scan function keeps of the records into the destination
+    // 
+    //
+    ErrorCodeT
+    ScanFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        FileIOSizeT RecordBytes,
+        uint16_t ScanId,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        ContextT Context,
+        PollT* Poll
+    );
+
     //
     // Async read from a file with scattering
     // 
@@ -178,6 +440,26 @@ public:
         PollT* Poll
     );
 
+    //
+    // Async reads and writes of a batch of file I/O slots on a poll
+    // 
+    //
+    ErrorCodeT
+    SubmitFileIOBatch(
+        FileIOT** IOs,
+        size_t NumIOs,
+        PollT* Poll
+    );
+
+    //
+    // Publish the reads and writes staged on a poll
+    // 
+    //
+    ErrorCodeT
+    FlushRequests(
+        PollT* Poll
+    );
+
     //
     // Get file properties by file id
     // 
@@ -218,6 +500,38 @@ public:
         const char* NewFileName
     );
 
+    //
+    // Apply a batch of updates, in order, to the cache table the back end serves offloaded reads from;
+    // stops at the first update that fails and returns its error
+    //
+    //
+    ErrorCodeT
+    UpdateCacheTable(
+        const CacheUpdateT* Updates,
+        size_t NumUpdates
+    );
+
+    //
+    // Run a batch of control operations
+    //
+    //
+    ErrorCodeT
+    SubmitControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps,
+        DirIdT DirId
+    );
+
+    //
+    // Return the result of the batch that was run
+    //
+    //
+    ErrorCodeT
+    PollControlBatch(
+        bool Wait,
+        bool* Completed
+    );
+
     //
     // Retrieve a response
     // 
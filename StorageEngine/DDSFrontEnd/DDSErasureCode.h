@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace DDS_FrontEnd {
+
+//
+// Reed-Solomon coding of the rows of stripe units for up to two parity stripes (SetErasureCoding),
+// over GF(2^8) with the polynomial 0x11d and generator 2: P is the XOR of the data units of a row,
+// and Q the sum of 2^j times data unit j; any two lost units of a row can be reconstructed from the rest.
+// Bytes are coded eight at a time, multiplying by 2 with shifts and masks, and by other constants through
+// the tables of logarithms, which only reconstruction needs
+//
+//
+
+#define DDS_ERASURE_MAX_PARITY_STRIPES 2
+
+//
+// Logarithms and powers of 2 in GF(2^8); Exp is doubled so that sums of logarithms need no reduction
+//
+//
+struct GFTablesT {
+    uint8_t Exp[512];
+    uint8_t Log[256];
+
+    GFTablesT() {
+        unsigned x = 1;
+        for (unsigned i = 0; i != 255; i++) {
+            Exp[i] = (uint8_t)x;
+            Exp[i + 255] = (uint8_t)x;
+            Log[x] = (uint8_t)i;
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11d;
+            }
+        }
+        Exp[510] = Exp[0];
+        Exp[511] = Exp[1];
+        Log[0] = 0;
+    }
+};
+
+inline const GFTablesT&
+GFTables() {
+    static const GFTablesT tables;
+    return tables;
+}
+
+//
+// Multiply each of the eight bytes of a word by 2
+//
+//
+inline uint64_t
+GFMul2x8(
+    uint64_t X
+) {
+    uint64_t high = X & 0x8080808080808080ULL;
+    return ((X << 1) & 0xfefefefefefefefeULL) ^ ((high >> 7) * 0x1d);
+}
+
+//
+// 2^Power, for a power in [0, 255)
+//
+//
+inline uint8_t
+GFPow2(
+    unsigned Power
+) {
+    return GFTables().Exp[Power % 255];
+}
+
+//
+// A / B, for a non-zero B
+//
+//
+inline uint8_t
+GFDiv(
+    uint8_t A,
+    uint8_t B
+) {
+    const GFTablesT& tables = GFTables();
+    return A ? tables.Exp[tables.Log[A] + 255 - tables.Log[B]] : 0;
+}
+
+//
+// Out[i] = Factor * In[i] ^ (Accumulate ? Out[i] : 0)
+//
+//
+inline void
+GFMulBytes(
+    uint8_t Factor,
+    const char* In,
+    char* Out,
+    size_t Bytes,
+    bool Accumulate
+) {
+    const GFTablesT& tables = GFTables();
+    uint8_t row[256];
+    row[0] = 0;
+    for (unsigned b = 1; b != 256; b++) {
+        row[b] = Factor ? tables.Exp[tables.Log[b] + tables.Log[Factor]] : 0;
+    }
+
+    for (size_t i = 0; i != Bytes; i++) {
+        uint8_t product = row[(uint8_t)In[i]];
+        Out[i] = (char)(Accumulate ? (uint8_t)Out[i] ^ product : product);
+    }
+}
+
+//
+// P and, if given, Q of the NumData units at Units, skipping the units in SkipMask as if they were zeros;
+// Bytes is a multiple of 8
+//
+//
+inline void
+ComputeParity(
+    const char* const* Units,
+    size_t NumData,
+    uint32_t SkipMask,
+    char* P,
+    char* Q,
+    size_t Bytes
+) {
+    for (size_t w = 0; w < Bytes; w += sizeof(uint64_t)) {
+        uint64_t p = 0;
+        uint64_t q = 0;
+        for (size_t j = NumData; j-- != 0;) {
+            uint64_t d = 0;
+            if (!(SkipMask & (1u << j))) {
+                memcpy(&d, Units[j] + w, sizeof(uint64_t));
+            }
+            p ^= d;
+            q = GFMul2x8(q) ^ d;
+        }
+        memcpy(P + w, &p, sizeof(uint64_t));
+        if (Q) {
+            memcpy(Q + w, &q, sizeof(uint64_t));
+        }
+    }
+}
+
+//
+// Reconstruct in place the data units in LostMask of a row whose NumData data units are followed at Units
+// by its NumParity parity units, of which those in LostMask are lost too;
+// Scratch holds 2 * Bytes; false if more units are lost than the parity covers
+//
+//
+inline bool
+ReconstructUnits(
+    char* const* Units,
+    size_t NumData,
+    size_t NumParity,
+    uint32_t LostMask,
+    char* Scratch,
+    size_t Bytes
+) {
+    uint32_t dataMask = (1u << NumData) - 1;
+    uint32_t lostData = LostMask & dataMask;
+    bool hasP = NumParity >= 1 && !(LostMask & (1u << NumData));
+    bool hasQ = NumParity >= 2 && !(LostMask & (1u << (NumData + 1)));
+
+    if (!lostData) {
+        return true;
+    }
+
+    size_t x = 0;
+    while (!(lostData & (1u << x))) {
+        x++;
+    }
+    uint32_t others = lostData & ~(1u << x);
+    char* partialP = Scratch;
+    char* partialQ = Scratch + Bytes;
+
+    //
+    // The parity of the units left, so that P ^ partialP is the sum of the lost units, and Q ^ partialQ their weighted sum
+    //
+    //
+    ComputeParity(Units, NumData, lostData, partialP, hasQ ? partialQ : nullptr, Bytes);
+
+    if (!others && hasP) {
+        const char* p = Units[NumData];
+        for (size_t i = 0; i != Bytes; i++) {
+            Units[x][i] = p[i] ^ partialP[i];
+        }
+        return true;
+    }
+
+    if (!others && hasQ) {
+        //
+        // D_x = (Q ^ partialQ) / 2^x
+        //
+        //
+        const char* q = Units[NumData + 1];
+        for (size_t i = 0; i != Bytes; i++) {
+            partialQ[i] ^= q[i];
+        }
+        GFMulBytes(GFDiv(1, GFPow2((unsigned)x)), partialQ, Units[x], Bytes, false);
+        return true;
+    }
+
+    if (!hasP || !hasQ || (others & (others - 1))) {
+        return false;
+    }
+
+    //
+    // Two data units x < y: with g = 2^(y - x),
+    // D_x = g / (g ^ 1) * (P ^ partialP) ^ 2^-x / (g ^ 1) * (Q ^ partialQ), and D_y = D_x ^ P ^ partialP
+    //
+    //
+    size_t y = x + 1;
+    while (!(others & (1u << y))) {
+        y++;
+    }
+    const char* p = Units[NumData];
+    const char* q = Units[NumData + 1];
+    for (size_t i = 0; i != Bytes; i++) {
+        partialP[i] ^= p[i];
+        partialQ[i] ^= q[i];
+    }
+
+    uint8_t g = GFPow2((unsigned)(y - x));
+    uint8_t a = GFDiv(g, g ^ 1);
+    uint8_t b = GFDiv(GFDiv(1, GFPow2((unsigned)x)), g ^ 1);
+    GFMulBytes(a, partialP, Units[x], Bytes, false);
+    GFMulBytes(b, partialQ, Units[x], Bytes, true);
+    for (size_t i = 0; i != Bytes; i++) {
+        Units[y][i] = Units[x][i] ^ partialP[i];
+    }
+
+    return true;
+}
+
+}
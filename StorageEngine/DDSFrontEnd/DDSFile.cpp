@@ -3,9 +3,12 @@
  * Licensed under the MIT License
  */
 
+#include <chrono>
 #include <string.h>
 
 #include "DDSFile.h"
+#include "DDSFileCache.h"
+#include "DDSFrontEndConfig.h"
 
 namespace DDS_FrontEnd {
 
@@ -18,11 +21,21 @@ DDSFile::DDSFile() {
     this->Properties.LastAccessTime = time(NULL);
     this->Properties.LastWriteTime = time(NULL);
     this->Properties.FileSize = 0;
+    this->Size = 0;
+    this->SizeLeaseStart = 0;
     this->Properties.Position = 0;
     this->Properties.Access = 0;
     this->Properties.ShareMode = 0;
     this->PollId = DDS_POLL_DEFAULT;
     this->PollContext = nullptr;
+    this->WriteMode = WRITE_AT_POINTER;
+    this->Cache = nullptr;
+    this->CompressReads = false;
+    this->Durability = DURABILITY_VOLATILE;
+    this->LeaseMode = LEASE_NONE;
+    this->LeaseEnd = 0;
+    this->LeaseCallback = nullptr;
+    this->LeaseContext = nullptr;
 }
 
 DDSFile::DDSFile(
@@ -41,11 +54,27 @@ DDSFile::DDSFile(
     this->Properties.LastAccessTime = time(NULL);
     this->Properties.LastWriteTime = time(NULL);
     this->Properties.FileSize = 0;
+    this->Size = 0;
+    this->SizeLeaseStart = 0;
     this->Properties.Position = 0;
     this->Properties.Access = FileAccess;
     this->Properties.ShareMode = FileShareMode;
     this->PollId = DDS_POLL_DEFAULT;
     this->PollContext = nullptr;
+    this->WriteMode = WRITE_AT_POINTER;
+    this->Cache = nullptr;
+    this->CompressReads = false;
+    this->Durability = DURABILITY_VOLATILE;
+    this->LeaseMode = LEASE_NONE;
+    this->LeaseEnd = 0;
+    this->LeaseCallback = nullptr;
+    this->LeaseContext = nullptr;
+}
+
+DDSFile::~DDSFile() {
+    if (this->Cache) {
+        delete this->Cache;
+    }
 }
 
 const char*
@@ -70,7 +99,7 @@ DDSFile::GetShareMode() {
 
 FileSizeT
 DDSFile::GetSize() {
-    return this->Properties.FileSize;
+    return this->Size.load(std::memory_order_acquire);
 }
 
 FileSizeT
@@ -102,7 +131,55 @@ DDSFile::SetName(
 
 void
 DDSFile::SetSize(FileSizeT FileSize) {
-    this->Properties.FileSize = FileSize;
+    this->Size.store(FileSize, std::memory_order_release);
+}
+
+void
+DDSFile::GrowSize(FileSizeT End) {
+    FileSizeT size = this->Size.load(std::memory_order_relaxed);
+    while (size < End && !this->Size.compare_exchange_weak(size, End, std::memory_order_acq_rel)) {
+    }
+}
+
+//
+// Milliseconds of the steady clock; 0 never holds a lease
+//
+//
+int64_t
+DDSFile::LeaseNow() {
+    return (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() + 1;
+}
+
+bool
+DDSFile::HoldsSizeLease() {
+    if (GetLease() != LEASE_NONE) {
+        return true;
+    }
+
+    int64_t start = this->SizeLeaseStart.load(std::memory_order_acquire);
+    return start && LeaseNow() - start < DDS_FILE_SIZE_LEASE_MS;
+}
+
+void
+DDSFile::RenewSizeLease(FileSizeT FileSize) {
+    SetSize(FileSize);
+    this->SizeLeaseStart.store(LeaseNow(), std::memory_order_release);
+}
+
+void
+DDSFile::ExpireSizeLease() {
+    this->SizeLeaseStart.store(0, std::memory_order_release);
+}
+
+FileLeaseMode
+DDSFile::GetLease() {
+    int mode = this->LeaseMode.load(std::memory_order_acquire);
+    if (mode == LEASE_NONE || LeaseNow() >= this->LeaseEnd.load(std::memory_order_relaxed)) {
+        return LEASE_NONE;
+    }
+
+    return (FileLeaseMode)mode;
 }
 
 void
@@ -112,20 +189,30 @@ DDSFile::SetPointer(FileSizeT FilePointer) {
 
 void
 DDSFile::IncrementPointer(FileSizeT Delta) {
-    PositionInFileT delta = Delta;
-    PositionInFileT currentPointer = this->Properties.Position;
-    while(this->Properties.Position.compare_exchange_weak(currentPointer, currentPointer + delta, std::memory_order_relaxed) == false) {
-        currentPointer = this->Properties.Position;
-    }
+    this->Properties.Position.fetch_add((PositionInFileT)Delta, std::memory_order_relaxed);
 }
 
 void
 DDSFile::DecrementPointer(FileSizeT Delta) {
-    PositionInFileT delta = Delta;
-    PositionInFileT currentPointer = this->Properties.Position;
-    while(this->Properties.Position.compare_exchange_weak(currentPointer, currentPointer - delta, std::memory_order_relaxed) == false) {
-        currentPointer = this->Properties.Position;
-    }
+    this->Properties.Position.fetch_sub((PositionInFileT)Delta, std::memory_order_relaxed);
+}
+
+FileSizeT
+DDSFile::ReservePointer(FileSizeT Delta) {
+    return (FileSizeT)this->Properties.Position.fetch_add((PositionInFileT)Delta, std::memory_order_relaxed);
+}
+
+bool
+DDSFile::UnreservePointer(
+    FileSizeT Reserved,
+    FileSizeT Delta
+) {
+    PositionInFileT expected = (PositionInFileT)(Reserved + Delta);
+    return this->Properties.Position.compare_exchange_strong(
+        expected,
+        (PositionInFileT)Reserved,
+        std::memory_order_relaxed
+    );
 }
 
 void
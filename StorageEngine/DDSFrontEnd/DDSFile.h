@@ -9,18 +9,44 @@
 
 namespace DDS_FrontEnd {
 
+class DDSFileCache;
+
 class DDSFile {
 private:
     FileIdT Id;
     FileProperties Properties;
 
+    //
+    // The size of the file, which write completions grow without a lock,
+    // and when the size of a shared file was last read from the back end
+    //
+    //
+    Atomic<FileSizeT> Size;
+    Atomic<int64_t> SizeLeaseStart;
+
 public:
     PollIdT PollId;
     ContextT PollContext;
+    FileWriteMode WriteMode;
+    DDSFileCache* Cache;
+    bool CompressReads;
+    FileDurability Durability;
+
+    //
+    // The lease of the file the front end holds (FileLeaseMode), until LeaseEnd on the clock of LeaseNow,
+    // and the callback of its revocation
+    //
+    //
+    Atomic<int> LeaseMode;
+    Atomic<int64_t> LeaseEnd;
+    LeaseRevokedCallback LeaseCallback;
+    ContextT LeaseContext;
 
 public:
     DDSFile();
 
+    ~DDSFile();
+
     DDSFile(
         FileIdT FileId,
         const char* FileName,
@@ -66,6 +92,53 @@ public:
         FileSizeT FileSize
     );
 
+    //
+    // Raise the size to End if the file is smaller; a completed write past the end grows the file
+    //
+    //
+    void
+    GrowSize(
+        FileSizeT End
+    );
+
+    //
+    // Whether the size was read from the back end in the last DDS_FILE_SIZE_LEASE_MS milliseconds,
+    // or the front end holds a lease of the file
+    //
+    //
+    bool
+    HoldsSizeLease();
+
+    //
+    // Read the size from the back end at the next GetFileSize
+    //
+    //
+    void
+    ExpireSizeLease();
+
+    //
+    // The lease of the file the front end holds, LEASE_NONE if it ended
+    //
+    //
+    FileLeaseMode
+    GetLease();
+
+    //
+    // Milliseconds of the steady clock the leases are timed on; never 0
+    //
+    //
+    static int64_t
+    LeaseNow();
+
+    //
+    // Set the size read from the back end and start a lease on it
+    //
+    //
+    void
+    RenewSizeLease(
+        FileSizeT FileSize
+    );
+
     void
     SetPointer(
         FileSizeT FilePointer
@@ -81,6 +154,26 @@ public:
         FileSizeT Delta
     );
 
+    //
+    // Atomically advance the pointer by Delta and return where it was
+    //
+    //
+    FileSizeT
+    ReservePointer(
+        FileSizeT Delta
+    );
+
+    //
+    // Give back a range taken by ReservePointer if nothing was reserved after it;
+    // otherwise the range is left as a hole
+    //
+    //
+    bool
+    UnreservePointer(
+        FileSizeT Reserved,
+        FileSizeT Delta
+    );
+
     void
     SetLastAccessTime(
         time_t NewTime
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#include <new>
+#include <string.h>
+
+#include "DDSFileCache.h"
+
+namespace DDS_FrontEnd {
+
+DDSFileCache::DDSFileCache(
+    bool ReadAhead,
+    bool WriteBack
+) {
+    ReadAheadEnabled = ReadAhead;
+    Window = nullptr;
+    WindowOffset = 0;
+    WindowBytes = 0;
+    WindowReady = false;
+    WindowFilling = false;
+    WindowStale = false;
+    NextSequentialOffset = 0;
+    SequentialReads = 0;
+
+    WriteBackEnabled = WriteBack;
+    WriteBuffer = nullptr;
+    DirtyOffset = 0;
+    DirtyBytes = 0;
+    Flushing = false;
+    WriteBackError = DDS_ERROR_CODE_SUCCESS;
+}
+
+DDSFileCache::~DDSFileCache() {
+    if (Window) {
+        delete[] Window;
+    }
+
+    if (WriteBuffer) {
+        delete[] WriteBuffer;
+    }
+}
+
+//
+// Allocate the cache buffers
+//
+//
+bool
+DDSFileCache::Allocate() {
+    if (ReadAheadEnabled) {
+        Window = new (std::nothrow) char[DDS_FILE_CACHE_READ_AHEAD_BYTES];
+        if (!Window) {
+            return false;
+        }
+    }
+
+    if (WriteBackEnabled) {
+        WriteBuffer = new (std::nothrow) char[DDS_FILE_CACHE_WRITE_BACK_BYTES];
+        if (!WriteBuffer) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Check if [Offset, Offset + Bytes) overlaps the buffered writes
+//
+//
+bool
+DDSFileCache::OverlapsDirty(
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    return DirtyBytes && Offset < DirtyOffset + DirtyBytes && DirtyOffset < Offset + Bytes;
+}
+
+//
+// Drop the read-ahead window if it overlaps [Offset, Offset + Bytes)
+//
+//
+void
+DDSFileCache::InvalidateWindow(
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    if (!ReadAheadEnabled) {
+        return;
+    }
+
+    if (WindowFilling) {
+        //
+        // The window being read cannot be trusted, drop it when the read completes
+        //
+        //
+        if (Offset < WindowOffset + DDS_FILE_CACHE_READ_AHEAD_BYTES && WindowOffset < Offset + Bytes) {
+            WindowStale = true;
+        }
+    }
+    else if (WindowReady && Offset < WindowOffset + WindowBytes && WindowOffset < Offset + Bytes) {
+        WindowReady = false;
+    }
+}
+
+//
+// Start writing back the buffered writes
+//
+//
+void
+DDSFileCache::StartWriteBack(
+    CacheIOT* WriteBack
+) {
+    Flushing = true;
+    WriteBack->Valid = true;
+    WriteBack->Buffer = WriteBuffer;
+    WriteBack->Offset = DirtyOffset;
+    WriteBack->Bytes = DirtyBytes;
+}
+
+//
+// Serve a read from the cache;
+// on a miss, ReadAhead may ask for the next window to be read;
+// on a retry, the read overlaps buffered writes that must be written back first
+//
+//
+CacheResultT
+DDSFileCache::Read(
+    FileSizeT Offset,
+    BufferT DestBuffer,
+    FileIOSizeT BytesToRead,
+    CacheIOT* ReadAhead
+) {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    ReadAhead->Valid = false;
+
+    //
+    // Buffered writes are newer than anything on storage
+    //
+    //
+    if (OverlapsDirty(Offset, BytesToRead)) {
+        if (Offset >= DirtyOffset && Offset + BytesToRead <= DirtyOffset + DirtyBytes) {
+            memcpy(DestBuffer, WriteBuffer + (Offset - DirtyOffset), BytesToRead);
+            return CACHE_HIT;
+        }
+        return CACHE_RETRY;
+    }
+
+    if (!ReadAheadEnabled) {
+        return CACHE_MISS;
+    }
+
+    bool sequential = Offset == NextSequentialOffset;
+    NextSequentialOffset = Offset + BytesToRead;
+
+    if (WindowReady && Offset >= WindowOffset && Offset + BytesToRead <= WindowOffset + WindowBytes) {
+        memcpy(DestBuffer, Window + (Offset - WindowOffset), BytesToRead);
+        return CACHE_HIT;
+    }
+
+    SequentialReads = sequential ? SequentialReads + 1 : 0;
+
+    FileSizeT windowOffset = NextSequentialOffset - NextSequentialOffset % DDS_PAGE_SIZE;
+
+    //
+    // A window over buffered writes would hold what storage had before them
+    //
+    //
+    if (SequentialReads >= DDS_FILE_CACHE_SEQUENTIAL_THRESHOLD &&
+        BytesToRead <= DDS_FILE_CACHE_MAX_CACHED_READ_BYTES &&
+        !WindowFilling &&
+        !OverlapsDirty(windowOffset, DDS_FILE_CACHE_READ_AHEAD_BYTES)) {
+        //
+        // Read ahead from where this read ends, with the window aligned to pages
+        //
+        //
+        WindowOffset = windowOffset;
+        WindowBytes = 0;
+        WindowReady = false;
+        WindowFilling = true;
+        WindowStale = false;
+
+        ReadAhead->Valid = true;
+        ReadAhead->Buffer = Window;
+        ReadAhead->Offset = WindowOffset;
+        ReadAhead->Bytes = DDS_FILE_CACHE_READ_AHEAD_BYTES;
+    }
+
+    return CACHE_MISS;
+}
+
+//
+// Buffer a write;
+// on a miss, the caller issues the write itself;
+// on a retry, the write overlaps buffered writes that are being written back;
+// WriteBack may ask for the buffered writes to be written back
+//
+//
+CacheResultT
+DDSFileCache::Write(
+    FileSizeT Offset,
+    BufferT SourceBuffer,
+    FileIOSizeT BytesToWrite,
+    CacheIOT* WriteBack
+) {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    WriteBack->Valid = false;
+
+    InvalidateWindow(Offset, BytesToWrite);
+
+    if (!WriteBackEnabled) {
+        return CACHE_MISS;
+    }
+
+    if (Flushing) {
+        return OverlapsDirty(Offset, BytesToWrite) ? CACHE_RETRY : CACHE_MISS;
+    }
+
+    if (BytesToWrite <= DDS_FILE_CACHE_WRITE_BACK_BYTES) {
+        if (DirtyBytes == 0) {
+            DirtyOffset = Offset;
+        }
+
+        if (Offset >= DirtyOffset && Offset <= DirtyOffset + DirtyBytes &&
+            Offset - DirtyOffset + BytesToWrite <= DDS_FILE_CACHE_WRITE_BACK_BYTES) {
+            //
+            // Append to or overwrite the buffered writes
+            //
+            //
+            memcpy(WriteBuffer + (Offset - DirtyOffset), SourceBuffer, BytesToWrite);
+            if (Offset - DirtyOffset + BytesToWrite > DirtyBytes) {
+                DirtyBytes = (FileIOSizeT)(Offset - DirtyOffset) + BytesToWrite;
+            }
+            return CACHE_HIT;
+        }
+    }
+
+    if (DirtyBytes == 0) {
+        return CACHE_MISS;
+    }
+
+    //
+    // Not adjacent to the buffered writes or too large: write them back
+    // and let this write go directly unless it would overtake them
+    //
+    //
+    bool overlaps = OverlapsDirty(Offset, BytesToWrite);
+    StartWriteBack(WriteBack);
+
+    return overlaps ? CACHE_RETRY : CACHE_MISS;
+}
+
+//
+// Write back the buffered writes;
+// return DDS_ERROR_CODE_IO_PENDING until everything buffered has reached storage,
+// then the result of the write-backs since the last flush
+//
+//
+ErrorCodeT
+DDSFileCache::Flush(
+    CacheIOT* WriteBack
+) {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    WriteBack->Valid = false;
+
+    if (Flushing) {
+        return DDS_ERROR_CODE_IO_PENDING;
+    }
+
+    if (DirtyBytes) {
+        StartWriteBack(WriteBack);
+        return DDS_ERROR_CODE_IO_PENDING;
+    }
+
+    ErrorCodeT result = WriteBackError;
+    WriteBackError = DDS_ERROR_CODE_SUCCESS;
+
+    return result;
+}
+
+//
+// Drop cached data overlapping a write that bypasses the cache
+//
+//
+void
+DDSFileCache::Invalidate(
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    InvalidateWindow(Offset, Bytes);
+}
+
+void
+DDSFileCache::InvalidateAll() {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    if (!ReadAheadEnabled) {
+        return;
+    }
+
+    if (WindowFilling) {
+        WindowStale = true;
+    }
+    WindowReady = false;
+}
+
+//
+// Undo a read-ahead or write-back that could not be issued
+//
+//
+void
+DDSFileCache::ReadAheadFailed() {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    WindowFilling = false;
+}
+
+void
+DDSFileCache::WriteBackFailed() {
+    std::lock_guard<std::mutex> guard(Lock);
+
+    //
+    // Keep the writes buffered; the next flush tries again
+    //
+    //
+    Flushing = false;
+}
+
+//
+// Completions of the I/Os issued for the cache
+//
+//
+void
+DDSFileCache::OnReadAheadComplete(
+    ErrorCodeT ErrorCode,
+    FileIOSizeT BytesServiced,
+    ContextT Context
+) {
+    DDSFileCache* cache = (DDSFileCache*)Context;
+    std::lock_guard<std::mutex> guard(cache->Lock);
+
+    cache->WindowFilling = false;
+    if (ErrorCode == DDS_ERROR_CODE_SUCCESS && !cache->WindowStale) {
+        cache->WindowBytes = BytesServiced;
+        cache->WindowReady = BytesServiced != 0;
+    }
+}
+
+void
+DDSFileCache::OnWriteBackComplete(
+    ErrorCodeT ErrorCode,
+    FileIOSizeT BytesServiced,
+    ContextT Context
+) {
+    DDSFileCache* cache = (DDSFileCache*)Context;
+    std::lock_guard<std::mutex> guard(cache->Lock);
+
+    if (ErrorCode == DDS_ERROR_CODE_SUCCESS && BytesServiced != cache->DirtyBytes) {
+        ErrorCode = DDS_ERROR_CODE_IO_FAILURE;
+    }
+    if (ErrorCode != DDS_ERROR_CODE_SUCCESS) {
+        cache->WriteBackError = ErrorCode;
+    }
+
+    //
+    // A window read while the writes were buffered predates them
+    //
+    //
+    cache->InvalidateWindow(cache->DirtyOffset, cache->DirtyBytes);
+
+    cache->DirtyBytes = 0;
+    cache->Flushing = false;
+}
+
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "DDSFrontEndConfig.h"
+#include "DDSFrontEndInterface.h"
+
+namespace DDS_FrontEnd {
+
+//
+// Outcome of serving a read or write with the file cache
+//
+//
+enum CacheResultT {
+    CACHE_HIT,
+    CACHE_MISS,
+    CACHE_RETRY
+};
+
+//
+// An I/O the front end issues on behalf of the cache
+//
+//
+typedef struct CacheIOT {
+    bool Valid;
+    BufferT Buffer;
+    FileSizeT Offset;
+    FileIOSizeT Bytes;
+} CacheIOT;
+
+//
+// Front-end cache of a file, used by ReadFile and WriteFile on the file pointer:
+// sequential reads are detected and read ahead into one aligned window,
+// adjacent writes are coalesced in one bounded buffer until it is written back;
+// the cache never issues I/O itself, it asks the caller to by returning a CacheIOT
+//
+//
+class DDSFileCache {
+private:
+    std::mutex Lock;
+
+    //
+    // Read-ahead window
+    //
+    //
+    bool ReadAheadEnabled;
+    BufferT Window;
+    FileSizeT WindowOffset;
+    FileIOSizeT WindowBytes;
+    bool WindowReady;
+    bool WindowFilling;
+    bool WindowStale;
+    FileSizeT NextSequentialOffset;
+    int SequentialReads;
+
+    //
+    // Write-back buffer
+    //
+    //
+    bool WriteBackEnabled;
+    BufferT WriteBuffer;
+    FileSizeT DirtyOffset;
+    FileIOSizeT DirtyBytes;
+    bool Flushing;
+    ErrorCodeT WriteBackError;
+
+    //
+    // Check if [Offset, Offset + Bytes) overlaps the buffered writes
+    //
+    //
+    bool
+    OverlapsDirty(
+        FileSizeT Offset,
+        FileIOSizeT Bytes
+    );
+
+    //
+    // Drop the read-ahead window if it overlaps [Offset, Offset + Bytes)
+    //
+    //
+    void
+    InvalidateWindow(
+        FileSizeT Offset,
+        FileIOSizeT Bytes
+    );
+
+    //
+    // Start writing back the buffered writes
+    //
+    //
+    void
+    StartWriteBack(
+        CacheIOT* WriteBack
+    );
+
+public:
+    DDSFileCache(
+        bool ReadAhead,
+        bool WriteBack
+    );
+
+    ~DDSFileCache();
+
+    //
+    // Allocate the cache buffers
+    //
+    //
+    bool
+    Allocate();
+
+    //
+    // Serve a read from the cache;
+    // on a miss, ReadAhead may ask for the next window to be read;
+    // on a retry, the read overlaps buffered writes that must be written back first
+    //
+    //
+    CacheResultT
+    Read(
+        FileSizeT Offset,
+        BufferT DestBuffer,
+        FileIOSizeT BytesToRead,
+        CacheIOT* ReadAhead
+    );
+
+    //
+    // Buffer a write;
+    // on a miss, the caller issues the write itself;
+    // on a retry, the write overlaps buffered writes that are being written back;
+    // WriteBack may ask for the buffered writes to be written back
+    //
+    //
+    CacheResultT
+    Write(
+        FileSizeT Offset,
+        BufferT SourceBuffer,
+        FileIOSizeT BytesToWrite,
+        CacheIOT* WriteBack
+    );
+
+    //
+    // Write back the buffered writes;
+    // return DDS_ERROR_CODE_IO_PENDING until everything buffered has reached storage,
+    // then the result of the write-backs since the last flush
+    //
+    //
+    ErrorCodeT
+    Flush(
+        CacheIOT* WriteBack
+    );
+
+    //
+    // Drop cached data overlapping a write that bypasses the cache
+    //
+    //
+    void
+    Invalidate(
+        FileSizeT Offset,
+        FileIOSizeT Bytes
+    );
+
+    //
+    // Drop all cached data, as other front ends may write the file
+    //
+    //
+    void
+    InvalidateAll();
+
+    //
+    // Undo a read-ahead or write-back that could not be issued
+    //
+    //
+    void
+    ReadAheadFailed();
+
+    void
+    WriteBackFailed();
+
+    //
+    // Completions of the I/Os issued for the cache
+    //
+    //
+    static void
+    OnReadAheadComplete(
+        ErrorCodeT ErrorCode,
+        FileIOSizeT BytesServiced,
+        ContextT Context
+    );
+
+    static void
+    OnWriteBackComplete(
+        ErrorCodeT ErrorCode,
+        FileIOSizeT BytesServiced,
+        ContextT Context
+    );
+};
+
+}
@@ -3,41 +3,629 @@
  * Licensed under the MIT License
  */
 
+#include <algorithm>
 #include <chrono>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <new>
 #include <string.h>
 #include <thread>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
+#include "DDSCapture.h"
+#include "DDSErasureCode.h"
 #include "DDSFrontEnd.h"
+#include "Profiler.h"
 
 using std::cout;
 using std::endl;
 
 namespace DDS_FrontEnd {
 
+#ifdef DDS_IO_STATISTICS_ENABLED
+//
+// Time staged requests from when they are published rather than from when they were staged
+//
+//
+static void
+StampPublishedRequests(
+    void* Context,
+    const RequestIdT* RequestIds,
+    size_t NumRequests
+) {
+    PollT* poll = (PollT*)Context;
+    uint64_t ticks = ReadIOClock();
+
+    for (size_t r = 0; r != NumRequests; r++) {
+        if (RequestIds[r] != BUFF_MSG_REQUEST_FENCE) {
+            poll->OutstandingRequests[RequestIds[r] & (poll->QueueDepth - 1)]->RingTicks = ticks;
+        }
+    }
+}
+#endif
+
 //
 // Initialize a poll structure
 //
 //
-PollT::PollT() {
-    for (size_t i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
-        OutstandingRequests[i] = nullptr;
+PollT::PollT(size_t QueueDepth, PollT* StripeOf) {
+    this->QueueDepth = QueueDepth;
+    this->StripeOf = StripeOf;
+    Priority = POLL_PRIORITY_NORMAL;
+    FreeSlotWords = QueueDepth / DDS_POLL_SLOT_BITMAP_WORD_BITS;
+    if (StripeOf) {
+        //
+        // A stripe takes the slots of the poll it is a stripe of
+        //
+        //
+        OutstandingRequests = StripeOf->OutstandingRequests;
+        FreeSlots = StripeOf->FreeSlots;
+    }
+    else {
+        OutstandingRequests = new FileIOT*[QueueDepth];
+        for (size_t i = 0; i != QueueDepth; i++) {
+            OutstandingRequests[i] = nullptr;
+        }
+        FreeSlots = new Atomic<uint64_t>[FreeSlotWords];
+        for (size_t w = 0; w != FreeSlotWords; w++) {
+            FreeSlots[w] = ~0ULL;
+        }
     }
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
+    NumStripes = 1;
+    Stripes[0] = this;
+    for (size_t s = 1; s != DDS_MAX_STRIPES; s++) {
+        Stripes[s] = nullptr;
+    }
+    NextStripe = 0;
+    NumDeviceBuffers = 0;
+    Handovers = 0;
+    BackEndLost = false;
+    Publishers = 0;
+    ResponseWaiters = 0;
+#ifdef DDS_IO_STATISTICS_ENABLED
+    RequestStaging.Published = StampPublishedRequests;
+    RequestStaging.PublishedContext = this;
+#endif
     MsgBuffer = NULL;
     RequestRing = NULL;
     ResponseRing = NULL;
+    OffloadRings = NULL;
+    NextOffloadRing = 0;
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    for (size_t c = 0; c != DDS_POLL_MAX_CONSUMERS; c++) {
+        ResponseCursorT* cursor = &ResponseCursors[c];
+        cursor->Busy = false;
+        cursor->Pending = false;
+        memset(&cursor->BatchRef, 0, sizeof(cursor->BatchRef));
+        cursor->ProcessedBytes = 0;
+        cursor->NextResponse = NULL;
+        cursor->WriteAcksTaken = 0;
+        cursor->Batch = 0;
+    }
+#endif
+    ResponseBatchPins = new Atomic<int>[QueueDepth];
+    ResponseBatchBytes = new Atomic<FileIOSizeT>[QueueDepth];
+    for (size_t b = 0; b != QueueDepth; b++) {
+        ResponseBatchPins[b] = 0;
+        ResponseBatchBytes[b] = 0;
+    }
+    ResponseBatchHead = 0;
+    ResponseBatchTail = 0;
+    ResponseBatchDraining = false;
+    CoalescedCompletions = nullptr;
+    ControlOpsPending = 0;
+    BacklogSize = 0;
+
+    PollPolicyT defaultPolicy;
+    defaultPolicy.SpinMicroseconds = DDS_POLL_DEFAULT_SPIN_MICROSECONDS;
+    defaultPolicy.YieldMicroseconds = DDS_POLL_DEFAULT_YIELD_MICROSECONDS;
+    defaultPolicy.Adaptive = DDS_POLL_DEFAULT_ADAPTIVE;
+    defaultPolicy.StageRequests = DDS_POLL_DEFAULT_STAGE_REQUESTS;
+    defaultPolicy.BacklogRequests = DDS_POLL_DEFAULT_BACKLOG_REQUESTS;
+    SetPolicy(&defaultPolicy);
+}
+
+//
+// Free the arrays of a poll structure; the I/O objects in its slots belong to the front end
+//
+//
+PollT::~PollT() {
+    if (!StripeOf) {
+        delete[] OutstandingRequests;
+        delete[] FreeSlots;
+    }
+    delete[] ResponseBatchPins;
+    delete[] ResponseBatchBytes;
+}
+
+//
+// The bitmap word where the calling thread starts searching for a free slot;
+// threads start from different words so that they rarely contend on the same one
+//
+//
+static thread_local size_t SlotSearchHint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+//
+// The trace id of the next I/O of a thread, the trace ring of the thread, and all the rings,
+// which live as long as the process, as threads may record into them until they exit
+//
+//
+static thread_local uint64_t NextIOTraceId = 0;
+static thread_local DDSTraceRingT* ThreadTraceRing = nullptr;
+static std::mutex TraceRingsMutex;
+static std::vector<DDSTraceRingT*> TraceRings;
+
+void
+RecordIOTraceOnThread(
+    uint64_t TraceId,
+    uint32_t Hop,
+    uint32_t Arg
+) {
+    if (!ThreadTraceRing) {
+        std::lock_guard<std::mutex> lock(TraceRingsMutex);
+        ThreadTraceRing = DDSTraceRingCreate((uint32_t)TraceRings.size());
+        if (!ThreadTraceRing) {
+            return;
+        }
+        TraceRings.push_back(ThreadTraceRing);
+    }
+
+    DDSTraceRecord(ThreadTraceRing, TraceId, Hop, Arg);
+}
+
+uint64_t
+TakeIOTraceId() {
+    uint64_t traceId = NextIOTraceId;
+    NextIOTraceId = 0;
+    return traceId;
+}
+
+//
+// Append the hops of the traced I/Os of all threads
+//
+//
+static void
+DumpIOTraces(
+    const char* Path
+) {
+    std::lock_guard<std::mutex> lock(TraceRingsMutex);
+    if (TraceRings.empty()) {
+        return;
+    }
+
+    FILE* traceFile = fopen(Path, "a");
+    if (!traceFile) {
+        return;
+    }
+    for (DDSTraceRingT* ring : TraceRings) {
+        DDSTraceDump(ring, "frontend", traceFile);
+    }
+    fclose(traceFile);
+}
+
+//
+// The capture buffer of a thread; its lock is taken by the thread and by StopCapture, before CaptureMutex.
+// A buffer of an earlier capture is told by its generation, and emptied on the next record
+//
+//
+struct CaptureBufferT {
+    std::mutex Lock;
+    uint64_t Generation;
+    uint16_t Thread;
+    size_t NumRecords;
+    DDSCaptureRecordT Records[DDS_CAPTURE_BUFFER_RECORDS];
+};
+
+static std::atomic<bool> CaptureOn(false);
+static std::atomic<uint64_t> CaptureGeneration(0);
+static std::atomic<uint64_t> CaptureStartNs(0);
+static std::mutex CaptureMutex;
+static FILE* CaptureFile = nullptr;
+static std::vector<CaptureBufferT*> CaptureBuffers;
+static thread_local CaptureBufferT* ThreadCaptureBuffer = nullptr;
+
+static inline uint64_t
+CaptureNowNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+// Append the records of a buffer to the trace, if they belong to the current capture;
+// the caller holds the lock of the buffer
+//
+//
+static void
+WriteCaptureBuffer(
+    CaptureBufferT* Buffer
+) {
+    std::lock_guard<std::mutex> lock(CaptureMutex);
+    if (CaptureFile && Buffer->Generation == CaptureGeneration.load(std::memory_order_relaxed)) {
+        fwrite(Buffer->Records, sizeof(DDSCaptureRecordT), Buffer->NumRecords, CaptureFile);
+    }
+    Buffer->NumRecords = 0;
+}
+
+static void
+RecordCapture(
+    uint8_t Op,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    if (!ThreadCaptureBuffer) {
+        std::lock_guard<std::mutex> lock(CaptureMutex);
+        ThreadCaptureBuffer = new (std::nothrow) CaptureBufferT;
+        if (!ThreadCaptureBuffer) {
+            return;
+        }
+        ThreadCaptureBuffer->Generation = 0;
+        ThreadCaptureBuffer->Thread = (uint16_t)CaptureBuffers.size();
+        ThreadCaptureBuffer->NumRecords = 0;
+        CaptureBuffers.push_back(ThreadCaptureBuffer);
+    }
+
+    CaptureBufferT* buffer = ThreadCaptureBuffer;
+    std::lock_guard<std::mutex> lock(buffer->Lock);
+
+    //
+    // The capture may have stopped since the caller looked
+    //
+    //
+    if (!CaptureOn.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    uint64_t generation = CaptureGeneration.load(std::memory_order_acquire);
+    if (buffer->Generation != generation) {
+        buffer->Generation = generation;
+        buffer->NumRecords = 0;
+    }
+
+    DDSCaptureRecordT* record = &buffer->Records[buffer->NumRecords];
+    memset(record, 0, sizeof(DDSCaptureRecordT));
+    record->TimeNs = CaptureNowNs() - CaptureStartNs.load(std::memory_order_relaxed);
+    record->Offset = Offset;
+    record->Bytes = Bytes;
+    record->FileId = FileId;
+    record->Thread = buffer->Thread;
+    record->Op = Op;
+
+    if (++buffer->NumRecords == DDS_CAPTURE_BUFFER_RECORDS) {
+        WriteCaptureBuffer(buffer);
+    }
+}
+
+//
+// Record a request the application submitted if a capture is on and the front end took the request;
+// returns Result, so that a submission can return through it
+//
+//
+static inline ErrorCodeT
+CaptureIO(
+    uint8_t Op,
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    ErrorCodeT Result
+) {
+    if (CaptureOn.load(std::memory_order_relaxed) &&
+        (Result == DDS_ERROR_CODE_SUCCESS || Result == DDS_ERROR_CODE_IO_PENDING)) {
+        RecordCapture(Op, FileId, Offset, Bytes);
+    }
+
+    return Result;
+}
+
+//
+// Index of the lowest set bit of a non-zero word
+//
+//
+static inline size_t
+LowestSetBit(
+    uint64_t Word
+) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, Word);
+    return (size_t)index;
+#else
+    return (size_t)__builtin_ctzll(Word);
+#endif
+}
+
+//
+// Take any free I/O slot, or return nullptr if all slots are in flight
+//
+//
+FileIOT* PollT::AcquireSlot() {
+    size_t start = SlotSearchHint % FreeSlotWords;
+
+    for (size_t w = 0; w != FreeSlotWords; w++) {
+        size_t word = (start + w) % FreeSlotWords;
+        uint64_t bits = FreeSlots[word].load(std::memory_order_relaxed);
+
+        while (bits) {
+            size_t bit = LowestSetBit(bits);
+            if (FreeSlots[word].compare_exchange_weak(
+                bits,
+                bits & ~(1ULL << bit),
+                std::memory_order_acquire,
+                std::memory_order_relaxed
+            )) {
+                //
+                // Stick to this word next time, it most likely still has free slots
+                //
+                //
+                SlotSearchHint = word;
+                FileIOT* io = OutstandingRequests[word * DDS_POLL_SLOT_BITMAP_WORD_BITS + bit];
+                DDS_IO_STAMP(io, SubmitTicks);
+                io->TraceId = TakeIOTraceId();
+                return io;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+//
+// Return an I/O slot to the free bitmap
+//
+//
+void PollT::ReleaseSlot(FileIOT* IO) {
+    IO->IsInternal = false;
+    IO->CompressRead = false;
+    IO->DurableWrite = false;
+    IO->DeviceRead = false;
+    IO->DirectRead = false;
+    IO->Append = false;
+    IO->AppendedOffset = nullptr;
+    IO->AtomicOp = false;
+    IO->AtomicPrior = nullptr;
+    IO->NextCoalesced = nullptr;
+    IO->Stream = nullptr;
+    IO->TraceId = 0;
+    IO->TraceKey = 0;
+    IO->Erasure = nullptr;
+    IO->AtBackEnd = nullptr;
+    IO->Replayable = false;
+    IO->IsControl = false;
+    FreeSlots[IO->RequestId / DDS_POLL_SLOT_BITMAP_WORD_BITS].fetch_or(
+        1ULL << (IO->RequestId % DDS_POLL_SLOT_BITMAP_WORD_BITS),
+        std::memory_order_release
+    );
+}
+
+//
+// Queue the rest of a merged read or a finished stream, to be reported by the next polls
+//
+//
+void PollT::PushCoalescedCompletions(FileIOT* IOs) {
+    FileIOT* last = IOs;
+    while (last->NextCoalesced) {
+        last = last->NextCoalesced;
+    }
+
+    std::lock_guard<std::mutex> lock(CoalescedLock);
+    last->NextCoalesced = CoalescedCompletions.load(std::memory_order_relaxed);
+    CoalescedCompletions.store(IOs, std::memory_order_relaxed);
+}
+
+//
+// Take a queued part of a merged read, or return nullptr if there is none
+//
+//
+FileIOT* PollT::PopCoalescedCompletion() {
+    if (!CoalescedCompletions.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(CoalescedLock);
+    FileIOT* io = CoalescedCompletions.load(std::memory_order_relaxed);
+    if (io) {
+        CoalescedCompletions.store(io->NextCoalesced, std::memory_order_relaxed);
+    }
+
+    return io;
+}
+
+//
+// Check if there is room to track one more response batch;
+// every cursor may be opening a batch at the same time, so room is kept for all of them
+//
+//
+bool PollT::CanOpenResponseBatch() {
+    return ResponseBatchTail.load(std::memory_order_acquire) - ResponseBatchHead.load(std::memory_order_acquire) <= QueueDepth - DDS_POLL_MAX_CONSUMERS;
+}
+
+//
+// Start tracking a fetched response batch, pinned once for its processing
+//
+//
+size_t PollT::OpenResponseBatch(FileIOSizeT Bytes) {
+    size_t batch = ResponseBatchTail.fetch_add(1, std::memory_order_acq_rel);
+    ResponseBatchPins[batch % QueueDepth].store(1, std::memory_order_relaxed);
+    ResponseBatchBytes[batch % QueueDepth].store(Bytes, std::memory_order_release);
+
+    return batch;
+}
+
+//
+// Pin a response batch for a zero-copy read
+//
+//
+void PollT::PinResponseBatch(size_t Batch) {
+    ResponseBatchPins[Batch % QueueDepth].fetch_add(1, std::memory_order_relaxed);
+}
+
+//
+// Check if the batch at the head of the queue has been opened and has no pins
+//
+//
+static inline bool
+IsResponseBatchReleased(
+    PollT* Poll,
+    size_t Batch
+) {
+    return Poll->ResponseBatchBytes[Batch % Poll->QueueDepth].load(std::memory_order_acquire) != 0 &&
+        Poll->ResponseBatchPins[Batch % Poll->QueueDepth].load(std::memory_order_acquire) == 0;
+}
+
+//
+// Drop a pin of a response batch, and give every leading batch without pins back to the ring
+//
+//
+void PollT::ReleaseResponseBatch(size_t Batch) {
+    if (ResponseBatchPins[Batch % QueueDepth].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    bool expected = false;
+    while (ResponseBatchDraining.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+        size_t head = ResponseBatchHead.load(std::memory_order_relaxed);
+        size_t tail = ResponseBatchTail.load(std::memory_order_acquire);
+
+        while (head != tail && IsResponseBatchReleased(this, head)) {
+            IncrementProgress(ResponseRing, ResponseBatchBytes[head % QueueDepth].load(std::memory_order_relaxed));
+            ResponseBatchBytes[head % QueueDepth].store(0, std::memory_order_relaxed);
+            head++;
+        }
+
+        ResponseBatchHead.store(head, std::memory_order_release);
+        ResponseBatchDraining.store(false, std::memory_order_release);
+
+        //
+        // Drain again if the head batch was released while we were draining
+        //
+        //
+        if (head == ResponseBatchTail.load(std::memory_order_acquire) || !IsResponseBatchReleased(this, head)) {
+            break;
+        }
+        expected = false;
+    }
+}
+
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+//
+// The cursor where the calling thread starts looking for a free one;
+// threads start from different cursors so that they rarely contend on the same one
+//
+//
+static thread_local size_t ResponseCursorHint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+//
+// Take a free response cursor, waiting if all are held
+//
+//
+ResponseCursorT* PollT::AcquireResponseCursor() {
+    for (size_t i = 0;; i++) {
+        ResponseCursorT* cursor = &ResponseCursors[(ResponseCursorHint + i) % DDS_POLL_MAX_CONSUMERS];
+        bool expected = false;
+
+        if (!cursor->Busy.load(std::memory_order_relaxed) &&
+            cursor->Busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            ResponseCursorHint += i;
+            return cursor;
+        }
+
+        if (i % DDS_POLL_MAX_CONSUMERS == DDS_POLL_MAX_CONSUMERS - 1) {
+            YieldProcessor();
+        }
+    }
+}
+
+//
+// Take a free response cursor whose batch has responses left, or return nullptr if there is none
+//
+//
+ResponseCursorT* PollT::AcquirePendingResponseCursor() {
+    for (size_t c = 0; c != DDS_POLL_MAX_CONSUMERS; c++) {
+        ResponseCursorT* cursor = &ResponseCursors[c];
+        bool expected = false;
+
+        if (!cursor->Pending.load(std::memory_order_relaxed) || cursor->Busy.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        if (cursor->Busy.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            if (cursor->NextResponse) {
+                return cursor;
+            }
+            cursor->Busy.store(false, std::memory_order_release);
+        }
+    }
+
+    return nullptr;
+}
+
+//
+// Give a response cursor back
+//
+//
+void PollT::ReleaseResponseCursor(ResponseCursorT* Cursor) {
+    Cursor->Pending.store(Cursor->NextResponse != NULL, std::memory_order_relaxed);
+    Cursor->Busy.store(false, std::memory_order_release);
+}
 #endif
+
+//
+// Set the polling policy and restart its adaptation
+//
+//
+void PollT::SetPolicy(const PollPolicyT* NewPolicy) {
+    Policy = *NewPolicy;
+    SpinWindowNs = Policy.SpinMicroseconds * 1000;
+    AvgInterCompletionNs = SpinWindowNs / 2;
+    LastCompletionTime = std::chrono::steady_clock::now();
+}
+
+//
+// Record a completion and adapt the spin window to the average time between completions:
+// spinning pays off only if the next completion most likely arrives within the window
+//
+//
+void PollT::RecordCompletion() {
+    auto now = std::chrono::steady_clock::now();
+    size_t sinceLast = (size_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - LastCompletionTime).count();
+    LastCompletionTime = now;
+
+    if (!Policy.Adaptive) {
+        return;
+    }
+
+    AvgInterCompletionNs = AvgInterCompletionNs - AvgInterCompletionNs / 8 + sinceLast / 8;
+
+    size_t maxWindowNs = Policy.SpinMicroseconds * 1000;
+    if (AvgInterCompletionNs > maxWindowNs) {
+        SpinWindowNs = 0;
+    }
+    else {
+        SpinWindowNs = 2 * AvgInterCompletionNs < maxWindowNs ? 2 * AvgInterCompletionNs : maxWindowNs;
+    }
 }
 
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
 //
 // Set up the DMA buffer
 //
 //
 ErrorCodeT PollT::SetUpDMABuffer(void* BackEnd) {
     DDSBackEndBridge* backEndDPU = (DDSBackEndBridge*)BackEnd;
-    MsgBuffer = new DMABuffer(DDS_BACKEND_ADDR, DDS_BACKEND_PORT, DDS_REQUEST_RING_BYTES + DDS_RESPONSE_RING_BYTES + 1024, backEndDPU->ClientId);
+    MsgBuffer = new DMABuffer(
+        backEndDPU->BackEndAddr,
+        backEndDPU->BackEndPort,
+        (size_t)backEndDPU->RequestRingBytes + backEndDPU->ResponseRingBytes + DDS_RING_DMA_OVERHEAD_BYTES,
+        backEndDPU->ClientId,
+        Priority,
+        backEndDPU->RequestRingBytes,
+        backEndDPU->ResponseRingBytes,
+        backEndDPU->RingProtocol,
+        (uint32_t)QueueDepth
+    );
     if (!MsgBuffer) {
         cout << __func__ << " [error]: Failed to allocate a DMABuffer object" << endl;
         return DDS_ERROR_CODE_OOM;
@@ -64,6 +652,15 @@ void PollT::DestroyDMABuffer() {
         delete MsgBuffer;
         MsgBuffer = NULL;
     }
+
+    //
+    // The back end stops writing the offload response rings once the buffer is released
+    //
+    //
+    if (OffloadRings) {
+        VirtualFree(OffloadRings, 0, MEM_RELEASE);
+        OffloadRings = NULL;
+    }
 }
 
 //
@@ -71,10 +668,9 @@ void PollT::DestroyDMABuffer() {
 //
 //
 void PollT::InitializeRings() {
-    RequestRing = AllocateRequestBufferProgressive(MsgBuffer->BufferAddress);
-    ResponseRing = AllocateResponseBufferProgressive(RequestRing->Buffer + DDS_REQUEST_RING_BYTES);
+    RequestRing = AllocateRequestBufferProgressive(MsgBuffer->BufferAddress, MsgBuffer->RequestRingBytes);
+    ResponseRing = AllocateResponseBufferProgressive(RequestRing->Buffer + RequestRing->Capacity, MsgBuffer->ResponseRingBytes);
 }
-#endif
     
 //
 // A dummy callback for app
@@ -88,8 +684,9 @@ DummyReadWriteCallback(
 ) { }
 
 DDSFrontEnd::DDSFrontEnd(
-    const char* StoreName
-) : BackEnd(NULL) {
+    const char* StoreName,
+    BackEndTypeT BackEndType
+) : BackEndType(BackEndType), RequestRingBytes(DDS_REQUEST_RING_BYTES), ResponseRingBytes(DDS_RESPONSE_RING_BYTES), RingProtocol(DDS_RING_PROTOCOL_DEFAULT), PollQueueDepth(DDS_MAX_OUTSTANDING_IO), StreamChunkBytes((FileIOSizeT)-1), BackEnd(NULL), NumStripes(1), DataStripes(1), ParityStripes(0), StripeUnitBytes(DDS_MAX_STRIPE_UNIT_BYTES) {
     //
     // Set the name of the store
     //
@@ -100,88 +697,294 @@ DDSFrontEnd::DDSFrontEnd(
     // Prepare directories, files, and polls
     //
     //
-    for (size_t d = 0; d != DDS_MAX_DIRS; d++) {
-        AllDirs[d] = nullptr;
-    }
     DirIdEnd = 0;
-
-    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
-        AllFiles[f] = nullptr;
-    }
     FileIdEnd = 0;
+    FindPattern[0] = '\0';
+    ControlBatchOps = nullptr;
+    ControlBatchNumOps = 0;
+    AsyncControlHead = nullptr;
+    AsyncControlTail = &AsyncControlHead;
+    AsyncControlBatchNumOps = 0;
 
     for (size_t p = 0; p != DDS_MAX_POLLS; p++) {
         AllPolls[p] = nullptr;
     }
     PollIdEnd = 0;
 
+    //
+    // One DPU, the default back end, until SetStripes
+    //
+    //
+    strcpy(StripeAddrs[0], DDS_BACKEND_ADDR);
+    StripePorts[0] = DDS_BACKEND_PORT;
+    for (size_t s = 0; s != DDS_MAX_STRIPES; s++) {
+        StripeBackEnds[s] = nullptr;
+        StripeHandovers[s] = 0;
+    }
+
     //
     // Cannot allocate heap here otherwise SQL server would crash
     //
 }
 
 DDSFrontEnd::~DDSFrontEnd() {
-    for (size_t d = 0; d != DDS_MAX_DIRS; d++) {
+    for (size_t d = 0; d != AllDirs.Capacity(); d++) {
         if (AllDirs[d] != nullptr) {
             delete AllDirs[d];
         }
     }
 
-    for (size_t f = 0; f != DDS_MAX_FILES; f++) {
+    for (size_t f = 0; f != AllFiles.Capacity(); f++) {
         if (AllFiles[f] != nullptr) {
             delete AllFiles[f];
         }
     }
 
+    //
+    // Control operations of the async calls that were never reported
+    //
+    //
+    for (size_t o = 0; o != AsyncControlBatchNumOps; o++) {
+        delete AsyncControlBatch[o];
+    }
+    while (AsyncControlHead) {
+        AsyncControlOpT* next = AsyncControlHead->Next;
+        delete AsyncControlHead;
+        AsyncControlHead = next;
+    }
+
     for (size_t p = 0; p != DDS_MAX_POLLS; p++) {
         if (AllPolls[p]) {
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
-            AllPolls[p]->DestroyDMABuffer();
-#endif
-            for (size_t i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
-                delete AllPolls[p]->OutstandingRequests[i];
-            }
-
-            delete AllPolls[p];
+            ReleasePoll((PollIdT)p);
         }
     }
 
-    if (BackEnd) {
-        BackEnd->Disconnect();
-        delete BackEnd;
+    for (size_t s = 0; s != NumStripes; s++) {
+        if (StripeBackEnds[s]) {
+            StripeBackEnds[s]->Disconnect();
+            delete StripeBackEnds[s];
+        }
     }
+
+    DumpIOTraces(DDS_TRACE_FRONT_END_PATH);
+    StopCapture();
+
+#ifdef PROFILER_ENABLED
+    ProfilerDump(stdout);
+#endif
 }
 
 //
-// Intialize the front end, including connecting to back end
-// and setting up the root directory and default poll
+// Set the sizes of the request and response rings of every poll,
+// which the DPU back end may lower when Initialize connects to it;
+// must be called before Initialize
 //
 //
 ErrorCodeT
-DDSFrontEnd::Initialize() {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-        
+DDSFrontEnd::SetRingBytes(
+    RingSizeT RequestRingBytes,
+    RingSizeT ResponseRingBytes
+) {
+    if (BackEnd ||
+        !DDS_RING_BYTES_VALID(RequestRingBytes, DDS_REQUEST_RING_BYTES, DDS_REQUEST_RING_BYTES_ALIGNMENT) ||
+        !DDS_RING_BYTES_VALID(ResponseRingBytes, DDS_RESPONSE_RING_BYTES, DDS_RESPONSE_RING_BYTES_ALIGNMENT)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    this->RequestRingBytes = RequestRingBytes;
+    this->ResponseRingBytes = ResponseRingBytes;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Set the protocol of the request and response rings of every poll,
+// which the DPU back end may replace when Initialize connects to it;
+// must be called before Initialize
+//
+//
+ErrorCodeT
+DDSFrontEnd::SetRingProtocol(
+    RingProtocolT RingProtocol
+) {
+    if (BackEnd) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    if (!DDS_RING_PROTOCOL_IMPLEMENTED(RingProtocol)) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    this->RingProtocol = RingProtocol;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Set the queue depth of every poll, a power of two in [DDS_MIN_POLL_QUEUE_DEPTH, DDS_MAX_POLL_QUEUE_DEPTH],
+// which the DPU back end may lower when Initialize connects to it;
+// must be called before Initialize
+//
+//
+ErrorCodeT
+DDSFrontEnd::SetPollQueueDepth(
+    uint32_t PollQueueDepth
+) {
+    if (BackEnd || !DDS_POLL_QUEUE_DEPTH_VALID(PollQueueDepth)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    this->PollQueueDepth = PollQueueDepth;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Stripe the files across several DPUs, file offsets [k * StripeUnitBytes, (k + 1) * StripeUnitBytes)
+// going to the DPU of index k % NumBackEnds; every poll has a DMA buffer on every DPU, the I/Os that span
+// stripe units are split and reassembled as streams, and control operations go to every DPU;
+// the first DPU takes the place of the default back end; must be called before Initialize
+//
+//
+ErrorCodeT
+DDSFrontEnd::SetStripes(
+    const char* const* BackEndAddrs,
+    const unsigned short* BackEndPorts,
+    size_t NumBackEnds,
+    FileIOSizeT StripeUnitBytes
+) {
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (BackEnd || !BackEndAddrs || !BackEndPorts || NumBackEnds == 0 || NumBackEnds > DDS_MAX_STRIPES ||
+        StripeUnitBytes < DDS_MIN_STRIPE_UNIT_BYTES || StripeUnitBytes > DDS_MAX_STRIPE_UNIT_BYTES ||
+        StripeUnitBytes % DDS_MIN_STRIPE_UNIT_BYTES != 0) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    for (size_t s = 0; s != NumBackEnds; s++) {
+        if (!BackEndAddrs[s] || strlen(BackEndAddrs[s]) >= sizeof(StripeAddrs[s])) {
+            return DDS_ERROR_CODE_INVALID_PARAM;
+        }
+    }
+
+    for (size_t s = 0; s != NumBackEnds; s++) {
+        strcpy(StripeAddrs[s], BackEndAddrs[s]);
+        StripePorts[s] = BackEndPorts[s];
+    }
+    this->NumStripes = NumBackEnds;
+    this->DataStripes = NumBackEnds;
+    this->ParityStripes = 0;
+    this->StripeUnitBytes = StripeUnitBytes;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Keep the last ParityStripes of the DPUs for the parity of the others
+//
+//
+ErrorCodeT
+DDSFrontEnd::SetErasureCoding(
+    size_t ParityStripes
+) {
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (BackEnd || ParityStripes > DDS_ERASURE_MAX_PARITY_STRIPES || ParityStripes >= NumStripes) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    this->DataStripes = NumStripes - ParityStripes;
+    this->ParityStripes = ParityStripes;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Intialize the front end, including connecting to back end
+// and setting up the root directory and default poll
+//
+//
+ErrorCodeT
+DDSFrontEnd::Initialize() {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+        
     //
     // Set up back end
     //
     //
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
-    BackEnd = new DDSBackEndBridge();
-#elif BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
-    BackEnd = new DDSBackEndBridgeForLocalMemory();
-#else
-#error "Unknown backend type"
-#endif
-    result = BackEnd->Connect();
-    if (result != DDS_ERROR_CODE_SUCCESS) {
-        cout << __func__ << " [error]: Failed to connect to the back end (" << result << ")" << endl;
-        return result;
+    switch (BackEndType) {
+    case BACKEND_TYPE_DPU:
+        for (size_t s = 0; s != NumStripes; s++) {
+            DDSBackEndBridge* backEndDPU = new (std::nothrow) DDSBackEndBridge(RequestRingBytes, ResponseRingBytes, RingProtocol, PollQueueDepth);
+            if (!backEndDPU) {
+                return DDS_ERROR_CODE_OUT_OF_MEMORY;
+            }
+            strcpy(backEndDPU->BackEndAddr, StripeAddrs[s]);
+            backEndDPU->BackEndPort = StripePorts[s];
+            StripeBackEnds[s] = backEndDPU;
+        }
+        break;
+    case BACKEND_TYPE_LOCAL_MEMORY:
+        StripeBackEnds[0] = new (std::nothrow) DDSBackEndBridgeForLocalMemory();
+        break;
+    default:
+        cout << __func__ << " [error]: Unknown back end type (" << BackEndType << ")" << endl;
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+    BackEnd = StripeBackEnds[0];
+    if (!BackEnd) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    for (size_t s = 0; s != NumStripes; s++) {
+        result = StripeBackEnds[s]->Connect();
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            cout << __func__ << " [error]: Failed to connect to the back end " << s << " (" << result << ")" << endl;
+            return result;
+        }
+    }
+    if (BackEndType == BACKEND_TYPE_DPU) {
+        //
+        // Every DPU grants its own rings and queue depth; the slots of a poll serve all its stripes,
+        // so polls take the smallest queue depth granted
+        //
+        //
+        RingSizeT ringBytes = (RingSizeT)-1;
+        for (size_t s = 0; s != NumStripes; s++) {
+            DDSBackEndBridge* backEndDPU = (DDSBackEndBridge*)StripeBackEnds[s];
+            if (s == 0 || backEndDPU->PollQueueDepth < PollQueueDepth) {
+                PollQueueDepth = backEndDPU->PollQueueDepth;
+            }
+            if (backEndDPU->RequestRingBytes < ringBytes) {
+                ringBytes = backEndDPU->RequestRingBytes;
+            }
+            if (backEndDPU->ResponseRingBytes < ringBytes) {
+                ringBytes = backEndDPU->ResponseRingBytes;
+            }
+        }
+
+        //
+        // The chunks of a stream in flight take at most half of the smallest ring, whatever size was negotiated
+        //
+        //
+        RingSizeT chunkBytes = ringBytes / (2 * DDS_STREAM_IO_CHUNKS_IN_FLIGHT);
+        if (chunkBytes > DDS_STREAM_IO_CHUNK_BYTES) {
+            chunkBytes = DDS_STREAM_IO_CHUNK_BYTES;
+        }
+        StreamChunkBytes = chunkBytes & ~(RingSizeT)(DDS_BACKEND_SECTOR_SIZE - 1);
     }
 
     //
     // Set up root directory
     //
     //
+    if (!AllDirs.Reserve(DDS_DIR_ROOT)) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
     DDSDir* rootDir = new DDSDir(DDS_DIR_ROOT, DDS_DIR_INVALID, "/");
     AllDirs[DDS_DIR_ROOT] = rootDir;
 
@@ -189,30 +992,113 @@ DDSFrontEnd::Initialize() {
     // Set up default poll
     //
     //
-    PollT* poll = new PollT();
-    for (size_t i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
+    result = AllocatePoll(DDS_POLL_DEFAULT, POLL_PRIORITY_NORMAL);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        cout << __func__ << " [error]: Failed to set up the default poll (" << result << ")" << endl;
+        return result;
+    }
+
+    return result;
+}
+
+//
+// Release the stripes, DMA buffers and I/O objects of a poll, and the poll
+//
+//
+static void
+DestroyPoll(
+    PollT* Poll
+) {
+    for (size_t s = 1; s != Poll->NumStripes; s++) {
+        Poll->Stripes[s]->DestroyDMABuffer();
+        delete Poll->Stripes[s];
+    }
+    Poll->DestroyDMABuffer();
+    for (size_t i = 0; i != Poll->QueueDepth; i++) {
+        delete Poll->OutstandingRequests[i];
+    }
+    delete Poll;
+}
+
+//
+// Allocate a poll with its own I/O slots and, for the DPU back end,
+// its own DMA buffer and request/response rings on every DPU
+//
+//
+ErrorCodeT
+DDSFrontEnd::AllocatePoll(
+    PollIdT PollId,
+    PollPriority Priority
+) {
+    PollT* poll = new PollT(PollQueueDepth);
+    if (!poll) {
+        fprintf(stderr, "%s [error]: Failed to allocate a poll object\n", __func__);
+        return DDS_ERROR_CODE_OOM;
+    }
+    poll->Priority = Priority;
+
+    for (size_t i = 0; i != poll->QueueDepth; i++) {
         poll->OutstandingRequests[i] = new FileIOT();
         if (!poll->OutstandingRequests[i]) {
             fprintf(stderr, "%s [error]: Failed to allocate a file I/O object\n", __func__);
             for (size_t j = 0; j != i; j++) {
                 delete poll->OutstandingRequests[j];
             }
+            delete poll;
             return DDS_ERROR_CODE_OOM;
         }
 
         poll->OutstandingRequests[i]->RequestId = (RequestIdT)i;
     }
-    poll->NextRequestSlot = 0;
-    AllPolls[DDS_POLL_DEFAULT] = poll;
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
-    DDSBackEndBridge* backEndDPU = (DDSBackEndBridge*)BackEnd;
-    poll->SetUpDMABuffer(backEndDPU);
-    poll->InitializeRings();
-    fprintf(stdout, "%s [info]: Request ring data base address = %p\n", __func__, poll->RequestRing->Buffer);
-    fprintf(stdout, "%s [info]: Response ring data base address = %p\n", __func__, poll->ResponseRing->Buffer);
-#endif
 
-    return result;
+    if (BackEndType == BACKEND_TYPE_DPU) {
+        //
+        // Each poll has its own DMA buffer on every DPU, which the back end sees as a separate buffer connection;
+        // the stripes on the DPUs after the first share the slots of the poll
+        //
+        //
+        for (size_t s = 0; s != NumStripes; s++) {
+            PollT* stripe = s ? new PollT(PollQueueDepth, poll) : poll;
+            if (!stripe) {
+                fprintf(stderr, "%s [error]: Failed to allocate stripe %zu of poll %hu\n", __func__, s, PollId);
+                DestroyPoll(poll);
+                return DDS_ERROR_CODE_OOM;
+            }
+            stripe->Priority = Priority;
+
+            ErrorCodeT result = stripe->SetUpDMABuffer((DDSBackEndBridge*)StripeBackEnds[s]);
+            if (result != DDS_ERROR_CODE_SUCCESS) {
+                fprintf(stderr, "%s [error]: Failed to set up the DMA buffer for poll %hu on DPU %zu (%d)\n", __func__, PollId, s, result);
+                if (s) {
+                    delete stripe;
+                }
+                DestroyPoll(poll);
+                return result;
+            }
+            poll->Stripes[s] = stripe;
+            poll->NumStripes = s + 1;
+
+            stripe->InitializeRings();
+            fprintf(stdout, "%s [info]: Poll %hu request ring data base address on DPU %zu = %p\n", __func__, PollId, s, stripe->RequestRing->Buffer);
+            fprintf(stdout, "%s [info]: Poll %hu response ring data base address on DPU %zu = %p\n", __func__, PollId, s, stripe->ResponseRing->Buffer);
+        }
+    }
+
+    AllPolls[PollId] = poll;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Release a poll and everything allocated by AllocatePoll
+//
+//
+void
+DDSFrontEnd::ReleasePoll(
+    PollIdT PollId
+) {
+    DestroyPoll(AllPolls[PollId]);
+    AllPolls[PollId] = nullptr;
 }
 
 //
@@ -245,7 +1131,7 @@ DDSFrontEnd::CreateDirectory(
     //
     DirIdT id = 0;
     for (; id != DDS_MAX_DIRS; id++) {
-        if (!AllDirs[id]) {
+        if (id == AllDirs.Capacity() || !AllDirs[id]) {
             break;
         }
     }
@@ -254,6 +1140,10 @@ DDSFrontEnd::CreateDirectory(
         return DDS_ERROR_CODE_TOO_MANY_DIRS;
     }
 
+    if (!AllDirs.Reserve(id)) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
     DirIdT parentId = DDS_DIR_ROOT;
 
     DDSDir* dir = new DDSDir(id, parentId, PathName);
@@ -274,7 +1164,9 @@ DDSFrontEnd::CreateDirectory(
     // Reflect the update on back end
     //
     //
-    return BackEnd->CreateDirectory(PathName, *DirId, parentId);
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->CreateDirectory(PathName, *DirId, parentId);
+    });
 }
 
 void
@@ -291,12 +1183,25 @@ DDSFrontEnd::RemoveDirectoryRecursive(
 
     LinkedList<FileIdT>* pFiles = Dir->GetFiles();
     for (auto cur = pFiles->Begin(); cur != pFiles->End(); cur = cur->Next) {
+        FileNames.Remove(AllFiles[cur->Value]->GetName(), cur->Value);
         delete AllFiles[cur->Value];
         AllFiles[cur->Value] = nullptr;
+        FileHandles[cur->Value] = FileHandle();
     }
     pFiles->DeleteAll();
 }
 
+//
+// The id of the file of a name, or DDS_FILE_INVALID
+//
+//
+FileIdT
+DDSFrontEnd::FindFileByName(
+    const char* FileName
+) {
+    return FileNames.Find(FileName, [this](FileIdT Id) { return AllFiles[Id]->GetName(); });
+}
+
 //
 // Delete a directory
 // 
@@ -331,7 +1236,9 @@ DDSFrontEnd::RemoveDirectory(
     // Reflect the update on back end
     //
     //
-    return BackEnd->RemoveDirectory(id);
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->RemoveDirectory(id);
+    });
 }
 
 //
@@ -345,29 +1252,59 @@ DDSFrontEnd::CreateFile(
     FileShareModeT ShareMode,
     FileAttributesT FileAttributes,
     FileIdT* FileId
+) {
+    std::lock_guard<std::mutex> lock(ControlLock);
+    ErrorCodeT result = AddFileToTables(FileName, DesiredAccess, ShareMode, FileAttributes, FileId);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    //
+    // Reflect the update on back end
+    //
+    //
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->CreateFile(FileName, FileAttributes, *FileId, DDS_DIR_ROOT);
+    });
+}
+
+//
+// Add a file to the tables of the front end, without reflecting it on the back end
+//
+//
+ErrorCodeT
+DDSFrontEnd::AddFileToTables(
+    const char* FileName,
+    FileAccessT DesiredAccess,
+    FileShareModeT ShareMode,
+    FileAttributesT FileAttributes,
+    FileIdT* FileId
 ) {
     //
     // Check existance of the file
     //
     //
-    bool exists = false;
-    for (size_t i = 0; i != FileIdEnd; i++) {
-        if (AllFiles[i] && strcmp(FileName, AllFiles[i]->GetName()) == 0) {
-            exists = true;
-            break;
-        }
-    }
-    if (exists) {
+    if (FindFileByName(FileName) != DDS_FILE_INVALID) {
         return DDS_ERROR_CODE_FILE_EXISTS;
     }
 
+    //
+    // An atomic write goes to one DPU as it is; the write-back cache would split or merge it,
+    // and parity would span DPUs
+    //
+    //
+    if ((FileAttributes & DDS_FILE_ATTRIBUTE_ATOMIC_WRITES) &&
+        ((FileAttributes & DDS_FILE_ATTRIBUTE_WRITE_BACK) || ParityStripes)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
     //
     // Retrieve an id
     //
     //
     FileIdT id = 0;
     for (; id != DDS_MAX_FILES; id++) {
-        if (!AllFiles[id]) {
+        if (id == AllFiles.Capacity() || !AllFiles[id]) {
             break;
         }
     }
@@ -376,16 +1313,45 @@ DDSFrontEnd::CreateFile(
         return DDS_ERROR_CODE_TOO_MANY_FILES;
     }
 
+    if (!AllFiles.Reserve(id) || !FileHandles.Reserve(id)) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
     //
     // Create the file
     //
     //
     DDSFile* file = new DDSFile(id, FileName, FileAttributes, DesiredAccess, ShareMode);
 
+    //
+    // The windows of a cache would straddle DPUs, so striped files are not cached
+    //
+    //
+    if ((FileAttributes & (DDS_FILE_ATTRIBUTE_READ_AHEAD | DDS_FILE_ATTRIBUTE_WRITE_BACK)) && NumStripes == 1) {
+        file->Cache = new (std::nothrow) DDSFileCache(
+            (FileAttributes & DDS_FILE_ATTRIBUTE_READ_AHEAD) != 0,
+            (FileAttributes & DDS_FILE_ATTRIBUTE_WRITE_BACK) != 0
+        );
+
+        if (!file->Cache || !file->Cache->Allocate()) {
+            delete file;
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+
+    if (!FileNames.Add(file->GetName(), id)) {
+        delete file;
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
     DirIdT dirId = DDS_DIR_ROOT;
     AllDirs[dirId]->AddFile(id);
 
     AllFiles[id] = file;
+    FileHandles[id].File = file;
+    FileHandles[id].FileId = id;
+    FileHandles[id].PollId = DDS_POLL_DEFAULT;
+    FileHandles[id].Poll = AllPolls[DDS_POLL_DEFAULT];
     if (id >= FileIdEnd) {
         //
         // End is the next to the last valid file ID
@@ -396,11 +1362,7 @@ DDSFrontEnd::CreateFile(
 
     *FileId = id;
 
-    //
-    // Reflect the update on back end
-    //
-    //
-    return BackEnd->CreateFile(FileName, FileAttributes, *FileId, dirId);
+    return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
@@ -411,30 +1373,38 @@ ErrorCodeT
 DDSFrontEnd::DeleteFile(
     const char* FileName
 ) {
-    FileIdT id = DDS_FILE_INVALID;
-
-    for (FileIdT i = 0; i != FileIdEnd; i++) {
-        if (AllFiles[i] && strcmp(FileName, AllFiles[i]->GetName()) == 0) {
-            id = i;
-            break;
-        }
-    }
+    std::lock_guard<std::mutex> lock(ControlLock);
+    FileIdT id = FindFileByName(FileName);
 
     if (id == DDS_FILE_INVALID) {
         return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
 
-    DirIdT dirId = DDS_DIR_ROOT;
-    AllDirs[dirId]->DeleteFile(id);
-
-    delete AllFiles[id];
-    AllFiles[id] = nullptr;
+    RemoveFileFromTables(id);
 
     //
     // Reflect the update on back end
     //
     //
-    return BackEnd->DeleteFile(id, dirId);
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->DeleteFile(id, DDS_DIR_ROOT);
+    });
+}
+
+//
+// Remove a file from the tables of the front end, without reflecting it on the back end
+//
+//
+void
+DDSFrontEnd::RemoveFileFromTables(
+    FileIdT FileId
+) {
+    AllDirs[DDS_DIR_ROOT]->DeleteFile(FileId);
+
+    FileNames.Remove(AllFiles[FileId]->GetName(), FileId);
+    delete AllFiles[FileId];
+    AllFiles[FileId] = nullptr;
+    FileHandles[FileId] = FileHandle();
 }
 
 //
@@ -447,10 +1417,20 @@ DDSFrontEnd::ChangeFileSize(
     FileSizeT NewSize
 ) {
     //
-    // Change file size on back end first
+    // Erasure-coded, a file shrinks to whole rows, lest the parity of its last row cover bytes no longer in it
+    //
+    //
+    if (ParityStripes && NewSize < AllFiles[FileId]->GetSize() && NewSize % ((FileSizeT)StripeUnitBytes * DataStripes)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
     //
+    // Change file size on back end first; every DPU holds its stripe units of the file
     //
-    ErrorCodeT result = BackEnd->ChangeFileSize(FileId, NewSize);
+    //
+    ErrorCodeT result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t Stripe) {
+        return backEnd->ChangeFileSize(FileId, NumStripes == 1 ? NewSize : StripeFileSize(NewSize, Stripe));
+    });
     
     if (result == DDS_ERROR_CODE_SUCCESS) {
         AllFiles[FileId]->SetSize(NewSize);
@@ -471,10 +1451,17 @@ DDSFrontEnd::SetEndOfFile(
     DDSFile* pFile = AllFiles[FileId];
 
     //
-    // Change file size on back end first
+    // Change file size on back end first; every DPU holds its stripe units of the file
     //
     //
-    ErrorCodeT result = BackEnd->ChangeFileSize(FileId, pFile->GetPointer());
+    FileSizeT newSize = pFile->GetPointer();
+    if (ParityStripes && newSize < pFile->GetSize() && newSize % ((FileSizeT)StripeUnitBytes * DataStripes)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    ErrorCodeT result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t Stripe) {
+        return backEnd->ChangeFileSize(FileId, NumStripes == 1 ? newSize : StripeFileSize(newSize, Stripe));
+    });
     
     if (result == DDS_ERROR_CODE_SUCCESS) {
         pFile->SetSize(pFile->GetPointer());
@@ -519,564 +1506,767 @@ DDSFrontEnd::SetFilePointer(
 #pragma warning(default:26812)
 
 //
-// Get file size
+// Set how writes without an offset use the file pointer
 // 
 //
 ErrorCodeT
-DDSFrontEnd::GetFileSize(
+DDSFrontEnd::SetFileWriteMode(
     FileIdT FileId,
-    FileSizeT* FileSize
+    FileWriteMode Mode
 ) {
-    if (FileId >= DDS_MAX_FILES || AllFiles[FileId] == nullptr) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
         return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
 
-    //
-    // No writes on the DPU, so it's safe to get file size here
-    //
-    //
-    *FileSize = AllFiles[FileId]->GetSize();
+    AllFiles[FileId]->WriteMode = Mode;
 
     return DDS_ERROR_CODE_SUCCESS;
 }
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async read from a file
+// Set whether the back end may compress the data read from a file
 // 
 //
 ErrorCodeT
-DDSFrontEnd::ReadFile(
+DDSFrontEnd::SetFileCompression(
     FileIdT FileId,
-    BufferT DestBuffer,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ReadWriteCallback Callback,
-    ContextT Context
+    bool Enabled
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    AllFiles[FileId]->CompressReads = Enabled;
 
-    //
-    // Lock-free busy polling for completion
-    //
-    //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
-        }
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Set when the writes to a file become durable and what FlushFileBuffers does to the device
+// 
+//
+ErrorCodeT
+DDSFrontEnd::SetFileDurability(
+    FileIdT FileId,
+    FileDurability Mode
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
 
-    pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
-    pIO->AppBuffer = DestBuffer;
-    pIO->AppBufferArray = nullptr;
-    pIO->BytesDesired = BytesToRead;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
+    AllFiles[FileId]->Durability = Mode;
 
-    result = BackEnd->ReadFile(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBuffer,
-        pIO->BytesDesired,
-        BytesRead,
-        pIO,
-        poll
-    );
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Limit the I/O of a file on the back end, or lift the limit if BytesPerSecond is 0
+// 
+//
+ErrorCodeT
+DDSFrontEnd::SetFileQoS(
+    FileIdT FileId,
+    uint64_t BytesPerSecond,
+    uint64_t BurstBytes,
+    uint32_t Weight
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
 
     //
-    // TODO: better handle file pointer
+    // Striped, the I/O of the file spreads evenly across the DPUs, and so does its limit
     //
     //
-    FileSizeT newPointer = ((DDSFile*)pIO->FileReference)->GetPointer() + BytesToRead;
-    ((DDSFile*)pIO->FileReference)->SetPointer(newPointer);
-
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
-    }
-
-    return result;
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->SetFileQoS(FileId, BytesPerSecond / NumStripes, BurstBytes / NumStripes, Weight);
+    });
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
-// Async read from a file
+// Take a read-only snapshot of a file as a new file named SnapshotName
 // 
 //
 ErrorCodeT
-DDSFrontEnd::ReadFile(
+DDSFrontEnd::CreateSnapshot(
     FileIdT FileId,
-    BufferT DestBuffer,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ReadWriteCallback Callback,
-    ContextT Context
+    const char* SnapshotName,
+    FileIdT* SnapshotFileId
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
-
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        //
-        // If this is a callback-based completion,
-        // perform polling once
-        //
-        //
-        if (pIO->AppCallback) {
-            FileIOSizeT bytesServiced;
-            ContextT fileCtxt;
-            ContextT ioCtxt;
-            bool pollResult;
-
-            PollWait(
-                pollId,
-                &bytesServiced,
-                &fileCtxt,
-                &ioCtxt,
-                0,
-                &pollResult
-            );
-        }
-        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
     }
 
-    pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
-    pIO->BytesDesired = BytesToRead;
-    pIO->AppBuffer = DestBuffer;
-    pIO->AppBufferArray = nullptr;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
-
-    result = BackEnd->ReadFile(
-        FileId,
-        pIO->Offset,
-        DestBuffer,
-        BytesToRead,
-        nullptr,
-        pIO,
-        poll
+    DDSFile* source = AllFiles[FileId];
+    FileIdT id = DDS_FILE_INVALID;
+    ErrorCodeT result = AddFileToTables(
+        SnapshotName,
+        source->GetAccess(),
+        source->GetShareMode(),
+        source->GetAttributes() | DDS_FILE_ATTRIBUTE_SNAPSHOT,
+        &id
     );
-
-    if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+    if (result != DDS_ERROR_CODE_SUCCESS) {
         return result;
     }
 
     //
-    // Update file pointer
+    // Reflect the update on back end, which shares the segments of the file with the snapshot
     //
     //
-    ((DDSFile*)pIO->FileReference)->IncrementPointer(BytesToRead);
+    result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->CreateSnapshot(FileId, id, DDS_DIR_ROOT, SnapshotName);
+    });
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        RemoveFileFromTables(id);
+        return result;
+    }
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    AllFiles[id]->SetSize(source->GetSize());
+    *SnapshotFileId = id;
+
+    return DDS_ERROR_CODE_SUCCESS;
 }
-#else
-#error "Unknown backend type"
-#endif
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async read from a file with scattering
+// Tell the back end how a file will be read
 // 
 //
 ErrorCodeT
-DDSFrontEnd::ReadFileScatter(
+DDSFrontEnd::SetFileAccessHint(
     FileIdT FileId,
-    BufferT* DestBufferArray,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ReadWriteCallback Callback,
-    ContextT Context
+    FileAccessHint Hint,
+    FileSizeT Offset,
+    FileSizeT Bytes
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    if (NumStripes == 1) {
+        return BackEnd->SetFileAccessHint(FileId, Hint, Offset, Bytes);
+    }
 
     //
-    // Lock-free busy polling for completion
+    // Striped, every DPU is told about the rows of stripe units that the range touches
     //
     //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
-        }
-    }
-
-    pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
-    pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = DestBufferArray;
-    pIO->BytesDesired = BytesToRead;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
-
-    result = BackEnd->ReadFileScatter(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBufferArray,
-        pIO->BytesDesired,
-        BytesRead,
-        pIO,
-        poll
-    );
-
-    FileSizeT newPointer = ((DDSFile*)pIO->FileReference)->GetPointer() + BytesToRead;
-    ((DDSFile*)pIO->FileReference)->SetPointer(newPointer);
-
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
-    }
-
-    return result;
+    FileSizeT rowBytes = (FileSizeT)StripeUnitBytes * DataStripes;
+    FileSizeT firstRow = Offset / rowBytes;
+    FileSizeT endRow = Bytes ? (Offset + Bytes + rowBytes - 1) / rowBytes : firstRow;
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->SetFileAccessHint(FileId, Hint, firstRow * StripeUnitBytes, (endRow - firstRow) * StripeUnitBytes);
+    });
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
-// Async read from a file with scattering
+// Take a lease of a shared file, or change its mode;
+// striped, the lease is taken on every DPU, and one that refuses it undoes it on those before
 // 
 //
 ErrorCodeT
-DDSFrontEnd::ReadFileScatter(
+DDSFrontEnd::AcquireFileLease(
     FileIdT FileId,
-    BufferT* DestBufferArray,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ReadWriteCallback Callback,
+    FileLeaseMode Mode,
+    LeaseRevokedCallback Callback,
     ContextT Context
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
-
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        //
-        // If this is a callback-based completion,
-        // perform polling once
-        //
-        //
-        if (pIO->AppCallback) {
-            FileIOSizeT bytesServiced;
-            ContextT fileCtxt;
-            ContextT ioCtxt;
-            bool pollResult;
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+    if (Mode != LEASE_READ && Mode != LEASE_WRITE) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
 
-            PollWait(
-                pollId,
-                &bytesServiced,
-                &fileCtxt,
-                &ioCtxt,
-                0,
-                &pollResult
-            );
+    DDSFile* file = AllFiles[FileId];
+    FileLeaseMode held = file->GetLease();
+    int64_t start = DDSFile::LeaseNow();
+    uint32_t termMs = UINT32_MAX;
+    size_t granted = 0;
+
+    ErrorCodeT result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        uint32_t stripeTermMs;
+        ErrorCodeT stripeResult = backEnd->AcquireFileLease(FileId, Mode, &stripeTermMs);
+        if (stripeResult == DDS_ERROR_CODE_SUCCESS) {
+            termMs = stripeTermMs < termMs ? stripeTermMs : termMs;
+            granted++;
         }
+        return stripeResult;
+    });
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        for (size_t s = 0; s != granted; s++) {
+            uint32_t stripeTermMs;
+            if (held != LEASE_NONE) {
+                StripeBackEnds[s]->AcquireFileLease(FileId, held, &stripeTermMs);
+            }
+            else {
+                StripeBackEnds[s]->ReleaseFileLease(FileId);
+            }
+        }
+        return result;
+    }
 
-        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    //
+    // Writes of other front ends before the lease are in the size the back end has now
+    //
+    //
+    if (held == LEASE_NONE) {
+        FileSizeT fileSize;
+        file->ExpireSizeLease();
+        result = GetFileSize(FileId, &fileSize);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+                return backEnd->ReleaseFileLease(FileId);
+            });
+            return result;
+        }
     }
 
-    pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
-    pIO->BytesDesired = BytesToRead;
-    pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = DestBufferArray;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
+    file->LeaseCallback = Callback;
+    file->LeaseContext = Context;
+    file->LeaseEnd.store(termMs == UINT32_MAX ? INT64_MAX : start + termMs, std::memory_order_relaxed);
+    file->LeaseMode.store(Mode, std::memory_order_release);
 
-    result = BackEnd->ReadFileScatter(
-        FileId,
-        pIO->Offset,
-        DestBufferArray,
-        BytesToRead,
-        nullptr,
-        pIO,
-        poll
-    );
+    return DDS_ERROR_CODE_SUCCESS;
+}
 
-    if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
-        return result;
+//
+// Flush a leased file, drop its cache and give its lease back to every DPU
+//
+//
+ErrorCodeT
+DDSFrontEnd::GiveBackLease(
+    FileIdT FileId
+) {
+    DDSFile* file = AllFiles[FileId];
+    ErrorCodeT result = FlushFileBuffers(FileId);
+    if (file->Cache) {
+        file->Cache->InvalidateAll();
     }
 
-    //
-    // Update file pointer
-    //
-    //
-    ((DDSFile*)pIO->FileReference)->IncrementPointer(BytesToRead);
+    file->LeaseMode.store(LEASE_NONE, std::memory_order_release);
+    file->ExpireSizeLease();
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    ErrorCodeT releaseResult = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->ReleaseFileLease(FileId);
+    });
+    return result != DDS_ERROR_CODE_SUCCESS ? result : releaseResult;
 }
-#else
-#error "Unknown backend type"
-#endif
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async write to a file
+// Flush a file and give back its lease
 // 
 //
 ErrorCodeT
-DDSFrontEnd::WriteFile(
-    FileIdT FileId,
-    BufferT SourceBuffer,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
-    ReadWriteCallback Callback,
-    ContextT Context
+DDSFrontEnd::ReleaseFileLease(
+    FileIdT FileId
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    if (AllFiles[FileId]->LeaseMode.load(std::memory_order_acquire) == LEASE_NONE) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
 
-    //
-    // Lock-free busy polling for completion
-    //
-    //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
+    return GiveBackLease(FileId);
+}
+
+//
+// Renew the leases of the front end; a lease revoked by any DPU, or one that ended before it was renewed,
+// runs its callback and is given back
+// 
+//
+ErrorCodeT
+DDSFrontEnd::RenewFileLeases() {
+    static thread_local bool revoked[DDS_MAX_FILES];
+    FileIdT revokedIds[CTRL_MSG_RENEW_LEASES_MAX_REVOKED];
+    int64_t start = DDSFile::LeaseNow();
+    uint32_t termMs = UINT32_MAX;
+
+    memset(revoked, 0, sizeof(revoked));
+    ErrorCodeT result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        uint32_t numRevoked;
+        uint32_t stripeTermMs;
+        ErrorCodeT stripeResult = backEnd->RenewFileLeases(revokedIds, CTRL_MSG_RENEW_LEASES_MAX_REVOKED,
+            &numRevoked, &stripeTermMs);
+        if (stripeResult == DDS_ERROR_CODE_SUCCESS) {
+            termMs = stripeTermMs < termMs ? stripeTermMs : termMs;
+            for (uint32_t r = 0; r != numRevoked; r++) {
+                revoked[revokedIds[r]] = true;
+            }
         }
+        return stripeResult;
+    });
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
     }
 
-    pIO->IsRead = false;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
-    pIO->AppBuffer = DestBuffer;
-    pIO->AppBufferArray = nullptr;
-    pIO->BytesDesired = BytesToWrite;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
+    for (size_t f = 0; f != FileIdEnd; f++) {
+        DDSFile* file = AllFiles[f];
+        if (!file) {
+            continue;
+        }
 
-    result = BackEnd->WriteFile(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBuffer,
-        pIO->BytesDesired,
-        BytesWritten,
-        pIO,
-        poll
-    );
+        FileLeaseMode mode = (FileLeaseMode)file->LeaseMode.load(std::memory_order_acquire);
+        if (mode == LEASE_NONE) {
+            continue;
+        }
 
-    FileSizeT newPointer = ((DDSFile*)pIO->FileReference)->GetPointer() + BytesToWrite;
-    ((DDSFile*)pIO->FileReference)->SetPointer(newPointer);
+        if (!revoked[f] && file->GetLease() != LEASE_NONE) {
+            file->LeaseEnd.store(termMs == UINT32_MAX ? INT64_MAX : start + termMs, std::memory_order_relaxed);
+            continue;
+        }
 
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
+        if (file->LeaseCallback) {
+            file->LeaseCallback((FileIdT)f, mode, file->LeaseContext);
+        }
+        ErrorCodeT giveBackResult = GiveBackLease((FileIdT)f);
+        if (giveBackResult != DDS_ERROR_CODE_SUCCESS) {
+            result = giveBackResult;
+        }
     }
 
     return result;
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
-// Async write to a file
+// Compile and load a scan function on the back end, which names it by ScanId in later scans
 // 
 //
 ErrorCodeT
-DDSFrontEnd::WriteFile(
-    FileIdT FileId,
-    BufferT SourceBuffer,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
-    ReadWriteCallback Callback,
-    ContextT Context
+DDSFrontEnd::LoadScanFunction(
+    const char* CodePath,
+    uint16_t* ScanId
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    if (!CodePath || !ScanId) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
 
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        //
-        // If this is a callback-based completion,
-        // perform polling once
-        //
-        //
-        if (pIO->AppCallback) {
-            FileIOSizeT bytesServiced;
-            ContextT fileCtxt;
-            ContextT ioCtxt;
-            bool pollResult;
+    return BackEnd->LoadScanFunction(CodePath, ScanId);
+}
 
-            PollWait(
-                pollId,
-                &bytesServiced,
-                &fileCtxt,
-                &ioCtxt,
-                0,
-                &pollResult
-            );
-        }
+//
+// Start capturing the requests of all threads into a trace at Path (DDSCapture.h);
+// there is one capture at a time in a process
+// 
+//
+ErrorCodeT
+DDSFrontEnd::StartCapture(
+    const char* Path
+) {
+    DDSCaptureHeaderT header;
 
-        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    if (!Path) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
     }
 
-    pIO->IsRead = false;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
-    pIO->BytesDesired = BytesToWrite;
-    pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = nullptr;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
+    std::lock_guard<std::mutex> lock(CaptureMutex);
+    if (CaptureFile) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
 
-    result = BackEnd->WriteFile(
-        FileId,
-        pIO->Offset,
-        SourceBuffer,
-        BytesToWrite,
-        nullptr,
-        pIO,
-        poll
+    CaptureFile = fopen(Path, "wb");
+    if (!CaptureFile) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    DDSCaptureHeaderInit(&header);
+    if (fwrite(&header, sizeof(header), 1, CaptureFile) != 1) {
+        fclose(CaptureFile);
+        CaptureFile = nullptr;
+        return DDS_ERROR_CODE_IO_FAILURE;
+    }
+
+    CaptureStartNs.store(CaptureNowNs(), std::memory_order_relaxed);
+    CaptureGeneration.fetch_add(1, std::memory_order_release);
+    CaptureOn.store(true, std::memory_order_release);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Stop the capture, writing out what the threads have buffered
+// 
+//
+void
+DDSFrontEnd::StopCapture() {
+    std::vector<CaptureBufferT*> buffers;
+
+    if (!CaptureOn.exchange(false)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(CaptureMutex);
+        buffers = CaptureBuffers;
+    }
+
+    for (CaptureBufferT* buffer : buffers) {
+        std::lock_guard<std::mutex> lock(buffer->Lock);
+        WriteCaptureBuffer(buffer);
+    }
+
+    std::lock_guard<std::mutex> lock(CaptureMutex);
+    fclose(CaptureFile);
+    CaptureFile = nullptr;
+}
+
+//
+// Trace the next read or write the calling thread submits with a trace id
+// 
+//
+void
+DDSFrontEnd::SetNextIOTraceId(
+    uint64_t TraceId
+) {
+    NextIOTraceId = TraceId;
+}
+
+//
+// Get file size
+// 
+//
+ErrorCodeT
+DDSFrontEnd::GetFileSize(
+    FileIdT FileId,
+    FileSizeT* FileSize
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    //
+    // Writes of this front end grow the size as they complete,
+    // so only a shared file whose lease expired asks the back end
+    //
+    //
+    DDSFile* file = AllFiles[FileId];
+    if ((file->GetAttributes() & DDS_FILE_ATTRIBUTE_SHARED) && !file->HoldsSizeLease()) {
+        //
+        // Striped, the file ends after the last byte that any data DPU holds
+        //
+        //
+        FileSizeT backEndSize = 0;
+        ErrorCodeT result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t Stripe) {
+            FileSizeT stripeSize;
+            ErrorCodeT stripeResult = backEnd->GetFileSize(FileId, &stripeSize);
+            if (stripeResult == DDS_ERROR_CODE_SUCCESS && stripeSize && Stripe < DataStripes) {
+                FileSizeT last = stripeSize - 1;
+                FileSizeT end = NumStripes == 1 ? stripeSize :
+                    ((last / StripeUnitBytes) * DataStripes + Stripe) * StripeUnitBytes + last % StripeUnitBytes + 1;
+                if (end > backEndSize) {
+                    backEndSize = end;
+                }
+            }
+            return stripeResult;
+        });
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            return result;
+        }
+
+        file->RenewSizeLease(backEndSize);
+    }
+
+    *FileSize = file->GetSize();
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Open a handle to a file for I/O;
+// the handle stays valid until the file is deleted
+// 
+//
+ErrorCodeT
+DDSFrontEnd::OpenFileHandle(
+    FileIdT FileId,
+    FileHandleT* Handle
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    *Handle = &FileHandles[FileId];
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Async read from a file
+// 
+//
+ErrorCodeT
+DDSFrontEnd::ReadFile(
+    FileIdT FileId,
+    BufferT DestBuffer,
+    FileIOSizeT BytesToRead,
+    FileIOSizeT* BytesRead,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    PROFILE_SCOPE("ReadFile");
+    FileHandle* handle = &FileHandles[FileId];
+    DDSFileCache* cache = handle->File->Cache;
+    CacheIOT readAhead;
+
+    //
+    // The cache copies with the CPU, so a read into a device buffer goes around it
+    //
+    //
+    if (cache && IsDeviceBuffer(handle->Poll, DestBuffer, BytesToRead)) {
+        cache = nullptr;
+    }
+
+    if (cache) {
+        CacheResultT cacheResult = cache->Read(handle->File->GetPointer(), DestBuffer, BytesToRead, &readAhead);
+
+        if (cacheResult == CACHE_HIT) {
+            //
+            // Served synchronously; no callback or poll completion follows
+            //
+            //
+            CaptureIO(DDS_CAPTURE_OP_READ, FileId, handle->File->GetPointer(), BytesToRead, DDS_ERROR_CODE_SUCCESS);
+            handle->File->IncrementPointer(BytesToRead);
+            if (BytesRead) {
+                *BytesRead = BytesToRead;
+            }
+            return DDS_ERROR_CODE_SUCCESS;
+        }
+
+        if (cacheResult == CACHE_RETRY) {
+            //
+            // The read needs buffered writes: write them back, unless that is already under way,
+            // and fence the read behind them so that it goes to storage as usual
+            //
+            //
+            CacheIOT writeBack;
+            cache->Flush(&writeBack);
+            ErrorCodeT result = SubmitCacheIO(handle, false, &writeBack);
+            if (result != DDS_ERROR_CODE_SUCCESS && result != DDS_ERROR_CODE_IO_PENDING) {
+                return result;
+            }
+
+            result = FenceFile(FileId, handle->File->GetPointer(), BytesToRead);
+            if (result != DDS_ERROR_CODE_SUCCESS) {
+                return result;
+            }
+        }
+    }
+
+    ErrorCodeT result = ReadFileAt(
+        handle,
+        DestBuffer,
+        handle->File->GetPointer(),
+        BytesToRead,
+        BytesRead,
+        Callback,
+        Context
     );
 
     if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+        if (cache && readAhead.Valid) {
+            cache->ReadAheadFailed();
+        }
         return result;
     }
 
+    CaptureIO(DDS_CAPTURE_OP_READ, FileId, handle->File->GetPointer(), BytesToRead, result);
+
     //
     // Update file pointer
     //
     //
-    ((DDSFile*)pIO->FileReference)->IncrementPointer(BytesToWrite);
+    handle->File->IncrementPointer(BytesToRead);
+
+    if (cache) {
+        SubmitCacheIO(handle, true, &readAhead);
+    }
 
     return DDS_ERROR_CODE_IO_PENDING;
 }
-#else
-#error "Unknown backend type"
-#endif
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async write to a file with gathering
+// Async read from a file with scattering
 // 
 //
 ErrorCodeT
-DDSFrontEnd::WriteFileGather(
+DDSFrontEnd::ReadFileScatter(
     FileIdT FileId,
-    BufferT* SourceBufferArray,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
+    BufferT* DestBufferArray,
+    FileIOSizeT BytesToRead,
+    FileIOSizeT* BytesRead,
     ReadWriteCallback Callback,
     ContextT Context
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    FileHandle* handle = &FileHandles[FileId];
+    PollIdT pollId = handle->PollId;
+    PollT* poll = handle->Poll;
 
     //
-    // Lock-free busy polling for completion
+    // Scattered and gathered I/Os are not split across DPUs
     //
     //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    FileSizeT offset = handle->File->GetPointer();
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        //
+        // All slots are in flight; if this is a callback-based completion,
+        // perform polling once
+        //
+        //
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                pollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
         }
+
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
-    pIO->IsRead = false;
-    pIO->IsSegmented = true;
-    pIO->FileReference = AllFiles[FileId];
+    pIO->IsRead = true;
+    pIO->FileReference = handle->File;
     pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
+    pIO->Offset = offset;
+    pIO->BytesDesired = BytesToRead;
     pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = SourceBufferArray;
-    pIO->BytesDesired = BytesToWrite;
-    pIO->BytesServiced = 0;
+    pIO->AppBufferArray = DestBufferArray;
+    pIO->ZeroCopyResponse = nullptr;
     pIO->AppCallback = Callback;
     pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->ReadFileScatter(
+            FileId,
+            offset,
+            DestBufferArray,
+            BytesToRead,
+            nullptr,
+            pIO,
+            poll
+        );
+    });
 
-    result = BackEnd->WriteFileGather(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBufferArray,
-        pIO->BytesDesired,
-        &pIO->BytesServiced,
-        pIO,
-        poll
-    );
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
+    }
+
+    //
+    // Update file pointer
+    //
+    //
+    handle->File->IncrementPointer(BytesToRead);
+
+    return CaptureIO(DDS_CAPTURE_OP_READ, FileId, offset, BytesToRead, DDS_ERROR_CODE_IO_PENDING);
+}
+
+//
+// Async write to a file
+// 
+//
+ErrorCodeT
+DDSFrontEnd::WriteFile(
+    FileIdT FileId,
+    BufferT SourceBuffer,
+    FileIOSizeT BytesToWrite,
+    FileIOSizeT* BytesWritten,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    FileHandle* handle = &FileHandles[FileId];
+    DDSFile* file = handle->File;
+
+    if (file->WriteMode == WRITE_APPEND) {
+        //
+        // Reserve the range before issuing so that concurrent appends never overlap
+        //
+        //
+        FileSizeT offset = file->ReservePointer(BytesToWrite);
+
+        ErrorCodeT result = WriteFileAt(
+            handle,
+            SourceBuffer,
+            offset,
+            BytesToWrite,
+            BytesWritten,
+            Callback,
+            Context
+        );
+
+        if (result != DDS_ERROR_CODE_IO_PENDING) {
+            file->UnreservePointer(offset, BytesToWrite);
+        }
 
-    if (BytesWritten) {
-        *BytesWritten = pIO->BytesServiced;
+        return CaptureIO(DDS_CAPTURE_OP_WRITE, FileId, offset, BytesToWrite, result);
     }
 
-    FileSizeT newPointer = ((DDSFile*)pIO->FileReference)->GetPointer() + BytesToWrite;
-    ((DDSFile*)pIO->FileReference)->SetPointer(newPointer);
+    if (file->Cache) {
+        CacheIOT writeBack;
+        CacheResultT cacheResult = file->Cache->Write(file->GetPointer(), SourceBuffer, BytesToWrite, &writeBack);
+        SubmitCacheIO(handle, false, &writeBack);
+
+        if (cacheResult == CACHE_HIT) {
+            //
+            // Buffered synchronously; no callback or poll completion follows
+            //
+            //
+            FileSizeT offset = file->ReservePointer(BytesToWrite);
+            file->GrowSize(offset + BytesToWrite);
+            if (BytesWritten) {
+                *BytesWritten = BytesToWrite;
+            }
+            return CaptureIO(DDS_CAPTURE_OP_WRITE, FileId, offset, BytesToWrite, DDS_ERROR_CODE_SUCCESS);
+        }
 
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
+        if (cacheResult == CACHE_RETRY) {
+            return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+        }
     }
 
-    return result;
+    ErrorCodeT result = WriteFileAt(
+        handle,
+        SourceBuffer,
+        file->GetPointer(),
+        BytesToWrite,
+        BytesWritten,
+        Callback,
+        Context
+    );
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        return result;
+    }
+
+    CaptureIO(DDS_CAPTURE_OP_WRITE, FileId, file->GetPointer(), BytesToWrite, result);
+
+    //
+    // Update file pointer
+    //
+    //
+    file->IncrementPointer(BytesToWrite);
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
 // Async write to a file with gathering
 // 
@@ -1092,24 +2282,27 @@ DDSFrontEnd::WriteFileGather(
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    FileHandle* handle = &FileHandles[FileId];
+    PollIdT pollId = handle->PollId;
+    PollT* poll = handle->Poll;
+
+    //
+    // Scattered and gathered I/Os are not split across DPUs
+    //
+    //
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    FileIOT* pIO = poll->AcquireSlot();
 
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
+    if (!pIO) {
         //
-        // If this is a callback-based completion,
+        // All slots are in flight; if this is a callback-based completion,
         // perform polling once
         //
         //
-        if (pIO->AppCallback) {
+        if (Callback) {
             FileIOSizeT bytesServiced;
             ContextT fileCtxt;
             ContextT ioCtxt;
@@ -1127,28 +2320,43 @@ DDSFrontEnd::WriteFileGather(
         return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
+    //
+    // In append mode, reserve the range before issuing so that concurrent appends never overlap
+    //
+    //
+    bool append = handle->File->WriteMode == WRITE_APPEND;
+
     pIO->IsRead = false;
-    pIO->FileReference = AllFiles[FileId];
+    pIO->DurableWrite = handle->File->Durability == DURABILITY_FUA;
+    pIO->FileReference = handle->File;
     pIO->FileId = FileId;
-    pIO->Offset = AllFiles[FileId]->GetPointer();
+    FileSizeT offset = append ? handle->File->ReservePointer(BytesToWrite) : handle->File->GetPointer();
+    pIO->Offset = offset;
     pIO->BytesDesired = BytesToWrite;
     pIO->AppBuffer = nullptr;
     pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
     pIO->AppCallback = Callback;
     pIO->Context = Context;
-
-    result = BackEnd->WriteFileGather(
-        FileId,
-        pIO->Offset,
-        SourceBufferArray,
-        BytesToWrite,
-        nullptr,
-        pIO,
-        poll
-    );
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->WriteFileGather(
+            FileId,
+            offset,
+            SourceBufferArray,
+            BytesToWrite,
+            nullptr,
+            pIO,
+            poll
+        );
+    });
 
     if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+        if (append) {
+            handle->File->UnreservePointer(offset, BytesToWrite);
+        }
+        poll->ReleaseSlot(pIO);
         return result;
     }
 
@@ -1156,20 +2364,18 @@ DDSFrontEnd::WriteFileGather(
     // Update file pointer
     //
     //
-    ((DDSFile*)pIO->FileReference)->IncrementPointer(BytesToWrite);
+    if (!append) {
+        handle->File->IncrementPointer(BytesToWrite);
+    }
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    return CaptureIO(DDS_CAPTURE_OP_WRITE, FileId, offset, BytesToWrite, DDS_ERROR_CODE_IO_PENDING);
 }
-#else
-#error "Unknown backend type"
-#endif
 
 //
 // Read/write with offset
 //
 //
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
 // Async read from a file
 // 
@@ -1184,62 +2390,27 @@ DDSFrontEnd::ReadFile(
     ReadWriteCallback Callback,
     ContextT Context
 ) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
-
-    //
-    // Lock-free busy polling for completion
-    //
-    //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
-        }
-    }
-
-    pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = Offset;
-    pIO->AppBuffer = DestBuffer;
-    pIO->AppBufferArray = nullptr;
-    pIO->BytesDesired = BytesToRead;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
-
-    result = BackEnd->ReadFile(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBuffer,
-        pIO->BytesDesired,
+    PROFILE_SCOPE("ReadFile");
+    ErrorCodeT result = ReadFileAt(
+        &FileHandles[FileId],
+        DestBuffer,
+        Offset,
+        BytesToRead,
         BytesRead,
-        pIO,
-        poll
+        Callback,
+        Context
     );
 
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
-    }
-
-    return result;
+    return CaptureIO(DDS_CAPTURE_OP_READ, FileId, Offset, BytesToRead, result);
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
-// Async read from a file
+// Async read from an opened file with offset
 // 
 //
 ErrorCodeT
-DDSFrontEnd::ReadFile(
-    FileIdT FileId,
+DDSFrontEnd::ReadFileAt(
+    FileHandleT Handle,
     BufferT DestBuffer,
     FileSizeT Offset,
     FileIOSizeT BytesToRead,
@@ -1249,24 +2420,28 @@ DDSFrontEnd::ReadFile(
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    //
+    // Erasure-coded, a read goes through a stream while a DPU is lost, in case it has to be reconstructed
+    //
+    //
+    if (BytesToRead > StreamChunkBytes || StripeChunkBytes(Offset, BytesToRead) != BytesToRead ||
+        (ParityStripes && BytesToRead && LostStripes(Handle->Poll))) {
+        return StreamIO(Handle, true, DestBuffer, Offset, BytesToRead, Callback, Context);
+    }
+
+    PollIdT pollId = Handle->PollId;
+    PollT* poll = Handle->Poll;
+    FileSizeT stripeOffset = Offset;
+    PollT* stripe = poll->NumStripes == 1 ? poll : poll->Stripes[StripeOfOffset(Offset, &stripeOffset)];
+    FileIOT* pIO = poll->AcquireSlot();
 
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
+    if (!pIO) {
         //
-        // If this is a callback-based completion,
+        // All slots are in flight; if this is a callback-based completion,
         // perform polling once
         //
         //
-        if (pIO->AppCallback) {
+        if (Callback) {
             FileIOSizeT bytesServiced;
             ContextT fileCtxt;
             ContextT ioCtxt;
@@ -1285,134 +2460,83 @@ DDSFrontEnd::ReadFile(
     }
 
     pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
+    pIO->CompressRead = Handle->File->CompressReads;
+    pIO->FileReference = Handle->File;
+    pIO->FileId = Handle->FileId;
     pIO->Offset = Offset;
     pIO->BytesDesired = BytesToRead;
     pIO->AppBuffer = DestBuffer;
     pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
     pIO->AppCallback = Callback;
     pIO->Context = Context;
-
-    result = BackEnd->ReadFile(
-        FileId,
-        Offset,
-        DestBuffer,
-        BytesToRead,
-        nullptr,
-        pIO,
-        poll
-    );
+    pIO->Replayable = true;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->ReadFile(
+            Handle->FileId,
+            stripeOffset,
+            DestBuffer,
+            BytesToRead,
+            nullptr,
+            pIO,
+            stripe
+        );
+    });
 
     if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+        poll->ReleaseSlot(pIO);
         return result;
     }
 
     return DDS_ERROR_CODE_IO_PENDING;
 }
-#else
-#error "Unknown backend type"
-#endif
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async read from a file with scattering
+// Async read from a file without copying;
+// on completion, Response views the data in the response ring until ReleaseResponse
 // 
 //
 ErrorCodeT
-DDSFrontEnd::ReadFileScatter(
+DDSFrontEnd::ReadFileZeroCopy(
     FileIdT FileId,
-    BufferT* DestBufferArray,
     FileSizeT Offset,
     FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
+    ZeroCopyReadT* Response,
     ReadWriteCallback Callback,
     ContextT Context
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
-
     //
-    // Lock-free busy polling for completion
+    // Only the DPU back end has response rings to view data in
     //
     //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
-        }
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
     }
 
-    pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = Offset;
-    pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = DestBufferArray;
-    pIO->BytesDesired = BytesToRead;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
-
-    result = BackEnd->ReadFileScatter(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBufferArray,
-        pIO->BytesDesired,
-        BytesRead,
-        pIO,
-        poll
-    );
-
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
+    //
+    // A zero-copy read views the response ring of one DPU
+    //
+    //
+    if (NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
     }
 
-    return result;
-}
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
-//
-// Async read from a file with scattering
-// 
-//
-ErrorCodeT
-DDSFrontEnd::ReadFileScatter(
-    FileIdT FileId,
-    BufferT* DestBufferArray,
-    FileSizeT Offset,
-    FileIOSizeT BytesToRead,
-    FileIOSizeT* BytesRead,
-    ReadWriteCallback Callback,
-    ContextT Context
-) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
-
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    FileHandle* handle = &FileHandles[FileId];
+    PollIdT pollId = handle->PollId;
+    PollT* poll = handle->Poll;
+    FileIOT* pIO = poll->AcquireSlot();
 
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
+    if (!pIO) {
         //
-        // If this is a callback-based completion,
+        // All slots are in flight; if this is a callback-based completion,
         // perform polling once
         //
         //
-        if (pIO->AppCallback) {
+        if (Callback) {
             FileIOSizeT bytesServiced;
             ContextT fileCtxt;
             ContextT ioCtxt;
@@ -1427,139 +2551,194 @@ DDSFrontEnd::ReadFileScatter(
                 &pollResult
             );
         }
-
         return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
+    Response->PollId = pollId;
+    Response->Data.TotalSize = 0;
+    Response->Data.FirstSize = 0;
+    Response->Data.FirstAddr = nullptr;
+    Response->Data.SecondAddr = nullptr;
+
     pIO->IsRead = true;
-    pIO->FileReference = AllFiles[FileId];
+    pIO->FileReference = handle->File;
     pIO->FileId = FileId;
     pIO->Offset = Offset;
     pIO->BytesDesired = BytesToRead;
     pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = DestBufferArray;
+    pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = Response;
     pIO->AppCallback = Callback;
     pIO->Context = Context;
-
-    result = BackEnd->ReadFileScatter(
-        FileId,
-        Offset,
-        DestBufferArray,
-        BytesToRead,
-        nullptr,
-        pIO,
-        poll
-    );
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->ReadFile(
+            FileId,
+            Offset,
+            nullptr,
+            BytesToRead,
+            nullptr,
+            pIO,
+            poll
+        );
+    });
 
     if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+        poll->ReleaseSlot(pIO);
         return result;
     }
 
-    return DDS_ERROR_CODE_IO_PENDING;
+    return CaptureIO(DDS_CAPTURE_OP_READ, FileId, Offset, BytesToRead, DDS_ERROR_CODE_IO_PENDING);
 }
-#else
-#error "Unknown backend type"
-#endif
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async write to a file
+// Async read of the item a key maps to in the cache table on the DPU
 // 
 //
 ErrorCodeT
-DDSFrontEnd::WriteFile(
-    FileIdT FileId,
-    BufferT SourceBuffer,
-    FileSizeT Offset,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
+DDSFrontEnd::GetByKey(
+    PollIdT PollId,
+    const CacheKeyT* Key,
+    BufferT DestBuffer,
+    FileIOSizeT BufferSize,
+    FileIOSizeT* BytesRead,
     ReadWriteCallback Callback,
     ContextT Context
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+
+    //
+    // The items of the cache table are at offsets of files on one DPU
+    //
+    //
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
 
     //
-    // Lock-free busy polling for completion
+    // An item comes back inline in the response, to be copied
     //
     //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
+    if (IsDeviceBuffer(poll, DestBuffer, BufferSize)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        //
+        // All slots are in flight; if this is a callback-based completion,
+        // perform polling once
+        //
+        //
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                PollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
         }
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
-    pIO->IsRead = false;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = Offset;
+    //
+    // The read has no file of its own until the back end resolves the key
+    //
+    //
+    pIO->IsRead = true;
+    pIO->CompressRead = false;
+    pIO->FileReference = nullptr;
+    pIO->FileId = BUFF_MSG_REQUEST_FILE_BY_KEY;
+    pIO->Offset = 0;
+    pIO->BytesDesired = BufferSize;
     pIO->AppBuffer = DestBuffer;
     pIO->AppBufferArray = nullptr;
-    pIO->BytesDesired = BytesToWrite;
+    pIO->ZeroCopyResponse = nullptr;
     pIO->AppCallback = Callback;
     pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->ReadFileByKey(
+            Key,
+            DestBuffer,
+            BufferSize,
+            pIO,
+            poll
+        );
+    });
 
-    result = BackEnd->WriteFile(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBuffer,
-        pIO->BytesDesired,
-        BytesWritten,
-        pIO,
-        poll
-    );
-
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
     }
 
-    return result;
+    return DDS_ERROR_CODE_IO_PENDING;
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
-// Async write to a file
+// Async scan of Bytes of a file from Offset in records of RecordBytes with a loaded scan function;
+// only what the function keeps of the records is read into the destination, and BytesRead tells how much that is
 // 
 //
 ErrorCodeT
-DDSFrontEnd::WriteFile(
+DDSFrontEnd::ScanFile(
     FileIdT FileId,
-    BufferT SourceBuffer,
+    uint16_t ScanId,
     FileSizeT Offset,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
+    FileIOSizeT Bytes,
+    FileIOSizeT RecordBytes,
+    BufferT DestBuffer,
+    FileIOSizeT BufferSize,
+    FileIOSizeT* BytesRead,
     ReadWriteCallback Callback,
     ContextT Context
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    //
+    // A scan runs over the records of a file on one DPU
+    //
+    //
+    if (NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (RecordBytes == 0) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    FileHandle* handle = &FileHandles[FileId];
+    PollIdT pollId = handle->PollId;
+    PollT* poll = handle->Poll;
+    FileIOT* pIO = poll->AcquireSlot();
 
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
+    if (!pIO) {
         //
-        // If this is a callback-based completion,
+        // All slots are in flight; if this is a callback-based completion,
         // perform polling once
         //
         //
-        if (pIO->AppCallback) {
+        if (Callback) {
             FileIOSizeT bytesServiced;
             ContextT fileCtxt;
             ContextT ioCtxt;
@@ -1574,145 +2753,184 @@ DDSFrontEnd::WriteFile(
                 &pollResult
             );
         }
-
         return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
-    pIO->IsRead = false;
-    pIO->FileReference = AllFiles[FileId];
+    pIO->IsRead = true;
+    pIO->CompressRead = false;
+    pIO->FileReference = handle->File;
     pIO->FileId = FileId;
     pIO->Offset = Offset;
-    pIO->BytesDesired = BytesToWrite;
-    pIO->AppBuffer = nullptr;
+    pIO->BytesDesired = BufferSize;
+    pIO->AppBuffer = DestBuffer;
     pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
     pIO->AppCallback = Callback;
     pIO->Context = Context;
-
-    result = BackEnd->WriteFile(
-        FileId,
-        Offset,
-        SourceBuffer,
-        BytesToWrite,
-        nullptr,
-        pIO,
-        poll
-    );
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->ScanFile(
+            FileId,
+            Offset,
+            Bytes,
+            RecordBytes,
+            ScanId,
+            DestBuffer,
+            BufferSize,
+            pIO,
+            poll
+        );
+    });
 
     if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+        poll->ReleaseSlot(pIO);
         return result;
     }
 
     return DDS_ERROR_CODE_IO_PENDING;
 }
-#else
-#error "Unknown backend type"
-#endif
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Async write to a file with gathering
+// Release the data of a completed zero-copy read back to the response ring
 // 
 //
 ErrorCodeT
-DDSFrontEnd::WriteFileGather(
-    FileIdT FileId,
-    BufferT* SourceBufferArray,
-    FileSizeT Offset,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
-    ReadWriteCallback Callback,
-    ContextT Context
+DDSFrontEnd::ReleaseResponse(
+    ZeroCopyReadT* Response
+) {
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (Response->PollId >= DDS_MAX_POLLS || !AllPolls[Response->PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    AllPolls[Response->PollId]->ReleaseResponseBatch(Response->Batch);
+    Response->Data.FirstAddr = nullptr;
+    Response->Data.SecondAddr = nullptr;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Submit a batch of reads or writes on one poll
+// 
+//
+ErrorCodeT
+DDSFrontEnd::SubmitFileIOBatch(
+    bool IsRead,
+    FileIOBatchEntryT* Entries,
+    size_t NumEntries,
+    size_t* NumSubmitted,
+    ReadWriteCallback Callback
 ) {
     ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    PollT* poll = AllPolls[AllFiles[FileId]->PollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+    *NumSubmitted = 0;
+    if (NumEntries == 0) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    //
+    // A batch goes into the request ring of a single poll
+    //
+    //
+    PollIdT pollId = FileHandles[Entries[0].FileId].PollId;
+    PollT* poll = FileHandles[Entries[0].FileId].Poll;
 
     //
-    // Lock-free busy polling for completion
+    // A batch goes into the request ring of one DPU
     //
     //
-    bool expectedCompletion = true;
-    while (pIO->IsComplete.compare_exchange_weak(
-        expectedCompletion,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
-        if (pIO->AppCallback == nullptr) {
-            return DDS_ERROR_CODE_REQUIRE_POLLING;
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    for (size_t e = 1; e != NumEntries; e++) {
+        if (FileHandles[Entries[e].FileId].PollId != pollId) {
+            return DDS_ERROR_CODE_INVALID_PARAM;
         }
     }
 
-    pIO->IsRead = false;
-    pIO->IsSegmented = true;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = Offset;
-    pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = SourceBufferArray;
-    pIO->BytesDesired = BytesToWrite;
-    pIO->BytesServiced = 0;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
+    //
+    // Merged reads are split by copying, which the host cannot do into a device buffer
+    //
+    //
+    for (size_t e = 0; IsRead && poll->NumDeviceBuffers && e != NumEntries; e++) {
+        if (IsDeviceBuffer(poll, Entries[e].Buffer, Entries[e].Bytes)) {
+            return DDS_ERROR_CODE_INVALID_PARAM;
+        }
+    }
 
-    result = BackEnd->WriteFileGather(
-        pIO->FileId,
-        pIO->Offset,
-        pIO->AppBufferArray,
-        pIO->BytesDesired,
-        &pIO->BytesServiced,
-        pIO,
-        poll
-    );
+    //
+    // Take as many slots as are available for the leading entries
+    //
+    //
+    FileIOT* ios[DDS_MAX_OUTSTANDING_IO];
+    size_t maxIOs = NumEntries < DDS_MAX_OUTSTANDING_IO ? NumEntries : DDS_MAX_OUTSTANDING_IO;
+    size_t numIOs = 0;
 
-    if (BytesWritten) {
-        *BytesWritten = pIO->BytesServiced;
-    }
+    for (; numIOs != maxIOs; numIOs++) {
+        FileIOT* pIO = poll->AcquireSlot();
+        if (!pIO) {
+            break;
+        }
 
-    if (!Callback) {
-        return DDS_ERROR_CODE_IO_PENDING;
+        FileIOBatchEntryT* entry = &Entries[numIOs];
+        pIO->IsRead = IsRead;
+        pIO->DurableWrite = !IsRead && FileHandles[entry->FileId].File->Durability == DURABILITY_FUA;
+        pIO->FileReference = FileHandles[entry->FileId].File;
+        pIO->FileId = entry->FileId;
+        pIO->Offset = entry->Offset;
+        pIO->BytesDesired = entry->Bytes;
+        pIO->AppBuffer = entry->Buffer;
+        pIO->AppBufferArray = nullptr;
+        pIO->ZeroCopyResponse = nullptr;
+        pIO->AppCallback = Callback;
+        pIO->Context = entry->Context;
+
+        ios[numIOs] = pIO;
     }
 
-    return result;
-}
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
-//
-// Async write to a file with gathering
-// 
-//
-ErrorCodeT
-DDSFrontEnd::WriteFileGather(
-    FileIdT FileId,
-    BufferT* SourceBufferArray,
-    FileSizeT Offset,
-    FileIOSizeT BytesToWrite,
-    FileIOSizeT* BytesWritten,
-    ReadWriteCallback Callback,
-    ContextT Context
-) {
-    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    //
+    // Merge runs of reads to adjacent ranges of the same file into one request,
+    // chained from the first read; the response is split back when it arrives
+    //
+    //
+    FileIOT* requests[DDS_MAX_OUTSTANDING_IO];
+    size_t numRequests = 0;
+    FileIOT* lastRead = nullptr;
+
+    for (size_t i = 0; i != numIOs; i++) {
+        FileIOT* pIO = ios[i];
+
+        if (IsRead && lastRead) {
+            FileIOT* leader = requests[numRequests - 1];
+            FileIOSizeT leaderBytes = leader->NextCoalesced ? leader->CoalescedBytes : leader->BytesDesired;
+
+            if (lastRead->FileId == pIO->FileId &&
+                lastRead->Offset + lastRead->BytesDesired == pIO->Offset &&
+                (size_t)leaderBytes + pIO->BytesDesired <= DDS_READ_COALESCE_MAX_BYTES) {
+                lastRead->NextCoalesced = pIO;
+                leader->CoalescedBytes = leaderBytes + pIO->BytesDesired;
+                lastRead = pIO;
+                continue;
+            }
+        }
 
-    PollIdT pollId = AllFiles[FileId]->PollId;
-    PollT* poll = AllPolls[pollId];
-    size_t mySlot = poll->NextRequestSlot.fetch_add(1, std::memory_order_relaxed);
-    mySlot %= DDS_MAX_OUTSTANDING_IO;
-    FileIOT* pIO = poll->OutstandingRequests[mySlot];
+        requests[numRequests++] = pIO;
+        lastRead = pIO;
+    }
 
-    bool expectedAvail = true;
-    if (pIO->IsAvailable.compare_exchange_weak(
-        expectedAvail,
-        false,
-        std::memory_order_relaxed
-    ) == false) {
+    if (numIOs == 0) {
         //
-        // If this is a callback-based completion,
+        // All slots are in flight; if this is a callback-based completion,
         // perform polling once
         //
         //
-        if (pIO->AppCallback) {
+        if (Callback) {
             FileIOSizeT bytesServiced;
             ContextT fileCtxt;
             ContextT ioCtxt;
@@ -1730,478 +2948,3144 @@ DDSFrontEnd::WriteFileGather(
         return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
-    pIO->IsRead = false;
-    pIO->FileReference = AllFiles[FileId];
-    pIO->FileId = FileId;
-    pIO->Offset = Offset;
-    pIO->BytesDesired = BytesToWrite;
-    pIO->AppBuffer = nullptr;
-    pIO->AppBufferArray = nullptr;
-    pIO->AppCallback = Callback;
-    pIO->Context = Context;
+#ifdef DDS_IO_STATISTICS_ENABLED
+    for (size_t i = 0; i != numIOs; i++) {
+        DDS_IO_STAMP(ios[i], RingTicks);
+    }
+#endif
 
-    result = BackEnd->WriteFileGather(
-        FileId,
-        Offset,
-        SourceBufferArray,
-        BytesToWrite,
-        nullptr,
-        pIO,
-        poll
-    );
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->SubmitFileIOBatch(
+            requests,
+            numRequests,
+            poll
+        );
+    });
 
     if (result != DDS_ERROR_CODE_IO_PENDING) {
-        pIO->IsAvailable = true;
+        for (size_t i = 0; i != numIOs; i++) {
+            poll->ReleaseSlot(ios[i]);
+        }
         return result;
     }
 
-    //
-    // Update file pointer
-    //
-    //
-    ((DDSFile*)pIO->FileReference)->IncrementPointer(BytesToWrite);
+    *NumSubmitted = numIOs;
+
+    for (size_t e = 0; e != numIOs; e++) {
+        CaptureIO(IsRead ? DDS_CAPTURE_OP_READ : DDS_CAPTURE_OP_WRITE, Entries[e].FileId, Entries[e].Offset,
+            Entries[e].Bytes, DDS_ERROR_CODE_IO_PENDING);
+    }
 
     return DDS_ERROR_CODE_IO_PENDING;
 }
-#else
-#error "Unknown backend type"
-#endif
 
 //
-// Flush buffered data to storage
-// Note: buffering is disabled
+// Async reads of a batch of entries, submitted to the back end at once
 // 
 //
 ErrorCodeT
-DDSFrontEnd::FlushFileBuffers(
-    FileIdT FileId
+DDSFrontEnd::ReadFileBatch(
+    FileIOBatchEntryT* Entries,
+    size_t NumEntries,
+    size_t* NumSubmitted,
+    ReadWriteCallback Callback
 ) {
-    return DDS_ERROR_CODE_SUCCESS;
+    return SubmitFileIOBatch(true, Entries, NumEntries, NumSubmitted, Callback);
 }
 
 //
-// Search a directory for a file or subdirectory
-// with a name that matches a specific name
-// (or partial name if wildcards are used)
+// Async writes of a batch of entries, submitted to the back end at once
 // 
 //
 ErrorCodeT
-DDSFrontEnd::FindFirstFile(
-    const char* FileName,
-    FileIdT* FileId
+DDSFrontEnd::WriteFileBatch(
+    FileIOBatchEntryT* Entries,
+    size_t NumEntries,
+    size_t* NumSubmitted,
+    ReadWriteCallback Callback
 ) {
-    //
-    // TODO: support wild card search
-    //
-    //
-    FileIdT id = DDS_FILE_INVALID;
-
-    for (FileIdT i = 0; i != FileIdEnd; i++) {
-        if (AllFiles[i]) {
-            if (strcmp(FileName, AllFiles[i]->GetName()) == 0) {
-                id = i;
-                break;
-            }
-        }
-    }
-
-    if (id == DDS_FILE_INVALID) {
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
-    }
-
-    *FileId = id;
-
-    return DDS_ERROR_CODE_SUCCESS;
+    return SubmitFileIOBatch(false, Entries, NumEntries, NumSubmitted, Callback);
 }
 
 //
-// Continue a file search from a previous call
-// to the FindFirstFile
+// Async read from a file with scattering
 // 
 //
 ErrorCodeT
-DDSFrontEnd::FindNextFile(
-    FileIdT LastFileId,
-    FileIdT* FileId
+DDSFrontEnd::ReadFileScatter(
+    FileIdT FileId,
+    BufferT* DestBufferArray,
+    FileSizeT Offset,
+    FileIOSizeT BytesToRead,
+    FileIOSizeT* BytesRead,
+    ReadWriteCallback Callback,
+    ContextT Context
 ) {
-    *FileId = DDS_FILE_INVALID;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    return DDS_ERROR_CODE_SUCCESS;
+    FileHandle* handle = &FileHandles[FileId];
+    PollIdT pollId = handle->PollId;
+    PollT* poll = handle->Poll;
+
+    //
+    // Scattered and gathered I/Os are not split across DPUs
+    //
+    //
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        //
+        // All slots are in flight; if this is a callback-based completion,
+        // perform polling once
+        //
+        //
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                pollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
+        }
+
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    pIO->IsRead = true;
+    pIO->FileReference = handle->File;
+    pIO->FileId = FileId;
+    pIO->Offset = Offset;
+    pIO->BytesDesired = BytesToRead;
+    pIO->AppBuffer = nullptr;
+    pIO->AppBufferArray = DestBufferArray;
+    pIO->ZeroCopyResponse = nullptr;
+    pIO->AppCallback = Callback;
+    pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->ReadFileScatter(
+            FileId,
+            Offset,
+            DestBufferArray,
+            BytesToRead,
+            nullptr,
+            pIO,
+            poll
+        );
+    });
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
+    }
+
+    return CaptureIO(DDS_CAPTURE_OP_READ, FileId, Offset, BytesToRead, DDS_ERROR_CODE_IO_PENDING);
 }
 
 //
-// Get file properties by file id
+// Async write to a file
 // 
 //
 ErrorCodeT
-DDSFrontEnd::GetFileInformationById(
+DDSFrontEnd::WriteFile(
     FileIdT FileId,
-    FilePropertiesT* FileProperties
+    BufferT SourceBuffer,
+    FileSizeT Offset,
+    FileIOSizeT BytesToWrite,
+    FileIOSizeT* BytesWritten,
+    ReadWriteCallback Callback,
+    ContextT Context
 ) {
-    DDSFile* pFile = AllFiles[FileId];
-    FileProperties->Access = pFile->GetAccess();
-    FileProperties->Position = pFile->GetPointer();
-    FileProperties->ShareMode = pFile->GetShareMode();
-    FileProperties->FileAttributes = pFile->GetAttributes();
-    FileProperties->CreationTime = pFile->GetCreationTime();
-    FileProperties->LastAccessTime = pFile->GetLastAccessTime();
-    FileProperties->LastWriteTime = pFile->GetLastWriteTime();
+    ErrorCodeT result = WriteFileAt(
+        &FileHandles[FileId],
+        SourceBuffer,
+        Offset,
+        BytesToWrite,
+        BytesWritten,
+        Callback,
+        Context
+    );
 
-    return DDS_ERROR_CODE_SUCCESS;
+    return CaptureIO(DDS_CAPTURE_OP_WRITE, FileId, Offset, BytesToWrite, result);
 }
 
 //
-// Get file attributes by file name
+// Async write to an opened file with offset
 // 
 //
 ErrorCodeT
-DDSFrontEnd::GetFileAttributes(
-    const char* FileName,
-    FileAttributesT* FileAttributes
+DDSFrontEnd::WriteFileAt(
+    FileHandleT Handle,
+    BufferT SourceBuffer,
+    FileSizeT Offset,
+    FileIOSizeT BytesToWrite,
+    FileIOSizeT* BytesWritten,
+    ReadWriteCallback Callback,
+    ContextT Context
 ) {
-    FileIdT id = DDS_FILE_INVALID;
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
 
-    for (FileIdT i = 0; i != FileIdEnd; i++) {
-        if (AllFiles[i] && strcmp(FileName, AllFiles[i]->GetName()) == 0) {
-            id = i;
-            break;
-        }
+    //
+    // An atomic write is one request, never streamed in chunks
+    //
+    //
+    if ((Handle->File->GetAttributes() & DDS_FILE_ATTRIBUTE_ATOMIC_WRITES) &&
+        (BytesToWrite > DDS_MAX_ATOMIC_WRITE_BYTES || BytesToWrite > StreamChunkBytes ||
+        StripeChunkBytes(Offset, BytesToWrite) != BytesToWrite)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
     }
 
-    if (id == DDS_FILE_INVALID) {
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    if (Handle->File->Cache) {
+        Handle->File->Cache->Invalidate(Offset, BytesToWrite);
     }
 
     //
-    // File attributes might be updated on the DPU, so get it from back end
+    // Erasure-coded, a write covers whole rows, and streams their parity after their data
     //
     //
-    return BackEnd->GetFileAttributes(id, FileAttributes);
+    if (ParityStripes) {
+        FileSizeT rowBytes = (FileSizeT)StripeUnitBytes * DataStripes;
+        if (Offset % rowBytes != 0 || BytesToWrite % rowBytes != 0) {
+            return DDS_ERROR_CODE_INVALID_PARAM;
+        }
+        return StreamIO(Handle, false, SourceBuffer, Offset, BytesToWrite, Callback, Context);
+    }
+
+    if (BytesToWrite > StreamChunkBytes || StripeChunkBytes(Offset, BytesToWrite) != BytesToWrite) {
+        return StreamIO(Handle, false, SourceBuffer, Offset, BytesToWrite, Callback, Context);
+    }
+
+    PollIdT pollId = Handle->PollId;
+    PollT* poll = Handle->Poll;
+    FileSizeT stripeOffset = Offset;
+    PollT* stripe = poll->NumStripes == 1 ? poll : poll->Stripes[StripeOfOffset(Offset, &stripeOffset)];
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        //
+        // All slots are in flight; if this is a callback-based completion,
+        // perform polling once
+        //
+        //
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                pollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
+        }
+
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    pIO->IsRead = false;
+    pIO->DurableWrite = Handle->File->Durability == DURABILITY_FUA;
+    pIO->FileReference = Handle->File;
+    pIO->FileId = Handle->FileId;
+    pIO->Offset = Offset;
+    pIO->BytesDesired = BytesToWrite;
+    pIO->AppBuffer = nullptr;
+    pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
+    pIO->AppCallback = Callback;
+    pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->WriteFile(
+            Handle->FileId,
+            stripeOffset,
+            SourceBuffer,
+            BytesToWrite,
+            nullptr,
+            pIO,
+            stripe
+        );
+    });
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
+    }
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
-// Retrieve the current directory for the
-// current process
+// Async append to an opened file
 // 
 //
 ErrorCodeT
-DDSFrontEnd::GetCurrentDirectory(
-    unsigned BufferLength,
-    BufferT DirectoryBuffer
+DDSFrontEnd::AppendFile(
+    FileHandleT Handle,
+    BufferT SourceBuffer,
+    FileIOSizeT BytesToWrite,
+    FileSizeT* AppendedOffset,
+    ReadWriteCallback Callback,
+    ContextT Context
 ) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
     //
-    // TODO: this function is more like an OS feature
-    // check whether it is necessary
+    // The end of a striped file is on no single DPU
     //
     //
-    DDSDir* pDir = AllDirs[DDS_DIR_ROOT];
-    if (strlen(pDir->GetName()) > BufferLength) {
-        return DDS_ERROR_CODE_BUFFER_OVERFLOW;
+    if (NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
     }
 
-    strcpy((char*)DirectoryBuffer, pDir->GetName());
+    //
+    // An append is one request, as only the back end knows where it lands,
+    // which is also why the cache of a file cannot follow it
+    //
+    //
+    if (BytesToWrite == 0 || BytesToWrite > StreamChunkBytes || Handle->File->Cache) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
 
-    return DDS_ERROR_CODE_SUCCESS;
+    PollIdT pollId = Handle->PollId;
+    PollT* poll = Handle->Poll;
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                pollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
+        }
+
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    pIO->IsRead = false;
+    pIO->DurableWrite = Handle->File->Durability == DURABILITY_FUA;
+    pIO->Append = true;
+    pIO->AppendedOffset = AppendedOffset;
+    pIO->FileReference = Handle->File;
+    pIO->FileId = Handle->FileId;
+    pIO->Offset = BUFF_MSG_REQUEST_OFFSET_APPEND;
+    pIO->BytesDesired = BytesToWrite;
+    pIO->AppBuffer = nullptr;
+    pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
+    pIO->AppCallback = Callback;
+    pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->WriteFile(
+            Handle->FileId,
+            BUFF_MSG_REQUEST_OFFSET_APPEND,
+            SourceBuffer,
+            BytesToWrite,
+            nullptr,
+            pIO,
+            poll
+        );
+    });
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
+    }
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
-// Get the size of free space on the storage
-// 
+// Send an atomic operation on a word to the DPU that holds it
+//
 //
 ErrorCodeT
-DDSFrontEnd::GetStorageFreeSpace(
-    FileSizeT* StorageFreeSpace
+DDSFrontEnd::AtomicOnFile(
+    FileHandleT Handle,
+    uint32_t Op,
+    FileSizeT Offset,
+    uint64_t Operand,
+    uint64_t Compare,
+    uint64_t* Prior,
+    ReadWriteCallback Callback,
+    ContextT Context
 ) {
-    return BackEnd->GetStorageFreeSpace(StorageFreeSpace);
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    //
+    // Parity would no longer match a word changed on its DPU alone,
+    // and a write-back cache would write its copy of the word over the result
+    //
+    //
+    if (ParityStripes) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+    if (Offset % sizeof(uint64_t) != 0 || (Handle->File->GetAttributes() & DDS_FILE_ATTRIBUTE_WRITE_BACK)) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+    if (Handle->File->Cache) {
+        Handle->File->Cache->Invalidate(Offset, sizeof(uint64_t));
+    }
+
+    PollIdT pollId = Handle->PollId;
+    PollT* poll = Handle->Poll;
+    FileSizeT stripeOffset = Offset;
+    PollT* stripe = poll->NumStripes == 1 ? poll : poll->Stripes[StripeOfOffset(Offset, &stripeOffset)];
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                pollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
+        }
+
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    pIO->IsRead = false;
+    pIO->DurableWrite = Handle->File->Durability == DURABILITY_FUA;
+    pIO->AtomicOp = true;
+    pIO->AtomicRequest.Offset = stripeOffset;
+    pIO->AtomicRequest.Operand = Operand;
+    pIO->AtomicRequest.Compare = Compare;
+    pIO->AtomicRequest.Op = Op;
+    pIO->AtomicRequest.Reserved = 0;
+    pIO->AtomicPrior = Prior;
+    pIO->FileReference = Handle->File;
+    pIO->FileId = Handle->FileId;
+    pIO->Offset = Offset;
+    pIO->BytesDesired = sizeof(uint64_t);
+    pIO->AppBuffer = nullptr;
+    pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
+    pIO->AppCallback = Callback;
+    pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    //
+    // The request is sent as a write of its header, which stays in the slot should the request wait for ring space
+    //
+    //
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->WriteFile(
+            Handle->FileId,
+            BUFF_MSG_REQUEST_OFFSET_ATOMIC,
+            (BufferT)&pIO->AtomicRequest,
+            sizeof(BuffMsgF2BAtomicHeader),
+            nullptr,
+            pIO,
+            stripe
+        );
+    });
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
+    }
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
-// Lock the specified file for exclusive
-// access by the calling process
+// Async compare-and-swap of a word of an opened file
 // 
 //
 ErrorCodeT
-DDSFrontEnd::LockFile(
-    FileIdT FileId,
-    PositionInFileT FileOffset,
-    PositionInFileT NumberOfBytesToLock
+DDSFrontEnd::CompareAndSwapFile(
+    FileHandleT Handle,
+    FileSizeT Offset,
+    uint64_t Expected,
+    uint64_t Desired,
+    uint64_t* Prior,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    return AtomicOnFile(Handle, BUFF_MSG_ATOMIC_COMPARE_SWAP, Offset, Desired, Expected, Prior, Callback, Context);
+}
+
+//
+// Async fetch-and-add of a word of an opened file
+// 
+//
+ErrorCodeT
+DDSFrontEnd::FetchAndAddFile(
+    FileHandleT Handle,
+    FileSizeT Offset,
+    uint64_t Addend,
+    uint64_t* Prior,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    return AtomicOnFile(Handle, BUFF_MSG_ATOMIC_FETCH_ADD, Offset, Addend, 0, Prior, Callback, Context);
+}
+
+//
+// Async write to a file with gathering
+// 
+//
+ErrorCodeT
+DDSFrontEnd::WriteFileGather(
+    FileIdT FileId,
+    BufferT* SourceBufferArray,
+    FileSizeT Offset,
+    FileIOSizeT BytesToWrite,
+    FileIOSizeT* BytesWritten,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    FileHandle* handle = &FileHandles[FileId];
+    PollIdT pollId = handle->PollId;
+    PollT* poll = handle->Poll;
+
+    //
+    // Scattered and gathered I/Os are not split across DPUs
+    //
+    //
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (handle->File->Cache) {
+        handle->File->Cache->Invalidate(Offset, BytesToWrite);
+    }
+
+    FileIOT* pIO = poll->AcquireSlot();
+
+    if (!pIO) {
+        //
+        // All slots are in flight; if this is a callback-based completion,
+        // perform polling once
+        //
+        //
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                pollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
+        }
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    pIO->IsRead = false;
+    pIO->DurableWrite = handle->File->Durability == DURABILITY_FUA;
+    pIO->FileReference = handle->File;
+    pIO->FileId = FileId;
+    pIO->Offset = Offset;
+    pIO->BytesDesired = BytesToWrite;
+    pIO->AppBuffer = nullptr;
+    pIO->AppBufferArray = nullptr;
+    pIO->ZeroCopyResponse = nullptr;
+    pIO->AppCallback = Callback;
+    pIO->Context = Context;
+    DDS_IO_STAMP(pIO, RingTicks);
+
+    result = OnBackEnd([&](auto* backEnd) {
+        return backEnd->WriteFileGather(
+            FileId,
+            Offset,
+            SourceBufferArray,
+            BytesToWrite,
+            nullptr,
+            pIO,
+            poll
+        );
+    });
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        poll->ReleaseSlot(pIO);
+        return result;
+    }
+
+    //
+    // Update file pointer
+    //
+    //
+    handle->File->IncrementPointer(BytesToWrite);
+
+    return CaptureIO(DDS_CAPTURE_OP_WRITE, FileId, Offset, BytesToWrite, DDS_ERROR_CODE_IO_PENDING);
+}
+
+//
+// Flush buffered data to storage
+// Note: only files opened with DDS_FILE_ATTRIBUTE_WRITE_BACK buffer data;
+//       the device is flushed only for files in DURABILITY_GROUP_COMMIT,
+//       as the writes of DURABILITY_FUA are durable when they complete
+// 
+//
+ErrorCodeT
+DDSFrontEnd::FlushFileBuffers(
+    FileIdT FileId
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    DDSFile* file = AllFiles[FileId];
+    CaptureIO(DDS_CAPTURE_OP_FLUSH, FileId, 0, 0, DDS_ERROR_CODE_SUCCESS);
+
+    if (file->Cache) {
+        CacheIOT writeBack;
+        ErrorCodeT result = file->Cache->Flush(&writeBack);
+        SubmitCacheIO(&FileHandles[FileId], false, &writeBack);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            return result;
+        }
+    }
+
+    if (file->Durability == DURABILITY_GROUP_COMMIT) {
+        return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+            return backEnd->FlushFile(FileId);
+        });
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Order later reads of a file behind the earlier writes that overlap them;
+// the fence goes down the ring of the poll of the file, so it orders the writes that ring carried before it,
+// staged or not
+// 
+//
+ErrorCodeT
+DDSFrontEnd::FenceFile(
+    FileIdT FileId,
+    FileSizeT Offset,
+    FileIOSizeT Bytes
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    if (!Bytes) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    PollT* poll = FileHandles[FileId].Poll;
+    if (poll->NumStripes == 1) {
+        return OnBackEnd([&](auto* backEnd) {
+            return backEnd->FenceFile(FileId, Offset, Bytes, poll);
+        });
+    }
+
+    //
+    // Striped, every DPU that holds a stripe unit of the range fences the rows of stripe units that the range touches,
+    // as does every parity DPU, which the writes of the rows also go to
+    //
+    //
+    FileSizeT rowBytes = (FileSizeT)StripeUnitBytes * DataStripes;
+    FileSizeT firstRow = Offset / rowBytes;
+    FileSizeT endRow = (Offset + Bytes + rowBytes - 1) / rowBytes;
+    FileSizeT firstUnit = Offset / StripeUnitBytes;
+    FileSizeT units = (Offset + Bytes - 1) / StripeUnitBytes - firstUnit + 1;
+
+    for (size_t stripe = 0; stripe != poll->NumStripes; stripe++) {
+        if (stripe < DataStripes && (stripe + DataStripes - firstUnit % DataStripes) % DataStripes >= units) {
+            continue;
+        }
+
+        ErrorCodeT result = OnBackEnd([&](auto* backEnd) {
+            return backEnd->FenceFile(FileId, firstRow * StripeUnitBytes, (FileIOSizeT)((endRow - firstRow) * StripeUnitBytes), poll->Stripes[stripe]);
+        });
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            return result;
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Whether a name matches a pattern of '*' and '?' wildcards;
+// a '*' that fails to match is retried one character further, without recursion
+//
+//
+static bool
+MatchesPattern(
+    const char* Name,
+    const char* Pattern
+) {
+    const char* star = nullptr;
+    const char* resume = nullptr;
+
+    while (*Name) {
+        if (*Pattern == '*') {
+            star = Pattern++;
+            resume = Name;
+        }
+        else if (*Pattern == '?' || *Pattern == *Name) {
+            Pattern++;
+            Name++;
+        }
+        else if (star) {
+            Pattern = star + 1;
+            Name = ++resume;
+        }
+        else {
+            return false;
+        }
+    }
+
+    while (*Pattern == '*') {
+        Pattern++;
+    }
+
+    return *Pattern == '\0';
+}
+
+//
+// Search a directory for a file or subdirectory
+// with a name that matches a specific name
+// (or partial name if wildcards are used)
+// 
+//
+ErrorCodeT
+DDSFrontEnd::FindFirstFile(
+    const char* FileName,
+    FileIdT* FileId
+) {
+    //
+    // A name without wildcards has at most one file, which the name index finds
+    //
+    //
+    if (!strpbrk(FileName, "*?")) {
+        FindPattern[0] = '\0';
+
+        FileIdT id = FindFileByName(FileName);
+
+        if (id == DDS_FILE_INVALID) {
+            return DDS_ERROR_CODE_FILE_NOT_FOUND;
+        }
+
+        *FileId = id;
+
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    if (strlen(FileName) >= DDS_MAX_FILE_PATH) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+    strcpy(FindPattern, FileName);
+
+    FileIdT cursor = DDS_FILE_INVALID;
+    DirEntryT entry;
+    size_t numEntries = 0;
+    ErrorCodeT result = FindFiles(NULL, FindPattern, &cursor, &entry, 1, &numEntries);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    if (numEntries == 0) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    *FileId = entry.FileId;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Continue a file search from a previous call
+// to the FindFirstFile
+// 
+//
+ErrorCodeT
+DDSFrontEnd::FindNextFile(
+    FileIdT LastFileId,
+    FileIdT* FileId
+) {
+    *FileId = DDS_FILE_INVALID;
+
+    if (FindPattern[0] == '\0') {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    FileIdT cursor = LastFileId;
+    DirEntryT entry;
+    size_t numEntries = 0;
+    ErrorCodeT result = FindFiles(NULL, FindPattern, &cursor, &entry, 1, &numEntries);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    if (numEntries == 1) {
+        *FileId = entry.FileId;
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Enumerate the files of a directory whose names match a pattern,
+// in batches of entries with their properties
+//
+//
+ErrorCodeT
+DDSFrontEnd::FindFiles(
+    const char* PathName,
+    const char* Pattern,
+    FileIdT* Cursor,
+    DirEntryT* Entries,
+    size_t MaxEntries,
+    size_t* NumEntries
+) {
+    *NumEntries = 0;
+
+    DirIdT dirId = DDS_DIR_INVALID;
+    if (!PathName) {
+        dirId = DDS_DIR_ROOT;
+    }
+    else {
+        for (DirIdT i = 0; i != DirIdEnd; i++) {
+            if (AllDirs[i] && strcmp(PathName, AllDirs[i]->GetName()) == 0) {
+                dirId = i;
+                break;
+            }
+        }
+    }
+
+    if (dirId == DDS_DIR_INVALID || !AllDirs[dirId]) {
+        return DDS_ERROR_CODE_DIR_NOT_FOUND;
+    }
+
+    //
+    // Resume after the file at the cursor, which must still be in the directory
+    //
+    //
+    LinkedList<FileIdT>* pFiles = AllDirs[dirId]->GetFiles();
+    NodeT<FileIdT>* cur = pFiles->Begin();
+    if (*Cursor != DDS_FILE_INVALID) {
+        while (cur != pFiles->End() && cur->Value != *Cursor) {
+            cur = cur->Next;
+        }
+        if (cur == pFiles->End()) {
+            return DDS_ERROR_CODE_FILE_NOT_FOUND;
+        }
+        cur = cur->Next;
+    }
+
+    for (; cur != pFiles->End(); cur = cur->Next) {
+        DDSFile* pFile = AllFiles[cur->Value];
+        if (Pattern && !MatchesPattern(pFile->GetName(), Pattern)) {
+            continue;
+        }
+
+        if (*NumEntries == MaxEntries) {
+            return DDS_ERROR_CODE_SUCCESS;
+        }
+
+        DirEntryT* entry = &Entries[(*NumEntries)++];
+        entry->FileId = cur->Value;
+        GetFileInformationById(cur->Value, &entry->Properties);
+        entry->Properties.FileSize = pFile->GetSize();
+        strcpy(entry->Properties.FileName, pFile->GetName());
+        *Cursor = cur->Value;
+    }
+
+    *Cursor = DDS_FILE_INVALID;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Get file properties by file id
+// 
+//
+ErrorCodeT
+DDSFrontEnd::GetFileInformationById(
+    FileIdT FileId,
+    FilePropertiesT* FileProperties
+) {
+    DDSFile* pFile = AllFiles[FileId];
+    FileProperties->Access = pFile->GetAccess();
+    FileProperties->Position = pFile->GetPointer();
+    FileProperties->ShareMode = pFile->GetShareMode();
+    FileProperties->FileAttributes = pFile->GetAttributes();
+    FileProperties->CreationTime = pFile->GetCreationTime();
+    FileProperties->LastAccessTime = pFile->GetLastAccessTime();
+    FileProperties->LastWriteTime = pFile->GetLastWriteTime();
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Get file attributes by file name
+// 
+//
+ErrorCodeT
+DDSFrontEnd::GetFileAttributes(
+    const char* FileName,
+    FileAttributesT* FileAttributes
+) {
+    FileIdT id = FindFileByName(FileName);
+
+    if (id == DDS_FILE_INVALID) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    //
+    // File attributes might be updated on the DPU, so get it from back end
+    //
+    //
+    return BackEnd->GetFileAttributes(id, FileAttributes);
+}
+
+//
+// Retrieve the current directory for the
+// current process
+// 
+//
+ErrorCodeT
+DDSFrontEnd::GetCurrentDirectory(
+    unsigned BufferLength,
+    BufferT DirectoryBuffer
+) {
+    //
+    // TODO: this function is more like an OS feature
+    // check whether it is necessary
+    //
+    //
+    DDSDir* pDir = AllDirs[DDS_DIR_ROOT];
+    if (strlen(pDir->GetName()) > BufferLength) {
+        return DDS_ERROR_CODE_BUFFER_OVERFLOW;
+    }
+
+    strcpy((char*)DirectoryBuffer, pDir->GetName());
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Get the size of free space on the storage
+// 
+//
+ErrorCodeT
+DDSFrontEnd::GetStorageFreeSpace(
+    FileSizeT* StorageFreeSpace
+) {
+    //
+    // Striped, files take the free space of every DPU, less the share of the parity if erasure-coded
+    //
+    //
+    *StorageFreeSpace = 0;
+    ErrorCodeT result = OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        FileSizeT freeSpace;
+        ErrorCodeT stripeResult = backEnd->GetStorageFreeSpace(&freeSpace);
+        if (stripeResult == DDS_ERROR_CODE_SUCCESS) {
+            *StorageFreeSpace += freeSpace;
+        }
+        return stripeResult;
+    });
+    *StorageFreeSpace = *StorageFreeSpace / NumStripes * DataStripes;
+
+    return result;
+}
+
+//
+// Lock the specified file for exclusive
+// access by the calling process
+// 
+//
+ErrorCodeT
+DDSFrontEnd::LockFile(
+    FileIdT FileId,
+    PositionInFileT FileOffset,
+    PositionInFileT NumberOfBytesToLock
+) {
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+}
+
+//
+// Unlock a region in an open file;
+// Unlocking a region enables other
+// processes to access the region
+// 
+//
+ErrorCodeT
+DDSFrontEnd::UnlockFile(
+    FileIdT FileId,
+    PositionInFileT FileOffset,
+    PositionInFileT NumberOfBytesToUnlock
+) {
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+}
+
+//
+// Move an existing file or a directory,
+// including its children
+// 
+//
+ErrorCodeT
+DDSFrontEnd::MoveFile(
+    const char* ExistingFileName,
+    const char* NewFileName
+) {
+    FileIdT id = FindFileByName(ExistingFileName);
+
+    if (id == DDS_FILE_INVALID) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    //
+    // Names stay unique, so that the index finds the one file of a name
+    //
+    //
+    FileIdT existing = FindFileByName(NewFileName);
+    if (existing != DDS_FILE_INVALID && existing != id) {
+        return DDS_ERROR_CODE_FILE_EXISTS;
+    }
+
+    DDSFile* pFile = AllFiles[id];
+    FileNames.Remove(pFile->GetName(), id);
+    pFile->SetName(NewFileName);
+    FileNames.Add(pFile->GetName(), id);
+
+    //
+    // Reflect the update on back end
+    //
+    //
+    return OnEveryBackEnd([&](DDSBackEndBridgeBase* backEnd, size_t) {
+        return backEnd->MoveFile(id, NewFileName);
+    });
+}
+
+//
+// Apply a batch of updates to the cache table on the DPU
+//
+//
+ErrorCodeT
+DDSFrontEnd::UpdateCacheTable(
+    const CacheUpdateT* Updates,
+    size_t NumUpdates
+) {
+    return BackEnd->UpdateCacheTable(Updates, NumUpdates);
+}
+
+//
+// Send a batch of control operations to the back end without waiting;
+// creates take their ids and enter the tables here, and are undone if the back end does not create them,
+// while the other operations change the tables once the back end has done them
+//
+//
+ErrorCodeT
+DDSFrontEnd::SubmitControlBatch(
+    ControlOpT* Ops,
+    size_t NumOps
+) {
+    //
+    // A batch of control operations goes to one DPU
+    //
+    //
+    if (NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (NumOps == 0 || NumOps > CTRL_MSG_BATCH_MAX_OPS) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    std::lock_guard<std::mutex> lock(ControlLock);
+    if (ControlBatchOps) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+    size_t o = 0;
+    for (; o != NumOps && result == DDS_ERROR_CODE_SUCCESS; o++) {
+        result = PrepareControlOp(&Ops[o]);
+    }
+
+    if (result == DDS_ERROR_CODE_SUCCESS) {
+        result = BackEnd->SubmitControlBatch(Ops, NumOps, DDS_DIR_ROOT);
+    }
+    else {
+        Ops[--o].Result = result;
+    }
+
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        for (size_t c = 0; c != o; c++) {
+            if (Ops[c].Type == CONTROL_OP_CREATE_FILE && Ops[c].Result == DDS_ERROR_CODE_IO_PENDING) {
+                RemoveFileFromTables(Ops[c].FileId);
+            }
+        }
+        return result;
+    }
+
+    ControlBatchOps = Ops;
+    ControlBatchNumOps = NumOps;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Check for the completion of the outstanding batch, or wait for it,
+// and bring the tables in line with what the back end has done
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollControlBatch(
+    bool Wait,
+    bool* Completed
+) {
+    *Completed = false;
+
+    std::lock_guard<std::mutex> lock(ControlLock);
+    if (!ControlBatchOps) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    ErrorCodeT result = BackEnd->PollControlBatch(Wait, Completed);
+    if (!*Completed) {
+        return result;
+    }
+
+    for (size_t o = 0; o != ControlBatchNumOps; o++) {
+        ApplyControlOp(&ControlBatchOps[o]);
+    }
+
+    ControlBatchOps = nullptr;
+    ControlBatchNumOps = 0;
+
+    return result;
+}
+
+//
+// Run any number of control operations in batches
+//
+//
+ErrorCodeT
+DDSFrontEnd::RunControlBatch(
+    ControlOpT* Ops,
+    size_t NumOps
+) {
+    for (size_t first = 0; first < NumOps; first += CTRL_MSG_BATCH_MAX_OPS) {
+        size_t numOps = std::min(NumOps - first, (size_t)CTRL_MSG_BATCH_MAX_OPS);
+
+        ErrorCodeT result = SubmitControlBatch(&Ops[first], numOps);
+        if (result == DDS_ERROR_CODE_SUCCESS) {
+            bool completed = false;
+            result = PollControlBatch(true, &completed);
+        }
+
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            for (size_t o = first + numOps; o < NumOps; o++) {
+                Ops[o].Result = DDS_ERROR_CODE_NO_COMPLETION;
+            }
+            return result;
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Bring the tables in line with a control operation about to go to the back end:
+// a create takes its id and enters the tables here, and a delete finds the id of its file
+//
+//
+ErrorCodeT
+DDSFrontEnd::PrepareControlOp(
+    ControlOpT* Op
+) {
+    Op->Result = DDS_ERROR_CODE_IO_PENDING;
+
+    switch (Op->Type) {
+        case CONTROL_OP_CREATE_FILE:
+            return AddFileToTables(Op->FileName, Op->DesiredAccess, Op->ShareMode, Op->FileAttributes, &Op->FileId);
+        case CONTROL_OP_DELETE_FILE:
+            Op->FileId = FindFileByName(Op->FileName);
+            if (Op->FileId == DDS_FILE_INVALID) {
+                return DDS_ERROR_CODE_FILE_NOT_FOUND;
+            }
+            return DDS_ERROR_CODE_SUCCESS;
+        case CONTROL_OP_CHANGE_FILE_SIZE:
+        case CONTROL_OP_GET_FILE_SIZE:
+        case CONTROL_OP_FLUSH_FILE:
+            if (Op->FileId >= AllFiles.Capacity() || AllFiles[Op->FileId] == nullptr) {
+                return DDS_ERROR_CODE_FILE_NOT_FOUND;
+            }
+            return DDS_ERROR_CODE_SUCCESS;
+        default:
+            return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+}
+
+//
+// Bring the tables in line with a control operation the back end has answered:
+// a create it did not do is undone, and a delete or a change of size it did is applied
+//
+//
+void
+DDSFrontEnd::ApplyControlOp(
+    ControlOpT* Op
+) {
+    bool done = Op->Result == DDS_ERROR_CODE_SUCCESS;
+
+    switch (Op->Type) {
+        case CONTROL_OP_CREATE_FILE:
+            if (!done) {
+                RemoveFileFromTables(Op->FileId);
+                Op->FileId = DDS_FILE_INVALID;
+            }
+            break;
+        case CONTROL_OP_DELETE_FILE:
+            if (done && AllFiles[Op->FileId]) {
+                RemoveFileFromTables(Op->FileId);
+            }
+            break;
+        case CONTROL_OP_CHANGE_FILE_SIZE:
+            if (done) {
+                AllFiles[Op->FileId]->SetSize(Op->FileSize);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+//
+// Queue a control operation of the async calls: it takes a slot of its poll, which reports it,
+// and the tables change as they do for an operation of a batch; Op gets the id of the file
+//
+//
+ErrorCodeT
+DDSFrontEnd::QueueControlOp(
+    PollIdT PollId,
+    ControlOpT* Op,
+    FileSizeT* FileSize,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    //
+    // A batch of control operations goes to one DPU
+    //
+    //
+    if (NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+    FileIOT* io = poll->AcquireSlot();
+    if (!io) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    AsyncControlOpT* asyncOp = new (std::nothrow) AsyncControlOpT;
+    if (!asyncOp) {
+        poll->ReleaseSlot(io);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ControlLock);
+        asyncOp->Op = *Op;
+        ErrorCodeT result = PrepareControlOp(&asyncOp->Op);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            delete asyncOp;
+            poll->ReleaseSlot(io);
+            return result;
+        }
+
+        //
+        // The name of a new file is kept by the file, as the application may reuse its own
+        //
+        //
+        if (asyncOp->Op.Type == CONTROL_OP_CREATE_FILE) {
+            asyncOp->Op.FileName = AllFiles[asyncOp->Op.FileId]->GetName();
+        }
+
+        Op->FileId = asyncOp->Op.FileId;
+        io->IsControl = true;
+        io->FileId = asyncOp->Op.FileId;
+        io->AppCallback = Callback;
+        io->Context = Context;
+        asyncOp->Poll = poll;
+        asyncOp->IO = io;
+        asyncOp->FileSize = FileSize;
+        asyncOp->Next = nullptr;
+        *AsyncControlTail = asyncOp;
+        AsyncControlTail = &asyncOp->Next;
+        poll->ControlOpsPending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //
+    // With no batch in flight, the operation goes out right away;
+    // the ones that come while a batch is in flight go out together in the next
+    //
+    //
+    ProgressControlOps();
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Take the ack of the batch of control operations of the async calls, if it has come, report the operations
+// the back end answered through their polls and queue again those it did not get to, and send the next batch;
+// a thread that finds another one at it leaves the work to that one
+//
+//
+void
+DDSFrontEnd::ProgressControlOps() {
+    std::unique_lock<std::mutex> lock(ControlLock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    if (AsyncControlBatchNumOps) {
+        bool completed = false;
+        ErrorCodeT batchResult = BackEnd->PollControlBatch(false, &completed);
+        if (!completed) {
+            return;
+        }
+
+        //
+        // The back end stops at the first operation that fails, and the operations after it go in the next batch,
+        // ahead of the queued ones; if it did none, the first one takes the error of the batch
+        //
+        //
+        AsyncControlOpT* retried = nullptr;
+        AsyncControlOpT** retriedTail = &retried;
+        for (size_t o = 0; o != AsyncControlBatchNumOps; o++) {
+            AsyncControlOpT* asyncOp = AsyncControlBatch[o];
+            ControlOpT* op = &AsyncControlBatchOps[o];
+
+            if (op->Result == DDS_ERROR_CODE_NO_COMPLETION) {
+                if (o != 0) {
+                    *retriedTail = asyncOp;
+                    retriedTail = &asyncOp->Next;
+                    continue;
+                }
+                op->Result = batchResult != DDS_ERROR_CODE_SUCCESS ? batchResult : DDS_ERROR_CODE_UNEXPECTED_MSG;
+            }
+
+            ApplyControlOp(op);
+            if (op->Type == CONTROL_OP_GET_FILE_SIZE && op->Result == DDS_ERROR_CODE_SUCCESS && AllFiles[op->FileId]) {
+                AllFiles[op->FileId]->RenewSizeLease(op->FileSize);
+                *asyncOp->FileSize = AllFiles[op->FileId]->GetSize();
+            }
+
+            FileIOT* io = asyncOp->IO;
+            PollT* poll = asyncOp->Poll;
+            io->CoalescedResult = op->Result;
+            io->CoalescedBytesServiced = 0;
+            delete asyncOp;
+
+            poll->PushCoalescedCompletions(io);
+            poll->ControlOpsPending.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        if (retried) {
+            *retriedTail = AsyncControlHead;
+            if (!AsyncControlHead) {
+                AsyncControlTail = retriedTail;
+            }
+            AsyncControlHead = retried;
+        }
+        AsyncControlBatchNumOps = 0;
+    }
+
+    if (!AsyncControlHead) {
+        return;
+    }
+
+    size_t numOps = 0;
+    for (AsyncControlOpT* asyncOp = AsyncControlHead; asyncOp && numOps != CTRL_MSG_BATCH_MAX_OPS; asyncOp = asyncOp->Next) {
+        AsyncControlBatch[numOps] = asyncOp;
+        AsyncControlBatchOps[numOps] = asyncOp->Op;
+        numOps++;
+    }
+
+    //
+    // A batch of the application may be outstanding, in which case a later poll sends this one
+    //
+    //
+    if (BackEnd->SubmitControlBatch(AsyncControlBatchOps, numOps, DDS_DIR_ROOT) != DDS_ERROR_CODE_SUCCESS) {
+        return;
+    }
+
+    AsyncControlHead = AsyncControlBatch[numOps - 1]->Next;
+    if (!AsyncControlHead) {
+        AsyncControlTail = &AsyncControlHead;
+    }
+    AsyncControlBatchNumOps = numOps;
+}
+
+//
+// Create a file without waiting for the back end
+//
+//
+ErrorCodeT
+DDSFrontEnd::CreateFileAsync(
+    const char* FileName,
+    FileAccessT DesiredAccess,
+    FileShareModeT ShareMode,
+    FileAttributesT FileAttributes,
+    FileIdT* FileId,
+    PollIdT PollId,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    ControlOpT op = {};
+    op.Type = CONTROL_OP_CREATE_FILE;
+    op.FileName = FileName;
+    op.DesiredAccess = DesiredAccess;
+    op.ShareMode = ShareMode;
+    op.FileAttributes = FileAttributes;
+
+    //
+    // The id is taken as the operation is queued
+    //
+    //
+    ErrorCodeT result = QueueControlOp(PollId, &op, nullptr, Callback, Context);
+    if (result == DDS_ERROR_CODE_IO_PENDING) {
+        *FileId = op.FileId;
+    }
+
+    return result;
+}
+
+//
+// Delete a file without waiting for the back end
+//
+//
+ErrorCodeT
+DDSFrontEnd::DeleteFileAsync(
+    const char* FileName,
+    PollIdT PollId,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    ControlOpT op = {};
+    op.Type = CONTROL_OP_DELETE_FILE;
+    op.FileName = FileName;
+
+    return QueueControlOp(PollId, &op, nullptr, Callback, Context);
+}
+
+//
+// Get the size of a file without waiting for the back end;
+// only a shared file whose lease expired asks the back end, as GetFileSize does
+//
+//
+ErrorCodeT
+DDSFrontEnd::GetFileSizeAsync(
+    FileIdT FileId,
+    FileSizeT* FileSize,
+    PollIdT PollId,
+    ReadWriteCallback Callback,
+    ContextT Context
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    DDSFile* file = AllFiles[FileId];
+    if ((file->GetAttributes() & DDS_FILE_ATTRIBUTE_SHARED) && !file->HoldsSizeLease()) {
+        ControlOpT op = {};
+        op.Type = CONTROL_OP_GET_FILE_SIZE;
+        op.FileId = FileId;
+
+        return QueueControlOp(PollId, &op, FileSize, Callback, Context);
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+    FileIOT* io = poll->AcquireSlot();
+    if (!io) {
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+    }
+
+    *FileSize = file->GetSize();
+    io->IsControl = true;
+    io->FileId = FileId;
+    io->AppCallback = Callback;
+    io->Context = Context;
+    io->CoalescedResult = DDS_ERROR_CODE_SUCCESS;
+    io->CoalescedBytesServiced = 0;
+    poll->PushCoalescedCompletions(io);
+
+    return DDS_ERROR_CODE_IO_PENDING;
+}
+
+//
+// Get the default poll structure for async I/O
+//
+//
+ErrorCodeT
+DDSFrontEnd::GetDefaultPoll(
+    PollIdT* PollId
+) {
+    *PollId = DDS_POLL_DEFAULT;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+
+//
+// Create a poll structure for async I/O
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollCreate(
+    PollIdT* PollId
+) {
+    return PollCreate(PollId, POLL_PRIORITY_NORMAL);
+}
+
+//
+// Create a poll structure for async I/O of a priority class
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollCreate(
+    PollIdT* PollId,
+    PollPriority Priority
+) {
+    //
+    // Retrieve an id
+    //
+    //
+    PollIdT id = 0;
+    for (; id != DDS_MAX_POLLS; id++) {
+        if (!AllPolls[id]) {
+            break;
+        }
+    }
+
+    if (id == DDS_MAX_POLLS) {
+        return DDS_ERROR_CODE_TOO_MANY_POLLS;
+    }
+
+    ErrorCodeT result = AllocatePoll(id, Priority);
+    if (result != DDS_ERROR_CODE_SUCCESS) {
+        return result;
+    }
+
+    *PollId = id;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Delete a poll structure
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollDelete(
+    PollIdT PollId
+) {
+    if (PollId == DDS_POLL_DEFAULT) {
+        return DDS_ERROR_CODE_INVALID_POLL_DELETION;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_POLL_DELETION;
+    }
+
+    //
+    // Files added to this poll fall back to the default poll
+    //
+    //
+    for (size_t f = 0; f != FileIdEnd; f++) {
+        if (AllFiles[f] && AllFiles[f]->PollId == PollId) {
+            AllFiles[f]->PollId = DDS_POLL_DEFAULT;
+            AllFiles[f]->PollContext = NULL;
+            FileHandles[f].PollId = DDS_POLL_DEFAULT;
+            FileHandles[f].Poll = AllPolls[DDS_POLL_DEFAULT];
+        }
+    }
+
+    ReleasePoll(PollId);
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Add a file to a poll; the handle of the file follows it, so that its next I/Os go through the rings of the poll
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollAdd(
+    FileIdT FileId,
+    PollIdT PollId,
+    ContextT FileContext
+) {
+    if (FileId >= AllFiles.Capacity() || AllFiles[FileId] == nullptr) {
+        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    DDSFile* pFile = AllFiles[FileId];
+
+    if (PollId != pFile->PollId) {
+        pFile->PollId = PollId;
+        FileHandles[FileId].PollId = PollId;
+        FileHandles[FileId].Poll = AllPolls[PollId];
+    }
+
+    pFile->PollContext = FileContext;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Set the waiting policy of a poll
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollSetPolicy(
+    PollIdT PollId,
+    const PollPolicyT* Policy
+) {
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    for (size_t s = 0; s != AllPolls[PollId]->NumStripes; s++) {
+        AllPolls[PollId]->Stripes[s]->SetPolicy(Policy);
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Publish the reads and writes staged on a poll
+//
+//
+ErrorCodeT
+DDSFrontEnd::FlushRequests(
+    PollIdT PollId
+) {
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    for (size_t s = 0; s != poll->NumStripes && result == DDS_ERROR_CODE_SUCCESS; s++) {
+        result = OnBackEnd([&](auto* backEnd) {
+            return backEnd->FlushRequests(poll->Stripes[s]);
+        });
+    }
+
+    return result;
+}
+
+//
+// Register an application buffer with a poll so that reads into it,
+// and scattered reads into its pages, are written in place by the back end
+//
+//
+ErrorCodeT
+DDSFrontEnd::RegisterScatterBuffer(
+    PollIdT PollId,
+    BufferT Buffer,
+    size_t Bytes
+) {
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId] || !Buffer || !Bytes) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    //
+    // Striped, the reads into the buffer may go to any DPU
+    //
+    //
+    PollT* poll = AllPolls[PollId];
+    for (size_t s = 0; s != poll->NumStripes; s++) {
+        if (!poll->Stripes[s]->MsgBuffer->RegisterExternalRegion(Buffer, Bytes)) {
+            for (size_t r = 0; r != s; r++) {
+                poll->Stripes[r]->MsgBuffer->ReleaseExternalRegion(Buffer);
+            }
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Register a GPU buffer with a poll so that reads into it are written in place by the back end
+//
+//
+ErrorCodeT
+DDSFrontEnd::RegisterDeviceBuffer(
+    PollIdT PollId,
+    BufferT Buffer,
+    size_t Bytes
+) {
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId] || !Buffer || !Bytes) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    //
+    // The NIC of every DPU takes the GPU pages through its peer memory module
+    //
+    //
+    PollT* poll = AllPolls[PollId];
+    for (size_t s = 0; s != poll->NumStripes; s++) {
+        if (!poll->Stripes[s]->MsgBuffer->RegisterExternalRegion(Buffer, Bytes, false, true)) {
+            for (size_t r = 0; r != s; r++) {
+                poll->Stripes[r]->MsgBuffer->ReleaseExternalRegion(Buffer);
+            }
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+    }
+    poll->NumDeviceBuffers++;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Unregister an application buffer from a poll
+//
+//
+ErrorCodeT
+DDSFrontEnd::UnregisterScatterBuffer(
+    PollIdT PollId,
+    BufferT Buffer
+) {
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+    if (IsDeviceBuffer(poll, Buffer, 1)) {
+        poll->NumDeviceBuffers--;
+    }
+
+    for (size_t s = 0; s != poll->NumStripes; s++) {
+        if (!poll->Stripes[s]->MsgBuffer->ReleaseExternalRegion(Buffer)) {
+            return DDS_ERROR_CODE_INVALID_PARAM;
+        }
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Bind the offload response rings of the DPU to a poll;
+// every ring starts with its tail and head unset, until the DPU first writes its tail
+//
+//
+ErrorCodeT
+DDSFrontEnd::BindOffloadResponses(
+    PollIdT PollId
+) {
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId]) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+
+    //
+    // Offload responses come from one DPU
+    //
+    //
+    if (poll->NumStripes != 1) {
+        return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    }
+
+    std::lock_guard<std::mutex> lock(poll->OffloadLock);
+    if (poll->OffloadRings) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    size_t bytes = (size_t)OFFLOAD_RESPONSE_RINGS * OFFLOAD_RESPONSE_RING_STRIDE;
+    char* rings = (char*)VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!rings) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    for (size_t r = 0; r != OFFLOAD_RESPONSE_RINGS; r++) {
+        char* ring = rings + r * OFFLOAD_RESPONSE_RING_STRIDE;
+        *(volatile uint64_t*)(ring + OFFLOAD_RESPONSE_RING_TAIL_OFFSET) = UINT64_MAX;
+        *(volatile uint64_t*)(ring + OFFLOAD_RESPONSE_RING_HEAD_OFFSET) = UINT64_MAX;
+    }
+
+    if (!poll->MsgBuffer->BindOffloadResponseRings(rings, bytes)) {
+        VirtualFree(rings, 0, MEM_RELEASE);
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    poll->OffloadRings = rings;
+
+    return DDS_ERROR_CODE_SUCCESS;
+#else
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+#endif
+}
+
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+//
+// Take the next record of a ring into Buffer; padding is skipped, and a record that doesn't fit stays
+//
+//
+static ErrorCodeT
+TakeOffloadResponse(
+    char* Ring,
+    OffloadResponseT* Response,
+    BufferT Buffer,
+    FileIOSizeT BufferBytes,
+    bool* Taken
 ) {
+    volatile uint64_t* tailPtr = (volatile uint64_t*)(Ring + OFFLOAD_RESPONSE_RING_TAIL_OFFSET);
+    volatile uint64_t* headPtr = (volatile uint64_t*)(Ring + OFFLOAD_RESPONSE_RING_HEAD_OFFSET);
+    char* data = Ring + OFFLOAD_RESPONSE_RING_META_BYTES;
+
+    *Taken = false;
+
+    uint64_t tail = *tailPtr;
+    if (tail == UINT64_MAX) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    uint64_t head = *headPtr;
+    if (head == UINT64_MAX) {
+        head = tail;
+    }
+
+    while (head < tail) {
+        char* record = data + head % OFFLOAD_RESPONSE_RING_DATA_BYTES;
+        FileIOSizeT size = *(FileIOSizeT*)record;
+
+        if (size & OFFLOAD_RESPONSE_SIZE_FLAG_PADDING) {
+            head += size & ~OFFLOAD_RESPONSE_SIZE_FLAG_PADDING;
+            continue;
+        }
+
+        OffloadResponseT* response = (OffloadResponseT*)(record + sizeof(FileIOSizeT));
+        if ((size_t)response->ReqSize + response->BytesServiced > BufferBytes) {
+            *headPtr = head;
+            return DDS_ERROR_CODE_BUFFER_OVERFLOW;
+        }
+
+        *Response = *response;
+        char* req = (char*)(response + 1);
+        memcpy(Buffer, req, response->ReqSize);
+        memcpy(Buffer + response->ReqSize, record + response->DataOffset, response->BytesServiced);
+        Response->DataOffset = response->ReqSize;
+
+        head += size;
+        *Taken = true;
+        break;
+    }
+
+    //
+    // The DPU reads the head back to reuse the ring
+    //
+    //
+    std::atomic_thread_fence(std::memory_order_release);
+    *headPtr = head;
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+#endif
+
+//
+// Poll a request the DPU has read for, from the rings in turn
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollWaitOffload(
+    PollIdT PollId,
+    OffloadResponseT* Response,
+    BufferT Buffer,
+    FileIOSizeT BufferBytes,
+    size_t WaitTime,
+    bool* PollResult
+) {
+#ifdef OFFLOAD_ENGINE_RESPONSE_INCLUDES_REQUEST
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId] || !Response || !Buffer || !PollResult) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
+    }
+
+    PollT* poll = AllPolls[PollId];
+    std::chrono::time_point<std::chrono::steady_clock> begin = std::chrono::steady_clock::now();
+
+    *PollResult = false;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(poll->OffloadLock);
+            if (!poll->OffloadRings) {
+                return DDS_ERROR_CODE_INVALID_PARAM;
+            }
+
+            for (size_t i = 0; i != OFFLOAD_RESPONSE_RINGS; i++) {
+                size_t r = poll->NextOffloadRing;
+                poll->NextOffloadRing = (r + 1) % OFFLOAD_RESPONSE_RINGS;
+
+                ErrorCodeT result = TakeOffloadResponse(
+                    poll->OffloadRings + r * OFFLOAD_RESPONSE_RING_STRIDE,
+                    Response,
+                    Buffer,
+                    BufferBytes,
+                    PollResult
+                );
+                if (result != DDS_ERROR_CODE_SUCCESS || *PollResult) {
+                    return result;
+                }
+            }
+        }
+
+        if (WaitTime != INFINITE &&
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count() >= (long long)WaitTime) {
+            return DDS_ERROR_CODE_SUCCESS;
+        }
+
+        std::this_thread::yield();
+    }
+#else
     return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+#endif
+}
+
+//
+// Note when the response of an I/O, and of the reads merged into it, arrived, and trace it if it is traced
+//
+//
+static inline void
+StampResponse(
+    FileIOT* IO
+) {
+#ifdef DDS_IO_STATISTICS_ENABLED
+    uint64_t ticks = ReadIOClock();
+#endif
+    for (; IO; IO = IO->NextCoalesced) {
+#ifdef DDS_IO_STATISTICS_ENABLED
+        IO->ResponseTicks = ticks;
+#endif
+        RecordIOTrace(IO->TraceId, DDS_TRACE_HOP_FE_RESPONSE, IO->TraceKey);
+    }
+}
+
+//
+// Publish the requests staged or queued on the stripes of a poll
+//
+//
+ErrorCodeT
+DDSFrontEnd::FlushStripes(
+    PollT* Poll
+) {
+    ErrorCodeT result = DDS_ERROR_CODE_SUCCESS;
+
+    for (size_t s = 0; s != Poll->NumStripes; s++) {
+        PollT* stripe = Poll->Stripes[s];
+        if (stripe->Policy.StageRequests || stripe->BacklogSize.load(std::memory_order_relaxed)) {
+            ErrorCodeT stripeResult = OnBackEnd([&](auto* backEnd) {
+                return backEnd->FlushRequests(stripe);
+            });
+            if (result == DDS_ERROR_CODE_SUCCESS) {
+                result = stripeResult;
+            }
+        }
+    }
+
+    return result;
+}
+
+//
+// Retrieve a response from the ring of a poll or, striped across DPUs, from the ring of any of its stripes;
+// the rings are looked at in turn without waiting, starting after the one of the last response, until WaitTime passes
+//
+//
+ErrorCodeT
+DDSFrontEnd::GetStripedResponse(
+    PollT* Poll,
+    size_t WaitTime,
+    FileIOSizeT* BytesServiced,
+    RequestIdT* ReqId
+) {
+    if (Poll->NumStripes == 1) {
+        for (;;) {
+            ErrorCodeT result = OnBackEnd([&](auto* backEnd) {
+                return backEnd->GetResponse(Poll, WaitTime, BytesServiced, ReqId);
+            });
+            if (result != DDS_ERROR_CODE_NO_COMPLETION || !(ResumeHandedOverStripes(Poll) || RecoverLostStripes(Poll))) {
+                return result;
+            }
+        }
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (;;) {
+        size_t first = Poll->NextStripe.load(std::memory_order_relaxed);
+        for (size_t i = 0; i != Poll->NumStripes; i++) {
+            size_t s = (first + i) % Poll->NumStripes;
+            ErrorCodeT result = OnBackEnd([&](auto* backEnd) {
+                return backEnd->GetResponse(Poll->Stripes[s], 0, BytesServiced, ReqId);
+            });
+            if (result != DDS_ERROR_CODE_NO_COMPLETION) {
+                Poll->NextStripe.store((s + 1) % Poll->NumStripes, std::memory_order_relaxed);
+                return result;
+            }
+        }
+
+        ResumeHandedOverStripes(Poll);
+        RecoverLostStripes(Poll);
+
+        if (WaitTime != INFINITE &&
+            (size_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count() >= WaitTime) {
+            return DDS_ERROR_CODE_NO_COMPLETION;
+        }
+        std::this_thread::yield();
+    }
+}
+
+//
+// Move the stripes of a poll whose DPU has handed over to a new build (DDS_RING_HANDOVER_OFFSET) to the new back end:
+// the buffer leaves the old back end, the first poll to get there connects the bridge to the new one,
+// and the buffer is connected to it, which resumes the rings where the old one left them;
+// return whether a stripe was moved
+//
+//
+bool
+DDSFrontEnd::ResumeHandedOverStripes(
+    PollT* Poll
+) {
+    bool resumed = false;
+
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return false;
+    }
+
+    for (size_t s = 0; s != Poll->NumStripes; s++) {
+        PollT* stripe = Poll->Stripes[s];
+        if (!stripe->ResponseRing->HandedOver.load()) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(HandoverLock);
+        DDSBackEndBridge* backEndDPU = (DDSBackEndBridge*)StripeBackEnds[s];
+
+        stripe->MsgBuffer->Detach();
+        if (stripe->Handovers == StripeHandovers[s]) {
+            if (backEndDPU->Reconnect() != DDS_ERROR_CODE_SUCCESS) {
+                cout << __func__ << " [error]: Failed to follow the handover of DPU #" << s << endl;
+                continue;
+            }
+            StripeHandovers[s]++;
+        }
+
+        if (!stripe->MsgBuffer->Reconnect(
+            &backEndDPU->LocalSock,
+            &backEndDPU->BackEndSock,
+            backEndDPU->QueueDepth,
+            backEndDPU->MaxSge,
+            backEndDPU->InlineThreshold,
+            backEndDPU->ClientId,
+            stripe->RequestRing->Head[0],
+            stripe->ResponseRing->Tail[0])) {
+            cout << __func__ << " [error]: Failed to reconnect the buffer of a poll to DPU #" << s << endl;
+            continue;
+        }
+        stripe->Handovers = StripeHandovers[s];
+        stripe->ResponseRing->HandedOver.store(0);
+        resumed = true;
+    }
+
+    return resumed;
+}
+
+//
+// Move the stripes of a poll whose DPU is lost, such as one that crashed, to the back end started in its place,
+// once every response the lost one wrote has been taken: the first poll to get there reconnects the bridge,
+// and the buffer is connected again with the request ring resumed past every request published to the lost back end;
+// the I/Os of those requests are issued again if they are plain reads, which can be repeated,
+// and fail with DDS_ERROR_CODE_BACKEND_RESTARTED otherwise, as the lost back end may have done them in part;
+// return whether a stripe was moved
+//
+//
+bool
+DDSFrontEnd::RecoverLostStripes(
+    PollT* Poll
+) {
+    bool recovered = false;
+
+    if (BackEndType != BACKEND_TYPE_DPU) {
+        return false;
+    }
+
+    for (size_t s = 0; s != Poll->NumStripes; s++) {
+        PollT* stripe = Poll->Stripes[s];
+        if (stripe->ResponseRing->HandedOver.load()) {
+            continue;
+        }
+
+        if (!stripe->BackEndLost.load()) {
+            if (!stripe->MsgBuffer->ConnectionLost()) {
+                continue;
+            }
+            stripe->BackEndLost.store(true);
+            cout << __func__ << " [warning]: lost the connection to DPU #" << s << ", reconnecting" << endl;
+        }
+
+        //
+        // Publishers that came before the loss was seen finish, and later ones queue their requests;
+        // the responses the lost back end wrote are all taken before its requests are looked at
+        //
+        //
+        while (stripe->Publishers.load()) {
+            std::this_thread::yield();
+        }
+
+        bool responsesTaken = stripe->ResponseRing->Head[0] == stripe->ResponseRing->Tail[0];
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+        for (size_t c = 0; responsesTaken && c != DDS_POLL_MAX_CONSUMERS; c++) {
+            responsesTaken = !stripe->ResponseCursors[c].Busy.load() && !stripe->ResponseCursors[c].NextResponse;
+        }
+#endif
+        if (!responsesTaken) {
+            continue;
+        }
+
+        std::vector<FileIOT*> lostIOs;
+        DDSBackEndBridge* backEndDPU = (DDSBackEndBridge*)StripeBackEnds[s];
+        {
+            std::lock_guard<std::mutex> lock(HandoverLock);
+            if (!stripe->BackEndLost.load()) {
+                continue;
+            }
+
+            stripe->MsgBuffer->Detach();
+            if (stripe->Handovers == StripeHandovers[s]) {
+                if (backEndDPU->Reconnect(true) != DDS_ERROR_CODE_SUCCESS) {
+                    cout << __func__ << " [error]: Failed to reconnect to DPU #" << s << endl;
+                    continue;
+                }
+                StripeHandovers[s]++;
+            }
+
+            //
+            // Every request published to the lost back end is behind the tail, and none of them is taken again
+            //
+            //
+            RequestRingBufferProgressive* requestRing = stripe->RequestRing;
+            int requestHead = requestRing->Tail[0];
+            while (requestRing->Progress[0] != requestHead) {
+                std::this_thread::yield();
+            }
+            requestRing->Head[0] = requestHead;
+
+            if (!stripe->MsgBuffer->Reconnect(
+                &backEndDPU->LocalSock,
+                &backEndDPU->BackEndSock,
+                backEndDPU->QueueDepth,
+                backEndDPU->MaxSge,
+                backEndDPU->InlineThreshold,
+                backEndDPU->ClientId,
+                requestHead,
+                stripe->ResponseRing->Tail[0])) {
+                cout << __func__ << " [error]: Failed to reconnect the buffer of a poll to DPU #" << s << endl;
+                continue;
+            }
+            stripe->Handovers = StripeHandovers[s];
+
+            //
+            // Requests still staged never reached the lost back end, and are issued again with the lost ones
+            //
+            //
+            DiscardStagedRequests(&stripe->RequestStaging);
+
+            for (size_t i = 0; i != Poll->QueueDepth; i++) {
+                FileIOT* io = Poll->OutstandingRequests[i];
+                if (io->AtBackEnd.load() == stripe) {
+                    io->AtBackEnd = nullptr;
+                    lostIOs.push_back(io);
+                }
+            }
+            stripe->BackEndLost.store(false);
+        }
+
+        size_t replayed = 0;
+        for (FileIOT* io : lostIOs) {
+            if (io->Replayable && !io->NextCoalesced) {
+                FileSizeT stripeOffset = io->Offset;
+                if (Poll->NumStripes != 1) {
+                    StripeOfOffset(io->Offset, &stripeOffset);
+                }
+
+                if (backEndDPU->ReadFile(io->FileId, stripeOffset, io->AppBuffer, io->BytesDesired, nullptr, io, stripe) == DDS_ERROR_CODE_IO_PENDING) {
+                    replayed++;
+                    continue;
+                }
+            }
+
+            //
+            // Cache I/Os and chunks of streams finish here; the others are reported by the next polls
+            //
+            //
+            if (io->IsInternal) {
+                RetireIO(Poll, io, DDS_ERROR_CODE_BACKEND_RESTARTED, 0);
+                continue;
+            }
+
+            for (FileIOT* member = io; member; member = member->NextCoalesced) {
+                member->CoalescedResult = DDS_ERROR_CODE_BACKEND_RESTARTED;
+                member->CoalescedBytesServiced = 0;
+            }
+            Poll->PushCoalescedCompletions(io);
+        }
+        backEndDPU->FlushRequests(stripe);
+
+        cout << __func__ << ": reconnected to DPU #" << s << ", issued " << replayed << " of " << lostIOs.size() << " lost I/Os again" << endl;
+        recovered = true;
+    }
+
+    return recovered;
+}
+
+//
+// Poll a completion event
+//
+//
+ErrorCodeT
+DDSFrontEnd::PollWait(
+    PollIdT PollId,
+    FileIOSizeT* BytesServiced,
+    ContextT* FileContext,
+    ContextT* IOContext,
+    size_t WaitTime,
+    bool* PollResult
+) {
+    std::chrono::time_point<std::chrono::system_clock> begin, cur;
+
+    PollT* poll = AllPolls[PollId];
+    RequestIdT reqId;
+
+    //
+    // Requests staged or queued on the poll would never complete while it waits for them;
+    // if the ring is full, they are published by a later wait
+    //
+    //
+    FlushStripes(poll);
+
+    //
+    // Control operations of the async calls are reported by the poll they were made on;
+    // while some are in flight, the rings are not waited on for long, so that the ack of their batch is taken
+    //
+    //
+    size_t waitTime = WaitTime;
+    if (poll->ControlOpsPending.load(std::memory_order_relaxed)) {
+        ProgressControlOps();
+        waitTime = std::min(waitTime, (size_t)DDS_CONTROL_OPS_POLL_MS);
+    }
+
+    //
+    // Report the rest of a merged read, a finished stream or a control operation before fetching another response
+    //
+    //
+    FileIOT* coalesced = poll->PopCoalescedCompletion();
+    if (coalesced) {
+        FileIOT* io = coalesced;
+
+        *BytesServiced = io->CoalescedBytesServiced;
+        *FileContext = io->IsControl ? nullptr : AllFiles[io->FileId]->PollContext;
+        *IOContext = io->Context;
+        *PollResult = true;
+
+        RetireIO(poll, io, io->CoalescedResult, *BytesServiced);
+
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    ErrorCodeT result = GetStripedResponse(poll, waitTime, BytesServiced, &reqId);
+
+    if (result == DDS_ERROR_CODE_NO_COMPLETION) {
+        *PollResult = false;
+        *FileContext = nullptr;
+        *IOContext = nullptr;
+    }
+    else if (poll->OutstandingRequests[reqId]->IsInternal) {
+        //
+        // Cache I/Os are finished here and not reported
+        //
+        //
+        RetireIO(poll, poll->OutstandingRequests[reqId], result, *BytesServiced);
+
+        *PollResult = false;
+        *FileContext = nullptr;
+        *IOContext = nullptr;
+    }
+    else {
+        FileIOT* io = poll->OutstandingRequests[reqId];
+        StampResponse(io);
+        if (io->NextCoalesced) {
+            *BytesServiced = io->CoalescedBytesServiced;
+            poll->PushCoalescedCompletions(io->NextCoalesced);
+        }
+        *FileContext = AllFiles[io->FileId]->PollContext;
+        *IOContext = io->Context;
+        *PollResult = true;
+
+        RetireIO(poll, io, result, *BytesServiced);
+    }
+
+    return DDS_ERROR_CODE_SUCCESS;
+}
+
+//
+// Finish a completed I/O: run its callback and give its slot back
+//
+//
+void
+DDSFrontEnd::RetireIO(
+    PollT* Poll,
+    FileIOT* IO,
+    ErrorCodeT Result,
+    FileIOSizeT BytesServiced
+) {
+    //
+    // If the application provides a callback, we should handle it here
+    // because this poll might be invoked by a read/write call
+    //
+    //
+#ifdef DDS_IO_STATISTICS_ENABLED
+    if (!IO->IsInternal && !IO->IsControl) {
+        Poll->IOStatistics.Record(IO->SubmitTicks, IO->RingTicks, IO->ResponseTicks, ReadIOClock());
+    }
+#endif
+
+    if (IO->Stream) {
+        FinishStreamChunk(Poll, IO, Result, BytesServiced);
+        return;
+    }
+
+    if (!IO->IsRead && !IO->IsControl && Result == DDS_ERROR_CODE_SUCCESS) {
+        ((DDSFile*)IO->FileReference)->GrowSize(IO->Offset + BytesServiced);
+        if (IO->AppendedOffset) {
+            *IO->AppendedOffset = IO->Offset;
+        }
+        if (IO->AtomicPrior) {
+            *IO->AtomicPrior = IO->AtomicValue;
+        }
+    }
+
+    if (IO->AppCallback) {
+        IO->AppCallback(Result, BytesServiced, IO->Context);
+    }
+
+    //
+    // Mark this slot as available
+    //
+    //
+    Poll->ReleaseSlot(IO);
+
+    Poll->RecordCompletion();
+}
+
+//
+// Issue a read-ahead or write-back asked for by a file cache;
+// its completion goes to the cache and is never reported by polls;
+// return DDS_ERROR_CODE_IO_PENDING once issued and success if nothing was asked for
+//
+//
+ErrorCodeT
+DDSFrontEnd::SubmitCacheIO(
+    FileHandleT Handle,
+    bool IsRead,
+    CacheIOT* CacheIO
+) {
+    if (!CacheIO->Valid) {
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    DDSFileCache* cache = Handle->File->Cache;
+    PollT* poll = Handle->Poll;
+    FileIOT* pIO = poll->AcquireSlot();
+    ErrorCodeT result = DDS_ERROR_CODE_TOO_MANY_REQUESTS;
+
+    if (pIO) {
+        pIO->IsRead = IsRead;
+        pIO->DurableWrite = !IsRead && Handle->File->Durability == DURABILITY_FUA;
+        pIO->IsInternal = true;
+        pIO->FileReference = Handle->File;
+        pIO->FileId = Handle->FileId;
+        pIO->Offset = CacheIO->Offset;
+        pIO->BytesDesired = CacheIO->Bytes;
+        pIO->AppBuffer = IsRead ? CacheIO->Buffer : nullptr;
+        pIO->AppBufferArray = nullptr;
+        pIO->ZeroCopyResponse = nullptr;
+        pIO->AppCallback = IsRead ? DDSFileCache::OnReadAheadComplete : DDSFileCache::OnWriteBackComplete;
+        pIO->Context = cache;
+
+        result = OnBackEnd([&](auto* backEnd) {
+            if (IsRead) {
+                return backEnd->ReadFile(Handle->FileId, CacheIO->Offset, CacheIO->Buffer, CacheIO->Bytes, nullptr, pIO, poll);
+            }
+            return backEnd->WriteFile(Handle->FileId, CacheIO->Offset, CacheIO->Buffer, CacheIO->Bytes, nullptr, pIO, poll);
+        });
+
+        if (result != DDS_ERROR_CODE_IO_PENDING) {
+            poll->ReleaseSlot(pIO);
+        }
+    }
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        //
+        // Nothing is lost: the window is simply not read ahead,
+        // and the buffered writes are written back on a later flush
+        //
+        //
+        if (IsRead) {
+            cache->ReadAheadFailed();
+        }
+        else {
+            cache->WriteBackFailed();
+        }
+    }
+
+    return result;
+}
+
+//
+// Finish the rows of an erasure-coded streamed I/O once its chunks are done: a degraded read
+// reconstructs the units of the lost DPUs and copies what was asked for out of them, up to the end of the file;
+// a write is done once its data and parity are all written
+//
+//
+static void
+FinishErasureIO(
+    FileIOT* Whole
+) {
+    ErasureIOT* erasure = Whole->Erasure;
+    ErrorCodeT result = Whole->StreamResult.load(std::memory_order_relaxed);
+    FileIOSizeT serviced = 0;
+
+    if (result == DDS_ERROR_CODE_SUCCESS && !Whole->IsRead) {
+        serviced = Whole->BytesDesired;
+    }
+    else if (result == DDS_ERROR_CODE_SUCCESS) {
+        size_t numStripes = erasure->DataStripes + erasure->ParityStripes;
+        FileIOSizeT columnBytes = erasure->ColumnBytes;
+        char* scratch = erasure->Buffer + erasure->Rows * numStripes * columnBytes;
+
+        for (size_t row = 0; row != erasure->Rows; row++) {
+            char* units[DDS_MAX_STRIPES];
+            for (size_t s = 0; s != numStripes; s++) {
+                units[s] = erasure->Buffer + (row * numStripes + s) * columnBytes;
+            }
+            if (!ReconstructUnits(units, erasure->DataStripes, erasure->ParityStripes, erasure->LostMask, scratch, columnBytes)) {
+                result = DDS_ERROR_CODE_FAILED_CONNECTION;
+                break;
+            }
+        }
+
+        FileSizeT fileSize = ((DDSFile*)Whole->FileReference)->GetSize();
+        if (result == DDS_ERROR_CODE_SUCCESS && Whole->Offset < fileSize) {
+            serviced = (FileIOSizeT)std::min<FileSizeT>(Whole->BytesDesired, fileSize - Whole->Offset);
+        }
+
+        FileSizeT rowBytes = (FileSizeT)erasure->UnitBytes * erasure->DataStripes;
+        for (FileIOSizeT copied = 0; copied != serviced;) {
+            FileSizeT offset = Whole->Offset + copied;
+            size_t row = (size_t)(offset / rowBytes - erasure->FirstRow);
+            size_t stripe = (size_t)(offset % rowBytes / erasure->UnitBytes);
+            FileIOSizeT inUnit = (FileIOSizeT)(offset % erasure->UnitBytes);
+            FileIOSizeT bytes = std::min(erasure->UnitBytes - inUnit, serviced - copied);
+            memcpy(
+                Whole->AppBuffer + copied,
+                erasure->Buffer + (row * numStripes + stripe) * columnBytes + (inUnit - erasure->ColumnOffset),
+                bytes
+            );
+            copied += bytes;
+        }
+    }
+
+    Whole->StreamResult.store(result, std::memory_order_relaxed);
+    Whole->StreamServiced.store(serviced, std::memory_order_relaxed);
+    delete[] erasure->Buffer;
+    delete erasure;
+    Whole->Erasure = nullptr;
+}
+
+//
+// Drop references of a streamed I/O, its chunks or the submitting thread;
+// the last one queues the whole I/O to be reported by the next poll, like the rest of a merged read
+//
+//
+static inline void
+DropStreamReferences(
+    PollT* Poll,
+    FileIOT* Whole,
+    size_t References
+) {
+    if (Whole->StreamChunks.fetch_sub(References, std::memory_order_acq_rel) != References) {
+        return;
+    }
+
+    if (Whole->Erasure) {
+        FinishErasureIO(Whole);
+    }
+
+    Whole->CoalescedResult = Whole->StreamResult.load(std::memory_order_relaxed);
+    Whole->CoalescedBytesServiced = Whole->StreamServiced.load(std::memory_order_relaxed);
+    StampResponse(Whole);
+    Poll->PushCoalescedCompletions(Whole);
 }
 
 //
-// Unlock a region in an open file;
-// Unlocking a region enables other
-// processes to access the region
-// 
+// Stop issuing the chunks of a streamed I/O, recording Result if it is the first failure
 //
-ErrorCodeT
-DDSFrontEnd::UnlockFile(
-    FileIdT FileId,
-    PositionInFileT FileOffset,
-    PositionInFileT NumberOfBytesToUnlock
+//
+static inline void
+EndStream(
+    FileIOT* Whole,
+    ErrorCodeT Result
 ) {
-    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
+    if (Result != DDS_ERROR_CODE_SUCCESS) {
+        ErrorCodeT expected = DDS_ERROR_CODE_SUCCESS;
+        Whole->StreamResult.compare_exchange_strong(expected, Result, std::memory_order_relaxed);
+    }
+    Whole->StreamEnded.store(true, std::memory_order_relaxed);
 }
 
 //
-// Move an existing file or a directory,
-// including its children
-// 
+// Issue a read or write larger than StreamChunkBytes, or that spans stripe units, as chunks,
+// up to DDS_STREAM_IO_CHUNKS_IN_FLIGHT at a time per DPU;
+// the whole I/O is reported once, by a poll, after its last chunk
+//
 //
 ErrorCodeT
-DDSFrontEnd::MoveFile(
-    const char* ExistingFileName,
-    const char* NewFileName
+DDSFrontEnd::StreamIO(
+    FileHandleT Handle,
+    bool IsRead,
+    BufferT Buffer,
+    FileSizeT Offset,
+    FileIOSizeT Bytes,
+    ReadWriteCallback Callback,
+    ContextT Context
 ) {
-    FileIdT id = DDS_FILE_INVALID;
-    DDSFile* pFile = NULL;
+    PollT* poll = Handle->Poll;
+    size_t maxChunks = (Bytes + (size_t)StreamChunkBytes - 1) / StreamChunkBytes;
+    if (poll->NumStripes != 1) {
+        //
+        // Striped, a chunk ends at the end of its stripe unit too, and every DPU takes chunks in flight
+        //
+        //
+        maxChunks = ((Offset % StripeUnitBytes) + Bytes + StripeUnitBytes - 1) / StripeUnitBytes;
+        if (StreamChunkBytes < StripeUnitBytes) {
+            maxChunks += (Bytes + (size_t)StreamChunkBytes - 1) / StreamChunkBytes;
+        }
+    }
+    if (maxChunks > DDS_STREAM_IO_CHUNKS_IN_FLIGHT * poll->NumStripes || ParityStripes) {
+        maxChunks = DDS_STREAM_IO_CHUNKS_IN_FLIGHT * poll->NumStripes;
+    }
 
-    for (FileIdT i = 0; i != FileIdEnd; i++) {
-        if (AllFiles[i] && strcmp(ExistingFileName, AllFiles[i]->GetName()) == 0) {
-            id = i;
-            pFile = AllFiles[i];
-            break;
+    //
+    // The whole I/O takes a slot of its own, which never goes to the back end, and streams on as many
+    // chunk slots as it gets; a chunk slot issues the next chunk when its chunk completes
+    //
+    //
+    FileIOT* chunks[DDS_STREAM_IO_CHUNKS_IN_FLIGHT * DDS_MAX_STRIPES];
+    size_t numChunks = 0;
+    FileIOT* whole = poll->AcquireSlot();
+    if (whole) {
+        for (; numChunks != maxChunks; numChunks++) {
+            chunks[numChunks] = poll->AcquireSlot();
+            if (!chunks[numChunks]) {
+                break;
+            }
         }
     }
 
-    if (id == DDS_FILE_INVALID) {
-        return DDS_ERROR_CODE_FILE_NOT_FOUND;
+    if (!numChunks) {
+        if (whole) {
+            poll->ReleaseSlot(whole);
+        }
+
+        //
+        // All slots are in flight; if this is a callback-based completion,
+        // perform polling once
+        //
+        //
+        if (Callback) {
+            FileIOSizeT bytesServiced;
+            ContextT fileCtxt;
+            ContextT ioCtxt;
+            bool pollResult;
+
+            PollWait(
+                Handle->PollId,
+                &bytesServiced,
+                &fileCtxt,
+                &ioCtxt,
+                0,
+                &pollResult
+            );
+        }
+
+        return DDS_ERROR_CODE_TOO_MANY_REQUESTS;
     }
 
-    pFile->SetName(NewFileName);
+    whole->IsRead = IsRead;
+    whole->CompressRead = IsRead && Handle->File->CompressReads;
+    whole->DurableWrite = !IsRead && Handle->File->Durability == DURABILITY_FUA;
+    whole->FileReference = Handle->File;
+    whole->FileId = Handle->FileId;
+    whole->Offset = Offset;
+    whole->BytesDesired = Bytes;
+    whole->AppBuffer = Buffer;
+    whole->AppBufferArray = nullptr;
+    whole->ZeroCopyResponse = nullptr;
+    whole->AppCallback = Callback;
+    whole->Context = Context;
+    whole->StreamIssued.store(0, std::memory_order_relaxed);
+    whole->StreamChunks.store(numChunks + 1, std::memory_order_relaxed);
+    whole->StreamServiced.store(0, std::memory_order_relaxed);
+    whole->StreamResult.store(DDS_ERROR_CODE_SUCCESS, std::memory_order_relaxed);
+    whole->StreamEnded.store(false, std::memory_order_relaxed);
+    DDS_IO_STAMP(whole, RingTicks);
+
+    if (ParityStripes) {
+        ErrorCodeT result = PrepareErasureIO(poll, whole);
+        if (result != DDS_ERROR_CODE_SUCCESS) {
+            for (size_t c = 0; c != numChunks; c++) {
+                poll->ReleaseSlot(chunks[c]);
+            }
+            poll->ReleaseSlot(whole);
+            return result;
+        }
+    }
+
+    size_t issued = 0;
+    while (issued != numChunks && IssueStreamChunk(poll, whole, chunks[issued])) {
+        issued++;
+    }
+
+    for (size_t c = issued; c != numChunks; c++) {
+        poll->ReleaseSlot(chunks[c]);
+    }
+
+    if (!issued) {
+        ErrorCodeT result = whole->StreamResult.load(std::memory_order_relaxed);
+        if (whole->Erasure) {
+            delete[] whole->Erasure->Buffer;
+            delete whole->Erasure;
+        }
+        poll->ReleaseSlot(whole);
+        return result;
+    }
 
     //
-    // Reflect the update on back end
+    // The chunks not issued and the submitting thread let go; the whole I/O can be done already
     //
     //
-    return BackEnd->MoveFile(id, NewFileName);
+    DropStreamReferences(poll, whole, numChunks - issued + 1);
+
+    return DDS_ERROR_CODE_IO_PENDING;
 }
 
 //
-// Get the default poll structure for async I/O
+// Issue the next chunk of a streamed I/O on a chunk slot; false if there is none left or it failed
 //
 //
-ErrorCodeT
-DDSFrontEnd::GetDefaultPoll(
-    PollIdT* PollId
+bool
+DDSFrontEnd::IssueStreamChunk(
+    PollT* Poll,
+    FileIOT* Whole,
+    FileIOT* Chunk
 ) {
-    *PollId = DDS_POLL_DEFAULT;
+    if (Whole->Erasure) {
+        return IssueErasureChunk(Poll, Whole, Chunk);
+    }
 
-    return DDS_ERROR_CODE_SUCCESS;
-}
+    if (Whole->StreamEnded.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    //
+    // Claim the next chunk, which ends at the end of its stripe unit if the file is striped
+    //
+    //
+    uint64_t issued = Whole->StreamIssued.load(std::memory_order_relaxed);
+    FileIOSizeT bytes;
+    do {
+        if (issued >= Whole->BytesDesired) {
+            return false;
+        }
+
+        bytes = Whole->BytesDesired - (FileIOSizeT)issued;
+        if (bytes > StreamChunkBytes) {
+            bytes = StreamChunkBytes;
+        }
+        bytes = StripeChunkBytes(Whole->Offset + issued, bytes);
+    } while (!Whole->StreamIssued.compare_exchange_weak(issued, issued + bytes, std::memory_order_relaxed));
+
+    FileSizeT stripeOffset = Whole->Offset + issued;
+    PollT* stripe = Poll->NumStripes == 1 ? Poll : Poll->Stripes[StripeOfOffset(Whole->Offset + issued, &stripeOffset)];
+
+    Chunk->IsRead = Whole->IsRead;
+    Chunk->IsInternal = true;
+    Chunk->CompressRead = Whole->CompressRead;
+    Chunk->DurableWrite = Whole->DurableWrite;
+    Chunk->Stream = Whole;
+    Chunk->FileReference = Whole->FileReference;
+    Chunk->FileId = Whole->FileId;
+    Chunk->Offset = Whole->Offset + issued;
+    Chunk->BytesDesired = bytes;
+    Chunk->AppBuffer = Whole->IsRead ? Whole->AppBuffer + issued : nullptr;
+    Chunk->AppBufferArray = nullptr;
+    Chunk->ZeroCopyResponse = nullptr;
+    Chunk->AppCallback = nullptr;
+    Chunk->Context = Whole;
+    Chunk->Replayable = Chunk->IsRead;
+
+    ErrorCodeT result = OnBackEnd([&](auto* backEnd) {
+        if (Chunk->IsRead) {
+            return backEnd->ReadFile(Chunk->FileId, stripeOffset, Chunk->AppBuffer, bytes, nullptr, Chunk, stripe);
+        }
+        return backEnd->WriteFile(Chunk->FileId, stripeOffset, Whole->AppBuffer + issued, bytes, nullptr, Chunk, stripe);
+    });
 
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        EndStream(Whole, result);
+        return false;
+    }
+
+    return true;
+}
 
 //
-// Create a poll structure for async I/O
+// Account for a completed chunk of a streamed I/O, issuing the next chunk on its slot;
+// a failed or short chunk ends the stream, and the chunks in flight finish it
 //
 //
-ErrorCodeT
-DDSFrontEnd::PollCreate(
-    PollIdT* PollId
+void
+DDSFrontEnd::FinishStreamChunk(
+    PollT* Poll,
+    FileIOT* Chunk,
+    ErrorCodeT Result,
+    FileIOSizeT BytesServiced
 ) {
-    //
-    // Retrieve an id
-    //
-    //
-    PollIdT id = 0;
-    for (; id != DDS_MAX_POLLS; id++) {
-        if (!AllPolls[id]) {
-            break;
+    FileIOT* whole = Chunk->Stream;
+
+    if (whole->Erasure) {
+        //
+        // A degraded read takes what the data DPUs do not hold past the end of the file as zeros;
+        // a write fails if any of its data or parity is not written, so that no row is taken as written without its parity
+        //
+        //
+        if (Result == DDS_ERROR_CODE_SUCCESS && !whole->IsRead && BytesServiced < Chunk->BytesDesired) {
+            Result = DDS_ERROR_CODE_IO_FAILURE;
+        }
+        if (Result != DDS_ERROR_CODE_SUCCESS) {
+            EndStream(whole, Result);
         }
     }
-
-    if (id == DDS_MAX_POLLS) {
-        return DDS_ERROR_CODE_TOO_MANY_POLLS;
+    else {
+        whole->StreamServiced.fetch_add(BytesServiced, std::memory_order_relaxed);
+        if (Result != DDS_ERROR_CODE_SUCCESS || BytesServiced < Chunk->BytesDesired) {
+            EndStream(whole, Result);
+        }
     }
 
-    PollT* poll = new PollT();
-    for (size_t i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
-        poll->OutstandingRequests[i] = new FileIOT();
+    if (IssueStreamChunk(Poll, whole, Chunk)) {
+        return;
     }
-    poll->NextRequestSlot = 0;
-    AllPolls[id] = poll;
 
-    *PollId = id;
-
-    return DDS_ERROR_CODE_SUCCESS;
+    Poll->ReleaseSlot(Chunk);
+    DropStreamReferences(Poll, whole, 1);
 }
 
 //
-// Delete a poll structure
+// Set up the rows of a streamed I/O of an erasure-coded front end: a write has the parity of its rows
+// encoded here, before any of it is issued; a read that touches the data of a lost DPU reads the same columns
+// of the rows from the data DPUs left and as many parity DPUs as there are lost data DPUs, and one that does not
+// streams as usual
 //
 //
 ErrorCodeT
-DDSFrontEnd::PollDelete(
-    PollIdT PollId
+DDSFrontEnd::PrepareErasureIO(
+    PollT* Poll,
+    FileIOT* Whole
 ) {
-    if (PollId == DDS_POLL_DEFAULT) {
-        return DDS_ERROR_CODE_INVALID_POLL_DELETION;
+    FileSizeT rowBytes = (FileSizeT)StripeUnitBytes * DataStripes;
+    FileSizeT firstRow = Whole->Offset / rowBytes;
+    uint32_t lost = 0;
+
+    if (Whole->IsRead) {
+        //
+        // The data DPUs the read touches, all of them once it spans a row
+        //
+        //
+        FileSizeT firstUnit = Whole->Offset / StripeUnitBytes;
+        FileSizeT units = (Whole->Offset + Whole->BytesDesired - 1) / StripeUnitBytes - firstUnit + 1;
+        uint32_t touched = 0;
+        for (FileSizeT u = 0; u != units && u != DataStripes; u++) {
+            touched |= 1u << ((firstUnit + u) % DataStripes);
+        }
+
+        lost = LostStripes(Poll);
+        if (!(lost & touched)) {
+            return DDS_ERROR_CODE_SUCCESS;
+        }
     }
 
-    PollT* poll = AllPolls[PollId];
-    if (!poll) {
-        return DDS_ERROR_CODE_INVALID_POLL_DELETION;
+    ErasureIOT* erasure = new (std::nothrow) ErasureIOT;
+    if (!erasure) {
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
+    }
+
+    erasure->FirstRow = firstRow;
+    erasure->DataStripes = DataStripes;
+    erasure->ParityStripes = ParityStripes;
+    erasure->UnitBytes = StripeUnitBytes;
+    erasure->LostMask = lost;
+    erasure->NumStripes = 0;
+
+    if (!Whole->IsRead) {
+        //
+        // The parity units of every row, in the order of rows and parity DPUs, issued after the data
+        //
+        //
+        erasure->Rows = (size_t)(Whole->BytesDesired / rowBytes);
+        erasure->ColumnOffset = 0;
+        erasure->ColumnBytes = StripeUnitBytes;
+        for (size_t p = 0; p != ParityStripes; p++) {
+            erasure->Stripes[erasure->NumStripes++] = (uint8_t)(DataStripes + p);
+        }
+        erasure->IssueBytes = Whole->BytesDesired + (uint64_t)erasure->Rows * ParityStripes * StripeUnitBytes;
+        erasure->Buffer = new (std::nothrow) char[erasure->Rows * ParityStripes * StripeUnitBytes];
+        if (!erasure->Buffer) {
+            delete erasure;
+            return DDS_ERROR_CODE_OUT_OF_MEMORY;
+        }
+
+        for (size_t row = 0; row != erasure->Rows; row++) {
+            const char* units[DDS_MAX_STRIPES];
+            for (size_t s = 0; s != DataStripes; s++) {
+                units[s] = Whole->AppBuffer + row * rowBytes + s * StripeUnitBytes;
+            }
+            char* parity = erasure->Buffer + row * ParityStripes * StripeUnitBytes;
+            ComputeParity(units, DataStripes, 0, parity, ParityStripes > 1 ? parity + StripeUnitBytes : nullptr, StripeUnitBytes);
+        }
+
+        Whole->Erasure = erasure;
+        return DDS_ERROR_CODE_SUCCESS;
     }
 
-    for (size_t i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
-        delete poll->OutstandingRequests[i];
+    //
+    // Every data DPU left, and a parity DPU left for every lost data DPU
+    //
+    //
+    size_t needed = 0;
+    for (size_t s = 0; s != DataStripes; s++) {
+        if (lost & (1u << s)) {
+            needed++;
+        }
+        else {
+            erasure->Stripes[erasure->NumStripes++] = (uint8_t)s;
+        }
+    }
+    for (size_t s = DataStripes; s != NumStripes && needed; s++) {
+        if (!(lost & (1u << s))) {
+            erasure->Stripes[erasure->NumStripes++] = (uint8_t)s;
+            needed--;
+        }
+    }
+    if (needed) {
+        delete erasure;
+        return DDS_ERROR_CODE_FAILED_CONNECTION;
+    }
+
+    //
+    // A read within a stripe unit reads only its columns of the other units, widened to words for the decoding
+    //
+    //
+    FileIOSizeT inUnit = (FileIOSizeT)(Whole->Offset % StripeUnitBytes);
+    if (inUnit + Whole->BytesDesired <= StripeUnitBytes) {
+        erasure->ColumnOffset = inUnit & ~(FileIOSizeT)(sizeof(uint64_t) - 1);
+        erasure->ColumnBytes = ((inUnit + Whole->BytesDesired + (FileIOSizeT)sizeof(uint64_t) - 1) &
+            ~(FileIOSizeT)(sizeof(uint64_t) - 1)) - erasure->ColumnOffset;
+    }
+    else {
+        erasure->ColumnOffset = 0;
+        erasure->ColumnBytes = StripeUnitBytes;
+    }
+
+    //
+    // The units of the rows, zeroed so that what is past the end of the file on a DPU decodes as the zeros it was
+    // encoded as, and the scratch of the decoding after them
+    //
+    //
+    erasure->Rows = (size_t)((Whole->Offset + Whole->BytesDesired - 1) / rowBytes - firstRow + 1);
+    erasure->IssueBytes = (uint64_t)erasure->Rows * erasure->NumStripes * erasure->ColumnBytes;
+    erasure->Buffer = new (std::nothrow) char[(erasure->Rows * NumStripes + 2) * erasure->ColumnBytes]();
+    if (!erasure->Buffer) {
+        delete erasure;
+        return DDS_ERROR_CODE_OUT_OF_MEMORY;
     }
-    delete poll;
-    AllPolls[PollId] = nullptr;
 
+    Whole->Erasure = erasure;
     return DDS_ERROR_CODE_SUCCESS;
 }
 
 //
-// Add a file to a pool
+// Issue the next chunk of a streamed I/O of an erasure-coded front end: the data of a write goes to the data DPUs
+// as in any stream, and its parity, or the units of a degraded read, go chunk by chunk along the rows
 //
 //
-ErrorCodeT
-DDSFrontEnd::PollAdd(
-    FileIdT FileId,
-    PollIdT PollId,
-    ContextT FileContext
+bool
+DDSFrontEnd::IssueErasureChunk(
+    PollT* Poll,
+    FileIOT* Whole,
+    FileIOT* Chunk
 ) {
-    DDSFile* pFile = AllFiles[FileId];
-
-    if (PollId != pFile->PollId) {
-        pFile->PollId = PollId;
+    if (Whole->StreamEnded.load(std::memory_order_relaxed)) {
+        return false;
     }
 
-    pFile->PollContext = FileContext;
+    ErasureIOT* erasure = Whole->Erasure;
+    uint64_t issued = Whole->StreamIssued.load(std::memory_order_relaxed);
+    FileIOSizeT bytes;
+    size_t stripe;
+    FileSizeT stripeOffset;
+    char* buffer;
+    do {
+        if (issued >= erasure->IssueBytes) {
+            return false;
+        }
 
-    return DDS_ERROR_CODE_SUCCESS;
+        if (!Whole->IsRead && issued < Whole->BytesDesired) {
+            bytes = Whole->BytesDesired - (FileIOSizeT)issued;
+            if (bytes > StreamChunkBytes) {
+                bytes = StreamChunkBytes;
+            }
+            bytes = StripeChunkBytes(Whole->Offset + issued, bytes);
+            stripe = StripeOfOffset(Whole->Offset + issued, &stripeOffset);
+            buffer = Whole->AppBuffer + issued;
+        }
+        else {
+            uint64_t position = Whole->IsRead ? issued : issued - Whole->BytesDesired;
+            uint64_t unit = position / erasure->ColumnBytes;
+            FileIOSizeT column = (FileIOSizeT)(position % erasure->ColumnBytes);
+            size_t row = (size_t)(unit / erasure->NumStripes);
+            stripe = erasure->Stripes[unit % erasure->NumStripes];
+
+            bytes = erasure->ColumnBytes - column;
+            if (bytes > StreamChunkBytes) {
+                bytes = StreamChunkBytes;
+            }
+            stripeOffset = (erasure->FirstRow + row) * StripeUnitBytes + erasure->ColumnOffset + column;
+            buffer = Whole->IsRead ?
+                erasure->Buffer + (row * NumStripes + stripe) * erasure->ColumnBytes + column :
+                erasure->Buffer + position;
+        }
+    } while (!Whole->StreamIssued.compare_exchange_weak(issued, issued + bytes, std::memory_order_relaxed));
+
+    PollT* stripePoll = Poll->Stripes[stripe];
+
+    Chunk->IsRead = Whole->IsRead;
+    Chunk->IsInternal = true;
+    Chunk->CompressRead = Whole->CompressRead;
+    Chunk->DurableWrite = Whole->DurableWrite;
+    Chunk->Stream = Whole;
+    Chunk->FileReference = Whole->FileReference;
+    Chunk->FileId = Whole->FileId;
+    Chunk->Offset = Whole->Offset + issued;
+    Chunk->BytesDesired = bytes;
+    Chunk->AppBuffer = Whole->IsRead ? buffer : nullptr;
+    Chunk->AppBufferArray = nullptr;
+    Chunk->ZeroCopyResponse = nullptr;
+    Chunk->AppCallback = nullptr;
+    Chunk->Context = Whole;
+    Chunk->Replayable = false;
+
+    ErrorCodeT result = OnBackEnd([&](auto* backEnd) {
+        if (Chunk->IsRead) {
+            return backEnd->ReadFile(Chunk->FileId, stripeOffset, buffer, bytes, nullptr, Chunk, stripePoll);
+        }
+        return backEnd->WriteFile(Chunk->FileId, stripeOffset, buffer, bytes, nullptr, Chunk, stripePoll);
+    });
+
+    if (result != DDS_ERROR_CODE_IO_PENDING) {
+        EndStream(Whole, result);
+        return false;
+    }
+
+    return true;
 }
 
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 //
-// Poll a completion event
+// Poll up to MaxCompletions completion events;
+// only the first one is waited for, the rest are those already available,
+// e.g., the remaining responses of a cached batch
 //
 //
 ErrorCodeT
-DDSFrontEnd::PollWait(
+DDSFrontEnd::PollWaitBatch(
     PollIdT PollId,
-    FileIOSizeT* BytesServiced,
-    ContextT* FileContext,
-    ContextT* IOContext,
+    PollCompletionT* Completions,
+    size_t MaxCompletions,
     size_t WaitTime,
-    bool* PollResult
+    size_t* NumCompletions
 ) {
-    std::chrono::time_point<std::chrono::system_clock> begin, cur;
-
     PollT* poll = AllPolls[PollId];
+    size_t waitTime = WaitTime;
 
-    *PollResult = false;
+    *NumCompletions = 0;
 
-    begin = std::chrono::system_clock::now();
+    FlushStripes(poll);
 
-    size_t sleepTimeInUs = 1;
+    if (poll->ControlOpsPending.load(std::memory_order_relaxed)) {
+        ProgressControlOps();
+        waitTime = std::min(waitTime, (size_t)DDS_CONTROL_OPS_POLL_MS);
+    }
 
-    while (true) {
-        for (size_t i = 0; i != DDS_MAX_OUTSTANDING_IO; i++) {
-            FileIOT* io = poll->OutstandingRequests[i];
+    while (*NumCompletions != MaxCompletions) {
+        FileIOSizeT bytesServiced;
+        RequestIdT reqId;
 
-            bool expectedCompletion = true;
-            if (io->IsReadyForPoll.compare_exchange_weak(
-                expectedCompletion,
-                false,
-                std::memory_order_relaxed
-            )) {
-                *BytesServiced = io->BytesServiced;
-                *FileContext = AllFiles[io->FileId]->PollContext;
-                *IOContext = io->Context;
-                *PollResult = true;
+        FileIOT* coalesced = poll->PopCoalescedCompletion();
+        if (coalesced) {
+            FileIOT* io = coalesced;
 
-                io->IsComplete = true;
+            PollCompletionT* completion = &Completions[*NumCompletions];
+            completion->Result = io->CoalescedResult;
+            completion->BytesServiced = io->CoalescedBytesServiced;
+            completion->FileContext = io->IsControl ? nullptr : AllFiles[io->FileId]->PollContext;
+            completion->IOContext = io->Context;
+            (*NumCompletions)++;
 
-                break;
-            }
+            RetireIO(poll, io, completion->Result, completion->BytesServiced);
+
+            waitTime = 0;
+            continue;
         }
 
-        if (*PollResult) {
+        ErrorCodeT result = GetStripedResponse(poll, waitTime, &bytesServiced, &reqId);
+
+        if (result == DDS_ERROR_CODE_NO_COMPLETION) {
             break;
         }
 
-        cur = std::chrono::system_clock::now();
-        if ((size_t)std::chrono::duration_cast<std::chrono::milliseconds>(cur - begin).count() >= WaitTime) {
-            break;
+        FileIOT* io = poll->OutstandingRequests[reqId];
+        if (io->IsInternal) {
+            RetireIO(poll, io, result, bytesServiced);
+            waitTime = 0;
+            continue;
         }
 
-        //
-        // Adaptively yeild the CPU usage until the tolerated latency upper bound
-        //
-        //
-        std::this_thread::sleep_for(std::chrono::microseconds(sleepTimeInUs));
-        if (sleepTimeInUs < DDS_POLL_MAX_LATENCY_MICROSECONDS) {
-            sleepTimeInUs *= 2;
+        StampResponse(io);
+        if (io->NextCoalesced) {
+            bytesServiced = io->CoalescedBytesServiced;
+            poll->PushCoalescedCompletions(io->NextCoalesced);
         }
-    }
 
-    if (!(*PollResult)) {
-        *FileContext = nullptr;
-        *IOContext = nullptr;
+        PollCompletionT* completion = &Completions[*NumCompletions];
+        completion->Result = result;
+        completion->BytesServiced = bytesServiced;
+        completion->FileContext = AllFiles[io->FileId]->PollContext;
+        completion->IOContext = io->Context;
+        (*NumCompletions)++;
+
+        RetireIO(poll, io, result, bytesServiced);
+
+        waitTime = 0;
     }
 
     return DDS_ERROR_CODE_SUCCESS;
 }
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
+
 //
-// Poll a completion event
+// Read the latency histograms of the I/Os completed on a poll so far
 //
 //
 ErrorCodeT
-DDSFrontEnd::PollWait(
+DDSFrontEnd::GetIOStatistics(
     PollIdT PollId,
-    FileIOSizeT* BytesServiced,
-    ContextT* FileContext,
-    ContextT* IOContext,
-    size_t WaitTime,
-    bool* PollResult
+    IOStatisticsT* Statistics
 ) {
-    std::chrono::time_point<std::chrono::system_clock> begin, cur;
-
-    PollT* poll = AllPolls[PollId];
-    RequestIdT reqId;
-
-    ErrorCodeT result = BackEnd->GetResponse(
-        poll,
-        WaitTime,
-        BytesServiced,
-        &reqId
-    );
-
-    if (result == DDS_ERROR_CODE_NO_COMPLETION) {
-        *PollResult = false;
-        *FileContext = nullptr;
-        *IOContext = nullptr;
+#ifdef DDS_IO_STATISTICS_ENABLED
+    if (PollId >= DDS_MAX_POLLS || !AllPolls[PollId] || !Statistics) {
+        return DDS_ERROR_CODE_INVALID_PARAM;
     }
-    else {
-        FileIOT* io = poll->OutstandingRequests[reqId];
-        *FileContext = AllFiles[io->FileId]->PollContext;
-        *IOContext = io->Context;
-        *PollResult = true;
-
-        //
-        // If the application provides a callback, we should handle it here
-        // because this poll might be invoked by a read/write call
-        //
-        //
-        if (io->AppCallback) {
-            io->AppCallback(result, *BytesServiced, io->Context);
-        }
 
-        //
-        // Mark this slot as available
-        //
-        //
-        io->IsAvailable.store(true);
-    }
+    AllPolls[PollId]->IOStatistics.Read(Statistics);
 
     return DDS_ERROR_CODE_SUCCESS;
-}
 #else
-#error "Unknown backend type"
+    return DDS_ERROR_CODE_NOT_IMPLEMENTED;
 #endif
+}
 
-}
\ No newline at end of file
+}
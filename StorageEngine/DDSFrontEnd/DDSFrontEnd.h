@@ -6,19 +6,15 @@
 #pragma once
 
 #include <atomic>
+#include <mutex>
 
 #include "DDSDir.h"
 #include "DDSFile.h"
+#include "DDSFileCache.h"
 #include "DDSFrontEndInterface.h"
 #include "DDSFrontEndTypes.h"
-
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
 #include "DDSBackEndBridge.h"
-#elif BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
 #include "DDSBackEndBridgeForLocalMemory.h"
-#else
-#error "Unknown backend type"
-#endif
 
 #undef CreateDirectory
 #undef RemoveDirectory
@@ -51,27 +47,507 @@ class DDSFrontEnd : public DDSFrontEndInterface
 {
 private:
     char StoreName[DDS_MAX_DEVICE_NAME_LEN];
+    BackEndTypeT BackEndType;
+    RingSizeT RequestRingBytes;
+    RingSizeT ResponseRingBytes;
+    RingProtocolT RingProtocol;
+    uint32_t PollQueueDepth;
+    FileIOSizeT StreamChunkBytes;
     DDSBackEndBridgeBase* BackEnd;
-    DDSDir* AllDirs[DDS_MAX_DIRS];
+    size_t NumStripes;
+    size_t DataStripes;
+    size_t ParityStripes;
+    FileIOSizeT StripeUnitBytes;
+    char StripeAddrs[DDS_MAX_STRIPES][sizeof(DDSBackEndBridge::BackEndAddr)];
+    unsigned short StripePorts[DDS_MAX_STRIPES];
+    DDSBackEndBridgeBase* StripeBackEnds[DDS_MAX_STRIPES];
+    IdTable<DDSDir*, DDS_MAX_DIRS, DDS_DIR_TABLE_CHUNK_ENTRIES> AllDirs;
     DirIdT DirIdEnd;
-    DDSFile* AllFiles[DDS_MAX_FILES];
+    IdTable<DDSFile*, DDS_MAX_FILES, DDS_FILE_TABLE_CHUNK_ENTRIES> AllFiles;
+    IdTable<FileHandle, DDS_MAX_FILES, DDS_FILE_TABLE_CHUNK_ENTRIES> FileHandles;
+    FileNameIndex<DDS_MAX_FILES, DDS_FILE_TABLE_CHUNK_ENTRIES> FileNames;
     FileIdT FileIdEnd;
+    char FindPattern[DDS_MAX_FILE_PATH];
+    ControlOpT* ControlBatchOps;
+    size_t ControlBatchNumOps;
+
+    //
+    // Control operations of the async calls: those waiting for a batch, in order, with the link to the last,
+    // and those of the batch in flight; the lock keeps them and the tables of files in step
+    // as the threads that poll take the acks of batches
+    //
+    //
+    AsyncControlOpT* AsyncControlHead;
+    AsyncControlOpT** AsyncControlTail;
+    AsyncControlOpT* AsyncControlBatch[CTRL_MSG_BATCH_MAX_OPS];
+    ControlOpT AsyncControlBatchOps[CTRL_MSG_BATCH_MAX_OPS];
+    size_t AsyncControlBatchNumOps;
+    std::mutex ControlLock;
+
     PollT* AllPolls[DDS_MAX_POLLS];
     PollIdT PollIdEnd;
 
+    //
+    // Handovers of every DPU to a new build and reconnects after it was lost the bridge to it has followed,
+    // and the lock that moves polls to the new back end one at a time
+    //
+    //
+    size_t StripeHandovers[DDS_MAX_STRIPES];
+    std::mutex HandoverLock;
+
 private:
+    //
+    // Flush a leased file, drop its cache and give its lease back to every DPU
+    //
+    //
+    ErrorCodeT
+    GiveBackLease(
+        FileIdT FileId
+    );
+
+    //
+    // Run an operation on the back end through its concrete type;
+    // both bridges are final, so the calls the operation makes are bound statically
+    // and the I/O path costs one predictable branch instead of virtual calls
+    //
+    //
+    template <typename OperationT>
+    inline ErrorCodeT
+    OnBackEnd(
+        OperationT Operation
+    ) {
+        if (BackEndType == BACKEND_TYPE_DPU) {
+            return Operation(static_cast<DDSBackEndBridge*>(BackEnd));
+        }
+        return Operation(static_cast<DDSBackEndBridgeForLocalMemory*>(BackEnd));
+    }
+
+    //
+    // Run a control operation on the back end of every DPU, the first being BackEnd, with the index of the DPU;
+    // it stops at the first failure, which leaves the operation done on the DPUs before
+    //
+    //
+    template <typename OperationT>
+    inline ErrorCodeT
+    OnEveryBackEnd(
+        OperationT Operation
+    ) {
+        for (size_t s = 0; s != NumStripes; s++) {
+            ErrorCodeT result = Operation(StripeBackEnds[s], s);
+            if (result != DDS_ERROR_CODE_SUCCESS) {
+                return result;
+            }
+        }
+
+        return DDS_ERROR_CODE_SUCCESS;
+    }
+
+    //
+    // The stripes of a poll whose DPU is lost, as a mask of their indices
+    //
+    //
+    inline uint32_t
+    LostStripes(
+        PollT* Poll
+    ) {
+        uint32_t lost = 0;
+        for (size_t s = 0; s != Poll->NumStripes; s++) {
+            if (Poll->Stripes[s]->BackEndLost.load(std::memory_order_relaxed)) {
+                lost |= 1u << s;
+            }
+        }
+
+        return lost;
+    }
+
+    //
+    // Whether [Buffer, Buffer + Bytes) is in a device buffer registered with a poll
+    //
+    //
+    inline bool
+    IsDeviceBuffer(
+        PollT* Poll,
+        const char* Buffer,
+        size_t Bytes
+    ) {
+        uint32_t token;
+        bool device = false;
+
+        return Poll->NumDeviceBuffers && Poll->MsgBuffer->FindExternalRegion(Buffer, Bytes, &token, &device) && device;
+    }
+
+    //
+    // The DPU that holds a byte of a file, and where the byte is in the file on that DPU;
+    // the data of a file is striped across the DataStripes first DPUs, the parity DPUs coming after them
+    //
+    //
+    inline size_t
+    StripeOfOffset(
+        FileSizeT Offset,
+        FileSizeT* StripeOffset
+    ) {
+        FileSizeT unit = Offset / StripeUnitBytes;
+        *StripeOffset = (unit / DataStripes) * StripeUnitBytes + Offset % StripeUnitBytes;
+
+        return (size_t)(unit % DataStripes);
+    }
+
+    //
+    // How many of the bytes of a file of FileSize a DPU holds; a parity DPU holds a unit for every row
+    //
+    //
+    inline FileSizeT
+    StripeFileSize(
+        FileSizeT FileSize,
+        size_t Stripe
+    ) {
+        FileSizeT rowBytes = (FileSizeT)StripeUnitBytes * DataStripes;
+        if (Stripe >= DataStripes) {
+            return (FileSize + rowBytes - 1) / rowBytes * StripeUnitBytes;
+        }
+
+        FileSizeT rest = FileSize % rowBytes;
+        FileSizeT before = (FileSizeT)StripeUnitBytes * Stripe;
+        FileSizeT tail = rest <= before ? 0 : (rest - before < StripeUnitBytes ? rest - before : StripeUnitBytes);
+
+        return (FileSize / rowBytes) * StripeUnitBytes + tail;
+    }
+
+    //
+    // The bytes of an I/O at Offset that go to one DPU, up to the end of the stripe unit of Offset
+    //
+    //
+    inline FileIOSizeT
+    StripeChunkBytes(
+        FileSizeT Offset,
+        FileIOSizeT Bytes
+    ) {
+        if (NumStripes == 1) {
+            return Bytes;
+        }
+
+        FileIOSizeT left = StripeUnitBytes - (FileIOSizeT)(Offset % StripeUnitBytes);
+        return Bytes < left ? Bytes : left;
+    }
+
     void
     RemoveDirectoryRecursive(
         DDSDir* Dir
     );
 
+    //
+    // The id of the file of a name, or DDS_FILE_INVALID
+    //
+    //
+    FileIdT
+    FindFileByName(
+        const char* FileName
+    );
+
+    //
+    // Add a file to the tables of the front end, without reflecting it on the back end
+    //
+    //
+    ErrorCodeT
+    AddFileToTables(
+        const char* FileName,
+        FileAccessT DesiredAccess,
+        FileShareModeT ShareMode,
+        FileAttributesT FileAttributes,
+        FileIdT* FileId
+    );
+
+    //
+    // Remove a file from the tables of the front end, without reflecting it on the back end
+    //
+    //
+    void
+    RemoveFileFromTables(
+        FileIdT FileId
+    );
+
+    //
+    // Bring the tables in line with a control operation about to go to the back end,
+    // and with one the back end has answered
+    //
+    //
+    ErrorCodeT
+    PrepareControlOp(
+        ControlOpT* Op
+    );
+
+    void
+    ApplyControlOp(
+        ControlOpT* Op
+    );
+
+    //
+    // Queue a control operation of the async calls, to be reported by a poll once the back end has done it
+    //
+    //
+    ErrorCodeT
+    QueueControlOp(
+        PollIdT PollId,
+        ControlOpT* Op,
+        FileSizeT* FileSize,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Take the ack of the batch of control operations of the async calls, if it has come,
+    // and send the next batch
+    //
+    //
+    void
+    ProgressControlOps();
+
+    //
+    // Allocate a poll with its own I/O slots and, for the DPU back end,
+    // its own DMA buffer and request/response rings
+    //
+    //
+    ErrorCodeT
+    AllocatePoll(
+        PollIdT PollId,
+        PollPriority Priority
+    );
+
+    //
+    // Release a poll and everything allocated by AllocatePoll
+    //
+    //
+    void
+    ReleasePoll(
+        PollIdT PollId
+    );
+
+    //
+    // Publish the requests staged or queued on the stripes of a poll
+    //
+    //
+    ErrorCodeT
+    FlushStripes(
+        PollT* Poll
+    );
+
+    //
+    // Retrieve a response from the ring of a poll or, striped across DPUs, from the ring of any of its stripes
+    //
+    //
+    ErrorCodeT
+    GetStripedResponse(
+        PollT* Poll,
+        size_t WaitTime,
+        FileIOSizeT* BytesServiced,
+        RequestIdT* ReqId
+    );
+
+    //
+    // Move the stripes of a poll whose DPU has handed over to a new build to the new back end;
+    // return whether a stripe was moved
+    //
+    //
+    bool
+    ResumeHandedOverStripes(
+        PollT* Poll
+    );
+
+    //
+    // Move the stripes of a poll whose DPU is lost to the back end started in its place,
+    // issuing the lost reads again and failing the other lost I/Os; return whether a stripe was moved
+    //
+    //
+    bool
+    RecoverLostStripes(
+        PollT* Poll
+    );
+
+    //
+    // Finish a completed I/O: run its callback and give its slot back
+    //
+    //
+    void
+    RetireIO(
+        PollT* Poll,
+        FileIOT* IO,
+        ErrorCodeT Result,
+        FileIOSizeT BytesServiced
+    );
+
+    //
+    // Issue a read-ahead or write-back asked for by a file cache;
+    // its completion goes to the cache and is never reported by polls;
+    // return DDS_ERROR_CODE_IO_PENDING once issued and success if nothing was asked for
+    //
+    //
+    ErrorCodeT
+    SubmitCacheIO(
+        FileHandleT Handle,
+        bool IsRead,
+        CacheIOT* CacheIO
+    );
+
+    //
+    // Issue a read or write larger than StreamChunkBytes as chunks, up to DDS_STREAM_IO_CHUNKS_IN_FLIGHT at a time;
+    // the whole I/O is reported once, by a poll, after its last chunk
+    //
+    //
+    ErrorCodeT
+    StreamIO(
+        FileHandleT Handle,
+        bool IsRead,
+        BufferT Buffer,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Send an atomic operation on the word at Offset to the DPU that holds it
+    //
+    //
+    ErrorCodeT
+    AtomicOnFile(
+        FileHandleT Handle,
+        uint32_t Op,
+        FileSizeT Offset,
+        uint64_t Operand,
+        uint64_t Compare,
+        uint64_t* Prior,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Issue the next chunk of a streamed I/O on a chunk slot; false if there is none left or it failed
+    //
+    //
+    bool
+    IssueStreamChunk(
+        PollT* Poll,
+        FileIOT* Whole,
+        FileIOT* Chunk
+    );
+
+    //
+    // Set up the rows of a streamed I/O of an erasure-coded front end: encode the parity of a write,
+    // or plan the reads that reconstruct the data of the lost DPUs for a read
+    //
+    //
+    ErrorCodeT
+    PrepareErasureIO(
+        PollT* Poll,
+        FileIOT* Whole
+    );
+
+    //
+    // Issue the next chunk of a streamed I/O of an erasure-coded front end; false if there is none left or it failed
+    //
+    //
+    bool
+    IssueErasureChunk(
+        PollT* Poll,
+        FileIOT* Whole,
+        FileIOT* Chunk
+    );
+
+    //
+    // Account for a completed chunk of a streamed I/O, issuing the next chunk on its slot
+    //
+    //
+    void
+    FinishStreamChunk(
+        PollT* Poll,
+        FileIOT* Chunk,
+        ErrorCodeT Result,
+        FileIOSizeT BytesServiced
+    );
+
+    //
+    // Submit a batch of reads or writes on one poll
+    //
+    //
+    ErrorCodeT
+    SubmitFileIOBatch(
+        bool IsRead,
+        FileIOBatchEntryT* Entries,
+        size_t NumEntries,
+        size_t* NumSubmitted,
+        ReadWriteCallback Callback
+    );
+
 public:
     DDSFrontEnd(
-        const char* StoreName
+        const char* StoreName,
+        BackEndTypeT BackEndType = DDS_DEFAULT_BACKEND_TYPE
     );
 
     ~DDSFrontEnd();
 
+    //
+    // Set the sizes of the request and response rings of every poll,
+    // which the DPU back end may lower when Initialize connects to it;
+    // must be called before Initialize
+    //
+    //
+    ErrorCodeT
+    SetRingBytes(
+        RingSizeT RequestRingBytes,
+        RingSizeT ResponseRingBytes
+    );
+
+    //
+    // Set the protocol of the request and response rings of every poll,
+    // which the DPU back end may replace when Initialize connects to it;
+    // must be called before Initialize
+    //
+    //
+    ErrorCodeT
+    SetRingProtocol(
+        RingProtocolT RingProtocol
+    );
+
+    //
+    // Set the queue depth of every poll, a power of two in [DDS_MIN_POLL_QUEUE_DEPTH, DDS_MAX_POLL_QUEUE_DEPTH],
+    // which the DPU back end may lower when Initialize connects to it;
+    // must be called before Initialize
+    //
+    //
+    ErrorCodeT
+    SetPollQueueDepth(
+        uint32_t PollQueueDepth
+    );
+
+    //
+    // Stripe the files across several DPUs, file offsets [k * StripeUnitBytes, (k + 1) * StripeUnitBytes)
+    // going to the DPU of index k % NumBackEnds; every poll has a DMA buffer on every DPU, the I/Os that span
+    // stripe units are split and reassembled as streams, and control operations go to every DPU;
+    // the first DPU takes the place of the default back end; must be called before Initialize
+    //
+    //
+    ErrorCodeT
+    SetStripes(
+        const char* const* BackEndAddrs,
+        const unsigned short* BackEndPorts,
+        size_t NumBackEnds,
+        FileIOSizeT StripeUnitBytes
+    );
+
+    //
+    // Keep the last ParityStripes of the DPUs given to SetStripes for the Reed-Solomon parity of the others,
+    // at most DDS_ERASURE_MAX_PARITY_STRIPES, so that the data survives as many lost DPUs; the data is striped
+    // across the other DPUs, and every row of their stripe units has a parity unit on every parity DPU.
+    // Writes cover whole rows; reads go to the data DPUs alone, unless some are lost, when they are reconstructed.
+    // Must be called after SetStripes and before Initialize
+    //
+    //
+    ErrorCodeT
+    SetErasureCoding(
+        size_t ParityStripes
+    );
+
     //
     // Intialize the front end, including connecting to back end
     // and setting up the root directory and default poll
@@ -152,6 +628,135 @@ public:
         FilePointerPosition MoveMethod
     );
 
+    //
+    // Set how writes without an offset use the file pointer
+    // 
+    //
+    ErrorCodeT
+    SetFileWriteMode(
+        FileIdT FileId,
+        FileWriteMode Mode
+    );
+
+    //
+    // Set whether the back end may compress the data read from a file
+    // 
+    //
+    ErrorCodeT
+    SetFileCompression(
+        FileIdT FileId,
+        bool Enabled
+    );
+
+    //
+    // Set when the writes to a file become durable and what FlushFileBuffers does to the device
+    // 
+    //
+    ErrorCodeT
+    SetFileDurability(
+        FileIdT FileId,
+        FileDurability Mode
+    );
+
+    //
+    // Limit the I/O of a file on the back end, or lift the limit if BytesPerSecond is 0
+    // 
+    //
+    ErrorCodeT
+    SetFileQoS(
+        FileIdT FileId,
+        uint64_t BytesPerSecond,
+        uint64_t BurstBytes,
+        uint32_t Weight
+    );
+
+    //
+    // Take a read-only snapshot of a file as a new file named SnapshotName
+    // 
+    //
+    ErrorCodeT
+    CreateSnapshot(
+        FileIdT FileId,
+        const char* SnapshotName,
+        FileIdT* SnapshotFileId
+    );
+
+    //
+    // Tell the back end how a file will be read
+    // 
+    //
+    ErrorCodeT
+    SetFileAccessHint(
+        FileIdT FileId,
+        FileAccessHint Hint,
+        FileSizeT Offset,
+        FileSizeT Bytes
+    );
+
+    //
+    // Take a lease of a shared file, or change its mode
+    // 
+    //
+    ErrorCodeT
+    AcquireFileLease(
+        FileIdT FileId,
+        FileLeaseMode Mode,
+        LeaseRevokedCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Flush a file and give back its lease
+    // 
+    //
+    ErrorCodeT
+    ReleaseFileLease(
+        FileIdT FileId
+    );
+
+    //
+    // Renew the leases of the front end, giving back the revoked ones
+    // 
+    //
+    ErrorCodeT
+    RenewFileLeases();
+
+    //
+    // Compile and load a scan function on the back end, which names it by ScanId in later scans
+    // 
+    //
+    ErrorCodeT
+    LoadScanFunction(
+        const char* CodePath,
+        uint16_t* ScanId
+    );
+
+    //
+    // Start capturing the reads, writes and flushes of the application into a trace at Path (DDSCapture.h),
+    // which FrontEndReplay replays
+    // 
+    //
+    ErrorCodeT
+    StartCapture(
+        const char* Path
+    );
+
+    //
+    // Stop the capture and close its trace
+    // 
+    //
+    void
+    StopCapture();
+
+    //
+    // Trace the next read or write the calling thread submits with a trace id (DDSTrace.h)
+    // 
+    //
+    void
+    SetNextIOTraceId(
+        uint64_t TraceId
+    );
+
     //
     // Get file size
     // 
@@ -238,6 +843,94 @@ public:
         ContextT Context
     );
 
+    //
+    // Async read from a file without copying;
+    // on completion, Response views the data in the response ring until ReleaseResponse
+    // 
+    //
+    ErrorCodeT
+    ReadFileZeroCopy(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT BytesToRead,
+        ZeroCopyReadT* Response,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Release the data of a completed zero-copy read back to the response ring
+    // 
+    //
+    ErrorCodeT
+    ReleaseResponse(
+        ZeroCopyReadT* Response
+    );
+
+    //
+    // Async read of the item a key maps to in the cache table on the DPU, which looks the key up
+    // and reads the item in the same step; the completion arrives on the poll PollId, and fails
+    // with DDS_ERROR_CODE_KEY_NOT_FOUND if the key is not in the table, or with DDS_ERROR_CODE_BUFFER_OVERFLOW
+    // if the item is larger than BufferSize
+    // 
+    //
+    ErrorCodeT
+    GetByKey(
+        PollIdT PollId,
+        const CacheKeyT* Key,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        FileIOSizeT* BytesRead,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Async scan of Bytes of a file from Offset in records of RecordBytes with a loaded scan function;
+    // only what the function keeps of the records is read into the destination
+    // 
+    //
+    ErrorCodeT
+    ScanFile(
+        FileIdT FileId,
+        uint16_t ScanId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes,
+        FileIOSizeT RecordBytes,
+        BufferT DestBuffer,
+        FileIOSizeT BufferSize,
+        FileIOSizeT* BytesRead,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Async reads of a batch of entries, submitted to the back end at once;
+    // all entries must be on the same poll, and NumSubmitted tells how many leading
+    // entries were submitted when I/O slots run out
+    // 
+    //
+    ErrorCodeT
+    ReadFileBatch(
+        FileIOBatchEntryT* Entries,
+        size_t NumEntries,
+        size_t* NumSubmitted,
+        ReadWriteCallback Callback
+    );
+
+    //
+    // Async writes of a batch of entries, submitted to the back end at once;
+    // same rules as ReadFileBatch
+    // 
+    //
+    ErrorCodeT
+    WriteFileBatch(
+        FileIOBatchEntryT* Entries,
+        size_t NumEntries,
+        size_t* NumSubmitted,
+        ReadWriteCallback Callback
+    );
+
     //
     // Async read from a file with scattering
     // 
@@ -283,6 +976,90 @@ public:
         ContextT Context
     );
 
+    //
+    // Open a handle to a file for I/O;
+    // the handle stays valid until the file is deleted
+    // 
+    //
+    ErrorCodeT
+    OpenFileHandle(
+        FileIdT FileId,
+        FileHandleT* Handle
+    );
+
+    //
+    // Async read from an opened file with offset
+    // 
+    //
+    ErrorCodeT
+    ReadFileAt(
+        FileHandleT Handle,
+        BufferT DestBuffer,
+        FileSizeT Offset,
+        FileIOSizeT BytesToRead,
+        FileIOSizeT* BytesRead,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Async write to an opened file with offset
+    // 
+    //
+    ErrorCodeT
+    WriteFileAt(
+        FileHandleT Handle,
+        BufferT SourceBuffer,
+        FileSizeT Offset,
+        FileIOSizeT BytesToWrite,
+        FileIOSizeT* BytesWritten,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Async append to an opened file
+    // 
+    //
+    ErrorCodeT
+    AppendFile(
+        FileHandleT Handle,
+        BufferT SourceBuffer,
+        FileIOSizeT BytesToWrite,
+        FileSizeT* AppendedOffset,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Async compare-and-swap of a word of an opened file
+    // 
+    //
+    ErrorCodeT
+    CompareAndSwapFile(
+        FileHandleT Handle,
+        FileSizeT Offset,
+        uint64_t Expected,
+        uint64_t Desired,
+        uint64_t* Prior,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Async fetch-and-add of a word of an opened file
+    // 
+    //
+    ErrorCodeT
+    FetchAndAddFile(
+        FileHandleT Handle,
+        FileSizeT Offset,
+        uint64_t Addend,
+        uint64_t* Prior,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
     //
     // Flush buffered data to storage
     // Note: buffering is disabled
@@ -293,6 +1070,17 @@ public:
         FileIdT FileId
     );
 
+    //
+    // Order later reads of a file behind the earlier writes that overlap them
+    // 
+    //
+    ErrorCodeT
+    FenceFile(
+        FileIdT FileId,
+        FileSizeT Offset,
+        FileIOSizeT Bytes
+    );
+
     //
     // Search a directory for a file or subdirectory
     // with a name that matches a specific name
@@ -316,6 +1104,21 @@ public:
         FileIdT* FileId
     );
 
+    //
+    // Enumerate the files of a directory whose names match a pattern,
+    // in batches of entries with their properties
+    //
+    //
+    ErrorCodeT
+    FindFiles(
+        const char* PathName,
+        const char* Pattern,
+        FileIdT* Cursor,
+        DirEntryT* Entries,
+        size_t MaxEntries,
+        size_t* NumEntries
+    );
+
     //
     // Get file properties by file id
     // 
@@ -392,6 +1195,87 @@ public:
         const char* NewFileName
     );
 
+    //
+    // Apply a batch of updates to the cache table on the DPU
+    //
+    //
+    ErrorCodeT
+    UpdateCacheTable(
+        const CacheUpdateT* Updates,
+        size_t NumUpdates
+    );
+
+    //
+    // Send a batch of control operations to the back end without waiting
+    //
+    //
+    ErrorCodeT
+    SubmitControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps
+    );
+
+    //
+    // Check for the completion of the outstanding batch, or wait for it
+    //
+    //
+    ErrorCodeT
+    PollControlBatch(
+        bool Wait,
+        bool* Completed
+    );
+
+    //
+    // Run any number of control operations in batches
+    //
+    //
+    ErrorCodeT
+    RunControlBatch(
+        ControlOpT* Ops,
+        size_t NumOps
+    );
+
+    //
+    // Create a file without waiting for the back end; the completion is reported by a poll
+    //
+    //
+    ErrorCodeT
+    CreateFileAsync(
+        const char* FileName,
+        FileAccessT DesiredAccess,
+        FileShareModeT ShareMode,
+        FileAttributesT FileAttributes,
+        FileIdT* FileId,
+        PollIdT PollId,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Delete a file without waiting for the back end; the completion is reported by a poll
+    //
+    //
+    ErrorCodeT
+    DeleteFileAsync(
+        const char* FileName,
+        PollIdT PollId,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
+    //
+    // Get the size of a file without waiting for the back end; the completion is reported by a poll
+    //
+    //
+    ErrorCodeT
+    GetFileSizeAsync(
+        FileIdT FileId,
+        FileSizeT* FileSize,
+        PollIdT PollId,
+        ReadWriteCallback Callback,
+        ContextT Context
+    );
+
     //
     // Get the default poll structure for async I/O
     //
@@ -410,6 +1294,16 @@ public:
         PollIdT* PollId
     );
 
+    //
+    // Create a poll structure for async I/O of a priority class
+    //
+    //
+    ErrorCodeT
+    PollCreate(
+        PollIdT* PollId,
+        PollPriority Priority
+    );
+
     //
     // Delete a poll structure
     //
@@ -420,7 +1314,7 @@ public:
     );
 
     //
-    // Add a file to a pool
+    // Add a file to a poll
     //
     //
     ErrorCodeT
@@ -430,6 +1324,82 @@ public:
         ContextT FileContext
     );
 
+    //
+    // Set the waiting policy of a poll
+    //
+    //
+    ErrorCodeT
+    PollSetPolicy(
+        PollIdT PollId,
+        const PollPolicyT* Policy
+    );
+
+    //
+    // Publish the reads and writes staged on a poll
+    // whose policy stages requests, and those the poll has queued for lack of credits
+    //
+    //
+    ErrorCodeT
+    FlushRequests(
+        PollIdT PollId
+    );
+
+    //
+    // Register an application buffer with a poll so that reads into it,
+    // and scattered reads into its pages, are written in place by the back end
+    //
+    //
+    ErrorCodeT
+    RegisterScatterBuffer(
+        PollIdT PollId,
+        BufferT Buffer,
+        size_t Bytes
+    );
+
+    //
+    // Register a GPU buffer with a poll so that reads into it are written in place by the back end
+    //
+    //
+    ErrorCodeT
+    RegisterDeviceBuffer(
+        PollIdT PollId,
+        BufferT Buffer,
+        size_t Bytes
+    );
+
+    //
+    // Unregister an application buffer from a poll
+    //
+    //
+    ErrorCodeT
+    UnregisterScatterBuffer(
+        PollIdT PollId,
+        BufferT Buffer
+    );
+
+    //
+    // Bind the offload response rings of the DPU to a poll
+    //
+    //
+    ErrorCodeT
+    BindOffloadResponses(
+        PollIdT PollId
+    );
+
+    //
+    // Poll a request the DPU has read for
+    //
+    //
+    ErrorCodeT
+    PollWaitOffload(
+        PollIdT PollId,
+        OffloadResponseT* Response,
+        BufferT Buffer,
+        FileIOSizeT BufferBytes,
+        size_t WaitTime,
+        bool* PollResult
+    );
+
     //
     // Poll a completion event
     //
@@ -443,6 +1413,31 @@ public:
         size_t WaitTime,
         bool* PollResult
     );
+
+    //
+    // Poll up to MaxCompletions completion events;
+    // only the first one is waited for, the rest are those already available
+    //
+    //
+    ErrorCodeT
+    PollWaitBatch(
+        PollIdT PollId,
+        PollCompletionT* Completions,
+        size_t MaxCompletions,
+        size_t WaitTime,
+        size_t* NumCompletions
+    );
+
+    //
+    // Read the latency histograms of the I/Os completed on a poll so far;
+    // not implemented unless the front end is built with DDS_IO_STATISTICS_ENABLED
+    //
+    //
+    ErrorCodeT
+    GetIOStatistics(
+        PollIdT PollId,
+        IOStatisticsT* Statistics
+    );
 };
 
 }
\ No newline at end of file
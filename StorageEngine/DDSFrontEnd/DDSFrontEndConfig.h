@@ -5,8 +5,119 @@
 
 #pragma once
 
-#define BACKEND_TYPE_LOCAL_MEMORY 0
-#define BACKEND_TYPE_DPU 1
-#define BACKEND_TYPE BACKEND_TYPE_DPU
+//
+// The back end a front end uses unless another one is given at construction
+//
+//
+#define DDS_DEFAULT_BACKEND_TYPE BACKEND_TYPE_DPU
 
-#define DDS_POLLING_IN_ORDER
\ No newline at end of file
+#define DDS_POLLING_IN_ORDER
+
+//
+// Number of entries by which the directory and file tables grow
+//
+//
+#define DDS_DIR_TABLE_CHUNK_ENTRIES 16
+#define DDS_FILE_TABLE_CHUNK_ENTRIES 64
+
+//
+// Buckets of the hash index from file names to file ids; a power of two
+//
+//
+#define DDS_FILE_NAME_INDEX_BUCKETS 4096
+
+//
+// Default polling policy of a poll
+//
+//
+#define DDS_POLL_DEFAULT_SPIN_MICROSECONDS 20
+#define DDS_POLL_DEFAULT_YIELD_MICROSECONDS 50
+#define DDS_POLL_DEFAULT_ADAPTIVE true
+#define DDS_POLL_DEFAULT_STAGE_REQUESTS false
+#define DDS_POLL_DEFAULT_BACKLOG_REQUESTS true
+
+//
+// Threads that can take response batches from the ring of a poll at the same time;
+// more threads than this still work, but wait for a cursor to free up
+//
+//
+#define DDS_POLL_MAX_CONSUMERS 8
+
+//
+// Front-end file cache: the read-ahead window, the largest read that triggers read-ahead,
+// the number of back-to-back sequential reads before reading ahead, and the write-back buffer
+//
+//
+#define DDS_FILE_CACHE_READ_AHEAD_BYTES 1048576
+#define DDS_FILE_CACHE_MAX_CACHED_READ_BYTES 65536
+#define DDS_FILE_CACHE_SEQUENTIAL_THRESHOLD 2
+#define DDS_FILE_CACHE_WRITE_BACK_BYTES 1048576
+
+//
+// How long the front end trusts the size of a file created with DDS_FILE_ATTRIBUTE_SHARED
+// before GetFileSize reads it from the back end again
+//
+//
+#define DDS_FILE_SIZE_LEASE_MS 10
+
+//
+// How often an application holding leases of files calls RenewFileLeases, well within the term of the leases
+//
+//
+#define DDS_FILE_LEASE_RENEW_MS 1000
+
+//
+// How long a poll waits on its rings at a time while control operations of the async calls made on it are in flight,
+// before it looks for the ack of their batch again
+//
+//
+#define DDS_CONTROL_OPS_POLL_MS 1
+
+//
+// Largest request that adjacent reads of a batch are merged into; 0 disables merging
+//
+//
+#define DDS_READ_COALESCE_MAX_BYTES 262144
+
+//
+// Reads and writes larger than a chunk go to the DPU back end as a stream of chunks, this many in flight,
+// and complete once as a whole; a chunk is DDS_STREAM_IO_CHUNK_BYTES, or less if the chunks in flight
+// would take more than half of the smaller ring of the poll
+//
+//
+#define DDS_STREAM_IO_CHUNK_BYTES 4194304
+#define DDS_STREAM_IO_CHUNKS_IN_FLIGHT 4
+
+//
+// Striping across DPUs: the most DPUs a front end stripes files across, and the bounds of the stripe unit,
+// the bytes of a file that go to one DPU before the next; a stream keeps DDS_STREAM_IO_CHUNKS_IN_FLIGHT chunks
+// in flight per DPU, so that every DPU is busy with a large I/O
+//
+//
+#define DDS_MAX_STRIPES 8
+#define DDS_MIN_STRIPE_UNIT_BYTES 4096
+#define DDS_MAX_STRIPE_UNIT_BYTES DDS_STREAM_IO_CHUNK_BYTES
+
+//
+// Local-memory back end: the threads that serve reads, the address space reserved per file,
+// the granularity at which file memory is committed, and the memory all files may commit
+//
+//
+#define DDS_LOCAL_MEMORY_IO_THREADS 4
+#define DDS_LOCAL_MEMORY_MAX_FILE_BYTES 4294967296ULL
+#define DDS_LOCAL_MEMORY_COMMIT_BYTES 2097152ULL
+#define DDS_LOCAL_MEMORY_CAPACITY_BYTES 17179869184ULL
+
+//
+// Per-poll latency histograms of reads and writes, read with GetIOStatistics;
+// an I/O costs four clock readings and a few uncontended stores, and nothing when this is not defined
+//
+//
+#define DDS_IO_STATISTICS_ENABLED
+#define DDS_IO_STATISTICS_CALIBRATION_MILLISECONDS 10
+
+//
+// Where the front end appends the hops of traced I/Os (DDSTrace.h) when it is destroyed
+//
+//
+#define DDS_TRACE_FRONT_END_PATH "dds_frontend_trace.csv"
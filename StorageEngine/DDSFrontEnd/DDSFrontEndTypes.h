@@ -6,63 +6,644 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string.h>
 
+#include "DDSFile.h"
 #include "DDSFrontEndConfig.h"
+#include "DDSFrontEndInterface.h"
+#include "DDSIOStatistics.h"
+#include "DDSTrace.h"
 #include "DDSTypes.h"
 
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
 #include "DMABuffer.h"
 #include "RingBufferProgressive.h"
-#endif
 
 namespace DDS_FrontEnd {
 
 template <typename T>
 using Atomic = std::atomic<T>;
 
+//
+// Back end of a front end
+// BACKEND_TYPE_LOCAL_MEMORY: files in host memory, a baseline without the DPU
+// BACKEND_TYPE_DPU: files on the DPU, reached through per-poll DMA rings
+//
+//
+enum BackEndTypeT {
+    BACKEND_TYPE_LOCAL_MEMORY,
+    BACKEND_TYPE_DPU
+};
+
+#define DDS_POLL_SLOT_BITMAP_WORD_BITS 64
+static_assert(DDS_MIN_POLL_QUEUE_DEPTH % DDS_POLL_SLOT_BITMAP_WORD_BITS == 0, "I/O slots must fill whole bitmap words");
+
+//
+// A table indexed by ids that grows by chunks of ChunkEntries up to MaxEntries;
+// entries never move once allocated, so the lookup stays O(1)
+// and pointers to entries stay valid as the table grows
+//
+//
+template <typename T, size_t MaxEntries, size_t ChunkEntries>
+class IdTable {
+private:
+    T* Chunks[(MaxEntries + ChunkEntries - 1) / ChunkEntries];
+    size_t NumChunks;
+
+public:
+    IdTable() : NumChunks(0) {
+        for (size_t c = 0; c != sizeof(Chunks) / sizeof(Chunks[0]); c++) {
+            Chunks[c] = nullptr;
+        }
+    }
+
+    ~IdTable() {
+        for (size_t c = 0; c != NumChunks; c++) {
+            delete[] Chunks[c];
+        }
+    }
+
+    //
+    // Number of ids that have entries
+    //
+    //
+    size_t
+    Capacity() const {
+        size_t capacity = NumChunks * ChunkEntries;
+        return capacity < MaxEntries ? capacity : MaxEntries;
+    }
+
+    //
+    // Make sure the entry of an id is allocated
+    //
+    //
+    bool
+    Reserve(
+        size_t Id
+    ) {
+        if (Id >= MaxEntries) {
+            return false;
+        }
+
+        while (Id >= NumChunks * ChunkEntries) {
+            T* chunk = new (std::nothrow) T[ChunkEntries]();
+            if (!chunk) {
+                return false;
+            }
+            Chunks[NumChunks] = chunk;
+            NumChunks++;
+        }
+
+        return true;
+    }
+
+    T&
+    operator[](
+        size_t Id
+    ) {
+        return Chunks[Id / ChunkEntries][Id % ChunkEntries];
+    }
+};
+
+static_assert((DDS_FILE_NAME_INDEX_BUCKETS & (DDS_FILE_NAME_INDEX_BUCKETS - 1)) == 0, "File name index buckets must be a power of two");
+
+//
+// A hash index from the names of files to their ids, chained through a table of the next id in each bucket;
+// nothing is allocated until the first name is added, and a lookup compares only the names of one bucket
+//
+//
+template <size_t MaxEntries, size_t ChunkEntries>
+class FileNameIndex {
+private:
+    FileIdT* Buckets;
+    IdTable<FileIdT, MaxEntries, ChunkEntries> Next;
+
+    //
+    // The bucket of a name, by FNV-1a
+    //
+    //
+    static size_t
+    Bucket(
+        const char* Name
+    ) {
+        uint32_t hash = 2166136261U;
+        for (; *Name; Name++) {
+            hash = (hash ^ (unsigned char)*Name) * 16777619U;
+        }
+
+        return hash & (DDS_FILE_NAME_INDEX_BUCKETS - 1);
+    }
+
+public:
+    FileNameIndex() : Buckets(nullptr) {
+    }
+
+    ~FileNameIndex() {
+        delete[] Buckets;
+    }
+
+    //
+    // Add the name of a file, which must not be in the index yet
+    //
+    //
+    bool
+    Add(
+        const char* Name,
+        FileIdT FileId
+    ) {
+        if (!Buckets) {
+            Buckets = new (std::nothrow) FileIdT[DDS_FILE_NAME_INDEX_BUCKETS];
+            if (!Buckets) {
+                return false;
+            }
+            for (size_t b = 0; b != DDS_FILE_NAME_INDEX_BUCKETS; b++) {
+                Buckets[b] = (FileIdT)DDS_FILE_INVALID;
+            }
+        }
+
+        if (!Next.Reserve(FileId)) {
+            return false;
+        }
+
+        size_t bucket = Bucket(Name);
+        Next[FileId] = Buckets[bucket];
+        Buckets[bucket] = FileId;
+
+        return true;
+    }
+
+    //
+    // Remove a file from the index, under the name it was added with
+    //
+    //
+    void
+    Remove(
+        const char* Name,
+        FileIdT FileId
+    ) {
+        if (!Buckets) {
+            return;
+        }
+
+        FileIdT* link = &Buckets[Bucket(Name)];
+        while (*link != (FileIdT)DDS_FILE_INVALID) {
+            if (*link == FileId) {
+                *link = Next[FileId];
+                return;
+            }
+            link = &Next[*link];
+        }
+    }
+
+    //
+    // The id of the file of a name, or DDS_FILE_INVALID; NameOf gives the current name of an id
+    //
+    //
+    template <typename NameOfT>
+    FileIdT
+    Find(
+        const char* Name,
+        NameOfT NameOf
+    ) {
+        if (!Buckets) {
+            return (FileIdT)DDS_FILE_INVALID;
+        }
+
+        for (FileIdT id = Buckets[Bucket(Name)]; id != (FileIdT)DDS_FILE_INVALID; id = Next[id]) {
+            if (strcmp(Name, NameOf(id)) == 0) {
+                return id;
+            }
+        }
+
+        return (FileIdT)DDS_FILE_INVALID;
+    }
+};
+
+//
+// The rows of stripe units a streamed I/O of an erasure-coded front end (SetErasureCoding) works on:
+// a write issues the parity of its rows, kept in Buffer, after its data; a degraded read, whose DPUs
+// are not all reachable, reads ColumnBytes from ColumnOffset of the units of its rows on Stripes into Buffer,
+// in the order of rows and stripes, and reconstructs the units of the stripes in LostMask from them
+//
+//
+typedef struct ErasureIOT {
+    char* Buffer;
+    uint64_t IssueBytes;
+    FileSizeT FirstRow;
+    size_t Rows;
+    size_t DataStripes;
+    size_t ParityStripes;
+    FileIOSizeT UnitBytes;
+    FileIOSizeT ColumnOffset;
+    FileIOSizeT ColumnBytes;
+    uint8_t Stripes[DDS_MAX_STRIPES];
+    size_t NumStripes;
+    uint32_t LostMask;
+} ErasureIOT;
+
 //
 // File read/write operation
 //
 //
 typedef struct FileIOT {
     bool IsRead = false;
-#if BACKEND_TYPE == BACKEND_TYPE_LOCAL_MEMORY
-    Atomic<bool> IsComplete = true;
-    Atomic<bool> IsReadyForPoll = false;
-#elif BACKEND_TYPE == BACKEND_TYPE_DPU
     RequestIdT RequestId = 0;
-    Atomic<bool> IsAvailable = true;
-#endif
+    bool IsInternal = false;
+
+    //
+    // Whether the back end may compress the data of this read
+    //
+    //
+    bool CompressRead = false;
+
+    //
+    // Whether the back end acknowledges this write only after flushing it to the media
+    //
+    //
+    bool DurableWrite = false;
+
+    //
+    // Whether this read lands in a device buffer, which the back end must write in place
+    //
+    //
+    bool DeviceRead = false;
+
+    //
+    // Whether this read was sent as a direct read, which the back end answers without data
+    // once it has written the registered buffer or pages, unless it falls back to an inline response
+    //
+    //
+    bool DirectRead = false;
+
+    //
+    // Whether this write is an append, which the back end places at the end of the file;
+    // Offset becomes the offset it was given once it completes, and AppendedOffset, if set, takes it too
+    //
+    //
+    bool Append = false;
+    FileSizeT* AppendedOffset = nullptr;
+
+    //
+    // Whether this write is an atomic operation on a word, whose request AtomicRequest is the data sent;
+    // AtomicValue takes the value the word had once it completes, and AtomicPrior, if set, takes it too
+    //
+    //
+    bool AtomicOp = false;
+    BuffMsgF2BAtomicHeader AtomicRequest;
+    uint64_t AtomicValue = 0;
+    uint64_t* AtomicPrior = nullptr;
+
+    //
+    // Adjacent reads merged into the request of the first one: the next read in the chain,
+    // the bytes of the whole request (on the first read), and the share of each read in the response
+    //
+    //
+    struct FileIOT* NextCoalesced = nullptr;
+    FileIOSizeT CoalescedBytes = 0;
+    ErrorCodeT CoalescedResult = DDS_ERROR_CODE_SUCCESS;
+    FileIOSizeT CoalescedBytesServiced = 0;
+
+    //
+    // A read or write streamed in chunks: on a chunk, the whole I/O it is part of; on the whole I/O,
+    // the bytes handed to chunks so far, the chunks in flight (and one for the submitting thread),
+    // the bytes serviced, the first failure, and whether no more chunks are issued
+    //
+    //
+    struct FileIOT* Stream = nullptr;
+    Atomic<uint64_t> StreamIssued{ 0 };
+    Atomic<size_t> StreamChunks{ 0 };
+    Atomic<FileIOSizeT> StreamServiced{ 0 };
+    Atomic<ErrorCodeT> StreamResult{ DDS_ERROR_CODE_SUCCESS };
+    Atomic<bool> StreamEnded{ false };
+
+    //
+    // On a whole I/O of an erasure-coded front end, its rows
+    //
+    //
+    ErasureIOT* Erasure = nullptr;
+
     ContextT FileReference = (ContextT)nullptr;
     FileIdT FileId = (FileIdT)DDS_FILE_INVALID;
     FileSizeT Offset = (FileSizeT)0;
     BufferT AppBuffer = (BufferT)nullptr;
     BufferT* AppBufferArray = (BufferT*)nullptr;
+    ZeroCopyReadT* ZeroCopyResponse = (ZeroCopyReadT*)nullptr;
     FileIOSizeT BytesDesired = (FileIOSizeT)0;
     ReadWriteCallback AppCallback = (ReadWriteCallback)nullptr;
     ContextT Context = (ContextT)nullptr;
+
+#ifdef DDS_IO_STATISTICS_ENABLED
+    //
+    // I/O clock readings at submission, at the hand-off to the back end, and when the response arrived
+    //
+    //
+    uint64_t SubmitTicks = 0;
+    uint64_t RingTicks = 0;
+    uint64_t ResponseTicks = 0;
+#endif
+
+    //
+    // The trace of a traced I/O, 0 for the others, and the tagged request id it went to the back end with
+    //
+    //
+    uint64_t TraceId = 0;
+    RequestIdT TraceKey = 0;
+
+    //
+    // DPU back end: the poll whose ring holds the request of this I/O, from just before the request is published
+    // until its response is taken, and whether it is a plain read, issued again if that back end is lost
+    //
+    //
+    Atomic<struct PollT*> AtBackEnd{ nullptr };
+    bool Replayable = false;
+
+    //
+    // Whether this slot reports a control operation of the async calls (CreateFileAsync and others)
+    // rather than an I/O of a file
+    //
+    //
+    bool IsControl = false;
 } FileIOT;
 
+//
+// A control operation of the async calls, queued until it goes to the back end in a batch:
+// the slot of its poll that reports it, and where a get of size puts the size
+//
+//
+struct AsyncControlOpT {
+    ControlOpT Op;
+    struct PollT* Poll;
+    FileIOT* IO;
+    FileSizeT* FileSize;
+    AsyncControlOpT* Next;
+};
+
+//
+// Read the I/O clock into a reading of an I/O; compiled out without DDS_IO_STATISTICS_ENABLED
+//
+//
+#ifdef DDS_IO_STATISTICS_ENABLED
+#define DDS_IO_STAMP(IO, Ticks) ((IO)->Ticks = ReadIOClock())
+#else
+#define DDS_IO_STAMP(IO, Ticks) ((void)0)
+#endif
+
+//
+// Record a hop of a traced I/O into the trace ring of the calling thread, created on its first hop
+//
+//
+void
+RecordIOTraceOnThread(
+    uint64_t TraceId,
+    uint32_t Hop,
+    uint32_t Arg
+);
+
+inline void
+RecordIOTrace(
+    uint64_t TraceId,
+    uint32_t Hop,
+    uint32_t Arg
+) {
+    if (TraceId) {
+        RecordIOTraceOnThread(TraceId, Hop, Arg);
+    }
+}
+
+//
+// Take the trace id the calling thread set for its next I/O
+//
+//
+uint64_t
+TakeIOTraceId();
+
+//
+// A completion of the local-memory back end, waiting to be reported by a poll
+//
+//
+typedef struct LocalCompletionT {
+    RequestIdT RequestId;
+    ErrorCodeT Result;
+    FileIOSizeT BytesServiced;
+} LocalCompletionT;
+
+//
+// A consumer cursor of the response ring of a poll: the batch a completion thread has fetched
+// and how far it has got through it, down to the packed write acks (MsgTypes.h) of the next response;
+// a thread holds one cursor at a time, so several threads can take batches from the same ring,
+// and a batch left behind is finished by whoever finds it
+//
+//
+typedef struct alignas(DDS_CACHE_LINE_SIZE) ResponseCursorT {
+    Atomic<bool> Busy;
+    Atomic<bool> Pending;
+    SplittableBufferT BatchRef;
+    FileIOSizeT ProcessedBytes;
+    BufferT NextResponse;
+    FileIOSizeT WriteAcksTaken;
+    size_t Batch;
+} ResponseCursorT;
+
+static_assert(DDS_POLL_MAX_CONSUMERS < DDS_MIN_POLL_QUEUE_DEPTH, "Every cursor needs room to open a response batch");
+
+//
+// A read or write queued on a poll for lack of credits, with a copy of the data of a write,
+// as the application may reuse its buffer as soon as the write returns
+//
+//
+typedef struct BacklogEntry {
+    RequestBatchEntryT Request;
+    std::unique_ptr<char[]> Data;
+} BacklogEntryT;
+
 //
 // Poll structure
 //
 //
 typedef struct PollT {
-    FileIOT* OutstandingRequests[DDS_MAX_OUTSTANDING_IO];
-    Atomic<size_t> NextRequestSlot;
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
+    //
+    // The I/O slots of this poll, as many as its queue depth
+    //
+    //
+    size_t QueueDepth;
+    FileIOT** OutstandingRequests;
+    PollPriority Priority;
+
+    //
+    // Lock-free bitmap of free slots in OutstandingRequests (a set bit is a free slot)
+    //
+    //
+    size_t FreeSlotWords;
+    Atomic<uint64_t>* FreeSlots;
+
+    //
+    // Local-memory back end: requests completed by the back-end threads, in completion order,
+    // until this poll reports them
+    //
+    //
+    std::mutex CompletionLock;
+    std::condition_variable CompletionSignal;
+    std::deque<LocalCompletionT> CompletedRequests;
+
+    //
+    // DPU back end: the DMA buffer of this poll and its request/response rings
+    //
+    //
     DMABuffer* MsgBuffer;
     struct RequestRingBufferProgressive* RequestRing;
     struct ResponseRingBufferProgressive* ResponseRing;
+
+    //
+    // DPU back end striped across several DPUs: the poll of every DPU, this one first, and the poll this one
+    // is a stripe of, if any; the stripes share the slots of the first poll, so a request id names the same I/O
+    // in every ring, and they are only ever polled through the first poll, starting at NextStripe
+    //
+    //
+    size_t NumStripes;
+    PollT* Stripes[DDS_MAX_STRIPES];
+    PollT* StripeOf;
+    Atomic<size_t> NextStripe;
+
+    //
+    // DPU back end: the device buffers registered with this poll (RegisterDeviceBuffer),
+    // so that the paths the host would copy through only look for them when there are any
+    //
+    //
+    size_t NumDeviceBuffers;
+
+    //
+    // DPU back end: the handovers of its DPU (DDS_RING_HANDOVER_OFFSET) and the reconnects after its DPU was lost
+    // the buffer of this poll has followed
+    //
+    //
+    size_t Handovers;
+
+    //
+    // DPU back end: whether the connection to the DPU is lost and not recovered yet, while requests are queued
+    // in the backlog rather than published, and the threads that are publishing requests, which recovery waits for
+    //
+    //
+    Atomic<bool> BackEndLost;
+    Atomic<size_t> Publishers;
+
+    //
+    // DPU back end: the reads and writes staged for the request ring when the policy stages requests,
+    // shared by every thread that submits to this poll, and the threads getting responses from the ring,
+    // for whom what is staged is published at once
+    //
+    //
+    RequestStagingT RequestStaging;
+    Atomic<size_t> ResponseWaiters;
+
+    //
+    // DPU back end: reads and writes that found no credits left in the request ring,
+    // in submission order, until the back end gives credits back
+    //
+    //
+    std::mutex BacklogLock;
+    std::deque<BacklogEntryT> Backlog;
+    Atomic<size_t> BacklogSize;
+
+    //
+    // DPU back end: the offload response rings bound to this poll, if any, and the ring to look at next;
+    // rare enough for a lock
+    //
+    //
+    std::mutex OffloadLock;
+    char* OffloadRings;
+    size_t NextOffloadRing;
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    //
+    // The cursors of the threads taking response batches from this poll's ring
+    //
+    //
+    ResponseCursorT ResponseCursors[DDS_POLL_MAX_CONSUMERS];
 #endif
 
-    PollT();
+    //
+    // Response batches that have not been given back to the ring yet, at most as many as the queue depth;
+    // a batch is pinned while it is being processed and by every zero-copy read into it,
+    // and the ring progress only advances past a batch, in order, once it has no pins;
+    // the bytes of a batch are set last when it is opened and cleared when it is given back;
+    // a batch is taken from the ring and opened under the lock, so that the queue is in ring order
+    //
+    //
+    std::mutex ResponseBatchLock;
+    Atomic<int>* ResponseBatchPins;
+    Atomic<FileIOSizeT>* ResponseBatchBytes;
+    Atomic<size_t> ResponseBatchHead;
+    Atomic<size_t> ResponseBatchTail;
+    Atomic<bool> ResponseBatchDraining;
 
-#if BACKEND_TYPE == BACKEND_TYPE_DPU
+    //
+    // Polling policy and the state that adapts it
+    //
+    //
+    PollPolicyT Policy;
+    size_t SpinWindowNs;
+    size_t AvgInterCompletionNs;
+    std::chrono::steady_clock::time_point LastCompletionTime;
+
+    //
+    // Merged reads whose data has arrived and streamed I/Os whose chunks are done, not reported yet,
+    // shared by the threads polling this poll; rare enough for a lock
+    //
+    //
+    std::mutex CoalescedLock;
+    Atomic<FileIOT*> CoalescedCompletions;
+
+    //
+    // Control operations of the async calls made on this poll that have not been reported yet
+    //
+    //
+    Atomic<size_t> ControlOpsPending;
+
+#ifdef DDS_IO_STATISTICS_ENABLED
+    //
+    // Latency histograms of the I/Os reported by this poll
+    //
+    //
+    PollIOStatistics IOStatistics;
+#endif
+
+    PollT(size_t QueueDepth, PollT* StripeOf = nullptr);
+    ~PollT();
+
+    FileIOT* AcquireSlot();
+    void ReleaseSlot(FileIOT* IO);
+    void SetPolicy(const PollPolicyT* NewPolicy);
+    void RecordCompletion();
+    void PushCoalescedCompletions(FileIOT* IOs);
+    FileIOT* PopCoalescedCompletion();
+    bool CanOpenResponseBatch();
+    size_t OpenResponseBatch(FileIOSizeT Bytes);
+    void PinResponseBatch(size_t Batch);
+    void ReleaseResponseBatch(size_t Batch);
+#ifdef RING_BUFFER_RESPONSE_BATCH_ENABLED
+    ResponseCursorT* AcquireResponseCursor();
+    ResponseCursorT* AcquirePendingResponseCursor();
+    void ReleaseResponseCursor(ResponseCursorT* Cursor);
+#endif
     ErrorCodeT SetUpDMABuffer(void* BackEndDPU);
     void DestroyDMABuffer();
     void InitializeRings();
-#endif
 } PollT;
 
-}
\ No newline at end of file
+//
+// An opened file: the file, its id, and the poll its I/Os go to,
+// kept up to date as the file is added to polls
+//
+//
+struct FileHandle {
+    DDSFile* File = nullptr;
+    FileIdT FileId = (FileIdT)DDS_FILE_INVALID;
+    PollIdT PollId = DDS_POLL_DEFAULT;
+    PollT* Poll = nullptr;
+};
+
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "DDSFrontEndConfig.h"
+#include "DDSFrontEndInterface.h"
+
+namespace DDS_FrontEnd {
+
+//
+// Read the clock that times I/Os: the time stamp counter where there is one,
+// which costs a few ns, and the steady clock otherwise
+//
+//
+inline uint64_t
+ReadIOClock() {
+#if defined(_M_X64) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+//
+// Nanoseconds per tick of the I/O clock, measured once against the steady clock
+//
+//
+inline double
+IOClockNsPerTick() {
+    static const double nsPerTick = []() {
+        auto beginTime = std::chrono::steady_clock::now();
+        uint64_t beginTicks = ReadIOClock();
+        auto endTime = beginTime;
+
+        while (endTime - beginTime < std::chrono::milliseconds(DDS_IO_STATISTICS_CALIBRATION_MILLISECONDS)) {
+            endTime = std::chrono::steady_clock::now();
+        }
+
+        uint64_t ticks = ReadIOClock() - beginTicks;
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - beginTime).count();
+        return ticks ? ns / (double)ticks : 1.0;
+    }();
+
+    return nsPerTick;
+}
+
+//
+// Index of the highest set bit of a non-zero word
+//
+//
+inline size_t
+HighestSetBit(
+    uint64_t Word
+) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, Word);
+    return (size_t)index;
+#else
+    return (size_t)(63 - __builtin_clzll(Word));
+#endif
+}
+
+//
+// The bucket of a latency histogram that counts a latency
+//
+//
+inline size_t
+LatencyBucket(
+    uint64_t Ns
+) {
+    if (Ns < DDS_LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return (size_t)Ns;
+    }
+
+    size_t shift = HighestSetBit(Ns) - DDS_LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    return (shift + 1) * DDS_LATENCY_HISTOGRAM_SUB_BUCKETS + (size_t)((Ns >> shift) & (DDS_LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+//
+// A lock-free latency histogram: the threads polling a poll update each counter atomically,
+// and a reader sees every counter as some value it had, though not all counters at the same instant
+//
+//
+class LatencyHistogram {
+private:
+    std::atomic<uint64_t> Count;
+    std::atomic<uint64_t> TotalNs;
+    std::atomic<uint64_t> MaxNs;
+    std::atomic<uint64_t> Buckets[DDS_LATENCY_HISTOGRAM_BUCKETS];
+
+    static inline void
+    Add(
+        std::atomic<uint64_t>& Counter,
+        uint64_t Value
+    ) {
+        Counter.fetch_add(Value, std::memory_order_relaxed);
+    }
+
+public:
+    LatencyHistogram() : Count(0), TotalNs(0), MaxNs(0) {
+        for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+            Buckets[b] = 0;
+        }
+    }
+
+    inline void
+    Record(
+        uint64_t Ns
+    ) {
+        Add(Buckets[LatencyBucket(Ns)], 1);
+        Add(Count, 1);
+        Add(TotalNs, Ns);
+        uint64_t maxNs = MaxNs.load(std::memory_order_relaxed);
+        while (Ns > maxNs && !MaxNs.compare_exchange_weak(maxNs, Ns, std::memory_order_relaxed)) { }
+    }
+
+    void
+    Read(
+        IOLatencyHistogramT* Histogram
+    ) const {
+        Histogram->Count = Count.load(std::memory_order_relaxed);
+        Histogram->TotalNs = TotalNs.load(std::memory_order_relaxed);
+        Histogram->MaxNs = MaxNs.load(std::memory_order_relaxed);
+        for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+            Histogram->Buckets[b] = Buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+//
+// Latency histograms of the I/Os completed on a poll,
+// written by the threads polling the poll
+//
+//
+class PollIOStatistics {
+private:
+    double NsPerTick;
+    LatencyHistogram SubmitToRing;
+    LatencyHistogram RingToResponse;
+    LatencyHistogram ResponseToCallback;
+    LatencyHistogram SubmitToCallback;
+
+    //
+    // Ticks between two readings of the I/O clock, in ns;
+    // readings taken on different cores may be slightly out of order
+    //
+    //
+    inline uint64_t
+    Elapsed(
+        uint64_t BeginTicks,
+        uint64_t EndTicks
+    ) const {
+        return EndTicks > BeginTicks ? (uint64_t)((double)(EndTicks - BeginTicks) * NsPerTick) : 0;
+    }
+
+public:
+    PollIOStatistics() : NsPerTick(IOClockNsPerTick()) { }
+
+    //
+    // Record an I/O from the clock readings taken along its way
+    //
+    //
+    inline void
+    Record(
+        uint64_t SubmitTicks,
+        uint64_t RingTicks,
+        uint64_t ResponseTicks,
+        uint64_t CallbackTicks
+    ) {
+        SubmitToRing.Record(Elapsed(SubmitTicks, RingTicks));
+        RingToResponse.Record(Elapsed(RingTicks, ResponseTicks));
+        ResponseToCallback.Record(Elapsed(ResponseTicks, CallbackTicks));
+        SubmitToCallback.Record(Elapsed(SubmitTicks, CallbackTicks));
+    }
+
+    void
+    Read(
+        IOStatisticsT* Statistics
+    ) const {
+        SubmitToRing.Read(&Statistics->SubmitToRing);
+        RingToResponse.Read(&Statistics->RingToResponse);
+        ResponseToCallback.Read(&Statistics->ResponseToCallback);
+        SubmitToCallback.Read(&Statistics->SubmitToCallback);
+    }
+};
+
+}
@@ -0,0 +1,955 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// The DMA pattern benchmark, DPU half: it takes the place of the back end for one host buffer, negotiated
+// as the back end does, and moves the rings of the buffer with the DMA that FileBackEnd.c issues for them,
+// without executing any request, so that the time of a batch is what the NIC and PCIe take for the DMA of the agent;
+// compared with the polls of the agent, it shows how close the agent comes to that bound and which round trips
+// a batch waits for. DMAPatternBenchmarkHost connects to it as the front end does and leaves the buffer to it.
+//
+// A batch is BatchRequests requests of RequestBytes and as many responses of ResponseBytes, moved in one of three modes:
+//
+// agent: a poll of the agent, each step waiting for the one before as the agent does: a read of the request meta data
+// (the progress and the tail), a read of the request data from the head, split at the end of the ring, with the write
+// of the new head behind it, a read of the response meta data (the head), and a write of the response data from the tail,
+// split at the end of the ring, with the write of the new tail behind it, which carries an immediate under
+// DDS_NOTIFICATION_METHOD_INTERRUPT
+//
+// pipelined: as agent, with the read of the request meta data of the next batch posted behind the request data,
+// as the agent does with BACKEND_REQUEST_PIPELINE
+//
+// raw: the request data reads and the response data writes alone, the bound for the same bytes without meta data
+//
+// Request DMA goes through the queue pair of the request lane and response DMA through that of the response lane,
+// as in FileBackEnd.h; each run reports batches/s, requests/s, the bandwidth each way, and the mean, median and
+// 99th percentile of every step and of the batch. Without -b or -r, batches of DMA_PATTERN_BATCH_REQUESTS requests
+// of DMA_PATTERN_MESSAGE_BYTES bytes are swept; responses are as large as requests without -w
+//
+// Usage: DMAPatternBenchmark [-a ListenAddress] [-p Port] [-m agent|pipelined|raw] [-b BatchRequests]
+//                            [-r RequestBytes] [-w ResponseBytes] [-n Batches] [-q QueuePairs]
+//
+//
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <infiniband/verbs.h>
+#include <rdma/rdma_cma.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MsgTypes.h"
+#include "Protocol.h"
+#include "RingBufferPolling.h"
+
+#define DMA_PATTERN_DEFAULT_BATCHES 100000
+#define DMA_PATTERN_WARMUP_BATCHES 1000
+#define DMA_PATTERN_LISTEN_BACKLOG 8
+#define DMA_PATTERN_SENDQ_DEPTH 16
+#define DMA_PATTERN_RECVQ_DEPTH 4
+#define DMA_PATTERN_COMPQ_DEPTH (BUFF_CONN_MAX_QUEUE_PAIRS * (DMA_PATTERN_SENDQ_DEPTH + DMA_PATTERN_RECVQ_DEPTH) + \
+    DMA_PATTERN_SENDQ_DEPTH)
+
+//
+// Queue pairs of the host buffer, DMA_BUFFER_QUEUE_PAIRS of DMABuffer.h, and the lanes of requests and responses,
+// BUFF_REQUEST_LANE and BUFF_RESPONSE_LANE of FileBackEnd.h
+//
+//
+#define DMA_PATTERN_QUEUE_PAIRS 2
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+#define DMA_PATTERN_REQUEST_LANE 1
+#define DMA_PATTERN_RESPONSE_LANE 0
+#else
+#define DMA_PATTERN_REQUEST_LANE 0
+#define DMA_PATTERN_RESPONSE_LANE 1
+#endif
+
+#define DMA_PATTERN_CTRL_RECV_WR_ID 1
+#define DMA_PATTERN_BUFF_RECV_WR_ID 2
+#define DMA_PATTERN_MSG_SEND_WR_ID 3
+#define DMA_PATTERN_DMA_WR_ID 4
+
+#define DMA_PATTERN_MODE_AGENT 0
+#define DMA_PATTERN_MODE_PIPELINED 1
+#define DMA_PATTERN_MODE_RAW 2
+#define DMA_PATTERN_MODES 3
+
+static const char* const DMA_PATTERN_MODE_NAMES[DMA_PATTERN_MODES] = {
+    "agent",
+    "pipelined",
+    "raw",
+};
+
+#define DMA_PATTERN_STEP_REQUEST_META 0
+#define DMA_PATTERN_STEP_REQUEST_DATA 1
+#define DMA_PATTERN_STEP_RESPONSE_META 2
+#define DMA_PATTERN_STEP_RESPONSE_DATA 3
+#define DMA_PATTERN_STEP_BATCH 4
+#define DMA_PATTERN_STEPS 5
+
+static const char* const DMA_PATTERN_STEP_NAMES[DMA_PATTERN_STEPS] = {
+    "request meta",
+    "request data",
+    "response meta",
+    "response data",
+    "batch",
+};
+
+static const int DMA_PATTERN_BATCH_REQUESTS[] = { 1, 4, 16, 64 };
+static const int DMA_PATTERN_MESSAGE_BYTES[] = { 64, 512, 4096, 32768 };
+
+//
+// Messages of the connections and the meta data of the rings, in one region
+//
+//
+typedef struct {
+    char CtrlRecv[CTRL_MSG_SIZE];
+    char CtrlSend[CTRL_MSG_SIZE];
+    char BuffRecv[BUFF_MSG_SIZE];
+    char BuffSend[BUFF_MSG_SIZE];
+    char RequestMeta[RING_BUFFER_REQUEST_META_DATA_SIZE];
+    char ResponseMeta[RING_BUFFER_RESPONSE_META_DATA_SIZE];
+    int Head;
+    int Tail;
+} DMAPatternMessagesT;
+
+typedef struct {
+    struct rdma_event_channel* CmChannel;
+    struct rdma_cm_id* ListenId;
+    struct ibv_context* Verbs;
+    struct ibv_pd* PDomain;
+    struct ibv_cq* CompQ;
+
+    //
+    // The control connection and the queue pairs of the buffer, of which the lane 0 is the buffer connection
+    //
+    //
+    struct rdma_cm_id* CtrlId;
+    struct rdma_cm_id* LaneIds[BUFF_CONN_MAX_QUEUE_PAIRS];
+    int EstablishedLanes;
+    int QueuePairs;
+
+    DMAPatternMessagesT* Msgs;
+    struct ibv_mr* MsgsMr;
+    char* RequestData;
+    struct ibv_mr* RequestDataMr;
+    char* ResponseData;
+    struct ibv_mr* ResponseDataMr;
+
+    struct RequestRingBufferBackEnd RequestRing;
+    struct ResponseRingBufferBackEnd ResponseRing;
+    bool BufferBound;
+    bool Released;
+} DMAPatternBenchT;
+
+static inline uint64_t
+NowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+//
+// Post a receive of a message into Buffer
+//
+//
+static int
+PostMsgRecv(
+    DMAPatternBenchT* Bench,
+    struct rdma_cm_id* CmId,
+    char* Buffer,
+    uint32_t Bytes,
+    uint64_t WrId
+) {
+    struct ibv_sge sgl;
+    struct ibv_recv_wr wr;
+    struct ibv_recv_wr* badWr = NULL;
+
+    sgl.addr = (uint64_t)Buffer;
+    sgl.length = Bytes;
+    sgl.lkey = Bench->MsgsMr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = WrId;
+    wr.sg_list = &sgl;
+    wr.num_sge = 1;
+
+    return ibv_post_recv(CmId->qp, &wr, &badWr);
+}
+
+//
+// Send the Bytes of a message in Buffer
+//
+//
+static int
+PostMsgSend(
+    DMAPatternBenchT* Bench,
+    struct rdma_cm_id* CmId,
+    char* Buffer,
+    uint32_t Bytes
+) {
+    struct ibv_sge sgl;
+    struct ibv_send_wr wr;
+    struct ibv_send_wr* badWr = NULL;
+
+    sgl.addr = (uint64_t)Buffer;
+    sgl.length = Bytes;
+    sgl.lkey = Bench->MsgsMr->lkey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = DMA_PATTERN_MSG_SEND_WR_ID;
+    wr.opcode = IBV_WR_SEND;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.sg_list = &sgl;
+    wr.num_sge = 1;
+
+    return ibv_post_send(CmId->qp, &wr, &badWr);
+}
+
+//
+// Post a signaled DMA of Bytes between LocalAddr and RemoteAddr of the host buffer
+//
+//
+static int
+PostDMA(
+    DMAPatternBenchT* Bench,
+    struct ibv_qp* QPair,
+    enum ibv_wr_opcode Opcode,
+    uint64_t LocalAddr,
+    uint32_t LocalKey,
+    uint64_t RemoteAddr,
+    uint32_t Bytes,
+    uint32_t Imm
+) {
+    struct ibv_sge sgl;
+    struct ibv_send_wr wr;
+    struct ibv_send_wr* badWr = NULL;
+
+    sgl.addr = LocalAddr;
+    sgl.length = Bytes;
+    sgl.lkey = LocalKey;
+    memset(&wr, 0, sizeof(wr));
+    wr.wr_id = DMA_PATTERN_DMA_WR_ID;
+    wr.opcode = Opcode;
+    wr.send_flags = IBV_SEND_SIGNALED;
+    wr.sg_list = &sgl;
+    wr.num_sge = 1;
+    wr.imm_data = Imm;
+    wr.wr.rdma.remote_addr = RemoteAddr;
+    wr.wr.rdma.rkey = Bench->RequestRing.AccessToken;
+
+    return ibv_post_send(QPair, &wr, &badWr);
+}
+
+//
+// Post the DMA of Bytes of ring data from Offset, split at the end of the ring as the agent does,
+// with the local buffer a mirror of the ring; return the work requests posted, or -1
+//
+//
+static int
+PostRingDMA(
+    DMAPatternBenchT* Bench,
+    struct ibv_qp* QPair,
+    enum ibv_wr_opcode Opcode,
+    char* LocalData,
+    uint32_t LocalKey,
+    uint64_t RemoteData,
+    uint32_t Capacity,
+    uint32_t Offset,
+    uint32_t Bytes
+) {
+    uint32_t firstBytes = Bytes;
+    int posted = 0;
+
+    if (Offset + Bytes > Capacity) {
+        firstBytes = Capacity - Offset;
+        if (PostDMA(Bench, QPair, Opcode, (uint64_t)LocalData, LocalKey, RemoteData, Bytes - firstBytes, 0)) {
+            return -1;
+        }
+        posted++;
+    }
+
+    if (PostDMA(Bench, QPair, Opcode, (uint64_t)(LocalData + Offset), LocalKey, RemoteData + Offset, firstBytes, 0)) {
+        return -1;
+    }
+
+    return posted + 1;
+}
+
+//
+// Answer a message of the host, received into the control or the buffer message buffer
+//
+//
+static int
+HandleMessage(
+    DMAPatternBenchT* Bench,
+    uint64_t WrId
+) {
+    bool ctrl = WrId == DMA_PATTERN_CTRL_RECV_WR_ID;
+    struct rdma_cm_id* cmId = ctrl ? Bench->CtrlId : Bench->LaneIds[0];
+    MsgHeader* msgIn = (MsgHeader*)(ctrl ? Bench->Msgs->CtrlRecv : Bench->Msgs->BuffRecv);
+    MsgHeader* msgOut = (MsgHeader*)(ctrl ? Bench->Msgs->CtrlSend : Bench->Msgs->BuffSend);
+
+    switch (msgIn->MsgId) {
+        case CTRL_MSG_F2B_REQUEST_ID: {
+            CtrlMsgF2BRequestId* req = (CtrlMsgF2BRequestId*)(msgIn + 1);
+            CtrlMsgB2FRespondId* resp = (CtrlMsgB2FRespondId*)(msgOut + 1);
+
+            //
+            // Grant the rings and the queue depth as the back end does
+            //
+            //
+            msgOut->MsgId = CTRL_MSG_B2F_RESPOND_ID;
+            resp->ClientId = 0;
+            resp->RequestRingBytes = DDS_RING_BYTES_VALID(req->RequestRingBytes, BACKEND_REQUEST_BUFFER_SIZE,
+                DDS_REQUEST_RING_BYTES_ALIGNMENT) ? req->RequestRingBytes : BACKEND_REQUEST_BUFFER_SIZE;
+            resp->ResponseRingBytes = DDS_RING_BYTES_VALID(req->ResponseRingBytes, BACKEND_RESPONSE_BUFFER_SIZE,
+                DDS_RESPONSE_RING_BYTES_ALIGNMENT) ? req->ResponseRingBytes : BACKEND_RESPONSE_BUFFER_SIZE;
+            resp->RingProtocol = DDS_RING_PROTOCOL_IMPLEMENTED(req->RingProtocol) ? req->RingProtocol : DDS_RING_PROTOCOL_DEFAULT;
+            resp->PollQueueDepth = DDS_POLL_QUEUE_DEPTH_VALID(req->PollQueueDepth) &&
+                req->PollQueueDepth <= DDS_BACKEND_MAX_POLL_QUEUE_DEPTH ? req->PollQueueDepth : DDS_BACKEND_MAX_POLL_QUEUE_DEPTH;
+
+            if (PostMsgRecv(Bench, cmId, Bench->Msgs->CtrlRecv, CTRL_MSG_SIZE, DMA_PATTERN_CTRL_RECV_WR_ID) ||
+                PostMsgSend(Bench, cmId, (char*)msgOut, sizeof(MsgHeader) + sizeof(CtrlMsgB2FRespondId))) {
+                fprintf(stderr, "%s [error]: failed to answer the client id request\n", __func__);
+                return -1;
+            }
+            fprintf(stdout, "Client connected\n");
+        }
+            break;
+        case CTRL_MSG_F2B_TERMINATE:
+        case BUFF_MSG_F2B_RELEASE: {
+            fprintf(stdout, "The host released the buffer\n");
+            Bench->Released = true;
+        }
+            break;
+        case BUFF_MSG_F2B_REQUEST_ID: {
+            BuffMsgF2BRequestId* req = (BuffMsgF2BRequestId*)(msgIn + 1);
+            BuffMsgB2FRespondId* resp = (BuffMsgB2FRespondId*)(msgOut + 1);
+
+            msgOut->MsgId = BUFF_MSG_B2F_RESPOND_ID;
+            resp->BufferId = 0;
+            if (Bench->BufferBound ||
+                !DDS_RING_BYTES_VALID(req->RequestRingBytes, BACKEND_REQUEST_BUFFER_SIZE, DDS_REQUEST_RING_BYTES_ALIGNMENT) ||
+                !DDS_RING_BYTES_VALID(req->ResponseRingBytes, BACKEND_RESPONSE_BUFFER_SIZE, DDS_RESPONSE_RING_BYTES_ALIGNMENT) ||
+                InitializeRingBufferBackEnd(
+                    &Bench->RequestRing,
+                    &Bench->ResponseRing,
+                    req->BufferAddress,
+                    req->AccessToken,
+                    req->Capacity,
+                    req->RequestRingBytes,
+                    req->ResponseRingBytes
+                )) {
+                fprintf(stderr, "%s [error]: invalid buffer (%u/%u bytes of rings)\n", __func__,
+                    req->RequestRingBytes, req->ResponseRingBytes);
+                resp->BufferId = -1;
+            }
+
+            if (PostMsgRecv(Bench, cmId, Bench->Msgs->BuffRecv, BUFF_MSG_SIZE, DMA_PATTERN_BUFF_RECV_WR_ID) ||
+                PostMsgSend(Bench, cmId, (char*)msgOut, sizeof(MsgHeader) + sizeof(BuffMsgB2FRespondId))) {
+                fprintf(stderr, "%s [error]: failed to answer the buffer request\n", __func__);
+                return -1;
+            }
+
+            if (resp->BufferId == 0) {
+                Bench->BufferBound = true;
+                fprintf(stdout, "Buffer bound: %u bytes at %p, request ring of %u bytes, response ring of %u bytes\n",
+                    req->Capacity, (void*)req->BufferAddress, Bench->RequestRing.Capacity, Bench->ResponseRing.Capacity);
+            }
+        }
+            break;
+        default:
+            fprintf(stderr, "%s [error]: unexpected message %d\n", __func__, (int)msgIn->MsgId);
+            return -1;
+    }
+
+    return 0;
+}
+
+//
+// Poll the completion queue until Expected DMA completions, answering the messages that come meanwhile;
+// return -1 on a failed work request or once the host has released the buffer
+//
+//
+static int
+WaitForDMA(
+    DMAPatternBenchT* Bench,
+    int Expected
+) {
+    struct ibv_wc wc[DMA_PATTERN_SENDQ_DEPTH];
+
+    while (Expected > 0) {
+        int n = ibv_poll_cq(Bench->CompQ, DMA_PATTERN_SENDQ_DEPTH, wc);
+        if (n < 0) {
+            fprintf(stderr, "%s [error]: ibv_poll_cq failed\n", __func__);
+            return -1;
+        }
+
+        for (int i = 0; i != n; i++) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                fprintf(stderr, "%s [error]: work request %lu failed: %s\n", __func__,
+                    (unsigned long)wc[i].wr_id, ibv_wc_status_str(wc[i].status));
+                return -1;
+            }
+
+            if (wc[i].wr_id == DMA_PATTERN_DMA_WR_ID) {
+                Expected--;
+            }
+            else if (wc[i].opcode & IBV_WC_RECV) {
+                if (HandleMessage(Bench, wc[i].wr_id)) {
+                    return -1;
+                }
+            }
+        }
+
+        if (Bench->Released) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Create the queue pair of a connection, with the protection domain and the completion queue of the first one
+//
+//
+static int
+SetUpQPair(
+    DMAPatternBenchT* Bench,
+    struct rdma_cm_id* CmId
+) {
+    struct ibv_qp_init_attr initAttr;
+
+    if (!Bench->PDomain) {
+        Bench->Verbs = CmId->verbs;
+        Bench->PDomain = ibv_alloc_pd(CmId->verbs);
+        if (!Bench->PDomain) {
+            fprintf(stderr, "%s [error]: ibv_alloc_pd failed\n", __func__);
+            return -1;
+        }
+
+        Bench->CompQ = ibv_create_cq(CmId->verbs, DMA_PATTERN_COMPQ_DEPTH, NULL, NULL, 0);
+        if (!Bench->CompQ) {
+            fprintf(stderr, "%s [error]: ibv_create_cq failed\n", __func__);
+            return -1;
+        }
+
+        //
+        // Rings are mirrored into buffers as large as the largest rings, as the agent does
+        //
+        //
+        Bench->Msgs = (DMAPatternMessagesT*)calloc(1, sizeof(DMAPatternMessagesT));
+        Bench->RequestData = (char*)malloc(BACKEND_REQUEST_BUFFER_SIZE);
+        Bench->ResponseData = (char*)calloc(1, BACKEND_RESPONSE_BUFFER_SIZE);
+        if (!Bench->Msgs || !Bench->RequestData || !Bench->ResponseData) {
+            fprintf(stderr, "%s [error]: OOM for the DMA buffers\n", __func__);
+            return -1;
+        }
+
+        int access = IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ;
+        Bench->MsgsMr = ibv_reg_mr(Bench->PDomain, Bench->Msgs, sizeof(DMAPatternMessagesT), access);
+        Bench->RequestDataMr = ibv_reg_mr(Bench->PDomain, Bench->RequestData, BACKEND_REQUEST_BUFFER_SIZE, access);
+        Bench->ResponseDataMr = ibv_reg_mr(Bench->PDomain, Bench->ResponseData, BACKEND_RESPONSE_BUFFER_SIZE, access);
+        if (!Bench->MsgsMr || !Bench->RequestDataMr || !Bench->ResponseDataMr) {
+            fprintf(stderr, "%s [error]: ibv_reg_mr failed\n", __func__);
+            return -1;
+        }
+    }
+    else if (CmId->verbs != Bench->Verbs) {
+        fprintf(stderr, "%s [error]: connections must come through one device\n", __func__);
+        return -1;
+    }
+
+    memset(&initAttr, 0, sizeof(initAttr));
+    initAttr.cap.max_send_wr = DMA_PATTERN_SENDQ_DEPTH;
+    initAttr.cap.max_recv_wr = DMA_PATTERN_RECVQ_DEPTH;
+    initAttr.cap.max_recv_sge = 1;
+    initAttr.cap.max_send_sge = 1;
+    initAttr.qp_type = IBV_QPT_RC;
+    initAttr.send_cq = Bench->CompQ;
+    initAttr.recv_cq = Bench->CompQ;
+
+    if (rdma_create_qp(CmId, Bench->PDomain, &initAttr)) {
+        fprintf(stderr, "%s [error]: rdma_create_qp failed\n", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// Accept a connection of the host, with a receive posted first for the messages of the control or the buffer
+// connection, as RecvWrId says, or none for a lane
+//
+//
+static int
+AcceptConnection(
+    DMAPatternBenchT* Bench,
+    struct rdma_cm_id* CmId,
+    uint64_t RecvWrId
+) {
+    struct rdma_conn_param connParam;
+    int ret = 0;
+
+    if (SetUpQPair(Bench, CmId)) {
+        return -1;
+    }
+
+    if (RecvWrId == DMA_PATTERN_CTRL_RECV_WR_ID) {
+        ret = PostMsgRecv(Bench, CmId, Bench->Msgs->CtrlRecv, CTRL_MSG_SIZE, RecvWrId);
+    }
+    else if (RecvWrId == DMA_PATTERN_BUFF_RECV_WR_ID) {
+        ret = PostMsgRecv(Bench, CmId, Bench->Msgs->BuffRecv, BUFF_MSG_SIZE, RecvWrId);
+    }
+    if (ret) {
+        fprintf(stderr, "%s [error]: ibv_post_recv failed\n", __func__);
+        return -1;
+    }
+
+    memset(&connParam, 0, sizeof(connParam));
+    connParam.responder_resources = DMA_PATTERN_SENDQ_DEPTH;
+    connParam.initiator_depth = DMA_PATTERN_SENDQ_DEPTH;
+    connParam.rnr_retry_count = 7;
+    if (rdma_accept(CmId, &connParam)) {
+        fprintf(stderr, "%s [error]: rdma_accept failed %d\n", __func__, errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+//
+// Process the connection events that are pending
+//
+//
+static int
+ProcessCmEvents(
+    DMAPatternBenchT* Bench
+) {
+    struct rdma_cm_event* event;
+
+    while (rdma_get_cm_event(Bench->CmChannel, &event) == 0) {
+        struct rdma_cm_id* cmId = event->id;
+        int ret = 0;
+
+        switch (event->event) {
+            case RDMA_CM_EVENT_CONNECT_REQUEST: {
+                uint8_t privData = event->param.conn.private_data_len ? *(uint8_t*)event->param.conn.private_data : 0;
+                BuffLaneConnPrivData lanePrivData;
+
+                memset(&lanePrivData, 0, sizeof(lanePrivData));
+                if (event->param.conn.private_data_len >= sizeof(lanePrivData)) {
+                    memcpy(&lanePrivData, event->param.conn.private_data, sizeof(lanePrivData));
+                }
+                rdma_ack_cm_event(event);
+
+                if (privData == CTRL_CONN_PRIV_DATA && !Bench->CtrlId) {
+                    Bench->CtrlId = cmId;
+                    ret = AcceptConnection(Bench, cmId, DMA_PATTERN_CTRL_RECV_WR_ID);
+                }
+                else if (privData == BUFF_CONN_PRIV_DATA && !Bench->LaneIds[0]) {
+                    Bench->LaneIds[0] = cmId;
+                    ret = AcceptConnection(Bench, cmId, DMA_PATTERN_BUFF_RECV_WR_ID);
+                }
+                else if (privData == BUFF_LANE_CONN_PRIV_DATA && lanePrivData.Lane > 0 &&
+                    lanePrivData.Lane < BUFF_CONN_MAX_QUEUE_PAIRS && lanePrivData.BufferId == 0 &&
+                    !Bench->LaneIds[lanePrivData.Lane]) {
+                    Bench->LaneIds[lanePrivData.Lane] = cmId;
+                    ret = AcceptConnection(Bench, cmId, 0);
+                }
+                else {
+                    fprintf(stderr, "%s [error]: unexpected connection (%u)\n", __func__, privData);
+                    rdma_reject(cmId, NULL, 0);
+                }
+            }
+                break;
+            case RDMA_CM_EVENT_ESTABLISHED: {
+                if (cmId != Bench->CtrlId) {
+                    Bench->EstablishedLanes++;
+                }
+                rdma_ack_cm_event(event);
+            }
+                break;
+            case RDMA_CM_EVENT_DISCONNECTED: {
+                fprintf(stdout, "The host disconnected\n");
+                Bench->Released = true;
+                rdma_ack_cm_event(event);
+            }
+                break;
+            default:
+                rdma_ack_cm_event(event);
+                break;
+        }
+
+        if (ret) {
+            return -1;
+        }
+    }
+
+    return errno == EAGAIN ? 0 : -1;
+}
+
+static int
+CompareSamples(
+    const void* A,
+    const void* B
+) {
+    uint32_t a = *(const uint32_t*)A;
+    uint32_t b = *(const uint32_t*)B;
+    return a < b ? -1 : a > b;
+}
+
+//
+// Move Batches batches of the pattern, after a warm-up, and report the rates and the steps
+//
+//
+static int
+RunPattern(
+    DMAPatternBenchT* Bench,
+    int Mode,
+    uint32_t BatchRequests,
+    uint32_t RequestBytes,
+    uint32_t ResponseBytes,
+    int Batches
+) {
+    struct ibv_qp* requestQPair = Bench->LaneIds[DMA_PATTERN_REQUEST_LANE < Bench->QueuePairs ? DMA_PATTERN_REQUEST_LANE : 0]->qp;
+    struct ibv_qp* responseQPair = Bench->LaneIds[DMA_PATTERN_RESPONSE_LANE < Bench->QueuePairs ? DMA_PATTERN_RESPONSE_LANE : 0]->qp;
+    uint32_t requestBatchBytes = BatchRequests * RequestBytes;
+    uint32_t responseBatchBytes = BatchRequests * ResponseBytes;
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+    enum ibv_wr_opcode tailOpcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+#else
+    enum ibv_wr_opcode tailOpcode = IBV_WR_RDMA_WRITE;
+#endif
+    uint32_t* samples[DMA_PATTERN_STEPS];
+    bool metaPosted = false;
+    uint64_t elapsedNs = 0;
+    int ret = 0;
+
+    if (requestBatchBytes > BACKEND_REQUEST_MAX_DMA_SIZE || requestBatchBytes >= Bench->RequestRing.Capacity ||
+        responseBatchBytes > BACKEND_RESPONSE_MAX_DMA_SIZE || responseBatchBytes >= Bench->ResponseRing.Capacity) {
+        fprintf(stdout, "%s: %u requests of %u bytes do not fit the rings, skipped\n",
+            DMA_PATTERN_MODE_NAMES[Mode], BatchRequests, RequestBytes);
+        return 0;
+    }
+
+    for (int s = 0; s != DMA_PATTERN_STEPS; s++) {
+        samples[s] = (uint32_t*)calloc(Batches, sizeof(uint32_t));
+        if (!samples[s]) {
+            fprintf(stderr, "%s [error]: OOM for samples\n", __func__);
+            while (s--) {
+                free(samples[s]);
+            }
+            return -1;
+        }
+    }
+
+    for (int b = -DMA_PATTERN_WARMUP_BATCHES; b != Batches && !ret; b++) {
+        uint64_t stepNs[DMA_PATTERN_STEPS] = { 0 };
+        uint64_t start = NowNs();
+        uint64_t t0 = start;
+        uint64_t t1;
+        int posted;
+
+        //
+        // The progress and the tail of the requests
+        //
+        //
+        if (Mode == DMA_PATTERN_MODE_AGENT || (Mode == DMA_PATTERN_MODE_PIPELINED && !metaPosted)) {
+            if (PostDMA(Bench, requestQPair, IBV_WR_RDMA_READ, (uint64_t)Bench->Msgs->RequestMeta, Bench->MsgsMr->lkey,
+                Bench->RequestRing.ReadMetaAddr, Bench->RequestRing.ReadMetaSize, 0) || WaitForDMA(Bench, 1)) {
+                ret = -1;
+                break;
+            }
+        }
+        t1 = NowNs();
+        stepNs[DMA_PATTERN_STEP_REQUEST_META] = t1 - t0;
+        t0 = t1;
+
+        //
+        // The requests from the head, then the new head, and the next meta data when pipelined
+        //
+        //
+        posted = PostRingDMA(Bench, requestQPair, IBV_WR_RDMA_READ, Bench->RequestData, Bench->RequestDataMr->lkey,
+            Bench->RequestRing.DataBaseAddr, Bench->RequestRing.Capacity, (uint32_t)Bench->RequestRing.Head, requestBatchBytes);
+        Bench->RequestRing.Head = (int)(((uint32_t)Bench->RequestRing.Head + requestBatchBytes) % Bench->RequestRing.Capacity);
+        Bench->Msgs->Head = Bench->RequestRing.Head;
+        if (posted > 0 && Mode != DMA_PATTERN_MODE_RAW) {
+            if (PostDMA(Bench, requestQPair, IBV_WR_RDMA_WRITE, (uint64_t)&Bench->Msgs->Head, Bench->MsgsMr->lkey,
+                Bench->RequestRing.WriteMetaAddr, Bench->RequestRing.WriteMetaSize, 0)) {
+                posted = -1;
+            }
+            else {
+                posted++;
+            }
+        }
+        if (posted > 0 && Mode == DMA_PATTERN_MODE_PIPELINED) {
+            if (PostDMA(Bench, requestQPair, IBV_WR_RDMA_READ, (uint64_t)Bench->Msgs->RequestMeta, Bench->MsgsMr->lkey,
+                Bench->RequestRing.ReadMetaAddr, Bench->RequestRing.ReadMetaSize, 0)) {
+                posted = -1;
+            }
+            else {
+                posted++;
+                metaPosted = true;
+            }
+        }
+        if (posted < 0 || WaitForDMA(Bench, posted)) {
+            ret = -1;
+            break;
+        }
+        t1 = NowNs();
+        stepNs[DMA_PATTERN_STEP_REQUEST_DATA] = t1 - t0;
+        t0 = t1;
+
+        //
+        // The progress and the head of the responses
+        //
+        //
+        if (Mode != DMA_PATTERN_MODE_RAW) {
+            if (PostDMA(Bench, responseQPair, IBV_WR_RDMA_READ, (uint64_t)Bench->Msgs->ResponseMeta, Bench->MsgsMr->lkey,
+                Bench->ResponseRing.ReadMetaAddr, Bench->ResponseRing.ReadMetaSize, 0) || WaitForDMA(Bench, 1)) {
+                ret = -1;
+                break;
+            }
+        }
+        t1 = NowNs();
+        stepNs[DMA_PATTERN_STEP_RESPONSE_META] = t1 - t0;
+        t0 = t1;
+
+        //
+        // The responses from the tail, then the new tail
+        //
+        //
+        posted = PostRingDMA(Bench, responseQPair, IBV_WR_RDMA_WRITE, Bench->ResponseData, Bench->ResponseDataMr->lkey,
+            Bench->ResponseRing.DataBaseAddr, Bench->ResponseRing.Capacity, (uint32_t)Bench->ResponseRing.TailC, responseBatchBytes);
+        Bench->ResponseRing.TailC = (int)(((uint32_t)Bench->ResponseRing.TailC + responseBatchBytes) % Bench->ResponseRing.Capacity);
+        Bench->Msgs->Tail = Bench->ResponseRing.TailC;
+        if (posted > 0 && Mode != DMA_PATTERN_MODE_RAW) {
+            if (PostDMA(Bench, responseQPair, tailOpcode, (uint64_t)&Bench->Msgs->Tail, Bench->MsgsMr->lkey,
+                Bench->ResponseRing.WriteMetaAddr, Bench->ResponseRing.WriteMetaSize, htonl((uint32_t)Bench->ResponseRing.TailC))) {
+                posted = -1;
+            }
+            else {
+                posted++;
+            }
+        }
+        if (posted < 0 || WaitForDMA(Bench, posted)) {
+            ret = -1;
+            break;
+        }
+        t1 = NowNs();
+        stepNs[DMA_PATTERN_STEP_RESPONSE_DATA] = t1 - t0;
+        stepNs[DMA_PATTERN_STEP_BATCH] = t1 - start;
+
+        if (b >= 0) {
+            for (int s = 0; s != DMA_PATTERN_STEPS; s++) {
+                samples[s][b] = (uint32_t)stepNs[s];
+            }
+            elapsedNs += stepNs[DMA_PATTERN_STEP_BATCH];
+        }
+    }
+
+    //
+    // A pipelined run leaves the read of the next meta data behind
+    //
+    //
+    if (!ret && metaPosted && WaitForDMA(Bench, 1)) {
+        ret = -1;
+    }
+
+    if (!ret) {
+        double seconds = (double)elapsedNs / 1e9;
+        fprintf(stdout, "%s: %u requests of %u bytes, responses of %u bytes: %.0f batches/s, %.0f requests/s, "
+            "%.1f MB/s in, %.1f MB/s out\n",
+            DMA_PATTERN_MODE_NAMES[Mode], BatchRequests, RequestBytes, ResponseBytes, Batches / seconds,
+            (double)Batches * BatchRequests / seconds, (double)Batches * requestBatchBytes / seconds / 1e6,
+            (double)Batches * responseBatchBytes / seconds / 1e6);
+        fprintf(stdout, "  %-14s %10s %10s %10s\n", "step", "mean us", "p50 us", "p99 us");
+        for (int s = 0; s != DMA_PATTERN_STEPS; s++) {
+            uint64_t totalNs = 0;
+            for (int b = 0; b != Batches; b++) {
+                totalNs += samples[s][b];
+            }
+            qsort(samples[s], Batches, sizeof(uint32_t), CompareSamples);
+            fprintf(stdout, "  %-14s %10.2f %10.2f %10.2f\n", DMA_PATTERN_STEP_NAMES[s], (double)totalNs / Batches / 1e3,
+                samples[s][Batches / 2] / 1e3, samples[s][(size_t)Batches * 99 / 100] / 1e3);
+        }
+    }
+
+    for (int s = 0; s != DMA_PATTERN_STEPS; s++) {
+        free(samples[s]);
+    }
+
+    return ret;
+}
+
+int
+main(
+    int Argc,
+    char** Argv
+) {
+    DMAPatternBenchT bench;
+    const char* listenAddress = "0.0.0.0";
+    int port = DDS_BACKEND_PORT;
+    int mode = DMA_PATTERN_MODE_AGENT;
+    int batchRequests = 0;
+    int requestBytes = 0;
+    int responseBytes = 0;
+    int batches = DMA_PATTERN_DEFAULT_BATCHES;
+    struct sockaddr_in sin;
+    int opt;
+    int ret = 0;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.QueuePairs = DMA_PATTERN_QUEUE_PAIRS;
+
+    while ((opt = getopt(Argc, Argv, "a:p:m:b:r:w:n:q:")) != -1) {
+        switch (opt) {
+            case 'a': listenAddress = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'm':
+                mode = 0;
+                while (mode != DMA_PATTERN_MODES && strcmp(optarg, DMA_PATTERN_MODE_NAMES[mode])) {
+                    mode++;
+                }
+                break;
+            case 'b': batchRequests = atoi(optarg); break;
+            case 'r': requestBytes = atoi(optarg); break;
+            case 'w': responseBytes = atoi(optarg); break;
+            case 'n': batches = atoi(optarg); break;
+            case 'q': bench.QueuePairs = atoi(optarg); break;
+            default:
+                mode = DMA_PATTERN_MODES;
+                break;
+        }
+    }
+
+    if (mode == DMA_PATTERN_MODES || batchRequests < 0 || requestBytes < 0 || responseBytes < 0 || batches <= 0 ||
+        bench.QueuePairs < 1 || bench.QueuePairs > BUFF_CONN_MAX_QUEUE_PAIRS) {
+        fprintf(stderr, "Usage: %s [-a ListenAddress] [-p Port] [-m agent|pipelined|raw] [-b BatchRequests] "
+            "[-r RequestBytes] [-w ResponseBytes] [-n Batches] [-q QueuePairs]\n", Argv[0]);
+        return -1;
+    }
+
+    //
+    // Listen as the back end does, and wait for the host to bind its buffer and connect its lanes
+    //
+    //
+    bench.CmChannel = rdma_create_event_channel();
+    if (!bench.CmChannel) {
+        fprintf(stderr, "rdma_create_event_channel error %d\n", errno);
+        return -1;
+    }
+
+    if (fcntl(bench.CmChannel->fd, F_SETFL, fcntl(bench.CmChannel->fd, F_GETFL, 0) | O_NONBLOCK) == -1 ||
+        rdma_create_id(bench.CmChannel, &bench.ListenId, &bench, RDMA_PS_TCP)) {
+        fprintf(stderr, "rdma_create_id error %d\n", errno);
+        ret = -1;
+        goto DestroyChannel;
+    }
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, listenAddress, &sin.sin_addr) != 1 ||
+        rdma_bind_addr(bench.ListenId, (struct sockaddr*)&sin) ||
+        rdma_listen(bench.ListenId, DMA_PATTERN_LISTEN_BACKLOG)) {
+        fprintf(stderr, "failed to listen on %s:%d (%d)\n", listenAddress, port, errno);
+        ret = -1;
+        goto DestroyId;
+    }
+    fprintf(stdout, "Listening on %s:%d\n", listenAddress, port);
+
+    while (!bench.BufferBound || bench.EstablishedLanes < bench.QueuePairs) {
+        if (ProcessCmEvents(&bench) || bench.Released) {
+            ret = -1;
+            goto DestroyConnections;
+        }
+
+        //
+        // Answer the messages of the connections so far
+        //
+        //
+        if (bench.CompQ) {
+            struct ibv_wc wc;
+            int n = ibv_poll_cq(bench.CompQ, 1, &wc);
+            if (n < 0 || (n == 1 && wc.status != IBV_WC_SUCCESS) ||
+                (n == 1 && (wc.opcode & IBV_WC_RECV) && HandleMessage(&bench, wc.wr_id))) {
+                fprintf(stderr, "failed to set up the buffer\n");
+                ret = -1;
+                goto DestroyConnections;
+            }
+        }
+    }
+    fprintf(stdout, "%d queue pair(s) connected\n", bench.QueuePairs);
+
+    //
+    // Run the configurations asked for, sweeping what is not
+    //
+    //
+    for (size_t b = 0; b != sizeof(DMA_PATTERN_BATCH_REQUESTS) / sizeof(int) && !ret; b++) {
+        for (size_t r = 0; r != sizeof(DMA_PATTERN_MESSAGE_BYTES) / sizeof(int) && !ret; r++) {
+            uint32_t runBatch = batchRequests ? (uint32_t)batchRequests : (uint32_t)DMA_PATTERN_BATCH_REQUESTS[b];
+            uint32_t runRequest = requestBytes ? (uint32_t)requestBytes : (uint32_t)DMA_PATTERN_MESSAGE_BYTES[r];
+            uint32_t runResponse = responseBytes ? (uint32_t)responseBytes : runRequest;
+
+            ret = RunPattern(&bench, mode, runBatch, runRequest, runResponse, batches);
+
+            if (requestBytes) {
+                break;
+            }
+        }
+
+        if (batchRequests) {
+            break;
+        }
+    }
+
+DestroyConnections:
+    for (int lane = 0; lane != BUFF_CONN_MAX_QUEUE_PAIRS; lane++) {
+        if (bench.LaneIds[lane]) {
+            rdma_disconnect(bench.LaneIds[lane]);
+            rdma_destroy_qp(bench.LaneIds[lane]);
+            rdma_destroy_id(bench.LaneIds[lane]);
+        }
+    }
+    if (bench.CtrlId) {
+        rdma_disconnect(bench.CtrlId);
+        rdma_destroy_qp(bench.CtrlId);
+        rdma_destroy_id(bench.CtrlId);
+    }
+    if (bench.ResponseDataMr) {
+        ibv_dereg_mr(bench.ResponseDataMr);
+    }
+    if (bench.RequestDataMr) {
+        ibv_dereg_mr(bench.RequestDataMr);
+    }
+    if (bench.MsgsMr) {
+        ibv_dereg_mr(bench.MsgsMr);
+    }
+    if (bench.CompQ) {
+        ibv_destroy_cq(bench.CompQ);
+    }
+    if (bench.PDomain) {
+        ibv_dealloc_pd(bench.PDomain);
+    }
+    free(bench.ResponseData);
+    free(bench.RequestData);
+    free(bench.Msgs);
+
+DestroyId:
+    rdma_destroy_id(bench.ListenId);
+
+DestroyChannel:
+    rdma_destroy_event_channel(bench.CmChannel);
+
+    return ret;
+}
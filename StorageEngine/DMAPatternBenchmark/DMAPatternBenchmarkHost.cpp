@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// The DMA pattern benchmark, host half: it connects to DMAPatternBenchmark on the DPU as a poll of the front end
+// connects to the back end, with DDSBackEndBridge and a DMABuffer of the rings, and leaves the buffer to the DPU,
+// which moves its rings as the DMA agent does; with DDS_NOTIFICATION_METHOD_INTERRUPT, it takes the notifications
+// of the tail writes as the front end does, so that the receives of the buffer are posted again.
+// It releases the buffer once Seconds have passed, which should be after the DPU is done
+//
+// Usage: DMAPatternBenchmarkHost [-a BackEndAddress] [-p Port] [-s Seconds]
+//                                [-r RequestRingBytes] [-w ResponseRingBytes]
+//
+//
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "DDSBackEndBridge.h"
+#include "DMABuffer.h"
+
+using namespace DDS_FrontEnd;
+
+#define DMA_PATTERN_HOST_DEFAULT_SECONDS 600
+#define DMA_PATTERN_HOST_WAIT_MS 1000
+
+int
+main(
+    int argc,
+    char** argv
+) {
+    const char* backEndAddr = DDS_BACKEND_ADDR;
+    unsigned short backEndPort = DDS_BACKEND_PORT;
+    int seconds = DMA_PATTERN_HOST_DEFAULT_SECONDS;
+    RingSizeT requestRingBytes = DDS_REQUEST_RING_BYTES;
+    RingSizeT responseRingBytes = DDS_RESPONSE_RING_BYTES;
+    bool valid = (argc - 1) % 2 == 0;
+
+    for (int i = 1; valid && i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-a")) {
+            backEndAddr = argv[i + 1];
+        }
+        else if (!strcmp(argv[i], "-p")) {
+            backEndPort = (unsigned short)strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-s")) {
+            seconds = atoi(argv[i + 1]);
+        }
+        else if (!strcmp(argv[i], "-r")) {
+            requestRingBytes = (RingSizeT)strtoul(argv[i + 1], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-w")) {
+            responseRingBytes = (RingSizeT)strtoul(argv[i + 1], nullptr, 10);
+        }
+        else {
+            valid = false;
+        }
+    }
+
+    if (!valid || seconds <= 0 || strlen(backEndAddr) >= sizeof(DDSBackEndBridge::BackEndAddr)) {
+        fprintf(stderr, "Usage: %s [-a BackEndAddress] [-p Port] [-s Seconds] [-r RequestRingBytes] [-w ResponseRingBytes]\n", argv[0]);
+        return -1;
+    }
+
+    //
+    // Negotiate the rings and set up the buffer as a poll does
+    //
+    //
+    DDSBackEndBridge bridge(requestRingBytes, responseRingBytes, DDS_RING_PROTOCOL_DEFAULT, DDS_MAX_OUTSTANDING_IO);
+    strcpy(bridge.BackEndAddr, backEndAddr);
+    bridge.BackEndPort = backEndPort;
+    if (bridge.Connect() != DDS_ERROR_CODE_SUCCESS) {
+        fprintf(stderr, "Failed to connect to %s:%u\n", backEndAddr, backEndPort);
+        return -1;
+    }
+
+    DMABuffer* buffer = new DMABuffer(
+        backEndAddr,
+        backEndPort,
+        (size_t)bridge.RequestRingBytes + bridge.ResponseRingBytes + DDS_RING_DMA_OVERHEAD_BYTES,
+        bridge.ClientId,
+        POLL_PRIORITY_NORMAL,
+        bridge.RequestRingBytes,
+        bridge.ResponseRingBytes,
+        bridge.RingProtocol,
+        bridge.PollQueueDepth
+    );
+    if (!buffer->Allocate(&bridge.LocalSock, &bridge.BackEndSock, bridge.QueueDepth, bridge.MaxSge, bridge.InlineThreshold)) {
+        fprintf(stderr, "Failed to allocate the DMA buffer\n");
+        delete buffer;
+        bridge.Disconnect();
+        return -1;
+    }
+    printf("Buffer of %u + %u bytes of rings is with the DPU for %d seconds\n",
+        bridge.RequestRingBytes, bridge.ResponseRingBytes, seconds);
+
+    //
+    // Take the notifications of the DPU until the time is up
+    //
+    //
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    uint64_t notifications = 0;
+    while (std::chrono::steady_clock::now() < end) {
+#if DDS_NOTIFICATION_METHOD == DDS_NOTIFICATION_METHOD_INTERRUPT
+        if (buffer->WaitForACompletionWithTimeout(DMA_PATTERN_HOST_WAIT_MS)) {
+            notifications++;
+        }
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(DMA_PATTERN_HOST_WAIT_MS));
+#endif
+    }
+    printf("Took %llu notifications\n", (unsigned long long)notifications);
+
+    buffer->Release();
+    delete buffer;
+    bridge.Disconnect();
+
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// Benchmark of the front end hot path against the loopback back end (DMA_BUFFER_LOOPBACK in DMABuffer.h):
+// every thread owns a poll and a file, keeps a queue depth of random reads and writes in flight through
+// the callbacks of ReadFile and WriteFile, and polls its completions; a thread of the loopback back end
+// per poll serves the rings in the format of the DPU after the simulated DMA latency
+//
+// Every combination of thread count and request size reports I/Os/s, bytes/s and, from the statistics
+// of the polls, the submit-to-callback latency, split into submit-to-ring, ring-to-response and
+// response-to-callback, so that changes of the rings, slot allocation and completion path can be measured
+// without RDMA hardware; the run is only as fast as the loopback thread of a poll, which shares the host
+//
+// Usage: FrontEndBenchmark [-p Threads,...] [-s RequestBytes,...] [-q QueueDepth] [-r ReadPercent]
+//                          [-t Seconds] [-l LatencyNs]
+//
+//
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "DDSFrontEnd.h"
+
+#ifndef DMA_BUFFER_LOOPBACK
+#error "The front end benchmark runs against the loopback back end"
+#endif
+
+using namespace DDS_FrontEnd;
+
+#define FRONT_END_BENCHMARK_DEFAULT_SECONDS 2
+#define FRONT_END_BENCHMARK_DEFAULT_QUEUE_DEPTH 32
+#define FRONT_END_BENCHMARK_DEFAULT_READ_PERCENT 50
+#define FRONT_END_BENCHMARK_MAX_CONFIGS 16
+#define FRONT_END_BENCHMARK_FILE_BYTES 1073741824ULL
+
+//
+// A thread of a run, with its poll, its file and the I/Os it has seen complete
+//
+//
+struct WorkerT {
+    PollIdT PollId;
+    FileIdT FileId;
+    char* Buffers;
+    uint64_t Random;
+    uint64_t Submitted;
+    uint64_t Completed;
+    uint64_t Failed;
+};
+
+//
+// Results of one run, merged from all threads
+//
+//
+struct RunResultT {
+    double Seconds;
+    uint64_t Completed;
+    uint64_t Failed;
+    IOStatisticsT Statistics;
+};
+
+static inline uint64_t
+NextRandom(
+    uint64_t* State
+) {
+    uint64_t x = *State;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *State = x;
+    return x;
+}
+
+static void
+OnIOComplete(
+    ErrorCodeT ErrorCode,
+    FileIOSizeT BytesServiced,
+    ContextT Context
+) {
+    WorkerT* worker = (WorkerT*)Context;
+
+    worker->Completed++;
+    if (ErrorCode != DDS_ERROR_CODE_SUCCESS) {
+        worker->Failed++;
+    }
+}
+
+//
+// The smallest latency below which a fraction of the recorded latencies fall
+//
+//
+static uint64_t
+Percentile(
+    const IOLatencyHistogramT* Histogram,
+    double Fraction
+) {
+    uint64_t target = (uint64_t)((double)Histogram->Count * Fraction);
+    uint64_t seen = 0;
+
+    for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+        seen += Histogram->Buckets[b];
+        if (seen > target) {
+            return LatencyBucketLowerBoundNs(b);
+        }
+    }
+
+    return Histogram->MaxNs;
+}
+
+static void
+MergeHistogram(
+    IOLatencyHistogramT* Merged,
+    const IOLatencyHistogramT* Histogram
+) {
+    Merged->Count += Histogram->Count;
+    Merged->TotalNs += Histogram->TotalNs;
+    if (Histogram->MaxNs > Merged->MaxNs) {
+        Merged->MaxNs = Histogram->MaxNs;
+    }
+    for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+        Merged->Buckets[b] += Histogram->Buckets[b];
+    }
+}
+
+static inline double
+MeanNs(
+    const IOLatencyHistogramT* Histogram
+) {
+    return Histogram->Count ? (double)Histogram->TotalNs / Histogram->Count : 0.0;
+}
+
+//
+// Keep QueueDepth I/Os of a thread in flight until Stop, then wait for all of them
+//
+//
+static void
+RunWorker(
+    DDSFrontEnd* FrontEnd,
+    WorkerT* Worker,
+    FileIOSizeT RequestBytes,
+    size_t QueueDepth,
+    size_t ReadPercent,
+    std::atomic<bool>* Start,
+    std::atomic<bool>* Stop
+) {
+    uint64_t numBlocks = FRONT_END_BENCHMARK_FILE_BYTES / RequestBytes;
+    FileIOSizeT bytesServiced;
+    ContextT fileContext;
+    ContextT ioContext;
+    bool pollResult;
+
+    while (!Start->load(std::memory_order_acquire)) { }
+
+    while (!Stop->load(std::memory_order_relaxed)) {
+        while (Worker->Submitted - Worker->Completed < QueueDepth) {
+            //
+            // The data is not checked, so a buffer is simply the one of the slot in submission order
+            //
+            //
+            char* buffer = Worker->Buffers + (Worker->Submitted % QueueDepth) * RequestBytes;
+            FileSizeT offset = (FileSizeT)(NextRandom(&Worker->Random) % numBlocks) * RequestBytes;
+            ErrorCodeT result;
+
+            if (NextRandom(&Worker->Random) % 100 < ReadPercent) {
+                result = FrontEnd->ReadFile(Worker->FileId, buffer, offset, RequestBytes, &bytesServiced, OnIOComplete, Worker);
+            }
+            else {
+                result = FrontEnd->WriteFile(Worker->FileId, buffer, offset, RequestBytes, &bytesServiced, OnIOComplete, Worker);
+            }
+
+            if (result != DDS_ERROR_CODE_IO_PENDING) {
+                break;
+            }
+            Worker->Submitted++;
+        }
+
+        FrontEnd->PollWait(Worker->PollId, &bytesServiced, &fileContext, &ioContext, 0, &pollResult);
+    }
+
+    while (Worker->Completed != Worker->Submitted) {
+        FrontEnd->PollWait(Worker->PollId, &bytesServiced, &fileContext, &ioContext, INFINITE, &pollResult);
+    }
+}
+
+//
+// Run threads on a fresh front end for a number of seconds
+//
+//
+static bool
+RunFrontEnd(
+    size_t NumThreads,
+    FileIOSizeT RequestBytes,
+    size_t QueueDepth,
+    size_t ReadPercent,
+    size_t Seconds,
+    RunResultT* Result
+) {
+    DDSFrontEnd* frontEnd = new DDSFrontEnd("FrontEndBenchmark", BACKEND_TYPE_DPU);
+    std::vector<WorkerT> workers(NumThreads);
+    std::vector<std::thread> threads;
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    DirIdT dirId;
+
+    //
+    // Polls as deep as the deepest a thread keeps in flight
+    //
+    //
+    uint32_t pollQueueDepth = DDS_MAX_OUTSTANDING_IO;
+    while (pollQueueDepth < QueueDepth) {
+        pollQueueDepth *= 2;
+    }
+
+    bool ready = frontEnd->SetPollQueueDepth(pollQueueDepth) == DDS_ERROR_CODE_SUCCESS &&
+        frontEnd->Initialize() == DDS_ERROR_CODE_SUCCESS &&
+        frontEnd->CreateDirectory("/bench", &dirId) == DDS_ERROR_CODE_SUCCESS;
+
+    for (size_t t = 0; ready && t != NumThreads; t++) {
+        WorkerT* worker = &workers[t];
+        char fileName[DDS_MAX_FILE_PATH];
+        snprintf(fileName, sizeof(fileName), "/bench/file%zu", t);
+
+        memset(worker, 0, sizeof(WorkerT));
+        worker->Random = 0x9E3779B97F4A7C15ULL * (t + 1);
+        worker->Buffers = (char*)calloc(QueueDepth, RequestBytes);
+        ready = worker->Buffers &&
+            frontEnd->CreateFile(fileName, 0, 0, 0, &worker->FileId) == DDS_ERROR_CODE_SUCCESS &&
+            frontEnd->ChangeFileSize(worker->FileId, FRONT_END_BENCHMARK_FILE_BYTES) == DDS_ERROR_CODE_SUCCESS &&
+            frontEnd->PollCreate(&worker->PollId) == DDS_ERROR_CODE_SUCCESS &&
+            frontEnd->PollAdd(worker->FileId, worker->PollId, worker) == DDS_ERROR_CODE_SUCCESS;
+    }
+
+    if (ready) {
+        for (size_t t = 0; t != NumThreads; t++) {
+            threads.emplace_back(RunWorker, frontEnd, &workers[t], RequestBytes, QueueDepth, ReadPercent, &start, &stop);
+        }
+
+        auto beginTime = std::chrono::steady_clock::now();
+        start.store(true, std::memory_order_release);
+        std::this_thread::sleep_for(std::chrono::seconds(Seconds));
+        stop.store(true, std::memory_order_relaxed);
+
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        auto endTime = std::chrono::steady_clock::now();
+
+        memset(Result, 0, sizeof(RunResultT));
+        Result->Seconds = std::chrono::duration<double>(endTime - beginTime).count();
+
+        IOStatisticsT* statistics = new IOStatisticsT;
+        for (size_t t = 0; t != NumThreads; t++) {
+            Result->Completed += workers[t].Completed;
+            Result->Failed += workers[t].Failed;
+            if (frontEnd->GetIOStatistics(workers[t].PollId, statistics) == DDS_ERROR_CODE_SUCCESS) {
+                MergeHistogram(&Result->Statistics.SubmitToRing, &statistics->SubmitToRing);
+                MergeHistogram(&Result->Statistics.RingToResponse, &statistics->RingToResponse);
+                MergeHistogram(&Result->Statistics.ResponseToCallback, &statistics->ResponseToCallback);
+                MergeHistogram(&Result->Statistics.SubmitToCallback, &statistics->SubmitToCallback);
+            }
+        }
+        delete statistics;
+    }
+
+    for (size_t t = 0; t != NumThreads; t++) {
+        free(workers[t].Buffers);
+    }
+    delete frontEnd;
+
+    return ready;
+}
+
+//
+// Parse a comma-separated list of positive numbers
+//
+//
+template <typename T>
+static size_t
+ParseList(
+    const char* Arg,
+    T* Values,
+    size_t MaxValues
+) {
+    size_t numValues = 0;
+
+    while (*Arg && numValues != MaxValues) {
+        char* end;
+        unsigned long long value = strtoull(Arg, &end, 10);
+        if (end == Arg || value == 0) {
+            return 0;
+        }
+        Values[numValues++] = (T)value;
+        Arg = *end == ',' ? end + 1 : end;
+    }
+
+    return numValues;
+}
+
+int
+main(
+    int argc,
+    char** argv
+) {
+    size_t threads[FRONT_END_BENCHMARK_MAX_CONFIGS] = { 1, 2, 4 };
+    size_t numThreadCounts = 3;
+    FileIOSizeT sizes[FRONT_END_BENCHMARK_MAX_CONFIGS] = { 512, 4096, 65536 };
+    size_t numSizes = 3;
+    size_t queueDepth = FRONT_END_BENCHMARK_DEFAULT_QUEUE_DEPTH;
+    size_t readPercent = FRONT_END_BENCHMARK_DEFAULT_READ_PERCENT;
+    size_t seconds = FRONT_END_BENCHMARK_DEFAULT_SECONDS;
+    uint64_t latencyNs = DMA_BUFFER_LOOPBACK_LATENCY_NS;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-p")) {
+            numThreadCounts = ParseList(argv[i + 1], threads, FRONT_END_BENCHMARK_MAX_CONFIGS);
+        }
+        else if (!strcmp(argv[i], "-s")) {
+            numSizes = ParseList(argv[i + 1], sizes, FRONT_END_BENCHMARK_MAX_CONFIGS);
+        }
+        else if (!strcmp(argv[i], "-q")) {
+            queueDepth = (size_t)strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-r")) {
+            readPercent = (size_t)strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-t")) {
+            seconds = (size_t)strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-l")) {
+            latencyNs = strtoull(argv[i + 1], nullptr, 10);
+        }
+        else {
+            numSizes = 0;
+        }
+    }
+
+    //
+    // The default poll takes one of the polls
+    //
+    //
+    bool valid = (argc - 1) % 2 == 0 && numThreadCounts && numSizes && seconds && readPercent <= 100 &&
+        queueDepth && queueDepth <= DDS_MAX_POLL_QUEUE_DEPTH;
+    for (size_t p = 0; valid && p != numThreadCounts; p++) {
+        valid = threads[p] < DDS_MAX_POLLS;
+    }
+    for (size_t s = 0; valid && s != numSizes; s++) {
+        valid = sizes[s] <= FRONT_END_BENCHMARK_FILE_BYTES;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "Usage: %s [-p Threads,...] [-s RequestBytes,...] [-q QueueDepth] [-r ReadPercent] [-t Seconds] [-l LatencyNs]\n", argv[0]);
+        fprintf(stderr, "Threads are fewer than %d and QueueDepth is at most %d\n", DDS_MAX_POLLS, DDS_MAX_POLL_QUEUE_DEPTH);
+        return -1;
+    }
+
+    DMABuffer::SetLoopbackLatency(latencyNs);
+    printf("Loopback latency: %llu ns, queue depth %zu per thread, %zu%% reads, %zu seconds per run\n",
+        (unsigned long long)latencyNs, queueDepth, readPercent, seconds);
+
+    RunResultT* result = (RunResultT*)malloc(sizeof(RunResultT));
+    if (!result) {
+        fprintf(stderr, "Failed to allocate results\n");
+        return -1;
+    }
+
+    for (size_t s = 0; s != numSizes; s++) {
+        for (size_t p = 0; p != numThreadCounts; p++) {
+            if (!RunFrontEnd(threads[p], sizes[s], queueDepth, readPercent, seconds, result)) {
+                fprintf(stderr, "threads=%zu bytes=%u: failed to set up the front end\n", threads[p], sizes[s]);
+                free(result);
+                return -1;
+            }
+
+            const IOStatisticsT* statistics = &result->Statistics;
+            printf(
+                "threads=%-3zu bytes=%-8u %12.0f IO/s %10.1f MB/s   submit-to-callback ns: mean %-7.0f p50 %-7llu p99 %-7llu p99.9 %-8llu   mean submit %.0f ring %.0f callback %.0f   failed %llu\n",
+                threads[p],
+                sizes[s],
+                (double)result->Completed / result->Seconds,
+                (double)result->Completed * sizes[s] / result->Seconds / 1e6,
+                MeanNs(&statistics->SubmitToCallback),
+                (unsigned long long)Percentile(&statistics->SubmitToCallback, 0.5),
+                (unsigned long long)Percentile(&statistics->SubmitToCallback, 0.99),
+                (unsigned long long)Percentile(&statistics->SubmitToCallback, 0.999),
+                MeanNs(&statistics->SubmitToRing),
+                MeanNs(&statistics->RingToResponse),
+                MeanNs(&statistics->ResponseToCallback),
+                (unsigned long long)result->Failed
+            );
+            fflush(stdout);
+        }
+    }
+
+    free(result);
+
+    return 0;
+}
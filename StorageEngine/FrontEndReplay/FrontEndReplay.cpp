@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// Replay of a trace captured by DDSFrontEnd::StartCapture (DDSCapture.h) against a back end: the files of the trace
+// are created as large as the trace reaches into them, and the requests are issued open loop by one thread,
+// each at its time in the trace divided by the speedup, whether or not the earlier ones have completed;
+// a request the poll has no room for is retried at once and counts as throttled, and the lag of the issue
+// behind the trace is reported with the throughput and the submit-to-callback latency of the poll.
+// The data is not checked, so all requests share one buffer
+//
+// Usage: FrontEndReplay Trace [-b dpu|memory] [-x Speedup] [-q QueueDepth]
+//
+//
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "DDSCapture.h"
+#include "DDSFrontEnd.h"
+
+using namespace DDS_FrontEnd;
+
+#define FRONT_END_REPLAY_MAX_FILES 65536
+
+//
+// What the replay has seen complete, and how far it fell behind the trace
+//
+//
+struct ReplayT {
+    uint64_t Submitted;
+    uint64_t Completed;
+    uint64_t Failed;
+    uint64_t Throttled;
+    uint64_t Bytes;
+    uint64_t Ops[DDS_CAPTURE_OPS];
+    uint64_t TotalLagNs;
+    uint64_t MaxLagNs;
+};
+
+static void
+OnIOComplete(
+    ErrorCodeT ErrorCode,
+    FileIOSizeT BytesServiced,
+    ContextT Context
+) {
+    ReplayT* replay = (ReplayT*)Context;
+
+    replay->Completed++;
+    if (ErrorCode != DDS_ERROR_CODE_SUCCESS) {
+        replay->Failed++;
+    }
+}
+
+//
+// The smallest latency below which a fraction of the recorded latencies fall
+//
+//
+static uint64_t
+Percentile(
+    const IOLatencyHistogramT* Histogram,
+    double Fraction
+) {
+    uint64_t target = (uint64_t)((double)Histogram->Count * Fraction);
+    uint64_t seen = 0;
+
+    for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+        seen += Histogram->Buckets[b];
+        if (seen > target) {
+            return LatencyBucketLowerBoundNs(b);
+        }
+    }
+
+    return Histogram->MaxNs;
+}
+
+//
+// Read the records of a trace, in time order
+//
+//
+static bool
+LoadTrace(
+    const char* Path,
+    std::vector<DDSCaptureRecordT>* Records
+) {
+    DDSCaptureHeaderT header;
+    DDSCaptureRecordT record;
+    FILE* trace = fopen(Path, "rb");
+
+    if (!trace) {
+        fprintf(stderr, "Failed to open %s\n", Path);
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, trace) != 1 || !DDSCaptureHeaderValid(&header)) {
+        fprintf(stderr, "%s is not a trace of this version\n", Path);
+        fclose(trace);
+        return false;
+    }
+
+    while (fread(&record, sizeof(record), 1, trace) == 1) {
+        if (record.Op < DDS_CAPTURE_OPS) {
+            Records->push_back(record);
+        }
+    }
+    fclose(trace);
+
+    //
+    // Each thread wrote its records in order, a buffer at a time
+    //
+    //
+    std::stable_sort(Records->begin(), Records->end(), [](const DDSCaptureRecordT& A, const DDSCaptureRecordT& B) {
+        return A.TimeNs < B.TimeNs;
+    });
+
+    return true;
+}
+
+//
+// Create the files of the trace, each as large as the furthest byte the trace reads or writes,
+// all in one poll; FileIds maps the files of the trace to those of the replay
+//
+//
+static bool
+CreateFiles(
+    DDSFrontEnd* FrontEnd,
+    const std::vector<DDSCaptureRecordT>& Records,
+    ReplayT* Replay,
+    std::vector<FileIdT>* FileIds,
+    PollIdT* PollId
+) {
+    std::vector<FileSizeT> fileBytes(FRONT_END_REPLAY_MAX_FILES, 0);
+    std::vector<bool> used(FRONT_END_REPLAY_MAX_FILES, false);
+    DirIdT dirId;
+
+    for (const DDSCaptureRecordT& record : Records) {
+        used[record.FileId] = true;
+        fileBytes[record.FileId] = std::max(fileBytes[record.FileId], (FileSizeT)(record.Offset + record.Bytes));
+    }
+
+    if (FrontEnd->CreateDirectory("/replay", &dirId) != DDS_ERROR_CODE_SUCCESS ||
+        FrontEnd->PollCreate(PollId) != DDS_ERROR_CODE_SUCCESS) {
+        return false;
+    }
+
+    for (size_t f = 0; f != FRONT_END_REPLAY_MAX_FILES; f++) {
+        if (!used[f]) {
+            continue;
+        }
+
+        char fileName[DDS_MAX_FILE_PATH];
+        snprintf(fileName, sizeof(fileName), "/replay/file%zu", f);
+        if (FrontEnd->CreateFile(fileName, 0, 0, 0, &(*FileIds)[f]) != DDS_ERROR_CODE_SUCCESS ||
+            FrontEnd->ChangeFileSize((*FileIds)[f], fileBytes[f]) != DDS_ERROR_CODE_SUCCESS ||
+            FrontEnd->PollAdd((*FileIds)[f], *PollId, Replay) != DDS_ERROR_CODE_SUCCESS) {
+            fprintf(stderr, "Failed to create the file %zu of %llu bytes\n", f, (unsigned long long)fileBytes[f]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// Issue the requests of the trace at their times, and wait for all of them
+//
+//
+static void
+RunReplay(
+    DDSFrontEnd* FrontEnd,
+    const std::vector<DDSCaptureRecordT>& Records,
+    const std::vector<FileIdT>& FileIds,
+    PollIdT PollId,
+    char* Buffer,
+    double Speedup,
+    ReplayT* Replay
+) {
+    FileIOSizeT bytesServiced;
+    ContextT fileContext;
+    ContextT ioContext;
+    bool pollResult;
+    auto beginTime = std::chrono::steady_clock::now();
+
+    for (const DDSCaptureRecordT& record : Records) {
+        auto dueTime = beginTime + std::chrono::nanoseconds((uint64_t)((double)record.TimeNs / Speedup));
+
+        //
+        // Reap completions until the request is due
+        //
+        //
+        while (std::chrono::steady_clock::now() < dueTime) {
+            FrontEnd->PollWait(PollId, &bytesServiced, &fileContext, &ioContext, 0, &pollResult);
+        }
+
+        uint64_t lagNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - dueTime).count();
+        Replay->TotalLagNs += lagNs;
+        Replay->MaxLagNs = std::max(Replay->MaxLagNs, lagNs);
+        Replay->Ops[record.Op]++;
+
+        FileIdT fileId = FileIds[record.FileId];
+        if (record.Op == DDS_CAPTURE_OP_FLUSH) {
+            if (FrontEnd->FlushFileBuffers(fileId) != DDS_ERROR_CODE_SUCCESS) {
+                Replay->Failed++;
+            }
+            continue;
+        }
+
+        for (;;) {
+            ErrorCodeT result;
+
+            if (record.Op == DDS_CAPTURE_OP_READ) {
+                result = FrontEnd->ReadFile(fileId, Buffer, record.Offset, record.Bytes, &bytesServiced, OnIOComplete, Replay);
+            }
+            else {
+                result = FrontEnd->WriteFile(fileId, Buffer, record.Offset, record.Bytes, &bytesServiced, OnIOComplete, Replay);
+            }
+
+            if (result == DDS_ERROR_CODE_IO_PENDING) {
+                Replay->Submitted++;
+                Replay->Bytes += record.Bytes;
+                break;
+            }
+            if (result != DDS_ERROR_CODE_TOO_MANY_REQUESTS) {
+                //
+                // Served at once, e.g. by the cache of the file, or failed
+                //
+                //
+                if (result != DDS_ERROR_CODE_SUCCESS) {
+                    Replay->Failed++;
+                }
+                else {
+                    Replay->Bytes += record.Bytes;
+                }
+                break;
+            }
+
+            Replay->Throttled++;
+        }
+    }
+
+    while (Replay->Completed != Replay->Submitted) {
+        FrontEnd->PollWait(PollId, &bytesServiced, &fileContext, &ioContext, INFINITE, &pollResult);
+    }
+}
+
+int
+main(
+    int argc,
+    char** argv
+) {
+    BackEndTypeT backEndType = BACKEND_TYPE_DPU;
+    double speedup = 1.0;
+    uint32_t queueDepth = DDS_MAX_POLL_QUEUE_DEPTH;
+    bool valid = argc >= 2 && (argc - 2) % 2 == 0;
+
+    for (int i = 2; valid && i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-b")) {
+            if (!strcmp(argv[i + 1], "dpu")) {
+                backEndType = BACKEND_TYPE_DPU;
+            }
+            else if (!strcmp(argv[i + 1], "memory")) {
+                backEndType = BACKEND_TYPE_LOCAL_MEMORY;
+            }
+            else {
+                valid = false;
+            }
+        }
+        else if (!strcmp(argv[i], "-x")) {
+            speedup = strtod(argv[i + 1], nullptr);
+        }
+        else if (!strcmp(argv[i], "-q")) {
+            queueDepth = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+        }
+        else {
+            valid = false;
+        }
+    }
+
+    if (!valid || speedup <= 0 || queueDepth == 0 || queueDepth > DDS_MAX_POLL_QUEUE_DEPTH) {
+        fprintf(stderr, "Usage: %s Trace [-b dpu|memory] [-x Speedup] [-q QueueDepth]\n", argv[0]);
+        fprintf(stderr, "QueueDepth is at most %d\n", DDS_MAX_POLL_QUEUE_DEPTH);
+        return -1;
+    }
+
+    std::vector<DDSCaptureRecordT> records;
+    if (!LoadTrace(argv[1], &records)) {
+        return -1;
+    }
+    if (records.empty()) {
+        printf("The trace has no requests\n");
+        return 0;
+    }
+
+    FileIOSizeT maxBytes = 1;
+    for (const DDSCaptureRecordT& record : records) {
+        maxBytes = std::max(maxBytes, (FileIOSizeT)record.Bytes);
+    }
+
+    DDSFrontEnd* frontEnd = new DDSFrontEnd("FrontEndReplay", backEndType);
+    std::vector<FileIdT> fileIds(FRONT_END_REPLAY_MAX_FILES, 0);
+    ReplayT* replay = (ReplayT*)calloc(1, sizeof(ReplayT));
+    char* buffer = (char*)calloc(1, maxBytes);
+    PollIdT pollId;
+
+    bool ready = replay && buffer &&
+        frontEnd->SetPollQueueDepth(queueDepth) == DDS_ERROR_CODE_SUCCESS &&
+        frontEnd->Initialize() == DDS_ERROR_CODE_SUCCESS &&
+        CreateFiles(frontEnd, records, replay, &fileIds, &pollId);
+
+    if (!ready) {
+        fprintf(stderr, "Failed to set up the front end\n");
+        free(buffer);
+        free(replay);
+        delete frontEnd;
+        return -1;
+    }
+
+    printf("Replaying %zu requests over %.3f s at %.2fx, queue depth %u\n",
+        records.size(), (double)records.back().TimeNs / 1e9, speedup, queueDepth);
+
+    auto beginTime = std::chrono::steady_clock::now();
+    RunReplay(frontEnd, records, fileIds, pollId, buffer, speedup, replay);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - beginTime).count();
+
+    IOStatisticsT* statistics = new IOStatisticsT;
+    if (frontEnd->GetIOStatistics(pollId, statistics) != DDS_ERROR_CODE_SUCCESS) {
+        memset(statistics, 0, sizeof(IOStatisticsT));
+    }
+    const IOLatencyHistogramT* latency = &statistics->SubmitToCallback;
+
+    printf(
+        "%.3f s: %llu reads %llu writes %llu flushes, %12.0f IO/s %10.1f MB/s   failed %llu throttled %llu   "
+        "lag behind the trace ns: mean %.0f max %llu   submit-to-callback ns: mean %.0f p50 %llu p99 %llu p99.9 %llu\n",
+        seconds,
+        (unsigned long long)replay->Ops[DDS_CAPTURE_OP_READ],
+        (unsigned long long)replay->Ops[DDS_CAPTURE_OP_WRITE],
+        (unsigned long long)replay->Ops[DDS_CAPTURE_OP_FLUSH],
+        (double)records.size() / seconds,
+        (double)replay->Bytes / seconds / 1e6,
+        (unsigned long long)replay->Failed,
+        (unsigned long long)replay->Throttled,
+        (double)replay->TotalLagNs / records.size(),
+        (unsigned long long)replay->MaxLagNs,
+        latency->Count ? (double)latency->TotalNs / latency->Count : 0.0,
+        (unsigned long long)Percentile(latency, 0.5),
+        (unsigned long long)Percentile(latency, 0.99),
+        (unsigned long long)Percentile(latency, 0.999)
+    );
+
+    delete statistics;
+    free(buffer);
+    free(replay);
+    delete frontEnd;
+
+    return 0;
+}
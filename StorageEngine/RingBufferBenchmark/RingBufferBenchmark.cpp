@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) Microsoft Corporation.
+ * Licensed under the MIT License
+ */
+
+//
+// Microbenchmark of the host request ring variants:
+// producer threads insert requests of a fixed size while one consumer thread drains the ring
+// the way the back end does; every combination of variant, producer count and request size
+// reports requests/s, bytes/s and percentiles of the insertion latency
+//
+// Usage: RingBufferBenchmark [-p Producers,...] [-s RequestBytes,...] [-t Seconds] [-r RingBytes]
+//
+// A variant is an adapter with the ring type, its allocation, insertion of a group of requests,
+// and the fetch/parse pair the consumer uses; only the variants whose insertion and fetch
+// are implemented under Common/Source/Host can be driven
+//
+// The consumer thread stands in for the DPU: it writes the head and reads the progress and tail
+// the way the back end does, so sampling the cross-core traffic of a run, e.g., with perf c2c or
+// the memory access analysis of VTune, shows whether producers and consumer contend on the meta data lines
+//
+//
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "DDSIOStatistics.h"
+#include "MsgTypes.h"
+#include "RingBufferProgressive.h"
+
+using namespace DDS_FrontEnd;
+
+#define RING_BENCHMARK_DEFAULT_SECONDS 2
+#define RING_BENCHMARK_MAX_CONFIGS 16
+#define RING_BENCHMARK_BATCH_REQUESTS 8
+
+//
+// Progressive ring, one insertion per request
+//
+//
+struct ProgressiveVariant {
+    typedef RequestRingBufferProgressive RingT;
+    static const int RequestsPerInsertion = 1;
+
+    static const char*
+    Name() {
+        return "Progressive";
+    }
+
+    static RingT*
+    Allocate(
+        BufferT Buffer,
+        RingSizeT RingBytes
+    ) {
+        return AllocateRequestBufferProgressive(Buffer, RingBytes);
+    }
+
+    static bool
+    Insert(
+        RingT* Ring,
+        BufferT Payload,
+        FileIOSizeT RequestBytes
+    ) {
+        return InsertToRequestBufferProgressive(Ring, Payload, RequestBytes);
+    }
+
+    static bool
+    Fetch(
+        RingT* Ring,
+        BufferT CopyTo,
+        FileIOSizeT* Bytes
+    ) {
+        return FetchFromRequestBufferProgressive(Ring, CopyTo, Bytes);
+    }
+
+    static bool
+    Flush(
+        RingT* Ring
+    ) {
+        return true;
+    }
+};
+
+//
+// Progressive ring, a batch of write requests per insertion,
+// as ReadFileBatch and WriteFileBatch insert them
+//
+//
+struct ProgressiveBatchVariant : public ProgressiveVariant {
+    static const int RequestsPerInsertion = RING_BENCHMARK_BATCH_REQUESTS;
+
+    static const char*
+    Name() {
+        return "ProgressiveBatch";
+    }
+
+    static bool
+    Insert(
+        RingT* Ring,
+        BufferT Payload,
+        FileIOSizeT RequestBytes
+    ) {
+        RequestBatchEntryT requests[RING_BENCHMARK_BATCH_REQUESTS];
+
+        for (int i = 0; i != RING_BENCHMARK_BATCH_REQUESTS; i++) {
+            requests[i].IsRead = false;
+            requests[i].RequestId = (RequestIdT)i;
+            requests[i].FileId = 0;
+            requests[i].Offset = 0;
+            requests[i].Bytes = RequestBytes;
+            requests[i].SourceBuffer = Payload;
+        }
+
+        return InsertRequestBatch(Ring, requests, RING_BENCHMARK_BATCH_REQUESTS);
+    }
+};
+
+//
+// Progressive ring, write requests staged per producer thread
+// and published once RING_BUFFER_REQUEST_STAGING_FLUSH_BYTES are staged
+//
+//
+static thread_local RequestStagingT ProducerStaging;
+
+struct ProgressiveStagedVariant : public ProgressiveVariant {
+    static const char*
+    Name() {
+        return "ProgressiveStaged";
+    }
+
+    static bool
+    Insert(
+        RingT* Ring,
+        BufferT Payload,
+        FileIOSizeT RequestBytes
+    ) {
+        return StageWriteFileRequest(Ring, &ProducerStaging, 0, 0, 0, RequestBytes, Payload);
+    }
+
+    static bool
+    Flush(
+        RingT* Ring
+    ) {
+        return FlushStagedRequests(Ring, &ProducerStaging);
+    }
+};
+
+//
+// Results of one run, merged from all producers
+//
+//
+struct RunResultT {
+    double Seconds;
+    uint64_t Requests;
+    uint64_t Insertions;
+    uint64_t FullRetries;
+    IOLatencyHistogramT InsertLatency;
+};
+
+//
+// The smallest latency below which a fraction of the recorded latencies fall
+//
+//
+static uint64_t
+Percentile(
+    const IOLatencyHistogramT* Histogram,
+    double Fraction
+) {
+    uint64_t target = (uint64_t)((double)Histogram->Count * Fraction);
+    uint64_t seen = 0;
+
+    for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+        seen += Histogram->Buckets[b];
+        if (seen > target) {
+            return LatencyBucketLowerBoundNs(b);
+        }
+    }
+
+    return Histogram->MaxNs;
+}
+
+//
+// Run producers against one consumer on a fresh ring for a number of seconds
+//
+//
+template <typename VariantT>
+static bool
+RunRing(
+    size_t NumProducers,
+    FileIOSizeT RequestBytes,
+    RingSizeT RingBytes,
+    size_t Seconds,
+    RunResultT* Result
+) {
+    size_t ringAllocationBytes = offsetof(typename VariantT::RingT, Buffer) + RingBytes + DDS_RING_ALIGNMENT;
+    char* ringMemory = (char*)calloc(1, ringAllocationBytes);
+    char* copyTo = (char*)malloc(RingBytes);
+    char* payload = (char*)calloc(1, RequestBytes);
+    if (!ringMemory || !copyTo || !payload) {
+        free(ringMemory);
+        free(copyTo);
+        free(payload);
+        return false;
+    }
+
+    typename VariantT::RingT* ring = VariantT::Allocate(ringMemory, RingBytes);
+    std::atomic<bool> start(false);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> producersDone(0);
+    std::vector<LatencyHistogram*> latencies(NumProducers);
+    std::vector<uint64_t> insertions(NumProducers, 0);
+    std::vector<uint64_t> fullRetries(NumProducers, 0);
+    std::vector<std::thread> producers;
+    uint64_t requestsConsumed = 0;
+    double nsPerTick = IOClockNsPerTick();
+
+    for (size_t p = 0; p != NumProducers; p++) {
+        latencies[p] = new LatencyHistogram();
+    }
+
+    for (size_t p = 0; p != NumProducers; p++) {
+        producers.emplace_back([&, p]() {
+            while (!start.load(std::memory_order_acquire)) { }
+
+            //
+            // An insertion takes until the ring accepts it, including retries while the ring is full
+            //
+            //
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t beginTicks = ReadIOClock();
+                while (!VariantT::Insert(ring, payload, RequestBytes)) {
+                    fullRetries[p]++;
+                    if (stop.load(std::memory_order_relaxed)) {
+                        producersDone++;
+                        return;
+                    }
+                }
+                latencies[p]->Record((uint64_t)((double)(ReadIOClock() - beginTicks) * nsPerTick));
+                insertions[p]++;
+            }
+
+            //
+            // Publish whatever is still staged while the consumer drains the ring
+            //
+            //
+            while (!VariantT::Flush(ring)) { }
+
+            producersDone++;
+        });
+    }
+
+    std::thread consumer([&]() {
+        while (!start.load(std::memory_order_acquire)) { }
+
+        for (;;) {
+            bool done = producersDone.load(std::memory_order_acquire) == NumProducers;
+            FileIOSizeT bytes = 0;
+
+            if (!VariantT::Fetch(ring, copyTo, &bytes)) {
+                if (done && CheckForRequestCompletionProgressive(ring)) {
+                    break;
+                }
+                continue;
+            }
+
+            //
+            // Walk the fetched requests as the back end parses them
+            //
+            //
+            BufferT next = copyTo;
+            FileIOSizeT remaining = bytes;
+            while (next && remaining) {
+                BufferT request;
+                FileIOSizeT requestSize;
+                ParseNextRequestProgressive(next, remaining, &request, &requestSize, &next, &remaining);
+                requestsConsumed++;
+            }
+        }
+    });
+
+    auto beginTime = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::seconds(Seconds));
+    stop.store(true, std::memory_order_relaxed);
+
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    consumer.join();
+    auto endTime = std::chrono::steady_clock::now();
+
+    memset(Result, 0, sizeof(RunResultT));
+    Result->Seconds = std::chrono::duration<double>(endTime - beginTime).count();
+    Result->Requests = requestsConsumed;
+
+    for (size_t p = 0; p != NumProducers; p++) {
+        IOLatencyHistogramT histogram;
+        latencies[p]->Read(&histogram);
+        Result->InsertLatency.Count += histogram.Count;
+        Result->InsertLatency.TotalNs += histogram.TotalNs;
+        if (histogram.MaxNs > Result->InsertLatency.MaxNs) {
+            Result->InsertLatency.MaxNs = histogram.MaxNs;
+        }
+        for (size_t b = 0; b != DDS_LATENCY_HISTOGRAM_BUCKETS; b++) {
+            Result->InsertLatency.Buckets[b] += histogram.Buckets[b];
+        }
+        Result->Insertions += insertions[p];
+        Result->FullRetries += fullRetries[p];
+        delete latencies[p];
+    }
+
+    free(ringMemory);
+    free(copyTo);
+    free(payload);
+
+    return true;
+}
+
+//
+// Run and report every producer count and request size of a variant
+//
+//
+template <typename VariantT>
+static void
+BenchmarkVariant(
+    const size_t* Producers,
+    size_t NumProducerCounts,
+    const FileIOSizeT* Sizes,
+    size_t NumSizes,
+    RingSizeT RingBytes,
+    size_t Seconds
+) {
+    RunResultT* result = (RunResultT*)malloc(sizeof(RunResultT));
+    if (!result) {
+        fprintf(stderr, "Failed to allocate results\n");
+        return;
+    }
+
+    for (size_t s = 0; s != NumSizes; s++) {
+        //
+        // A group of requests must fit in one tail advancement
+        //
+        //
+        if ((size_t)(Sizes[s] + sizeof(BuffMsgF2BReqHeader) + 2 * sizeof(FileIOSizeT)) * VariantT::RequestsPerInsertion >= RingBytes) {
+            fprintf(stderr, "%s: %u-byte requests do not fit into a %u-byte ring\n", VariantT::Name(), Sizes[s], RingBytes);
+            continue;
+        }
+
+        for (size_t p = 0; p != NumProducerCounts; p++) {
+            if (!RunRing<VariantT>(Producers[p], Sizes[s], RingBytes, Seconds, result)) {
+                fprintf(stderr, "%s: failed to allocate a %u-byte ring\n", VariantT::Name(), RingBytes);
+                free(result);
+                return;
+            }
+
+            uint64_t attempts = result->Insertions + result->FullRetries;
+            printf(
+                "%-18s producers=%-3zu bytes=%-8u %12.0f req/s %10.1f MB/s   insert ns: p50 %-7llu p99 %-7llu p99.9 %-8llu max %-9llu full %.1f%%\n",
+                VariantT::Name(),
+                Producers[p],
+                Sizes[s],
+                (double)result->Requests / result->Seconds,
+                (double)result->Requests * Sizes[s] / result->Seconds / 1e6,
+                (unsigned long long)Percentile(&result->InsertLatency, 0.5),
+                (unsigned long long)Percentile(&result->InsertLatency, 0.99),
+                (unsigned long long)Percentile(&result->InsertLatency, 0.999),
+                (unsigned long long)result->InsertLatency.MaxNs,
+                attempts ? 100.0 * result->FullRetries / attempts : 0.0
+            );
+            fflush(stdout);
+        }
+    }
+
+    free(result);
+}
+
+//
+// Parse a comma-separated list of positive numbers
+//
+//
+template <typename T>
+static size_t
+ParseList(
+    const char* Arg,
+    T* Values,
+    size_t MaxValues
+) {
+    size_t numValues = 0;
+
+    while (*Arg && numValues != MaxValues) {
+        char* end;
+        unsigned long long value = strtoull(Arg, &end, 10);
+        if (end == Arg || value == 0) {
+            return 0;
+        }
+        Values[numValues++] = (T)value;
+        Arg = *end == ',' ? end + 1 : end;
+    }
+
+    return numValues;
+}
+
+int
+main(
+    int argc,
+    char** argv
+) {
+    size_t producers[RING_BENCHMARK_MAX_CONFIGS] = { 1, 2, 4, 8 };
+    size_t numProducerCounts = 4;
+    FileIOSizeT sizes[RING_BENCHMARK_MAX_CONFIGS] = { 64, 512, 4096, 65536 };
+    size_t numSizes = 4;
+    size_t seconds = RING_BENCHMARK_DEFAULT_SECONDS;
+    RingSizeT ringBytes = DDS_REQUEST_RING_BYTES;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-p")) {
+            numProducerCounts = ParseList(argv[i + 1], producers, RING_BENCHMARK_MAX_CONFIGS);
+        }
+        else if (!strcmp(argv[i], "-s")) {
+            numSizes = ParseList(argv[i + 1], sizes, RING_BENCHMARK_MAX_CONFIGS);
+        }
+        else if (!strcmp(argv[i], "-t")) {
+            seconds = (size_t)strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-r")) {
+            ringBytes = (RingSizeT)strtoull(argv[i + 1], nullptr, 10);
+        }
+        else {
+            numSizes = 0;
+        }
+    }
+
+    if ((argc - 1) % 2 || !numProducerCounts || !numSizes || !seconds ||
+        !DDS_RING_BYTES_VALID(ringBytes, DDS_REQUEST_RING_BYTES, DDS_REQUEST_RING_BYTES_ALIGNMENT)) {
+        fprintf(stderr, "Usage: %s [-p Producers,...] [-s RequestBytes,...] [-t Seconds] [-r RingBytes]\n", argv[0]);
+        fprintf(stderr, "RingBytes is a multiple of %d from %d to %d\n", DDS_REQUEST_RING_BYTES_ALIGNMENT, DDS_RING_MIN_BYTES, DDS_REQUEST_RING_BYTES);
+        return -1;
+    }
+
+    printf("Ring: %u bytes, %zu seconds per run, %.3f ns per clock tick\n", ringBytes, seconds, IOClockNsPerTick());
+
+    BenchmarkVariant<ProgressiveVariant>(producers, numProducerCounts, sizes, numSizes, ringBytes, seconds);
+    BenchmarkVariant<ProgressiveBatchVariant>(producers, numProducerCounts, sizes, numSizes, ringBytes, seconds);
+    BenchmarkVariant<ProgressiveStagedVariant>(producers, numProducerCounts, sizes, numSizes, ringBytes, seconds);
+
+    return 0;
+}